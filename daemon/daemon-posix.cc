@@ -3,12 +3,20 @@
 // or any future license endorsed by Mnemosyne LLC.
 // License text can be found in the licenses/ folder.
 
+#include <algorithm>
+#include <array>
 #include <cassert>
 #include <cerrno>
 #include <csignal>
+#include <cstring> /* memcpy() */
+#include <string>
 #include <string_view>
 
 #include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h> /* chmod() */
+#include <sys/time.h> /* timeval */
+#include <sys/un.h>
 #include <unistd.h> /* fork(), setsid(), chdir(), dup2(), close(), pipe() */
 
 #ifdef HAVE_SYS_SIGNALFD_H
@@ -19,7 +27,10 @@
 
 #include <fmt/core.h>
 
+#include <libtransmission/transmission.h>
+
 #include <libtransmission/error.h>
+#include <libtransmission/log.h>
 #include <libtransmission/utils.h>
 
 #include "daemon.h"
@@ -193,3 +204,241 @@ bool tr_daemon::spawn(bool foreground, int* exit_code, tr_error** error)
 
     return true;
 }
+
+// --- Handing off to a new daemon
+
+namespace
+{
+// IPv4 and IPv6, plus room to spare
+auto constexpr MaxHandoffSockets = size_t{ 4U };
+
+// how long the new daemon waits for the old one to save its state and exit
+auto constexpr HandoffTimeoutSecs = 120;
+
+[[nodiscard]] bool make_handoff_address(std::string const& path, sockaddr_un& setme)
+{
+    if (std::size(path) >= sizeof(setme.sun_path))
+    {
+        tr_logAddError(fmt::format(_("Handoff socket path '{path}' is too long"), fmt::arg("path", path)));
+        return false;
+    }
+
+    setme = {};
+    setme.sun_family = AF_UNIX;
+    tr_strlcpy(setme.sun_path, path.c_str(), sizeof(setme.sun_path));
+    return true;
+}
+
+[[nodiscard]] bool is_same_user([[maybe_unused]] int fd)
+{
+#ifdef SO_PEERCRED
+    auto cred = ucred{};
+    auto len = socklen_t{ sizeof(cred) };
+    return getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) == 0 && cred.uid == geteuid();
+#else
+    // the socket file is only accessible to this user
+    return true;
+#endif
+}
+
+void on_handoff_connection(evutil_socket_t /*fd*/, short /*what*/, void* vdaemon)
+{
+    static_cast<tr_daemon*>(vdaemon)->handoff_accept();
+}
+} // namespace
+
+// If an older daemon with the same config dir is listening for a handoff,
+// take its peer sockets and wait for it to save its state and exit.
+void tr_daemon::handoff_receive()
+{
+    auto addr = sockaddr_un{};
+    if (!make_handoff_address(handoff_path(), addr))
+    {
+        return;
+    }
+
+    auto const fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1)
+    {
+        return;
+    }
+
+    if (connect(fd, reinterpret_cast<sockaddr const*>(&addr), sizeof(addr)) != 0)
+    {
+        // nothing to take over from
+        close(fd);
+        return;
+    }
+
+    tr_logAddInfo(_("Taking over from the running transmission-daemon"));
+
+    auto const timeout = timeval{ HandoffTimeoutSecs, 0 };
+    (void)setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    auto byte = char{};
+    auto iov = iovec{ &byte, 1U };
+    auto control = std::array<char, CMSG_SPACE(sizeof(int) * MaxHandoffSockets)>{};
+    auto msg = msghdr{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = std::data(control);
+    msg.msg_controllen = std::size(control);
+
+#ifdef MSG_CMSG_CLOEXEC
+    auto constexpr Flags = MSG_CMSG_CLOEXEC;
+#else
+    auto constexpr Flags = 0;
+#endif
+
+    if (recvmsg(fd, &msg, Flags) == 1)
+    {
+        for (auto* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg))
+        {
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+            {
+                auto sockets = std::array<int, MaxHandoffSockets>{};
+                auto const n = std::min((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int), std::size(sockets));
+                std::memcpy(std::data(sockets), CMSG_DATA(cmsg), n * sizeof(int));
+                tr_sessionAddInheritedPeerSockets(std::data(sockets), n);
+            }
+        }
+    }
+
+    // the old daemon closes the connection when it's done
+    auto n_read = ssize_t{};
+    while ((n_read = read(fd, &byte, 1)) > 0)
+    {
+    }
+
+    if (n_read < 0)
+    {
+        tr_logAddWarn(_("The old transmission-daemon is taking too long to exit; starting anyway"));
+    }
+
+    close(fd);
+}
+
+void tr_daemon::handoff_listen()
+{
+    auto const path = handoff_path();
+    auto addr = sockaddr_un{};
+    if (!make_handoff_address(path, addr))
+    {
+        return;
+    }
+
+    // left behind by a daemon that didn't exit cleanly
+    (void)unlink(path.c_str());
+
+    auto const fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1 || bind(fd, reinterpret_cast<sockaddr const*>(&addr), sizeof(addr)) != 0 || chmod(path.c_str(), 0600) != 0 ||
+        listen(fd, 1) != 0 || evutil_make_socket_nonblocking(fd) != 0)
+    {
+        auto const error_code = errno;
+        tr_logAddError(fmt::format(
+            _("Couldn't listen for handoffs on '{path}': {error} ({error_code})"),
+            fmt::arg("path", path),
+            fmt::arg("error", tr_strerror(error_code)),
+            fmt::arg("error_code", error_code)));
+
+        if (fd != -1)
+        {
+            close(fd);
+        }
+
+        return;
+    }
+
+    handoff_listener_ = fd;
+    handoff_ev_ = event_new(ev_base_, fd, EV_READ | EV_PERSIST, on_handoff_connection, this);
+    event_add(handoff_ev_, nullptr);
+}
+
+void tr_daemon::handoff_accept()
+{
+    auto const fd = accept(handoff_listener_, nullptr, nullptr);
+    if (fd == -1 || is_handing_off())
+    {
+        if (fd != -1)
+        {
+            close(fd);
+        }
+
+        return;
+    }
+
+    if (!is_same_user(fd))
+    {
+        tr_logAddWarn(_("Refusing a handoff to a transmission-daemon run by another user"));
+        close(fd);
+        return;
+    }
+
+    auto sockets = std::array<int, MaxHandoffSockets>{};
+    auto const n = tr_sessionGetPeerSockets(my_session_, std::data(sockets), std::size(sockets));
+
+    auto byte = char{ 1 };
+    auto iov = iovec{ &byte, 1U };
+    auto control = std::array<char, CMSG_SPACE(sizeof(int) * MaxHandoffSockets)>{};
+    auto msg = msghdr{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+
+    if (n > 0U)
+    {
+        msg.msg_control = std::data(control);
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * n);
+        auto* const cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * n);
+        std::memcpy(CMSG_DATA(cmsg), std::data(sockets), sizeof(int) * n);
+    }
+
+    auto const sent = sendmsg(fd, &msg, 0) == 1;
+
+    // the new daemon has its own copies now
+    for (size_t i = 0; i < n; ++i)
+    {
+        close(sockets[i]);
+    }
+
+    if (!sent)
+    {
+        close(fd);
+        return;
+    }
+
+    tr_logAddInfo(_("Handing off to a new transmission-daemon"));
+    handoff_peer_ = fd;
+    stop();
+}
+
+void tr_daemon::handoff_stop_listening()
+{
+    if (handoff_ev_ != nullptr)
+    {
+        event_del(handoff_ev_);
+        event_free(handoff_ev_);
+        handoff_ev_ = nullptr;
+    }
+
+    if (handoff_listener_ != -1)
+    {
+        close(handoff_listener_);
+        handoff_listener_ = -1;
+
+        // before handoff_finish(), so that this can't remove the new daemon's socket
+        (void)unlink(handoff_path().c_str());
+    }
+}
+
+// Let the new daemon start, now that this one has saved its state.
+void tr_daemon::handoff_finish()
+{
+    if (handoff_peer_ != -1)
+    {
+        close(handoff_peer_);
+        handoff_peer_ = -1;
+    }
+}
@@ -209,6 +209,27 @@ void tr_daemon::cleanup_signals([[maybe_unused]] struct event* sig_ev) const
 {
 }
 
+void tr_daemon::handoff_receive()
+{
+    tr_logAddError(_("Handoffs are unsupported on Windows"));
+}
+
+void tr_daemon::handoff_listen()
+{
+}
+
+void tr_daemon::handoff_accept()
+{
+}
+
+void tr_daemon::handoff_stop_listening()
+{
+}
+
+void tr_daemon::handoff_finish()
+{
+}
+
 bool tr_daemon::spawn(bool foreground, int* exit_code, tr_error** error)
 {
     daemon = this;
@@ -40,6 +40,7 @@
 #include <libtransmission/variant.h>
 #include <libtransmission/version.h>
 #include <libtransmission/watchdir.h>
+#include <libtransmission/watchdir-ingest.h>
 
 #include "daemon.h"
 
@@ -61,6 +62,7 @@ struct tr_torrent;
 
 using namespace std::literals;
 using libtransmission::Watchdir;
+using libtransmission::WatchdirIngest;
 
 static char constexpr MyName[] = "transmission-daemon";
 static char constexpr Usage[] = "Transmission " LONG_VERSION_STRING
@@ -94,7 +96,7 @@ static char constexpr SpeedTStr[] = "TB/s";
 ****  Config File
 ***/
 
-static auto constexpr Options = std::array<tr_option, 45>{
+static auto constexpr Options = std::array<tr_option, 46>{
     { { 'a', "allowed", "Allowed IP addresses. (Default: " TR_DEFAULT_RPC_WHITELIST ")", "a", true, "<list>" },
       { 'b', "blocklist", "Enable peer blocklists", "b", false, nullptr },
       { 'B', "no-blocklist", "Disable peer blocklists", "B", false, nullptr },
@@ -103,6 +105,12 @@ static auto constexpr Options = std::array<tr_option, 45>{
       { 941, "incomplete-dir", "Where to store new torrents until they're complete", nullptr, true, "<directory>" },
       { 942, "no-incomplete-dir", "Don't store incomplete torrents in a different location", nullptr, false, nullptr },
       { 'd', "dump-settings", "Dump the settings and exit", "d", false, nullptr },
+      { 944,
+        "handoff",
+        "Take over the peer sockets of a running daemon with the same config dir, and hand them to the next one",
+        nullptr,
+        false,
+        nullptr },
       { 943, "default-trackers", "Trackers for public torrents to use automatically", nullptr, true, "<list>" },
       { 'e', "logfile", "Dump the log messages to this filename", "e", true, "<filename>" },
       { 'f', "foreground", "Run in the foreground instead of daemonizing", "f", false, nullptr },
@@ -209,59 +217,12 @@ static std::string getConfigDir(int argc, char const* const* argv)
     return tr_getDefaultConfigDir(MyName);
 }
 
-static auto onFileAdded(tr_session const* session, std::string_view dirname, std::string_view basename)
+static auto onFileParsed(tr_session const* session, WatchdirIngest::Item& item)
 {
-    auto const lowercase = tr_strlower(basename);
-    auto const is_torrent = tr_strv_ends_with(lowercase, ".torrent"sv);
-    auto const is_magnet = tr_strv_ends_with(lowercase, ".magnet"sv);
-
-    if (!is_torrent && !is_magnet)
-    {
-        return Watchdir::Action::Done;
-    }
-
-    auto const filename = tr_pathbuf{ dirname, '/', basename };
+    auto const filename = tr_pathbuf{ item.dirname, '/', item.basename };
+    auto const& basename = item.basename;
     tr_ctor* const ctor = tr_ctorNew(session);
-
-    bool retry = false;
-
-    if (is_torrent)
-    {
-        if (!tr_ctorSetMetainfoFromFile(ctor, filename, nullptr))
-        {
-            retry = true;
-        }
-    }
-    else // is_magnet
-    {
-        auto content = std::vector<char>{};
-        tr_error* error = nullptr;
-        if (!tr_file_read(filename, content, &error))
-        {
-            tr_logAddWarn(fmt::format(
-                _("Couldn't read '{path}': {error} ({error_code})"),
-                fmt::arg("path", basename),
-                fmt::arg("error", error->message),
-                fmt::arg("error_code", error->code)));
-            tr_error_free(error);
-            retry = true;
-        }
-        else
-        {
-            content.push_back('\0'); // zero-terminated string
-            auto const* data = std::data(content);
-            if (!tr_ctorSetMetainfoFromMagnetLink(ctor, data, nullptr))
-            {
-                retry = true;
-            }
-        }
-    }
-
-    if (retry)
-    {
-        tr_ctorFree(ctor);
-        return Watchdir::Action::Retry;
-    }
+    item.move_to(ctor);
 
     if (tr_torrentNew(ctor, nullptr) == nullptr)
     {
@@ -489,6 +450,10 @@ bool tr_daemon::parse_args(int argc, char const* const* argv, bool* dump_setting
             *dump_settings = true;
             break;
 
+        case 944:
+            handoff_ = true;
+            break;
+
         case 'e':
             if (reopen_log_file(optstr))
             {
@@ -694,6 +659,11 @@ void tr_daemon::stop(void)
     event_base_loopexit(ev_base_, nullptr);
 }
 
+std::string tr_daemon::handoff_path() const
+{
+    return fmt::format(FMT_STRING("{:s}/handoff.sock"), config_dir_);
+}
+
 int tr_daemon::start([[maybe_unused]] bool foreground)
 {
     bool boolVal;
@@ -702,6 +672,7 @@ int tr_daemon::start([[maybe_unused]] bool foreground)
     struct event* status_ev = nullptr;
     struct event* sig_ev = nullptr;
     auto watchdir = std::unique_ptr<Watchdir>{};
+    auto watchdir_ingest = std::unique_ptr<WatchdirIngest>{};
     char const* const cdir = this->config_dir_.c_str();
 
     sd_notifyf(0, "MAINPID=%d\n", (int)getpid());
@@ -721,6 +692,13 @@ int tr_daemon::start([[maybe_unused]] bool foreground)
         return 1;
     }
 
+    /* take over from the daemon that this one is replacing */
+    if (handoff_)
+    {
+        sd_notify(0, "STATUS=Waiting for the old transmission-daemon to exit...\n");
+        handoff_receive();
+    }
+
     /* start the session */
     tr_formatter_mem_init(MemK, MemKStr, MemMStr, MemGStr, MemTStr);
     tr_formatter_size_init(DiskK, DiskKStr, DiskMStr, DiskGStr, DiskTStr);
@@ -786,17 +764,28 @@ int tr_daemon::start([[maybe_unused]] bool foreground)
         {
             tr_logAddInfo(fmt::format(_("Watching '{path}' for new torrent files"), fmt::arg("path", dir)));
 
-            auto handler = [session](std::string_view dirname, std::string_view basename)
+            // new files are parsed in worker threads, then added here in batches
+            auto timer_maker = libtransmission::EvTimerMaker{ ev_base_ };
+            watchdir_ingest = std::make_unique<WatchdirIngest>(
+                timer_maker,
+                [session](WatchdirIngest::Item& item) { return onFileParsed(session, item); },
+                [&watchdir](std::string_view basename, Watchdir::Action action) { watchdir->finish(basename, action); });
+
+            auto handler = [&watchdir_ingest](std::string_view dirname, std::string_view basename)
             {
-                return onFileAdded(session, dirname, basename);
+                return watchdir_ingest->enqueue(dirname, basename);
             };
 
-            auto timer_maker = libtransmission::EvTimerMaker{ ev_base_ };
             watchdir = force_generic ? Watchdir::create_generic(dir, handler, timer_maker) :
                                        Watchdir::create(dir, handler, timer_maker, ev_base_);
         }
     }
 
+    if (handoff_)
+    {
+        handoff_listen();
+    }
+
     /* load the torrents */
     {
         tr_ctor* ctor = tr_ctorNew(my_session_);
@@ -859,9 +848,18 @@ int tr_daemon::start([[maybe_unused]] bool foreground)
     }
 
 CLEANUP:
-    sd_notify(0, "STATUS=Closing transmission session...\n");
+    if (is_handing_off())
+    {
+        sd_notify(0, "STATUS=Handing off to the new transmission-daemon...\n");
+    }
+    else
+    {
+        sd_notify(0, "STATUS=Closing transmission session...\n");
+    }
+
     printf("Closing transmission session...");
 
+    watchdir_ingest.reset();
     watchdir.reset();
 
     if (status_ev != nullptr)
@@ -871,11 +869,15 @@ CLEANUP:
     }
 
     cleanup_signals(sig_ev);
+    handoff_stop_listening();
 
     event_base_free(ev_base_);
 
     tr_sessionSaveSettings(my_session_, cdir, &settings_);
-    tr_sessionClose(my_session_);
+
+    // The new daemon announces as soon as it starts,
+    // so don't wait to tell the trackers that this one stopped.
+    tr_sessionClose(my_session_, is_handing_off() ? 0U : 15U);
     pumpLogMessages(logfile_, logfile_flush_);
     printf(" done.\n");
 
@@ -898,6 +900,9 @@ CLEANUP:
 
     sd_notify(0, "STATUS=\n");
 
+    // last, so that the new daemon doesn't start until everything's saved
+    handoff_finish();
+
     return 0;
 }
 
@@ -42,12 +42,24 @@ public:
     void reconfigure();
     void stop();
 
+    // --handoff: hand the peer sockets to a new daemon that's replacing this one
+    void handoff_accept();
+
+    [[nodiscard]] constexpr bool is_handing_off() const noexcept
+    {
+        return handoff_peer_ != -1;
+    }
+
 private:
 #ifdef HAVE_SYS_SIGNALFD_H
     int sigfd_ = -1;
 #endif /* signalfd API */
     bool paused_ = false;
     bool seen_hup_ = false;
+    bool handoff_ = false;
+    int handoff_listener_ = -1;
+    int handoff_peer_ = -1; // the new daemon that's taking over
+    struct event* handoff_ev_ = nullptr;
     std::string config_dir_;
     tr_variant settings_ = {};
     bool logfile_flush_ = false;
@@ -62,5 +74,10 @@ private:
     bool reopen_log_file(char const* filename);
     bool setup_signals(struct event*& sig_ev);
     void cleanup_signals(struct event* sig_ev) const;
+    [[nodiscard]] std::string handoff_path() const;
+    void handoff_receive();
+    void handoff_listen();
+    void handoff_stop_listening();
+    void handoff_finish();
     void report_status();
 };
@@ -20,7 +20,6 @@
 #include <glibmm/main.h>
 #include <glibmm/markup.h>
 #include <glibmm/miscutils.h>
-#include <glibmm/nodetree.h>
 #include <gtkmm/cellrendererpixbuf.h>
 #include <gtkmm/cellrendererprogress.h>
 #include <gtkmm/cellrenderertext.h>
@@ -35,11 +34,14 @@
 #include <fmt/core.h>
 
 #include <algorithm>
+#include <array>
 #include <cstddef>
+#include <cstdint> // uint64_t
+#include <limits>
 #include <list>
 #include <memory>
+#include <optional>
 #include <queue>
-#include <stack>
 #include <string>
 #include <string_view>
 #include <unordered_map>
@@ -74,6 +76,7 @@ public:
         add(have);
         add(priority);
         add(enabled);
+        add(node);
     }
 
     Gtk::TreeModelColumn<Glib::RefPtr<Gio::Icon>> icon;
@@ -87,10 +90,36 @@ public:
     Gtk::TreeModelColumn<uint64_t> have;
     Gtk::TreeModelColumn<int> priority;
     Gtk::TreeModelColumn<int> enabled;
+    Gtk::TreeModelColumn<unsigned int> node;
 };
 
 FileModelColumns const file_cols;
 
+// Sorting a Gtk::TreeStore as each row is added or changed is quadratic,
+// so leave it unsorted while making a batch of changes and sort it once after.
+class SortSuspender
+{
+public:
+    explicit SortSuspender(Glib::RefPtr<Gtk::TreeStore> store)
+        : store_{ std::move(store) }
+    {
+        store_->get_sort_column_id(sort_column_id_, order_);
+        store_->set_sort_column(GTK_TREE_SORTABLE_UNSORTED_SORT_COLUMN_ID, TR_GTK_SORT_TYPE(ASCENDING));
+    }
+
+    ~SortSuspender()
+    {
+        store_->set_sort_column(sort_column_id_, order_);
+    }
+
+    TR_DISABLE_COPY_MOVE(SortSuspender)
+
+private:
+    Glib::RefPtr<Gtk::TreeStore> const store_;
+    int sort_column_id_ = {};
+    Gtk::SortType order_ = TR_GTK_SORT_TYPE(ASCENDING);
+};
+
 } // namespace
 
 class FileList::Impl
@@ -110,9 +139,68 @@ public:
     void reset_torrent();
 
 private:
+    static auto constexpr NoNode = std::numeric_limits<unsigned int>::max();
+    static auto constexpr MaxChangesWhileSorted = size_t{ 16U };
+
+    // What the files in a folder add up to. These are kept current as
+    // files change, so refreshing doesn't walk the tree.
+    struct Totals
+    {
+        uint64_t size_wanted = {};
+        uint64_t have_wanted = {};
+        int n_wanted = {};
+        int n_unwanted = {};
+        std::array<int, 3> n_priority = {}; // indexed by priority - TR_PRI_LOW
+
+        Totals& operator+=(Totals const& that) noexcept;
+        Totals& operator-=(Totals const& that) noexcept;
+    };
+
+    // The whole tree is kept here, but a folder's rows aren't added
+    // to the store until the folder is first expanded.
+    struct Node
+    {
+        std::string name;
+        int file_index = -1; // -1 for folders
+        unsigned int parent = NoNode;
+        std::vector<unsigned int> children;
+        Totals totals;
+        Gtk::TreeStore::iterator row; // unset until the row is added
+        bool has_child_rows = false;
+        bool is_changed = false;
+    };
+
+    // the tr_file_view values last shown for each file
+    struct FileState
+    {
+        uint64_t length = {};
+        uint64_t have = {};
+        int progress = {};
+        tr_priority_t priority = {};
+        bool wanted = {};
+        unsigned int node = NoNode;
+    };
+
+    struct RowValues
+    {
+        uint64_t size = {};
+        uint64_t have = {};
+        int progress = {};
+        int priority = {};
+        int enabled = {};
+    };
+
     void clearData();
     void refresh();
 
+    [[nodiscard]] static Totals totalsOf(FileState const& file);
+    void buildNodes(tr_torrent const* tor);
+    [[nodiscard]] RowValues rowValues(Node const& node) const;
+    void addRow(unsigned int node_id, Gtk::TreeNodeChildren const& siblings);
+    void updateRow(Node const& node);
+    void collectFiles(unsigned int node_id, std::vector<tr_file_index_t>& setme) const;
+    bool onTestExpandRow(Gtk::TreeModel::iterator const& iter, Gtk::TreeModel::Path const& path);
+
     bool getAndSelectEventPath(double view_x, double view_y, Gtk::TreeViewColumn*& col, Gtk::TreeModel::Path& path);
 
     [[nodiscard]] std::vector<tr_file_index_t> getActiveFilesForPath(Gtk::TreeModel::Path const& path) const;
@@ -133,6 +221,8 @@ private:
     // GtkWidget* top_ = nullptr; // == widget_
     Gtk::TreeView* view_ = nullptr;
     Glib::RefPtr<Gtk::TreeStore> store_;
+    std::vector<Node> nodes_; // nodes_.front() is the root
+    std::vector<FileState> files_;
     tr_torrent_id_t torrent_id_ = {};
     sigc::connection timeout_tag_;
     std::queue<sigc::connection> rename_done_tags_;
@@ -141,6 +231,8 @@ private:
 void FileList::Impl::clearData()
 {
     torrent_id_ = -1;
+    nodes_.clear();
+    files_.clear();
 
     timeout_tag_.disconnect();
 }
@@ -160,268 +252,297 @@ FileList::Impl::~Impl()
 ****
 ***/
 
-namespace
+FileList::Impl::Totals& FileList::Impl::Totals::operator+=(Totals const& that) noexcept
 {
+    size_wanted += that.size_wanted;
+    have_wanted += that.have_wanted;
+    n_wanted += that.n_wanted;
+    n_unwanted += that.n_unwanted;
+    for (size_t i = 0; i < std::size(n_priority); ++i)
+    {
+        n_priority[i] += that.n_priority[i];
+    }
 
-struct RefreshData
-{
-    int sort_column_id;
-    bool resort_needed;
-    tr_torrent* tor;
-};
+    return *this;
+}
 
-bool refreshFilesForeach(
-    Glib::RefPtr<Gtk::TreeStore> const& store,
-    Gtk::TreeModel::iterator const& iter,
-    RefreshData& refresh_data)
+FileList::Impl::Totals& FileList::Impl::Totals::operator-=(Totals const& that) noexcept
 {
-    bool const is_file = iter->children().empty();
+    size_wanted -= that.size_wanted;
+    have_wanted -= that.have_wanted;
+    n_wanted -= that.n_wanted;
+    n_unwanted -= that.n_unwanted;
+    for (size_t i = 0; i < std::size(n_priority); ++i)
+    {
+        n_priority[i] -= that.n_priority[i];
+    }
 
-    auto const old_enabled = iter->get_value(file_cols.enabled);
-    auto const old_have = iter->get_value(file_cols.have);
-    auto const old_priority = iter->get_value(file_cols.priority);
-    auto const old_progress = iter->get_value(file_cols.prog);
-    auto const old_size = iter->get_value(file_cols.size);
+    return *this;
+}
 
-    auto new_enabled = int{};
-    auto new_have = decltype(old_have){};
-    auto new_priority = int{};
-    auto new_progress = int{};
-    auto new_size = decltype(old_size){};
+FileList::Impl::Totals FileList::Impl::totalsOf(FileState const& file)
+{
+    auto totals = Totals{};
+    totals.n_priority[std::clamp(int{ file.priority }, int{ TR_PRI_LOW }, int{ TR_PRI_HIGH }) - TR_PRI_LOW] = 1;
 
-    if (is_file)
+    if (file.wanted)
     {
-        auto const index = iter->get_value(file_cols.index);
-        auto const file = tr_torrentFile(refresh_data.tor, index);
-
-        new_enabled = static_cast<int>(file.wanted);
-        new_priority = int{ file.priority };
-        new_have = file.have;
-        new_size = file.length;
-        new_progress = static_cast<int>(100 * file.progress);
+        totals.size_wanted = file.length;
+        totals.have_wanted = file.have;
+        totals.n_wanted = 1;
     }
     else
     {
-        new_enabled = NOT_SET;
-        new_priority = NOT_SET;
-
-        /* since gtk_tree_model_foreach() is depth-first, we can
-         * get the `sub' info by walking the immediate children */
+        totals.n_unwanted = 1;
+    }
 
-        for (auto const& child : iter->children())
-        {
-            auto const child_size = child[file_cols.size];
-            auto const child_have = child[file_cols.have];
-            auto const child_priority = child[file_cols.priority];
-            auto const child_enabled = child[file_cols.enabled];
+    return totals;
+}
 
-            if (child_enabled != static_cast<int>(false) && (child_enabled != NOT_SET))
-            {
-                new_size += child_size;
-                new_have += child_have;
-            }
+FileList::Impl::RowValues FileList::Impl::rowValues(Node const& node) const
+{
+    auto values = RowValues{};
 
-            if (new_enabled == NOT_SET)
-            {
-                new_enabled = child_enabled;
-            }
-            else if (new_enabled != child_enabled)
-            {
-                new_enabled = MIXED;
-            }
+    if (node.file_index >= 0)
+    {
+        auto const& file = files_[node.file_index];
+        values.size = file.length;
+        values.have = file.have;
+        values.progress = file.progress;
+        values.priority = file.priority;
+        values.enabled = static_cast<int>(file.wanted);
+        return values;
+    }
 
-            if (new_priority == NOT_SET)
-            {
-                new_priority = child_priority;
-            }
-            else if (new_priority != child_priority)
-            {
-                new_priority = MIXED;
-            }
-        }
+    auto const& totals = node.totals;
+    values.size = totals.size_wanted;
+    values.have = totals.have_wanted;
+    values.progress = values.size != 0 ? static_cast<int>(100.0 * values.have / values.size) : 1;
+    values.progress = std::clamp(values.progress, 0, 100);
 
-        new_progress = new_size != 0 ? static_cast<int>(100.0 * new_have / new_size) : 1;
+    if (totals.n_unwanted == 0)
+    {
+        values.enabled = static_cast<int>(true);
+    }
+    else
+    {
+        values.enabled = totals.n_wanted == 0 ? static_cast<int>(false) : MIXED;
     }
 
-    new_progress = std::clamp(new_progress, 0, 100);
-
-    if (new_priority != old_priority || new_enabled != old_enabled)
+    values.priority = NOT_SET;
+    for (int priority = TR_PRI_LOW; priority <= TR_PRI_HIGH; ++priority)
     {
-        /* Changing a value in the sort column can trigger a resort
-         * which breaks this foreach () call. (See #3529)
-         * As a workaround: if that's about to happen, temporarily disable
-         * sorting until we finish walking the tree. */
-        if (!refresh_data.resort_needed &&
-            (((refresh_data.sort_column_id == file_cols.priority.index()) && (new_priority != old_priority)) ||
-             ((refresh_data.sort_column_id == file_cols.enabled.index()) && (new_enabled != old_enabled))))
+        if (totals.n_priority[priority - TR_PRI_LOW] != 0)
         {
-            refresh_data.resort_needed = true;
-
-            store->set_sort_column(GTK_TREE_SORTABLE_UNSORTED_SORT_COLUMN_ID, TR_GTK_SORT_TYPE(ASCENDING));
+            values.priority = values.priority == NOT_SET ? priority : MIXED;
         }
     }
 
-    if (new_enabled != old_enabled)
+    return values;
+}
+
+void FileList::Impl::addRow(unsigned int node_id, Gtk::TreeNodeChildren const& siblings)
+{
+    auto& node = nodes_[node_id];
+    bool const is_file = node.file_index >= 0;
+    auto const mime_type = is_file ? tr_get_mime_type_for_filename(node.name) : DirectoryMimeType;
+    auto const values = rowValues(node);
+
+    auto const row = store_->append(siblings);
+    (*row)[file_cols.node] = node_id;
+    (*row)[file_cols.index] = node.file_index;
+    (*row)[file_cols.label] = node.name;
+    (*row)[file_cols.label_esc] = Glib::Markup::escape_text(node.name);
+    (*row)[file_cols.icon] = gtr_get_mime_type_icon(mime_type);
+    (*row)[file_cols.size] = values.size;
+    (*row)[file_cols.size_str] = tr_strlsize(values.size);
+    (*row)[file_cols.have] = values.have;
+    (*row)[file_cols.prog] = values.progress;
+    (*row)[file_cols.prog_str] = fmt::format(FMT_STRING("{:d}%"), values.progress);
+    (*row)[file_cols.priority] = values.priority;
+    (*row)[file_cols.enabled] = values.enabled;
+    node.row = row;
+
+    if (!is_file)
     {
-        (*iter)[file_cols.enabled] = new_enabled;
+        // a placeholder so the folder can be expanded; see onTestExpandRow()
+        auto const placeholder = store_->append(row->children());
+        (*placeholder)[file_cols.node] = NoNode;
     }
+}
+
+void FileList::Impl::updateRow(Node const& node)
+{
+    auto const& row = *node.row;
+    auto const values = rowValues(node);
 
-    if (new_priority != old_priority)
+    if (values.enabled != row.get_value(file_cols.enabled))
     {
-        (*iter)[file_cols.priority] = new_priority;
+        row[file_cols.enabled] = values.enabled;
     }
 
-    if (new_size != old_size)
+    if (values.priority != row.get_value(file_cols.priority))
     {
-        (*iter)[file_cols.size] = new_size;
-        (*iter)[file_cols.size_str] = tr_strlsize(new_size);
+        row[file_cols.priority] = values.priority;
     }
 
-    if (new_have != old_have)
+    if (values.size != row.get_value(file_cols.size))
     {
-        (*iter)[file_cols.have] = new_have;
+        row[file_cols.size] = values.size;
+        row[file_cols.size_str] = tr_strlsize(values.size);
     }
 
-    if (new_progress != old_progress)
+    if (values.have != row.get_value(file_cols.have))
     {
-        (*iter)[file_cols.prog] = new_progress;
-        (*iter)[file_cols.prog_str] = fmt::format(FMT_STRING("{:d}%"), new_progress);
+        row[file_cols.have] = values.have;
     }
 
-    return false; /* keep walking */
+    if (values.progress != row.get_value(file_cols.prog))
+    {
+        row[file_cols.prog] = values.progress;
+        row[file_cols.prog_str] = fmt::format(FMT_STRING("{:d}%"), values.progress);
+    }
 }
 
-void gtr_tree_model_foreach_postorder(Glib::RefPtr<Gtk::TreeModel> const& model, Gtk::TreeModel::SlotForeachIter const& func)
+bool FileList::Impl::onTestExpandRow(Gtk::TreeModel::iterator const& iter, Gtk::TreeModel::Path const& /*path*/)
 {
-    auto items = std::stack<Gtk::TreeModel::iterator>();
-    if (auto const root_child_it = model->children().begin(); root_child_it)
+    auto const node_id = iter->get_value(file_cols.node);
+    if (node_id >= std::size(nodes_) || nodes_[node_id].has_child_rows)
     {
-        items.push(root_child_it);
+        return false;
     }
 
-    while (!items.empty())
-    {
-        while (items.top())
-        {
-            if (auto const child_it = items.top()->children().begin(); child_it)
-            {
-                items.push(child_it);
-            }
-            else
-            {
-                func(items.top()++);
-            }
-        }
+    auto const suspender = SortSuspender{ store_ };
 
-        items.pop();
+    for (auto child = iter->children().begin(); child;)
+    {
+        child = store_->erase(child);
+    }
 
-        if (!items.empty())
-        {
-            func(items.top()++);
-        }
+    auto& node = nodes_[node_id];
+    node.has_child_rows = true;
+    for (auto const child_id : node.children)
+    {
+        addRow(child_id, iter->children());
     }
-}
 
-} // namespace
+    return false; // let the row expand
+}
 
 void FileList::Impl::refresh()
 {
-    if (tr_torrent* tor = core_->find_torrent(torrent_id_); tor == nullptr)
+    auto* const tor = core_->find_torrent(torrent_id_);
+    if (tor == nullptr)
     {
         widget_.clear();
+        return;
     }
-    else
+
+    auto changed = std::vector<unsigned int>{};
+
+    for (tr_file_index_t i = 0, n_files = static_cast<tr_file_index_t>(std::size(files_)); i < n_files; ++i)
     {
-        Gtk::SortType order = TR_GTK_SORT_TYPE(ASCENDING);
-        int sort_column_id = 0;
-        store_->get_sort_column_id(sort_column_id, order);
+        auto const view = tr_torrentFile(tor, i);
+        auto& file = files_[i];
+        auto const progress = std::clamp(static_cast<int>(100 * view.progress), 0, 100);
+
+        if (file.have == view.have && file.progress == progress && file.priority == view.priority &&
+            file.wanted == view.wanted)
+        {
+            continue;
+        }
 
-        RefreshData refresh_data{ sort_column_id, false, tor };
-        gtr_tree_model_foreach_postorder(
-            store_,
-            [this, &refresh_data](Gtk::TreeModel::iterator const& iter)
-            { return refreshFilesForeach(store_, iter, refresh_data); });
+        auto delta = Totals{};
+        delta -= totalsOf(file);
+        file.have = view.have;
+        file.progress = progress;
+        file.priority = view.priority;
+        file.wanted = view.wanted;
+        delta += totalsOf(file);
 
-        if (refresh_data.resort_needed)
+        for (auto node_id = file.node; node_id != NoNode; node_id = nodes_[node_id].parent)
         {
-            store_->set_sort_column(sort_column_id, order);
+            auto& node = nodes_[node_id];
+            node.totals += delta;
+
+            if (node.row && !node.is_changed)
+            {
+                node.is_changed = true;
+                changed.push_back(node_id);
+            }
         }
     }
+
+    // resorting after each change is cheaper than resorting everything for just a few
+    auto suspender = std::optional<SortSuspender>{};
+    if (std::size(changed) > MaxChangesWhileSorted)
+    {
+        suspender.emplace(store_);
+    }
+
+    for (auto const node_id : changed)
+    {
+        auto& node = nodes_[node_id];
+        updateRow(node);
+        node.is_changed = false;
+    }
 }
 
 /***
 ****
 ***/
 
-namespace
+void FileList::Impl::collectFiles(unsigned int node_id, std::vector<tr_file_index_t>& setme) const
 {
+    if (node_id >= std::size(nodes_))
+    {
+        return;
+    }
 
-bool getSelectedFilesForeach(
-    Gtk::TreeModel::iterator const& iter,
-    Glib::RefPtr<Gtk::TreeSelection> const& sel,
-    std::vector<tr_file_index_t>& indexBuf)
-{
-    if (bool const is_file = iter->children().empty(); is_file)
+    auto todo = std::vector<unsigned int>{ node_id };
+
+    while (!std::empty(todo))
     {
-        /* active means: if it's selected or any ancestor is selected */
-        bool is_active = sel->is_selected(iter);
+        auto const& node = nodes_[todo.back()];
+        todo.pop_back();
 
-        if (!is_active)
+        if (node.file_index >= 0)
         {
-            for (auto walk = iter->parent(); !is_active && walk; walk = walk->parent())
-            {
-                is_active = sel->is_selected(walk);
-            }
+            setme.push_back(node.file_index);
         }
 
-        if (is_active)
-        {
-            indexBuf.push_back(iter->get_value(file_cols.index));
-        }
+        todo.insert(std::end(todo), std::begin(node.children), std::end(node.children));
     }
-
-    return false; /* keep walking */
 }
 
-} // namespace
-
 std::vector<tr_file_index_t> FileList::Impl::getSelectedFilesAndDescendants() const
 {
-    auto const sel = view_->get_selection();
-    std::vector<tr_file_index_t> indexBuf;
-    store_->foreach_iter([&sel, &indexBuf](Gtk::TreeModel::iterator const& iter)
-                         { return getSelectedFilesForeach(iter, sel, indexBuf); });
-    return indexBuf;
-}
+    auto files = std::vector<tr_file_index_t>{};
 
-namespace
-{
-
-bool getSubtreeForeach(
-    Gtk::TreeModel::Path const& path,
-    Gtk::TreeModel::iterator const& iter,
-    Gtk::TreeModel::Path const& subtree_path,
-    std::vector<tr_file_index_t>& indexBuf)
-{
-    if (bool const is_file = iter->children().empty(); is_file)
+    for (auto const& path : view_->get_selection()->get_selected_rows())
     {
-        if (path == subtree_path || path.is_descendant(subtree_path))
+        if (auto const iter = store_->get_iter(path); iter)
         {
-            indexBuf.push_back(iter->get_value(file_cols.index));
+            collectFiles(iter->get_value(file_cols.node), files);
         }
     }
 
-    return false; /* keep walking */
+    // a selected row's descendants may be selected too
+    std::sort(std::begin(files), std::end(files));
+    files.erase(std::unique(std::begin(files), std::end(files)), std::end(files));
+    return files;
 }
 
-} // namespace
-
 std::vector<tr_file_index_t> FileList::Impl::getSubtree(Gtk::TreeModel::Path const& subtree_path) const
 {
-    std::vector<tr_file_index_t> indexBuf;
-    store_->foreach ([&subtree_path, &indexBuf](Gtk::TreeModel::Path const& path, Gtk::TreeModel::iterator const& iter)
-                     { return getSubtreeForeach(path, iter, subtree_path, indexBuf); });
-    return indexBuf;
+    auto files = std::vector<tr_file_index_t>{};
+
+    if (auto const iter = store_->get_iter(subtree_path); iter)
+    {
+        collectFiles(iter->get_value(file_cols.node), files);
+    }
+
+    return files;
 }
 
 /* if `path' is a selected row, all selected rows are returned.
@@ -451,58 +572,6 @@ void FileList::clear()
     impl_->reset_torrent();
 }
 
-namespace
-{
-
-struct build_data
-{
-    Gtk::Widget* w = nullptr;
-    tr_torrent* tor = nullptr;
-    Gtk::TreeStore::iterator iter;
-    Glib::RefPtr<Gtk::TreeStore> store;
-};
-
-struct row_struct
-{
-    uint64_t length = 0;
-    Glib::ustring name;
-    int index = 0;
-};
-
-using FileRowNode = Glib::NodeTree<row_struct>;
-
-void buildTree(FileRowNode& node, build_data& build)
-{
-    auto const& child_data = node.data();
-    bool const isLeaf = node.child_count() == 0;
-
-    auto const mime_type = isLeaf ? tr_get_mime_type_for_filename(child_data.name.raw()) : DirectoryMimeType;
-    auto const icon = gtr_get_mime_type_icon(mime_type);
-    auto const file = isLeaf ? tr_torrentFile(build.tor, child_data.index) : tr_file_view{};
-    int const priority = isLeaf ? file.priority : 0;
-    bool const enabled = isLeaf ? file.wanted : true;
-    auto name_esc = Glib::Markup::escape_text(child_data.name);
-
-    auto const child_iter = build.store->prepend(build.iter->children());
-    (*child_iter)[file_cols.index] = child_data.index;
-    (*child_iter)[file_cols.label] = child_data.name;
-    (*child_iter)[file_cols.label_esc] = name_esc;
-    (*child_iter)[file_cols.size] = child_data.length;
-    (*child_iter)[file_cols.size_str] = tr_strlsize(child_data.length);
-    (*child_iter)[file_cols.icon] = icon;
-    (*child_iter)[file_cols.priority] = priority;
-    (*child_iter)[file_cols.enabled] = static_cast<int>(enabled);
-
-    if (!isLeaf)
-    {
-        build_data b = build;
-        b.iter = child_iter;
-        node.foreach ([&b](auto& child_node) { buildTree(child_node, b); }, TR_GLIB_NODE_TREE_TRAVERSE_FLAGS(FileRowNode, ALL));
-    }
-}
-
-} // namespace
-
 void FileList::set_torrent(tr_torrent_id_t torrent_id)
 {
     impl_->set_torrent(torrent_id);
@@ -517,6 +586,56 @@ struct PairHash
     }
 };
 
+void FileList::Impl::buildNodes(tr_torrent const* tor)
+{
+    nodes_.clear();
+    nodes_.emplace_back(); // the root
+
+    auto const n_files = tr_torrentFileCount(tor);
+    files_.clear();
+    files_.reserve(n_files);
+
+    auto node_ids = std::unordered_map<std::pair<unsigned int /*parent*/, std::string_view>, unsigned int, PairHash>{};
+
+    for (tr_file_index_t i = 0; i < n_files; ++i)
+    {
+        auto const view = tr_torrentFile(tor, i);
+        auto parent = 0U;
+
+        auto path = std::string_view{ view.name };
+        auto token = std::string_view{};
+        while (tr_strv_sep(&path, &token, '/'))
+        {
+            auto const [iter, added] = node_ids.try_emplace(std::make_pair(parent, token), static_cast<unsigned int>(std::size(nodes_)));
+
+            if (added)
+            {
+                auto& node = nodes_.emplace_back();
+                node.name = token;
+                node.file_index = std::empty(path) ? static_cast<int>(i) : -1;
+                node.parent = parent;
+                nodes_[parent].children.push_back(iter->second);
+            }
+
+            parent = iter->second;
+        }
+
+        auto& file = files_.emplace_back();
+        file.length = view.length;
+        file.have = view.have;
+        file.progress = std::clamp(static_cast<int>(100 * view.progress), 0, 100);
+        file.priority = view.priority;
+        file.wanted = view.wanted;
+        file.node = parent;
+
+        auto const totals = totalsOf(file);
+        for (auto node_id = parent; node_id != NoNode; node_id = nodes_[node_id].parent)
+        {
+            nodes_[node_id].totals += totals;
+        }
+    }
+}
+
 void FileList::Impl::set_torrent(tr_torrent_id_t torrent_id)
 {
     if (torrent_id_ == torrent_id && store_ != nullptr && !store_->children().empty())
@@ -534,54 +653,16 @@ void FileList::Impl::set_torrent(tr_torrent_id_t torrent_id)
     /* populate the model */
     if (torrent_id_ > 0)
     {
-        if (auto* const tor = core_->find_torrent(torrent_id_); tor != nullptr)
+        if (auto const* const tor = core_->find_torrent(torrent_id_); tor != nullptr)
         {
-            // build a GNode tree of the files
-            auto root = FileRowNode{};
-            auto& root_data = root.data();
-            root_data.name = tr_torrentName(tor);
-            root_data.index = -1;
-            root_data.length = 0;
-
-            auto nodes = std::unordered_map<std::pair<FileRowNode* /*parent*/, std::string_view>, FileRowNode*, PairHash>{};
-
-            for (tr_file_index_t i = 0, n_files = tr_torrentFileCount(tor); i < n_files; ++i)
+            // only the top level gets rows here; folders get theirs when they're expanded
+            buildNodes(tor);
+            for (auto const node_id : nodes_.front().children)
             {
-                auto* parent = &root;
-                auto const file = tr_torrentFile(tor, i);
-
-                auto path = std::string_view{ file.name };
-                auto token = std::string_view{};
-                while (tr_strv_sep(&path, &token, '/'))
-                {
-                    auto*& node = nodes[std::make_pair(parent, token)];
-
-                    if (node == nullptr)
-                    {
-                        auto const is_leaf = std::empty(path);
-
-                        node = parent->prepend_data({});
-                        auto& node_data = node->data();
-                        node_data.name = std::string{ token };
-                        node_data.index = is_leaf ? (int)i : -1;
-                        node_data.length = is_leaf ? file.length : 0;
-                    }
-
-                    parent = node;
-                }
+                addRow(node_id, store_->children());
             }
-
-            // now, add them to the model
-            struct build_data build;
-            build.w = &widget_;
-            build.tor = tor;
-            build.store = store_;
-            root.foreach (
-                [&build](auto& child_node) { buildTree(child_node, build); },
-                TR_GLIB_NODE_TREE_TRAVERSE_FLAGS(FileRowNode, ALL));
         }
 
-        refresh();
         timeout_tag_ = Glib::signal_timeout().connect_seconds(
             [this]() { return refresh(), true; },
             SECONDARY_WINDOW_REFRESH_INTERVAL_SECONDS);
@@ -819,11 +900,18 @@ void FileList::Impl::on_rename_done_idle(Glib::ustring const& path_string, Glib:
     {
         if (auto const iter = store_->get_iter(path_string); iter)
         {
-            bool const isLeaf = iter->children().empty();
+            auto const node_id = iter->get_value(file_cols.node);
+            bool const isLeaf = node_id < std::size(nodes_) && nodes_[node_id].file_index >= 0;
             auto const mime_type = isLeaf ? tr_get_mime_type_for_filename(newname.raw()) : DirectoryMimeType;
             auto const icon = gtr_get_mime_type_icon(mime_type);
 
+            if (node_id < std::size(nodes_))
+            {
+                nodes_[node_id].name = newname.raw();
+            }
+
             (*iter)[file_cols.label] = newname;
+            (*iter)[file_cols.label_esc] = Glib::Markup::escape_text(newname);
             (*iter)[file_cols.icon] = icon;
 
             if (!iter->parent())
@@ -924,6 +1012,7 @@ FileList::Impl::Impl(
 {
     /* create the view */
     view_->signal_row_activated().connect(sigc::mem_fun(*this, &Impl::onRowActivated));
+    view_->signal_test_expand_row().connect(sigc::mem_fun(*this, &Impl::onTestExpandRow), false);
     setup_item_view_button_event_handling(
         *view_,
         [this](guint button, TrGdkModifierType state, double view_x, double view_y, bool /*context_menu_requested*/)
@@ -618,9 +618,14 @@ void FilterBar::Impl::update_filter_models(Torrent::ChangeFlags changes)
         tracker_filter_model_update();
     }
 
+#if GTKMM_CHECK_VERSION(4, 0, 0)
     filter_->update(changes);
+#else
+    // Gtk::TreeModelFilter already rechecks each changed row when it gets
+    // row-changed, so refiltering every row would be wasted.
+#endif
 
-    if (changes.test(activity_flags | tracker_flags))
+    if (changes.test(activity_flags | tracker_flags | Torrent::ChangeFlag::NAME))
     {
         update_count_label_idle();
     }
@@ -710,6 +715,10 @@ FilterBar::Impl::Impl(FilterBar& widget, Glib::RefPtr<Session> const& core)
     filter_->signal_changed().connect([this](auto /*changes*/) { update_count_label_idle(); });
 
     filter_model_ = FilterListModel<Torrent>::create(core_->get_sorted_model(), filter_);
+#if GTKMM_CHECK_VERSION(4, 0, 0)
+    // refilter large lists in steps instead of blocking the UI
+    filter_model_->set_incremental(true);
+#endif
 
     tracker_->signal_changed().connect(sigc::mem_fun(*this, &Impl::update_filter_tracker));
     activity_->signal_changed().connect(sigc::mem_fun(*this, &Impl::update_filter_activity));
@@ -541,9 +541,18 @@ Session::Impl::Impl(Session& core, tr_session* session)
     , session_{ session }
 {
     raw_model_ = Gio::ListStore<Torrent>::create();
-    signal_torrents_changed_.connect(sigc::hide<0>(sigc::mem_fun(*sorter_, &TorrentSorter::update)));
     sorted_model_ = SortListModel<Torrent>::create(gtr_ptr_static_cast<Gio::ListModel>(raw_model_), sorter_);
 
+#if GTKMM_CHECK_VERSION(4, 0, 0)
+    // Gtk::SortListModel doesn't watch its items, so changed torrents need a
+    // resort; do it in steps so that large lists don't block the UI.
+    signal_torrents_changed_.connect(sigc::hide<0>(sigc::mem_fun(*sorter_, &TorrentSorter::update)));
+    sorted_model_->set_incremental(true);
+#else
+    // Gtk::TreeModelSort already moves each changed row to its new place
+    // when it gets row-changed, so resorting every row would be wasted.
+#endif
+
     /* init from prefs & listen to pref changes */
     on_pref_changed(TR_KEY_sort_mode);
     on_pref_changed(TR_KEY_sort_reversed);
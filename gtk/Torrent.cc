@@ -20,6 +20,7 @@
 
 #include <array>
 #include <cmath>
+#include <optional>
 #include <utility>
 
 using namespace std::string_view_literals;
@@ -149,6 +150,9 @@ public:
         time_t added_date = {};
         time_t eta = {};
 
+        // when `mime_type` and `trackers` were last rebuilt
+        std::optional<time_t> edit_date;
+
         tr_torrent_activity activity = {};
 
         unsigned int trackers = {};
@@ -269,7 +273,17 @@ Torrent::ChangeFlags Torrent::Impl::update_cache()
     update_cache_value(cache_.finished, stats->finished, result, ChangeFlag::FINISHED);
     update_cache_value(cache_.priority, tr_torrentGetPriority(raw_torrent_), result, ChangeFlag::PRIORITY);
     update_cache_value(cache_.queue_position, stats->queuePosition, result, ChangeFlag::QUEUE_POSITION);
-    update_cache_value(cache_.trackers, build_torrent_trackers_hash(*raw_torrent_), result, ChangeFlag::TRACKERS);
+
+    // The trackers and file list only change when the torrent is edited,
+    // and walking them for every torrent on every tick adds up.
+    auto const edited = cache_.edit_date != stats->editDate;
+    cache_.edit_date = stats->editDate;
+
+    if (edited)
+    {
+        update_cache_value(cache_.trackers, build_torrent_trackers_hash(*raw_torrent_), result, ChangeFlag::TRACKERS);
+    }
+
     update_cache_value(cache_.error_code, stats->error, result, ChangeFlag::ERROR_CODE);
     update_cache_value(cache_.error_message, stats->errorString, result, ChangeFlag::ERROR_MESSAGE);
     update_cache_value(
@@ -277,8 +291,11 @@ Torrent::ChangeFlags Torrent::Impl::update_cache()
         stats->peersSendingToUs + stats->peersGettingFromUs + stats->webseedsSendingToUs,
         result,
         ChangeFlag::ACTIVE_PEER_COUNT);
-    update_cache_value(cache_.mime_type, get_mime_type(*raw_torrent_), result, ChangeFlag::MIME_TYPE);
     update_cache_value(cache_.has_metadata, tr_torrentHasMetadata(raw_torrent_), result, ChangeFlag::HAS_METADATA);
+    if (edited || result.test(ChangeFlag::HAS_METADATA))
+    {
+        update_cache_value(cache_.mime_type, get_mime_type(*raw_torrent_), result, ChangeFlag::MIME_TYPE);
+    }
     update_cache_value(cache_.stalled, stats->isStalled, result, ChangeFlag::STALLED);
     update_cache_value(cache_.ratio, stats->ratio, 0.01F, result, ChangeFlag::RATIO);
 
@@ -4,8 +4,16 @@
 // License text can be found in the licenses/ folder.
 
 #include <algorithm>
+#include <atomic>
+#include <cstddef> // size_t
+#include <functional> // std::hash
+#include <iterator>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <string_view>
+#include <unordered_map>
+#include <utility>
 
 #include <fmt/core.h>
 
@@ -22,7 +30,7 @@ using namespace std::literals;
 
 size_t tr_announce_list::set(char const* const* announce_urls, tr_tracker_tier_t const* tiers, size_t n)
 {
-    trackers_.clear();
+    clear();
 
     for (size_t i = 0; i < n; ++i)
     {
@@ -35,24 +43,24 @@ size_t tr_announce_list::set(char const* const* announce_urls, tr_tracker_tier_t
 bool tr_announce_list::remove(std::string_view announce_url)
 {
     auto const it = find(announce_url);
-    if (it == std::end(trackers_))
+    if (it == end())
     {
         return false;
     }
 
-    trackers_.erase(it);
+    erase(it);
     return true;
 }
 
 bool tr_announce_list::remove(tr_tracker_id_t id)
 {
-    auto it = find(id);
-    if (it == std::end(trackers_))
+    auto const it = find(id);
+    if (it == end())
     {
         return false;
     }
 
-    trackers_.erase(it);
+    erase(it);
     return true;
 }
 
@@ -63,14 +71,14 @@ bool tr_announce_list::replace(tr_tracker_id_t id, std::string_view announce_url
         return false;
     }
 
-    auto it = find(id);
-    if (it == std::end(trackers_))
+    auto const it = find(id);
+    if (it == end())
     {
         return false;
     }
 
     auto const tier = it->tier;
-    trackers_.erase(it);
+    erase(it);
     return add(announce_url_sv, tier);
 }
 
@@ -95,8 +103,9 @@ bool tr_announce_list::add(std::string_view announce_url_sv, tr_tracker_tier_t t
         tracker.scrape = *scrape_str;
     }
 
-    auto const it = std::lower_bound(std::begin(trackers_), std::end(trackers_), tracker);
-    trackers_.insert(it, tracker);
+    auto& trackers = trackers_for_write();
+    auto const it = std::lower_bound(std::begin(trackers), std::end(trackers), tracker);
+    trackers.insert(it, tracker);
 
     return true;
 }
@@ -160,31 +169,147 @@ tr_quark tr_announce_list::announce_to_scrape(tr_quark announce)
 
 tr_tracker_tier_t tr_announce_list::nextTier() const
 {
-    return std::empty(trackers_) ? 0 : trackers_.back().tier + 1;
+    return empty() ? 0 : trackers().back().tier + 1;
 }
 
 tr_tracker_id_t tr_announce_list::next_unique_id()
 {
-    static tr_tracker_id_t id = 0;
+    // torrents' announce lists may be parsed on several threads at once
+    static auto id = std::atomic<tr_tracker_id_t>{ 0 };
     return id++;
 }
 
-tr_announce_list::trackers_t::iterator tr_announce_list::find(tr_tracker_id_t id)
+tr_announce_list::trackers_t::const_iterator tr_announce_list::find(tr_tracker_id_t id) const
 {
     auto const test = [&id](auto const& tracker)
     {
         return tracker.id == id;
     };
-    return std::find_if(std::begin(trackers_), std::end(trackers_), test);
+    return std::find_if(begin(), end(), test);
 }
 
-tr_announce_list::trackers_t::iterator tr_announce_list::find(std::string_view announce)
+tr_announce_list::trackers_t::const_iterator tr_announce_list::find(std::string_view announce) const
 {
     auto const test = [&announce](auto const& tracker)
     {
         return announce == tracker.announce.sv();
     };
-    return std::find_if(std::begin(trackers_), std::end(trackers_), test);
+    return std::find_if(begin(), end(), test);
+}
+
+void tr_announce_list::erase(trackers_t::const_iterator it)
+{
+    auto const pos = std::distance(begin(), it);
+    auto& trackers = trackers_for_write();
+    trackers.erase(std::next(std::begin(trackers), pos));
+}
+
+tr_announce_list::trackers_t& tr_announce_list::trackers_for_write()
+{
+    if (!trackers_)
+    {
+        trackers_ = std::make_shared<trackers_t>();
+    }
+    else if (is_interned_ || trackers_.use_count() > 1)
+    {
+        trackers_ = std::make_shared<trackers_t>(*trackers_);
+    }
+
+    is_interned_ = false;
+    return *trackers_;
+}
+
+// ---
+
+namespace
+{
+// The interned lists. Entries are weak so that a list is freed when
+// the last torrent using it is, and its deleter removes its entry.
+template<typename Trackers>
+class tr_announce_list_pool
+{
+public:
+    [[nodiscard]] static tr_announce_list_pool& instance()
+    {
+        // leaked so that lists can be freed during static destruction
+        static auto* const pool = new tr_announce_list_pool{};
+        return *pool;
+    }
+
+    [[nodiscard]] std::shared_ptr<Trackers> intern(Trackers& trackers)
+    {
+        auto const key = hash(trackers);
+        auto const lock = std::lock_guard{ mutex_ };
+
+        auto [begin, end] = lists_.equal_range(key);
+        for (auto it = begin; it != end; ++it)
+        {
+            // the tracker_infos' operator== ignores their ids
+            if (auto shared = it->second.list.lock(); shared && *shared == trackers)
+            {
+                return shared;
+            }
+        }
+
+        auto* const raw = new Trackers{ std::move(trackers) };
+        auto shared = std::shared_ptr<Trackers>{ raw, [this, key](Trackers* doomed) { release(key, doomed); } };
+        lists_.emplace(key, Entry{ raw, shared });
+        return shared;
+    }
+
+private:
+    struct Entry
+    {
+        Trackers const* raw;
+        std::weak_ptr<Trackers> list;
+    };
+
+    [[nodiscard]] static size_t hash(Trackers const& trackers) noexcept
+    {
+        auto ret = std::size(trackers);
+        for (auto const& tracker : trackers)
+        {
+            ret = ret * 31U + std::hash<tr_quark>{}(tracker.announce.quark());
+            ret = ret * 31U + tracker.tier;
+        }
+        return ret;
+    }
+
+    void release(size_t key, Trackers* doomed)
+    {
+        {
+            auto const lock = std::lock_guard{ mutex_ };
+            auto [begin, end] = lists_.equal_range(key);
+            auto const it = std::find_if(begin, end, [doomed](auto const& item) { return item.second.raw == doomed; });
+            if (it != end)
+            {
+                lists_.erase(it);
+            }
+        }
+
+        delete doomed;
+    }
+
+    std::mutex mutex_;
+    std::unordered_multimap<size_t, Entry> lists_;
+};
+} // namespace
+
+void tr_announce_list::intern()
+{
+    if (is_interned_ || !trackers_)
+    {
+        return;
+    }
+
+    if (trackers_.use_count() > 1)
+    {
+        // don't move trackers out from under the other copies
+        trackers_ = std::make_shared<trackers_t>(*trackers_);
+    }
+
+    trackers_ = tr_announce_list_pool<trackers_t>::instance().intern(*trackers_);
+    is_interned_ = true;
 }
 
 // if two announce URLs differ only by scheme, put them in the same tier.
@@ -206,8 +331,8 @@ tr_tracker_tier_t tr_announce_list::get_tier(tr_tracker_tier_t tier, tr_url_pars
         return candidate->host == announce.host && candidate->path == announce.path;
     };
 
-    auto const it = std::find_if(std::begin(trackers_), std::end(trackers_), is_sibling);
-    return it != std::end(trackers_) ? it->tier : tier;
+    auto const it = std::find_if(begin(), end(), is_sibling);
+    return it != end() ? it->tier : tier;
 }
 
 bool tr_announce_list::can_add(tr_url_parsed_t const& announce) const noexcept
@@ -230,7 +355,7 @@ bool tr_announce_list::can_add(tr_url_parsed_t const& announce) const noexcept
             tracker_parsed->port == announce.port && tracker_parsed->path == announce.path &&
             tracker_parsed->query == announce.query;
     };
-    return std::none_of(std::begin(trackers_), std::end(trackers_), is_same);
+    return std::none_of(begin(), end(), is_same);
 }
 
 bool tr_announce_list::save(std::string_view torrent_file, tr_error** error) const
@@ -6,6 +6,7 @@
 #pragma once
 
 #include <cstddef> // size_t
+#include <memory>
 #include <optional>
 #include <string>
 #include <string_view>
@@ -63,41 +64,41 @@ private:
     using trackers_t = std::vector<tracker_info>;
 
 public:
-    [[nodiscard]] TR_CONSTEXPR20 auto begin() const noexcept
+    [[nodiscard]] auto begin() const noexcept
     {
-        return std::begin(trackers_);
+        return std::begin(trackers());
     }
 
-    [[nodiscard]] TR_CONSTEXPR20 auto end() const noexcept
+    [[nodiscard]] auto end() const noexcept
     {
-        return std::end(trackers_);
+        return std::end(trackers());
     }
 
-    [[nodiscard]] TR_CONSTEXPR20 bool empty() const noexcept
+    [[nodiscard]] bool empty() const noexcept
     {
-        return std::empty(trackers_);
+        return std::empty(trackers());
     }
 
-    [[nodiscard]] TR_CONSTEXPR20 size_t size() const noexcept
+    [[nodiscard]] size_t size() const noexcept
     {
-        return std::size(trackers_);
+        return std::size(trackers());
     }
 
-    [[nodiscard]] TR_CONSTEXPR20 tracker_info const& at(size_t i) const
+    [[nodiscard]] tracker_info const& at(size_t i) const
     {
-        return trackers_.at(i);
+        return trackers().at(i);
     }
 
     [[nodiscard]] tr_tracker_tier_t nextTier() const;
 
-    [[nodiscard]] TR_CONSTEXPR20 bool operator==(tr_announce_list const& that) const
+    [[nodiscard]] bool operator==(tr_announce_list const& that) const
     {
-        return trackers_ == that.trackers_;
+        return trackers_ == that.trackers_ || trackers() == that.trackers();
     }
 
     [[nodiscard]] bool operator!=(tr_announce_list const& that) const
     {
-        return trackers_ != that.trackers_;
+        return !(*this == that);
     }
 
     bool add(std::string_view announce_url_sv)
@@ -112,9 +113,25 @@ public:
     bool replace(tr_tracker_id_t id, std::string_view announce_url_sv);
     size_t set(char const* const* announce_urls, tr_tracker_tier_t const* tiers, size_t n);
 
-    TR_CONSTEXPR20 void clear()
+    void clear() noexcept
     {
-        return trackers_.clear();
+        trackers_.reset();
+        is_interned_ = false;
+    }
+
+    /**
+     * Share this list with every other interned list that has the same
+     * trackers in the same tiers, e.g. torrents from the same tracker.
+     * The trackers' ids are replaced by the shared list's ids.
+     *
+     * Copies of a list share it until one of them is changed,
+     * so an interned list stays the same while it's shared.
+     */
+    void intern();
+
+    [[nodiscard]] constexpr bool is_interned() const noexcept
+    {
+        return is_interned_;
     }
 
     /**
@@ -135,8 +152,19 @@ private:
 
     [[nodiscard]] bool can_add(tr_url_parsed_t const& announce) const noexcept;
     static tr_tracker_id_t next_unique_id();
-    trackers_t::iterator find(std::string_view announce);
-    trackers_t::iterator find(tr_tracker_id_t id);
+    [[nodiscard]] trackers_t::const_iterator find(std::string_view announce) const;
+    [[nodiscard]] trackers_t::const_iterator find(tr_tracker_id_t id) const;
+    void erase(trackers_t::const_iterator it);
+
+    [[nodiscard]] trackers_t const& trackers() const noexcept
+    {
+        static auto const Empty = trackers_t{};
+        return trackers_ ? *trackers_ : Empty;
+    }
+
+    // copy-on-write: returns trackers that only this list holds
+    [[nodiscard]] trackers_t& trackers_for_write();
 
-    trackers_t trackers_;
+    std::shared_ptr<trackers_t> trackers_; // nullptr if empty
+    bool is_interned_ = false;
 };
@@ -9,8 +9,10 @@
 #error only the libtransmission announcer module should #include this header.
 #endif
 
+#include <algorithm> // std::max(), std::min()
 #include <array>
 #include <chrono>
+#include <cstddef> // size_t
 #include <cstdint> // uint64_t
 #include <optional>
 #include <string>
@@ -149,20 +151,78 @@ struct tr_announce_response
 
 // --- SCRAPE
 
-/* pick a number small enough for common tracker software:
+/* pick numbers small enough for common tracker software:
  *  - ocelot has no upper bound
  *  - opentracker has an upper bound of 64
  *  - udp protocol has an upper bound of 74
  *  - xbtt has no upper bound
  *
- * This is only an upper bound: if the tracker complains about
+ * These are only upper bounds: if the tracker complains about
  * length, announcer will incrementally lower the batch size.
  */
-auto inline constexpr TR_MULTISCRAPE_MAX = 60;
+auto inline constexpr TR_MULTISCRAPE_MAX = 74;
+auto inline constexpr TR_HTTP_MULTISCRAPE_MAX = 64;
 
 auto inline constexpr TR_ANNOUNCE_TIMEOUT_SEC = std::chrono::seconds{ 45 };
 auto inline constexpr TR_SCRAPE_TIMEOUT_SEC = std::chrono::seconds{ 30 };
 
+/**
+ * Paces the announces sent to a single tracker host.
+ *
+ * The number of announces allowed in flight grows by one each time the
+ * tracker answers quickly, and is cut in half whenever it times out or
+ * can't be reached. Tracker-level errors such as "unregistered torrent"
+ * are answers, not signs of overload, so they don't slow things down.
+ */
+class tr_announce_host_limit
+{
+public:
+    static auto constexpr InitialInFlight = size_t{ 4U };
+    static auto constexpr MaxInFlight = size_t{ 64U };
+    static auto constexpr FastResponse = std::chrono::milliseconds{ 1500 };
+
+    [[nodiscard]] constexpr bool can_send() const noexcept
+    {
+        return in_flight_ < max_in_flight_;
+    }
+
+    [[nodiscard]] constexpr auto in_flight() const noexcept
+    {
+        return in_flight_;
+    }
+
+    [[nodiscard]] constexpr auto max_in_flight() const noexcept
+    {
+        return max_in_flight_;
+    }
+
+    constexpr void on_sent() noexcept
+    {
+        ++in_flight_;
+    }
+
+    constexpr void on_done(bool did_respond, std::chrono::milliseconds latency) noexcept
+    {
+        if (in_flight_ > 0U)
+        {
+            --in_flight_;
+        }
+
+        if (!did_respond)
+        {
+            max_in_flight_ = std::max(size_t{ 1U }, max_in_flight_ / 2U);
+        }
+        else if (latency <= FastResponse)
+        {
+            max_in_flight_ = std::min(MaxInFlight, max_in_flight_ + 1U);
+        }
+    }
+
+private:
+    size_t in_flight_ = 0U;
+    size_t max_in_flight_ = InitialInFlight;
+};
+
 struct tr_scrape_request
 {
     /* the scrape URL */
@@ -279,6 +279,7 @@ void tr_tracker_http_announce(
     options.timeout_secs = TR_ANNOUNCE_TIMEOUT_SEC;
     options.sndbuf = 4096;
     options.rcvbuf = 4096;
+    options.reuse_connection = true;
 
     auto do_make_request = [&](std::string_view const& protocol_name, tr_web::FetchOptions&& opt)
     {
@@ -560,6 +561,7 @@ void tr_tracker_http_scrape(tr_session const* session, tr_scrape_request const&
     options.timeout_secs = TR_SCRAPE_TIMEOUT_SEC;
     options.sndbuf = 4096;
     options.rcvbuf = 4096;
+    options.reuse_connection = true;
     session->fetch(std::move(options));
 }
 
@@ -5,27 +5,23 @@
 
 #include <algorithm> // for std::find_if()
 #include <array>
-#include <chrono> // operator""ms, literals
 #include <climits> // CHAR_BIT
 #include <cstddef> // std::byte
 #include <cstdint> // uint32_t, uint64_t
 #include <cstring> // memcpy()
 #include <ctime>
-#include <future>
 #include <list>
 #include <memory>
 #include <optional>
 #include <string>
 #include <string_view>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
 #ifdef _WIN32
 #include <ws2tcpip.h>
-#undef gai_strerror
-#define gai_strerror gai_strerrorA
 #else
-#include <netdb.h> // gai_strerror()
 #include <netinet/in.h> // IPPROTO_UDP, in_addr
 #include <sys/socket.h> // sockaddr_storage, AF_INET
 #endif
@@ -37,6 +33,7 @@
 #include "libtransmission/announcer.h"
 #include "libtransmission/announcer-common.h"
 #include "libtransmission/crypto-utils.h" // for tr_rand_obj()
+#include "libtransmission/dns.h"
 #include "libtransmission/interned-string.h"
 #include "libtransmission/log.h"
 #include "libtransmission/net.h"
@@ -46,7 +43,6 @@
 #include "libtransmission/utils.h"
 #include "libtransmission/web-utils.h"
 
-#define logwarn(interned, msg) tr_logAddWarn(msg, (interned).sv())
 #define logdbg(interned, msg) tr_logAddDebug(msg, (interned).sv())
 #define logtrace(interned, msg) tr_logAddTrace(msg, (interned).sv())
 
@@ -63,6 +59,10 @@ using PayloadBuffer = libtransmission::StackBuffer<4096, std::byte>;
 
 constexpr auto TauConnectionTtlSecs = time_t{ 45 };
 
+// Ask for a new connection id this long before the current one expires,
+// so that requests never have to wait on a reconnect.
+constexpr auto TauConnectionRefreshSecs = time_t{ 10 };
+
 auto tau_transaction_new()
 {
     return tr_rand_obj<tau_transaction_t>();
@@ -297,15 +297,27 @@ private:
 
 // --- TRACKER
 
+struct tau_tracker;
+
+// Every transaction awaiting a response, mapped to the tracker that sent it.
+// Lets incoming datagrams be dispatched without scanning every tracker.
+using tau_transaction_map = std::unordered_map<tau_transaction_t, tau_tracker*>;
+
 struct tau_tracker
 {
     using Mediator = tr_announcer_udp::Mediator;
 
-    tau_tracker(Mediator& mediator, tr_interned_string key_in, tr_interned_string host_in, tr_port port_in)
+    tau_tracker(
+        Mediator& mediator,
+        tau_transaction_map& transactions,
+        tr_interned_string key_in,
+        tr_interned_string host_in,
+        tr_port port_in)
         : key{ key_in }
         , host{ host_in }
         , port{ port_in }
         , mediator_{ mediator }
+        , transactions_{ transactions }
     {
     }
 
@@ -321,21 +333,61 @@ struct tau_tracker
         mediator_.sendto(buf, buflen, reinterpret_cast<sockaddr const*>(&ss), sslen);
     }
 
+    // @return true if `transaction_id` belonged to one of this tracker's requests
+    bool on_response(tau_transaction_t transaction_id, tau_action_t action, InBuf& buf)
+    {
+        if (this->connecting_at != 0 && transaction_id == this->connection_transaction_id)
+        {
+            logtrace(this->key, fmt::format("{} is my connection request!", transaction_id));
+            on_connection_response(action, buf);
+            return true;
+        }
+
+        if (on_response(this->announces, transaction_id, action, buf))
+        {
+            logtrace(this->key, fmt::format("{} is an announce request!", transaction_id));
+            return true;
+        }
+
+        if (on_response(this->scrapes, transaction_id, action, buf))
+        {
+            logtrace(this->key, fmt::format("{} is a scrape request!", transaction_id));
+            return true;
+        }
+
+        return false;
+    }
+
     void on_connection_response(tau_action_t action, InBuf& buf)
     {
+        auto const now = tr_time();
+
+        transactions_.erase(this->connection_transaction_id);
         this->connecting_at = 0;
         this->connection_transaction_id = 0;
 
         if (action == TAU_ACTION_CONNECT)
         {
             this->connection_id = buf.to_uint64();
-            this->connection_expiration_time = tr_time() + TauConnectionTtlSecs;
+            this->connection_expiration_time = now + TauConnectionTtlSecs;
+            this->connection_refresh_time_ = this->connection_expiration_time - TauConnectionRefreshSecs;
             logdbg(this->key, fmt::format("Got a new connection ID from tracker: {}", this->connection_id));
         }
         else if (action == TAU_ACTION_ERROR)
         {
             std::string errmsg = !std::empty(buf) ? buf.to_string() : _("Connection failed");
-            this->failAll(true, false, errmsg);
+
+            if (is_connected(now))
+            {
+                // a refresh failed, but the current connection id is still good.
+                // keep using it and don't try to refresh again before it expires.
+                this->connection_refresh_time_ = this->connection_expiration_time;
+            }
+            else
+            {
+                this->failAll(true, false, errmsg);
+            }
+
             logdbg(this->key, std::move(errmsg));
         }
 
@@ -346,28 +398,21 @@ struct tau_tracker
     {
         time_t const now = tr_time();
 
-        // do we have a DNS request that's ready?
-        if (addr_pending_dns_ && addr_pending_dns_->wait_for(0ms) == std::future_status::ready)
-        {
-            addr_ = addr_pending_dns_->get();
-            addr_pending_dns_.reset();
-            addr_expires_at_ = now + DnsRetryIntervalSecs;
-        }
-
         // are there any requests pending?
         if (this->isIdle())
         {
             return;
         }
 
-        // update the addr if our lookup is past its shelf date
-        if (!addr_pending_dns_ && addr_expires_at_ <= now)
+        // do we know the tracker's address yet?
+        auto const addresses = mediator_.dns().get(this->host.sv(), now);
+        if (!addresses)
         {
-            addr_.reset();
-            addr_pending_dns_ = std::async(std::launch::async, lookup, this->host, this->port, this->key);
             return;
         }
 
+        addr_ = pick_address(*addresses, this->port);
+
         logtrace(
             this->key,
             fmt::format(
@@ -377,11 +422,13 @@ struct tau_tracker
                 now,
                 this->connecting_at));
 
-        /* also need a valid connection ID... */
-        if (addr_ && !is_connected(now) && this->connecting_at == 0)
+        // also need a valid connection ID. Refresh it before it expires
+        // so that pipelined requests don't stall at the TTL boundary.
+        if (addr_ && this->connecting_at == 0 && (!is_connected(now) || this->connection_refresh_time_ <= now))
         {
             this->connecting_at = now;
             this->connection_transaction_id = tau_transaction_new();
+            transactions_.insert_or_assign(this->connection_transaction_id, this);
             logtrace(this->key, fmt::format("Trying to connect. Transaction ID is {}", this->connection_transaction_id));
 
             auto buf = PayloadBuffer{};
@@ -412,53 +459,37 @@ private:
         return connection_id != tau_connection_t{} && now < connection_expiration_time;
     }
 
-    [[nodiscard]] static MaybeSockaddr lookup(tr_interned_string host, tr_port port, tr_interned_string logname)
+    [[nodiscard]] static MaybeSockaddr pick_address(tr_dns::Addresses const& addresses, tr_port port)
     {
-        auto szport = std::array<char, 16>{};
-        *fmt::format_to(std::data(szport), FMT_STRING("{:d}"), port.host()) = '\0';
-
-        auto hints = addrinfo{};
-        hints.ai_family = AF_INET; // https://github.com/transmission/transmission/issues/4719
-        hints.ai_protocol = IPPROTO_UDP;
-        hints.ai_socktype = SOCK_DGRAM;
-
-        addrinfo* info = nullptr;
-        if (int const rc = getaddrinfo(host.c_str(), std::data(szport), &hints, &info); rc != 0)
+        // https://github.com/transmission/transmission/issues/4719
+        auto const iter = std::find_if(
+            std::begin(addresses),
+            std::end(addresses),
+            [](tr_address const& addr) { return addr.is_ipv4(); });
+        if (iter == std::end(addresses))
         {
-            logwarn(
-                logname,
-                fmt::format(
-                    _("Couldn't look up '{address}:{port}': {error} ({error_code})"),
-                    fmt::arg("address", host.sv()),
-                    fmt::arg("port", port.host()),
-                    fmt::arg("error", gai_strerror(rc)),
-                    fmt::arg("error_code", static_cast<int>(rc))));
             return {};
         }
 
-        auto ss = sockaddr_storage{};
-        auto const len = info->ai_addrlen;
-        memcpy(&ss, info->ai_addr, len);
-        freeaddrinfo(info);
-
-        logdbg(logname, "DNS lookup succeeded");
-        return std::make_pair(ss, len);
+        return iter->to_sockaddr(port);
     }
 
     [[nodiscard]] bool isIdle() const noexcept
     {
-        return std::empty(announces) && std::empty(scrapes) && !addr_pending_dns_;
+        return std::empty(announces) && std::empty(scrapes);
     }
 
     void failAll(bool did_connect, bool did_timeout, std::string_view errmsg)
     {
         for (auto& req : this->scrapes)
         {
+            transactions_.erase(req.transaction_id);
             req.fail(did_connect, did_timeout, errmsg);
         }
 
         for (auto& req : this->announces)
         {
+            transactions_.erase(req.transaction_id);
             req.fail(did_connect, did_timeout, errmsg);
         }
 
@@ -488,6 +519,7 @@ private:
             if (auto& req = *it; req.expiresAt() <= now)
             {
                 logtrace(this->key, fmt::format("timeout {} req {}", name, fmt::ptr(&req)));
+                transactions_.erase(req.transaction_id);
                 req.fail(false, true, "");
                 it = requests.erase(it);
             }
@@ -498,13 +530,33 @@ private:
         }
     }
 
+    template<typename T>
+    bool on_response(std::list<T>& reqs, tau_transaction_t transaction_id, tau_action_t action, InBuf& buf)
+    {
+        auto it = std::find_if(
+            std::begin(reqs),
+            std::end(reqs),
+            [&transaction_id](auto const& req) { return req.transaction_id == transaction_id; });
+        if (it == std::end(reqs))
+        {
+            return false;
+        }
+
+        auto req = std::move(*it);
+        reqs.erase(it);
+        req.onResponse(action, buf);
+        return true;
+    }
+
     ///
 
+    // Sends every unsent request. Requests are pipelined: there is no limit
+    // on how many transactions may be outstanding, and the datagrams are
+    // queued into the UDP core's send batch rather than sent one by one.
+    // This keeps working while a connection id refresh is in flight.
     void send_requests()
     {
-        TR_ASSERT(!addr_pending_dns_);
         TR_ASSERT(addr_);
-        TR_ASSERT(this->connecting_at == 0);
         TR_ASSERT(this->connection_expiration_time > tr_time());
 
         send_requests(this->announces);
@@ -532,6 +584,7 @@ private:
 
             if (req.has_callback())
             {
+                transactions_.insert_or_assign(req.transaction_id, this);
                 ++it;
                 continue;
             }
@@ -567,13 +620,12 @@ public:
 
 private:
     Mediator& mediator_;
+    tau_transaction_map& transactions_;
 
-    std::optional<std::future<MaybeSockaddr>> addr_pending_dns_ = {};
+    time_t connection_refresh_time_ = 0;
 
     MaybeSockaddr addr_ = {};
-    time_t addr_expires_at_ = 0;
 
-    static inline constexpr auto DnsRetryIntervalSecs = time_t{ 3600 };
     static inline constexpr auto ConnectionRequestTtl = int{ 30 };
 };
 
@@ -641,56 +693,18 @@ public:
             return false;
         }
 
-        /* extract the transaction_id and look for a match */
+        // extract the transaction_id and look for a match
         tau_transaction_t const transaction_id = buf.to_uint32();
 
-        for (auto& tracker : trackers_)
+        auto const it = transactions_.find(transaction_id);
+        if (it == std::end(transactions_))
         {
-            // is it a connection response?
-            if (tracker.connecting_at != 0 && transaction_id == tracker.connection_transaction_id)
-            {
-                logtrace(tracker.key, fmt::format("{} is my connection request!", transaction_id));
-                tracker.on_connection_response(action_id, buf);
-                return true;
-            }
-
-            // is it a response to one of this tracker's announces?
-            if (auto& reqs = tracker.announces; !std::empty(reqs))
-            {
-                auto it = std::find_if(
-                    std::begin(reqs),
-                    std::end(reqs),
-                    [&transaction_id](auto const& req) { return req.transaction_id == transaction_id; });
-                if (it != std::end(reqs))
-                {
-                    logtrace(tracker.key, fmt::format("{} is an announce request!", transaction_id));
-                    auto req = *it;
-                    it = reqs.erase(it);
-                    req.onResponse(action_id, buf);
-                    return true;
-                }
-            }
-
-            // is it a response to one of this tracker's scrapes?
-            if (auto& reqs = tracker.scrapes; !std::empty(reqs))
-            {
-                auto it = std::find_if(
-                    std::begin(reqs),
-                    std::end(reqs),
-                    [&transaction_id](auto const& req) { return req.transaction_id == transaction_id; });
-                if (it != std::end(reqs))
-                {
-                    logtrace(tracker.key, fmt::format("{} is a scrape request!", transaction_id));
-                    auto req = *it;
-                    it = reqs.erase(it);
-                    req.onResponse(action_id, buf);
-                    return true;
-                }
-            }
+            return false;
         }
 
-        /* no match... */
-        return false;
+        auto* const tracker = it->second;
+        transactions_.erase(it);
+        return tracker->on_response(transaction_id, action_id, buf);
     }
 
 private:
@@ -717,7 +731,12 @@ private:
         }
 
         // we don't have it -- build a new one
-        trackers_.emplace_back(mediator_, key, tr_interned_string(parsed->host), tr_port::fromHost(parsed->port));
+        trackers_.emplace_back(
+            mediator_,
+            transactions_,
+            key,
+            tr_interned_string(parsed->host),
+            tr_port::fromHost(parsed->port));
         auto* const tracker = &trackers_.back();
         logtrace(tracker->key, "New tau_tracker created");
         return tracker;
@@ -748,6 +767,8 @@ private:
         return false;
     }
 
+    tau_transaction_map transactions_;
+
     std::list<tau_tracker> trackers_;
 
     Mediator& mediator_;
@@ -6,13 +6,16 @@
 #include <algorithm>
 #include <array>
 #include <chrono> // operator""ms
+#include <cstdint> // uint64_t
 #include <cstdio>
 #include <ctime>
 #include <deque>
+#include <functional> // std::greater
 #include <iterator>
 #include <map>
 #include <memory>
 #include <numeric>
+#include <queue>
 #include <set>
 #include <string>
 #include <string_view>
@@ -31,11 +34,13 @@
 #include "libtransmission/crypto-utils.h" /* tr_rand_int() */
 #include "libtransmission/interned-string.h" // tr_interned_string
 #include "libtransmission/log.h"
+#include "libtransmission/metrics.h"
 #include "libtransmission/session.h"
 #include "libtransmission/timer.h"
 #include "libtransmission/torrent.h"
 #include "libtransmission/tr-assert.h"
 #include "libtransmission/tr-macros.h" // tr_sha1_digest_t, TR_C...
+#include "libtransmission/tracing.h"
 #include "libtransmission/utils.h"
 #include "libtransmission/web-utils.h"
 
@@ -54,9 +59,13 @@ auto constexpr DefaultScrapeIntervalSec = int{ 60 * 30 };
 /* the value of the 'numwant' argument passed in tracker requests. */
 auto constexpr Numwant = int{ 80 };
 
-/* how often to announce & scrape */
-auto constexpr MaxAnnouncesPerUpkeep = int{ 20 };
-auto constexpr MaxScrapesPerUpkeep = int{ 20 };
+/* how many announces can be in flight at once, across all trackers.
+ * Each tracker host also has its own adaptive limit; see tr_announce_host_limit. */
+auto constexpr MaxAnnouncesInFlight = size_t{ 512U };
+
+/* how many scrape requests to send per upkeep. Each one can hold
+ * up to tr_scrape_info::multiscrape_max torrents. */
+auto constexpr MaxScrapesPerUpkeep = size_t{ 20U };
 
 /* how many infohashes to remove when we get a scrape-too-long error */
 auto constexpr TrMultiscrapeStep = int{ 5 };
@@ -96,6 +105,8 @@ struct StopsCompare
 
 // ---
 
+struct tr_tier;
+
 struct tr_scrape_info
 {
     int multiscrape_max;
@@ -118,7 +129,7 @@ public:
     explicit tr_announcer_impl(tr_session* session_in, tr_announcer_udp& announcer_udp, std::atomic<size_t>& n_pending_stops)
         : session{ session_in }
         , announcer_udp_{ announcer_udp }
-        , upkeep_timer_{ session_in->timerMaker().create() }
+        , upkeep_timer_{ session_in->timerMaker().create(tr_source_location::current()) }
         , n_pending_stops_{ n_pending_stops }
     {
         upkeep_timer_->set_callback([this]() { this->upkeep(); });
@@ -149,6 +160,12 @@ public:
 
     void upkeep();
 
+    // Schedule `tier` to be announced at its `announceAt` time
+    void queueAnnounce(tr_tier const* tier);
+
+    // Announce the tiers whose time has come, as fast as their trackers allow
+    void announceMore(time_t now);
+
     void onAnnounceDone(int tier_id, tr_announce_event event, bool is_running_on_success, tr_announce_response const& response);
     void onScrapeDone(tr_scrape_response const& response);
 
@@ -159,7 +176,8 @@ public:
             return nullptr;
         }
 
-        auto const [it, is_new] = scrape_info_.try_emplace(url, url, TR_MULTISCRAPE_MAX);
+        auto const multiscrape_max = tr_strv_starts_with(url.sv(), "udp://"sv) ? TR_MULTISCRAPE_MAX : TR_HTTP_MULTISCRAPE_MAX;
+        auto const [it, is_new] = scrape_info_.try_emplace(url, url, multiscrape_max);
         return &it->second;
     }
 
@@ -216,9 +234,48 @@ public:
         }
     }
 
+    [[nodiscard]] tr_announce_host_limit& host_limit(tr_interned_string host_and_port)
+    {
+        return announce_hosts_[host_and_port];
+    }
+
+    void onAnnounceSent(tr_interned_string host_and_port)
+    {
+        host_limit(host_and_port).on_sent();
+        ++n_announces_in_flight_;
+    }
+
+    void onAnnounceResponse(tr_interned_string host_and_port, uint64_t sent_at_msec, tr_announce_response const& response)
+    {
+        auto const latency = std::chrono::milliseconds{ tr_time_msec() - sent_at_msec };
+        host_limit(host_and_port).on_done(response.did_connect && !response.did_timeout, latency);
+        tr_metrics::instance().observe_announce(host_and_port.sv(), latency);
+        if (n_announces_in_flight_ > 0U)
+        {
+            --n_announces_in_flight_;
+        }
+    }
+
+    [[nodiscard]] constexpr bool canAnnounceMore() const noexcept
+    {
+        return n_announces_in_flight_ < MaxAnnouncesInFlight;
+    }
+
     tr_session* const session;
 
 private:
+    struct announce_queue_entry
+    {
+        time_t announce_at;
+        tr_torrent_id_t tor_id;
+        int tier_id;
+
+        [[nodiscard]] constexpr bool operator>(announce_queue_entry const& that) const noexcept
+        {
+            return announce_at > that.announce_at;
+        }
+    };
+
     void flushCloseMessages()
     {
         for (auto& stop : stops_)
@@ -235,6 +292,15 @@ private:
 
     std::map<tr_interned_string, tr_scrape_info> scrape_info_;
 
+    std::map<tr_interned_string, tr_announce_host_limit> announce_hosts_;
+
+    // Tiers waiting to announce, soonest first. Entries aren't removed when a
+    // tier is rescheduled or its torrent goes away; stale ones are skipped
+    // when they reach the front of the queue.
+    std::priority_queue<announce_queue_entry, std::vector<announce_queue_entry>, std::greater<>> announce_queue_;
+
+    size_t n_announces_in_flight_ = 0U;
+
     std::unique_ptr<libtransmission::Timer> const upkeep_timer_;
 
     std::set<tr_announce_request, StopsCompare> stops_;
@@ -259,12 +325,9 @@ std::unique_ptr<tr_announcer> tr_announcer::create(
 /* a row in tr_tier's list of trackers */
 struct tr_tracker
 {
-    explicit tr_tracker(tr_announcer_impl* announcer, tr_announce_list::tracker_info const& info)
-        : host_and_port{ info.host_and_port }
-        , announce_url{ info.announce }
-        , sitename{ info.sitename }
-        , scrape_info{ std::empty(info.scrape) ? nullptr : announcer->scrape_info(info.scrape) }
-        , id{ info.id }
+    explicit tr_tracker(tr_announcer_impl* announcer, tr_announce_list::tracker_info const& info_in)
+        : info{ info_in }
+        , scrape_info{ std::empty(info_in.scrape) ? nullptr : announcer->scrape_info(info_in.scrape) }
     {
     }
 
@@ -295,9 +358,9 @@ struct tr_tracker
         }
     }
 
-    tr_interned_string const host_and_port;
-    tr_interned_string const announce_url;
-    std::string_view const sitename;
+    // the tracker's URLs, shared with every torrent that has the same
+    // trackers. Kept alive by tr_torrent_announcer::announce_list.
+    tr_announce_list::tracker_info const& info;
     tr_scrape_info* const scrape_info;
 
     std::string tracker_id;
@@ -308,8 +371,6 @@ struct tr_tracker
     int downloader_count = -1;
 
     int consecutive_failures = 0;
-
-    tr_tracker_id_t const id;
 };
 
 // format: `${host}:${port}`
@@ -328,13 +389,14 @@ tr_interned_string tr_announcerGetKey(tr_url_parsed_t const& parsed)
 /** @brief A group of trackers in a single tier, as per the multitracker spec */
 struct tr_tier
 {
-    tr_tier(tr_announcer_impl* announcer, tr_torrent* tor_in, std::vector<tr_announce_list::tracker_info const*> const& infos)
-        : tor{ tor_in }
+    tr_tier(tr_announcer_impl* announcer_in, tr_torrent* tor_in, std::vector<tr_announce_list::tracker_info const*> const& infos)
+        : announcer{ announcer_in }
+        , tor{ tor_in }
     {
         trackers.reserve(std::size(infos));
         for (auto const* info : infos)
         {
-            trackers.emplace_back(announcer, *info);
+            trackers.emplace_back(announcer_in, *info);
         }
         useNextTracker();
         scrapeSoon();
@@ -413,7 +475,7 @@ struct tr_tier
     {
         for (size_t i = 0, n = std::size(trackers); i < n; ++i)
         {
-            if (announce_url == trackers[i].announce_url)
+            if (announce_url == trackers[i].info.announce)
             {
                 return i;
             }
@@ -433,7 +495,7 @@ struct tr_tier
     {
         auto const* const torrent_name = tr_torrentName(tor);
         auto const* const current_tracker = currentTracker();
-        auto const host_and_port_sv = current_tracker == nullptr ? "?"sv : current_tracker->host_and_port.sv();
+        auto const host_and_port_sv = current_tracker == nullptr ? "?"sv : current_tracker->info.host_and_port.sv();
         *fmt::format_to_n(buf, buflen - 1, FMT_STRING("{:s} at {:s}"), torrent_name, host_and_port_sv).out = '\0';
     }
 
@@ -470,6 +532,8 @@ struct tr_tier
 
     std::optional<size_t> current_tracker_index_;
 
+    tr_announcer_impl* const announcer;
+
     tr_torrent* const tor;
 
     time_t scrapeAt = 0;
@@ -541,10 +605,10 @@ private:
 struct tr_torrent_announcer
 {
     tr_torrent_announcer(tr_announcer_impl* announcer, tr_torrent* tor)
+        : announce_list{ getAnnounceList(tor) }
     {
         // build the trackers
         auto tier_to_infos = std::map<tr_tracker_tier_t, std::vector<tr_announce_list::tracker_info const*>>{};
-        auto const announce_list = getAnnounceList(tor);
         for (auto const& info : announce_list)
         {
             tier_to_infos[info.tier].emplace_back(&info);
@@ -598,7 +662,7 @@ struct tr_torrent_announcer
         {
             for (auto const& tracker : tier.trackers)
             {
-                if (tracker.announce_url == announce_url)
+                if (tracker.info.announce == announce_url)
                 {
                     *setme_tier = &tier;
                     *setme_tracker = &tracker;
@@ -610,6 +674,9 @@ struct tr_torrent_announcer
         return false;
     }
 
+    // interned, so it's shared with the torrent and with other torrents
+    tr_announce_list const announce_list;
+
     std::vector<tr_tier> tiers;
 
     tr_tracker_callback callback;
@@ -625,6 +692,7 @@ private:
             announce_list.add(tor->session->defaultTrackers());
         }
 
+        announce_list.intern();
         return announce_list;
     }
 };
@@ -647,7 +715,7 @@ void publishMessage(tr_tier* tier, std::string_view msg, tr_tracker_event::Type
 
         if (auto const* const current_tracker = tier->currentTracker(); current_tracker != nullptr)
         {
-            event.announce_url = current_tracker->announce_url;
+            event.announce_url = current_tracker->info.announce;
         }
 
         ta->callback(*tier->tor, &event);
@@ -820,6 +888,7 @@ void tier_announce_event_push(tr_tier* tier, tr_announce_event e, time_t announc
     events.push_back(e);
     tier->announceAt = announce_at;
     tier_update_announce_priority(tier);
+    tier->announcer->queueAnnounce(tier);
 
     tr_logAddTrace_tier_announce_queue(tier);
     tr_logAddTraceTier(tier, fmt::format("announcing in {} seconds", difftime(announce_at, tr_time())));
@@ -847,7 +916,7 @@ void on_announce_error(tr_tier* tier, char const* err, tr_announce_event e)
     using namespace announce_helpers;
 
     auto* current_tracker = tier->currentTracker();
-    std::string const announce_url = current_tracker != nullptr ? tr_urlTrackerLogName(current_tracker->announce_url) :
+    std::string const announce_url = current_tracker != nullptr ? tr_urlTrackerLogName(current_tracker->info.announce) :
                                                                   "nullptr";
 
     /* increment the error count */
@@ -897,7 +966,7 @@ void on_announce_error(tr_tier* tier, char const* err, tr_announce_event e)
 
     auto req = tr_announce_request{};
     req.port = announcer->session->advertisedPeerPort();
-    req.announce_url = current_tracker->announce_url;
+    req.announce_url = current_tracker->info.announce;
     req.tracker_id = current_tracker->tracker_id;
     req.info_hash = tor->info_hash();
     req.peer_id = tor->peer_id();
@@ -951,6 +1020,8 @@ void tr_announcer_impl::onAnnounceDone(
     using namespace announce_helpers;
     using namespace publish_helpers;
 
+    TR_TRACE_SCOPE("announcer", "onAnnounceDone");
+
     auto* const tier = getTier(this, response.info_hash, tier_id);
     if (tier == nullptr)
     {
@@ -1240,7 +1311,7 @@ void on_scrape_error(tr_session const* /*session*/, tr_tier* tier, char const* e
 
     // schedule a rescrape
     auto const interval = current_tracker->getRetryInterval();
-    auto const* const host_and_port_cstr = current_tracker->host_and_port.c_str();
+    auto const* const host_and_port_cstr = current_tracker->info.host_and_port.c_str();
     tr_logAddDebugTier(
         tier,
         fmt::format("Tracker '{}' scrape error: {} (Retrying in {} seconds)", host_and_port_cstr, errmsg, interval));
@@ -1288,6 +1359,8 @@ void tr_announcer_impl::onScrapeDone(tr_scrape_response const& response)
     using namespace on_scrape_done_helpers;
     using namespace publish_helpers;
 
+    TR_TRACE_SCOPE("announcer", "onScrapeDone");
+
     auto const now = tr_time();
 
     for (int i = 0; i < response.row_count; ++i)
@@ -1389,10 +1462,9 @@ namespace
 void multiscrape(tr_announcer_impl* announcer, std::vector<tr_tier*> const& tiers)
 {
     auto const now = tr_time();
-    auto requests = std::array<tr_scrape_request, MaxScrapesPerUpkeep>{};
-    auto request_count = size_t{};
 
-    // batch as many info_hashes into a request as we can
+    // group the tiers by scrape URL
+    auto groups = std::map<tr_interned_string, std::vector<tr_tier*>>{};
     for (auto* tier : tiers)
     {
         auto const* const current_tracker = tier->currentTracker();
@@ -1409,58 +1481,51 @@ void multiscrape(tr_announcer_impl* announcer, std::vector<tr_tier*> const& tier
             continue;
         }
 
-        bool found = false;
+        groups[scrape_info->scrape_url].push_back(tier);
+    }
 
-        /* if there's a request with this scrape URL and a free slot, use it */
-        for (size_t j = 0; !found && j < request_count; ++j)
-        {
-            auto* const req = &requests[j];
+    // Send each tracker the largest batches it accepts. Take turns between
+    // trackers so that one busy tracker can't use up all of the requests.
+    auto pending = std::vector<std::pair<tr_scrape_info*, std::vector<tr_tier*>::const_iterator>>{};
+    pending.reserve(std::size(groups));
+    for (auto const& [scrape_url, group] : groups)
+    {
+        pending.emplace_back(announcer->scrape_info(scrape_url), std::begin(group));
+    }
 
-            if (req->info_hash_count >= scrape_info->multiscrape_max)
-            {
-                continue;
-            }
+    auto request_count = size_t{};
+    auto request = tr_scrape_request{};
+    while (!std::empty(pending) && request_count < MaxScrapesPerUpkeep)
+    {
+        for (auto it = std::begin(pending); it != std::end(pending) && request_count < MaxScrapesPerUpkeep;)
+        {
+            auto& [scrape_info, next] = *it;
+            auto const group_end = std::end(groups[scrape_info->scrape_url]);
 
-            if (scrape_info->scrape_url != req->scrape_url)
+            request.scrape_url = scrape_info->scrape_url;
+            (*next)->buildLogName(request.log_name, sizeof(request.log_name));
+            request.info_hash_count = 0;
+            for (; next != group_end && request.info_hash_count < scrape_info->multiscrape_max; ++next)
             {
-                continue;
+                auto* const tier = *next;
+                request.info_hash[request.info_hash_count++] = tier->tor->info_hash();
+                tier->isScraping = true;
+                tier->lastScrapeStartTime = now;
             }
 
-            req->info_hash[req->info_hash_count] = tier->tor->info_hash();
-            ++req->info_hash_count;
-            tier->isScraping = true;
-            tier->lastScrapeStartTime = now;
-            found = true;
-        }
-
-        /* otherwise, if there's room for another request, build a new one */
-        if (!found && request_count < MaxScrapesPerUpkeep)
-        {
-            auto* const req = &requests[request_count];
-            req->scrape_url = scrape_info->scrape_url;
-            tier->buildLogName(req->log_name, sizeof(req->log_name));
-
-            req->info_hash[req->info_hash_count] = tier->tor->info_hash();
-            ++req->info_hash_count;
-            tier->isScraping = true;
-            tier->lastScrapeStartTime = now;
-
+            announcer->scrape(
+                request,
+                [session = announcer->session, announcer](tr_scrape_response const& response)
+                {
+                    if (session->announcer_)
+                    {
+                        announcer->onScrapeDone(response);
+                    }
+                });
             ++request_count;
-        }
-    }
 
-    /* send the requests we just built */
-    for (size_t i = 0; i < request_count; ++i)
-    {
-        announcer->scrape(
-            requests[i],
-            [session = announcer->session, announcer](tr_scrape_response const& response)
-            {
-                if (session->announcer_)
-                {
-                    announcer->onScrapeDone(response);
-                }
-            });
+            it = next == group_end ? pending.erase(it) : std::next(it);
+        }
     }
 }
 
@@ -1525,34 +1590,33 @@ void tierAnnounce(tr_announcer_impl* announcer, tr_tier* tier)
 
     auto tier_id = tier->id;
     auto is_running_on_success = tor->is_running();
+    auto const host_and_port = tier->currentTracker()->info.host_and_port;
+    auto const sent_at_msec = tr_time_msec();
 
+    announcer->onAnnounceSent(host_and_port);
     announcer->announce(
         req,
-        [session = announcer->session, announcer, tier_id, event, is_running_on_success](tr_announce_response const& response)
+        [session = announcer->session, announcer, tier_id, event, is_running_on_success, host_and_port, sent_at_msec](
+            tr_announce_response const& response)
         {
             if (session->announcer_)
             {
+                announcer->onAnnounceResponse(host_and_port, sent_at_msec, response);
                 announcer->onAnnounceDone(tier_id, event, is_running_on_success, response);
             }
         });
 }
 
-void scrapeAndAnnounceMore(tr_announcer_impl* announcer)
+void scrapeMore(tr_announcer_impl* announcer)
 {
     auto const now = tr_time();
 
-    /* build a list of tiers that need to be announced */
-    auto announce_me = std::vector<tr_tier*>{};
+    /* build a list of tiers that need to be scraped */
     auto scrape_me = std::vector<tr_tier*>{};
     for (auto* const tor : announcer->session->torrents())
     {
         for (auto& tier : tor->torrent_announcer->tiers)
         {
-            if (tier.needsToAnnounce(now))
-            {
-                announce_me.push_back(&tier);
-            }
-
             if (tier.needsToScrape(now))
             {
                 scrape_me.push_back(&tier);
@@ -1560,37 +1624,83 @@ void scrapeAndAnnounceMore(tr_announcer_impl* announcer)
         }
     }
 
-    /* First, scrape what we can. We handle scrapes first because
-     * we can work through that queue much faster than announces
-     * (thanks to multiscrape) _and_ the scrape responses will tell
-     * us which swarms are interesting and should be announced next. */
     multiscrape(announcer, scrape_me);
+}
+} // namespace upkeep_helpers
+} // namespace
 
-    /* Second, announce what we can. If there aren't enough slots
-     * available, use compareAnnounceTiers to prioritize. */
-    if (announce_me.size() > MaxAnnouncesPerUpkeep)
+void tr_announcer_impl::queueAnnounce(tr_tier const* tier)
+{
+    if (tier->announceAt != 0)
     {
-        std::partial_sort(
-            std::begin(announce_me),
-            std::begin(announce_me) + MaxAnnouncesPerUpkeep,
-            std::end(announce_me),
-            [](auto const* a, auto const* b) { return compareAnnounceTiers(a, b) < 0; });
-        announce_me.resize(MaxAnnouncesPerUpkeep);
+        announce_queue_.push({ tier->announceAt, tier->tor->id(), tier->id });
     }
+}
+
+void tr_announcer_impl::announceMore(time_t now)
+{
+    using namespace upkeep_helpers;
 
-    for (auto*& tier : announce_me)
+    // pull the tiers whose time has come out of the queue
+    auto due = std::vector<tr_tier*>{};
+    auto busy = std::vector<tr_tier*>{};
+    while (!std::empty(announce_queue_) && announce_queue_.top().announce_at <= now)
     {
+        auto const entry = announce_queue_.top();
+        announce_queue_.pop();
+
+        auto* const tor = session->torrents().get(entry.tor_id);
+        auto* const tier = tor == nullptr || tor->torrent_announcer == nullptr ? nullptr :
+                                                                                 tor->torrent_announcer->getTier(entry.tier_id);
+        if (tier == nullptr || tier->announceAt != entry.announce_at || std::empty(tier->announce_events) ||
+            tier->currentTracker() == nullptr)
+        {
+            continue; // stale entry
+        }
+
+        // a tier that's busy now will still need to announce when it's done
+        (tier->isAnnouncing || tier->isScraping ? busy : due).push_back(tier);
+    }
+
+    // a tier may have been queued more than once for the same time
+    for (auto* list : { &due, &busy })
+    {
+        std::sort(std::begin(*list), std::end(*list));
+        list->erase(std::unique(std::begin(*list), std::end(*list)), std::end(*list));
+    }
+
+    /* If there are more due tiers than the trackers will take right now,
+     * use compareAnnounceTiers to prioritize. */
+    std::sort(
+        std::begin(due),
+        std::end(due),
+        [](auto const* a, auto const* b) { return compareAnnounceTiers(a, b) < 0; });
+
+    for (auto* const tier : due)
+    {
+        if (!canAnnounceMore() || !host_limit(tier->currentTracker()->info.host_and_port).can_send())
+        {
+            busy.push_back(tier);
+            continue;
+        }
+
         tr_logAddTraceTier(tier, "Announcing to tracker");
-        tierAnnounce(announcer, tier);
+        tierAnnounce(this, tier);
+    }
+
+    // try the rest again on the next upkeep
+    for (auto const* const tier : busy)
+    {
+        queueAnnounce(tier);
     }
 }
-} // namespace upkeep_helpers
-} // namespace
 
 void tr_announcer_impl::upkeep()
 {
     using namespace upkeep_helpers;
 
+    TR_TRACE_SCOPE("announcer", "upkeep");
+
     auto const lock = session->unique_lock();
 
     // maybe send out some "stopped" messages for closed torrents
@@ -1599,7 +1709,12 @@ void tr_announcer_impl::upkeep()
     // maybe kick off some scrapes / announces whose time has come
     if (!is_shutting_down_)
     {
-        scrapeAndAnnounceMore(this);
+        /* Scrape first. We can work through that queue much faster
+         * than announces (thanks to multiscrape) _and_ the scrape
+         * responses tell us which swarms are interesting and should
+         * be announced next. */
+        scrapeMore(this);
+        announceMore(tr_time());
     }
 
     announcer_udp_.upkeep();
@@ -1616,15 +1731,15 @@ namespace tracker_view_helpers
     auto const now = tr_time();
     auto view = tr_tracker_view{};
 
-    view.host_and_port = tracker.host_and_port.c_str();
-    view.announce = tracker.announce_url.c_str();
+    view.host_and_port = tracker.info.host_and_port.c_str();
+    view.announce = tracker.info.announce.c_str();
     view.scrape = tracker.scrape_info == nullptr ? "" : tracker.scrape_info->scrape_url.c_str();
     *std::copy_n(
-        std::begin(tracker.sitename),
-        std::min(std::size(tracker.sitename), sizeof(view.sitename) - 1),
+        std::begin(tracker.info.sitename),
+        std::min(std::size(tracker.info.sitename), sizeof(view.sitename) - 1),
         view.sitename) = '\0';
 
-    view.id = tracker.id;
+    view.id = tracker.info.id;
     view.tier = tier_index;
     view.isBackup = &tracker != tier.currentTracker();
     view.lastScrapeStartTime = tier.lastScrapeStartTime;
@@ -1767,7 +1882,7 @@ void tr_announcer_impl::resetTorrent(tr_torrent* tor)
             {
                 tr_tier const* old_tier = nullptr;
                 tr_tracker const* old_tracker = nullptr;
-                if (older->findTracker(new_tracker.announce_url, &old_tier, &old_tracker))
+                if (older->findTracker(new_tracker.info.announce, &old_tier, &old_tracker))
                 {
                     new_tracker.seeder_count = old_tracker->seeder_count;
                     new_tracker.leecher_count = old_tracker->leecher_count;
@@ -1779,7 +1894,7 @@ void tr_announcer_impl::resetTorrent(tr_torrent* tor)
 
                     auto const* const old_current = old_tier->currentTracker();
                     new_tier.current_tracker_index_ = old_current == nullptr ? std::nullopt :
-                                                                               new_tier.indexOf(old_current->announce_url);
+                                                                               new_tier.indexOf(old_current->info.announce);
                 }
             }
         }
@@ -32,6 +32,7 @@
 
 struct tr_address;
 class tr_announcer_udp;
+class tr_dns;
 struct tr_session;
 struct tr_torrent;
 struct tr_torrent_announcer;
@@ -144,6 +145,9 @@ public:
         virtual ~Mediator() noexcept = default;
         virtual void sendto(void const* buf, size_t buflen, sockaddr const* addr, socklen_t addrlen) = 0;
         [[nodiscard]] virtual std::optional<tr_address> announce_ip() const = 0;
+
+        // looks up trackers' addresses
+        [[nodiscard]] virtual tr_dns& dns() = 0;
     };
 
     virtual ~tr_announcer_udp() noexcept = default;
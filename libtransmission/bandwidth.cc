@@ -19,59 +19,58 @@
 #include "libtransmission/tr-assert.h"
 #include "libtransmission/utils.h" // tr_time_msec()
 
-tr_bytes_per_second_t tr_bandwidth::get_speed_bytes_per_second(RateControl& r, unsigned int interval_msec, uint64_t now)
+tr_bytes_per_second_t tr_bandwidth::get_speed_bytes_per_second(RateControl& r, uint64_t now)
 {
     if (now == 0)
     {
         now = tr_time_msec();
     }
 
-    if (now != r.cache_time_)
-    {
-        uint64_t bytes = 0;
-        uint64_t const cutoff = now - interval_msec;
+    return static_cast<tr_bytes_per_second_t>(r.sum(now) * 1000U / RateControl::WindowMSec);
+}
 
-        for (int i = r.newest_; r.date_[i] > cutoff;)
-        {
-            bytes += r.size_[i];
+void tr_bandwidth::notify_bandwidth_consumed_bytes(uint64_t const now, RateControl* r, size_t size)
+{
+    r->add(now, size);
+}
 
-            if (--i == -1)
-            {
-                i = HistorySize - 1; /* circular history */
-            }
+// ---
 
-            if (i == r.newest_)
-            {
-                break; /* we've come all the way around */
-            }
-        }
+void tr_bandwidth::TokenBucket::refill(tr_bytes_per_second_t rate, uint64_t burst_msec, uint64_t now_msec) noexcept
+{
+    auto then = refilled_at_msec_.load(std::memory_order_relaxed);
+    if (now_msec <= then)
+    {
+        return;
+    }
 
-        r.cache_val_ = static_cast<tr_bytes_per_second_t>(bytes * 1000U / interval_msec);
-        r.cache_time_ = now;
+    // if another thread won the race, it's already added these tokens
+    if (!refilled_at_msec_.compare_exchange_strong(then, now_msec, std::memory_order_relaxed))
+    {
+        return;
     }
 
-    return r.cache_val_;
-}
+    auto const burst = static_cast<size_t>(uint64_t{ rate } * burst_msec / 1000U);
+    auto const elapsed_msec = std::min(now_msec - then, burst_msec);
+    auto const added = static_cast<size_t>(uint64_t{ rate } * elapsed_msec / 1000U);
 
-void tr_bandwidth::notify_bandwidth_consumed_bytes(uint64_t const now, RateControl* r, size_t size)
-{
-    if (r->date_[r->newest_] + GranularityMSec >= now)
+    auto tokens = tokens_.load(std::memory_order_relaxed);
+    while (!tokens_.compare_exchange_weak(tokens, std::min(tokens + added, burst), std::memory_order_relaxed))
     {
-        r->size_[r->newest_] += size;
     }
-    else
-    {
-        if (++r->newest_ == HistorySize)
-        {
-            r->newest_ = 0;
-        }
 
-        r->date_[r->newest_] = now;
-        r->size_[r->newest_] = size;
+    if (auto const wanted = tokens + added; wanted > burst)
+    {
+        unused_.fetch_add(wanted - burst, std::memory_order_relaxed);
     }
+}
 
-    /* invalidate cache_val*/
-    r->cache_time_ = 0;
+void tr_bandwidth::TokenBucket::consume(size_t n_bytes) noexcept
+{
+    auto tokens = tokens_.load(std::memory_order_relaxed);
+    while (!tokens_.compare_exchange_weak(tokens, tokens - std::min(tokens, n_bytes), std::memory_order_relaxed))
+    {
+    }
 }
 
 // ---
@@ -137,17 +136,18 @@ void tr_bandwidth::set_parent(tr_bandwidth* new_parent)
 void tr_bandwidth::allocate_bandwidth(
     tr_priority_t parent_priority,
     unsigned int period_msec,
+    uint64_t now_msec,
     std::vector<std::shared_ptr<tr_peerIo>>& peer_pool)
 {
     auto const priority = std::max(parent_priority, this->priority_);
 
-    // set the available bandwidth
+    // top up the available bandwidth
     for (auto const dir : { TR_UP, TR_DOWN })
     {
         if (auto& bandwidth = band_[dir]; bandwidth.is_limited_)
         {
-            auto const next_pulse_speed = bandwidth.desired_speed_bps_;
-            bandwidth.bytes_left_ = next_pulse_speed * period_msec / 1000U;
+            bandwidth.burst_msec_ = period_msec;
+            bandwidth.bucket_.refill(bandwidth.desired_speed_bps_, bandwidth.burst_msec_, now_msec);
         }
     }
 
@@ -161,7 +161,7 @@ void tr_bandwidth::allocate_bandwidth(
     // traverse & repeat for the subtree
     for (auto* child : this->children_)
     {
-        child->allocate_bandwidth(priority, period_msec, peer_pool);
+        child->allocate_bandwidth(priority, period_msec, now_msec, peer_pool);
     }
 }
 
@@ -203,12 +203,13 @@ void tr_bandwidth::phase_one(std::vector<tr_peerIo*>& peers, tr_direction dir)
     }
 }
 
-void tr_bandwidth::allocate(unsigned int period_msec)
+size_t tr_bandwidth::allocate(unsigned int period_msec)
 {
-    // keep these peers alive for the scope of this function
-    auto refs = std::vector<std::shared_ptr<tr_peerIo>>{};
-
-    auto peer_arrays = std::array<std::vector<tr_peerIo*>, 3>{};
+    // Reuse the same scratch arrays on every call so that allocating
+    // bandwidth doesn't churn the heap. `refs` keeps the peers alive
+    // for the scope of this function.
+    thread_local auto refs = std::vector<std::shared_ptr<tr_peerIo>>{};
+    thread_local auto peer_arrays = std::array<std::vector<tr_peerIo*>, 3>{};
     auto& high = peer_arrays[0];
     auto& normal = peer_arrays[1];
     auto& low = peer_arrays[2];
@@ -216,7 +217,7 @@ void tr_bandwidth::allocate(unsigned int period_msec)
     // allocateBandwidth () is a helper function with two purposes:
     // 1. allocate bandwidth to b and its subtree
     // 2. accumulate an array of all the peerIos from b and its subtree.
-    this->allocate_bandwidth(TR_PRI_LOW, period_msec, refs);
+    this->allocate_bandwidth(TR_PRI_LOW, period_msec, tr_time_msec(), refs);
 
     for (auto const& io : refs)
     {
@@ -251,11 +252,27 @@ void tr_bandwidth::allocate(unsigned int period_msec)
     // enable on-demand IO for peers with bandwidth left to burn.
     // This on-demand IO is enabled until (1) the peer runs out of bandwidth,
     // or (2) the next tr_bandwidth::allocate () call, when we start over again.
+    auto n_starved = size_t{};
     for (auto const& io : refs)
     {
-        io->set_enabled(TR_UP, io->has_bandwidth_left(TR_UP));
-        io->set_enabled(TR_DOWN, io->has_bandwidth_left(TR_DOWN));
+        auto const can_write = io->has_bandwidth_left(TR_UP);
+        auto const can_read = io->has_bandwidth_left(TR_DOWN);
+        io->set_enabled(TR_UP, can_write);
+        io->set_enabled(TR_DOWN, can_read);
+
+        if (!can_read || !can_write)
+        {
+            ++n_starved;
+        }
     }
+
+    for (auto& peers : peer_arrays)
+    {
+        peers.clear();
+    }
+    refs.clear();
+
+    return n_starved;
 }
 
 // ---
@@ -264,18 +281,20 @@ size_t tr_bandwidth::clamp(uint64_t now, tr_direction dir, size_t byte_count) co
 {
     TR_ASSERT(tr_isDirection(dir));
 
-    if (this->band_[dir].is_limited_)
+    if (auto& band = this->band_[dir]; band.is_limited_)
     {
-        byte_count = std::min(byte_count, this->band_[dir].bytes_left_);
+        if (now == 0)
+        {
+            now = tr_time_msec();
+        }
+
+        band.bucket_.refill(band.desired_speed_bps_, band.burst_msec_, now);
+        byte_count = std::min(byte_count, band.bucket_.available());
 
         /* if we're getting close to exceeding the speed limit,
          * clamp down harder on the bytes available */
         if (byte_count > 0)
         {
-            if (now == 0)
-            {
-                now = tr_time_msec();
-            }
 
             auto const current = this->get_raw_speed_bytes_per_second(now, dir);
             auto const desired = this->get_desired_speed_bytes_per_second(dir);
@@ -305,14 +324,24 @@ size_t tr_bandwidth::clamp(uint64_t now, tr_direction dir, size_t byte_count) co
 }
 
 void tr_bandwidth::notify_bandwidth_consumed(tr_direction dir, size_t byte_count, bool is_piece_data, uint64_t now)
+{
+    notify_bandwidth_consumed(dir, byte_count, is_piece_data, now, true);
+}
+
+void tr_bandwidth::notify_bandwidth_consumed(
+    tr_direction dir,
+    size_t byte_count,
+    bool is_piece_data,
+    uint64_t now,
+    bool debit_bucket)
 {
     TR_ASSERT(tr_isDirection(dir));
 
     Band* band = &this->band_[dir];
 
-    if (band->is_limited_ && is_piece_data)
+    if (band->is_limited_ && is_piece_data && debit_bucket)
     {
-        band->bytes_left_ -= std::min(size_t{ band->bytes_left_ }, byte_count);
+        band->bucket_.consume(byte_count);
     }
 
 #ifdef DEBUG_DIRECTION
@@ -338,9 +367,16 @@ void tr_bandwidth::notify_bandwidth_consumed(tr_direction dir, size_t byte_count
         notify_bandwidth_consumed_bytes(now, &band->piece_, byte_count);
     }
 
+    // the parents still count this in their speeds, but bytes that
+    // weren't clamped by their limits don't use up their allowance
     if (this->parent_ != nullptr)
     {
-        this->parent_->notify_bandwidth_consumed(dir, byte_count, is_piece_data, now);
+        this->parent_->notify_bandwidth_consumed(
+            dir,
+            byte_count,
+            is_piece_data,
+            now,
+            debit_bucket && band->honor_parent_limits_);
     }
 }
 
@@ -10,6 +10,7 @@
 #endif
 
 #include <array>
+#include <atomic>
 #include <cstddef> // size_t
 #include <cstdint> // uint64_t
 #include <memory>
@@ -18,6 +19,7 @@
 
 #include "transmission.h"
 
+#include "history.h"
 #include "tr-assert.h"
 
 class tr_peerIo;
@@ -62,10 +64,15 @@ struct tr_bandwidth_limits
  *
  * CONSTRAINING
  *
- *   Call `tr_bandwidth::allocate()` periodically. `tr_bandwidth` knows its current
- *   speed and will decide how many bytes to make available over the
- *   user-specified period to reach the user-specified desired speed.
- *   If appropriate, it notifies its peer-ios that new bandwidth is available.
+ *   Each limited `tr_bandwidth` has a token bucket per direction. The bucket
+ *   refills continuously at the desired speed, up to a burst of one
+ *   allocation period's worth of bytes, so peer-ios can spend bandwidth as
+ *   soon as it accrues instead of waiting for the next allocation.
+ *   Consuming bytes debits the bucket atomically.
+ *
+ *   Call `tr_bandwidth::allocate()` periodically. It tops up the buckets and
+ *   hands out the bandwidth round-robin so that fast peers can't starve the
+ *   others, then wakes the peer-ios that still have bandwidth to burn.
  *
  *   `tr_bandwidth::allocate()` operates on the `tr_bandwidth` subtree, so usually
  *   you'll only need to invoke it for the top-level `tr_session` bandwidth.
@@ -81,6 +88,7 @@ private:
     static constexpr size_t IntervalMSec = HistoryMSec;
     static constexpr size_t GranularityMSec = 250;
     static constexpr size_t HistorySize = (IntervalMSec / GranularityMSec);
+    static constexpr uint64_t DefaultBurstMSec = 500U;
 
 public:
     explicit tr_bandwidth(tr_bandwidth* newParent);
@@ -114,8 +122,10 @@ public:
 
     /**
      * @brief allocate the next `period_msec`'s worth of bandwidth for the peer-ios to consume
+     * `period_msec` is also the size of the token buckets' burst allowance.
+     * @return the number of peer-ios that used up their bandwidth before the next allocation
      */
-    void allocate(unsigned int period_msec);
+    size_t allocate(unsigned int period_msec);
 
     void set_parent(tr_bandwidth* new_parent);
 
@@ -142,7 +152,7 @@ public:
     {
         TR_ASSERT(tr_isDirection(dir));
 
-        return get_speed_bytes_per_second(this->band_[dir].raw_, HistoryMSec, now);
+        return get_speed_bytes_per_second(this->band_[dir].raw_, now);
     }
 
     /** @brief Get the number of piece data bytes read or sent by this bandwidth subtree. */
@@ -150,7 +160,7 @@ public:
     {
         TR_ASSERT(tr_isDirection(dir));
 
-        return get_speed_bytes_per_second(this->band_[dir].piece_, HistoryMSec, now);
+        return get_speed_bytes_per_second(this->band_[dir].piece_, now);
     }
 
     /**
@@ -227,31 +237,66 @@ public:
         return this->band_[direction].honor_parent_limits_;
     }
 
+    /**
+     * @brief Get how many bytes of this bandwidth's allowance went unused.
+     * These are tokens that were discarded because the bucket was already
+     * full, i.e. the speed limit allowed them but nobody was there to use them.
+     */
+    [[nodiscard]] uint64_t get_unused_bytes(tr_direction dir) const noexcept
+    {
+        TR_ASSERT(tr_isDirection(dir));
+
+        return this->band_[dir].bucket_.unused();
+    }
+
     [[nodiscard]] tr_bandwidth_limits get_limits() const;
 
     void set_limits(tr_bandwidth_limits const* limits);
 
 private:
-    struct RateControl
+    using RateControl = tr_rollingSum<HistorySize, GranularityMSec>;
+    static_assert(RateControl::WindowMSec == HistoryMSec);
+
+    // A token bucket that can be debited from any thread.
+    class TokenBucket
     {
-        std::array<uint64_t, HistorySize> date_;
-        std::array<size_t, HistorySize> size_;
-        uint64_t cache_time_;
-        tr_bytes_per_second_t cache_val_;
-        int newest_;
+    public:
+        // add `rate` bytes per second for the time since the last refill,
+        // keeping at most `burst_msec`'s worth of tokens in the bucket
+        void refill(tr_bytes_per_second_t rate, uint64_t burst_msec, uint64_t now_msec) noexcept;
+
+        // remove up to `n_bytes` tokens from the bucket
+        void consume(size_t n_bytes) noexcept;
+
+        [[nodiscard]] size_t available() const noexcept
+        {
+            return tokens_.load(std::memory_order_relaxed);
+        }
+
+        // the number of tokens that overflowed a full bucket
+        [[nodiscard]] uint64_t unused() const noexcept
+        {
+            return unused_.load(std::memory_order_relaxed);
+        }
+
+    private:
+        std::atomic<size_t> tokens_ = {};
+        std::atomic<uint64_t> unused_ = {};
+        std::atomic<uint64_t> refilled_at_msec_ = {};
     };
 
     struct Band
     {
         RateControl raw_;
         RateControl piece_;
-        size_t bytes_left_;
+        TokenBucket bucket_;
+        uint64_t burst_msec_ = DefaultBurstMSec;
         tr_bytes_per_second_t desired_speed_bps_;
         bool is_limited_ = false;
         bool honor_parent_limits_ = true;
     };
 
-    static tr_bytes_per_second_t get_speed_bytes_per_second(RateControl& r, unsigned int interval_msec, uint64_t now);
+    static tr_bytes_per_second_t get_speed_bytes_per_second(RateControl& r, uint64_t now);
 
     [[nodiscard]] constexpr auto* parent() noexcept
     {
@@ -262,6 +307,8 @@ private:
 
     static void notify_bandwidth_consumed_bytes(uint64_t now, RateControl* r, size_t size);
 
+    void notify_bandwidth_consumed(tr_direction dir, size_t byte_count, bool is_piece_data, uint64_t now, bool debit_bucket);
+
     [[nodiscard]] size_t clamp(uint64_t now, tr_direction dir, size_t byte_count) const;
 
     static void phase_one(std::vector<tr_peerIo*>& peers, tr_direction dir);
@@ -269,6 +316,7 @@ private:
     void allocate_bandwidth(
         tr_priority_t parent_priority,
         unsigned int period_msec,
+        uint64_t now_msec,
         std::vector<std::shared_ptr<tr_peerIo>>& peer_pool);
 
     mutable std::array<Band, 2> band_ = {};
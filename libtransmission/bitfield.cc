@@ -4,6 +4,10 @@
 // License text can be found in the licenses/ folder.
 
 #include <algorithm> // std::copy, std::fill_n, std::min, std::max
+#include <cstddef> // ptrdiff_t, size_t
+#include <cstdint> // uint8_t, uint32_t, uint64_t
+#include <cstring> // std::memcpy
+#include <functional> // std::bit_and, std::bit_or
 #include <vector> // std::vector
 
 #include "libtransmission/bitfield.h"
@@ -50,16 +54,48 @@ void setAllTrue(uint8_t* array, size_t bit_count)
 /* Switch to std::popcount if project upgrades to c++20 or newer */
 [[nodiscard]] uint32_t doPopcount(uint8_t flags) noexcept
 {
-    /* If flags are ever expanded to use machine words instead of
-       uint8_t popcnt64 is also available */
     return tr_popcnt<uint8_t>::count(flags);
 }
 
+// The bulk operations below work on the byte array a machine word at a
+// time. The bytes keep their BEP0003 order, which doesn't matter to
+// popcount or to bitwise ops, so no byte swapping is needed. The loops
+// are simple enough for compilers to vectorize.
+using Word = uint64_t;
+
+[[nodiscard]] Word loadWord(uint8_t const* bytes) noexcept
+{
+    auto word = Word{};
+    std::memcpy(&word, bytes, sizeof(word));
+    return word;
+}
+
+void storeWord(uint8_t* bytes, Word word) noexcept
+{
+    std::memcpy(bytes, &word, sizeof(word));
+}
+
+[[nodiscard]] uint32_t doPopcount(Word flags) noexcept
+{
+    return tr_popcnt<Word>::count(flags);
+}
+
 [[nodiscard]] size_t rawCountFlags(uint8_t const* flags, size_t n) noexcept
 {
     auto ret = size_t{};
 
-    for (auto const* const end = flags + n; flags != end; ++flags)
+    /* Use 2x accumulators to help alleviate high latency of
+       popcnt instruction on many architectures. */
+    auto tmp_accum = size_t{};
+    auto const* const end = flags + n;
+    for (; end - flags >= static_cast<ptrdiff_t>(sizeof(Word) * 2); flags += sizeof(Word) * 2)
+    {
+        ret += doPopcount(loadWord(flags));
+        tmp_accum += doPopcount(loadWord(flags + sizeof(Word)));
+    }
+    ret += tmp_accum;
+
+    for (; flags != end; ++flags)
     {
         ret += doPopcount(*flags);
     }
@@ -67,88 +103,199 @@ void setAllTrue(uint8_t* array, size_t bit_count)
     return ret;
 }
 
-} // namespace
+// @return the number of bits that are set in both `a` and `b`
+[[nodiscard]] size_t rawAndCount(uint8_t const* a, uint8_t const* b, size_t n) noexcept
+{
+    auto ret = size_t{};
 
-// ---
+    auto i = size_t{};
+    for (; n - i >= sizeof(Word); i += sizeof(Word))
+    {
+        ret += doPopcount(loadWord(a + i) & loadWord(b + i));
+    }
 
-size_t tr_bitfield::count_flags() const noexcept
-{
-    return rawCountFlags(std::data(flags_), std::size(flags_));
+    for (; i < n; ++i)
+    {
+        ret += doPopcount(static_cast<uint8_t>(a[i] & b[i]));
+    }
+
+    return ret;
 }
 
-size_t tr_bitfield::count_flags(size_t begin, size_t end) const noexcept
+// tgt[i] = op(tgt[i], src[i]) for i in [0..n)
+template<typename BinaryOp>
+void rawTransform(uint8_t* tgt, uint8_t const* src, size_t n, BinaryOp op) noexcept
 {
-    auto ret = size_t{};
-    size_t const first_byte = begin >> 3U;
-    size_t const last_byte = (end - 1) >> 3U;
-
-    if (bit_count_ == 0)
+    auto i = size_t{};
+    for (; n - i >= sizeof(Word); i += sizeof(Word))
     {
-        return 0;
+        storeWord(tgt + i, op(loadWord(tgt + i), loadWord(src + i)));
     }
 
-    if (first_byte >= std::size(flags_))
+    for (; i < n; ++i)
     {
-        return 0;
+        tgt[i] = static_cast<uint8_t>(op(tgt[i], src[i]));
     }
+}
 
+// @return the number of bits set in [begin, end) of `flags`.
+// Bytes at or past `n_bytes` are treated as zero.
+[[nodiscard]] size_t rawCountRange(uint8_t const* flags, size_t n_bytes, size_t begin, size_t end) noexcept
+{
     TR_ASSERT(begin < end);
-    TR_ASSERT(!std::empty(flags_));
+
+    size_t const first_byte = begin >> 3U;
+    size_t const last_byte = (end - 1) >> 3U;
+
+    if (first_byte >= n_bytes)
+    {
+        return 0;
+    }
 
     if (first_byte == last_byte)
     {
-        uint8_t val = flags_[first_byte];
+        uint8_t val = flags[first_byte];
 
         auto i = begin & 7U;
         val <<= i;
         i = (begin - end) & 7U;
         val >>= i;
-        ret = doPopcount(val);
+        return doPopcount(val);
     }
-    else
+
+    size_t const walk_end = std::min(n_bytes, last_byte);
+
+    /* first byte */
+    size_t const first_shift = begin & 7U;
+    uint8_t val = flags[first_byte];
+    val <<= first_shift;
+    /* No need to shift back val for correct popcount. */
+    auto ret = size_t{ doPopcount(val) };
+
+    /* middle bytes */
+    if (walk_end > first_byte + 1)
     {
-        size_t const walk_end = std::min(std::size(flags_), last_byte);
+        ret += rawCountFlags(flags + first_byte + 1, walk_end - (first_byte + 1));
+    }
 
-        /* first byte */
-        size_t const first_shift = begin & 7U;
-        uint8_t val = flags_[first_byte];
-        val <<= first_shift;
+    /* last byte */
+    if (last_byte < n_bytes)
+    {
+        /* -end & 7U. Since bitcount is unsigned do ~end + 1 to
+           replace -end as linters warn about negating unsigned
+           types. Any compiler will optimize ~x + 1 to -x in the
+           backend. */
+        uint32_t const last_shift = (~end + 1) & 7U;
+        val = flags[last_byte];
+        val >>= last_shift;
         /* No need to shift back val for correct popcount. */
-        ret = doPopcount(val);
+        ret += doPopcount(val);
+    }
+
+    return ret;
+}
 
-        /* middle bytes */
+// Sets bits [begin, end) of `flags` to `value`
+void rawSetRange(uint8_t* flags, size_t begin, size_t end, bool value) noexcept
+{
+    TR_ASSERT(begin < end);
 
-        /* Use 2x accumulators to help alleviate high latency of
-           popcnt instruction on many architectures. */
-        size_t tmp_accum = 0;
-        for (size_t i = first_byte + 1; i < walk_end;)
+    --end;
+    auto walk = begin >> 3;
+    auto const last_byte = end >> 3;
+
+    unsigned char first_mask = 0xff >> (begin & 7U);
+    unsigned char last_mask = 0xff << ((~end) & 7U);
+    if (value)
+    {
+        if (walk == last_byte)
+        {
+            flags[walk] |= first_mask & last_mask;
+        }
+        else
         {
-            tmp_accum += doPopcount(flags_[i]);
-            i += 2;
-            if (i > walk_end)
+            flags[walk] |= first_mask;
+            flags[last_byte] |= last_mask;
+            if (++walk < last_byte)
             {
-                break;
+                std::fill_n(flags + walk, last_byte - walk, 0xff);
             }
-            ret += doPopcount(flags_[i - 1]);
         }
-        ret += tmp_accum;
+    }
+    else
+    {
+        first_mask = ~first_mask;
+        last_mask = ~last_mask;
+        if (walk == last_byte)
+        {
+            flags[walk] &= first_mask | last_mask;
+        }
+        else
+        {
+            flags[walk] &= first_mask;
+            flags[last_byte] &= last_mask;
+            if (++walk < last_byte)
+            {
+                std::fill_n(flags + walk, last_byte - walk, 0);
+            }
+        }
+    }
+}
+
+} // namespace
+
+// ---
+
+size_t tr_bitfield::count_flags() const noexcept
+{
+    auto ret = size_t{};
+
+    for (auto const& chunk : chunks_)
+    {
+        ret += chunk.n_set;
+    }
+
+    return ret;
+}
+
+size_t tr_bitfield::count_flags(size_t begin, size_t end) const noexcept
+{
+    if (bit_count_ == 0)
+    {
+        return 0;
+    }
+
+    TR_ASSERT(begin < end);
+
+    auto ret = size_t{};
 
-        /* last byte */
-        if (last_byte < std::size(flags_))
+    for (auto idx = begin / ChunkBits, last = (end - 1) / ChunkBits; idx <= last && idx < std::size(chunks_); ++idx)
+    {
+        auto const& chunk = chunks_[idx];
+        auto const chunk_begin = idx * ChunkBits;
+        auto const lo = std::max(begin, chunk_begin) - chunk_begin;
+        auto const hi = std::min(end, chunk_begin + ChunkBits) - chunk_begin;
+
+        if (chunk.n_set == 0U)
         {
-            /* -end & 7U. Since bitcount is unsigned do ~end + 1 to
-               replace -end as linters warn about negating unsigned
-               types. Any compiler will optimize ~x + 1 to -x in the
-               backend. */
-            uint32_t const last_shift = (~end + 1) & 7U;
-            val = flags_[last_byte];
-            val >>= last_shift;
-            /* No need to shift back val for correct popcount. */
-            ret += doPopcount(val);
+            continue;
+        }
+
+        if (lo == 0U && hi == ChunkBits)
+        {
+            ret += chunk.n_set;
+        }
+        else if (chunk.is_uniform())
+        {
+            ret += hi - lo;
+        }
+        else
+        {
+            ret += rawCountRange(std::data(chunk.flags), std::size(chunk.flags), lo, hi);
         }
     }
 
-    TR_ASSERT(ret <= (begin - end));
+    TR_ASSERT(ret <= end - begin);
     return ret;
 }
 
@@ -171,7 +318,20 @@ size_t tr_bitfield::count(size_t begin, size_t end) const
 
 bool tr_bitfield::is_valid() const
 {
-    return std::empty(flags_) || true_count_ == count_flags();
+    auto n_set = size_t{};
+
+    for (auto const& chunk : chunks_)
+    {
+        if (chunk.is_uniform() ? chunk.n_set != 0U && chunk.n_set != ChunkBits :
+                                 chunk.n_set != rawCountFlags(std::data(chunk.flags), std::size(chunk.flags)))
+        {
+            return false;
+        }
+
+        n_set += chunk.n_set;
+    }
+
+    return std::empty(chunks_) || true_count_ == n_set;
 }
 
 std::vector<uint8_t> tr_bitfield::raw() const
@@ -179,35 +339,70 @@ std::vector<uint8_t> tr_bitfield::raw() const
     /* Impossible for bit_count_ to exceed SIZE_MAX - 8 */
     auto const n = getBytesNeededSafe(bit_count_);
 
-    if (!std::empty(flags_))
+    if (std::empty(chunks_))
     {
-        return flags_;
+        auto raw = std::vector<uint8_t>(n);
+
+        if (has_all())
+        {
+            setAllTrue(std::data(raw), bit_count_);
+        }
+
+        return raw;
     }
 
-    auto raw = std::vector<uint8_t>(n);
+    auto raw = std::vector<uint8_t>{};
+    raw.reserve(std::size(chunks_) * ChunkBytes);
+    for (auto const& chunk : chunks_)
+    {
+        if (chunk.is_uniform())
+        {
+            raw.insert(std::end(raw), ChunkBytes, chunk.n_set != 0U ? 0xFF : 0x00);
+        }
+        else
+        {
+            raw.insert(std::end(raw), std::begin(chunk.flags), std::end(chunk.flags));
+            raw.insert(std::end(raw), ChunkBytes - std::size(chunk.flags), 0x00);
+        }
+    }
 
-    if (has_all())
+    // trim the last chunk's padding, but keep all the bytes that `bit_count_` needs
+    auto size = std::size(raw);
+    while (size > n && raw[size - 1] == 0U)
     {
-        setAllTrue(std::data(raw), bit_count_);
+        --size;
     }
 
+    raw.resize(std::max(size, n));
     return raw;
 }
 
 void tr_bitfield::ensure_bits_alloced(size_t n)
 {
-    bool const has_all = this->has_all();
+    // a has-all bitfield doesn't store its bits, so spell them out first
+    if (has_all() && std::empty(chunks_))
+    {
+        chunks_.resize(true_count_ / ChunkBits + (true_count_ % ChunkBits != 0 ? 1 : 0));
+
+        for (size_t idx = 0; idx < std::size(chunks_); ++idx)
+        {
+            auto& chunk = chunks_[idx];
+            chunk.n_set = std::min(ChunkBits, true_count_ - idx * ChunkBits);
+
+            if (chunk.n_set != ChunkBits)
+            {
+                chunk.flags.resize(getBytesNeededSafe(chunk.n_set));
+                setAllTrue(std::data(chunk.flags), chunk.n_set);
+            }
+        }
+    }
 
     /* Can't use getBytesNeededSafe as n can be > SIZE_MAX - 8. */
-    size_t const bytes_needed = has_all ? getBytesNeeded(std::max(n, true_count_)) : getBytesNeeded(n);
+    size_t const chunks_needed = n / ChunkBits + (n % ChunkBits != 0 ? 1 : 0);
 
-    if (std::size(flags_) < bytes_needed)
+    if (std::size(chunks_) < chunks_needed)
     {
-        flags_.resize(bytes_needed);
-        if (has_all)
-        {
-            setAllTrue(std::data(flags_), true_count_);
-        }
+        chunks_.resize(chunks_needed);
     }
 }
 
@@ -223,6 +418,57 @@ bool tr_bitfield::ensure_nth_bit_alloced(size_t nth)
     return true;
 }
 
+// @return chunk `idx` with its bits in an array of at least `min_bytes`
+tr_bitfield::Chunk& tr_bitfield::writable_chunk(size_t idx, size_t min_bytes)
+{
+    TR_ASSERT(idx < std::size(chunks_));
+    TR_ASSERT(min_bytes <= ChunkBytes);
+
+    auto& chunk = chunks_[idx];
+
+    if (!chunk.is_uniform())
+    {
+        if (std::size(chunk.flags) < min_bytes)
+        {
+            chunk.flags.resize(min_bytes);
+        }
+    }
+    else if (chunk.n_set != 0U)
+    {
+        chunk.flags.assign(ChunkBytes, 0xFF);
+    }
+    else
+    {
+        // don't allocate more of the last chunk than the bitfield needs
+        auto const chunk_begin = idx * ChunkBits;
+        auto const n_bits = bit_count_ > chunk_begin ? std::min(bit_count_ - chunk_begin, ChunkBits) : size_t{};
+        chunk.flags.assign(std::max(getBytesNeededSafe(n_bits), min_bytes), 0x00);
+    }
+
+    return chunk;
+}
+
+// Replace the bits with BEP0003-ordered `bytes`. The caller updates true_count_.
+void tr_bitfield::assign_bytes(uint8_t const* bytes, size_t byte_count)
+{
+    free_array();
+    chunks_.resize(byte_count / ChunkBytes + (byte_count % ChunkBytes != 0 ? 1 : 0));
+
+    for (size_t idx = 0; idx < std::size(chunks_); ++idx)
+    {
+        auto const* const begin = bytes + idx * ChunkBytes;
+        auto const len = std::min(ChunkBytes, byte_count - idx * ChunkBytes);
+
+        auto& chunk = chunks_[idx];
+        chunk.n_set = rawCountFlags(begin, len);
+
+        if (chunk.n_set != 0U && chunk.n_set != ChunkBits)
+        {
+            chunk.flags.assign(begin, begin + len);
+        }
+    }
+}
+
 void tr_bitfield::set_true_count(size_t n) noexcept
 {
     TR_ASSERT(bit_count_ == 0 || n <= bit_count_);
@@ -285,7 +531,7 @@ void tr_bitfield::set_has_all() noexcept
 
 void tr_bitfield::set_raw(uint8_t const* raw, size_t byte_count)
 {
-    flags_.assign(raw, raw + byte_count);
+    auto flags = std::vector<uint8_t>(raw, raw + byte_count);
 
     // ensure any excess bits at the end of the array are set to '0'.
     if (byte_count == getBytesNeededSafe(bit_count_))
@@ -296,10 +542,11 @@ void tr_bitfield::set_raw(uint8_t const* raw, size_t byte_count)
 
         if (excess_bit_count != 0)
         {
-            flags_.back() &= 0xff << excess_bit_count;
+            flags.back() &= 0xff << excess_bit_count;
         }
     }
 
+    assign_bytes(std::data(flags), std::size(flags));
     rebuild_true_count();
 }
 
@@ -307,18 +554,17 @@ void tr_bitfield::set_from_bools(bool const* flags, size_t n)
 {
     size_t true_count = 0;
 
-    free_array();
-    ensure_bits_alloced(n);
-
+    auto bytes = std::vector<uint8_t>(getBytesNeeded(n));
     for (size_t i = 0; i < n; ++i)
     {
         if (flags[i])
         {
             ++true_count;
-            flags_[i >> 3U] |= (0x80 >> (i & 7U));
+            bytes[i >> 3U] |= (0x80 >> (i & 7U));
         }
     }
 
+    assign_bytes(std::data(bytes), std::size(bytes));
     set_true_count(true_count);
 }
 
@@ -335,25 +581,24 @@ void tr_bitfield::set(size_t nth, bool value)
     }
 
     /* Already tested that val != nth bit so just swap */
-    auto& byte = flags_[nth >> 3U];
-#ifdef TR_ENABLE_ASSERTS
-    auto const old_byte_pop = doPopcount(byte);
-#endif
-    byte ^= 0x80 >> (nth & 7U);
-#ifdef TR_ENABLE_ASSERTS
-    auto const new_byte_pop = doPopcount(byte);
-#endif
+    auto const bit = nth % ChunkBits;
+    auto& chunk = writable_chunk(nth / ChunkBits, (bit >> 3U) + 1U);
+    chunk.flags[bit >> 3U] ^= 0x80 >> (bit & 7U);
 
     if (value)
     {
+        ++chunk.n_set;
         ++true_count_;
-        TR_ASSERT(old_byte_pop + 1 == new_byte_pop);
     }
     else
     {
+        --chunk.n_set;
         --true_count_;
-        TR_ASSERT(new_byte_pop + 1 == old_byte_pop);
     }
+
+    chunk.normalize();
+    TR_ASSERT(test_flag(nth) == value);
+
     have_all_hint_ = true_count_ == bit_count_;
     have_none_hint_ = true_count_ == 0;
 }
@@ -368,8 +613,9 @@ void tr_bitfield::set_span(size_t begin, size_t end, bool value)
         return;
     }
 
-    // NB: count(begin, end) can be quite expensive. Might be worth it
-    // to fuse the count and set loop
+    // NB: count(begin, end) is cheap over runs, but can be expensive
+    // over chunks that hold arrays. Might be worth it to fuse the count
+    // and set loop
     size_t const old_count = count(begin, end);
     size_t const new_count = value ? (end - begin) : 0;
     // did anything change?
@@ -378,57 +624,43 @@ void tr_bitfield::set_span(size_t begin, size_t end, bool value)
         return;
     }
 
-    --end;
-    if (!ensure_nth_bit_alloced(end))
+    if (!ensure_nth_bit_alloced(end - 1))
     {
         return;
     }
 
-    auto walk = begin >> 3;
-    auto const last_byte = end >> 3;
-
-    unsigned char first_mask = 0xff >> (begin & 7U);
-    unsigned char last_mask = 0xff << ((~end) & 7U);
-    if (value)
+    for (auto idx = begin / ChunkBits, last = (end - 1) / ChunkBits; idx <= last; ++idx)
     {
-        if (walk == last_byte)
+        auto const chunk_begin = idx * ChunkBits;
+        auto const lo = std::max(begin, chunk_begin) - chunk_begin;
+        auto const hi = std::min(end, chunk_begin + ChunkBits) - chunk_begin;
+
+        // a whole chunk becomes a run
+        if (lo == 0U && hi == ChunkBits)
         {
-            flags_[walk] |= first_mask & last_mask;
+            auto& chunk = chunks_[idx];
+            chunk.flags = std::vector<uint8_t>{};
+            chunk.n_set = value ? ChunkBits : 0U;
+            continue;
         }
-        else
+
+        if (auto const& chunk = chunks_[idx]; chunk.is_uniform() && (chunk.n_set != 0U) == value)
         {
-            flags_[walk] |= first_mask;
-            /* last_byte is expected to be hot in cache due to earlier
-               count(begin, end) */
-            flags_[last_byte] |= last_mask;
-            if (++walk < last_byte)
-            {
-                std::fill_n(std::data(flags_) + walk, last_byte - walk, 0xff);
-            }
+            continue;
         }
 
+        auto& chunk = writable_chunk(idx, getBytesNeededSafe(hi));
+        rawSetRange(std::data(chunk.flags), lo, hi, value);
+        chunk.n_set = rawCountFlags(std::data(chunk.flags), std::size(chunk.flags));
+        chunk.normalize();
+    }
+
+    if (value)
+    {
         increment_true_count(new_count - old_count);
     }
     else
     {
-        first_mask = ~first_mask;
-        last_mask = ~last_mask;
-        if (walk == last_byte)
-        {
-            flags_[walk] &= first_mask | last_mask;
-        }
-        else
-        {
-            flags_[walk] &= first_mask;
-            /* last_byte is expected to be hot in cache due to earlier
-               count(begin, end) */
-            flags_[last_byte] &= last_mask;
-            if (++walk < last_byte)
-            {
-                std::fill_n(std::data(flags_) + walk, last_byte - walk, 0);
-            }
-        }
-
         decrement_true_count(old_count);
     }
 }
@@ -446,11 +678,33 @@ tr_bitfield& tr_bitfield::operator|=(tr_bitfield const& that) noexcept
         return *this;
     }
 
-    flags_.resize(std::max(std::size(flags_), std::size(that.flags_)));
+    chunks_.resize(std::max(std::size(chunks_), std::size(that.chunks_)));
 
-    for (size_t i = 0, n = std::size(that.flags_); i < n; ++i)
+    for (size_t idx = 0; idx < std::size(that.chunks_); ++idx)
     {
-        flags_[i] |= that.flags_[i];
+        auto& chunk = chunks_[idx];
+        auto const& other = that.chunks_[idx];
+
+        if (other.n_set == 0U || chunk.n_set == ChunkBits)
+        {
+            continue;
+        }
+
+        if (other.n_set == ChunkBits || chunk.n_set == 0U)
+        {
+            chunk = other;
+            continue;
+        }
+
+        // both chunks hold arrays
+        if (std::size(chunk.flags) < std::size(other.flags))
+        {
+            chunk.flags.resize(std::size(other.flags));
+        }
+
+        rawTransform(std::data(chunk.flags), std::data(other.flags), std::size(other.flags), std::bit_or<>{});
+        chunk.n_set = rawCountFlags(std::data(chunk.flags), std::size(chunk.flags));
+        chunk.normalize();
     }
 
     rebuild_true_count();
@@ -470,11 +724,33 @@ tr_bitfield& tr_bitfield::operator&=(tr_bitfield const& that) noexcept
         return *this;
     }
 
-    flags_.resize(std::min(std::size(flags_), std::size(that.flags_)));
+    chunks_.resize(std::min(std::size(chunks_), std::size(that.chunks_)));
 
-    for (size_t i = 0, n = std::size(flags_); i < n; ++i)
+    for (size_t idx = 0; idx < std::size(chunks_); ++idx)
     {
-        flags_[i] &= that.flags_[i];
+        auto& chunk = chunks_[idx];
+        auto const& other = that.chunks_[idx];
+
+        if (chunk.n_set == 0U || other.n_set == ChunkBits)
+        {
+            continue;
+        }
+
+        if (other.n_set == 0U || chunk.n_set == ChunkBits)
+        {
+            chunk = other;
+            continue;
+        }
+
+        // both chunks hold arrays
+        if (std::size(chunk.flags) > std::size(other.flags))
+        {
+            chunk.flags.resize(std::size(other.flags));
+        }
+
+        rawTransform(std::data(chunk.flags), std::data(other.flags), std::size(chunk.flags), std::bit_and<>{});
+        chunk.n_set = rawCountFlags(std::data(chunk.flags), std::size(chunk.flags));
+        chunk.normalize();
     }
 
     rebuild_true_count();
@@ -493,13 +769,92 @@ bool tr_bitfield::intersects(tr_bitfield const& that) const noexcept
         return true;
     }
 
-    for (size_t i = 0, n = std::min(std::size(flags_), std::size(that.flags_)); i < n; ++i)
+    for (size_t idx = 0, n_chunks = std::min(std::size(chunks_), std::size(that.chunks_)); idx < n_chunks; ++idx)
     {
-        if ((flags_[i] & that.flags_[i]) != 0U)
+        auto const& chunk = chunks_[idx];
+        auto const& other = that.chunks_[idx];
+
+        if (chunk.n_set == 0U || other.n_set == 0U)
+        {
+            continue;
+        }
+
+        // one of them is a run of set bits and the other has a bit set
+        if (chunk.is_uniform() || other.is_uniform())
         {
             return true;
         }
+
+        auto const* const a = std::data(chunk.flags);
+        auto const* const b = std::data(other.flags);
+        auto const n = std::min(std::size(chunk.flags), std::size(other.flags));
+
+        auto i = size_t{};
+        for (; n - i >= sizeof(Word); i += sizeof(Word))
+        {
+            if ((loadWord(a + i) & loadWord(b + i)) != 0U)
+            {
+                return true;
+            }
+        }
+
+        for (; i < n; ++i)
+        {
+            if ((a[i] & b[i]) != 0U)
+            {
+                return true;
+            }
+        }
     }
 
     return false;
 }
+
+size_t tr_bitfield::and_count(tr_bitfield const& that) const noexcept
+{
+    if (has_none() || that.has_none())
+    {
+        return 0;
+    }
+
+    if (has_all())
+    {
+        return that.count();
+    }
+
+    if (that.has_all())
+    {
+        return count();
+    }
+
+    auto ret = size_t{};
+
+    for (size_t idx = 0, n_chunks = std::min(std::size(chunks_), std::size(that.chunks_)); idx < n_chunks; ++idx)
+    {
+        auto const& chunk = chunks_[idx];
+        auto const& other = that.chunks_[idx];
+
+        if (chunk.n_set == 0U || other.n_set == 0U)
+        {
+            continue;
+        }
+
+        if (chunk.is_uniform())
+        {
+            ret += other.n_set;
+        }
+        else if (other.is_uniform())
+        {
+            ret += chunk.n_set;
+        }
+        else
+        {
+            ret += rawAndCount(
+                std::data(chunk.flags),
+                std::data(other.flags),
+                std::min(std::size(chunk.flags), std::size(other.flags)));
+        }
+    }
+
+    return ret;
+}
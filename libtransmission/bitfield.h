@@ -35,6 +35,11 @@
  *
  * - "Have none" is another special case that has the same advantages
  *   and motivations as "Have all".
+ *
+ * - The bits are stored in fixed-size chunks, and a chunk whose bits are
+ *   all set or all unset doesn't allocate anything. A mostly-complete
+ *   torrent's block bitfield is mostly such runs, so it's much smaller
+ *   than a flat array, and counting over a run doesn't touch any bits.
  */
 class tr_bitfield
 {
@@ -116,27 +121,72 @@ public:
     tr_bitfield& operator&=(tr_bitfield const& that) noexcept;
     [[nodiscard]] bool intersects(tr_bitfield const& that) const noexcept;
 
+    // @return the number of bits that are set in both bitfields,
+    // i.e. `(*this & that).count()` without building the intersection
+    [[nodiscard]] size_t and_count(tr_bitfield const& that) const noexcept;
+
 private:
     [[nodiscard]] size_t count_flags() const noexcept;
     [[nodiscard]] size_t count_flags(size_t begin, size_t end) const noexcept;
 
+    static auto constexpr ChunkBits = size_t{ 8192U };
+    static auto constexpr ChunkBytes = ChunkBits / 8U;
+
+    struct Chunk
+    {
+        // The chunk's bits in BEP0003 order. Missing bytes at the end are
+        // zero. If it's empty, the bits are all set or all unset: see n_set.
+        std::vector<uint8_t> flags;
+
+        // how many of the chunk's bits are set
+        size_t n_set = 0;
+
+        [[nodiscard]] TR_CONSTEXPR20 bool is_uniform() const noexcept
+        {
+            return std::empty(flags);
+        }
+
+        // free the array if its bits are all the same
+        void normalize() noexcept
+        {
+            if (n_set == 0U || n_set == ChunkBits)
+            {
+                flags = std::vector<uint8_t>{};
+            }
+        }
+    };
+
     [[nodiscard]] TR_CONSTEXPR20 bool test_flag(size_t n) const
     {
-        if (n >> 3U >= std::size(flags_))
+        if (n / ChunkBits >= std::size(chunks_))
+        {
+            return false;
+        }
+
+        auto const& chunk = chunks_[n / ChunkBits];
+        if (chunk.is_uniform())
+        {
+            return chunk.n_set != 0U;
+        }
+
+        n %= ChunkBits;
+        if (n >> 3U >= std::size(chunk.flags))
         {
             return false;
         }
 
-        return (flags_[n >> 3U] << (n & 7U) & 0x80) != 0;
+        return (chunk.flags[n >> 3U] << (n & 7U) & 0x80) != 0;
     }
 
     void ensure_bits_alloced(size_t n);
     [[nodiscard]] bool ensure_nth_bit_alloced(size_t nth);
+    [[nodiscard]] Chunk& writable_chunk(size_t idx, size_t min_bytes);
+    void assign_bytes(uint8_t const* bytes, size_t byte_count);
 
     void free_array() noexcept
     {
         // move-assign to ensure the reserve memory is cleared
-        flags_ = std::vector<uint8_t>{};
+        chunks_ = std::vector<Chunk>{};
     }
 
     void increment_true_count(size_t inc) noexcept;
@@ -147,7 +197,7 @@ private:
         set_true_count(count_flags());
     }
 
-    std::vector<uint8_t> flags_;
+    std::vector<Chunk> chunks_;
 
     size_t bit_count_ = 0;
     size_t true_count_ = 0;
@@ -0,0 +1,292 @@
+#include <algorithm> // std::any_of(), std::min(), std::remove_if()
+#include <cstddef> // size_t, std::byte
+#include <cstdint> // uintptr_t
+#include <ctime> // time_t
+#include <functional> // std::less
+#include <iterator> // std::prev()
+#include <mutex>
+#include <new>
+
+#ifndef _WIN32
+#include <sys/mman.h> // mmap(), munmap(), madvise()
+#endif
+
+#include <fmt/core.h>
+
+#include "libtransmission/block-pool.h"
+#include "libtransmission/log.h"
+
+namespace
+{
+#ifdef _WIN32
+
+[[nodiscard]] std::byte* map_slab() noexcept
+{
+    return nullptr;
+}
+
+void unmap_slab(std::byte* /*base*/) noexcept
+{
+}
+
+#else
+
+[[nodiscard]] std::byte* map_slab() noexcept
+{
+    static auto constexpr Size = tr_block_pool::SlabSize;
+    static auto constexpr Prot = PROT_READ | PROT_WRITE;
+
+#if defined(MAP_HUGETLB) && defined(MAP_HUGE_2MB)
+    // explicit huge pages, if the admin has reserved some
+    if (auto* const ptr = mmap(nullptr, Size, Prot, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_HUGE_2MB, -1, 0);
+        ptr != MAP_FAILED)
+    {
+        return static_cast<std::byte*>(ptr);
+    }
+#endif
+
+    // Otherwise map twice the size and trim it to a 2 MiB boundary,
+    // so that one transparent huge page can back the whole slab.
+    auto* const ptr = mmap(nullptr, Size * 2U, Prot, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED)
+    {
+        return nullptr;
+    }
+
+    auto* const raw = static_cast<std::byte*>(ptr);
+    auto* const raw_end = raw + Size * 2U;
+    auto const misalignment = reinterpret_cast<uintptr_t>(raw) % Size;
+    auto* const base = misalignment == 0U ? raw : raw + (Size - misalignment);
+    if (base != raw)
+    {
+        munmap(raw, base - raw);
+    }
+    if (base + Size != raw_end)
+    {
+        munmap(base + Size, raw_end - (base + Size));
+    }
+
+#ifdef MADV_HUGEPAGE
+    (void)madvise(base, Size, MADV_HUGEPAGE);
+#endif
+
+    return base;
+}
+
+void unmap_slab(std::byte* base) noexcept
+{
+    munmap(base, tr_block_pool::SlabSize);
+}
+
+#endif
+} // namespace
+
+tr_block_pool::~tr_block_pool()
+{
+    release_all();
+
+    // any slabs left still have buffers in use; leave them be
+}
+
+void tr_block_pool::deallocate(void* buf) noexcept
+{
+    // slab buffers go when their whole slab does; see release_free_slabs()
+    if (find_slab(buf) == std::end(slabs_))
+    {
+        ::operator delete(buf, std::align_val_t{ alignment_ });
+    }
+}
+
+tr_block_pool::Slabs::iterator tr_block_pool::find_slab(void* buf) noexcept
+{
+    auto* const addr = static_cast<std::byte*>(buf);
+
+    // find the last slab that begins at or before `addr`
+    auto iter = slabs_.upper_bound(addr);
+    if (iter == std::begin(slabs_))
+    {
+        return std::end(slabs_);
+    }
+
+    iter = std::prev(iter);
+    return std::less{}(addr, iter->first + SlabSize) ? iter : std::end(slabs_);
+}
+
+void* tr_block_pool::allocate_from_new_slab()
+{
+    auto* const base = map_slab();
+    if (base == nullptr)
+    {
+        return nullptr;
+    }
+
+    // hand out the first buffer and keep the rest for later
+    auto const n_buffers = SlabSize / stride_;
+    free_.reserve(std::size(free_) + n_buffers - 1U);
+    for (size_t i = n_buffers - 1U; i > 0U; --i)
+    {
+        free_.push_back(base + i * stride_);
+    }
+
+    slabs_.try_emplace(base, Slab{ 1U });
+    return base;
+}
+
+size_t tr_block_pool::release_free_slabs(size_t max_buffers)
+{
+    auto const n_per_slab = SlabSize / stride_;
+    auto n_released = size_t{};
+    auto released = std::vector<std::byte*>{};
+
+    for (auto iter = std::begin(slabs_); iter != std::end(slabs_) && n_released + n_per_slab <= max_buffers;)
+    {
+        if (iter->second.n_used != 0U)
+        {
+            ++iter;
+            continue;
+        }
+
+        unmap_slab(iter->first);
+        released.push_back(iter->first);
+        n_released += n_per_slab;
+        iter = slabs_.erase(iter);
+    }
+
+    if (std::empty(released))
+    {
+        return 0U;
+    }
+
+    auto const was_released = [&released](void* buf)
+    {
+        auto* const addr = static_cast<std::byte*>(buf);
+        return std::any_of(
+            std::begin(released),
+            std::end(released),
+            [addr](std::byte* base) { return !std::less{}(addr, base) && std::less{}(addr, base + SlabSize); });
+    };
+    auto const old_size = std::size(free_);
+    free_.erase(std::remove_if(std::begin(free_), std::end(free_), was_released), std::end(free_));
+    return old_size - std::size(free_);
+}
+
+size_t tr_block_pool::release_heap_buffers(size_t max_buffers)
+{
+    auto n_released = size_t{};
+    auto const release = [this, &n_released, max_buffers](void* buf)
+    {
+        if (n_released >= max_buffers || find_slab(buf) != std::end(slabs_))
+        {
+            return false;
+        }
+
+        deallocate(buf);
+        ++n_released;
+        return true;
+    };
+    free_.erase(std::remove_if(std::begin(free_), std::end(free_), release), std::end(free_));
+    return n_released;
+}
+
+void* tr_block_pool::get()
+{
+    {
+        auto const lock = std::lock_guard(mutex_);
+
+        if (!std::empty(free_))
+        {
+            ++hits_;
+            auto* const buf = free_.back();
+            free_.pop_back();
+            low_water_ = std::min(low_water_, std::size(free_));
+            if (auto const iter = find_slab(buf); iter != std::end(slabs_))
+            {
+                ++iter->second.n_used;
+            }
+            return buf;
+        }
+
+        ++misses_;
+        low_water_ = 0U;
+
+        if (backing_ == Backing::Slabs)
+        {
+            if (auto* const buf = allocate_from_new_slab(); buf != nullptr)
+            {
+                return buf;
+            }
+        }
+    }
+
+    return ::operator new(buffer_size_, std::align_val_t{ alignment_ });
+}
+
+void tr_block_pool::put(void* buf) noexcept
+{
+    if (buf == nullptr)
+    {
+        return;
+    }
+
+    auto const lock = std::lock_guard(mutex_);
+
+    if (auto const iter = find_slab(buf); iter != std::end(slabs_))
+    {
+        --iter->second.n_used;
+    }
+
+    try
+    {
+        free_.push_back(buf);
+    }
+    catch (std::bad_alloc const&)
+    {
+        deallocate(buf);
+    }
+}
+
+void tr_block_pool::release_all()
+{
+    auto const lock = std::lock_guard(mutex_);
+
+    release_free_slabs(SIZE_MAX);
+    release_heap_buffers(SIZE_MAX);
+    free_.shrink_to_fit();
+    low_water_ = 0U;
+}
+
+void tr_block_pool::release_idle(time_t now)
+{
+    auto const lock = std::lock_guard(mutex_);
+
+    if (now - last_release_ < IdleSecs)
+    {
+        return;
+    }
+
+    // Buffers that have sat in the free list since the last release haven't
+    // been needed, so give them back. The rest are in use often enough to keep.
+    auto const n_idle = std::min(low_water_, std::size(free_));
+    auto const n_from_slabs = release_free_slabs(n_idle);
+    auto const n_release = n_from_slabs + release_heap_buffers(n_idle - std::min(n_idle, n_from_slabs));
+    free_.shrink_to_fit();
+
+    if (n_release > 0U)
+    {
+        tr_logAddTrace(fmt::format(
+            "block pool released {} idle buffers; {} hits, {} misses, {} free",
+            n_release,
+            hits_,
+            misses_,
+            std::size(free_)));
+    }
+
+    low_water_ = std::size(free_);
+    last_release_ = now;
+}
+
+tr_block_pool::Stats tr_block_pool::stats() const
+{
+    auto const lock = std::lock_guard(mutex_);
+    return { hits_, misses_, std::size(free_), std::size(slabs_) };
+}
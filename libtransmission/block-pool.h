@@ -0,0 +1,122 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <cstddef> // size_t, std::byte
+#include <cstdint> // uint64_t
+#include <ctime> // time_t
+#include <map>
+#include <mutex>
+#include <vector>
+
+// A free list of fixed-size buffers. Used for Cache::BlockData so that
+// downloading and uploading don't churn the heap with 16 KiB allocations,
+// and for the aligned buffers that direct I/O reads into.
+class tr_block_pool
+{
+public:
+    enum class Backing : uint8_t
+    {
+        // each buffer is its own heap allocation
+        Heap,
+
+        // Buffers are carved out of 2 MiB slabs that are mapped with huge
+        // pages where the OS allows it, so that a big cache touched at random
+        // needs far fewer TLB entries. A slab is only given back once all of
+        // its buffers are free. Falls back to `Heap` where slabs can't be mapped.
+        Slabs
+    };
+
+    struct Stats
+    {
+        uint64_t hits = 0; // get() reused a free buffer
+        uint64_t misses = 0; // get() had to allocate a new buffer or slab
+        size_t n_free = 0; // buffers waiting to be reused
+        size_t n_slabs = 0; // slabs mapped, if the backing is `Slabs`
+    };
+
+    // How long a free buffer may go unused before it's given back to the heap
+    static auto constexpr IdleSecs = time_t{ 60 };
+
+    static auto constexpr SlabSize = size_t{ 2U * 1024U * 1024U };
+
+    explicit tr_block_pool(
+        size_t buffer_size,
+        size_t alignment = __STDCPP_DEFAULT_NEW_ALIGNMENT__,
+        Backing backing = Backing::Heap) noexcept
+        : buffer_size_{ buffer_size }
+        , alignment_{ alignment }
+        , stride_{ (buffer_size + alignment - 1U) / alignment * alignment }
+        , backing_{ stride_ <= SlabSize ? backing : Backing::Heap }
+    {
+    }
+
+    ~tr_block_pool();
+
+    tr_block_pool(tr_block_pool const&) = delete;
+    tr_block_pool(tr_block_pool&&) = delete;
+    tr_block_pool& operator=(tr_block_pool const&) = delete;
+    tr_block_pool& operator=(tr_block_pool&&) = delete;
+
+    [[nodiscard]] constexpr auto buffer_size() const noexcept
+    {
+        return buffer_size_;
+    }
+
+    [[nodiscard]] void* get();
+    void put(void* buf) noexcept;
+
+    // Free any buffers that weren't needed in the last `IdleSecs`.
+    // This is cheap to call often; it's a no-op until `IdleSecs` have passed.
+    void release_idle(time_t now);
+
+    // Free every buffer that isn't in use, e.g. when memory is short.
+    void release_all();
+
+    [[nodiscard]] Stats stats() const;
+
+private:
+    struct Slab
+    {
+        size_t n_used = 0;
+    };
+
+    using Slabs = std::map<std::byte*, Slab>;
+
+    void deallocate(void* buf) noexcept;
+
+    [[nodiscard]] void* allocate_from_new_slab();
+    [[nodiscard]] Slabs::iterator find_slab(void* buf) noexcept;
+
+    // Unmap slabs that have no buffers in use, up to `max_buffers` free
+    // buffers' worth, and drop their buffers from the free list.
+    // @return how many free buffers were dropped
+    size_t release_free_slabs(size_t max_buffers);
+
+    // Free up to `max_buffers` free buffers that aren't part of a slab.
+    // @return how many were freed
+    size_t release_heap_buffers(size_t max_buffers);
+
+    size_t const buffer_size_;
+    size_t const alignment_;
+    size_t const stride_;
+    Backing const backing_;
+
+    mutable std::mutex mutex_;
+    std::vector<void*> free_;
+    Slabs slabs_;
+
+    // the fewest free buffers we've had since the last release_idle()
+    size_t low_water_ = 0;
+    time_t last_release_ = 0;
+
+    uint64_t hits_ = 0;
+    uint64_t misses_ = 0;
+};
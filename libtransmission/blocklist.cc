@@ -7,9 +7,13 @@
 #include <array>
 #include <cstddef>
 #include <cstdint>
+#include <cstring> // for std::memcpy()
 #include <fstream>
 #include <initializer_list>
+#include <optional>
+#include <string>
 #include <string_view>
+#include <utility>
 #include <vector>
 
 #ifdef _WIN32
@@ -39,45 +43,184 @@ namespace
 {
 
 // A string at the beginning of .bin files to test & make sure we don't load incompatible files
-auto constexpr BinContentsPrefix = std::string_view{ "-tr-blocklist-file-format-v3-" };
+auto constexpr BinContentsPrefix = std::string_view{ "-tr-blocklist-file-format-v4-" };
 
 // In the blocklists directory, the The plaintext source file can be anything, e.g. "level1".
 // The pre-parsed, fast-to-load binary file will have a ".bin" suffix e.g. "level1.bin".
 auto constexpr BinFileSuffix = std::string_view{ ".bin" };
 
+// Scratch files written while importing a list. They are neither sources nor .bins.
+auto constexpr TmpFileSuffix = std::string_view{ ".tmp" };
+
+// How many parsed ranges an import holds in memory before sorting them
+// and spilling them to a run file on disk.
+auto constexpr MaxRangesInMemory = size_t{ 1U << 18U };
+
 using address_range_t = std::pair<tr_address, tr_address>;
+using ipv4_range_t = Blocklist::ipv4_range_t;
+using ipv6_range_t = Blocklist::ipv6_range_t;
+
+struct Rules
+{
+    std::vector<ipv4_range_t> ipv4;
+    std::vector<ipv6_range_t> ipv6;
+};
+
+// .bin layout after the prefix: the IPv4 and IPv6 rule counts as
+// uint64_t, then the IPv4 ranges, then the IPv6 ranges.
+auto constexpr BinHeaderSize = std::size(BinContentsPrefix) + 2 * sizeof(uint64_t);
+
+[[nodiscard]] Blocklist::ipv4_t toIpv4(tr_address const& addr) noexcept
+{
+    return ntohl(addr.addr.addr4.s_addr);
+}
+
+[[nodiscard]] Blocklist::ipv6_t toIpv6(tr_address const& addr) noexcept
+{
+    auto ret = Blocklist::ipv6_t{};
+    std::memcpy(std::data(ret), &addr.addr.addr6, std::size(ret));
+    return ret;
+}
 
-void save(std::string_view filename, address_range_t const* ranges, size_t n_ranges)
+// Sort ranges by start address and merge the overlapping ones.
+template<typename Range>
+void normalize(std::vector<Range>& ranges)
 {
-    auto out = std::ofstream{ tr_pathbuf{ filename }, std::ios_base::out | std::ios_base::trunc | std::ios_base::binary };
-    if (!out.is_open())
+    if (std::empty(ranges))
     {
-        tr_logAddWarn(fmt::format(
-            _("Couldn't read '{path}': {error} ({error_code})"),
-            fmt::arg("path", filename),
-            fmt::arg("error", tr_strerror(errno)),
-            fmt::arg("error_code", errno)));
         return;
     }
 
-    if (!out.write(std::data(BinContentsPrefix), std::size(BinContentsPrefix)) ||
-        !out.write(reinterpret_cast<char const*>(ranges), n_ranges * sizeof(*ranges)))
+    // safeguard against some joker swapping the begin & end ranges
+    for (auto& [low, high] : ranges)
     {
-        tr_logAddWarn(fmt::format(
-            _("Couldn't save '{path}': {error} ({error_code})"),
-            fmt::arg("path", filename),
-            fmt::arg("error", tr_strerror(errno)),
-            fmt::arg("error_code", errno)));
+        if (high < low)
+        {
+            std::swap(low, high);
+        }
     }
-    else
+
+    std::sort(std::begin(ranges), std::end(ranges), [](auto const& a, auto const& b) { return a.first < b.first; });
+
+    auto keep = size_t{ 0U };
+    for (auto const& range : ranges)
+    {
+        if (ranges[keep].second < range.first)
+        {
+            ranges[++keep] = range;
+        }
+        else if (ranges[keep].second < range.second)
+        {
+            ranges[keep].second = range.second;
+        }
+    }
+
+    TR_ASSERT_MSG(keep + 1 <= std::size(ranges), "Can shrink `ranges` or leave intact, but not grow");
+    ranges.resize(keep + 1);
+
+#ifdef TR_ENABLE_ASSERTS
+    for (auto const& [low, high] : ranges)
     {
-        tr_logAddInfo(fmt::format(
-            tr_ngettext("Blocklist '{path}' has {count} entry", "Blocklist '{path}' has {count} entries", n_ranges),
-            fmt::arg("path", tr_sys_path_basename(filename)),
-            fmt::arg("count", n_ranges)));
+        TR_ASSERT(!(high < low));
     }
+    for (size_t i = 1, n = std::size(ranges); i < n; ++i)
+    {
+        TR_ASSERT(ranges[i - 1].second < ranges[i].first);
+    }
+#endif
+}
 
-    out.close();
+// Lay out sorted ranges in Eytzinger order: the children of slot k are 2k+1 and 2k+2.
+template<typename Range>
+size_t toEytzinger(std::vector<Range> const& sorted, std::vector<Range>& out, size_t i = 0U, size_t k = 0U)
+{
+    if (k < std::size(out))
+    {
+        i = toEytzinger(sorted, out, i, 2 * k + 1);
+        out[k] = sorted[i++];
+        i = toEytzinger(sorted, out, i, 2 * k + 2);
+    }
+
+    return i;
+}
+
+// Find the first range that ends at or after `key`, then check whether it starts before it.
+template<typename Range, typename Key>
+[[nodiscard]] bool eytzingerContains(std::vector<Range> const& ranges, Key const& key) noexcept
+{
+    auto const n = std::size(ranges);
+    auto candidate = n;
+    for (size_t k = 0U; k < n;)
+    {
+        if (ranges[k].second < key)
+        {
+            k = 2 * k + 2;
+        }
+        else
+        {
+            candidate = k;
+            k = 2 * k + 1;
+        }
+    }
+
+    return candidate != n && !(key < ranges[candidate].first);
+}
+
+// eytzingerContains() for up to N keys at a time. The walks are done in
+// lockstep and without branches, so that the CPU can have several of
+// their loads in flight at once instead of mispredicting each step.
+template<typename Range, typename Key, size_t N>
+void eytzingerContains(
+    std::vector<Range> const& ranges,
+    std::array<Key, N> const& keys,
+    size_t n_keys,
+    std::array<bool, N>& setme) noexcept
+{
+    auto const n = std::size(ranges);
+
+    // 1-based node numbers, so that node `j`'s children are `2j` and `2j + 1`
+    auto j = std::array<size_t, N>{};
+    j.fill(1U);
+
+    // the levels where every node exists...
+    for (auto m = n + 1U; m > 1U; m >>= 1U)
+    {
+        for (size_t i = 0U; i < n_keys; ++i)
+        {
+            j[i] = 2U * j[i] + (ranges[j[i] - 1U].second < keys[i] ? 1U : 0U);
+        }
+    }
+
+    // ...and the last level, which may be partly filled
+    for (size_t i = 0U; i < n_keys; ++i)
+    {
+        if (j[i] <= n)
+        {
+            j[i] = 2U * j[i] + (ranges[j[i] - 1U].second < keys[i] ? 1U : 0U);
+        }
+
+        // Undo the right turns taken after the last left turn; that
+        // left turn's node is the first range that ends at or after the key.
+        // If there were no left turns, `j` becomes 0.
+        while ((j[i] & 1U) != 0U)
+        {
+            j[i] >>= 1U;
+        }
+        j[i] >>= 1U;
+
+        setme[i] = j[i] != 0U && !(keys[i] < ranges[j[i] - 1U].first);
+    }
+}
+
+template<typename Range, typename Key>
+[[nodiscard]] bool sortedContains(std::vector<Range> const& ranges, Key const& key) noexcept
+{
+    auto const iter = std::lower_bound(
+        std::begin(ranges),
+        std::end(ranges),
+        key,
+        [](Range const& range, Key const& k) { return range.second < k; });
+    return iter != std::end(ranges) && !(key < iter->first);
 }
 
 namespace ParseHelpers
@@ -219,23 +362,182 @@ std::optional<address_range_t> parseLine(std::string_view line)
 }
 } // namespace ParseHelpers
 
-auto parseFile(std::string_view filename)
+// Sorts a stream of ranges too large to hold in memory at once:
+// ranges are sorted a chunk at a time and spilled into run files,
+// which merge() then combines into one sorted, deduplicated stream.
+template<typename Range>
+class ExternalSorter
 {
-    using namespace ParseHelpers;
+public:
+    explicit ExternalSorter(std::string_view run_file_prefix)
+        : run_file_prefix_{ run_file_prefix }
+    {
+    }
+
+    ExternalSorter(ExternalSorter&&) = delete;
+    ExternalSorter(ExternalSorter const&) = delete;
+    ExternalSorter& operator=(ExternalSorter&&) = delete;
+    ExternalSorter& operator=(ExternalSorter const&) = delete;
+
+    ~ExternalSorter()
+    {
+        for (auto const& run_file : run_files_)
+        {
+            tr_sys_path_remove(run_file);
+        }
+    }
+
+    void add(Range const& range)
+    {
+        chunk_.emplace_back(range);
+        ++n_added_;
+
+        if (std::size(chunk_) >= MaxRangesInMemory)
+        {
+            spill();
+        }
+    }
+
+    [[nodiscard]] constexpr auto ok() const noexcept
+    {
+        return ok_;
+    }
+
+    [[nodiscard]] constexpr auto empty() const noexcept
+    {
+        return n_added_ == 0U;
+    }
+
+    // Pass each range to `out` in sorted order, with overlaps merged.
+    // Returns the number of ranges passed.
+    template<typename Out>
+    size_t merge(Out&& out)
+    {
+        if (std::empty(run_files_))
+        {
+            normalize(chunk_);
+            std::for_each(std::begin(chunk_), std::end(chunk_), out);
+            return std::size(chunk_);
+        }
+
+        spill();
 
-    auto ranges = std::vector<address_range_t>{};
+        auto runs = std::vector<std::ifstream>{};
+        runs.reserve(std::size(run_files_));
+        for (auto const& run_file : run_files_)
+        {
+            runs.emplace_back(run_file, std::ios_base::in | std::ios_base::binary);
+        }
+
+        // min-heap of (next range, run index)
+        using Entry = std::pair<Range, size_t>;
+        auto const greater = [](Entry const& a, Entry const& b)
+        {
+            return b.first.first < a.first.first;
+        };
+        auto heap = std::vector<Entry>{};
+        auto const read_next = [&runs, &heap, &greater](size_t idx)
+        {
+            if (auto range = Range{}; runs[idx].read(reinterpret_cast<char*>(&range), sizeof(range)))
+            {
+                heap.emplace_back(range, idx);
+                std::push_heap(std::begin(heap), std::end(heap), greater);
+            }
+        };
+
+        for (size_t idx = 0U, n = std::size(runs); idx < n; ++idx)
+        {
+            read_next(idx);
+        }
+
+        auto n_ranges = size_t{ 0U };
+        auto current = std::optional<Range>{};
+        while (!std::empty(heap))
+        {
+            std::pop_heap(std::begin(heap), std::end(heap), greater);
+            auto const [range, idx] = heap.back();
+            heap.pop_back();
+            read_next(idx);
+
+            if (!current)
+            {
+                current = range;
+            }
+            else if (current->second < range.first)
+            {
+                out(*current);
+                ++n_ranges;
+                current = range;
+            }
+            else if (current->second < range.second)
+            {
+                current->second = range.second;
+            }
+        }
+
+        if (current)
+        {
+            out(*current);
+            ++n_ranges;
+        }
 
-    auto in = std::ifstream{ tr_pathbuf{ filename } };
+        return n_ranges;
+    }
+
+private:
+    void spill()
+    {
+        if (std::empty(chunk_))
+        {
+            return;
+        }
+
+        normalize(chunk_);
+
+        auto const run_file = fmt::format("{:s}.run{:d}{:s}", run_file_prefix_, std::size(run_files_), TmpFileSuffix);
+        auto out = std::ofstream{ run_file, std::ios_base::out | std::ios_base::trunc | std::ios_base::binary };
+        run_files_.emplace_back(run_file);
+        if (!out.write(reinterpret_cast<char const*>(std::data(chunk_)), std::size(chunk_) * sizeof(Range)))
+        {
+            tr_logAddWarn(fmt::format(
+                _("Couldn't save '{path}': {error} ({error_code})"),
+                fmt::arg("path", run_file),
+                fmt::arg("error", tr_strerror(errno)),
+                fmt::arg("error_code", errno)));
+            ok_ = false;
+        }
+
+        chunk_.clear();
+    }
+
+    std::string const run_file_prefix_;
+    std::vector<std::string> run_files_;
+    std::vector<Range> chunk_;
+    size_t n_added_ = 0U;
+    bool ok_ = true;
+};
+
+// Parse a plaintext blocklist into a .bin file without holding the whole list in memory.
+// The .bin is written under a temporary name and then renamed into place,
+// so that readers only ever see a complete file.
+std::optional<size_t> importFile(std::string_view src_file, std::string_view bin_file)
+{
+    using namespace ParseHelpers;
+
+    auto in = std::ifstream{ tr_pathbuf{ src_file } };
     if (!in.is_open())
     {
         tr_logAddWarn(fmt::format(
             _("Couldn't read '{path}': {error} ({error_code})"),
-            fmt::arg("path", filename),
+            fmt::arg("path", src_file),
             fmt::arg("error", tr_strerror(errno)),
             fmt::arg("error_code", errno)));
-        return ranges;
+        return {};
     }
 
+    auto ipv4 = ExternalSorter<ipv4_range_t>{ tr_pathbuf{ bin_file, ".ipv4"sv } };
+    auto ipv6 = ExternalSorter<ipv6_range_t>{ tr_pathbuf{ bin_file, ".ipv6"sv } };
+
     auto line = std::string{};
     auto line_number = size_t{ 0U };
     while (std::getline(in, line))
@@ -243,7 +545,14 @@ auto parseFile(std::string_view filename)
         ++line_number;
         if (auto range = parseLine(line); range && (range->first.type == range->second.type))
         {
-            ranges.push_back(*range);
+            if (range->first.is_ipv4())
+            {
+                ipv4.add({ toIpv4(range->first), toIpv4(range->second) });
+            }
+            else
+            {
+                ipv6.add({ toIpv6(range->first), toIpv6(range->second) });
+            }
         }
         else
         {
@@ -253,52 +562,47 @@ auto parseFile(std::string_view filename)
     }
     in.close();
 
-    if (std::empty(ranges))
-    {
-        return ranges;
-    }
-
-    // safeguard against some joker swapping the begin & end ranges
-    for (auto& [low, high] : ranges)
-    {
-        if (low > high)
-        {
-            std::swap(low, high);
-        }
-    }
-
-    // sort ranges by start address
-    std::sort(std::begin(ranges), std::end(ranges), [](auto const& a, auto const& b) { return a.first < b.first; });
-
-    // merge overlapping ranges
-    auto keep = size_t{ 0U };
-    for (auto const& range : ranges)
+    if (!ipv4.ok() || !ipv6.ok() || (ipv4.empty() && ipv6.empty()))
     {
-        if (ranges[keep].second < range.first)
-        {
-            ranges[++keep] = range;
-        }
-        else if (ranges[keep].second < range.second)
-        {
-            ranges[keep].second = range.second;
-        }
+        return {};
     }
 
-    TR_ASSERT_MSG(keep + 1 <= std::size(ranges), "Can shrink `ranges` or leave intact, but not grow");
-    ranges.resize(keep + 1);
+    auto const tmp_file = tr_pathbuf{ bin_file, TmpFileSuffix };
+    auto out = std::ofstream{ tmp_file, std::ios_base::out | std::ios_base::trunc | std::ios_base::binary };
+
+    // the rule counts aren't known until the runs are merged,
+    // so leave room for them and fill them in afterwards
+    auto n_ipv4 = uint64_t{};
+    auto n_ipv6 = uint64_t{};
+    out.write(std::data(BinContentsPrefix), std::size(BinContentsPrefix));
+    out.write(reinterpret_cast<char const*>(&n_ipv4), sizeof(n_ipv4));
+    out.write(reinterpret_cast<char const*>(&n_ipv6), sizeof(n_ipv6));
+    n_ipv4 = ipv4.merge([&out](ipv4_range_t const& range) { out.write(reinterpret_cast<char const*>(&range), sizeof(range)); });
+    n_ipv6 = ipv6.merge([&out](ipv6_range_t const& range) { out.write(reinterpret_cast<char const*>(&range), sizeof(range)); });
+    out.seekp(std::size(BinContentsPrefix));
+    out.write(reinterpret_cast<char const*>(&n_ipv4), sizeof(n_ipv4));
+    out.write(reinterpret_cast<char const*>(&n_ipv6), sizeof(n_ipv6));
+    out.close();
 
-#ifdef TR_ENABLE_ASSERTS
-    for (auto const& [low, high] : ranges)
-    {
-        TR_ASSERT(low <= high);
-    }
-    for (size_t i = 1, n = std::size(ranges); i < n; ++i)
+    tr_error* error = nullptr;
+    if (!out || !tr_sys_path_rename(tmp_file, tr_pathbuf{ bin_file }, &error))
     {
-        TR_ASSERT(ranges[i - 1].second < ranges[i].first);
+        tr_logAddWarn(fmt::format(
+            _("Couldn't save '{path}': {error} ({error_code})"),
+            fmt::arg("path", bin_file),
+            fmt::arg("error", error != nullptr ? error->message : tr_strerror(errno)),
+            fmt::arg("error_code", error != nullptr ? error->code : errno)));
+        tr_error_clear(&error);
+        tr_sys_path_remove(tmp_file);
+        return {};
     }
-#endif
 
-    return ranges;
+    auto const n_rules = static_cast<size_t>(n_ipv4 + n_ipv6);
+    tr_logAddInfo(fmt::format(
+        tr_ngettext("Blocklist '{path}' has {count} entry", "Blocklist '{path}' has {count} entries", n_rules),
+        fmt::arg("path", tr_sys_path_basename(bin_file)),
+        fmt::arg("count", n_rules)));
+    return n_rules;
 }
 
 auto getFilenamesInDir(std::string_view folder)
@@ -316,7 +620,7 @@ auto getFilenamesInDir(std::string_view folder)
 
 void Blocklist::ensureLoaded() const
 {
-    if (!std::empty(rules_))
+    if (!std::empty(ipv4_rules_) || !std::empty(ipv6_rules_))
     {
         return;
     }
@@ -352,11 +656,9 @@ void Blocklist::ensureLoaded() const
 
     // check to see if the file is usable
     bool supported_file = true;
-    if (file_info->size < std::size(BinContentsPrefix)) // too small
-    {
-        supported_file = false;
-    }
-    else if (((file_info->size - std::size(BinContentsPrefix)) % sizeof(address_range_t)) != 0) // wrong size
+    auto n_ipv4 = uint64_t{};
+    auto n_ipv6 = uint64_t{};
+    if (file_info->size < BinHeaderSize) // too small
     {
         supported_file = false;
     }
@@ -364,7 +666,10 @@ void Blocklist::ensureLoaded() const
     {
         auto tmp = std::array<char, std::size(BinContentsPrefix)>{};
         in.read(std::data(tmp), std::size(tmp));
-        supported_file = BinContentsPrefix == std::string_view{ std::data(tmp), std::size(tmp) };
+        in.read(reinterpret_cast<char*>(&n_ipv4), sizeof(n_ipv4));
+        in.read(reinterpret_cast<char*>(&n_ipv6), sizeof(n_ipv6));
+        supported_file = in && BinContentsPrefix == std::string_view{ std::data(tmp), std::size(tmp) } &&
+            file_info->size == BinHeaderSize + n_ipv4 * sizeof(ipv4_range_t) + n_ipv6 * sizeof(ipv6_range_t);
     }
 
     if (!supported_file)
@@ -374,28 +679,34 @@ void Blocklist::ensureLoaded() const
         if (auto const sz_src_file = std::string{ std::data(bin_file_), std::size(bin_file_) - std::size(BinFileSuffix) };
             tr_sys_path_exists(sz_src_file))
         {
-            rules_ = parseFile(sz_src_file);
-            if (!std::empty(rules_))
+            tr_logAddInfo(_("Rewriting old blocklist file format to new format"));
+            if (importFile(sz_src_file, bin_file_))
             {
-                tr_logAddInfo(_("Rewriting old blocklist file format to new format"));
-                tr_sys_path_remove(bin_file_);
-                save(bin_file_, std::data(rules_), std::size(rules_));
+                ensureLoaded();
             }
         }
         return;
     }
 
-    auto range = address_range_t{};
-    rules_.reserve((file_info->size - std::size(BinContentsPrefix)) / sizeof(address_range_t));
-    while (in.read(reinterpret_cast<char*>(&range), sizeof(range)))
+    ipv4_rules_.resize(n_ipv4);
+    ipv6_rules_.resize(n_ipv6);
+    if (!in.read(reinterpret_cast<char*>(std::data(ipv4_rules_)), n_ipv4 * sizeof(ipv4_range_t)) ||
+        !in.read(reinterpret_cast<char*>(std::data(ipv6_rules_)), n_ipv6 * sizeof(ipv6_range_t)))
     {
-        rules_.emplace_back(range);
+        tr_logAddWarn(fmt::format(
+            _("Couldn't read '{path}': {error} ({error_code})"),
+            fmt::arg("path", bin_file_),
+            fmt::arg("error", tr_strerror(errno)),
+            fmt::arg("error_code", errno)));
+        ipv4_rules_.clear();
+        ipv6_rules_.clear();
+        return;
     }
 
     tr_logAddInfo(fmt::format(
-        tr_ngettext("Blocklist '{path}' has {count} entry", "Blocklist '{path}' has {count} entries", std::size(rules_)),
+        tr_ngettext("Blocklist '{path}' has {count} entry", "Blocklist '{path}' has {count} entries", size()),
         fmt::arg("path", tr_sys_path_basename(bin_file_)),
-        fmt::arg("count", std::size(rules_))));
+        fmt::arg("count", size())));
 }
 
 std::vector<Blocklist> Blocklist::loadBlocklists(std::string_view const blocklist_dir, bool const is_enabled)
@@ -403,7 +714,7 @@ std::vector<Blocklist> Blocklist::loadBlocklists(std::string_view const blocklis
     // check for files that need to be updated
     for (auto const& src_file : getFilenamesInDir(blocklist_dir))
     {
-        if (tr_strv_ends_with(src_file, BinFileSuffix))
+        if (tr_strv_ends_with(src_file, BinFileSuffix) || tr_strv_ends_with(src_file, TmpFileSuffix))
         {
             continue;
         }
@@ -415,10 +726,7 @@ std::vector<Blocklist> Blocklist::loadBlocklists(std::string_view const blocklis
         auto const bin_needs_update = src_info && (!bin_info || bin_info->last_modified_at <= src_info->last_modified_at);
         if (bin_needs_update)
         {
-            if (auto const ranges = parseFile(src_file); !std::empty(ranges))
-            {
-                save(bin_file, std::data(ranges), std::size(ranges));
-            }
+            importFile(src_file, bin_file);
         }
     }
 
@@ -444,54 +752,16 @@ bool Blocklist::contains(tr_address const& addr) const
 
     ensureLoaded();
 
-    struct Compare
-    {
-        [[nodiscard]] static auto compare(tr_address const& a, address_range_t const& b) noexcept // <=>
-        {
-            if (a < b.first)
-            {
-                return -1;
-            }
-            if (b.second < a)
-            {
-                return 1;
-            }
-            return 0;
-        }
-
-        [[nodiscard]] static auto compare(address_range_t const& a, tr_address const& b) noexcept // <=>
-        {
-            return -compare(b, a);
-        }
-
-        [[nodiscard]] auto operator()(address_range_t const& a, tr_address const& b) const noexcept // <
-        {
-            return compare(a, b) < 0;
-        }
-
-        [[nodiscard]] auto operator()(tr_address const& a, address_range_t const& b) const noexcept // <
-        {
-            return compare(a, b) < 0;
-        }
-    };
-
-    return std::binary_search(std::begin(rules_), std::end(rules_), addr, Compare{});
+    return addr.is_ipv4() ? sortedContains(ipv4_rules_, toIpv4(addr)) : sortedContains(ipv6_rules_, toIpv6(addr));
 }
 
 std::optional<Blocklist> Blocklist::saveNew(std::string_view external_file, std::string_view bin_file, bool is_enabled)
 {
-    // if we can't parse the file, do nothing
-    auto rules = parseFile(external_file);
-    if (std::empty(rules))
-    {
-        return {};
-    }
-
     // make a copy of `external_file` for our own safekeeping
     auto const src_file = std::string{ std::data(bin_file), std::size(bin_file) - std::size(BinFileSuffix) };
-    tr_sys_path_remove(src_file.c_str());
+    auto const tmp_file = tr_pathbuf{ src_file, TmpFileSuffix };
     tr_error* error = nullptr;
-    auto const copied = tr_sys_path_copy(tr_pathbuf{ external_file }, src_file.c_str(), &error);
+    auto const copied = tr_sys_path_copy(tr_pathbuf{ external_file }, tmp_file, &error);
     if (error != nullptr)
     {
         tr_logAddWarn(fmt::format(
@@ -506,12 +776,96 @@ std::optional<Blocklist> Blocklist::saveNew(std::string_view external_file, std:
         return {};
     }
 
-    save(bin_file, std::data(rules), std::size(rules));
+    // if we can't parse the file, do nothing
+    if (!importFile(tmp_file, bin_file))
+    {
+        tr_sys_path_remove(tmp_file);
+        return {};
+    }
+
+    // The .bin must be newer than its source, or loadBlocklists() will rebuild it.
+    // Renaming the copy into place keeps the copy's older timestamp.
+    tr_sys_path_rename(tmp_file, src_file.c_str());
 
-    // return a new Blocklist with these rules
-    auto ret = Blocklist{ bin_file, is_enabled };
-    ret.rules_ = std::move(rules);
-    return ret;
+    return Blocklist{ bin_file, is_enabled };
+}
+
+// ---
+
+MergedBlocklist::MergedBlocklist(std::vector<Blocklist> const& blocklists)
+{
+    auto merged = Rules{};
+    for (auto const& blocklist : blocklists)
+    {
+        if (!blocklist.enabled())
+        {
+            continue;
+        }
+
+        blocklist.ensureLoaded();
+        merged.ipv4.insert(std::end(merged.ipv4), std::begin(blocklist.ipv4_rules_), std::end(blocklist.ipv4_rules_));
+        merged.ipv6.insert(std::end(merged.ipv6), std::begin(blocklist.ipv6_rules_), std::end(blocklist.ipv6_rules_));
+    }
+
+    normalize(merged.ipv4);
+    normalize(merged.ipv6);
+
+    ipv4_rules_.resize(std::size(merged.ipv4));
+    toEytzinger(merged.ipv4, ipv4_rules_);
+    ipv6_rules_.resize(std::size(merged.ipv6));
+    toEytzinger(merged.ipv6, ipv6_rules_);
+}
+
+bool MergedBlocklist::contains(tr_address const& addr) const noexcept
+{
+    TR_ASSERT(addr.is_valid());
+
+    return addr.is_ipv4() ? eytzingerContains(ipv4_rules_, toIpv4(addr)) : eytzingerContains(ipv6_rules_, toIpv6(addr));
+}
+
+void MergedBlocklist::contains(tr_address const* addrs, size_t n_addrs, bool* setme) const noexcept
+{
+    static auto constexpr BatchSize = size_t{ 8U };
+
+    auto const lookup = [&](auto const& rules, tr_address_type type, auto to_key)
+    {
+        using Key = decltype(to_key(tr_address{}));
+
+        auto keys = std::array<Key, BatchSize>{};
+        auto indices = std::array<size_t, BatchSize>{};
+        auto found = std::array<bool, BatchSize>{};
+        auto n_keys = size_t{};
+
+        auto const flush = [&]()
+        {
+            eytzingerContains(rules, keys, n_keys, found);
+            for (size_t i = 0U; i < n_keys; ++i)
+            {
+                setme[indices[i]] = found[i];
+            }
+            n_keys = 0U;
+        };
+
+        for (size_t i = 0U; i < n_addrs; ++i)
+        {
+            if (addrs[i].type == type)
+            {
+                TR_ASSERT(addrs[i].is_valid());
+                keys[n_keys] = to_key(addrs[i]);
+                indices[n_keys] = i;
+
+                if (++n_keys == BatchSize)
+                {
+                    flush();
+                }
+            }
+        }
+
+        flush();
+    };
+
+    lookup(ipv4_rules_, TR_AF_INET, [](tr_address const& addr) { return toIpv4(addr); });
+    lookup(ipv6_rules_, TR_AF_INET6, [](tr_address const& addr) { return toIpv6(addr); });
 }
 
 } // namespace libtransmission
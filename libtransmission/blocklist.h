@@ -9,6 +9,9 @@
 #error only libtransmission should #include this header.
 #endif
 
+#include <array>
+#include <cstddef> // size_t
+#include <cstdint> // uint32_t
 #include <optional>
 #include <string>
 #include <string_view>
@@ -23,8 +26,17 @@ namespace libtransmission
 class Blocklist
 {
 public:
+    // Addresses are kept in a compact form that sorts the same way
+    // the addresses do: host byte order for IPv4, raw bytes for IPv6.
+    using ipv4_t = uint32_t;
+    using ipv6_t = std::array<uint8_t, 16>;
+    using ipv4_range_t = std::pair<ipv4_t, ipv4_t>;
+    using ipv6_range_t = std::pair<ipv6_t, ipv6_t>;
+
     [[nodiscard]] static std::vector<Blocklist> loadBlocklists(std::string_view const blocklist_dir, bool const is_enabled);
 
+    // Import `external_file` into `bin_file`. This only touches the filesystem,
+    // so it can run in a worker thread while the session keeps running.
     static std::optional<Blocklist> saveNew(std::string_view external_file, std::string_view bin_file, bool is_enabled);
 
     Blocklist() = default;
@@ -41,7 +53,7 @@ public:
     {
         ensureLoaded();
 
-        return std::size(rules_);
+        return std::size(ipv4_rules_) + std::size(ipv6_rules_);
     }
 
     [[nodiscard]] constexpr bool enabled() const noexcept
@@ -60,12 +72,41 @@ public:
     }
 
 private:
+    friend class MergedBlocklist;
+
     void ensureLoaded() const;
 
-    mutable std::vector<std::pair<tr_address, tr_address>> rules_;
+    mutable std::vector<ipv4_range_t> ipv4_rules_;
+    mutable std::vector<ipv6_range_t> ipv6_rules_;
 
     std::string bin_file_;
     bool is_enabled_ = false;
 };
 
+// The rules of several blocklists merged into a single lookup table.
+// Ranges are stored in Eytzinger (BFS) order so that a lookup walks
+// down an implicit binary tree whose top levels stay in cache.
+class MergedBlocklist
+{
+public:
+    MergedBlocklist() = default;
+
+    explicit MergedBlocklist(std::vector<Blocklist> const& blocklists);
+
+    [[nodiscard]] bool contains(tr_address const& addr) const noexcept;
+
+    // Set `setme[i]` to whether `addrs[i]` is blocked. Several lookups are
+    // walked at once, so that their cache misses overlap.
+    void contains(tr_address const* addrs, size_t n_addrs, bool* setme) const noexcept;
+
+    [[nodiscard]] auto size() const noexcept
+    {
+        return std::size(ipv4_rules_) + std::size(ipv6_rules_);
+    }
+
+private:
+    std::vector<Blocklist::ipv4_range_t> ipv4_rules_;
+    std::vector<Blocklist::ipv6_range_t> ipv6_rules_;
+};
+
 } // namespace libtransmission
@@ -5,112 +5,176 @@
 
 #include <algorithm>
 #include <cerrno>
+#include <chrono>
 #include <cstdint> // uint8_t
-#include <iterator> // std::distance(), std::next(), std::prev()
+#include <ctime> // time_t
+#include <iterator> // std::back_inserter(), std::make_move_iterator(), std::next(), std::prev()
+#include <limits>
 #include <memory>
-#include <numeric> // std::accumulate()
-#include <utility> // std::make_pair()
+#include <string>
+#include <string_view>
+#include <utility> // std::move()
 #include <vector>
 
+#ifdef __linux__
+#include <sys/stat.h>
+#include <sys/sysmacros.h> // major(), minor()
+#endif
+
 #include <fmt/core.h>
 #include <small/vector.hpp>
 
 #include "libtransmission/transmission.h"
 
 #include "libtransmission/cache.h"
+#include "libtransmission/disk-writer.h"
+#include "libtransmission/error.h"
+#include "libtransmission/file.h" // tr_sys_file_iovec
 #include "libtransmission/inout.h"
 #include "libtransmission/log.h"
+#include "libtransmission/metrics.h"
 #include "libtransmission/torrent.h"
 #include "libtransmission/torrents.h"
 #include "libtransmission/tr-assert.h"
-#include "libtransmission/utils.h" // tr_formatter
+#include "libtransmission/tracing.h"
+#include "libtransmission/utils.h" // tr_formatter, tr_strerror()
 
-Cache::Key Cache::make_key(tr_torrent const* torrent, tr_block_info::Location loc) noexcept
+namespace
+{
+// @return true if `path` is on a spinning disk, as far as we can tell
+[[nodiscard]] bool is_on_rotational_disk([[maybe_unused]] std::string_view path)
 {
-    return std::make_pair(torrent->id(), loc.block);
+#ifdef __linux__
+    struct stat sb = {};
+    if (stat(std::string{ path }.c_str(), &sb) != 0)
+    {
+        return false;
+    }
+
+    // a partition has no queue/ of its own, but its parent disk does
+    for (auto const* const pattern : { "/sys/dev/block/{:d}:{:d}/queue/rotational", "/sys/dev/block/{:d}:{:d}/../queue/rotational" })
+    {
+        auto contents = std::vector<char>{};
+        if (tr_file_read(fmt::format(fmt::runtime(pattern), major(sb.st_dev), minor(sb.st_dev)), contents))
+        {
+            return !std::empty(contents) && contents.front() == '1';
+        }
+    }
+#endif
+
+    return false;
 }
+} // namespace
 
-Cache::CIter Cache::find_span_end(CIter span_begin, CIter end) noexcept
+tr_block_pool& Cache::BlockData::pool()
 {
-    static constexpr auto NotAdjacent = [](CacheBlock const& block1, CacheBlock const& block2)
-    {
-        return block1.key.first != block2.key.first || block1.key.second + 1 != block2.key.second;
-    };
-    auto const span_end = std::adjacent_find(span_begin, end, NotAdjacent);
-    return span_end == end ? end : std::next(span_end);
+    static auto instance = tr_block_pool{ sizeof(BlockData),
+                                          __STDCPP_DEFAULT_NEW_ALIGNMENT__,
+                                          tr_block_pool::Backing::Slabs };
+    return instance;
 }
 
-std::pair<Cache::CIter, Cache::CIter> Cache::find_biggest_span(CIter const begin, CIter const end) noexcept
+void* Cache::BlockData::operator new([[maybe_unused]] size_t size)
 {
-    auto biggest_begin = begin;
-    auto biggest_end = begin;
-    auto biggest_len = std::distance(biggest_begin, biggest_end);
+    TR_ASSERT(size == pool().buffer_size()); // BlockData is final
+    return pool().get();
+}
 
-    for (auto span_begin = begin; span_begin < end;)
-    {
-        auto span_end = find_span_end(span_begin, end);
-        auto const len = std::distance(span_begin, span_end);
+void Cache::BlockData::operator delete(void* ptr) noexcept
+{
+    pool().put(ptr);
+}
 
-        if (len > biggest_len)
-        {
-            biggest_begin = span_begin;
-            biggest_end = span_end;
-            biggest_len = len;
-        }
+// ---
 
-        std::advance(span_begin, len);
+Cache::Runs::iterator Cache::find_run(Runs& runs, tr_block_index_t block) noexcept
+{
+    // find the last run that begins at or before `block`
+    auto iter = runs.upper_bound(block);
+    if (iter == std::begin(runs))
+    {
+        return std::end(runs);
     }
 
-    return { biggest_begin, biggest_end };
+    iter = std::prev(iter);
+    auto const& [begin, blocks] = *iter;
+    return block < begin + std::size(blocks) ? iter : std::end(runs);
 }
 
-int Cache::write_contiguous(CIter const begin, CIter const end) const
+Cache::Runs::iterator Cache::add_run(tr_torrent_id_t tor_id, Runs& runs, tr_block_index_t begin, Blocks&& blocks)
 {
-    // The most common case without an extra data copy.
-    auto const* out = std::data(*begin->buf);
-    auto outlen = std::size(*begin->buf);
+    TR_ASSERT(!std::empty(blocks));
+
+    n_blocks_ += std::size(blocks);
+    runs_by_size_.insert(RunKey{ std::size(blocks), tor_id, begin });
+    return runs.try_emplace(begin, std::move(blocks)).first;
+}
 
-    // Contiguous area to join more than one block, if any.
-    auto buf = std::vector<uint8_t>{};
+Cache::Blocks Cache::take_run(tr_torrent_id_t tor_id, Runs& runs, Runs::iterator iter)
+{
+    auto blocks = std::move(iter->second);
+    runs_by_size_.erase(RunKey{ std::size(blocks), tor_id, iter->first });
+    n_blocks_ -= std::size(blocks);
+    runs.erase(iter);
+    return blocks;
+}
 
-    if (end - begin > 1)
+void Cache::split_run(tr_torrent_id_t tor_id, Runs& runs, tr_block_index_t block)
+{
+    auto const iter = find_run(runs, block);
+    if (iter == std::end(runs) || iter->first == block)
     {
-        // copy blocks into contiguous memory
-        auto const buflen = std::accumulate(
-            begin,
-            end,
-            size_t{},
-            [](size_t sum, auto const& block) { return sum + std::size(*block.buf); });
-        buf.resize(buflen);
-        auto* walk = std::data(buf);
-        for (auto iter = begin; iter != end; ++iter)
-        {
-            TR_ASSERT(begin->key.first == iter->key.first);
-            TR_ASSERT(begin->key.second + std::distance(begin, iter) == iter->key.second);
-            walk = std::copy_n(std::data(*iter->buf), std::size(*iter->buf), walk);
-        }
-        TR_ASSERT(std::data(buf) + std::size(buf) == walk);
-        out = std::data(buf);
-        outlen = std::size(buf);
+        return;
     }
 
-    // save it
-    auto const& [torrent_id, block] = begin->key;
-    auto* const tor = torrents_.get(torrent_id);
+    auto const begin = iter->first;
+    auto head = take_run(tor_id, runs, iter);
+    auto const split = std::next(std::begin(head), block - begin);
+    auto tail = Blocks{ std::make_move_iterator(split), std::make_move_iterator(std::end(head)) };
+    head.erase(split, std::end(head));
+
+    add_run(tor_id, runs, begin, std::move(head));
+    add_run(tor_id, runs, block, std::move(tail));
+}
+
+int Cache::write_contiguous(tr_torrent_id_t const tor_id, tr_block_index_t const begin, Blocks const& blocks)
+{
+    TR_ASSERT(!std::empty(blocks));
+    TR_TRACE_SCOPE("cache", "write_contiguous");
+
+    auto* const tor = torrents_.get(tor_id);
     if (tor == nullptr)
     {
         return EINVAL;
     }
 
-    auto const loc = tor->block_loc(block);
+    // write the blocks straight from their own buffers
+    auto vecs = std::vector<tr_sys_file_iovec>{};
+    vecs.reserve(std::size(blocks));
+    auto outlen = size_t{};
+    for (auto const& block : blocks)
+    {
+        vecs.push_back({ std::data(*block), std::size(*block) });
+        outlen += std::size(*block);
+    }
 
-    if (auto const err = tr_ioWrite(tor, loc, outlen, out); err != 0)
+    auto const ticket = io_scheduler_.begin(disk(tor).device, tr_io_scheduler::Class::Flush, outlen);
+    auto const started_at = std::chrono::steady_clock::now();
+    if (auto const err = tr_ioWrite(tor, tor->block_loc(begin), std::data(vecs), std::size(vecs)); err != 0)
     {
         return err;
     }
 
     ++disk_writes_;
     disk_write_bytes_ += outlen;
+    tor->usage().add_io(tr_torrent_usage::DiskWrites, tr_torrent_usage::DiskWriteBytes, outlen);
+
+    auto const duration = std::chrono::steady_clock::now() - started_at;
+    tr_metrics::instance().cache_flush_duration.observe(std::chrono::duration_cast<std::chrono::microseconds>(duration));
+
+    ++flush_stats_.n_writes;
+    flush_stats_.n_bytes += outlen;
+    flush_stats_.msec += std::chrono::duration_cast<std::chrono::milliseconds>(duration).count();
     return {};
 }
 
@@ -128,8 +192,46 @@ int Cache::set_limit(size_t new_limit)
     return cache_trim();
 }
 
-Cache::Cache(tr_torrents& torrents, size_t max_bytes)
+void Cache::set_read_limit(size_t new_limit)
+{
+    read_cache_.set_max_blocks(get_max_blocks(new_limit));
+
+    tr_logAddDebug(
+        fmt::format("Maximum read cache size set to {} ({} blocks)", tr_formatter_mem_B(new_limit), read_cache_.max_blocks()));
+}
+
+size_t Cache::dirty_bytes() const noexcept
+{
+    auto n_blocks = n_blocks_;
+    for (auto const& [job_id, in_flight] : in_flight_)
+    {
+        n_blocks += std::size(in_flight.blocks);
+    }
+    return n_blocks * tr_block_info::BlockSize;
+}
+
+size_t Cache::dirty_bytes(tr_torrent_id_t tor_id) const
+{
+    auto n_blocks = size_t{};
+    if (auto const found = runs_.find(tor_id); found != std::end(runs_))
+    {
+        for (auto const& [begin, blocks] : found->second)
+        {
+            n_blocks += std::size(blocks);
+        }
+    }
+
+    for (auto const& [job_id, in_flight] : in_flight_)
+    {
+        n_blocks += in_flight.tor_id == tor_id ? std::size(in_flight.blocks) : 0U;
+    }
+
+    return n_blocks * tr_block_info::BlockSize;
+}
+
+Cache::Cache(tr_torrents& torrents, tr_io_scheduler& io_scheduler, size_t max_bytes)
     : torrents_{ torrents }
+    , io_scheduler_{ io_scheduler }
     , max_blocks_(get_max_blocks(max_bytes))
 {
 }
@@ -138,129 +240,478 @@ Cache::Cache(tr_torrents& torrents, size_t max_bytes)
 
 int Cache::write_block(tr_torrent_id_t tor_id, tr_block_index_t block, std::unique_ptr<BlockData> writeme)
 {
+    reap_async_writes();
+
+    if (trace_.is_open())
+    {
+        if (auto const* const tor = torrents_.get(tor_id); tor != nullptr)
+        {
+            trace_.record(tr_io_trace::Op::Write, tor, tor->block_loc(block).byte, std::size(*writeme));
+        }
+    }
+
+    // any clean copy is stale now
+    read_cache_.erase({ tor_id, block });
+
     if (max_blocks_ == 0U)
     {
-        TR_ASSERT(std::empty(blocks_));
+        TR_ASSERT(n_blocks_ == 0U);
+
+        // don't let an older background write clobber this one
+        finish_async_writes();
 
         // Bypass cache. This may be helpful for those whose filesystem
         // already has a cache layer for the very purpose of this cache
         // https://github.com/transmission/transmission/pull/5668
         auto* const tor = torrents_.get(tor_id);
+        tor->usage().add_io(tr_torrent_usage::DiskWrites, tr_torrent_usage::DiskWriteBytes, std::size(*writeme));
         return tr_ioWrite(tor, tor->block_loc(block), std::size(*writeme), std::data(*writeme));
     }
 
-    auto const key = Key{ tor_id, block };
-    auto iter = std::lower_bound(std::begin(blocks_), std::end(blocks_), key, CompareCacheBlockByKey);
-    if (iter == std::end(blocks_) || iter->key != key)
+    ++cache_writes_;
+    cache_write_bytes_ += std::size(*writeme);
+    if (auto* const tor = torrents_.get(tor_id); tor != nullptr)
     {
-        iter = blocks_.emplace(iter);
-        iter->key = key;
+        tor->usage().add_io(tr_torrent_usage::CacheWrites, tr_torrent_usage::CacheWriteBytes, std::size(*writeme));
     }
 
-    iter->buf = std::move(writeme);
-
-    ++cache_writes_;
-    cache_write_bytes_ += std::size(*iter->buf);
+    insert_block(tor_id, block, std::move(writeme));
 
     return cache_trim();
 }
 
-Cache::CIter Cache::get_block(tr_torrent const* torrent, tr_block_info::Location const& loc) noexcept
+void Cache::insert_block(tr_torrent_id_t tor_id, tr_block_index_t block, std::unique_ptr<BlockData> writeme)
+{
+    auto& runs = runs_[tor_id];
+    dirty_since_.try_emplace(tor_id, tr_time());
+
+    // if we already have this block, just replace it
+    if (auto const iter = find_run(runs, block); iter != std::end(runs))
+    {
+        iter->second[block - iter->first] = std::move(writeme);
+        return;
+    }
+
+    auto begin = block;
+    auto blocks = Blocks{};
+    blocks.emplace_back(std::move(writeme));
+
+    // join the run that ends just before this block, if any
+    if (auto const iter = runs.lower_bound(block); iter != std::begin(runs))
+    {
+        if (auto const prev = std::prev(iter); prev->first + std::size(prev->second) == block)
+        {
+            begin = prev->first;
+            auto head = take_run(tor_id, runs, prev);
+            head.emplace_back(std::move(blocks.front()));
+            blocks = std::move(head);
+        }
+    }
+
+    // join the run that begins just after this block, if any
+    if (auto const next = runs.find(block + 1); next != std::end(runs))
+    {
+        auto tail = take_run(tor_id, runs, next);
+
+        // move the shorter run onto the longer one
+        if (std::size(blocks) < std::size(tail))
+        {
+            for (auto iter = std::rbegin(blocks); iter != std::rend(blocks); ++iter)
+            {
+                tail.emplace_front(std::move(*iter));
+            }
+            blocks = std::move(tail);
+        }
+        else
+        {
+            std::move(std::begin(tail), std::end(tail), std::back_inserter(blocks));
+        }
+    }
+
+    add_run(tor_id, runs, begin, std::move(blocks));
+}
+
+Cache::BlockData const* Cache::get_block(tr_torrent const* torrent, tr_block_info::Location const& loc) noexcept
 {
-    if (auto const [begin, end] = std::equal_range(
-            std::begin(blocks_),
-            std::end(blocks_),
-            make_key(torrent, loc),
-            CompareCacheBlockByKey);
-        begin < end)
+    if (auto const found = runs_.find(torrent->id()); found != std::end(runs_))
     {
-        return begin;
+        auto& runs = found->second;
+        if (auto const iter = find_run(runs, loc.block); iter != std::end(runs))
+        {
+            return iter->second[loc.block - iter->first].get();
+        }
     }
 
-    return std::end(blocks_);
+    // maybe it's still being written. Check the newest writes first.
+    for (auto iter = std::rbegin(in_flight_), end = std::rend(in_flight_); iter != end; ++iter)
+    {
+        auto const& [tor_id, begin, blocks] = iter->second;
+        if (tor_id == torrent->id() && begin <= loc.block && loc.block < begin + std::size(blocks))
+        {
+            return blocks[loc.block - begin].get();
+        }
+    }
+
+    return nullptr;
 }
 
 int Cache::read_block(tr_torrent* torrent, tr_block_info::Location const& loc, uint32_t len, uint8_t* setme)
 {
-    if (auto const iter = get_block(torrent, loc); iter != std::end(blocks_))
+    trace_.record(tr_io_trace::Op::Read, torrent, loc.byte, len);
+
+    auto& usage = torrent->usage();
+    if (auto const* const block = get_block(torrent, loc); block != nullptr)
+    {
+        usage.add_io(tr_torrent_usage::CacheReads, tr_torrent_usage::CacheReadBytes, len);
+        std::copy_n(std::begin(*block), len, setme);
+        return {};
+    }
+
+    if (!std::empty(reading_))
+    {
+        reap_async_writes();
+    }
+
+    auto const key = std::make_pair(torrent->id(), loc.block);
+    if (auto const* const data = read_cache_.get(key); data != nullptr && loc.block_offset + len <= std::size(*data))
     {
-        std::copy_n(std::begin(*iter->buf), len, setme);
+        usage.add_io(tr_torrent_usage::CacheReads, tr_torrent_usage::CacheReadBytes, len);
+        std::copy_n(std::next(std::begin(*data), loc.block_offset), len, setme);
         return {};
     }
 
-    return tr_ioRead(torrent, loc, len, setme);
+    usage.add_io(tr_torrent_usage::DiskReads, tr_torrent_usage::DiskReadBytes, len);
+    auto ticket = io_scheduler_.begin(disk(torrent).device, tr_io_scheduler::Class::Read, len);
+    if (auto const err = tr_ioRead(torrent, loc, len, setme); err != 0)
+    {
+        return err;
+    }
+    ticket.reset();
+
+    // keep whole blocks that we have, e.g. ones being uploaded
+    if (auto const block_size = torrent->block_size(loc.block);
+        loc.block_offset == 0U && len == block_size && torrent->has_block(loc.block))
+    {
+        auto data = std::make_unique<BlockData>(block_size);
+        std::copy_n(setme, len, std::data(*data));
+        read_cache_.insert(key, std::move(data));
+    }
+
+    return {};
 }
 
 int Cache::prefetch_block(tr_torrent* torrent, tr_block_info::Location const& loc, uint32_t len)
 {
-    if (auto const iter = get_block(torrent, loc); iter != std::end(blocks_))
+    trace_.record(tr_io_trace::Op::Prefetch, torrent, loc.byte, len);
+
+    if (get_block(torrent, loc) != nullptr)
     {
         return {}; // already have it
     }
 
-    return tr_ioPrefetch(torrent, loc, len);
+    // Fall back to an OS hint if there's nowhere to read into,
+    // or if the disk is already busy enough.
+    if (!writer_ || read_cache_.max_blocks() < MinReadAheadBlocks || writer_->size() >= MaxInFlightWrites ||
+        !io_scheduler_.may_start(disk(torrent).device, tr_io_scheduler::Class::Prefetch))
+    {
+        return tr_ioPrefetch(torrent, loc, len);
+    }
+
+    // If the block is already cached or on its way, then so is the
+    // window that was read along with it; the window slides forward
+    // when a peer asks for a block past its end.
+    if (!wants_read_ahead(torrent, loc.block))
+    {
+        return {};
+    }
+
+    auto const end = std::min(loc.block + std::min(read_ahead_window_, MaxReadAheadBlocks), torrent->block_count());
+
+    // read the blocks that we have and that aren't cached yet, in runs
+    auto run_begin = loc.block;
+    for (auto block = loc.block; block < end; ++block)
+    {
+        if (!wants_read_ahead(torrent, block))
+        {
+            read_ahead(torrent, run_begin, block);
+            run_begin = block + 1U;
+        }
+    }
+    read_ahead(torrent, run_begin, end);
+
+    return {};
+}
+
+// --- read-ahead
+
+bool Cache::wants_read_ahead(tr_torrent const* torrent, tr_block_index_t block) noexcept
+{
+    return torrent->has_block(block) && !read_cache_.contains({ torrent->id(), block }) &&
+        get_block(torrent, torrent->block_loc(block)) == nullptr;
+}
+
+void Cache::read_ahead(tr_torrent* torrent, tr_block_index_t begin, tr_block_index_t end)
+{
+    if (begin >= end)
+    {
+        return;
+    }
+
+    auto blocks = Blocks{};
+    auto vecs = std::vector<tr_sys_file_iovec>{};
+    vecs.reserve(end - begin);
+    for (auto block = begin; block < end; ++block)
+    {
+        auto& data = blocks.emplace_back(std::make_unique<BlockData>(torrent->block_size(block)));
+        vecs.push_back({ std::data(*data), std::size(*data) });
+    }
+
+    // A read splits at file boundaries the same way that a write does.
+    // Padding files are left out of it, so their bytes have to start out as zeroes.
+    for (auto const& data : blocks)
+    {
+        std::fill_n(std::data(*data), std::size(*data), uint8_t{});
+    }
+    auto reads = tr_ioPlanWrite(torrent, torrent->block_loc(begin), std::data(vecs), std::size(vecs));
+    if (!reads)
+    {
+        return;
+    }
+
+    auto const tor_id = torrent->id();
+    for (auto block = begin; block < end; ++block)
+    {
+        read_cache_.reserve({ tor_id, block });
+    }
+
+    auto const n_bytes = std::size(blocks) * uint64_t{ tr_block_info::BlockSize };
+    torrent->usage().add_io(tr_torrent_usage::DiskReads, tr_torrent_usage::DiskReadBytes, n_bytes);
+    auto ticket = io_scheduler_.begin(disk(torrent).device, tr_io_scheduler::Class::Prefetch, n_bytes);
+    auto const id = writer_->add_read(std::move(*reads), std::move(ticket));
+    reading_.try_emplace(id, InFlight{ tor_id, begin, std::move(blocks) });
+}
+
+void Cache::on_read_ahead_done(InFlight& reading, int err)
+{
+    auto& [tor_id, begin, blocks] = reading;
+
+    for (size_t i = 0, n = std::size(blocks); i < n; ++i)
+    {
+        auto const key = std::make_pair(tor_id, static_cast<tr_block_index_t>(begin + i));
+
+        if (err != 0)
+        {
+            read_cache_.unreserve(key);
+        }
+        else
+        {
+            // dropped if the block was rewritten or its torrent flushed since the read began
+            read_cache_.fill(key, std::move(blocks[i]));
+        }
+    }
+
+    resize_read_ahead_window();
+}
+
+void Cache::resize_read_ahead_window()
+{
+    auto const& stats = read_cache_.stats();
+    auto const used = stats.evicted_used - read_ahead_last_stats_.evicted_used;
+    auto const wasted = stats.evicted_unused - read_ahead_last_stats_.evicted_unused;
+    if (used + wasted < ReadAheadSampleSize)
+    {
+        return;
+    }
+
+    // Grow while nearly everything is used; shrink when a quarter or more is wasted.
+    if (wasted * 4U >= used + wasted)
+    {
+        read_ahead_window_ = std::max(read_ahead_window_ / 2U, MinReadAheadBlocks);
+    }
+    else if (wasted * 16U < used + wasted)
+    {
+        auto const max_window = std::max(static_cast<tr_block_index_t>(read_cache_.max_blocks() / 2U), MinReadAheadBlocks);
+        read_ahead_window_ = std::min({ read_ahead_window_ * 2U, MaxReadAheadBlocks, max_window });
+    }
+
+    read_ahead_last_stats_ = stats;
 }
 
 // ---
 
-int Cache::flush_span(CIter const begin, CIter const end)
+int Cache::flush_span(tr_torrent_id_t const tor_id, tr_block_index_t const begin, tr_block_index_t const end)
 {
-    for (auto span_begin = begin; span_begin < end;)
+    // callers expect the data to be on disk when we return
+    finish_async_writes();
+
+    auto const found = runs_.find(tor_id);
+    if (found == std::end(runs_))
     {
-        auto const span_end = find_span_end(span_begin, end);
+        return {};
+    }
 
-        if (auto const err = write_contiguous(span_begin, span_end); err != 0)
+    auto& runs = found->second;
+    split_run(tor_id, runs, begin);
+    split_run(tor_id, runs, end);
+
+    for (auto iter = runs.lower_bound(begin); iter != std::end(runs) && iter->first < end; iter = runs.lower_bound(begin))
+    {
+        if (auto const err = write_contiguous(tor_id, iter->first, iter->second); err != 0)
         {
             return err;
         }
 
-        span_begin = span_end;
+        take_run(tor_id, runs, iter);
+    }
+
+    if (std::empty(runs))
+    {
+        runs_.erase(found);
+        dirty_since_.erase(tor_id);
     }
 
-    blocks_.erase(begin, end);
     return {};
 }
 
 int Cache::flush_file(tr_torrent const* torrent, tr_file_index_t file)
 {
-    auto const tor_id = torrent->id();
+    if (trace_.is_open())
+    {
+        auto const [begin, end] = torrent->byte_span(file);
+        trace_.record(tr_io_trace::Op::FlushFile, torrent, begin, end - begin);
+    }
+
     auto const [block_begin, block_end] = tr_torGetFileBlockSpan(torrent, file);
 
-    return flush_span(
-        std::lower_bound(std::begin(blocks_), std::end(blocks_), std::make_pair(tor_id, block_begin), CompareCacheBlockByKey),
-        std::lower_bound(std::begin(blocks_), std::end(blocks_), std::make_pair(tor_id, block_end), CompareCacheBlockByKey));
+    return flush_span(torrent->id(), block_begin, block_end);
 }
 
 int Cache::flush_torrent(tr_torrent const* torrent)
 {
-    auto const tor_id = torrent->id();
+    trace_.record(tr_io_trace::Op::FlushTorrent, torrent, 0U, torrent->total_size());
+
+    // the torrent's files may be about to move or change
+    read_cache_.erase_torrent(torrent->id());
+    disks_.erase(torrent->id());
 
-    return flush_span(
-        std::lower_bound(std::begin(blocks_), std::end(blocks_), std::make_pair(tor_id, 0), CompareCacheBlockByKey),
-        std::lower_bound(std::begin(blocks_), std::end(blocks_), std::make_pair(tor_id + 1, 0), CompareCacheBlockByKey));
+    return flush_span(torrent->id(), 0U, torrent->block_count());
+}
+
+int Cache::flush_aged(time_t const now)
+{
+    auto aged = std::vector<tr_torrent_id_t>{};
+    for (auto const& [tor_id, dirty_since] : dirty_since_)
+    {
+        auto const* const tor = torrents_.get(tor_id);
+        auto const max_age = tor != nullptr && disk(tor).is_rotational ? MaxDirtySecsRotational : MaxDirtySecs;
+        if (dirty_since + max_age <= now)
+        {
+            aged.push_back(tor_id);
+        }
+    }
+
+    auto ret = 0;
+    for (auto const tor_id : aged)
+    {
+        // flush_span() writes in file-offset order
+        if (auto const err = flush_span(tor_id, 0U, std::numeric_limits<tr_block_index_t>::max()); err != 0)
+        {
+            // don't retry every second
+            dirty_since_[tor_id] = now;
+            ret = ret != 0 ? ret : err;
+        }
+    }
+
+    return ret;
+}
+
+Cache::Disk const& Cache::disk(tr_torrent const* torrent)
+{
+    auto const [iter, is_new] = disks_.try_emplace(torrent->id());
+    if (is_new)
+    {
+        auto const dir = torrent->current_dir().sv();
+        iter->second.device = tr_io_scheduler::device_of(dir);
+        iter->second.is_rotational = is_on_rotational_disk(dir);
+    }
+
+    return iter->second;
 }
 
 int Cache::flush_biggest()
 {
-    auto const [begin, end] = find_biggest_span(std::begin(blocks_), std::end(blocks_));
+    if (std::empty(runs_by_size_)) // nothing to flush
+    {
+        return 0;
+    }
+
+    auto const [n_blocks, tor_id, begin] = *std::begin(runs_by_size_);
+
+    // On a spinning disk, seeking costs more than writing. Since we're
+    // going to seek to this file anyway, write all of its dirty blocks.
+    if (auto const* const tor = torrents_.get(tor_id); tor != nullptr && disk(tor).is_rotational)
+    {
+        auto const file = tor->file_offset(tor->block_loc(begin)).index;
+        auto const [file_begin, file_end] = tr_torGetFileBlockSpan(tor, file);
+        return flush_runs(tor_id, std::min(begin, file_begin), std::max(begin + 1U, file_end));
+    }
+
+    return flush_runs(tor_id, begin, begin + 1U);
+}
 
-    if (begin == end) // nothing to flush
+int Cache::flush_runs(tr_torrent_id_t const tor_id, tr_block_index_t const begin, tr_block_index_t const end)
+{
+    auto const found = runs_.find(tor_id);
+    if (found == std::end(runs_))
     {
         return 0;
     }
 
-    if (auto const err = write_contiguous(begin, end); err != 0)
+    auto& runs = found->second;
+    auto iter = find_run(runs, begin);
+    if (iter == std::end(runs))
     {
-        return err;
+        iter = runs.lower_bound(begin);
+    }
+
+    while (iter != std::end(runs) && iter->first < end)
+    {
+        auto const run_begin = iter->first;
+        auto const run_end = run_begin + std::size(iter->second);
+
+        if (!write_async(tor_id, runs, iter))
+        {
+            // Don't let an older background write clobber this one.
+            // Finishing them may change the cache, so start over afterwards.
+            if (!std::empty(in_flight_))
+            {
+                finish_async_writes();
+                return 0;
+            }
+
+            if (auto const err = write_contiguous(tor_id, run_begin, iter->second); err != 0)
+            {
+                return err;
+            }
+
+            take_run(tor_id, runs, iter);
+        }
+
+        iter = runs.lower_bound(run_end);
+    }
+
+    if (std::empty(runs))
+    {
+        runs_.erase(found);
+        dirty_since_.erase(tor_id);
     }
 
-    blocks_.erase(begin, end);
     return 0;
 }
 
 int Cache::cache_trim()
 {
-    while (std::size(blocks_) > max_blocks_)
+    while (n_blocks_ > max_blocks_)
     {
         if (auto const err = flush_biggest(); err != 0)
         {
@@ -270,3 +721,160 @@ int Cache::cache_trim()
 
     return 0;
 }
+
+// ---
+
+void Cache::set_async_writes(bool enabled)
+{
+    if (!enabled)
+    {
+        finish_async_writes();
+        writer_.reset();
+    }
+    else if (!writer_)
+    {
+        writer_ = std::make_unique<tr_disk_writer>();
+        writer_->set_direct_io(direct_io_);
+    }
+}
+
+void Cache::set_trace_file(std::string_view filename)
+{
+    trace_.close();
+
+    if (tr_error* error = nullptr; !std::empty(filename) && !trace_.open(filename, &error))
+    {
+        tr_logAddWarn(fmt::format(
+            _("Couldn't open '{path}': {error} ({error_code})"),
+            fmt::arg("path", filename),
+            fmt::arg("error", error->message),
+            fmt::arg("error_code", error->code)));
+        tr_error_free(error);
+    }
+}
+
+void Cache::set_direct_io(bool enabled)
+{
+    direct_io_ = enabled;
+
+    if (writer_)
+    {
+        writer_->set_direct_io(enabled);
+    }
+}
+
+bool Cache::write_async(tr_torrent_id_t tor_id, Runs& runs, Runs::iterator iter)
+{
+    if (!writer_)
+    {
+        return false;
+    }
+
+    auto* const tor = torrents_.get(tor_id);
+    if (tor == nullptr)
+    {
+        return false;
+    }
+
+    auto const& [begin, blocks] = *iter;
+    auto vecs = std::vector<tr_sys_file_iovec>{};
+    vecs.reserve(std::size(blocks));
+    auto n_bytes = size_t{};
+    for (auto const& block : blocks)
+    {
+        vecs.push_back({ std::data(*block), std::size(*block) });
+        n_bytes += std::size(*block);
+    }
+
+    // files that haven't been created yet take the synchronous path,
+    // which knows how to create and preallocate them
+    auto writes = tr_ioPlanWrite(tor, tor->block_loc(begin), std::data(vecs), std::size(vecs));
+    if (!writes)
+    {
+        return false;
+    }
+
+    // Don't let the writer fall too far behind. The finished writes
+    // are reaped later, since reaping them here could change `runs`.
+    writer_->wait(MaxInFlightWrites - 1U);
+
+    auto const run_begin = begin;
+    auto in_flight = InFlight{ tor_id, run_begin, take_run(tor_id, runs, iter) };
+    auto ticket = io_scheduler_.begin(disk(tor).device, tr_io_scheduler::Class::Flush, n_bytes);
+    auto const id = writer_->add(std::move(*writes), std::move(ticket));
+    in_flight_.try_emplace(id, std::move(in_flight));
+
+    ++disk_writes_;
+    disk_write_bytes_ += n_bytes;
+    tor->usage().add_io(tr_torrent_usage::DiskWrites, tr_torrent_usage::DiskWriteBytes, n_bytes);
+
+    ++flush_stats_.n_writes;
+    flush_stats_.n_bytes += n_bytes;
+    return true;
+}
+
+void Cache::finish_async_writes()
+{
+    if (writer_ && (!std::empty(in_flight_) || !std::empty(reading_)))
+    {
+        writer_->wait(0U);
+        reap_async_writes();
+    }
+}
+
+void Cache::reap_async_writes()
+{
+    if (!writer_)
+    {
+        return;
+    }
+
+    for (auto& [id, err, filename, msec] : writer_->take_finished())
+    {
+        if (auto reading = reading_.extract(id); reading)
+        {
+            on_read_ahead_done(reading.mapped(), err);
+            continue;
+        }
+
+        flush_stats_.msec += msec;
+        tr_metrics::instance().cache_flush_duration.observe(std::chrono::milliseconds{ msec });
+
+        auto node = in_flight_.extract(id);
+        if (!node || err == 0)
+        {
+            continue;
+        }
+
+        // Put back the blocks that haven't been rewritten since
+        // so that they're not lost; the torrent is stopped below.
+        auto& [tor_id, begin, blocks] = node.mapped();
+        for (size_t i = 0, n = std::size(blocks); i < n; ++i)
+        {
+            auto const block = static_cast<tr_block_index_t>(begin + i);
+            if (auto& runs = runs_[tor_id]; find_run(runs, block) == std::end(runs))
+            {
+                insert_block(tor_id, block, std::move(blocks[i]));
+            }
+        }
+
+        auto* const tor = torrents_.get(tor_id);
+        if (tor == nullptr)
+        {
+            continue;
+        }
+
+        auto msg = fmt::format(
+            _("Couldn't save '{path}': {error} ({error_code})"),
+            fmt::arg("path", filename),
+            fmt::arg("error", tr_strerror(err)),
+            fmt::arg("error_code", err));
+        if (tor->error != TR_STAT_LOCAL_ERROR)
+        {
+            tor->set_local_error(msg);
+            tr_torrentStop(tor);
+        }
+
+        tr_logAddErrorTor(tor, std::move(msg));
+    }
+}
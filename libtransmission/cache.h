@@ -11,15 +11,25 @@
 
 #include <cstddef> // for size_t
 #include <cstdint> // for intX_t, uintX_t
+#include <ctime> // for time_t
+#include <deque>
+#include <map>
 #include <memory> // for std::unique_ptr
-#include <utility> // for std::pair
-#include <vector>
+#include <set>
+#include <string_view>
+#include <tuple> // for std::tie
+#include <unordered_map>
 
 #include <small/vector.hpp>
 
 #include "transmission.h"
 
 #include "block-info.h"
+#include "block-pool.h"
+#include "disk-writer.h"
+#include "io-scheduler.h"
+#include "io-trace.h"
+#include "read-cache.h"
 
 class tr_torrents;
 struct tr_torrent;
@@ -27,73 +37,235 @@ struct tr_torrent;
 class Cache
 {
 public:
-    using BlockData = small::max_size_vector<uint8_t, tr_block_info::BlockSize>;
+    // Block buffers are recycled through a tr_block_pool so that downloading
+    // and uploading don't need a fresh heap allocation for every block.
+    // They're carved from huge-page slabs to keep TLB misses down in big caches.
+    struct BlockData final : public small::max_size_vector<uint8_t, tr_block_info::BlockSize>
+    {
+        using small::max_size_vector<uint8_t, tr_block_info::BlockSize>::max_size_vector;
+
+        [[nodiscard]] static void* operator new(size_t size);
+        static void operator delete(void* ptr) noexcept;
+
+        [[nodiscard]] static tr_block_pool& pool();
+    };
 
-    Cache(tr_torrents& torrents, size_t max_bytes);
+    Cache(tr_torrents& torrents, tr_io_scheduler& io_scheduler, size_t max_bytes);
 
     int set_limit(size_t new_limit);
 
+    // Set the memory budget for clean blocks that are kept for reading,
+    // e.g. blocks that peers are downloading from us.
+    void set_read_limit(size_t new_limit);
+
+    [[nodiscard]] constexpr auto const& read_stats() const noexcept
+    {
+        return read_cache_.stats();
+    }
+
+    // @return the memory held by dirty blocks, including ones being written in the background
+    [[nodiscard]] size_t dirty_bytes() const noexcept;
+
+    // @return the memory held by clean blocks kept for reading
+    [[nodiscard]] constexpr size_t clean_bytes() const noexcept
+    {
+        return read_cache_.size() * tr_block_info::BlockSize;
+    }
+
+    // @return dirty_bytes() for one torrent
+    [[nodiscard]] size_t dirty_bytes(tr_torrent_id_t tor_id) const;
+
+    // @return clean_bytes() for one torrent
+    [[nodiscard]] size_t clean_bytes(tr_torrent_id_t tor_id) const
+    {
+        return read_cache_.count_torrent(tor_id) * tr_block_info::BlockSize;
+    }
+
     // @return any error code from cacheTrim()
     int write_block(tr_torrent_id_t tor, tr_block_index_t block, std::unique_ptr<BlockData> writeme);
 
+    // Blocks that aren't being written are looked up in the read cache.
+    // Blocks that aren't there either are read from disk and added to it.
     int read_block(tr_torrent* torrent, tr_block_info::Location const& loc, uint32_t len, uint8_t* setme);
+
+    // Called when a peer asks us for a block. When async writes are enabled,
+    // this block and a read-ahead window after it are read into the read
+    // cache in the background so that they're ready when the requests are served.
+    // Requests from different peers for nearby blocks share the same reads.
+    // Otherwise, or if the disk is busy with more urgent I/O, this just
+    // hints the OS to prefetch the block.
     int prefetch_block(tr_torrent* torrent, tr_block_info::Location const& loc, uint32_t len);
+
+    // @return true if the block is cached, i.e. if it may be newer than what's on disk
+    [[nodiscard]] bool has_block(tr_torrent const* torrent, tr_block_info::Location const& loc) noexcept
+    {
+        return get_block(torrent, loc) != nullptr;
+    }
+
     int flush_torrent(tr_torrent const* torrent);
     int flush_file(tr_torrent const* torrent, tr_file_index_t file);
 
+    // Write out the torrents whose oldest dirty block has been cached too long.
+    // @return any error code from writeContiguous()
+    int flush_aged(time_t now);
+
+    struct FlushStats
+    {
+        uint64_t n_writes = 0; // disk writes made to flush the cache
+        uint64_t n_bytes = 0; // bytes written by those writes
+        uint64_t msec = 0; // time spent in those writes
+    };
+
+    [[nodiscard]] constexpr auto const& flush_stats() const noexcept
+    {
+        return flush_stats_;
+    }
+
+    // When enabled, blocks evicted from the cache are written to disk
+    // by a tr_disk_writer thread instead of on the caller's thread.
+    void set_async_writes(bool enabled);
+
+    // See tr_disk_writer::set_direct_io()
+    void set_direct_io(bool enabled);
+
+    // Release the blocks of any finished background writes and handle their errors.
+    // Finished read-aheads are added to the cache.
+    void reap_async_writes();
+
+    // Record the blocks that are read, written, prefetched, and flushed to
+    // `filename` for replaying later. An empty filename stops recording.
+    void set_trace_file(std::string_view filename);
+
 private:
-    using Key = std::pair<tr_torrent_id_t, tr_block_index_t>;
+    using Blocks = std::deque<std::unique_ptr<BlockData>>;
+
+    // Blocks being written by `writer_`. They stay readable until the write finishes.
+    struct InFlight
+    {
+        tr_torrent_id_t tor_id;
+        tr_block_index_t begin;
+        Blocks blocks;
+    };
 
-    struct CacheBlock
+    // the most background writes that may be queued at once
+    static auto constexpr MaxInFlightWrites = size_t{ 8U };
+
+    // How long a dirty block may stay in the cache before its torrent is
+    // flushed. Seeks are expensive on spinning disks, so give their
+    // writes longer to coalesce.
+    static auto constexpr MaxDirtySecs = time_t{ 10 };
+    static auto constexpr MaxDirtySecsRotational = time_t{ 30 };
+
+    // Bounds on the read-ahead window. It grows while the blocks read ahead
+    // get used and shrinks while they get evicted unused.
+    static auto constexpr MinReadAheadBlocks = tr_block_index_t{ 16U };
+    static auto constexpr MaxReadAheadBlocks = tr_block_index_t{ 256U };
+
+    // How many read cache evictions to see before resizing the window.
+    static auto constexpr ReadAheadSampleSize = uint64_t{ 64U };
+
+    // A torrent's cached blocks, stored as runs of adjacent blocks
+    // and keyed by the index of each run's first block.
+    using Runs = std::map<tr_block_index_t, Blocks>;
+
+    // Identifies a run in `runs_by_size_`.
+    struct RunKey
     {
-        Key key;
-        std::unique_ptr<BlockData> buf;
+        size_t n_blocks;
+        tr_torrent_id_t tor_id;
+        tr_block_index_t begin;
+
+        // sort the biggest runs first, breaking ties by torrent and block
+        [[nodiscard]] bool operator<(RunKey const& that) const noexcept
+        {
+            return std::tie(that.n_blocks, tor_id, begin) < std::tie(n_blocks, that.tor_id, that.begin);
+        }
     };
 
-    using Blocks = std::vector<CacheBlock>;
-    using CIter = Blocks::const_iterator;
+    [[nodiscard]] static Runs::iterator find_run(Runs& runs, tr_block_index_t block) noexcept;
 
-    [[nodiscard]] static Key make_key(tr_torrent const* torrent, tr_block_info::Location loc) noexcept;
+    Runs::iterator add_run(tr_torrent_id_t tor_id, Runs& runs, tr_block_index_t begin, Blocks&& blocks);
 
-    [[nodiscard]] static std::pair<CIter, CIter> find_biggest_span(CIter begin, CIter end) noexcept;
+    Blocks take_run(tr_torrent_id_t tor_id, Runs& runs, Runs::iterator iter);
 
-    [[nodiscard]] static CIter find_span_end(CIter span_begin, CIter end) noexcept;
+    // Ensure that no run straddles `block`, i.e. that `block` begins a run if it's cached
+    void split_run(tr_torrent_id_t tor_id, Runs& runs, tr_block_index_t block);
 
     // @return any error code from tr_ioWrite()
-    [[nodiscard]] int write_contiguous(CIter begin, CIter end) const;
+    [[nodiscard]] int write_contiguous(tr_torrent_id_t tor_id, tr_block_index_t begin, Blocks const& blocks);
+
+    // @return true if the blocks were queued for writing in the background
+    [[nodiscard]] bool write_async(tr_torrent_id_t tor_id, Runs& runs, Runs::iterator iter);
+
+    // Block until all the background writes are done
+    void finish_async_writes();
+
+    [[nodiscard]] bool wants_read_ahead(tr_torrent const* torrent, tr_block_index_t block) noexcept;
+    void read_ahead(tr_torrent* torrent, tr_block_index_t begin, tr_block_index_t end);
+    void on_read_ahead_done(InFlight& reading, int err);
+    void resize_read_ahead_window();
+
+    void insert_block(tr_torrent_id_t tor_id, tr_block_index_t block, std::unique_ptr<BlockData> writeme);
 
     // @return any error code from writeContiguous()
-    [[nodiscard]] int flush_span(CIter begin, CIter end);
+    [[nodiscard]] int flush_span(tr_torrent_id_t tor_id, tr_block_index_t begin, tr_block_index_t end);
 
     // @return any error code from writeContiguous()
     [[nodiscard]] int flush_biggest();
 
+    // Write every run that overlaps [begin, end), in file-offset order.
+    // @return any error code from writeContiguous()
+    [[nodiscard]] int flush_runs(tr_torrent_id_t tor_id, tr_block_index_t begin, tr_block_index_t end);
+
+    // Where a torrent's data is
+    struct Disk
+    {
+        tr_io_scheduler::DeviceId device = {};
+        bool is_rotational = false;
+    };
+
+    [[nodiscard]] Disk const& disk(tr_torrent const* torrent);
+
     // @return any error code from writeContiguous()
     [[nodiscard]] int cache_trim();
 
     [[nodiscard]] static size_t get_max_blocks(size_t max_bytes) noexcept;
 
-    [[nodiscard]] CIter get_block(tr_torrent const* torrent, tr_block_info::Location const& loc) noexcept;
+    [[nodiscard]] BlockData const* get_block(tr_torrent const* torrent, tr_block_info::Location const& loc) noexcept;
 
     tr_torrents& torrents_;
+    tr_io_scheduler& io_scheduler_;
 
-    Blocks blocks_ = {};
+    std::unordered_map<tr_torrent_id_t, Runs> runs_;
+    std::set<RunKey> runs_by_size_;
+    size_t n_blocks_ = 0;
     size_t max_blocks_ = 0;
 
+    std::map<tr_disk_writer::JobId, InFlight> in_flight_;
+
+    // Clean blocks, kept separately from the dirty runs so that they're never written back.
+    // Blocks being read ahead are reserved in it until their reads in `reading_` finish.
+    tr_read_cache<BlockData> read_cache_;
+    std::map<tr_disk_writer::JobId, InFlight> reading_;
+    tr_block_index_t read_ahead_window_ = 64U;
+    tr_read_cache<BlockData>::Stats read_ahead_last_stats_;
+
+    // depends-on: in_flight_, reading_
+    std::unique_ptr<tr_disk_writer> writer_;
+    bool direct_io_ = false;
+
+    // when each torrent's oldest dirty block was cached
+    std::unordered_map<tr_torrent_id_t, time_t> dirty_since_;
+
+    // which disk each torrent's data is on
+    std::unordered_map<tr_torrent_id_t, Disk> disks_;
+
+    tr_io_trace trace_;
+
+    mutable FlushStats flush_stats_;
+
     mutable size_t disk_writes_ = 0;
     mutable size_t disk_write_bytes_ = 0;
     mutable size_t cache_writes_ = 0;
     mutable size_t cache_write_bytes_ = 0;
-
-    static constexpr struct
-    {
-        [[nodiscard]] constexpr bool operator()(Key const& key, CacheBlock const& block)
-        {
-            return key < block.key;
-        }
-        [[nodiscard]] constexpr bool operator()(CacheBlock const& block, Key const& key)
-        {
-            return block.key < key;
-        }
-    } CompareCacheBlockByKey{};
 };
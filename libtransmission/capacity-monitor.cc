@@ -0,0 +1,121 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <cerrno>
+#include <ctime>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "libtransmission/capacity-monitor.h"
+#include "libtransmission/error.h"
+#include "libtransmission/executor.h"
+#include "libtransmission/file.h"
+
+tr_capacity_monitor::tr_capacity_monitor(tr_executor& executor)
+    : executor_{ executor }
+{
+}
+
+tr_capacity_monitor::~tr_capacity_monitor()
+{
+    auto lock = std::unique_lock(mutex_);
+    cv_.wait(lock, [this]() { return n_pending_ == 0U; });
+}
+
+tr_capacity_monitor::Capacity tr_capacity_monitor::get(std::string_view path, time_t now)
+{
+    auto lock = std::unique_lock(mutex_);
+
+    auto iter = entries_.find(path);
+    if (iter == std::end(entries_))
+    {
+        ++stats_.misses;
+
+        // nothing to show yet, so answer this one directly
+        auto key = std::string{ path };
+        lock.unlock();
+        auto capacity = query(key);
+        lock.lock();
+
+        prune();
+        iter = entries_.try_emplace(std::move(key)).first;
+        auto& entry = iter->second;
+        entry.capacity = std::move(capacity);
+        entry.updated_at = now;
+        entry.used_at = now;
+        return entry.capacity;
+    }
+
+    ++stats_.hits;
+
+    auto& entry = iter->second;
+    entry.used_at = now;
+
+    if (!entry.is_pending && entry.updated_at + RefreshInterval <= now)
+    {
+        entry.is_pending = true;
+        ++n_pending_;
+        ++stats_.refreshes;
+        executor_.submit(
+            [this, key = iter->first, now]() { on_refresh_done(key, query(key), now); },
+            tr_executor::Priority::Low);
+    }
+
+    return entry.capacity;
+}
+
+tr_capacity_monitor::Capacity tr_capacity_monitor::query(std::string const& path)
+{
+    auto const old_errno = errno;
+    auto ret = Capacity{};
+    tr_error* error = nullptr;
+    ret.capacity = tr_sys_path_get_capacity(path, &error);
+    ret.error_code = error != nullptr ? error->code : 0;
+    tr_error_clear(&error);
+    errno = old_errno;
+    return ret;
+}
+
+void tr_capacity_monitor::on_refresh_done(std::string const& path, Capacity&& capacity, time_t now)
+{
+    auto const lock = std::lock_guard(mutex_);
+
+    if (auto const iter = entries_.find(path); iter != std::end(entries_))
+    {
+        auto& entry = iter->second;
+        entry.is_pending = false;
+        entry.capacity = std::move(capacity);
+        entry.updated_at = now;
+    }
+
+    --n_pending_;
+    cv_.notify_all();
+}
+
+void tr_capacity_monitor::prune()
+{
+    // forget the folders that were asked about least recently
+    while (std::size(entries_) >= MaxEntries)
+    {
+        auto oldest = std::end(entries_);
+        for (auto iter = std::begin(entries_); iter != std::end(entries_); ++iter)
+        {
+            auto const& entry = iter->second;
+            if (!entry.is_pending && (oldest == std::end(entries_) || entry.used_at < oldest->second.used_at))
+            {
+                oldest = iter;
+            }
+        }
+
+        if (oldest == std::end(entries_))
+        {
+            break;
+        }
+
+        entries_.erase(oldest);
+    }
+}
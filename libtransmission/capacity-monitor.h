@@ -0,0 +1,98 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <condition_variable>
+#include <cstddef> // size_t
+#include <ctime> // time_t
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "libtransmission/file.h" // tr_sys_path_capacity
+
+class tr_executor;
+
+/**
+ * Caches the free space of the folders that RPC clients ask about, so
+ * that polling `session-get` or `free-space` doesn't parse the mount
+ * table and stat a slow network filesystem on the session thread.
+ *
+ * The first query for a folder is answered directly. After that, the
+ * cached answer is returned and, once it's older than RefreshInterval,
+ * refreshed in a `tr_executor`. Folders that nobody has asked about
+ * for a while are forgotten when room is needed for new ones.
+ *
+ * Safe to use from any thread.
+ */
+class tr_capacity_monitor
+{
+public:
+    static auto constexpr RefreshInterval = time_t{ 10 };
+    static auto constexpr MaxEntries = size_t{ 256U };
+
+    struct Capacity
+    {
+        std::optional<tr_sys_path_capacity> capacity;
+        int error_code = 0; // if `capacity` is nullopt
+    };
+
+    struct Stats
+    {
+        size_t hits = 0; // answered from the cache
+        size_t misses = 0; // had to be answered directly
+        size_t refreshes = 0; // refreshes started in the background
+    };
+
+    explicit tr_capacity_monitor(tr_executor& executor);
+
+    // waits for refreshes that are still running
+    ~tr_capacity_monitor();
+
+    tr_capacity_monitor(tr_capacity_monitor const&) = delete;
+    tr_capacity_monitor(tr_capacity_monitor&&) = delete;
+    tr_capacity_monitor& operator=(tr_capacity_monitor const&) = delete;
+    tr_capacity_monitor& operator=(tr_capacity_monitor&&) = delete;
+
+    [[nodiscard]] Capacity get(std::string_view path, time_t now);
+
+    [[nodiscard]] Stats stats() const
+    {
+        auto const lock = std::lock_guard(mutex_);
+        return stats_;
+    }
+
+private:
+    struct Entry
+    {
+        Capacity capacity;
+        time_t updated_at = 0;
+        time_t used_at = 0;
+        bool is_pending = false;
+    };
+
+    [[nodiscard]] static Capacity query(std::string const& path);
+
+    void on_refresh_done(std::string const& path, Capacity&& capacity, time_t now);
+    void prune();
+
+    tr_executor& executor_;
+
+    mutable std::mutex mutex_;
+
+    // notified when a refresh finishes
+    std::condition_variable cv_;
+
+    std::map<std::string, Entry, std::less<>> entries_;
+    size_t n_pending_ = 0;
+    Stats stats_;
+};
@@ -697,3 +697,10 @@ void tr_clientForId(char* buf, size_t buflen, tr_peer_id_t peer_id)
         buf_append(buf, buflen, std::string_view(begin, walk - begin));
     }
 }
+
+tr_interned_string tr_client_name(tr_peer_id_t const& peer_id)
+{
+    auto buf = std::array<char, 128>{};
+    tr_clientForId(std::data(buf), std::size(buf), peer_id);
+    return tr_interned_string{ std::data(buf) };
+}
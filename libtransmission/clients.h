@@ -11,10 +11,18 @@
 
 #include <cstddef> // size_t
 
-#include "tr-macros.h" // tr_peer_id_t
+#include "libtransmission/interned-string.h"
+#include "libtransmission/tr-macros.h" // tr_peer_id_t
 
 /**
  * @brief parse a peer-id into a human-readable client name and version number
  * @ingroup utils
  */
 void tr_clientForId(char* buf, size_t buflen, tr_peer_id_t peer_id);
+
+/**
+ * @brief tr_clientForId(), interned so that every peer running the same
+ *        client shares one copy of the name.
+ * @ingroup utils
+ */
+[[nodiscard]] tr_interned_string tr_client_name(tr_peer_id_t const& peer_id);
@@ -3,7 +3,12 @@
 // or any future license endorsed by Mnemosyne LLC.
 // License text can be found in the licenses/ folder.
 
+#include <algorithm> // std::min(), std::max(), std::upper_bound()
+#include <atomic>
+#include <cstdint> // uint64_t
+#include <iterator> // std::back_inserter()
 #include <memory>
+#include <optional>
 #include <utility>
 #include <vector>
 
@@ -94,8 +99,13 @@ void tr_completion::amount_done(float* tab, size_t n_tabs) const
     }
 }
 
-std::vector<uint8_t> tr_completion::create_piece_bitfield() const
+std::vector<uint8_t> const& tr_completion::piece_bitfield() const
 {
+    if (piece_bitfield_)
+    {
+        return *piece_bitfield_;
+    }
+
     size_t const n = block_info_->piece_count();
     auto pieces = tr_bitfield{ n };
 
@@ -107,11 +117,117 @@ std::vector<uint8_t> tr_completion::create_piece_bitfield() const
     }
     pieces.set_from_bools(flags.get(), n);
 
-    return pieces.raw();
+    return piece_bitfield_.emplace(pieces.raw());
 }
 
 // --- mutators
 
+uint64_t tr_completion::block_bytes_in_piece(tr_block_index_t block, tr_piece_index_t piece) const
+{
+    auto const block_begin = block_info_->block_loc(block).byte;
+    auto const block_end = block_begin + block_info_->block_size(block);
+    auto const [piece_begin, piece_end] = block_info_->byte_span_for_piece(piece);
+    return std::min(block_end, piece_end) - std::max(block_begin, piece_begin);
+}
+
+// Called before a block is removed and after one is added, so that
+// has_piece() is true for the pieces that the block completes.
+void tr_completion::on_block_changed(tr_block_index_t block, bool added)
+{
+    if (!size_when_done_ && !has_valid_ && !piece_bitfield_)
+    {
+        return;
+    }
+
+    auto const [first_piece, last_piece] = pieces_for_block(block);
+    for (auto piece = first_piece; piece <= last_piece; ++piece)
+    {
+        // we'll have an unwanted piece's bytes only if they're already here
+        if (size_when_done_ && !tor_->piece_is_wanted(piece))
+        {
+            auto const n_bytes = block_bytes_in_piece(block, piece);
+            *size_when_done_ = added ? *size_when_done_ + n_bytes : *size_when_done_ - n_bytes;
+        }
+
+        // the block completes a piece if it was its last missing block,
+        // or breaks one if it was complete
+        if ((has_valid_ || piece_bitfield_) && has_piece(piece))
+        {
+            if (has_valid_)
+            {
+                auto const n_bytes = block_info_->piece_size(piece);
+                *has_valid_ = added ? *has_valid_ + n_bytes : *has_valid_ - n_bytes;
+            }
+
+            if (piece_bitfield_)
+            {
+                auto& byte = (*piece_bitfield_)[piece / 8U];
+                auto const bit = static_cast<uint8_t>(0x80U >> (piece % 8U));
+                byte = added ? byte | bit : byte & ~bit;
+                on_pieces_changed(added ? std::optional<tr_piece_index_t>{ piece } : std::nullopt);
+            }
+        }
+    }
+}
+
+uint64_t tr_completion::next_pieces_revision() noexcept
+{
+    static auto next = std::atomic<uint64_t>{ 1U };
+    return next++;
+}
+
+void tr_completion::on_pieces_changed(std::optional<tr_piece_index_t> added)
+{
+    pieces_revision_ = next_pieces_revision();
+
+    // past this, sending the whole bitfield is cheaper than the journal
+    auto const max_journal_size = block_info_->piece_count() / 32U + 1U;
+
+    if (added && std::size(pieces_journal_) < max_journal_size)
+    {
+        pieces_journal_.emplace_back(pieces_revision_, *added);
+    }
+    else
+    {
+        pieces_journal_.clear();
+        pieces_journal_begin_ = pieces_revision_;
+    }
+}
+
+std::optional<std::vector<tr_piece_index_t>> tr_completion::pieces_added_since(uint64_t revision) const
+{
+    if (revision < pieces_journal_begin_ || revision > pieces_revision_)
+    {
+        return {};
+    }
+
+    auto const begin = std::upper_bound(
+        std::begin(pieces_journal_),
+        std::end(pieces_journal_),
+        revision,
+        [](uint64_t rev, auto const& entry) { return rev < entry.first; });
+
+    auto pieces = std::vector<tr_piece_index_t>{};
+    pieces.reserve(std::end(pieces_journal_) - begin);
+    std::transform(
+        begin,
+        std::end(pieces_journal_),
+        std::back_inserter(pieces),
+        [](auto const& entry) { return entry.second; });
+    return pieces;
+}
+
+void tr_completion::on_piece_wanted_changed(tr_piece_index_t piece)
+{
+    if (!size_when_done_)
+    {
+        return;
+    }
+
+    auto const n_missing = count_missing_bytes_in_piece(piece);
+    *size_when_done_ = tor_->piece_is_wanted(piece) ? *size_when_done_ + n_missing : *size_when_done_ - n_missing;
+}
+
 void tr_completion::add_block(tr_block_index_t block)
 {
     if (has_block(block))
@@ -122,8 +238,7 @@ void tr_completion::add_block(tr_block_index_t block)
     blocks_.set(block);
     size_now_ += block_info_->block_size(block);
 
-    size_when_done_.reset();
-    has_valid_.reset();
+    on_block_changed(block, true);
 }
 
 void tr_completion::set_blocks(tr_bitfield blocks)
@@ -134,6 +249,8 @@ void tr_completion::set_blocks(tr_bitfield blocks)
     size_now_ = count_has_bytes_in_span({ 0, block_info_->total_size() });
     size_when_done_.reset();
     has_valid_.reset();
+    piece_bitfield_.reset();
+    on_pieces_changed();
 }
 
 void tr_completion::set_has_all() noexcept
@@ -144,6 +261,8 @@ void tr_completion::set_has_all() noexcept
     size_now_ = total_size;
     size_when_done_ = total_size;
     has_valid_ = total_size;
+    piece_bitfield_.reset();
+    on_pieces_changed();
 }
 
 void tr_completion::add_piece(tr_piece_index_t piece)
@@ -163,11 +282,10 @@ void tr_completion::remove_block(tr_block_index_t block)
         return; // already didn't have it
     }
 
+    on_block_changed(block, false);
+
     blocks_.unset(block);
     size_now_ -= block_info_->block_size(block);
-
-    size_when_done_.reset();
-    has_valid_.reset();
 }
 
 void tr_completion::remove_piece(tr_piece_index_t piece)
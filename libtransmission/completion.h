@@ -13,6 +13,7 @@
 #include <cstdint>
 #include <cstddef> // size_t
 #include <optional>
+#include <utility> // std::pair
 #include <vector>
 
 #include "libtransmission/transmission.h"
@@ -117,7 +118,19 @@ struct tr_completion
         return TR_LEECH;
     }
 
-    [[nodiscard]] std::vector<uint8_t> create_piece_bitfield() const;
+    // @return a raw bitfield of the pieces we have, e.g. for a BitTorrent BITFIELD message
+    [[nodiscard]] std::vector<uint8_t> const& piece_bitfield() const;
+
+    // @return a number that changes whenever piece_bitfield() does.
+    // Revisions are unique across tr_completion instances.
+    [[nodiscard]] constexpr uint64_t pieces_revision() const noexcept
+    {
+        return pieces_revision_;
+    }
+
+    // @return the pieces completed since `revision`, in the order they were
+    // completed, or nullopt if that's unknown, e.g. because a piece was lost
+    [[nodiscard]] std::optional<std::vector<tr_piece_index_t>> pieces_added_since(uint64_t revision) const;
 
     [[nodiscard]] size_t count_missing_blocks_in_piece(tr_piece_index_t piece) const
     {
@@ -157,6 +170,10 @@ struct tr_completion
         size_when_done_.reset();
     }
 
+    // Call after `piece` changes from wanted to unwanted or back, so that
+    // size_when_done() can be updated without walking every piece
+    void on_piece_wanted_changed(tr_piece_index_t piece);
+
     [[nodiscard]] uint64_t count_has_bytes_in_span(tr_byte_span_t) const;
 
     [[nodiscard]] constexpr bool has_metainfo() const noexcept
@@ -175,19 +192,53 @@ private:
 
     void remove_block(tr_block_index_t block);
 
+    // @return the pieces that `block` is part of. Pieces are never smaller
+    // than a block, so a block can straddle at most two of them.
+    [[nodiscard]] constexpr std::pair<tr_piece_index_t, tr_piece_index_t> pieces_for_block(tr_block_index_t block) const
+    {
+        auto const first = block_info_->block_loc(block);
+        return { first.piece, block_info_->byte_loc(first.byte + block_info_->block_size(block) - 1U).piece };
+    }
+
+    // @return how many bytes of `block` are in `piece`
+    [[nodiscard]] uint64_t block_bytes_in_piece(tr_block_index_t block, tr_piece_index_t piece) const;
+
+    // Update the cached totals for `block` being added or removed
+    void on_block_changed(tr_block_index_t block, bool added);
+
+    [[nodiscard]] static uint64_t next_pieces_revision() noexcept;
+
+    // Bump the pieces revision. If `added` is a newly-completed piece, it's
+    // journaled; otherwise the journal starts over.
+    void on_pieces_changed(std::optional<tr_piece_index_t> added = {});
+
     torrent_view const* tor_;
     tr_block_info const* block_info_;
 
     tr_bitfield blocks_{ 0 };
 
     // Number of bytes we'll have when done downloading. [0..totalSize]
-    // Mutable because lazy-calculated
+    // Mutable because lazy-calculated; once calculated, it's kept
+    // current as blocks are added or removed and as pieces' wanted
+    // state changes.
     mutable std::optional<uint64_t> size_when_done_;
 
     // Number of verified bytes we have right now. [0..totalSize]
-    // Mutable because lazy-calculated
+    // Mutable because lazy-calculated, then kept current like size_when_done_
     mutable std::optional<uint64_t> has_valid_;
 
+    // Raw bitfield of the pieces we have.
+    // Mutable because lazy-calculated, then kept current like size_when_done_
+    mutable std::optional<std::vector<uint8_t>> piece_bitfield_;
+
+    // Only bumped while piece_bitfield_ is cached. Nothing can have seen a
+    // revision without caching piece_bitfield_, and dropping it bumps this.
+    uint64_t pieces_revision_ = next_pieces_revision();
+
+    // The revisions and pieces completed since pieces_journal_begin_
+    std::vector<std::pair<uint64_t, tr_piece_index_t>> pieces_journal_;
+    uint64_t pieces_journal_begin_ = pieces_revision_;
+
     // Number of bytes we have now. [0..sizeWhenDone]
     uint64_t size_now_ = 0;
 };
@@ -3,7 +3,7 @@
 // or any future license endorsed by Mnemosyne LLC.
 // License text can be found in the licenses/ folder.
 
-#include <memory>
+#include <new>
 #include <type_traits>
 
 #include <CommonCrypto/CommonDigest.h>
@@ -95,99 +95,72 @@ bool check_ccrypto_result(CCCryptorStatus result, char const* file, long line)
 
 // ---
 
-namespace
-{
-
-class Sha1Impl final : public tr_sha1
+tr_sha1_context::tr_sha1_context()
 {
-public:
-    Sha1Impl()
-    {
-        clear();
-    }
-
-    ~Sha1Impl() override = default;
+    new (std::data(state_)) CC_SHA1_CTX{};
+    clear();
+}
 
-    void clear() override
-    {
-        CC_SHA1_Init(&handle_);
-    }
+tr_sha1_context::~tr_sha1_context() = default;
 
-    void add(void const* data, size_t data_length) override
-    {
-        static auto constexpr Max = static_cast<size_t>(std::numeric_limits<CC_LONG>::max());
-        auto const* sha_data = static_cast<uint8_t const*>(data);
-        while (data_length > 0)
-        {
-            auto const n_bytes = static_cast<CC_LONG>(std::min(data_length, Max));
-            CC_SHA1_Update(&handle_, sha_data, n_bytes);
-            data_length -= n_bytes;
-            sha_data += n_bytes;
-        }
-    }
+void tr_sha1_context::clear()
+{
+    CC_SHA1_Init(handle<CC_SHA1_CTX>());
+}
 
-    [[nodiscard]] tr_sha1_digest_t finish() override
+void tr_sha1_context::add(void const* data, size_t data_length)
+{
+    static auto constexpr Max = static_cast<size_t>(std::numeric_limits<CC_LONG>::max());
+    auto const* sha_data = static_cast<uint8_t const*>(data);
+    while (data_length > 0)
     {
-        auto digest = tr_sha1_digest_t{};
-        CC_SHA1_Final(reinterpret_cast<unsigned char*>(std::data(digest)), &handle_);
-        clear();
-        return digest;
+        auto const n_bytes = static_cast<CC_LONG>(std::min(data_length, Max));
+        CC_SHA1_Update(handle<CC_SHA1_CTX>(), sha_data, n_bytes);
+        data_length -= n_bytes;
+        sha_data += n_bytes;
     }
+}
 
-private:
-    CC_SHA1_CTX handle_ = {};
-};
-
-class Sha256Impl final : public tr_sha256
+tr_sha1_digest_t tr_sha1_context::finish()
 {
-public:
-    Sha256Impl()
-    {
-        clear();
-    }
+    auto digest = tr_sha1_digest_t{};
+    CC_SHA1_Final(reinterpret_cast<unsigned char*>(std::data(digest)), handle<CC_SHA1_CTX>());
+    clear();
+    return digest;
+}
 
-    ~Sha256Impl() override = default;
+tr_sha256_context::tr_sha256_context()
+{
+    new (std::data(state_)) CC_SHA256_CTX{};
+    clear();
+}
 
-    void clear() override
-    {
-        CC_SHA256_Init(&handle_);
-    }
+tr_sha256_context::~tr_sha256_context() = default;
 
-    void add(void const* data, size_t data_length) override
-    {
-        static auto constexpr Max = static_cast<size_t>(std::numeric_limits<CC_LONG>::max());
-        auto const* sha_data = static_cast<uint8_t const*>(data);
-        while (data_length > 0)
-        {
-            auto const n_bytes = static_cast<CC_LONG>(std::min(data_length, Max));
-            CC_SHA256_Update(&handle_, sha_data, n_bytes);
-            data_length -= n_bytes;
-            sha_data += n_bytes;
-        }
-    }
+void tr_sha256_context::clear()
+{
+    CC_SHA256_Init(handle<CC_SHA256_CTX>());
+}
 
-    [[nodiscard]] tr_sha256_digest_t finish() override
+void tr_sha256_context::add(void const* data, size_t data_length)
+{
+    static auto constexpr Max = static_cast<size_t>(std::numeric_limits<CC_LONG>::max());
+    auto const* sha_data = static_cast<uint8_t const*>(data);
+    while (data_length > 0)
     {
-        auto digest = tr_sha256_digest_t{};
-        CC_SHA256_Final(reinterpret_cast<unsigned char*>(std::data(digest)), &handle_);
-        clear();
-        return digest;
+        auto const n_bytes = static_cast<CC_LONG>(std::min(data_length, Max));
+        CC_SHA256_Update(handle<CC_SHA256_CTX>(), sha_data, n_bytes);
+        data_length -= n_bytes;
+        sha_data += n_bytes;
     }
-
-private:
-    CC_SHA256_CTX handle_;
-};
-
-} // namespace
-
-std::unique_ptr<tr_sha1> tr_sha1::create()
-{
-    return std::make_unique<Sha1Impl>();
 }
 
-std::unique_ptr<tr_sha256> tr_sha256::create()
+tr_sha256_digest_t tr_sha256_context::finish()
 {
-    return std::make_unique<Sha256Impl>();
+    auto digest = tr_sha256_digest_t{};
+    CC_SHA256_Final(reinterpret_cast<unsigned char*>(std::data(digest)), handle<CC_SHA256_CTX>());
+    clear();
+    return digest;
 }
 
 // ---
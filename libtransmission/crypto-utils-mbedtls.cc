@@ -3,8 +3,8 @@
 // or any future license endorsed by Mnemosyne LLC.
 // License text can be found in the licenses/ folder.
 
-#include <memory>
 #include <mutex>
+#include <new>
 
 #include <mbedtls/base64.h>
 #include <mbedtls/ctr_drbg.h>
@@ -101,121 +101,104 @@ static std::recursive_mutex rng_mutex_;
 
 // ---
 
-namespace
+tr_sha1_context::tr_sha1_context()
 {
+    new (std::data(state_)) mbedtls_sha1_context{};
+    clear();
+}
 
-class Sha1Impl final : public tr_sha1
+tr_sha1_context::~tr_sha1_context()
 {
-public:
-    Sha1Impl()
-    {
-        clear();
-    }
-
-    ~Sha1Impl() override = default;
+    mbedtls_sha1_free(handle<mbedtls_sha1_context>());
+}
 
-    void clear() override
-    {
-        mbedtls_sha1_init(&handle_);
+void tr_sha1_context::clear()
+{
+    auto* const ctx = handle<mbedtls_sha1_context>();
+    mbedtls_sha1_free(ctx);
+    mbedtls_sha1_init(ctx);
 
 #if MBEDTLS_VERSION_NUMBER >= 0x02070000
-        mbedtls_sha1_starts_ret(&handle_);
+    mbedtls_sha1_starts_ret(ctx);
 #else
-        mbedtls_sha1_starts(&handle_);
+    mbedtls_sha1_starts(ctx);
 #endif
-    }
+}
 
-    void add(void const* data, size_t data_length) override
+void tr_sha1_context::add(void const* data, size_t data_length)
+{
+    if (data_length > 0U)
     {
-        if (data_length > 0U)
-        {
 #if MBEDTLS_VERSION_NUMBER >= 0x02070000
-            mbedtls_sha1_update_ret(&handle_, static_cast<unsigned char const*>(data), data_length);
+        mbedtls_sha1_update_ret(handle<mbedtls_sha1_context>(), static_cast<unsigned char const*>(data), data_length);
 #else
-            mbedtls_sha1_update(&handle_, static_cast<unsigned char const*>(data), data_length);
+        mbedtls_sha1_update(handle<mbedtls_sha1_context>(), static_cast<unsigned char const*>(data), data_length);
 #endif
-        }
     }
+}
 
-    [[nodiscard]] tr_sha1_digest_t finish() override
-    {
-        auto digest = tr_sha1_digest_t{};
-        auto* const digest_as_uchar = reinterpret_cast<unsigned char*>(std::data(digest));
+tr_sha1_digest_t tr_sha1_context::finish()
+{
+    auto digest = tr_sha1_digest_t{};
+    auto* const digest_as_uchar = reinterpret_cast<unsigned char*>(std::data(digest));
 #if MBEDTLS_VERSION_NUMBER >= 0x02070000
-        mbedtls_sha1_finish_ret(&handle_, digest_as_uchar);
+    mbedtls_sha1_finish_ret(handle<mbedtls_sha1_context>(), digest_as_uchar);
 #else
-        mbedtls_sha1_finish(&handle_, digest_as_uchar);
+    mbedtls_sha1_finish(handle<mbedtls_sha1_context>(), digest_as_uchar);
 #endif
 
-        mbedtls_sha1_free(&handle_);
-        return digest;
-    }
-
-private:
-    mbedtls_sha1_context handle_ = {};
-};
+    clear();
+    return digest;
+}
 
-class Sha256Impl final : public tr_sha256
+tr_sha256_context::tr_sha256_context()
 {
-public:
-    Sha256Impl()
-    {
-        clear();
-    }
+    new (std::data(state_)) mbedtls_sha256_context{};
+    clear();
+}
 
-    ~Sha256Impl() override = default;
+tr_sha256_context::~tr_sha256_context()
+{
+    mbedtls_sha256_free(handle<mbedtls_sha256_context>());
+}
 
-    void clear() override
-    {
-        mbedtls_sha256_init(&handle_);
+void tr_sha256_context::clear()
+{
+    auto* const ctx = handle<mbedtls_sha256_context>();
+    mbedtls_sha256_free(ctx);
+    mbedtls_sha256_init(ctx);
 
 #if MBEDTLS_VERSION_NUMBER >= 0x02070000
-        mbedtls_sha256_starts_ret(&handle_, 0);
+    mbedtls_sha256_starts_ret(ctx, 0);
 #else
-        mbedtls_sha256_starts(&handle_);
+    mbedtls_sha256_starts(ctx);
 #endif
-    }
+}
 
-    void add(void const* data, size_t data_length) override
+void tr_sha256_context::add(void const* data, size_t data_length)
+{
+    if (data_length > 0U)
     {
-        if (data_length > 0U)
-        {
 #if MBEDTLS_VERSION_NUMBER >= 0x02070000
-            mbedtls_sha256_update_ret(&handle_, static_cast<unsigned char const*>(data), data_length);
+        mbedtls_sha256_update_ret(handle<mbedtls_sha256_context>(), static_cast<unsigned char const*>(data), data_length);
 #else
-            mbedtls_sha256_update(&handle_, static_cast<unsigned char const*>(data), data_length);
+        mbedtls_sha256_update(handle<mbedtls_sha256_context>(), static_cast<unsigned char const*>(data), data_length);
 #endif
-        }
     }
+}
 
-    [[nodiscard]] tr_sha256_digest_t finish() override
-    {
-        auto digest = tr_sha256_digest_t{};
-        auto* const digest_as_uchar = reinterpret_cast<unsigned char*>(std::data(digest));
+tr_sha256_digest_t tr_sha256_context::finish()
+{
+    auto digest = tr_sha256_digest_t{};
+    auto* const digest_as_uchar = reinterpret_cast<unsigned char*>(std::data(digest));
 #if MBEDTLS_VERSION_NUMBER >= 0x02070000
-        mbedtls_sha256_finish_ret(&handle_, digest_as_uchar);
+    mbedtls_sha256_finish_ret(handle<mbedtls_sha256_context>(), digest_as_uchar);
 #else
-        mbedtls_sha256_finish(&handle_, digest_as_uchar);
+    mbedtls_sha256_finish(handle<mbedtls_sha256_context>(), digest_as_uchar);
 #endif
 
-        mbedtls_sha256_free(&handle_);
-        return digest;
-    }
-
-private:
-    mbedtls_sha256_context handle_ = {};
-};
-
-} // namespace
-
-std::unique_ptr<tr_sha1> tr_sha1::create()
-{
-    return std::make_unique<Sha1Impl>();
-}
-
-std::unique_ptr<tr_sha256> tr_sha256::create()
-{
-    return std::make_unique<Sha256Impl>();
+    clear();
+    return digest;
 }
 
 // ---
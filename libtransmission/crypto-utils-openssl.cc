@@ -10,7 +10,8 @@
 
 #include <array>
 #include <cstddef> // size_t
-#include <memory>
+#include <new>
+#include <vector>
 
 #include <openssl/crypto.h>
 #include <openssl/err.h>
@@ -80,133 +81,146 @@ bool check_openssl_result(int result, int expected_result, bool expected_equal,
 namespace sha_helpers
 {
 
-class ShaHelper
+// EVP_MD_CTX is opaque, so OpenSSL has to heap-allocate it.
+// Keep a few released ones around so that making a context usually doesn't.
+class MdCtxPool
 {
 public:
-    using EvpFunc = decltype((EVP_sha1));
+    MdCtxPool() = default;
+    MdCtxPool(MdCtxPool&&) = delete;
+    MdCtxPool(MdCtxPool const&) = delete;
+    MdCtxPool& operator=(MdCtxPool&&) = delete;
+    MdCtxPool& operator=(MdCtxPool const&) = delete;
 
-    explicit ShaHelper(EvpFunc evp_func)
-        : evp_func_{ evp_func }
+    ~MdCtxPool()
     {
-        clear();
-    }
-
-    void clear() const
-    {
-        EVP_DigestInit_ex(handle_.get(), evp_func_(), nullptr);
-    }
-
-    void update(void const* data, size_t data_length) const
-    {
-        if (data_length != 0U)
+        for (auto* const ctx : free_)
         {
-            EVP_DigestUpdate(handle_.get(), data, data_length);
+            EVP_MD_CTX_destroy(ctx);
         }
     }
 
-    template<typename DigestType>
-    [[nodiscard]] DigestType digest()
+    [[nodiscard]] EVP_MD_CTX* acquire()
     {
-        TR_ASSERT(handle_ != nullptr);
-
-        unsigned int hash_length = 0;
-        auto digest = DigestType{};
-        auto* const digest_as_uchar = reinterpret_cast<unsigned char*>(std::data(digest));
-        [[maybe_unused]] bool const ok = check_result(EVP_DigestFinal_ex(handle_.get(), digest_as_uchar, &hash_length));
-        TR_ASSERT(!ok || hash_length == std::size(digest));
+        if (std::empty(free_))
+        {
+            return EVP_MD_CTX_create();
+        }
 
-        clear();
-        return digest;
+        auto* const ctx = free_.back();
+        free_.pop_back();
+        return ctx;
     }
 
-private:
-    struct MessageDigestDeleter
+    void release(EVP_MD_CTX* ctx)
     {
-        void operator()(EVP_MD_CTX* ctx) const noexcept
+        if (std::size(free_) < MaxFree)
+        {
+            free_.push_back(ctx);
+        }
+        else
         {
             EVP_MD_CTX_destroy(ctx);
         }
-    };
+    }
 
-    EvpFunc evp_func_;
-    std::unique_ptr<EVP_MD_CTX, MessageDigestDeleter> const handle_{ EVP_MD_CTX_create() };
-};
+private:
+    static auto constexpr MaxFree = size_t{ 8U };
 
-class Sha1Impl final : public tr_sha1
-{
-public:
-    Sha1Impl() = default;
-    Sha1Impl(Sha1Impl&&) = delete;
-    Sha1Impl(Sha1Impl const&) = delete;
-    ~Sha1Impl() override = default;
-    Sha1Impl& operator=(Sha1Impl&&) = delete;
-    Sha1Impl& operator=(Sha1Impl const&) = delete;
-
-    void clear() override
-    {
-        helper_.clear();
-    }
+    std::vector<EVP_MD_CTX*> free_;
+};
 
-    void add(void const* data, size_t data_length) override
-    {
-        helper_.update(data, data_length);
-    }
+thread_local auto md_ctx_pool = MdCtxPool{};
 
-    [[nodiscard]] tr_sha1_digest_t finish() override
-    {
-        return helper_.digest<tr_sha1_digest_t>();
-    }
+using EvpFunc = decltype((EVP_sha1));
 
-private:
-    ShaHelper helper_{ EVP_sha1 };
-};
+void sha_clear(EVP_MD_CTX* ctx, EvpFunc evp_func)
+{
+    EVP_DigestInit_ex(ctx, evp_func(), nullptr);
+}
 
-class Sha256Impl final : public tr_sha256
+void sha_update(EVP_MD_CTX* ctx, void const* data, size_t data_length)
 {
-public:
-    Sha256Impl() = default;
-    Sha256Impl(Sha256Impl&&) = delete;
-    Sha256Impl(Sha256Impl const&) = delete;
-    ~Sha256Impl() override = default;
-    Sha256Impl& operator=(Sha256Impl&&) = delete;
-    Sha256Impl& operator=(Sha256Impl const&) = delete;
-
-    void clear() override
+    if (data_length != 0U)
     {
-        helper_.clear();
+        EVP_DigestUpdate(ctx, data, data_length);
     }
+}
 
-    void add(void const* data, size_t data_length) override
-    {
-        helper_.update(data, data_length);
-    }
+template<typename DigestType>
+[[nodiscard]] DigestType sha_finish(EVP_MD_CTX* ctx, EvpFunc evp_func)
+{
+    TR_ASSERT(ctx != nullptr);
 
-    [[nodiscard]] tr_sha256_digest_t finish() override
-    {
-        return helper_.digest<tr_sha256_digest_t>();
-    }
+    unsigned int hash_length = 0;
+    auto digest = DigestType{};
+    auto* const digest_as_uchar = reinterpret_cast<unsigned char*>(std::data(digest));
+    [[maybe_unused]] bool const ok = check_result(EVP_DigestFinal_ex(ctx, digest_as_uchar, &hash_length));
+    TR_ASSERT(!ok || hash_length == std::size(digest));
 
-private:
-    ShaHelper helper_{ EVP_sha256 };
-};
+    sha_clear(ctx, evp_func);
+    return digest;
+}
 
 } // namespace sha_helpers
 } // namespace
 
 // --- sha
 
-std::unique_ptr<tr_sha1> tr_sha1::create()
+tr_sha1_context::tr_sha1_context()
 {
     using namespace sha_helpers;
 
-    return std::make_unique<Sha1Impl>();
+    auto* const ctx = *new (std::data(state_)) EVP_MD_CTX*{ md_ctx_pool.acquire() };
+    sha_clear(ctx, EVP_sha1);
+}
+
+tr_sha1_context::~tr_sha1_context()
+{
+    sha_helpers::md_ctx_pool.release(*handle<EVP_MD_CTX*>());
+}
+
+void tr_sha1_context::clear()
+{
+    sha_helpers::sha_clear(*handle<EVP_MD_CTX*>(), EVP_sha1);
+}
+
+void tr_sha1_context::add(void const* data, size_t data_length)
+{
+    sha_helpers::sha_update(*handle<EVP_MD_CTX*>(), data, data_length);
 }
 
-std::unique_ptr<tr_sha256> tr_sha256::create()
+tr_sha1_digest_t tr_sha1_context::finish()
+{
+    return sha_helpers::sha_finish<tr_sha1_digest_t>(*handle<EVP_MD_CTX*>(), EVP_sha1);
+}
+
+tr_sha256_context::tr_sha256_context()
 {
     using namespace sha_helpers;
 
-    return std::make_unique<Sha256Impl>();
+    auto* const ctx = *new (std::data(state_)) EVP_MD_CTX*{ md_ctx_pool.acquire() };
+    sha_clear(ctx, EVP_sha256);
+}
+
+tr_sha256_context::~tr_sha256_context()
+{
+    sha_helpers::md_ctx_pool.release(*handle<EVP_MD_CTX*>());
+}
+
+void tr_sha256_context::clear()
+{
+    sha_helpers::sha_clear(*handle<EVP_MD_CTX*>(), EVP_sha256);
+}
+
+void tr_sha256_context::add(void const* data, size_t data_length)
+{
+    sha_helpers::sha_update(*handle<EVP_MD_CTX*>(), data, data_length);
+}
+
+tr_sha256_digest_t tr_sha256_context::finish()
+{
+    return sha_helpers::sha_finish<tr_sha256_digest_t>(*handle<EVP_MD_CTX*>(), EVP_sha256);
 }
 
 // --- x509
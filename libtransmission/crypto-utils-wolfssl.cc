@@ -3,8 +3,8 @@
 // or any future license endorsed by Mnemosyne LLC.
 // License text can be found in the licenses/ folder.
 
-#include <memory>
 #include <mutex>
+#include <new>
 
 #include <wolfssl/options.h>
 #include <wolfssl/wolfcrypt/error-crypt.h>
@@ -87,89 +87,62 @@ static std::mutex rng_mutex_;
 
 // ---
 
-namespace
+tr_sha1_context::tr_sha1_context()
 {
+    new (std::data(state_)) wc_Sha{};
+    clear();
+}
 
-class Sha1Impl final : public tr_sha1
-{
-public:
-    Sha1Impl()
-    {
-        clear();
-    }
-
-    ~Sha1Impl() override = default;
-
-    void clear() override
-    {
-        wc_InitSha(&handle_);
-    }
+tr_sha1_context::~tr_sha1_context() = default;
 
-    void add(void const* data, size_t data_length) override
-    {
-        if (data_length > 0U)
-        {
-            wc_ShaUpdate(&handle_, static_cast<byte const*>(data), data_length);
-        }
-    }
+void tr_sha1_context::clear()
+{
+    wc_InitSha(handle<wc_Sha>());
+}
 
-    [[nodiscard]] tr_sha1_digest_t finish() override
+void tr_sha1_context::add(void const* data, size_t data_length)
+{
+    if (data_length > 0U)
     {
-        auto digest = tr_sha1_digest_t{};
-        wc_ShaFinal(&handle_, reinterpret_cast<byte*>(std::data(digest)));
-        clear();
-        return digest;
+        wc_ShaUpdate(handle<wc_Sha>(), static_cast<byte const*>(data), data_length);
     }
+}
 
-private:
-    wc_Sha handle_ = {};
-};
-
-class Sha256Impl final : public tr_sha256
+tr_sha1_digest_t tr_sha1_context::finish()
 {
-public:
-    Sha256Impl()
-    {
-        clear();
-    }
+    auto digest = tr_sha1_digest_t{};
+    wc_ShaFinal(handle<wc_Sha>(), reinterpret_cast<byte*>(std::data(digest)));
+    clear();
+    return digest;
+}
 
-    ~Sha256Impl() override = default;
+tr_sha256_context::tr_sha256_context()
+{
+    new (std::data(state_)) wc_Sha256{};
+    clear();
+}
 
-    void clear() override
-    {
-        wc_InitSha256(&handle_);
-    }
+tr_sha256_context::~tr_sha256_context() = default;
 
-    void add(void const* data, size_t data_length) override
-    {
-        if (data_length > 0U)
-        {
-            wc_Sha256Update(&handle_, static_cast<byte const*>(data), data_length);
-        }
-    }
+void tr_sha256_context::clear()
+{
+    wc_InitSha256(handle<wc_Sha256>());
+}
 
-    [[nodiscard]] tr_sha256_digest_t finish() override
+void tr_sha256_context::add(void const* data, size_t data_length)
+{
+    if (data_length > 0U)
     {
-        auto digest = tr_sha256_digest_t{};
-        wc_Sha256Final(&handle_, reinterpret_cast<byte*>(std::data(digest)));
-        clear();
-        return digest;
+        wc_Sha256Update(handle<wc_Sha256>(), static_cast<byte const*>(data), data_length);
     }
-
-private:
-    wc_Sha256 handle_ = {};
-};
-
-} // namespace
-
-std::unique_ptr<tr_sha1> tr_sha1::create()
-{
-    return std::make_unique<Sha1Impl>();
 }
 
-std::unique_ptr<tr_sha256> tr_sha256::create()
+tr_sha256_digest_t tr_sha256_context::finish()
 {
-    return std::make_unique<Sha256Impl>();
+    auto digest = tr_sha256_digest_t{};
+    wc_Sha256Final(handle<wc_Sha256>(), reinterpret_cast<byte*>(std::data(digest)));
+    clear();
+    return digest;
 }
 
 // ---
@@ -6,18 +6,14 @@
 #include <algorithm>
 #include <array>
 #include <cctype>
+#include <cstdint> // uint32_t, int8_t
 #include <iterator>
+#include <memory>
 #include <random>
 #include <string>
 #include <string_view>
 #include <vector>
 
-extern "C"
-{
-#include <b64/cdecode.h>
-#include <b64/cencode.h>
-}
-
 #include <fmt/core.h>
 
 #include "libtransmission/crypto-utils.h"
@@ -28,6 +24,93 @@ using namespace std::literals;
 
 // ---
 
+void tr_sha1_context::digest_batch(std::string_view const* buffers, size_t n_buffers, tr_sha1_digest_t* setme)
+{
+    for (size_t i = 0; i < n_buffers; ++i)
+    {
+        clear();
+        add(std::data(buffers[i]), std::size(buffers[i]));
+        setme[i] = finish();
+    }
+}
+
+void tr_sha256_context::digest_batch(std::string_view const* buffers, size_t n_buffers, tr_sha256_digest_t* setme)
+{
+    for (size_t i = 0; i < n_buffers; ++i)
+    {
+        clear();
+        add(std::data(buffers[i]), std::size(buffers[i]));
+        setme[i] = finish();
+    }
+}
+
+std::vector<tr_sha1_digest_t> tr_sha1_batch(std::vector<std::string_view> const& buffers)
+{
+    auto digests = std::vector<tr_sha1_digest_t>(std::size(buffers));
+
+    if (!std::empty(buffers))
+    {
+        tr_sha1_context{}.digest_batch(std::data(buffers), std::size(buffers), std::data(digests));
+    }
+
+    return digests;
+}
+
+std::vector<tr_sha256_digest_t> tr_sha256_batch(std::vector<std::string_view> const& buffers)
+{
+    auto digests = std::vector<tr_sha256_digest_t>(std::size(buffers));
+
+    if (!std::empty(buffers))
+    {
+        tr_sha256_context{}.digest_batch(std::data(buffers), std::size(buffers), std::data(digests));
+    }
+
+    return digests;
+}
+
+namespace
+{
+template<typename Base, typename Context, typename Digest>
+class ShaShim final : public Base
+{
+public:
+    void clear() override
+    {
+        context_.clear();
+    }
+
+    void add(void const* data, size_t data_length) override
+    {
+        context_.add(data, data_length);
+    }
+
+    [[nodiscard]] Digest finish() override
+    {
+        return context_.finish();
+    }
+
+    void digest_batch(std::string_view const* buffers, size_t n_buffers, Digest* setme) override
+    {
+        context_.digest_batch(buffers, n_buffers, setme);
+    }
+
+private:
+    Context context_;
+};
+} // namespace
+
+std::unique_ptr<tr_sha1> tr_sha1::create()
+{
+    return std::make_unique<ShaShim<tr_sha1, tr_sha1_context, tr_sha1_digest_t>>();
+}
+
+std::unique_ptr<tr_sha256> tr_sha256::create()
+{
+    return std::make_unique<ShaShim<tr_sha256, tr_sha256_context, tr_sha256_digest_t>>();
+}
+
+// ---
+
 namespace
 {
 constexpr auto TrSha1DigestStrlen = size_t{ 40 };
@@ -100,15 +183,34 @@ namespace
 namespace base64_impl
 {
 
-constexpr size_t base64AllocSize(std::string_view input)
+auto constexpr Alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/"sv;
+
+// Each 12-bit value's two characters, so that encoding takes two lookups per three bytes
+auto constexpr EncodePairs = []()
 {
-    size_t ret_length = 4 * ((std::size(input) + 2) / 3); // NOLINT misc-const-correctness
-#ifdef USE_SYSTEM_B64
-    // Additional space is needed for newlines if we're using unpatched libb64
-    ret_length += ret_length / 72 + 1;
-#endif
-    return ret_length * 8;
-}
+    auto pairs = std::array<char, 4096U * 2U>{};
+    for (size_t i = 0; i < 4096U; ++i)
+    {
+        pairs[i * 2U] = Alphabet[i >> 6U];
+        pairs[i * 2U + 1U] = Alphabet[i & 63U];
+    }
+    return pairs;
+}();
+
+// Each character's 6-bit value, or -1 if it's not in the alphabet
+auto constexpr DecodeValues = []()
+{
+    auto values = std::array<int8_t, 256U>{};
+    for (auto& value : values)
+    {
+        value = -1;
+    }
+    for (size_t i = 0; i < std::size(Alphabet); ++i)
+    {
+        values[static_cast<unsigned char>(Alphabet[i])] = static_cast<int8_t>(i);
+    }
+    return values;
+}();
 
 } // namespace base64_impl
 } // namespace
@@ -117,27 +219,84 @@ std::string tr_base64_encode(std::string_view input)
 {
     using namespace base64_impl;
 
-    auto buf = std::vector<char>(base64AllocSize(input));
-    auto state = base64_encodestate{};
-    base64_init_encodestate(&state);
-    size_t len = base64_encode_block(std::data(input), std::size(input), std::data(buf), &state);
-    len += base64_encode_blockend(std::data(buf) + len, &state);
-    auto str = std::string{};
-    std::copy_if(
-        std::data(buf),
-        std::data(buf) + len,
-        std::back_inserter(str),
-        [](auto ch) { return !tr_strv_contains("\r\n"sv, ch); });
-    return str;
+    auto const n_groups = std::size(input) / 3U;
+    auto const n_left = std::size(input) % 3U;
+    auto ret = std::string((n_groups + (n_left != 0U ? 1U : 0U)) * 4U, '=');
+
+    auto const* src = reinterpret_cast<unsigned char const*>(std::data(input));
+    auto* dst = std::data(ret);
+    for (size_t i = 0; i < n_groups; ++i, src += 3)
+    {
+        auto const val = (uint32_t{ src[0] } << 16U) | (uint32_t{ src[1] } << 8U) | uint32_t{ src[2] };
+        auto const* const hi = &EncodePairs[(val >> 12U) * 2U];
+        auto const* const lo = &EncodePairs[(val & 0xFFFU) * 2U];
+        *dst++ = hi[0];
+        *dst++ = hi[1];
+        *dst++ = lo[0];
+        *dst++ = lo[1];
+    }
+
+    if (n_left != 0U)
+    {
+        auto const val = (uint32_t{ src[0] } << 16U) | (n_left == 2U ? uint32_t{ src[1] } << 8U : 0U);
+        *dst++ = Alphabet[val >> 18U];
+        *dst++ = Alphabet[(val >> 12U) & 63U];
+        if (n_left == 2U)
+        {
+            *dst = Alphabet[(val >> 6U) & 63U];
+        }
+    }
+
+    return ret;
 }
 
 std::string tr_base64_decode(std::string_view input)
 {
-    auto buf = std::vector<char>(std::size(input) + 8);
-    auto state = base64_decodestate{};
-    base64_init_decodestate(&state);
-    size_t const len = base64_decode_block(std::data(input), std::size(input), std::data(buf), &state);
-    return std::string{ std::data(buf), len };
+    using namespace base64_impl;
+
+    auto ret = std::string(std::size(input) / 4U * 3U + 3U, '\0');
+    auto* const out = std::data(ret);
+    auto* dst = out;
+
+    auto const* src = reinterpret_cast<unsigned char const*>(std::data(input));
+    auto const* const end = src + std::size(input);
+    auto bits = uint32_t{};
+    auto n_bits = 0;
+    while (src != end)
+    {
+        // fast path: four characters that are all in the alphabet
+        if (n_bits == 0 && end - src >= 4)
+        {
+            auto const a = DecodeValues[src[0]];
+            auto const b = DecodeValues[src[1]];
+            auto const c = DecodeValues[src[2]];
+            auto const d = DecodeValues[src[3]];
+            if ((a | b | c | d) >= 0)
+            {
+                auto const val = (uint32_t(a) << 18U) | (uint32_t(b) << 12U) | (uint32_t(c) << 6U) | uint32_t(d);
+                *dst++ = static_cast<char>(val >> 16U);
+                *dst++ = static_cast<char>(val >> 8U);
+                *dst++ = static_cast<char>(val);
+                src += 4;
+                continue;
+            }
+        }
+
+        // otherwise, skip characters that aren't in the alphabet, e.g. padding or line breaks
+        if (auto const val = DecodeValues[*src++]; val >= 0)
+        {
+            bits = (bits << 6U) | uint32_t(val);
+            n_bits += 6;
+            if (n_bits >= 8)
+            {
+                n_bits -= 8;
+                *dst++ = static_cast<char>(bits >> n_bits);
+            }
+        }
+    }
+
+    ret.resize(dst - out);
+    return ret;
 }
 
 // ---
@@ -7,14 +7,16 @@
 #define TR_CRYPTO_UTILS_H
 
 #include <array>
-#include <cstddef> // size_t
+#include <cstddef> // size_t, std::byte, std::max_align_t
 #include <cstdint>
 #include <limits>
 #include <memory>
+#include <new> // std::launder()
 #include <optional>
 #include <random> // for std::uniform_int_distribution<T>
 #include <string>
 #include <string_view>
+#include <vector>
 
 #include "libtransmission/tr-macros.h" // tr_sha1_digest_t, tr_sha256_d...
 #include "libtransmission/tr-strbuf.h"
@@ -24,6 +26,79 @@
  * @{
  */
 
+// Room for the state of whichever crypto backend was chosen at build time.
+// Each backend checks that its SHA contexts fit.
+inline auto constexpr TrShaContextSize = size_t{ 512U };
+
+/**
+ * A SHA-1 context implemented directly by the crypto backend that was
+ * chosen at build time. Making one doesn't allocate and calling it isn't
+ * virtual, so prefer it to `tr_sha1` in hot paths. It can live on the
+ * stack or in another object. finish() leaves it ready for the next digest.
+ */
+class tr_sha1_context
+{
+public:
+    tr_sha1_context();
+    ~tr_sha1_context();
+    tr_sha1_context(tr_sha1_context&&) = delete;
+    tr_sha1_context(tr_sha1_context const&) = delete;
+    tr_sha1_context& operator=(tr_sha1_context&&) = delete;
+    tr_sha1_context& operator=(tr_sha1_context const&) = delete;
+
+    void clear();
+    void add(void const* data, size_t data_length);
+    [[nodiscard]] tr_sha1_digest_t finish();
+
+    // Digest `n_buffers` independent buffers, e.g. a run of pieces,
+    // writing one digest per buffer into `setme`.
+    void digest_batch(std::string_view const* buffers, size_t n_buffers, tr_sha1_digest_t* setme);
+
+private:
+    template<typename Handle>
+    [[nodiscard]] Handle* handle() noexcept
+    {
+        static_assert(sizeof(Handle) <= TrShaContextSize, "raise TrShaContextSize for this crypto backend");
+        static_assert(alignof(Handle) <= alignof(std::max_align_t));
+        return std::launder(reinterpret_cast<Handle*>(std::data(state_)));
+    }
+
+    alignas(std::max_align_t) std::array<std::byte, TrShaContextSize> state_;
+};
+
+// Like tr_sha1_context, for SHA-256
+class tr_sha256_context
+{
+public:
+    tr_sha256_context();
+    ~tr_sha256_context();
+    tr_sha256_context(tr_sha256_context&&) = delete;
+    tr_sha256_context(tr_sha256_context const&) = delete;
+    tr_sha256_context& operator=(tr_sha256_context&&) = delete;
+    tr_sha256_context& operator=(tr_sha256_context const&) = delete;
+
+    void clear();
+    void add(void const* data, size_t data_length);
+    [[nodiscard]] tr_sha256_digest_t finish();
+
+    // Digest `n_buffers` independent buffers, e.g. the 16 KiB blocks
+    // that are the leaves of a BitTorrent v2 merkle tree.
+    void digest_batch(std::string_view const* buffers, size_t n_buffers, tr_sha256_digest_t* setme);
+
+private:
+    template<typename Handle>
+    [[nodiscard]] Handle* handle() noexcept
+    {
+        static_assert(sizeof(Handle) <= TrShaContextSize, "raise TrShaContextSize for this crypto backend");
+        static_assert(alignof(Handle) <= alignof(std::max_align_t));
+        return std::launder(reinterpret_cast<Handle*>(std::data(state_)));
+    }
+
+    alignas(std::max_align_t) std::array<std::byte, TrShaContextSize> state_;
+};
+
+// A heap-allocated, polymorphic wrapper around tr_sha1_context,
+// kept for code that wants to hold a hasher behind a pointer.
 class tr_sha1
 {
 public:
@@ -33,16 +108,24 @@ public:
     virtual void clear() = 0;
     virtual void add(void const* data, size_t data_length) = 0;
     [[nodiscard]] virtual tr_sha1_digest_t finish() = 0;
+    virtual void digest_batch(std::string_view const* buffers, size_t n_buffers, tr_sha1_digest_t* setme) = 0;
 
     template<typename... T>
     [[nodiscard]] static tr_sha1_digest_t digest(T const&... args)
     {
-        auto context = tr_sha1::create();
-        (context->add(std::data(args), std::size(args)), ...);
-        return context->finish();
+        auto context = tr_sha1_context{};
+        (context.add(std::data(args), std::size(args)), ...);
+        return context.finish();
     }
 };
 
+/**
+ * @brief Compute the sha1 digests of many independent buffers.
+ * @return a vector with one digest per buffer, in the same order
+ */
+[[nodiscard]] std::vector<tr_sha1_digest_t> tr_sha1_batch(std::vector<std::string_view> const& buffers);
+
+// A heap-allocated, polymorphic wrapper around tr_sha256_context
 class tr_sha256
 {
 public:
@@ -52,16 +135,23 @@ public:
     virtual void clear() = 0;
     virtual void add(void const* data, size_t data_length) = 0;
     [[nodiscard]] virtual tr_sha256_digest_t finish() = 0;
+    virtual void digest_batch(std::string_view const* buffers, size_t n_buffers, tr_sha256_digest_t* setme) = 0;
 
     template<typename... T>
     [[nodiscard]] static tr_sha256_digest_t digest(T const&... args)
     {
-        auto context = tr_sha256::create();
-        (context->add(std::data(args), std::size(args)), ...);
-        return context->finish();
+        auto context = tr_sha256_context{};
+        (context.add(std::data(args), std::size(args)), ...);
+        return context.finish();
     }
 };
 
+/**
+ * @brief Compute the sha256 digests of many independent buffers.
+ * @return a vector with one digest per buffer, in the same order
+ */
+[[nodiscard]] std::vector<tr_sha256_digest_t> tr_sha256_batch(std::vector<std::string_view> const& buffers);
+
 /** @brief Opaque SSL context type. */
 using tr_ssl_ctx_t = void*;
 /** @brief Opaque X509 certificate store type. */
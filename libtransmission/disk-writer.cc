@@ -0,0 +1,423 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm> // std::copy_n(), std::find_if(), std::min()
+#include <cerrno>
+#include <chrono>
+#include <cstddef> // size_t
+#include <cstdint> // int64_t, uint8_t, uint64_t
+#include <iterator> // std::distance(), std::next()
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <tuple> // std::tie()
+#include <utility> // std::move
+#include <vector>
+
+#include "libtransmission/block-info.h"
+#include "libtransmission/block-pool.h"
+#include "libtransmission/disk-writer.h"
+#include "libtransmission/error.h"
+#include "libtransmission/file.h"
+#include "libtransmission/tracing.h"
+
+namespace
+{
+// The size of the bounce buffers that direct reads go through.
+// The smallest read-ahead window takes one or two reads.
+auto constexpr DirectBufferSize = size_t{ tr_block_info::BlockSize * 16U };
+
+// @return 0 on success, or an errno value on failure.
+// `vecs` is used as scratch space and is undefined afterwards.
+int transfer(tr_sys_file_t fd, bool is_read, uint64_t offset, std::vector<tr_sys_file_iovec>& vecs)
+{
+    tr_error* error = nullptr;
+    auto* walk = std::data(vecs);
+    auto n_left = std::size(vecs);
+    while (n_left > 0U)
+    {
+        auto n_written = uint64_t{};
+        auto const ok = is_read ? tr_sys_file_read_at_v(fd, walk, n_left, offset, &n_written, &error) :
+                                  tr_sys_file_write_at_v(fd, walk, n_left, offset, &n_written, &error);
+        if (!ok || n_written == 0U)
+        {
+            auto const err = error != nullptr ? error->code : EIO;
+            tr_error_clear(&error);
+            return err;
+        }
+
+        offset += n_written;
+
+        // skip past the buffers that were written
+        while (n_left > 0U && n_written >= walk->len)
+        {
+            n_written -= walk->len;
+            ++walk;
+            --n_left;
+        }
+
+        if (n_left > 0U)
+        {
+            walk->base = static_cast<uint8_t*>(walk->base) + n_written;
+            walk->len -= n_written;
+        }
+    }
+
+    return 0;
+}
+
+// Like transfer(), but for a file opened with TR_SYS_FILE_DIRECT.
+// The file is read in aligned chunks into a bounce buffer and copied out from there.
+int read_direct(tr_sys_file_t fd, uint64_t offset, std::vector<tr_sys_file_iovec> const& vecs)
+{
+    static auto pool = tr_block_pool{ DirectBufferSize, TR_SYS_FILE_DIRECT_ALIGNMENT };
+    auto const buf = std::unique_ptr<void, void (*)(void*)>{ pool.get(), [](void* ptr) { pool.put(ptr); } };
+
+    auto n_left = uint64_t{};
+    for (auto const& vec : vecs)
+    {
+        n_left += vec.len;
+    }
+
+    auto vec = std::begin(vecs);
+    auto vec_pos = size_t{};
+    while (n_left > 0U)
+    {
+        auto const aligned_offset = offset - offset % TR_SYS_FILE_DIRECT_ALIGNMENT;
+        auto const skip = offset - aligned_offset;
+        auto const wanted = skip + n_left;
+        auto const wanted_aligned = wanted + (TR_SYS_FILE_DIRECT_ALIGNMENT - wanted % TR_SYS_FILE_DIRECT_ALIGNMENT) %
+                TR_SYS_FILE_DIRECT_ALIGNMENT;
+
+        tr_error* error = nullptr;
+        auto n_read = uint64_t{};
+        auto const n_bytes = std::min(wanted_aligned, uint64_t{ DirectBufferSize });
+        if (!tr_sys_file_read_at(fd, buf.get(), n_bytes, aligned_offset, &n_read, &error))
+        {
+            auto const err = error != nullptr ? error->code : EIO;
+            tr_error_clear(&error);
+            return err;
+        }
+
+        if (n_read <= skip) // the file ended before the data that we want
+        {
+            return EIO;
+        }
+
+        auto const* src = static_cast<uint8_t const*>(buf.get()) + skip;
+        for (auto n_copy = std::min(n_read - skip, n_left); n_copy > 0U;)
+        {
+            auto const n = std::min(n_copy, uint64_t{ vec->len - vec_pos });
+            std::copy_n(src, n, static_cast<uint8_t*>(vec->base) + vec_pos);
+            src += n;
+            n_copy -= n;
+            n_left -= n;
+            offset += n;
+            vec_pos += n;
+
+            if (vec_pos == vec->len)
+            {
+                ++vec;
+                vec_pos = 0U;
+            }
+        }
+    }
+
+    return 0;
+}
+
+[[nodiscard]] uint64_t byte_count(std::vector<tr_sys_file_iovec> const& vecs)
+{
+    auto n_bytes = uint64_t{};
+    for (auto const& vec : vecs)
+    {
+        n_bytes += vec.len;
+    }
+    return n_bytes;
+}
+} // namespace
+
+tr_disk_writer::tr_disk_writer()
+    : thread_{ &tr_disk_writer::thread_func, this }
+{
+}
+
+tr_disk_writer::~tr_disk_writer()
+{
+    {
+        auto const lock = std::lock_guard(mutex_);
+        stopping_ = true;
+    }
+
+    todo_cv_.notify_one();
+    thread_.join();
+}
+
+tr_disk_writer::JobId tr_disk_writer::add(std::vector<Write>&& writes, tr_io_scheduler::Ticket ticket)
+{
+    return add(std::move(writes), Kind::Write, std::move(ticket));
+}
+
+tr_disk_writer::JobId tr_disk_writer::add_read(std::vector<Write>&& reads, tr_io_scheduler::Ticket ticket)
+{
+    return add(std::move(reads), Kind::Read, std::move(ticket));
+}
+
+tr_disk_writer::JobId tr_disk_writer::add_sync(std::vector<std::string> const& filenames)
+{
+    auto syncs = std::vector<Write>{};
+    syncs.reserve(std::size(filenames));
+    for (auto const& filename : filenames)
+    {
+        syncs.push_back(Write{ filename, 0U, {} });
+    }
+
+    return add(std::move(syncs), Kind::Sync, {});
+}
+
+tr_disk_writer::JobId tr_disk_writer::add(std::vector<Write>&& writes, Kind kind, tr_io_scheduler::Ticket ticket)
+{
+    auto lock = std::unique_lock(mutex_);
+    auto const id = next_id_++;
+    todo_.push_back(Job{ id, std::move(writes), kind, std::move(ticket), std::chrono::steady_clock::now() });
+    lock.unlock();
+
+    todo_cv_.notify_one();
+    return id;
+}
+
+std::vector<tr_disk_writer::Result> tr_disk_writer::take_finished()
+{
+    auto const lock = std::lock_guard(mutex_);
+    auto ret = std::vector<Result>{};
+    std::swap(ret, done_);
+    return ret;
+}
+
+void tr_disk_writer::wait(size_t max_pending)
+{
+    auto lock = std::unique_lock(mutex_);
+    done_cv_.wait(lock, [this, max_pending]() { return std::size(todo_) + n_running_ <= max_pending; });
+}
+
+tr_disk_writer::Result tr_disk_writer::run_sync(Job const& job)
+{
+    TR_TRACE_SCOPE("cache", "disk_writer_sync");
+    for (auto const& write : job.writes)
+    {
+        tr_error* error = nullptr;
+        auto const fd = tr_sys_file_open(write.filename.c_str(), TR_SYS_FILE_WRITE, 0, &error);
+        if (fd != TR_BAD_SYS_FILE)
+        {
+            tr_sys_file_flush_data(fd, &error);
+            tr_sys_file_close(fd);
+        }
+
+        if (error != nullptr)
+        {
+            auto const err = error->code;
+            tr_error_clear(&error);
+            return { job.id, err, write.filename };
+        }
+    }
+
+    return { job.id, 0, {} };
+}
+
+tr_disk_writer::Result tr_disk_writer::run(Job& job, bool direct_io)
+{
+    if (job.kind == Kind::Sync)
+    {
+        return run_sync(job);
+    }
+
+    auto const is_read = job.kind == Kind::Read;
+    TR_TRACE_SCOPE("cache", is_read ? "disk_writer_read" : "disk_writer_write");
+    for (auto& [filename, offset, vecs] : job.writes)
+    {
+        // not every filesystem supports direct I/O, so fall back to buffered reads
+        auto fd = direct_io && is_read ? tr_sys_file_open(filename.c_str(), TR_SYS_FILE_READ | TR_SYS_FILE_DIRECT, 0) :
+                                         TR_BAD_SYS_FILE;
+        auto const is_direct = fd != TR_BAD_SYS_FILE;
+
+        tr_error* error = nullptr;
+        if (!is_direct)
+        {
+            fd = tr_sys_file_open(filename.c_str(), is_read ? TR_SYS_FILE_READ : TR_SYS_FILE_WRITE, 0, &error);
+        }
+        if (fd == TR_BAD_SYS_FILE)
+        {
+            auto const err = error != nullptr ? error->code : EIO;
+            tr_error_clear(&error);
+            return { job.id, err, filename };
+        }
+
+        auto const n_bytes = byte_count(vecs);
+        auto const err = is_direct ? read_direct(fd, offset, vecs) : transfer(fd, is_read, offset, vecs);
+        if (err == 0 && direct_io && !is_direct)
+        {
+            // drop what we just read or wrote from the page cache.
+            // Written pages are only dropped once the OS has written them back.
+            tr_sys_file_advise(fd, offset, n_bytes, TR_SYS_FILE_ADVICE_DONT_NEED);
+        }
+
+        tr_sys_file_close(fd);
+
+        if (err != 0)
+        {
+            return { job.id, err, filename };
+        }
+    }
+
+    return { job.id, 0, {} };
+}
+
+std::vector<tr_disk_writer::Job> tr_disk_writer::take_next_locked()
+{
+    auto jobs = std::vector<Job>{};
+
+    // the reads at the front of the queue, which may run in any order
+    auto const reads_end = std::find_if(
+        std::begin(todo_),
+        std::end(todo_),
+        [](Job const& job) { return job.kind != Kind::Read || std::empty(job.writes); });
+    auto const n_reads = static_cast<size_t>(std::distance(std::begin(todo_), reads_end));
+
+    // Pick the first read at or past where the last one ended, or wrap
+    // around to the lowest one, unless the oldest has waited long enough
+    auto pick = size_t{};
+    if (n_reads > 1U && std::chrono::steady_clock::now() - todo_.front().added_at < MaxReadDelay)
+    {
+        auto const key_of = [this](size_t i)
+        {
+            auto const& read = todo_[i].writes.front();
+            return std::tie(read.filename, read.offset);
+        };
+
+        auto const last = std::tie(last_read_filename_, last_read_end_);
+        auto best_ahead = std::optional<size_t>{};
+        auto best_any = size_t{};
+        for (size_t i = 0; i < n_reads; ++i)
+        {
+            if (key_of(i) >= last && (!best_ahead || key_of(i) < key_of(*best_ahead)))
+            {
+                best_ahead = i;
+            }
+
+            if (key_of(i) < key_of(best_any))
+            {
+                best_any = i;
+            }
+        }
+
+        pick = best_ahead.value_or(best_any);
+    }
+
+    jobs.emplace_back(std::move(todo_[pick]));
+    todo_.erase(std::next(std::begin(todo_), pick));
+    auto n_reads_left = n_reads != 0U ? n_reads - 1U : 0U;
+
+    if (jobs.front().kind != Kind::Read || std::empty(jobs.front().writes))
+    {
+        return jobs;
+    }
+
+    // Merge in the reads that pick up where this one leaves off
+    if (std::size(jobs.front().writes) == 1U)
+    {
+        auto const filename = jobs.front().writes.front().filename; // jobs may reallocate
+        auto end = jobs.front().writes.front().offset + byte_count(jobs.front().writes.front().vecs);
+        auto n_bytes = end - jobs.front().writes.front().offset;
+
+        for (auto found = true; found;)
+        {
+            found = false;
+            for (size_t i = 0; i < n_reads_left; ++i)
+            {
+                auto const& writes = todo_[i].writes;
+                if (std::size(writes) != 1U || writes.front().filename != filename || writes.front().offset != end)
+                {
+                    continue;
+                }
+
+                auto const len = byte_count(writes.front().vecs);
+                if (n_bytes + len > MaxMergedReadBytes)
+                {
+                    continue;
+                }
+
+                end += len;
+                n_bytes += len;
+                jobs.emplace_back(std::move(todo_[i]));
+                todo_.erase(std::next(std::begin(todo_), i));
+                --n_reads_left;
+                found = true;
+                break;
+            }
+        }
+    }
+
+    auto const& last_read = jobs.back().writes.back();
+    last_read_filename_ = last_read.filename;
+    last_read_end_ = last_read.offset + byte_count(last_read.vecs);
+    return jobs;
+}
+
+void tr_disk_writer::thread_func()
+{
+    auto lock = std::unique_lock(mutex_);
+
+    for (;;)
+    {
+        // finish every queued job before stopping so that nothing is lost
+        todo_cv_.wait(lock, [this]() { return stopping_ || !std::empty(todo_); });
+        if (std::empty(todo_))
+        {
+            return;
+        }
+
+        auto jobs = take_next_locked();
+        TR_TRACE_COUNTER("cache", "disk_writer_queue", static_cast<int64_t>(std::size(todo_)));
+        n_running_ = std::size(jobs);
+        lock.unlock();
+
+        auto const started_at = std::chrono::steady_clock::now();
+        auto result = Result{};
+        if (std::size(jobs) == 1U)
+        {
+            result = run(jobs.front(), direct_io_);
+        }
+        else
+        {
+            // adjacent reads of one file, so run them as a single read
+            auto const& first = jobs.front().writes.front();
+            auto merged = Job{ jobs.front().id, {}, Kind::Read, {}, {} };
+            auto& read = merged.writes.emplace_back(Write{ first.filename, first.offset, {} });
+            for (auto const& job : jobs)
+            {
+                auto const& vecs = job.writes.front().vecs;
+                read.vecs.insert(std::end(read.vecs), std::begin(vecs), std::end(vecs));
+            }
+            result = run(merged, direct_io_);
+        }
+
+        for (auto& job : jobs)
+        {
+            job.ticket.reset();
+        }
+        result.msec = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started_at)
+                          .count();
+
+        lock.lock();
+        n_running_ = 0U;
+        for (auto const& job : jobs)
+        {
+            auto& done = done_.emplace_back(result);
+            done.id = job.id;
+        }
+        done_cv_.notify_all();
+    }
+}
@@ -0,0 +1,154 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef> // size_t
+#include <cstdint> // uint64_t
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility> // std::pair
+#include <vector>
+
+#include "libtransmission/file.h" // tr_sys_file_iovec
+#include "libtransmission/io-scheduler.h"
+
+// Performs file writes on a background thread so that a slow disk
+// doesn't stall the session thread. It can also read ahead for the cache,
+// and flush files to the disk.
+//
+// Jobs are run one at a time, in the order they were added, so a
+// later job that overwrites the same bytes as an earlier one always wins
+// and a read sees every write that was added before it.
+// The exception is reads that are queued back to back: none of them can
+// see a write that the others don't, so they're run in file and offset
+// order, sweeping across the disk like an elevator, and reads of adjacent
+// ranges of a file are merged into one. That way the read-aheads for many
+// peers don't make the disk seek back and forth between them.
+// The caller owns the buffers and must keep them alive until the job
+// shows up in take_finished().
+class tr_disk_writer
+{
+public:
+    using JobId = uint64_t;
+
+    // One gathered write into a single, already-existing file
+    struct Write
+    {
+        std::string filename;
+        uint64_t offset = 0;
+        std::vector<tr_sys_file_iovec> vecs;
+    };
+
+    struct Result
+    {
+        JobId id = {};
+        int err = 0; // an errno value on failure
+        std::string filename; // the file that failed, if any
+        uint64_t msec = 0; // how long the job took to run
+    };
+
+    tr_disk_writer();
+    ~tr_disk_writer();
+
+    tr_disk_writer(tr_disk_writer const&) = delete;
+    tr_disk_writer(tr_disk_writer&&) = delete;
+    tr_disk_writer& operator=(tr_disk_writer const&) = delete;
+    tr_disk_writer& operator=(tr_disk_writer&&) = delete;
+
+    // `ticket` is held until the job has run, so that the I/O
+    // scheduler sees the job from when it's queued until it's done
+    [[nodiscard]] JobId add(std::vector<Write>&& writes, tr_io_scheduler::Ticket ticket = {});
+
+    // Like add(), but fills the buffers from the files instead.
+    // A read that runs past the end of a file fails with EIO.
+    [[nodiscard]] JobId add_read(std::vector<Write>&& reads, tr_io_scheduler::Ticket ticket = {});
+
+    // Flush each file's data to the disk with fdatasync(). Since jobs run
+    // in order, this covers every write that was added before it.
+    [[nodiscard]] JobId add_sync(std::vector<std::string> const& filenames);
+
+    // A read that's waited this long runs next, wherever it is on the disk
+    static auto constexpr MaxReadDelay = std::chrono::milliseconds{ 100 };
+
+    // The most bytes that adjacent reads are merged into
+    static auto constexpr MaxMergedReadBytes = uint64_t{ 1024U * 1024U * 4U };
+
+    // With direct I/O, reads bypass the OS' page cache and go through an aligned
+    // bounce buffer, and written ranges are dropped from the page cache afterwards,
+    // so that data which the cache already holds isn't cached twice.
+    // Filesystems that don't support it get buffered reads instead.
+    void set_direct_io(bool enabled) noexcept
+    {
+        direct_io_ = enabled;
+    }
+
+    // @return the jobs that have finished since the last call
+    [[nodiscard]] std::vector<Result> take_finished();
+
+    // Block until no more than `max_pending` jobs are unfinished
+    void wait(size_t max_pending);
+
+    // @return the number of unfinished jobs
+    [[nodiscard]] size_t size() const
+    {
+        auto const lock = std::lock_guard(mutex_);
+        return std::size(todo_) + n_running_;
+    }
+
+private:
+    enum class Kind : uint8_t
+    {
+        Write,
+        Read,
+        Sync
+    };
+
+    struct Job
+    {
+        JobId id;
+        std::vector<Write> writes;
+        Kind kind = Kind::Write;
+        tr_io_scheduler::Ticket ticket;
+        std::chrono::steady_clock::time_point added_at;
+    };
+
+    [[nodiscard]] JobId add(std::vector<Write>&& writes, Kind kind, tr_io_scheduler::Ticket ticket);
+
+    // @return the next job, or several adjacent reads to run as one
+    [[nodiscard]] std::vector<Job> take_next_locked();
+
+    [[nodiscard]] static Result run_sync(Job const& job);
+
+    [[nodiscard]] static Result run(Job& job, bool direct_io);
+
+    void thread_func();
+
+    mutable std::mutex mutex_;
+    std::condition_variable todo_cv_;
+    std::condition_variable done_cv_;
+    std::deque<Job> todo_;
+    std::vector<Result> done_;
+    JobId next_id_ = 1;
+    size_t n_running_ = 0;
+
+    // where the last read ended, for picking the next one
+    std::string last_read_filename_;
+    uint64_t last_read_end_ = 0;
+
+    bool stopping_ = false;
+    std::atomic<bool> direct_io_ = false;
+
+    std::thread thread_;
+};
@@ -0,0 +1,170 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <ctime>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#ifdef _WIN32
+#include <ws2tcpip.h>
+#undef gai_strerror
+#define gai_strerror gai_strerrorA
+#else
+#include <netdb.h> // getaddrinfo(), gai_strerror()
+#include <sys/socket.h> // AF_UNSPEC, SOCK_STREAM
+#endif
+
+#include <fmt/core.h>
+
+#include "libtransmission/dns.h"
+#include "libtransmission/executor.h"
+#include "libtransmission/log.h"
+#include "libtransmission/net.h"
+#include "libtransmission/utils.h"
+
+tr_dns::tr_dns(tr_executor& executor)
+    : executor_{ executor }
+{
+}
+
+tr_dns::~tr_dns()
+{
+    auto lock = std::unique_lock(mutex_);
+    cv_.wait(lock, [this]() { return n_pending_ == 0U; });
+}
+
+std::optional<tr_dns::Addresses> tr_dns::get(std::string_view host, time_t now)
+{
+    // no need to look up an address
+    if (auto const addr = tr_address::from_string(host); addr)
+    {
+        return Addresses{ *addr };
+    }
+
+    auto key = tr_strlower(host);
+    auto const lock = std::lock_guard(mutex_);
+
+    auto iter = entries_.find(key);
+    if (iter == std::end(entries_))
+    {
+        prune(now);
+        iter = entries_.try_emplace(key).first;
+    }
+
+    auto& entry = iter->second;
+    if (entry.addresses)
+    {
+        ++stats_.hits;
+    }
+    else
+    {
+        ++stats_.misses;
+    }
+
+    if (!entry.is_pending && (!entry.addresses || entry.expires_at <= now))
+    {
+        entry.is_pending = true;
+        ++n_pending_;
+        ++stats_.lookups;
+        executor_.submit(
+            [this, key = std::move(key), now]() mutable { on_lookup_done(key, lookup(key), now); },
+            tr_executor::Priority::High);
+    }
+
+    return entry.addresses;
+}
+
+tr_dns::Addresses tr_dns::lookup(std::string const& host)
+{
+    auto hints = addrinfo{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM; // only to get one answer per address
+
+    addrinfo* info = nullptr;
+    if (int const rc = getaddrinfo(host.c_str(), nullptr, &hints, &info); rc != 0)
+    {
+        tr_logAddWarn(fmt::format(
+            _("Couldn't look up '{address}': {error} ({error_code})"),
+            fmt::arg("address", host),
+            fmt::arg("error", gai_strerror(rc)),
+            fmt::arg("error_code", rc)));
+        return {};
+    }
+
+    auto addresses = Addresses{};
+    for (auto const* walk = info; walk != nullptr; walk = walk->ai_next)
+    {
+        if (auto const sockaddr = tr_address::from_sockaddr(walk->ai_addr); sockaddr)
+        {
+            if (auto const& addr = sockaddr->address();
+                std::find(std::begin(addresses), std::end(addresses), addr) == std::end(addresses))
+            {
+                addresses.emplace_back(addr);
+            }
+        }
+    }
+
+    freeaddrinfo(info);
+
+    tr_logAddDebug(fmt::format("DNS lookup for '{}' found {} addresses", host, std::size(addresses)));
+    return addresses;
+}
+
+void tr_dns::on_lookup_done(std::string const& host, Addresses&& addresses, time_t now)
+{
+    auto const lock = std::lock_guard(mutex_);
+
+    if (auto const iter = entries_.find(host); iter != std::end(entries_))
+    {
+        auto& entry = iter->second;
+        entry.is_pending = false;
+        entry.expires_at = now + (std::empty(addresses) ? NegativeTtl : Ttl);
+        stats_.failures += std::empty(addresses) ? 1U : 0U;
+        entry.addresses = std::move(addresses);
+    }
+
+    --n_pending_;
+    cv_.notify_all();
+}
+
+void tr_dns::prune(time_t now)
+{
+    if (std::size(entries_) < MaxEntries)
+    {
+        return;
+    }
+
+    // drop the expired answers first...
+    for (auto iter = std::begin(entries_); iter != std::end(entries_);)
+    {
+        auto const& entry = iter->second;
+        iter = !entry.is_pending && entry.expires_at <= now ? entries_.erase(iter) : std::next(iter);
+    }
+
+    // ...then the answers that expire soonest
+    while (std::size(entries_) >= MaxEntries)
+    {
+        auto oldest = std::end(entries_);
+        for (auto iter = std::begin(entries_); iter != std::end(entries_); ++iter)
+        {
+            auto const& entry = iter->second;
+            if (!entry.is_pending && (oldest == std::end(entries_) || entry.expires_at < oldest->second.expires_at))
+            {
+                oldest = iter;
+            }
+        }
+
+        if (oldest == std::end(entries_))
+        {
+            break;
+        }
+
+        entries_.erase(oldest);
+    }
+}
@@ -0,0 +1,103 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <condition_variable>
+#include <cstddef> // size_t
+#include <ctime> // time_t
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "libtransmission/net.h" // tr_address
+
+class tr_executor;
+
+/**
+ * Looks up host names in a `tr_executor` and caches the answers, so that
+ * the UDP announcer, the web client, and DHT bootstrapping share a single
+ * lookup per host instead of each blocking a thread on its own.
+ *
+ * Lookups that fail are cached too, but for less time, so that a dead
+ * tracker's name isn't looked up again on every announce.
+ *
+ * `getaddrinfo()` doesn't say how long a record may be cached, so answers
+ * are kept for a fixed time. A stale answer is still returned while it's
+ * being refreshed in the background.
+ *
+ * Safe to use from any thread.
+ */
+class tr_dns
+{
+public:
+    using Addresses = std::vector<tr_address>;
+
+    static auto constexpr Ttl = time_t{ 3600 };
+    static auto constexpr NegativeTtl = time_t{ 300 };
+    static auto constexpr MaxEntries = size_t{ 2048U };
+
+    struct Stats
+    {
+        size_t hits = 0; // answered from the cache
+        size_t misses = 0; // had to wait for a lookup
+        size_t lookups = 0; // lookups started
+        size_t failures = 0; // lookups that found nothing
+    };
+
+    explicit tr_dns(tr_executor& executor);
+
+    // waits for lookups that are still running
+    ~tr_dns();
+
+    tr_dns(tr_dns const&) = delete;
+    tr_dns(tr_dns&&) = delete;
+    tr_dns& operator=(tr_dns const&) = delete;
+    tr_dns& operator=(tr_dns&&) = delete;
+
+    // Get the addresses that `host` resolves to. If the answer isn't
+    // cached or is stale, a lookup is started in the background.
+    // @return the addresses; an empty vector if `host` didn't resolve;
+    // or nullopt if the first lookup for `host` hasn't finished yet.
+    [[nodiscard]] std::optional<Addresses> get(std::string_view host, time_t now);
+
+    [[nodiscard]] Stats stats() const
+    {
+        auto const lock = std::lock_guard(mutex_);
+        return stats_;
+    }
+
+private:
+    struct Entry
+    {
+        std::optional<Addresses> addresses;
+        time_t expires_at = 0;
+        bool is_pending = false;
+    };
+
+    [[nodiscard]] static Addresses lookup(std::string const& host);
+
+    void on_lookup_done(std::string const& host, Addresses&& addresses, time_t now);
+    void prune(time_t now);
+
+    tr_executor& executor_;
+
+    mutable std::mutex mutex_;
+
+    // notified when a lookup finishes
+    std::condition_variable cv_;
+
+    std::map<std::string, Entry, std::less<>> entries_;
+    size_t n_pending_ = 0;
+    Stats stats_;
+};
@@ -0,0 +1,334 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <cstddef> // size_t
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include <fmt/core.h>
+
+#include "libtransmission/executor.h"
+#include "libtransmission/log.h"
+#include "libtransmission/tr-assert.h"
+
+namespace
+{
+// the executor and worker index of the calling thread, if it's a worker
+thread_local tr_executor const* tls_executor = nullptr;
+thread_local size_t tls_index = 0U;
+
+void pin_to_cpu([[maybe_unused]] std::thread& thread, int cpu)
+{
+    if (cpu < 0)
+    {
+        return;
+    }
+
+#ifdef _WIN32
+    if (cpu >= 64 || SetThreadAffinityMask(thread.native_handle(), DWORD_PTR{ 1U } << cpu) == 0)
+    {
+        tr_logAddWarn(fmt::format("Couldn't pin a worker thread to CPU {}", cpu));
+    }
+#elif defined(__linux__)
+    auto cpuset = cpu_set_t{};
+    CPU_ZERO(&cpuset);
+    CPU_SET(cpu, &cpuset);
+    if (cpu >= CPU_SETSIZE || pthread_setaffinity_np(thread.native_handle(), sizeof(cpuset), &cpuset) != 0)
+    {
+        tr_logAddWarn(fmt::format("Couldn't pin a worker thread to CPU {}", cpu));
+    }
+#else
+    tr_logAddDebug(fmt::format("Can't pin a worker thread to CPU {} on this platform", cpu));
+#endif
+}
+} // namespace
+
+void tr_executor::start(size_t n_threads, std::vector<int> cpus)
+{
+    {
+        auto const lock = std::lock_guard(mutex_);
+        if (started_ || stopping_)
+        {
+            return;
+        }
+
+        started_ = true;
+    }
+
+    if (n_threads == 0U)
+    {
+        n_threads = std::max(size_t{ std::thread::hardware_concurrency() }, size_t{ 1U });
+    }
+
+    // create all the workers before starting any threads so that
+    // `workers_` doesn't change while the threads are stealing
+    workers_.reserve(n_threads);
+    for (size_t i = 0; i < n_threads; ++i)
+    {
+        workers_.emplace_back(std::make_unique<Worker>());
+    }
+
+    n_workers_.store(n_threads, std::memory_order_release);
+
+    for (size_t i = 0; i < n_threads; ++i)
+    {
+        auto const cpu = std::empty(cpus) ? -1 : cpus[i % std::size(cpus)];
+        auto& thread = workers_[i]->thread;
+        thread = std::thread{ &tr_executor::worker_func, this, i };
+        pin_to_cpu(thread, cpu);
+    }
+}
+
+tr_executor::~tr_executor()
+{
+    {
+        auto const lock = std::lock_guard(mutex_);
+        stopping_ = true;
+    }
+
+    cv_.notify_all();
+
+    for (auto& worker : workers_)
+    {
+        if (worker->thread.joinable())
+        {
+            worker->thread.join();
+        }
+    }
+
+    // if the workers were never started, run what's left here
+    auto task = Task{};
+    for (size_t priority = 0; priority < NumPriorities; ++priority)
+    {
+        while (pop_shared(priority, task))
+        {
+            --n_queued_;
+            task();
+            --n_pending_;
+        }
+    }
+}
+
+void tr_executor::submit(Task&& task, Priority priority)
+{
+    TR_ASSERT(task);
+
+    auto const idx = static_cast<size_t>(priority);
+
+    ++n_pending_;
+    ++n_queued_;
+
+    if (tls_executor == this)
+    {
+        auto& worker = *workers_[tls_index];
+        auto const lock = std::lock_guard(worker.mutex);
+        worker.queues[idx].push_back(std::move(task));
+    }
+    else
+    {
+        auto const lock = std::lock_guard(shared_mutex_);
+        shared_[idx].push_back(std::move(task));
+    }
+
+    // lock before notifying so that a worker that's about to
+    // sleep can't miss the update to `n_queued_`
+    {
+        auto const lock = std::lock_guard(mutex_);
+    }
+
+    cv_.notify_one();
+}
+
+bool tr_executor::pop_own(Worker& worker, size_t priority, Task& setme)
+{
+    auto const lock = std::lock_guard(worker.mutex);
+    auto& queue = worker.queues[priority];
+    if (std::empty(queue))
+    {
+        return false;
+    }
+
+    // newest first: it's the most likely to still be in the cache
+    setme = std::move(queue.back());
+    queue.pop_back();
+    return true;
+}
+
+bool tr_executor::pop_shared(size_t priority, Task& setme)
+{
+    auto const lock = std::lock_guard(shared_mutex_);
+    auto& queue = shared_[priority];
+    if (std::empty(queue))
+    {
+        return false;
+    }
+
+    setme = std::move(queue.front());
+    queue.pop_front();
+    return true;
+}
+
+bool tr_executor::steal(size_t thief, size_t priority, Task& setme)
+{
+    auto const n_workers = thread_count();
+
+    for (size_t i = 1; i < n_workers; ++i)
+    {
+        auto& victim = *workers_[(thief + i) % n_workers];
+        auto const lock = std::lock_guard(victim.mutex);
+        auto& queue = victim.queues[priority];
+        if (!std::empty(queue))
+        {
+            // oldest first, so that the owner keeps the newest
+            setme = std::move(queue.front());
+            queue.pop_front();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool tr_executor::next_task(size_t index, Task& setme)
+{
+    auto& worker = *workers_[index];
+
+    for (size_t priority = 0; priority < NumPriorities; ++priority)
+    {
+        if (pop_own(worker, priority, setme) || pop_shared(priority, setme) || steal(index, priority, setme))
+        {
+            --n_queued_;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void tr_executor::worker_func(size_t index)
+{
+    tls_executor = this;
+    tls_index = index;
+
+    auto task = Task{};
+
+    for (;;)
+    {
+        if (next_task(index, task))
+        {
+            task();
+            task = {};
+            --n_pending_;
+            continue;
+        }
+
+        auto lock = std::unique_lock(mutex_);
+        cv_.wait(lock, [this]() { return stopping_ || n_queued_ > 0U; });
+
+        // finish the queued tasks before stopping
+        if (stopping_ && n_queued_ == 0U)
+        {
+            break;
+        }
+    }
+
+    tls_executor = nullptr;
+}
+
+// ---
+
+tr_executor_queue::~tr_executor_queue()
+{
+    cancel();
+    wait();
+}
+
+void tr_executor_queue::submit(Task&& task)
+{
+    TR_ASSERT(task);
+
+    auto const lock = std::lock_guard(mutex_);
+    if (cancelled())
+    {
+        return;
+    }
+
+    tasks_.push_back(std::move(task));
+
+    if (max_running_ == 0U || n_runners_ < max_running_)
+    {
+        ++n_runners_;
+        executor_.submit([this]() { run_tasks(); }, priority_);
+    }
+}
+
+void tr_executor_queue::run_tasks()
+{
+    for (auto ran_one = false;; ran_one = true)
+    {
+        auto task = Task{};
+
+        {
+            auto const lock = std::lock_guard(mutex_);
+            if (ran_one)
+            {
+                --n_running_tasks_;
+            }
+
+            if (std::empty(tasks_))
+            {
+                if (--n_runners_ == 0U)
+                {
+                    idle_cv_.notify_all();
+                }
+                return;
+            }
+
+            task = std::move(tasks_.front());
+            tasks_.pop_front();
+            ++n_running_tasks_;
+        }
+
+        // the task is destroyed before the lock is taken again
+        task();
+    }
+}
+
+void tr_executor_queue::cancel()
+{
+    auto dropped = std::deque<Task>{};
+
+    {
+        auto const lock = std::lock_guard(mutex_);
+        cancelled_.store(true, std::memory_order_release);
+        dropped.swap(tasks_);
+    }
+
+    // destroy the dropped tasks outside of the lock
+    dropped.clear();
+}
+
+void tr_executor_queue::wait()
+{
+    auto lock = std::unique_lock(mutex_);
+    idle_cv_.wait(lock, [this]() { return n_runners_ == 0U; });
+}
+
+size_t tr_executor_queue::size() const
+{
+    auto const lock = std::lock_guard(mutex_);
+    return std::size(tasks_) + n_running_tasks_;
+}
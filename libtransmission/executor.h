@@ -0,0 +1,211 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef> // size_t
+#include <cstdint> // uint8_t
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * A pool of worker threads that libtransmission's background work shares,
+ * e.g. verifying local data, hashing pieces, and DNS lookups, so that
+ * the total number of threads is bounded in one place.
+ *
+ * Each worker has its own queue. Tasks submitted from a worker go to the
+ * end of its queue, where it picks them up again next; tasks submitted
+ * from other threads go to a shared queue. Idle workers steal from the
+ * front of the other workers' queues. Higher-priority tasks are always
+ * picked before lower-priority ones.
+ *
+ * Tasks that are still queued when the executor is destroyed are run
+ * before the destructor returns.
+ */
+class tr_executor
+{
+public:
+    enum class Priority : uint8_t
+    {
+        // something is waiting on the result, e.g. a DNS lookup
+        High,
+
+        // e.g. checking a piece that was just downloaded
+        Normal,
+
+        // long-running bulk work, e.g. verifying local data
+        Low
+    };
+
+    using Task = std::function<void()>;
+
+    // Tasks that are submitted before `start()` wait until it's called.
+    tr_executor() = default;
+
+    explicit tr_executor(size_t n_threads, std::vector<int> cpus = {})
+    {
+        start(n_threads, std::move(cpus));
+    }
+
+    ~tr_executor();
+
+    tr_executor(tr_executor const&) = delete;
+    tr_executor(tr_executor&&) = delete;
+    tr_executor& operator=(tr_executor const&) = delete;
+    tr_executor& operator=(tr_executor&&) = delete;
+
+    // Start the worker threads. Does nothing if they're already started.
+    // If `n_threads` is 0, one thread per CPU is started.
+    // If `cpus` isn't empty, workers are pinned to those CPUs in turn.
+    void start(size_t n_threads, std::vector<int> cpus = {});
+
+    [[nodiscard]] size_t thread_count() const noexcept
+    {
+        return n_workers_.load(std::memory_order_acquire);
+    }
+
+    // @return the number of tasks that are queued or running
+    [[nodiscard]] size_t size() const noexcept
+    {
+        return n_pending_.load(std::memory_order_acquire);
+    }
+
+    void submit(Task&& task, Priority priority = Priority::Normal);
+
+    // Run `func` in the executor.
+    // @return a future for `func`'s result
+    template<typename Func>
+    [[nodiscard]] auto async(Func&& func, Priority priority = Priority::Normal)
+    {
+        using Result = std::invoke_result_t<std::decay_t<Func>>;
+
+        // std::function needs a copyable callable, so share the task
+        auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<Func>(func));
+        auto future = task->get_future();
+        submit([task]() { (*task)(); }, priority);
+        return future;
+    }
+
+private:
+    static auto constexpr NumPriorities = size_t{ 3U };
+
+    using Queues = std::array<std::deque<Task>, NumPriorities>;
+
+    struct Worker
+    {
+        std::mutex mutex;
+        Queues queues;
+        std::thread thread;
+    };
+
+    [[nodiscard]] bool pop_own(Worker& worker, size_t priority, Task& setme);
+    [[nodiscard]] bool pop_shared(size_t priority, Task& setme);
+    [[nodiscard]] bool steal(size_t thief, size_t priority, Task& setme);
+    [[nodiscard]] bool next_task(size_t index, Task& setme);
+
+    void worker_func(size_t index);
+
+    // `workers_` is filled in by `start()` before `n_workers_` is
+    // published, and doesn't change again until the destructor.
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::atomic<size_t> n_workers_ = {};
+
+    // tasks that were submitted from outside the worker threads
+    std::mutex shared_mutex_;
+    Queues shared_;
+
+    // guards `stopping_` and sleeping on `cv_`
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stopping_ = false;
+    bool started_ = false;
+
+    // the number of tasks that are queued or running
+    std::atomic<size_t> n_pending_ = {};
+
+    // the number of tasks that are queued but not yet picked up
+    std::atomic<size_t> n_queued_ = {};
+};
+
+/**
+ * Runs one owner's tasks on a tr_executor, at most `max_running` of them
+ * at a time, so that the owner's share of the executor is bounded and it
+ * can drop or wait for its tasks when it shuts down.
+ *
+ * Tasks start in the order they were submitted. Don't call `wait()` from
+ * one of the queue's own tasks.
+ */
+class tr_executor_queue
+{
+public:
+    using Task = tr_executor::Task;
+
+    // If `max_running` is 0, only the executor's thread count limits it.
+    tr_executor_queue(
+        tr_executor& executor,
+        size_t max_running,
+        tr_executor::Priority priority = tr_executor::Priority::Normal) noexcept
+        : executor_{ executor }
+        , max_running_{ max_running }
+        , priority_{ priority }
+    {
+    }
+
+    // cancel() and wait()
+    ~tr_executor_queue();
+
+    tr_executor_queue(tr_executor_queue const&) = delete;
+    tr_executor_queue(tr_executor_queue&&) = delete;
+    tr_executor_queue& operator=(tr_executor_queue const&) = delete;
+    tr_executor_queue& operator=(tr_executor_queue&&) = delete;
+
+    void submit(Task&& task);
+
+    // Drop the tasks that haven't started yet and any that are submitted
+    // later. Tasks that are running can check `cancelled()` to stop early.
+    void cancel();
+
+    [[nodiscard]] bool cancelled() const noexcept
+    {
+        return cancelled_.load(std::memory_order_acquire);
+    }
+
+    // Wait until none of the queue's tasks are queued or running
+    void wait();
+
+    // @return the number of tasks that are queued or running
+    [[nodiscard]] size_t size() const;
+
+private:
+    void run_tasks();
+
+    tr_executor& executor_;
+    size_t const max_running_;
+    tr_executor::Priority const priority_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable idle_cv_;
+    std::deque<Task> tasks_;
+
+    // the number of executor tasks that are running `run_tasks()`
+    size_t n_runners_ = 0U;
+    size_t n_running_tasks_ = 0U;
+
+    std::atomic<bool> cancelled_ = false;
+};
@@ -0,0 +1,203 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <utility>
+
+#include "libtransmission/error.h"
+#include "libtransmission/file-mover.h"
+#include "libtransmission/file.h"
+#include "libtransmission/tr-strbuf.h"
+
+using namespace std::literals;
+
+namespace
+{
+// Files are copied under a temporary name and renamed when they're done,
+// so a file with the target's name is always a complete copy.
+auto constexpr PartialSuffix = ".moving"sv;
+} // namespace
+
+tr_file_mover::tr_file_mover(Mediator& mediator, size_t max_threads)
+    : mediator_{ mediator }
+    , max_threads_{ std::max(max_threads, size_t{ 1U }) }
+{
+}
+
+tr_file_mover::~tr_file_mover()
+{
+    {
+        auto const lock = std::lock_guard(mutex_);
+        stopping_ = true;
+    }
+
+    cv_.notify_all();
+
+    for (auto& thread : threads_)
+    {
+        thread.join();
+    }
+
+    for (auto& job : jobs_)
+    {
+        tr_error_clear(&job.error);
+    }
+}
+
+void tr_file_mover::add(tr_torrent_id_t id, std::vector<File>&& files, DoneFunc&& on_done)
+{
+    {
+        auto const lock = std::lock_guard(mutex_);
+
+        auto& job = jobs_.emplace_back();
+        job.id = id;
+        job.files = std::move(files);
+        job.on_done = std::move(on_done);
+        for (auto const& file : job.files)
+        {
+            job.bytes_total += file.size;
+        }
+
+        // start threads lazily, up to one per file that's waiting to be copied
+        auto n_waiting = size_t{};
+        for (auto const& walk : jobs_)
+        {
+            n_waiting += walk.has_unclaimed_files() ? std::size(walk.files) - walk.next_file : 0U;
+        }
+
+        while (std::size(threads_) < max_threads_ && std::size(threads_) < n_waiting)
+        {
+            threads_.emplace_back(&tr_file_mover::thread_func, this);
+        }
+
+        finish_if_done(std::prev(std::end(jobs_)));
+    }
+
+    cv_.notify_all();
+}
+
+void tr_file_mover::remove(tr_torrent_id_t id)
+{
+    auto const lock = std::lock_guard(mutex_);
+
+    for (auto it = std::begin(jobs_); it != std::end(jobs_);)
+    {
+        auto const next = std::next(it);
+        if (it->id == id)
+        {
+            it->stop = true;
+            finish_if_done(it);
+        }
+        it = next;
+    }
+}
+
+std::optional<double> tr_file_mover::progress(tr_torrent_id_t id) const
+{
+    auto const lock = std::lock_guard(mutex_);
+
+    for (auto const& job : jobs_)
+    {
+        if (job.id == id && !job.stop)
+        {
+            return job.bytes_total == 0U ? 1.0 : static_cast<double>(job.bytes_done) / job.bytes_total;
+        }
+    }
+
+    return {};
+}
+
+// Call with `mutex_` locked. Forgets the job if all of its files are copied,
+// or if it was stopped or failed and none of its copies are still in flight.
+void tr_file_mover::finish_if_done(std::list<Job>::iterator job)
+{
+    if (job->n_in_flight != 0U || job->has_unclaimed_files())
+    {
+        return;
+    }
+
+    if (!job->stop)
+    {
+        mediator_.post(
+            [on_done = std::move(job->on_done), error = job->error]() mutable
+            {
+                on_done(error);
+                tr_error_clear(&error);
+            });
+        job->error = nullptr;
+    }
+
+    tr_error_clear(&job->error);
+    jobs_.erase(job);
+}
+
+void tr_file_mover::thread_func()
+{
+    auto lock = std::unique_lock(mutex_);
+
+    for (;;)
+    {
+        auto job = std::end(jobs_);
+        cv_.wait(
+            lock,
+            [this, &job]()
+            {
+                job = std::find_if(
+                    std::begin(jobs_),
+                    std::end(jobs_),
+                    [](auto const& walk) { return walk.has_unclaimed_files(); });
+                return stopping_ || job != std::end(jobs_);
+            });
+
+        if (stopping_)
+        {
+            return;
+        }
+
+        auto const file = job->files[job->next_file++];
+        ++job->n_in_flight;
+        lock.unlock();
+
+        tr_error* error = nullptr;
+        auto const ok = copy_file(file, &error);
+
+        lock.lock();
+        --job->n_in_flight;
+        job->bytes_done += file.size;
+        if (!ok && job->error == nullptr)
+        {
+            job->error = error;
+            error = nullptr;
+        }
+        tr_error_clear(&error);
+
+        finish_if_done(job);
+    }
+}
+
+bool tr_file_mover::copy_file(File const& file, tr_error** error)
+{
+    auto const tgt = tr_pathbuf{ file.tgt };
+
+    // a complete copy from an earlier move
+    if (auto const info = tr_sys_path_get_info(tgt); info && info->isFile() && info->size == file.size)
+    {
+        return true;
+    }
+
+    auto const partial = tr_pathbuf{ file.tgt, PartialSuffix };
+    auto const ok = tr_sys_dir_create(tr_pathbuf{ tr_sys_path_dirname(file.tgt) }, TR_SYS_DIR_CREATE_PARENTS, 0777, error) &&
+        tr_sys_path_copy(tr_pathbuf{ file.src }, partial, error) && tr_sys_path_rename(partial, tgt, error);
+
+    if (!ok)
+    {
+        tr_sys_path_remove(partial);
+    }
+
+    return ok;
+}
@@ -0,0 +1,110 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <condition_variable>
+#include <cstddef> // size_t
+#include <cstdint> // uint64_t
+#include <functional>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "libtransmission/transmission.h" // tr_torrent_id_t
+
+struct tr_error;
+
+// Copies torrents' files to another filesystem on background threads, so
+// that relocating a large torrent doesn't stall the session thread. The
+// old files are left alone, so the torrent can keep seeding from them
+// until the caller switches over to the copies.
+class tr_file_mover
+{
+public:
+    struct File
+    {
+        std::string src;
+        std::string tgt;
+        uint64_t size = 0;
+    };
+
+    // Invoked after `Mediator::post()` has delivered it back to the
+    // caller's thread. `error` is nullptr if every file was copied.
+    using DoneFunc = std::function<void(tr_error const* error)>;
+
+    class Mediator
+    {
+    public:
+        virtual ~Mediator() = default;
+
+        // Run `func` in the thread that's waiting for the copies,
+        // e.g. `tr_session::runInSessionThread()`.
+        virtual void post(std::function<void(void)>&& func) = 0;
+    };
+
+    static auto constexpr DefaultMaxThreads = size_t{ 4U };
+
+    explicit tr_file_mover(Mediator& mediator, size_t max_threads = DefaultMaxThreads);
+    ~tr_file_mover();
+
+    tr_file_mover(tr_file_mover const&) = delete;
+    tr_file_mover(tr_file_mover&&) = delete;
+    tr_file_mover& operator=(tr_file_mover const&) = delete;
+    tr_file_mover& operator=(tr_file_mover&&) = delete;
+
+    // Copy a torrent's files. Targets that already hold a complete copy,
+    // e.g. from an earlier move that was interrupted, aren't copied again.
+    void add(tr_torrent_id_t id, std::vector<File>&& files, DoneFunc&& on_done);
+
+    // Stop copying a torrent's files. Its `on_done` won't be called.
+    // Files that were already copied are kept so that a later move
+    // to the same place can pick up where this one stopped.
+    void remove(tr_torrent_id_t id);
+
+    // @return how much of the torrent's data has been copied, in [0..1],
+    // or nullopt if its files aren't being copied
+    [[nodiscard]] std::optional<double> progress(tr_torrent_id_t id) const;
+
+private:
+    struct Job
+    {
+        tr_torrent_id_t id = {};
+        std::vector<File> files;
+        DoneFunc on_done;
+        uint64_t bytes_total = 0;
+        uint64_t bytes_done = 0;
+        size_t next_file = 0;
+        size_t n_in_flight = 0;
+        tr_error* error = nullptr;
+        bool stop = false;
+
+        [[nodiscard]] constexpr bool has_unclaimed_files() const noexcept
+        {
+            return !stop && error == nullptr && next_file < std::size(files);
+        }
+    };
+
+    void thread_func();
+    void finish_if_done(std::list<Job>::iterator job);
+
+    [[nodiscard]] static bool copy_file(File const& file, tr_error** error);
+
+    Mediator& mediator_;
+    size_t const max_threads_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::list<Job> jobs_;
+    std::vector<std::thread> threads_;
+    bool stopping_ = false;
+};
@@ -3,6 +3,10 @@
 // or any future license endorsed by Mnemosyne LLC.
 // License text can be found in the licenses/ folder.
 
+#include <algorithm> // std::lower_bound(), std::min(), std::sort()
+#include <cstddef> // size_t
+#include <cstdint> // uint64_t
+#include <iterator> // std::prev()
 #include <vector>
 
 #include <small/set.hpp>
@@ -15,6 +19,49 @@
 #include "libtransmission/torrent-metainfo.h"
 #include "libtransmission/tr-assert.h"
 
+namespace
+{
+// @return the pieces that `files` touch, as sorted spans that don't overlap
+[[nodiscard]] std::vector<tr_file_piece_map::piece_span_t> get_piece_spans(
+    tr_file_piece_map const& fpm,
+    tr_file_index_t const* files,
+    size_t n)
+{
+    auto const n_pieces = fpm.piece_count();
+
+    auto spans = std::vector<tr_file_piece_map::piece_span_t>{};
+    spans.reserve(n);
+    for (size_t i = 0; i < n; ++i)
+    {
+        // a zero-byte file at the very end begins after the last piece
+        auto span = fpm.piece_span(files[i]);
+        span.end = std::min(span.end, n_pieces);
+        if (span.begin < span.end)
+        {
+            spans.push_back(span);
+        }
+    }
+
+    std::sort(std::begin(spans), std::end(spans), [](auto const& a, auto const& b) { return a.begin < b.begin; });
+
+    auto merged = std::begin(spans);
+    for (auto it = std::begin(spans); it != std::end(spans); ++it)
+    {
+        if (it != std::begin(spans) && it->begin <= std::prev(merged)->end)
+        {
+            std::prev(merged)->end = std::max(std::prev(merged)->end, it->end);
+        }
+        else
+        {
+            *merged++ = *it;
+        }
+    }
+    spans.erase(merged, std::end(spans));
+
+    return spans;
+}
+} // namespace
+
 void tr_file_piece_map::reset(tr_block_info const& block_info, uint64_t const* file_sizes, size_t n_files)
 {
     file_bytes_.resize(n_files);
@@ -58,6 +105,20 @@ void tr_file_piece_map::reset(tr_block_info const& block_info, uint64_t const* f
     }
 
     edge_pieces_.assign(std::begin(edge_pieces), std::end(edge_pieces));
+
+    piece_size_ = block_info.piece_size();
+    auto const n_pieces = block_info.piece_count();
+    piece_files_.resize(n_pieces + 1U);
+    piece_files_.shrink_to_fit();
+    for (tr_piece_index_t piece = 0, file = 0; piece <= n_pieces; ++piece)
+    {
+        auto const piece_begin = uint64_t{ piece } * piece_size_;
+        while (file < n_files && file_bytes_[file].end <= piece_begin)
+        {
+            ++file;
+        }
+        piece_files_[piece] = file;
+    }
 }
 
 void tr_file_piece_map::reset(tr_torrent_metainfo const& tm)
@@ -83,7 +144,29 @@ tr_file_piece_map::file_offset_t tr_file_piece_map::file_offset(uint64_t offset)
 {
     constexpr auto Compare = CompareToSpan<uint64_t>{};
     auto const begin = std::begin(file_bytes_);
-    auto const it = std::lower_bound(begin, std::end(file_bytes_), offset, Compare);
+    auto it = std::end(file_bytes_);
+
+    // the file that holds `offset` is one of the files that touch its piece
+    auto const piece = piece_size_ == 0U ? size_t{} : static_cast<size_t>(offset / piece_size_);
+    if (piece + 1U < std::size(piece_files_))
+    {
+        auto const first = begin + piece_files_[piece];
+
+        // Fast path: it's the piece's first file. This is the
+        // usual case unless the piece holds many small files.
+        if (first->end > offset)
+        {
+            return file_offset_t{ piece_files_[piece], offset - first->begin };
+        }
+
+        auto const last = begin + std::min(size_t{ piece_files_[piece + 1U] } + 1U, std::size(file_bytes_));
+        it = std::lower_bound(first, last, offset, Compare);
+    }
+    else
+    {
+        it = std::lower_bound(begin, std::end(file_bytes_), offset, Compare);
+    }
+
     tr_file_index_t const file_index = std::distance(begin, it);
     auto const file_offset = offset - it->begin;
     return file_offset_t{ file_index, file_offset };
@@ -95,10 +178,21 @@ void tr_file_priorities::reset(tr_file_piece_map const* fpm)
 {
     fpm_ = fpm;
     priorities_ = {};
+    piece_priorities_ = {};
 }
 
 void tr_file_priorities::set(tr_file_index_t file, tr_priority_t new_priority)
 {
+    set(&file, 1U, new_priority);
+}
+
+void tr_file_priorities::set(tr_file_index_t const* files, size_t n, tr_priority_t new_priority)
+{
+    if (n == 0U)
+    {
+        return;
+    }
+
     if (std::empty(priorities_))
     {
         if (new_priority == TR_PRI_NORMAL)
@@ -108,16 +202,27 @@ void tr_file_priorities::set(tr_file_index_t file, tr_priority_t new_priority)
 
         priorities_.assign(std::size(*fpm_), TR_PRI_NORMAL);
         priorities_.shrink_to_fit();
-    }
 
-    priorities_[file] = new_priority;
-}
+        auto const n_pieces = fpm_->piece_count();
+        piece_priorities_.resize(n_pieces);
+        piece_priorities_.shrink_to_fit();
+        for (tr_piece_index_t piece = 0; piece < n_pieces; ++piece)
+        {
+            piece_priorities_[piece] = fpm_->is_edge_piece(piece) ? TR_PRI_HIGH : TR_PRI_NORMAL;
+        }
+    }
 
-void tr_file_priorities::set(tr_file_index_t const* files, size_t n, tr_priority_t new_priority)
-{
     for (size_t i = 0; i < n; ++i)
     {
-        set(files[i], new_priority);
+        priorities_[files[i]] = new_priority;
+    }
+
+    for (auto const [begin, end] : get_piece_spans(*fpm_, files, n))
+    {
+        for (auto piece = begin; piece < end; ++piece)
+        {
+            piece_priorities_[piece] = compute_piece_priority(piece);
+        }
     }
 }
 
@@ -133,7 +238,7 @@ tr_priority_t tr_file_priorities::file_priority(tr_file_index_t file) const
     return priorities_[file];
 }
 
-tr_priority_t tr_file_priorities::piece_priority(tr_piece_index_t piece) const
+tr_priority_t tr_file_priorities::compute_piece_priority(tr_piece_index_t piece) const
 {
     // increase priority if a file begins or ends in this piece
     // because that makes life easier for code/users using at incomplete files.
@@ -164,28 +269,99 @@ void tr_files_wanted::reset(tr_file_piece_map const* fpm)
     fpm_ = fpm;
     wanted_ = tr_bitfield{ std::size(*fpm) };
     wanted_.set_has_all(); // by default we want all files
+    pieces_wanted_ = tr_bitfield{ fpm->piece_count() };
+    pieces_wanted_.set_has_all();
 }
 
 void tr_files_wanted::set(tr_file_index_t file, bool wanted)
 {
     wanted_.set(file, wanted);
+    update_pieces_wanted(&file, 1U, nullptr);
 }
 
-void tr_files_wanted::set(tr_file_index_t const* files, size_t n, bool wanted)
+void tr_files_wanted::set(
+    tr_file_index_t const* files,
+    size_t n,
+    bool wanted,
+    std::vector<tr_piece_index_t>* changed_pieces)
 {
-    for (size_t i = 0; i < n; ++i)
+    // Setting a span of bits is much cheaper than setting them one at a
+    // time, and the files that a client changes together are usually
+    // neighbors, e.g. a folder. So sort them and set each run as a span.
+    auto sorted = std::vector<tr_file_index_t>(files, files + n);
+    std::sort(std::begin(sorted), std::end(sorted));
+
+    for (size_t i = 0; i < n;)
+    {
+        auto const begin = sorted[i];
+        auto end = begin + 1U;
+        for (++i; i < n && sorted[i] <= end; ++i)
+        {
+            end = sorted[i] + 1U;
+        }
+
+        if (end - begin == 1U)
+        {
+            wanted_.set(begin, wanted);
+        }
+        else
+        {
+            wanted_.set_span(begin, end, wanted);
+        }
+    }
+
+    update_pieces_wanted(std::data(sorted), std::size(sorted), changed_pieces);
+}
+
+void tr_files_wanted::set_piece_wanted(tr_piece_index_t piece, bool wanted, std::vector<tr_piece_index_t>* changed_pieces)
+{
+    if (changed_pieces != nullptr && pieces_wanted_.test(piece) != wanted)
     {
-        set(files[i], wanted);
+        changed_pieces->push_back(piece);
     }
+
+    pieces_wanted_.set(piece, wanted);
 }
 
-bool tr_files_wanted::piece_wanted(tr_piece_index_t piece) const
+void tr_files_wanted::update_pieces_wanted(
+    tr_file_index_t const* files,
+    size_t n,
+    std::vector<tr_piece_index_t>* changed_pieces)
 {
-    if (wanted_.has_all())
+    if (wanted_.has_all() || wanted_.has_none())
     {
-        return true;
+        auto const wanted = wanted_.has_all();
+
+        if (changed_pieces != nullptr)
+        {
+            for (tr_piece_index_t piece = 0, n_pieces = std::size(pieces_wanted_); piece < n_pieces; ++piece)
+            {
+                if (pieces_wanted_.test(piece) != wanted)
+                {
+                    changed_pieces->push_back(piece);
+                }
+            }
+        }
+
+        if (wanted)
+        {
+            pieces_wanted_.set_has_all();
+        }
+        else
+        {
+            pieces_wanted_.set_has_none();
+        }
+
+        return;
     }
 
-    auto const [begin, end] = fpm_->file_span(piece);
-    return wanted_.count(begin, end) != 0;
+    // a piece is wanted if any of its files are
+    for (auto const [begin, end] : get_piece_spans(*fpm_, files, n))
+    {
+        for (auto piece = begin; piece < end; ++piece)
+        {
+            auto const [begin_file, end_file] = fpm_->file_span(piece);
+            set_piece_wanted(piece, wanted_.count(begin_file, end_file) != 0U, changed_pieces);
+        }
+    }
 }
@@ -69,6 +69,11 @@ public:
         return std::size(file_pieces_);
     }
 
+    [[nodiscard]] TR_CONSTEXPR20 tr_piece_index_t piece_count() const noexcept
+    {
+        return std::empty(piece_files_) ? 0U : static_cast<tr_piece_index_t>(std::size(piece_files_) - 1U);
+    }
+
     [[nodiscard]] TR_CONSTEXPR20 bool empty() const noexcept
     {
         return std::empty(file_pieces_);
@@ -96,6 +101,13 @@ private:
 
     std::vector<tr_piece_index_t> edge_pieces_;
 
+    // piece_files_[piece] is the first file that has bytes at or after
+    // the piece's first byte, so file_offset() only has to search the
+    // files that touch that piece. Has one extra entry for the end.
+    std::vector<tr_file_index_t> piece_files_;
+
+    uint64_t piece_size_ = {};
+
     template<typename T>
     struct CompareToSpan
     {
@@ -146,11 +158,28 @@ public:
     void set(tr_file_index_t const* files, size_t n, tr_priority_t priority);
 
     [[nodiscard]] tr_priority_t file_priority(tr_file_index_t file) const;
-    [[nodiscard]] tr_priority_t piece_priority(tr_piece_index_t piece) const;
+
+    // This is called for every piece each time the wishlist is rebuilt,
+    // so it's a lookup in an array that's updated when files change.
+    [[nodiscard]] TR_CONSTEXPR20 tr_priority_t piece_priority(tr_piece_index_t piece) const
+    {
+        if (std::empty(piece_priorities_))
+        {
+            return fpm_->is_edge_piece(piece) ? TR_PRI_HIGH : TR_PRI_NORMAL;
+        }
+
+        return piece_priorities_[piece];
+    }
 
 private:
+    [[nodiscard]] tr_priority_t compute_piece_priority(tr_piece_index_t piece) const;
+
     tr_file_piece_map const* fpm_;
+
+    // Both are empty until a file gets a priority other than normal,
+    // which most torrents never do.
     std::vector<tr_priority_t> priorities_;
+    std::vector<tr_priority_t> piece_priorities_;
 };
 
 class tr_files_wanted
@@ -164,16 +193,33 @@ public:
     void reset(tr_file_piece_map const* fpm);
 
     void set(tr_file_index_t file, bool wanted);
-    void set(tr_file_index_t const* files, size_t n, bool wanted);
+
+    // If `changed_pieces` isn't null, the pieces whose wanted state
+    // changed are appended to it.
+    void set(
+        tr_file_index_t const* files,
+        size_t n,
+        bool wanted,
+        std::vector<tr_piece_index_t>* changed_pieces = nullptr);
 
     [[nodiscard]] TR_CONSTEXPR20 bool file_wanted(tr_file_index_t file) const
     {
         return wanted_.test(file);
     }
 
-    [[nodiscard]] bool piece_wanted(tr_piece_index_t piece) const;
+    // This is called for every piece each time the wishlist is rebuilt,
+    // so it's a lookup in a bitfield that's updated when files change.
+    [[nodiscard]] TR_CONSTEXPR20 bool piece_wanted(tr_piece_index_t piece) const
+    {
+        return pieces_wanted_.test(piece);
+    }
 
 private:
+    void update_pieces_wanted(tr_file_index_t const* files, size_t n, std::vector<tr_piece_index_t>* changed_pieces);
+
+    void set_piece_wanted(tr_piece_index_t piece, bool wanted, std::vector<tr_piece_index_t>* changed_pieces);
+
     tr_file_piece_map const* fpm_;
     tr_bitfield wanted_;
+    tr_bitfield pieces_wanted_{ 0U };
 };
@@ -19,7 +19,9 @@
 
 #include <dirent.h>
 #include <fcntl.h> /* O_LARGEFILE, posix_fadvise(), [posix_]fallocate(), fcntl() */
+#include <sys/mman.h> /* mmap(), munmap() */
 #include <sys/stat.h>
+#include <sys/uio.h> /* preadv(), pwritev() */
 #include <unistd.h> /* lseek(), write(), ftruncate(), pread(), pwrite(), pathconf(), etc */
 
 #ifdef HAVE_XFS_XFS_H
@@ -29,7 +31,9 @@
 
 /* OS-specific file copy (copy_file_range, sendfile64, or copyfile). */
 #if defined(__linux__)
+#include <linux/fs.h> /* FICLONE */
 #include <linux/version.h>
+#include <sys/ioctl.h>
 /* Linux's copy_file_range(2) is buggy prior to 5.3. */
 #if defined(HAVE_COPY_FILE_RANGE) && LINUX_VERSION_CODE >= KERNEL_VERSION(5, 3, 0)
 #define USE_COPY_FILE_RANGE
@@ -71,6 +75,9 @@
 #ifndef O_CLOEXEC
 #define O_CLOEXEC 0
 #endif
+#ifndef O_DIRECT
+#define O_DIRECT 0
+#endif
 
 #ifndef PATH_MAX
 #define PATH_MAX 4096
@@ -134,6 +141,125 @@ void set_file_for_single_pass(tr_sys_file_t handle)
 
     errno = err;
 }
+
+#if defined(HAVE_PREADV) || defined(HAVE_PWRITEV)
+
+// the most buffers we pass to a single preadv() / pwritev() call
+#ifdef IOV_MAX
+auto constexpr MaxIoVecs = size_t{ IOV_MAX < 64 ? IOV_MAX : 64 };
+#else
+auto constexpr MaxIoVecs = size_t{ 16 };
+#endif
+
+// @return the number of buffers copied, which may be fewer than `n_vecs`
+size_t to_native_iovecs(tr_sys_file_iovec const* vecs, size_t n_vecs, std::array<struct iovec, MaxIoVecs>& setme)
+{
+    n_vecs = std::min(n_vecs, std::size(setme));
+
+    for (size_t i = 0; i < n_vecs; ++i)
+    {
+        setme[i].iov_base = vecs[i].base;
+        setme[i].iov_len = vecs[i].len;
+    }
+
+    return n_vecs;
+}
+
+#endif
+
+#ifndef HAVE_PREADV
+
+bool read_at_v_fallback(
+    tr_sys_file_t handle,
+    tr_sys_file_iovec const* vecs,
+    size_t n_vecs,
+    uint64_t offset,
+    uint64_t* bytes_read,
+    tr_error** error)
+{
+    auto total = uint64_t{};
+
+    for (size_t i = 0; i < n_vecs; ++i)
+    {
+        auto n_read = uint64_t{};
+        tr_error* my_error = nullptr;
+        if (!tr_sys_file_read_at(handle, vecs[i].base, vecs[i].len, offset + total, &n_read, &my_error))
+        {
+            // report a short read if we got anything at all
+            if (total == 0U)
+            {
+                tr_error_propagate(error, &my_error);
+                return false;
+            }
+
+            tr_error_clear(&my_error);
+            break;
+        }
+
+        total += n_read;
+
+        if (n_read < vecs[i].len)
+        {
+            break;
+        }
+    }
+
+    if (bytes_read != nullptr)
+    {
+        *bytes_read = total;
+    }
+
+    return total > 0U;
+}
+
+#endif
+
+#ifndef HAVE_PWRITEV
+
+bool write_at_v_fallback(
+    tr_sys_file_t handle,
+    tr_sys_file_iovec const* vecs,
+    size_t n_vecs,
+    uint64_t offset,
+    uint64_t* bytes_written,
+    tr_error** error)
+{
+    auto total = uint64_t{};
+
+    for (size_t i = 0; i < n_vecs; ++i)
+    {
+        auto n_written = uint64_t{};
+        tr_error* my_error = nullptr;
+        if (!tr_sys_file_write_at(handle, vecs[i].base, vecs[i].len, offset + total, &n_written, &my_error))
+        {
+            // report a short write if we wrote anything at all
+            if (total == 0U)
+            {
+                tr_error_propagate(error, &my_error);
+                return false;
+            }
+
+            tr_error_clear(&my_error);
+            break;
+        }
+
+        total += n_written;
+
+        if (n_written < vecs[i].len)
+        {
+            break;
+        }
+    }
+
+    if (bytes_written != nullptr)
+    {
+        *bytes_written = total;
+    }
+
+    return true;
+}
+
+#endif
 } // namespace
 
 bool tr_sys_path_exists(char const* path, tr_error** error)
@@ -219,6 +345,27 @@ bool tr_sys_path_is_same(char const* path1, char const* path2, tr_error** error)
     return ret;
 }
 
+bool tr_sys_path_is_same_filesystem(char const* path1, char const* path2, tr_error** error)
+{
+    TR_ASSERT(path1 != nullptr);
+    TR_ASSERT(path2 != nullptr);
+
+    bool ret = false;
+    struct stat sb1 = {};
+    struct stat sb2 = {};
+
+    if (stat(path1, &sb1) != -1 && stat(path2, &sb2) != -1)
+    {
+        ret = sb1.st_dev == sb2.st_dev;
+    }
+    else
+    {
+        tr_error_set_from_errno(error, errno);
+    }
+
+    return ret;
+}
+
 std::string tr_sys_path_resolve(std::string_view path, tr_error** error)
 {
     auto const szpath = tr_pathbuf{ path };
@@ -371,6 +518,18 @@ bool tr_sys_path_copy(char const* src_path, char const* dst_path, tr_error** err
     uint64_t file_size = info->size;
     int errno_cpy = 0; /* keep errno intact across copy attempts */
 
+#if defined(FICLONE)
+
+    /* Share the data instead of copying it if the filesystem supports */
+    /* reflinks, e.g. btrfs or XFS. Fails with EXDEV between filesystems */
+    /* and with EOPNOTSUPP or EINVAL elsewhere, so fall through quietly. */
+    if (file_size > 0U && ioctl(out, FICLONE, in) == 0)
+    {
+        file_size = 0U;
+    }
+
+#endif /* FICLONE */
+
 #if defined(USE_COPY_FILE_RANGE)
 
     /* Kernel copy by copy_file_range */
@@ -518,6 +677,21 @@ bool tr_sys_path_copy(char const* src_path, char const* dst_path, tr_error** err
 #endif /* USE_COPYFILE */
 }
 
+bool tr_sys_path_link(char const* src_path, char const* dst_path, tr_error** error)
+{
+    TR_ASSERT(src_path != nullptr);
+    TR_ASSERT(dst_path != nullptr);
+
+    bool const ret = link(src_path, dst_path) != -1;
+
+    if (!ret)
+    {
+        tr_error_set_from_errno(error, errno);
+    }
+
+    return ret;
+}
+
 bool tr_sys_path_remove(char const* path, tr_error** error)
 {
     TR_ASSERT(path != nullptr);
@@ -575,14 +749,15 @@ tr_sys_file_t tr_sys_file_open(char const* path, int flags, int permissions, tr_
         int native_value;
     };
 
-    auto constexpr NativeMap = std::array<native_map_item, 8>{
+    auto constexpr NativeMap = std::array<native_map_item, 9>{
         { { TR_SYS_FILE_READ | TR_SYS_FILE_WRITE, TR_SYS_FILE_READ | TR_SYS_FILE_WRITE, O_RDWR },
           { TR_SYS_FILE_READ | TR_SYS_FILE_WRITE, TR_SYS_FILE_READ, O_RDONLY },
           { TR_SYS_FILE_READ | TR_SYS_FILE_WRITE, TR_SYS_FILE_WRITE, O_WRONLY },
           { TR_SYS_FILE_CREATE, TR_SYS_FILE_CREATE, O_CREAT },
           { TR_SYS_FILE_APPEND, TR_SYS_FILE_APPEND, O_APPEND },
           { TR_SYS_FILE_TRUNCATE, TR_SYS_FILE_TRUNCATE, O_TRUNC },
-          { TR_SYS_FILE_SEQUENTIAL, TR_SYS_FILE_SEQUENTIAL, O_SEQUENTIAL } }
+          { TR_SYS_FILE_SEQUENTIAL, TR_SYS_FILE_SEQUENTIAL, O_SEQUENTIAL },
+          { TR_SYS_FILE_DIRECT, TR_SYS_FILE_DIRECT, O_DIRECT } }
     };
 
     int native_flags = O_BINARY | O_LARGEFILE | O_CLOEXEC;
@@ -603,6 +778,13 @@ tr_sys_file_t tr_sys_file_open(char const* path, int flags, int permissions, tr_
         {
             set_file_for_single_pass(ret);
         }
+
+#ifdef __APPLE__
+        if ((flags & TR_SYS_FILE_DIRECT) != 0)
+        {
+            (void)fcntl(ret, F_NOCACHE, 1);
+        }
+#endif
     }
     else
     {
@@ -713,6 +895,51 @@ bool tr_sys_file_read_at(
     return ret;
 }
 
+bool tr_sys_file_read_at_v(
+    tr_sys_file_t handle,
+    tr_sys_file_iovec const* vecs,
+    size_t n_vecs,
+    uint64_t offset,
+    uint64_t* bytes_read,
+    tr_error** error)
+{
+    TR_ASSERT(handle != TR_BAD_SYS_FILE);
+    TR_ASSERT(vecs != nullptr || n_vecs == 0);
+    /* seek requires signed offset, so it should be in mod range */
+    TR_ASSERT(offset < UINT64_MAX / 2);
+
+#ifdef HAVE_PREADV
+
+    auto iov = std::array<struct iovec, MaxIoVecs>{};
+    n_vecs = to_native_iovecs(vecs, n_vecs, iov);
+    auto const my_bytes_read = preadv(handle, std::data(iov), static_cast<int>(n_vecs), offset);
+
+    static_assert(sizeof(*bytes_read) >= sizeof(my_bytes_read));
+
+    if (my_bytes_read > 0)
+    {
+        if (bytes_read != nullptr)
+        {
+            *bytes_read = my_bytes_read;
+        }
+
+        return true;
+    }
+
+    if (my_bytes_read == -1)
+    {
+        tr_error_set_from_errno(error, errno);
+    }
+
+    return false;
+
+#else
+
+    return read_at_v_fallback(handle, vecs, n_vecs, offset, bytes_read, error);
+
+#endif
+}
+
 bool tr_sys_file_write(tr_sys_file_t handle, void const* buffer, uint64_t size, uint64_t* bytes_written, tr_error** error)
 {
     TR_ASSERT(handle != TR_BAD_SYS_FILE);
@@ -784,6 +1011,47 @@ bool tr_sys_file_write_at(
     return ret;
 }
 
+bool tr_sys_file_write_at_v(
+    tr_sys_file_t handle,
+    tr_sys_file_iovec const* vecs,
+    size_t n_vecs,
+    uint64_t offset,
+    uint64_t* bytes_written,
+    tr_error** error)
+{
+    TR_ASSERT(handle != TR_BAD_SYS_FILE);
+    TR_ASSERT(vecs != nullptr || n_vecs == 0);
+    /* seek requires signed offset, so it should be in mod range */
+    TR_ASSERT(offset < UINT64_MAX / 2);
+
+#ifdef HAVE_PWRITEV
+
+    auto iov = std::array<struct iovec, MaxIoVecs>{};
+    n_vecs = to_native_iovecs(vecs, n_vecs, iov);
+    auto const my_bytes_written = pwritev(handle, std::data(iov), static_cast<int>(n_vecs), offset);
+
+    static_assert(sizeof(*bytes_written) >= sizeof(my_bytes_written));
+
+    if (my_bytes_written == -1)
+    {
+        tr_error_set_from_errno(error, errno);
+        return false;
+    }
+
+    if (bytes_written != nullptr)
+    {
+        *bytes_written = my_bytes_written;
+    }
+
+    return true;
+
+#else
+
+    return write_at_v_fallback(handle, vecs, n_vecs, offset, bytes_written, error);
+
+#endif
+}
+
 bool tr_sys_file_flush(tr_sys_file_t handle, tr_error** error)
 {
     TR_ASSERT(handle != TR_BAD_SYS_FILE);
@@ -798,6 +1066,25 @@ bool tr_sys_file_flush(tr_sys_file_t handle, tr_error** error)
     return ret;
 }
 
+bool tr_sys_file_flush_data(tr_sys_file_t handle, tr_error** error)
+{
+    TR_ASSERT(handle != TR_BAD_SYS_FILE);
+
+#ifdef __APPLE__
+    // macOS has no documented fdatasync()
+    return tr_sys_file_flush(handle, error);
+#else
+    bool const ret = (fdatasync(handle) != -1);
+
+    if (!ret)
+    {
+        tr_error_set_from_errno(error, errno);
+    }
+
+    return ret;
+#endif
+}
+
 bool tr_sys_file_flush_possible(tr_sys_file_t handle, tr_error** error)
 {
     TR_ASSERT(handle != TR_BAD_SYS_FILE);
@@ -881,10 +1168,17 @@ bool preallocate_fallocate64(tr_sys_file_t handle, uint64_t size)
 {
     return fallocate64(handle, 0, 0, size) == 0;
 }
+
+#ifdef FALLOC_FL_KEEP_SIZE
+bool reserve_fallocate64(tr_sys_file_t handle, uint64_t size)
+{
+    return fallocate64(handle, FALLOC_FL_KEEP_SIZE, 0, size) == 0;
+}
+#endif
 #endif
 
 #ifdef HAVE_XFS_XFS_H
-bool full_preallocate_xfs(tr_sys_file_t handle, uint64_t size)
+bool reserve_xfs(tr_sys_file_t handle, uint64_t size)
 {
     if (platform_test_xfs_fd(handle) == 0) // true if on xfs filesystem
     {
@@ -897,19 +1191,17 @@ bool full_preallocate_xfs(tr_sys_file_t handle, uint64_t size)
     fl.l_len = size;
 
     // The blocks are allocated, but not zeroed, and the file size does not change
-    bool ok = xfsctl(nullptr, handle, XFS_IOC_RESVSP64, &fl) != -1;
-
-    if (ok)
-    {
-        ok = ftruncate(handle, size) == 0;
-    }
+    return xfsctl(nullptr, handle, XFS_IOC_RESVSP64, &fl) != -1;
+}
 
-    return ok;
+bool full_preallocate_xfs(tr_sys_file_t handle, uint64_t size)
+{
+    return reserve_xfs(handle, size) && ftruncate(handle, size) == 0;
 }
 #endif
 
 #ifdef __APPLE__
-bool full_preallocate_apple(tr_sys_file_t handle, uint64_t size)
+bool reserve_apple(tr_sys_file_t handle, uint64_t size)
 {
     fstore_t fst;
 
@@ -919,14 +1211,12 @@ bool full_preallocate_apple(tr_sys_file_t handle, uint64_t size)
     fst.fst_length = size;
     fst.fst_bytesalloc = 0;
 
-    bool ok = fcntl(handle, F_PREALLOCATE, &fst) != -1;
-
-    if (ok)
-    {
-        ok = ftruncate(handle, size) == 0;
-    }
+    return fcntl(handle, F_PREALLOCATE, &fst) != -1;
+}
 
-    return ok;
+bool full_preallocate_apple(tr_sys_file_t handle, uint64_t size)
+{
+    return reserve_apple(handle, size) && ftruncate(handle, size) == 0;
 }
 #endif
 
@@ -945,6 +1235,39 @@ bool tr_sys_file_preallocate(tr_sys_file_t handle, uint64_t size, int flags, tr_
 
     using prealloc_func = bool (*)(tr_sys_file_t, uint64_t);
 
+    if ((flags & TR_SYS_FILE_PREALLOC_KEEP_SIZE) != 0)
+    {
+        auto const approaches = std::vector<prealloc_func>{
+#if defined(HAVE_FALLOCATE64) && defined(FALLOC_FL_KEEP_SIZE)
+            reserve_fallocate64,
+#endif
+#ifdef HAVE_XFS_XFS_H
+            reserve_xfs,
+#endif
+#ifdef __APPLE__
+            reserve_apple,
+#endif
+        };
+
+        for (auto& approach : approaches)
+        {
+            errno = 0;
+
+            if (approach(handle, size))
+            {
+                return true;
+            }
+
+            if (errno == ENOSPC)
+            {
+                break;
+            }
+        }
+
+        tr_error_set_from_errno(error, errno != 0 ? errno : ENOTSUP);
+        return false;
+    }
+
     // these approaches are fast and should be tried first
     auto approaches = std::vector<prealloc_func>{
 #ifdef HAVE_FALLOCATE64
@@ -1078,6 +1401,37 @@ bool tr_sys_file_lock([[maybe_unused]] tr_sys_file_t handle, [[maybe_unused]] in
     return ret;
 }
 
+void* tr_sys_file_map_for_reading(tr_sys_file_t handle, uint64_t offset, uint64_t size, tr_error** error)
+{
+    TR_ASSERT(handle != TR_BAD_SYS_FILE);
+    TR_ASSERT(size > 0);
+
+    void* ret = mmap(nullptr, size, PROT_READ, MAP_SHARED, handle, offset);
+
+    if (ret == MAP_FAILED) // NOLINT(performance-no-int-to-ptr)
+    {
+        tr_error_set_from_errno(error, errno);
+        ret = nullptr;
+    }
+
+    return ret;
+}
+
+bool tr_sys_file_unmap(void const* address, uint64_t size, tr_error** error)
+{
+    TR_ASSERT(address != nullptr);
+    TR_ASSERT(size > 0);
+
+    bool const ret = munmap(const_cast<void*>(address), size) != -1;
+
+    if (!ret)
+    {
+        tr_error_set_from_errno(error, errno);
+    }
+
+    return ret;
+}
+
 std::string tr_sys_dir_get_current(tr_error** error)
 {
     auto buf = std::vector<char>{};
@@ -507,6 +507,26 @@ bool tr_sys_path_is_same(char const* path1, char const* path2, tr_error** error)
         fi1->nFileIndexLow == fi2->nFileIndexLow;
 }
 
+bool tr_sys_path_is_same_filesystem(char const* path1, char const* path2, tr_error** error)
+{
+    TR_ASSERT(path1 != nullptr);
+    TR_ASSERT(path2 != nullptr);
+
+    auto const fi1 = get_file_info(path1, error);
+    if (!fi1)
+    {
+        return false;
+    }
+
+    auto const fi2 = get_file_info(path2, error);
+    if (!fi2)
+    {
+        return false;
+    }
+
+    return fi1->dwVolumeSerialNumber == fi2->dwVolumeSerialNumber;
+}
+
 std::string tr_sys_path_resolve(std::string_view path, tr_error** error)
 {
     auto ret = std::string{};
@@ -770,6 +790,28 @@ bool tr_sys_path_copy(char const* src_path, char const* dst_path, tr_error** err
     return true;
 }
 
+bool tr_sys_path_link(char const* src_path, char const* dst_path, tr_error** error)
+{
+    TR_ASSERT(src_path != nullptr);
+    TR_ASSERT(dst_path != nullptr);
+
+    bool ret = false;
+    auto const wide_src_path = path_to_native_path(src_path);
+    auto const wide_dst_path = path_to_native_path(dst_path);
+
+    if (!std::empty(wide_src_path) && !std::empty(wide_dst_path))
+    {
+        ret = CreateHardLinkW(wide_dst_path.c_str(), wide_src_path.c_str(), nullptr);
+    }
+
+    if (!ret)
+    {
+        set_system_error(error, GetLastError());
+    }
+
+    return ret;
+}
+
 bool tr_sys_path_remove(char const* path, tr_error** error)
 {
     TR_ASSERT(path != nullptr);
@@ -887,6 +929,11 @@ tr_sys_file_t tr_sys_file_open(char const* path, int flags, int /*permissions*/,
         native_flags |= FILE_FLAG_SEQUENTIAL_SCAN;
     }
 
+    if ((flags & TR_SYS_FILE_DIRECT) != 0)
+    {
+        native_flags |= FILE_FLAG_NO_BUFFERING;
+    }
+
     ret = open_file(path, native_access, native_disposition, native_flags, error);
 
     success = ret != TR_BAD_SYS_FILE;
@@ -1018,6 +1065,54 @@ bool tr_sys_file_read_at(
     return ret;
 }
 
+bool tr_sys_file_read_at_v(
+    tr_sys_file_t handle,
+    tr_sys_file_iovec const* vecs,
+    size_t n_vecs,
+    uint64_t offset,
+    uint64_t* bytes_read,
+    tr_error** error)
+{
+    TR_ASSERT(handle != TR_BAD_SYS_FILE);
+    TR_ASSERT(vecs != nullptr || n_vecs == 0);
+
+    // ReadFileScatter() needs page-aligned, page-sized buffers and an
+    // unbuffered handle, so just read the buffers one at a time.
+    auto total = uint64_t{};
+
+    for (size_t i = 0; i < n_vecs; ++i)
+    {
+        auto n_read = uint64_t{};
+        tr_error* my_error = nullptr;
+        if (!tr_sys_file_read_at(handle, vecs[i].base, vecs[i].len, offset + total, &n_read, &my_error))
+        {
+            // report a short read if we got anything at all
+            if (total == 0U)
+            {
+                tr_error_propagate(error, &my_error);
+                return false;
+            }
+
+            tr_error_clear(&my_error);
+            break;
+        }
+
+        total += n_read;
+
+        if (n_read < vecs[i].len)
+        {
+            break;
+        }
+    }
+
+    if (bytes_read != nullptr)
+    {
+        *bytes_read = total;
+    }
+
+    return total > 0U;
+}
+
 bool tr_sys_file_write(tr_sys_file_t handle, void const* buffer, uint64_t size, uint64_t* bytes_written, tr_error** error)
 {
     TR_ASSERT(handle != TR_BAD_SYS_FILE);
@@ -1092,6 +1187,54 @@ bool tr_sys_file_write_at(
     return ret;
 }
 
+bool tr_sys_file_write_at_v(
+    tr_sys_file_t handle,
+    tr_sys_file_iovec const* vecs,
+    size_t n_vecs,
+    uint64_t offset,
+    uint64_t* bytes_written,
+    tr_error** error)
+{
+    TR_ASSERT(handle != TR_BAD_SYS_FILE);
+    TR_ASSERT(vecs != nullptr || n_vecs == 0);
+
+    // WriteFileGather() needs page-aligned, page-sized buffers and an
+    // unbuffered handle, so just write the buffers one at a time.
+    auto total = uint64_t{};
+
+    for (size_t i = 0; i < n_vecs; ++i)
+    {
+        auto n_written = uint64_t{};
+        tr_error* my_error = nullptr;
+        if (!tr_sys_file_write_at(handle, vecs[i].base, vecs[i].len, offset + total, &n_written, &my_error))
+        {
+            // report a short write if we wrote anything at all
+            if (total == 0U)
+            {
+                tr_error_propagate(error, &my_error);
+                return false;
+            }
+
+            tr_error_clear(&my_error);
+            break;
+        }
+
+        total += n_written;
+
+        if (n_written < vecs[i].len)
+        {
+            break;
+        }
+    }
+
+    if (bytes_written != nullptr)
+    {
+        *bytes_written = total;
+    }
+
+    return true;
+}
+
 bool tr_sys_file_flush(tr_sys_file_t handle, tr_error** error)
 {
     TR_ASSERT(handle != TR_BAD_SYS_FILE);
@@ -1106,6 +1249,11 @@ bool tr_sys_file_flush(tr_sys_file_t handle, tr_error** error)
     return ret;
 }
 
+bool tr_sys_file_flush_data(tr_sys_file_t handle, tr_error** error)
+{
+    return tr_sys_file_flush(handle, error);
+}
+
 bool tr_sys_file_flush_possible(tr_sys_file_t handle, tr_error** error)
 {
     TR_ASSERT(handle != TR_BAD_SYS_FILE);
@@ -1160,6 +1308,14 @@ bool tr_sys_file_preallocate(tr_sys_file_t handle, uint64_t size, int flags, tr_
 {
     TR_ASSERT(handle != TR_BAD_SYS_FILE);
 
+    // NTFS frees clusters past the end of the file when it's closed,
+    // so there's no lasting way to reserve space without resizing it
+    if ((flags & TR_SYS_FILE_PREALLOC_KEEP_SIZE) != 0)
+    {
+        set_system_error(error, ERROR_NOT_SUPPORTED);
+        return false;
+    }
+
     if ((flags & TR_SYS_FILE_PREALLOC_SPARSE) != 0)
     {
         DWORD tmp;
@@ -1213,6 +1369,58 @@ bool tr_sys_file_lock(tr_sys_file_t handle, int operation, tr_error** error)
     return ret;
 }
 
+void* tr_sys_file_map_for_reading(tr_sys_file_t handle, uint64_t offset, uint64_t size, tr_error** error)
+{
+    TR_ASSERT(handle != TR_BAD_SYS_FILE);
+    TR_ASSERT(size > 0);
+
+    if (size > MAXSIZE_T)
+    {
+        set_system_error(error, ERROR_INVALID_PARAMETER);
+        return nullptr;
+    }
+
+    void* ret = nullptr;
+
+    if (HANDLE const mapping = CreateFileMappingW(handle, nullptr, PAGE_READONLY, 0, 0, nullptr); mapping != nullptr)
+    {
+        auto native_offset = ULARGE_INTEGER{};
+        native_offset.QuadPart = offset;
+
+        ret = MapViewOfFile(mapping, FILE_MAP_READ, native_offset.HighPart, native_offset.LowPart, static_cast<SIZE_T>(size));
+        auto const code = GetLastError();
+
+        // the view keeps the mapping alive
+        CloseHandle(mapping);
+
+        if (ret == nullptr)
+        {
+            set_system_error(error, code);
+        }
+    }
+    else
+    {
+        set_system_error(error, GetLastError());
+    }
+
+    return ret;
+}
+
+bool tr_sys_file_unmap(void const* address, [[maybe_unused]] uint64_t size, tr_error** error)
+{
+    TR_ASSERT(address != nullptr);
+    TR_ASSERT(size > 0);
+
+    bool const ret = UnmapViewOfFile(address) != FALSE;
+
+    if (!ret)
+    {
+        set_system_error(error, GetLastError());
+    }
+
+    return ret;
+}
+
 std::string tr_sys_dir_get_current(tr_error** error)
 {
     if (auto const size = GetCurrentDirectoryW(0, nullptr); size != 0)
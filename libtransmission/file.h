@@ -5,6 +5,7 @@
 
 #pragma once
 
+#include <cstddef> // size_t
 #include <cstdint> // uint64_t
 #include <ctime> // time_t
 #include <functional>
@@ -59,9 +60,15 @@ enum tr_sys_file_open_flags_t
     TR_SYS_FILE_CREATE = (1 << 2),
     TR_SYS_FILE_APPEND = (1 << 3),
     TR_SYS_FILE_TRUNCATE = (1 << 4),
-    TR_SYS_FILE_SEQUENTIAL = (1 << 5)
+    TR_SYS_FILE_SEQUENTIAL = (1 << 5),
+    // Bypass the OS' page cache. Buffers, offsets, and lengths must be
+    // multiples of TR_SYS_FILE_DIRECT_ALIGNMENT, except that a read may
+    // end at the end of the file. Not every filesystem supports this.
+    TR_SYS_FILE_DIRECT = (1 << 6)
 };
 
+#define TR_SYS_FILE_DIRECT_ALIGNMENT 4096U
+
 enum tr_sys_file_lock_flags_t
 {
     TR_SYS_FILE_LOCK_SH = (1 << 0),
@@ -83,7 +90,9 @@ enum tr_sys_file_advice_t
 
 enum tr_sys_file_preallocate_flags_t
 {
-    TR_SYS_FILE_PREALLOC_SPARSE = (1 << 0)
+    TR_SYS_FILE_PREALLOC_SPARSE = (1 << 0),
+    // reserve the disk space without changing the file's size
+    TR_SYS_FILE_PREALLOC_KEEP_SIZE = (1 << 1)
 };
 
 enum tr_sys_dir_create_flags_t
@@ -121,6 +130,13 @@ struct tr_sys_path_capacity
     int64_t total = -1;
 };
 
+/** @brief One buffer of a scatter/gather read or write, like `struct iovec`. */
+struct tr_sys_file_iovec
+{
+    void* base = nullptr;
+    uint64_t len = 0;
+};
+
 /**
  * @name Platform-specific wrapper functions
  *
@@ -148,6 +164,19 @@ struct tr_sys_path_capacity
  */
 bool tr_sys_path_copy(char const* src_path, char const* dst_path, struct tr_error** error = nullptr);
 
+/**
+ * @brief Portability wrapper for `link()`.
+ *
+ * @param[in]  src_path  Path to an existing file.
+ * @param[in]  dst_path  Path of the new hard link. It must not exist yet.
+ * @param[out] error     Pointer to error object. Optional, pass `nullptr` if
+ *                       you are not interested in error details.
+ *
+ * @return `True` on success, `false` otherwise (with `error` set accordingly).
+ *         Linking will only succeed if both paths are on the same filesystem.
+ */
+bool tr_sys_path_link(char const* src_path, char const* dst_path, struct tr_error** error = nullptr);
+
 /**
  * @brief Portability wrapper for `stat()`.
  *
@@ -223,6 +252,26 @@ bool tr_sys_path_is_same(T const& path1, U const& path2, struct tr_error** error
     return tr_sys_path_is_same(path1.c_str(), path2.c_str(), error);
 }
 
+/**
+ * @brief Test to see if two existing paths are on the same filesystem,
+ *        i.e. if one can be renamed into the other without copying data.
+ *
+ * @param[in]  path1 Path to first file or directory.
+ * @param[in]  path2 Path to second file or directory.
+ * @param[out] error Pointer to error object. Optional, pass `nullptr` if
+ *                   you are not interested in error details.
+ *
+ * @return `True` if both paths are on the same filesystem, `false`
+ *         otherwise. Note that `false` will also be returned in case of error.
+ */
+bool tr_sys_path_is_same_filesystem(char const* path1, char const* path2, struct tr_error** error = nullptr);
+
+template<typename T, typename U, typename = decltype(&T::c_str), typename = decltype(&U::c_str)>
+bool tr_sys_path_is_same_filesystem(T const& path1, U const& path2, struct tr_error** error = nullptr)
+{
+    return tr_sys_path_is_same_filesystem(path1.c_str(), path2.c_str(), error);
+}
+
 /**
  * @brief Portability wrapper for `realpath()`.
  *
@@ -405,6 +454,31 @@ bool tr_sys_file_read_at(
     uint64_t* bytes_read,
     struct tr_error** error = nullptr);
 
+/**
+ * @brief Like `preadv()`, except that the position is undefined afterwards.
+ *        Not thread-safe.
+ *
+ * Fills the buffers in order, so a short read fills some prefix of them.
+ *
+ * @param[in]  handle     Valid file descriptor.
+ * @param[in]  vecs       Buffers to store read data to.
+ * @param[in]  n_vecs     Number of buffers in `vecs`.
+ * @param[in]  offset     File offset in bytes to start reading from.
+ * @param[out] bytes_read Number of bytes actually read. Optional, pass `nullptr`
+ *                        if you are not interested.
+ * @param[out] error      Pointer to error object. Optional, pass `nullptr` if
+ *                        you are not interested in error details.
+ *
+ * @return `True` on success, `false` otherwise (with `error` set accordingly).
+ */
+bool tr_sys_file_read_at_v(
+    tr_sys_file_t handle,
+    tr_sys_file_iovec const* vecs,
+    size_t n_vecs,
+    uint64_t offset,
+    uint64_t* bytes_read,
+    struct tr_error** error = nullptr);
+
 /**
  * @brief Portability wrapper for `write()`.
  *
@@ -448,6 +522,31 @@ bool tr_sys_file_write_at(
     uint64_t* bytes_written,
     struct tr_error** error = nullptr);
 
+/**
+ * @brief Like `pwritev()`, except that the position is undefined afterwards.
+ *        Not thread-safe.
+ *
+ * Writes the buffers in order, so a short write writes some prefix of them.
+ *
+ * @param[in]  handle        Valid file descriptor.
+ * @param[in]  vecs          Buffers to get data being written from.
+ * @param[in]  n_vecs        Number of buffers in `vecs`.
+ * @param[in]  offset        File offset in bytes to start writing from.
+ * @param[out] bytes_written Number of bytes actually written. Optional, pass
+ *                           `nullptr` if you are not interested.
+ * @param[out] error         Pointer to error object. Optional, pass `nullptr`
+ *                          if you are not interested in error details.
+ *
+ * @return `True` on success, `false` otherwise (with `error` set accordingly).
+ */
+bool tr_sys_file_write_at_v(
+    tr_sys_file_t handle,
+    tr_sys_file_iovec const* vecs,
+    size_t n_vecs,
+    uint64_t offset,
+    uint64_t* bytes_written,
+    struct tr_error** error = nullptr);
+
 /**
  * @brief Portability wrapper for `fsync()`.
  *
@@ -459,6 +558,21 @@ bool tr_sys_file_write_at(
  */
 bool tr_sys_file_flush(tr_sys_file_t handle, struct tr_error** error = nullptr);
 
+/**
+ * @brief Portability wrapper for `fdatasync()`.
+ *
+ * Like `tr_sys_file_flush()`, but metadata that isn't needed to read the
+ * data back, e.g. the modification time, may be left unflushed.
+ * Falls back to `tr_sys_file_flush()` where that's not possible.
+ *
+ * @param[in]  handle Valid file descriptor.
+ * @param[out] error  Pointer to error object. Optional, pass `nullptr` if you
+ *                    are not interested in error details.
+ *
+ * @return `True` on success, `false` otherwise (with `error` set accordingly).
+ */
+bool tr_sys_file_flush_data(tr_sys_file_t handle, struct tr_error** error = nullptr);
+
 /* @brief Check whether `handle` may be flushed via `tr_sys_file_flush()`. */
 bool tr_sys_file_flush_possible(tr_sys_file_t handle, struct tr_error** error = nullptr);
 
@@ -495,6 +609,10 @@ bool tr_sys_file_advise(
 /**
  * @brief Preallocate file to specified size in full or sparse mode.
  *
+ * With `TR_SYS_FILE_PREALLOC_KEEP_SIZE`, the space is only reserved and the
+ * file's size is left alone, so the call is safe to make while the file is
+ * being written to. This fails if the platform or filesystem can't do that.
+ *
  * @param[in]  handle Valid file descriptor.
  * @param[in]  size   Number of bytes to preallocate file to.
  * @param[in]  flags  Combination of @ref tr_sys_file_preallocate_flags_t values.
@@ -520,6 +638,32 @@ bool tr_sys_file_preallocate(tr_sys_file_t handle, uint64_t size, int flags, str
  */
 bool tr_sys_file_lock(tr_sys_file_t handle, int operation, struct tr_error** error = nullptr);
 
+/**
+ * @brief Portability wrapper for `mmap()` for files.
+ *
+ * @param[in]  handle Valid file descriptor.
+ * @param[in]  offset Offset in file to map from.
+ * @param[in]  size   Number of bytes to map.
+ * @param[out] error  Pointer to error object. Optional, pass `nullptr` if you
+ *                    are not interested in error details.
+ *
+ * @return Pointer to mapped file data on success, `nullptr` otherwise (with
+ *         `error` set accordingly).
+ */
+void* tr_sys_file_map_for_reading(tr_sys_file_t handle, uint64_t offset, uint64_t size, struct tr_error** error = nullptr);
+
+/**
+ * @brief Portability wrapper for `munmap()` for files.
+ *
+ * @param[in]  address Pointer to mapped file data.
+ * @param[in]  size    Size of mapped data in bytes.
+ * @param[out] error   Pointer to error object. Optional, pass `nullptr` if you
+ *                     are not interested in error details.
+ *
+ * @return `True` on success, `false` otherwise (with `error` set accordingly).
+ */
+bool tr_sys_file_unmap(void const* address, uint64_t size, struct tr_error** error = nullptr);
+
 /* File-related wrappers (utility) */
 
 /**
@@ -122,7 +122,8 @@ namespace global_source_ip_helpers
 
 tr_global_ip_cache::tr_global_ip_cache(Mediator& mediator_in)
     : mediator_{ mediator_in }
-    , upkeep_timers_{ mediator_in.timer_maker().create(), mediator_in.timer_maker().create() }
+    , upkeep_timers_{ mediator_in.timer_maker().create(tr_source_location::current()),
+                      mediator_in.timer_maker().create(tr_source_location::current()) }
 {
     static_assert(TR_AF_INET == 0);
     static_assert(TR_AF_INET6 == 1);
@@ -6,6 +6,7 @@
 #include <algorithm>
 #include <array>
 #include <cerrno> // ECONNREFUSED, ETIMEDOUT
+#include <chrono>
 #include <string_view>
 #include <utility>
 
@@ -14,11 +15,11 @@
 #include "libtransmission/transmission.h"
 
 #include "libtransmission/bitfield.h"
-#include "libtransmission/clients.h"
 #include "libtransmission/crypto-utils.h"
 #include "libtransmission/error.h"
 #include "libtransmission/handshake.h"
 #include "libtransmission/log.h"
+#include "libtransmission/metrics.h"
 #include "libtransmission/peer-io.h"
 #include "libtransmission/peer-mse.h" // tr_message_stream_encryption::DH
 #include "libtransmission/timer.h"
@@ -113,6 +114,39 @@ tr_handshake::ParseResult tr_handshake::parse_handshake(tr_peerIo* peer_io)
     return ParseResult::Ok;
 }
 
+// ---
+
+ReadState tr_handshake::set_peer_public_key(DH::key_bigend_t const& peer_public_key, State next)
+{
+    auto* const worker = mediator_->mse_worker();
+    if (worker == nullptr)
+    {
+        dh_.setPeerPublicKey(peer_public_key);
+        set_state(next);
+        return READ_NOW;
+    }
+
+    // Stop reading until the worker has the secret, then pick up
+    // at `next` with whatever the peer has sent in the meantime.
+    set_state(State::AwaitingSecret);
+    worker->compute_secret(
+        dh_,
+        peer_public_key,
+        [this, alive = std::weak_ptr<bool>{ alive_ }, next](DH const& dh)
+        {
+            if (alive.expired() || !is_state(State::AwaitingSecret) || !peer_io_)
+            {
+                return;
+            }
+
+            dh_ = dh;
+            set_state(next);
+            auto const keep_alive = peer_io_;
+            keep_alive->read_buffered();
+        });
+    return READ_LATER;
+}
+
 // --- Outgoing Connections
 
 // 1 A->B: our public key (Ya) and some padding (PadA)
@@ -181,8 +215,11 @@ ReadState tr_handshake::read_yb(tr_peerIo* peer_io)
 
     // get the peer's public key
     peer_io->read_bytes(std::data(peer_public_key), std::size(peer_public_key));
-    dh_.setPeerPublicKey(peer_public_key);
+    return set_peer_public_key(peer_public_key, State::SendingCryptoProvide);
+}
 
+ReadState tr_handshake::send_crypto_provide(tr_peerIo* peer_io)
+{
     /* now send these: HASH('req1', S), HASH('req2', SKEY) xor HASH('req3', S),
      * ENCRYPT(VC, crypto_provide, len(PadC), PadC, len(IA)), ENCRYPT(IA) */
     auto outbuf = libtransmission::StackBuffer<1024U, std::byte>{};
@@ -427,9 +464,7 @@ ReadState tr_handshake::read_peer_id(tr_peerIo* peer_io)
     peer_io->read_bytes(std::data(peer_id), std::size(peer_id));
     set_peer_id(peer_id);
 
-    auto client = std::array<char, 128>{};
-    tr_clientForId(std::data(client), std::size(client), peer_id);
-    tr_logAddTraceHand(this, fmt::format("peer-id is '{}' ... isIncoming is {}", std::data(client), is_incoming()));
+    tr_logAddTraceHand(this, fmt::format("peer-id is '{}' ... isIncoming is {}", client_name_.sv(), is_incoming()));
 
     // if we've somehow connected to ourselves, don't keep the connection
     auto const info_hash = peer_io_->torrent_hash();
@@ -451,10 +486,17 @@ ReadState tr_handshake::read_ya(tr_peerIo* peer_io)
         return READ_LATER;
     }
 
+    // Incoming handshakes don't take a key pair until the peer shows that
+    // it wants an encrypted handshake, so idle connections don't use them up.
+    dh_ = get_dh(mediator_);
+
     /* read the incoming peer's public key */
     peer_io->read_bytes(std::data(peer_public_key), std::size(peer_public_key));
-    dh_.setPeerPublicKey(peer_public_key);
+    return set_peer_public_key(peer_public_key, State::SendingYb);
+}
 
+ReadState tr_handshake::send_yb(tr_peerIo* peer_io)
+{
     // send our public key to the peer
     tr_logAddTraceHand(this, "sending B->A: Diffie Hellman Yb, PadB");
     send_public_key_and_pad<PadbMaxlen>(peer_io);
@@ -681,6 +723,15 @@ ReadState tr_handshake::can_read(tr_peerIo* peer_io, void* vhandshake, size_t* p
 
     tr_logAddTraceHand(handshake, fmt::format("handling canRead; state is [{}]", handshake->state_string()));
 
+    if (auto const& started_at = handshake->connect_started_at_; started_at)
+    {
+        auto const elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - *started_at);
+        auto& metrics = tr_metrics::instance();
+        (peer_io->is_utp() ? metrics.outgoing_connect_duration_utp : metrics.outgoing_connect_duration_tcp).observe(elapsed);
+        handshake->connect_started_at_.reset();
+    }
+
     ReadState ret = READ_NOW;
     while (ready_for_more)
     {
@@ -698,6 +749,10 @@ ReadState tr_handshake::can_read(tr_peerIo* peer_io, void* vhandshake, size_t* p
             ret = handshake->read_ya(peer_io);
             break;
 
+        case State::SendingYb:
+            ret = handshake->send_yb(peer_io);
+            break;
+
         case State::AwaitingPadA:
             ret = handshake->read_pad_a(peer_io);
             break;
@@ -722,6 +777,10 @@ ReadState tr_handshake::can_read(tr_peerIo* peer_io, void* vhandshake, size_t* p
             ret = handshake->read_yb(peer_io);
             break;
 
+        case State::SendingCryptoProvide:
+            ret = handshake->send_crypto_provide(peer_io);
+            break;
+
         case State::AwaitingVc:
             ret = handshake->read_vc(peer_io);
             break;
@@ -734,6 +793,10 @@ ReadState tr_handshake::can_read(tr_peerIo* peer_io, void* vhandshake, size_t* p
             ret = handshake->read_pad_d(peer_io);
             break;
 
+        case State::AwaitingSecret:
+            ret = READ_LATER;
+            break;
+
         default:
 #ifdef TR_ENABLE_ASSERTS
             TR_ASSERT_MSG(
@@ -785,6 +848,7 @@ void tr_handshake::on_error(tr_peerIo* io, tr_error const& error, void* vhandsha
 
         if (handshake->mediator_->allows_tcp() && io->reconnect())
         {
+            handshake->connect_started_at_ = std::chrono::steady_clock::now();
             auto msg = std::array<uint8_t, HandshakeSize>{};
             handshake->build_handshake_message(io, std::data(msg));
             handshake->have_sent_bittorrent_handshake_ = true;
@@ -800,6 +864,7 @@ void tr_handshake::on_error(tr_peerIo* io, tr_error const& error, void* vhandsha
     if ((handshake->is_state(State::AwaitingYb) || handshake->is_state(State::AwaitingVc)) &&
         handshake->encryption_mode_ != TR_ENCRYPTION_REQUIRED && handshake->mediator_->allows_tcp() && io->reconnect())
     {
+        handshake->connect_started_at_ = std::chrono::steady_clock::now();
         auto msg = std::array<uint8_t, HandshakeSize>{};
         tr_logAddTraceHand(handshake, "handshake failed, trying plaintext...");
         handshake->build_handshake_message(io, std::data(msg));
@@ -813,6 +878,16 @@ void tr_handshake::on_error(tr_peerIo* io, tr_error const& error, void* vhandsha
     handshake->done(false);
 }
 
+void tr_handshake::on_timeout()
+{
+    if (peer_io_ && is_incoming())
+    {
+        tr_metrics::instance().incoming_handshakes_timed_out.add();
+    }
+
+    fire_done(false);
+}
+
 bool tr_handshake::fire_done(bool is_connected)
 {
     maybe_recycle_dh();
@@ -831,7 +906,7 @@ bool tr_handshake::fire_done(bool is_connected)
     auto peer_io = std::shared_ptr<tr_peerIo>{};
     std::swap(peer_io, peer_io_);
 
-    bool const success = (cb)(Result{ std::move(peer_io), peer_id_, have_read_anything_from_peer_, is_connected });
+    bool const success = (cb)(Result{ std::move(peer_io), peer_id_, client_name_, have_read_anything_from_peer_, is_connected });
     return success;
 }
 
@@ -845,6 +920,8 @@ std::string_view tr_handshake::state_string(State state) noexcept
         return "awaiting peer id";
     case State::AwaitingYa:
         return "awaiting ya";
+    case State::SendingYb:
+        return "sending yb";
     case State::AwaitingPadA:
         return "awaiting pad a";
     case State::AwaitingCryptoProvide:
@@ -859,12 +936,18 @@ std::string_view tr_handshake::state_string(State state) noexcept
     // outgoing
     case State::AwaitingYb:
         return "awaiting yb";
+    case State::SendingCryptoProvide:
+        return "sending crypto provide";
     case State::AwaitingVc:
         return "awaiting vc";
     case State::AwaitingCryptoSelect:
         return "awaiting crypto select";
     case State::AwaitingPadD:
         return "awaiting pad d";
+
+    // either
+    case State::AwaitingSecret:
+        return "awaiting secret";
     }
 
     return "unknown state";
@@ -892,10 +975,10 @@ uint32_t tr_handshake::crypto_provide() const noexcept
 // ---
 
 tr_handshake::tr_handshake(Mediator* mediator, std::shared_ptr<tr_peerIo> peer_io, tr_encryption_mode mode, DoneFunc on_done)
-    : dh_{ tr_handshake::get_dh(mediator) }
+    : dh_{ peer_io->is_incoming() ? DH{} : tr_handshake::get_dh(mediator) }
     , on_done_{ std::move(on_done) }
     , peer_io_{ std::move(peer_io) }
-    , timeout_timer_{ mediator->timer_maker().create([this]() { fire_done(false); }) }
+    , timeout_timer_{ mediator->timer_maker().create([this]() { on_timeout(); }) }
     , mediator_{ mediator }
     , encryption_mode_{ mode }
 {
@@ -903,6 +986,11 @@ tr_handshake::tr_handshake(Mediator* mediator, std::shared_ptr<tr_peerIo> peer_i
 
     peer_io_->set_callbacks(&tr_handshake::can_read, nullptr, &tr_handshake::on_error, this);
 
+    if (!is_incoming())
+    {
+        connect_started_at_ = std::chrono::steady_clock::now();
+    }
+
     if (is_incoming())
     {
         set_state(State::AwaitingHandshake);
@@ -23,8 +23,11 @@
 
 #include "libtransmission/transmission.h"
 
+#include "libtransmission/clients.h" // tr_client_name()
+#include "libtransmission/interned-string.h"
 #include "libtransmission/net.h"
 #include "libtransmission/peer-mse.h" // tr_message_stream_encryption::DH
+#include "libtransmission/peer-mse-worker.h"
 #include "libtransmission/peer-io.h"
 #include "libtransmission/timer.h"
 #include "libtransmission/tr-macros.h" // tr_sha1_digest_t, tr_peer_id_t
@@ -41,6 +44,7 @@ public:
     {
         std::shared_ptr<tr_peerIo> io;
         std::optional<tr_peer_id_t> peer_id;
+        tr_interned_string client_name; // decoded from peer_id
         bool read_anything_from_peer = false;
         bool is_connected = false;
     };
@@ -71,6 +75,12 @@ public:
             return DH::randomPrivateKey();
         }
 
+        // If this returns a worker, the DH math is done in the background.
+        [[nodiscard]] virtual tr_mse_worker* mse_worker()
+        {
+            return nullptr;
+        }
+
         virtual void set_utp_failed(tr_sha1_digest_t const& info_hash, tr_socket_address const& socket_address) = 0;
     };
 
@@ -91,6 +101,7 @@ private:
         AwaitingHandshake,
         AwaitingPeerId,
         AwaitingYa,
+        SendingYb,
         AwaitingPadA,
         AwaitingCryptoProvide,
         AwaitingPadC,
@@ -99,9 +110,13 @@ private:
 
         // outgoing
         AwaitingYb,
+        SendingCryptoProvide,
         AwaitingVc,
         AwaitingCryptoSelect,
-        AwaitingPadD
+        AwaitingPadD,
+
+        // either
+        AwaitingSecret
     };
 
     ///
@@ -130,12 +145,18 @@ private:
     ReadState read_yb(tr_peerIo*);
 
     void send_ya(tr_peerIo*);
+    ReadState send_yb(tr_peerIo*);
+    ReadState send_crypto_provide(tr_peerIo*);
+
+    // Compute the DH shared secret, then move on to `next`.
+    ReadState set_peer_public_key(DH::key_bigend_t const& peer_public_key, State next);
 
     ParseResult parse_handshake(tr_peerIo* peer_io);
 
-    void set_peer_id(tr_peer_id_t const& id) noexcept
+    void set_peer_id(tr_peer_id_t const& id)
     {
         peer_id_ = id;
+        client_name_ = tr_client_name(id);
     }
 
     constexpr void set_have_read_anything_from_peer(bool val) noexcept
@@ -188,6 +209,8 @@ private:
         io->write_bytes(data, walk - data, false);
     }
 
+    void on_timeout();
+
     bool fire_done(bool is_connected);
 
     ///
@@ -266,6 +289,14 @@ private:
 
     [[nodiscard]] static DH get_dh(Mediator* mediator)
     {
+        if (auto* const worker = mediator->mse_worker(); worker != nullptr)
+        {
+            if (auto dh = worker->take(); dh)
+            {
+                return *dh;
+            }
+        }
+
         auto lock = std::unique_lock(dh_pool_mutex_);
 
         if (dh_pool_size_ > 0U)
@@ -308,9 +339,13 @@ private:
 
     DH dh_ = {};
 
+    // lets callbacks from the mse worker tell if this handshake is gone
+    std::shared_ptr<bool> const alive_ = std::make_shared<bool>(true);
+
     DoneFunc on_done_;
 
     std::optional<tr_peer_id_t> peer_id_;
+    tr_interned_string client_name_;
 
     std::shared_ptr<tr_peerIo> peer_io_;
 
@@ -328,6 +363,9 @@ private:
     uint16_t pad_d_len_ = {};
     uint16_t ia_len_ = {};
 
+    // when an outgoing connect began; cleared once the peer's first bytes arrive
+    std::optional<std::chrono::steady_clock::time_point> connect_started_at_;
+
     bool have_read_anything_from_peer_ = false;
 
     bool have_sent_bittorrent_handshake_ = false;
@@ -10,8 +10,9 @@
 #endif
 
 #include <array>
+#include <cmath> // for std::exp(), std::log()
 #include <cstddef> // for size_t
-#include <cstdint> // for uint32_t
+#include <cstdint> // for uint32_t, uint64_t
 #include <ctime> // for time_t
 
 /**
@@ -19,6 +20,11 @@
  * happened over the last Seconds seconds. `tr_peer` uses it to count
  * how many bytes transferred to estimate the speed over the last
  * Seconds seconds.
+ *
+ * Each slot holds the running total as of the end of that second, so
+ * count() is the difference of two totals. Since the slots are in time
+ * order, finding the right one is a binary search instead of a scan.
+ * This assumes that `now` doesn't go backwards.
  */
 template<typename SizeType, std::size_t Seconds = 60>
 class tr_recentHistory
@@ -34,11 +40,12 @@ public:
         if (timestamps_[newest_] != now)
         {
             newest_ = (newest_ + 1) % Seconds;
+            evicted_ = totals_[newest_];
             timestamps_[newest_] = now;
-            count_[newest_] = {};
         }
 
-        count_[newest_] += n;
+        total_ += n;
+        totals_[newest_] = total_;
     }
 
     /**
@@ -48,22 +55,143 @@ public:
      */
     [[nodiscard]] constexpr SizeType count(time_t now, unsigned int age_sec) const
     {
-        auto sum = SizeType{};
         time_t const oldest = now - age_sec;
 
-        for (std::size_t i = 0; i < Seconds; ++i)
+        // find how many slots, oldest first, are too old to count
+        auto lo = std::size_t{ 0U };
+        auto hi = Seconds;
+        while (lo < hi)
         {
-            if (timestamps_[i] >= oldest)
+            auto const mid = lo + (hi - lo) / 2U;
+            if (timestamps_[slot(mid)] < oldest)
             {
-                sum += count_[i];
+                lo = mid + 1U;
+            }
+            else
+            {
+                hi = mid;
             }
         }
 
-        return sum;
+        auto const before = lo == 0U ? evicted_ : totals_[slot(lo - 1U)];
+        return static_cast<SizeType>(total_ - before);
     }
 
 private:
+    // @return the index of the `age`th slot, counting from the oldest
+    [[nodiscard]] constexpr std::size_t slot(std::size_t age) const noexcept
+    {
+        return (newest_ + 1U + age) % Seconds;
+    }
+
     std::array<time_t, Seconds> timestamps_ = {};
-    std::array<SizeType, Seconds> count_ = {};
+
+    // the running total as of the end of each slot.
+    // unsigned wraparound is fine; only the differences matter.
+    std::array<SizeType, Seconds> totals_ = {};
+
+    // the running total as of the newest slot that's been dropped
+    SizeType evicted_ = {};
+    SizeType total_ = {};
     uint32_t newest_ = 0;
 };
+
+/**
+ * A running total of what was added in the last `Slots * GranularityMSec`
+ * milliseconds, e.g. how many bytes a peer sent recently.
+ *
+ * Unlike tr_recentHistory the window is fixed, so the total can be kept
+ * up to date as things are added and as slots expire. add() and sum() are
+ * O(1) amortized: each slot is added to the total once and expired once.
+ */
+template<std::size_t Slots, uint64_t GranularityMSec>
+class tr_rollingSum
+{
+public:
+    static auto constexpr WindowMSec = Slots * GranularityMSec;
+
+    constexpr void add(uint64_t now_msec, uint64_t n) noexcept
+    {
+        if (n_slots_ == 0U || dates_[newest_] + GranularityMSec < now_msec)
+        {
+            if (n_slots_ == Slots)
+            {
+                expire_oldest();
+            }
+
+            newest_ = (newest_ + 1U) % Slots;
+            dates_[newest_] = now_msec;
+            sizes_[newest_] = 0U;
+            ++n_slots_;
+        }
+
+        sizes_[newest_] += n;
+        sum_ += n;
+    }
+
+    // @return the total added in the last `WindowMSec` milliseconds
+    [[nodiscard]] constexpr uint64_t sum(uint64_t now_msec) noexcept
+    {
+        while (n_slots_ > 0U && dates_[oldest()] + WindowMSec <= now_msec)
+        {
+            expire_oldest();
+        }
+
+        return sum_;
+    }
+
+private:
+    [[nodiscard]] constexpr std::size_t oldest() const noexcept
+    {
+        return (newest_ + Slots + 1U - n_slots_) % Slots;
+    }
+
+    constexpr void expire_oldest() noexcept
+    {
+        sum_ -= sizes_[oldest()];
+        --n_slots_;
+    }
+
+    std::array<uint64_t, Slots> dates_ = {};
+    std::array<uint64_t, Slots> sizes_ = {};
+    uint64_t sum_ = 0U;
+    std::size_t newest_ = 0U;
+    std::size_t n_slots_ = 0U;
+};
+
+/**
+ * An exponentially weighted moving average of a rate, e.g. bytes per second.
+ * Older samples fade away with the given half-life, so the estimate is
+ * smoother than a fixed window's but still follows changes. add() and
+ * get() are O(1) and it needs no history.
+ */
+class tr_ewmaRate
+{
+public:
+    explicit tr_ewmaRate(uint64_t half_life_msec) noexcept
+        : tau_msec_{ static_cast<double>(half_life_msec) / std::log(2.0) }
+    {
+    }
+
+    void add(uint64_t now_msec, uint64_t n) noexcept
+    {
+        rate_ = get(now_msec) + static_cast<double>(n) * 1000.0 / tau_msec_;
+        updated_at_msec_ = now_msec;
+    }
+
+    // @return the estimated rate per second
+    [[nodiscard]] double get(uint64_t now_msec) const noexcept
+    {
+        if (now_msec <= updated_at_msec_)
+        {
+            return rate_;
+        }
+
+        return rate_ * std::exp(-static_cast<double>(now_msec - updated_at_msec_) / tau_msec_);
+    }
+
+private:
+    double const tau_msec_;
+    double rate_ = 0.0;
+    uint64_t updated_at_msec_ = 0U;
+};
@@ -0,0 +1,103 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm> // std::copy_n()
+#include <cstddef> // size_t, std::byte
+#include <cstdint> // uint64_t
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include "libtransmission/transmission.h"
+
+#include "libtransmission/error.h"
+#include "libtransmission/file.h"
+#include "libtransmission/info-dict-cache.h"
+#include "libtransmission/log.h"
+#include "libtransmission/tr-strbuf.h"
+#include "libtransmission/utils.h" // _()
+
+namespace
+{
+bool readFromFile(std::string_view torrent_file, uint64_t offset, size_t len, std::byte* setme)
+{
+    tr_error* error = nullptr;
+    auto n_read = uint64_t{};
+    auto ok = false;
+
+    if (auto const fd = tr_sys_file_open(tr_pathbuf{ torrent_file }, TR_SYS_FILE_READ, 0, &error); fd != TR_BAD_SYS_FILE)
+    {
+        ok = tr_sys_file_read_at(fd, setme, len, offset, &n_read, &error) && n_read == len;
+        tr_sys_file_close(fd);
+    }
+
+    if (error != nullptr)
+    {
+        tr_logAddError(fmt::format(
+            _("Couldn't read '{path}': {error} ({error_code})"),
+            fmt::arg("path", torrent_file),
+            fmt::arg("error", error->message),
+            fmt::arg("error_code", error->code)));
+        tr_error_clear(&error);
+    }
+
+    return ok;
+}
+} // namespace
+
+tr_info_dict_cache::tr_info_dict_cache()
+{
+    info_dicts_.setPreErase([this](tr_torrent_id_t const& /*tor_id*/, std::vector<std::byte>& info_dict)
+                            { bytes_ -= std::size(info_dict); });
+}
+
+bool tr_info_dict_cache::read(
+    tr_torrent_id_t tor_id,
+    std::string_view torrent_file,
+    uint64_t info_dict_offset,
+    uint64_t info_dict_size,
+    uint64_t offset,
+    size_t len,
+    std::byte* setme)
+{
+    if (offset + len > info_dict_size)
+    {
+        return false;
+    }
+
+    if (info_dict_size > MaxInfoDictSize)
+    {
+        return readFromFile(torrent_file, info_dict_offset + offset, len, setme);
+    }
+
+    auto* info_dict = info_dicts_.get(tor_id);
+    if (info_dict == nullptr)
+    {
+        auto loaded = std::vector<std::byte>(info_dict_size);
+        if (!readFromFile(torrent_file, info_dict_offset, std::size(loaded), std::data(loaded)))
+        {
+            return false;
+        }
+
+        info_dict = &info_dicts_.add(tr_torrent_id_t{ tor_id });
+        *info_dict = std::move(loaded);
+        bytes_ += std::size(*info_dict);
+    }
+
+    std::copy_n(std::data(*info_dict) + offset, len, setme);
+    return true;
+}
+
+void tr_info_dict_cache::erase(tr_torrent_id_t tor_id)
+{
+    info_dicts_.erase(tor_id);
+}
+
+void tr_info_dict_cache::clear()
+{
+    info_dicts_.clear();
+}
@@ -0,0 +1,65 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <cstddef> // size_t, std::byte
+#include <cstdint> // uint64_t
+#include <string_view>
+#include <vector>
+
+#include "libtransmission/transmission.h" // tr_torrent_id_t
+
+#include "libtransmission/lru-cache.h"
+
+/**
+ * The raw info dicts of torrents that peers have recently asked for
+ * metadata pieces of, so that serving each ut_metadata request doesn't
+ * need to open and read the .torrent file again. This is shared by every
+ * torrent in the session and is only used in the session thread.
+ *
+ * The least recently used info dicts are dropped to make room for new ones,
+ * and all of them are dropped when the session is under memory pressure.
+ */
+class tr_info_dict_cache
+{
+public:
+    // Info dicts bigger than this are read from the .torrent file for each request
+    static auto constexpr MaxInfoDictSize = uint64_t{ 1024U * 1024U };
+
+    tr_info_dict_cache();
+
+    // Copy `len` bytes of a torrent's info dict, starting at `offset`, into `setme`.
+    // The info dict is `info_dict_size` bytes long and starts at `info_dict_offset` in `torrent_file`.
+    // @return false if it couldn't be read
+    [[nodiscard]] bool read(
+        tr_torrent_id_t tor_id,
+        std::string_view torrent_file,
+        uint64_t info_dict_offset,
+        uint64_t info_dict_size,
+        uint64_t offset,
+        size_t len,
+        std::byte* setme);
+
+    void erase(tr_torrent_id_t tor_id);
+
+    void clear();
+
+    // @return the number of bytes in the cached info dicts
+    [[nodiscard]] constexpr auto bytes() const noexcept
+    {
+        return bytes_;
+    }
+
+private:
+    static auto constexpr MaxInfoDicts = size_t{ 16U };
+
+    tr_lru_cache<tr_torrent_id_t, std::vector<std::byte>, MaxInfoDicts> info_dicts_;
+    uint64_t bytes_ = 0U;
+};
@@ -6,9 +6,12 @@
 #include <algorithm>
 #include <array>
 #include <cerrno>
+#include <memory>
 #include <optional>
+#include <string>
 #include <string_view>
 #include <utility> // std::move
+#include <vector>
 
 #include <fmt/core.h>
 
@@ -16,11 +19,13 @@
 
 #include "libtransmission/block-info.h" // tr_block_info
 #include "libtransmission/crypto-utils.h"
+#include "libtransmission/disk-writer.h"
 #include "libtransmission/error.h"
 #include "libtransmission/file.h"
 #include "libtransmission/inout.h"
 #include "libtransmission/log.h"
 #include "libtransmission/session.h"
+#include "libtransmission/storage.h"
 #include "libtransmission/torrent.h"
 #include "libtransmission/torrent-files.h"
 #include "libtransmission/tr-assert.h"
@@ -71,6 +76,39 @@ bool writeEntireBuf(tr_sys_file_t fd, uint64_t file_offset, uint8_t const* buf,
     return true;
 }
 
+// Like writeEntireBuf(), but gathers the data from several buffers.
+// `vecs` is used as scratch space and is undefined afterwards.
+bool writeEntireBufs(tr_sys_file_t fd, uint64_t file_offset, tr_sys_file_iovec* vecs, size_t n_vecs, tr_error** error)
+{
+    while (n_vecs > 0)
+    {
+        auto n_written = uint64_t{};
+
+        if (!tr_sys_file_write_at_v(fd, vecs, n_vecs, file_offset, &n_written, error))
+        {
+            return false;
+        }
+
+        file_offset += n_written;
+
+        // skip past the buffers that were written
+        while (n_vecs > 0 && n_written >= vecs->len)
+        {
+            n_written -= vecs->len;
+            ++vecs;
+            --n_vecs;
+        }
+
+        if (n_vecs > 0)
+        {
+            vecs->base = static_cast<uint8_t*>(vecs->base) + n_written;
+            vecs->len -= n_written;
+        }
+    }
+
+    return true;
+}
+
 enum class IoMode
 {
     Read,
@@ -80,9 +118,8 @@ enum class IoMode
 
 bool getFilename(tr_pathbuf& setme, tr_torrent const* tor, tr_file_index_t file_index, IoMode io_mode)
 {
-    if (auto found = tor->find_file(file_index); found)
+    if (tor->find_file_cached(file_index, setme))
     {
-        setme.assign(found->filename());
         return true;
     }
 
@@ -99,33 +136,79 @@ bool getFilename(tr_pathbuf& setme, tr_torrent const* tor, tr_file_index_t file_
     return true;
 }
 
-void readOrWriteBytes(
-    tr_session* session,
-    tr_torrent* tor,
-    IoMode io_mode,
-    tr_file_index_t file_index,
-    uint64_t file_offset,
-    uint8_t* buf,
-    size_t buflen,
-    tr_error** error)
+// Small files that a single call covers in full, i.e. ones that lie
+// inside a block or a span of blocks, are opened just for that call
+// instead of going through the open-files pool. Otherwise a torrent with
+// many tiny files would cycle every one of them through the pool, and
+// push out the files that are still being read or written.
+[[nodiscard]] constexpr bool isWholeFileInSpan(uint64_t file_offset, uint64_t n_bytes, uint64_t file_size, uint64_t span_len)
 {
-    TR_ASSERT(file_index < tor->file_count());
+    return file_offset == 0U && n_bytes == file_size && n_bytes < span_len;
+}
 
+// A file descriptor from the open-files pool, or one that was opened
+// for a single call and is closed when this goes out of scope.
+class FileRef
+{
+public:
+    FileRef() = default;
+
+    FileRef(tr_sys_file_t fd, bool owned) noexcept
+        : fd_{ fd }
+        , owned_{ owned }
+    {
+    }
+
+    FileRef(FileRef&& that) noexcept
+    {
+        *this = std::move(that);
+    }
+
+    FileRef& operator=(FileRef&& that) noexcept
+    {
+        std::swap(fd_, that.fd_);
+        std::swap(owned_, that.owned_);
+        return *this;
+    }
+
+    FileRef(FileRef const&) = delete;
+    FileRef& operator=(FileRef const&) = delete;
+
+    ~FileRef()
+    {
+        if (owned_ && fd_ != TR_BAD_SYS_FILE)
+        {
+            tr_sys_file_close(fd_);
+        }
+    }
+
+    [[nodiscard]] constexpr explicit operator bool() const noexcept
+    {
+        return fd_ != TR_BAD_SYS_FILE;
+    }
+
+    [[nodiscard]] constexpr auto operator*() const noexcept
+    {
+        return fd_;
+    }
+
+private:
+    tr_sys_file_t fd_ = TR_BAD_SYS_FILE;
+    bool owned_ = false;
+};
+
+FileRef getFd(tr_session* session, tr_torrent* tor, IoMode io_mode, tr_file_index_t file_index, bool uncached, tr_error** error)
+{
     bool const do_write = io_mode == IoMode::Write;
     auto const file_size = tor->file_size(file_index);
-    TR_ASSERT(file_size == 0 || file_offset < file_size);
-    TR_ASSERT(file_offset + buflen <= file_size);
 
-    if (file_size == 0)
+    if (auto const fd = session->openFiles().get(tor->id(), file_index, do_write); fd)
     {
-        return;
+        return { *fd, false };
     }
 
-    // --- Find the fd
-
-    auto fd = session->openFiles().get(tor->id(), file_index, do_write);
     auto filename = tr_pathbuf{};
-    if (!fd && !getFilename(filename, tor, file_index, io_mode))
+    if (!getFilename(filename, tor, file_index, io_mode))
     {
         auto const err = ENOENT;
         auto const msg = fmt::format(
@@ -134,22 +217,37 @@ void readOrWriteBytes(
             fmt::arg("error", tr_strerror(err)),
             fmt::arg("error_code", err));
         tr_error_set(error, err, msg);
-        return;
+        return {};
     }
 
-    if (!fd) // not in the cache, so open or create it now
+    // not in the cache, so open (and maybe create) the file now.
+    // if the preallocator is still working on this torrent, leave it to that.
+    auto const prealloc = (!do_write || !tor->file_is_wanted(file_index) ||
+                           session->preallocateFilesProgress(tor->id())) ?
+        TR_PREALLOCATE_NONE :
+        tor->session->preallocationMode();
+    auto const open = [&]()
     {
-        // open (and maybe create) the file
-        auto const prealloc = (!do_write || !tor->file_is_wanted(file_index)) ? TR_PREALLOCATE_NONE :
-                                                                                tor->session->preallocationMode();
-        fd = session->openFiles().get(tor->id(), file_index, do_write, filename, prealloc, file_size);
-        if (fd && do_write)
+        return uncached ? session->openFiles().open_uncached(filename, do_write, prealloc, file_size) :
+                          session->openFiles().get(tor->id(), file_index, do_write, filename, prealloc, file_size);
+    };
+    auto fd = open();
+    if (!fd && errno == ENOENT)
+    {
+        // the file may have moved since its location was cached, so look for it again
+        tor->forget_found_file(file_index);
+        if (getFilename(filename, tor, file_index, io_mode))
         {
-            // make a note that we just created a file
-            tor->session->add_file_created();
+            fd = open();
         }
     }
 
+    if (fd && do_write)
+    {
+        // make a note that we just created a file
+        tor->session->add_file_created();
+    }
+
     if (!fd) // couldn't create/open it either
     {
         auto const err = errno;
@@ -160,6 +258,118 @@ void readOrWriteBytes(
             fmt::arg("error_code", err));
         tr_error_set(error, err, msg);
         tr_logAddErrorTor(tor, std::move(msg));
+        return {};
+    }
+
+    return { *fd, uncached };
+}
+
+// When direct I/O is enabled, the data is kept in the session's cache,
+// so it doesn't need to stay in the OS' page cache as well.
+// This path uses the open-files pool, whose files aren't opened for direct I/O
+// because blocks aren't aligned to the disk's sectors.
+void dropFromPageCache(tr_session const* session, tr_sys_file_t fd, uint64_t file_offset, uint64_t n_bytes)
+{
+    if (session->isDirectIoEnabled())
+    {
+        tr_sys_file_advise(fd, file_offset, n_bytes, TR_SYS_FILE_ADVICE_DONT_NEED);
+    }
+}
+
+// Like readOrWriteBytes(), for torrents whose data is kept in a tr_storage backend
+void readOrWriteStorage(
+    tr_storage& storage,
+    tr_torrent* tor,
+    IoMode io_mode,
+    tr_file_index_t file_index,
+    uint64_t file_offset,
+    uint8_t* buf,
+    size_t buflen,
+    tr_error** error)
+{
+    auto ok = true;
+    tr_error* my_error = nullptr;
+
+    switch (io_mode)
+    {
+    case IoMode::Read:
+        ok = storage.read_at(tor, file_index, file_offset, buf, buflen, &my_error);
+        break;
+
+    case IoMode::Write:
+        {
+            auto const vec = tr_sys_file_iovec{ buf, buflen };
+            ok = storage.write_at(tor, file_index, file_offset, &vec, 1U, &my_error);
+        }
+        break;
+
+    case IoMode::Prefetch:
+        storage.prefetch(tor, file_index, file_offset, buflen);
+        break;
+    }
+
+    if (ok)
+    {
+        return;
+    }
+
+    if (my_error == nullptr)
+    {
+        tr_error_set_from_errno(&my_error, EIO);
+    }
+
+    tr_logAddErrorTor(
+        tor,
+        fmt::format(
+            io_mode == IoMode::Write ? _("Couldn't save '{path}': {error} ({error_code})") :
+                                       _("Couldn't read '{path}': {error} ({error_code})"),
+            fmt::arg("path", tor->file_subpath(file_index)),
+            fmt::arg("error", my_error->message),
+            fmt::arg("error_code", my_error->code)));
+    tr_error_propagate(error, &my_error);
+}
+
+void readOrWriteBytes(
+    tr_session* session,
+    tr_torrent* tor,
+    IoMode io_mode,
+    tr_file_index_t file_index,
+    uint64_t file_offset,
+    uint8_t* buf,
+    size_t buflen,
+    bool uncached,
+    tr_storage* storage,
+    tr_error** error)
+{
+    TR_ASSERT(file_index < tor->file_count());
+
+    auto const file_size = tor->file_size(file_index);
+    TR_ASSERT(file_size == 0 || file_offset < file_size);
+    TR_ASSERT(file_offset + buflen <= file_size);
+
+    if (file_size == 0)
+    {
+        return;
+    }
+
+    if (tor->file_is_padding(file_index))
+    {
+        if (io_mode == IoMode::Read)
+        {
+            std::fill_n(buf, buflen, uint8_t{});
+        }
+        return;
+    }
+
+    if (storage != nullptr)
+    {
+        readOrWriteStorage(*storage, tor, io_mode, file_index, file_offset, buf, buflen, error);
+        return;
+    }
+
+    auto const fd = getFd(session, tor, io_mode, file_index, uncached, error);
+    if (!fd)
+    {
         return;
     }
 
@@ -178,6 +388,7 @@ void readOrWriteBytes(
             tr_error_propagate(error, &my_error);
             return;
         }
+        dropFromPageCache(session, *fd, file_offset, buflen);
         break;
 
     case IoMode::Write:
@@ -193,6 +404,7 @@ void readOrWriteBytes(
             tr_error_propagate(error, &my_error);
             return;
         }
+        dropFromPageCache(session, *fd, file_offset, buflen);
         break;
 
     case IoMode::Prefetch:
@@ -201,6 +413,88 @@ void readOrWriteBytes(
     }
 }
 
+void writeBytesV(
+    tr_session* session,
+    tr_torrent* tor,
+    tr_file_index_t file_index,
+    uint64_t file_offset,
+    tr_sys_file_iovec* vecs,
+    size_t n_vecs,
+    bool uncached,
+    tr_storage* storage,
+    tr_error** error)
+{
+    TR_ASSERT(file_index < tor->file_count());
+
+    if (tor->file_size(file_index) == 0 || n_vecs == 0 || tor->file_is_padding(file_index))
+    {
+        return;
+    }
+
+    if (storage != nullptr)
+    {
+        if (tr_error* my_error = nullptr; !storage->write_at(tor, file_index, file_offset, vecs, n_vecs, &my_error))
+        {
+            if (my_error == nullptr)
+            {
+                tr_error_set_from_errno(&my_error, EIO);
+            }
+
+            tr_logAddErrorTor(
+                tor,
+                fmt::format(
+                    _("Couldn't save '{path}': {error} ({error_code})"),
+                    fmt::arg("path", tor->file_subpath(file_index)),
+                    fmt::arg("error", my_error->message),
+                    fmt::arg("error_code", my_error->code)));
+            tr_error_propagate(error, &my_error);
+        }
+        return;
+    }
+
+    auto const fd = getFd(session, tor, IoMode::Write, file_index, uncached, error);
+    if (!fd)
+    {
+        return;
+    }
+
+    auto n_bytes = uint64_t{};
+    for (size_t i = 0; i < n_vecs; ++i)
+    {
+        n_bytes += vecs[i].len;
+    }
+
+    if (tr_error* my_error = nullptr; !writeEntireBufs(*fd, file_offset, vecs, n_vecs, &my_error) && my_error != nullptr)
+    {
+        tr_logAddErrorTor(
+            tor,
+            fmt::format(
+                _("Couldn't save '{path}': {error} ({error_code})"),
+                fmt::arg("path", tor->file_subpath(file_index)),
+                fmt::arg("error", my_error->message),
+                fmt::arg("error_code", my_error->code)));
+        tr_error_propagate(error, &my_error);
+    }
+    else
+    {
+        dropFromPageCache(session, *fd, file_offset, n_bytes);
+    }
+}
+
+// @return the error's code
+int onPieceIoError(tr_torrent* tor, IoMode io_mode, tr_error** error)
+{
+    if (io_mode == IoMode::Write && tor->error != TR_STAT_LOCAL_ERROR)
+    {
+        tor->set_local_error((*error)->message);
+        tr_torrentStop(tor);
+    }
+
+    auto const error_code = (*error)->code;
+    tr_error_clear(error);
+    return error_code;
+}
+
 /* returns 0 on success, or an errno on failure */
 int readOrWritePiece(tr_torrent* tor, IoMode io_mode, tr_block_info::Location loc, uint8_t* buf, size_t buflen)
 {
@@ -210,25 +504,31 @@ int readOrWritePiece(tr_torrent* tor, IoMode io_mode, tr_block_info::Location lo
     }
 
     auto [file_index, file_offset] = tor->file_offset(loc);
+    auto const span_len = uint64_t{ buflen };
+    auto const storage = tor->storage();
 
     while (buflen != 0)
     {
-        uint64_t const bytes_this_pass = std::min(uint64_t{ buflen }, uint64_t{ tor->file_size(file_index) - file_offset });
+        auto const file_size = tor->file_size(file_index);
+        uint64_t const bytes_this_pass = std::min(uint64_t{ buflen }, uint64_t{ file_size - file_offset });
+        auto const uncached = isWholeFileInSpan(file_offset, bytes_this_pass, file_size, span_len);
 
         tr_error* error = nullptr;
-        readOrWriteBytes(tor->session, tor, io_mode, file_index, file_offset, buf, bytes_this_pass, &error);
+        readOrWriteBytes(
+            tor->session,
+            tor,
+            io_mode,
+            file_index,
+            file_offset,
+            buf,
+            bytes_this_pass,
+            uncached,
+            storage.get(),
+            &error);
 
         if (error != nullptr)
         {
-            if (io_mode == IoMode::Write && tor->error != TR_STAT_LOCAL_ERROR)
-            {
-                tor->set_local_error(error->message);
-                tr_torrentStop(tor);
-            }
-
-            auto const error_code = error->code;
-            tr_error_clear(&error);
-            return error_code;
+            return onPieceIoError(tor, io_mode, &error);
         }
 
         if (buf != nullptr)
@@ -244,12 +544,115 @@ int readOrWritePiece(tr_torrent* tor, IoMode io_mode, tr_block_info::Location lo
     return 0;
 }
 
-std::optional<tr_sha1_digest_t> recalculateHash(tr_torrent* tor, tr_piece_index_t piece)
+// Split the buffers in `vecs` at file boundaries, calling
+// `func(file_index, file_offset, std::vector<tr_sys_file_iovec>&)`
+// once per file. Iteration stops early if `func` returns false.
+template<typename Func>
+void forEachFile(tr_torrent const* tor, tr_block_info::Location loc, tr_sys_file_iovec const* vecs, size_t n_vecs, Func&& func)
+{
+    auto [file_index, file_offset] = tor->file_offset(loc);
+
+    auto todo = std::vector<tr_sys_file_iovec>(vecs, vecs + n_vecs);
+    auto todo_begin = std::begin(todo);
+    auto pass = std::vector<tr_sys_file_iovec>{};
+    pass.reserve(std::size(todo));
+
+    while (todo_begin != std::end(todo))
+    {
+        pass.clear();
+
+        for (auto bytes_left = uint64_t{ tor->file_size(file_index) - file_offset };
+             bytes_left > 0U && todo_begin != std::end(todo);)
+        {
+            if (todo_begin->len <= bytes_left)
+            {
+                bytes_left -= todo_begin->len;
+                pass.emplace_back(*todo_begin++);
+            }
+            else // this buffer straddles the end of the file
+            {
+                pass.push_back({ todo_begin->base, bytes_left });
+                todo_begin->base = static_cast<uint8_t*>(todo_begin->base) + bytes_left;
+                todo_begin->len -= bytes_left;
+                bytes_left = 0U;
+            }
+        }
+
+        if (!func(file_index, file_offset, pass))
+        {
+            return;
+        }
+
+        ++file_index;
+        file_offset = 0;
+    }
+}
+
+/* returns 0 on success, or an errno on failure */
+int writePieceV(tr_torrent* tor, tr_block_info::Location loc, tr_sys_file_iovec const* vecs, size_t n_vecs)
+{
+    if (loc.piece >= tor->piece_count())
+    {
+        return EINVAL;
+    }
+
+    auto err = 0;
+    auto const storage = tor->storage();
+    auto span_len = uint64_t{};
+    for (size_t i = 0; i < n_vecs; ++i)
+    {
+        span_len += vecs[i].len;
+    }
+
+    forEachFile(
+        tor,
+        loc,
+        vecs,
+        n_vecs,
+        [tor, &err, span_len, &storage](
+            tr_file_index_t file_index,
+            uint64_t file_offset,
+            std::vector<tr_sys_file_iovec>& pass)
+        {
+            auto pass_len = uint64_t{};
+            for (auto const& vec : pass)
+            {
+                pass_len += vec.len;
+            }
+            auto const uncached = isWholeFileInSpan(file_offset, pass_len, tor->file_size(file_index), span_len);
+
+            tr_error* error = nullptr;
+            writeBytesV(
+                tor->session,
+                tor,
+                file_index,
+                file_offset,
+                std::data(pass),
+                std::size(pass),
+                uncached,
+                storage.get(),
+                &error);
+
+            if (error != nullptr)
+            {
+                err = onPieceIoError(tor, IoMode::Write, &error);
+                return false;
+            }
+
+            return true;
+        });
+
+    return err;
+}
+
+// Walk through a piece's data, one block at a time, consulting the cache first.
+// `func` is called with each run of bytes that belongs to `piece`.
+template<typename Func>
+[[nodiscard]] bool walkPiece(tr_torrent* tor, tr_piece_index_t piece, Func&& func)
 {
     TR_ASSERT(tor != nullptr);
     TR_ASSERT(piece < tor->piece_count());
 
-    auto sha = tr_sha1::create();
     auto buffer = std::array<uint8_t, tr_block_info::BlockSize>{};
 
     auto& cache = tor->session->cache;
@@ -262,7 +665,7 @@ std::optional<tr_sha1_digest_t> recalculateHash(tr_torrent* tor, tr_piece_index_
         auto const block_len = tor->block_size(block);
         if (auto const success = cache->read_block(tor, block_loc, block_len, std::data(buffer)) == 0; !success)
         {
-            return {};
+            return false;
         }
 
         auto begin = std::data(buffer);
@@ -278,12 +681,24 @@ std::optional<tr_sha1_digest_t> recalculateHash(tr_torrent* tor, tr_piece_index_
             end -= (block_loc.byte + block_len - end_byte);
         }
 
-        sha->add(begin, end - begin);
+        func(begin, end);
         n_bytes_checked += (end - begin);
     }
 
     TR_ASSERT(tor->piece_size(piece) == n_bytes_checked);
-    return sha->finish();
+    return true;
+}
+
+std::optional<tr_sha1_digest_t> recalculateHash(tr_torrent* tor, tr_piece_index_t piece)
+{
+    auto sha = tr_sha1_context{};
+
+    if (!walkPiece(tor, piece, [&sha](uint8_t const* begin, uint8_t const* end) { sha.add(begin, end - begin); }))
+    {
+        return {};
+    }
+
+    return sha.finish();
 }
 
 } // namespace
@@ -303,8 +718,73 @@ int tr_ioWrite(tr_torrent* tor, tr_block_info::Location const& loc, size_t len,
     return readOrWritePiece(tor, IoMode::Write, loc, const_cast<uint8_t*>(writeme), len);
 }
 
+int tr_ioWrite(tr_torrent* tor, tr_block_info::Location const& loc, tr_sys_file_iovec const* vecs, size_t n_vecs)
+{
+    return writePieceV(tor, loc, vecs, n_vecs);
+}
+
+std::optional<std::vector<tr_disk_writer::Write>> tr_ioPlanWrite(
+    tr_torrent const* tor,
+    tr_block_info::Location const& loc,
+    tr_sys_file_iovec const* vecs,
+    size_t n_vecs)
+{
+    // the disk writer only knows about the local filesystem
+    if (loc.piece >= tor->piece_count() || tor->storage())
+    {
+        return {};
+    }
+
+    auto writes = std::vector<tr_disk_writer::Write>{};
+    auto ok = true;
+
+    forEachFile(
+        tor,
+        loc,
+        vecs,
+        n_vecs,
+        [tor, &writes, &ok](tr_file_index_t file_index, uint64_t file_offset, std::vector<tr_sys_file_iovec>& pass)
+        {
+            if (std::empty(pass) || tor->file_size(file_index) == 0U || tor->file_is_padding(file_index))
+            {
+                return true;
+            }
+
+            auto const found = tor->find_file(file_index);
+            if (!found)
+            {
+                ok = false;
+                return false;
+            }
+
+            writes.push_back({ std::string{ found->filename().sv() }, file_offset, std::move(pass) });
+            pass = {};
+            return true;
+        });
+
+    if (!ok)
+    {
+        return {};
+    }
+
+    return writes;
+}
+
 bool tr_ioTestPiece(tr_torrent* tor, tr_piece_index_t piece)
 {
     auto const hash = recalculateHash(tor, piece);
     return hash && *hash == tor->piece_hash(piece);
 }
+
+std::optional<std::vector<uint8_t>> tr_ioReadPiece(tr_torrent* tor, tr_piece_index_t piece)
+{
+    auto data = std::vector<uint8_t>{};
+    data.reserve(tor->piece_size(piece));
+
+    if (!walkPiece(tor, piece, [&data](uint8_t const* begin, uint8_t const* end) { data.insert(std::end(data), begin, end); }))
+    {
+        return {};
+    }
+
+    return data;
+}
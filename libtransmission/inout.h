@@ -11,10 +11,13 @@
 
 #include <cstddef> // size_t
 #include <cstdint> // uint8_t, uint32_t
+#include <optional>
+#include <vector>
 
 #include "libtransmission/transmission.h"
 
 #include "libtransmission/block-info.h"
+#include "libtransmission/disk-writer.h"
 
 struct tr_torrent;
 
@@ -37,9 +40,38 @@ int tr_ioPrefetch(tr_torrent* tor, tr_block_info::Location const& loc, size_t le
  */
 [[nodiscard]] int tr_ioWrite(struct tr_torrent* tor, tr_block_info::Location const& loc, size_t len, uint8_t const* writeme);
 
+/**
+ * Like tr_ioWrite(), but gathers the data from several buffers,
+ * e.g. to write a run of cached blocks without copying them together first.
+ * @return 0 on success, or an errno value on failure.
+ */
+[[nodiscard]] int tr_ioWrite(
+    struct tr_torrent* tor,
+    tr_block_info::Location const& loc,
+    struct tr_sys_file_iovec const* vecs,
+    size_t n_vecs);
+
+/**
+ * Split a gathered write at file boundaries, e.g. to hand it to a tr_disk_writer.
+ * Padding files are left out, since they're never written to disk.
+ * @return the writes, or an empty optional if any of the files haven't been created yet
+ *         or the torrent's data is kept in a tr_storage backend.
+ */
+[[nodiscard]] std::optional<std::vector<tr_disk_writer::Write>> tr_ioPlanWrite(
+    tr_torrent const* tor,
+    tr_block_info::Location const& loc,
+    struct tr_sys_file_iovec const* vecs,
+    size_t n_vecs);
+
 /**
  * @brief Test to see if the piece matches its metainfo's SHA1 checksum.
  */
 bool tr_ioTestPiece(tr_torrent* tor, tr_piece_index_t piece);
 
+/**
+ * @brief Read a piece's data, e.g. to check its checksum somewhere else.
+ * @return the piece's data, or an empty optional on failure.
+ */
+[[nodiscard]] std::optional<std::vector<uint8_t>> tr_ioReadPiece(tr_torrent* tor, tr_piece_index_t piece);
+
 /* @} */
@@ -0,0 +1,294 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm> // std::max(), std::min()
+#include <chrono>
+#include <cstddef> // size_t
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility> // std::exchange()
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+#ifdef __linux__
+#include <sys/sysmacros.h> // major(), minor()
+#endif
+
+#include <fmt/core.h>
+
+#include "libtransmission/io-scheduler.h"
+#include "libtransmission/metrics.h"
+
+using namespace std::literals;
+
+namespace
+{
+[[nodiscard]] std::string device_name(tr_io_scheduler::DeviceId id)
+{
+#ifdef __linux__
+    auto const dev = static_cast<dev_t>(id);
+    return fmt::format("{:d}:{:d}", major(dev), minor(dev));
+#else
+    return fmt::format("{:d}", id);
+#endif
+}
+
+[[nodiscard]] std::string_view class_name(size_t cls)
+{
+    static auto constexpr Names = std::array<std::string_view, 4U>{ "read"sv, "flush"sv, "prefetch"sv, "verify"sv };
+    return Names[cls];
+}
+} // namespace
+
+// ---
+
+tr_io_scheduler::Ticket& tr_io_scheduler::Ticket::operator=(Ticket&& that) noexcept
+{
+    if (this != &that)
+    {
+        reset();
+        scheduler_ = std::exchange(that.scheduler_, nullptr);
+        device_ = that.device_;
+        cls_ = that.cls_;
+        asked_at_ = that.asked_at_;
+    }
+
+    return *this;
+}
+
+void tr_io_scheduler::Ticket::reset()
+{
+    if (auto* const scheduler = std::exchange(scheduler_, nullptr); scheduler != nullptr)
+    {
+        scheduler->finish(device_, cls_, asked_at_);
+    }
+}
+
+// ---
+
+tr_io_scheduler::Device::Device(DeviceId id)
+    : name{ device_name(id) }
+{
+}
+
+tr_io_scheduler::DeviceId tr_io_scheduler::device_of([[maybe_unused]] std::string_view path)
+{
+#ifndef _WIN32
+    // A download dir may not have been created yet,
+    // so fall back to the closest folder that does exist
+    auto dir = std::string{ path };
+    while (!std::empty(dir))
+    {
+        if (struct stat sb = {}; stat(dir.c_str(), &sb) == 0)
+        {
+            return static_cast<DeviceId>(sb.st_dev);
+        }
+
+        auto const pos = dir.find_last_of('/');
+        if (pos == std::string::npos || dir == "/"sv)
+        {
+            break;
+        }
+
+        dir.resize(std::max(pos, size_t{ 1U }));
+    }
+#endif
+
+    return {};
+}
+
+tr_io_scheduler::Device& tr_io_scheduler::device(DeviceId id)
+{
+    return devices_.try_emplace(id, id).first->second;
+}
+
+void tr_io_scheduler::set_limits(Limits limits)
+{
+    auto const lock = std::lock_guard(mutex_);
+    limits_ = limits;
+    cv_.notify_all();
+}
+
+void tr_io_scheduler::refill(Device& dev, Clock::time_point now) const
+{
+    auto const secs = std::chrono::duration<double>{ now - dev.refilled_at }.count();
+    dev.refilled_at = now;
+
+    auto const max_bytes = static_cast<double>(limits_.bytes_per_second);
+    auto const max_ops = static_cast<double>(limits_.ops_per_second);
+    dev.byte_tokens = std::min(dev.byte_tokens + secs * max_bytes, max_bytes);
+    dev.op_tokens = std::min(dev.op_tokens + secs * max_ops, max_ops);
+}
+
+bool tr_io_scheduler::has_budget(Device& dev, Clock::time_point now) const
+{
+    refill(dev, now);
+
+    // An I/O may overdraw the byte budget. The ones after it wait until it's paid back.
+    return (limits_.bytes_per_second == 0U || dev.byte_tokens > 0) && (limits_.ops_per_second == 0U || dev.op_tokens >= 1);
+}
+
+bool tr_io_scheduler::is_turn(Device const& dev, Class cls, Clock::time_point now)
+{
+    if (!is_background(cls))
+    {
+        return true;
+    }
+
+    for (size_t higher = 0U; higher < static_cast<size_t>(cls); ++higher)
+    {
+        if (auto const& state = dev.classes[higher]; state.n_active > 0U || now - state.last_done < YieldWindow)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool tr_io_scheduler::may_start(DeviceId id, Class cls)
+{
+    auto const lock = std::lock_guard(mutex_);
+    auto const now = Clock::now();
+    auto& dev = device(id);
+    return is_turn(dev, cls, now) && (!is_background(cls) || has_budget(dev, now));
+}
+
+tr_io_scheduler::Ticket tr_io_scheduler::begin(DeviceId id, Class cls, uint64_t n_bytes)
+{
+    auto const lock = std::lock_guard(mutex_);
+    auto const now = Clock::now();
+    auto& dev = device(id);
+    refill(dev, now);
+    return start(dev, id, cls, n_bytes, now);
+}
+
+tr_io_scheduler::Ticket tr_io_scheduler::acquire(DeviceId id, Class cls, uint64_t n_bytes)
+{
+    auto lock = std::unique_lock(mutex_);
+    auto const asked_at = Clock::now();
+    auto& dev = device(id);
+    auto& state = dev.classes[static_cast<size_t>(cls)];
+
+    ++state.n_waiting;
+    for (;;)
+    {
+        auto const now = Clock::now();
+        auto const turn = now >= asked_at + MaxYield || is_turn(dev, cls, now);
+        if (turn && (!is_background(cls) || has_budget(dev, now)))
+        {
+            break;
+        }
+
+        // Yield windows and budgets free up as time passes, not just
+        // when an I/O finishes, so look again after a little while
+        cv_.wait_for(lock, PollInterval);
+    }
+    --state.n_waiting;
+
+    return start(dev, id, cls, n_bytes, asked_at);
+}
+
+tr_io_scheduler::Ticket tr_io_scheduler::start(
+    Device& dev,
+    DeviceId id,
+    Class cls,
+    uint64_t n_bytes,
+    Clock::time_point asked_at)
+{
+    if (is_background(cls))
+    {
+        if (limits_.bytes_per_second != 0U)
+        {
+            dev.byte_tokens -= static_cast<double>(n_bytes);
+        }
+
+        if (limits_.ops_per_second != 0U)
+        {
+            dev.op_tokens -= 1;
+        }
+    }
+
+    auto& state = dev.classes[static_cast<size_t>(cls)];
+    ++state.n_active;
+    ++state.n_ops;
+    state.n_bytes += n_bytes;
+    return Ticket{ this, id, cls, asked_at };
+}
+
+void tr_io_scheduler::finish(DeviceId id, Class cls, Clock::time_point asked_at)
+{
+    auto const lock = std::lock_guard(mutex_);
+    auto const now = Clock::now();
+    auto& state = device(id).classes[static_cast<size_t>(cls)];
+    --state.n_active;
+    state.last_done = now;
+    state.latency.observe(std::chrono::duration_cast<std::chrono::microseconds>(now - asked_at));
+    cv_.notify_all();
+}
+
+void tr_io_scheduler::write_metrics(std::string& out) const
+{
+    using Metrics = tr_metrics;
+
+    auto const lock = std::lock_guard(mutex_);
+
+    auto const labels = [](Device const& dev, size_t cls)
+    {
+        return fmt::format("device=\"{:s}\",class=\"{:s}\"", dev.name, class_name(cls));
+    };
+
+    Metrics::write_header(
+        out,
+        "transmission_io_queue_depth"sv,
+        "gauge"sv,
+        "Disk I/Os that are waiting for their turn or running, per device and class."sv);
+    for (auto const& [id, dev] : devices_)
+    {
+        for (size_t cls = 0U; cls < NClasses; ++cls)
+        {
+            auto const& state = dev.classes[cls];
+            Metrics::write_sample(
+                out,
+                "transmission_io_queue_depth"sv,
+                labels(dev, cls),
+                uint64_t{ state.n_active + state.n_waiting });
+        }
+    }
+
+    Metrics::write_header(out, "transmission_io_operations_total"sv, "counter"sv, "Disk I/Os, per device and class."sv);
+    for (auto const& [id, dev] : devices_)
+    {
+        for (size_t cls = 0U; cls < NClasses; ++cls)
+        {
+            Metrics::write_sample(out, "transmission_io_operations_total"sv, labels(dev, cls), dev.classes[cls].n_ops);
+        }
+    }
+
+    Metrics::write_header(out, "transmission_io_bytes_total"sv, "counter"sv, "Bytes read or written, per device and class."sv);
+    for (auto const& [id, dev] : devices_)
+    {
+        for (size_t cls = 0U; cls < NClasses; ++cls)
+        {
+            Metrics::write_sample(out, "transmission_io_bytes_total"sv, labels(dev, cls), dev.classes[cls].n_bytes);
+        }
+    }
+
+    Metrics::write_header(
+        out,
+        "transmission_io_duration_seconds"sv,
+        "histogram"sv,
+        "Time from asking for a disk I/O to finishing it, including the wait for its turn, per device and class."sv);
+    for (auto const& [id, dev] : devices_)
+    {
+        for (size_t cls = 0U; cls < NClasses; ++cls)
+        {
+            dev.classes[cls].latency.write(out, "transmission_io_duration_seconds"sv, labels(dev, cls));
+        }
+    }
+}
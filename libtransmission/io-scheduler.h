@@ -0,0 +1,189 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef> // size_t
+#include <cstdint> // uint8_t, uint64_t
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility> // std::move()
+
+#include "libtransmission/metrics.h"
+
+/**
+ * Arbitrates the disk I/O that the session makes on each physical device,
+ * so that a recheck or a read-ahead doesn't starve uploads from the same disk.
+ *
+ * I/O is sorted into classes. Reads for peers and cache flushes always start
+ * right away, since a peer or the cache is waiting for them. Prefetches and
+ * verification are background work: they yield to any higher class that has
+ * used the device in the last `YieldWindow`, and they share an optional
+ * per-device budget of bytes and operations per second.
+ *
+ * Each I/O holds a Ticket from when it's asked for until it's done, which
+ * is what the per-device queue depth and latency metrics are made from.
+ *
+ * Safe to use from any thread.
+ */
+class tr_io_scheduler
+{
+public:
+    using DeviceId = uint64_t;
+
+    // highest priority first
+    enum class Class : uint8_t
+    {
+        Read, // reading blocks that peers asked for
+        Flush, // writing the cache's blocks
+        Prefetch, // reading ahead of peers' requests
+        Verify // checking local data
+    };
+
+    // How long background I/O waits after a higher class has used the device
+    static auto constexpr YieldWindow = std::chrono::milliseconds{ 50 };
+
+    // The longest that background I/O yields to higher classes before it
+    // goes anyway, so that a busy seed still makes progress on a recheck.
+    // It still waits for the budget.
+    static auto constexpr MaxYield = std::chrono::milliseconds{ 250 };
+
+    // Zero means no limit
+    struct Limits
+    {
+        uint64_t bytes_per_second = 0;
+        uint64_t ops_per_second = 0;
+    };
+
+    // One I/O on a device. It's done when the ticket is destroyed or reset.
+    class Ticket
+    {
+    public:
+        Ticket() = default;
+
+        ~Ticket()
+        {
+            reset();
+        }
+
+        Ticket(Ticket const&) = delete;
+        Ticket& operator=(Ticket const&) = delete;
+
+        Ticket(Ticket&& that) noexcept
+        {
+            *this = std::move(that);
+        }
+
+        Ticket& operator=(Ticket&& that) noexcept;
+
+        void reset();
+
+    private:
+        friend class tr_io_scheduler;
+
+        Ticket(tr_io_scheduler* scheduler, DeviceId device, Class cls, std::chrono::steady_clock::time_point asked_at)
+            : scheduler_{ scheduler }
+            , device_{ device }
+            , cls_{ cls }
+            , asked_at_{ asked_at }
+        {
+        }
+
+        tr_io_scheduler* scheduler_ = nullptr;
+        DeviceId device_ = {};
+        Class cls_ = Class::Read;
+        std::chrono::steady_clock::time_point asked_at_;
+    };
+
+    tr_io_scheduler() = default;
+    tr_io_scheduler(tr_io_scheduler const&) = delete;
+    tr_io_scheduler(tr_io_scheduler&&) = delete;
+    tr_io_scheduler& operator=(tr_io_scheduler const&) = delete;
+    tr_io_scheduler& operator=(tr_io_scheduler&&) = delete;
+
+    // @return the device that `path` is on. Paths that can't be looked up
+    // are all lumped together as device 0.
+    [[nodiscard]] static DeviceId device_of(std::string_view path);
+
+    // Set the per-device budget for background I/O. Since acquire() waits
+    // for it, it shouldn't be so small that a single read takes seconds.
+    void set_limits(Limits limits);
+
+    // Start an I/O now, regardless of its class, e.g. on a thread that mustn't block.
+    // It still counts against the background budget if it's background I/O.
+    [[nodiscard]] Ticket begin(DeviceId device, Class cls, uint64_t n_bytes);
+
+    // Block until it's this class' turn on the device, then start an I/O
+    [[nodiscard]] Ticket acquire(DeviceId device, Class cls, uint64_t n_bytes);
+
+    // @return true if acquire() wouldn't have to wait
+    [[nodiscard]] bool may_start(DeviceId device, Class cls);
+
+    // Append the per-device metrics in the Prometheus text format
+    void write_metrics(std::string& out) const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    static auto constexpr NClasses = size_t{ 4U };
+
+    // how often acquire() checks whether it's its turn while the device is busy
+    static auto constexpr PollInterval = std::chrono::milliseconds{ 10 };
+
+    [[nodiscard]] static constexpr bool is_background(Class cls) noexcept
+    {
+        return cls == Class::Prefetch || cls == Class::Verify;
+    }
+
+    struct ClassState
+    {
+        size_t n_active = 0; // tickets that are held
+        size_t n_waiting = 0; // callers blocked in acquire()
+        Clock::time_point last_done = {};
+        uint64_t n_ops = 0;
+        uint64_t n_bytes = 0;
+        tr_metrics::Histogram latency;
+    };
+
+    struct Device
+    {
+        explicit Device(DeviceId id);
+
+        std::string name;
+        std::array<ClassState, NClasses> classes;
+
+        // the background budget, as token buckets that hold up to a second's worth
+        double byte_tokens = 0;
+        double op_tokens = 0;
+        Clock::time_point refilled_at = {};
+    };
+
+    [[nodiscard]] Device& device(DeviceId id);
+
+    void refill(Device& dev, Clock::time_point now) const;
+
+    [[nodiscard]] bool has_budget(Device& dev, Clock::time_point now) const;
+    [[nodiscard]] static bool is_turn(Device const& dev, Class cls, Clock::time_point now);
+
+    Ticket start(Device& dev, DeviceId id, Class cls, uint64_t n_bytes, Clock::time_point asked_at);
+    void finish(DeviceId id, Class cls, Clock::time_point asked_at);
+
+    mutable std::mutex mutex_;
+
+    // notified when an I/O finishes or the limits change
+    std::condition_variable cv_;
+
+    std::map<DeviceId, Device> devices_;
+    Limits limits_;
+};
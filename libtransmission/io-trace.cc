@@ -0,0 +1,273 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <cerrno> // EINVAL
+#include <chrono>
+#include <cstdint> // uint8_t, uint64_t
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility> // std::move()
+#include <vector>
+
+#include "libtransmission/transmission.h"
+
+#include "libtransmission/error.h"
+#include "libtransmission/file.h"
+#include "libtransmission/io-trace.h"
+#include "libtransmission/torrent.h"
+#include "libtransmission/tr-strbuf.h"
+#include "libtransmission/utils.h" // tr_file_read(), tr_strv_starts_with()
+
+using namespace std::literals;
+
+namespace
+{
+// Reads the varints of a record, remembering if it ran off the end
+class VarintReader
+{
+public:
+    explicit VarintReader(std::string_view buf)
+        : buf_{ buf }
+    {
+    }
+
+    [[nodiscard]] uint64_t next() noexcept
+    {
+        auto val = uint64_t{};
+        for (auto shift = 0U; shift < 64U; shift += 7U)
+        {
+            if (std::empty(buf_))
+            {
+                ok_ = false;
+                return {};
+            }
+
+            auto const ch = static_cast<uint8_t>(buf_.front());
+            buf_.remove_prefix(1U);
+            val |= uint64_t{ ch & 0x7FU } << shift;
+            if ((ch & 0x80U) == 0U)
+            {
+                return val;
+            }
+        }
+
+        ok_ = false;
+        return {};
+    }
+
+    [[nodiscard]] constexpr auto ok() const noexcept
+    {
+        return ok_;
+    }
+
+    [[nodiscard]] constexpr auto remaining() const noexcept
+    {
+        return buf_;
+    }
+
+private:
+    std::string_view buf_;
+    bool ok_ = true;
+};
+} // namespace
+
+bool tr_io_trace::open(std::string_view filename, tr_error** error)
+{
+    close();
+
+    auto const path = tr_pathbuf{ filename };
+    fd_ = tr_sys_file_open(path, TR_SYS_FILE_WRITE | TR_SYS_FILE_CREATE | TR_SYS_FILE_TRUNCATE, 0600, error);
+    if (fd_ == TR_BAD_SYS_FILE)
+    {
+        return false;
+    }
+
+    buf_.assign(Magic);
+    started_at_ = std::chrono::steady_clock::now();
+    last_time_ = {};
+    recorded_torrents_.clear();
+    return true;
+}
+
+void tr_io_trace::close()
+{
+    if (is_open())
+    {
+        flush();
+        tr_sys_file_close(fd_);
+        fd_ = TR_BAD_SYS_FILE;
+    }
+
+    buf_.clear();
+}
+
+void tr_io_trace::record(Op op, tr_torrent const* tor, uint64_t byte, uint64_t length)
+{
+    if (!is_open())
+    {
+        return;
+    }
+
+    auto const tor_id = tor->id();
+    if (recorded_torrents_.count(tor_id) == 0U)
+    {
+        auto layout = Layout{ tor_id, tor->piece_size(), {} };
+        layout.file_sizes.reserve(tor->file_count());
+        for (tr_file_index_t file = 0, n = tor->file_count(); file < n; ++file)
+        {
+            layout.file_sizes.push_back(tor->file_size(file));
+        }
+        record(layout);
+    }
+
+    auto const [file, offset] = tor->file_offset(tor->byte_loc(byte));
+    auto const time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started_at_);
+    record(Event{ op, time, tor_id, file, offset, length });
+}
+
+void tr_io_trace::record(Layout const& layout)
+{
+    if (!is_open())
+    {
+        return;
+    }
+
+    recorded_torrents_.insert(layout.tor_id);
+
+    buf_.push_back(static_cast<char>(Op::Torrent));
+    add_varint(layout.tor_id);
+    add_varint(layout.piece_size);
+    add_varint(std::size(layout.file_sizes));
+    for (auto const size : layout.file_sizes)
+    {
+        add_varint(size);
+    }
+
+    if (std::size(buf_) >= FlushThreshold)
+    {
+        flush();
+    }
+}
+
+void tr_io_trace::record(Event const& event)
+{
+    if (!is_open())
+    {
+        return;
+    }
+
+    // events are recorded in order, but be safe if the clock isn't
+    auto const delta = event.time > last_time_ ? event.time - last_time_ : std::chrono::microseconds{};
+    last_time_ += delta;
+
+    buf_.push_back(static_cast<char>(event.op));
+    add_varint(delta.count());
+    add_varint(event.tor_id);
+    add_varint(event.file);
+    add_varint(event.offset);
+    add_varint(event.length);
+
+    if (std::size(buf_) >= FlushThreshold)
+    {
+        flush();
+    }
+}
+
+void tr_io_trace::add_varint(uint64_t val)
+{
+    while (val >= 0x80U)
+    {
+        buf_.push_back(static_cast<char>((val & 0x7FU) | 0x80U));
+        val >>= 7U;
+    }
+
+    buf_.push_back(static_cast<char>(val));
+}
+
+void tr_io_trace::flush()
+{
+    if (!std::empty(buf_))
+    {
+        // a trace is a diagnostic, so just stop tracing if the disk is full
+        if (!tr_sys_file_write(fd_, std::data(buf_), std::size(buf_), nullptr))
+        {
+            tr_sys_file_close(fd_);
+            fd_ = TR_BAD_SYS_FILE;
+        }
+
+        buf_.clear();
+    }
+}
+
+std::optional<tr_io_trace::Trace> tr_io_trace::load(std::string_view filename, tr_error** error)
+{
+    auto contents = std::vector<char>{};
+    if (!tr_file_read(filename, contents, error))
+    {
+        return {};
+    }
+
+    auto buf = std::string_view{ std::data(contents), std::size(contents) };
+    if (!tr_strv_starts_with(buf, Magic))
+    {
+        tr_error_set(error, EINVAL, "not an I/O trace"sv);
+        return {};
+    }
+    buf.remove_prefix(std::size(Magic));
+
+    auto trace = Trace{};
+    auto time = std::chrono::microseconds{};
+    while (!std::empty(buf))
+    {
+        auto const op = static_cast<Op>(buf.front());
+        auto reader = VarintReader{ buf.substr(1U) };
+
+        if (op == Op::Torrent)
+        {
+            auto layout = Layout{};
+            layout.tor_id = static_cast<tr_torrent_id_t>(reader.next());
+            layout.piece_size = static_cast<uint32_t>(reader.next());
+            auto const n_files = reader.next();
+            for (uint64_t i = 0U; reader.ok() && i < n_files; ++i)
+            {
+                layout.file_sizes.push_back(reader.next());
+            }
+
+            if (!reader.ok())
+            {
+                break;
+            }
+
+            trace.torrents.emplace_back(std::move(layout));
+        }
+        else if (op <= Op::FlushTorrent)
+        {
+            auto event = Event{};
+            event.op = op;
+            time += std::chrono::microseconds{ reader.next() };
+            event.time = time;
+            event.tor_id = static_cast<tr_torrent_id_t>(reader.next());
+            event.file = static_cast<tr_file_index_t>(reader.next());
+            event.offset = reader.next();
+            event.length = reader.next();
+
+            if (!reader.ok())
+            {
+                break;
+            }
+
+            trace.events.push_back(event);
+        }
+        else
+        {
+            break; // corrupt
+        }
+
+        buf = reader.remaining();
+    }
+
+    return trace;
+}
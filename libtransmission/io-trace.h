@@ -0,0 +1,126 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <chrono>
+#include <cstdint> // uint8_t, uint32_t, uint64_t
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+#include "libtransmission/transmission.h" // tr_file_index_t, tr_torrent_id_t
+
+#include "libtransmission/file.h" // tr_sys_file_t
+
+struct tr_error;
+struct tr_torrent;
+
+/**
+ * Records the block-level requests that reach the Cache to a compact binary
+ * log, so that a real workload can be replayed later against other cache
+ * sizes, open file limits, and write backends. See tests/io-replay.
+ *
+ * The log starts with `Magic`. Each record after it is an Op byte and then
+ * LEB128 varints. A torrent's layout is recorded before its first event:
+ *
+ *   Torrent: torrent id, piece size, file count, then each file's size
+ *
+ * and each event is:
+ *
+ *   Read, Write, Prefetch, FlushFile, FlushTorrent:
+ *     microseconds since the previous event, torrent id, file, offset in the file, length
+ *
+ * An event that spans several files is recorded at its first file.
+ * The log is buffered, so it's only complete once it's closed.
+ */
+class tr_io_trace
+{
+public:
+    static auto constexpr Magic = std::string_view{ "TRIOTRC1" };
+
+    enum class Op : uint8_t
+    {
+        Torrent,
+        Read,
+        Write,
+        Prefetch,
+        FlushFile,
+        FlushTorrent
+    };
+
+    struct Layout
+    {
+        tr_torrent_id_t tor_id = {};
+        uint32_t piece_size = {};
+        std::vector<uint64_t> file_sizes;
+    };
+
+    struct Event
+    {
+        Op op = {};
+        std::chrono::microseconds time = {}; // since the trace began
+        tr_torrent_id_t tor_id = {};
+        tr_file_index_t file = {};
+        uint64_t offset = {};
+        uint64_t length = {};
+    };
+
+    struct Trace
+    {
+        std::vector<Layout> torrents;
+        std::vector<Event> events;
+    };
+
+    tr_io_trace() = default;
+    tr_io_trace(tr_io_trace const&) = delete;
+    tr_io_trace(tr_io_trace&&) = delete;
+    tr_io_trace& operator=(tr_io_trace const&) = delete;
+    tr_io_trace& operator=(tr_io_trace&&) = delete;
+
+    ~tr_io_trace()
+    {
+        close();
+    }
+
+    // Start a new trace, replacing any file that's already there
+    bool open(std::string_view filename, tr_error** error = nullptr);
+
+    void close();
+
+    [[nodiscard]] constexpr bool is_open() const noexcept
+    {
+        return fd_ != TR_BAD_SYS_FILE;
+    }
+
+    // Record an event for the `length` bytes at `byte` in `tor`,
+    // and the torrent's layout if it hasn't been recorded yet
+    void record(Op op, tr_torrent const* tor, uint64_t byte, uint64_t length);
+
+    void record(Layout const& layout);
+    void record(Event const& event);
+
+    // @return the trace in `filename`, up to its last complete record
+    [[nodiscard]] static std::optional<Trace> load(std::string_view filename, tr_error** error = nullptr);
+
+private:
+    // how much to buffer before writing it to the file
+    static auto constexpr FlushThreshold = size_t{ 64U * 1024U };
+
+    void add_varint(uint64_t val);
+    void flush();
+
+    tr_sys_file_t fd_ = TR_BAD_SYS_FILE;
+    std::string buf_;
+    std::chrono::steady_clock::time_point started_at_;
+    std::chrono::microseconds last_time_ = {};
+    std::unordered_set<tr_torrent_id_t> recorded_torrents_;
+};
@@ -0,0 +1,256 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm> // std::min(), std::remove_if()
+#include <cstddef> // std::byte
+#include <cstdint> // uint64_t
+#include <iterator> // std::begin(), std::end()
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include "libtransmission/transmission.h"
+
+#include "libtransmission/crypto-utils.h"
+#include "libtransmission/error.h"
+#include "libtransmission/file.h"
+#include "libtransmission/local-data-index.h"
+#include "libtransmission/log.h"
+#include "libtransmission/torrent.h"
+#include "libtransmission/torrents.h"
+#include "libtransmission/tr-strbuf.h"
+#include "libtransmission/utils.h" // _()
+
+using namespace std::literals;
+
+void tr_local_data_index::set_enabled(bool enabled, tr_torrents& torrents)
+{
+    if (enabled_ == enabled)
+    {
+        return;
+    }
+
+    enabled_ = enabled;
+    by_size_.clear();
+
+    if (enabled)
+    {
+        for (auto const* const tor : torrents)
+        {
+            add(tor);
+        }
+    }
+}
+
+void tr_local_data_index::add(tr_torrent const* tor)
+{
+    if (!enabled_ || !tor->has_metainfo())
+    {
+        return;
+    }
+
+    erase(tor);
+
+    for (tr_file_index_t file = 0, n = tor->file_count(); file < n; ++file)
+    {
+        if (auto const size = tor->file_size(file); size >= MinFileSize && !tor->file_is_padding(file))
+        {
+            by_size_[size].push_back({ tor->id(), file });
+        }
+    }
+}
+
+void tr_local_data_index::erase(tr_torrent const* tor)
+{
+    if (!enabled_ || !tor->has_metainfo())
+    {
+        return;
+    }
+
+    auto const tor_id = tor->id();
+    for (tr_file_index_t file = 0, n = tor->file_count(); file < n; ++file)
+    {
+        auto const iter = by_size_.find(tor->file_size(file));
+        if (iter == std::end(by_size_))
+        {
+            continue;
+        }
+
+        auto& locations = iter->second;
+        locations.erase(
+            std::remove_if(
+                std::begin(locations),
+                std::end(locations),
+                [tor_id](auto const& location) { return location.tor_id == tor_id; }),
+            std::end(locations));
+
+        if (std::empty(locations))
+        {
+            by_size_.erase(iter);
+        }
+    }
+}
+
+std::vector<tr_local_data_index::Import> tr_local_data_index::plan(tr_torrent const* tor, tr_torrents& torrents) const
+{
+    auto imports = std::vector<Import>{};
+
+    if (!enabled_ || !tor->has_metainfo())
+    {
+        return imports;
+    }
+
+    for (tr_file_index_t file = 0, n = tor->file_count(); file < n; ++file)
+    {
+        auto const size = tor->file_size(file);
+        auto const found = by_size_.find(size);
+        if (found == std::end(by_size_) || tor->file_is_padding(file) || tor->find_file(file))
+        {
+            continue;
+        }
+
+        auto import = Import{};
+        import.size = size;
+
+        // only the pieces that lie wholly in the file can be checked without its neighbours
+        auto const [file_begin, file_end] = tor->byte_span(file);
+        auto const [piece_begin, piece_end] = tor->pieces_in_file(file);
+        for (auto piece = piece_begin; piece < piece_end; ++piece)
+        {
+            auto const begin = tor->piece_loc(piece).byte;
+            auto const length = tor->piece_size(piece);
+            if (begin >= file_begin && begin + length <= file_end)
+            {
+                import.pieces.push_back({ begin - file_begin, length, tor->piece_hash(piece) });
+            }
+        }
+
+        if (std::empty(import.pieces))
+        {
+            continue;
+        }
+
+        for (auto const [tor_id, other_file] : found->second)
+        {
+            auto const* const other = torrents.get(tor_id);
+            if (other == nullptr || other == tor)
+            {
+                continue;
+            }
+
+            auto const [other_begin, other_end] = other->pieces_in_file(other_file);
+            auto is_complete = true;
+            for (auto piece = other_begin; is_complete && piece < other_end; ++piece)
+            {
+                is_complete = other->has_piece(piece);
+            }
+
+            if (auto const other_found = other->find_file(other_file); is_complete && other_found &&
+                other_found->size == size && !tr_strv_ends_with(other_found->filename(), tr_torrent_files::PartialFileSuffix))
+            {
+                import.candidates.emplace_back(other_found->filename());
+            }
+        }
+
+        if (!std::empty(import.candidates))
+        {
+            import.target = tr_pathbuf{ tor->download_dir(), '/', tor->file_subpath(file) };
+            imports.emplace_back(std::move(import));
+        }
+    }
+
+    return imports;
+}
+
+bool tr_local_data_index::matches(std::string const& filename, Import const& import)
+{
+    auto const info = tr_sys_path_get_info(filename);
+    if (!info || info->size != import.size)
+    {
+        return false;
+    }
+
+    auto const fd = tr_sys_file_open(filename.c_str(), TR_SYS_FILE_READ | TR_SYS_FILE_SEQUENTIAL, 0);
+    if (fd == TR_BAD_SYS_FILE)
+    {
+        return false;
+    }
+
+    auto buf = std::vector<std::byte>(1024U * 256U);
+    auto sha = tr_sha1_context{};
+    auto ok = true;
+    for (auto const& [offset, length, hash] : import.pieces)
+    {
+        sha.clear();
+
+        for (auto pos = uint64_t{}, end = uint64_t{ length }; ok && pos < end;)
+        {
+            auto const n_wanted = std::min(end - pos, uint64_t{ std::size(buf) });
+            auto n_read = uint64_t{};
+            ok = tr_sys_file_read_at(fd, std::data(buf), n_wanted, offset + pos, &n_read) && n_read > 0U;
+            sha.add(std::data(buf), n_read);
+            pos += n_read;
+        }
+
+        if (!ok || sha.finish() != hash)
+        {
+            ok = false;
+            break;
+        }
+    }
+
+    tr_sys_file_close(fd);
+    return ok;
+}
+
+tr_local_data_index::Method tr_local_data_index::import_file(Import const& import)
+{
+    for (auto const& candidate : import.candidates)
+    {
+        // don't clobber a file that was created since plan() looked
+        if (tr_sys_path_exists(import.target) || !matches(candidate, import))
+        {
+            continue;
+        }
+
+        tr_error* error = nullptr;
+        if (!tr_sys_dir_create(std::string{ tr_sys_path_dirname(import.target) }, TR_SYS_DIR_CREATE_PARENTS, 0777, &error))
+        {
+            tr_logAddWarn(fmt::format(
+                _("Couldn't create '{path}': {error} ({error_code})"),
+                fmt::arg("path", tr_sys_path_dirname(import.target)),
+                fmt::arg("error", error->message),
+                fmt::arg("error_code", error->code)));
+            tr_error_free(error);
+            return Method::None;
+        }
+
+        if (import.covers_file() && tr_sys_path_link(candidate.c_str(), import.target.c_str()))
+        {
+            return Method::Link;
+        }
+
+        // copy under another name so that a half-copied file is never mistaken for a complete one
+        auto const tmp = tr_pathbuf{ import.target, tr_torrent_files::PartialFileSuffix };
+        if (tr_sys_path_copy(candidate.c_str(), tmp.c_str(), &error) && tr_sys_path_rename(tmp, import.target, &error))
+        {
+            return Method::Copy;
+        }
+
+        tr_logAddWarn(fmt::format(
+            _("Couldn't copy '{old_path}' to '{path}': {error} ({error_code})"),
+            fmt::arg("old_path", candidate),
+            fmt::arg("path", import.target),
+            fmt::arg("error", error->message),
+            fmt::arg("error_code", error->code)));
+        tr_error_free(error);
+        tr_sys_path_remove(tmp);
+        return Method::None;
+    }
+
+    return Method::None;
+}
@@ -0,0 +1,110 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <cstdint> // uint32_t, uint64_t
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "libtransmission/transmission.h" // tr_file_index_t, tr_torrent_id_t
+
+#include "libtransmission/tr-macros.h" // tr_sha1_digest_t
+
+class tr_torrents;
+struct tr_torrent;
+
+/**
+ * Finds a new torrent's files in other torrents' local data, e.g. when
+ * the same content is in a repack or in a copy of a torrent with other
+ * trackers, so that it doesn't have to be downloaded again.
+ *
+ * The session's torrents' files are indexed by size. When a torrent is
+ * added, plan() lists the same-sized complete files of other torrents
+ * for each of its files that isn't on disk yet. import_file() then hashes
+ * a candidate's bytes against the pieces that lie wholly in the file and,
+ * if they all match, hard links the candidate into place or copies it
+ * (which is a reflink where the filesystem supports it). The new torrent
+ * is verified afterwards as usual.
+ */
+class tr_local_data_index
+{
+public:
+    // Smaller files aren't worth it
+    static auto constexpr MinFileSize = uint64_t{ 1024U * 1024U };
+
+    struct Piece
+    {
+        uint64_t offset = 0; // from the start of the file
+        uint32_t length = 0;
+        tr_sha1_digest_t hash = {};
+    };
+
+    // One of a new torrent's files, and where else it might be found
+    struct Import
+    {
+        std::string target;
+        uint64_t size = 0;
+
+        // paths of other torrents' complete files that are the same size
+        std::vector<std::string> candidates;
+
+        // the new torrent's pieces that lie wholly in the file, in order
+        std::vector<Piece> pieces;
+
+        // @return true if `pieces` cover every byte of the file. Otherwise,
+        // the new torrent might fail and re-download a piece that it shares
+        // with a neighbouring file, so the file mustn't be a hard link.
+        [[nodiscard]] bool covers_file() const noexcept
+        {
+            return !std::empty(pieces) && pieces.front().offset == 0U &&
+                pieces.back().offset + pieces.back().length == size;
+        }
+    };
+
+    enum class Method
+    {
+        None, // no candidate matched
+        Link,
+        Copy
+    };
+
+    [[nodiscard]] constexpr auto enabled() const noexcept
+    {
+        return enabled_;
+    }
+
+    // Enabling it indexes the torrents that are already in the session
+    void set_enabled(bool enabled, tr_torrents& torrents);
+
+    // Index or re-index a torrent's files. Does nothing if it's not enabled.
+    void add(tr_torrent const* tor);
+
+    void erase(tr_torrent const* tor);
+
+    // @return the files of `tor` that aren't on disk but that may be in other torrents
+    [[nodiscard]] std::vector<Import> plan(tr_torrent const* tor, tr_torrents& torrents) const;
+
+    // Put the file in place from the first candidate whose data matches.
+    // This reads and hashes whole files, so it's meant for a worker thread.
+    [[nodiscard]] static Method import_file(Import const& import);
+
+private:
+    struct Location
+    {
+        tr_torrent_id_t tor_id;
+        tr_file_index_t file;
+    };
+
+    [[nodiscard]] static bool matches(std::string const& filename, Import const& import);
+
+    std::unordered_map<uint64_t, std::vector<Location>> by_size_;
+    bool enabled_ = false;
+};
@@ -4,14 +4,17 @@
 // License text can be found in the licenses/ folder.
 
 #include <array>
+#include <atomic>
 #include <cerrno>
 #include <chrono>
+#include <condition_variable>
 #include <cstddef> // size_t
 #include <iterator> // back_insert_iterator, empty
 #include <map>
 #include <mutex>
 #include <string>
 #include <string_view>
+#include <thread>
 #include <utility>
 
 #ifdef __ANDROID__
@@ -24,7 +27,7 @@
 #include "libtransmission/file.h"
 #include "libtransmission/log.h"
 #include "libtransmission/tr-assert.h"
-#include "libtransmission/tr-strbuf.h"
+#include "libtransmission/tr-macros.h"
 #include "libtransmission/utils.h"
 
 using namespace std::literals;
@@ -32,25 +35,233 @@ using namespace std::literals;
 namespace
 {
 
+// Messages are pushed onto a lock-free MPSC list, so logging threads never
+// wait on each other or on the disk. The list is drained either by the
+// client, via tr_logGetQueue(), or by a background thread that writes the
+// messages to stderr in batches.
 class tr_log_state
 {
 public:
-    [[nodiscard]] auto unique_lock()
+    // Under overload, i.e. when this many messages are waiting, new ones
+    // are dropped and counted instead of queued.
+    static auto constexpr MaxPending = size_t{ TR_LOG_MAX_QUEUE_LENGTH };
+
+    tr_log_state() = default;
+    TR_DISABLE_COPY_MOVE(tr_log_state)
+
+    ~tr_log_state()
+    {
+        {
+            auto const lock = std::lock_guard{ writer_mutex_ };
+            stopping_ = true;
+        }
+
+        writer_cv_.notify_one();
+
+        if (writer_.joinable())
+        {
+            writer_.join();
+        }
+    }
+
+    void push(tr_log_message* msg)
     {
-        return std::unique_lock(message_mutex_);
+        if (pending_.fetch_add(1U, std::memory_order_relaxed) >= MaxPending)
+        {
+            pending_.fetch_sub(1U, std::memory_order_relaxed);
+            dropped_.fetch_add(1U, std::memory_order_relaxed);
+            delete msg;
+            return;
+        }
+
+        // once msg is published, the consumer owns it; so check `old_head`, not `msg->next`
+        auto* old_head = head_.load(std::memory_order_relaxed);
+        do
+        {
+            msg->next = old_head;
+        } while (!head_.compare_exchange_weak(old_head, msg, std::memory_order_release, std::memory_order_relaxed));
+
+        if (old_head == nullptr && !queue_enabled_.load(std::memory_order_relaxed))
+        {
+            wake_writer();
+        }
     }
 
-    tr_log_level level = TR_LOG_ERROR;
+    void set_queue_enabled(bool is_enabled)
+    {
+        queue_enabled_.store(is_enabled, std::memory_order_relaxed);
 
-    bool queue_enabled_ = false;
+        // hand anything that was queued for the client to the writer instead
+        if (has_messages_for_writer())
+        {
+            wake_writer();
+        }
+    }
 
-    tr_log_message* queue_ = nullptr;
+    // @return the pending messages, oldest first
+    [[nodiscard]] tr_log_message* take()
+    {
+        auto* walk = head_.exchange(nullptr, std::memory_order_acquire);
 
-    tr_log_message** queue_tail_ = &queue_;
+        // the list is newest-first, so reverse it
+        tr_log_message* ret = nullptr;
+        auto n = size_t{};
+        while (walk != nullptr)
+        {
+            auto* const next = walk->next;
+            walk->next = ret;
+            ret = walk;
+            walk = next;
+            ++n;
+        }
 
-    int queue_length_ = 0;
+        pending_.fetch_sub(n, std::memory_order_relaxed);
 
-    std::recursive_mutex message_mutex_;
+        if (auto const n_dropped = dropped_.exchange(0U, std::memory_order_relaxed); n_dropped != 0U)
+        {
+            auto* const note = new tr_log_message{};
+            note->level = TR_LOG_WARN;
+            note->when = tr_time();
+            note->message = fmt::format(
+                tr_ngettext(
+                    "Dropped {count} log message because too many were waiting",
+                    "Dropped {count} log messages because too many were waiting",
+                    n_dropped),
+                fmt::arg("count", n_dropped));
+            note->file = __FILE__;
+            note->line = __LINE__;
+
+            auto** tail = &ret;
+            while (*tail != nullptr)
+            {
+                tail = &(*tail)->next;
+            }
+            *tail = note;
+        }
+
+        return ret;
+    }
+
+    void set_tap(tr_log_tap_func func, void* user_data)
+    {
+        auto const lock = std::lock_guard{ tap_mutex_ };
+        tap_func_ = func;
+        tap_user_data_ = user_data;
+        has_tap_.store(func != nullptr, std::memory_order_relaxed);
+    }
+
+    void tap(tr_log_message const& msg)
+    {
+        if (!has_tap_.load(std::memory_order_relaxed))
+        {
+            return;
+        }
+
+        auto const lock = std::lock_guard{ tap_mutex_ };
+        if (tap_func_ != nullptr)
+        {
+            tap_func_(msg, tap_user_data_);
+        }
+    }
+
+    std::atomic<tr_log_level> level = TR_LOG_ERROR;
+
+    // guards the per-line counts that keep warnings from repeating forever
+    std::mutex repeat_mutex;
+
+private:
+    [[nodiscard]] bool has_messages_for_writer() const noexcept
+    {
+        return !queue_enabled_.load(std::memory_order_relaxed) && head_.load(std::memory_order_relaxed) != nullptr;
+    }
+
+    void wake_writer()
+    {
+        {
+            auto const lock = std::lock_guard{ writer_mutex_ };
+
+            if (stopping_)
+            {
+                return;
+            }
+
+            if (!writer_.joinable())
+            {
+                writer_ = std::thread{ &tr_log_state::writer_func, this };
+            }
+        }
+
+        writer_cv_.notify_one();
+    }
+
+    void writer_func()
+    {
+        auto lock = std::unique_lock{ writer_mutex_ };
+
+        for (;;)
+        {
+            writer_cv_.wait(lock, [this]() { return stopping_ || has_messages_for_writer(); });
+
+            auto const stopping = stopping_;
+            lock.unlock();
+
+            if (has_messages_for_writer())
+            {
+                write_batch(take());
+            }
+
+            if (stopping)
+            {
+                return;
+            }
+
+            lock.lock();
+        }
+    }
+
+    static void write_batch(tr_log_message* list)
+    {
+        static auto const fp = tr_sys_file_get_std(TR_STD_SYS_FILE_ERR);
+
+        auto timestr = std::array<char, 64U>{};
+        tr_logGetTimeStr(std::data(timestr), std::size(timestr));
+
+        auto buf = std::string{};
+        for (auto const* walk = list; walk != nullptr; walk = walk->next)
+        {
+            if (std::empty(walk->name))
+            {
+                fmt::format_to(std::back_inserter(buf), "[{:s}] {:s}\n", std::data(timestr), walk->message);
+            }
+            else
+            {
+                fmt::format_to(std::back_inserter(buf), "[{:s}] {:s}: {:s}\n", std::data(timestr), walk->name, walk->message);
+            }
+        }
+
+        tr_logFreeQueue(list);
+
+        if (fp != TR_BAD_SYS_FILE && !std::empty(buf))
+        {
+            tr_sys_file_write(fp, std::data(buf), std::size(buf), nullptr);
+            tr_sys_file_flush(fp);
+        }
+    }
+
+    std::atomic<tr_log_message*> head_ = nullptr;
+    std::atomic<bool> queue_enabled_ = false;
+    std::atomic<size_t> pending_ = {};
+    std::atomic<size_t> dropped_ = {};
+
+    std::mutex tap_mutex_;
+    tr_log_tap_func tap_func_ = nullptr;
+    void* tap_user_data_ = nullptr;
+    std::atomic<bool> has_tap_ = false;
+
+    std::mutex writer_mutex_;
+    std::condition_variable writer_cv_;
+    std::thread writer_;
+    bool stopping_ = false;
 };
 
 auto log_state = tr_log_state{};
@@ -69,8 +280,6 @@ void logAddImpl(
         return;
     }
 
-    auto const lock = log_state.unique_lock();
-
 #if defined(__ANDROID__)
 
     int prio;
@@ -105,53 +314,16 @@ void logAddImpl(
 
 #else
 
-    if (log_state.queue_enabled_)
-    {
-        auto* const newmsg = new tr_log_message{};
-        newmsg->level = level;
-        newmsg->when = tr_time();
-        newmsg->message = std::move(msg);
-        newmsg->file = file;
-        newmsg->line = line;
-        newmsg->name = name;
-
-        *log_state.queue_tail_ = newmsg;
-        log_state.queue_tail_ = &newmsg->next;
-        ++log_state.queue_length_;
-
-        if (log_state.queue_length_ > TR_LOG_MAX_QUEUE_LENGTH)
-        {
-            tr_log_message* old = log_state.queue_;
-            log_state.queue_ = old->next;
-            old->next = nullptr;
-            tr_logFreeQueue(old);
-            --log_state.queue_length_;
-            TR_ASSERT(log_state.queue_length_ == TR_LOG_MAX_QUEUE_LENGTH);
-        }
-    }
-    else
-    {
-        static auto const fp = tr_sys_file_get_std(TR_STD_SYS_FILE_ERR);
-        if (fp == TR_BAD_SYS_FILE)
-        {
-            return;
-        }
-
-        auto timestr = std::array<char, 64U>{};
-        tr_logGetTimeStr(std::data(timestr), std::size(timestr));
+    auto* const newmsg = new tr_log_message{};
+    newmsg->level = level;
+    newmsg->when = tr_time();
+    newmsg->message = std::move(msg);
+    newmsg->file = file;
+    newmsg->line = line;
+    newmsg->name = name;
+    log_state.tap(*newmsg);
+    log_state.push(newmsg);
 
-        auto buf = tr_strbuf<char, 2048U>{};
-        if (std::empty(name))
-        {
-            fmt::format_to(std::back_inserter(buf), "[{:s}] {:s}", std::data(timestr), msg);
-        }
-        else
-        {
-            fmt::format_to(std::back_inserter(buf), "[{:s}] {:s}: {:s}", std::data(timestr), name, msg);
-        }
-        tr_sys_file_write_line(fp, buf);
-        tr_sys_file_flush(fp);
-    }
 #endif
 }
 
@@ -159,7 +331,7 @@ void logAddImpl(
 
 tr_log_level tr_logGetLevel()
 {
-    return log_state.level;
+    return log_state.level.load(std::memory_order_relaxed);
 }
 
 bool tr_logLevelIsActive(tr_log_level level)
@@ -169,24 +341,17 @@ bool tr_logLevelIsActive(tr_log_level level)
 
 void tr_logSetLevel(tr_log_level level)
 {
-    log_state.level = level;
+    log_state.level.store(level, std::memory_order_relaxed);
 }
 
 void tr_logSetQueueEnabled(bool is_enabled)
 {
-    log_state.queue_enabled_ = is_enabled;
+    log_state.set_queue_enabled(is_enabled);
 }
 
 tr_log_message* tr_logGetQueue()
 {
-    auto const lock = log_state.unique_lock();
-
-    auto* const ret = log_state.queue_;
-    log_state.queue_ = nullptr;
-    log_state.queue_tail_ = &log_state.queue_;
-    log_state.queue_length_ = 0;
-
-    return ret;
+    return log_state.take();
 }
 
 void tr_logFreeQueue(tr_log_message* freeme)
@@ -199,6 +364,11 @@ void tr_logFreeQueue(tr_log_message* freeme)
     }
 }
 
+void tr_logSetTap(tr_log_tap_func func, void* user_data)
+{
+    log_state.set_tap(func, user_data);
+}
+
 // ---
 
 char* tr_logGetTimeStr(char* buf, size_t buflen)
@@ -242,13 +412,12 @@ void tr_logAddMessage(char const* file, long line, tr_log_level level, std::stri
         return;
     }
 
-    auto const lock = log_state.unique_lock();
-
     // don't log the same warning ad infinitum.
     // it's not useful after some point.
     bool last_one = false;
     if (level == TR_LOG_CRITICAL || level == TR_LOG_ERROR || level == TR_LOG_WARN)
     {
+        auto const lock = std::lock_guard{ log_state.repeat_mutex };
         static auto constexpr MaxRepeat = size_t{ 30 };
         static auto counts = new std::map<std::pair<std::string_view, int>, size_t>{};
 
@@ -321,3 +490,9 @@ std::optional<tr_log_level> tr_logGetLevelFromKey(std::string_view key_in)
 
     return std::nullopt;
 }
+
+std::string_view tr_logGetKeyFromLevel(tr_log_level level)
+{
+    auto const idx = static_cast<size_t>(level);
+    return idx < std::size(LogKeys) ? LogKeys[idx].first : ""sv;
+}
@@ -42,6 +42,8 @@ enum tr_log_level
 
 std::optional<tr_log_level> tr_logGetLevelFromKey(std::string_view key);
 
+[[nodiscard]] std::string_view tr_logGetKeyFromLevel(tr_log_level level);
+
 // ---
 
 struct tr_log_message
@@ -75,6 +77,13 @@ void tr_logSetQueueEnabled(bool is_enabled);
 
 void tr_logFreeQueue(tr_log_message* freeme);
 
+// Also pass each new message to `func`, e.g. to stream it to RPC clients.
+// `func` may be called from any thread and must not log. Pass nullptr to stop;
+// once this returns, `func` won't be called again.
+using tr_log_tap_func = void (*)(tr_log_message const& message, void* user_data);
+
+void tr_logSetTap(tr_log_tap_func func, void* user_data);
+
 // ---
 
 void tr_logSetLevel(tr_log_level);
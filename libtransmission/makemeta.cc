@@ -6,11 +6,16 @@
 #include <algorithm>
 #include <cerrno> // for ENOENT
 #include <cmath>
+#include <condition_variable>
 #include <ctime> // time()
+#include <deque>
+#include <map>
+#include <mutex>
 #include <optional>
 #include <set>
 #include <string>
 #include <string_view>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -24,9 +29,11 @@
 #include "libtransmission/file.h"
 #include "libtransmission/log.h"
 #include "libtransmission/makemeta.h"
+#include "libtransmission/merkle.h"
 #include "libtransmission/quark.h" // TR_KEY_length, TR_KEY_a...
 #include "libtransmission/session.h" // TR_NAME
 #include "libtransmission/torrent-files.h"
+#include "libtransmission/torrent-metainfo.h"
 #include "libtransmission/tr-assert.h"
 #include "libtransmission/tr-strbuf.h" // tr_pathbuf
 #include "libtransmission/utils.h" // for _()
@@ -38,6 +45,146 @@ using namespace std::literals;
 namespace
 {
 
+// when creating checksums, how much piece data to hash in one batch
+auto constexpr MaxChecksumBatchBytes = size_t{ 1024U * 1024U * 4U };
+
+// Hashes batches of pieces on worker threads while the caller reads
+// the next ones from disk. Each batch's digests are written to their
+// own place in `sha1s` and `leaves`, so they come out in piece order.
+class ChecksumWorkers
+{
+public:
+    struct Batch
+    {
+        std::vector<char> buf;
+        std::vector<std::string_view> pieces;
+        std::vector<std::string_view> blocks; // v2 merkle tree leaves
+        tr_piece_index_t first_piece = 0;
+        size_t first_leaf = 0;
+    };
+
+    // `sha1s` is nullptr for v2 torrents and `leaves` is nullptr for v1 torrents
+    ChecksumWorkers(
+        std::vector<std::byte>* sha1s,
+        std::vector<tr_sha256_digest_t>* leaves,
+        size_t n_threads,
+        size_t batch_bytes)
+        : sha1s_{ sha1s }
+        , leaves_{ leaves }
+        , batches_(n_threads + 1U) // one for each worker, plus one being read
+    {
+        for (auto& batch : batches_)
+        {
+            batch.buf.resize(batch_bytes);
+            free_.emplace_back(&batch);
+        }
+
+        for (size_t i = 0; i < n_threads; ++i)
+        {
+            threads_.emplace_back(&ChecksumWorkers::thread_func, this);
+        }
+    }
+
+    ChecksumWorkers(ChecksumWorkers&&) = delete;
+    ChecksumWorkers(ChecksumWorkers const&) = delete;
+    ChecksumWorkers& operator=(ChecksumWorkers&&) = delete;
+    ChecksumWorkers& operator=(ChecksumWorkers const&) = delete;
+
+    ~ChecksumWorkers()
+    {
+        finish();
+    }
+
+    // @return an empty batch to read pieces into.
+    // Waits for one to be hashed if they're all in use.
+    [[nodiscard]] Batch* get()
+    {
+        auto lock = std::unique_lock{ mutex_ };
+        free_cv_.wait(lock, [this]() { return !std::empty(free_); });
+        auto* const batch = free_.front();
+        free_.pop_front();
+        batch->pieces.clear();
+        batch->blocks.clear();
+        return batch;
+    }
+
+    void hash(Batch* batch)
+    {
+        auto const lock = std::lock_guard{ mutex_ };
+        todo_.emplace_back(batch);
+        todo_cv_.notify_one();
+    }
+
+    // Wait for every batch passed to `hash()` to be hashed.
+    void finish()
+    {
+        {
+            auto const lock = std::lock_guard{ mutex_ };
+            done_ = true;
+            todo_cv_.notify_all();
+        }
+
+        for (auto& thread : threads_)
+        {
+            thread.join();
+        }
+
+        threads_.clear();
+    }
+
+private:
+    void thread_func()
+    {
+        auto lock = std::unique_lock{ mutex_ };
+
+        for (;;)
+        {
+            todo_cv_.wait(lock, [this]() { return done_ || !std::empty(todo_); });
+            if (std::empty(todo_))
+            {
+                return;
+            }
+
+            auto* const batch = todo_.front();
+            todo_.pop_front();
+            lock.unlock();
+
+            if (sha1s_ != nullptr)
+            {
+                auto* walk = std::data(*sha1s_) + size_t{ batch->first_piece } * std::size(tr_sha1_digest_t{});
+                for (auto const& digest : tr_sha1_batch(batch->pieces))
+                {
+                    walk = std::copy(std::begin(digest), std::end(digest), walk);
+                }
+            }
+
+            if (leaves_ != nullptr && !std::empty(batch->blocks))
+            {
+                tr_sha256_context{}.digest_batch(
+                    std::data(batch->blocks),
+                    std::size(batch->blocks),
+                    std::data(*leaves_) + batch->first_leaf);
+            }
+
+            lock.lock();
+            free_.emplace_back(batch);
+            free_cv_.notify_one();
+        }
+    }
+
+    std::vector<std::byte>* const sha1s_;
+    std::vector<tr_sha256_digest_t>* const leaves_;
+    std::vector<Batch> batches_;
+    std::vector<std::thread> threads_;
+
+    std::mutex mutex_;
+    std::condition_variable todo_cv_;
+    std::condition_variable free_cv_;
+    std::deque<Batch*> todo_;
+    std::deque<Batch*> free_;
+    bool done_ = false;
+};
+
 namespace find_files_helpers
 {
 
@@ -129,6 +276,63 @@ tr_torrent_files findFiles(std::string_view const top, std::string_view const su
     return files;
 }
 
+// v2 torrents list their files in a "file tree" dictionary, so they're
+// ordered by each path component's bytes instead of case-insensitively
+[[nodiscard]] bool isBeforeInFileTree(std::string_view lhs, std::string_view rhs)
+{
+    auto lhs_token = std::string_view{};
+    auto rhs_token = std::string_view{};
+
+    for (;;)
+    {
+        auto const lhs_more = tr_strv_sep(&lhs, &lhs_token, '/');
+        auto const rhs_more = tr_strv_sep(&rhs, &rhs_token, '/');
+
+        if (!lhs_more || !rhs_more)
+        {
+            return !lhs_more && rhs_more;
+        }
+
+        if (lhs_token != rhs_token)
+        {
+            return lhs_token < rhs_token;
+        }
+    }
+}
+
+tr_torrent_files sortFiles(tr_torrent_files const& files, tr_metainfo_builder::Version version)
+{
+    auto tmp = std::vector<std::pair<std::string, uint64_t>>{};
+    tmp.reserve(files.fileCount());
+    for (tr_file_index_t i = 0, n = files.fileCount(); i < n; ++i)
+    {
+        tmp.emplace_back(files.path(i), files.fileSize(i));
+    }
+
+    if (version == tr_metainfo_builder::Version::V1)
+    {
+        std::sort(
+            std::begin(tmp),
+            std::end(tmp),
+            [](auto const& lhs, auto const& rhs) { return tr_strlower(lhs.first) < tr_strlower(rhs.first); });
+    }
+    else
+    {
+        std::sort(
+            std::begin(tmp),
+            std::end(tmp),
+            [](auto const& lhs, auto const& rhs) { return isBeforeInFileTree(lhs.first, rhs.first); });
+    }
+
+    auto ret = tr_torrent_files{};
+    ret.reserve(std::size(tmp));
+    for (auto const& [path, size] : tmp)
+    {
+        ret.add(path, size);
+    }
+    return ret;
+}
+
 } // namespace
 
 tr_metainfo_builder::tr_metainfo_builder(std::string_view single_file_or_parent_directory)
@@ -145,13 +349,182 @@ bool tr_metainfo_builder::set_piece_size(uint32_t piece_size) noexcept
         return false;
     }
 
-    block_info_ = tr_block_info{ files_.totalSize(), piece_size };
+    block_info_ = tr_block_info{ aligned_size(piece_size), piece_size };
+    return true;
+}
+
+bool tr_metainfo_builder::set_previous(std::string_view torrent_filename, tr_error** error)
+{
+    auto metainfo = tr_torrent_metainfo{};
+    if (!metainfo.parse_torrent_file(torrent_filename, nullptr, error))
+    {
+        return false;
+    }
+
+    if (!metainfo.has_v1_metadata())
+    {
+        tr_error_set(
+            error,
+            EINVAL,
+            fmt::format(_("Couldn't reuse '{path}': it has no v1 piece hashes"), fmt::arg("path", torrent_filename)));
+        return false;
+    }
+
+    auto previous = Previous{};
+    previous.files = metainfo.files();
+    previous.piece_size = metainfo.piece_size();
+    previous.piece_hashes.reserve(metainfo.piece_count());
+    for (tr_piece_index_t piece = 0, n = metainfo.piece_count(); piece < n; ++piece)
+    {
+        previous.piece_hashes.emplace_back(metainfo.piece_hash(piece));
+    }
+
+    // anonymized torrents have no creation date, so fall back to when it was saved
+    previous.date_created = metainfo.date_created();
+    if (auto const info = tr_sys_path_get_info(torrent_filename); previous.date_created == 0 && info)
+    {
+        previous.date_created = info->last_modified_at;
+    }
+
+    previous_ = std::move(previous);
+    set_piece_size(previous_->piece_size);
     return true;
 }
 
+void tr_metainfo_builder::set_version(Version version)
+{
+    version_ = version;
+    files_ = sortFiles(files_, version);
+    block_info_ = tr_block_info{ aligned_size(piece_size()), piece_size() };
+}
+
+void tr_metainfo_builder::set_pad_files(bool pad_files)
+{
+    pad_files_ = pad_files;
+    block_info_ = tr_block_info{ aligned_size(piece_size()), piece_size() };
+}
+
+// @return the torrent's size, including the padding that aligned
+// torrents have to make each file start on a new piece
+uint64_t tr_metainfo_builder::aligned_size(uint32_t piece_size) const noexcept
+{
+    if (!is_aligned())
+    {
+        return total_size();
+    }
+
+    auto ret = uint64_t{};
+    for (tr_file_index_t i = 0, n = file_count(); i < n; ++i)
+    {
+        if (auto const file_size = this->file_size(i); file_size != 0U)
+        {
+            ret = ((ret + piece_size - 1U) / piece_size) * piece_size + file_size;
+        }
+    }
+    return ret;
+}
+
+// @return which pieces' hashes can be copied from `previous_` instead of being
+// hashed: the ones that cover the same bytes as they did in the old torrent,
+// all of which come from files that are where they were and are unchanged
+std::vector<bool> tr_metainfo_builder::reusable_pieces() const
+{
+    auto const n_pieces = piece_count();
+    auto ret = std::vector<bool>(n_pieces);
+    if (!previous_ || version_ != Version::V1 || previous_->piece_size != piece_size())
+    {
+        return ret;
+    }
+
+    auto const& prev = *previous_;
+    auto const& prev_files = prev.files;
+    auto const piece_size = this->piece_size();
+
+    for (tr_piece_index_t piece = 0, n = std::min(n_pieces, tr_piece_index_t(std::size(prev.piece_hashes))); piece < n; ++piece)
+    {
+        auto const begin = uint64_t{ piece } * piece_size;
+        ret[piece] = std::min(begin + piece_size, prev_files.totalSize()) == begin + block_info_.piece_size(piece);
+    }
+
+    auto const mark_changed = [&ret, piece_size](uint64_t offset, uint64_t length)
+    {
+        if (length == 0U)
+        {
+            return;
+        }
+
+        auto const end = std::min(size_t((offset + length - 1U) / piece_size + 1U), std::size(ret));
+        for (auto piece = size_t(offset / piece_size); piece < end; ++piece)
+        {
+            ret[piece] = false;
+        }
+    };
+
+    // where each of the old torrent's files was
+    auto prev_offsets = std::vector<uint64_t>{};
+    prev_offsets.reserve(prev_files.fileCount());
+    auto prev_indices = std::map<std::string_view, tr_file_index_t>{};
+    auto prev_offset = uint64_t{};
+    for (tr_file_index_t i = 0, n = prev_files.fileCount(); i < n; ++i)
+    {
+        prev_offsets.emplace_back(prev_offset);
+        prev_offset += prev_files.fileSize(i);
+        if (!prev_files.isPadding(i))
+        {
+            prev_indices.try_emplace(prev_files.path(i), i);
+        }
+    }
+
+    auto prev_unchanged = std::vector<bool>(prev_files.fileCount());
+    auto const parent = tr_sys_path_dirname(top_);
+    auto offset = uint64_t{};
+    for (tr_file_index_t i = 0, n = file_count(); i < n; ++i)
+    {
+        auto const file_size = this->file_size(i);
+        if (file_size == 0U)
+        {
+            continue;
+        }
+
+        if (is_aligned())
+        {
+            offset = ((offset + piece_size - 1U) / piece_size) * piece_size;
+        }
+
+        auto filename = tr_pathbuf{ parent, '/', path(i) };
+        tr_sys_path_native_separators(std::data(filename));
+        auto const info = tr_sys_path_get_info(filename);
+        if (auto const iter = prev_indices.find(path(i)); iter != std::end(prev_indices) &&
+            prev_offsets[iter->second] == offset && prev_files.fileSize(iter->second) == file_size && info &&
+            info->last_modified_at < prev.date_created)
+        {
+            prev_unchanged[iter->second] = true;
+        }
+        else
+        {
+            mark_changed(offset, file_size);
+        }
+
+        offset += file_size;
+    }
+
+    // the old torrent's pad files were zeroes, just like the new padding,
+    // but anything else that's gone or moved changed the pieces it was in
+    for (tr_file_index_t i = 0, n = prev_files.fileCount(); i < n; ++i)
+    {
+        if (!prev_files.isPadding(i) && !prev_unchanged[i])
+        {
+            mark_changed(prev_offsets[i], prev_files.fileSize(i));
+        }
+    }
+
+    return ret;
+}
+
 bool tr_metainfo_builder::blocking_make_checksums(tr_error** error)
 {
     checksum_piece_ = 0;
+    n_reused_pieces_ = 0;
     cancel_ = false;
 
     if (total_size() == 0U)
@@ -160,27 +533,54 @@ bool tr_metainfo_builder::blocking_make_checksums(tr_error** error)
         return false;
     }
 
-    auto hashes = std::vector<std::byte>(std::size(tr_sha1_digest_t{}) * piece_count());
-    auto* walk = std::data(hashes);
-    auto sha = tr_sha1::create();
+    // v2, hybrid and padded v1 torrents start each file on a new piece, padding
+    // the end of the previous file's last piece with zeroes. The padding is
+    // part of the v1 pieces but not the v2 ones.
+    auto const is_aligned = this->is_aligned();
+    auto const want_v1 = version_ != Version::V2;
+    auto const want_v2 = version_ != Version::V1;
+
+    auto hashes = std::vector<std::byte>(want_v1 ? std::size(tr_sha1_digest_t{}) * piece_count() : 0U);
+
+    auto leaves = std::vector<tr_sha256_digest_t>{};
+    if (want_v2)
+    {
+        auto n_leaves = size_t{};
+        for (tr_file_index_t i = 0, n = file_count(); i < n; ++i)
+        {
+            n_leaves += tr_merkle_leaf_count(file_size(i));
+        }
+        leaves.resize(n_leaves);
+    }
+
+    auto const reusable = reusable_pieces();
 
     auto file_index = tr_file_index_t{ 0U };
     auto piece_index = tr_piece_index_t{ 0U };
-    auto total_remain = total_size();
+    auto leaf_index = size_t{ 0U };
+    auto total_remain = block_info_.total_size();
     auto off = uint64_t{ 0U };
 
-    auto buf = std::vector<char>(piece_size());
-
+    // files are opened when there's something to read from them,
+    // since unchanged ones may not need to be read at all
     auto const parent = tr_sys_path_dirname(top_);
-    auto fd = tr_sys_file_open(
-        tr_pathbuf{ parent, '/', path(file_index) },
-        TR_SYS_FILE_READ | TR_SYS_FILE_SEQUENTIAL,
-        0,
-        error);
-    if (fd == TR_BAD_SYS_FILE)
-    {
-        return false;
-    }
+    auto fd = tr_sys_file_t{ TR_BAD_SYS_FILE };
+
+    // read several pieces at a time so they can be hashed as a batch.
+    // This thread reads the batches and the workers hash them, so use
+    // smaller batches if that's what it takes to keep them all busy.
+    auto const n_threads = n_threads_ != 0U ? n_threads_ :
+                                              std::max(size_t{ std::thread::hardware_concurrency() }, size_t{ 1U });
+    auto const pieces_per_batch = std::clamp(
+        (size_t{ piece_count() } + n_threads - 1U) / n_threads,
+        size_t{ 1U },
+        std::max(size_t{ 1U }, MaxChecksumBatchBytes / piece_size()));
+    auto const n_batches = (size_t{ piece_count() } + pieces_per_batch - 1U) / pieces_per_batch;
+    auto workers = ChecksumWorkers{ want_v1 ? &hashes : nullptr,
+                                    want_v2 ? &leaves : nullptr,
+                                    std::min(n_threads, n_batches),
+                                    size_t{ piece_size() } * pieces_per_batch };
+    auto* batch = workers.get();
 
     while (!cancel_ && (total_remain > 0U))
     {
@@ -189,27 +589,27 @@ bool tr_metainfo_builder::blocking_make_checksums(tr_error** error)
         TR_ASSERT(piece_index < piece_count());
 
         auto const piece_size = block_info_.piece_size(piece_index);
-        buf.resize(piece_size);
-        auto* bufptr = std::data(buf);
+        auto const reuse = reusable[piece_index];
+        if (reuse && !std::empty(batch->pieces))
+        {
+            // a batch's pieces have to be consecutive
+            workers.hash(batch);
+            batch = workers.get();
+        }
+
+        auto* const piece_begin = std::data(batch->buf) + std::size(batch->pieces) * size_t{ this->piece_size() };
+        auto* bufptr = piece_begin;
+        auto* data_end = piece_begin;
 
         auto left_in_piece = piece_size;
         while (left_in_piece > 0U)
         {
             auto const n_this_pass = std::min(file_size(file_index) - off, uint64_t{ left_in_piece });
-            auto n_read = uint64_t{};
+            auto n_read = n_this_pass; // a reused piece's bytes are skipped
 
-            (void)tr_sys_file_read(fd, bufptr, n_this_pass, &n_read, error);
-            bufptr += n_read;
-            off += n_read;
-            left_in_piece -= n_read;
-
-            if (off == file_size(file_index))
+            if (!reuse && n_this_pass != 0U)
             {
-                off = 0;
-                tr_sys_file_close(fd);
-                fd = TR_BAD_SYS_FILE;
-
-                if (++file_index < file_count())
+                if (fd == TR_BAD_SYS_FILE)
                 {
                     fd = tr_sys_file_open(
                         tr_pathbuf{ parent, '/', path(file_index) },
@@ -221,21 +621,81 @@ bool tr_metainfo_builder::blocking_make_checksums(tr_error** error)
                         return false;
                     }
                 }
+
+                n_read = 0U;
+                (void)tr_sys_file_read_at(fd, bufptr, n_this_pass, off, &n_read, error);
+            }
+
+            bufptr += n_read;
+            off += n_read;
+            left_in_piece -= n_read;
+            data_end = bufptr;
+
+            if (off == file_size(file_index))
+            {
+                if (is_aligned && bufptr != piece_begin)
+                {
+                    if (!reuse)
+                    {
+                        std::fill_n(bufptr, left_in_piece, '\0');
+                    }
+
+                    bufptr += left_in_piece;
+                    left_in_piece = 0U;
+                }
+
+                off = 0;
+                if (fd != TR_BAD_SYS_FILE)
+                {
+                    tr_sys_file_close(fd);
+                    fd = TR_BAD_SYS_FILE;
+                }
+
+                ++file_index;
             }
         }
 
-        TR_ASSERT(bufptr - std::data(buf) == (int)piece_size);
+        TR_ASSERT(bufptr - piece_begin == (int)piece_size);
         TR_ASSERT(left_in_piece == 0);
-        sha->add(std::data(buf), std::size(buf));
-        auto const digest = sha->finish();
-        walk = std::copy(std::begin(digest), std::end(digest), walk);
-        sha->clear();
+        if (reuse)
+        {
+            // only v1 torrents reuse pieces, so there are no v2 leaves to hash
+            auto const& digest = previous_->piece_hashes[piece_index];
+            std::copy(std::begin(digest), std::end(digest), std::data(hashes) + size_t{ piece_index } * std::size(digest));
+            ++n_reused_pieces_;
+        }
+        else
+        {
+            if (std::empty(batch->pieces))
+            {
+                batch->first_piece = piece_index;
+                batch->first_leaf = leaf_index;
+            }
+            batch->pieces.emplace_back(piece_begin, piece_size);
+
+            if (want_v2)
+            {
+                // when aligned, a piece's data all comes from one file
+                for (auto* walk = piece_begin; walk < data_end; walk += TR_MERKLE_BLOCK_SIZE)
+                {
+                    batch->blocks.emplace_back(walk, std::min(size_t(data_end - walk), size_t{ TR_MERKLE_BLOCK_SIZE }));
+                    ++leaf_index;
+                }
+            }
+        }
 
         total_remain -= piece_size;
         ++piece_index;
+
+        if (!std::empty(batch->pieces) && (std::size(batch->pieces) == pieces_per_batch || total_remain == 0U))
+        {
+            workers.hash(batch);
+            batch = total_remain != 0U ? workers.get() : nullptr;
+        }
     }
 
-    TR_ASSERT(cancel_ || size_t(walk - std::data(hashes)) == std::size(hashes));
+    workers.finish();
+
     TR_ASSERT(cancel_ || total_remain == 0U);
 
     if (fd != TR_BAD_SYS_FILE)
@@ -250,12 +710,67 @@ bool tr_metainfo_builder::blocking_make_checksums(tr_error** error)
     }
 
     piece_hashes_ = std::move(hashes);
+
+    if (want_v2)
+    {
+        TR_ASSERT(leaf_index == std::size(leaves));
+        make_merkle_trees(leaves);
+    }
+    else
+    {
+        pieces_roots_.clear();
+        piece_layers_.clear();
+    }
+
     return true;
 }
 
+void tr_metainfo_builder::make_merkle_trees(std::vector<tr_sha256_digest_t> const& leaves)
+{
+    auto const n_files = file_count();
+    pieces_roots_.assign(n_files, tr_sha256_digest_t{});
+    piece_layers_.assign(n_files, {});
+
+    auto const leaves_per_piece = size_t{ piece_size() / TR_MERKLE_BLOCK_SIZE };
+    auto const zero_piece = tr_merkle_pad(leaves_per_piece);
+
+    auto const* walk = std::data(leaves);
+    for (tr_file_index_t i = 0; i < n_files; ++i)
+    {
+        auto const n_leaves = tr_merkle_leaf_count(file_size(i));
+        if (n_leaves == 0U)
+        {
+            continue;
+        }
+
+        if (n_leaves <= leaves_per_piece)
+        {
+            // the file fits in one piece, so it has no piece layer
+            auto const file_leaves = std::vector<tr_sha256_digest_t>(walk, walk + n_leaves);
+            pieces_roots_[i] = tr_merkle_root(file_leaves, tr_merkle_width(n_leaves));
+        }
+        else
+        {
+            auto& layer = piece_layers_[i];
+            for (size_t leaf = 0; leaf < n_leaves; leaf += leaves_per_piece)
+            {
+                auto const n = std::min(leaves_per_piece, n_leaves - leaf);
+                auto const subtree = std::vector<tr_sha256_digest_t>(walk + leaf, walk + leaf + n);
+                layer.emplace_back(tr_merkle_root(subtree, leaves_per_piece));
+            }
+
+            pieces_roots_[i] = tr_merkle_root(layer, tr_merkle_width(std::size(layer)), zero_piece);
+        }
+
+        walk += n_leaves;
+    }
+}
+
 std::string tr_metainfo_builder::benc(tr_error** error) const
 {
-    TR_ASSERT_MSG(!std::empty(piece_hashes_), "did you forget to call makeChecksums() first?");
+    TR_ASSERT_MSG(
+        !std::empty(piece_hashes_) || !std::empty(pieces_roots_),
+        "did you forget to call makeChecksums() first?");
 
     auto const anonymize = this->anonymize();
     auto const& comment = this->comment();
@@ -324,13 +839,27 @@ std::string tr_metainfo_builder::benc(tr_error** error) const
 
     tr_variantDictAddStrView(&top, TR_KEY_encoding, "UTF-8");
 
-    auto* const info_dict = tr_variantDictAddDict(&top, TR_KEY_info, 5);
+    auto* const info_dict = tr_variantDictAddDict(&top, TR_KEY_info, 8);
     auto const base = tr_sys_path_basename(top_);
+    auto const is_single_file = file_count() == 1U && !tr_strv_contains(path(0), '/');
+    auto const subpath = [this, &base](tr_file_index_t i)
+    {
+        auto ret = std::string_view{ path(i) };
+        if (!std::empty(base))
+        {
+            ret.remove_prefix(std::size(base) + std::size("/"sv));
+        }
+        return ret;
+    };
 
     // "There is also a key `length` or a key `files`, but not both or neither.
     // If length is present then the download represents a single file,
     // otherwise it represents a set of files which go in a directory structure."
-    if (file_count() == 1U && !tr_strv_contains(path(0), '/'))
+    if (version_ == Version::V2)
+    {
+        // v2 torrents only have a "file tree"
+    }
+    else if (is_single_file)
     {
         tr_variantDictAddInt(info_dict, TR_KEY_length, file_size(0));
     }
@@ -338,23 +867,80 @@ std::string tr_metainfo_builder::benc(tr_error** error) const
     {
         auto const n_files = file_count();
         auto* const file_list = tr_variantDictAddList(info_dict, TR_KEY_files, n_files);
+        auto offset = uint64_t{};
 
         for (tr_file_index_t i = 0; i < n_files; ++i)
         {
+            // hybrid and padded v1 torrents pad each file's last piece with
+            // a pad file so that the next file starts on a new piece, as in BEP 47
+            if (auto const pad = offset % piece_size(); is_aligned() && pad != 0U && file_size(i) != 0U)
+            {
+                auto const pad_size = piece_size() - pad;
+                auto* const pad_dict = tr_variantListAddDict(file_list, 3);
+                tr_variantDictAddStrView(pad_dict, TR_KEY_attr, "p"sv);
+                tr_variantDictAddInt(pad_dict, TR_KEY_length, pad_size);
+                auto* const path_list = tr_variantDictAddList(pad_dict, TR_KEY_path, 2);
+                tr_variantListAddStrView(path_list, ".pad"sv);
+                tr_variantListAddStr(path_list, std::to_string(pad_size));
+                offset += pad_size;
+            }
+
             auto* const file_dict = tr_variantListAddDict(file_list, 2);
             tr_variantDictAddInt(file_dict, TR_KEY_length, file_size(i));
+            offset += file_size(i);
 
-            auto subpath = std::string_view{ path(i) };
-            if (!std::empty(base))
+            auto* const path_list = tr_variantDictAddList(file_dict, TR_KEY_path, 0);
+            auto token = std::string_view{};
+            for (auto sv = subpath(i); tr_strv_sep(&sv, &token, '/');)
             {
-                subpath.remove_prefix(std::size(base) + std::size("/"sv));
+                tr_variantListAddStr(path_list, token);
             }
+        }
+    }
 
-            auto* const path_list = tr_variantDictAddList(file_dict, TR_KEY_path, 0);
+    if (version_ != Version::V1)
+    {
+        tr_variantDictAddInt(info_dict, TR_KEY_meta_version, 2);
+
+        auto* const file_tree = tr_variantDictAddDict(info_dict, TR_KEY_file_tree, 1);
+        for (tr_file_index_t i = 0, n_files = file_count(); i < n_files; ++i)
+        {
+            auto* node = file_tree;
             auto token = std::string_view{};
-            while (tr_strv_sep(&subpath, &token, '/'))
+            for (auto sv = is_single_file ? std::string_view{ path(i) } : subpath(i); tr_strv_sep(&sv, &token, '/');)
             {
-                tr_variantListAddStr(path_list, token);
+                auto const key = tr_quark_new(token);
+                if (tr_variant* child = nullptr; tr_variantDictFindDict(node, key, &child))
+                {
+                    node = child;
+                }
+                else
+                {
+                    node = tr_variantDictAddDict(node, key, 1);
+                }
+            }
+
+            // a file's properties are in a dict whose key is an empty string
+            auto* const file_dict = tr_variantDictAddDict(node, TR_KEY_NONE, 2);
+            tr_variantDictAddInt(file_dict, TR_KEY_length, file_size(i));
+            if (file_size(i) != 0U)
+            {
+                auto const& root = pieces_roots_.at(i);
+                tr_variantDictAddRaw(file_dict, TR_KEY_pieces_root, std::data(root), std::size(root));
+            }
+        }
+
+        // the hashes in the layer of each file's merkle tree that covers
+        // one piece per hash, keyed by the file's root. Files that fit in
+        // one piece don't need one, since their root is their piece hash.
+        auto* const piece_layers = tr_variantDictAddDict(&top, TR_KEY_piece_layers, file_count());
+        for (tr_file_index_t i = 0, n_files = file_count(); i < n_files; ++i)
+        {
+            if (auto const& layer = piece_layers_.at(i); !std::empty(layer))
+            {
+                auto const& root = pieces_roots_.at(i);
+                auto const key = tr_quark_new({ reinterpret_cast<char const*>(std::data(root)), std::size(root) });
+                tr_variantDictAddRaw(piece_layers, key, std::data(layer), std::size(layer) * sizeof(tr_sha256_digest_t));
             }
         }
     }
@@ -365,7 +951,11 @@ std::string tr_metainfo_builder::benc(tr_error** error) const
     }
 
     tr_variantDictAddInt(info_dict, TR_KEY_piece_length, piece_size());
-    tr_variantDictAddRaw(info_dict, TR_KEY_pieces, std::data(piece_hashes_), std::size(piece_hashes_));
+
+    if (version_ != Version::V2)
+    {
+        tr_variantDictAddRaw(info_dict, TR_KEY_pieces, std::data(piece_hashes_), std::size(piece_hashes_));
+    }
 
     if (is_private_)
     {
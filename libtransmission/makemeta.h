@@ -5,9 +5,11 @@
 
 #pragma once
 
-#include <cstddef> // std::byte
+#include <cstddef> // size_t, std::byte
 #include <cstdint>
+#include <ctime> // time_t
 #include <future>
+#include <optional>
 #include <string>
 #include <string_view>
 #include <utility> // std::pair
@@ -27,6 +29,18 @@ struct tr_error;
 class tr_metainfo_builder
 {
 public:
+    // Which versions of the BitTorrent protocol the torrent is for.
+    // v2 torrents hash each file separately into a merkle tree.
+    // Hybrid torrents have both, with each file aligned to a piece
+    // so that the v1 and v2 pieces are the same.
+    // https://www.bittorrent.org/beps/bep_0052.html
+    enum class Version : uint8_t
+    {
+        V1,
+        V2,
+        Hybrid
+    };
+
     explicit tr_metainfo_builder(std::string_view single_file_or_parent_directory);
 
     tr_metainfo_builder(tr_metainfo_builder&&) = delete;
@@ -91,8 +105,26 @@ public:
         comment_ = comment;
     }
 
+    // Whether v1 torrents should have BEP 47 padding files, so that each
+    // file starts on a new piece. v2 and hybrid torrents always do.
+    void set_pad_files(bool pad_files);
+
     bool set_piece_size(uint32_t piece_size) noexcept;
 
+    // Reuse the piece hashes of an earlier .torrent made from the same files,
+    // so that `make_checksums()` only hashes what's new or changed. A piece's
+    // hash is reused if each of its files has the same path, size, and offset
+    // as before, and hasn't been modified since the old torrent was created.
+    // This adopts the old torrent's piece size. Only v1 torrents reuse hashes.
+    bool set_previous(std::string_view torrent_filename, tr_error** error = nullptr);
+
+    // How many threads `make_checksums()` should hash pieces with,
+    // or 0 for one per CPU core. Pieces are read ahead while they hash.
+    constexpr void set_threads(size_t n_threads) noexcept
+    {
+        n_threads_ = n_threads;
+    }
+
     constexpr void set_private(bool is_private) noexcept
     {
         is_private_ = is_private;
@@ -103,6 +135,10 @@ public:
         source_ = source;
     }
 
+    // This may change the order of the files, since v2 torrents
+    // list them in the order of their path components.
+    void set_version(Version version);
+
     void set_webseeds(std::vector<std::string> webseeds)
     {
         webseeds_ = std::move(webseeds);
@@ -145,6 +181,11 @@ public:
         return tr_sys_path_basename(top_);
     }
 
+    [[nodiscard]] constexpr auto pad_files() const noexcept
+    {
+        return pad_files_;
+    }
+
     [[nodiscard]] auto const& path(tr_file_index_t i) const noexcept
     {
         return files_.path(i);
@@ -160,11 +201,27 @@ public:
         return block_info_.piece_count();
     }
 
+    // How many pieces `make_checksums()` got from `set_previous()`'s torrent
+    [[nodiscard]] constexpr auto reused_piece_count() const noexcept
+    {
+        return n_reused_pieces_;
+    }
+
     [[nodiscard]] constexpr auto const& source() const noexcept
     {
         return source_;
     }
 
+    [[nodiscard]] constexpr auto threads() const noexcept
+    {
+        return n_threads_;
+    }
+
+    [[nodiscard]] constexpr auto version() const noexcept
+    {
+        return version_;
+    }
+
     [[nodiscard]] constexpr auto const& top() const noexcept
     {
         return top_;
@@ -175,6 +232,13 @@ public:
         return files_.totalSize();
     }
 
+    // The root of a file's v2 merkle tree, or all zeroes if the file is empty.
+    // Only set for v2 and hybrid torrents.
+    [[nodiscard]] auto const& pieces_root(tr_file_index_t i) const
+    {
+        return pieces_roots_.at(i);
+    }
+
     [[nodiscard]] constexpr auto const& webseeds() const noexcept
     {
         return webseeds_;
@@ -193,21 +257,49 @@ public:
     }
 
 private:
+    // an earlier version of the torrent whose piece hashes may be reused
+    struct Previous
+    {
+        tr_torrent_files files; // including BEP 47 padding files
+        std::vector<tr_sha1_digest_t> piece_hashes;
+        uint32_t piece_size = 0;
+        time_t date_created = 0;
+    };
+
     bool blocking_make_checksums(tr_error** error = nullptr);
 
+    // whether each file starts on a new piece
+    [[nodiscard]] constexpr bool is_aligned() const noexcept
+    {
+        return version_ != Version::V1 || pad_files_;
+    }
+
+    [[nodiscard]] uint64_t aligned_size(uint32_t piece_size) const noexcept;
+    [[nodiscard]] std::vector<bool> reusable_pieces() const;
+    void make_merkle_trees(std::vector<tr_sha256_digest_t> const& leaves);
+
     std::string top_;
     tr_torrent_files files_;
     tr_announce_list announce_;
     tr_block_info block_info_;
     std::vector<std::byte> piece_hashes_;
+    std::vector<tr_sha256_digest_t> pieces_roots_; // v2, one per file
+    std::vector<std::vector<tr_sha256_digest_t>> piece_layers_; // v2, one per file
     std::vector<std::string> webseeds_;
+    std::optional<Previous> previous_;
 
     std::string comment_;
     std::string source_;
 
     tr_piece_index_t checksum_piece_ = 0;
+    tr_piece_index_t n_reused_pieces_ = 0;
+
+    size_t n_threads_ = 0U;
+
+    Version version_ = Version::V1;
 
     bool is_private_ = false;
     bool anonymize_ = false;
+    bool pad_files_ = false;
     bool cancel_ = false;
 };
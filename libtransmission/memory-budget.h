@@ -0,0 +1,177 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <array>
+#include <cstddef> // size_t
+#include <cstdint> // uint8_t, uint64_t
+#include <string_view>
+
+// How much memory the session's biggest consumers are using, by category.
+struct tr_memory_usage
+{
+    enum Category : uint8_t
+    {
+        Cache, // dirty blocks waiting to be written
+        ReadCache, // clean blocks kept for uploading
+        BlockPool, // free block buffers waiting to be reused
+        PeerBuffers, // peers' read and write buffers
+        Metadata, // magnet links' partly-downloaded metainfo
+        InfoDicts, // info dicts kept for answering peers' metadata requests
+        NumCategories
+    };
+
+    // @return the category's name, e.g. "read_cache"
+    [[nodiscard]] static constexpr std::string_view name(Category category) noexcept
+    {
+        using namespace std::literals;
+
+        switch (category)
+        {
+        case Cache:
+            return "cache"sv;
+        case ReadCache:
+            return "read_cache"sv;
+        case BlockPool:
+            return "block_pool"sv;
+        case PeerBuffers:
+            return "peer_buffers"sv;
+        case Metadata:
+            return "metadata"sv;
+        case InfoDicts:
+            return "info_dicts"sv;
+        default:
+            return {};
+        }
+    }
+
+    [[nodiscard]] constexpr uint64_t total() const noexcept
+    {
+        auto sum = uint64_t{};
+        for (auto const n : bytes)
+        {
+            sum += n;
+        }
+        return sum;
+    }
+
+    std::array<uint64_t, NumCategories> bytes = {};
+};
+
+/**
+ * A limit on the total of a `tr_memory_usage`.
+ *
+ * The session measures its usage once a second. As the total nears the
+ * limit, the pressure goes up and the session sheds memory before the
+ * limit is reached: first by shrinking its caches, trimming peer buffers,
+ * and refusing new peers, then by hibernating idle seeds.
+ */
+class tr_memory_budget
+{
+public:
+    enum class Pressure : uint8_t
+    {
+        // under the budget, or there is no budget
+        None,
+
+        // near the budget: shed memory that's cheap to lose
+        High,
+
+        // at or over the budget: shed whatever can be shed
+        Critical
+    };
+
+    // the share of the budget that puts the session under pressure
+    static auto constexpr HighPercent = uint64_t{ 90U };
+
+    // Once under pressure, stay there until usage falls below this share,
+    // so that shedding doesn't switch on and off around `HighPercent`.
+    static auto constexpr RelievedPercent = uint64_t{ 75U };
+
+    // Zero means no limit
+    constexpr void set_limit(uint64_t limit_bytes) noexcept
+    {
+        limit_ = limit_bytes;
+        update(usage_);
+    }
+
+    [[nodiscard]] constexpr auto limit() const noexcept
+    {
+        return limit_;
+    }
+
+    [[nodiscard]] constexpr auto const& usage() const noexcept
+    {
+        return usage_;
+    }
+
+    [[nodiscard]] constexpr auto pressure() const noexcept
+    {
+        return pressure_;
+    }
+
+    // @return true if new peer connections should be refused
+    [[nodiscard]] constexpr bool is_refusing_peers() const noexcept
+    {
+        return pressure_ != Pressure::None;
+    }
+
+    // Record the latest usage.
+    // @return the new pressure
+    constexpr Pressure update(tr_memory_usage const& usage) noexcept
+    {
+        usage_ = usage;
+
+        auto const total = usage.total();
+        if (limit_ == 0U)
+        {
+            pressure_ = Pressure::None;
+        }
+        else if (total >= limit_)
+        {
+            pressure_ = Pressure::Critical;
+        }
+        else if (total * 100U >= limit_ * HighPercent)
+        {
+            pressure_ = Pressure::High;
+        }
+        else if (pressure_ != Pressure::None && total * 100U >= limit_ * RelievedPercent)
+        {
+            pressure_ = Pressure::High;
+        }
+        else
+        {
+            pressure_ = Pressure::None;
+        }
+
+        return pressure_;
+    }
+
+    // @return e.g. "high"
+    [[nodiscard]] static constexpr std::string_view name(Pressure pressure) noexcept
+    {
+        using namespace std::literals;
+
+        switch (pressure)
+        {
+        case Pressure::High:
+            return "high"sv;
+        case Pressure::Critical:
+            return "critical"sv;
+        default:
+            return "none"sv;
+        }
+    }
+
+private:
+    tr_memory_usage usage_;
+    uint64_t limit_ = 0U;
+    Pressure pressure_ = Pressure::None;
+};
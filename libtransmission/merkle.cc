@@ -0,0 +1,61 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm> // std::min()
+#include <string_view>
+#include <vector>
+
+#include "libtransmission/crypto-utils.h"
+#include "libtransmission/merkle.h"
+
+tr_sha256_digest_t tr_merkle_root(std::vector<tr_sha256_digest_t> layer, size_t width, tr_sha256_digest_t pad)
+{
+    static_assert(sizeof(tr_sha256_digest_t) == 32U, "the hashes in a layer must be contiguous");
+
+    auto pairs = std::vector<std::string_view>{};
+
+    for (; width > 1U; width /= 2U)
+    {
+        if (std::size(layer) % 2U != 0U)
+        {
+            layer.emplace_back(pad);
+        }
+
+        pairs.clear();
+        for (size_t i = 0; i < std::size(layer); i += 2U)
+        {
+            pairs.emplace_back(reinterpret_cast<char const*>(&layer[i]), sizeof(tr_sha256_digest_t) * 2U);
+        }
+
+        layer = tr_sha256_batch(pairs);
+        pad = tr_sha256::digest(pad, pad);
+    }
+
+    return std::empty(layer) ? pad : layer.front();
+}
+
+tr_sha256_digest_t tr_merkle_pad(size_t width)
+{
+    return tr_merkle_root({}, width);
+}
+
+std::vector<tr_sha256_digest_t> tr_merkle_leaves(std::string_view data)
+{
+    auto blocks = std::vector<std::string_view>{};
+    blocks.reserve(tr_merkle_leaf_count(std::size(data)));
+    for (size_t pos = 0; pos < std::size(data); pos += TR_MERKLE_BLOCK_SIZE)
+    {
+        blocks.emplace_back(data.substr(pos, std::min(std::size(data) - pos, size_t{ TR_MERKLE_BLOCK_SIZE })));
+    }
+
+    return tr_sha256_batch(blocks);
+}
+
+bool tr_merkle_verify(std::string_view data, tr_merkle_subtree const& subtree)
+{
+    return !std::empty(data) && std::size(data) == subtree.n_bytes &&
+        tr_merkle_leaf_count(std::size(data)) <= subtree.width &&
+        tr_merkle_root(tr_merkle_leaves(data), subtree.width) == subtree.root;
+}
@@ -0,0 +1,61 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#include <cstddef> // size_t
+#include <cstdint> // uint32_t, uint64_t
+#include <string_view>
+#include <vector>
+
+#include "libtransmission/crypto-utils.h" // tr_sha256_digest_t
+
+// BitTorrent v2 hashes each file with a merkle tree.
+// https://www.bittorrent.org/beps/bep_0052.html
+
+// the tree has a leaf for every 16 KiB of the file
+auto inline constexpr TR_MERKLE_BLOCK_SIZE = uint32_t{ 1024U * 16U };
+
+// The part of a file's merkle tree that covers one piece
+struct tr_merkle_subtree
+{
+    tr_sha256_digest_t root = {};
+    size_t width = 0; // number of leaves, including the zero padding
+    uint32_t n_bytes = 0; // how much of the piece is file data, i.e. not padding
+};
+
+[[nodiscard]] constexpr size_t tr_merkle_leaf_count(uint64_t n_bytes) noexcept
+{
+    return static_cast<size_t>((n_bytes + TR_MERKLE_BLOCK_SIZE - 1U) / TR_MERKLE_BLOCK_SIZE);
+}
+
+// @return the smallest power of two that's at least `n_leaves`
+[[nodiscard]] constexpr size_t tr_merkle_width(size_t n_leaves) noexcept
+{
+    auto ret = size_t{ 1U };
+    while (ret < n_leaves)
+    {
+        ret <<= 1U;
+    }
+    return ret;
+}
+
+// @return the root of a merkle tree whose bottom layer is `layer`, padded
+// to `width` hashes with `pad`. `width` must be a power of two, and `pad`
+// is the root of a subtree of the same height whose leaves are all zeroes.
+[[nodiscard]] tr_sha256_digest_t tr_merkle_root(
+    std::vector<tr_sha256_digest_t> layer,
+    size_t width,
+    tr_sha256_digest_t pad = {});
+
+// @return the root of a subtree of `width` leaves that are all zeroes,
+// i.e. what pads a layer whose hashes are the roots of such subtrees
+[[nodiscard]] tr_sha256_digest_t tr_merkle_pad(size_t width);
+
+// @return the leaf hashes of `data`, one for every 16 KiB
+[[nodiscard]] std::vector<tr_sha256_digest_t> tr_merkle_leaves(std::string_view data);
+
+// @return true if `data`, the first `subtree.n_bytes` of a piece, is what `subtree` covers
+[[nodiscard]] bool tr_merkle_verify(std::string_view data, tr_merkle_subtree const& subtree);
@@ -0,0 +1,363 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include "libtransmission/log.h"
+#include "libtransmission/metrics.h"
+#include "libtransmission/utils.h" // _()
+
+using namespace std::literals;
+
+namespace
+{
+// Label values are quoted, so escape the characters that the format reserves.
+[[nodiscard]] std::string escape_label_value(std::string_view src)
+{
+    auto ret = std::string{};
+    ret.reserve(std::size(src));
+
+    for (auto const ch : src)
+    {
+        switch (ch)
+        {
+        case '\\':
+            ret += "\\\\"sv;
+            break;
+
+        case '"':
+            ret += "\\\""sv;
+            break;
+
+        case '\n':
+            ret += "\\n"sv;
+            break;
+
+        default:
+            ret += ch;
+            break;
+        }
+    }
+
+    return ret;
+}
+
+[[nodiscard]] constexpr double to_seconds(uint64_t usec) noexcept
+{
+    return static_cast<double>(usec) / 1000000.0;
+}
+
+[[nodiscard]] bool is_same_place(tr_source_location const& a, tr_source_location const& b) noexcept
+{
+    return a.line == b.line && (a.file == b.file || std::strcmp(a.file, b.file) == 0);
+}
+
+[[nodiscard]] std::string labels(tr_metrics::SlowCalls const& calls)
+{
+    return fmt::format("kind=\"{:s}\",location=\"{:s}\"", calls.kind_name(), escape_label_value(calls.location()));
+}
+
+// how many places' slow calls to list in the metrics
+auto constexpr SlowCallsReported = size_t{ 20U };
+} // namespace
+
+void tr_metrics::Histogram::observe(std::chrono::microseconds duration) noexcept
+{
+    auto const usec = static_cast<uint64_t>(std::max(duration.count(), decltype(duration.count()){}));
+    auto const& bounds = BucketBoundsUsec;
+    auto const bucket = std::lower_bound(std::begin(bounds), std::end(bounds), usec) - std::begin(bounds);
+
+    buckets_[bucket].fetch_add(1U, std::memory_order_relaxed);
+    sum_usec_.fetch_add(usec, std::memory_order_relaxed);
+    count_.fetch_add(1U, std::memory_order_relaxed);
+}
+
+void tr_metrics::Histogram::write(std::string& out, std::string_view name, std::string_view labels) const
+{
+    auto const sep = std::empty(labels) ? ""sv : ","sv;
+    auto const bucket_name = fmt::format("{:s}_bucket", name);
+
+    auto cumulative = uint64_t{};
+    for (size_t i = 0; i < std::size(BucketBoundsUsec); ++i)
+    {
+        cumulative += buckets_[i].load(std::memory_order_relaxed);
+        auto const le = to_seconds(BucketBoundsUsec[i]);
+        write_sample(out, bucket_name, fmt::format("{:s}{:s}le=\"{}\"", labels, sep, le), cumulative);
+    }
+
+    cumulative += buckets_.back().load(std::memory_order_relaxed);
+    write_sample(out, bucket_name, fmt::format("{:s}{:s}le=\"+Inf\"", labels, sep), cumulative);
+    write_sample(out, fmt::format("{:s}_sum", name), labels, to_seconds(sum_usec_.load(std::memory_order_relaxed)));
+    write_sample(out, fmt::format("{:s}_count", name), labels, count_.load(std::memory_order_relaxed));
+}
+
+std::string_view tr_metrics::SlowCalls::kind_name() const noexcept
+{
+    return kind == LoopCall::Timer ? "timer"sv : "callback"sv;
+}
+
+std::string tr_metrics::SlowCalls::location() const
+{
+    auto file = std::string_view{ where.file };
+    if (auto const pos = file.find_last_of("/\\"sv); pos != std::string_view::npos)
+    {
+        file.remove_prefix(pos + 1U);
+    }
+
+    return fmt::format("{:s}:{:d}", std::empty(file) ? "unknown"sv : file, where.line);
+}
+
+// ---
+
+tr_metrics& tr_metrics::instance()
+{
+    static auto metrics = tr_metrics{};
+    return metrics;
+}
+
+void tr_metrics::observe_loop_call(LoopCall kind, tr_source_location where, std::chrono::microseconds duration)
+{
+    (kind == LoopCall::Timer ? loop_timer_duration : loop_callback_duration).observe(duration);
+
+    if (duration < SlowCallFloor)
+    {
+        return;
+    }
+
+    auto calls = SlowCalls{ kind, where };
+    {
+        auto const lock = std::lock_guard{ slow_calls_mutex_ };
+
+        auto iter = std::find_if(
+            std::begin(slow_calls_),
+            std::end(slow_calls_),
+            [kind, &where](auto const& walk) { return walk.kind == kind && is_same_place(walk.where, where); });
+        if (iter == std::end(slow_calls_))
+        {
+            iter = slow_calls_.insert(std::end(slow_calls_), calls);
+        }
+
+        ++iter->count;
+        iter->total += duration;
+        iter->max = std::max(iter->max, duration);
+    }
+
+    if (auto const warn_usec = slow_call_warning_usec_.load(std::memory_order_relaxed);
+        warn_usec > 0 && duration.count() > warn_usec)
+    {
+        tr_logAddWarn(fmt::format(
+            _("A {kind} from {location} blocked the event loop for {duration} ms"),
+            fmt::arg("kind", calls.kind_name()),
+            fmt::arg("location", calls.location()),
+            fmt::arg("duration", std::chrono::duration_cast<std::chrono::milliseconds>(duration).count())));
+    }
+}
+
+std::vector<tr_metrics::SlowCalls> tr_metrics::slowest_loop_calls(size_t n) const
+{
+    auto ret = std::vector<SlowCalls>{};
+    {
+        auto const lock = std::lock_guard{ slow_calls_mutex_ };
+        ret = slow_calls_;
+    }
+
+    auto const longest_first = [](auto const& a, auto const& b)
+    {
+        return a.total > b.total;
+    };
+    n = std::min(n, std::size(ret));
+    std::partial_sort(std::begin(ret), std::begin(ret) + n, std::end(ret), longest_first);
+    ret.resize(n);
+    return ret;
+}
+
+void tr_metrics::observe_announce(std::string_view host_and_port, std::chrono::microseconds duration)
+{
+    auto const lock = std::lock_guard{ announce_mutex_ };
+
+    auto iter = announce_duration_.find(host_and_port);
+    if (iter == std::end(announce_duration_))
+    {
+        iter = announce_duration_.try_emplace(std::string{ host_and_port }, std::make_unique<Histogram>()).first;
+    }
+
+    iter->second->observe(duration);
+}
+
+void tr_metrics::write(std::string& out) const
+{
+    write_header(
+        out,
+        "transmission_cache_flush_duration_seconds"sv,
+        "histogram"sv,
+        "Time spent per disk write made to flush the cache."sv);
+    cache_flush_duration.write(out, "transmission_cache_flush_duration_seconds"sv);
+
+    write_header(out, "transmission_verify_pieces_total"sv, "counter"sv, "Pieces checked while verifying local data."sv);
+    write_sample(out, "transmission_verify_pieces_total"sv, {}, verify_pieces.value());
+
+    write_header(out, "transmission_verify_bytes_total"sv, "counter"sv, "Bytes checked while verifying local data."sv);
+    write_sample(out, "transmission_verify_bytes_total"sv, {}, verify_bytes.value());
+
+    write_header(
+        out,
+        "transmission_duplicate_block_requests_total"sv,
+        "counter"sv,
+        "Block requests sent to a peer while another peer had already been asked for the block."sv);
+    write_sample(out, "transmission_duplicate_block_requests_total"sv, {}, duplicate_block_requests.value());
+
+    write_header(
+        out,
+        "transmission_cancels_sent_total"sv,
+        "counter"sv,
+        "Block requests cancelled because the block came from another peer or took too long."sv);
+    write_sample(out, "transmission_cancels_sent_total"sv, {}, cancels_sent.value());
+
+    write_header(
+        out,
+        "transmission_wasted_piece_bytes_total"sv,
+        "counter"sv,
+        "Piece data that was thrown away because the block was cancelled or had already arrived."sv);
+    write_sample(out, "transmission_wasted_piece_bytes_total"sv, {}, wasted_piece_bytes.value());
+
+    write_header(
+        out,
+        "transmission_incoming_handshakes_total"sv,
+        "counter"sv,
+        "Incoming peer connections, by whether their handshake was accepted, refused, or timed out."sv);
+    for (auto const& [result, counter] : { std::pair{ "accepted"sv, &incoming_handshakes_accepted },
+                                           std::pair{ "refused"sv, &incoming_handshakes_refused },
+                                           std::pair{ "timed_out"sv, &incoming_handshakes_timed_out } })
+    {
+        write_sample(
+            out,
+            "transmission_incoming_handshakes_total"sv,
+            fmt::format("result=\"{:s}\"", result),
+            counter->value());
+    }
+
+    write_header(
+        out,
+        "transmission_outgoing_connect_duration_seconds"sv,
+        "histogram"sv,
+        "Time from starting an outgoing peer connection to reading the peer's first bytes, by transport."sv);
+    outgoing_connect_duration_tcp.write(out, "transmission_outgoing_connect_duration_seconds"sv, "transport=\"tcp\""sv);
+    outgoing_connect_duration_utp.write(out, "transmission_outgoing_connect_duration_seconds"sv, "transport=\"utp\""sv);
+
+    write_header(
+        out,
+        "transmission_event_loop_lag_seconds"sv,
+        "histogram"sv,
+        "How late timers fire, i.e. how far behind their event loop is."sv);
+    event_loop_lag.write(out, "transmission_event_loop_lag_seconds"sv);
+
+    write_header(
+        out,
+        "transmission_loop_callback_wait_seconds"sv,
+        "histogram"sv,
+        "Time that callbacks queued for the session thread waited to run."sv);
+    loop_callback_wait.write(out, "transmission_loop_callback_wait_seconds"sv);
+
+    write_header(
+        out,
+        "transmission_loop_call_duration_seconds"sv,
+        "histogram"sv,
+        "Time spent per queued callback or timer callback, blocking its event loop."sv);
+    loop_callback_duration.write(out, "transmission_loop_call_duration_seconds"sv, "kind=\"callback\""sv);
+    loop_timer_duration.write(out, "transmission_loop_call_duration_seconds"sv, "kind=\"timer\""sv);
+
+    auto const slowest = slowest_loop_calls(SlowCallsReported);
+    write_header(
+        out,
+        "transmission_loop_slow_calls_total"sv,
+        "counter"sv,
+        "Event loop calls that took 1ms or more, by where they came from."sv);
+    for (auto const& calls : slowest)
+    {
+        write_sample(out, "transmission_loop_slow_calls_total"sv, labels(calls), calls.count);
+    }
+
+    write_header(
+        out,
+        "transmission_loop_slow_calls_seconds_total"sv,
+        "counter"sv,
+        "Time spent in event loop calls that took 1ms or more, by where they came from."sv);
+    for (auto const& calls : slowest)
+    {
+        write_sample(
+            out,
+            "transmission_loop_slow_calls_seconds_total"sv,
+            labels(calls),
+            to_seconds(static_cast<uint64_t>(calls.total.count())));
+    }
+
+    write_header(
+        out,
+        "transmission_loop_slowest_call_seconds"sv,
+        "gauge"sv,
+        "The longest event loop call, by where it came from."sv);
+    for (auto const& calls : slowest)
+    {
+        write_sample(
+            out,
+            "transmission_loop_slowest_call_seconds"sv,
+            labels(calls),
+            to_seconds(static_cast<uint64_t>(calls.max.count())));
+    }
+
+    write_header(
+        out,
+        "transmission_announce_duration_seconds"sv,
+        "histogram"sv,
+        "Time from sending an announce to getting its response, per tracker."sv);
+    auto const lock = std::lock_guard{ announce_mutex_ };
+    for (auto const& [host_and_port, histogram] : announce_duration_)
+    {
+        histogram->write(
+            out,
+            "transmission_announce_duration_seconds"sv,
+            fmt::format("tracker=\"{:s}\"", escape_label_value(host_and_port)));
+    }
+}
+
+void tr_metrics::write_header(std::string& out, std::string_view name, std::string_view type, std::string_view help)
+{
+    fmt::format_to(std::back_inserter(out), "# HELP {:s} {:s}\n# TYPE {:s} {:s}\n", name, help, name, type);
+}
+
+void tr_metrics::write_sample(std::string& out, std::string_view name, std::string_view labels, uint64_t value)
+{
+    if (std::empty(labels))
+    {
+        fmt::format_to(std::back_inserter(out), "{:s} {:d}\n", name, value);
+    }
+    else
+    {
+        fmt::format_to(std::back_inserter(out), "{:s}{{{:s}}} {:d}\n", name, labels, value);
+    }
+}
+
+void tr_metrics::write_sample(std::string& out, std::string_view name, std::string_view labels, double value)
+{
+    if (std::empty(labels))
+    {
+        fmt::format_to(std::back_inserter(out), "{:s} {}\n", name, value);
+    }
+    else
+    {
+        fmt::format_to(std::back_inserter(out), "{:s}{{{:s}}} {}\n", name, labels, value);
+    }
+}
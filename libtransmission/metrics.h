@@ -0,0 +1,165 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef> // size_t
+#include <cstdint> // uint64_t
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "libtransmission/tr-macros.h" // tr_source_location
+
+// Process-wide counters and histograms for the hot paths that the other
+// stats don't cover. Updating one is a relaxed atomic add, so they can be
+// bumped from any thread. `tr_rpc_server` serves them, along with the
+// session's own stats, at `/transmission/metrics` in the Prometheus text
+// exposition format.
+class tr_metrics
+{
+public:
+    class Counter
+    {
+    public:
+        void add(uint64_t n = 1U) noexcept
+        {
+            value_.fetch_add(n, std::memory_order_relaxed);
+        }
+
+        [[nodiscard]] uint64_t value() const noexcept
+        {
+            return value_.load(std::memory_order_relaxed);
+        }
+
+    private:
+        std::atomic<uint64_t> value_ = {};
+    };
+
+    // A latency histogram with fixed buckets from 1ms to 10s.
+    class Histogram
+    {
+    public:
+        static constexpr auto BucketBoundsUsec = std::array<uint64_t, 13U>{
+            1'000U, 2'500U, 5'000U, 10'000U, 25'000U, 50'000U, 100'000U, 250'000U, 500'000U, 1'000'000U, 2'500'000U, 5'000'000U,
+            10'000'000U,
+        };
+
+        void observe(std::chrono::microseconds duration) noexcept;
+
+        // Append this histogram's series, as `name{labels,le="..."}` etc.
+        void write(std::string& out, std::string_view name, std::string_view labels = {}) const;
+
+    private:
+        // non-cumulative; the last one counts the observations above every bound
+        std::array<std::atomic<uint64_t>, std::size(BucketBoundsUsec) + 1U> buckets_ = {};
+        std::atomic<uint64_t> sum_usec_ = {};
+        std::atomic<uint64_t> count_ = {};
+    };
+
+    [[nodiscard]] static tr_metrics& instance();
+
+    // time spent writing the cache's blocks to disk, per write
+    Histogram cache_flush_duration;
+
+    // pieces, and bytes in those pieces, checked by tr_verify_worker
+    Counter verify_pieces;
+    Counter verify_bytes;
+
+    // block requests sent to a second peer, e.g. in endgame; the cancels
+    // sent when another peer's copy came first; and the piece data that
+    // arrived anyway and was thrown away
+    Counter duplicate_block_requests;
+    Counter cancels_sent;
+    Counter wasted_piece_bytes;
+
+    // incoming peer handshakes, by what became of them
+    Counter incoming_handshakes_accepted;
+    Counter incoming_handshakes_refused;
+    Counter incoming_handshakes_timed_out;
+
+    // time from starting an outgoing peer connection to reading the
+    // peer's first bytes, by the transport that got through
+    Histogram outgoing_connect_duration_tcp;
+    Histogram outgoing_connect_duration_utp;
+
+    // how late libtransmission::Timers fire, i.e. how far behind their event loops are
+    Histogram event_loop_lag;
+
+    // how long callbacks queued with `tr_session::runInSessionThread()` waited to run
+    Histogram loop_callback_wait;
+
+    // how long each queued callback or timer callback ran; while it ran, its event loop was blocked
+    Histogram loop_callback_duration;
+    Histogram loop_timer_duration;
+
+    enum class LoopCall
+    {
+        Callback,
+        Timer
+    };
+
+    // The calls that held up an event loop the most, by the place in the
+    // code that queued the callback or made the timer. Only calls that took
+    // at least `SlowCallFloor` are counted.
+    struct SlowCalls
+    {
+        LoopCall kind = LoopCall::Callback;
+        tr_source_location where;
+        uint64_t count = 0;
+        std::chrono::microseconds total = {};
+        std::chrono::microseconds max = {};
+
+        // e.g. "timer"
+        [[nodiscard]] std::string_view kind_name() const noexcept;
+
+        // e.g. "torrent.cc:123"
+        [[nodiscard]] std::string location() const;
+    };
+
+    static auto constexpr SlowCallFloor = std::chrono::milliseconds{ 1 };
+
+    // Record a queued callback or a timer callback that ran in an event loop.
+    void observe_loop_call(LoopCall kind, tr_source_location where, std::chrono::microseconds duration);
+
+    // @return up to `n` places whose calls held up an event loop the longest, longest first
+    [[nodiscard]] std::vector<SlowCalls> slowest_loop_calls(size_t n) const;
+
+    // Log a warning for each call that takes longer than this. Zero disables it.
+    void set_slow_call_warning(std::chrono::milliseconds threshold) noexcept
+    {
+        slow_call_warning_usec_.store(std::chrono::microseconds{ threshold }.count(), std::memory_order_relaxed);
+    }
+
+    // Record the time from sending an announce to `host_and_port` to getting its response.
+    void observe_announce(std::string_view host_and_port, std::chrono::microseconds duration);
+
+    // Append the metrics above in the Prometheus text format.
+    void write(std::string& out) const;
+
+    // Helpers for writing other metrics in the same format.
+    static void write_header(std::string& out, std::string_view name, std::string_view type, std::string_view help);
+    static void write_sample(std::string& out, std::string_view name, std::string_view labels, uint64_t value);
+    static void write_sample(std::string& out, std::string_view name, std::string_view labels, double value);
+
+private:
+    std::atomic<int64_t> slow_call_warning_usec_ = {};
+
+    mutable std::mutex slow_calls_mutex_;
+    std::vector<SlowCalls> slow_calls_;
+
+    mutable std::mutex announce_mutex_;
+    std::map<std::string, std::unique_ptr<Histogram>, std::less<>> announce_duration_;
+};
@@ -9,15 +9,17 @@
 #include <cstdint>
 #include <cstring>
 #include <iterator> // std::back_inserter
+#include <mutex>
 #include <string_view>
 #include <utility> // std::pair
+#include <vector>
 
 #include <sys/types.h>
 
 #ifdef _WIN32
 #include <ws2tcpip.h>
 #else
-#include <netinet/tcp.h> /* TCP_CONGESTION */
+#include <netinet/tcp.h> /* TCP_CONGESTION, TCP_FASTOPEN_CONNECT, TCP_NOTSENT_LOWAT */
 #endif
 
 #include <event2/util.h>
@@ -142,6 +144,42 @@ void tr_netSetCongestionControl([[maybe_unused]] tr_socket_t s, [[maybe_unused]]
 #endif
 }
 
+static void setSocketBuffer(tr_socket_t s, int optname, char const* name, size_t size)
+{
+    if (size == 0U)
+    {
+        return;
+    }
+
+    auto const n = static_cast<int>(std::min(size, size_t{ INT_MAX }));
+    if (setsockopt(s, SOL_SOCKET, optname, reinterpret_cast<char const*>(&n), sizeof(n)) == -1)
+    {
+        tr_logAddDebug(fmt::format("Unable to set {} on socket {}: {}", name, s, tr_net_strerror(sockerrno)));
+    }
+}
+
+void tr_netSetSocketBuffers(tr_socket_t s, size_t send_size, size_t receive_size)
+{
+    setSocketBuffer(s, SO_SNDBUF, "SO_SNDBUF", send_size);
+    setSocketBuffer(s, SO_RCVBUF, "SO_RCVBUF", receive_size);
+}
+
+void tr_netSetNotSentLowat([[maybe_unused]] tr_socket_t s, [[maybe_unused]] size_t bytes)
+{
+#ifdef TCP_NOTSENT_LOWAT
+    if (bytes == 0U)
+    {
+        return;
+    }
+
+    auto const n = static_cast<int>(std::min(bytes, size_t{ INT_MAX }));
+    if (setsockopt(s, IPPROTO_TCP, TCP_NOTSENT_LOWAT, reinterpret_cast<char const*>(&n), sizeof(n)) == -1)
+    {
+        tr_logAddDebug(fmt::format("Unable to set TCP_NOTSENT_LOWAT on socket {}: {}", s, tr_net_strerror(sockerrno)));
+    }
+#endif
+}
+
 static tr_socket_t createSocket(int domain, int type)
 {
     auto const sockfd = socket(domain, type, 0);
@@ -210,12 +248,7 @@ tr_peer_socket tr_netOpenPeerSocket(tr_session* session, tr_socket_address const
     // seeds don't need a big read buffer, so make it smaller
     if (client_is_seed)
     {
-        int n = 8192;
-
-        if (setsockopt(s, SOL_SOCKET, SO_RCVBUF, reinterpret_cast<char const*>(&n), sizeof(n)) == -1)
-        {
-            tr_logAddDebug(fmt::format("Unable to set SO_RCVBUF on socket {}: {}", s, tr_net_strerror(sockerrno)));
-        }
+        tr_netSetSocketBuffers(s, 0U, 8192U);
     }
 
     auto const [sock, addrlen] = addr.to_sockaddr(port);
@@ -236,6 +269,18 @@ tr_peer_socket tr_netOpenPeerSocket(tr_session* session, tr_socket_address const
         return {};
     }
 
+#ifdef TCP_FASTOPEN_CONNECT
+    // Let the kernel carry our first write -- the handshake -- in the SYN
+    // when it has a Fast Open cookie for this peer. connect() then returns
+    // right away and the real connect happens on that first write. Whether
+    // it's used at all is up to the net.ipv4.tcp_fastopen sysctl.
+    if (int optval = 1;
+        setsockopt(s, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, reinterpret_cast<char const*>(&optval), sizeof(optval)) == -1)
+    {
+        tr_logAddDebug(fmt::format("Unable to set TCP_FASTOPEN_CONNECT on socket {}: {}", s, tr_net_strerror(sockerrno)));
+    }
+#endif
+
     auto ret = tr_peer_socket{};
     if (connect(s, reinterpret_cast<sockaddr const*>(&sock), addrlen) == -1 &&
 #ifdef _WIN32
@@ -267,7 +312,7 @@ tr_peer_socket tr_netOpenPeerSocket(tr_session* session, tr_socket_address const
     return ret;
 }
 
-static tr_socket_t tr_netBindTCPImpl(tr_address const& addr, tr_port port, bool suppress_msgs, int* err_out)
+static tr_socket_t tr_netBindTCPImpl(tr_address const& addr, tr_port port, bool suppress_msgs, bool reuse_port, int* err_out)
 {
     TR_ASSERT(addr.is_valid());
 
@@ -291,6 +336,22 @@ static tr_socket_t tr_netBindTCPImpl(tr_address const& addr, tr_port port, bool
     (void)setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, reinterpret_cast<char const*>(&optval), sizeof(optval));
     (void)setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<char const*>(&optval), sizeof(optval));
 
+#if HAVE_SO_REUSEPORT
+    if (reuse_port && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, reinterpret_cast<char const*>(&optval), sizeof(optval)) == -1)
+    {
+        *err_out = sockerrno;
+        tr_net_close_socket(fd);
+        return TR_BAD_SOCKET;
+    }
+#else
+    if (reuse_port)
+    {
+        *err_out = ENOPROTOOPT;
+        tr_net_close_socket(fd);
+        return TR_BAD_SOCKET;
+    }
+#endif
+
 #ifdef IPV6_V6ONLY
 
     if (addr.is_ipv6() &&
@@ -358,36 +419,152 @@ static tr_socket_t tr_netBindTCPImpl(tr_address const& addr, tr_port port, bool
     return fd;
 }
 
-tr_socket_t tr_netBindTCP(tr_address const& addr, tr_port port, bool suppress_msgs)
+namespace
+{
+namespace inherited_sockets_helpers
+{
+auto inherited_mutex = std::mutex{};
+auto inherited_sockets = std::vector<tr_socket_t>{};
+
+[[nodiscard]] tr_socket_t take_inherited_socket(tr_address const& addr, tr_port port)
+{
+    auto const lock = std::lock_guard{ inherited_mutex };
+
+    for (auto iter = std::begin(inherited_sockets); iter != std::end(inherited_sockets); ++iter)
+    {
+        auto sock = sockaddr_storage{};
+        auto len = socklen_t{ sizeof(sock) };
+        if (getsockname(*iter, reinterpret_cast<sockaddr*>(&sock), &len) != 0)
+        {
+            continue;
+        }
+
+        if (auto const bound = tr_address::from_sockaddr(reinterpret_cast<sockaddr const*>(&sock));
+            bound && bound->address() == addr && bound->port() == port)
+        {
+            auto const fd = *iter;
+            inherited_sockets.erase(iter);
+            return fd;
+        }
+    }
+
+    return TR_BAD_SOCKET;
+}
+} // namespace inherited_sockets_helpers
+} // namespace
+
+void tr_net_add_inherited_socket(tr_socket_t sockfd)
+{
+    using namespace inherited_sockets_helpers;
+
+    auto const lock = std::lock_guard{ inherited_mutex };
+    inherited_sockets.push_back(sockfd);
+}
+
+void tr_net_close_inherited_sockets()
 {
+    using namespace inherited_sockets_helpers;
+
+    auto const lock = std::lock_guard{ inherited_mutex };
+    for (auto const fd : inherited_sockets)
+    {
+        tr_net_close_socket(fd);
+    }
+
+    inherited_sockets.clear();
+}
+
+tr_socket_t tr_netBindTCP(tr_address const& addr, tr_port port, bool suppress_msgs, bool reuse_port)
+{
+    using namespace inherited_sockets_helpers;
+
+    if (auto const fd = take_inherited_socket(addr, port); fd != TR_BAD_SOCKET)
+    {
+        tr_logAddDebug(fmt::format("Using inherited socket {:d} for port {:d} on {:s}", fd, port.host(), addr.display_name()));
+        return fd;
+    }
+
     int unused = 0;
-    return tr_netBindTCPImpl(addr, port, suppress_msgs, &unused);
+    return tr_netBindTCPImpl(addr, port, suppress_msgs, reuse_port, &unused);
 }
 
-std::optional<std::pair<tr_socket_address, tr_socket_t>> tr_netAccept(tr_session* session, tr_socket_t listening_sockfd)
+namespace
 {
-    TR_ASSERT(session != nullptr);
+namespace accept_helpers
+{
+// Accept a connection as a nonblocking socket that isn't inherited by child processes
+[[nodiscard]] tr_socket_t accept_socket(tr_socket_t listening_sockfd, sockaddr_storage& sock)
+{
+    auto len = socklen_t{ sizeof(sock) };
 
-    // accept the incoming connection
-    auto sock = sockaddr_storage{};
-    socklen_t len = sizeof(struct sockaddr_storage);
+#if defined(SOCK_NONBLOCK) && defined(SOCK_CLOEXEC)
+    return accept4(listening_sockfd, reinterpret_cast<sockaddr*>(&sock), &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
     auto const sockfd = accept(listening_sockfd, reinterpret_cast<sockaddr*>(&sock), &len);
-    if (sockfd == TR_BAD_SOCKET)
+    if (sockfd != TR_BAD_SOCKET &&
+        (evutil_make_socket_nonblocking(sockfd) == -1 || evutil_make_socket_closeonexec(sockfd) == -1))
     {
-        return {};
+        tr_net_close_socket(sockfd);
+        return TR_BAD_SOCKET;
     }
 
-    // get the address and port,
-    // make the socket unblocking,
-    // and confirm we don't have too many peers
-    auto const addrport = tr_address::from_sockaddr(reinterpret_cast<struct sockaddr*>(&sock));
-    if (!addrport || evutil_make_socket_nonblocking(sockfd) == -1 || tr_peer_socket::limit_reached(session))
+    return sockfd;
+#endif
+}
+
+// @return true if a failed accept() only lost that one connection,
+// e.g. because the peer gave up while it was in the backlog
+[[nodiscard]] constexpr bool is_transient_accept_error(int err) noexcept
+{
+#ifdef _WIN32
+    return err == WSAECONNRESET || err == WSAEINTR;
+#else
+    return err == ECONNABORTED || err == EINTR || err == EPROTO;
+#endif
+}
+} // namespace accept_helpers
+} // namespace
+
+std::vector<std::pair<tr_socket_address, tr_socket_t>> tr_netAccept(
+    tr_session* session,
+    tr_socket_t listening_sockfd,
+    size_t budget)
+{
+    using namespace accept_helpers;
+
+    TR_ASSERT(session != nullptr);
+
+    auto accepted = std::vector<std::pair<tr_socket_address, tr_socket_t>>{};
+
+    for (size_t n_tries = 0U; n_tries < budget; ++n_tries)
     {
-        tr_net_close_socket(sockfd);
-        return {};
+        auto sock = sockaddr_storage{};
+        auto const sockfd = accept_socket(listening_sockfd, sock);
+        if (sockfd == TR_BAD_SOCKET)
+        {
+            // stop when the backlog is empty or on errors like EMFILE
+            // that'll just happen again for the next connection
+            if (is_transient_accept_error(sockerrno))
+            {
+                continue;
+            }
+
+            break;
+        }
+
+        // Connections that can't be used are still taken off the backlog
+        // and closed right away, so that they don't crowd out good ones
+        auto const addrport = tr_address::from_sockaddr(reinterpret_cast<struct sockaddr*>(&sock));
+        if (!addrport || tr_peer_socket::limit_reached(session))
+        {
+            tr_net_close_socket(sockfd);
+            continue;
+        }
+
+        accepted.emplace_back(*addrport, sockfd);
     }
 
-    return std::pair{ *addrport, sockfd };
+    return accepted;
 }
 
 void tr_net_close_socket(tr_socket_t sockfd)
@@ -739,3 +916,93 @@ int tr_address::compare(tr_address const& that) const noexcept // <=>
 
     return false;
 }
+
+// --- tr_subnet
+
+std::optional<tr_subnet> tr_subnet::from_string(std::string_view subnet_sv)
+{
+    subnet_sv = tr_strv_strip(subnet_sv);
+    auto const address_sv = tr_strv_sep(&subnet_sv, '/');
+
+    auto const addr = tr_address::from_string(address_sv);
+    if (!addr)
+    {
+        return {};
+    }
+
+    auto const max_prefix_len = tr_address::CompactAddrBytes[addr->type] * 8U;
+    auto prefix_len = max_prefix_len;
+    if (!std::empty(subnet_sv))
+    {
+        auto remainder = std::string_view{};
+        auto const parsed = tr_num_parse<unsigned int>(subnet_sv, &remainder);
+        if (!parsed || !std::empty(remainder) || *parsed > max_prefix_len)
+        {
+            return {};
+        }
+
+        prefix_len = *parsed;
+    }
+
+    return tr_subnet{ *addr, static_cast<uint8_t>(prefix_len) };
+}
+
+std::vector<tr_subnet> tr_subnet::list_from_string(std::string_view subnets_sv)
+{
+    auto ret = std::vector<tr_subnet>{};
+
+    auto token = std::string_view{};
+    while (tr_strv_sep(&subnets_sv, &token, ','))
+    {
+        if (auto const subnet = from_string(token); subnet)
+        {
+            ret.emplace_back(*subnet);
+        }
+        else if (!std::empty(tr_strv_strip(token)))
+        {
+            tr_logAddWarn(fmt::format(_("Couldn't parse subnet '{subnet}'"), fmt::arg("subnet", tr_strv_strip(token))));
+        }
+    }
+
+    return ret;
+}
+
+std::vector<tr_subnet> const& tr_subnet::lan_defaults()
+{
+    static auto const subnets = list_from_string(
+        "10.0.0.0/8,172.16.0.0/12,192.168.0.0/16,169.254.0.0/16,127.0.0.0/8,"
+        "fc00::/7,fe80::/10,::1/128"sv);
+    return subnets;
+}
+
+bool tr_subnet::contains(tr_address const& addr) const noexcept
+{
+    if (addr.type != address_.type)
+    {
+        return false;
+    }
+
+    auto const* const a = addr.is_ipv4() ? reinterpret_cast<uint8_t const*>(&addr.addr.addr4.s_addr) :
+                                           addr.addr.addr6.s6_addr;
+    auto const* const b = address_.is_ipv4() ? reinterpret_cast<uint8_t const*>(&address_.addr.addr4.s_addr) :
+                                               address_.addr.addr6.s6_addr;
+
+    auto const n_whole_bytes = prefix_len_ / 8U;
+    if (std::memcmp(a, b, n_whole_bytes) != 0)
+    {
+        return false;
+    }
+
+    if (auto const n_bits = prefix_len_ % 8U; n_bits != 0U)
+    {
+        auto const mask = static_cast<uint8_t>(0xFFU << (8U - n_bits));
+        return (a[n_whole_bytes] & mask) == (b[n_whole_bytes] & mask);
+    }
+
+    return true;
+}
+
+std::string tr_subnet::display_name() const
+{
+    return fmt::format("{:s}/{:d}", address_.display_name(), prefix_len_);
+}
@@ -16,6 +16,7 @@
 #include <string>
 #include <string_view>
 #include <utility> // std::pair
+#include <vector>
 
 #ifdef _WIN32
 #include <ws2tcpip.h>
@@ -419,18 +420,61 @@ private:
     constexpr static std::hash<uint16_t> PortHasher{};
 };
 
+// An address block in CIDR notation, e.g. "192.168.0.0/16" or "fc00::/7"
+struct tr_subnet
+{
+    // A bare address is parsed as a block that holds only that address.
+    [[nodiscard]] static std::optional<tr_subnet> from_string(std::string_view subnet_sv);
+
+    // Parse a comma-separated list of subnets, skipping any invalid ones.
+    [[nodiscard]] static std::vector<tr_subnet> list_from_string(std::string_view subnets_sv);
+
+    // The private, link-local and loopback blocks of both address families
+    [[nodiscard]] static std::vector<tr_subnet> const& lan_defaults();
+
+    [[nodiscard]] bool contains(tr_address const& addr) const noexcept;
+
+    [[nodiscard]] std::string display_name() const;
+
+    tr_address address_;
+    uint8_t prefix_len_ = 0U;
+};
+
 // --- Sockets
 
 struct tr_session;
 
-tr_socket_t tr_netBindTCP(tr_address const& addr, tr_port port, bool suppress_msgs);
+// If `reuse_port` is true, the socket is bound with SO_REUSEPORT so that
+// several sockets can listen on the same port and share its connections.
+tr_socket_t tr_netBindTCP(tr_address const& addr, tr_port port, bool suppress_msgs, bool reuse_port = false);
+
+// Listening sockets that another process handed over, e.g. a daemon that's
+// being replaced. tr_netBindTCP() takes one of these instead of binding a
+// new socket if it's bound to the same address and port.
+void tr_net_add_inherited_socket(tr_socket_t sockfd);
 
-[[nodiscard]] std::optional<std::pair<tr_socket_address, tr_socket_t>> tr_netAccept(
+// Close the inherited sockets that tr_netBindTCP() didn't take.
+void tr_net_close_inherited_sockets();
+
+// Accept the connections that are waiting on a listening socket, until its
+// backlog is empty or `budget` of them have been taken off it. The accepted
+// sockets are nonblocking. Ones that can't be used, e.g. because there are
+// too many peers already, are closed instead of being returned.
+[[nodiscard]] std::vector<std::pair<tr_socket_address, tr_socket_t>> tr_netAccept(
     tr_session* session,
-    tr_socket_t listening_sockfd);
+    tr_socket_t listening_sockfd,
+    size_t budget);
 
 void tr_netSetCongestionControl(tr_socket_t s, char const* algorithm);
 
+// Set a socket's SO_SNDBUF and SO_RCVBUF. A size of 0 leaves that one alone.
+void tr_netSetSocketBuffers(tr_socket_t s, size_t send_size, size_t receive_size);
+
+// Only report a TCP socket as writable once less than `bytes` of what's
+// been written to it is still unsent, so that the rest waits in our own
+// buffers instead of the kernel's. A size of 0 leaves it alone.
+void tr_netSetNotSentLowat(tr_socket_t s, size_t bytes);
+
 void tr_net_close_socket(tr_socket_t fd);
 
 // --- TOS / DSCP
@@ -6,9 +6,14 @@
 #include <algorithm> // std::min
 #include <array>
 #include <cstdint> // uint8_t, uint64_t
+#include <limits>
 #include <string_view>
 #include <utility>
 
+#ifndef _WIN32
+#include <sys/resource.h> // getrlimit(), setrlimit()
+#endif
+
 #include <fmt/core.h>
 
 #include "libtransmission/transmission.h"
@@ -109,19 +114,110 @@ bool preallocate_file_full(tr_sys_file_t fd, uint64_t length, tr_error** error)
     return false;
 }
 
+// @return how many files the pool may hold without using more than half
+// of the process' file descriptors, raising the soft limit if that helps.
+[[nodiscard]] size_t get_max_open_files_for_fd_limit([[maybe_unused]] size_t wanted)
+{
+#ifndef _WIN32
+    auto rlim = rlimit{};
+    if (getrlimit(RLIMIT_NOFILE, &rlim) != 0 || rlim.rlim_cur == RLIM_INFINITY)
+    {
+        return std::numeric_limits<size_t>::max();
+    }
+
+    if (auto const wanted_fds = static_cast<rlim_t>(wanted) * 2U; rlim.rlim_cur < wanted_fds)
+    {
+        auto raised = rlim;
+        raised.rlim_cur = rlim.rlim_max == RLIM_INFINITY ? wanted_fds : std::min(wanted_fds, rlim.rlim_max);
+        if (setrlimit(RLIMIT_NOFILE, &raised) == 0)
+        {
+            rlim = raised;
+        }
+    }
+
+    return std::max(size_t{ 1U }, static_cast<size_t>(rlim.rlim_cur / 2U));
+#else
+    return std::numeric_limits<size_t>::max();
+#endif
+}
+
 } // unnamed namespace
 
 // ---
 
+void tr_open_files::set_max_open_files(size_t max_open_files)
+{
+    max_open_files = std::max(size_t{ 1U }, max_open_files);
+
+    if (auto const limit = get_max_open_files_for_fd_limit(max_open_files); max_open_files > limit)
+    {
+        tr_logAddWarn(fmt::format(
+            _("Only keeping {count} files open due to the system's open file limit"),
+            fmt::arg("count", limit)));
+        max_open_files = limit;
+    }
+
+    max_open_files_ = max_open_files;
+
+    while (size() > max_open_files_)
+    {
+        evict_oldest();
+    }
+}
+
+tr_open_files::Val* tr_open_files::find(tr_torrent_id_t tor_id, tr_file_index_t file_num)
+{
+    auto const tor_iter = pool_.find(tor_id);
+    if (tor_iter == std::end(pool_))
+    {
+        return nullptr;
+    }
+
+    auto& files = tor_iter->second;
+    auto const iter = files.find(file_num);
+    if (iter == std::end(files))
+    {
+        return nullptr;
+    }
+
+    // mark it as the most recently used
+    auto& val = iter->second;
+    lru_.splice(std::begin(lru_), lru_, val.lru_pos_);
+    return &val;
+}
+
+void tr_open_files::add(tr_torrent_id_t tor_id, tr_file_index_t file_num, tr_sys_file_t fd, bool writable)
+{
+    while (size() >= max_open_files_)
+    {
+        evict_oldest();
+    }
+
+    auto& val = pool_[tor_id][file_num];
+    val.fd_ = fd;
+    val.writable_ = writable;
+    val.lru_pos_ = lru_.emplace(std::begin(lru_), tor_id, file_num);
+}
+
+void tr_open_files::evict_oldest()
+{
+    TR_ASSERT(!std::empty(lru_));
+
+    auto const [tor_id, file_num] = lru_.back();
+    close_file(tor_id, file_num);
+    ++stats_.evictions;
+}
+
 std::optional<tr_sys_file_t> tr_open_files::get(tr_torrent_id_t tor_id, tr_file_index_t file_num, bool writable)
 {
-    if (auto* const found = pool_.get(make_key(tor_id, file_num)); found != nullptr)
+    if (auto* const found = find(tor_id, file_num); found != nullptr)
     {
         if (writable && !found->writable_)
         {
             return {};
         }
 
+        ++stats_.hits;
         return found->fd_;
     }
 
@@ -137,21 +233,52 @@ std::optional<tr_sys_file_t> tr_open_files::get(
     uint64_t file_size)
 {
     // is there already an entry
-    auto key = make_key(tor_id, file_num);
-    if (auto* const found = pool_.get(key); found != nullptr)
+    if (auto* const found = find(tor_id, file_num); found != nullptr)
     {
         if (!writable || found->writable_)
         {
+            ++stats_.hits;
             return found->fd_;
         }
 
-        pool_.erase(key); // close so we can re-open as writable
+        close_file(tor_id, file_num); // close so we can re-open as writable
+    }
+
+    ++stats_.misses;
+
+    auto const fd = open_file(filename_in, &writable, allocation, file_size);
+    if (!fd)
+    {
+        return {};
     }
 
+    // cache it
+    add(tor_id, file_num, *fd, writable);
+
+    return fd;
+}
+
+std::optional<tr_sys_file_t> tr_open_files::open_uncached(
+    std::string_view filename,
+    bool writable,
+    tr_preallocation_mode allocation,
+    uint64_t file_size)
+{
+    ++stats_.misses;
+
+    return open_file(filename, &writable, allocation, file_size);
+}
+
+std::optional<tr_sys_file_t> tr_open_files::open_file(
+    std::string_view filename_in,
+    bool* writable,
+    tr_preallocation_mode allocation,
+    uint64_t file_size)
+{
     // create subfolders, if any
     auto const filename = tr_pathbuf{ filename_in };
     tr_error* error = nullptr;
-    if (writable)
+    if (*writable)
     {
         auto dir = tr_pathbuf{ filename.sv() };
         dir.popdir();
@@ -172,10 +299,10 @@ std::optional<tr_sys_file_t> tr_open_files::get(
 
     // we need write permissions to resize the file
     bool const resize_needed = already_existed && (file_size < info->size);
-    writable |= resize_needed;
+    *writable |= resize_needed;
 
     // open the file
-    int flags = writable ? (TR_SYS_FILE_WRITE | TR_SYS_FILE_CREATE) : 0;
+    int flags = *writable ? (TR_SYS_FILE_WRITE | TR_SYS_FILE_CREATE) : 0;
     flags |= TR_SYS_FILE_READ | TR_SYS_FILE_SEQUENTIAL;
     auto const fd = tr_sys_file_open(filename, flags, 0666, &error);
     if (!is_open(fd))
@@ -189,7 +316,7 @@ std::optional<tr_sys_file_t> tr_open_files::get(
         return {};
     }
 
-    if (writable && !already_existed && allocation != TR_PREALLOCATE_NONE)
+    if (*writable && !already_existed && allocation != TR_PREALLOCATE_NONE)
     {
         bool success = false;
         char const* type = nullptr;
@@ -239,27 +366,50 @@ std::optional<tr_sys_file_t> tr_open_files::get(
         return {};
     }
 
-    // cache it
-    auto& entry = pool_.add(std::move(key));
-    entry.fd_ = fd;
-    entry.writable_ = writable;
-
     return fd;
 }
 
 void tr_open_files::close_all()
 {
     pool_.clear();
+    lru_.clear();
 }
 
 void tr_open_files::close_torrent(tr_torrent_id_t tor_id)
 {
-    return pool_.erase_if([&tor_id](Key const& key, Val const& /*unused*/) { return key.first == tor_id; });
+    auto const tor_iter = pool_.find(tor_id);
+    if (tor_iter == std::end(pool_))
+    {
+        return;
+    }
+
+    for (auto const& [file_num, val] : tor_iter->second)
+    {
+        lru_.erase(val.lru_pos_);
+    }
+
+    pool_.erase(tor_iter);
 }
 
 void tr_open_files::close_file(tr_torrent_id_t tor_id, tr_file_index_t file_num)
 {
-    pool_.erase(make_key(tor_id, file_num));
+    auto const tor_iter = pool_.find(tor_id);
+    if (tor_iter == std::end(pool_))
+    {
+        return;
+    }
+
+    auto& files = tor_iter->second;
+    if (auto const iter = files.find(file_num); iter != std::end(files))
+    {
+        lru_.erase(iter->second.lru_pos_);
+        files.erase(iter);
+    }
+
+    if (std::empty(files))
+    {
+        pool_.erase(tor_iter);
+    }
 }
 
 tr_open_files::Val::~Val()
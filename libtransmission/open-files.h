@@ -11,19 +11,37 @@
 
 #include <cstddef> // for size_t
 #include <cstdint> // for uintX_t
+#include <list>
 #include <optional>
 #include <string_view>
+#include <unordered_map>
 #include <utility>
 
 #include "transmission.h"
 
 #include "file.h" // tr_sys_file_t
-#include "lru-cache.h"
 
-// A pool of open files that are cached while reading / writing torrents' data
+// A pool of open files that are cached while reading / writing torrents' data.
+// Files are looked up by torrent, then by file index, so that closing all of
+// a torrent's files doesn't need to walk the whole pool. When the pool is
+// full, the least-recently-used file is closed to make room.
 class tr_open_files
 {
 public:
+    static auto constexpr DefaultMaxOpenFiles = size_t{ 32U };
+
+    struct Stats
+    {
+        uint64_t hits = 0U;
+        uint64_t misses = 0U;
+        uint64_t evictions = 0U;
+    };
+
+    explicit tr_open_files(size_t max_open_files = DefaultMaxOpenFiles)
+    {
+        set_max_open_files(max_open_files);
+    }
+
     [[nodiscard]] std::optional<tr_sys_file_t> get(tr_torrent_id_t tor_id, tr_file_index_t file_num, bool writable);
 
     [[nodiscard]] std::optional<tr_sys_file_t> get(
@@ -34,18 +52,45 @@ public:
         tr_preallocation_mode allocation,
         uint64_t file_size);
 
+    // Open a file without adding it to the pool, e.g. a small file that
+    // is read or written in full by one call, so that it doesn't push out
+    // files that are still being used. The caller must close it.
+    [[nodiscard]] std::optional<tr_sys_file_t> open_uncached(
+        std::string_view filename,
+        bool writable,
+        tr_preallocation_mode allocation,
+        uint64_t file_size);
+
     void close_all();
     void close_torrent(tr_torrent_id_t tor_id);
     void close_file(tr_torrent_id_t tor_id, tr_file_index_t file_num);
 
-private:
-    using Key = std::pair<tr_torrent_id_t, tr_file_index_t>;
+    // Set how many files may be open at once. This is clamped so that the
+    // pool never uses more than half of the process' file descriptor limit,
+    // leaving the rest for peer sockets. Extra files are closed right away.
+    void set_max_open_files(size_t max_open_files);
 
-    [[nodiscard]] static Key make_key(tr_torrent_id_t tor_id, tr_file_index_t file_num) noexcept
+    [[nodiscard]] constexpr auto max_open_files() const noexcept
     {
-        return std::make_pair(tor_id, file_num);
+        return max_open_files_;
     }
 
+    [[nodiscard]] auto size() const noexcept
+    {
+        return std::size(lru_);
+    }
+
+    [[nodiscard]] constexpr auto const& stats() const noexcept
+    {
+        return stats_;
+    }
+
+private:
+    using Key = std::pair<tr_torrent_id_t, tr_file_index_t>;
+
+    // most-recently-used first
+    using LruList = std::list<Key>;
+
     struct Val
     {
         Val() noexcept = default;
@@ -59,14 +104,32 @@ private:
         {
             std::swap(this->fd_, that.fd_);
             std::swap(this->writable_, that.writable_);
+            std::swap(this->lru_pos_, that.lru_pos_);
             return *this;
         }
         ~Val();
 
         tr_sys_file_t fd_ = TR_BAD_SYS_FILE;
         bool writable_ = false;
+        LruList::iterator lru_pos_ = {};
     };
 
-    static constexpr size_t MaxOpenFiles = 32;
-    tr_lru_cache<Key, Val, MaxOpenFiles> pool_;
+    using TorrentFiles = std::unordered_map<tr_file_index_t, Val>;
+
+    [[nodiscard]] Val* find(tr_torrent_id_t tor_id, tr_file_index_t file_num);
+
+    // `writable` is set to true if the file had to be opened writable to truncate it
+    [[nodiscard]] static std::optional<tr_sys_file_t> open_file(
+        std::string_view filename,
+        bool* writable,
+        tr_preallocation_mode allocation,
+        uint64_t file_size);
+
+    void add(tr_torrent_id_t tor_id, tr_file_index_t file_num, tr_sys_file_t fd, bool writable);
+    void evict_oldest();
+
+    std::unordered_map<tr_torrent_id_t, TorrentFiles> pool_;
+    LruList lru_;
+    Stats stats_;
+    size_t max_open_files_ = DefaultMaxOpenFiles;
 };
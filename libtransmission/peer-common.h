@@ -49,6 +49,7 @@ public:
         ClientGotHave,
         ClientGotHaveAll,
         ClientGotHaveNone,
+        ClientWillResetHave, // a Bitfield, HaveAll, or HaveNone is about to replace the peer's bitfield
         ClientSentPieceData,
         Error // generic
     };
@@ -161,6 +162,13 @@ public:
         return event;
     }
 
+    [[nodiscard]] constexpr static auto WillResetHave() noexcept
+    {
+        auto event = tr_peer_event{};
+        event.type = Type::ClientWillResetHave;
+        return event;
+    }
+
     [[nodiscard]] constexpr static auto SentPieceData(uint32_t length) noexcept
     {
         auto event = tr_peer_event{};
@@ -0,0 +1,54 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <cstddef> // size_t
+#include <thread>
+
+#include <event2/event.h>
+
+#include "libtransmission/peer-io-threads.h"
+#include "libtransmission/session-thread.h"
+#include "libtransmission/tr-assert.h"
+
+tr_peer_io_threads::tr_peer_io_threads(size_t n_threads)
+{
+    tr_session_thread::tr_evthread_init();
+
+    workers_.resize(std::max(n_threads, size_t{ 1U }));
+    for (auto& worker : workers_)
+    {
+        worker.evbase = libtransmission::evhelpers::make_event_base();
+        worker.thread = std::thread([evbase = worker.evbase.get()]() { event_base_loop(evbase, EVLOOP_NO_EXIT_ON_EMPTY); });
+    }
+}
+
+tr_peer_io_threads::~tr_peer_io_threads()
+{
+    for (auto& worker : workers_)
+    {
+        // Use a one-shot event instead of event_base_loopexit() because
+        // the latter is lost if the loop hasn't started running yet.
+        event_base_once(
+            worker.evbase.get(),
+            -1,
+            EV_TIMEOUT,
+            [](evutil_socket_t, short /*type*/, void* vevbase) { event_base_loopbreak(static_cast<event_base*>(vevbase)); },
+            worker.evbase.get(),
+            nullptr);
+    }
+
+    for (auto& worker : workers_)
+    {
+        worker.thread.join();
+    }
+}
+
+event_base* tr_peer_io_threads::next_event_base() noexcept
+{
+    TR_ASSERT(!std::empty(workers_));
+
+    return workers_[next_++ % std::size(workers_)].evbase.get();
+}
@@ -0,0 +1,57 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <atomic>
+#include <cstddef> // size_t
+#include <thread>
+#include <vector>
+
+#include "libtransmission/utils-ev.h"
+
+struct event_base;
+
+// Event loops running on background threads. Peer sockets are spread
+// across them so that polling and reading many sockets isn't all done
+// by the session thread.
+class tr_peer_io_threads
+{
+public:
+    explicit tr_peer_io_threads(size_t n_threads);
+    ~tr_peer_io_threads();
+
+    tr_peer_io_threads(tr_peer_io_threads const&) = delete;
+    tr_peer_io_threads(tr_peer_io_threads&&) = delete;
+    tr_peer_io_threads& operator=(tr_peer_io_threads const&) = delete;
+    tr_peer_io_threads& operator=(tr_peer_io_threads&&) = delete;
+
+    // @return the event base that the next peer socket should use
+    [[nodiscard]] struct event_base* next_event_base() noexcept;
+
+    [[nodiscard]] auto size() const noexcept
+    {
+        return std::size(workers_);
+    }
+
+    [[nodiscard]] struct event_base* nth_event_base(size_t i) const noexcept
+    {
+        return workers_[i].evbase.get();
+    }
+
+private:
+    struct Worker
+    {
+        libtransmission::evhelpers::evbase_unique_ptr evbase;
+        std::thread thread;
+    };
+
+    std::vector<Worker> workers_;
+    std::atomic<size_t> next_ = {};
+};
@@ -3,7 +3,6 @@
 // or any future license endorsed by Mnemosyne LLC.
 // License text can be found in the licenses/ folder.
 
-#include <array>
 #include <cerrno>
 #include <cstdint>
 
@@ -30,6 +29,7 @@
 #include "libtransmission/peer-socket.h" // tr_peer_socket, tr_netOpen...
 #include "libtransmission/session.h"
 #include "libtransmission/tr-assert.h"
+#include "libtransmission/tracing.h"
 #include "libtransmission/utils.h" // for _()
 
 struct sockaddr;
@@ -165,6 +165,16 @@ std::shared_ptr<tr_peerIo> tr_peerIo::new_outgoing(
     return {};
 }
 
+tr_peerIo::FileHandle tr_peerIo::make_file_handle(tr_sys_file_t fd)
+{
+    return { new tr_sys_file_t{ fd },
+             [](tr_sys_file_t const* file)
+             {
+                 tr_sys_file_close(*file);
+                 delete file;
+             } };
+}
+
 tr_peerIo::~tr_peerIo()
 {
     auto const lock = session_->unique_lock();
@@ -183,10 +193,15 @@ void tr_peerIo::set_socket(tr_peer_socket socket_in)
 
     socket_ = std::move(socket_in);
 
+    // LAN fast-path peers bypass the torrent and session speed limits,
+    // though their traffic still shows up in the parents' speeds
+    lan_fast_path_ = session_->isLanFastPathPeer(socket_.address());
+    bandwidth_.honor_parent_limits(TR_UP, !lan_fast_path_);
+    bandwidth_.honor_parent_limits(TR_DOWN, !lan_fast_path_);
+
     if (socket_.is_tcp())
     {
-        event_read_.reset(event_new(session_->event_base(), socket_.handle.tcp, EV_READ, &tr_peerIo::event_read_cb, this));
-        event_write_.reset(event_new(session_->event_base(), socket_.handle.tcp, EV_WRITE, &tr_peerIo::event_write_cb, this));
+        make_tcp_events();
     }
 #ifdef WITH_UTP
     else if (socket_.is_utp())
@@ -202,9 +217,32 @@ void tr_peerIo::set_socket(tr_peer_socket socket_in)
 
 void tr_peerIo::close()
 {
-    socket_.close();
+    // free the events before closing the socket so that
+    // a peer I/O thread can't be reading from it
     event_write_.reset();
     event_read_.reset();
+    worker_read_.reset();
+    socket_.close();
+}
+
+void tr_peerIo::make_tcp_events()
+{
+    auto const sock = socket_.handle.tcp;
+
+    event_write_.reset(event_new(session_->event_base(), sock, EV_WRITE, &tr_peerIo::event_write_cb, this));
+
+    if (auto* const worker_base = session_->peer_io_event_base(); worker_base != nullptr)
+    {
+        worker_read_ = std::make_unique<WorkerRead>();
+        worker_read_->io = weak_from_this();
+        worker_read_->session = session_;
+        worker_read_->generation = ++worker_read_generation_;
+        event_read_.reset(event_new(worker_base, sock, EV_READ, &tr_peerIo::event_read_worker_cb, worker_read_.get()));
+    }
+    else
+    {
+        event_read_.reset(event_new(session_->event_base(), sock, EV_READ, &tr_peerIo::event_read_cb, this));
+    }
 }
 
 void tr_peerIo::clear()
@@ -237,8 +275,7 @@ bool tr_peerIo::reconnect()
         return false;
     }
 
-    this->event_read_.reset(event_new(session_->event_base(), socket_.handle.tcp, EV_READ, event_read_cb, this));
-    this->event_write_.reset(event_new(session_->event_base(), socket_.handle.tcp, EV_WRITE, event_write_cb, this));
+    make_tcp_events();
 
     event_enable(pending_events);
 
@@ -290,8 +327,9 @@ size_t tr_peerIo::try_write(size_t max)
         return {};
     }
 
-    auto& buf = outbuf_;
-    max = std::min(max, std::size(buf));
+    TR_TRACE_SCOPE("peer-io", "try_write");
+
+    max = std::min(max, pending_write_bytes());
     max = bandwidth().clamp(Dir, max);
     if (max == 0)
     {
@@ -299,10 +337,58 @@ size_t tr_peerIo::try_write(size_t max)
         return {};
     }
 
+    // Send the outbuf and any queued files in the order they were added.
+    // Stop as soon as the socket takes less than we offered.
     tr_error* error = nullptr;
-    auto const n_written = socket_.try_write(buf, max, &error);
+    auto n_written = size_t{};
+    while (n_written < max && error == nullptr)
+    {
+        auto const n_left = max - n_written;
+        auto n_wanted = n_left;
+        auto n_sent = size_t{};
+
+        if (std::empty(out_files_))
+        {
+            n_sent = socket_.try_write(outbuf_, n_wanted, false, &error);
+        }
+        else if (auto& out = out_files_.front(); out.n_buf_before > 0U)
+        {
+            // If the file's data is sent next, e.g. after a PIECE message's
+            // header, say so, so that the header doesn't go out in a tiny
+            // TCP segment of its own.
+            n_wanted = std::min(n_left, out.n_buf_before);
+            n_sent = socket_.try_write(outbuf_, n_wanted, n_wanted < n_left, &error);
+            out.n_buf_before -= n_sent;
+        }
+        else
+        {
+            n_wanted = std::min(n_left, out.n_bytes);
+            n_sent = socket_.try_write_file(*out.file, out.offset, n_wanted, &error);
+            out.offset += n_sent;
+            out.n_bytes -= n_sent;
+            out_file_bytes_ -= n_sent;
+
+            if (out.n_bytes == 0U)
+            {
+                out_files_.pop_front();
+            }
+        }
+
+        n_written += n_sent;
+
+        if (n_sent < n_wanted)
+        {
+            break;
+        }
+    }
+
     // enable further writes if there's more data to write
-    set_enabled(Dir, !std::empty(buf) && (error == nullptr || canRetryFromError(error->code)));
+    set_enabled(Dir, pending_write_bytes() > 0U && (error == nullptr || canRetryFromError(error->code)));
+
+    if (n_written > 0U)
+    {
+        did_write_wrapper(n_written);
+    }
 
     if (error != nullptr)
     {
@@ -316,12 +402,26 @@ size_t tr_peerIo::try_write(size_t max)
 
         tr_error_clear(&error);
     }
-    else if (n_written > 0U)
+
+    return n_written;
+}
+
+void tr_peerIo::write_file(FileHandle file, uint64_t offset, size_t n_bytes)
+{
+    TR_ASSERT(supports_sendfile());
+    TR_ASSERT(file);
+
+    if (n_bytes == 0U)
     {
-        did_write_wrapper(n_written);
+        return;
     }
 
-    return n_written;
+    outbuf_info_.emplace_back(n_bytes, true);
+
+    auto const n_buf_before = std::empty(out_files_) ? std::size(outbuf_) : buf_bytes_since_last_file_;
+    out_files_.push_back({ std::move(file), offset, n_bytes, n_buf_before });
+    out_file_bytes_ += n_bytes;
+    buf_bytes_since_last_file_ = 0U;
 }
 
 void tr_peerIo::event_write_cb([[maybe_unused]] evutil_socket_t fd, short /*event*/, void* vio)
@@ -414,6 +514,8 @@ size_t tr_peerIo::try_read(size_t max)
         return {};
     }
 
+    TR_TRACE_SCOPE("peer-io", "try_read");
+
     // Do not write more than the bandwidth allows.
     // If there is no bandwidth left available, disable writes.
     max = bandwidth().clamp(TR_DOWN, max);
@@ -423,9 +525,26 @@ size_t tr_peerIo::try_read(size_t max)
         return {};
     }
 
-    auto& buf = inbuf_;
+    // When a peer I/O thread is reading this socket, never read it here too:
+    // that could reorder the stream. Just make sure the worker is polling.
+    if (worker_read_)
+    {
+        set_enabled(Dir, true);
+        return {};
+    }
+
+    // Once the read buffer's been drained into the read sink,
+    // read the rest of the sink's bytes straight from the socket
+    auto const use_sink = read_sink_.n_left() > 0U && std::empty(inbuf_) && socket_.is_tcp();
+    auto* const sink_begin = read_sink_.data();
+    if (use_sink)
+    {
+        max = std::min(max, read_sink_.n_left());
+    }
+
+    auto& buf = use_sink ? static_cast<tr_peer_socket::InBuf&>(read_sink_) : inbuf_;
     tr_error* error = nullptr;
-    auto const n_read = socket_.try_read(buf, max, std::empty(buf), &error);
+    auto const n_read = socket_.try_read(buf, max, std::empty(inbuf_), &error);
     set_enabled(Dir, error == nullptr || canRetryFromError(error->code));
 
     if (error != nullptr)
@@ -438,7 +557,20 @@ size_t tr_peerIo::try_read(size_t max)
 
         tr_error_clear(&error);
     }
-    else if (!std::empty(buf))
+    else if (use_sink && n_read > 0U)
+    {
+        // can_read_wrapper() only counts what's drained from `inbuf_`
+        auto const now = tr_time_msec();
+        filter_.decrypt(sink_begin, n_read, sink_begin);
+        bandwidth().notify_bandwidth_consumed(TR_DOWN, n_read, true, now);
+        if (auto const overhead = socket_.guess_packet_overhead(n_read); overhead > 0U)
+        {
+            bandwidth().notify_bandwidth_consumed(TR_DOWN, overhead, false, now);
+        }
+
+        can_read_wrapper();
+    }
+    else if (!std::empty(inbuf_))
     {
         can_read_wrapper();
     }
@@ -464,6 +596,75 @@ void tr_peerIo::event_read_cb([[maybe_unused]] evutil_socket_t fd, short /*event
     io->try_read(n_left);
 }
 
+// Called in a peer I/O thread. Reads from the socket without touching
+// the tr_peerIo, then hands the bytes to the session thread.
+void tr_peerIo::event_read_worker_cb(evutil_socket_t fd, short /*event*/, void* vworker_read)
+{
+    auto const* const worker_read = static_cast<WorkerRead const*>(vworker_read);
+    auto const max_bytes = std::max(worker_read->max_bytes.load(), size_t{ 1U });
+
+    auto data = std::vector<std::byte>(max_bytes);
+    auto const n_read = recv(fd, reinterpret_cast<char*>(std::data(data)), std::size(data), 0);
+    auto err = 0;
+    if (n_read > 0)
+    {
+        data.resize(static_cast<size_t>(n_read));
+    }
+    else
+    {
+        // When a stream socket peer has performed an orderly shutdown,
+        // the return value will be 0 (the traditional "end-of-file" return).
+        err = n_read == 0 ? ENOTCONN : sockerrno;
+        data.clear();
+    }
+
+    worker_read->session->runInSessionThread(
+        [weak_io = worker_read->io, generation = worker_read->generation, data = std::move(data), err]()
+        {
+            if (auto const io = weak_io.lock(); io)
+            {
+                io->on_worker_read(generation, data, err);
+            }
+        });
+}
+
+void tr_peerIo::on_worker_read(size_t generation, std::vector<std::byte> const& data, int err)
+{
+    static auto constexpr Dir = TR_DOWN;
+
+    // ignore reads from a socket that has since been replaced
+    if (!worker_read_ || worker_read_->generation != generation)
+    {
+        return;
+    }
+
+    // the worker's event is one-shot, so it's no longer pending
+    auto const was_enabled = (pending_events_ & EV_READ) != 0;
+    pending_events_ &= ~EV_READ;
+
+    if (err != 0)
+    {
+        if (canRetryFromError(err))
+        {
+            set_enabled(Dir, was_enabled);
+        }
+        else
+        {
+            tr_error* error = nullptr;
+            tr_error_set(&error, err, tr_net_strerror(err));
+            tr_logAddTraceIo(this, fmt::format("worker read err: errno:{} ({})", error->code, error->message));
+            call_error_callback(*error);
+            tr_error_clear(&error);
+        }
+
+        return;
+    }
+
+    inbuf_.add(data);
+    set_enabled(Dir, was_enabled);
+    can_read_wrapper();
+}
+
 // ---
 
 void tr_peerIo::event_enable(short event)
@@ -474,6 +675,21 @@ void tr_peerIo::event_enable(short event)
     TR_ASSERT(!need_events || event_read_);
     TR_ASSERT(!need_events || event_write_);
 
+    if ((event & EV_READ) != 0 && (pending_events_ & EV_READ) == 0 && worker_read_)
+    {
+        // tell the worker how much it may read, and don't poll at all
+        // if we're out of bandwidth or our read buffer is full
+        auto const n_used = std::size(inbuf_);
+        auto const n_left = n_used >= RcvBuf ? size_t{} : RcvBuf - n_used;
+        auto const max_bytes = bandwidth().clamp(TR_DOWN, n_left);
+        worker_read_->max_bytes = max_bytes;
+
+        if (max_bytes == 0U)
+        {
+            event = static_cast<short>(event & ~EV_READ);
+        }
+    }
+
     if ((event & EV_READ) != 0 && (pending_events_ & EV_READ) == 0)
     {
         tr_logAddTraceIo(this, "enabling ready-to-read polling");
@@ -577,12 +793,25 @@ size_t tr_peerIo::flush_outgoing_protocol_msgs()
 size_t tr_peerIo::get_write_buffer_space(uint64_t now) const noexcept
 {
     size_t const desired_len = get_desired_output_buffer_size(this, now);
-    size_t const current_len = std::size(outbuf_);
+    size_t const current_len = pending_write_bytes();
     return desired_len > current_len ? desired_len - current_len : 0U;
 }
 
 // ---
 
+void tr_peerIo::release_idle_buffers(uint64_t now_msec)
+{
+    if (std::empty(inbuf_) && bandwidth_.get_raw_speed_bytes_per_second(now_msec, TR_DOWN) == 0U)
+    {
+        inbuf_.shrink_to_fit();
+    }
+
+    if (std::empty(outbuf_) && bandwidth_.get_raw_speed_bytes_per_second(now_msec, TR_UP) == 0U)
+    {
+        outbuf_.shrink_to_fit();
+    }
+}
+
 void tr_peerIo::read_uint16(uint16_t* setme)
 {
     auto tmp = uint16_t{};
@@ -599,14 +828,20 @@ void tr_peerIo::read_uint32(uint32_t* setme)
 
 void tr_peerIo::read_buffer_drain(size_t byte_count)
 {
-    auto buf = std::array<char, 4096>{};
+    byte_count = std::min(byte_count, std::size(inbuf_));
+    auto const n_plain = std::min(byte_count, n_decrypted_);
+    filter_.decrypt_skip(byte_count - n_plain);
+    n_decrypted_ -= n_plain;
+    inbuf_.drain(byte_count);
+}
 
-    while (byte_count > 0)
-    {
-        auto const this_pass = std::min(byte_count, std::size(buf));
-        read_bytes(std::data(buf), this_pass);
-        byte_count -= this_pass;
-    }
+std::pair<std::byte const*, size_t> tr_peerIo::read_buffer_view() noexcept
+{
+    auto* const data = std::data(inbuf_);
+    auto const len = std::size(inbuf_);
+    filter_.decrypt(data + n_decrypted_, len - n_decrypted_, data + n_decrypted_);
+    n_decrypted_ = len;
+    return { data, len };
 }
 
 // --- UTP
@@ -676,6 +911,28 @@ void tr_peerIo::on_utp_error(int errcode)
 
 #endif /* #ifdef WITH_UTP */
 
+void tr_peerIo::utp_flush_reads(tr_session* session)
+{
+    auto pending = std::vector<std::weak_ptr<tr_peerIo>>{};
+    std::swap(pending, session->utp_pending_reads);
+
+    for (auto const& weak : pending)
+    {
+        if (auto const io = weak.lock(); io)
+        {
+            io->utp_read_pending_ = false;
+            io->can_read_wrapper();
+        }
+    }
+
+    // reuse the allocation next time
+    pending.clear();
+    if (std::empty(session->utp_pending_reads))
+    {
+        std::swap(pending, session->utp_pending_reads);
+    }
+}
+
 void tr_peerIo::utp_init([[maybe_unused]] struct_utp_context* ctx)
 {
 #ifdef WITH_UTP
@@ -693,7 +950,13 @@ void tr_peerIo::utp_init([[maybe_unused]] struct_utp_context* ctx)
             {
                 io->inbuf_.add(args->buf, args->len);
                 io->set_enabled(TR_DOWN, true);
-                io->can_read_wrapper();
+
+                // parse it after the rest of the batch; see utp_flush_reads()
+                if (!io->utp_read_pending_)
+                {
+                    io->utp_read_pending_ = true;
+                    io->session_->utp_pending_reads.emplace_back(io->weak_from_this());
+                }
             }
             return {};
         });
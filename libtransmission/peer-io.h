@@ -10,11 +10,13 @@
 #endif
 
 #include <algorithm>
+#include <atomic>
 #include <cstddef> // size_t
 #include <cstdint> // uintX_t
 #include <deque>
 #include <memory>
 #include <utility> // std::pair
+#include <vector>
 
 #include <event2/util.h> // for evutil_socket_t
 
@@ -22,6 +24,7 @@
 
 #include "libtransmission/bandwidth.h"
 #include "libtransmission/block-info.h"
+#include "libtransmission/file.h" // tr_sys_file_t
 #include "libtransmission/net.h" // tr_address
 #include "libtransmission/peer-mse.h"
 #include "libtransmission/peer-socket.h"
@@ -54,6 +57,11 @@ class tr_peerIo final : public std::enable_shared_from_this<tr_peerIo>
     using GotError = void (*)(tr_peerIo* io, tr_error const& error, void* userData);
 
 public:
+    // An open file that's closed when the last reference goes away.
+    using FileHandle = std::shared_ptr<tr_sys_file_t const>;
+
+    [[nodiscard]] static FileHandle make_file_handle(tr_sys_file_t fd);
+
     tr_peerIo(
         tr_session* session_in,
         tr_sha1_digest_t const* info_hash,
@@ -81,9 +89,22 @@ public:
         user_data_ = user_data;
     }
 
-    constexpr void clear_callbacks()
+    void clear_callbacks()
     {
         set_callbacks(nullptr, nullptr, nullptr, nullptr);
+        read_sink_ = {};
+    }
+
+    [[nodiscard]] constexpr auto has_callbacks() const noexcept
+    {
+        return can_read_ != nullptr;
+    }
+
+    // Run the read callback on what's already been read, e.g. after
+    // it returned READ_LATER to wait on something besides the socket.
+    void read_buffered()
+    {
+        can_read_wrapper();
     }
 
     void set_socket(tr_peer_socket);
@@ -114,13 +135,56 @@ public:
 
     void read_buffer_drain(size_t byte_count);
 
+    // Decrypt the whole read buffer in place and return it, so that
+    // complete messages can be parsed where they are instead of being
+    // read out one field at a time. The view is invalidated by anything
+    // that reads from, drains, or adds to the read buffer.
+    [[nodiscard]] std::pair<std::byte const*, size_t> read_buffer_view() noexcept;
+
     void read_bytes(void* bytes, size_t n_bytes)
     {
         n_bytes = std::min(n_bytes, std::size(inbuf_));
-        filter_.decrypt(std::data(inbuf_), n_bytes, reinterpret_cast<std::byte*>(bytes));
+        read_buffer_copy(n_bytes, reinterpret_cast<std::byte*>(bytes));
+        inbuf_.drain(n_bytes);
+    }
+
+    // Move `n_bytes` from the read buffer into `out`, decrypting
+    // straight into `out`'s memory instead of through a scratch buffer.
+    template<typename T>
+    void read_bytes(libtransmission::BufferWriter<T>& out, size_t n_bytes)
+    {
+        n_bytes = std::min(n_bytes, std::size(inbuf_));
+        auto const [buf, buflen] = out.reserve_space(n_bytes);
+        read_buffer_copy(n_bytes, reinterpret_cast<std::byte*>(buf));
+        out.commit_space(n_bytes);
         inbuf_.drain(n_bytes);
     }
 
+    // Have the next `n_bytes` of the stream go straight into `out`, e.g. a
+    // Piece message's payload into its block buffer. fill_read_sink() moves
+    // what's already in the read buffer; after that, TCP reads skip the read
+    // buffer and go from the socket into `out` until it's full. The read
+    // callback is still called as data arrives. `out` must stay valid until
+    // read_sink_left() is zero or the callbacks are cleared.
+    void set_read_sink(std::byte* out, size_t n_bytes) noexcept
+    {
+        read_sink_ = ReadSink{ out, n_bytes };
+    }
+
+    // Move as much of the read buffer as fits into the read sink.
+    // @return the number of bytes moved
+    size_t fill_read_sink()
+    {
+        auto const n_bytes = std::min(read_sink_.n_left(), std::size(inbuf_));
+        read_bytes(read_sink_, n_bytes);
+        return n_bytes;
+    }
+
+    [[nodiscard]] size_t read_sink_left() const noexcept
+    {
+        return read_sink_.n_left();
+    }
+
     void read_uint8(uint8_t* setme)
     {
         read_bytes(setme, sizeof(uint8_t));
@@ -134,9 +198,29 @@ public:
 
     [[nodiscard]] size_t get_write_buffer_space(uint64_t now) const noexcept;
 
+    // Free the heap memory that an empty read or write buffer grew into
+    // during a burst of traffic, if no data has moved in that direction
+    // recently. Cheap enough to call on every peer pulse.
+    void release_idle_buffers(uint64_t now_msec);
+
+    // Like release_idle_buffers(), but even if data is still moving.
+    // Used to shed memory when the session is short of it.
+    void release_buffers()
+    {
+        inbuf_.shrink_to_fit();
+        outbuf_.shrink_to_fit();
+    }
+
+    // @return the memory held by the read and write buffers
+    [[nodiscard]] size_t buffer_bytes() const noexcept
+    {
+        return inbuf_.capacity() + outbuf_.capacity();
+    }
+
     void write_bytes(void const* bytes, size_t n_bytes, bool is_piece_data)
     {
         outbuf_info_.emplace_back(n_bytes, is_piece_data);
+        buf_bytes_since_last_file_ += n_bytes;
 
         auto [resbuf, reslen] = outbuf_.reserve_space(n_bytes);
         filter_.encrypt(reinterpret_cast<std::byte const*>(bytes), n_bytes, resbuf);
@@ -153,6 +237,22 @@ public:
         buf.drain(n_bytes);
     }
 
+    // @return true if write_file() can be used, i.e. if the data
+    // can go from the file to the socket without being filtered
+    [[nodiscard]] constexpr bool supports_sendfile() const noexcept
+    {
+#ifdef HAVE_SENDFILE64
+        return socket_.is_tcp() && !filter_.is_active();
+#else
+        return false;
+#endif
+    }
+
+    // Queue `n_bytes` of piece data from `file` to be sent after
+    // everything that's already been written. The data is sent
+    // straight from the file instead of being copied into `outbuf_`.
+    void write_file(FileHandle file, uint64_t offset, size_t n_bytes);
+
     size_t flush_outgoing_protocol_msgs();
 
     size_t flush(tr_direction dir, size_t byte_limit);
@@ -169,6 +269,17 @@ public:
         return bandwidth_.get_piece_speed_bytes_per_second(now, dir);
     }
 
+    // Let the socket's buffers hold twice the bandwidth-delay product
+    // of the peer's measured round-trip time.
+    void on_rtt_measured(uint64_t rtt_msec, uint64_t now_msec)
+    {
+        auto const bdp = [this, rtt_msec, now_msec](tr_direction dir)
+        {
+            return static_cast<size_t>(get_piece_speed_bytes_per_second(now_msec, dir) * rtt_msec * 2U / 1000U);
+        };
+        socket_.grow_buffers(bdp(TR_UP), bdp(TR_DOWN));
+    }
+
     ///
 
     [[nodiscard]] constexpr auto supports_fext() const noexcept
@@ -273,6 +384,13 @@ public:
         return socket_.display_name();
     }
 
+    // LAN fast-path peers aren't held back by speed limits.
+    // See tr_session::isLanFastPathPeer().
+    [[nodiscard]] constexpr auto is_lan_fast_path() const noexcept
+    {
+        return lan_fast_path_;
+    }
+
     ///
 
     [[nodiscard]] constexpr auto is_encrypted() const noexcept
@@ -294,15 +412,60 @@ public:
 
     static void utp_init(struct_utp_context* ctx);
 
+    // Let the µTP peers that got data in the last batch of datagrams parse
+    // it, once per peer instead of once per datagram.
+    static void utp_flush_reads(tr_session* session);
+
 private:
     // Our target socket receive buffer size.
     // Gets read from the socket buffer into the PeerBuffer inbuf_.
     static constexpr auto RcvBuf = size_t{ 256 * 1024 };
 
     // The buffer size for incoming & outgoing peer messages.
-    // Starts off with enough capacity to read a single BT Piece message,
-    // but has a 5x GrowthFactor so that it can quickly to high volume.
-    using PeerBuffer = libtransmission::StackBuffer<tr_block_info::BlockSize + 16U, std::byte, std::ratio<5, 1>>;
+    // The inline storage only needs to hold the handshake and everyday
+    // small messages, so that an idle peer costs little; Piece data goes
+    // to the heap while it's in flight. The 5x GrowthFactor lets a busy
+    // peer quickly grow to high volume. Goes back to the inline storage
+    // when idle; see release_idle_buffers().
+    using PeerBuffer = libtransmission::StackBuffer<1024U, std::byte, std::ratio<5, 1>>;
+
+    // A fixed span of someone else's memory; see set_read_sink()
+    class ReadSink final : public libtransmission::BufferWriter<std::byte>
+    {
+    public:
+        ReadSink() noexcept = default;
+
+        ReadSink(std::byte* out, size_t n_bytes) noexcept
+            : out_{ out }
+            , n_left_{ n_bytes }
+        {
+        }
+
+        [[nodiscard]] constexpr std::byte* data() const noexcept
+        {
+            return out_;
+        }
+
+        [[nodiscard]] constexpr size_t n_left() const noexcept
+        {
+            return n_left_;
+        }
+
+        std::pair<std::byte*, size_t> reserve_space(size_t n_bytes) override
+        {
+            return { out_, std::min(n_bytes, n_left_) };
+        }
+
+        void commit_space(size_t n_bytes) override
+        {
+            out_ += n_bytes;
+            n_left_ -= n_bytes;
+        }
+
+    private:
+        std::byte* out_ = nullptr;
+        size_t n_left_ = 0U;
+    };
 
     friend class libtransmission::test::HandshakeTest;
 
@@ -326,6 +489,10 @@ private:
 
     static void event_read_cb(evutil_socket_t fd, short /*event*/, void* vio);
     static void event_write_cb(evutil_socket_t fd, short /*event*/, void* vio);
+    static void event_read_worker_cb(evutil_socket_t fd, short /*event*/, void* vworker_read);
+
+    void make_tcp_events();
+    void on_worker_read(size_t generation, std::vector<std::byte> const& data, int err);
 
     void event_enable(short event);
     void event_disable(short event);
@@ -336,6 +503,21 @@ private:
     size_t try_read(size_t max);
     size_t try_write(size_t max);
 
+    [[nodiscard]] TR_CONSTEXPR20 size_t pending_write_bytes() const noexcept
+    {
+        return std::size(outbuf_) + out_file_bytes_;
+    }
+
+    // Copy the first `n_bytes` of `inbuf_` to `out`, decrypting
+    // the ones that read_buffer_view() hasn't already decrypted.
+    void read_buffer_copy(size_t n_bytes, std::byte* out) noexcept
+    {
+        auto const n_plain = std::min(n_bytes, n_decrypted_);
+        std::copy_n(std::data(inbuf_), n_plain, out);
+        filter_.decrypt(std::data(inbuf_) + n_plain, n_bytes - n_plain, out + n_plain);
+        n_decrypted_ -= n_plain;
+    }
+
     // this is only public for testing purposes.
     // production code should use new_outgoing() or new_incoming()
     static std::shared_ptr<tr_peerIo> create(
@@ -358,6 +540,26 @@ private:
     PeerBuffer inbuf_;
     PeerBuffer outbuf_;
 
+    ReadSink read_sink_;
+
+    // how many bytes at the front of `inbuf_` are already decrypted
+    size_t n_decrypted_ = 0;
+
+    // A run of file data waiting to be sent with write_file().
+    struct OutFile
+    {
+        FileHandle file;
+        uint64_t offset = 0;
+        size_t n_bytes = 0;
+
+        // how many `outbuf_` bytes must be sent before this file's data
+        size_t n_buf_before = 0;
+    };
+
+    std::deque<OutFile> out_files_;
+    size_t out_file_bytes_ = 0;
+    size_t buf_bytes_since_last_file_ = 0;
+
     tr_session* const session_;
 
     CanRead can_read_ = nullptr;
@@ -365,6 +567,20 @@ private:
     GotError got_error_ = nullptr;
     void* user_data_ = nullptr;
 
+    // When the session has peer I/O threads, `event_read_` fires on one
+    // of them and the bytes it reads are handed back to the session thread.
+    // Declared before `event_read_` so that the event is freed first.
+    struct WorkerRead
+    {
+        std::weak_ptr<tr_peerIo> io;
+        tr_session* session = nullptr;
+        size_t generation = 0;
+        std::atomic<size_t> max_bytes = {};
+    };
+
+    std::unique_ptr<WorkerRead> worker_read_;
+    size_t worker_read_generation_ = 0;
+
     libtransmission::evhelpers::event_unique_ptr event_read_;
     libtransmission::evhelpers::event_unique_ptr event_write_;
 
@@ -375,6 +591,10 @@ private:
     bool const is_seed_;
     bool const is_incoming_;
 
+    bool utp_read_pending_ = false;
+
+    bool lan_fast_path_ = false;
+
     bool utp_supported_ = false;
     bool dht_supported_ = false;
     bool extended_protocol_supported_ = false;
@@ -3,169 +3,345 @@
 // or any future license endorsed by Mnemosyne LLC.
 // License text can be found in the licenses/ folder.
 
-#include <algorithm>
 #include <cstddef> // size_t
+#include <cstdint> // uint64_t
 #include <ctime>
+#include <limits>
 #include <memory>
 #include <utility>
 #include <unordered_map>
 #include <vector>
 
-#include <small/map.hpp>
-
 #define LIBTRANSMISSION_PEER_MODULE
 
 #include "libtransmission/transmission.h"
 
 #include "libtransmission/peer-mgr-active-requests.h"
-#include "libtransmission/peer-mgr-wishlist.h"
 #include "libtransmission/tr-assert.h"
 
 class tr_peer;
 
+// An open-addressing hash table of (block, peer) requests.
+//
+// Entries are hashed by block alone, so that all the requests for a
+// block land in the same run of slots and count(block) / remove(block)
+// only need to walk that run. Lookups use linear probing and deletes use
+// backward shifting, so there are no tombstones and no per-request
+// allocations. The table only grows with the number of *active*
+// requests, not with the size of the torrent.
 class ActiveRequests::Impl
 {
 public:
-    size_t size() const
+    struct Entry
+    {
+        tr_block_index_t block = EmptyBlock;
+        tr_peer* peer = nullptr;
+        time_t sent_at = {};
+
+        [[nodiscard]] constexpr bool empty() const noexcept
+        {
+            return block == EmptyBlock;
+        }
+    };
+
+    static auto constexpr EmptyBlock = std::numeric_limits<tr_block_index_t>::max();
+
+    [[nodiscard]] constexpr auto size() const noexcept
     {
         return size_;
     }
 
-    size_t count(tr_peer const* peer) const
+    [[nodiscard]] constexpr auto count_duplicates() const noexcept
+    {
+        return n_duplicates_;
+    }
+
+    [[nodiscard]] size_t count(tr_peer const* peer) const
     {
-        auto const it = count_.find(peer);
-        return it != std::end(count_) ? it->second : size_t{};
+        auto const iter = count_.find(peer);
+        return iter != std::end(count_) ? iter->second : size_t{};
     }
 
-    void incCount(tr_peer const* peer)
+    [[nodiscard]] size_t count(tr_block_index_t block) const
     {
+        auto n = size_t{};
+        for_each_slot(block, [&n](size_t /*slot*/) { ++n; });
+        return n;
+    }
+
+    [[nodiscard]] bool has(tr_block_index_t block, tr_peer const* peer) const
+    {
+        return find(block, peer) != NotFound;
+    }
+
+    bool add(tr_block_index_t block, tr_peer* peer, time_t when)
+    {
+        TR_ASSERT(block != EmptyBlock);
+
+        if (has(block, peer))
+        {
+            return false;
+        }
+
+        // keep the load factor at or below 1/2
+        if ((size_ + 1U) * 2U > std::size(slots_))
+        {
+            grow();
+        }
+
+        if (first_slot(block) != NotFound)
+        {
+            ++n_duplicates_;
+        }
+
+        insert(Entry{ block, peer, when });
         ++count_[peer];
         ++size_;
+        return true;
+    }
+
+    bool remove(tr_block_index_t block, tr_peer const* peer)
+    {
+        auto const slot = find(block, peer);
+        if (slot == NotFound)
+        {
+            return false;
+        }
+
+        erase(slot);
+        return true;
+    }
+
+    std::vector<tr_peer*> remove(tr_block_index_t block)
+    {
+        auto removed = std::vector<tr_peer*>{};
+
+        // erase() shifts later entries back, so restart the walk after each one
+        for (auto slot = first_slot(block); slot != NotFound; slot = first_slot(block))
+        {
+            removed.push_back(slots_[slot].peer);
+            erase(slot);
+        }
+
+        return removed;
     }
 
-    void decCount(tr_peer const* peer)
+    std::vector<tr_block_index_t> remove(tr_peer const* peer)
     {
-        auto it = count_.find(peer);
-        TR_ASSERT(it != std::end(count_));
-        TR_ASSERT(it->second > 0);
-        TR_ASSERT(size_ > 0);
+        auto removed = std::vector<tr_block_index_t>{};
+        auto n_left = count(peer);
+        removed.reserve(n_left);
 
-        if (it != std::end(count_))
+        for (size_t slot = 0U; n_left > 0U && slot < std::size(slots_);)
         {
-            if (--it->second == 0)
+            if (auto const& entry = slots_[slot]; !entry.empty() && entry.peer == peer)
             {
-                count_.erase(it);
+                // erase() may shift another entry into `slot`, so check it again
+                removed.push_back(entry.block);
+                erase(slot);
+                --n_left;
+            }
+            else
+            {
+                ++slot;
             }
-            --size_;
         }
-    }
 
-    std::unordered_map<tr_peer const*, size_t> count_;
+        count_.erase(peer);
+        return removed;
+    }
 
-    std::unordered_map<tr_block_index_t, small::map<tr_peer const*, time_t, Wishlist::EndgameMaxPeers>> blocks_;
+    template<typename Func>
+    void for_each(Func&& func) const
+    {
+        for (auto const& entry : slots_)
+        {
+            if (!entry.empty())
+            {
+                func(entry);
+            }
+        }
+    }
 
 private:
-    size_t size_ = 0;
-};
+    static auto constexpr NotFound = std::numeric_limits<size_t>::max();
+    static auto constexpr MinSlots = size_t{ 64U };
 
-ActiveRequests::ActiveRequests()
-    : impl_{ std::make_unique<Impl>() }
-{
-}
-
-ActiveRequests::~ActiveRequests() = default;
+    [[nodiscard]] constexpr size_t mask() const noexcept
+    {
+        return std::size(slots_) - 1U;
+    }
 
-bool ActiveRequests::add(tr_block_index_t block, tr_peer* peer, time_t when)
-{
-    bool const added = impl_->blocks_[block].emplace(peer, when).second;
+    [[nodiscard]] size_t home(tr_block_index_t block) const noexcept
+    {
+        // Fibonacci hashing spreads out runs of sequential blocks
+        return static_cast<size_t>((uint64_t{ block } * 0x9E3779B97F4A7C15ULL) >> 32U) & mask();
+    }
 
-    if (added)
+    // call `func(slot)` for each entry requesting `block`
+    template<typename Func>
+    void for_each_slot(tr_block_index_t block, Func&& func) const
     {
-        impl_->incCount(peer);
+        if (std::empty(slots_))
+        {
+            return;
+        }
+
+        for (auto slot = home(block); !slots_[slot].empty(); slot = (slot + 1U) & mask())
+        {
+            if (slots_[slot].block == block)
+            {
+                func(slot);
+            }
+        }
     }
 
-    return added;
-}
+    [[nodiscard]] size_t first_slot(tr_block_index_t block) const
+    {
+        if (std::empty(slots_))
+        {
+            return NotFound;
+        }
 
-// remove a request to `peer` for `block`
-bool ActiveRequests::remove(tr_block_index_t block, tr_peer const* peer)
-{
-    auto const it = impl_->blocks_.find(block);
-    auto const removed = it != std::end(impl_->blocks_) && it->second.erase(peer) != 0;
+        for (auto slot = home(block); !slots_[slot].empty(); slot = (slot + 1U) & mask())
+        {
+            if (slots_[slot].block == block)
+            {
+                return slot;
+            }
+        }
+
+        return NotFound;
+    }
 
-    if (removed)
+    [[nodiscard]] size_t find(tr_block_index_t block, tr_peer const* peer) const
     {
-        impl_->decCount(peer);
+        if (std::empty(slots_))
+        {
+            return NotFound;
+        }
 
-        if (std::empty(it->second))
+        for (auto slot = home(block); !slots_[slot].empty(); slot = (slot + 1U) & mask())
         {
-            impl_->blocks_.erase(it);
+            if (auto const& entry = slots_[slot]; entry.block == block && entry.peer == peer)
+            {
+                return slot;
+            }
         }
+
+        return NotFound;
     }
 
-    return removed;
-}
+    void insert(Entry const& entry)
+    {
+        auto slot = home(entry.block);
+        while (!slots_[slot].empty())
+        {
+            slot = (slot + 1U) & mask();
+        }
 
-// remove requests to `peer` and return the associated blocks
-std::vector<tr_block_index_t> ActiveRequests::remove(tr_peer const* peer)
-{
-    auto removed = std::vector<tr_block_index_t>{};
-    removed.reserve(impl_->blocks_.size());
+        slots_[slot] = entry;
+    }
 
-    for (auto const& [block, peers_at] : impl_->blocks_)
+    void erase(size_t slot)
     {
-        if (peers_at.count(peer) != 0U)
+        auto const block = slots_[slot].block;
+        auto const* const peer = slots_[slot].peer;
+        if (auto iter = count_.find(peer); iter != std::end(count_))
+        {
+            TR_ASSERT(iter->second > 0U);
+            --iter->second;
+        }
+
+        TR_ASSERT(size_ > 0U);
+        --size_;
+
+        // Backward-shift deletion: pull later entries in the run back into
+        // the hole if doing so doesn't move them before their home slot.
+        auto hole = slot;
+        for (auto next = (hole + 1U) & mask(); !slots_[next].empty(); next = (next + 1U) & mask())
+        {
+            auto const next_home = home(slots_[next].block);
+            if (((next - next_home) & mask()) >= ((next - hole) & mask()))
+            {
+                slots_[hole] = slots_[next];
+                hole = next;
+            }
+        }
+
+        slots_[hole] = Entry{};
+
+        // if someone else is still being asked for `block`, this was a duplicate
+        if (first_slot(block) != NotFound)
         {
-            removed.push_back(block);
+            TR_ASSERT(n_duplicates_ > 0U);
+            --n_duplicates_;
         }
     }
 
-    for (auto block : removed)
+    void grow()
     {
-        remove(block, peer);
+        auto old_slots = std::vector<Entry>(std::max(MinSlots, std::size(slots_) * 2U));
+        std::swap(slots_, old_slots);
+
+        for (auto const& entry : old_slots)
+        {
+            if (!entry.empty())
+            {
+                insert(entry);
+            }
+        }
     }
 
-    return removed;
+    // size is always zero or a power of two
+    std::vector<Entry> slots_;
+
+    std::unordered_map<tr_peer const*, size_t> count_;
+
+    size_t size_ = 0;
+    size_t n_duplicates_ = 0;
+};
+
+ActiveRequests::ActiveRequests()
+    : impl_{ std::make_unique<Impl>() }
+{
 }
 
-// remove requests for `block` and return the associated peers
-std::vector<tr_peer*> ActiveRequests::remove(tr_block_index_t block)
+ActiveRequests::~ActiveRequests() = default;
+
+bool ActiveRequests::add(tr_block_index_t block, tr_peer* peer, time_t when)
 {
-    auto removed = std::vector<tr_peer*>{};
+    return impl_->add(block, peer, when);
+}
 
-    if (auto it = impl_->blocks_.find(block); it != std::end(impl_->blocks_))
-    {
-        auto const n = std::size(it->second);
-        removed.resize(n);
-        std::transform(
-            std::begin(it->second),
-            std::end(it->second),
-            std::begin(removed),
-            [](auto const& iter) { return const_cast<tr_peer*>(iter.first); });
-        impl_->blocks_.erase(block);
-    }
+// remove a request to `peer` for `block`
+bool ActiveRequests::remove(tr_block_index_t block, tr_peer const* peer)
+{
+    return impl_->remove(block, peer);
+}
 
-    for (auto const* const peer : removed)
-    {
-        impl_->decCount(peer);
-    }
+// remove requests to `peer` and return the associated blocks
+std::vector<tr_block_index_t> ActiveRequests::remove(tr_peer const* peer)
+{
+    return impl_->remove(peer);
+}
 
-    return removed;
+// remove requests for `block` and return the associated peers
+std::vector<tr_peer*> ActiveRequests::remove(tr_block_index_t block)
+{
+    return impl_->remove(block);
 }
 
 // return true if there's an active request to `peer` for `block`
 bool ActiveRequests::has(tr_block_index_t block, tr_peer const* peer) const
 {
-    auto const iter = impl_->blocks_.find(block);
-    return iter != std::end(impl_->blocks_) && (iter->second.count(peer) != 0U);
+    return impl_->has(block, peer);
 }
 
 // count how many peers we're asking for `block`
 size_t ActiveRequests::count(tr_block_index_t block) const
 {
-    auto const& blocks = impl_->blocks_;
-    auto const iter = blocks.find(block);
-    return iter == std::end(blocks) ? 0U : std::size(iter->second);
+    return impl_->count(block);
 }
 
 // count how many active block requests we have to `peer`
@@ -180,22 +356,25 @@ size_t ActiveRequests::size() const
     return impl_->size();
 }
 
+size_t ActiveRequests::count_duplicates() const
+{
+    return impl_->count_duplicates();
+}
+
 // returns the active requests sent before `when`
 std::vector<std::pair<tr_block_index_t, tr_peer*>> ActiveRequests::sentBefore(time_t when) const
 {
     auto sent_before = std::vector<std::pair<tr_block_index_t, tr_peer*>>{};
-    sent_before.reserve(std::size(impl_->blocks_));
+    sent_before.reserve(impl_->size());
 
-    for (auto const& [block, peers_at] : impl_->blocks_)
-    {
-        for (auto const& [peer, sent_at] : peers_at)
+    impl_->for_each(
+        [&sent_before, when](Impl::Entry const& entry)
         {
-            if (sent_at < when)
+            if (entry.sent_at < when)
             {
-                sent_before.emplace_back(block, const_cast<tr_peer*>(peer));
+                sent_before.emplace_back(entry.block, entry.peer);
             }
-        }
-    }
+        });
 
     return sent_before;
 }
@@ -53,6 +53,10 @@ public:
     // return the total number of active requests
     [[nodiscard]] size_t size() const;
 
+    // return how many active requests are for blocks that another peer
+    // has also been asked for, i.e. size() minus the number of blocks
+    [[nodiscard]] size_t count_duplicates() const;
+
     // returns the active requests sent before `when`
     [[nodiscard]] std::vector<std::pair<tr_block_index_t, tr_peer*>> sentBefore(time_t when) const;
 
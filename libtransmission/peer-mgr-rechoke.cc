@@ -0,0 +1,88 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <cstddef> // size_t
+#include <iterator> // std::next()
+#include <vector>
+
+#define LIBTRANSMISSION_PEER_MODULE
+
+#include "libtransmission/transmission.h"
+
+#include "libtransmission/crypto-utils.h" // tr_rand_int()
+#include "libtransmission/peer-mgr-rechoke.h"
+
+ChokeData* rechoke_candidates(std::vector<ChokeData>& candidates, size_t slots, bool is_maxed_out, bool want_optimistic)
+{
+    auto const unchoke = [is_maxed_out](ChokeData& item)
+    {
+        item.is_choked = is_maxed_out ? item.was_choked : false;
+    };
+
+    /**
+     * Reciprocation and number of uploads capping is managed by unchoking
+     * the N peers which have the best upload rate and are interested.
+     * This maximizes the client's download rate. These N peers are
+     * referred to as downloaders, because they are interested in downloading
+     * from the client.
+     *
+     * Peers which have a better upload rate (as compared to the downloaders)
+     * but aren't interested get unchoked. If they become interested, the
+     * downloader with the worst upload rate gets choked. If a client has
+     * a complete file, it uses its upload rate rather than its download
+     * rate to decide which peers to unchoke.
+     *
+     * If our bandwidth is maxed out, don't unchoke any more peers.
+     *
+     * Only the slowest downloader matters as a cutoff, so select it with
+     * nth_element() instead of sorting the whole swarm.
+     */
+    auto const begin = std::begin(candidates);
+    auto const end = std::end(candidates);
+    auto const interested_end = std::partition(begin, end, [](auto const& item) { return item.is_interested; });
+    auto const n_interested = static_cast<size_t>(std::distance(begin, interested_end));
+
+    // the interested peers that didn't get a slot
+    auto losers_begin = interested_end;
+
+    if (n_interested < slots)
+    {
+        std::for_each(begin, end, unchoke);
+    }
+    else if (slots > 0U)
+    {
+        auto const cutoff = std::next(begin, slots - 1U);
+        std::nth_element(begin, cutoff, interested_end);
+        losers_begin = std::next(cutoff);
+
+        // Exactly `slots` downloaders, even if others tie with the slowest one
+        std::for_each(begin, losers_begin, unchoke);
+
+        auto const& slowest_downloader = *cutoff;
+        for (auto iter = interested_end; iter != end; ++iter)
+        {
+            if (!(slowest_downloader < *iter))
+            {
+                unchoke(*iter);
+            }
+        }
+    }
+    else
+    {
+        losers_begin = begin;
+    }
+
+    /* optimistic unchoke */
+    if (!want_optimistic || is_maxed_out || losers_begin == interested_end)
+    {
+        return nullptr;
+    }
+
+    auto const n = static_cast<size_t>(std::distance(losers_begin, interested_end));
+    auto& optimistic = *std::next(losers_begin, tr_rand_int(n));
+    optimistic.is_choked = false;
+    return &optimistic;
+}
@@ -0,0 +1,77 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef LIBTRANSMISSION_PEER_MODULE
+#error only the libtransmission peer module should #include this header.
+#endif
+
+#include <cstddef> // size_t
+#include <cstdint> // uint8_t
+#include <vector>
+
+#include "libtransmission/utils.h" // tr_compare_3way
+
+class tr_peerMsgs;
+
+/**
+ * A peer that rechoking may choke or unchoke, and what's known about it.
+ */
+struct ChokeData
+{
+    ChokeData(tr_peerMsgs* msgs_in, int rate_in, uint8_t salt_in, bool is_interested_in, bool was_choked_in, bool is_choked_in)
+        : msgs{ msgs_in }
+        , rate{ rate_in }
+        , salt{ salt_in }
+        , is_interested{ is_interested_in }
+        , was_choked{ was_choked_in }
+        , is_choked{ is_choked_in }
+    {
+    }
+
+    tr_peerMsgs* msgs;
+    int rate;
+    uint8_t salt;
+    bool is_interested;
+    bool was_choked;
+    bool is_choked;
+
+    [[nodiscard]] constexpr auto compare(ChokeData const& that) const noexcept // <=>
+    {
+        // prefer higher overall speeds
+        if (auto const val = tr_compare_3way(this->rate, that.rate); val != 0)
+        {
+            return -val;
+        }
+
+        if (this->was_choked != that.was_choked) // prefer unchoked
+        {
+            return this->was_choked ? 1 : -1;
+        }
+
+        return tr_compare_3way(this->salt, that.salt);
+    }
+
+    [[nodiscard]] constexpr auto operator<(ChokeData const& that) const noexcept
+    {
+        return compare(that) < 0;
+    }
+};
+
+/**
+ * Decide which of `candidates` to unchoke, and set their `is_choked`.
+ *
+ * The fastest `slots` interested peers are unchoked, along with the
+ * uninterested peers that rank at least as high as the slowest of them.
+ * If `is_maxed_out`, no peer that was choked gets unchoked.
+ *
+ * If `want_optimistic` and we aren't maxed out, one interested peer that
+ * didn't get a slot is picked at random and unchoked as well.
+ *
+ * @return the optimistically-unchoked peer, or nullptr if there isn't one.
+ * The candidates are reordered, so it's only valid until they change.
+ */
+ChokeData* rechoke_candidates(std::vector<ChokeData>& candidates, size_t slots, bool is_maxed_out, bool want_optimistic);
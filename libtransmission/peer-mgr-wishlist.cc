@@ -3,7 +3,6 @@
 // or any future license endorsed by Mnemosyne LLC.
 // License text can be found in the licenses/ folder.
 
-#include <algorithm> // std::min, std::partial_sort
 #include <cstddef>
 #include <set>
 #include <utility>
@@ -15,133 +14,208 @@
 
 #include "libtransmission/crypto-utils.h" // for tr_salt_shaker
 #include "libtransmission/peer-mgr-wishlist.h"
+#include "libtransmission/tr-assert.h"
 #include "libtransmission/utils.h"
 
 namespace
 {
-using SaltType = tr_piece_index_t;
-
-struct Candidate
+std::vector<tr_block_span_t> makeSpans(tr_block_index_t const* sorted_blocks, size_t n_blocks)
 {
-    tr_piece_index_t piece;
-    size_t n_blocks_missing;
-    tr_priority_t priority;
-    SaltType salt;
-
-    Candidate(tr_piece_index_t piece_in, size_t missing_in, tr_priority_t priority_in, SaltType salt_in)
-        : piece{ piece_in }
-        , n_blocks_missing{ missing_in }
-        , priority{ priority_in }
-        , salt{ salt_in }
+    if (n_blocks == 0)
     {
+        return {};
     }
 
-    [[nodiscard]] constexpr auto compare(Candidate const& that) const noexcept // <=>
+    auto spans = std::vector<tr_block_span_t>{};
+    auto cur = tr_block_span_t{ sorted_blocks[0], sorted_blocks[0] + 1 };
+    for (size_t i = 1; i < n_blocks; ++i)
     {
-        // prefer pieces closer to completion
-        if (auto const val = tr_compare_3way(n_blocks_missing, that.n_blocks_missing); val != 0)
+        if (cur.end == sorted_blocks[i])
         {
-            return val;
+            ++cur.end;
         }
-
-        // prefer higher priority
-        if (auto const val = tr_compare_3way(priority, that.priority); val != 0)
+        else
         {
-            return -val;
+            spans.push_back(cur);
+            cur = tr_block_span_t{ sorted_blocks[i], sorted_blocks[i] + 1 };
         }
+    }
+    spans.push_back(cur);
+
+    return spans;
+}
+
+} // namespace
+
+int Wishlist::Candidate::compare(Candidate const& that) const noexcept // <=>
+{
+    // prefer pieces that a reader will need soonest
+    if (auto const val = tr_compare_3way(deadline, that.deadline); val != 0)
+    {
+        return val;
+    }
+
+    // prefer pieces closer to completion
+    if (auto const val = tr_compare_3way(n_blocks_missing, that.n_blocks_missing); val != 0)
+    {
+        return val;
+    }
+
+    // prefer higher priority
+    if (auto const val = tr_compare_3way(priority, that.priority); val != 0)
+    {
+        return -val;
+    }
 
-        return tr_compare_3way(salt, that.salt);
+    // prefer rarer pieces
+    if (auto const val = tr_compare_3way(n_peers_with_piece, that.n_peers_with_piece); val != 0)
+    {
+        return val;
     }
 
-    bool operator<(Candidate const& that) const // less than
+    if (auto const val = tr_compare_3way(salt, that.salt); val != 0)
     {
-        return compare(that) < 0;
+        return val;
     }
-};
 
-std::vector<Candidate> getCandidates(Wishlist::Mediator const& mediator)
+    // salts can collide, so fall back to the piece to keep the keys unique
+    return tr_compare_3way(piece, that.piece);
+}
+
+Wishlist::SaltType Wishlist::make_salt(tr_piece_index_t piece)
 {
-    // count up the pieces that we still want
-    auto wanted_pieces = std::vector<std::pair<tr_piece_index_t, size_t>>{};
-    auto const n_pieces = mediator.countAllPieces();
-    wanted_pieces.reserve(n_pieces);
-    for (tr_piece_index_t i = 0; i < n_pieces; ++i)
+    return is_sequential_ ? piece : salter_();
+}
+
+void Wishlist::insert(tr_piece_index_t piece, size_t n_blocks_missing)
+{
+    // rarity doesn't matter when downloading in order
+    auto const n_peers = is_sequential_ ? size_t{} : mediator_.countPeersWithPiece(piece);
+    auto const deadline = mediator_.pieceDeadline(piece).value_or(NoDeadline);
+    auto const candidate = Candidate{ piece, deadline, n_blocks_missing, mediator_.priority(piece), n_peers, make_salt(piece) };
+    piece_candidates_[piece] = candidates_.insert(candidate).first;
+}
+
+// Move a candidate to its new place in the list after `func` changes it.
+// `func` returns false if the candidate should be removed instead.
+// extract() + insert() reuses the node instead of reallocating it.
+template<typename Update>
+void Wishlist::update(tr_piece_index_t piece, Update&& func)
+{
+    auto& iter = piece_candidates_[piece];
+    auto node = candidates_.extract(iter);
+    iter = std::end(candidates_);
+    if (func(node.value()))
+    {
+        iter = candidates_.insert(std::move(node)).position;
+    }
+}
+
+void Wishlist::rebuild()
+{
+    candidates_.clear();
+    is_sequential_ = mediator_.isSequentialDownload();
+
+    auto const n_pieces = mediator_.countAllPieces();
+    piece_candidates_.assign(n_pieces, std::end(candidates_));
+
+    // add the pieces that we still want
+    for (tr_piece_index_t piece = 0; piece < n_pieces; ++piece)
     {
-        if (!mediator.clientCanRequestPiece(i))
+        if (!mediator_.clientWantsPiece(piece))
         {
             continue;
         }
 
-        size_t const n_missing = mediator.countMissingBlocks(i);
-        if (n_missing == 0)
+        if (auto const n_missing = mediator_.countMissingBlocks(piece); n_missing != 0U)
         {
-            continue;
+            insert(piece, n_missing);
         }
-
-        wanted_pieces.emplace_back(i, n_missing);
-    }
-
-    // transform them into candidates
-    auto salter = tr_salt_shaker<SaltType>{};
-    auto const n = std::size(wanted_pieces);
-    auto candidates = std::vector<Candidate>{};
-    auto const is_sequential = mediator.isSequentialDownload();
-    candidates.reserve(n);
-    for (size_t i = 0; i < n; ++i)
-    {
-        auto const [piece, n_missing] = wanted_pieces[i];
-        auto const salt = is_sequential ? piece : salter();
-        candidates.emplace_back(piece, n_missing, mediator.priority(piece), salt);
     }
 
-    return candidates;
+    is_dirty_ = false;
 }
 
-std::vector<tr_block_span_t> makeSpans(tr_block_index_t const* sorted_blocks, size_t n_blocks)
+void Wishlist::on_blocks_changed(tr_piece_index_t piece)
 {
-    if (n_blocks == 0)
+    // no point in updating a list that's going to be rebuilt
+    if (is_dirty_ || piece >= std::size(piece_candidates_))
     {
-        return {};
+        return;
     }
 
-    auto spans = std::vector<tr_block_span_t>{};
-    auto cur = tr_block_span_t{ sorted_blocks[0], sorted_blocks[0] + 1 };
-    for (size_t i = 1; i < n_blocks; ++i)
+    auto const n_missing = mediator_.countMissingBlocks(piece);
+
+    auto& iter = piece_candidates_[piece];
+    if (iter == std::end(candidates_))
     {
-        if (cur.end == sorted_blocks[i])
+        // e.g. a piece that failed its checksum test and is missing again
+        if (n_missing != 0U && mediator_.clientWantsPiece(piece))
         {
-            ++cur.end;
-        }
-        else
-        {
-            spans.push_back(cur);
-            cur = tr_block_span_t{ sorted_blocks[i], sorted_blocks[i] + 1 };
+            insert(piece, n_missing);
         }
+
+        return;
     }
-    spans.push_back(cur);
 
-    return spans;
+    if (iter->n_blocks_missing != n_missing)
+    {
+        update(
+            piece,
+            [n_missing](Candidate& candidate)
+            {
+                candidate.n_blocks_missing = n_missing;
+                return n_missing != 0U;
+            });
+    }
 }
 
-} // namespace
+void Wishlist::on_availability_changed(tr_piece_index_t piece)
+{
+    if (is_dirty_ || is_sequential_ || piece >= std::size(piece_candidates_) ||
+        piece_candidates_[piece] == std::end(candidates_))
+    {
+        return;
+    }
+
+    if (auto const n_peers = mediator_.countPeersWithPiece(piece); piece_candidates_[piece]->n_peers_with_piece != n_peers)
+    {
+        update(
+            piece,
+            [n_peers](Candidate& candidate)
+            {
+                candidate.n_peers_with_piece = n_peers;
+                return true;
+            });
+    }
+}
 
-std::vector<tr_block_span_t> Wishlist::next(size_t n_wanted_blocks)
+std::vector<tr_block_span_t> Wishlist::next(
+    size_t n_wanted_blocks,
+    PeerHasPiece const& peer_has_piece,
+    HasActiveRequestToPeer const& has_active_request_to_peer,
+    bool is_fast_peer)
 {
     if (n_wanted_blocks == 0)
     {
         return {};
     }
 
-    auto candidates = getCandidates(mediator_);
+    if (is_dirty_ || mediator_.isSequentialDownload() != is_sequential_ ||
+        mediator_.countAllPieces() != std::size(piece_candidates_))
+    {
+        rebuild();
+    }
 
-    // We usually won't need all the candidates to be sorted until endgame, so don't
-    // waste cycles sorting all of them here. partial sort is enough.
-    static auto constexpr MaxSortedPieces = size_t{ 30 };
-    auto const middle = std::min(std::size(candidates), MaxSortedPieces);
-    std::partial_sort(std::begin(candidates), std::begin(candidates) + middle, std::end(candidates));
+    // don't request from too many peers, and only send duplicate
+    // requests in endgame or when a block is needed soon
+    auto const max_dupe_peers = is_fast_peer ? EndgameMaxPeers : size_t{ 1U };
+    auto const max_peers = mediator_.isEndgame() ? max_dupe_peers : size_t{ 1U };
+    auto const urgent_at = mediator_.now() + UrgentMsec;
+    auto n_dupes_left = is_fast_peer ? mediator_.countDuplicatesAllowed() : size_t{};
 
     auto blocks = std::set<tr_block_index_t>{};
-    for (auto const& candidate : candidates)
+    for (auto const& candidate : candidates_)
     {
         // do we have enough?
         if (std::size(blocks) >= n_wanted_blocks)
@@ -149,23 +223,40 @@ std::vector<tr_block_span_t> Wishlist::next(size_t n_wanted_blocks)
             break;
         }
 
+        // does the peer have this piece?
+        if (!peer_has_piece(candidate.piece))
+        {
+            continue;
+        }
+
+        auto const max_piece_peers = candidate.deadline <= urgent_at ? max_dupe_peers : max_peers;
+
         // walk the blocks in this piece
         auto const [begin, end] = mediator_.blockSpan(candidate.piece);
         for (tr_block_index_t block = begin; block < end && std::size(blocks) < n_wanted_blocks; ++block)
         {
-            // don't request blocks we've already got
-            if (!mediator_.clientCanRequestBlock(block))
+            // don't request blocks we've already got or already asked this peer for
+            if (mediator_.clientHasBlock(block) || has_active_request_to_peer(block))
             {
                 continue;
             }
 
-            // don't request from too many peers
-            size_t const n_peers = mediator_.countActiveRequests(block);
-            if (size_t const max_peers = mediator_.isEndgame() ? 2 : 1; n_peers >= max_peers)
+            auto const n_active = mediator_.countActiveRequests(block);
+            if (n_active >= max_piece_peers)
             {
                 continue;
             }
 
+            if (n_active != 0U)
+            {
+                if (n_dupes_left == 0U)
+                {
+                    continue;
+                }
+
+                --n_dupes_left;
+            }
+
             blocks.insert(block);
         }
     }
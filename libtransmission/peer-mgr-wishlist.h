@@ -10,22 +10,50 @@
 #endif
 
 #include <cstddef> // size_t
+#include <cstdint> // uint64_t
+#include <functional>
+#include <limits>
+#include <optional>
+#include <set>
 #include <vector>
 
 #include "libtransmission/transmission.h"
 
+#include "libtransmission/crypto-utils.h" // for tr_salt_shaker
+
 /**
  * Figures out what blocks we want to request next.
+ *
+ * The candidate pieces are kept sorted between calls to `next()`.
+ * The owner is expected to call `on_blocks_changed()` as blocks arrive
+ * and `invalidate()` when the set of wanted pieces or their priorities
+ * change, so that the list doesn't need to be rebuilt for every request.
+ *
+ * Among pieces that are equally close to done and equally important,
+ * the ones that the fewest peers have are requested first.
+ *
+ * Pieces with deadlines, e.g. the ones just ahead of a streaming reader,
+ * come before all others, earliest first. Once a deadline is close, its
+ * blocks may be requested from a second fast peer in case the first one
+ * doesn't deliver in time.
+ *
+ * In endgame, any missing block may be requested from a second peer.
+ * Either way, those duplicate requests only go to fast peers, and only
+ * as many as `Mediator::countDuplicatesAllowed()` says, since whichever
+ * copy arrives second is wasted.
  */
 class Wishlist
 {
 public:
     static auto constexpr EndgameMaxPeers = size_t{ 2U };
 
+    // blocks due within this long are urgent enough to request twice
+    static auto constexpr UrgentMsec = uint64_t{ 3000U };
+
     struct Mediator
     {
-        [[nodiscard]] virtual bool clientCanRequestBlock(tr_block_index_t block) const = 0;
-        [[nodiscard]] virtual bool clientCanRequestPiece(tr_piece_index_t piece) const = 0;
+        [[nodiscard]] virtual bool clientHasBlock(tr_block_index_t block) const = 0;
+        [[nodiscard]] virtual bool clientWantsPiece(tr_piece_index_t piece) const = 0;
         [[nodiscard]] virtual bool isEndgame() const = 0;
         [[nodiscard]] virtual bool isSequentialDownload() const = 0;
         [[nodiscard]] virtual size_t countActiveRequests(tr_block_index_t block) const = 0;
@@ -33,17 +61,95 @@ public:
         [[nodiscard]] virtual tr_block_span_t blockSpan(tr_piece_index_t) const = 0;
         [[nodiscard]] virtual tr_piece_index_t countAllPieces() const = 0;
         [[nodiscard]] virtual tr_priority_t priority(tr_piece_index_t) const = 0;
+        [[nodiscard]] virtual size_t countPeersWithPiece(tr_piece_index_t) const = 0;
+        [[nodiscard]] virtual std::optional<uint64_t> pieceDeadline(tr_piece_index_t) const = 0;
+        [[nodiscard]] virtual uint64_t now() const = 0;
+        // how many more blocks may be requested from a second peer right now
+        [[nodiscard]] virtual size_t countDuplicatesAllowed() const = 0;
         virtual ~Mediator() = default;
     };
 
-    constexpr explicit Wishlist(Mediator const& mediator)
+    using PeerHasPiece = std::function<bool(tr_piece_index_t)>;
+    using HasActiveRequestToPeer = std::function<bool(tr_block_index_t)>;
+
+    explicit Wishlist(Mediator const& mediator)
         : mediator_{ mediator }
     {
     }
 
-    // the next blocks that we should request from a peer
-    [[nodiscard]] std::vector<tr_block_span_t> next(size_t n_wanted_blocks);
+    // the next blocks that we should request from a peer.
+    // Blocks are only requested twice from peers that are `is_fast_peer`.
+    [[nodiscard]] std::vector<tr_block_span_t> next(
+        size_t n_wanted_blocks,
+        PeerHasPiece const& peer_has_piece,
+        HasActiveRequestToPeer const& has_active_request_to_peer,
+        bool is_fast_peer = true);
+
+    // Call when the number of blocks missing from `piece` has changed,
+    // e.g. when we've received one of its blocks.
+    void on_blocks_changed(tr_piece_index_t piece);
+
+    // Call when the number of peers that have `piece` has changed
+    void on_availability_changed(tr_piece_index_t piece);
+
+    // Call when the wanted pieces, their priorities, their deadlines,
+    // or the download order has changed. The next call to `next()` rebuilds the list.
+    constexpr void invalidate() noexcept
+    {
+        is_dirty_ = true;
+    }
+
+    // Free the list's memory, e.g. while the torrent is idle.
+    // The next call to `next()` rebuilds it.
+    void clear()
+    {
+        candidates_.clear();
+        piece_candidates_ = std::vector<Candidates::iterator>{};
+        is_dirty_ = true;
+    }
 
 private:
+    using SaltType = tr_piece_index_t;
+
+    static auto constexpr NoDeadline = std::numeric_limits<uint64_t>::max();
+
+    struct Candidate
+    {
+        tr_piece_index_t piece;
+        uint64_t deadline;
+        size_t n_blocks_missing;
+        tr_priority_t priority;
+        size_t n_peers_with_piece;
+        SaltType salt;
+
+        [[nodiscard]] int compare(Candidate const& that) const noexcept; // <=>
+
+        [[nodiscard]] bool operator<(Candidate const& that) const noexcept
+        {
+            return compare(that) < 0;
+        }
+    };
+
+    using Candidates = std::set<Candidate>;
+
+    void rebuild();
+
+    [[nodiscard]] SaltType make_salt(tr_piece_index_t piece);
+
+    void insert(tr_piece_index_t piece, size_t n_blocks_missing);
+
+    template<typename Update>
+    void update(tr_piece_index_t piece, Update&& func);
+
     Mediator const& mediator_;
+
+    Candidates candidates_;
+
+    // index: piece. value: its entry in `candidates_`, or end() if none
+    std::vector<Candidates::iterator> piece_candidates_;
+
+    tr_salt_shaker<SaltType> salter_;
+
+    bool is_sequential_ = false;
+    bool is_dirty_ = true;
 };
@@ -12,7 +12,12 @@
 #include <cstdint>
 #include <ctime> // time_t
 #include <iterator> // std::back_inserter
+#include <limits>
+#include <map>
+#include <memory>
 #include <optional>
+#include <queue>
+#include <set>
 #include <tuple> // std::tie
 #include <unordered_map>
 #include <utility>
@@ -27,16 +32,17 @@
 
 #include "libtransmission/announcer.h"
 #include "libtransmission/block-info.h" // tr_block_info
-#include "libtransmission/clients.h"
 #include "libtransmission/crypto-utils.h"
 #include "libtransmission/handshake.h"
 #include "libtransmission/interned-string.h"
 #include "libtransmission/log.h"
+#include "libtransmission/metrics.h"
 #include "libtransmission/net.h"
 #include "libtransmission/observable.h"
 #include "libtransmission/peer-common.h"
 #include "libtransmission/peer-io.h"
 #include "libtransmission/peer-mgr-active-requests.h"
+#include "libtransmission/peer-mgr-rechoke.h"
 #include "libtransmission/peer-mgr-wishlist.h"
 #include "libtransmission/peer-mgr.h"
 #include "libtransmission/peer-msgs.h"
@@ -111,6 +117,11 @@ public:
         return session_.timerMaker();
     }
 
+    [[nodiscard]] tr_mse_worker* mse_worker() override
+    {
+        return session_.mseWorker();
+    }
+
     [[nodiscard]] size_t pad(void* setme, size_t maxlen) const override
     {
         auto const len = tr_rand_int(maxlen);
@@ -126,15 +137,76 @@ using Handshakes = std::unordered_map<tr_socket_address, tr_handshake>;
 
 } // anonymous namespace
 
+tr_peer_addresses& tr_peer_addresses::instance()
+{
+    static auto addresses = tr_peer_addresses{};
+    return addresses;
+}
+
+tr_peer_addresses::index_t tr_peer_addresses::acquire(tr_socket_address const& socket_address)
+{
+    auto& self = instance();
+
+    if (auto const iter = self.index_.find(socket_address); iter != std::end(self.index_))
+    {
+        ++self.refcounts_[iter->second];
+        return iter->second;
+    }
+
+    auto idx = index_t{};
+    if (!std::empty(self.free_))
+    {
+        idx = self.free_.back();
+        self.free_.pop_back();
+        self.addresses_[idx] = socket_address;
+        self.refcounts_[idx] = 1U;
+        self.blocklisted_[idx].reset();
+        self.utp_supported_[idx].reset();
+    }
+    else
+    {
+        idx = static_cast<index_t>(std::size(self.addresses_));
+        self.addresses_.emplace_back(socket_address);
+        self.refcounts_.emplace_back(1U);
+        self.blocklisted_.emplace_back();
+        self.utp_supported_.emplace_back();
+    }
+
+    self.index_.try_emplace(socket_address, idx);
+    return idx;
+}
+
+void tr_peer_addresses::release(index_t idx) noexcept
+{
+    auto& self = instance();
+    TR_ASSERT(idx < std::size(self.refcounts_));
+    TR_ASSERT(self.refcounts_[idx] > 0U);
+
+    if (--self.refcounts_[idx] == 0U)
+    {
+        self.index_.erase(self.addresses_[idx]);
+        self.free_.emplace_back(idx);
+    }
+}
+
+void tr_peer_addresses::clear_blocklisted() noexcept
+{
+    auto& self = instance();
+    std::fill(std::begin(self.blocklisted_), std::end(self.blocklisted_), std::nullopt);
+}
+
+// ---
+
 bool tr_peer_info::is_blocklisted(tr_session const* session) const
 {
-    if (blocklisted_)
+    auto& blocklisted = tr_peer_addresses::blocklisted(address_idx_);
+    if (blocklisted)
     {
-        return *blocklisted_;
+        return *blocklisted;
     }
 
     auto const value = session->addressIsBlocked(listen_address());
-    blocklisted_ = value;
+    blocklisted = value;
     return value;
 }
 
@@ -173,6 +245,29 @@ constexpr struct
     }
 } CompareAtomsByUsefulness{};
 
+/* when a pool is too big, the peers to forget go first */
+constexpr struct
+{
+    [[nodiscard]] constexpr bool operator()(tr_peer_info const* a, tr_peer_info const* b) const noexcept
+    {
+        if (auto const val = a->compare_by_failure_count(*b); val != 0)
+        {
+            return val > 0;
+        }
+
+        if (auto const val = CompareAtomsByUsefulness.compare(*a, *b); val != 0)
+        {
+            return val > 0;
+        }
+
+        return a->last_heard_at() < b->last_heard_at();
+    }
+} CompareAtomsByEvictionOrder{};
+
+// Update the session-wide count of connected peers.
+// Defined after tr_peerMgr so that tr_swarm can call it.
+void count_peer(tr_peerMgr* manager, bool added);
+
 } // namespace
 
 /** @brief Opaque, per-torrent data structure for peer connection information */
@@ -182,6 +277,84 @@ public:
     using Peers = std::vector<tr_peerMsgs*>;
     using Pool = std::unordered_map<tr_socket_address, tr_peer_info>;
 
+    class WishlistMediator final : public Wishlist::Mediator
+    {
+    public:
+        explicit WishlistMediator(tr_swarm const& swarm)
+            : swarm_{ swarm }
+        {
+        }
+
+        [[nodiscard]] bool clientHasBlock(tr_block_index_t block) const override
+        {
+            return swarm_.tor->has_block(block);
+        }
+
+        [[nodiscard]] bool clientWantsPiece(tr_piece_index_t piece) const override
+        {
+            return swarm_.tor->piece_is_wanted(piece);
+        }
+
+        [[nodiscard]] bool isEndgame() const override
+        {
+            return swarm_.isEndgame();
+        }
+
+        [[nodiscard]] size_t countActiveRequests(tr_block_index_t block) const override
+        {
+            return swarm_.active_requests.count(block);
+        }
+
+        [[nodiscard]] size_t countMissingBlocks(tr_piece_index_t piece) const override
+        {
+            return swarm_.tor->count_missing_blocks_in_piece(piece);
+        }
+
+        [[nodiscard]] tr_block_span_t blockSpan(tr_piece_index_t piece) const override
+        {
+            return swarm_.tor->block_span_for_piece(piece);
+        }
+
+        [[nodiscard]] tr_piece_index_t countAllPieces() const override
+        {
+            return swarm_.tor->piece_count();
+        }
+
+        [[nodiscard]] tr_priority_t priority(tr_piece_index_t piece) const override
+        {
+            return swarm_.tor->piece_priority(piece);
+        }
+
+        [[nodiscard]] size_t countPeersWithPiece(tr_piece_index_t piece) const override
+        {
+            return swarm_.piece_availability(piece);
+        }
+
+        [[nodiscard]] bool isSequentialDownload() const override
+        {
+            return swarm_.tor->is_sequential_download();
+        }
+
+        [[nodiscard]] std::optional<uint64_t> pieceDeadline(tr_piece_index_t piece) const override
+        {
+            return swarm_.tor->piece_deadline(piece);
+        }
+
+        [[nodiscard]] uint64_t now() const override
+        {
+            return tr_time_msec();
+        }
+
+        [[nodiscard]] size_t countDuplicatesAllowed() const override
+        {
+            auto const n_dupes = swarm_.active_requests.count_duplicates();
+            return n_dupes < MaxDuplicateRequests ? MaxDuplicateRequests - n_dupes : size_t{};
+        }
+
+    private:
+        tr_swarm const& swarm_;
+    };
+
     [[nodiscard]] auto unique_lock() const
     {
         return tor->unique_lock();
@@ -199,6 +372,19 @@ public:
               tor_in->started_.observe([this](tr_torrent*) { on_torrent_started(); }),
               tor_in->stopped_.observe([this](tr_torrent*) { on_torrent_stopped(); }),
               tor_in->swarm_is_all_seeds_.observe([this](tr_torrent* /*tor*/) { on_swarm_is_all_seeds(); }),
+              tor_in->files_wanted_changed_.observe(
+                  [this](tr_torrent* /*tor*/)
+                  {
+                      wishlist.invalidate();
+                      wanted_missing_.reset();
+                  }),
+              tor_in->priority_changed_.observe(
+                  [this](tr_torrent* /*tor*/)
+                  {
+                      wishlist.invalidate();
+                      mark_candidates_dirty();
+                  }),
+              tor_in->stream_cursor_changed_.observe([this](tr_torrent* /*tor*/) { wishlist.invalidate(); }),
           } }
     {
 
@@ -275,10 +461,14 @@ public:
         auto const socket_address = peer->socket_address();
         auto const listen_socket_address = peer_info->listen_socket_address();
         auto const was_incoming = peer->is_incoming_connection();
+        auto const freed_upload_slot = !peer->peer_is_choked() && peer->peer_is_interested();
         TR_ASSERT(peer_info != nullptr);
 
         --stats.peer_count;
         --stats.peer_from_count[peer_info->from_first()];
+        count_peer(manager, false);
+
+        add_availability(peer->has(), -1);
 
         if (auto iter = std::find(std::begin(peers), std::end(peers), peer); iter != std::end(peers))
         {
@@ -297,6 +487,14 @@ public:
             }
         }
         graveyard_pool.erase(listen_socket_address);
+
+        // they can be reconnected to once their reconnect interval passes
+        mark_candidates_dirty();
+
+        if (freed_upload_slot && is_running)
+        {
+            rechoke_soon();
+        }
     }
 
     void remove_all_peers()
@@ -311,6 +509,133 @@ public:
         TR_ASSERT(stats.peer_count == 0);
     }
 
+    // --- piece availability
+
+    // How many connected peers have `piece`. Seeds aren't counted since
+    // they have every piece and so don't change which ones are rarest.
+    [[nodiscard]] TR_CONSTEXPR20 size_t piece_availability(tr_piece_index_t piece) const noexcept
+    {
+        return piece < std::size(piece_availability_) ? piece_availability_[piece] : 0U;
+    }
+
+    void add_availability(tr_bitfield const& have, int delta)
+    {
+        if (have.has_none() || have.has_all())
+        {
+            return;
+        }
+
+        for (tr_piece_index_t piece = 0, n = std::min(std::size(piece_availability_), have.size()); piece < n; ++piece)
+        {
+            if (auto& count = piece_availability_[piece]; have.test(piece) && (delta > 0 || count > 0U))
+            {
+                count += delta;
+            }
+        }
+
+        // a bulk change, so it's cheaper to re-sort everything once
+        wishlist.invalidate();
+    }
+
+    void on_peer_got_piece(tr_peerMsgs const* peer, tr_piece_index_t piece)
+    {
+        if (piece >= std::size(piece_availability_))
+        {
+            return;
+        }
+
+        // if the peer just became a seed, move it out of the counts
+        if (peer->isSeed())
+        {
+            auto was = peer->has();
+            was.unset(piece);
+            add_availability(was, -1);
+            return;
+        }
+
+        ++piece_availability_[piece];
+        wishlist.on_availability_changed(piece);
+    }
+
+    // --- hibernation
+
+    // An idle seed doesn't need its per-piece state until a peer shows up,
+    // so free it. Seeding thousands of torrents that are rarely active adds up.
+    void update_hibernation(time_t now)
+    {
+        if (!is_idle_seed())
+        {
+            busy_at_ = now;
+            wake();
+            return;
+        }
+
+        // seeds hibernated by hibernate_if_idle() sleep until they're busy,
+        // even if idle seeds aren't otherwise hibernated
+        if (tor->is_hibernating())
+        {
+            return;
+        }
+
+        if (auto const idle_secs = static_cast<time_t>(tor->session->hibernateIdleSeedsMinutes() * 60U); idle_secs == 0)
+        {
+            busy_at_ = now;
+        }
+        else if (now >= busy_at_ + idle_secs)
+        {
+            hibernate();
+        }
+    }
+
+    // Hibernate now if this is an idle seed, e.g. when memory is short
+    // @return true if the swarm went into hibernation
+    bool hibernate_if_idle()
+    {
+        if (tor->is_hibernating() || !is_idle_seed())
+        {
+            return false;
+        }
+
+        hibernate();
+        return true;
+    }
+
+    [[nodiscard]] bool is_idle_seed() const
+    {
+        return tor->is_running() && tor->is_done() && tor->verify_state() == TR_VERIFY_NONE && std::empty(peers);
+    }
+
+    void hibernate()
+    {
+        tor->hibernate();
+        wishlist.clear();
+        piece_availability_ = std::vector<uint16_t>{};
+        pex_snapshot.reset();
+    }
+
+    void wake()
+    {
+        if (tor->is_hibernating())
+        {
+            tor->wake();
+            rebuild_availability();
+        }
+    }
+
+    void rebuild_availability()
+    {
+        piece_availability_.assign(tor->piece_count(), 0U);
+
+        for (auto const* const peer : peers)
+        {
+            add_availability(peer->has(), 1);
+        }
+
+        wishlist.invalidate();
+    }
+
+    // ---
+
     void updateEndgame()
     {
         /* we consider ourselves to be in endgame if the number of bytes
@@ -318,7 +643,7 @@ public:
         is_endgame_ = uint64_t(std::size(active_requests)) * tr_block_info::BlockSize >= tor->left_until_done();
     }
 
-    [[nodiscard]] constexpr auto isEndgame() const noexcept
+    [[nodiscard]] constexpr bool isEndgame() const noexcept
     {
         return is_endgame_;
     }
@@ -365,6 +690,27 @@ public:
         return *pool_is_all_seeds_;
     }
 
+    // The pieces we want but don't have, i.e. the pieces that make a peer
+    // interesting. Kept up to date as pieces complete or fail their checks,
+    // and rebuilt after anything that changes many pieces at once.
+    [[nodiscard]] tr_bitfield const& wanted_missing_pieces() const
+    {
+        if (!wanted_missing_)
+        {
+            auto const n_pieces = tor->piece_count();
+            auto& pieces = wanted_missing_.emplace(n_pieces);
+            for (tr_piece_index_t piece = 0; piece < n_pieces; ++piece)
+            {
+                if (tor->piece_is_wanted(piece) && !tor->has_piece(piece))
+                {
+                    pieces.set(piece);
+                }
+            }
+        }
+
+        return *wanted_missing_;
+    }
+
     [[nodiscard]] tr_peer_info* get_existing_peer_info(tr_socket_address const& socket_address) noexcept
     {
         auto&& it = connectable_pool.find(socket_address);
@@ -388,12 +734,110 @@ public:
             peer_info.found_at(from);
             peer_info.set_pex_flags(flags);
         }
+        else if (is_connectable)
+        {
+            mark_candidates_dirty();
+        }
 
         mark_all_seeds_flag_dirty();
 
         return peer_info;
     }
 
+    // ensure_info_exists() for a batch of connectable peers, e.g. a tracker's response
+    void ensure_infos_exist(std::vector<tr_pex> const& pex, tr_peer_from const from)
+    {
+        TR_ASSERT(from < TR_PEER_FROM__MAX);
+
+        if (std::empty(pex))
+        {
+            return;
+        }
+
+        auto any_new = false;
+        for (auto const& peer : pex)
+        {
+            auto const socket_address = tr_socket_address{ peer.addr, peer.port };
+            TR_ASSERT(socket_address.is_valid());
+
+            auto&& [it, is_new] = connectable_pool.try_emplace(socket_address, socket_address, peer.flags, from);
+            if (!is_new)
+            {
+                it->second.found_at(from);
+                it->second.set_pex_flags(peer.flags);
+            }
+
+            any_new |= is_new;
+        }
+
+        if (any_new)
+        {
+            mark_candidates_dirty();
+        }
+
+        mark_all_seeds_flag_dirty();
+    }
+
+    // Forget the connectable peers that we haven't heard of in a while,
+    // then the least useful ones until no more than `max_size` are left.
+    // Peers that we're connected or connecting to are always kept.
+    // @return the number of peers that were forgotten
+    size_t prune_connectable_pool(size_t const max_size, time_t const now)
+    {
+        auto evictable = std::vector<tr_peer_info const*>{};
+        evictable.reserve(std::size(connectable_pool));
+        auto doomed = std::vector<tr_socket_address>{};
+        for (auto const& [socket_address, peer_info] : connectable_pool)
+        {
+            if (peer_is_in_use(peer_info))
+            {
+                continue;
+            }
+
+            if (now - peer_info.last_heard_at() >= PoolEntryMaxAgeSecs)
+            {
+                doomed.emplace_back(socket_address);
+            }
+            else
+            {
+                evictable.emplace_back(&peer_info);
+            }
+        }
+
+        if (auto const n_left = std::size(connectable_pool) - std::size(doomed); n_left > max_size)
+        {
+            auto const n_evict = std::min(n_left - max_size, std::size(evictable));
+            auto const nth = std::begin(evictable) + n_evict;
+            std::nth_element(std::begin(evictable), nth, std::end(evictable), CompareAtomsByEvictionOrder);
+            std::transform(
+                std::begin(evictable),
+                nth,
+                std::back_inserter(doomed),
+                [](tr_peer_info const* info) { return info->listen_socket_address(); });
+        }
+
+        if (std::empty(doomed))
+        {
+            return 0U;
+        }
+
+        for (auto const& socket_address : doomed)
+        {
+            connectable_pool.erase(socket_address);
+        }
+
+        tr_logAddTraceSwarm(this, fmt::format("forgot {} known peers", std::size(doomed)));
+        mark_candidates_dirty();
+        mark_all_seeds_flag_dirty();
+        return std::size(doomed);
+    }
+
+    // Ask the peer manager to rebuild this swarm's outbound connection candidates.
+    void mark_candidates_dirty();
+
+    // Ask the peer manager to rechoke this swarm before its next full pass.
+    void rechoke_soon();
+
     void mark_peer_as_seed(tr_peer_info& peer_info)
     {
         tr_logAddTraceSwarm(this, fmt::format("marking peer {} as a seed", peer_info.display_name()));
@@ -454,11 +898,17 @@ public:
             break;
 
         case tr_peer_event::Type::ClientGotHave:
+            s->on_peer_got_piece(msgs, event.pieceIndex);
+            break;
+
         case tr_peer_event::Type::ClientGotHaveAll:
         case tr_peer_event::Type::ClientGotHaveNone:
         case tr_peer_event::Type::ClientGotBitfield:
-            /* TODO: if we don't need these, should these events be removed? */
-            /* noop */
+            s->add_availability(msgs->has(), 1);
+            break;
+
+        case tr_peer_event::Type::ClientWillResetHave:
+            s->add_availability(msgs->has(), -1);
             break;
 
         case tr_peer_event::Type::ClientGotChoke:
@@ -498,6 +948,10 @@ public:
 
     mutable tr_swarm_stats stats = {};
 
+    // This swarm's share of the session's upload slots, as of the last
+    // full rechoke. Unset until the swarm has had demand for uploads.
+    std::optional<size_t> upload_slots;
+
     uint8_t optimistic_unchoke_time_scaler = 0;
 
     bool is_running = false;
@@ -508,6 +962,15 @@ public:
 
     ActiveRequests active_requests;
 
+    // index: piece. value: how many non-seed peers have it
+    std::vector<uint16_t> piece_availability_ = std::vector<uint16_t>(tor->piece_count());
+
+    // depends-on: tor, active_requests, piece_availability_
+    WishlistMediator wishlist_mediator{ *this };
+
+    // depends-on: wishlist_mediator
+    Wishlist wishlist{ wishlist_mediator };
+
     // depends-on: active_requests
     std::vector<std::unique_ptr<tr_peer>> webseeds;
 
@@ -524,6 +987,20 @@ public:
 
     time_t lastCancel = 0;
 
+    // when this swarm last had a reason not to hibernate
+    time_t busy_at_ = tr_time();
+
+    std::shared_ptr<tr_pex_snapshot> pex_snapshot;
+    time_t pex_snapshot_at = 0;
+
+    // The peers' stats, refreshed at most once a second so that RPC
+    // clients polling a big swarm don't ask every peer for its stats
+    // on each request. Only used on the session thread.
+    std::vector<tr_peer_stat> peer_stats;
+    time_t peer_stats_at = 0;
+
+    tr_ltep_handshake_cache ltep_handshake;
+
 private:
     static void maybeSendCancelRequest(tr_peer* peer, tr_block_index_t block, tr_peer const* muted)
     {
@@ -567,6 +1044,11 @@ private:
 
     void on_piece_completed(tr_piece_index_t piece)
     {
+        if (wanted_missing_)
+        {
+            wanted_missing_->unset(piece);
+        }
+
         bool piece_came_from_peers = false;
 
         for (auto* const peer : peers)
@@ -606,6 +1088,13 @@ private:
         }
 
         tr_announcerAddBytes(tor, TR_ANN_CORRUPT, byte_count);
+
+        // the piece's blocks are about to be marked as missing again
+        wishlist.invalidate();
+        if (wanted_missing_ && tor->piece_is_wanted(piece))
+        {
+            wanted_missing_->set(piece);
+        }
     }
 
     void on_got_metainfo()
@@ -613,6 +1102,10 @@ private:
         // the webseed list may have changed...
         rebuildWebseeds();
 
+        // ...and so has the list of pieces
+        rebuild_availability();
+        wanted_missing_.reset();
+
         // some peer_msgs' progress fields may not be accurate if we
         // didn't have the metadata before now... so refresh them all...
         for (auto* peer : peers)
@@ -646,6 +1139,13 @@ private:
                 s->cancelAllRequestsForBlock(loc.block, peer);
                 peer->blocks_sent_to_client.add(tr_time(), 1);
                 tr_torrentGotBlock(tor, loc.block);
+
+                // a block can straddle two pieces
+                auto const last_piece = tor->byte_loc(loc.byte + tor->block_size(loc.block) - 1U).piece;
+                for (auto piece = loc.piece; piece <= last_piece; ++piece)
+                {
+                    s->wishlist.on_blocks_changed(piece);
+                }
             }
 
             break;
@@ -728,6 +1228,7 @@ private:
         info_this.set_listen_port(event.port);
 
         mark_all_seeds_flag_dirty();
+        mark_candidates_dirty();
     }
 
     bool on_got_port_duplicate_connection(tr_peerMsgs* const msgs, Pool::iterator& it_that, bool was_connectable)
@@ -775,52 +1276,223 @@ private:
     // how long we'll let requests we've made linger before we cancel them
     static auto constexpr RequestTtlSecs = int{ 90 };
 
-    std::array<libtransmission::ObserverTag, 8> const tags_;
+    // how many blocks may be requested from two peers at once. Every
+    // duplicate that isn't cancelled in time is a block's worth of waste,
+    // so this caps the waste at 4 MiB per torrent at any one time.
+    static auto constexpr MaxDuplicateRequests = size_t{ 4U * 1024U * 1024U / tr_block_info::BlockSize };
+
+    // how long a peer that we aren't connected to is remembered after we
+    // last heard of it. Trackers, DHT, PEX, and LPD keep mentioning the
+    // peers that are still in the swarm, so the rest are probably gone.
+    static auto constexpr PoolEntryMaxAgeSecs = time_t{ 60 * 60 * 2 };
+
+    std::array<libtransmission::ObserverTag, 11> const tags_;
 
     mutable std::optional<bool> pool_is_all_seeds_;
 
+    mutable std::optional<tr_bitfield> wanted_missing_;
+
     bool is_endgame_ = false;
 };
 
+// The peers we might initiate connections to, kept across pulses.
+// Each swarm contributes its best few candidates to a shared heap,
+// and a swarm is only rescored when something in it changes, when
+// its candidates run out, or when the scores are getting stale.
+class OutboundCandidateIndex
+{
+public:
+    struct Candidate
+    {
+        uint64_t score; // smaller is better
+        uint64_t generation;
+        tr_torrent_id_t tor_id;
+        tr_socket_address socket_address;
+    };
+
+    // Rescan `tor_id` at `when`, unless it's already due sooner.
+    void schedule_rescan(tr_torrent_id_t tor_id, time_t when)
+    {
+        auto& swarm = swarms_[tor_id];
+        if (swarm.rescan_at)
+        {
+            if (*swarm.rescan_at <= when)
+            {
+                return;
+            }
+
+            rescans_.erase({ *swarm.rescan_at, tor_id });
+        }
+
+        swarm.rescan_at = when;
+        rescans_.emplace(when, tor_id);
+    }
+
+    // @return the swarm that's been waiting longest for a rescan, if any are due
+    [[nodiscard]] std::optional<tr_torrent_id_t> pop_due_rescan(time_t now)
+    {
+        if (std::empty(rescans_) || now < std::begin(rescans_)->first)
+        {
+            return {};
+        }
+
+        auto const tor_id = std::begin(rescans_)->second;
+        rescans_.erase(std::begin(rescans_));
+        swarms_[tor_id].rescan_at.reset();
+        return tor_id;
+    }
+
+    // Replace all of `tor_id`'s candidates with `scored`.
+    void set_candidates(tr_torrent_id_t tor_id, std::vector<std::pair<uint64_t, tr_socket_address>> const& scored)
+    {
+        auto& swarm = swarms_[tor_id];
+        n_live_ -= swarm.n_live;
+        swarm.generation = ++generation_;
+        swarm.n_live = std::size(scored);
+        n_live_ += swarm.n_live;
+
+        for (auto const& [score, socket_address] : scored)
+        {
+            heap_.push_back(Candidate{ score, swarm.generation, tor_id, socket_address });
+            std::push_heap(std::begin(heap_), std::end(heap_), IsWorse);
+        }
+
+        compact();
+    }
+
+    // Drop everything we know about `tor_id`, e.g. because it stopped.
+    void forget(tr_torrent_id_t tor_id)
+    {
+        if (auto const iter = swarms_.find(tor_id); iter != std::end(swarms_))
+        {
+            if (iter->second.rescan_at)
+            {
+                rescans_.erase({ *iter->second.rescan_at, tor_id });
+            }
+
+            n_live_ -= iter->second.n_live;
+            swarms_.erase(iter);
+        }
+    }
+
+    // @return the best candidate across all swarms
+    [[nodiscard]] std::optional<Candidate> pop(time_t now)
+    {
+        while (!std::empty(heap_))
+        {
+            std::pop_heap(std::begin(heap_), std::end(heap_), IsWorse);
+            auto const candidate = heap_.back();
+            heap_.pop_back();
+
+            auto const iter = swarms_.find(candidate.tor_id);
+            if (iter == std::end(swarms_) || iter->second.generation != candidate.generation)
+            {
+                continue; // stale
+            }
+
+            --n_live_;
+            if (--iter->second.n_live == 0U)
+            {
+                schedule_rescan(candidate.tor_id, now);
+            }
+
+            return candidate;
+        }
+
+        return {};
+    }
+
+private:
+    static bool IsWorse(Candidate const& a, Candidate const& b) noexcept
+    {
+        return a.score > b.score;
+    }
+
+    // Rescanning a swarm leaves its old candidates in the heap to be
+    // skipped when popped; clean them out if they start to pile up.
+    void compact()
+    {
+        if (std::size(heap_) < MinCompactSize || std::size(heap_) < n_live_ * 2U)
+        {
+            return;
+        }
+
+        auto const is_stale = [this](Candidate const& candidate)
+        {
+            auto const iter = swarms_.find(candidate.tor_id);
+            return iter == std::end(swarms_) || iter->second.generation != candidate.generation;
+        };
+        heap_.erase(std::remove_if(std::begin(heap_), std::end(heap_), is_stale), std::end(heap_));
+        std::make_heap(std::begin(heap_), std::end(heap_), IsWorse);
+    }
+
+    static auto constexpr MinCompactSize = size_t{ 1024U };
+
+    struct SwarmCandidates
+    {
+        std::optional<time_t> rescan_at;
+        uint64_t generation = 0U;
+        size_t n_live = 0U;
+    };
+
+    std::vector<Candidate> heap_;
+    std::map<tr_torrent_id_t, SwarmCandidates> swarms_;
+    std::set<std::pair<time_t, tr_torrent_id_t>> rescans_;
+    uint64_t generation_ = 0U;
+    size_t n_live_ = 0U;
+};
+
 struct tr_peerMgr
 {
 private:
     static auto constexpr BandwidthTimerPeriod = 500ms;
     static auto constexpr RechokePeriod = 10s;
+    static auto constexpr RechokeSoonPeriod = 100ms;
+
+    // When adaptive bandwidth is enabled, allocate bandwidth more often
+    // while peers are running out of it before the next allocation.
+    static auto constexpr MinAllocatePeriod = 25ms;
+    static auto constexpr MaxAllocatePeriod = BandwidthTimerPeriod;
     static auto constexpr RefillUpkeepPeriod = 10s;
+    static auto constexpr PoolUpkeepPeriod = 60s;
 
     // Max number of outbound peer connections to initiate.
     // This throttle is an arbitrary number to avoid overloading routers.
     static auto constexpr MaxConnectionsPerSecond = size_t{ 18U };
     static auto constexpr MaxConnectionsPerPulse = size_t(MaxConnectionsPerSecond * BandwidthTimerPeriod / 1s);
 
-    // Building a peer candidate list is expensive, so cache it across pulses.
-    // We want to cache it long enough to avoid excess CPU cycles,
-    // but short enough that the data isn't too stale.
-    static auto constexpr OutboundCandidatesListTtl = BandwidthTimerPeriod * 4U;
+public:
+    // How many of a swarm's best candidates go into the outbound candidate index.
+    // Once they've been used up, the swarm is rescanned for more.
+    static auto constexpr MaxCandidatesPerSwarm = size_t{ 8U };
 
-    // How big the candidate list should be when we create it.
-    static auto constexpr OutboundCandidateListCapacity = MaxConnectionsPerPulse * OutboundCandidatesListTtl /
-        BandwidthTimerPeriod;
+    // Upper bound on the peers scored per pulse, so that a burst of changed
+    // swarms is spread across several pulses instead of stalling one.
+    static auto constexpr MaxCandidateScansPerPulse = size_t{ 16384U };
 
-public:
-    // The peers we might try connecting to in the next few seconds.
-    // This list is cached between pulses so use resilient keys, e.g.
-    // a `tr_torrent_id_t` instead of a `tr_torrent*` that can be freed.
-    using OutboundCandidates = small::
-        max_size_vector<std::pair<tr_torrent_id_t, tr_socket_address>, OutboundCandidateListCapacity>;
+    // Rescore swarms at least this often so that scores which depend on
+    // time, e.g. "recently started torrent", don't get too stale.
+    static auto constexpr CandidateRefreshSecs = time_t{ 60 };
+
+    // How long to wait before checking again on a swarm that can't take
+    // new connections right now, e.g. because it's at its peer limit.
+    static auto constexpr FullSwarmRescanSecs = time_t{ 5 };
 
     explicit tr_peerMgr(tr_session* session_in)
         : session{ session_in }
         , handshake_mediator_{ *session }
         , bandwidth_timer_{ session->timerMaker().create([this]() { bandwidthPulse(); }) }
+        , allocate_timer_{ session->timerMaker().create([this]() { allocatePulse(); }) }
         , rechoke_timer_{ session->timerMaker().create([this]() { rechokePulseMarshall(); }) }
         , refill_upkeep_timer_{ session->timerMaker().create([this]() { refillUpkeep(); }) }
+        , pool_upkeep_timer_{ session->timerMaker().create([this]() { poolUpkeep(); }) }
         , blocklist_tag_{ session->blocklist_changed_.observe([this]() { on_blocklist_changed(); }) }
     {
         bandwidth_timer_->start_repeating(BandwidthTimerPeriod);
+        allocate_timer_->start_single_shot(allocate_period_);
         rechoke_timer_->start_repeating(RechokePeriod);
         refill_upkeep_timer_->start_repeating(RefillUpkeepPeriod);
+        pool_upkeep_timer_->start_repeating(PoolUpkeepPeriod);
     }
 
     tr_peerMgr(tr_peerMgr&&) = delete;
@@ -839,17 +1511,32 @@ public:
         incoming_handshakes.clear();
     }
 
-    void rechokeSoon() noexcept
+    // Rechoke one swarm soon instead of waiting for the next full pass,
+    // e.g. because the torrent just started or an upload slot opened up.
+    void rechokeSoon(tr_torrent_id_t tor_id)
     {
-        rechoke_timer_->set_interval(100ms);
+        rechoke_soon_.insert(tor_id);
+        rechoke_timer_->set_interval(RechokeSoonPeriod);
     }
 
     void bandwidthPulse();
-    void rechokePulse() const;
+    void allocatePulse();
+    void rechokePulse();
     void reconnectPulse();
     void refillUpkeep() const;
+    void poolUpkeep() const;
     void make_new_peer_connections();
 
+    void on_candidates_changed(tr_torrent_id_t tor_id)
+    {
+        outbound_candidates_.schedule_rescan(tor_id, 0);
+    }
+
+    void forget_candidates(tr_torrent_id_t tor_id)
+    {
+        outbound_candidates_.forget(tor_id);
+    }
+
     [[nodiscard]] tr_swarm* get_existing_swarm(tr_sha1_digest_t const& hash) const
     {
         auto* const tor = session->torrents().get(hash);
@@ -859,36 +1546,41 @@ public:
     tr_session* const session;
     Handshakes incoming_handshakes;
 
+    // connected peers in every swarm, kept current as they come and go
+    size_t peer_count = 0U;
+
     HandshakeMediator handshake_mediator_;
 
 private:
     void rechokePulseMarshall()
     {
         rechokePulse();
-        rechoke_timer_->set_interval(RechokePeriod);
+
+        auto const since_full_rechoke = std::chrono::milliseconds(tr_time_msec() - last_full_rechoke_msec_);
+        auto const until_full_rechoke = std::chrono::milliseconds{ RechokePeriod } - since_full_rechoke;
+        rechoke_timer_->set_interval(std::max(RechokeSoonPeriod, until_full_rechoke));
     }
 
-    void on_blocklist_changed() const
+    static void on_blocklist_changed()
     {
         /* we cache whether or not a peer is blocklisted...
            since the blocklist has changed, erase that cached value */
-        for (auto* const tor : session->torrents())
-        {
-            for (auto& pool : { std::ref(tor->swarm->connectable_pool), std::ref(tor->swarm->incoming_pool) })
-            {
-                for (auto& [socket_address, atom] : pool.get())
-                {
-                    atom.set_blocklisted_dirty();
-                }
-            }
-        }
+        tr_peer_addresses::clear_blocklisted();
     }
 
-    OutboundCandidates outbound_candidates_;
+    OutboundCandidateIndex outbound_candidates_;
+
+    // swarms waiting to be rechoked before the next full pass
+    std::set<tr_torrent_id_t> rechoke_soon_;
+    uint64_t last_full_rechoke_msec_ = 0U;
+
+    std::chrono::milliseconds allocate_period_ = MaxAllocatePeriod;
 
     std::unique_ptr<libtransmission::Timer> const bandwidth_timer_;
+    std::unique_ptr<libtransmission::Timer> const allocate_timer_;
     std::unique_ptr<libtransmission::Timer> const rechoke_timer_;
     std::unique_ptr<libtransmission::Timer> const refill_upkeep_timer_;
+    std::unique_ptr<libtransmission::Timer> const pool_upkeep_timer_;
 
     libtransmission::ObserverTag const blocklist_tag_;
 };
@@ -922,6 +1614,27 @@ void tr_peerMgrFree(tr_peerMgr* manager)
     delete manager;
 }
 
+namespace
+{
+void count_peer(tr_peerMgr* manager, bool added)
+{
+    if (added)
+    {
+        ++manager->peer_count;
+    }
+    else
+    {
+        TR_ASSERT(manager->peer_count > 0U);
+        --manager->peer_count;
+    }
+}
+} // namespace
+
+size_t tr_peerMgrPeerCount(tr_peerMgr const* manager)
+{
+    return manager->peer_count;
+}
+
 // ---
 
 /**
@@ -946,106 +1659,189 @@ void tr_peerMgrClientSentRequests(tr_torrent* torrent, tr_peer* peer, tr_block_s
 {
     auto const now = tr_time();
 
+    auto& active_requests = torrent->swarm->active_requests;
+    auto& metrics = tr_metrics::instance();
     for (tr_block_index_t block = span.begin; block < span.end; ++block)
     {
-        torrent->swarm->active_requests.add(block, peer, now);
+        if (active_requests.count(block) != 0U)
+        {
+            metrics.duplicate_block_requests.add();
+        }
+
+        active_requests.add(block, peer, now);
     }
 }
 
 std::vector<tr_block_span_t> tr_peerMgrGetNextRequests(tr_torrent* torrent, tr_peer const* peer, size_t numwant)
 {
-    class MediatorImpl final : public Wishlist::Mediator
-    {
-    public:
-        MediatorImpl(tr_torrent const* torrent_in, tr_peer const* peer_in)
-            : torrent_{ torrent_in }
-            , swarm_{ torrent_in->swarm }
-            , peer_{ peer_in }
-        {
-        }
+    auto* const swarm = torrent->swarm;
+    swarm->updateEndgame();
 
-        MediatorImpl(MediatorImpl&&) = delete;
-        MediatorImpl(MediatorImpl const&) = delete;
-        MediatorImpl& operator=(MediatorImpl&&) = delete;
-        MediatorImpl& operator=(MediatorImpl const&) = delete;
+    // a peer is fast enough for duplicate requests if it's at least as fast as the average peer
+    auto const now = tr_time_msec();
+    auto const n_peers = std::max(swarm->peerCount(), size_t{ 1U });
+    auto const average_speed = torrent->bandwidth_.get_piece_speed_bytes_per_second(now, TR_DOWN) / n_peers;
+    auto const is_fast_peer = peer->get_piece_speed_bytes_per_second(now, TR_PEER_TO_CLIENT) >= average_speed;
+
+    return swarm->wishlist.next(
+        numwant,
+        [peer](tr_piece_index_t piece) { return peer->hasPiece(piece); },
+        [swarm, peer](tr_block_index_t block) { return swarm->active_requests.has(block, peer); },
+        is_fast_peer);
+}
 
-        ~MediatorImpl() override = default;
+// --- Piece List Manipulation / Accessors
 
-        [[nodiscard]] bool clientCanRequestBlock(tr_block_index_t block) const override
-        {
-            return !torrent_->has_block(block) && !swarm_->active_requests.has(block, peer_);
-        }
+bool tr_peerMgrDidPeerRequest(tr_torrent const* tor, tr_peer const* peer, tr_block_index_t block)
+{
+    return tor->swarm->active_requests.has(block, peer);
+}
 
-        [[nodiscard]] bool clientCanRequestPiece(tr_piece_index_t piece) const override
-        {
-            return torrent_->piece_is_wanted(piece) && peer_->hasPiece(piece);
-        }
+size_t tr_peerMgrCountActiveRequestsToPeer(tr_torrent const* tor, tr_peer const* peer)
+{
+    return tor->swarm->active_requests.count(peer);
+}
 
-        [[nodiscard]] bool isEndgame() const override
-        {
-            return swarm_->isEndgame();
-        }
+size_t tr_peerMgrCountPeersWithPiece(tr_torrent const* tor, tr_piece_index_t piece)
+{
+    return tor->swarm->piece_availability(piece);
+}
 
-        [[nodiscard]] size_t countActiveRequests(tr_block_index_t block) const override
-        {
-            return swarm_->active_requests.count(block);
-        }
+std::optional<tr_piece_index_t> tr_peerMgrGetSuperSeedPiece(tr_torrent const* tor, tr_peer const* peer)
+{
+    auto const* const swarm = tor->swarm;
+    auto const n_pieces = tor->piece_count();
+    if (n_pieces == 0U)
+    {
+        return {};
+    }
 
-        [[nodiscard]] size_t countMissingBlocks(tr_piece_index_t piece) const override
+    // pieces that are already on offer will have another copy soon
+    auto n_offers = std::unordered_map<tr_piece_index_t, size_t>{};
+    for (auto const* const other : swarm->peers)
+    {
+        if (auto const offer = other->super_seed_offer(); other != peer && offer)
         {
-            return torrent_->count_missing_blocks_in_piece(piece);
+            ++n_offers[*offer];
         }
+    }
 
-        [[nodiscard]] tr_block_span_t blockSpan(tr_piece_index_t piece) const override
-        {
-            return torrent_->block_span_for_piece(piece);
-        }
+    auto const n_offered = [&n_offers](tr_piece_index_t piece)
+    {
+        auto const iter = n_offers.find(piece);
+        return iter != std::end(n_offers) ? iter->second : size_t{};
+    };
 
-        [[nodiscard]] tr_piece_index_t countAllPieces() const override
+    // start at a random piece so that ties don't all go to the same piece
+    auto best = std::optional<tr_piece_index_t>{};
+    auto best_score = std::numeric_limits<size_t>::max();
+    auto const offset = tr_rand_int(n_pieces);
+    for (tr_piece_index_t i = 0; i < n_pieces && best_score != 0U; ++i)
+    {
+        auto const piece = (offset + i) % n_pieces;
+        if (peer->hasPiece(piece))
         {
-            return torrent_->piece_count();
+            continue;
         }
 
-        [[nodiscard]] tr_priority_t priority(tr_piece_index_t piece) const override
+        if (auto const score = swarm->piece_availability(piece) + n_offered(piece); score < best_score)
         {
-            return torrent_->piece_priority(piece);
+            best = piece;
+            best_score = score;
         }
+    }
 
-        [[nodiscard]] bool isSequentialDownload() const override
-        {
-            return torrent_->is_sequential_download();
-        }
+    return best;
+}
 
-    private:
-        tr_torrent const* const torrent_;
-        tr_swarm const* const swarm_;
-        tr_peer const* const peer_;
-    };
+size_t tr_peerMgrBufferBytes(tr_peerMgr const* manager)
+{
+    auto const lock = manager->unique_lock();
+
+    auto n_bytes = size_t{};
+    for (auto const* const tor : manager->session->torrents())
+    {
+        n_bytes += tr_peerMgrBufferBytes(tor);
+    }
 
-    torrent->swarm->updateEndgame();
-    auto const mediator = MediatorImpl{ torrent, peer };
-    return Wishlist{ mediator }.next(numwant);
+    return n_bytes;
 }
 
-// --- Piece List Manipulation / Accessors
+size_t tr_peerMgrBufferBytes(tr_torrent const* tor)
+{
+    auto n_bytes = size_t{};
+    for (auto const* const peer : tor->swarm->peers)
+    {
+        n_bytes += peer->buffer_bytes();
+    }
 
-bool tr_peerMgrDidPeerRequest(tr_torrent const* tor, tr_peer const* peer, tr_block_index_t block)
+    return n_bytes;
+}
+
+void tr_peerMgrReleaseBuffers(tr_peerMgr* manager)
 {
-    return tor->swarm->active_requests.has(block, peer);
+    auto const lock = manager->unique_lock();
+
+    for (auto const* const tor : manager->session->torrents())
+    {
+        for (auto* const peer : tor->swarm->peers)
+        {
+            peer->release_buffers();
+        }
+    }
 }
 
-size_t tr_peerMgrCountActiveRequestsToPeer(tr_torrent const* tor, tr_peer const* peer)
+size_t tr_peerMgrHibernateIdleSeeds(tr_peerMgr* manager)
 {
-    return tor->swarm->active_requests.count(peer);
+    auto const lock = manager->unique_lock();
+
+    auto n_hibernated = size_t{};
+    for (auto* const tor : manager->session->torrents())
+    {
+        n_hibernated += tor->swarm->hibernate_if_idle() ? 1U : 0U;
+    }
+
+    return n_hibernated;
 }
 
 void tr_peerMgr::refillUpkeep() const
 {
     auto const lock = unique_lock();
 
+    auto const now = tr_time();
+
     for (auto* const tor : session->torrents())
     {
         tor->swarm->cancelOldRequests();
+        tor->swarm->update_hibernation(now);
+    }
+}
+
+// Keep the connectable pools from growing without bound: a long-running
+// public torrent hears of far more peers than it will ever connect to.
+void tr_peerMgr::poolUpkeep() const
+{
+    auto const lock = unique_lock();
+
+    auto const now = tr_time();
+    auto const per_torrent_limit = session->peerPoolLimitPerTorrent();
+    auto const max_per_torrent = per_torrent_limit != 0U ? per_torrent_limit : std::numeric_limits<size_t>::max();
+
+    auto n_known = size_t{};
+    for (auto* const tor : session->torrents())
+    {
+        tor->swarm->prune_connectable_pool(max_per_torrent, now);
+        n_known += std::size(tor->swarm->connectable_pool);
+    }
+
+    // if we're over the session-wide limit, every swarm gives up the same share
+    if (auto const global_limit = session->peerPoolLimitGlobal(); global_limit != 0U && n_known > global_limit)
+    {
+        for (auto* const tor : session->torrents())
+        {
+            auto const n = uint64_t{ std::size(tor->swarm->connectable_pool) };
+            tor->swarm->prune_connectable_pool(static_cast<size_t>(n * global_limit / n_known), now);
+        }
     }
 }
 
@@ -1061,18 +1857,30 @@ void create_bit_torrent_peer(tr_torrent* tor, std::shared_ptr<tr_peerIo> io, tr_
 
     tr_swarm* swarm = tor->swarm;
 
+    // rebuild the state that a hibernating swarm freed before the peer uses it
+    swarm->wake();
+
     auto* peer = tr_peerMsgsNew(tor, peer_info, std::move(io), client, &tr_swarm::peer_callback_bt, swarm);
 
     swarm->peers.push_back(peer);
 
     ++swarm->stats.peer_count;
     ++swarm->stats.peer_from_count[peer_info->from_first()];
+    count_peer(swarm->manager, true);
 
     TR_ASSERT(swarm->stats.peer_count == swarm->peerCount());
     TR_ASSERT(swarm->stats.peer_from_count[peer_info->from_first()] <= swarm->stats.peer_count);
 }
 
 /* FIXME: this is kind of a mess. */
+// Half-open incoming connections may hold at most this share of the
+// peer limit, so that a flash crowd can't crowd out established peers.
+[[nodiscard]] size_t max_incoming_handshakes(tr_session const* session) noexcept
+{
+    static auto constexpr MinIncomingHandshakes = size_t{ 16U };
+    return std::max(size_t{ session->peerLimit() } / 4U, MinIncomingHandshakes);
+}
+
 [[nodiscard]] bool on_handshake_done(tr_peerMgr* const manager, tr_handshake::Result const& result)
 {
     TR_ASSERT(result.io != nullptr);
@@ -1090,6 +1898,7 @@ void create_bit_torrent_peer(tr_torrent* tor, std::shared_ptr<tr_peerIo> io, tr_
     else if (s != nullptr)
     {
         s->outgoing_handshakes.erase(socket_address);
+        s->mark_candidates_dirty();
     }
 
     auto const lock = manager->unique_lock();
@@ -1146,16 +1955,8 @@ void create_bit_torrent_peer(tr_torrent* tor, std::shared_ptr<tr_peerIo> io, tr_
         }
         else
         {
-            auto client = tr_interned_string{};
-            if (result.peer_id)
-            {
-                auto buf = std::array<char, 128>{};
-                tr_clientForId(std::data(buf), sizeof(buf), *result.peer_id);
-                client = tr_interned_string{ tr_quark_new(std::data(buf)) };
-            }
-
             result.io->set_bandwidth(&s->tor->bandwidth_);
-            create_bit_torrent_peer(s->tor, result.io, &info, client);
+            create_bit_torrent_peer(s->tor, result.io, &info, result.client_name);
 
             return true;
         }
@@ -1175,46 +1976,95 @@ void tr_peerMgrAddIncoming(tr_peerMgr* manager, tr_peer_socket&& socket)
 
     tr_session* session = manager->session;
 
+    // Refuse what we can before allocating a peer io or any handshake state,
+    // so that a flood of connections costs as little as possible.
+    auto& metrics = tr_metrics::instance();
     if (session->addressIsBlocked(socket.address()))
     {
         tr_logAddTrace(fmt::format("Banned IP address '{}' tried to connect to us", socket.display_name()));
+        metrics.incoming_handshakes_refused.add();
         socket.close();
     }
     else if (manager->incoming_handshakes.count(socket.socket_address()) != 0U)
     {
+        metrics.incoming_handshakes_refused.add();
+        socket.close();
+    }
+    else if (std::size(manager->incoming_handshakes) >= max_incoming_handshakes(session))
+    {
+        tr_logAddTrace(fmt::format("Too many incoming handshakes; refusing '{}'", socket.display_name()));
+        metrics.incoming_handshakes_refused.add();
+        socket.close();
+    }
+    else if (session->memory_budget().is_refusing_peers())
+    {
+        tr_logAddTrace(fmt::format("Short of memory; refusing '{}'", socket.display_name()));
+        metrics.incoming_handshakes_refused.add();
         socket.close();
     }
     else /* we don't have a connection to them yet... */
     {
+        metrics.incoming_handshakes_accepted.add();
         auto socket_address = socket.socket_address();
         manager->incoming_handshakes.try_emplace(
             socket_address,
             &manager->handshake_mediator_,
             tr_peerIo::new_incoming(session, &session->top_bandwidth_, std::move(socket)),
-            session->encryptionMode(),
+            session->encryptionMode(socket_address.address()),
             [manager](tr_handshake::Result const& result) { return on_handshake_done(manager, result); });
     }
 }
 
 size_t tr_peerMgrAddPex(tr_torrent* tor, tr_peer_from from, tr_pex const* pex, size_t n_pex)
 {
-    size_t n_used = 0;
+    // we store peers that are supposedly connectable (socket address should be the peer's listening address).
+    // don't care about non-connectable peers that we are not connected to
+    if (from == TR_PEER_FROM_INCOMING)
+    {
+        return 0U;
+    }
+
+    auto peers = std::vector<tr_pex>{};
+    peers.reserve(n_pex);
+    std::copy_if(
+        pex,
+        pex + n_pex,
+        std::back_inserter(peers),
+        [from](tr_pex const& peer)
+        {
+            return tr_isPex(&peer) && /* safeguard against corrupt data */
+                peer.is_valid_for_peers() && (from != TR_PEER_FROM_PEX || (peer.flags & ADDED_F_CONNECTABLE) != 0);
+        });
+
+    // drop duplicates, keeping the last copy of each since its flags are the newest
+    std::stable_sort(std::begin(peers), std::end(peers));
+    peers.erase(std::begin(peers), std::unique(std::rbegin(peers), std::rend(peers)).base());
+
     tr_swarm* s = tor->swarm;
     auto const lock = s->manager->unique_lock();
 
-    for (tr_pex const* const end = pex + n_pex; pex != end; ++pex)
+    // check the whole batch against the blocklist at once
+    auto addrs = std::vector<tr_address>{};
+    addrs.reserve(std::size(peers));
+    std::transform(
+        std::begin(peers),
+        std::end(peers),
+        std::back_inserter(addrs),
+        [](tr_pex const& peer) { return peer.addr; });
+    auto const blocked = std::make_unique<bool[]>(std::size(addrs));
+    s->manager->session->addressesAreBlocked(std::data(addrs), std::size(addrs), blocked.get());
+
+    auto n_used = size_t{};
+    for (size_t i = 0U, n = std::size(peers); i < n; ++i)
     {
-        if (tr_isPex(pex) && /* safeguard against corrupt data */
-            !s->manager->session->addressIsBlocked(pex->addr) && pex->is_valid_for_peers() && from != TR_PEER_FROM_INCOMING &&
-            (from != TR_PEER_FROM_PEX || (pex->flags & ADDED_F_CONNECTABLE) != 0))
+        if (!blocked[i])
         {
-            // we store this peer since it is supposedly connectable (socket address should be the peer's listening address)
-            // don't care about non-connectable peers that we are not connected to
-            s->ensure_info_exists({ pex->addr, pex->port }, pex->flags, from, true);
-            ++n_used;
+            peers[n_used++] = peers[i];
         }
     }
+    peers.resize(n_used);
 
+    s->ensure_infos_exist(peers, from);
     return n_used;
 }
 
@@ -1355,25 +2205,83 @@ std::vector<tr_pex> tr_peerMgrGetPeers(tr_torrent const* tor, uint8_t address_ty
     {
         auto const& [addr, port] = info->listen_socket_address();
 
-        TR_ASSERT(addr.is_valid());
-        TR_ASSERT(addr.type == address_type);
-        pex.emplace_back(addr, port, info->pex_flags());
+        TR_ASSERT(addr.is_valid());
+        TR_ASSERT(addr.type == address_type);
+        pex.emplace_back(addr, port, info->pex_flags());
+    }
+
+    std::sort(std::begin(pex), std::end(pex));
+    return pex;
+}
+
+std::shared_ptr<tr_pex_snapshot> tr_peerMgrGetPexSnapshot(
+    tr_torrent const* tor,
+    size_t max_peer_count,
+    std::chrono::seconds max_age)
+{
+    TR_ASSERT(tr_isTorrent(tor));
+    auto const lock = tor->unique_lock();
+
+    auto* const s = tor->swarm;
+    auto const now = tr_time();
+    if (s->pex_snapshot && now - s->pex_snapshot_at < max_age.count())
+    {
+        return s->pex_snapshot;
+    }
+
+    auto snapshot = std::make_shared<tr_pex_snapshot>();
+    if (auto const& prev = s->pex_snapshot; prev)
+    {
+        // copied rather than moved: connections that were sent `prev`
+        // still need its peers to diff against
+        snapshot->generation = prev->generation + 1U;
+        snapshot->previous_peers = prev->peers;
+    }
+
+    for (uint8_t i = 0; i < NUM_TR_AF_INET_TYPES; ++i)
+    {
+        snapshot->peers[i] = tr_peerMgrGetPeers(tor, i, TR_PEERS_CONNECTED, max_peer_count);
     }
 
-    std::sort(std::begin(pex), std::end(pex));
-    return pex;
+    s->pex_snapshot = snapshot;
+    s->pex_snapshot_at = now;
+    return snapshot;
+}
+
+tr_ltep_handshake_cache& tr_peerMgrLtepHandshakeCache(tr_torrent const* tor)
+{
+    TR_ASSERT(tr_isTorrent(tor));
+    return tor->swarm->ltep_handshake;
 }
 
 void tr_swarm::on_torrent_started()
 {
     auto const lock = tor->unique_lock();
     is_running = true;
-    manager->rechokeSoon();
+
+    // the torrent may have been verified while it was stopped
+    wishlist.invalidate();
+    wanted_missing_.reset();
+
+    mark_candidates_dirty();
+
+    rechoke_soon();
 }
 
 void tr_swarm::on_torrent_stopped()
 {
     stop();
+    manager->forget_candidates(tor->id());
+}
+
+void tr_swarm::mark_candidates_dirty()
+{
+    manager->on_candidates_changed(tor->id());
+}
+
+void tr_swarm::rechoke_soon()
+{
+    manager->rechokeSoon(tor->id());
 }
 
 void tr_peerMgrAddTorrent(tr_peerMgr* manager, tr_torrent* tor)
@@ -1524,7 +2432,9 @@ namespace peer_stat_helpers
     stats.cancelsToClient = peer->cancels_sent_to_client.count(now, CancelHistorySec);
 
     stats.activeReqsToPeer = peer->activeReqCount(TR_CLIENT_TO_PEER);
+    stats.desiredReqsToPeer = peer->request_queue_length();
     stats.activeReqsToClient = peer->activeReqCount(TR_PEER_TO_CLIENT);
+    stats.bufferBytes = peer->buffer_bytes();
 
     char* pch = stats.flagStr;
 
@@ -1593,6 +2503,31 @@ namespace peer_stat_helpers
 } // namespace peer_stat_helpers
 } // namespace
 
+std::vector<tr_peer_stat> const& tr_peerMgrPeerStatsSnapshot(tr_torrent const* tor)
+{
+    using namespace peer_stat_helpers;
+
+    TR_ASSERT(tr_isTorrent(tor));
+    TR_ASSERT(tor->swarm->manager != nullptr);
+
+    auto* const swarm = tor->swarm;
+    auto const& peers = swarm->peers;
+    auto const now = tr_time();
+    if (swarm->peer_stats_at != now || std::size(swarm->peer_stats) != std::size(peers))
+    {
+        auto const now_msec = tr_time_msec();
+        swarm->peer_stats.resize(std::size(peers));
+        std::transform(
+            std::begin(peers),
+            std::end(peers),
+            std::begin(swarm->peer_stats),
+            [&now, &now_msec](auto const* peer) { return get_peer_stats(peer, now, now_msec); });
+        swarm->peer_stats_at = now;
+    }
+
+    return swarm->peer_stats;
+}
+
 tr_peer_stat* tr_peerMgrPeerStats(tr_torrent const* tor, size_t* setme_count)
 {
     using namespace peer_stat_helpers;
@@ -1600,6 +2535,7 @@ tr_peer_stat* tr_peerMgrPeerStats(tr_torrent const* tor, size_t* setme_count)
     TR_ASSERT(tr_isTorrent(tor));
     TR_ASSERT(tor->swarm->manager != nullptr);
 
+    // not the cached snapshot: this is public API that may be called from any thread
     auto const peers = tor->swarm->peers;
     auto const n = std::size(peers);
     auto* const ret = new tr_peer_stat[n];
@@ -1623,7 +2559,7 @@ namespace update_interest_helpers
 /* does this peer have any pieces that we want? */
 [[nodiscard]] bool isPeerInteresting(
     tr_torrent const* const tor,
-    std::vector<bool> const& piece_is_interesting,
+    tr_bitfield const& wanted_missing_pieces,
     tr_peerMsgs const* const peer)
 {
     /* these cases should have already been handled by the calling code... */
@@ -1635,15 +2571,7 @@ namespace update_interest_helpers
         return true;
     }
 
-    for (tr_piece_index_t i = 0; i < tor->piece_count(); ++i)
-    {
-        if (piece_is_interesting[i] && peer->hasPiece(i))
-        {
-            return true;
-        }
-    }
-
-    return false;
+    return wanted_missing_pieces.intersects(peer->has());
 }
 
 // determine which peers to show interest in
@@ -1658,18 +2586,11 @@ void updateInterest(tr_swarm* swarm)
 
     if (auto const& peers = swarm->peers; !std::empty(peers))
     {
-        int const n = tor->piece_count();
-
-        // build a bitfield of interesting pieces...
-        auto piece_is_interesting = std::vector<bool>(n);
-        for (int i = 0; i < n; ++i)
-        {
-            piece_is_interesting[i] = tor->piece_is_wanted(i) && !tor->has_piece(i);
-        }
+        auto const& wanted_missing_pieces = swarm->wanted_missing_pieces();
 
         for (auto* const peer : peers)
         {
-            peer->set_interested(isPeerInteresting(tor, piece_is_interesting, peer));
+            peer->set_interested(isPeerInteresting(tor, wanted_missing_pieces, peer));
         }
     }
 }
@@ -1682,72 +2603,131 @@ namespace
 {
 namespace rechoke_uploads_helpers
 {
-struct ChokeData
+/* get a rate for deciding which peers to choke and unchoke. */
+[[nodiscard]] auto getRateBps(tr_torrent const* tor, tr_peer const* peer, uint64_t now)
 {
-    ChokeData(tr_peerMsgs* msgs_in, int rate_in, uint8_t salt_in, bool is_interested_in, bool was_choked_in, bool is_choked_in)
-        : msgs{ msgs_in }
-        , rate{ rate_in }
-        , salt{ salt_in }
-        , is_interested{ is_interested_in }
-        , was_choked{ was_choked_in }
-        , is_choked{ is_choked_in }
+    if (tor->is_done())
+    {
+        return peer->get_piece_speed_bytes_per_second(now, TR_CLIENT_TO_PEER);
+    }
+
+    /* downloading a private torrent... take upload speed into account
+     * because there may only be a small window of opportunity to share */
+    if (tor->is_private())
     {
+        return peer->get_piece_speed_bytes_per_second(now, TR_PEER_TO_CLIENT) +
+            peer->get_piece_speed_bytes_per_second(now, TR_CLIENT_TO_PEER);
     }
 
-    tr_peerMsgs* msgs;
-    int rate;
-    uint8_t salt;
-    bool is_interested;
-    bool was_choked;
-    bool is_choked;
+    /* downloading a public torrent */
+    return peer->get_piece_speed_bytes_per_second(now, TR_PEER_TO_CLIENT);
+}
+
+// an optimistically unchoked peer is immune from rechoking
+// for this many calls to rechokeUploads().
+auto constexpr OptimisticUnchokeMultiplier = uint8_t{ 4 };
+
+// Upload slots are a session-wide resource. Rather than giving each swarm
+// the same fixed number, hand them out one at a time to whichever swarm
+// gets the most out of its next slot.
+class UploadSlotAllocator
+{
+public:
+    struct Demand
+    {
+        size_t n_interested = 0U; // peers that want to download from us
+        size_t n_seeds = 0U; // peers that could serve them instead of us
+        tr_bytes_per_second_t upload_bps = 0U;
+    };
+
+    // Roughly the upload speed that makes a slot worthwhile.
+    // Used to size the budget when the upload speed is limited.
+    static auto constexpr SlotBps = tr_bytes_per_second_t{ 4096U };
 
-    [[nodiscard]] constexpr auto compare(ChokeData const& that) const noexcept // <=>
+    [[nodiscard]] static size_t budget(
+        size_t n_demanding_swarms,
+        size_t slots_per_torrent,
+        std::optional<tr_bytes_per_second_t> upload_limit_bps)
     {
-        // prefer higher overall speeds
-        if (auto const val = tr_compare_3way(this->rate, that.rate); val != 0)
+        auto const n_slots = n_demanding_swarms * slots_per_torrent;
+
+        if (!upload_limit_bps)
         {
-            return -val;
+            return n_slots;
+        }
+
+        return std::min(n_slots, std::max(slots_per_torrent, *upload_limit_bps / SlotBps));
+    }
+
+    [[nodiscard]] static std::vector<size_t> allocate(std::vector<Demand> const& demands, size_t budget)
+    {
+        auto slots = std::vector<size_t>(std::size(demands));
+
+        auto queue = std::priority_queue<std::pair<double, size_t>>{};
+        for (size_t idx = 0U, n = std::size(demands); idx < n; ++idx)
+        {
+            if (demands[idx].n_interested > 0U)
+            {
+                queue.emplace(utility(demands[idx], 0U), idx);
+            }
         }
 
-        if (this->was_choked != that.was_choked) // prefer unchoked
+        while (budget > 0U && !std::empty(queue))
         {
-            return this->was_choked ? 1 : -1;
+            auto const idx = queue.top().second;
+            queue.pop();
+            --budget;
+
+            // no point in more slots than there are peers to fill them
+            if (++slots[idx] < demands[idx].n_interested)
+            {
+                queue.emplace(utility(demands[idx], slots[idx]), idx);
+            }
         }
 
-        return tr_compare_3way(this->salt, that.salt);
+        return slots;
     }
 
-    [[nodiscard]] constexpr auto operator<(ChokeData const& that) const noexcept
+private:
+    // The value of giving a swarm its next slot. Swarms where we're one of
+    // few sources, and swarms that are already moving data, come first.
+    // Each additional slot in the same swarm is worth less than the last.
+    [[nodiscard]] static double utility(Demand const& demand, size_t n_assigned)
     {
-        return compare(that) < 0;
+        auto const scarcity = static_cast<double>(demand.n_interested) / (1.0 + static_cast<double>(demand.n_seeds));
+        auto const throughput = 1.0 + static_cast<double>(demand.upload_bps) / SlotBps;
+        return scarcity * throughput / static_cast<double>(n_assigned + 1U);
     }
 };
 
-/* get a rate for deciding which peers to choke and unchoke. */
-[[nodiscard]] auto getRateBps(tr_torrent const* tor, tr_peer const* peer, uint64_t now)
+[[nodiscard]] UploadSlotAllocator::Demand getUploadDemand(tr_swarm* s, uint64_t const now)
 {
-    if (tor->is_done())
+    auto const lock = s->unique_lock();
+
+    auto demand = UploadSlotAllocator::Demand{};
+
+    if (!s->tor->client_can_upload())
     {
-        return peer->get_piece_speed_bytes_per_second(now, TR_CLIENT_TO_PEER);
+        return demand;
     }
 
-    /* downloading a private torrent... take upload speed into account
-     * because there may only be a small window of opportunity to share */
-    if (tor->is_private())
+    for (auto const* const peer : s->peers)
     {
-        return peer->get_piece_speed_bytes_per_second(now, TR_PEER_TO_CLIENT) +
-            peer->get_piece_speed_bytes_per_second(now, TR_CLIENT_TO_PEER);
+        if (peer->isSeed())
+        {
+            ++demand.n_seeds;
+        }
+        else if (peer->peer_is_interested())
+        {
+            ++demand.n_interested;
+        }
     }
 
-    /* downloading a public torrent */
-    return peer->get_piece_speed_bytes_per_second(now, TR_PEER_TO_CLIENT);
+    demand.upload_bps = s->tor->bandwidth_.get_piece_speed_bytes_per_second(now, TR_UP);
+    return demand;
 }
 
-// an optimistically unchoked peer is immune from rechoking
-// for this many calls to rechokeUploads().
-auto constexpr OptimisticUnchokeMultiplier = uint8_t{ 4 };
-
-void rechokeUploads(tr_swarm* s, uint64_t const now)
+void rechokeUploads(tr_swarm* s, size_t const slots, uint64_t const now)
 {
     auto const lock = s->unique_lock();
 
@@ -1755,7 +2735,6 @@ void rechokeUploads(tr_swarm* s, uint64_t const now)
     auto const peer_count = std::size(peers);
     auto choked = std::vector<ChokeData>{};
     choked.reserve(peer_count);
-    auto const* const session = s->manager->session;
     bool const choke_all = !s->tor->client_can_upload();
     bool const is_maxed_out = s->tor->bandwidth_.is_maxed_out(TR_UP, now);
 
@@ -1796,63 +2775,11 @@ void rechokeUploads(tr_swarm* s, uint64_t const now)
         }
     }
 
-    std::sort(std::begin(choked), std::end(choked));
-
-    /**
-     * Reciprocation and number of uploads capping is managed by unchoking
-     * the N peers which have the best upload rate and are interested.
-     * This maximizes the client's download rate. These N peers are
-     * referred to as downloaders, because they are interested in downloading
-     * from the client.
-     *
-     * Peers which have a better upload rate (as compared to the downloaders)
-     * but aren't interested get unchoked. If they become interested, the
-     * downloader with the worst upload rate gets choked. If a client has
-     * a complete file, it uses its upload rate rather than its download
-     * rate to decide which peers to unchoke.
-     *
-     * If our bandwidth is maxed out, don't unchoke any more peers.
-     */
-    auto checked_choke_count = size_t{ 0U };
-    auto unchoked_interested = size_t{ 0U };
-
-    for (auto& item : choked)
-    {
-        if (unchoked_interested >= session->uploadSlotsPerTorrent())
-        {
-            break;
-        }
-
-        item.is_choked = is_maxed_out ? item.was_choked : false;
-
-        ++checked_choke_count;
-
-        if (item.is_interested)
-        {
-            ++unchoked_interested;
-        }
-    }
-
-    /* optimistic unchoke */
-    if (s->optimistic == nullptr && !is_maxed_out && checked_choke_count < std::size(choked))
+    if (auto const* const optimistic = rechoke_candidates(choked, slots, is_maxed_out, s->optimistic == nullptr);
+        optimistic != nullptr)
     {
-        auto rand_pool = std::vector<ChokeData*>{};
-
-        for (auto i = checked_choke_count, n = std::size(choked); i < n; ++i)
-        {
-            if (choked[i].is_interested)
-            {
-                rand_pool.push_back(&choked[i]);
-            }
-        }
-
-        if (auto const n = std::size(rand_pool); n != 0)
-        {
-            auto* c = rand_pool[tr_rand_int(n)];
-            c->is_choked = false;
-            s->optimistic = c->msgs;
-            s->optimistic_unchoke_time_scaler = OptimisticUnchokeMultiplier;
-        }
+        s->optimistic = optimistic->msgs;
+        s->optimistic_unchoke_time_scaler = OptimisticUnchokeMultiplier;
     }
 
     for (auto& item : choked)
@@ -1863,7 +2790,7 @@ void rechokeUploads(tr_swarm* s, uint64_t const now)
 } // namespace rechoke_uploads_helpers
 } // namespace
 
-void tr_peerMgr::rechokePulse() const
+void tr_peerMgr::rechokePulse()
 {
     using namespace update_interest_helpers;
     using namespace rechoke_uploads_helpers;
@@ -1871,7 +2798,31 @@ void tr_peerMgr::rechokePulse() const
     auto const lock = unique_lock();
     auto const now = tr_time_msec();
 
-    for (auto* const tor : session->torrents())
+    // Between full passes, only revisit the swarms that asked for it.
+    auto torrents = std::vector<tr_torrent*>{};
+    auto const is_full_pass = now - last_full_rechoke_msec_ >=
+        static_cast<uint64_t>(std::chrono::milliseconds{ RechokePeriod }.count());
+    if (is_full_pass)
+    {
+        torrents.assign(std::begin(session->torrents()), std::end(session->torrents()));
+        last_full_rechoke_msec_ = now;
+    }
+    else
+    {
+        torrents.reserve(std::size(rechoke_soon_));
+        for (auto const tor_id : rechoke_soon_)
+        {
+            if (auto* const tor = session->torrents().get(tor_id); tor != nullptr)
+            {
+                torrents.push_back(tor);
+            }
+        }
+    }
+    rechoke_soon_.clear();
+
+    auto swarms = std::vector<tr_swarm*>{};
+    swarms.reserve(std::size(torrents));
+    for (auto* const tor : torrents)
     {
         if (tor->is_running())
         {
@@ -1883,11 +2834,39 @@ void tr_peerMgr::rechokePulse() const
         {
             if (auto* const swarm = tor->swarm; swarm->stats.peer_count > 0)
             {
-                rechokeUploads(swarm, now);
-                updateInterest(swarm);
+                swarms.push_back(swarm);
             }
         }
     }
+
+    auto const slots_per_torrent = session->uploadSlotsPerTorrent();
+
+    if (is_full_pass)
+    {
+        auto demands = std::vector<UploadSlotAllocator::Demand>{};
+        demands.reserve(std::size(swarms));
+        std::transform(
+            std::begin(swarms),
+            std::end(swarms),
+            std::back_inserter(demands),
+            [now](auto* const swarm) { return getUploadDemand(swarm, now); });
+
+        auto const n_demanding = static_cast<size_t>(
+            std::count_if(std::begin(demands), std::end(demands), [](auto const& demand) { return demand.n_interested > 0U; }));
+        auto const budget = UploadSlotAllocator::budget(n_demanding, slots_per_torrent, session->activeSpeedLimitBps(TR_UP));
+        auto const slots = UploadSlotAllocator::allocate(demands, budget);
+
+        for (size_t idx = 0U, n = std::size(swarms); idx < n; ++idx)
+        {
+            swarms[idx]->upload_slots = demands[idx].n_interested > 0U ? std::optional<size_t>{ slots[idx] } : std::nullopt;
+        }
+    }
+
+    for (auto* const swarm : swarms)
+    {
+        rechokeUploads(swarm, swarm->upload_slots.value_or(slots_per_torrent), now);
+        updateInterest(swarm);
+    }
 }
 
 // --- Life and Death
@@ -2121,6 +3100,11 @@ void queuePulse(tr_session* session, tr_direction dir)
     }
 
     auto const n = session->countQueueFreeSlots(dir);
+    if (n == 0U)
+    {
+        return;
+    }
+
     for (auto* tor : session->getNextQueuedTorrents(dir, n))
     {
         tr_torrentStartNow(tor);
@@ -2139,10 +3123,6 @@ void tr_peerMgr::bandwidthPulse()
 
     pumpAllPeers(this);
 
-    // allocate bandwidth to the peers
-    static auto constexpr Msec = std::chrono::duration_cast<std::chrono::milliseconds>(BandwidthTimerPeriod).count();
-    session->top_bandwidth_.allocate(Msec);
-
     // torrent upkeep
     for (auto* const tor : session->torrents())
     {
@@ -2157,6 +3137,30 @@ void tr_peerMgr::bandwidthPulse()
     reconnectPulse();
 }
 
+void tr_peerMgr::allocatePulse()
+{
+    auto const lock = unique_lock();
+
+    auto const n_starved = session->top_bandwidth_.allocate(static_cast<unsigned int>(allocate_period_.count()));
+
+    // If peers ran dry before the next refill, come back sooner so that
+    // they don't sit idle for the rest of the period. Otherwise back off.
+    if (!session->adaptiveBandwidthEnabled())
+    {
+        allocate_period_ = MaxAllocatePeriod;
+    }
+    else if (n_starved > 0U)
+    {
+        allocate_period_ = std::max(MinAllocatePeriod, allocate_period_ / 2);
+    }
+    else
+    {
+        allocate_period_ = std::min(MaxAllocatePeriod, allocate_period_ * 2);
+    }
+
+    allocate_timer_->start_single_shot(allocate_period_);
+}
+
 // ---
 
 bool tr_swarm::peer_is_in_use(tr_peer_info const& peer_info) const
@@ -2211,22 +3215,6 @@ namespace connect_helpers
     return true;
 }
 
-struct peer_candidate
-{
-    peer_candidate() = default;
-
-    peer_candidate(uint64_t score_in, tr_torrent const* const tor_in, tr_peer_info const* const peer_info_in)
-        : score{ score_in }
-        , tor{ tor_in }
-        , peer_info{ peer_info_in }
-    {
-    }
-
-    uint64_t score;
-    tr_torrent const* tor;
-    tr_peer_info const* peer_info;
-};
-
 [[nodiscard]] bool torrentWasRecentlyStarted(tr_torrent const* tor)
 {
     return difftime(tr_time(), tor->startDate) < 120;
@@ -2297,78 +3285,89 @@ struct peer_candidate
     return score;
 }
 
-[[nodiscard]] tr_peerMgr::OutboundCandidates get_peer_candidates(tr_session* session)
+// can this torrent take any more outgoing connections right now?
+[[nodiscard]] bool is_torrent_candidate(tr_torrent const* tor, uint64_t now_msec)
 {
-    auto const now = tr_time();
-    auto const now_msec = tr_time_msec();
+    auto const* const swarm = tor->swarm;
 
-    // leave 5% of connection slots for incoming connections -- ticket #2609
-    if (auto const max_candidates = static_cast<size_t>(session->peerLimit() * 0.95); max_candidates <= tr_peerMsgs::size())
+    if (swarm == nullptr || !swarm->is_running)
     {
-        return {};
+        return false;
     }
 
-    auto candidates = std::vector<peer_candidate>{};
-    candidates.reserve(tr_peer_info::known_connectable_count());
+    /* if everyone in the swarm is seeds and pex is disabled,
+     * then don't initiate connections */
+    bool const seeding = tor->is_done();
+    if (seeding && swarm->is_all_seeds() && !tor->allows_pex())
+    {
+        return false;
+    }
 
-    /* populate the candidate array */
-    auto salter = tr_salt_shaker{};
-    for (auto* const tor : session->torrents())
+    /* if we've already got enough peers in this torrent... */
+    if (tor->peer_limit() <= swarm->peerCount())
     {
-        auto* const swarm = tor->swarm;
+        return false;
+    }
 
-        if (!swarm->is_running)
-        {
-            continue;
-        }
+    /* if we've already got enough speed in this torrent... */
+    if (seeding && tor->bandwidth_.is_maxed_out(TR_UP, now_msec))
+    {
+        return false;
+    }
 
-        /* if everyone in the swarm is seeds and pex is disabled,
-         * then don't initiate connections */
-        bool const seeding = tor->is_done();
-        if (seeding && swarm->is_all_seeds() && !tor->allows_pex())
-        {
-            continue;
-        }
+    return true;
+}
 
-        /* if we've already got enough peers in this torrent... */
-        if (tor->peer_limit() <= swarm->peerCount())
-        {
-            continue;
-        }
+// Rescore a swarm's peers and put its best candidates into the index.
+// @return the number of peers that were looked at
+size_t rescan_candidates(OutboundCandidateIndex& index, tr_torrent const* tor, time_t now, uint64_t now_msec)
+{
+    auto const tor_id = tor->id();
+
+    if (tor->swarm == nullptr || !tor->swarm->is_running)
+    {
+        index.forget(tor_id);
+        return 0U;
+    }
+
+    if (!is_torrent_candidate(tor, now_msec))
+    {
+        index.set_candidates(tor_id, {});
+        index.schedule_rescan(tor_id, now + tr_peerMgr::FullSwarmRescanSecs);
+        return 0U;
+    }
 
-        /* if we've already got enough speed in this torrent... */
-        if (seeding && tor->bandwidth_.is_maxed_out(TR_UP, now_msec))
+    auto const& pool = tor->swarm->connectable_pool;
+    auto scored = std::vector<std::pair<uint64_t, tr_socket_address>>{};
+    auto next_rescan_at = now + tr_peerMgr::CandidateRefreshSecs;
+    auto salter = tr_salt_shaker{};
+    for (auto const& [socket_address, atom] : pool)
+    {
+        if (is_peer_candidate(tor, atom, now))
         {
-            continue;
+            scored.emplace_back(getPeerCandidateScore(tor, atom, salter()), socket_address);
         }
-
-        for (auto const& [socket_address, atom] : swarm->connectable_pool)
+        else if (!atom.reconnect_interval_has_passed(now))
         {
-            if (is_peer_candidate(tor, atom, now))
-            {
-                candidates.emplace_back(getPeerCandidateScore(tor, atom, salter()), tor, &atom);
-            }
+            // check back when it's eligible again
+            next_rescan_at = std::min(next_rescan_at, std::max(atom.reconnect_at(now), now + 1));
         }
     }
 
-    // only keep the best `max` candidates
-    if (auto const max = tr_peerMgr::OutboundCandidates::requested_inline_size; max < std::size(candidates))
+    // only keep the best few
+    if (auto const max = tr_peerMgr::MaxCandidatesPerSwarm; max < std::size(scored))
     {
         std::partial_sort(
-            std::begin(candidates),
-            std::begin(candidates) + max,
-            std::end(candidates),
-            [](auto const& a, auto const& b) { return a.score < b.score; });
-        candidates.resize(max);
+            std::begin(scored),
+            std::begin(scored) + max,
+            std::end(scored),
+            [](auto const& a, auto const& b) { return a.first < b.first; });
+        scored.resize(max);
     }
 
-    // put the best candiates at the end of the list
-    auto ret = tr_peerMgr::OutboundCandidates{};
-    for (auto it = std::crbegin(candidates), end = std::crend(candidates); it != end; ++it)
-    {
-        ret.emplace_back(it->tor->id(), it->peer_info->listen_socket_address());
-    }
-    return ret;
+    index.set_candidates(tor_id, scored);
+    index.schedule_rescan(tor_id, next_rescan_at);
+    return std::size(pool);
 }
 
 void initiate_connection(tr_peerMgr* mgr, tr_swarm* s, tr_peer_info& peer_info)
@@ -2408,7 +3407,7 @@ void initiate_connection(tr_peerMgr* mgr, tr_swarm* s, tr_peer_info& peer_info)
             peer_info.listen_socket_address(),
             &mgr->handshake_mediator_,
             peer_io,
-            session->encryptionMode(),
+            session->encryptionMode(peer_io->address()),
             [mgr](tr_handshake::Result const& result) { return on_handshake_done(mgr, result); });
     }
 
@@ -2423,31 +3422,72 @@ void tr_peerMgr::make_new_peer_connections()
 
     auto const lock = session->unique_lock();
 
-    // get the candidates if we need to
-    auto& candidates = outbound_candidates_;
-    if (std::empty(candidates))
+    // don't take on new peers while memory is short
+    if (session->memory_budget().is_refusing_peers())
+    {
+        return;
+    }
+
+    // leave 5% of connection slots for incoming connections -- ticket #2609
+    if (auto const max_candidates = static_cast<size_t>(session->peerLimit() * 0.95); max_candidates <= tr_peerMsgs::size())
     {
-        candidates = get_peer_candidates(session);
+        return;
     }
 
-    // initiate connections to the last N candidates
-    auto const n_this_pass = std::min(std::size(candidates), MaxConnectionsPerPulse);
-    auto const it_end = std::crbegin(candidates) + n_this_pass;
-    for (auto it = std::crbegin(candidates); it != it_end; ++it)
+    auto const now = tr_time();
+    auto const now_msec = tr_time_msec();
+    auto& index = outbound_candidates_;
+
+    // rescore the swarms that have changed since we last looked
+    for (auto n_scanned = size_t{}; n_scanned < MaxCandidateScansPerPulse;)
     {
-        auto const& [tor_id, sock_addr] = *it;
+        auto const tor_id = index.pop_due_rescan(now);
+        if (!tor_id)
+        {
+            break;
+        }
 
-        if (auto* const tor = session->torrents().get(tor_id); tor != nullptr)
+        if (auto const* const tor = session->torrents().get(*tor_id); tor != nullptr)
         {
-            if (auto* const peer_info = tor->swarm->get_existing_peer_info(sock_addr); peer_info != nullptr)
-            {
-                initiate_connection(this, tor->swarm, *peer_info);
-            }
+            n_scanned += rescan_candidates(index, tor, now, now_msec);
+        }
+        else
+        {
+            index.forget(*tor_id);
         }
     }
 
-    // remove the N candidates that we just consumed
-    candidates.resize(std::size(candidates) - n_this_pass);
+    // initiate connections to the best N candidates
+    for (auto n_attempts = size_t{}; n_attempts < MaxConnectionsPerPulse;)
+    {
+        auto const candidate = index.pop(now);
+        if (!candidate)
+        {
+            break;
+        }
+
+        auto* const tor = session->torrents().get(candidate->tor_id);
+        if (tor == nullptr)
+        {
+            index.forget(candidate->tor_id);
+            continue;
+        }
+
+        // the swarm may have filled up since it was scanned
+        if (!is_torrent_candidate(tor, now_msec))
+        {
+            index.set_candidates(candidate->tor_id, {});
+            index.schedule_rescan(candidate->tor_id, now + FullSwarmRescanSecs);
+            continue;
+        }
+
+        if (auto* const peer_info = tor->swarm->get_existing_peer_info(candidate->socket_address);
+            peer_info != nullptr && is_peer_candidate(tor, *peer_info, now))
+        {
+            initiate_connection(this, tor->swarm, *peer_info);
+            ++n_attempts;
+        }
+    }
 }
 
 void HandshakeMediator::set_utp_failed(tr_sha1_digest_t const& info_hash, tr_socket_address const& socket_address)
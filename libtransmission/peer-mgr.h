@@ -9,12 +9,17 @@
 #error only libtransmission should #include this header.
 #endif
 
+#include <algorithm> // std::max(), std::min()
+#include <array>
+#include <chrono>
 #include <cstddef> // size_t
 #include <cstdint> // uint8_t, uint64_t
 #include <ctime>
 #include <limits>
+#include <memory>
 #include <optional>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "libtransmission/transmission.h" // tr_block_span_t (ptr only)
@@ -51,6 +56,58 @@ enum
     ADDED_F_CONNECTABLE = 16
 };
 
+/**
+ * Every peer address known to any swarm, stored once no matter how many
+ * swarms know about it. tr_peer_info objects refer to their address by
+ * index, and facts about a peer that don't depend on the torrent are kept
+ * here in parallel arrays next to the address.
+ *
+ * Like the swarms' peer pools, this must only be used with the session lock held.
+ */
+class tr_peer_addresses
+{
+public:
+    using index_t = uint32_t;
+
+    [[nodiscard]] static index_t acquire(tr_socket_address const& socket_address);
+    static void release(index_t idx) noexcept;
+
+    [[nodiscard]] static tr_socket_address address(index_t idx) noexcept
+    {
+        return instance().addresses_[idx];
+    }
+
+    [[nodiscard]] static std::optional<bool>& blocklisted(index_t idx) noexcept
+    {
+        return instance().blocklisted_[idx];
+    }
+
+    [[nodiscard]] static std::optional<bool>& utp_supported(index_t idx) noexcept
+    {
+        return instance().utp_supported_[idx];
+    }
+
+    // forget every address's cached blocklist status
+    static void clear_blocklisted() noexcept;
+
+    // @return the number of distinct addresses in use
+    [[nodiscard]] static size_t size() noexcept
+    {
+        return std::size(instance().index_);
+    }
+
+private:
+    [[nodiscard]] static tr_peer_addresses& instance();
+
+    std::vector<tr_socket_address> addresses_;
+    std::vector<uint32_t> refcounts_;
+    std::vector<std::optional<bool>> blocklisted_;
+    std::vector<std::optional<bool>> utp_supported_;
+
+    std::unordered_map<tr_socket_address, index_t> index_;
+    std::vector<index_t> free_;
+};
+
 /**
  * Peer information that should be retained even when not connected,
  * e.g. to help us decide which peers to connect to.
@@ -59,7 +116,7 @@ class tr_peer_info
 {
 public:
     tr_peer_info(tr_socket_address socket_address, uint8_t pex_flags, tr_peer_from from)
-        : listen_socket_address_{ socket_address }
+        : address_idx_{ tr_peer_addresses::acquire(socket_address) }
         , from_first_{ from }
         , from_best_{ from }
     {
@@ -69,7 +126,7 @@ public:
     }
 
     tr_peer_info(tr_address address, uint8_t pex_flags, tr_peer_from from)
-        : listen_socket_address_{ address, tr_port{} }
+        : address_idx_{ tr_peer_addresses::acquire({ address, tr_port{} }) }
         , from_first_{ from }
         , from_best_{ from }
     {
@@ -83,11 +140,13 @@ public:
 
     ~tr_peer_info()
     {
-        if (!std::empty(listen_socket_address_.port()))
+        if (!std::empty(tr_peer_addresses::address(address_idx_).port()))
         {
             [[maybe_unused]] auto const n_prev = n_known_connectable_--;
             TR_ASSERT(n_prev > 0U);
         }
+
+        tr_peer_addresses::release(address_idx_);
     }
 
     [[nodiscard]] static auto known_connectable_count() noexcept
@@ -97,37 +156,40 @@ public:
 
     // ---
 
-    [[nodiscard]] constexpr auto const& listen_socket_address() const noexcept
+    [[nodiscard]] auto listen_socket_address() const noexcept
     {
-        return listen_socket_address_;
+        return tr_peer_addresses::address(address_idx_);
     }
 
-    [[nodiscard]] constexpr auto const& listen_address() const noexcept
+    [[nodiscard]] auto listen_address() const noexcept
     {
-        return listen_socket_address_.address();
+        return listen_socket_address().address();
     }
 
-    [[nodiscard]] constexpr auto listen_port() const noexcept
+    [[nodiscard]] auto listen_port() const noexcept
     {
-        return listen_socket_address_.port();
+        return listen_socket_address().port();
     }
 
-    void set_listen_port(tr_port port_in) noexcept
+    void set_listen_port(tr_port port_in)
     {
         if (!std::empty(port_in))
         {
-            auto& port = listen_socket_address_.port_;
+            auto const [address, port] = listen_socket_address();
             if (std::empty(port)) // increment known connectable peers if we did not know the listening port of this peer before
             {
                 ++n_known_connectable_;
             }
-            port = port_in;
+
+            auto const old_idx = address_idx_;
+            address_idx_ = tr_peer_addresses::acquire({ address, port_in });
+            tr_peer_addresses::release(old_idx);
         }
     }
 
     [[nodiscard]] auto display_name() const
     {
-        return listen_socket_address_.display_name();
+        return listen_socket_address().display_name();
     }
 
     // ---
@@ -142,9 +204,17 @@ public:
         return from_best_;
     }
 
-    constexpr void found_at(tr_peer_from from) noexcept
+    void found_at(tr_peer_from from) noexcept
     {
         from_best_ = std::min(from_best_, from);
+        found_at_ = tr_time();
+    }
+
+    // The last time that a tracker, DHT, PEX, or LPD told us about this
+    // peer, or that we connected to it, disconnected, or got piece data
+    [[nodiscard]] constexpr time_t last_heard_at() const noexcept
+    {
+        return std::max({ found_at_, connection_changed_at_, piece_data_at_ });
     }
 
     // ---
@@ -173,14 +243,16 @@ public:
 
     // ---
 
+    // µTP support is a property of the peer, not of the swarm,
+    // so it's shared by every swarm that knows this address.
     void set_utp_supported(bool value = true) noexcept
     {
-        is_utp_supported_ = value;
+        tr_peer_addresses::utp_supported(address_idx_) = value;
     }
 
-    [[nodiscard]] constexpr auto supports_utp() const noexcept
+    [[nodiscard]] auto supports_utp() const noexcept
     {
-        return is_utp_supported_;
+        return tr_peer_addresses::utp_supported(address_idx_);
     }
 
     // ---
@@ -221,7 +293,7 @@ public:
 
     void set_blocklisted_dirty()
     {
-        blocklisted_.reset();
+        tr_peer_addresses::blocklisted(address_idx_).reset();
     }
 
     // ---
@@ -264,6 +336,12 @@ public:
         return interval >= get_reconnect_interval_secs(now);
     }
 
+    // The earliest time that reconnect_interval_has_passed() could become true.
+    [[nodiscard]] constexpr time_t reconnect_at(time_t const now) const noexcept
+    {
+        return std::max(connection_attempted_at_, connection_changed_at_) + get_reconnect_interval_secs(now);
+    }
+
     [[nodiscard]] constexpr std::optional<time_t> idle_secs(time_t now) const noexcept
     {
         if (!is_connected_)
@@ -291,7 +369,7 @@ public:
 
     // ---
 
-    constexpr void set_pex_flags(uint8_t pex_flags) noexcept
+    void set_pex_flags(uint8_t pex_flags) noexcept
     {
         pex_flags_ = pex_flags;
 
@@ -308,7 +386,7 @@ public:
         is_seed_ = (pex_flags & ADDED_F_SEED_FLAG) != 0U;
     }
 
-    [[nodiscard]] constexpr uint8_t pex_flags() const noexcept
+    [[nodiscard]] uint8_t pex_flags() const noexcept
     {
         auto ret = pex_flags_;
 
@@ -324,9 +402,9 @@ public:
             }
         }
 
-        if (is_utp_supported_)
+        if (auto const is_utp_supported = supports_utp(); is_utp_supported)
         {
-            if (*is_utp_supported_)
+            if (*is_utp_supported)
             {
                 ret |= ADDED_F_UTP_FLAGS;
             }
@@ -355,6 +433,7 @@ public:
         connection_attempted_at_ = std::max(connection_attempted_at_, that.connection_attempted_at_);
         connection_changed_at_ = std::max(connection_changed_at_, that.connection_changed_at_);
         piece_data_at_ = std::max(piece_data_at_, that.piece_data_at_);
+        found_at_ = std::max(found_at_, that.found_at_);
 
         /* no need to merge blocklist since it gets updated elsewhere */
 
@@ -482,16 +561,16 @@ private:
 
     static auto inline n_known_connectable_ = size_t{};
 
-    // if the port is 0, it SHOULD mean we don't know this peer's listen socket address
-    tr_socket_address listen_socket_address_;
-
     time_t connection_attempted_at_ = {};
     time_t connection_changed_at_ = {};
     time_t piece_data_at_ = {};
+    time_t found_at_ = tr_time();
+
+    // index of our listen socket address in tr_peer_addresses.
+    // if the port is 0, it SHOULD mean we don't know this peer's listen socket address
+    tr_peer_addresses::index_t address_idx_;
 
-    mutable std::optional<bool> blocklisted_;
     std::optional<bool> is_connectable_;
-    std::optional<bool> is_utp_supported_;
 
     tr_peer_from from_first_; // where the peer was first found
     tr_peer_from from_best_; // the "best" place where this peer was found
@@ -632,8 +711,33 @@ void tr_peerMgrClientSentRequests(tr_torrent* torrent, tr_peer* peer, tr_block_s
 
 [[nodiscard]] size_t tr_peerMgrCountActiveRequestsToPeer(tr_torrent const* torrent, tr_peer const* peer);
 
+// @return how many connected peers have `piece`, not counting seeds
+[[nodiscard]] size_t tr_peerMgrCountPeersWithPiece(tr_torrent const* torrent, tr_piece_index_t piece);
+
+// Super-seeding: pick the next piece to offer `peer`. This is the piece
+// that `peer` doesn't have and that the fewest other peers have or are
+// being offered, so that each piece we upload spreads as far as it can.
+[[nodiscard]] std::optional<tr_piece_index_t> tr_peerMgrGetSuperSeedPiece(tr_torrent const* torrent, tr_peer const* peer);
+
 void tr_peerMgrAddIncoming(tr_peerMgr* manager, tr_peer_socket&& socket);
 
+// @return how many peers are connected, in every torrent. O(1).
+[[nodiscard]] size_t tr_peerMgrPeerCount(tr_peerMgr const* manager);
+
+// @return the memory held by all the peers' read and write buffers
+[[nodiscard]] size_t tr_peerMgrBufferBytes(tr_peerMgr const* manager);
+
+// @return the memory held by one torrent's peers' read and write buffers
+[[nodiscard]] size_t tr_peerMgrBufferBytes(tr_torrent const* tor);
+
+// Free what memory the peers' buffers can spare
+void tr_peerMgrReleaseBuffers(tr_peerMgr* manager);
+
+// Hibernate every running seed that has no peers, whatever
+// `hibernate-idle-seeds-minutes` says. Used when memory is short.
+// @return how many torrents went into hibernation
+size_t tr_peerMgrHibernateIdleSeeds(tr_peerMgr* manager);
+
 size_t tr_peerMgrAddPex(tr_torrent* tor, tr_peer_from from, tr_pex const* pex, size_t n_pex);
 
 enum
@@ -648,6 +752,66 @@ enum
     uint8_t peer_list_mode,
     size_t max_peer_count);
 
+// The connected peers that a swarm advertises in ut_pex messages. A swarm
+// builds one at most once per `max_age` and all of its peer connections
+// share it, so that they don't each have to walk and sort the swarm.
+struct tr_pex_snapshot
+{
+    using PexLists = std::array<std::vector<tr_pex>, NUM_TR_AF_INET_TYPES>;
+
+    // one more than the swarm's previous snapshot
+    uint64_t generation = 1U;
+
+    // index: tr_address_type. Sorted, as from tr_peerMgrGetPeers().
+    PexLists peers;
+    PexLists previous_peers;
+
+    // The ut_pex payload that takes a peer from the previous snapshot
+    // to this one, encoded by the first connection that needs it.
+    std::optional<std::string> delta_payload;
+};
+
+[[nodiscard]] std::shared_ptr<tr_pex_snapshot> tr_peerMgrGetPexSnapshot(
+    tr_torrent const* tor,
+    size_t max_peer_count,
+    std::chrono::seconds max_age);
+
+// The parts of a swarm's LTEP handshake that are the same for all of its
+// peer connections. They're benc-encoded by the first connection that needs
+// them and reused by the others until one of the inputs changes.
+struct tr_ltep_handshake_cache
+{
+    struct Inputs
+    {
+        std::optional<tr_address> ipv4;
+        std::optional<tr_address> ipv6;
+        size_t reqq = 0U;
+        uint64_t metadata_size = 0U;
+        uint32_t max_request_size = 0U;
+        uint16_t port = 0U;
+        bool encrypt = false;
+        bool upload_only = false;
+        bool allow_metadata_xfer = false;
+        bool allow_pex = false;
+
+        [[nodiscard]] bool operator==(Inputs const& that) const noexcept
+        {
+            return ipv4 == that.ipv4 && ipv6 == that.ipv6 && reqq == that.reqq && metadata_size == that.metadata_size &&
+                max_request_size == that.max_request_size && port == that.port && encrypt == that.encrypt &&
+                upload_only == that.upload_only && allow_metadata_xfer == that.allow_metadata_xfer && allow_pex == that.allow_pex;
+        }
+    };
+
+    // the inputs that `payload` was built from
+    std::optional<Inputs> inputs;
+
+    // The benc'ed handshake dict, less the closing 'e'. The per-peer
+    // `yourip` key sorts after all of these, so it's appended to this.
+    std::string payload;
+};
+
+[[nodiscard]] tr_ltep_handshake_cache& tr_peerMgrLtepHandshakeCache(tr_torrent const* tor);
+
 void tr_peerMgrAddTorrent(tr_peerMgr* manager, struct tr_torrent* tor);
 
 // return the number of connected peers that have `piece`, or -1 if we already have it
@@ -659,6 +823,10 @@ void tr_peerMgrTorrentAvailability(tr_torrent const* tor, int8_t* tab, unsigned
 
 [[nodiscard]] struct tr_peer_stat* tr_peerMgrPeerStats(tr_torrent const* tor, size_t* setme_count);
 
+// @return the swarm's peer stats, refreshed if they're more than a second old.
+// Must be called from the session thread.
+[[nodiscard]] std::vector<tr_peer_stat> const& tr_peerMgrPeerStatsSnapshot(tr_torrent const* tor);
+
 [[nodiscard]] tr_webseed_view tr_peerMgrWebseed(tr_torrent const* tor, size_t i);
 
 /* @} */
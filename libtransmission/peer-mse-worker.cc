@@ -0,0 +1,106 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <mutex>
+#include <optional>
+#include <utility>
+
+#include "libtransmission/executor.h"
+#include "libtransmission/peer-mse-worker.h"
+
+tr_mse_worker::tr_mse_worker(tr_executor& executor, Mediator& mediator, size_t pool_size, size_t max_tasks)
+    : mediator_{ mediator }
+    , pool_size_{ pool_size }
+    , max_tasks_{ std::max(max_tasks, size_t{ 1U }) }
+    , queue_{ executor, 0U, tr_executor::Priority::High }
+{
+    auto const lock = std::lock_guard(mutex_);
+    pool_.reserve(pool_size_);
+    maybe_start_task();
+}
+
+tr_mse_worker::~tr_mse_worker()
+{
+    {
+        auto const lock = std::lock_guard(mutex_);
+        stopping_ = true;
+    }
+
+    // let the tasks finish the secrets that are already queued
+    queue_.wait();
+}
+
+std::optional<tr_mse_worker::DH> tr_mse_worker::take()
+{
+    auto const lock = std::lock_guard(mutex_);
+
+    if (std::empty(pool_))
+    {
+        return {};
+    }
+
+    auto dh = pool_.back();
+    pool_.pop_back();
+    maybe_start_task();
+    return dh;
+}
+
+void tr_mse_worker::compute_secret(DH const& dh, DH::key_bigend_t const& peer_public_key, DoneFunc&& on_done)
+{
+    auto const lock = std::lock_guard(mutex_);
+    todo_.push_back(Job{ dh, peer_public_key, std::move(on_done) });
+    maybe_start_task();
+}
+
+void tr_mse_worker::maybe_start_task()
+{
+    // start tasks, up to `max_tasks_`, while there's more work than tasks
+    if (!stopping_ && n_tasks_ < max_tasks_ && has_work())
+    {
+        ++n_tasks_;
+        queue_.submit([this]() { run_task(); });
+    }
+}
+
+void tr_mse_worker::run_task()
+{
+    auto lock = std::unique_lock(mutex_);
+
+    for (;;)
+    {
+        // finish the secrets that are already queued before stopping so
+        // that every caller gets its answer, but don't bother refilling
+        if (stopping_ ? std::empty(todo_) : !has_work())
+        {
+            --n_tasks_;
+            return;
+        }
+
+        // a handshake is waiting on each secret, so they come first
+        if (!std::empty(todo_))
+        {
+            auto job = std::move(todo_.front());
+            todo_.pop_front();
+            lock.unlock();
+
+            job.dh.setPeerPublicKey(job.peer_public_key);
+            mediator_.post([on_done = std::move(job.on_done), dh = job.dh]() { on_done(dh); });
+
+            lock.lock();
+            continue;
+        }
+
+        ++n_refilling_;
+        lock.unlock();
+
+        auto dh = DH{};
+        [[maybe_unused]] auto const public_key = dh.publicKey();
+
+        lock.lock();
+        --n_refilling_;
+        pool_.push_back(dh);
+    }
+}
@@ -0,0 +1,104 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <cstddef> // size_t
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+#include "libtransmission/executor.h"
+#include "libtransmission/peer-mse.h" // tr_message_stream_encryption::DH
+
+// Does the Diffie-Hellman math for encrypted peer handshakes in the
+// executor, so that a burst of handshakes doesn't stall the session
+// thread's peer I/O.
+//
+// It keeps a pool of key pairs whose public keys are already computed,
+// refilling it as it's drained, and computes shared secrets on demand.
+class tr_mse_worker
+{
+public:
+    using DH = tr_message_stream_encryption::DH;
+
+    // Invoked with `dh`, its shared secret now set, after
+    // `Mediator::post()` has delivered it back to the caller's thread.
+    using DoneFunc = std::function<void(DH const& dh)>;
+
+    class Mediator
+    {
+    public:
+        virtual ~Mediator() = default;
+
+        // Run `func` in the thread that's waiting for secrets,
+        // e.g. `tr_session::runInSessionThread()`.
+        virtual void post(std::function<void(void)>&& func) = 0;
+    };
+
+    static auto constexpr DefaultPoolSize = size_t{ 64U };
+    static auto constexpr DefaultMaxTasks = size_t{ 2U };
+
+    tr_mse_worker(
+        tr_executor& executor,
+        Mediator& mediator,
+        size_t pool_size = DefaultPoolSize,
+        size_t max_tasks = DefaultMaxTasks);
+    ~tr_mse_worker();
+
+    tr_mse_worker(tr_mse_worker const&) = delete;
+    tr_mse_worker(tr_mse_worker&&) = delete;
+    tr_mse_worker& operator=(tr_mse_worker const&) = delete;
+    tr_mse_worker& operator=(tr_mse_worker&&) = delete;
+
+    // @return a key pair whose public key is ready to send,
+    // or nullopt if the pool has run dry
+    [[nodiscard]] std::optional<DH> take();
+
+    // Compute `dh`'s shared secret with `peer_public_key` in the background.
+    void compute_secret(DH const& dh, DH::key_bigend_t const& peer_public_key, DoneFunc&& on_done);
+
+    [[nodiscard]] size_t pool_size() const
+    {
+        auto const lock = std::lock_guard(mutex_);
+        return std::size(pool_);
+    }
+
+private:
+    struct Job
+    {
+        DH dh;
+        DH::key_bigend_t peer_public_key;
+        DoneFunc on_done;
+    };
+
+    void maybe_start_task();
+    void run_task();
+
+    [[nodiscard]] bool has_work() const noexcept
+    {
+        return !std::empty(todo_) || std::size(pool_) + n_refilling_ < pool_size_;
+    }
+
+    Mediator& mediator_;
+    size_t const pool_size_;
+    size_t const max_tasks_;
+
+    mutable std::mutex mutex_;
+    std::deque<Job> todo_;
+    std::vector<DH> pool_;
+    size_t n_tasks_ = 0;
+    size_t n_refilling_ = 0;
+    bool stopping_ = false;
+
+    // declared last so that it's destroyed before the state its tasks use
+    tr_executor_queue queue_;
+};
@@ -84,6 +84,16 @@ public:
         process(buf_in, buf_len, buf_out, dec_active_, dec_key_);
     }
 
+    // Advance the decrypt keystream past `buf_len` bytes that are being
+    // dropped without being read
+    constexpr void decrypt_skip(size_t buf_len) noexcept
+    {
+        if (dec_active_)
+        {
+            dec_key_.discard(buf_len);
+        }
+    }
+
     void encrypt_init(bool is_incoming, DH const&, tr_sha1_digest_t const& info_hash);
 
     template<typename T>
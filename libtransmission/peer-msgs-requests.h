@@ -0,0 +1,91 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <algorithm> // std::min()
+#include <cstddef> // size_t
+#include <cstdint> // int64_t, uint32_t
+#include <iterator> // std::begin()
+
+#include "libtransmission/transmission.h" // tr_piece_index_t
+
+#include "libtransmission/block-info.h"
+
+// Large requests: two peers that both send `max_request_size` in their
+// LTEP handshakes may ask for, and send, several blocks of a piece at once.
+// Both sides still track requests one block at a time.
+//
+// `Request` is anything with `index`, `offset` and `length` members,
+// e.g. peer-msgs' peer_request.
+namespace libtransmission
+{
+
+// @return the most bytes that one request or Piece message may have,
+// given our `max_request_size` (0 if large requests are off) and the
+// one in the peer's handshake: the smaller of the two, in whole blocks.
+[[nodiscard]] constexpr uint32_t negotiated_max_request_size(uint32_t our_max, int64_t peer_max) noexcept
+{
+    auto const n_blocks = std::min(int64_t{ our_max }, peer_max) / tr_block_info::BlockSize;
+    return n_blocks > 1 ? static_cast<uint32_t>(n_blocks * tr_block_info::BlockSize) : tr_block_info::BlockSize;
+}
+
+// Call `func` with a request for each block of `req`,
+// which must be for whole blocks of one piece
+template<typename Request, typename Func>
+constexpr void for_each_block_request(Request const& req, Func&& func)
+{
+    for (auto offset = req.offset, end = req.offset + req.length; offset < end; offset += tr_block_info::BlockSize)
+    {
+        func(Request{ req.index, offset, std::min(tr_block_info::BlockSize, end - offset) });
+    }
+}
+
+// Remove the request at the front of `requests` and return it, merged with
+// the requests right after it that are for the next bytes of the same piece,
+// so long as the merged request isn't longer than `max_len`.
+template<typename Request, typename Container>
+[[nodiscard]] Request pop_merged_request(Container& requests, uint32_t max_len)
+{
+    auto n_merged = size_t{ 1U };
+    auto req = Request{ requests.front() };
+    for (; n_merged < std::size(requests); ++n_merged)
+    {
+        auto const& next = requests[n_merged];
+        if (next.index != req.index || next.offset != req.offset + req.length || req.length + next.length > max_len)
+        {
+            break;
+        }
+
+        req.length += next.length;
+    }
+
+    requests.erase(std::begin(requests), std::begin(requests) + n_merged);
+    return req;
+}
+
+// @return how many of a Piece message's `len` bytes of data, which start
+// at `offset` in `piece`, go into the block that `offset` is in.
+// Only a large Piece message has more than one block.
+[[nodiscard]] constexpr uint32_t piece_data_chunk_len(
+    tr_block_info const& block_info,
+    tr_piece_index_t piece,
+    uint32_t offset,
+    size_t len) noexcept
+{
+    if (len <= tr_block_info::BlockSize)
+    {
+        return static_cast<uint32_t>(len);
+    }
+
+    auto const loc = block_info.piece_loc(piece, offset);
+    return static_cast<uint32_t>(std::min(len, size_t{ block_info.block_size(loc.block) - loc.block_offset }));
+}
+
+} // namespace libtransmission
@@ -0,0 +1,159 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <algorithm> // std::copy_n(), std::min()
+#include <cstddef> // size_t, std::byte
+#include <cstdint> // uint8_t, uint16_t, uint32_t
+
+namespace libtransmission
+{
+
+// A message's payload, read in place from a peer's read buffer.
+// Has the parts of BufferReader's interface that the common
+// peer messages need, but without the virtual calls.
+class PeerMessagePayload
+{
+public:
+    constexpr PeerMessagePayload(std::byte const* data, size_t len) noexcept
+        : data_{ data }
+        , len_{ len }
+    {
+    }
+
+    [[nodiscard]] constexpr auto size() const noexcept
+    {
+        return len_;
+    }
+
+    [[nodiscard]] constexpr auto const* data() const noexcept
+    {
+        return data_;
+    }
+
+    constexpr void drain(size_t n_bytes) noexcept
+    {
+        n_bytes = std::min(n_bytes, len_);
+        data_ += n_bytes;
+        len_ -= n_bytes;
+    }
+
+    void to_buf(void* tgt, size_t n_bytes) noexcept
+    {
+        n_bytes = std::min(n_bytes, len_);
+        std::copy_n(data_, n_bytes, static_cast<std::byte*>(tgt));
+        data_ += n_bytes;
+        len_ -= n_bytes;
+    }
+
+    [[nodiscard]] constexpr uint8_t to_uint8() noexcept
+    {
+        return static_cast<uint8_t>(to_uint(sizeof(uint8_t)));
+    }
+
+    [[nodiscard]] constexpr uint16_t to_uint16() noexcept
+    {
+        return static_cast<uint16_t>(to_uint(sizeof(uint16_t)));
+    }
+
+    [[nodiscard]] constexpr uint32_t to_uint32() noexcept
+    {
+        return to_uint(sizeof(uint32_t));
+    }
+
+private:
+    // read a big-endian integer
+    constexpr uint32_t to_uint(size_t n_bytes) noexcept
+    {
+        n_bytes = std::min(n_bytes, len_);
+
+        auto val = uint32_t{};
+        for (size_t i = 0; i < n_bytes; ++i)
+        {
+            val = (val << 8U) | static_cast<uint8_t>(data_[i]);
+        }
+
+        data_ += n_bytes;
+        len_ -= n_bytes;
+        return val;
+    }
+
+    std::byte const* data_;
+    size_t len_;
+};
+
+// The BitTorrent message at the front of a peer's read buffer,
+// parsed in place so that a buffer holding many small messages
+// can be handled in a single pass without copying them out.
+//
+// https://www.bittorrent.org/beps/bep_0003.html
+// <length prefix><message ID><payload>. The length prefix is a four byte
+// big-endian value. Messages of length zero are keepalives.
+class PeerMessageView
+{
+public:
+    constexpr PeerMessageView(std::byte const* data, size_t len) noexcept
+        : data_{ data }
+        , len_{ len }
+    {
+        if (len_ >= sizeof(uint32_t))
+        {
+            message_len_ = PeerMessagePayload{ data_, len_ }.to_uint32();
+        }
+    }
+
+    // @return true if the length prefix and message ID are present
+    [[nodiscard]] constexpr bool has_header() const noexcept
+    {
+        return len_ >= sizeof(uint32_t) && (message_len_ == 0U || len_ > sizeof(uint32_t));
+    }
+
+    [[nodiscard]] constexpr bool is_keepalive() const noexcept
+    {
+        return has_header() && message_len_ == 0U;
+    }
+
+    // @return true if the whole message is present
+    [[nodiscard]] constexpr bool is_complete() const noexcept
+    {
+        return has_header() && len_ >= frame_len();
+    }
+
+    // @return the length prefix, i.e. the size of the message ID and payload
+    [[nodiscard]] constexpr auto message_len() const noexcept
+    {
+        return message_len_;
+    }
+
+    // @return the size of the whole message, including its length prefix
+    [[nodiscard]] constexpr size_t frame_len() const noexcept
+    {
+        return sizeof(uint32_t) + size_t{ message_len_ };
+    }
+
+    // Only valid if `has_header() && !is_keepalive()`
+    [[nodiscard]] constexpr auto id() const noexcept
+    {
+        return static_cast<uint8_t>(data_[sizeof(uint32_t)]);
+    }
+
+    // Only valid if `is_complete() && !is_keepalive()`
+    [[nodiscard]] constexpr auto payload() const noexcept
+    {
+        return PeerMessagePayload{ data_ + sizeof(uint32_t) + sizeof(uint8_t), message_len_ - sizeof(uint8_t) };
+    }
+
+private:
+    std::byte const* data_;
+    size_t len_;
+    uint32_t message_len_ = 0U;
+};
+
+} // namespace libtransmission
@@ -7,6 +7,7 @@
 #include <array>
 #include <bitset>
 #include <cerrno>
+#include <chrono>
 #include <cstdint>
 #include <cstring>
 #include <ctime>
@@ -20,6 +21,8 @@
 #include <utility>
 #include <vector>
 
+#include <small/vector.hpp>
+
 #include <fmt/core.h>
 
 #include "libtransmission/transmission.h"
@@ -30,10 +33,13 @@
 #include "libtransmission/crypto-utils.h"
 #include "libtransmission/interned-string.h"
 #include "libtransmission/log.h"
+#include "libtransmission/metrics.h"
 #include "libtransmission/peer-common.h"
 #include "libtransmission/peer-io.h"
 #include "libtransmission/peer-mgr.h"
 #include "libtransmission/peer-msgs.h"
+#include "libtransmission/peer-msgs-requests.h"
+#include "libtransmission/peer-msgs-view.h"
 #include "libtransmission/quark.h"
 #include "libtransmission/session.h"
 #include "libtransmission/timer.h"
@@ -175,11 +181,23 @@ auto constexpr KeepaliveIntervalSecs = int{ 100 };
 
 auto constexpr MetadataReqQ = int{ 64 };
 
+// how many metadata pieces to ask a peer for in each pulse
+auto constexpr MetadataReqsPerPulse = int{ 4 };
+
+// how long to leave a peer alone after it rejects a metadata request
+auto constexpr MetadataRejectBackoffSecs = time_t{ 10 };
+
 auto constexpr ReqQ = int{ 512 };
 
+// LAN fast-path peers get deeper queues so that a bulk copy over
+// the LAN isn't stalled waiting for requests. 4096 blocks is 64 MiB.
+auto constexpr LanReqQ = int{ 4096 };
+auto constexpr LanRequestFloor = size_t{ 256 };
+
 // used in lowering the outMessages queue period
 
-// how many blocks to keep prefetched per peer
+// how many of a peer's queued requests to prefetch.
+// The cache reads ahead past these, so this needn't be large.
 auto constexpr PrefetchMax = size_t{ 18 };
 
 // when we're making requests from another peer,
@@ -187,6 +205,31 @@ auto constexpr PrefetchMax = size_t{ 18 };
 // meet our bandwidth goals for the next N seconds
 auto constexpr RequestBufSecs = int{ 10 };
 
+// Once we've measured a peer's round-trip time, keep enough requests
+// in flight to cover this many RTTs of transfer at the peer's current
+// speed, i.e. a multiple of the bandwidth-delay product. Going over 1
+// leaves room for the speed to grow. RequestBufSecs is the upper bound.
+auto constexpr RequestBufRtts = uint64_t{ 2U };
+auto constexpr MinRequestBufMsec = uint64_t{ 500U };
+
+// How long a minimum RTT sample is trusted before a newer, larger
+// sample may replace it, e.g. because the route to the peer changed.
+auto constexpr RttWindowMsec = uint64_t{ 30000U };
+
+// Give up on an RTT probe whose block never arrived.
+auto constexpr RttProbeTimeoutMsec = uint64_t{ 60000U };
+
+// HAVEs for newly-completed pieces are held for up to this long so that
+// a fast download sends each peer a few batches instead of a stream of
+// tiny writes. Enough pending HAVEs are sent right away.
+auto constexpr HaveBatchMsec = uint64_t{ 250U };
+auto constexpr MaxPendingHaves = size_t{ 64U };
+
+// BEP 16 super-seeding waits until a peer's last offered piece shows up
+// at another peer before offering it the next one, but not forever:
+// in a small swarm there may be nobody else to pass it on to.
+auto constexpr SuperSeedMaxWaitSecs = time_t{ 60 };
+
 // ---
 
 auto constexpr MaxPexPeerCount = size_t{ 50 };
@@ -266,6 +309,29 @@ struct tr_incoming
     };
 
     std::map<tr_block_index_t, incoming_piece_data> blocks;
+
+    // A Piece message whose payload is being read straight into its
+    // block's buffer through tr_peerIo's read sink. A large Piece
+    // message is read one block at a time.
+    struct streaming_piece
+    {
+        tr_block_info::Location loc;
+        uint32_t len = {};
+
+        // where the next block's data starts, and how much is left after this one
+        uint32_t piece = {};
+        uint32_t next_offset = {};
+        uint32_t n_left = {};
+
+        // set if the message has the whole block; otherwise the
+        // payload goes into the block's entry in `blocks`
+        std::unique_ptr<Cache::BlockData> buf;
+
+        // true if we didn't ask for this block, so `buf` is scratch space
+        bool is_discarded = false;
+    };
+
+    std::optional<streaming_piece> piece;
 };
 
 class tr_peerMsgsImpl;
@@ -277,9 +343,10 @@ void gotError(tr_peerIo* io, tr_error const& err, void* vmsgs);
 void peerPulse(void* vmsgs);
 size_t protocolSendCancel(tr_peerMsgsImpl* msgs, struct peer_request const& req);
 size_t protocolSendChoke(tr_peerMsgsImpl* msgs, bool choke);
-size_t protocolSendHave(tr_peerMsgsImpl* msgs, tr_piece_index_t index);
+size_t protocolSendHaves(tr_peerMsgsImpl* msgs, std::vector<tr_piece_index_t> const& pieces);
 size_t protocolSendPort(tr_peerMsgsImpl* msgs, tr_port port);
 size_t protocolSendRequest(tr_peerMsgsImpl* msgs, struct peer_request const& req);
+size_t protocolSendSuggest(tr_peerMsgsImpl* msgs, tr_piece_index_t piece);
 void sendInterest(tr_peerMsgsImpl* msgs, bool b);
 void sendLtepHandshake(tr_peerMsgsImpl* msgs);
 void tellPeerWhatWeHave(tr_peerMsgsImpl* msgs);
@@ -413,6 +480,21 @@ public:
         return io->socket_address();
     }
 
+    [[nodiscard]] std::optional<tr_piece_index_t> super_seed_offer() const noexcept override
+    {
+        return super_seed_offer_;
+    }
+
+    [[nodiscard]] size_t buffer_bytes() const noexcept override
+    {
+        return io->buffer_bytes();
+    }
+
+    void release_buffers() override
+    {
+        io->release_buffers();
+    }
+
     [[nodiscard]] std::string display_name() const override
     {
         auto const [addr, port] = socket_address();
@@ -431,6 +513,17 @@ public:
         update_active();
     }
 
+    // Peers normally send a Bitfield, HaveAll, or HaveNone only once,
+    // before any Haves. If one replaces pieces we already know about,
+    // let the swarm forget them first so its availability counts stay right.
+    void will_reset_have()
+    {
+        if (!have_.has_none())
+        {
+            publish(tr_peer_event::WillResetHave());
+        }
+    }
+
     void invalidatePercentDone()
     {
         updateInterest();
@@ -438,7 +531,29 @@ public:
 
     void cancel_block_request(tr_block_index_t block) override
     {
+        cancel_rtt_probe(block);
         protocolSendCancel(this, blockToReq(torrent, block));
+        tr_metrics::instance().cancels_sent.add();
+
+        // Every byte the peer sends before it sees the cancel is wasted,
+        // so don't wait for the next bandwidth pass to send it. Flushing
+        // from a zero-delay timer lets the cancels for all the blocks
+        // that arrive in one read go out together.
+        if (!cancel_flush_timer_)
+        {
+            cancel_flush_timer_ = session->timerMaker().create(
+                [this]()
+                {
+                    cancel_flush_pending_ = false;
+                    io->flush_outgoing_protocol_msgs();
+                });
+        }
+
+        if (!cancel_flush_pending_)
+        {
+            cancel_flush_pending_ = true;
+            cancel_flush_timer_->start_single_shot(0ms);
+        }
     }
 
     void set_choke(bool peer_is_choked) override
@@ -472,12 +587,112 @@ public:
 
     void on_piece_completed(tr_piece_index_t piece) override
     {
-        protocolSendHave(this, piece);
+        // seeds already have every piece, so they don't need to hear about it
+        if (!isSeed())
+        {
+            if (std::empty(pending_haves_))
+            {
+                pending_haves_since_msec_ = tr_time_msec();
+            }
+
+            pending_haves_.emplace_back(piece);
+
+            if (std::size(pending_haves_) >= MaxPendingHaves)
+            {
+                send_pending_haves();
+            }
+        }
 
         // since we have more pieces now, we might not be interested in this peer
         updateInterest();
     }
 
+    // --- BEP 16 super-seeding
+
+    [[nodiscard]] constexpr auto is_super_seeding() const noexcept
+    {
+        return is_super_seeding_;
+    }
+
+    // @return true if we've told the peer that we have `piece`
+    [[nodiscard]] bool is_piece_announced(tr_piece_index_t piece) const
+    {
+        return !is_super_seeding_ || super_seed_announced_.test(piece);
+    }
+
+    // Hide our bitfield from the peer so that it can be offered pieces one at a time
+    void begin_super_seeding()
+    {
+        is_super_seeding_ = true;
+        super_seed_announced_ = tr_bitfield{ torrent->piece_count() };
+    }
+
+    // Called when the peer tells us it has `piece`
+    void on_super_seed_have(tr_piece_index_t piece, time_t now)
+    {
+        if (super_seed_offer_ == piece)
+        {
+            super_seed_offer_.reset();
+            super_seed_spreading_ = piece;
+            super_seed_spreading_since_ = now;
+        }
+    }
+
+    void update_super_seeding(time_t now)
+    {
+        if (!is_super_seeding_)
+        {
+            return;
+        }
+
+        // super-seeding was turned off, or we lost a piece, e.g. to a failed
+        // verify. Either way, the peer needs to hear about everything we have.
+        if (!torrent->is_super_seeding() || !torrent->has_all())
+        {
+            end_super_seeding();
+            return;
+        }
+
+        if (super_seed_offer_ || isSeed())
+        {
+            return;
+        }
+
+        // don't offer another piece until the last one has been passed on
+        if (super_seed_spreading_)
+        {
+            if (tr_peerMgrCountPeersWithPiece(torrent, *super_seed_spreading_) < 2U &&
+                now < super_seed_spreading_since_ + SuperSeedMaxWaitSecs)
+            {
+                return;
+            }
+
+            super_seed_spreading_.reset();
+        }
+
+        if (auto const piece = tr_peerMgrGetSuperSeedPiece(torrent, this); piece)
+        {
+            logtrace(this, fmt::format("super-seeding: offering piece {:d}", *piece));
+            super_seed_offer_ = piece;
+            super_seed_announced_.set(*piece);
+            protocolSendHaves(this, { *piece });
+
+            if (io->supports_fext())
+            {
+                protocolSendSuggest(this, *piece);
+            }
+        }
+    }
+
+    // Send the HAVEs that on_piece_completed() queued, if they've waited long enough
+    void maybe_send_pending_haves(uint64_t now_msec)
+    {
+        if (!std::empty(pending_haves_) && now_msec - pending_haves_since_msec_ >= HaveBatchMsec)
+        {
+            send_pending_haves();
+        }
+    }
+
     void set_interested(bool interested) override
     {
         if (client_is_interested() != interested)
@@ -497,7 +712,27 @@ public:
 
     [[nodiscard]] bool isValidRequest(peer_request const& req) const
     {
-        return tr_torrentReqIsValid(torrent, req.index, req.offset, req.length);
+        if (req.length <= tr_block_info::BlockSize)
+        {
+            return tr_torrentReqIsValid(torrent, req.index, req.offset, req.length);
+        }
+
+        // a large request is for whole blocks of one piece
+        return req.length <= max_request_size_ && req.index < torrent->piece_count() &&
+            req.offset % tr_block_info::BlockSize == 0U && req.offset + req.length <= torrent->piece_size(req.index);
+    }
+
+    // The most bytes that a request or a Piece message may have. This is
+    // more than a block only if both sides have large requests turned on.
+    [[nodiscard]] constexpr auto max_request_size() const noexcept
+    {
+        return max_request_size_;
+    }
+
+    void set_peer_max_request_size(int64_t peer_max)
+    {
+        max_request_size_ = libtransmission::negotiated_max_request_size(session->largeRequestSize(), peer_max);
+        logtrace(this, fmt::format("max request size is {:d}", max_request_size_));
     }
 
     void requestBlocks(tr_block_span_t const* block_spans, size_t n_spans) override
@@ -506,8 +741,37 @@ public:
         TR_ASSERT(client_is_interested());
         TR_ASSERT(!client_is_choked());
 
+        if (n_spans > 0U)
+        {
+            start_rtt_probe(block_spans->begin, tr_time_msec());
+        }
+
+        // Large requests need every block to start on a block boundary in its piece
+        auto const max_blocks_per_request = torrent->piece_size() % tr_block_info::BlockSize == 0U ?
+            max_request_size_ / tr_block_info::BlockSize :
+            1U;
+
         for (auto const *span = block_spans, *span_end = span + n_spans; span != span_end; ++span)
         {
+            if (max_blocks_per_request > 1U)
+            {
+                for (auto [block, block_end] = *span; block < block_end;)
+                {
+                    auto const loc = torrent->block_loc(block);
+                    auto const piece_end = torrent->block_span_for_piece(loc.piece).end;
+                    auto const n_blocks = std::min({ block_end - block, piece_end - block, max_blocks_per_request });
+                    auto req_len = uint32_t{};
+                    for (auto const end = block + n_blocks; block < end; ++block)
+                    {
+                        req_len += torrent->block_size(block);
+                    }
+                    protocolSendRequest(this, { loc.piece, loc.piece_offset, req_len });
+                }
+
+                tr_peerMgrClientSentRequests(torrent, this, *span);
+                continue;
+            }
+
             for (auto [block, block_end] = *span; block < block_end; ++block)
             {
                 // Note that requests can't cross over a piece boundary.
@@ -531,6 +795,58 @@ public:
         }
     }
 
+    [[nodiscard]] size_t request_queue_length() const noexcept override
+    {
+        return desired_request_count;
+    }
+
+    // Time one request at a time to sample the peer's round-trip time.
+    void start_rtt_probe(tr_block_index_t block, uint64_t now_msec)
+    {
+        if (rtt_probe_ && now_msec - rtt_probe_->sent_at_msec < RttProbeTimeoutMsec)
+        {
+            return;
+        }
+
+        rtt_probe_ = RttProbe{ block, now_msec, activeReqCount(TR_CLIENT_TO_PEER) };
+    }
+
+    void on_rtt_probe_done(tr_block_index_t block, uint64_t now_msec)
+    {
+        if (!rtt_probe_ || rtt_probe_->block != block)
+        {
+            return;
+        }
+
+        auto const probe = *rtt_probe_;
+        rtt_probe_.reset();
+
+        // Don't count the time the block spent queued behind
+        // the requests that were already in flight.
+        auto latency_msec = now_msec - probe.sent_at_msec;
+        if (auto const rate = get_piece_speed_bytes_per_second(now_msec, TR_PEER_TO_CLIENT); rate > 0U)
+        {
+            auto const queued_msec = probe.n_ahead * tr_block_info::BlockSize * 1000U / rate;
+            latency_msec = latency_msec > queued_msec ? latency_msec - queued_msec : 1U;
+        }
+
+        // windowed minimum, so that congestion doesn't inflate the estimate
+        if (!min_rtt_msec_ || latency_msec <= *min_rtt_msec_ || now_msec - min_rtt_at_msec_ > RttWindowMsec)
+        {
+            min_rtt_msec_ = std::max(latency_msec, uint64_t{ 1U });
+            min_rtt_at_msec_ = now_msec;
+            io->on_rtt_measured(*min_rtt_msec_, now_msec);
+        }
+    }
+
+    void cancel_rtt_probe(tr_block_index_t block)
+    {
+        if (rtt_probe_ && rtt_probe_->block == block)
+        {
+            rtt_probe_.reset();
+        }
+    }
+
     // how many blocks could we request from this peer right now?
     [[nodiscard]] RequestLimit canRequest() const noexcept override
     {
@@ -538,6 +854,12 @@ public:
         return RequestLimit{ max_blocks, max_blocks };
     }
 
+    // how many outstanding requests we accept from this peer
+    [[nodiscard]] size_t max_peer_requests() const noexcept
+    {
+        return static_cast<size_t>(io->is_lan_fast_path() ? LanReqQ : ReqQ);
+    }
+
     void sendPex();
 
     void publish(tr_peer_event const& peer_event)
@@ -558,15 +880,17 @@ private:
 
         // Get the rate limit we should use.
         // TODO: this needs to consider all the other peers as well...
+        // LAN fast-path peers aren't held to the speed limits.
         uint64_t const now = tr_time_msec();
+        auto const is_lan = io->is_lan_fast_path();
         auto rate_bytes_per_second = get_piece_speed_bytes_per_second(now, TR_PEER_TO_CLIENT);
-        if (torrent->uses_speed_limit(TR_PEER_TO_CLIENT))
+        if (!is_lan && torrent->uses_speed_limit(TR_PEER_TO_CLIENT))
         {
             rate_bytes_per_second = std::min(rate_bytes_per_second, torrent->speed_limit_bps(TR_PEER_TO_CLIENT));
         }
 
         // honor the session limits, if enabled
-        if (torrent->uses_session_limits())
+        if (!is_lan && torrent->uses_session_limits())
         {
             if (auto const irate_bytes_per_second = torrent->session->activeSpeedLimitBps(TR_PEER_TO_CLIENT);
                 irate_bytes_per_second)
@@ -578,13 +902,18 @@ private:
         // use this desired rate to figure out how
         // many requests we should send to this peer
         size_t constexpr Floor = 32;
-        size_t constexpr Seconds = RequestBufSecs;
-        size_t const estimated_blocks_in_period = (rate_bytes_per_second * Seconds) / tr_block_info::BlockSize;
+        auto buf_msec = uint64_t{ RequestBufSecs * 1000U };
+        if (min_rtt_msec_)
+        {
+            buf_msec = std::clamp(RequestBufRtts * *min_rtt_msec_, MinRequestBufMsec, buf_msec);
+        }
+        size_t const estimated_blocks_in_period = (rate_bytes_per_second * buf_msec / 1000U) / tr_block_info::BlockSize;
         size_t const ceil = reqq ? *reqq : 250;
+        size_t const min_reqs = is_lan ? std::min(LanRequestFloor, ceil) : Floor;
 
         auto max_reqs = estimated_blocks_in_period;
         max_reqs = std::min(max_reqs, ceil);
-        max_reqs = std::max(max_reqs, Floor);
+        max_reqs = std::max(max_reqs, min_reqs);
         return max_reqs;
     }
 
@@ -636,6 +965,8 @@ public:
 
     int64_t metadata_size_hint = 0;
 
+    time_t metadata_rejected_at = 0;
+
     tr_torrent* const torrent;
 
     std::shared_ptr<tr_peerIo> const io;
@@ -652,7 +983,12 @@ public:
 
     std::vector<QueuedPeerRequest> peer_requested_;
 
-    std::array<std::vector<tr_pex>, NUM_TR_AF_INET_TYPES> pex;
+    // the file that we most recently uploaded from with sendfile()
+    tr_file_index_t upload_file_index_ = {};
+    tr_peerIo::FileHandle upload_file_;
+
+    // the swarm's pex snapshot that we last sent to this peer
+    std::shared_ptr<tr_pex_snapshot> pex_sent_;
 
     std::queue<int> peerAskedForMetadata;
 
@@ -669,12 +1005,77 @@ public:
        supplied a reqq argument, it's stored here. */
     std::optional<size_t> reqq;
 
+    uint32_t max_request_size_ = tr_block_info::BlockSize;
+
     std::unique_ptr<libtransmission::Timer> pex_timer_;
 
+    // created the first time we cancel a request to this peer
+    std::unique_ptr<libtransmission::Timer> cancel_flush_timer_;
+    bool cancel_flush_pending_ = false;
+
     tr_bitfield have_;
 
 private:
+    struct RttProbe
+    {
+        tr_block_index_t block;
+        uint64_t sent_at_msec;
+        size_t n_ahead; // requests already in flight when this one was sent
+    };
+
+    std::optional<RttProbe> rtt_probe_;
+    std::optional<uint64_t> min_rtt_msec_;
+    uint64_t min_rtt_at_msec_ = 0U;
+
+    void send_pending_haves()
+    {
+        // the peer may have become a seed while these were waiting
+        if (!isSeed())
+        {
+            protocolSendHaves(this, pending_haves_);
+        }
+
+        pending_haves_.clear();
+    }
+
+    // pieces we've completed but haven't told the peer about yet
+    std::vector<tr_piece_index_t> pending_haves_;
+    uint64_t pending_haves_since_msec_ = 0U;
+
+    void end_super_seeding()
+    {
+        auto pieces = std::vector<tr_piece_index_t>{};
+        for (tr_piece_index_t piece = 0, n = torrent->piece_count(); piece < n; ++piece)
+        {
+            if (torrent->has_piece(piece) && !super_seed_announced_.test(piece))
+            {
+                pieces.emplace_back(piece);
+            }
+        }
+
+        if (!std::empty(pieces) && !isSeed())
+        {
+            protocolSendHaves(this, pieces);
+        }
+
+        is_super_seeding_ = false;
+        super_seed_offer_.reset();
+        super_seed_spreading_.reset();
+        super_seed_announced_ = tr_bitfield{ 0U };
+    }
+
+    // BEP 16 super-seeding: the peer was shown an empty bitfield and
+    // is offered one piece at a time, so that it downloads pieces that
+    // nobody else has and passes them on to the rest of the swarm.
+    tr_bitfield super_seed_announced_{ 0U };
+    std::optional<tr_piece_index_t> super_seed_offer_;
+    std::optional<tr_piece_index_t> super_seed_spreading_;
+    time_t super_seed_spreading_since_ = 0;
+    bool is_super_seeding_ = false;
+
     friend ReadResult process_peer_message(tr_peerMsgsImpl* msgs, uint8_t id, MessageReader& payload);
+    template<typename Payload>
+    friend ReadResult process_hot_message(tr_peerMsgsImpl* msgs, uint8_t id, Payload& payload);
     friend void parseLtepHandshake(tr_peerMsgsImpl* msgs, MessageReader& payload);
     friend void parseUtMetadata(tr_peerMsgsImpl* msgs, MessageReader& payload_in);
 
@@ -683,11 +1084,17 @@ private:
 
     // seconds between periodic sendPex() calls
     static auto constexpr SendPexInterval = 90s;
+    static auto constexpr SendPexIntervalSlack = 5s;
 };
 
 // ---
 
-[[nodiscard]] constexpr bool messageLengthIsCorrect(tr_torrent const* const tor, uint8_t id, uint32_t len)
+// `max_piece_len` is the most piece data that a Piece message may have
+[[nodiscard]] constexpr bool messageLengthIsCorrect(
+    tr_torrent const* const tor,
+    uint8_t id,
+    uint32_t len,
+    uint32_t max_piece_len = tr_block_info::BlockSize)
 {
     switch (id)
     {
@@ -714,7 +1121,7 @@ private:
 
     case BtPeerMsgs::Piece:
         len -= sizeof(id) + sizeof(uint32_t /*piece*/) + sizeof(uint32_t /*offset*/);
-        return len <= tr_block_info::BlockSize;
+        return len <= max_piece_len;
 
     case BtPeerMsgs::Port:
         return len == 3U;
@@ -727,6 +1134,27 @@ private:
     }
 }
 
+// The messages that make up nearly all of a busy connection's traffic.
+// process_message_batch() parses these straight from the read buffer.
+[[nodiscard]] constexpr bool isHotMessage(uint8_t id) noexcept
+{
+    switch (id)
+    {
+    case BtPeerMsgs::Choke:
+    case BtPeerMsgs::Unchoke:
+    case BtPeerMsgs::Interested:
+    case BtPeerMsgs::NotInterested:
+    case BtPeerMsgs::Have:
+    case BtPeerMsgs::Request:
+    case BtPeerMsgs::Cancel:
+    case BtPeerMsgs::Piece:
+        return true;
+
+    default:
+        return false;
+    }
+}
+
 namespace protocol_send_message_helpers
 {
 namespace
@@ -819,7 +1247,7 @@ void build_peer_message(tr_peerMsgsImpl const* const msgs, MessageWriter& out, u
     out.add_uint8(type);
     (add_param(out, args), ...);
 
-    TR_ASSERT(messageLengthIsCorrect(msgs->torrent, type, msg_len));
+    TR_ASSERT(messageLengthIsCorrect(msgs->torrent, type, msg_len, msgs->max_request_size()));
 }
 } // namespace protocol_send_message_helpers
 
@@ -869,9 +1297,25 @@ size_t protocolSendPort(tr_peerMsgsImpl* const msgs, tr_port port)
     return protocol_send_message(msgs, BtPeerMsgs::Port, port.host());
 }
 
-size_t protocolSendHave(tr_peerMsgsImpl* const msgs, tr_piece_index_t index)
+// Send several HAVEs with a single write
+size_t protocolSendHaves(tr_peerMsgsImpl* const msgs, std::vector<tr_piece_index_t> const& pieces)
+{
+    using namespace protocol_send_message_helpers;
+
+    auto out = MessageBuffer{};
+    for (auto const piece : pieces)
+    {
+        build_peer_message(msgs, out, BtPeerMsgs::Have, piece);
+    }
+
+    auto const n_bytes_added = std::size(out);
+    msgs->io->write(out, false);
+    return n_bytes_added;
+}
+
+size_t protocolSendSuggest(tr_peerMsgsImpl* const msgs, tr_piece_index_t piece)
 {
-    return protocol_send_message(msgs, BtPeerMsgs::Have, index);
+    return protocol_send_message(msgs, BtPeerMsgs::FextSuggest, piece);
 }
 
 size_t protocolSendChoke(tr_peerMsgsImpl* const msgs, bool choke)
@@ -915,47 +1359,26 @@ void cancelAllRequestsToClient(tr_peerMsgsImpl* msgs)
 
 // ---
 
-void sendLtepHandshake(tr_peerMsgsImpl* msgs)
+// @return the benc'ed LTEP handshake dict, less the closing 'e'
+[[nodiscard]] std::string make_ltep_handshake_payload(tr_ltep_handshake_cache::Inputs const& inputs)
 {
     static tr_quark version_quark = 0;
 
-    if (msgs->clientSentLtepHandshake)
-    {
-        return;
-    }
-
     if (version_quark == 0)
     {
         version_quark = tr_quark_new(TR_NAME " " USERAGENT_PREFIX);
     }
 
-    logtrace(msgs, "sending an ltep handshake");
-    msgs->clientSentLtepHandshake = true;
-
-    /* decide if we want to advertise metadata xfer support (BEP 9) */
-    bool const allow_metadata_xfer = msgs->torrent->is_public();
-
-    /* decide if we want to advertise pex support */
-    bool const allow_pex = msgs->torrent->allows_pex();
-
     auto val = tr_variant{};
     tr_variantInitDict(&val, 8);
-    tr_variantDictAddBool(&val, TR_KEY_e, msgs->session->encryptionMode() != TR_CLEAR_PREFERRED);
+    tr_variantDictAddBool(&val, TR_KEY_e, inputs.encrypt);
 
-    // If connecting to global peer, then use global address
-    // Otherwise we are connecting to local peer, use bind address directly
-    if (auto const addr = msgs->io->address().is_global_unicast_address() ? msgs->session->global_address(TR_AF_INET) :
-                                                                            msgs->session->bind_address(TR_AF_INET);
-        addr && !addr->is_any())
+    if (auto const& addr = inputs.ipv4; addr)
     {
-        TR_ASSERT(addr->is_ipv4());
         tr_variantDictAddRaw(&val, TR_KEY_ipv4, &addr->addr.addr4, sizeof(addr->addr.addr4));
     }
-    if (auto const addr = msgs->io->address().is_global_unicast_address() ? msgs->session->global_address(TR_AF_INET6) :
-                                                                            msgs->session->bind_address(TR_AF_INET6);
-        addr && !addr->is_any())
+    if (auto const& addr = inputs.ipv6; addr)
     {
-        TR_ASSERT(addr->is_ipv6());
         tr_variantDictAddRaw(&val, TR_KEY_ipv6, &addr->addr.addr6, sizeof(addr->addr.addr6));
     }
 
@@ -963,10 +1386,9 @@ void sendLtepHandshake(tr_peerMsgsImpl* msgs)
     // It also adds "metadata_size" to the handshake message (not the
     // "m" dictionary) specifying an integer value of the number of
     // bytes of the metadata.
-    if (auto const info_dict_size = msgs->torrent->info_dict_size();
-        allow_metadata_xfer && msgs->torrent->has_metainfo() && info_dict_size > 0)
+    if (inputs.metadata_size > 0U)
     {
-        tr_variantDictAddInt(&val, TR_KEY_metadata_size, info_dict_size);
+        tr_variantDictAddInt(&val, TR_KEY_metadata_size, inputs.metadata_size);
     }
 
     // http://bittorrent.org/beps/bep_0010.html
@@ -974,25 +1396,19 @@ void sendLtepHandshake(tr_peerMsgsImpl* msgs)
     // port number of the other side. Note that there is no need for the
     // receiving side of the connection to send this extension message,
     // since its port number is already known.
-    tr_variantDictAddInt(&val, TR_KEY_p, msgs->session->advertisedPeerPort().host());
+    tr_variantDictAddInt(&val, TR_KEY_p, inputs.port);
 
     // http://bittorrent.org/beps/bep_0010.html
     // An integer, the number of outstanding request messages this
     // client supports without dropping any. The default in in
     // libtorrent is 250.
-    tr_variantDictAddInt(&val, TR_KEY_reqq, ReqQ);
+    tr_variantDictAddInt(&val, TR_KEY_reqq, inputs.reqq);
 
-    // https://www.bittorrent.org/beps/bep_0010.html
-    // A string containing the compact representation of the ip address this peer sees
-    // you as. i.e. this is the receiver's external ip address (no port is included).
-    // This may be either an IPv4 (4 bytes) or an IPv6 (16 bytes) address.
+    // Transmission's own extension: the most bytes that we'll ask for or
+    // serve in one request. Both sides use the smaller of the two values.
+    if (inputs.max_request_size > 0U)
     {
-        auto buf = std::array<std::byte, TR_ADDRSTRLEN>{};
-        auto const begin = std::data(buf);
-        auto const end = msgs->io->address().to_compact(begin);
-        auto const len = end - begin;
-        TR_ASSERT(len == 4 || len == 16);
-        tr_variantDictAddRaw(&val, TR_KEY_yourip, begin, len);
+        tr_variantDictAddInt(&val, TR_KEY_max_request_size, inputs.max_request_size);
     }
 
     // http://bittorrent.org/beps/bep_0010.html
@@ -1006,60 +1422,138 @@ void sendLtepHandshake(tr_peerMsgsImpl* msgs)
     // the extension handshake 'upload_only'. Setting the value of this
     // key to 1 indicates that this peer is not interested in downloading
     // anything.
-    tr_variantDictAddBool(&val, TR_KEY_upload_only, msgs->torrent->is_done());
+    tr_variantDictAddBool(&val, TR_KEY_upload_only, inputs.upload_only);
 
-    if (allow_metadata_xfer || allow_pex)
+    if (inputs.allow_metadata_xfer || inputs.allow_pex)
     {
         tr_variant* m = tr_variantDictAddDict(&val, TR_KEY_m, 2);
 
-        if (allow_metadata_xfer)
+        if (inputs.allow_metadata_xfer)
         {
             tr_variantDictAddInt(m, TR_KEY_ut_metadata, UT_METADATA_ID);
         }
 
-        if (allow_pex)
+        if (inputs.allow_pex)
         {
             tr_variantDictAddInt(m, TR_KEY_ut_pex, UT_PEX_ID);
         }
     }
 
-    protocol_send_message(msgs, BtPeerMsgs::Ltep, LtepMessages::Handshake, tr_variantToStr(&val, TR_VARIANT_FMT_BENC));
-
-    /* cleanup */
+    auto payload = tr_variantToStr(&val, TR_VARIANT_FMT_BENC);
     tr_variantClear(&val);
+
+    TR_ASSERT(tr_strv_ends_with(payload, 'e'));
+    payload.pop_back();
+    return payload;
 }
 
-void parseLtepHandshake(tr_peerMsgsImpl* msgs, MessageReader& payload)
+void sendLtepHandshake(tr_peerMsgsImpl* msgs)
 {
-    auto const handshake_sv = payload.to_string_view();
-
-    auto val = tr_variant{};
-    if (!tr_variantFromBuf(&val, TR_VARIANT_PARSE_BENC | TR_VARIANT_PARSE_INPLACE, handshake_sv) || !tr_variantIsDict(&val))
+    if (msgs->clientSentLtepHandshake)
     {
-        logtrace(msgs, "GET  extended-handshake, couldn't get dictionary");
         return;
     }
 
-    logtrace(msgs, fmt::format(FMT_STRING("here is the base64-encoded handshake: [{:s}]"), tr_base64_encode(handshake_sv)));
+    logtrace(msgs, "sending an ltep handshake");
+    msgs->clientSentLtepHandshake = true;
 
-    /* does the peer prefer encrypted connections? */
-    auto i = int64_t{};
-    auto pex = tr_pex{};
-    if (tr_variantDictFindInt(&val, TR_KEY_e, &i))
-    {
-        msgs->encryption_preference = i != 0 ? EncryptionPreference::Yes : EncryptionPreference::No;
+    auto const* const tor = msgs->torrent;
+    auto* const session = msgs->session;
+    auto inputs = tr_ltep_handshake_cache::Inputs{};
+    inputs.encrypt = session->encryptionMode() != TR_CLEAR_PREFERRED;
 
-        if (msgs->encryption_preference == EncryptionPreference::Yes)
-        {
-            pex.flags |= ADDED_F_ENCRYPTION_FLAG;
-        }
+    // If connecting to global peer, then use global address
+    // Otherwise we are connecting to local peer, use bind address directly
+    auto const is_global = msgs->io->address().is_global_unicast_address();
+    if (auto const addr = is_global ? session->global_address(TR_AF_INET) : session->bind_address(TR_AF_INET);
+        addr && !addr->is_any())
+    {
+        TR_ASSERT(addr->is_ipv4());
+        inputs.ipv4 = addr;
+    }
+    if (auto const addr = is_global ? session->global_address(TR_AF_INET6) : session->bind_address(TR_AF_INET6);
+        addr && !addr->is_any())
+    {
+        TR_ASSERT(addr->is_ipv6());
+        inputs.ipv6 = addr;
     }
 
-    /* check supported messages for utorrent pex */
-    msgs->peerSupportsPex = false;
-    msgs->peerSupportsMetadataXfer = false;
+    /* decide if we want to advertise metadata xfer support (BEP 9) */
+    inputs.allow_metadata_xfer = tor->is_public();
 
-    if (tr_variant* sub = nullptr; tr_variantDictFindDict(&val, TR_KEY_m, &sub))
+    /* decide if we want to advertise pex support */
+    inputs.allow_pex = tor->allows_pex();
+
+    if (inputs.allow_metadata_xfer && tor->has_metainfo())
+    {
+        inputs.metadata_size = tor->info_dict_size();
+    }
+
+    inputs.port = session->advertisedPeerPort().host();
+    inputs.reqq = msgs->max_peer_requests();
+    inputs.max_request_size = session->largeRequestSize();
+    inputs.upload_only = tor->is_done();
+
+    auto& cache = tr_peerMgrLtepHandshakeCache(tor);
+    if (!cache.inputs || !(*cache.inputs == inputs))
+    {
+        cache.payload = make_ltep_handshake_payload(inputs);
+        cache.inputs = inputs;
+    }
+
+    // https://www.bittorrent.org/beps/bep_0010.html
+    // A string containing the compact representation of the ip address this peer sees
+    // you as. i.e. this is the receiver's external ip address (no port is included).
+    // This may be either an IPv4 (4 bytes) or an IPv6 (16 bytes) address.
+    auto buf = std::array<std::byte, TR_ADDRSTRLEN>{};
+    auto const begin = std::data(buf);
+    auto const end = msgs->io->address().to_compact(begin);
+    auto const len = end - begin;
+    TR_ASSERT(len == 4 || len == 16);
+
+    auto payload = std::string{};
+    payload.reserve(std::size(cache.payload) + 16U + len);
+    payload += cache.payload;
+    payload += "6:yourip"sv;
+    payload += std::to_string(len);
+    payload += ':';
+    payload.append(reinterpret_cast<char const*>(begin), len);
+    payload += 'e';
+
+    protocol_send_message(msgs, BtPeerMsgs::Ltep, LtepMessages::Handshake, payload);
+}
+
+void parseLtepHandshake(tr_peerMsgsImpl* msgs, MessageReader& payload)
+{
+    auto const handshake_sv = payload.to_string_view();
+
+    auto val = tr_variant{};
+    if (!tr_variantFromBuf(&val, TR_VARIANT_PARSE_BENC | TR_VARIANT_PARSE_INPLACE, handshake_sv) || !tr_variantIsDict(&val))
+    {
+        logtrace(msgs, "GET  extended-handshake, couldn't get dictionary");
+        return;
+    }
+
+    logtrace(msgs, fmt::format(FMT_STRING("here is the base64-encoded handshake: [{:s}]"), tr_base64_encode(handshake_sv)));
+
+    /* does the peer prefer encrypted connections? */
+    auto i = int64_t{};
+    auto pex = tr_pex{};
+    if (tr_variantDictFindInt(&val, TR_KEY_e, &i))
+    {
+        msgs->encryption_preference = i != 0 ? EncryptionPreference::Yes : EncryptionPreference::No;
+
+        if (msgs->encryption_preference == EncryptionPreference::Yes)
+        {
+            pex.flags |= ADDED_F_ENCRYPTION_FLAG;
+        }
+    }
+
+    /* check supported messages for utorrent pex */
+    msgs->peerSupportsPex = false;
+    msgs->peerSupportsMetadataXfer = false;
+
+    if (tr_variant* sub = nullptr; tr_variantDictFindDict(&val, TR_KEY_m, &sub))
     {
         if (tr_variantDictFindInt(sub, TR_KEY_ut_pex, &i))
         {
@@ -1135,6 +1629,12 @@ void parseLtepHandshake(tr_peerMsgsImpl* msgs, MessageReader& payload)
         msgs->reqq = i;
     }
 
+    /* does the peer support large requests? */
+    if (tr_variantDictFindInt(&val, TR_KEY_max_request_size, &i))
+    {
+        msgs->set_peer_max_request_size(i);
+    }
+
     tr_variantClear(&val);
 }
 
@@ -1163,7 +1663,9 @@ void parseUtMetadata(tr_peerMsgsImpl* msgs, MessageReader& payload_in)
 
     if (msg_type == MetadataMsgType::Reject)
     {
-        /* NOOP */
+        // let another peer have a go at it
+        msgs->metadata_rejected_at = tr_time();
+        tr_torrentMetadataPieceRejected(msgs->torrent, piece);
     }
 
     if (msg_type == MetadataMsgType::Data && total_size == msgs->metadata_size_hint && !msgs->torrent->has_metainfo() &&
@@ -1305,7 +1807,7 @@ void prefetchPieces(tr_peerMsgsImpl* msgs)
         return false;
     }
 
-    if (std::size(msgs->peer_requested_) >= ReqQ)
+    if (std::size(msgs->peer_requested_) >= msgs->max_peer_requests())
     {
         logtrace(msgs, "rejecting request ... reqq is full");
         return false;
@@ -1323,11 +1825,28 @@ void prefetchPieces(tr_peerMsgsImpl* msgs)
         return false;
     }
 
+    if (!msgs->is_piece_announced(req.index))
+    {
+        logtrace(msgs, "rejecting request for a piece we're not offering.");
+        return false;
+    }
+
     return true;
 }
 
 void peerMadeRequest(tr_peerMsgsImpl* msgs, struct peer_request const* req)
 {
+    // Queue a large request as one request per block, so that
+    // each block can be cancelled or rejected on its own
+    if (req->length > tr_block_info::BlockSize && msgs->isValidRequest(*req))
+    {
+        libtransmission::for_each_block_request(
+            *req,
+            [msgs](peer_request const& block_req) { peerMadeRequest(msgs, &block_req); });
+
+        return;
+    }
+
     if (canAddRequestFromPeer(msgs, *req))
     {
         msgs->peer_requested_.emplace_back(*req);
@@ -1341,44 +1860,73 @@ void peerMadeRequest(tr_peerMsgsImpl* msgs, struct peer_request const* req)
 
 int clientGotBlock(tr_peerMsgsImpl* msgs, std::unique_ptr<Cache::BlockData> block_data, tr_block_index_t block);
 
-ReadResult read_piece_data(tr_peerMsgsImpl* msgs, MessageReader& payload)
+// @return where the Piece message's payload goes, or nullopt if we didn't ask for it
+[[nodiscard]] std::optional<tr_block_info::Location> check_piece_data(
+    tr_peerMsgsImpl* msgs,
+    uint32_t piece,
+    uint32_t offset,
+    size_t len)
 {
-    // <index><begin><block>
-    auto const piece = payload.to_uint32();
-    auto const offset = payload.to_uint32();
-    auto const len = std::size(payload);
-
     auto const loc = msgs->torrent->piece_loc(piece, offset);
-    auto const block = loc.block;
-    auto const block_size = msgs->torrent->block_size(block);
+    auto const block_size = msgs->torrent->block_size(loc.block);
 
     logtrace(msgs, fmt::format("got {:d} bytes for req {:d}:{:d}->{:d}", len, piece, offset, len));
 
     if (loc.block_offset + len > block_size)
     {
         logwarn(msgs, fmt::format("got unaligned piece {:d}:{:d}->{:d}", piece, offset, len));
-        return { READ_ERR, len };
+        return {};
     }
 
-    if (!tr_peerMgrDidPeerRequest(msgs->torrent, msgs, block))
+    // usually a block that we cancelled because another peer sent it first
+    if (!tr_peerMgrDidPeerRequest(msgs->torrent, msgs, loc.block))
     {
-        logwarn(msgs, fmt::format("got unrequested piece {:d}:{:d}->{:d}", piece, offset, len));
-        return { READ_ERR, len };
+        logdbg(msgs, fmt::format("got unrequested piece {:d}:{:d}->{:d}", piece, offset, len));
+        tr_metrics::instance().wasted_piece_bytes.add(len);
+        return {};
     }
 
-    msgs->publish(tr_peer_event::GotPieceData(len));
+    return loc;
+}
+
+// @return the buffer that a Piece message's payload should be copied into
+[[nodiscard]] std::byte* piece_data_target(
+    tr_peerMsgsImpl* msgs,
+    tr_block_info::Location const& loc,
+    size_t len,
+    std::unique_ptr<Cache::BlockData>& whole_block)
+{
+    auto const block_size = msgs->torrent->block_size(loc.block);
 
     if (loc.block_offset == 0U && len == block_size) // simple case: one message has entire block
     {
-        auto buf = std::make_unique<Cache::BlockData>(block_size);
-        payload.to_buf(std::data(*buf), len);
-        auto const ok = clientGotBlock(msgs, std::move(buf), block) == 0;
+        whole_block = std::make_unique<Cache::BlockData>(block_size);
+        return reinterpret_cast<std::byte*>(std::data(*whole_block));
+    }
+
+    auto& incoming_block = msgs->incoming.blocks.try_emplace(loc.block, block_size).first->second;
+    return reinterpret_cast<std::byte*>(std::data(*incoming_block.buf)) + loc.block_offset;
+}
+
+// Call when a Piece message's payload is in the buffer from piece_data_target()
+[[nodiscard]] ReadResult got_piece_data(
+    tr_peerMsgsImpl* msgs,
+    tr_block_info::Location const& loc,
+    size_t len,
+    std::unique_ptr<Cache::BlockData> whole_block)
+{
+    auto const block = loc.block;
+
+    msgs->publish(tr_peer_event::GotPieceData(len));
+
+    if (whole_block)
+    {
+        auto const ok = clientGotBlock(msgs, std::move(whole_block), block) == 0;
         return { ok ? READ_NOW : READ_ERR, len };
     }
 
     auto& blocks = msgs->incoming.blocks;
-    auto& incoming_block = blocks.try_emplace(block, block_size).first->second;
-    payload.to_buf(std::data(*incoming_block.buf) + loc.block_offset, len);
+    auto& incoming_block = blocks.at(block);
 
     if (!incoming_block.add_span(loc.block_offset, loc.block_offset + len))
     {
@@ -1396,38 +1944,163 @@ ReadResult read_piece_data(tr_peerMsgsImpl* msgs, MessageReader& payload)
     return { ok ? READ_NOW : READ_ERR, len };
 }
 
-ReadResult process_peer_message(tr_peerMsgsImpl* msgs, uint8_t id, MessageReader& payload)
+template<typename Payload>
+ReadResult read_piece_data(tr_peerMsgsImpl* msgs, Payload& payload)
 {
-    bool const fext = msgs->io->supports_fext();
+    // <index><begin><block>
+    auto const piece = payload.to_uint32();
+    auto offset = payload.to_uint32();
+    auto const len = std::size(payload);
 
-    auto ui32 = uint32_t{};
+    auto read_state = READ_NOW;
+    while (std::size(payload) > 0U)
+    {
+        auto const chunk_len = libtransmission::piece_data_chunk_len(
+            msgs->torrent->block_info(),
+            piece,
+            offset,
+            std::size(payload));
+        auto const loc = check_piece_data(msgs, piece, offset, chunk_len);
+        offset += chunk_len;
 
-    logtrace(
-        msgs,
-        fmt::format(
-            "got peer msg '{:s}' ({:d}) with payload len {:d}",
-            BtPeerMsgs::debug_name(id),
-            static_cast<int>(id),
-            std::size(payload)));
+        // the message is drained either way, so skipping it is safe
+        if (!loc)
+        {
+            payload.drain(chunk_len);
+            continue;
+        }
+
+        auto whole_block = std::unique_ptr<Cache::BlockData>{};
+        payload.to_buf(piece_data_target(msgs, *loc, chunk_len, whole_block), chunk_len);
+        read_state = got_piece_data(msgs, *loc, chunk_len, std::move(whole_block)).first;
+        if (read_state == READ_ERR)
+        {
+            break;
+        }
+    }
+
+    return { read_state, len };
+}
+
+// Point the read sink at where the next block of a streaming Piece message goes
+void start_streaming_chunk(tr_peerMsgsImpl* msgs, tr_peerIo* io, tr_incoming::streaming_piece& state)
+{
+    auto const len = libtransmission::piece_data_chunk_len(
+        msgs->torrent->block_info(),
+        state.piece,
+        state.next_offset,
+        state.n_left);
+    auto const loc = check_piece_data(msgs, state.piece, state.next_offset, len);
+    state.len = len;
+    state.next_offset += len;
+    state.n_left -= len;
+    state.buf.reset();
+    state.is_discarded = !loc;
 
-    if (!messageLengthIsCorrect(msgs->torrent, id, sizeof(id) + std::size(payload)))
+    if (loc)
     {
-        logdbg(
-            msgs,
-            fmt::format(
-                "bad msg: '{:s}' ({:d}) with payload len {:d}",
-                BtPeerMsgs::debug_name(id),
-                static_cast<int>(id),
-                std::size(payload)));
-        msgs->publish(tr_peer_event::GotError(EMSGSIZE));
-        return { READ_ERR, {} };
+        state.loc = *loc;
+        io->set_read_sink(piece_data_target(msgs, *loc, len, state.buf), len);
     }
+    else
+    {
+        // the payload still has to be read to get to the next message
+        state.buf = std::make_unique<Cache::BlockData>(len);
+        io->set_read_sink(reinterpret_cast<std::byte*>(std::data(*state.buf)), len);
+    }
+}
+
+// Read a Piece message that isn't all in the read buffer yet. Instead of
+// waiting for the whole payload to pile up in the read buffer, it goes
+// into the block's buffer as it arrives -- straight from the socket when
+// possible -- so it's copied once on its way to the cache.
+ReadState read_streaming_piece_data(tr_peerMsgsImpl* msgs, tr_peerIo* io, size_t* n_piece_bytes)
+{
+    auto& incoming = msgs->incoming;
+    auto& streaming = incoming.piece;
+
+    if (!streaming)
+    {
+        auto const message_len = *incoming.length;
+        if (!messageLengthIsCorrect(msgs->torrent, BtPeerMsgs::Piece, message_len, msgs->max_request_size()))
+        {
+            logdbg(msgs, fmt::format("bad msg: 'piece' with payload len {:d}", message_len - 1U));
+            msgs->publish(tr_peer_event::GotError(EMSGSIZE));
+            return READ_ERR;
+        }
+
+        // <index><begin>
+        auto piece = uint32_t{};
+        auto offset = uint32_t{};
+        if (io->read_buffer_size() < sizeof(piece) + sizeof(offset))
+        {
+            return READ_LATER;
+        }
+
+        io->read_uint32(&piece);
+        io->read_uint32(&offset);
+
+        auto& state = streaming.emplace();
+        state.piece = piece;
+        state.next_offset = offset;
+        state.n_left = static_cast<uint32_t>(message_len - sizeof(uint8_t) - sizeof(piece) - sizeof(offset));
+        start_streaming_chunk(msgs, io, state);
+    }
+
+    // <block>
+    for (;;)
+    {
+        *n_piece_bytes += io->fill_read_sink();
+        if (io->read_sink_left() > 0U)
+        {
+            return READ_LATER;
+        }
+
+        if (streaming->n_left == 0U)
+        {
+            auto state = std::move(*streaming);
+            streaming.reset();
+            incoming.length.reset();
+            incoming.id.reset();
+
+            if (state.is_discarded)
+            {
+                return READ_NOW;
+            }
+
+            auto const [read_state, n_piece_bytes_read] = got_piece_data(msgs, state.loc, state.len, std::move(state.buf));
+            return read_state == READ_LATER ? READ_NOW : read_state;
+        }
+
+        // a large Piece message: hand off this block, then read the next one
+        if (auto& state = *streaming; !state.is_discarded)
+        {
+            // `msgs` may be gone if this fails
+            if (got_piece_data(msgs, state.loc, state.len, std::move(state.buf)).first == READ_ERR)
+            {
+                return READ_ERR;
+            }
+        }
+
+        start_streaming_chunk(msgs, io, *streaming);
+    }
+}
+
+// `Payload` is a MessageReader when the message was copied out of the read
+// buffer, or a PeerMessagePayload when it's still in the read buffer.
+template<typename Payload>
+ReadResult process_hot_message(tr_peerMsgsImpl* msgs, uint8_t id, Payload& payload)
+{
+    bool const fext = msgs->io->supports_fext();
+
+    auto ui32 = uint32_t{};
 
     switch (id)
     {
     case BtPeerMsgs::Choke:
         logtrace(msgs, "got Choke");
         msgs->set_client_choked(true);
+        msgs->rtt_probe_.reset();
 
         if (!fext)
         {
@@ -1473,14 +2146,8 @@ ReadResult process_peer_message(tr_peerMsgsImpl* msgs, uint8_t id, MessageReader
             msgs->publish(tr_peer_event::GotHave(ui32));
         }
 
-        msgs->invalidatePercentDone();
-        break;
+        msgs->on_super_seed_have(ui32, tr_time());
 
-    case BtPeerMsgs::Bitfield:
-        logtrace(msgs, "got a bitfield");
-        msgs->have_ = tr_bitfield{ msgs->torrent->has_metainfo() ? msgs->torrent->piece_count() : std::size(payload) * 8 };
-        msgs->have_.set_raw(reinterpret_cast<uint8_t const*>(std::data(payload)), std::size(payload));
-        msgs->publish(tr_peer_event::GotBitfield(&msgs->have_));
         msgs->invalidatePercentDone();
         break;
 
@@ -1522,6 +2189,54 @@ ReadResult process_peer_message(tr_peerMsgsImpl* msgs, uint8_t id, MessageReader
 
     case BtPeerMsgs::Piece:
         return read_piece_data(msgs, payload);
+
+    default:
+        TR_ASSERT_MSG(false, "not a hot message");
+        break;
+    }
+
+    return { READ_NOW, {} };
+}
+
+ReadResult process_peer_message(tr_peerMsgsImpl* msgs, uint8_t id, MessageReader& payload)
+{
+    bool const fext = msgs->io->supports_fext();
+
+    logtrace(
+        msgs,
+        fmt::format(
+            "got peer msg '{:s}' ({:d}) with payload len {:d}",
+            BtPeerMsgs::debug_name(id),
+            static_cast<int>(id),
+            std::size(payload)));
+
+    if (!messageLengthIsCorrect(msgs->torrent, id, sizeof(id) + std::size(payload), msgs->max_request_size()))
+    {
+        logdbg(
+            msgs,
+            fmt::format(
+                "bad msg: '{:s}' ({:d}) with payload len {:d}",
+                BtPeerMsgs::debug_name(id),
+                static_cast<int>(id),
+                std::size(payload)));
+        msgs->publish(tr_peer_event::GotError(EMSGSIZE));
+        return { READ_ERR, {} };
+    }
+
+    if (isHotMessage(id))
+    {
+        return process_hot_message(msgs, id, payload);
+    }
+
+    switch (id)
+    {
+    case BtPeerMsgs::Bitfield:
+        logtrace(msgs, "got a bitfield");
+        msgs->will_reset_have();
+        msgs->have_ = tr_bitfield{ msgs->torrent->has_metainfo() ? msgs->torrent->piece_count() : std::size(payload) * 8 };
+        msgs->have_.set_raw(reinterpret_cast<uint8_t const*>(std::data(payload)), std::size(payload));
+        msgs->publish(tr_peer_event::GotBitfield(&msgs->have_));
+        msgs->invalidatePercentDone();
         break;
 
     case BtPeerMsgs::Port:
@@ -1580,6 +2295,7 @@ ReadResult process_peer_message(tr_peerMsgsImpl* msgs, uint8_t id, MessageReader
 
         if (fext)
         {
+            msgs->will_reset_have();
             msgs->have_.set_has_all();
             msgs->publish(tr_peer_event::GotHaveAll());
             msgs->invalidatePercentDone();
@@ -1597,6 +2313,7 @@ ReadResult process_peer_message(tr_peerMsgsImpl* msgs, uint8_t id, MessageReader
 
         if (fext)
         {
+            msgs->will_reset_have();
             msgs->have_.set_has_none();
             msgs->publish(tr_peer_event::GotHaveNone());
             msgs->invalidatePercentDone();
@@ -1618,8 +2335,9 @@ ReadResult process_peer_message(tr_peerMsgsImpl* msgs, uint8_t id, MessageReader
 
             if (fext)
             {
-                msgs->publish(
-                    tr_peer_event::GotRejected(msgs->torrent->block_info(), msgs->torrent->piece_loc(r.index, r.offset).block));
+                auto const block = msgs->torrent->piece_loc(r.index, r.offset).block;
+                msgs->cancel_rtt_probe(block);
+                msgs->publish(tr_peer_event::GotRejected(msgs->torrent->block_info(), block));
             }
             else
             {
@@ -1665,16 +2383,21 @@ int clientGotBlock(tr_peerMsgsImpl* msgs, std::unique_ptr<Cache::BlockData> bloc
 
     logtrace(msgs, fmt::format(FMT_STRING("got block {:d}"), block));
 
+    // e.g. another peer's copy arrived while this one was being read
     if (!tr_peerMgrDidPeerRequest(msgs->torrent, msgs, block))
     {
         logdbg(msgs, "we didn't ask for this message...");
+        tr_metrics::instance().wasted_piece_bytes.add(n_expected);
         return 0;
     }
 
+    msgs->on_rtt_probe_done(block, tr_time_msec());
+
     auto const loc = msgs->torrent->block_loc(block);
     if (msgs->torrent->has_piece(loc.piece))
     {
         logtrace(msgs, "we did ask for this message, but the piece is already complete...");
+        tr_metrics::instance().wasted_piece_bytes.add(n_expected);
         return 0;
     }
 
@@ -1703,10 +2426,76 @@ void didWrite(tr_peerIo* /*io*/, size_t bytes_written, bool was_piece_data, void
     peerPulse(msgs);
 }
 
+// Handle as many complete hot messages as possible where they sit in the
+// read buffer, so that a burst of small messages costs one pass over the
+// buffer instead of several virtual calls and copies per message.
+// Stops at the first message that isn't a hot one.
+// @return std::nullopt if canRead() should read the first message itself
+std::optional<ReadState> process_message_batch(tr_peerMsgsImpl* msgs, tr_peerIo* io, size_t* piece)
+{
+    auto n_handled = size_t{};
+
+    for (;;)
+    {
+        auto const [data, len] = io->read_buffer_view();
+        auto const message = libtransmission::PeerMessageView{ data, len };
+
+        if (!message.has_header())
+        {
+            return READ_LATER;
+        }
+
+        if (message.is_keepalive())
+        {
+            logtrace(msgs, "got KeepAlive");
+            io->read_buffer_drain(message.frame_len());
+            ++n_handled;
+            continue;
+        }
+
+        if (auto const id = message.id();
+            !isHotMessage(id) || !messageLengthIsCorrect(msgs->torrent, id, message.message_len(), msgs->max_request_size()))
+        {
+            if (n_handled == 0U)
+            {
+                return {};
+            }
+
+            return READ_NOW;
+        }
+
+        if (!message.is_complete())
+        {
+            // let canRead() stream the rest of a Piece message into its block
+            if (message.id() == BtPeerMsgs::Piece)
+            {
+                return n_handled == 0U ? std::nullopt : std::optional<ReadState>{ READ_NOW };
+            }
+
+            return READ_LATER;
+        }
+
+        auto payload = message.payload();
+        auto const [read_state, n_piece_bytes_read] = process_hot_message(msgs, message.id(), payload);
+        io->read_buffer_drain(message.frame_len());
+        *piece += n_piece_bytes_read;
+        ++n_handled;
+
+        // stop if that message closed the connection; `msgs` may be gone
+        if (read_state == READ_ERR || !io->has_callbacks())
+        {
+            return read_state;
+        }
+    }
+}
+
 ReadState canRead(tr_peerIo* io, void* vmsgs, size_t* piece)
 {
     auto* msgs = static_cast<tr_peerMsgsImpl*>(vmsgs);
 
+    // `msgs` may be gone when this is done, but its torrent won't be
+    auto const timer = tr_torrent_usage::Timer{ msgs->torrent->usage(), tr_torrent_usage::ParseUsec };
+
     // https://www.bittorrent.org/beps/bep_0003.html
     // Next comes an alternating stream of length prefixes and messages.
     // Messages of length zero are keepalives, and ignored.
@@ -1722,6 +2511,11 @@ ReadState canRead(tr_peerIo* io, void* vmsgs, size_t* piece)
     auto& current_message_len = msgs->incoming.length; // the full message payload length. Includes the +1 for id length
     if (!current_message_len)
     {
+        if (auto const read_state = process_message_batch(msgs, io, piece); read_state)
+        {
+            return *read_state;
+        }
+
         auto message_len = uint32_t{};
         if (io->read_buffer_size() < sizeof(message_len))
         {
@@ -1756,16 +2550,19 @@ ReadState canRead(tr_peerIo* io, void* vmsgs, size_t* piece)
         current_message_type = message_type;
     }
 
+    if (*current_message_type == BtPeerMsgs::Piece)
+    {
+        return read_streaming_piece_data(msgs, io, piece);
+    }
+
     // read <payload>
     auto& current_payload = msgs->incoming.payload;
     auto const full_payload_len = *current_message_len - sizeof(uint8_t /*message_type*/);
     auto n_left = full_payload_len - std::size(current_payload);
     while (n_left > 0U && io->read_buffer_size() > 0U)
     {
-        auto buf = std::array<char, tr_block_info::BlockSize>{};
-        auto const n_this_pass = std::min({ n_left, io->read_buffer_size(), std::size(buf) });
-        io->read_bytes(std::data(buf), n_this_pass);
-        current_payload.add(std::data(buf), n_this_pass);
+        auto const n_this_pass = std::min(n_left, io->read_buffer_size());
+        io->read_bytes(current_payload, n_this_pass);
         n_left -= n_this_pass;
         logtrace(msgs, fmt::format("read {:d} payload bytes; {:d} left to go", n_this_pass, n_left));
     }
@@ -1801,13 +2598,20 @@ void updateDesiredRequestCount(tr_peerMsgsImpl* msgs)
 
 void updateMetadataRequests(tr_peerMsgsImpl* msgs, time_t now)
 {
-    if (!msgs->peerSupportsMetadataXfer)
+    if (!msgs->peerSupportsMetadataXfer || msgs->metadata_rejected_at + MetadataRejectBackoffSecs > now)
     {
         return;
     }
 
-    if (auto const piece = tr_torrentGetNextMetadataRequest(msgs->torrent, now); piece)
+    auto const now_msec = tr_time_msec();
+    for (int i = 0; i < MetadataReqsPerPulse; ++i)
     {
+        auto const piece = tr_torrentGetNextMetadataRequest(msgs->torrent, now_msec);
+        if (!piece)
+        {
+            break;
+        }
+
         auto tmp = tr_variant{};
         tr_variantInitDict(&tmp, 3);
         tr_variantDictAddInt(&tmp, TR_KEY_msg_type, MetadataMsgType::Request);
@@ -1891,17 +2695,133 @@ namespace peer_pulse_helpers
     return n_bytes_written;
 }
 
+namespace add_next_piece_helpers
+{
+[[nodiscard]] tr_peerIo::FileHandle get_upload_file(tr_peerMsgsImpl* msgs, tr_file_index_t file_index)
+{
+    if (msgs->upload_file_ && msgs->upload_file_index_ == file_index)
+    {
+        return msgs->upload_file_;
+    }
+
+    auto const found = msgs->torrent->find_file(file_index);
+    if (!found)
+    {
+        return {};
+    }
+
+    auto const fd = tr_sys_file_open(found->filename(), TR_SYS_FILE_READ | TR_SYS_FILE_SEQUENTIAL, 0);
+    if (fd == TR_BAD_SYS_FILE)
+    {
+        return {};
+    }
+
+    msgs->upload_file_index_ = file_index;
+    msgs->upload_file_ = tr_peerIo::make_file_handle(fd);
+    return msgs->upload_file_;
+}
+
+// Send a block straight from its file to the peer's socket.
+// @return the number of bytes queued, or 0 if the block must be copied instead
+[[nodiscard]] size_t send_piece_from_file(tr_peerMsgsImpl* msgs, peer_request const& req)
+{
+    auto* const tor = msgs->torrent;
+    auto const loc = tor->piece_loc(req.index, req.offset);
+
+    // the cache may have data that's newer than what's on disk
+    auto& cache = *msgs->session->cache;
+    for (auto block = loc.block, last = tor->byte_loc(loc.byte + req.length - 1U).block; block <= last; ++block)
+    {
+        if (cache.has_block(tor, tor->block_loc(block)))
+        {
+            return {};
+        }
+    }
+
+    // only handle blocks that are in a single file
+    auto const [file_index, file_offset] = tor->file_offset(loc);
+    if (file_offset + req.length > tor->file_size(file_index))
+    {
+        return {};
+    }
+
+    auto file = get_upload_file(msgs, file_index);
+    if (!file)
+    {
+        return {};
+    }
+
+    // the message header: length prefix, message type, index, and offset
+    auto const msg_len = static_cast<uint32_t>(sizeof(uint8_t) + sizeof(uint32_t) * 2U + req.length);
+    TR_ASSERT(messageLengthIsCorrect(tor, BtPeerMsgs::Piece, msg_len, msgs->max_request_size()));
+    logtrace(msgs, fmt::format("sending 'piece' {:d} {:d} via sendfile", req.index, req.offset));
+
+    auto out = MessageBuffer{};
+    out.add_uint32(msg_len);
+    out.add_uint8(BtPeerMsgs::Piece);
+    out.add_uint32(req.index);
+    out.add_uint32(req.offset);
+    auto const n_header_bytes = std::size(out);
+    msgs->io->write(out, true);
+    msgs->io->write_file(std::move(file), file_offset, req.length);
+    return n_header_bytes + req.length;
+}
+
+// @return the request at the front of the queue. With large requests,
+// the requests for the blocks right after it are merged into it.
+[[nodiscard]] peer_request pop_next_request(tr_peerMsgsImpl* msgs)
+{
+    return libtransmission::pop_merged_request<peer_request>(msgs->peer_requested_, msgs->max_request_size());
+}
+
+// @return 0 on success, or an errno on failure
+[[nodiscard]] int read_request(tr_peerMsgsImpl* msgs, peer_request const& req, uint8_t* setme)
+{
+    auto* const tor = msgs->torrent;
+
+    // the cache reads a block at a time
+    for (auto n_read = uint32_t{}; n_read < req.length;)
+    {
+        auto const loc = tor->piece_loc(req.index, req.offset + n_read);
+        auto const len = std::min(req.length - n_read, tor->block_size(loc.block) - loc.block_offset);
+        if (auto const err = msgs->session->cache->read_block(tor, loc, len, setme + n_read); err != 0)
+        {
+            return err;
+        }
+
+        n_read += len;
+    }
+
+    return 0;
+}
+
+size_t send_reject(tr_peerMsgsImpl* msgs, peer_request const& req)
+{
+    if (req.length <= tr_block_info::BlockSize)
+    {
+        return protocolSendReject(msgs, &req);
+    }
+
+    // the peer asked for these blocks one at a time
+    auto n_bytes = size_t{};
+    libtransmission::for_each_block_request(
+        req,
+        [msgs, &n_bytes](peer_request const& block_req) { n_bytes += protocolSendReject(msgs, &block_req); });
+    return n_bytes;
+}
+} // namespace add_next_piece_helpers
+
 [[nodiscard]] size_t add_next_piece(tr_peerMsgsImpl* msgs, uint64_t now)
 {
+    using namespace add_next_piece_helpers;
+
     if (msgs->io->get_write_buffer_space(now) == 0U || std::empty(msgs->peer_requested_))
     {
         return {};
     }
 
-    auto const req = msgs->peer_requested_.front();
-    msgs->peer_requested_.erase(std::begin(msgs->peer_requested_));
-
-    auto buf = std::array<uint8_t, tr_block_info::BlockSize>{};
+    auto const timer = tr_torrent_usage::Timer{ msgs->torrent->usage(), tr_torrent_usage::ServeUsec };
+    auto const req = pop_next_request(msgs);
     auto ok = msgs->isValidRequest(req) && msgs->torrent->has_piece(req.index);
 
     if (ok)
@@ -1915,10 +2835,18 @@ namespace peer_pulse_helpers
         }
     }
 
+    if (ok && msgs->io->supports_sendfile())
+    {
+        if (auto const n_bytes = send_piece_from_file(msgs, req); n_bytes != 0U)
+        {
+            return n_bytes;
+        }
+    }
+
+    auto buf = small::vector<uint8_t, tr_block_info::BlockSize>(req.length);
     if (ok)
     {
-        ok = msgs->session->cache
-                 ->read_block(msgs->torrent, msgs->torrent->piece_loc(req.index, req.offset), req.length, std::data(buf)) == 0;
+        ok = read_request(msgs, req, std::data(buf)) == 0;
     }
 
     if (ok)
@@ -1929,7 +2857,7 @@ namespace peer_pulse_helpers
 
     if (msgs->io->supports_fext())
     {
-        return protocolSendReject(msgs, &req);
+        return send_reject(msgs, req);
     }
 
     return {};
@@ -1977,6 +2905,8 @@ void peerPulse(void* vmsgs)
     auto* msgs = static_cast<tr_peerMsgsImpl*>(vmsgs);
     auto const now = tr_time();
 
+    msgs->maybe_send_pending_haves(tr_time_msec());
+    msgs->update_super_seeding(now);
     updateDesiredRequestCount(msgs);
     updateBlockRequests(msgs);
     updateMetadataRequests(msgs, now);
@@ -1988,6 +2918,8 @@ void peerPulse(void* vmsgs)
             break;
         }
     }
+
+    msgs->io->release_idle_buffers(tr_time_msec());
 }
 
 void gotError(tr_peerIo* /*io*/, tr_error const& /*error*/, void* vmsgs)
@@ -1999,6 +2931,19 @@ void tellPeerWhatWeHave(tr_peerMsgsImpl* msgs)
 {
     bool const fext = msgs->io->supports_fext();
 
+    // BEP 16: look like a new peer and offer the pieces one at a time
+    if (msgs->torrent->is_super_seeding() && msgs->torrent->has_all())
+    {
+        msgs->begin_super_seeding();
+
+        if (fext)
+        {
+            protocol_send_message(msgs, BtPeerMsgs::FextHaveNone);
+        }
+
+        return;
+    }
+
     if (fext && msgs->torrent->has_all())
     {
         protocol_send_message(msgs, BtPeerMsgs::FextHaveAll);
@@ -2009,18 +2954,14 @@ void tellPeerWhatWeHave(tr_peerMsgsImpl* msgs)
     }
     else if (!msgs->torrent->has_none())
     {
-        protocol_send_message(msgs, BtPeerMsgs::Bitfield, msgs->torrent->create_piece_bitfield());
+        protocol_send_message(msgs, BtPeerMsgs::Bitfield, msgs->torrent->piece_bitfield());
     }
 }
 
-void tr_peerMsgsImpl::sendPex()
+// @return a benc'ed ut_pex payload with the peers in `new_pex` but not in
+// `old_pex` as added, and those in `old_pex` but not in `new_pex` as dropped
+[[nodiscard]] std::string make_pex_payload(tr_pex_snapshot::PexLists const& old_pex, tr_pex_snapshot::PexLists const& new_pex)
 {
-    // only send pex if both the torrent and peer support it
-    if (!this->peerSupportsPex || !this->torrent->allows_pex())
-    {
-        return;
-    }
-
     static auto constexpr MaxPexAdded = size_t{ 50 };
     static auto constexpr MaxPexDropped = size_t{ 50 };
 
@@ -2036,23 +2977,21 @@ void tr_peerMsgsImpl::sendPex()
         static auto constexpr DroppedMap = std::array{ TR_KEY_dropped, TR_KEY_dropped6 };
         auto const ip_type = static_cast<tr_address_type>(i);
 
-        auto& old_pex = pex[i];
-        auto new_pex = tr_peerMgrGetPeers(this->torrent, ip_type, TR_PEERS_CONNECTED, MaxPexPeerCount);
         auto added = std::vector<tr_pex>{};
-        added.reserve(std::size(new_pex));
+        added.reserve(std::size(new_pex[i]));
         std::set_difference(
-            std::begin(new_pex),
-            std::end(new_pex),
-            std::begin(old_pex),
-            std::end(old_pex),
+            std::begin(new_pex[i]),
+            std::end(new_pex[i]),
+            std::begin(old_pex[i]),
+            std::end(old_pex[i]),
             std::back_inserter(added));
         auto dropped = std::vector<tr_pex>{};
-        dropped.reserve(std::size(old_pex));
+        dropped.reserve(std::size(old_pex[i]));
         std::set_difference(
-            std::begin(old_pex),
-            std::end(old_pex),
-            std::begin(new_pex),
-            std::end(new_pex),
+            std::begin(old_pex[i]),
+            std::end(old_pex[i]),
+            std::begin(new_pex[i]),
+            std::end(new_pex[i]),
             std::back_inserter(dropped));
 
         // Some peers give us error messages if we send
@@ -2061,25 +3000,6 @@ void tr_peerMsgsImpl::sendPex()
         added.resize(std::min(std::size(added), MaxPexAdded));
         dropped.resize(std::min(std::size(dropped), MaxPexDropped));
 
-        logtrace(
-            this,
-            fmt::format(
-                FMT_STRING("pex: old {:s} peer count {:d}, new peer count {:d}, added {:d}, dropped {:d}"),
-                tr_ip_protocol_sv(ip_type),
-                std::size(old_pex),
-                std::size(new_pex),
-                std::size(added),
-                std::size(dropped)));
-
-        // if there's nothing to send, then we're done
-        if (std::empty(added) && std::empty(dropped))
-        {
-            continue;
-        }
-
-        // update msgs
-        std::swap(old_pex, new_pex);
-
         // build the pex payload
         if (!std::empty(added))
         {
@@ -2114,9 +3034,52 @@ void tr_peerMsgsImpl::sendPex()
         }
     }
 
-    protocol_send_message(this, BtPeerMsgs::Ltep, this->ut_pex_id, tr_variantToStr(&val, TR_VARIANT_FMT_BENC));
-
+    auto ret = tr_variantToStr(&val, TR_VARIANT_FMT_BENC);
     tr_variantClear(&val);
+    return ret;
+}
+
+void tr_peerMsgsImpl::sendPex()
+{
+    // only send pex if both the torrent and peer support it
+    if (!this->peerSupportsPex || !this->torrent->allows_pex())
+    {
+        return;
+    }
+
+    // The swarm builds one snapshot per interval for all of its peers.
+    // It is rebuilt a little more often than we send, so that we usually get
+    // the one right after the last we were sent, whose payload is shared.
+    auto snapshot = tr_peerMgrGetPexSnapshot(this->torrent, MaxPexPeerCount, SendPexInterval - SendPexIntervalSlack);
+    auto const sent_generation = pex_sent_ ? pex_sent_->generation : 0U;
+
+    auto payload = std::string{};
+    if (sent_generation + 1U == snapshot->generation)
+    {
+        if (!snapshot->delta_payload)
+        {
+            snapshot->delta_payload = make_pex_payload(snapshot->previous_peers, snapshot->peers);
+        }
+
+        payload = *snapshot->delta_payload;
+    }
+    else
+    {
+        payload = make_pex_payload(pex_sent_ ? pex_sent_->peers : tr_pex_snapshot::PexLists{}, snapshot->peers);
+    }
+
+    logtrace(
+        this,
+        fmt::format(
+            FMT_STRING("pex: sending snapshot {:d} (last sent {:d}), {:d} ipv4 peers, {:d} ipv6 peers"),
+            snapshot->generation,
+            sent_generation,
+            std::size(snapshot->peers[TR_AF_INET]),
+            std::size(snapshot->peers[TR_AF_INET6])));
+
+    pex_sent_ = std::move(snapshot);
+
+    protocol_send_message(this, BtPeerMsgs::Ltep, this->ut_pex_id, payload);
 }
 
 } // namespace
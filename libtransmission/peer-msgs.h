@@ -13,6 +13,7 @@
 #include <atomic>
 #include <cstddef> // for size_t
 #include <memory>
+#include <optional>
 
 #include "libtransmission/transmission.h" // for tr_direction, tr_block_ind...
 
@@ -97,6 +98,19 @@ public:
 
     [[nodiscard]] virtual tr_socket_address socket_address() const = 0;
 
+    // how many block requests we try to keep in flight to this peer
+    [[nodiscard]] virtual size_t request_queue_length() const noexcept = 0;
+
+    // when super-seeding, the piece we've offered this peer and are
+    // waiting for it to download
+    [[nodiscard]] virtual std::optional<tr_piece_index_t> super_seed_offer() const noexcept = 0;
+
+    // @return the memory held by the connection's read and write buffers
+    [[nodiscard]] virtual size_t buffer_bytes() const noexcept = 0;
+
+    // Free what memory the connection's buffers can spare
+    virtual void release_buffers() = 0;
+
     virtual void cancel_block_request(tr_block_index_t block) = 0;
 
     virtual void set_choke(bool peer_is_choked) = 0;
@@ -3,6 +3,14 @@
 // or any future license endorsed by Mnemosyne LLC.
 // License text can be found in the licenses/ folder.
 
+#include <algorithm>
+#include <array>
+#include <cerrno>
+
+#ifdef HAVE_SENDFILE64
+#include <sys/sendfile.h>
+#endif
+
 #include <fmt/core.h>
 
 #include <libutp/utp.h>
@@ -10,6 +18,7 @@
 #include "libtransmission/transmission.h"
 
 #include "libtransmission/peer-socket.h"
+#include "libtransmission/file.h"
 #include "libtransmission/net.h"
 #include "libtransmission/session.h"
 
@@ -27,10 +36,20 @@ tr_peer_socket::tr_peer_socket(tr_session const* session, tr_socket_address cons
 
     ++n_open_sockets_;
     session->setSocketTOS(sock, address().type);
+    tr_netSetNotSentLowat(sock, session->peerSocketNotSentLowat());
 
-    if (auto const& algo = session->peerCongestionAlgorithm(); !std::empty(algo))
+    // The congestion algorithm and buffer sizes are meant for paths across
+    // the internet, so LAN peers keep the OS's defaults.
+    if (address().is_global_unicast_address())
     {
-        tr_netSetCongestionControl(sock, algo.c_str());
+        if (auto const& algo = session->peerCongestionAlgorithm(); !std::empty(algo))
+        {
+            tr_netSetCongestionControl(sock, algo.c_str());
+        }
+
+        send_buffer_ = session->peerSocketSendBuffer();
+        receive_buffer_ = session->peerSocketReceiveBuffer();
+        tr_netSetSocketBuffers(sock, send_buffer_, receive_buffer_);
     }
 
     tr_logAddTraceIo(this, fmt::format("socket (tcp) is {}", handle.tcp));
@@ -68,7 +87,33 @@ void tr_peer_socket::close()
     handle = {};
 }
 
-size_t tr_peer_socket::try_write(OutBuf& buf, size_t max, tr_error** error) const
+void tr_peer_socket::grow_buffers(size_t send_bytes, size_t receive_bytes)
+{
+    if (!is_tcp())
+    {
+        return;
+    }
+
+    // only grow by a quarter or more, to avoid a syscall on every RTT sample
+    auto const grown = [](size_t current, size_t wanted)
+    {
+        wanted = std::min(wanted, MaxBufferSize);
+        return current != 0U && wanted > current + current / 4U ? wanted : size_t{};
+    };
+
+    auto const send_size = grown(send_buffer_, send_bytes);
+    auto const receive_size = grown(receive_buffer_, receive_bytes);
+    if (send_size == 0U && receive_size == 0U)
+    {
+        return;
+    }
+
+    tr_netSetSocketBuffers(handle.tcp, send_size, receive_size);
+    send_buffer_ = std::max(send_buffer_, send_size);
+    receive_buffer_ = std::max(receive_buffer_, receive_size);
+}
+
+size_t tr_peer_socket::try_write(OutBuf& buf, size_t max, [[maybe_unused]] bool more, tr_error** error) const
 {
     if (max == size_t{})
     {
@@ -77,7 +122,12 @@ size_t tr_peer_socket::try_write(OutBuf& buf, size_t max, tr_error** error) cons
 
     if (is_tcp())
     {
-        return buf.to_socket(handle.tcp, max, error);
+#ifdef MSG_MORE
+        auto const flags = more ? MSG_MORE : 0;
+#else
+        auto const flags = 0;
+#endif
+        return buf.to_socket(handle.tcp, max, flags, error);
     }
 
 #ifdef WITH_UTP
@@ -105,6 +155,53 @@ size_t tr_peer_socket::try_write(OutBuf& buf, size_t max, tr_error** error) cons
     return {};
 }
 
+size_t tr_peer_socket::try_write_file(tr_sys_file_t fd, uint64_t offset, size_t n_bytes, tr_error** error) const
+{
+    TR_ASSERT(is_tcp());
+
+    if (n_bytes == size_t{} || !is_tcp())
+    {
+        return {};
+    }
+
+#ifdef HAVE_SENDFILE64
+    auto file_offset = static_cast<off64_t>(offset);
+    auto const n_sent = sendfile64(handle.tcp, fd, &file_offset, n_bytes);
+    auto const err = errno;
+
+    if (n_sent > 0)
+    {
+        return static_cast<size_t>(n_sent);
+    }
+
+    // sending nothing means we hit the end of the file
+    tr_error_set_from_errno(error, n_sent == 0 ? EIO : err);
+    return {};
+#else
+    auto buf = std::array<char, 16384>{};
+    auto n_read = uint64_t{};
+    if (!tr_sys_file_read_at(fd, std::data(buf), std::min(n_bytes, std::size(buf)), offset, &n_read, error))
+    {
+        return {};
+    }
+
+    if (n_read == 0U)
+    {
+        tr_error_set_from_errno(error, EIO);
+        return {};
+    }
+
+    if (auto const n_sent = send(handle.tcp, std::data(buf), n_read, 0); n_sent >= 0)
+    {
+        return static_cast<size_t>(n_sent);
+    }
+
+    auto const err = sockerrno;
+    tr_error_set(error, err, tr_net_strerror(err));
+    return {};
+#endif
+}
+
 size_t tr_peer_socket::try_read(InBuf& buf, size_t max, [[maybe_unused]] bool buf_is_empty, tr_error** error) const
 {
     if (max == size_t{})
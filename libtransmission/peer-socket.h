@@ -18,6 +18,7 @@
 #include "transmission.h"
 
 #include "error.h"
+#include "file.h"
 #include "net.h"
 #include "tr-assert.h"
 #include "tr-buffer.h"
@@ -45,6 +46,8 @@ public:
         handle = s.handle;
         socket_address_ = s.socket_address_;
         type_ = s.type_;
+        send_buffer_ = s.send_buffer_;
+        receive_buffer_ = s.receive_buffer_;
         // invalidate s.type_, s.handle so s.close() won't break anything
         s.type_ = Type::None;
         s.handle = {};
@@ -58,7 +61,13 @@ public:
     void close();
 
     size_t try_read(InBuf& buf, size_t max, bool buf_is_empty, tr_error** error) const;
-    size_t try_write(OutBuf& buf, size_t max, tr_error** error) const;
+    // If `more` is true, the caller is about to send more data, so a
+    // TCP socket can hold this data back to send it in full-sized segments.
+    size_t try_write(OutBuf& buf, size_t max, bool more, tr_error** error) const;
+
+    // Send `n_bytes` of `fd` starting at `offset` straight from the file.
+    // Only TCP sockets are supported.
+    size_t try_write_file(tr_sys_file_t fd, uint64_t offset, size_t n_bytes, tr_error** error) const;
 
     [[nodiscard]] constexpr auto const& socket_address() const noexcept
     {
@@ -144,7 +153,15 @@ public:
 
     [[nodiscard]] static bool limit_reached(tr_session* session) noexcept;
 
+    // Grow the socket's buffers, if they were sized explicitly rather than
+    // left to the OS, so that they can hold a high-RTT peer's bandwidth-delay
+    // product. Otherwise a small fixed buffer would cap the transfer rate.
+    void grow_buffers(size_t send_bytes, size_t receive_bytes);
+
 private:
+    // don't autotune past this
+    static auto constexpr MaxBufferSize = size_t{ 16U * 1024U * 1024U };
+
     enum class Type
     {
         None,
@@ -156,6 +173,10 @@ private:
 
     enum Type type_ = Type::None;
 
+    // explicit buffer sizes, or 0 if the OS is autotuning them
+    size_t send_buffer_ = 0U;
+    size_t receive_buffer_ = 0U;
+
     static inline std::atomic<size_t> n_open_sockets_ = {};
 };
 
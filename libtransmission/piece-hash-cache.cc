@@ -0,0 +1,66 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm> // std::min()
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include "libtransmission/transmission.h"
+
+#include "libtransmission/error.h"
+#include "libtransmission/log.h"
+#include "libtransmission/piece-hash-cache.h"
+#include "libtransmission/torrent-metainfo.h"
+#include "libtransmission/tr-assert.h"
+#include "libtransmission/utils.h" // _()
+
+std::optional<tr_sha1_digest_t> tr_piece_hash_cache::get(
+    tr_torrent_id_t tor_id,
+    tr_torrent_metainfo const& metainfo,
+    std::string_view torrent_file,
+    tr_piece_index_t piece)
+{
+    TR_ASSERT(piece < metainfo.piece_count());
+
+    auto const chunk = piece / ChunkSize;
+    auto const chunk_begin = chunk * ChunkSize;
+
+    auto const lock = std::lock_guard{ mutex_ };
+
+    auto key = Key{ tor_id, chunk };
+    auto* hashes = chunks_.get(key);
+    if (hashes == nullptr)
+    {
+        tr_error* error = nullptr;
+        auto const n_pieces = std::min(ChunkSize, metainfo.piece_count() - chunk_begin);
+        auto loaded = metainfo.read_piece_hashes(torrent_file, chunk_begin, n_pieces, &error);
+        if (!loaded)
+        {
+            tr_logAddError(fmt::format(
+                _("Couldn't read piece hashes from '{path}': {error} ({error_code})"),
+                fmt::arg("path", torrent_file),
+                fmt::arg("error", error != nullptr ? error->message : "short read"),
+                fmt::arg("error_code", error != nullptr ? error->code : 0)));
+            tr_error_clear(&error);
+            return {};
+        }
+
+        hashes = &chunks_.add(std::move(key));
+        *hashes = std::move(*loaded);
+    }
+
+    return (*hashes)[piece - chunk_begin];
+}
+
+void tr_piece_hash_cache::erase(tr_torrent_id_t tor_id)
+{
+    auto const lock = std::lock_guard{ mutex_ };
+    chunks_.erase_if([tor_id](Key const& key, auto const& /*hashes*/) { return key.first == tor_id; });
+}
@@ -0,0 +1,56 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <cstddef> // size_t
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "libtransmission/transmission.h" // tr_piece_index_t, tr_torrent_id_t
+
+#include "libtransmission/lru-cache.h"
+#include "libtransmission/tr-macros.h" // tr_sha1_digest_t
+
+struct tr_torrent_metainfo;
+
+/**
+ * Piece hashes for torrents whose metainfo dropped them to save memory.
+ * Hashes are read back from the .torrent file in chunks, so that verifying
+ * a torrent doesn't need a read per piece, and the most recently used
+ * chunks are kept. This is shared by every torrent in the session.
+ *
+ * This is safe to use from multiple threads, e.g. the verify thread.
+ */
+class tr_piece_hash_cache
+{
+public:
+    // Hashes are read this many pieces at a time
+    static auto constexpr ChunkSize = tr_piece_index_t{ 1024U };
+
+    [[nodiscard]] std::optional<tr_sha1_digest_t> get(
+        tr_torrent_id_t tor_id,
+        tr_torrent_metainfo const& metainfo,
+        std::string_view torrent_file,
+        tr_piece_index_t piece);
+
+    void erase(tr_torrent_id_t tor_id);
+
+private:
+    // torrent id, chunk index
+    using Key = std::pair<tr_torrent_id_t, tr_piece_index_t>;
+
+    static auto constexpr MaxChunks = size_t{ 64U };
+
+    std::mutex mutex_;
+    tr_lru_cache<Key, std::vector<tr_sha1_digest_t>, MaxChunks> chunks_;
+};
@@ -0,0 +1,70 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+#include "libtransmission/crypto-utils.h"
+#include "libtransmission/executor.h"
+#include "libtransmission/piece-hasher.h"
+
+tr_piece_hasher::tr_piece_hasher(Mediator& mediator, tr_executor& executor, size_t max_threads)
+    : mediator_{ mediator }
+    , executor_{ executor }
+    , max_threads_{ std::max(max_threads, size_t{ 1U }) }
+{
+}
+
+tr_piece_hasher::~tr_piece_hasher()
+{
+    // finish the jobs that are already queued so that every caller gets its verdict
+    auto lock = std::unique_lock(mutex_);
+    cv_.wait(lock, [this]() { return n_runners_ == 0U; });
+}
+
+void tr_piece_hasher::add(Data&& data, tr_sha1_digest_t const& expected, DoneFunc&& on_done)
+{
+    auto const lock = std::lock_guard(mutex_);
+    todo_.push_back(Job{ std::move(data), expected, std::move(on_done) });
+    maybe_start_runner();
+}
+
+void tr_piece_hasher::maybe_start_runner()
+{
+    // start runners lazily, one per job, up to `max_threads_`
+    if (n_runners_ < max_threads_ && n_runners_ < std::size(todo_) + n_busy_)
+    {
+        ++n_runners_;
+        executor_.submit([this]() { run(); }, tr_executor::Priority::Normal);
+    }
+}
+
+void tr_piece_hasher::run()
+{
+    auto sha = tr_sha1_context{};
+    auto lock = std::unique_lock(mutex_);
+
+    while (!std::empty(todo_))
+    {
+        auto job = std::move(todo_.front());
+        todo_.pop_front();
+        ++n_busy_;
+        lock.unlock();
+
+        sha.add(std::data(job.data), std::size(job.data));
+        auto const pass = sha.finish() == job.expected;
+        job.data = {}; // release the piece data before waiting for the verdict to be delivered
+
+        mediator_.post([on_done = std::move(job.on_done), pass]() { on_done(pass); });
+
+        lock.lock();
+        --n_busy_;
+    }
+
+    --n_runners_;
+    cv_.notify_all();
+}
@@ -0,0 +1,88 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <condition_variable>
+#include <cstddef> // size_t
+#include <cstdint> // uint8_t
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include "libtransmission/tr-macros.h" // tr_sha1_digest_t
+
+class tr_executor;
+
+// Checks the checksums of newly-completed pieces in a `tr_executor`
+// so that hashing large pieces doesn't stall the session thread.
+class tr_piece_hasher
+{
+public:
+    using Data = std::vector<uint8_t>;
+
+    // Invoked with the verdict after `Mediator::post()` has
+    // delivered it back to the caller's thread.
+    using DoneFunc = std::function<void(bool pass)>;
+
+    class Mediator
+    {
+    public:
+        virtual ~Mediator() = default;
+
+        // Run `func` in the thread that's waiting for verdicts,
+        // e.g. `tr_session::runInSessionThread()`.
+        virtual void post(std::function<void(void)>&& func) = 0;
+    };
+
+    static auto constexpr DefaultMaxThreads = size_t{ 2U };
+
+    // `max_threads` is how many of `executor`'s threads may hash at once
+    tr_piece_hasher(Mediator& mediator, tr_executor& executor, size_t max_threads = DefaultMaxThreads);
+    ~tr_piece_hasher();
+
+    tr_piece_hasher(tr_piece_hasher const&) = delete;
+    tr_piece_hasher(tr_piece_hasher&&) = delete;
+    tr_piece_hasher& operator=(tr_piece_hasher const&) = delete;
+    tr_piece_hasher& operator=(tr_piece_hasher&&) = delete;
+
+    void add(Data&& data, tr_sha1_digest_t const& expected, DoneFunc&& on_done);
+
+    [[nodiscard]] size_t size() const
+    {
+        auto const lock = std::lock_guard(mutex_);
+        return std::size(todo_) + n_busy_;
+    }
+
+private:
+    struct Job
+    {
+        Data data;
+        tr_sha1_digest_t expected;
+        DoneFunc on_done;
+    };
+
+    void maybe_start_runner();
+    void run();
+
+    Mediator& mediator_;
+    tr_executor& executor_;
+    size_t const max_threads_;
+
+    mutable std::mutex mutex_;
+
+    // notified when a runner exits
+    std::condition_variable cv_;
+    std::deque<Job> todo_;
+
+    // how many tasks are running in `executor_`
+    size_t n_runners_ = 0;
+    size_t n_busy_ = 0;
+};
@@ -0,0 +1,201 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <ctime> // time_t
+#include <memory>
+#include <set>
+#include <string>
+#include <utility> // std::exchange(), std::move()
+#include <vector>
+
+#include <fmt/core.h>
+
+#include "libtransmission/disk-writer.h"
+#include "libtransmission/log.h"
+#include "libtransmission/piece-syncer.h"
+#include "libtransmission/utils.h" // _(), tr_strerror()
+
+void tr_piece_syncer::set_interval(time_t secs)
+{
+    if (secs <= 0)
+    {
+        sync_all();
+        writer_.reset();
+        interval_ = 0;
+
+        // anything that couldn't be committed is the OS' to flush now
+        for (auto const& [tor_id, pending] : std::exchange(pending_, {}))
+        {
+            mediator_.on_synced(tor_id);
+        }
+
+        return;
+    }
+
+    interval_ = secs;
+}
+
+void tr_piece_syncer::add(tr_torrent_id_t tor_id, tr_piece_index_t piece, tr_file_index_t file_begin, tr_file_index_t file_end)
+{
+    if (!enabled())
+    {
+        return;
+    }
+
+    auto& pending = pending_[tor_id];
+    pending.pieces.insert(piece);
+    for (auto file = file_begin; file < file_end; ++file)
+    {
+        pending.files.insert(file);
+    }
+}
+
+std::vector<tr_piece_index_t> tr_piece_syncer::unsynced_pieces(tr_torrent_id_t tor_id) const
+{
+    auto ret = std::set<tr_piece_index_t>{};
+
+    if (auto const iter = pending_.find(tor_id); iter != std::end(pending_))
+    {
+        ret = iter->second.pieces;
+    }
+
+    for (auto const& [id, batch] : syncing_)
+    {
+        if (auto const iter = batch.find(tor_id); iter != std::end(batch))
+        {
+            ret.insert(std::begin(iter->second.pieces), std::end(iter->second.pieces));
+        }
+    }
+
+    return { std::begin(ret), std::end(ret) };
+}
+
+void tr_piece_syncer::erase(tr_torrent_id_t tor_id)
+{
+    pending_.erase(tor_id);
+
+    for (auto& [id, batch] : syncing_)
+    {
+        batch.erase(tor_id);
+    }
+}
+
+void tr_piece_syncer::pulse(time_t now)
+{
+    reap();
+
+    if (!enabled() || now < last_commit_ + interval_)
+    {
+        return;
+    }
+
+    last_commit_ = now;
+    commit();
+}
+
+void tr_piece_syncer::sync_all()
+{
+    commit();
+
+    if (writer_)
+    {
+        writer_->wait(0U);
+        reap();
+    }
+}
+
+void tr_piece_syncer::merge(Batch& tgt, Batch&& src)
+{
+    for (auto& [tor_id, pending] : src)
+    {
+        auto& tgt_pending = tgt[tor_id];
+        tgt_pending.pieces.merge(pending.pieces);
+        tgt_pending.files.merge(pending.files);
+    }
+}
+
+void tr_piece_syncer::commit()
+{
+    auto batch = Batch{};
+    auto filenames = std::vector<std::string>{};
+
+    for (auto iter = std::begin(pending_); iter != std::end(pending_);)
+    {
+        auto const& [tor_id, pending] = *iter;
+
+        // hand the cached blocks to the OS before asking it to flush them.
+        // If that fails, the cache has already flagged the torrent; try again next time.
+        auto ok = true;
+        for (auto const file : pending.files)
+        {
+            if (mediator_.flush_file(tor_id, file) != 0)
+            {
+                ok = false;
+                break;
+            }
+        }
+
+        if (!ok)
+        {
+            ++iter;
+            continue;
+        }
+
+        for (auto const file : pending.files)
+        {
+            if (auto filename = mediator_.find_file(tor_id, file); filename)
+            {
+                filenames.emplace_back(std::move(*filename));
+            }
+        }
+
+        batch.insert(pending_.extract(iter++));
+    }
+
+    if (std::empty(batch))
+    {
+        return;
+    }
+
+    if (!writer_)
+    {
+        writer_ = std::make_unique<tr_disk_writer>();
+    }
+
+    syncing_.try_emplace(writer_->add_sync(filenames), std::move(batch));
+}
+
+void tr_piece_syncer::reap()
+{
+    if (!writer_)
+    {
+        return;
+    }
+
+    for (auto& [id, err, filename, msec] : writer_->take_finished())
+    {
+        auto node = syncing_.extract(id);
+        if (!node)
+        {
+            continue;
+        }
+
+        if (err != 0)
+        {
+            tr_logAddWarn(fmt::format(
+                _("Couldn't flush '{path}' to disk: {error} ({error_code})"),
+                fmt::arg("path", filename),
+                fmt::arg("error", tr_strerror(err)),
+                fmt::arg("error_code", err)));
+            merge(pending_, std::move(node.mapped()));
+            continue;
+        }
+
+        for (auto const& [tor_id, pending] : node.mapped())
+        {
+            mediator_.on_synced(tor_id);
+        }
+    }
+}
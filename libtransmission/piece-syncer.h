@@ -0,0 +1,113 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <ctime> // time_t
+#include <map>
+#include <memory>
+#include <optional>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "libtransmission/transmission.h" // tr_file_index_t, tr_piece_index_t, tr_torrent_id_t
+
+#include "libtransmission/disk-writer.h"
+
+/**
+ * Makes newly-completed pieces durable with periodic group commits.
+ *
+ * Instead of flushing every write, the files touched by the pieces that
+ * completed since the last commit are flushed with fdatasync() together,
+ * across every torrent, on a background thread. Until that's done the
+ * pieces are left out of their torrent's saved progress, so a crash can't
+ * leave the resume data claiming pieces that never reached the disk.
+ */
+class tr_piece_syncer
+{
+public:
+    class Mediator
+    {
+    public:
+        virtual ~Mediator() = default;
+
+        // Write out the file's cached blocks.
+        // @return 0 on success, or an errno value on failure
+        virtual int flush_file(tr_torrent_id_t tor_id, tr_file_index_t file) = 0;
+
+        // @return the file's path, or nullopt if it's not on disk
+        [[nodiscard]] virtual std::optional<std::string> find_file(tr_torrent_id_t tor_id, tr_file_index_t file) const = 0;
+
+        // The torrent's pieces have reached the disk, e.g. so its progress should be saved again
+        virtual void on_synced(tr_torrent_id_t tor_id) = 0;
+    };
+
+    explicit tr_piece_syncer(Mediator& mediator) noexcept
+        : mediator_{ mediator }
+    {
+    }
+
+    tr_piece_syncer(tr_piece_syncer const&) = delete;
+    tr_piece_syncer(tr_piece_syncer&&) = delete;
+    tr_piece_syncer& operator=(tr_piece_syncer const&) = delete;
+    tr_piece_syncer& operator=(tr_piece_syncer&&) = delete;
+
+    // How often to commit. Zero leaves flushing to the OS; any pieces
+    // that are still waiting are committed first.
+    void set_interval(time_t secs);
+
+    [[nodiscard]] constexpr auto enabled() const noexcept
+    {
+        return interval_ > 0;
+    }
+
+    // Queue a completed piece, and the files in [file_begin, file_end) that it touches, for the next commit
+    void add(tr_torrent_id_t tor_id, tr_piece_index_t piece, tr_file_index_t file_begin, tr_file_index_t file_end);
+
+    // @return the torrent's completed pieces that may not have reached the disk yet
+    [[nodiscard]] std::vector<tr_piece_index_t> unsynced_pieces(tr_torrent_id_t tor_id) const;
+
+    // Forget a torrent that's going away
+    void erase(tr_torrent_id_t tor_id);
+
+    // Cheap to call once a second. Finishes the commits that are done
+    // and, once per interval, starts the next one.
+    void pulse(time_t now);
+
+    // Commit everything now and wait for it, e.g. when shutting down
+    void sync_all();
+
+private:
+    struct Pending
+    {
+        std::set<tr_piece_index_t> pieces;
+        std::set<tr_file_index_t> files;
+    };
+
+    using Batch = std::map<tr_torrent_id_t, Pending>;
+
+    static void merge(Batch& tgt, Batch&& src);
+
+    void commit();
+    void reap();
+
+    Mediator& mediator_;
+
+    // pieces waiting for the next commit
+    Batch pending_;
+
+    // pieces in the commits that are running
+    std::map<tr_disk_writer::JobId, Batch> syncing_;
+
+    std::unique_ptr<tr_disk_writer> writer_;
+
+    time_t interval_ = 0;
+    time_t last_commit_ = 0;
+};
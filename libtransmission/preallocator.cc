@@ -0,0 +1,180 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include <fmt/core.h>
+
+#include "libtransmission/error-types.h"
+#include "libtransmission/error.h"
+#include "libtransmission/file.h"
+#include "libtransmission/log.h"
+#include "libtransmission/preallocator.h"
+#include "libtransmission/tr-strbuf.h"
+#include "libtransmission/utils.h" // _()
+
+tr_preallocator::~tr_preallocator()
+{
+    {
+        auto const lock = std::lock_guard(mutex_);
+        stopping_ = true;
+    }
+
+    cv_.notify_all();
+
+    if (thread_.joinable())
+    {
+        thread_.join();
+    }
+}
+
+void tr_preallocator::add(tr_torrent_id_t id, std::vector<File>&& files, tr_preallocation_mode mode)
+{
+    if (mode == TR_PREALLOCATE_NONE || std::empty(files))
+    {
+        return;
+    }
+
+    {
+        auto const lock = std::lock_guard(mutex_);
+
+        jobs_.remove_if([id](auto const& job) { return job.id == id; });
+
+        auto& job = jobs_.emplace_back();
+        job.id = id;
+        job.files = std::move(files);
+        job.mode = mode;
+        for (auto const& file : job.files)
+        {
+            job.bytes_total += file.size;
+        }
+
+        if (!thread_.joinable())
+        {
+            thread_ = std::thread{ &tr_preallocator::thread_func, this };
+        }
+    }
+
+    cv_.notify_one();
+}
+
+void tr_preallocator::remove(tr_torrent_id_t id)
+{
+    auto const lock = std::lock_guard(mutex_);
+
+    jobs_.remove_if([id](auto const& job) { return job.id == id; });
+}
+
+std::optional<double> tr_preallocator::progress(tr_torrent_id_t id) const
+{
+    auto const lock = std::lock_guard(mutex_);
+
+    for (auto const& job : jobs_)
+    {
+        if (job.id == id)
+        {
+            return job.bytes_total == 0U ? 1.0 : static_cast<double>(job.bytes_done) / job.bytes_total;
+        }
+    }
+
+    return {};
+}
+
+void tr_preallocator::thread_func()
+{
+    auto lock = std::unique_lock(mutex_);
+
+    for (;;)
+    {
+        cv_.wait(lock, [this]() { return stopping_ || !std::empty(jobs_); });
+
+        if (stopping_)
+        {
+            return;
+        }
+
+        auto& job = jobs_.front();
+        auto const id = job.id;
+        auto const mode = job.mode;
+        auto const file = job.files[job.next_file++];
+        lock.unlock();
+
+        preallocate(file, mode);
+
+        // the job may have been removed while we were busy
+        lock.lock();
+        auto const iter = std::find_if(std::begin(jobs_), std::end(jobs_), [id](auto const& walk) { return walk.id == id; });
+        if (iter != std::end(jobs_))
+        {
+            iter->bytes_done += file.size;
+            if (iter->next_file >= std::size(iter->files))
+            {
+                jobs_.erase(iter);
+            }
+        }
+    }
+}
+
+void tr_preallocator::preallocate(File const& file, tr_preallocation_mode mode)
+{
+    auto const filename = tr_pathbuf{ file.filename };
+    if (tr_sys_path_exists(filename))
+    {
+        return;
+    }
+
+    tr_error* error = nullptr;
+    if (!tr_sys_dir_create(tr_pathbuf{ tr_sys_path_dirname(filename) }, TR_SYS_DIR_CREATE_PARENTS, 0777, &error))
+    {
+        tr_logAddDebug(fmt::format("Couldn't create '{}': {} ({})", filename, error->message, error->code));
+        tr_error_free(error);
+        return;
+    }
+
+    auto const fd = tr_sys_file_open(filename, TR_SYS_FILE_WRITE | TR_SYS_FILE_CREATE, 0666, &error);
+    if (fd == TR_BAD_SYS_FILE)
+    {
+        tr_logAddDebug(fmt::format("Couldn't open '{}': {} ({})", filename, error->message, error->code));
+        tr_error_free(error);
+        return;
+    }
+
+    auto flags = int{ TR_SYS_FILE_PREALLOC_KEEP_SIZE };
+    if (mode == TR_PREALLOCATE_SPARSE)
+    {
+        flags |= TR_SYS_FILE_PREALLOC_SPARSE;
+    }
+
+    if (tr_sys_file_preallocate(fd, file.size, flags, &error))
+    {
+        tr_logAddDebug(fmt::format("Preallocated file '{}' (size: {})", filename, file.size));
+    }
+    else if (!TR_ERROR_IS_ENOSPC(error->code))
+    {
+        // Couldn't reserve the space without resizing the file. Growing it
+        // is still safe while it's being written, since no write can be past
+        // its final size. Shrinking it wouldn't be, so only ever grow it.
+        tr_error_clear(&error);
+        if (auto const info = tr_sys_path_get_info(filename); info && info->size < file.size)
+        {
+            tr_sys_file_truncate(fd, file.size, &error);
+        }
+    }
+
+    if (error != nullptr)
+    {
+        tr_logAddError(fmt::format(
+            _("Couldn't preallocate '{path}': {error} ({error_code})"),
+            fmt::arg("path", filename),
+            fmt::arg("error", error->message),
+            fmt::arg("error_code", error->code)));
+        tr_error_free(error);
+    }
+
+    tr_sys_file_close(fd);
+}
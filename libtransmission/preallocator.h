@@ -0,0 +1,78 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <condition_variable>
+#include <cstdint> // uint64_t
+#include <list>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "libtransmission/transmission.h" // tr_preallocation_mode, tr_torrent_id_t
+
+// Creates and preallocates torrents' files on a background thread, so
+// that preallocating a large torrent doesn't stall the session thread.
+//
+// The space is reserved without changing the files' sizes where the
+// filesystem allows it, so it's safe to write to a file while it's being
+// preallocated. Elsewhere the files are only extended to their full size.
+class tr_preallocator
+{
+public:
+    struct File
+    {
+        std::string filename;
+        uint64_t size = 0;
+    };
+
+    tr_preallocator() = default;
+    ~tr_preallocator();
+
+    tr_preallocator(tr_preallocator const&) = delete;
+    tr_preallocator(tr_preallocator&&) = delete;
+    tr_preallocator& operator=(tr_preallocator const&) = delete;
+    tr_preallocator& operator=(tr_preallocator&&) = delete;
+
+    // Create and preallocate a torrent's files. Files that already
+    // exist are left alone.
+    void add(tr_torrent_id_t id, std::vector<File>&& files, tr_preallocation_mode mode);
+
+    // Stop preallocating a torrent's files. Doesn't wait for a file
+    // that is being preallocated right now.
+    void remove(tr_torrent_id_t id);
+
+    // @return how much of the torrent's data has been preallocated,
+    // in [0..1], or nullopt if its files aren't being preallocated
+    [[nodiscard]] std::optional<double> progress(tr_torrent_id_t id) const;
+
+private:
+    struct Job
+    {
+        tr_torrent_id_t id = {};
+        std::vector<File> files;
+        tr_preallocation_mode mode = TR_PREALLOCATE_NONE;
+        uint64_t bytes_total = 0;
+        uint64_t bytes_done = 0;
+        size_t next_file = 0;
+    };
+
+    void thread_func();
+
+    static void preallocate(File const& file, tr_preallocation_mode mode);
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::list<Job> jobs_;
+    std::thread thread_;
+    bool stopping_ = false;
+};
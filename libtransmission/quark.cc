@@ -5,8 +5,14 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
+#include <cstdint> // uint16_t, uint32_t
+#include <limits>
+#include <mutex>
+#include <optional>
 #include <string>
 #include <string_view>
+#include <utility> // std::pair
 #include <vector>
 
 #include "libtransmission/quark.h"
@@ -16,10 +22,11 @@ using namespace std::literals;
 namespace
 {
 
-auto constexpr MyStatic = std::array<std::string_view, 404>{ ""sv,
+auto constexpr MyStatic = std::array<std::string_view, 507>{ ""sv,
                                                              "activeTorrentCount"sv,
                                                              "activity-date"sv,
                                                              "activityDate"sv,
+                                                             "adaptive-bandwidth-enabled"sv,
                                                              "added"sv,
                                                              "added-date"sv,
                                                              "added.f"sv,
@@ -42,7 +49,11 @@ auto constexpr MyStatic = std::array<std::string_view, 404>{ ""sv,
                                                              "anti-brute-force-enabled"sv,
                                                              "anti-brute-force-threshold"sv,
                                                              "arguments"sv,
+                                                             "attr"sv,
                                                              "availability"sv,
+                                                             "background"sv,
+                                                             "background-io-limit-iops"sv,
+                                                             "background-io-limit-kbps"sv,
                                                              "bandwidth-priority"sv,
                                                              "bandwidthPriority"sv,
                                                              "beginPiece"sv,
@@ -55,8 +66,18 @@ auto constexpr MyStatic = std::array<std::string_view, 404>{ ""sv,
                                                              "blocklist-updates-enabled"sv,
                                                              "blocklist-url"sv,
                                                              "blocks"sv,
+                                                             "bufferBytes"sv,
                                                              "bytesCompleted"sv,
+                                                             "cache"sv,
+                                                             "cache-async-writes"sv,
                                                              "cache-size-mb"sv,
+                                                             "cacheFlushBytes"sv,
+                                                             "cacheFlushMsec"sv,
+                                                             "cacheFlushWrites"sv,
+                                                             "cache_read_bytes"sv,
+                                                             "cache_reads"sv,
+                                                             "cache_write_bytes"sv,
+                                                             "cache_writes"sv,
                                                              "clientIsChoked"sv,
                                                              "clientIsInterested"sv,
                                                              "clientName"sv,
@@ -68,6 +89,7 @@ auto constexpr MyStatic = std::array<std::string_view, 404>{ ""sv,
                                                              "cookies"sv,
                                                              "corrupt"sv,
                                                              "corruptEver"sv,
+                                                             "count"sv,
                                                              "created by"sv,
                                                              "created by.utf-8"sv,
                                                              "creation date"sv,
@@ -78,11 +100,19 @@ auto constexpr MyStatic = std::array<std::string_view, 404>{ ""sv,
                                                              "dateCreated"sv,
                                                              "default-trackers"sv,
                                                              "delete-local-data"sv,
+                                                             "delta-full"sv,
+                                                             "delta-token"sv,
                                                              "desiredAvailable"sv,
+                                                             "desiredReqsToPeer"sv,
                                                              "destination"sv,
                                                              "details-window-height"sv,
                                                              "details-window-width"sv,
                                                              "dht-enabled"sv,
+                                                             "direct-io-enabled"sv,
+                                                             "disk_read_bytes"sv,
+                                                             "disk_reads"sv,
+                                                             "disk_write_bytes"sv,
+                                                             "disk_writes"sv,
                                                              "dnd"sv,
                                                              "done-date"sv,
                                                              "doneDate"sv,
@@ -112,7 +142,11 @@ auto constexpr MyStatic = std::array<std::string_view, 404>{ ""sv,
                                                              "errorString"sv,
                                                              "eta"sv,
                                                              "etaIdle"sv,
+                                                             "event"sv,
+                                                             "executor-cpu-affinity"sv,
+                                                             "executor-threads"sv,
                                                              "fields"sv,
+                                                             "file tree"sv,
                                                              "file-count"sv,
                                                              "fileStats"sv,
                                                              "filename"sv,
@@ -121,6 +155,7 @@ auto constexpr MyStatic = std::array<std::string_view, 404>{ ""sv,
                                                              "files-unwanted"sv,
                                                              "files-wanted"sv,
                                                              "filesAdded"sv,
+                                                             "filter"sv,
                                                              "filter-mode"sv,
                                                              "filter-text"sv,
                                                              "filter-trackers"sv,
@@ -138,9 +173,11 @@ auto constexpr MyStatic = std::array<std::string_view, 404>{ ""sv,
                                                              "hasAnnounced"sv,
                                                              "hasScraped"sv,
                                                              "hashString"sv,
+                                                             "hash_usec"sv,
                                                              "have"sv,
                                                              "haveUnchecked"sv,
                                                              "haveValid"sv,
+                                                             "hibernate-idle-seeds-minutes"sv,
                                                              "honorsSessionLimits"sv,
                                                              "host"sv,
                                                              "id"sv,
@@ -154,6 +191,7 @@ auto constexpr MyStatic = std::array<std::string_view, 404>{ ""sv,
                                                              "incomplete-dir-enabled"sv,
                                                              "info"sv,
                                                              "inhibit-desktop-hibernation"sv,
+                                                             "io-trace-file"sv,
                                                              "ipv4"sv,
                                                              "ipv6"sv,
                                                              "isBackup"sv,
@@ -165,7 +203,11 @@ auto constexpr MyStatic = std::array<std::string_view, 404>{ ""sv,
                                                              "isStalled"sv,
                                                              "isUTP"sv,
                                                              "isUploadingTo"sv,
+                                                             "kind"sv,
                                                              "labels"sv,
+                                                             "lan-peer-fast-path-enabled"sv,
+                                                             "lan-peer-networks"sv,
+                                                             "large-request-size-kib"sv,
                                                              "lastAnnouncePeerCount"sv,
                                                              "lastAnnounceResult"sv,
                                                              "lastAnnounceStartTime"sv,
@@ -177,10 +219,15 @@ auto constexpr MyStatic = std::array<std::string_view, 404>{ ""sv,
                                                              "lastScrapeSucceeded"sv,
                                                              "lastScrapeTime"sv,
                                                              "lastScrapeTimedOut"sv,
+                                                             "lazy-piece-hashes-enabled"sv,
                                                              "leecherCount"sv,
                                                              "leftUntilDone"sv,
                                                              "length"sv,
+                                                             "level"sv,
+                                                             "limit"sv,
+                                                             "local-data-reuse-enabled"sv,
                                                              "location"sv,
+                                                             "lpd-cluster-mode"sv,
                                                              "lpd-enabled"sv,
                                                              "m"sv,
                                                              "magnetLink"sv,
@@ -190,12 +237,25 @@ auto constexpr MyStatic = std::array<std::string_view, 404>{ ""sv,
                                                              "main-window-width"sv,
                                                              "main-window-x"sv,
                                                              "main-window-y"sv,
+                                                             "manifest"sv,
                                                              "manualAnnounceTime"sv,
                                                              "max-peers"sv,
                                                              "maxConnectedPeers"sv,
+                                                             "maxMsec"sv,
+                                                             "max_request_size"sv,
+                                                             "memory"sv,
+                                                             "memory-budget-mb"sv,
                                                              "memory-bytes"sv,
                                                              "memory-units"sv,
+                                                             "memoryBudget"sv,
+                                                             "memoryPressure"sv,
+                                                             "memoryUsage"sv,
+                                                             "message"sv,
                                                              "message-level"sv,
+                                                             "meta version"sv,
+                                                             "metadata"sv,
+                                                             "metadata-cache-dir"sv,
+                                                             "metadata-cache-url"sv,
                                                              "metadataPercentComplete"sv,
                                                              "metadata_size"sv,
                                                              "metainfo"sv,
@@ -203,6 +263,7 @@ auto constexpr MyStatic = std::array<std::string_view, 404>{ ""sv,
                                                              "min_request_interval"sv,
                                                              "move"sv,
                                                              "msg_type"sv,
+                                                             "mtime"sv,
                                                              "mtimes"sv,
                                                              "name"sv,
                                                              "name.utf-8"sv,
@@ -210,23 +271,35 @@ auto constexpr MyStatic = std::array<std::string_view, 404>{ ""sv,
                                                              "nextScrapeTime"sv,
                                                              "nodes"sv,
                                                              "nodes6"sv,
+                                                             "offset"sv,
                                                              "open-dialog-dir"sv,
+                                                             "open-file-limit"sv,
+                                                             "openFileHits"sv,
+                                                             "openFileMisses"sv,
                                                              "p"sv,
+                                                             "parse_usec"sv,
                                                              "path"sv,
                                                              "path.utf-8"sv,
                                                              "paused"sv,
                                                              "pausedTorrentCount"sv,
                                                              "peer-congestion-algorithm"sv,
+                                                             "peer-io-threads"sv,
                                                              "peer-limit"sv,
                                                              "peer-limit-global"sv,
                                                              "peer-limit-per-torrent"sv,
+                                                             "peer-pool-limit-global"sv,
+                                                             "peer-pool-limit-per-torrent"sv,
                                                              "peer-port"sv,
                                                              "peer-port-random-high"sv,
                                                              "peer-port-random-low"sv,
                                                              "peer-port-random-on-start"sv,
+                                                             "peer-socket-notsent-lowat"sv,
+                                                             "peer-socket-receive-buffer"sv,
+                                                             "peer-socket-send-buffer"sv,
                                                              "peer-socket-tos"sv,
                                                              "peerIsChoked"sv,
                                                              "peerIsInterested"sv,
+                                                             "peer_buffers"sv,
                                                              "peers"sv,
                                                              "peers2"sv,
                                                              "peers2-6"sv,
@@ -238,14 +311,19 @@ auto constexpr MyStatic = std::array<std::string_view, 404>{ ""sv,
                                                              "percentDone"sv,
                                                              "pex-enabled"sv,
                                                              "piece"sv,
+                                                             "piece layers"sv,
                                                              "piece length"sv,
+                                                             "piece-sync-interval-seconds"sv,
                                                              "pieceCount"sv,
                                                              "pieceSize"sv,
                                                              "pieces"sv,
+                                                             "pieces root"sv,
+                                                             "piecesAdded"sv,
                                                              "play-download-complete-sound"sv,
                                                              "port"sv,
                                                              "port-forwarding-enabled"sv,
                                                              "port-is-open"sv,
+                                                             "preallocateProgress"sv,
                                                              "preallocation"sv,
                                                              "prefetch-enabled"sv,
                                                              "primary-mime-type"sv,
@@ -264,6 +342,7 @@ auto constexpr MyStatic = std::array<std::string_view, 404>{ ""sv,
                                                              "queue-stalled-enabled"sv,
                                                              "queue-stalled-minutes"sv,
                                                              "queuePosition"sv,
+                                                             "quick"sv,
                                                              "rateDownload"sv,
                                                              "rateToClient"sv,
                                                              "rateToPeer"sv,
@@ -271,7 +350,11 @@ auto constexpr MyStatic = std::array<std::string_view, 404>{ ""sv,
                                                              "ratio-limit"sv,
                                                              "ratio-limit-enabled"sv,
                                                              "ratio-mode"sv,
+                                                             "read-cache-size-mb"sv,
                                                              "read-clipboard"sv,
+                                                             "readCacheHits"sv,
+                                                             "readCacheMisses"sv,
+                                                             "read_cache"sv,
                                                              "recent-download-dir-1"sv,
                                                              "recent-download-dir-2"sv,
                                                              "recent-download-dir-3"sv,
@@ -281,6 +364,7 @@ auto constexpr MyStatic = std::array<std::string_view, 404>{ ""sv,
                                                              "recent-relocate-dir-3"sv,
                                                              "recent-relocate-dir-4"sv,
                                                              "recheckProgress"sv,
+                                                             "relocateProgress"sv,
                                                              "remote-session-enabled"sv,
                                                              "remote-session-host"sv,
                                                              "remote-session-https"sv,
@@ -291,12 +375,18 @@ auto constexpr MyStatic = std::array<std::string_view, 404>{ ""sv,
                                                              "removed"sv,
                                                              "rename-partial-files"sv,
                                                              "reqq"sv,
+                                                             "resourceUsage"sv,
                                                              "result"sv,
+                                                             "resume-journal-enabled"sv,
                                                              "rpc-authentication-required"sv,
                                                              "rpc-bind-address"sv,
+                                                             "rpc-compression-level"sv,
+                                                             "rpc-compression-min-size"sv,
                                                              "rpc-enabled"sv,
+                                                             "rpc-events-interval-msec"sv,
                                                              "rpc-host-whitelist"sv,
                                                              "rpc-host-whitelist-enabled"sv,
+                                                             "rpc-json-threads"sv,
                                                              "rpc-password"sv,
                                                              "rpc-port"sv,
                                                              "rpc-socket-mode"sv,
@@ -310,6 +400,7 @@ auto constexpr MyStatic = std::array<std::string_view, 404>{ ""sv,
                                                              "scrape"sv,
                                                              "scrape-paused-torrents-enabled"sv,
                                                              "scrapeState"sv,
+                                                             "script-hook-socket"sv,
                                                              "script-torrent-added-enabled"sv,
                                                              "script-torrent-added-filename"sv,
                                                              "script-torrent-done-enabled"sv,
@@ -330,6 +421,7 @@ auto constexpr MyStatic = std::array<std::string_view, 404>{ ""sv,
                                                              "seederCount"sv,
                                                              "seeding-time-seconds"sv,
                                                              "sequentialDownload"sv,
+                                                             "serve_usec"sv,
                                                              "session-count"sv,
                                                              "session-id"sv,
                                                              "sessionCount"sv,
@@ -345,6 +437,9 @@ auto constexpr MyStatic = std::array<std::string_view, 404>{ ""sv,
                                                              "size-bytes"sv,
                                                              "size-units"sv,
                                                              "sizeWhenDone"sv,
+                                                             "slow-callback-warning-msec"sv,
+                                                             "slowEventLoopCalls"sv,
+                                                             "sort"sv,
                                                              "sort-mode"sv,
                                                              "sort-reversed"sv,
                                                              "source"sv,
@@ -361,9 +456,13 @@ auto constexpr MyStatic = std::array<std::string_view, 404>{ ""sv,
                                                              "startDate"sv,
                                                              "status"sv,
                                                              "statusbar-stats"sv,
+                                                             "superSeeding"sv,
                                                              "tag"sv,
                                                              "tcp-enabled"sv,
+                                                             "tcp-reuseport-enabled"sv,
+                                                             "text"sv,
                                                              "tier"sv,
+                                                             "time"sv,
                                                              "time-checked"sv,
                                                              "torrent-added"sv,
                                                              "torrent-added-notification-command"sv,
@@ -380,10 +479,15 @@ auto constexpr MyStatic = std::array<std::string_view, 404>{ ""sv,
                                                              "torrentCount"sv,
                                                              "torrentFile"sv,
                                                              "torrents"sv,
+                                                             "torrentsByStatus"sv,
+                                                             "total"sv,
+                                                             "totalMsec"sv,
                                                              "totalSize"sv,
                                                              "total_size"sv,
+                                                             "tracker"sv,
                                                              "trackerAdd"sv,
                                                              "trackerList"sv,
+                                                             "trackerListReplace"sv,
                                                              "trackerRemove"sv,
                                                              "trackerReplace"sv,
                                                              "trackerStats"sv,
@@ -392,6 +496,8 @@ auto constexpr MyStatic = std::array<std::string_view, 404>{ ""sv,
                                                              "trash-original-torrent-files"sv,
                                                              "umask"sv,
                                                              "units"sv,
+                                                             "unusedDownloadBytes"sv,
+                                                             "unusedUploadBytes"sv,
                                                              "upload-slots-per-torrent"sv,
                                                              "uploadLimit"sv,
                                                              "uploadLimited"sv,
@@ -413,6 +519,9 @@ auto constexpr MyStatic = std::array<std::string_view, 404>{ ""sv,
                                                              "ut_recommend"sv,
                                                              "utp-enabled"sv,
                                                              "v"sv,
+                                                             "verify"sv,
+                                                             "verify-threads"sv,
+                                                             "verifyPaused"sv,
                                                              "version"sv,
                                                              "wanted"sv,
                                                              "watch-dir"sv,
@@ -437,49 +546,320 @@ bool constexpr quarks_are_sorted()
 static_assert(quarks_are_sorted(), "Predefined quarks must be sorted by their string value");
 static_assert(std::size(MyStatic) == TR_N_KEYS);
 
-auto& my_runtime{ *new std::vector<std::string_view>{} };
+// --- compile-time hash table of the predefined quarks
 
-} // namespace
+// FNV-1a. Cheap enough for the short keys seen in RPC and benc dicts,
+// and usable in a constant expression so the table can be built at compile time.
+[[nodiscard]] constexpr uint32_t quark_hash(std::string_view str) noexcept
+{
+    auto hash = uint32_t{ 2166136261U };
+    for (auto const ch : str)
+    {
+        hash ^= static_cast<uint8_t>(ch);
+        hash *= 16777619U;
+    }
+    return hash;
+}
 
-std::optional<tr_quark> tr_quark_lookup(std::string_view key)
+// Keep the load factor under 1/2 so that probe chains stay short
+auto constexpr StaticTableSize = size_t{ 1024U };
+static_assert(TR_N_KEYS * 2U <= StaticTableSize);
+static_assert((StaticTableSize & (StaticTableSize - 1U)) == 0U, "table size must be a power of two");
+
+auto constexpr EmptySlot = std::numeric_limits<uint16_t>::max();
+static_assert(TR_N_KEYS < EmptySlot);
+
+struct StaticTable
 {
-    // is it in our static array?
-    auto constexpr Sbegin = std::begin(MyStatic);
-    auto constexpr Send = std::end(MyStatic);
+    std::array<uint16_t, StaticTableSize> slots = {};
+    size_t max_probes = 0U;
+};
 
-    if (auto const sit = std::lower_bound(Sbegin, Send, key); sit != Send && *sit == key)
+[[nodiscard]] constexpr StaticTable build_static_table()
+{
+    auto table = StaticTable{};
+    for (auto& slot : table.slots)
     {
-        return std::distance(Sbegin, sit);
+        slot = EmptySlot;
     }
 
-    /* was it added during runtime? */
-    auto const rbegin = std::begin(my_runtime);
-    auto const rend = std::end(my_runtime);
-    if (auto const rit = std::find(rbegin, rend, key); rit != rend)
+    for (size_t i = 0; i < std::size(MyStatic); ++i)
+    {
+        auto pos = quark_hash(MyStatic[i]) & (StaticTableSize - 1U);
+        auto probes = size_t{ 1U };
+        while (table.slots[pos] != EmptySlot)
+        {
+            pos = (pos + 1U) & (StaticTableSize - 1U);
+            ++probes;
+        }
+
+        table.slots[pos] = static_cast<uint16_t>(i);
+        table.max_probes = std::max(table.max_probes, probes);
+    }
+
+    return table;
+}
+
+auto constexpr MyStaticTable = build_static_table();
+
+// If this ever fires, pick a larger StaticTableSize or a better hash
+static_assert(MyStaticTable.max_probes <= 8U, "predefined quark hash chains are too long");
+
+[[nodiscard]] constexpr std::optional<tr_quark> static_lookup(std::string_view key) noexcept
+{
+    auto pos = quark_hash(key) & (StaticTableSize - 1U);
+    for (size_t probe = 0U; probe < MyStaticTable.max_probes; ++probe)
     {
-        return TR_N_KEYS + std::distance(rbegin, rit);
+        auto const idx = MyStaticTable.slots[pos];
+        if (idx == EmptySlot)
+        {
+            break;
+        }
+
+        if (MyStatic[idx] == key)
+        {
+            return tr_quark{ idx };
+        }
+
+        pos = (pos + 1U) & (StaticTableSize - 1U);
     }
 
     return {};
 }
 
+static_assert(static_lookup(""sv) == TR_KEY_NONE);
+static_assert(static_lookup("yourip"sv) == TR_KEY_yourip);
+static_assert(!static_lookup("not-a-predefined-quark"sv));
+
+// --- quarks added at runtime
+
+// Strings are interned from worker threads too, e.g. when metainfo,
+// resume files, or RPC requests are parsed there. So the runtime table
+// is split into shards that each have their own lock for adding, and
+// looking up a string or a quark's string never takes a lock.
+
+// A quark's string. The chunks grow geometrically so that there's no
+// fixed limit and entries never move once they've been written.
+class RuntimeStrings
+{
+public:
+    // Only called by the thread that allocated `idx`, before the quark is published
+    void set(size_t idx, std::string_view str)
+    {
+        auto const [chunk_idx, offset] = locate(idx);
+        auto* chunk = chunks_[chunk_idx].load(std::memory_order_acquire);
+        if (chunk == nullptr)
+        {
+            auto* const fresh = new std::string_view[chunk_size(chunk_idx)];
+            if (chunks_[chunk_idx].compare_exchange_strong(chunk, fresh, std::memory_order_acq_rel))
+            {
+                chunk = fresh;
+            }
+            else
+            {
+                delete[] fresh; // another thread beat us to it
+            }
+        }
+
+        chunk[offset] = str;
+    }
+
+    [[nodiscard]] std::string_view get(size_t idx) const
+    {
+        auto const [chunk_idx, offset] = locate(idx);
+        return chunks_[chunk_idx].load(std::memory_order_acquire)[offset];
+    }
+
+private:
+    static auto constexpr FirstChunkBits = size_t{ 10U };
+    static auto constexpr MaxChunks = size_t{ 40U };
+
+    [[nodiscard]] static constexpr size_t chunk_size(size_t chunk_idx) noexcept
+    {
+        return size_t{ 1U } << (FirstChunkBits + chunk_idx);
+    }
+
+    // chunk n holds the entries [2^(n+FirstChunkBits) - 2^FirstChunkBits, ...)
+    [[nodiscard]] static constexpr std::pair<size_t, size_t> locate(size_t idx) noexcept
+    {
+        auto const n = idx + chunk_size(0U);
+        auto bits = size_t{};
+        while ((n >> (bits + 1U)) != 0U)
+        {
+            ++bits;
+        }
+
+        auto const chunk_idx = bits - FirstChunkBits;
+        return { chunk_idx, n - chunk_size(chunk_idx) };
+    }
+
+    std::array<std::atomic<std::string_view*>, MaxChunks> chunks_ = {};
+};
+
+auto& my_runtime_strings{ *new RuntimeStrings{} };
+auto my_runtime_count = std::atomic<size_t>{};
+
+// One shard of the string -> quark map: an open-addressed table whose
+// slots hold a string's hash and quark. Readers probe whichever table
+// is current; writers hold `mutex`, and grow the table by publishing a
+// copy. Retired tables are never freed, so a reader can't be left with
+// a dangling pointer. Interned strings are never freed either, so this
+// at most doubles the memory that the shard's tables use.
+class RuntimeShard
+{
+public:
+    RuntimeShard()
+        : table_{ new Table{ 64U } }
+    {
+    }
+
+    [[nodiscard]] std::optional<tr_quark> find(std::string_view key, uint32_t hash) const
+    {
+        return table_.load(std::memory_order_acquire)->find(key, hash);
+    }
+
+    [[nodiscard]] tr_quark add(std::string_view key, uint32_t hash)
+    {
+        auto const lock = std::lock_guard{ mutex_ };
+
+        auto* table = table_.load(std::memory_order_relaxed);
+        if (auto const prior = table->find(key, hash); prior)
+        {
+            return *prior; // someone else added it while we were waiting
+        }
+
+        // make a permanent, zero-terminated copy
+        auto const len = std::size(key);
+        auto* perma = new char[len + 1];
+        std::copy_n(std::begin(key), len, perma);
+        perma[len] = '\0';
+
+        auto const idx = my_runtime_count.fetch_add(1U, std::memory_order_relaxed);
+        my_runtime_strings.set(idx, std::string_view{ perma, len });
+        auto const quark = tr_quark{ TR_N_KEYS + idx };
+
+        if ((table->count + 1U) * 2U > std::size(table->slots))
+        {
+            auto* const grown = new Table{ std::size(table->slots) * 2U };
+            for (auto const& slot : table->slots)
+            {
+                if (auto const val = slot.load(std::memory_order_relaxed); val != EmptyRuntimeSlot)
+                {
+                    grown->insert(val);
+                }
+            }
+
+            table_.store(grown, std::memory_order_release);
+            table = grown;
+        }
+
+        table->insert(pack(hash, quark));
+        return quark;
+    }
+
+private:
+    static auto constexpr EmptyRuntimeSlot = uint64_t{};
+
+    // The slots hold `quark + 1` in the low bits so that zero means empty
+    [[nodiscard]] static constexpr uint64_t pack(uint32_t hash, tr_quark quark) noexcept
+    {
+        return (uint64_t{ hash } << 32U) | (quark + 1U);
+    }
+
+    struct Table
+    {
+        explicit Table(size_t n_slots)
+            : slots(n_slots)
+        {
+        }
+
+        [[nodiscard]] std::optional<tr_quark> find(std::string_view key, uint32_t hash) const
+        {
+            auto const mask = std::size(slots) - 1U;
+            for (auto pos = size_t{ hash } & mask;; pos = (pos + 1U) & mask)
+            {
+                auto const val = slots[pos].load(std::memory_order_acquire);
+                if (val == EmptyRuntimeSlot)
+                {
+                    return {};
+                }
+
+                if (auto const quark = tr_quark{ (val & 0xFFFFFFFFU) - 1U };
+                    (val >> 32U) == hash && my_runtime_strings.get(quark - TR_N_KEYS) == key)
+                {
+                    return quark;
+                }
+            }
+        }
+
+        // Only called with the shard's mutex held
+        void insert(uint64_t val)
+        {
+            auto const mask = std::size(slots) - 1U;
+            auto pos = size_t{ static_cast<uint32_t>(val >> 32U) } & mask;
+            while (slots[pos].load(std::memory_order_relaxed) != EmptyRuntimeSlot)
+            {
+                pos = (pos + 1U) & mask;
+            }
+
+            // release, so that a reader who sees the slot also sees the quark's string
+            slots[pos].store(val, std::memory_order_release);
+            ++count;
+        }
+
+        std::vector<std::atomic<uint64_t>> slots;
+        size_t count = 0U;
+    };
+
+    std::atomic<Table*> table_;
+    std::mutex mutex_;
+};
+
+auto constexpr NumRuntimeShards = size_t{ 16U };
+
+auto& my_runtime_shards{ *new std::array<RuntimeShard, NumRuntimeShards>{} };
+
+// The table's slots use the low bits of the hash, so pick shards with the high ones
+[[nodiscard]] RuntimeShard& runtime_shard(uint32_t hash)
+{
+    return my_runtime_shards[hash >> 28U];
+}
+
+static_assert(NumRuntimeShards == 16U, "runtime_shard() assumes 16 shards");
+
+} // namespace
+
+std::optional<tr_quark> tr_quark_lookup(std::string_view key)
+{
+    // is it in our static table?
+    if (auto const quark = static_lookup(key); quark)
+    {
+        return quark;
+    }
+
+    /* was it added during runtime? */
+    auto const hash = quark_hash(key);
+    return runtime_shard(hash).find(key, hash);
+}
+
 tr_quark tr_quark_new(std::string_view str)
 {
-    if (auto const prior = tr_quark_lookup(str); prior)
+    if (auto const quark = static_lookup(str); quark)
+    {
+        return *quark;
+    }
+
+    auto const hash = quark_hash(str);
+    auto& shard = runtime_shard(hash);
+    if (auto const prior = shard.find(str, hash); prior)
     {
         return *prior;
     }
 
-    auto const ret = TR_N_KEYS + std::size(my_runtime);
-    auto const len = std::size(str);
-    auto* perma = new char[len + 1];
-    std::copy_n(std::begin(str), len, perma);
-    perma[len] = '\0';
-    my_runtime.emplace_back(perma);
-    return ret;
+    return shard.add(str, hash);
 }
 
 std::string_view tr_quark_get_string_view(tr_quark q)
 {
-    return q < TR_N_KEYS ? MyStatic[q] : my_runtime[q - TR_N_KEYS];
+    return q < TR_N_KEYS ? MyStatic[q] : my_runtime_strings.get(q - TR_N_KEYS);
 }
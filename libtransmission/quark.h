@@ -25,6 +25,7 @@ enum
     TR_KEY_activeTorrentCount, /* rpc */
     TR_KEY_activity_date, /* resume file */
     TR_KEY_activityDate, /* rpc */
+    TR_KEY_adaptive_bandwidth_enabled,
     TR_KEY_added, /* pex */
     TR_KEY_added_date, /* rpc */
     TR_KEY_added_f, /* pex */
@@ -47,7 +48,11 @@ enum
     TR_KEY_anti_brute_force_enabled, /* rpc */
     TR_KEY_anti_brute_force_threshold, /* rpc */
     TR_KEY_arguments, /* rpc */
+    TR_KEY_attr,
     TR_KEY_availability, // rpc
+    TR_KEY_background, // rpc
+    TR_KEY_background_io_limit_iops,
+    TR_KEY_background_io_limit_kbps,
     TR_KEY_bandwidth_priority,
     TR_KEY_bandwidthPriority,
     TR_KEY_beginPiece,
@@ -60,8 +65,18 @@ enum
     TR_KEY_blocklist_updates_enabled,
     TR_KEY_blocklist_url,
     TR_KEY_blocks,
+    TR_KEY_bufferBytes,
     TR_KEY_bytesCompleted,
+    TR_KEY_cache,
+    TR_KEY_cache_async_writes,
     TR_KEY_cache_size_mb,
+    TR_KEY_cacheFlushBytes,
+    TR_KEY_cacheFlushMsec,
+    TR_KEY_cacheFlushWrites,
+    TR_KEY_cache_read_bytes,
+    TR_KEY_cache_reads,
+    TR_KEY_cache_write_bytes,
+    TR_KEY_cache_writes,
     TR_KEY_clientIsChoked,
     TR_KEY_clientIsInterested,
     TR_KEY_clientName,
@@ -73,6 +88,7 @@ enum
     TR_KEY_cookies,
     TR_KEY_corrupt,
     TR_KEY_corruptEver,
+    TR_KEY_count, /* rpc */
     TR_KEY_created_by,
     TR_KEY_created_by_utf_8,
     TR_KEY_creation_date,
@@ -83,11 +99,19 @@ enum
     TR_KEY_dateCreated,
     TR_KEY_default_trackers,
     TR_KEY_delete_local_data,
+    TR_KEY_delta_full,
+    TR_KEY_delta_token,
     TR_KEY_desiredAvailable,
+    TR_KEY_desiredReqsToPeer,
     TR_KEY_destination,
     TR_KEY_details_window_height,
     TR_KEY_details_window_width,
     TR_KEY_dht_enabled,
+    TR_KEY_direct_io_enabled,
+    TR_KEY_disk_read_bytes,
+    TR_KEY_disk_reads,
+    TR_KEY_disk_write_bytes,
+    TR_KEY_disk_writes,
     TR_KEY_dnd,
     TR_KEY_done_date,
     TR_KEY_doneDate,
@@ -117,7 +141,11 @@ enum
     TR_KEY_errorString,
     TR_KEY_eta,
     TR_KEY_etaIdle,
+    TR_KEY_event,
+    TR_KEY_executor_cpu_affinity,
+    TR_KEY_executor_threads,
     TR_KEY_fields,
+    TR_KEY_file_tree,
     TR_KEY_file_count,
     TR_KEY_fileStats,
     TR_KEY_filename,
@@ -126,6 +154,7 @@ enum
     TR_KEY_files_unwanted,
     TR_KEY_files_wanted,
     TR_KEY_filesAdded,
+    TR_KEY_filter, /* rpc */
     TR_KEY_filter_mode,
     TR_KEY_filter_text,
     TR_KEY_filter_trackers,
@@ -143,9 +172,11 @@ enum
     TR_KEY_hasAnnounced,
     TR_KEY_hasScraped,
     TR_KEY_hashString,
+    TR_KEY_hash_usec,
     TR_KEY_have,
     TR_KEY_haveUnchecked,
     TR_KEY_haveValid,
+    TR_KEY_hibernate_idle_seeds_minutes,
     TR_KEY_honorsSessionLimits,
     TR_KEY_host,
     TR_KEY_id,
@@ -159,6 +190,7 @@ enum
     TR_KEY_incomplete_dir_enabled,
     TR_KEY_info,
     TR_KEY_inhibit_desktop_hibernation,
+    TR_KEY_io_trace_file,
     TR_KEY_ipv4,
     TR_KEY_ipv6,
     TR_KEY_isBackup,
@@ -170,7 +202,11 @@ enum
     TR_KEY_isStalled,
     TR_KEY_isUTP,
     TR_KEY_isUploadingTo,
+    TR_KEY_kind, /* rpc */
     TR_KEY_labels,
+    TR_KEY_lan_peer_fast_path_enabled,
+    TR_KEY_lan_peer_networks,
+    TR_KEY_large_request_size_kib,
     TR_KEY_lastAnnouncePeerCount,
     TR_KEY_lastAnnounceResult,
     TR_KEY_lastAnnounceStartTime,
@@ -182,10 +218,15 @@ enum
     TR_KEY_lastScrapeSucceeded,
     TR_KEY_lastScrapeTime,
     TR_KEY_lastScrapeTimedOut,
+    TR_KEY_lazy_piece_hashes_enabled,
     TR_KEY_leecherCount,
     TR_KEY_leftUntilDone,
     TR_KEY_length,
+    TR_KEY_level,
+    TR_KEY_limit, /* rpc */
+    TR_KEY_local_data_reuse_enabled,
     TR_KEY_location,
+    TR_KEY_lpd_cluster_mode,
     TR_KEY_lpd_enabled,
     TR_KEY_m,
     TR_KEY_magnetLink,
@@ -195,12 +236,25 @@ enum
     TR_KEY_main_window_width,
     TR_KEY_main_window_x,
     TR_KEY_main_window_y,
+    TR_KEY_manifest,
     TR_KEY_manualAnnounceTime,
     TR_KEY_max_peers,
     TR_KEY_maxConnectedPeers,
+    TR_KEY_maxMsec, /* rpc */
+    TR_KEY_max_request_size,
+    TR_KEY_memory,
+    TR_KEY_memory_budget_mb,
     TR_KEY_memory_bytes,
     TR_KEY_memory_units,
+    TR_KEY_memoryBudget,
+    TR_KEY_memoryPressure,
+    TR_KEY_memoryUsage,
+    TR_KEY_message,
     TR_KEY_message_level,
+    TR_KEY_meta_version,
+    TR_KEY_metadata,
+    TR_KEY_metadata_cache_dir,
+    TR_KEY_metadata_cache_url,
     TR_KEY_metadataPercentComplete,
     TR_KEY_metadata_size,
     TR_KEY_metainfo,
@@ -208,6 +262,7 @@ enum
     TR_KEY_min_request_interval,
     TR_KEY_move,
     TR_KEY_msg_type,
+    TR_KEY_mtime,
     TR_KEY_mtimes,
     TR_KEY_name,
     TR_KEY_name_utf_8,
@@ -215,23 +270,35 @@ enum
     TR_KEY_nextScrapeTime,
     TR_KEY_nodes,
     TR_KEY_nodes6,
+    TR_KEY_offset, /* rpc */
     TR_KEY_open_dialog_dir,
+    TR_KEY_open_file_limit,
+    TR_KEY_openFileHits,
+    TR_KEY_openFileMisses,
     TR_KEY_p,
+    TR_KEY_parse_usec,
     TR_KEY_path,
     TR_KEY_path_utf_8,
     TR_KEY_paused,
     TR_KEY_pausedTorrentCount,
     TR_KEY_peer_congestion_algorithm,
+    TR_KEY_peer_io_threads,
     TR_KEY_peer_limit,
     TR_KEY_peer_limit_global,
     TR_KEY_peer_limit_per_torrent,
+    TR_KEY_peer_pool_limit_global,
+    TR_KEY_peer_pool_limit_per_torrent,
     TR_KEY_peer_port,
     TR_KEY_peer_port_random_high,
     TR_KEY_peer_port_random_low,
     TR_KEY_peer_port_random_on_start,
+    TR_KEY_peer_socket_notsent_lowat,
+    TR_KEY_peer_socket_receive_buffer,
+    TR_KEY_peer_socket_send_buffer,
     TR_KEY_peer_socket_tos,
     TR_KEY_peerIsChoked,
     TR_KEY_peerIsInterested,
+    TR_KEY_peer_buffers,
     TR_KEY_peers,
     TR_KEY_peers2,
     TR_KEY_peers2_6,
@@ -243,14 +310,19 @@ enum
     TR_KEY_percentDone,
     TR_KEY_pex_enabled,
     TR_KEY_piece,
+    TR_KEY_piece_layers,
     TR_KEY_piece_length,
+    TR_KEY_piece_sync_interval_seconds,
     TR_KEY_pieceCount,
     TR_KEY_pieceSize,
     TR_KEY_pieces,
+    TR_KEY_pieces_root,
+    TR_KEY_piecesAdded,
     TR_KEY_play_download_complete_sound,
     TR_KEY_port,
     TR_KEY_port_forwarding_enabled,
     TR_KEY_port_is_open,
+    TR_KEY_preallocateProgress, /* rpc */
     TR_KEY_preallocation,
     TR_KEY_prefetch_enabled,
     TR_KEY_primary_mime_type,
@@ -269,6 +341,7 @@ enum
     TR_KEY_queue_stalled_enabled,
     TR_KEY_queue_stalled_minutes,
     TR_KEY_queuePosition,
+    TR_KEY_quick, /* rpc */
     TR_KEY_rateDownload,
     TR_KEY_rateToClient,
     TR_KEY_rateToPeer,
@@ -276,7 +349,11 @@ enum
     TR_KEY_ratio_limit,
     TR_KEY_ratio_limit_enabled,
     TR_KEY_ratio_mode,
+    TR_KEY_read_cache_size_mb,
     TR_KEY_read_clipboard,
+    TR_KEY_readCacheHits,
+    TR_KEY_readCacheMisses,
+    TR_KEY_read_cache,
     TR_KEY_recent_download_dir_1,
     TR_KEY_recent_download_dir_2,
     TR_KEY_recent_download_dir_3,
@@ -286,6 +363,7 @@ enum
     TR_KEY_recent_relocate_dir_3,
     TR_KEY_recent_relocate_dir_4,
     TR_KEY_recheckProgress,
+    TR_KEY_relocateProgress, /* rpc */
     TR_KEY_remote_session_enabled,
     TR_KEY_remote_session_host,
     TR_KEY_remote_session_https,
@@ -296,12 +374,18 @@ enum
     TR_KEY_removed,
     TR_KEY_rename_partial_files,
     TR_KEY_reqq,
+    TR_KEY_resourceUsage,
     TR_KEY_result,
+    TR_KEY_resume_journal_enabled,
     TR_KEY_rpc_authentication_required,
     TR_KEY_rpc_bind_address,
+    TR_KEY_rpc_compression_level,
+    TR_KEY_rpc_compression_min_size,
     TR_KEY_rpc_enabled,
+    TR_KEY_rpc_events_interval_msec,
     TR_KEY_rpc_host_whitelist,
     TR_KEY_rpc_host_whitelist_enabled,
+    TR_KEY_rpc_json_threads,
     TR_KEY_rpc_password,
     TR_KEY_rpc_port,
     TR_KEY_rpc_socket_mode,
@@ -315,6 +399,7 @@ enum
     TR_KEY_scrape,
     TR_KEY_scrape_paused_torrents_enabled,
     TR_KEY_scrapeState,
+    TR_KEY_script_hook_socket,
     TR_KEY_script_torrent_added_enabled,
     TR_KEY_script_torrent_added_filename,
     TR_KEY_script_torrent_done_enabled,
@@ -335,6 +420,7 @@ enum
     TR_KEY_seederCount,
     TR_KEY_seeding_time_seconds,
     TR_KEY_sequentialDownload,
+    TR_KEY_serve_usec,
     TR_KEY_session_count,
     TR_KEY_session_id,
     TR_KEY_sessionCount,
@@ -350,6 +436,9 @@ enum
     TR_KEY_size_bytes,
     TR_KEY_size_units,
     TR_KEY_sizeWhenDone,
+    TR_KEY_slow_callback_warning_msec, /* settings */
+    TR_KEY_slowEventLoopCalls, /* rpc */
+    TR_KEY_sort, /* rpc */
     TR_KEY_sort_mode,
     TR_KEY_sort_reversed,
     TR_KEY_source,
@@ -366,9 +455,13 @@ enum
     TR_KEY_startDate,
     TR_KEY_status,
     TR_KEY_statusbar_stats,
+    TR_KEY_superSeeding,
     TR_KEY_tag,
     TR_KEY_tcp_enabled,
+    TR_KEY_tcp_reuseport_enabled,
+    TR_KEY_text, /* rpc */
     TR_KEY_tier,
+    TR_KEY_time,
     TR_KEY_time_checked,
     TR_KEY_torrent_added,
     TR_KEY_torrent_added_notification_command,
@@ -385,10 +478,15 @@ enum
     TR_KEY_torrentCount,
     TR_KEY_torrentFile,
     TR_KEY_torrents,
+    TR_KEY_torrentsByStatus,
+    TR_KEY_total, /* rpc */
+    TR_KEY_totalMsec, /* rpc */
     TR_KEY_totalSize,
     TR_KEY_total_size,
+    TR_KEY_tracker, /* rpc */
     TR_KEY_trackerAdd,
     TR_KEY_trackerList,
+    TR_KEY_trackerListReplace,
     TR_KEY_trackerRemove,
     TR_KEY_trackerReplace,
     TR_KEY_trackerStats,
@@ -397,6 +495,8 @@ enum
     TR_KEY_trash_original_torrent_files,
     TR_KEY_umask,
     TR_KEY_units,
+    TR_KEY_unusedDownloadBytes,
+    TR_KEY_unusedUploadBytes,
     TR_KEY_upload_slots_per_torrent,
     TR_KEY_uploadLimit,
     TR_KEY_uploadLimited,
@@ -418,6 +518,9 @@ enum
     TR_KEY_ut_recommend,
     TR_KEY_utp_enabled,
     TR_KEY_v,
+    TR_KEY_verify, /* .resume */
+    TR_KEY_verify_threads, /* settings */
+    TR_KEY_verifyPaused, // rpc
     TR_KEY_version,
     TR_KEY_wanted,
     TR_KEY_watch_dir,
@@ -446,5 +549,7 @@ enum
  * Create a new quark for the specified string. If a quark already
  * exists for that string, it is returned so that no duplicates are
  * created.
+ *
+ * The quark functions can be called from any thread.
  */
 [[nodiscard]] tr_quark tr_quark_new(std::string_view str);
@@ -0,0 +1,266 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <cstddef> // size_t
+#include <cstdint> // uint64_t
+#include <iterator> // std::next()
+#include <list>
+#include <map>
+#include <memory> // std::unique_ptr
+#include <utility> // std::pair
+
+#include "libtransmission/transmission.h" // tr_block_index_t, tr_torrent_id_t
+
+// A cache of clean blocks, e.g. blocks that several peers are downloading
+// from us, so that they don't have to be read from disk for every peer.
+//
+// Eviction follows the 2Q algorithm. New blocks wait in a FIFO queue, and
+// only blocks that are used again move to an LRU queue of hot blocks, so a
+// burst of blocks that are read once can't push out the hot ones. Blocks
+// recently evicted from the FIFO queue are remembered without their data,
+// and go straight to the hot queue if they're added again soon after.
+//
+// A block can also be reserved before its data is ready, e.g. while it's
+// being read in the background, so that it isn't read twice.
+template<typename Data>
+class tr_read_cache
+{
+public:
+    using Key = std::pair<tr_torrent_id_t, tr_block_index_t>;
+
+    struct Stats
+    {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evicted_used = 0; // blocks evicted after being used
+        uint64_t evicted_unused = 0; // blocks evicted without ever being used
+    };
+
+    explicit tr_read_cache(size_t max_blocks = 0U)
+        : max_blocks_{ max_blocks }
+    {
+    }
+
+    [[nodiscard]] constexpr auto max_blocks() const noexcept
+    {
+        return max_blocks_;
+    }
+
+    void set_max_blocks(size_t max_blocks)
+    {
+        max_blocks_ = max_blocks;
+        trim();
+    }
+
+    // @return the number of blocks holding data
+    [[nodiscard]] constexpr auto size() const noexcept
+    {
+        return n_blocks_;
+    }
+
+    [[nodiscard]] constexpr auto const& stats() const noexcept
+    {
+        return stats_;
+    }
+
+    // @return true if the block is cached or reserved
+    [[nodiscard]] bool contains(Key const& key) const
+    {
+        return entries_.count(key) != 0U;
+    }
+
+    // @return true if the block wasn't cached or reserved before
+    bool reserve(Key const& key)
+    {
+        return max_blocks_ != 0U && entries_.try_emplace(key).second;
+    }
+
+    // Add the data for a reserved block. It's dropped if the
+    // block was erased, e.g. rewritten, since it was reserved.
+    void fill(Key const& key, std::unique_ptr<Data> data)
+    {
+        if (auto const iter = entries_.find(key); iter != std::end(entries_) && !iter->second.data)
+        {
+            admit(iter, std::move(data));
+        }
+    }
+
+    // Forget a reserved block whose data couldn't be read.
+    void unreserve(Key const& key)
+    {
+        if (auto const iter = entries_.find(key); iter != std::end(entries_) && !iter->second.data)
+        {
+            entries_.erase(iter);
+        }
+    }
+
+    // Add the data for a block that was just read for use,
+    // so that the next use counts as a second one.
+    void insert(Key const& key, std::unique_ptr<Data> data)
+    {
+        if (max_blocks_ == 0U)
+        {
+            return;
+        }
+
+        if (auto const [iter, is_new] = entries_.try_emplace(key); is_new || !iter->second.data)
+        {
+            iter->second.is_used = true;
+            admit(iter, std::move(data));
+        }
+    }
+
+    // @return the block's data, or nullptr if it isn't cached
+    [[nodiscard]] Data const* get(Key const& key)
+    {
+        auto const iter = entries_.find(key);
+        if (iter == std::end(entries_) || !iter->second.data)
+        {
+            ++stats_.misses;
+            return nullptr;
+        }
+
+        ++stats_.hits;
+
+        auto& entry = iter->second;
+        if (entry.is_hot)
+        {
+            hot_.splice(std::begin(hot_), hot_, entry.pos);
+        }
+        else if (entry.is_used)
+        {
+            // used twice, so it's hot
+            fifo_.erase(entry.pos);
+            hot_.push_front(key);
+            entry.pos = std::begin(hot_);
+            entry.is_hot = true;
+        }
+
+        entry.is_used = true;
+        return entry.data.get();
+    }
+
+    // Forget a block, whether it's cached or only reserved.
+    void erase(Key const& key)
+    {
+        if (auto const iter = entries_.find(key); iter != std::end(entries_))
+        {
+            erase(iter);
+        }
+    }
+
+    // @return how many of a torrent's blocks are cached
+    [[nodiscard]] size_t count_torrent(tr_torrent_id_t tor_id) const
+    {
+        auto n_blocks = size_t{};
+        for (auto iter = entries_.lower_bound({ tor_id, 0U }); iter != std::end(entries_) && iter->first.first == tor_id;
+             ++iter)
+        {
+            n_blocks += iter->second.data ? 1U : 0U;
+        }
+        return n_blocks;
+    }
+
+    void erase_torrent(tr_torrent_id_t tor_id)
+    {
+        auto iter = entries_.lower_bound({ tor_id, 0U });
+        while (iter != std::end(entries_) && iter->first.first == tor_id)
+        {
+            iter = erase(iter);
+        }
+    }
+
+private:
+    struct Entry
+    {
+        std::unique_ptr<Data> data; // empty if the block is only reserved
+        typename std::list<Key>::iterator pos; // position in `fifo_` or `hot_`
+        bool is_hot = false;
+        bool is_used = false;
+    };
+
+    using Entries = std::map<Key, Entry>;
+
+    void admit(typename Entries::iterator iter, std::unique_ptr<Data> data)
+    {
+        auto const& key = iter->first;
+        auto& entry = iter->second;
+        entry.data = std::move(data);
+        ++n_blocks_;
+
+        if (auto const ghost = ghosts_.find(key); ghost != std::end(ghosts_))
+        {
+            ghost_order_.erase(ghost->second);
+            ghosts_.erase(ghost);
+            hot_.push_front(key);
+            entry.pos = std::begin(hot_);
+            entry.is_hot = true;
+        }
+        else
+        {
+            fifo_.push_back(key);
+            entry.pos = std::prev(std::end(fifo_));
+        }
+
+        trim();
+    }
+
+    typename Entries::iterator erase(typename Entries::iterator iter)
+    {
+        if (auto& entry = iter->second; entry.data)
+        {
+            (entry.is_hot ? hot_ : fifo_).erase(entry.pos);
+            --n_blocks_;
+        }
+
+        return entries_.erase(iter);
+    }
+
+    void trim()
+    {
+        while (n_blocks_ > max_blocks_)
+        {
+            // keep about a quarter of the cache for new blocks
+            auto const from_fifo = std::empty(hot_) || std::size(fifo_) > max_blocks_ / 4U;
+            auto const key = from_fifo ? fifo_.front() : hot_.back();
+            auto const iter = entries_.find(key);
+            ++(iter->second.is_used ? stats_.evicted_used : stats_.evicted_unused);
+            erase(iter);
+
+            if (from_fifo)
+            {
+                remember(key);
+            }
+        }
+    }
+
+    void remember(Key const& key)
+    {
+        ghost_order_.push_back(key);
+        ghosts_.try_emplace(key, std::prev(std::end(ghost_order_)));
+
+        // remember about half as many evicted blocks as we can cache
+        while (std::size(ghost_order_) > max_blocks_ / 2U)
+        {
+            ghosts_.erase(ghost_order_.front());
+            ghost_order_.pop_front();
+        }
+    }
+
+    Entries entries_;
+    std::list<Key> fifo_; // oldest first
+    std::list<Key> hot_; // most recently used first
+    std::list<Key> ghost_order_; // oldest first
+    std::map<Key, typename std::list<Key>::iterator> ghosts_;
+    size_t n_blocks_ = 0U;
+    size_t max_blocks_ = 0U;
+    Stats stats_;
+};
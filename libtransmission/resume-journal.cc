@@ -0,0 +1,234 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm> // std::copy_n()
+#include <cstddef> // size_t, std::byte
+#include <cstdint> // uint32_t
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include "libtransmission/error.h"
+#include "libtransmission/file.h"
+#include "libtransmission/log.h"
+#include "libtransmission/resume-journal.h"
+#include "libtransmission/utils.h"
+
+using namespace std::literals;
+
+namespace
+{
+// "TRJ" + format version
+auto constexpr Magic = "TRJ\x01"sv;
+
+// info hash + big-endian payload length. A length of 0 means "erased".
+auto constexpr RecordHeaderSize = std::tuple_size_v<tr_sha1_digest_t> + sizeof(uint32_t);
+
+// Don't bother rewriting small files
+auto constexpr MinRewriteSize = size_t{ 1024U * 1024U };
+
+[[nodiscard]] constexpr size_t record_size(size_t payload_size) noexcept
+{
+    return RecordHeaderSize + payload_size;
+}
+
+void append_record(std::string& out, tr_sha1_digest_t const& info_hash, std::string_view payload)
+{
+    auto const payload_size = static_cast<uint32_t>(std::size(payload));
+
+    out.append(reinterpret_cast<char const*>(std::data(info_hash)), std::size(info_hash));
+    for (int shift = 24; shift >= 0; shift -= 8)
+    {
+        out += static_cast<char>((payload_size >> shift) & 0xFFU);
+    }
+    out.append(payload);
+}
+} // namespace
+
+tr_resume_journal::tr_resume_journal(std::string filename)
+    : filename_{ std::move(filename) }
+{
+    load();
+}
+
+tr_resume_journal::~tr_resume_journal()
+{
+    flush();
+}
+
+void tr_resume_journal::load()
+{
+    live_size_ = std::size(Magic);
+
+    auto buf = std::vector<char>{};
+    if (!tr_sys_path_exists(filename_) || !tr_file_read(filename_, buf))
+    {
+        return;
+    }
+
+    auto sv = std::string_view{ std::data(buf), std::size(buf) };
+    if (!tr_strv_starts_with(sv, Magic))
+    {
+        tr_logAddWarn(fmt::format(_("Ignoring unrecognized file '{path}'"), fmt::arg("path", filename_)));
+        needs_rewrite_ = true;
+        return;
+    }
+
+    sv.remove_prefix(std::size(Magic));
+    file_size_ = std::size(Magic);
+
+    while (std::size(sv) >= RecordHeaderSize)
+    {
+        auto info_hash = tr_sha1_digest_t{};
+        std::copy_n(reinterpret_cast<std::byte const*>(std::data(sv)), std::size(info_hash), std::data(info_hash));
+
+        auto payload_size = uint32_t{};
+        for (size_t i = std::size(info_hash); i < RecordHeaderSize; ++i)
+        {
+            payload_size = (payload_size << 8U) | static_cast<uint8_t>(sv[i]);
+        }
+
+        if (std::size(sv) < record_size(payload_size))
+        {
+            break;
+        }
+
+        auto const payload = sv.substr(RecordHeaderSize, payload_size);
+        if (auto const iter = records_.find(info_hash); iter != std::end(records_))
+        {
+            live_size_ -= record_size(std::size(iter->second));
+            records_.erase(iter);
+        }
+
+        if (!std::empty(payload))
+        {
+            records_.try_emplace(info_hash, std::begin(payload), std::end(payload));
+            live_size_ += record_size(std::size(payload));
+        }
+
+        sv.remove_prefix(record_size(payload_size));
+        file_size_ += record_size(payload_size);
+    }
+
+    // a partial record from an interrupted write
+    if (!std::empty(sv))
+    {
+        needs_rewrite_ = true;
+    }
+
+    tr_logAddDebug(fmt::format("Read {} resume records from '{}'", std::size(records_), filename_));
+}
+
+std::vector<char> const* tr_resume_journal::get(tr_sha1_digest_t const& info_hash) const
+{
+    auto const iter = records_.find(info_hash);
+    return iter != std::end(records_) ? &iter->second : nullptr;
+}
+
+void tr_resume_journal::set(tr_sha1_digest_t const& info_hash, std::string_view benc)
+{
+    if (std::empty(benc))
+    {
+        return;
+    }
+
+    auto& record = records_[info_hash];
+    if (std::size(record) > 0U)
+    {
+        live_size_ -= record_size(std::size(record));
+    }
+
+    record.assign(std::begin(benc), std::end(benc));
+    live_size_ += record_size(std::size(record));
+    append_record(pending_, info_hash, benc);
+}
+
+void tr_resume_journal::erase(tr_sha1_digest_t const& info_hash)
+{
+    if (auto const iter = records_.find(info_hash); iter != std::end(records_))
+    {
+        live_size_ -= record_size(std::size(iter->second));
+        records_.erase(iter);
+        append_record(pending_, info_hash, {});
+    }
+}
+
+bool tr_resume_journal::flush()
+{
+    if (std::empty(pending_) && !needs_rewrite_)
+    {
+        return true;
+    }
+
+    tr_error* error = nullptr;
+    if (!write(&error))
+    {
+        tr_logAddWarn(fmt::format(
+            _("Couldn't save '{path}': {error} ({error_code})"),
+            fmt::arg("path", filename_),
+            fmt::arg("error", error->message),
+            fmt::arg("error_code", error->code)));
+        tr_error_free(error);
+        return false;
+    }
+
+    return true;
+}
+
+bool tr_resume_journal::write(tr_error** error)
+{
+    if (auto const new_size = file_size_ + std::size(pending_);
+        needs_rewrite_ || file_size_ == 0U || (new_size > MinRewriteSize && new_size > live_size_ * 2U))
+    {
+        return rewrite(error);
+    }
+
+    auto const fd = tr_sys_file_open(filename_.c_str(), TR_SYS_FILE_WRITE | TR_SYS_FILE_APPEND, 0600, error);
+    if (fd == TR_BAD_SYS_FILE)
+    {
+        return false;
+    }
+
+    auto const ok = tr_sys_file_write(fd, std::data(pending_), std::size(pending_), nullptr, error) &&
+        tr_sys_file_flush(fd, error);
+    tr_sys_file_close(fd);
+
+    if (!ok)
+    {
+        // we don't know how much made it to disk, so start over next time
+        needs_rewrite_ = true;
+        return false;
+    }
+
+    file_size_ += std::size(pending_);
+    pending_.clear();
+    return true;
+}
+
+bool tr_resume_journal::rewrite(tr_error** error)
+{
+    auto contents = std::string{};
+    contents.reserve(live_size_);
+    contents.append(Magic);
+
+    for (auto const& [info_hash, payload] : records_)
+    {
+        append_record(contents, info_hash, { std::data(payload), std::size(payload) });
+    }
+
+    if (!tr_file_save(filename_, contents, error))
+    {
+        return false;
+    }
+
+    tr_logAddDebug(fmt::format("Rewrote '{}' with {} resume records", filename_, std::size(records_)));
+    file_size_ = std::size(contents);
+    pending_.clear();
+    needs_rewrite_ = false;
+    return true;
+}
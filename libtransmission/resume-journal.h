@@ -0,0 +1,82 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <cstddef> // size_t
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "libtransmission/tr-macros.h" // tr_sha1_digest_t
+
+struct tr_error;
+
+/**
+ * A single append-only file that holds the resume data for every torrent,
+ * so that a save cycle is one sequential write and one flush instead of a
+ * small file per torrent. The payload of each record is the same benc that
+ * would go into a `.resume` file.
+ *
+ * The newest record for a torrent wins. When the file has grown to hold
+ * much more stale data than live data, it's rewritten with only the
+ * newest records. A truncated record at the end, e.g. from a crash while
+ * writing, is ignored and cleaned up by the next rewrite.
+ */
+class tr_resume_journal
+{
+public:
+    explicit tr_resume_journal(std::string filename);
+    ~tr_resume_journal();
+
+    tr_resume_journal(tr_resume_journal const&) = delete;
+    tr_resume_journal(tr_resume_journal&&) = delete;
+    tr_resume_journal& operator=(tr_resume_journal const&) = delete;
+    tr_resume_journal& operator=(tr_resume_journal&&) = delete;
+
+    // @return the newest resume data for `info_hash`, or nullptr if none
+    [[nodiscard]] std::vector<char> const* get(tr_sha1_digest_t const& info_hash) const;
+
+    // These are kept in memory until the next flush()
+    void set(tr_sha1_digest_t const& info_hash, std::string_view benc);
+    void erase(tr_sha1_digest_t const& info_hash);
+
+    // Write any pending records to disk
+    bool flush();
+
+    [[nodiscard]] auto size() const noexcept
+    {
+        return std::size(records_);
+    }
+
+    [[nodiscard]] constexpr auto const& filename() const noexcept
+    {
+        return filename_;
+    }
+
+private:
+    void load();
+    bool write(tr_error** error);
+    bool rewrite(tr_error** error);
+
+    std::string const filename_;
+
+    std::map<tr_sha1_digest_t, std::vector<char>> records_;
+
+    // records that haven't been written yet
+    std::string pending_;
+
+    // bytes in the file on disk, and how many of them are live records
+    size_t file_size_ = 0U;
+    size_t live_size_ = 0U;
+
+    // true if the file needs to be rewritten, e.g. it has a bad tail
+    bool needs_rewrite_ = false;
+};
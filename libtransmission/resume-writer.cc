@@ -0,0 +1,140 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility> // std::move()
+#include <vector>
+
+#include "libtransmission/transmission.h"
+
+#include "libtransmission/executor.h"
+#include "libtransmission/file.h"
+#include "libtransmission/resume-writer.h"
+#include "libtransmission/tr-strbuf.h"
+#include "libtransmission/variant.h"
+
+tr_resume_writer::tr_resume_writer(tr_executor& executor, ErrorFunc on_error)
+    : executor_{ executor }
+    , on_error_{ std::move(on_error) }
+{
+}
+
+tr_resume_writer::~tr_resume_writer()
+{
+    wait();
+}
+
+void tr_resume_writer::add(tr_torrent_id_t tor_id, std::string_view filename, std::unique_ptr<Snapshot> snapshot)
+{
+    enqueue(filename, Item{ tor_id, std::move(snapshot) });
+}
+
+void tr_resume_writer::remove(std::string_view filename)
+{
+    enqueue(filename, Item{});
+}
+
+void tr_resume_writer::enqueue(std::string_view filename, Item&& item)
+{
+    auto const dirname = tr_sys_path_dirname(filename);
+
+    auto const lock = std::lock_guard{ mutex_ };
+    auto iter = dirs_.find(dirname);
+    if (iter == std::end(dirs_))
+    {
+        iter = dirs_.try_emplace(std::string{ dirname }).first;
+    }
+
+    // only the newest snapshot of a file is worth writing
+    iter->second.items.insert_or_assign(std::string{ filename }, std::move(item));
+}
+
+void tr_resume_writer::flush()
+{
+    auto const lock = std::lock_guard{ mutex_ };
+    flush_locked();
+}
+
+void tr_resume_writer::flush_locked()
+{
+    for (auto& [dirname, dir] : dirs_)
+    {
+        // a busy dir's task picks up the new items when it's done with its batch
+        if (dir.busy || std::empty(dir.items))
+        {
+            continue;
+        }
+
+        dir.busy = true;
+        executor_.submit([this, name = dirname]() { write_dir(name); }, tr_executor::Priority::Low);
+    }
+}
+
+void tr_resume_writer::write_dir(std::string const& dirname)
+{
+    auto batch = std::vector<std::pair<std::string, Item>>{};
+
+    for (;;)
+    {
+        {
+            auto const lock = std::lock_guard{ mutex_ };
+            auto const iter = dirs_.find(dirname);
+            auto& items = iter->second.items;
+            if (std::empty(items))
+            {
+                dirs_.erase(iter);
+                idle_cv_.notify_all();
+                return;
+            }
+
+            batch.reserve(std::size(items));
+            for (auto& [filename, item] : items)
+            {
+                batch.emplace_back(filename, std::move(item));
+            }
+            items.clear();
+        }
+
+        for (auto const& [filename, item] : batch)
+        {
+            if (!item.snapshot)
+            {
+                if (auto const path = tr_pathbuf{ filename }; tr_sys_path_exists(path))
+                {
+                    tr_sys_path_remove(path);
+                }
+            }
+            else if (auto const err = tr_variantToFile(&item.snapshot->top, TR_VARIANT_FMT_BENC, filename);
+                     err != 0 && on_error_)
+            {
+                on_error_(item.tor_id, err);
+            }
+        }
+
+        batch.clear();
+    }
+}
+
+void tr_resume_writer::wait()
+{
+    auto lock = std::unique_lock{ mutex_ };
+    flush_locked();
+    idle_cv_.wait(lock, [this]() { return std::empty(dirs_); });
+}
+
+size_t tr_resume_writer::size() const
+{
+    auto const lock = std::lock_guard{ mutex_ };
+
+    auto n = size_t{};
+    for (auto const& [dirname, dir] : dirs_)
+    {
+        n += std::size(dir.items);
+    }
+    return n;
+}
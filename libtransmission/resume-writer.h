@@ -0,0 +1,109 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <condition_variable>
+#include <cstddef> // size_t
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+#include "libtransmission/transmission.h" // tr_torrent_id_t
+
+#include "libtransmission/variant.h"
+
+class tr_executor;
+
+/**
+ * Writes `.resume` files in the background, so that a save cycle on the
+ * session thread only costs building each torrent's variant.
+ *
+ * Snapshots wait in memory until flush(). Only the newest snapshot of a
+ * file is written. Each directory's files are written by one task at a
+ * time, so the writes to a directory are batched and never race each
+ * other. Each file is written to a temporary file and renamed into place.
+ */
+class tr_resume_writer
+{
+public:
+    // A torrent's resume data. The variant's memory comes from `arena`,
+    // so the two are handed to the writer together.
+    struct Snapshot
+    {
+        Snapshot() = default;
+        Snapshot(Snapshot const&) = delete;
+        Snapshot(Snapshot&&) = delete;
+        Snapshot& operator=(Snapshot const&) = delete;
+        Snapshot& operator=(Snapshot&&) = delete;
+
+        ~Snapshot()
+        {
+            tr_variantClear(&top);
+        }
+
+        tr_variant_arena arena;
+        tr_variant top = {};
+    };
+
+    // Called from a worker thread when a file couldn't be saved
+    using ErrorFunc = std::function<void(tr_torrent_id_t tor_id, int error_code)>;
+
+    explicit tr_resume_writer(tr_executor& executor, ErrorFunc on_error = {});
+
+    // Waits for the pending writes to finish
+    ~tr_resume_writer();
+
+    tr_resume_writer(tr_resume_writer const&) = delete;
+    tr_resume_writer(tr_resume_writer&&) = delete;
+    tr_resume_writer& operator=(tr_resume_writer const&) = delete;
+    tr_resume_writer& operator=(tr_resume_writer&&) = delete;
+
+    // Replaces any snapshot of `filename` that hasn't been written yet
+    void add(tr_torrent_id_t tor_id, std::string_view filename, std::unique_ptr<Snapshot> snapshot);
+
+    // Removes `filename` once any write to it that's in progress is done
+    void remove(std::string_view filename);
+
+    // Start writing the pending snapshots
+    void flush();
+
+    // flush() and wait for every pending write to finish
+    void wait();
+
+    // @return the number of files that are waiting to be written or removed
+    [[nodiscard]] size_t size() const;
+
+private:
+    struct Item
+    {
+        tr_torrent_id_t tor_id = {};
+        std::unique_ptr<Snapshot> snapshot; // nullptr to remove the file
+    };
+
+    struct Dir
+    {
+        std::map<std::string, Item, std::less<>> items;
+        bool busy = false;
+    };
+
+    void enqueue(std::string_view filename, Item&& item);
+    void flush_locked();
+    void write_dir(std::string const& dirname);
+
+    tr_executor& executor_;
+    ErrorFunc const on_error_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable idle_cv_;
+    std::map<std::string, Dir, std::less<>> dirs_;
+};
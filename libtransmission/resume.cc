@@ -5,7 +5,9 @@
 
 #include <cstring>
 #include <ctime>
+#include <memory>
 #include <string_view>
+#include <utility> // std::move()
 #include <vector>
 
 #include <fmt/core.h>
@@ -17,6 +19,7 @@
 #include "libtransmission/log.h"
 #include "libtransmission/magnet-metainfo.h"
 #include "libtransmission/peer-mgr.h" /* pex */
+#include "libtransmission/resume-writer.h"
 #include "libtransmission/resume.h"
 #include "libtransmission/session.h"
 #include "libtransmission/torrent.h"
@@ -445,7 +448,7 @@ void rawToBitfield(tr_bitfield& bitfield, uint8_t const* raw, size_t rawlen)
 
 void saveProgress(tr_variant* dict, tr_torrent const* tor)
 {
-    tr_variant* const prog = tr_variantDictAddDict(dict, TR_KEY_progress, 4);
+    tr_variant* const prog = tr_variantDictAddDict(dict, TR_KEY_progress, 5);
 
     // add the mtimes
     auto const& mtimes = tor->file_mtimes_;
@@ -459,14 +462,41 @@ void saveProgress(tr_variant* dict, tr_torrent const* tor)
     // add the 'checked pieces' bitfield
     bitfieldToRaw(tor->checked_pieces_, tr_variantDictAdd(prog, TR_KEY_pieces));
 
+    // add where an unfinished verify left off
+    if (auto const& checkpoint = tor->verify_checkpoint_; checkpoint)
+    {
+        tr_variant* const verify = tr_variantDictAddDict(prog, TR_KEY_verify, 3);
+        tr_variantDictAddInt(verify, TR_KEY_piece, checkpoint->piece);
+        tr_variantDictAddBool(verify, TR_KEY_quick, checkpoint->quick);
+        tr_variantDictAddBool(verify, TR_KEY_paused, checkpoint->paused);
+    }
+
+    // Pieces that may not have reached the disk yet are saved as missing,
+    // so that they're downloaded again instead of trusted after a crash.
+    // See tr_piece_syncer.
+    auto const unsynced = tor->session->piece_syncer().unsynced_pieces(tor->id());
+
     /* add the progress */
-    if (tor->completeness == TR_SEED)
+    if (tor->completeness == TR_SEED && std::empty(unsynced))
     {
         tr_variantDictAddStrView(prog, TR_KEY_have, "all"sv);
     }
 
     /* add the blocks bitfield */
-    bitfieldToRaw(tor->blocks(), tr_variantDictAdd(prog, TR_KEY_blocks));
+    if (std::empty(unsynced))
+    {
+        bitfieldToRaw(tor->blocks(), tr_variantDictAdd(prog, TR_KEY_blocks));
+    }
+    else
+    {
+        auto blocks = tor->blocks();
+        for (auto const piece : unsynced)
+        {
+            auto const [begin, end] = tor->block_span_for_piece(piece);
+            blocks.unset_span(begin, end);
+        }
+        bitfieldToRaw(blocks, tr_variantDictAdd(prog, TR_KEY_blocks));
+    }
 }
 
 /*
@@ -476,6 +506,8 @@ void saveProgress(tr_variant* dict, tr_torrent const* tor)
  * Current approach: 'progress' is a dict with two entries:
  * - 'pieces' a bitfield for whether each piece has been checked.
  * - 'mtimes', an array of per-file timestamps
+ * and, while a verify is unfinished, a 'verify' dict with the
+ * 'piece' it'll pick up from and whether it's 'quick' or 'paused'.
  * On startup, 'pieces' is loaded. Then we check to see if the disk
  * mtimes differ from the 'mtimes' list. Changed files have their
  * pieces cleared from the bitset.
@@ -564,6 +596,22 @@ auto loadProgress(tr_variant* dict, tr_torrent* tor)
 
         tor->init_checked_pieces(checked, std::data(mtimes));
 
+        /// UNFINISHED VERIFY
+
+        tor->verify_checkpoint_.reset();
+        if (tr_variant* verify = nullptr; tr_variantDictFindDict(prog, TR_KEY_verify, &verify))
+        {
+            if (auto piece = int64_t{};
+                tr_variantDictFindInt(verify, TR_KEY_piece, &piece) && piece >= 0 && piece < tor->piece_count())
+            {
+                auto checkpoint = tr_torrent::VerifyCheckpoint{};
+                checkpoint.piece = static_cast<tr_piece_index_t>(piece);
+                (void)tr_variantDictFindBool(verify, TR_KEY_quick, &checkpoint.quick);
+                (void)tr_variantDictFindBool(verify, TR_KEY_paused, &checkpoint.paused);
+                tor->verify_checkpoint_ = checkpoint;
+            }
+        }
+
         /// COMPLETION
 
         auto blocks = tr_bitfield{ tor->block_count() };
@@ -619,7 +667,7 @@ auto loadProgress(tr_variant* dict, tr_torrent* tor)
 
 // ---
 
-auto loadFromFile(tr_torrent* tor, tr_resume::fields_t fields_to_load)
+auto loadFromFile(tr_torrent* tor, tr_resume::fields_t fields_to_load, tr_ctor const* ctor)
 {
     auto fields_loaded = tr_resume::fields_t{};
 
@@ -628,17 +676,32 @@ auto loadFromFile(tr_torrent* tor, tr_resume::fields_t fields_to_load)
 
     tr_torrent_metainfo::migrate_file(tor->session->resumeDir(), tor->name(), tor->info_hash_string(), ".resume"sv);
 
+    // records in the journal are newer than any .resume file
     auto const filename = tor->resume_file();
-    if (!tr_sys_path_exists(filename))
+    auto const* const journal = tor->session->resume_journal();
+    auto const* prefetched = journal != nullptr ? journal->get(tor->info_hash()) : nullptr;
+    if (prefetched == nullptr)
+    {
+        prefetched = tr_ctorGetResumeContents(ctor, filename.sv());
+    }
+
+    if (prefetched == nullptr && !tr_sys_path_exists(filename))
     {
         return fields_loaded;
     }
 
     auto buf = std::vector<char>{};
     tr_error* error = nullptr;
+    auto arena = tr_variant_arena{};
     auto top = tr_variant{};
-    if (!tr_file_read(filename, buf, &error) ||
-        !tr_variantFromBuf(&top, TR_VARIANT_PARSE_BENC | TR_VARIANT_PARSE_INPLACE, buf, nullptr, &error))
+    if ((prefetched == nullptr && !tr_file_read(filename, buf, &error)) ||
+        !tr_variantFromBuf(
+            &top,
+            TR_VARIANT_PARSE_BENC | TR_VARIANT_PARSE_INPLACE,
+            prefetched != nullptr ? *prefetched : buf,
+            nullptr,
+            &error,
+            &arena))
     {
         tr_logAddDebugTor(tor, fmt::format("Couldn't read '{}': {}", filename, error->message));
         tr_error_clear(&error);
@@ -706,6 +769,13 @@ auto loadFromFile(tr_torrent* tor, tr_resume::fields_t fields_to_load)
         fields_loaded |= tr_resume::Run;
     }
 
+    if (auto val = bool{};
+        (fields_to_load & tr_resume::SuperSeeding) != 0 && tr_variantDictFindBool(&top, TR_KEY_superSeeding, &val))
+    {
+        tor->set_super_seeding(val);
+        fields_loaded |= tr_resume::SuperSeeding;
+    }
+
     if ((fields_to_load & tr_resume::AddedDate) != 0 && tr_variantDictFindInt(&top, TR_KEY_added_date, &i))
     {
         tor->addedDate = i;
@@ -863,7 +933,7 @@ fields_t load(tr_torrent* tor, fields_t fields_to_load, tr_ctor const* ctor)
 
     ret |= useMandatoryFields(tor, fields_to_load, ctor);
     fields_to_load &= ~ret;
-    ret |= loadFromFile(tor, fields_to_load);
+    ret |= loadFromFile(tor, fields_to_load, ctor);
     fields_to_load &= ~ret;
     ret |= useFallbackFields(tor, fields_to_load, ctor);
 
@@ -877,9 +947,11 @@ void save(tr_torrent* tor)
         return;
     }
 
-    auto top = tr_variant{};
+    // build the snapshot here, but serialize and write it in the background
+    auto snapshot = std::make_unique<tr_resume_writer::Snapshot>();
+    auto& top = snapshot->top;
     auto const now = tr_time();
-    tr_variantInitDict(&top, 50); /* arbitrary "big enough" number */
+    tr_variantInitDict(&top, 50, &snapshot->arena); /* arbitrary "big enough" number */
     tr_variantDictAddInt(&top, TR_KEY_seeding_time_seconds, tor->seconds_seeding(now));
     tr_variantDictAddInt(&top, TR_KEY_downloading_time_seconds, tor->seconds_downloading(now));
     tr_variantDictAddInt(&top, TR_KEY_activity_date, tor->activityDate);
@@ -899,6 +971,7 @@ void save(tr_torrent* tor)
     tr_variantDictAddInt(&top, TR_KEY_bandwidth_priority, tor->get_priority());
     tr_variantDictAddBool(&top, TR_KEY_paused, !tor->start_when_stable);
     tr_variantDictAddBool(&top, TR_KEY_sequentialDownload, tor->is_sequential_download());
+    tr_variantDictAddBool(&top, TR_KEY_superSeeding, tor->is_super_seeding());
     savePeers(&top, tor);
 
     if (tor->has_metainfo())
@@ -916,13 +989,14 @@ void save(tr_torrent* tor)
     saveLabels(&top, tor);
     saveGroup(&top, tor);
 
-    auto const resume_file = tor->resume_file();
-    if (auto const err = tr_variantToFile(&top, TR_VARIANT_FMT_BENC, resume_file); err != 0)
+    if (auto* const journal = tor->session->resume_journal(); journal != nullptr)
     {
-        tor->set_local_error(fmt::format("Unable to save resume file: {:s}", tr_strerror(err)));
+        journal->set(tor->info_hash(), tr_variantToStr(&top, TR_VARIANT_FMT_BENC));
+    }
+    else
+    {
+        tor->session->resume_writer().add(tor->id(), tor->resume_file(), std::move(snapshot));
     }
-
-    tr_variantClear(&top);
 }
 
 } // namespace tr_resume
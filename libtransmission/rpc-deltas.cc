@@ -0,0 +1,102 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <array>
+#include <cstdint> // int64_t
+#include <cstring> // memcpy()
+#include <functional> // std::hash
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "libtransmission/transmission.h"
+
+#include "libtransmission/rpc-deltas.h"
+#include "libtransmission/variant.h"
+
+template<typename Key>
+std::vector<Key> tr_rpc_delta_store<Key>::Snapshot::ids() const
+{
+    auto ret = std::vector<Key>{};
+    ret.reserve(std::size(hashes_));
+    for (auto const& [id, hashes] : hashes_)
+    {
+        ret.push_back(id);
+    }
+    return ret;
+}
+
+template<typename Key>
+typename tr_rpc_delta_store<Key>::Snapshot const* tr_rpc_delta_store<Key>::find(
+    Token token,
+    std::vector<tr_quark> const& fields) const
+{
+    auto const iter = std::find_if(
+        std::begin(snapshots_),
+        std::end(snapshots_),
+        [token](auto const& item) { return item.first == token; });
+
+    if (iter == std::end(snapshots_) || iter->second.fields() != fields)
+    {
+        return nullptr;
+    }
+
+    return &iter->second;
+}
+
+template<typename Key>
+typename tr_rpc_delta_store<Key>::Token tr_rpc_delta_store<Key>::add(Snapshot snapshot)
+{
+    auto const token = next_token_++;
+
+    snapshots_.emplace_back(token, std::move(snapshot));
+    while (std::size(snapshots_) > MaxSnapshots)
+    {
+        snapshots_.pop_front();
+    }
+
+    return token;
+}
+
+template<typename Key>
+typename tr_rpc_delta_store<Key>::Hash tr_rpc_delta_store<Key>::hash(tr_variant const* var)
+{
+    // mix the type in so that e.g. `0` and `false` differ
+    auto const mix = [var](auto const& val)
+    {
+        auto buf = std::array<char, sizeof(val) + 1U>{};
+        buf[0] = var->type;
+        std::memcpy(std::data(buf) + 1, &val, sizeof(val));
+        return Hash{ std::hash<std::string_view>{}(std::string_view{ std::data(buf), std::size(buf) }) };
+    };
+
+    if (auto val = int64_t{}; tr_variantIsInt(var) && tr_variantGetInt(var, &val))
+    {
+        return mix(val);
+    }
+
+    if (auto val = bool{}; tr_variantIsBool(var) && tr_variantGetBool(var, &val))
+    {
+        return mix(val);
+    }
+
+    if (auto val = double{}; tr_variantIsReal(var) && tr_variantGetReal(var, &val))
+    {
+        return mix(val);
+    }
+
+    if (auto sv = std::string_view{}; tr_variantGetStrView(var, &sv))
+    {
+        return std::hash<std::string_view>{}(sv);
+    }
+
+    // Containers, e.g. `files` or `peers`. Benc sorts the dict keys,
+    // so equal values always serialize the same way.
+    return std::hash<std::string>{}(tr_variantToStr(var, TR_VARIANT_FMT_BENC));
+}
+
+template class tr_rpc_delta_store<tr_torrent_id_t>;
+template class tr_rpc_delta_store<tr_rpc_peer_key>;
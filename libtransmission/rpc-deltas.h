@@ -0,0 +1,113 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <cstddef> // size_t
+#include <cstdint> // uint16_t, uint64_t
+#include <deque>
+#include <map>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "libtransmission/transmission.h" // tr_torrent_id_t
+
+#include "libtransmission/quark.h"
+
+struct tr_variant;
+
+/**
+ * Remembers what recent delta-mode responses sent, so that the next
+ * request can send only the fields whose values have changed.
+ *
+ * Each response's state is saved as a `Snapshot` of per-field hashes and
+ * given a token. Clients pass the token back in their next request.
+ * Only the last few snapshots are kept; an unknown token gets a full reply.
+ *
+ * `Key` identifies an item in a response, e.g. a torrent's id.
+ */
+template<typename Key>
+class tr_rpc_delta_store
+{
+public:
+    using Token = uint64_t;
+    using Hash = uint64_t;
+
+    class Snapshot
+    {
+    public:
+        Snapshot() = default;
+
+        explicit Snapshot(std::vector<tr_quark> fields)
+            : fields_{ std::move(fields) }
+        {
+        }
+
+        [[nodiscard]] constexpr auto const& fields() const noexcept
+        {
+            return fields_;
+        }
+
+        // @return the field hashes last sent for `key`, or nullptr if none
+        [[nodiscard]] std::vector<Hash> const* find(Key const& key) const
+        {
+            auto const iter = hashes_.find(key);
+            return iter != std::end(hashes_) ? &iter->second : nullptr;
+        }
+
+        void set(Key const& key, std::vector<Hash> hashes)
+        {
+            hashes_.insert_or_assign(key, std::move(hashes));
+        }
+
+        void erase(Key const& key)
+        {
+            hashes_.erase(key);
+        }
+
+        [[nodiscard]] std::vector<Key> ids() const;
+
+    private:
+        std::vector<tr_quark> fields_;
+        std::map<Key, std::vector<Hash>> hashes_;
+    };
+
+    // @return the snapshot for `token` if it was made with the same fields
+    [[nodiscard]] Snapshot const* find(Token token, std::vector<tr_quark> const& fields) const;
+
+    // @return the token that identifies `snapshot` in later requests
+    Token add(Snapshot snapshot);
+
+    // @return a hash of `var`'s value, suitable for noticing changes
+    [[nodiscard]] static Hash hash(tr_variant const* var);
+
+private:
+    static auto constexpr MaxSnapshots = size_t{ 4U };
+
+    std::deque<std::pair<Token, Snapshot>> snapshots_;
+    Token next_token_ = 1U;
+};
+
+// A peer's torrent, address, and port
+using tr_rpc_peer_key = std::tuple<tr_torrent_id_t, std::string, uint16_t>;
+
+extern template class tr_rpc_delta_store<tr_torrent_id_t>;
+extern template class tr_rpc_delta_store<tr_rpc_peer_key>;
+
+// `torrent-get`'s snapshots, keyed by torrent id
+class tr_rpc_deltas : public tr_rpc_delta_store<tr_torrent_id_t>
+{
+};
+
+// `torrent-peers`' snapshots
+class tr_rpc_peer_deltas : public tr_rpc_delta_store<tr_rpc_peer_key>
+{
+};
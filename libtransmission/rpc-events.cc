@@ -0,0 +1,397 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint> // int64_t
+#include <ctime>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include "libtransmission/transmission.h"
+
+#include "libtransmission/log.h"
+#include "libtransmission/quark.h"
+#include "libtransmission/rpc-events.h"
+#include "libtransmission/rpcimpl.h"
+#include "libtransmission/session.h"
+#include "libtransmission/timer.h"
+#include "libtransmission/torrent.h"
+#include "libtransmission/tr-assert.h"
+#include "libtransmission/utils.h"
+#include "libtransmission/variant.h"
+
+using namespace std::literals;
+
+namespace
+{
+// the most log messages to hold between pulses
+auto constexpr MaxLogLines = size_t{ 1000U };
+
+[[nodiscard]] std::string make_event(std::string_view name, tr_variant const& data)
+{
+    // lean JSON has no newlines, so the data fits on one `data:` line
+    return fmt::format("event: {:s}\ndata: {:s}\n\n", name, tr_variantToStr(&data, TR_VARIANT_FMT_JSON_LEAN));
+}
+
+[[nodiscard]] std::string make_torrent_event(std::string_view name, tr_torrent const* tor)
+{
+    auto data = tr_variant{};
+    tr_variantInitDict(&data, 3);
+    tr_variantDictAddInt(&data, TR_KEY_id, tor->id());
+    tr_variantDictAddStr(&data, TR_KEY_hashString, tor->info_hash_string());
+    tr_variantDictAddStr(&data, TR_KEY_name, tor->name());
+    auto ret = make_event(name, data);
+    tr_variantClear(&data);
+    return ret;
+}
+
+void session_stats_func(tr_session* /*session*/, tr_variant* response, void* vsetme)
+{
+    if (auto* args = tr_variantDictFind(response, TR_KEY_arguments); args != nullptr)
+    {
+        *static_cast<std::string*>(vsetme) = make_event("session-stats"sv, *args);
+    }
+}
+} // namespace
+
+tr_rpc_events::tr_rpc_events(tr_session* session, std::chrono::milliseconds interval)
+    : session_{ session }
+    , interval_{ interval }
+    , timer_{ session->timerMaker().create([this]() { pulse(); }) }
+{
+}
+
+tr_rpc_events::~tr_rpc_events()
+{
+    if (is_log_tapped_)
+    {
+        tr_logSetTap(nullptr, nullptr);
+    }
+}
+
+std::vector<std::string> tr_rpc_events::default_fields()
+{
+    // the fields that clients show in their torrent lists
+    return {
+        "error", "errorString", "eta", "id", "leftUntilDone", "name", "peersConnected",
+        "percentDone", "queuePosition", "rateDownload", "rateUpload", "sizeWhenDone", "status", "uploadRatio",
+    };
+}
+
+tr_rpc_events::Id tr_rpc_events::subscribe(std::unique_ptr<Sink> sink, std::vector<std::string> fields, tr_log_level log_level)
+{
+    TR_ASSERT(sink);
+
+    auto const lock = session_->unique_lock();
+
+    // subscribers that ask for the same fields in any order share a channel
+    fields.emplace_back("id");
+    std::sort(std::begin(fields), std::end(fields));
+    fields.erase(std::unique(std::begin(fields), std::end(fields)), std::end(fields));
+
+    if (std::empty(subscribers_))
+    {
+        // start from now, so that the new subscriber isn't told
+        // that every torrent was just added
+        is_done_.clear();
+        for (auto const* const tor : session_->torrents())
+        {
+            is_done_.try_emplace(tor->id(), tor->is_done());
+        }
+
+        session_stats_.clear();
+        timer_->start_repeating(interval_);
+    }
+
+    auto const id = next_id_++;
+    auto [iter, is_new_channel] = channels_.try_emplace(fields);
+    auto& channel = iter->second;
+    channel.subscribers.push_back(id);
+
+    // a new channel's first snapshot is this subscriber's starting point;
+    // otherwise, this subscriber starts with its own full copy and then
+    // gets the channel's changes with everyone else
+    sink->write(": Transmission events\n\n"sv);
+    sink->write(make_torrents_event(is_new_channel ? &channel : nullptr, fields));
+    if (!std::empty(session_stats_))
+    {
+        sink->write(session_stats_);
+    }
+
+    subscribers_.try_emplace(id, Subscriber{ std::move(sink), std::move(fields), log_level });
+    update_log_tap();
+
+    tr_logAddDebug(fmt::format("RPC event subscriber {} added; {} subscribers", id, std::size(subscribers_)));
+    return id;
+}
+
+void tr_rpc_events::unsubscribe(Id id)
+{
+    auto const iter = subscribers_.find(id);
+    if (iter == std::end(subscribers_))
+    {
+        return;
+    }
+
+    if (auto const chan = channels_.find(iter->second.fields); chan != std::end(channels_))
+    {
+        auto& subs = chan->second.subscribers;
+        subs.erase(std::remove(std::begin(subs), std::end(subs), id), std::end(subs));
+        if (std::empty(subs))
+        {
+            channels_.erase(chan);
+        }
+    }
+
+    subscribers_.erase(iter);
+    update_log_tap();
+
+    if (std::empty(subscribers_))
+    {
+        timer_->stop();
+    }
+
+    tr_logAddDebug(fmt::format("RPC event subscriber {} removed; {} subscribers", id, std::size(subscribers_)));
+}
+
+void tr_rpc_events::set_interval(std::chrono::milliseconds interval)
+{
+    interval_ = interval;
+
+    if (!std::empty(subscribers_))
+    {
+        timer_->start_repeating(interval_);
+    }
+}
+
+void tr_rpc_events::pulse()
+{
+    if (std::empty(subscribers_))
+    {
+        return;
+    }
+
+    auto const lock = session_->unique_lock();
+
+    send_torrent_events();
+    send_torrent_changes();
+    send_session_stats();
+    send_log_lines();
+    send_keepalive();
+}
+
+// ---
+
+std::string tr_rpc_events::make_torrents_event(Channel* channel, std::vector<std::string> const& fields)
+{
+    auto args_in = tr_variant{};
+    tr_variantInitDict(&args_in, 2);
+    auto* const list = tr_variantDictAddList(&args_in, TR_KEY_fields, std::size(fields));
+    for (auto const& field : fields)
+    {
+        tr_variantListAddStr(list, field);
+    }
+
+    if (channel != nullptr)
+    {
+        tr_variantDictAddInt(&args_in, TR_KEY_delta_token, static_cast<int64_t>(channel->token));
+    }
+
+    auto unused = tr_rpc_deltas{};
+    auto args_out = tr_variant{};
+    tr_variantInitDict(&args_out, 4);
+    (void)tr_rpc_torrent_get(session_, channel != nullptr ? channel->deltas : unused, &args_in, &args_out);
+
+    // the other torrent events already say which torrents were removed
+    auto is_full = channel == nullptr;
+    if (channel != nullptr)
+    {
+        if (auto token = int64_t{}; tr_variantDictFindInt(&args_out, TR_KEY_delta_token, &token))
+        {
+            channel->token = static_cast<tr_rpc_deltas::Token>(token);
+        }
+
+        (void)tr_variantDictFindBool(&args_out, TR_KEY_delta_full, &is_full);
+        tr_variantDictRemove(&args_out, TR_KEY_delta_token);
+        tr_variantDictRemove(&args_out, TR_KEY_delta_full);
+        tr_variantDictRemove(&args_out, TR_KEY_removed);
+    }
+
+    auto ret = std::string{};
+    auto* const torrents = tr_variantDictFind(&args_out, TR_KEY_torrents);
+    if (is_full || (torrents != nullptr && tr_variantListSize(torrents) > 0U))
+    {
+        ret = make_event(is_full ? "torrents"sv : "torrent-changed"sv, args_out);
+    }
+
+    tr_variantClear(&args_out);
+    tr_variantClear(&args_in);
+    return ret;
+}
+
+void tr_rpc_events::send_torrent_events()
+{
+    auto is_done = std::map<tr_torrent_id_t, bool>{};
+    auto text = std::string{};
+
+    for (auto const* const tor : session_->torrents())
+    {
+        auto const id = tor->id();
+        auto const done = tor->is_done();
+        is_done.try_emplace(id, done);
+
+        if (auto const iter = is_done_.find(id); iter == std::end(is_done_))
+        {
+            text += make_torrent_event("torrent-added"sv, tor);
+        }
+        else if (done && !iter->second)
+        {
+            text += make_torrent_event("torrent-completed"sv, tor);
+        }
+    }
+
+    for (auto const& [id, done] : is_done_)
+    {
+        if (is_done.count(id) == 0U)
+        {
+            text += fmt::format("event: torrent-removed\ndata: {{\"id\":{:d}}}\n\n", id);
+        }
+    }
+
+    is_done_ = std::move(is_done);
+
+    if (!std::empty(text))
+    {
+        write_all(text);
+    }
+}
+
+void tr_rpc_events::send_torrent_changes()
+{
+    for (auto& [fields, channel] : channels_)
+    {
+        if (auto const text = make_torrents_event(&channel, fields); !std::empty(text))
+        {
+            for (auto const id : channel.subscribers)
+            {
+                write(id, text);
+            }
+        }
+    }
+}
+
+void tr_rpc_events::send_session_stats()
+{
+    auto request = tr_variant{};
+    tr_variantInitDict(&request, 1);
+    tr_variantDictAddStrView(&request, TR_KEY_method, "session-stats"sv);
+
+    auto text = std::string{};
+    tr_rpc_request_exec_json(session_, &request, session_stats_func, &text, true);
+    tr_variantClear(&request);
+
+    if (!std::empty(text) && text != session_stats_)
+    {
+        session_stats_ = std::move(text);
+        write_all(session_stats_);
+    }
+}
+
+void tr_rpc_events::send_log_lines()
+{
+    auto lines = std::vector<LogLine>{};
+    {
+        auto const lock = std::lock_guard{ log_mutex_ };
+        std::swap(lines, log_lines_);
+    }
+
+    for (auto& [id, subscriber] : subscribers_)
+    {
+        auto text = std::string{};
+        for (auto const& line : lines)
+        {
+            if (line.level <= subscriber.log_level)
+            {
+                text += line.text;
+            }
+        }
+
+        if (!std::empty(text))
+        {
+            subscriber.sink->write(text);
+        }
+    }
+}
+
+void tr_rpc_events::send_keepalive()
+{
+    // SSE comments are ignored by clients
+    if (auto const now = tr_time(); now - last_write_at_ >= KeepaliveInterval)
+    {
+        write_all(": keepalive\n\n"sv);
+    }
+}
+
+void tr_rpc_events::write_all(std::string_view text)
+{
+    for (auto& [id, subscriber] : subscribers_)
+    {
+        subscriber.sink->write(text);
+    }
+
+    last_write_at_ = tr_time();
+}
+
+void tr_rpc_events::write(Id id, std::string_view text)
+{
+    if (auto const iter = subscribers_.find(id); iter != std::end(subscribers_))
+    {
+        iter->second.sink->write(text);
+        last_write_at_ = tr_time();
+    }
+}
+
+// ---
+
+void tr_rpc_events::update_log_tap()
+{
+    auto const wants_log = std::any_of(
+        std::begin(subscribers_),
+        std::end(subscribers_),
+        [](auto const& item) { return item.second.log_level != TR_LOG_OFF; });
+
+    if (wants_log != is_log_tapped_)
+    {
+        is_log_tapped_ = wants_log;
+        tr_logSetTap(wants_log ? on_log_message : nullptr, this);
+    }
+}
+
+void tr_rpc_events::on_log_message(tr_log_message const& message, void* vself)
+{
+    auto data = tr_variant{};
+    tr_variantInitDict(&data, 4);
+    tr_variantDictAddStrView(&data, TR_KEY_level, tr_logGetKeyFromLevel(message.level));
+    tr_variantDictAddInt(&data, TR_KEY_time, message.when);
+    tr_variantDictAddStr(&data, TR_KEY_name, message.name);
+    tr_variantDictAddStr(&data, TR_KEY_message, message.message);
+    auto text = make_event("log"sv, data);
+    tr_variantClear(&data);
+
+    auto* const self = static_cast<tr_rpc_events*>(vself);
+    auto const lock = std::lock_guard{ self->log_mutex_ };
+    if (std::size(self->log_lines_) < MaxLogLines)
+    {
+        self->log_lines_.push_back({ message.level, std::move(text) });
+    }
+}
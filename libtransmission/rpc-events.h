@@ -0,0 +1,156 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <chrono>
+#include <cstddef> // size_t
+#include <cstdint> // uint64_t
+#include <ctime> // time_t
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "libtransmission/transmission.h" // tr_torrent_id_t
+
+#include "libtransmission/log.h"
+#include "libtransmission/rpc-deltas.h"
+
+struct tr_session;
+
+namespace libtransmission
+{
+class Timer;
+}
+
+/**
+ * Pushes changes to RPC clients that subscribe to `<rpc-url>events`,
+ * as [Server-Sent Events](https://html.spec.whatwg.org/multipage/server-sent-events.html),
+ * so that they don't have to poll `torrent-get` and `session-stats`.
+ *
+ * Each pulse, the changes are found and serialized once for each set of
+ * fields that subscribers asked for, then written to all of them. So the
+ * work grows with how much changed, not with how many clients are watching.
+ *
+ * Events:
+ * - `torrents`: the subscribed fields of every torrent. Sent first, and
+ *   again if a subscriber needs to replace its state.
+ * - `torrent-changed`: the fields that changed, like delta-mode `torrent-get`.
+ * - `torrent-added`, `torrent-removed`, `torrent-completed`.
+ * - `session-stats`: the `session-stats` response, when it changes.
+ * - `log`: log messages, for subscribers that asked for them.
+ *
+ * Used only from the session thread.
+ */
+class tr_rpc_events
+{
+public:
+    // Where a subscriber's events are written, e.g. an HTTP response.
+    class Sink
+    {
+    public:
+        virtual ~Sink() = default;
+
+        virtual void write(std::string_view text) = 0;
+    };
+
+    using Id = uint64_t;
+
+    // send a comment to idle subscribers this often, so that proxies don't time out
+    static auto constexpr KeepaliveInterval = time_t{ 15 };
+
+    tr_rpc_events(tr_session* session, std::chrono::milliseconds interval);
+    ~tr_rpc_events();
+
+    tr_rpc_events(tr_rpc_events const&) = delete;
+    tr_rpc_events(tr_rpc_events&&) = delete;
+    tr_rpc_events& operator=(tr_rpc_events const&) = delete;
+    tr_rpc_events& operator=(tr_rpc_events&&) = delete;
+
+    // The `torrent-get` fields that are sent when a subscriber doesn't pick any.
+    [[nodiscard]] static std::vector<std::string> default_fields();
+
+    // Start sending events to `sink`, beginning with a `torrents` event.
+    // @param fields the `torrent-get` fields to send; `id` is always sent
+    // @param log_level also send log messages at this level or more important
+    Id subscribe(std::unique_ptr<Sink> sink, std::vector<std::string> fields, tr_log_level log_level = TR_LOG_OFF);
+
+    void unsubscribe(Id id);
+
+    [[nodiscard]] auto size() const noexcept
+    {
+        return std::size(subscribers_);
+    }
+
+    void set_interval(std::chrono::milliseconds interval);
+
+    // Find what changed since the last pulse and send it to the subscribers.
+    // This is called on a timer while there are subscribers.
+    void pulse();
+
+private:
+    // the subscribers that asked for the same fields
+    struct Channel
+    {
+        tr_rpc_deltas deltas;
+        tr_rpc_deltas::Token token = {};
+        std::vector<Id> subscribers;
+    };
+
+    struct Subscriber
+    {
+        std::unique_ptr<Sink> sink;
+        std::vector<std::string> fields;
+        tr_log_level log_level = TR_LOG_OFF;
+    };
+
+    struct LogLine
+    {
+        tr_log_level level = TR_LOG_OFF;
+        std::string text; // the whole event
+    };
+
+    [[nodiscard]] std::string make_torrents_event(Channel* channel, std::vector<std::string> const& fields);
+
+    void send_torrent_events();
+    void send_torrent_changes();
+    void send_session_stats();
+    void send_log_lines();
+    void send_keepalive();
+
+    void write_all(std::string_view text);
+    void write(Id id, std::string_view text);
+
+    void update_log_tap();
+    static void on_log_message(tr_log_message const& message, void* vself);
+
+    tr_session* const session_;
+    std::chrono::milliseconds interval_;
+    std::unique_ptr<libtransmission::Timer> timer_;
+
+    std::map<Id, Subscriber> subscribers_;
+    std::map<std::vector<std::string>, Channel> channels_;
+    Id next_id_ = 1U;
+
+    // whether each torrent was done as of the last pulse
+    std::map<tr_torrent_id_t, bool> is_done_;
+
+    // the last `session-stats` event that was sent
+    std::string session_stats_;
+
+    time_t last_write_at_ = 0;
+
+    // log messages can come from any thread
+    std::mutex log_mutex_;
+    std::vector<LogLine> log_lines_;
+    bool is_log_tapped_ = false;
+};
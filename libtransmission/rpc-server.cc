@@ -9,8 +9,11 @@
 #include <cstring> /* for strcspn() */
 #include <ctime>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
 #include <string_view>
+#include <tuple>
 #include <utility>
 #include <vector>
 
@@ -35,17 +38,29 @@
 
 #include "libtransmission/transmission.h"
 
+#include "libtransmission/cache.h"
 #include "libtransmission/crypto-utils.h" /* tr_ssha1_matches() */
 #include "libtransmission/error.h"
+#include "libtransmission/executor.h"
+#include "libtransmission/file.h"
 #include "libtransmission/log.h"
+#include "libtransmission/memory-budget.h"
+#include "libtransmission/metrics.h"
 #include "libtransmission/net.h"
+#include "libtransmission/peer-common.h" // tr_swarmGetStats()
 #include "libtransmission/platform.h" /* tr_getWebClientDir() */
 #include "libtransmission/quark.h"
+#include "libtransmission/rpc-events.h"
 #include "libtransmission/rpc-server.h"
+#include "libtransmission/rpc-whitelist.h"
 #include "libtransmission/rpcimpl.h"
 #include "libtransmission/session.h"
 #include "libtransmission/timer.h"
+#include "libtransmission/torrent-usage.h"
+#include "libtransmission/torrent.h"
 #include "libtransmission/tr-strbuf.h"
+#include "libtransmission/tracing.h"
+#include "libtransmission/utils-ev.h"
 #include "libtransmission/utils.h"
 #include "libtransmission/variant.h"
 #include "libtransmission/web-utils.h"
@@ -173,7 +188,8 @@ private:
 
 namespace
 {
-int constexpr DeflateLevel = 6; // medium / default
+// libdeflate supports levels 0 through 12
+auto constexpr MaxDeflateLevel = size_t{ 12U };
 
 // ---
 
@@ -220,14 +236,48 @@ void send_simple_response(struct evhttp_request* req, int code, char const* text
     return "application/octet-stream";
 }
 
-[[nodiscard]] evbuffer* make_response(struct evhttp_request* req, tr_rpc_server const* server, std::string_view content)
+[[nodiscard]] bool accepts_gzip(struct evhttp_request* req)
 {
-    auto* const out = evbuffer_new();
-
     char const* key = "Accept-Encoding";
     char const* encoding = evhttp_find_header(req->input_headers, key);
+    return encoding != nullptr && tr_strv_contains(encoding, "gzip"sv);
+}
+
+// Bencoded RPC is smaller than JSON and cheaper to print and parse,
+// which adds up in big `torrent-get` responses. Clients opt in with
+// `Accept` for responses and `Content-Type` for requests.
+[[nodiscard]] bool header_has_benc(struct evhttp_request* req, char const* key)
+{
+    char const* const value = evhttp_find_header(req->input_headers, key);
+    return value != nullptr && tr_strv_contains(value, std::string_view{ TR_RPC_BENC_CONTENT_TYPE });
+}
+
+// Compressing a small response saves fewer bytes than it costs in CPU,
+// so only compress if the client wants it and it's worth it.
+[[nodiscard]] bool should_compress(struct evhttp_request* req, tr_rpc_server const* server, size_t content_len)
+{
+    return server->compressor && content_len >= server->compression_min_size() && accepts_gzip(req);
+}
 
-    if (bool const do_compress = encoding != nullptr && tr_strv_contains(encoding, "gzip"sv); !do_compress)
+// @return a buffer that takes ownership of `content` instead of copying it
+[[nodiscard]] evbuffer* make_owned_buffer(std::string&& content)
+{
+    auto* const out = evbuffer_new();
+    auto* const owned = new std::string{ std::move(content) };
+    evbuffer_add_reference(
+        out,
+        std::data(*owned),
+        std::size(*owned),
+        [](void const* /*data*/, size_t /*datalen*/, void* vstr) { delete static_cast<std::string*>(vstr); },
+        owned);
+    return out;
+}
+
+[[nodiscard]] evbuffer* make_response(struct evhttp_request* req, tr_rpc_server const* server, std::string_view content)
+{
+    auto* const out = evbuffer_new();
+
+    if (!should_compress(req, server, std::size(content)))
     {
         evbuffer_add(out, std::data(content), std::size(content));
     }
@@ -261,13 +311,100 @@ void send_simple_response(struct evhttp_request* req, int code, char const* text
     return out;
 }
 
+// Same as above, but avoids copying uncompressed content by handing
+// ownership of the string to the evbuffer.
+[[nodiscard]] evbuffer* make_response(struct evhttp_request* req, tr_rpc_server const* server, std::string&& content)
+{
+    if (should_compress(req, server, std::size(content)) || std::empty(content))
+    {
+        return make_response(req, server, std::string_view{ content });
+    }
+
+    return make_owned_buffer(std::move(content));
+}
+
+// @return `content` gzipped, or an empty string if that doesn't make it smaller
+[[nodiscard]] std::string gzip(libdeflate_compressor* compressor, std::string_view content)
+{
+    auto ret = std::string{};
+    ret.resize(libdeflate_gzip_compress_bound(compressor, std::size(content)));
+    auto const compressed_len = libdeflate_gzip_compress(
+        compressor,
+        std::data(content),
+        std::size(content),
+        std::data(ret),
+        std::size(ret));
+    ret.resize(0 < compressed_len && compressed_len < std::size(content) ? compressed_len : 0U);
+    return ret;
+}
+
 void add_time_header(struct evkeyvalq* headers, char const* key, time_t now)
 {
     // RFC 2616 says this must follow RFC 1123's date format, so use gmtime instead of localtime
     evhttp_add_header(headers, key, fmt::format("{:%a %b %d %T %Y%n}", fmt::gmtime(now)).c_str());
 }
 
-void serve_file(struct evhttp_request* req, tr_rpc_server const* server, std::string_view filename)
+// Assets are only compressed when they're loaded, so use the best level
+// rather than the one that's configured for dynamic responses.
+// @return `content` gzipped, or an empty string if that doesn't make it smaller
+[[nodiscard]] std::string gzip_asset(tr_rpc_server const* server, std::string_view content)
+{
+    if (!server->compressor || std::size(content) < server->compression_min_size())
+    {
+        return {};
+    }
+
+    auto const compressor = std::unique_ptr<libdeflate_compressor, void (*)(libdeflate_compressor*)>{
+        libdeflate_alloc_compressor(static_cast<int>(MaxDeflateLevel)),
+        libdeflate_free_compressor
+    };
+    if (!compressor)
+    {
+        return {};
+    }
+
+    return gzip(compressor.get(), content);
+}
+
+// @return the cached copy of `filename`, (re)loading it if it's new or has changed on disk
+[[nodiscard]] tr_rpc_server::WebAsset const* get_web_asset(tr_rpc_server* server, std::string_view filename, tr_error** error)
+{
+    auto const info = tr_sys_path_get_info(filename, 0, error);
+    if (!info)
+    {
+        server->web_assets_.erase(std::string{ filename });
+        return nullptr;
+    }
+
+    if (auto const iter = server->web_assets_.find(filename); iter != std::end(server->web_assets_) &&
+        iter->second.size == info->size && iter->second.last_modified_at == info->last_modified_at)
+    {
+        return &iter->second;
+    }
+
+    auto content = std::vector<char>{};
+    if (!tr_file_read(filename, content, error))
+    {
+        server->web_assets_.erase(std::string{ filename });
+        return nullptr;
+    }
+
+    auto& asset = server->web_assets_[std::string{ filename }];
+    asset.size = info->size;
+    asset.last_modified_at = info->last_modified_at;
+    asset.content.assign(std::data(content), std::size(content));
+    asset.gzipped = gzip_asset(server, asset.content);
+    asset.etag = fmt::format("\"{:s}\"", tr_sha1_to_string(tr_sha1::digest(asset.content)));
+    return &asset;
+}
+
+[[nodiscard]] bool etag_matches(struct evhttp_request* req, std::string_view etag)
+{
+    char const* const if_none_match = evhttp_find_header(req->input_headers, "If-None-Match");
+    return if_none_match != nullptr && (tr_strv_contains(if_none_match, etag) || tr_strv_strip(if_none_match) == "*"sv);
+}
+
+void serve_file(struct evhttp_request* req, tr_rpc_server* server, std::string_view filename)
 {
     if (req->type != EVHTTP_REQ_GET)
     {
@@ -276,26 +413,47 @@ void serve_file(struct evhttp_request* req, tr_rpc_server const* server, std::st
         return;
     }
 
-    auto content = std::vector<char>{};
-
-    if (tr_error* error = nullptr; !tr_file_read(filename, content, &error))
+    tr_error* error = nullptr;
+    auto const* const asset = get_web_asset(server, filename, &error);
+    if (asset == nullptr)
     {
-        send_simple_response(req, HTTP_NOTFOUND, fmt::format("{} ({})", filename, error->message).c_str());
-        tr_error_free(error);
+        send_simple_response(
+            req,
+            HTTP_NOTFOUND,
+            fmt::format("{} ({})", filename, error != nullptr ? error->message : "").c_str());
+        tr_error_clear(&error);
         return;
     }
 
     auto const now = tr_time();
     add_time_header(req->output_headers, "Date", now);
     add_time_header(req->output_headers, "Expires", now + (24 * 60 * 60));
+    evhttp_add_header(req->output_headers, "Cache-Control", "public, max-age=86400");
+    evhttp_add_header(req->output_headers, "ETag", asset->etag.c_str());
+    evhttp_add_header(req->output_headers, "Vary", "Accept-Encoding");
+
+    if (etag_matches(req, asset->etag))
+    {
+        evhttp_send_reply(req, HTTP_NOTMODIFIED, "Not Modified", nullptr);
+        return;
+    }
+
     evhttp_add_header(req->output_headers, "Content-Type", mimetype_guess(filename));
 
-    auto* const response = make_response(req, server, std::string_view{ std::data(content), std::size(content) });
+    auto const use_gzip = !std::empty(asset->gzipped) && accepts_gzip(req);
+    auto const& body = use_gzip ? asset->gzipped : asset->content;
+    if (use_gzip)
+    {
+        evhttp_add_header(req->output_headers, "Content-Encoding", "gzip");
+    }
+
+    auto* const response = evbuffer_new();
+    evbuffer_add(response, std::data(body), std::size(body));
     evhttp_send_reply(req, HTTP_OK, "OK", response);
     evbuffer_free(response);
 }
 
-void handle_web_client(struct evhttp_request* req, tr_rpc_server const* server)
+void handle_web_client(struct evhttp_request* req, tr_rpc_server* server)
 {
     if (std::empty(server->web_client_dir_))
     {
@@ -341,28 +499,155 @@ void handle_web_client(struct evhttp_request* req, tr_rpc_server const* server)
     }
 }
 
+// libdeflate compressors can't be shared between threads,
+// so each executor thread keeps its own for RPC responses.
+[[nodiscard]] libdeflate_compressor* thread_compressor(int level)
+{
+    thread_local auto compressor = std::unique_ptr<libdeflate_compressor, void (*)(libdeflate_compressor*)>{
+        nullptr,
+        libdeflate_free_compressor
+    };
+    thread_local auto compressor_level = 0;
+
+    if (!compressor || compressor_level != level)
+    {
+        compressor.reset(libdeflate_alloc_compressor(level));
+        compressor_level = level;
+    }
+
+    return compressor.get();
+}
+
 struct rpc_response_data
 {
-    struct evhttp_request* req;
-    tr_rpc_server* server;
+    rpc_response_data(struct evhttp_request* req_in, tr_rpc_server* server_in)
+        : req{ req_in }
+        , server{ server_in }
+    {
+    }
+
+    ~rpc_response_data()
+    {
+        tr_variantClear(&response);
+    }
+
+    rpc_response_data(rpc_response_data const&) = delete;
+    rpc_response_data(rpc_response_data&&) = delete;
+    rpc_response_data& operator=(rpc_response_data const&) = delete;
+    rpc_response_data& operator=(rpc_response_data&&) = delete;
+
+    struct evhttp_request* const req;
+    tr_rpc_server* const server;
+
+    tr_variant response = {};
+    std::string body;
+    bool is_benc = false;
+    bool is_gzipped = false;
+
+    // set instead of `body` if the response was streamed straight into it
+    libtransmission::evhelpers::evbuffer_unique_ptr body_buf;
 };
 
-void rpc_response_func(tr_session* /*session*/, tr_variant* content, void* user_data)
+void send_rpc_response(rpc_response_data& data)
 {
-    auto* data = static_cast<struct rpc_response_data*>(user_data);
+    evhttp_add_header(
+        data.req->output_headers,
+        "Content-Type",
+        data.is_benc ? TR_RPC_BENC_CONTENT_TYPE : "application/json; charset=UTF-8");
+    if (data.is_gzipped)
+    {
+        evhttp_add_header(data.req->output_headers, "Content-Encoding", "gzip");
+    }
+
+    if (data.body_buf)
+    {
+        evhttp_send_reply(data.req, HTTP_OK, "OK", data.body_buf.get());
+        return;
+    }
 
-    auto* const response = make_response(data->req, data->server, tr_variantToStr(content, TR_VARIANT_FMT_JSON_LEAN));
-    evhttp_add_header(data->req->output_headers, "Content-Type", "application/json; charset=UTF-8");
-    evhttp_send_reply(data->req, HTTP_OK, "OK", response);
+    auto* const response = make_owned_buffer(std::move(data.body));
+    evhttp_send_reply(data.req, HTTP_OK, "OK", response);
     evbuffer_free(response);
+}
+
+// The response doesn't point into the session's state, so it can be
+// serialized and compressed in the executor without holding the session
+// lock. That keeps a big `torrent-get` from stalling peer I/O.
+void rpc_response_func(tr_session* session, tr_variant* content, void* user_data)
+{
+    auto data = std::shared_ptr<rpc_response_data>{ static_cast<rpc_response_data*>(user_data) };
+    auto* const server = data->server;
 
-    delete data;
+    data->response = *content;
+    tr_variantInitBool(content, false);
+
+    data->is_benc = header_has_benc(data->req, "Accept");
+    auto const is_benc = data->is_benc;
+    auto const n_threads = server->json_threads();
+    auto const min_size = server->compression_min_size();
+    auto const level = server->compressor && accepts_gzip(data->req) ? static_cast<int>(server->compression_level_) : 0;
+
+    server->begin_response();
+    session->executor().submit(
+        [session, server, data, is_benc, n_threads, min_size, level, alive = std::weak_ptr<bool>{ server->httpd_alive_ }]()
+        {
+            auto const* const response = &data->response;
+            if (is_benc)
+            {
+                data->body = tr_variantToStr(response, TR_VARIANT_FMT_BENC);
+            }
+            else if (level == 0 && n_threads <= 1U)
+            {
+                // nothing needs the whole body at once, so stream it
+                // into the reply's buffer instead of building a string
+                data->body_buf.reset(evbuffer_new());
+                tr_variantToBuf(response, TR_VARIANT_FMT_JSON_LEAN, data->body_buf.get());
+            }
+            else
+            {
+                data->body = n_threads > 1U ? tr_variantToStrJsonSharded(response, n_threads) :
+                                              tr_variantToStr(response, TR_VARIANT_FMT_JSON_LEAN);
+            }
+            tr_variantClear(&data->response);
+
+            if (level > 0 && std::size(data->body) >= min_size)
+            {
+                if (auto* const compressor = thread_compressor(level); compressor != nullptr)
+                {
+                    if (auto gzipped = gzip(compressor, data->body); !std::empty(gzipped))
+                    {
+                        data->body = std::move(gzipped);
+                        data->is_gzipped = true;
+                    }
+                }
+            }
+
+            session->runInSessionThread(
+                [data, alive]()
+                {
+                    // if httpd's gone, so is the request
+                    if (!alive.expired())
+                    {
+                        send_rpc_response(*data);
+                    }
+                });
+
+            server->end_response();
+        },
+        tr_executor::Priority::High);
 }
 
-void handle_rpc_from_json(struct evhttp_request* req, tr_rpc_server* server, std::string_view json)
+void handle_rpc_from_buf(struct evhttp_request* req, tr_rpc_server* server, std::string_view body)
 {
+    auto arena = tr_variant_arena{};
     auto top = tr_variant{};
-    auto const have_content = tr_variantFromBuf(&top, TR_VARIANT_PARSE_JSON | TR_VARIANT_PARSE_INPLACE, json);
+    auto const have_content = tr_variantFromBuf(
+        &top,
+        (header_has_benc(req, "Content-Type") ? TR_VARIANT_PARSE_BENC : TR_VARIANT_PARSE_JSON) | TR_VARIANT_PARSE_INPLACE,
+        body,
+        nullptr,
+        nullptr,
+        &arena);
 
     tr_rpc_request_exec_json(
         server->session,
@@ -380,15 +665,565 @@ void handle_rpc(struct evhttp_request* req, tr_rpc_server* server)
 {
     if (req->type == EVHTTP_REQ_POST)
     {
-        auto json = std::string_view{ reinterpret_cast<char const*>(evbuffer_pullup(req->input_buffer, -1)),
+        auto body = std::string_view{ reinterpret_cast<char const*>(evbuffer_pullup(req->input_buffer, -1)),
                                       evbuffer_get_length(req->input_buffer) };
-        handle_rpc_from_json(req, server, json);
+        handle_rpc_from_buf(req, server, body);
         return;
     }
 
     send_simple_response(req, HTTP_BADMETHOD);
 }
 
+// ---
+
+// Append the session's own stats, which are gathered on demand
+// rather than being counted by `tr_metrics`.
+void write_session_metrics(std::string& out, tr_session* session)
+{
+    using Metrics = tr_metrics;
+
+    auto n_running = uint64_t{};
+    auto n_peers = uint64_t{};
+    auto n_webseeds = uint64_t{};
+    auto n_active_peers = std::array<uint64_t, 2>{};
+    for (auto const* const tor : session->torrents())
+    {
+        n_running += tor->is_running() ? 1U : 0U;
+
+        if (tor->swarm != nullptr)
+        {
+            auto const stats = tr_swarmGetStats(tor->swarm);
+            n_peers += stats.peer_count;
+            n_webseeds += stats.active_webseed_count;
+            n_active_peers[TR_UP] += stats.active_peer_count[TR_UP];
+            n_active_peers[TR_DOWN] += stats.active_peer_count[TR_DOWN];
+        }
+    }
+
+    Metrics::write_header(out, "transmission_torrents"sv, "gauge"sv, "Torrents in the session."sv);
+    Metrics::write_sample(out, "transmission_torrents"sv, "state=\"running\""sv, n_running);
+    Metrics::write_sample(out, "transmission_torrents"sv, "state=\"paused\""sv, std::size(session->torrents()) - n_running);
+
+    Metrics::write_header(
+        out,
+        "transmission_peers"sv,
+        "gauge"sv,
+        "Connected peers, and the ones that are transferring data."sv);
+    Metrics::write_sample(out, "transmission_peers"sv, "state=\"connected\""sv, n_peers);
+    Metrics::write_sample(out, "transmission_peers"sv, "state=\"sending_to_us\""sv, n_active_peers[TR_DOWN]);
+    Metrics::write_sample(out, "transmission_peers"sv, "state=\"getting_from_us\""sv, n_active_peers[TR_UP]);
+
+    Metrics::write_header(out, "transmission_webseeds_sending_to_us"sv, "gauge"sv, "Webseeds that are sending data."sv);
+    Metrics::write_sample(out, "transmission_webseeds_sending_to_us"sv, {}, n_webseeds);
+
+    auto const stats = session->stats().cumulative();
+    Metrics::write_header(out, "transmission_downloaded_bytes_total"sv, "counter"sv, "Bytes downloaded, across restarts."sv);
+    Metrics::write_sample(out, "transmission_downloaded_bytes_total"sv, {}, stats.downloadedBytes);
+    Metrics::write_header(out, "transmission_uploaded_bytes_total"sv, "counter"sv, "Bytes uploaded, across restarts."sv);
+    Metrics::write_sample(out, "transmission_uploaded_bytes_total"sv, {}, stats.uploadedBytes);
+
+    Metrics::write_header(out, "transmission_speed_bytes_per_second"sv, "gauge"sv, "Piece data transfer speed."sv);
+    Metrics::write_sample(out, "transmission_speed_bytes_per_second"sv, "direction=\"up\""sv, session->pieceSpeedBps(TR_UP));
+    Metrics::write_sample(
+        out,
+        "transmission_speed_bytes_per_second"sv,
+        "direction=\"down\""sv,
+        session->pieceSpeedBps(TR_DOWN));
+
+    Metrics::write_header(
+        out,
+        "transmission_bandwidth_unused_bytes_total"sv,
+        "counter"sv,
+        "Bytes of the speed limits' allowance that went unused."sv);
+    Metrics::write_sample(
+        out,
+        "transmission_bandwidth_unused_bytes_total"sv,
+        "direction=\"up\""sv,
+        session->top_bandwidth_.get_unused_bytes(TR_UP));
+    Metrics::write_sample(
+        out,
+        "transmission_bandwidth_unused_bytes_total"sv,
+        "direction=\"down\""sv,
+        session->top_bandwidth_.get_unused_bytes(TR_DOWN));
+
+    if (auto const capacity = session->capacity_monitor().get(session->downloadDir(), tr_time()).capacity; capacity)
+    {
+        Metrics::write_header(
+            out,
+            "transmission_download_dir_free_bytes"sv,
+            "gauge"sv,
+            "Free space in the default download folder."sv);
+        Metrics::write_sample(out, "transmission_download_dir_free_bytes"sv, {}, static_cast<uint64_t>(capacity->free));
+    }
+
+    auto const& read_stats = session->cache->read_stats();
+    Metrics::write_header(out, "transmission_read_cache_hits_total"sv, "counter"sv, "Block reads served by the cache."sv);
+    Metrics::write_sample(out, "transmission_read_cache_hits_total"sv, {}, read_stats.hits);
+    Metrics::write_header(out, "transmission_read_cache_misses_total"sv, "counter"sv, "Block reads that went to disk."sv);
+    Metrics::write_sample(out, "transmission_read_cache_misses_total"sv, {}, read_stats.misses);
+
+    auto const& flush_stats = session->cache->flush_stats();
+    Metrics::write_header(out, "transmission_cache_flush_bytes_total"sv, "counter"sv, "Bytes written to flush the cache."sv);
+    Metrics::write_sample(out, "transmission_cache_flush_bytes_total"sv, {}, flush_stats.n_bytes);
+
+    session->io_scheduler().write_metrics(out);
+
+    auto const& memory_budget = session->memory_budget();
+    Metrics::write_header(
+        out,
+        "transmission_memory_bytes"sv,
+        "gauge"sv,
+        "Memory used by the caches, peer buffers, and metadata, by category."sv);
+    for (uint8_t i = 0U; i < tr_memory_usage::NumCategories; ++i)
+    {
+        auto const category = static_cast<tr_memory_usage::Category>(i);
+        Metrics::write_sample(
+            out,
+            "transmission_memory_bytes"sv,
+            fmt::format("category=\"{:s}\"", tr_memory_usage::name(category)),
+            memory_budget.usage().bytes[category]);
+    }
+    Metrics::write_header(
+        out,
+        "transmission_memory_budget_bytes"sv,
+        "gauge"sv,
+        "The limit on the memory counted by transmission_memory_bytes; 0 if there is none."sv);
+    Metrics::write_sample(out, "transmission_memory_budget_bytes"sv, {}, memory_budget.limit());
+    Metrics::write_header(
+        out,
+        "transmission_memory_pressure"sv,
+        "gauge"sv,
+        "How close memory use is to the budget: 0 for none, 1 for high, 2 for critical."sv);
+    Metrics::write_sample(out, "transmission_memory_pressure"sv, {}, static_cast<uint64_t>(memory_budget.pressure()));
+
+    auto const& open_file_stats = session->openFiles().stats();
+    Metrics::write_header(
+        out,
+        "transmission_open_file_hits_total"sv,
+        "counter"sv,
+        "File lookups served by the open-files pool."sv);
+    Metrics::write_sample(out, "transmission_open_file_hits_total"sv, {}, open_file_stats.hits);
+    Metrics::write_header(
+        out,
+        "transmission_open_file_misses_total"sv,
+        "counter"sv,
+        "File lookups that had to open the file."sv);
+    Metrics::write_sample(out, "transmission_open_file_misses_total"sv, {}, open_file_stats.misses);
+}
+
+// Append what each running torrent has cost, labeled by info hash.
+// Paused torrents are left out to keep the number of series down.
+void write_torrent_metrics(std::string& out, tr_session* session)
+{
+    using Metrics = tr_metrics;
+    using Usage = tr_torrent_usage;
+
+    auto torrents = std::vector<tr_torrent const*>{};
+    for (auto const* const tor : session->torrents())
+    {
+        if (tor->is_running())
+        {
+            torrents.push_back(tor);
+        }
+    }
+
+    auto const label = [](tr_torrent const* tor, std::string_view extra)
+    {
+        return fmt::format("torrent=\"{:s}\",{:s}", tor->info_hash_string().sv(), extra);
+    };
+
+    static auto constexpr CpuCounters = std::array<std::pair<Usage::Counter, std::string_view>, 3U>{ {
+        { Usage::ParseUsec, "task=\"parse\""sv },
+        { Usage::HashUsec, "task=\"hash\""sv },
+        { Usage::ServeUsec, "task=\"serve\""sv },
+    } };
+    Metrics::write_header(
+        out,
+        "transmission_torrent_cpu_seconds_total"sv,
+        "counter"sv,
+        "Time spent on each torrent's peer messages, piece checks, and uploads."sv);
+    for (auto const* const tor : torrents)
+    {
+        for (auto const& [counter, labels] : CpuCounters)
+        {
+            Metrics::write_sample(
+                out,
+                "transmission_torrent_cpu_seconds_total"sv,
+                label(tor, labels),
+                static_cast<double>(tor->usage().get(counter)) / 1000000.0);
+        }
+    }
+
+    // ops counter, bytes counter, and their labels
+    static auto constexpr IoCounters = std::array<std::tuple<Usage::Counter, Usage::Counter, std::string_view>, 4U>{ {
+        { Usage::CacheReads, Usage::CacheReadBytes, "op=\"read\",target=\"cache\""sv },
+        { Usage::DiskReads, Usage::DiskReadBytes, "op=\"read\",target=\"disk\""sv },
+        { Usage::CacheWrites, Usage::CacheWriteBytes, "op=\"write\",target=\"cache\""sv },
+        { Usage::DiskWrites, Usage::DiskWriteBytes, "op=\"write\",target=\"disk\""sv },
+    } };
+    Metrics::write_header(out, "transmission_torrent_io_total"sv, "counter"sv, "Each torrent's reads and writes."sv);
+    for (auto const* const tor : torrents)
+    {
+        for (auto const& [ops, bytes, labels] : IoCounters)
+        {
+            Metrics::write_sample(out, "transmission_torrent_io_total"sv, label(tor, labels), tor->usage().get(ops));
+        }
+    }
+    Metrics::write_header(
+        out,
+        "transmission_torrent_io_bytes_total"sv,
+        "counter"sv,
+        "Bytes in each torrent's reads and writes."sv);
+    for (auto const* const tor : torrents)
+    {
+        for (auto const& [ops, bytes, labels] : IoCounters)
+        {
+            Metrics::write_sample(out, "transmission_torrent_io_bytes_total"sv, label(tor, labels), tor->usage().get(bytes));
+        }
+    }
+
+    Metrics::write_header(
+        out,
+        "transmission_torrent_memory_bytes"sv,
+        "gauge"sv,
+        "Memory held for each torrent, by category."sv);
+    for (auto const* const tor : torrents)
+    {
+        auto const memory = tor->memory_usage();
+        auto const categories = std::array<std::pair<std::string_view, uint64_t>, 4U>{ {
+            { "category=\"cache\""sv, memory.cache },
+            { "category=\"read_cache\""sv, memory.read_cache },
+            { "category=\"peer_buffers\""sv, memory.peer_buffers },
+            { "category=\"metadata\""sv, memory.metadata },
+        } };
+        for (auto const& [labels, n_bytes] : categories)
+        {
+            Metrics::write_sample(out, "transmission_torrent_memory_bytes"sv, label(tor, labels), n_bytes);
+        }
+    }
+}
+
+void handle_metrics(struct evhttp_request* req, tr_rpc_server const* server)
+{
+    if (req->type != EVHTTP_REQ_GET)
+    {
+        evhttp_add_header(req->output_headers, "Allow", "GET");
+        send_simple_response(req, HTTP_BADMETHOD);
+        return;
+    }
+
+    auto content = std::string{};
+    write_session_metrics(content, server->session);
+    write_torrent_metrics(content, server->session);
+    tr_metrics::instance().write(content);
+
+    evhttp_add_header(req->output_headers, "Content-Type", "text/plain; version=0.0.4; charset=utf-8");
+    auto* const response = make_response(req, server, std::move(content));
+    evhttp_send_reply(req, HTTP_OK, "OK", response);
+    evbuffer_free(response);
+}
+
+void handle_trace(struct evhttp_request* req, tr_rpc_server const* server)
+{
+    if (req->type != EVHTTP_REQ_GET)
+    {
+        evhttp_add_header(req->output_headers, "Allow", "GET");
+        send_simple_response(req, HTTP_BADMETHOD);
+        return;
+    }
+
+    if (!tr_trace::Enabled)
+    {
+        send_simple_response(req, HTTP_NOTFOUND, "<p>Tracing isn't enabled in this build.</p>");
+        return;
+    }
+
+    auto content = std::string{};
+    tr_trace::write_json(content);
+
+    evhttp_add_header(req->output_headers, "Content-Type", "application/json; charset=UTF-8");
+    auto* const response = make_response(req, server, std::move(content));
+    evhttp_send_reply(req, HTTP_OK, "OK", response);
+    evbuffer_free(response);
+}
+
+// --- events
+
+class EventSink final : public tr_rpc_events::Sink
+{
+public:
+    EventSink(struct evhttp_request* req, tr_rpc_events& events)
+        : req_{ req }
+        , events_{ events }
+    {
+    }
+
+    void write(std::string_view text) override
+    {
+        auto* const buf = evbuffer_new();
+        evbuffer_add(buf, std::data(text), std::size(text));
+        evhttp_send_reply_chunk(req_, buf);
+        evbuffer_free(buf);
+    }
+
+    static void on_close(struct evhttp_connection* /*evcon*/, void* vself)
+    {
+        auto* const self = static_cast<EventSink*>(vself);
+        self->events_.unsubscribe(self->id); // deletes `self`
+    }
+
+    tr_rpc_events::Id id = {};
+
+private:
+    struct evhttp_request* const req_;
+    tr_rpc_events& events_;
+};
+
+// Push changes to the client as Server-Sent Events, e.g.
+// "/transmission/events?fields=id,name,percentDone&log=info".
+// The response stays open until the client goes away.
+void handle_events(struct evhttp_request* req, tr_rpc_server* server, std::string_view query)
+{
+    if (req->type != EVHTTP_REQ_GET)
+    {
+        evhttp_add_header(req->output_headers, "Allow", "GET");
+        send_simple_response(req, HTTP_BADMETHOD);
+        return;
+    }
+
+    auto fields = std::vector<std::string>{};
+    auto log_level = TR_LOG_OFF;
+    for (auto const& [key, val] : tr_url_query_view{ query })
+    {
+        auto const value = tr_urlPercentDecode(val);
+
+        if (key == "fields"sv)
+        {
+            for (auto sv = std::string_view{ value }, field = std::string_view{}; tr_strv_sep(&sv, &field, ',');)
+            {
+                if (field = tr_strv_strip(field); !std::empty(field))
+                {
+                    fields.emplace_back(field);
+                }
+            }
+        }
+        else if (key == "log"sv)
+        {
+            log_level = tr_logGetLevelFromKey(value).value_or(TR_LOG_OFF);
+        }
+    }
+
+    if (std::empty(fields))
+    {
+        fields = tr_rpc_events::default_fields();
+    }
+
+    if (!server->events_)
+    {
+        server->events_ = std::make_unique<tr_rpc_events>(
+            server->session,
+            std::chrono::milliseconds{ server->events_interval_msec_ });
+    }
+
+    evhttp_add_header(req->output_headers, "Content-Type", "text/event-stream; charset=UTF-8");
+    evhttp_add_header(req->output_headers, "Cache-Control", "no-cache");
+    evhttp_add_header(req->output_headers, "X-Accel-Buffering", "no"); // don't let nginx hold events back
+    evhttp_send_reply_start(req, HTTP_OK, "OK");
+
+    auto& events = *server->events_;
+    auto sink = std::make_unique<EventSink>(req, events);
+    auto* const sink_ptr = sink.get();
+    sink_ptr->id = events.subscribe(std::move(sink), std::move(fields), log_level);
+    evhttp_connection_set_closecb(evhttp_request_get_connection(req), EventSink::on_close, sink_ptr);
+}
+
+// --- streaming
+
+// the most bytes to send in one response; players ask again for the rest
+auto constexpr MaxStreamChunk = uint64_t{ 4U * 1024U * 1024U };
+
+// Parse a single-part `Range:` header, e.g. "bytes=100-", "bytes=100-199", or "bytes=-100".
+// @return the requested [begin, end) byte span of a file, or nullopt if it's unsatisfiable
+[[nodiscard]] std::optional<tr_byte_span_t> parse_range(char const* header, uint64_t file_size)
+{
+    if (header == nullptr)
+    {
+        return file_size == 0U ? std::nullopt : std::optional{ tr_byte_span_t{ 0U, file_size } };
+    }
+
+    static auto constexpr Prefix = "bytes="sv;
+    auto sv = tr_strv_strip(header);
+    if (!tr_strv_starts_with(sv, Prefix))
+    {
+        return {};
+    }
+    sv.remove_prefix(std::size(Prefix));
+
+    // suffix range: the last N bytes
+    if (tr_strv_starts_with(sv, '-'))
+    {
+        auto remainder = std::string_view{};
+        auto const n = tr_num_parse<uint64_t>(sv.substr(1), &remainder);
+        if (!n || *n == 0U || file_size == 0U || !std::empty(remainder))
+        {
+            return {};
+        }
+
+        return tr_byte_span_t{ file_size - std::min(*n, file_size), file_size };
+    }
+
+    auto remainder = std::string_view{};
+    auto const first = tr_num_parse<uint64_t>(sv, &remainder);
+    if (!first || !tr_strv_starts_with(remainder, '-'))
+    {
+        return {};
+    }
+    remainder.remove_prefix(1);
+
+    auto end = file_size;
+    if (!std::empty(remainder))
+    {
+        auto const last = tr_num_parse<uint64_t>(remainder, &remainder);
+        if (!last || !std::empty(remainder))
+        {
+            return {};
+        }
+
+        end = std::min(*last + 1U, file_size);
+    }
+
+    if (*first >= end)
+    {
+        return {};
+    }
+
+    return tr_byte_span_t{ *first, end };
+}
+
+// @return how many bytes, starting at `begin` and up to `max_bytes`, are in pieces we have
+[[nodiscard]] uint64_t count_streamable_bytes(tr_torrent const* tor, uint64_t begin, uint64_t max_bytes)
+{
+    auto n_bytes = uint64_t{};
+
+    for (auto piece = tor->byte_loc(begin).piece; n_bytes < max_bytes && piece < tor->piece_count(); ++piece)
+    {
+        if (!tor->has_piece(piece))
+        {
+            break;
+        }
+
+        n_bytes = tor->block_info().byte_span_for_piece(piece).end - begin;
+    }
+
+    return std::min(n_bytes, max_bytes);
+}
+
+// Read `n_bytes` of torrent data starting at `begin`, whole blocks at a time so that the cache can help
+[[nodiscard]] bool read_stream_bytes(tr_session* session, tr_torrent* tor, uint64_t begin, uint64_t n_bytes, evbuffer* out)
+{
+    auto block = std::vector<uint8_t>{};
+
+    while (n_bytes > 0U)
+    {
+        auto const loc = tor->byte_loc(begin);
+        auto const block_size = tor->block_size(loc.block);
+        block.resize(block_size);
+        if (session->cache->read_block(tor, tor->block_loc(loc.block), block_size, std::data(block)) != 0)
+        {
+            return false;
+        }
+
+        auto const n = std::min(n_bytes, uint64_t{ block_size - loc.block_offset });
+        evbuffer_add(out, std::data(block) + loc.block_offset, n);
+        begin += n;
+        n_bytes -= n;
+    }
+
+    return true;
+}
+
+// Serve a torrent's file to a media player, e.g. "/transmission/stream/<torrent id>/<file index>".
+// Only pieces that we have and have checked are served, and each request
+// moves the torrent's stream cursor so that the pieces after it are
+// downloaded first.
+void handle_stream(struct evhttp_request* req, tr_rpc_server* server, std::string_view subpath)
+{
+    if (req->type != EVHTTP_REQ_GET)
+    {
+        evhttp_add_header(req->output_headers, "Allow", "GET");
+        send_simple_response(req, HTTP_BADMETHOD);
+        return;
+    }
+
+    // find the torrent and file
+    subpath = subpath.substr(0, subpath.find_first_of("?#"sv));
+    auto remainder = std::string_view{};
+    auto const tor_id = tr_num_parse<tr_torrent_id_t>(subpath, &remainder);
+    auto const file = tr_strv_starts_with(remainder, '/') ? tr_num_parse<tr_file_index_t>(remainder.substr(1)) :
+                                                            std::nullopt;
+    auto* const tor = tor_id ? server->session->torrents().get(*tor_id) : nullptr;
+    if (tor == nullptr || !tor->has_metainfo() || !file || *file >= tor->file_count())
+    {
+        send_simple_response(req, HTTP_NOTFOUND, req->uri);
+        return;
+    }
+
+    evhttp_add_header(req->output_headers, "Accept-Ranges", "bytes");
+
+    auto const file_size = tor->file_size(*file);
+    auto const* const range_header = evhttp_find_header(req->input_headers, "Range");
+    auto const range = parse_range(range_header, file_size);
+    if (!range)
+    {
+        evhttp_add_header(req->output_headers, "Content-Range", fmt::format("bytes */{:d}", file_size).c_str());
+        send_simple_response(req, 416);
+        return;
+    }
+
+    // tell the scheduler where the reader is
+    auto const file_begin = tor->byte_span(*file).begin;
+    tor->set_stream_position(file_begin + range->begin, tr_time_msec());
+
+    auto const max_bytes = std::min(range->end - range->begin, MaxStreamChunk);
+    auto const n_bytes = count_streamable_bytes(tor, file_begin + range->begin, max_bytes);
+    if (n_bytes == 0U)
+    {
+        // the piece is now at the front of the line, so it shouldn't be long
+        evhttp_add_header(req->output_headers, "Retry-After", "1");
+        send_simple_response(req, HTTP_SERVUNAVAIL, "<p>That part of the file hasn't been downloaded yet.</p>");
+        return;
+    }
+
+    auto* const response = evbuffer_new();
+    if (!read_stream_bytes(server->session, tor, file_begin + range->begin, n_bytes, response))
+    {
+        evbuffer_free(response);
+        send_simple_response(req, HTTP_INTERNAL);
+        return;
+    }
+
+    auto const mime_type = std::string{ tr_get_mime_type_for_filename(tor->file_subpath(*file)) };
+    evhttp_add_header(
+        req->output_headers,
+        "Content-Type",
+        std::empty(mime_type) ? "application/octet-stream" : mime_type.c_str());
+
+    if (range_header == nullptr && n_bytes == file_size)
+    {
+        evhttp_send_reply(req, HTTP_OK, "OK", response);
+    }
+    else
+    {
+        auto const content_range = fmt::format("bytes {:d}-{:d}/{:d}", range->begin, range->begin + n_bytes - 1U, file_size);
+        evhttp_add_header(req->output_headers, "Content-Range", content_range.c_str());
+        evhttp_send_reply(req, 206, "Partial Content", response);
+    }
+
+    evbuffer_free(response);
+}
+
+// ---
+
 bool is_address_allowed(tr_rpc_server const* server, char const* address)
 {
     if (!server->is_whitelist_enabled())
@@ -396,8 +1231,7 @@ bool is_address_allowed(tr_rpc_server const* server, char const* address)
         return true;
     }
 
-    auto const& src = server->whitelist_;
-    return std::any_of(std::begin(src), std::end(src), [&address](auto const& s) { return tr_wildmat(address, s); });
+    return server->whitelist_.matches(address);
 }
 
 bool isIPAddressWithOptionalPort(char const* host)
@@ -438,16 +1272,15 @@ bool isHostnameAllowed(tr_rpc_server const* server, evhttp_request const* req)
     }
 
     /* Host header might include the port. */
-    auto const hostname = std::string(host, strcspn(host, ":"));
+    auto const hostname = std::string_view{ host, strcspn(host, ":") };
 
     /* localhost is always acceptable. */
-    if (hostname == "localhost" || hostname == "localhost.")
+    if (hostname == "localhost"sv || hostname == "localhost."sv)
     {
         return true;
     }
 
-    auto const& src = server->host_whitelist_;
-    return std::any_of(std::begin(src), std::end(src), [&hostname](auto const& str) { return tr_wildmat(hostname, str); });
+    return server->host_whitelist_.matches(hostname);
 }
 
 bool test_session_id(tr_rpc_server const* server, evhttp_request const* req)
@@ -456,29 +1289,56 @@ bool test_session_id(tr_rpc_server const* server, evhttp_request const* req)
     return session_id != nullptr && server->session->sessionId() == session_id;
 }
 
-bool is_authorized(tr_rpc_server const* server, char const* auth_header)
+// Compare in constant time so response timing doesn't leak the cached credentials
+[[nodiscard]] bool auth_headers_match(std::string_view lhs, std::string_view rhs) noexcept
+{
+    if (std::size(lhs) != std::size(rhs))
+    {
+        return false;
+    }
+
+    auto diff = 0U;
+    for (size_t i = 0, n = std::size(lhs); i < n; ++i)
+    {
+        diff |= static_cast<unsigned char>(lhs[i]) ^ static_cast<unsigned char>(rhs[i]);
+    }
+
+    return diff == 0U;
+}
+
+bool is_authorized(tr_rpc_server* server, char const* auth_header)
 {
     if (!server->is_password_enabled())
     {
         return true;
     }
 
+    auto auth = std::string_view{ auth_header != nullptr ? auth_header : "" };
+    if (!std::empty(auth) && auth_headers_match(auth, server->authorized_header_))
+    {
+        return true;
+    }
+
     // https://datatracker.ietf.org/doc/html/rfc7617
     // `Basic ${base64(username)}:${base64(password)}`
 
     auto constexpr Prefix = "Basic "sv;
-    auto auth = std::string_view{ auth_header != nullptr ? auth_header : "" };
     if (!tr_strv_starts_with(auth, Prefix))
     {
         return false;
     }
 
-    auth.remove_prefix(std::size(Prefix));
-    auto const decoded_str = tr_base64_decode(auth);
+    auto const decoded_str = tr_base64_decode(auth.substr(std::size(Prefix)));
     auto decoded = std::string_view{ decoded_str };
     auto const username = tr_strv_sep(&decoded, ':');
     auto const password = decoded;
-    return server->username() == username && tr_ssha1_matches(server->salted_password_, password);
+    if (server->username() != username || !tr_ssha1_matches(server->salted_password_, password))
+    {
+        return false;
+    }
+
+    server->authorized_header_ = auth;
+    return true;
 }
 
 void handle_request(struct evhttp_request* req, void* arg)
@@ -561,6 +1421,26 @@ void handle_request(struct evhttp_request* req, void* arg)
                 "attacks.</p>";
             send_simple_response(req, 421, tmp);
         }
+        else if (location == "metrics"sv)
+        {
+            // no session-id check: scrapers only GET, which can't change anything
+            handle_metrics(req, server);
+        }
+        else if (location == "trace"sv)
+        {
+            // no session-id check: like the metrics, this is a read-only GET
+            handle_trace(req, server);
+        }
+        else if (location == "events"sv || tr_strv_starts_with(location, "events?"sv))
+        {
+            // no session-id check: browsers' EventSource can't send one
+            handle_events(req, server, location.substr(std::min(std::size(location), std::size("events?"sv))));
+        }
+        else if (tr_strv_starts_with(location, "stream/"sv))
+        {
+            // no session-id check: media players can't send one
+            handle_stream(req, server, location.substr(std::size("stream/"sv)));
+        }
 #ifdef REQUIRE_SESSION_ID
         else if (!test_session_id(server, req))
         {
@@ -728,6 +1608,7 @@ void stop_server(tr_rpc_server* server)
     auto const address = server->get_bind_address();
 
     httpd.reset();
+    server->httpd_alive_ = std::make_shared<bool>(true);
 
     if (server->bind_address_->is_unix_addr())
     {
@@ -750,15 +1631,11 @@ void restart_server(tr_rpc_server* const server)
 
 auto parse_whitelist(std::string_view whitelist)
 {
-    auto list = std::vector<std::string>{};
+    auto list = tr_rpc_whitelist{ whitelist };
 
-    while (!std::empty(whitelist))
+    for (auto const& token : list.patterns())
     {
-        auto const pos = whitelist.find_first_of(" ,;"sv);
-        auto const token = tr_strv_strip(whitelist.substr(0, pos));
-        list.emplace_back(token);
         tr_logAddInfo(fmt::format(_("Added '{entry}' to host whitelist"), fmt::arg("entry", token)));
-        whitelist = pos == std::string_view::npos ? ""sv : whitelist.substr(pos + 1);
     }
 
     return list;
@@ -795,7 +1672,7 @@ void tr_rpc_server::set_port(tr_port port) noexcept
 
     if (is_enabled())
     {
-        session->runInSessionThread(&restart_server, this);
+        session->runInSessionThread([this]() { restart_server(this); });
     }
 }
 
@@ -816,6 +1693,7 @@ void tr_rpc_server::set_whitelist(std::string_view whitelist)
 void tr_rpc_server::set_username(std::string_view username)
 {
     username_ = username;
+    authorized_header_.clear();
     tr_logAddDebug(fmt::format(FMT_STRING("setting our username to '{:s}'"), username_));
 }
 
@@ -823,6 +1701,7 @@ void tr_rpc_server::set_password(std::string_view password) noexcept
 {
     auto const is_salted = tr_ssha1_test(password);
     salted_password_ = is_salted ? password : tr_ssha1(password);
+    authorized_header_.clear();
 
     tr_logAddDebug(fmt::format(FMT_STRING("setting our salted password to '{:s}'"), salted_password_));
 }
@@ -830,6 +1709,7 @@ void tr_rpc_server::set_password(std::string_view password) noexcept
 void tr_rpc_server::set_password_enabled(bool enabled)
 {
     is_password_enabled_ = enabled;
+    authorized_header_.clear();
     tr_logAddDebug(fmt::format("setting password-enabled to '{}'", enabled));
 }
 
@@ -851,7 +1731,7 @@ void tr_rpc_server::set_anti_brute_force_enabled(bool enabled) noexcept
 // --- LIFECYCLE
 
 tr_rpc_server::tr_rpc_server(tr_session* session_in, tr_variant* settings)
-    : compressor{ libdeflate_alloc_compressor(DeflateLevel), libdeflate_free_compressor }
+    : compressor{ nullptr, libdeflate_free_compressor }
     , web_client_dir_{ tr_getWebClientDir(session_in) }
     , bind_address_(std::make_unique<class tr_rpc_address>())
     , session{ session_in }
@@ -872,11 +1752,20 @@ void tr_rpc_server::load(tr_variant* src)
     RPC_SETTINGS_FIELDS(V)
 #undef V
 
+    if (events_)
+    {
+        events_->set_interval(std::chrono::milliseconds{ events_interval_msec_ });
+    }
+
     if (!tr_strv_ends_with(url_, '/'))
     {
         url_ = fmt::format(FMT_STRING("{:s}/"), url_);
     }
 
+    compression_level_ = std::min(compression_level_, MaxDeflateLevel);
+    compressor.reset(
+        compression_level_ > 0U ? libdeflate_alloc_compressor(static_cast<int>(compression_level_)) : nullptr);
+
     this->host_whitelist_ = parse_whitelist(host_whitelist_str_);
     this->set_password_enabled(authentication_required_);
     this->set_whitelist(whitelist_str_);
@@ -901,7 +1790,7 @@ void tr_rpc_server::load(tr_variant* src)
     {
         auto const rpc_uri = bind_address_->to_string(this->port()) + this->url_;
         tr_logAddInfo(fmt::format(_("Serving RPC and Web requests on {address}"), fmt::arg("address", rpc_uri)));
-        session->runInSessionThread(start_server, this);
+        session->runInSessionThread([this]() { start_server(this); });
 
         if (this->is_whitelist_enabled())
         {
@@ -942,4 +1831,21 @@ void tr_rpc_server::default_settings(tr_variant* tgt){
 tr_rpc_server::~tr_rpc_server()
 {
     stop_server(this);
+
+    // wait for the executor to finish with the responses it's working on
+    auto lock = std::unique_lock{ responses_mutex_ };
+    responses_cv_.wait(lock, [this]() { return n_pending_responses_ == 0U; });
+}
+
+void tr_rpc_server::begin_response()
+{
+    auto const lock = std::lock_guard{ responses_mutex_ };
+    ++n_pending_responses_;
+}
+
+void tr_rpc_server::end_response()
+{
+    auto const lock = std::lock_guard{ responses_mutex_ };
+    --n_pending_responses_;
+    responses_cv_.notify_all();
 }
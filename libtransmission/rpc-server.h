@@ -9,8 +9,13 @@
 #error only libtransmission should #include this header.
 #endif
 
+#include <condition_variable>
 #include <cstddef> // size_t
+#include <cstdint> // uint64_t
+#include <ctime> // time_t
+#include <map>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <string_view>
 #include <vector>
@@ -19,9 +24,11 @@
 
 #include "libtransmission/net.h"
 #include "libtransmission/quark.h"
+#include "libtransmission/rpc-whitelist.h"
 #include "libtransmission/utils-ev.h"
 
 class tr_rpc_address;
+class tr_rpc_events;
 struct tr_session;
 struct tr_variant;
 struct libdeflate_compressor;
@@ -36,9 +43,13 @@ class Timer;
     V(TR_KEY_anti_brute_force_threshold, anti_brute_force_limit_, size_t, 100U, "") \
     V(TR_KEY_rpc_authentication_required, authentication_required_, bool, false, "") \
     V(TR_KEY_rpc_bind_address, bind_address_str_, std::string, "0.0.0.0", "") \
+    V(TR_KEY_rpc_compression_level, compression_level_, size_t, 6U, "gzip level for responses, 0 to disable") \
+    V(TR_KEY_rpc_compression_min_size, compression_min_size_, size_t, 1024U, "Smaller responses are sent uncompressed") \
     V(TR_KEY_rpc_enabled, is_enabled_, bool, false, "") \
+    V(TR_KEY_rpc_events_interval_msec, events_interval_msec_, size_t, 1000U, "How often changes are pushed to event subscribers") \
     V(TR_KEY_rpc_host_whitelist, host_whitelist_str_, std::string, "", "") \
     V(TR_KEY_rpc_host_whitelist_enabled, is_host_whitelist_enabled_, bool, true, "") \
+    V(TR_KEY_rpc_json_threads, json_threads_, size_t, 1U, "Number of threads used to serialize large responses") \
     V(TR_KEY_rpc_port, port_, tr_port, tr_port::fromHost(TR_DEFAULT_RPC_PORT), "") \
     V(TR_KEY_rpc_password, salted_password_, std::string, "", "") \
     V(TR_KEY_rpc_socket_mode, socket_mode_, tr_mode_t, 0750, "") \
@@ -147,20 +158,63 @@ public:
         return socket_mode_;
     }
 
+    [[nodiscard]] constexpr auto json_threads() const noexcept
+    {
+        return json_threads_;
+    }
+
+    [[nodiscard]] constexpr auto compression_min_size() const noexcept
+    {
+        return compression_min_size_;
+    }
+
+    // RPC responses are serialized in the executor; the server isn't
+    // destroyed until the ones that have begun have ended.
+    void begin_response();
+    void end_response();
+
 #define V(key, name, type, default_value, comment) type name = type{ default_value };
     RPC_SETTINGS_FIELDS(V)
 #undef V
 
-    std::vector<std::string> host_whitelist_;
-    std::vector<std::string> whitelist_;
+    tr_rpc_whitelist host_whitelist_;
+    tr_rpc_whitelist whitelist_;
     std::string const web_client_dir_;
 
+    // The web client's files, kept in memory and precompressed so that
+    // they're only read and gzipped again after they change on disk.
+    struct WebAsset
+    {
+        uint64_t size = 0U;
+        time_t last_modified_at = 0;
+        std::string content;
+        std::string gzipped; // empty if not worth compressing
+        std::string etag;
+    };
+
+    std::map<std::string, WebAsset, std::less<>> web_assets_;
+
     std::unique_ptr<tr_rpc_address> bind_address_;
 
+    // created when the first client subscribes to events
+    std::unique_ptr<tr_rpc_events> events_;
+
     std::unique_ptr<libtransmission::Timer> start_retry_timer;
     libtransmission::evhelpers::evhttp_unique_ptr httpd;
     tr_session* const session;
 
+    // The last Authorization header that was accepted. Clients that poll
+    // send the same one every time, so this skips decoding and hashing it.
+    std::string authorized_header_;
+
+    // replaced when httpd is freed, so that responses that finish
+    // later know that their request was freed along with it
+    std::shared_ptr<bool> httpd_alive_ = std::make_shared<bool>(true);
+
+    std::mutex responses_mutex_;
+    std::condition_variable responses_cv_;
+    size_t n_pending_responses_ = 0U;
+
     size_t login_attempts_ = 0U;
     int start_retry_counter = 0;
 
@@ -0,0 +1,214 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <cstddef> // size_t
+#include <cstdint> // uint32_t
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility> // std::pair
+
+#include "libtransmission/rpc-whitelist.h"
+#include "libtransmission/utils.h" // tr_wildmat(), tr_strv_strip()
+
+using namespace std::literals;
+
+namespace
+{
+auto constexpr WildmatSpecials = "*?[\\"sv;
+
+[[nodiscard]] constexpr bool has_wildcards(std::string_view pattern) noexcept
+{
+    return pattern.find_first_of(WildmatSpecials) != std::string_view::npos;
+}
+
+[[nodiscard]] constexpr uint32_t prefix_mask(size_t n_octets) noexcept
+{
+    return n_octets == 0U ? 0U : ~uint32_t{} << (32U - 8U * n_octets);
+}
+
+// Parse the leading octet of `text`, which must be canonical: 0-255 with no leading zeroes.
+[[nodiscard]] std::optional<uint32_t> parse_octet(std::string_view text)
+{
+    if (std::empty(text) || std::size(text) > 3U || (std::size(text) > 1U && text.front() == '0'))
+    {
+        return {};
+    }
+
+    auto val = uint32_t{};
+    for (auto const ch : text)
+    {
+        if (ch < '0' || ch > '9')
+        {
+            return {};
+        }
+
+        val = val * 10U + static_cast<uint32_t>(ch - '0');
+    }
+
+    return val <= 255U ? std::optional<uint32_t>{ val } : std::nullopt;
+}
+
+// If `pattern` is some IPv4 octets followed by `*` octets, e.g. `10.*` or
+// `192.168.*.*`, return the network and its number of literal octets.
+[[nodiscard]] std::optional<std::pair<uint32_t, size_t>> parse_network(std::string_view pattern)
+{
+    auto network = uint32_t{};
+    auto n_octets = size_t{};
+    auto n_stars = size_t{};
+
+    while (!std::empty(pattern))
+    {
+        auto const pos = pattern.find('.');
+        auto const token = pattern.substr(0, pos);
+        pattern = pos == std::string_view::npos ? ""sv : pattern.substr(pos + 1U);
+
+        if (token == "*"sv)
+        {
+            ++n_stars;
+        }
+        else if (auto const octet = parse_octet(token); octet && n_stars == 0U)
+        {
+            network |= *octet << (24U - 8U * n_octets);
+            ++n_octets;
+        }
+        else
+        {
+            return {};
+        }
+
+        // e.g. `1.2.3.4.*` can't match an IPv4 address
+        if (n_octets + n_stars > 4U || (pos != std::string_view::npos && std::empty(pattern)))
+        {
+            return {};
+        }
+    }
+
+    if (n_stars == 0U)
+    {
+        return {};
+    }
+
+    return std::make_pair(network, n_octets);
+}
+} // namespace
+
+tr_rpc_whitelist::tr_rpc_whitelist(std::string_view patterns)
+{
+    while (!std::empty(patterns))
+    {
+        auto const pos = patterns.find_first_of(" ,;"sv);
+        auto const token = tr_strv_strip(patterns.substr(0, pos));
+        patterns = pos == std::string_view::npos ? ""sv : patterns.substr(pos + 1U);
+
+        if (!std::empty(token))
+        {
+            patterns_.emplace_back(token);
+            add(patterns_.back());
+        }
+    }
+}
+
+void tr_rpc_whitelist::add(std::string const& pattern)
+{
+    auto const sv = std::string_view{ pattern };
+
+    if (sv == "*"sv)
+    {
+        matches_all_ = true;
+    }
+    else if (!has_wildcards(sv))
+    {
+        literals_.emplace(pattern);
+    }
+    else if (auto const network = parse_network(sv); network)
+    {
+        auto const [addr, n_octets] = *network;
+        networks_[n_octets].emplace(addr);
+        network_patterns_.emplace_back(pattern);
+        has_networks_ = true;
+    }
+    else if (sv.back() == '*' && !has_wildcards(sv.substr(0, std::size(sv) - 1U)))
+    {
+        prefixes_.emplace_back(sv.substr(0, std::size(sv) - 1U));
+    }
+    else if (sv.front() == '*' && !has_wildcards(sv.substr(1U)))
+    {
+        suffixes_.emplace_back(sv.substr(1U));
+    }
+    else
+    {
+        wildcards_.emplace_back(pattern);
+    }
+}
+
+std::optional<uint32_t> tr_rpc_whitelist::parse_ipv4(std::string_view text)
+{
+    auto addr = uint32_t{};
+
+    for (size_t i = 0; i < 4U; ++i)
+    {
+        auto const pos = text.find('.');
+        if ((i < 3U) == (pos == std::string_view::npos))
+        {
+            return {};
+        }
+
+        auto const octet = parse_octet(text.substr(0, pos));
+        if (!octet)
+        {
+            return {};
+        }
+
+        addr = (addr << 8U) | *octet;
+        text = i < 3U ? text.substr(pos + 1U) : ""sv;
+    }
+
+    return addr;
+}
+
+bool tr_rpc_whitelist::matches(std::string_view text) const
+{
+    if (matches_all_ || literals_.count(std::string{ text }) != 0U)
+    {
+        return true;
+    }
+
+    if (has_networks_)
+    {
+        if (auto const addr = parse_ipv4(text); addr)
+        {
+            for (size_t n_octets = 0; n_octets < std::size(networks_); ++n_octets)
+            {
+                if (auto const& networks = networks_[n_octets];
+                    !std::empty(networks) && networks.count(*addr & prefix_mask(n_octets)) != 0U)
+                {
+                    return true;
+                }
+            }
+        }
+        else if (std::any_of(
+                     std::begin(network_patterns_),
+                     std::end(network_patterns_),
+                     [text](auto const& pattern) { return tr_wildmat(text, pattern); }))
+        {
+            return true;
+        }
+    }
+
+    return std::any_of(
+               std::begin(prefixes_),
+               std::end(prefixes_),
+               [text](auto const& prefix) { return tr_strv_starts_with(text, prefix); }) ||
+        std::any_of(
+               std::begin(suffixes_),
+               std::end(suffixes_),
+               [text](auto const& suffix) { return tr_strv_ends_with(text, suffix); }) ||
+        std::any_of(
+               std::begin(wildcards_),
+               std::end(wildcards_),
+               [text](auto const& pattern) { return tr_wildmat(text, pattern); });
+}
@@ -0,0 +1,69 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <array>
+#include <cstdint> // uint32_t
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+/**
+ * The RPC server's address and host whitelists, compiled so that checking
+ * a request doesn't mean running wildmat over every pattern.
+ *
+ * Patterns are split by shape:
+ * - literals, e.g. `127.0.0.1` or `nas.lan`, go into a hash set;
+ * - IPv4 octet wildcards, e.g. `192.168.*.*`, become network prefixes
+ *   that are looked up by prefix length;
+ * - `*.example.com` and `example.*` become suffix and prefix checks;
+ * - anything else is still matched with tr_wildmat().
+ *
+ * matches() gives the same answers as trying tr_wildmat() on each pattern.
+ */
+class tr_rpc_whitelist
+{
+public:
+    tr_rpc_whitelist() = default;
+
+    // `patterns` is separated by spaces, commas, or semicolons
+    explicit tr_rpc_whitelist(std::string_view patterns);
+
+    [[nodiscard]] bool matches(std::string_view text) const;
+
+    [[nodiscard]] constexpr auto const& patterns() const noexcept
+    {
+        return patterns_;
+    }
+
+private:
+    // @return `text` as a host-endian IPv4 address if it's in canonical dotted-quad form
+    [[nodiscard]] static std::optional<uint32_t> parse_ipv4(std::string_view text);
+
+    void add(std::string const& pattern);
+
+    std::vector<std::string> patterns_;
+
+    bool matches_all_ = false;
+    std::unordered_set<std::string> literals_;
+
+    // networks_[n] holds the networks with an n-octet prefix
+    std::array<std::unordered_set<uint32_t>, 5> networks_;
+    bool has_networks_ = false;
+
+    // the patterns behind networks_, for text that isn't an IPv4 address
+    std::vector<std::string> network_patterns_;
+
+    std::vector<std::string> prefixes_;
+    std::vector<std::string> suffixes_;
+    std::vector<std::string> wildcards_;
+};
@@ -5,15 +5,18 @@
 
 #include <algorithm>
 #include <array>
-#include <cerrno>
+#include <atomic>
 #include <cstdint>
 #include <ctime>
 #include <iterator>
+#include <limits>
 #include <memory>
 #include <numeric>
+#include <optional>
 #include <set>
 #include <string>
 #include <string_view>
+#include <tuple>
 #include <utility>
 #include <vector>
 
@@ -24,19 +27,28 @@
 #include "libtransmission/transmission.h"
 
 #include "libtransmission/announcer.h"
+#include "libtransmission/blocklist.h"
+#include "libtransmission/cache.h"
 #include "libtransmission/crypto-utils.h"
 #include "libtransmission/error.h"
 #include "libtransmission/file.h"
 #include "libtransmission/log.h"
+#include "libtransmission/memory-budget.h"
+#include "libtransmission/metrics.h"
 #include "libtransmission/peer-mgr.h"
 #include "libtransmission/quark.h"
+#include "libtransmission/rpc-deltas.h"
 #include "libtransmission/rpcimpl.h"
 #include "libtransmission/session.h"
+#include "libtransmission/torrent-metainfo.h"
+#include "libtransmission/torrent-usage.h"
 #include "libtransmission/torrent.h"
 #include "libtransmission/tr-assert.h"
 #include "libtransmission/tr-strbuf.h"
+#include "libtransmission/tracing.h"
 #include "libtransmission/utils.h"
 #include "libtransmission/variant.h"
+#include "libtransmission/verify-manifest.h"
 #include "libtransmission/version.h"
 #include "libtransmission/web-utils.h"
 #include "libtransmission/web.h"
@@ -63,6 +75,7 @@ enum class TrFormat
  * when the task is complete */
 struct tr_rpc_idle_data
 {
+    tr_variant_arena arena;
     tr_variant response = {};
     tr_session* session = nullptr;
     tr_variant* args_out = nullptr;
@@ -154,6 +167,173 @@ auto getTorrents(tr_session* session, tr_variant* args)
     return torrents;
 }
 
+// torrent-get's `filter` argument
+struct TorrentFilter
+{
+    std::vector<tr_quark> labels; // a torrent must have all of these
+    std::optional<tr_quark> group;
+    std::optional<tr_quark> tracker; // a host:port or a sitename
+    std::vector<int64_t> statuses; // a torrent must have one of these
+    std::string text; // lowercase; a torrent's name must contain it
+    bool matches_nothing = false; // e.g. it names a label that no torrent has
+
+    [[nodiscard]] bool matches(tr_torrent const* tor) const
+    {
+        auto const& tor_labels = tor->labels;
+        auto const has_label = [&tor_labels](tr_quark label)
+        {
+            return std::find(std::begin(tor_labels), std::end(tor_labels), label) != std::end(tor_labels);
+        };
+
+        auto const has_tracker = [this](auto const& info)
+        {
+            return info.host_and_port.quark() == *tracker || info.sitename.quark() == *tracker;
+        };
+
+        return std::all_of(std::begin(labels), std::end(labels), has_label) &&
+            (!group || tor->bandwidth_group().quark() == *group) &&
+            (!tracker || std::any_of(std::begin(tor->announce_list()), std::end(tor->announce_list()), has_tracker)) &&
+            (std::empty(statuses) ||
+             std::find(std::begin(statuses), std::end(statuses), tor->activity()) != std::end(statuses)) &&
+            (std::empty(text) || tr_strlower(tr_torrentName(tor)).find(text) != std::string::npos);
+    }
+
+    // @return the ids from the smallest of the indexes that apply, or nullptr if none do
+    [[nodiscard]] std::vector<tr_torrent_id_t> const* candidates(tr_torrents const& torrents) const
+    {
+        auto const* ret = static_cast<std::vector<tr_torrent_id_t> const*>(nullptr);
+        auto const consider = [&ret](std::vector<tr_torrent_id_t> const& ids)
+        {
+            if (ret == nullptr || std::size(ids) < std::size(*ret))
+            {
+                ret = &ids;
+            }
+        };
+
+        for (auto const label : labels)
+        {
+            consider(torrents.ids_with_label(label));
+        }
+
+        // torrents without a group aren't indexed
+        if (group && *group != TR_KEY_NONE)
+        {
+            consider(torrents.ids_in_group(*group));
+        }
+
+        if (tracker)
+        {
+            consider(torrents.ids_with_tracker(*tracker));
+        }
+
+        return ret;
+    }
+};
+
+std::optional<TorrentFilter> parseTorrentFilter(tr_variant* args)
+{
+    tr_variant* dict = nullptr;
+    if (!tr_variantDictFindDict(args, TR_KEY_filter, &dict))
+    {
+        return {};
+    }
+
+    auto filter = TorrentFilter{};
+    auto sv = std::string_view{};
+
+    // Names that were never interned can't belong to any torrent. Looking
+    // them up rather than interning them keeps clients from growing the
+    // quark table.
+    auto const lookup = [&filter](std::string_view name)
+    {
+        auto const key = tr_quark_lookup(name);
+        filter.matches_nothing |= !key;
+        return key.value_or(TR_KEY_NONE);
+    };
+
+    if (tr_variant* labels = nullptr; tr_variantDictFindList(dict, TR_KEY_labels, &labels))
+    {
+        for (size_t i = 0, n = tr_variantListSize(labels); i < n; ++i)
+        {
+            if (tr_variantGetStrView(tr_variantListChild(labels, i), &sv) && !std::empty(tr_strv_strip(sv)))
+            {
+                filter.labels.push_back(lookup(tr_strv_strip(sv)));
+            }
+        }
+    }
+
+    if (tr_variantDictFindStrView(dict, TR_KEY_group, &sv))
+    {
+        // "" matches the torrents that aren't in a group
+        sv = tr_strv_strip(sv);
+        filter.group = std::empty(sv) ? tr_quark{ TR_KEY_NONE } : lookup(sv);
+    }
+
+    if (tr_variantDictFindStrView(dict, TR_KEY_tracker, &sv))
+    {
+        filter.tracker = lookup(sv);
+    }
+
+    if (tr_variant* statuses = nullptr; tr_variantDictFindList(dict, TR_KEY_status, &statuses))
+    {
+        for (size_t i = 0, n = tr_variantListSize(statuses); i < n; ++i)
+        {
+            if (auto status = int64_t{}; tr_variantGetInt(tr_variantListChild(statuses, i), &status))
+            {
+                filter.statuses.push_back(status);
+            }
+        }
+    }
+    else if (auto status = int64_t{}; tr_variantDictFindInt(dict, TR_KEY_status, &status))
+    {
+        filter.statuses.push_back(status);
+    }
+
+    if (tr_variantDictFindStrView(dict, TR_KEY_text, &sv))
+    {
+        filter.text = tr_strlower(tr_strv_strip(sv));
+    }
+
+    return filter;
+}
+
+// Like getTorrents(), but only the torrents that match `filter`.
+// Unless specific ids were requested, the candidates come from the
+// tr_torrents indexes so that a narrow filter doesn't visit every torrent.
+auto getTorrents(tr_session* session, tr_variant* args, TorrentFilter const& filter)
+{
+    auto torrents = std::vector<tr_torrent*>{};
+
+    if (filter.matches_nothing)
+    {
+        return torrents;
+    }
+
+    auto const has_ids = tr_variantDictFind(args, TR_KEY_ids) != nullptr || tr_variantDictFind(args, TR_KEY_id) != nullptr;
+    if (auto const* const ids = filter.candidates(session->torrents()); ids != nullptr && !has_ids)
+    {
+        torrents.reserve(std::size(*ids));
+        for (auto const id : *ids)
+        {
+            if (auto* const tor = session->torrents().get(id); tor != nullptr)
+            {
+                torrents.push_back(tor);
+            }
+        }
+    }
+    else
+    {
+        torrents = getTorrents(session, args);
+    }
+
+    auto const no_match = [&filter](tr_torrent const* tor)
+    {
+        return !filter.matches(tor);
+    };
+    torrents.erase(std::remove_if(std::begin(torrents), std::end(torrents), no_match), std::end(torrents));
+    return torrents;
+}
+
 void notifyBatchQueueChange(tr_session* session, std::vector<tr_torrent*> const& torrents)
 {
     for (auto* tor : torrents)
@@ -286,11 +466,102 @@ char const* torrentReannounce(
     return nullptr;
 }
 
+char const* torrentAddPeers(
+    tr_session* session,
+    tr_variant* args_in,
+    tr_variant* /*args_out*/,
+    tr_rpc_idle_data* /*idle_data*/)
+{
+    tr_variant* list = nullptr;
+    if (!tr_variantDictFindList(args_in, TR_KEY_peers, &list))
+    {
+        return "no peers specified";
+    }
+
+    // same keys as torrent-get's `peers`, so that one node's peers can be given to another
+    auto pex = std::vector<tr_pex>{};
+    pex.reserve(tr_variantListSize(list));
+    for (size_t i = 0, n = tr_variantListSize(list); i < n; ++i)
+    {
+        auto* const peer = tr_variantListChild(list, i);
+        auto address = std::string_view{};
+        auto port = int64_t{};
+        if (!tr_variantDictFindStrView(peer, TR_KEY_address, &address) || !tr_variantDictFindInt(peer, TR_KEY_port, &port) ||
+            port <= 0 || port > std::numeric_limits<uint16_t>::max())
+        {
+            continue;
+        }
+
+        if (auto const addr = tr_address::from_string(address); addr)
+        {
+            pex.emplace_back(*addr, tr_port::fromHost(static_cast<uint16_t>(port)), ADDED_F_CONNECTABLE);
+        }
+    }
+
+    for (auto* tor : getTorrents(session, args_in))
+    {
+        // private torrents only get peers from their trackers
+        if (!tor->is_private())
+        {
+            tr_peerMgrAddPex(tor, TR_PEER_FROM_PEX, std::data(pex), std::size(pex));
+        }
+    }
+
+    return nullptr;
+}
+
 char const* torrentVerify(tr_session* session, tr_variant* args_in, tr_variant* /*args_out*/, tr_rpc_idle_data* /*idle_data*/)
+{
+    auto quick = bool{ false };
+    (void)tr_variantDictFindBool(args_in, TR_KEY_quick, &quick);
+    auto background = bool{ false };
+    (void)tr_variantDictFindBool(args_in, TR_KEY_background, &background);
+
+    for (auto* tor : getTorrents(session, args_in))
+    {
+        if (background)
+        {
+            tr_torrentVerifyBackground(tor);
+        }
+        else if (quick)
+        {
+            tr_torrentVerifyQuick(tor);
+        }
+        else
+        {
+            tr_torrentVerify(tor);
+        }
+
+        session->rpcNotify(TR_RPC_TORRENT_CHANGED, tor);
+    }
+
+    return nullptr;
+}
+
+char const* torrentVerifyPause(
+    tr_session* session,
+    tr_variant* args_in,
+    tr_variant* /*args_out*/,
+    tr_rpc_idle_data* /*idle_data*/)
+{
+    for (auto* tor : getTorrents(session, args_in))
+    {
+        tr_torrentVerifyPause(tor);
+        session->rpcNotify(TR_RPC_TORRENT_CHANGED, tor);
+    }
+
+    return nullptr;
+}
+
+char const* torrentVerifyResume(
+    tr_session* session,
+    tr_variant* args_in,
+    tr_variant* /*args_out*/,
+    tr_rpc_idle_data* /*idle_data*/)
 {
     for (auto* tor : getTorrents(session, args_in))
     {
-        tr_torrentVerify(tor);
+        tr_torrentVerifyResume(tor);
         session->rpcNotify(TR_RPC_TORRENT_CHANGED, tor);
     }
 
@@ -350,7 +621,7 @@ void addTrackers(tr_torrent const* tor, tr_variant* trackers)
         tr_variantDictAddQuark(d, TR_KEY_announce, tracker.announce.quark());
         tr_variantDictAddInt(d, TR_KEY_id, tracker.id);
         tr_variantDictAddQuark(d, TR_KEY_scrape, tracker.scrape.quark());
-        tr_variantDictAddStrView(d, TR_KEY_sitename, tracker.sitename);
+        tr_variantDictAddStr(d, TR_KEY_sitename, tracker.sitename);
         tr_variantDictAddInt(d, TR_KEY_tier, tracker.tier);
     }
 }
@@ -387,36 +658,162 @@ void addTrackerStats(tr_tracker_view const& tracker, tr_variant* list)
     tr_variantDictAddInt(d, TR_KEY_tier, tracker.tier);
 }
 
+// The fields of each peer in `torrent-get`'s `peers` and in `torrent-peers`
+auto constexpr PeerFields = std::array<tr_quark, 18>{
+    TR_KEY_address,
+    TR_KEY_bufferBytes,
+    TR_KEY_clientName,
+    TR_KEY_clientIsChoked,
+    TR_KEY_clientIsInterested,
+    TR_KEY_desiredReqsToPeer,
+    TR_KEY_flagStr,
+    TR_KEY_isDownloadingFrom,
+    TR_KEY_isEncrypted,
+    TR_KEY_isIncoming,
+    TR_KEY_isUploadingTo,
+    TR_KEY_isUTP,
+    TR_KEY_peerIsChoked,
+    TR_KEY_peerIsInterested,
+    TR_KEY_port,
+    TR_KEY_progress,
+    TR_KEY_rateToClient,
+    TR_KEY_rateToPeer,
+};
+
+[[nodiscard]] bool isSupportedPeerField(tr_quark key)
+{
+    return std::find(std::begin(PeerFields), std::end(PeerFields), key) != std::end(PeerFields);
+}
+
+void addPeerField(tr_variant* d, tr_peer_stat const& peer, tr_quark key)
+{
+    switch (key)
+    {
+    case TR_KEY_address:
+        tr_variantDictAddStr(d, key, peer.addr);
+        break;
+
+    case TR_KEY_bufferBytes:
+        tr_variantDictAddInt(d, key, peer.bufferBytes);
+        break;
+
+    case TR_KEY_clientName:
+        // interned, so it outlives the response
+        tr_variantDictAddStrView(d, key, peer.client);
+        break;
+
+    case TR_KEY_clientIsChoked:
+        tr_variantDictAddBool(d, key, peer.clientIsChoked);
+        break;
+
+    case TR_KEY_clientIsInterested:
+        tr_variantDictAddBool(d, key, peer.clientIsInterested);
+        break;
+
+    case TR_KEY_desiredReqsToPeer:
+        tr_variantDictAddInt(d, key, peer.desiredReqsToPeer);
+        break;
+
+    case TR_KEY_flagStr:
+        tr_variantDictAddStr(d, key, peer.flagStr);
+        break;
+
+    case TR_KEY_isDownloadingFrom:
+        tr_variantDictAddBool(d, key, peer.isDownloadingFrom);
+        break;
+
+    case TR_KEY_isEncrypted:
+        tr_variantDictAddBool(d, key, peer.isEncrypted);
+        break;
+
+    case TR_KEY_isIncoming:
+        tr_variantDictAddBool(d, key, peer.isIncoming);
+        break;
+
+    case TR_KEY_isUploadingTo:
+        tr_variantDictAddBool(d, key, peer.isUploadingTo);
+        break;
+
+    case TR_KEY_isUTP:
+        tr_variantDictAddBool(d, key, peer.isUTP);
+        break;
+
+    case TR_KEY_peerIsChoked:
+        tr_variantDictAddBool(d, key, peer.peerIsChoked);
+        break;
+
+    case TR_KEY_peerIsInterested:
+        tr_variantDictAddBool(d, key, peer.peerIsInterested);
+        break;
+
+    case TR_KEY_port:
+        tr_variantDictAddInt(d, key, peer.port);
+        break;
+
+    case TR_KEY_progress:
+        tr_variantDictAddReal(d, key, peer.progress);
+        break;
+
+    case TR_KEY_rateToClient:
+        tr_variantDictAddInt(d, key, tr_toSpeedBytes(peer.rateToClient_KBps));
+        break;
+
+    case TR_KEY_rateToPeer:
+        tr_variantDictAddInt(d, key, tr_toSpeedBytes(peer.rateToPeer_KBps));
+        break;
+
+    default:
+        break;
+    }
+}
+
 void addPeers(tr_torrent const* tor, tr_variant* list)
 {
-    auto peer_count = size_t{};
-    tr_peer_stat* peers = tr_torrentPeers(tor, &peer_count);
+    auto const& peers = tr_peerMgrPeerStatsSnapshot(tor);
 
-    tr_variantInitList(list, peer_count);
+    tr_variantInitList(list, std::size(peers));
 
-    for (size_t i = 0; i < peer_count; ++i)
+    for (auto const& peer : peers)
     {
-        tr_variant* d = tr_variantListAddDict(list, 16);
-        tr_peer_stat const* peer = peers + i;
-        tr_variantDictAddStr(d, TR_KEY_address, peer->addr);
-        tr_variantDictAddStr(d, TR_KEY_clientName, peer->client);
-        tr_variantDictAddBool(d, TR_KEY_clientIsChoked, peer->clientIsChoked);
-        tr_variantDictAddBool(d, TR_KEY_clientIsInterested, peer->clientIsInterested);
-        tr_variantDictAddStr(d, TR_KEY_flagStr, peer->flagStr);
-        tr_variantDictAddBool(d, TR_KEY_isDownloadingFrom, peer->isDownloadingFrom);
-        tr_variantDictAddBool(d, TR_KEY_isEncrypted, peer->isEncrypted);
-        tr_variantDictAddBool(d, TR_KEY_isIncoming, peer->isIncoming);
-        tr_variantDictAddBool(d, TR_KEY_isUploadingTo, peer->isUploadingTo);
-        tr_variantDictAddBool(d, TR_KEY_isUTP, peer->isUTP);
-        tr_variantDictAddBool(d, TR_KEY_peerIsChoked, peer->peerIsChoked);
-        tr_variantDictAddBool(d, TR_KEY_peerIsInterested, peer->peerIsInterested);
-        tr_variantDictAddInt(d, TR_KEY_port, peer->port);
-        tr_variantDictAddReal(d, TR_KEY_progress, peer->progress);
-        tr_variantDictAddInt(d, TR_KEY_rateToClient, tr_toSpeedBytes(peer->rateToClient_KBps));
-        tr_variantDictAddInt(d, TR_KEY_rateToPeer, tr_toSpeedBytes(peer->rateToPeer_KBps));
+        tr_variant* d = tr_variantListAddDict(list, std::size(PeerFields));
+        for (auto const key : PeerFields)
+        {
+            addPeerField(d, peer, key);
+        }
     }
+}
 
-    tr_torrentPeersFree(peers, peer_count);
+void initResourceUsage(tr_torrent const* const tor, tr_variant* const initme)
+{
+    using Usage = tr_torrent_usage;
+
+    // in the same order as Usage::Counter; see Usage::name()
+    static auto constexpr Keys = std::array<tr_quark, Usage::NumCounters>{ TR_KEY_parse_usec,        //
+                                                                           TR_KEY_hash_usec,         //
+                                                                           TR_KEY_serve_usec,        //
+                                                                           TR_KEY_cache_reads,       //
+                                                                           TR_KEY_cache_read_bytes,  //
+                                                                           TR_KEY_disk_reads,        //
+                                                                           TR_KEY_disk_read_bytes,   //
+                                                                           TR_KEY_cache_writes,      //
+                                                                           TR_KEY_cache_write_bytes, //
+                                                                           TR_KEY_disk_writes,       //
+                                                                           TR_KEY_disk_write_bytes };
+
+    auto const& usage = tor->usage();
+    tr_variantInitDict(initme, Usage::NumCounters + 1U);
+    for (uint8_t i = 0U; i < Usage::NumCounters; ++i)
+    {
+        tr_variantDictAddInt(initme, Keys[i], usage.get(static_cast<Usage::Counter>(i)));
+    }
+
+    auto const memory_usage = tor->memory_usage();
+    auto* const memory = tr_variantDictAddDict(initme, TR_KEY_memory, 5U);
+    tr_variantDictAddInt(memory, TR_KEY_cache, memory_usage.cache);
+    tr_variantDictAddInt(memory, TR_KEY_read_cache, memory_usage.read_cache);
+    tr_variantDictAddInt(memory, TR_KEY_peer_buffers, memory_usage.peer_buffers);
+    tr_variantDictAddInt(memory, TR_KEY_metadata, memory_usage.metadata);
+    tr_variantDictAddInt(memory, TR_KEY_total, memory_usage.total());
 }
 
 [[nodiscard]] auto constexpr isSupportedTorrentGetField(tr_quark key)
@@ -457,6 +854,7 @@ void addPeers(tr_torrent const* tor, tr_variant* list)
     case TR_KEY_labels:
     case TR_KEY_leftUntilDone:
     case TR_KEY_magnetLink:
+    case TR_KEY_manifest:
     case TR_KEY_manualAnnounceTime:
     case TR_KEY_maxConnectedPeers:
     case TR_KEY_metadataPercentComplete:
@@ -472,12 +870,15 @@ void addPeers(tr_torrent const* tor, tr_variant* list)
     case TR_KEY_pieceCount:
     case TR_KEY_pieceSize:
     case TR_KEY_pieces:
+    case TR_KEY_preallocateProgress:
     case TR_KEY_primary_mime_type:
     case TR_KEY_priorities:
     case TR_KEY_queuePosition:
     case TR_KEY_rateDownload:
     case TR_KEY_rateUpload:
     case TR_KEY_recheckProgress:
+    case TR_KEY_relocateProgress:
+    case TR_KEY_resourceUsage:
     case TR_KEY_secondsDownloading:
     case TR_KEY_secondsSeeding:
     case TR_KEY_seedIdleLimit:
@@ -488,6 +889,7 @@ void addPeers(tr_torrent const* tor, tr_variant* list)
     case TR_KEY_source:
     case TR_KEY_startDate:
     case TR_KEY_status:
+    case TR_KEY_superSeeding:
     case TR_KEY_torrentFile:
     case TR_KEY_totalSize:
     case TR_KEY_trackerList:
@@ -497,6 +899,7 @@ void addPeers(tr_torrent const* tor, tr_variant* list)
     case TR_KEY_uploadLimited:
     case TR_KEY_uploadRatio:
     case TR_KEY_uploadedEver:
+    case TR_KEY_verifyPaused:
     case TR_KEY_wanted:
     case TR_KEY_webseeds:
     case TR_KEY_webseedsSendingToUs:
@@ -507,6 +910,73 @@ void addPeers(tr_torrent const* tor, tr_variant* list)
     }
 }
 
+// @return the `tr_stat_group`s needed to fill in `key`'s value
+[[nodiscard]] constexpr uint32_t statGroupsFor(tr_quark key) noexcept
+{
+    switch (key)
+    {
+    case TR_KEY_activityDate:
+    case TR_KEY_addedDate:
+    case TR_KEY_doneDate:
+    case TR_KEY_editDate:
+    case TR_KEY_error:
+    case TR_KEY_errorString:
+    case TR_KEY_id:
+    case TR_KEY_queuePosition:
+    case TR_KEY_secondsDownloading:
+    case TR_KEY_secondsSeeding:
+    case TR_KEY_startDate:
+        return TR_STAT_GROUP_BASIC;
+
+    case TR_KEY_isStalled:
+    case TR_KEY_status:
+        return TR_STAT_GROUP_ACTIVITY;
+
+    case TR_KEY_peersConnected:
+    case TR_KEY_peersFrom:
+    case TR_KEY_peersGettingFromUs:
+    case TR_KEY_peersSendingToUs:
+    case TR_KEY_webseedsSendingToUs:
+        return TR_STAT_GROUP_SWARM;
+
+    case TR_KEY_rateDownload:
+    case TR_KEY_rateUpload:
+        return TR_STAT_GROUP_SPEED;
+
+    case TR_KEY_haveUnchecked:
+    case TR_KEY_haveValid:
+    case TR_KEY_leftUntilDone:
+    case TR_KEY_percentComplete:
+    case TR_KEY_percentDone:
+    case TR_KEY_sizeWhenDone:
+        return TR_STAT_GROUP_COMPLETION;
+
+    case TR_KEY_desiredAvailable:
+        return TR_STAT_GROUP_AVAILABLE;
+
+    case TR_KEY_metadataPercentComplete:
+    case TR_KEY_preallocateProgress:
+    case TR_KEY_recheckProgress:
+    case TR_KEY_relocateProgress:
+        return TR_STAT_GROUP_PROGRESS;
+
+    case TR_KEY_corruptEver:
+    case TR_KEY_downloadedEver:
+    case TR_KEY_uploadRatio:
+    case TR_KEY_uploadedEver:
+        return TR_STAT_GROUP_TRANSFER;
+
+    case TR_KEY_eta:
+    case TR_KEY_etaIdle:
+    case TR_KEY_isFinished:
+        return TR_STAT_GROUP_ETA;
+
+    default:
+        return 0U;
+    }
+}
+
+// `st` only needs to be current for the groups that statGroupsFor(key) returns
 void initField(tr_torrent const* const tor, tr_stat const* const st, tr_variant* const initme, tr_quark key)
 {
     TR_ASSERT(isSupportedTorrentGetField(key));
@@ -542,7 +1012,7 @@ void initField(tr_torrent const* const tor, tr_stat const* const st, tr_variant*
         break;
 
     case TR_KEY_creator:
-        tr_variantInitStrView(initme, tor->creator());
+        tr_variantInitStr(initme, tor->creator());
         break;
 
     case TR_KEY_dateCreated:
@@ -558,7 +1028,7 @@ void initField(tr_torrent const* const tor, tr_stat const* const st, tr_variant*
         break;
 
     case TR_KEY_downloadDir:
-        tr_variantInitStrView(initme, tr_torrentGetDownloadDir(tor));
+        tr_variantInitStr(initme, tr_torrentGetDownloadDir(tor));
         break;
 
     case TR_KEY_downloadedEver:
@@ -578,7 +1048,7 @@ void initField(tr_torrent const* const tor, tr_stat const* const st, tr_variant*
         break;
 
     case TR_KEY_errorString:
-        tr_variantInitStrView(initme, st->errorString);
+        tr_variantInitStr(initme, st->errorString);
         break;
 
     case TR_KEY_eta:
@@ -600,11 +1070,11 @@ void initField(tr_torrent const* const tor, tr_stat const* const st, tr_variant*
         break;
 
     case TR_KEY_group:
-        tr_variantInitStrView(initme, tor->bandwidth_group().sv());
+        tr_variantInitStr(initme, tor->bandwidth_group().sv());
         break;
 
     case TR_KEY_hashString:
-        tr_variantInitStrView(initme, tor->info_hash_string());
+        tr_variantInitStr(initme, tor->info_hash_string());
         break;
 
     case TR_KEY_haveUnchecked:
@@ -651,6 +1121,10 @@ void initField(tr_torrent const* const tor, tr_stat const* const st, tr_variant*
         tr_variantInitInt(initme, st->leftUntilDone);
         break;
 
+    case TR_KEY_manifest:
+        tr_verify_manifest::from_torrent(tor).to_variant(initme);
+        break;
+
     case TR_KEY_manualAnnounceTime:
         tr_variantInitInt(initme, tr_announcerNextManualAnnounce(tor));
         break;
@@ -669,7 +1143,7 @@ void initField(tr_torrent const* const tor, tr_stat const* const st, tr_variant*
         break;
 
     case TR_KEY_name:
-        tr_variantInitStrView(initme, tr_torrentName(tor));
+        tr_variantInitStr(initme, tr_torrentName(tor));
         break;
 
     case TR_KEY_percentComplete:
@@ -713,9 +1187,7 @@ void initField(tr_torrent const* const tor, tr_stat const* const st, tr_variant*
     case TR_KEY_pieces:
         if (tor->has_metainfo())
         {
-            auto const bytes = tor->create_piece_bitfield();
-            auto const enc = tr_base64_encode({ reinterpret_cast<char const*>(std::data(bytes)), std::size(bytes) });
-            tr_variantInitStr(initme, enc);
+            tr_variantInitStr(initme, tor->piece_bitfield_base64());
         }
         else
         {
@@ -732,8 +1204,12 @@ void initField(tr_torrent const* const tor, tr_stat const* const st, tr_variant*
         tr_variantInitInt(initme, tor->piece_size());
         break;
 
+    case TR_KEY_preallocateProgress:
+        tr_variantInitReal(initme, st->preallocateProgress);
+        break;
+
     case TR_KEY_primary_mime_type:
-        tr_variantInitStrView(initme, tor->primary_mime_type());
+        tr_variantInitStr(initme, tor->primary_mime_type());
         break;
 
     case TR_KEY_priorities:
@@ -767,6 +1243,14 @@ void initField(tr_torrent const* const tor, tr_stat const* const st, tr_variant*
         tr_variantInitReal(initme, st->recheckProgress);
         break;
 
+    case TR_KEY_relocateProgress:
+        tr_variantInitReal(initme, st->relocateProgress);
+        break;
+
+    case TR_KEY_resourceUsage:
+        initResourceUsage(tor, initme);
+        break;
+
     case TR_KEY_seedIdleLimit:
         tr_variantInitInt(initme, tor->idle_limit_minutes());
         break;
@@ -788,7 +1272,7 @@ void initField(tr_torrent const* const tor, tr_stat const* const st, tr_variant*
         break;
 
     case TR_KEY_source:
-        tr_variantInitStrView(initme, tor->source());
+        tr_variantInitStr(initme, tor->source());
         break;
 
     case TR_KEY_startDate:
@@ -799,6 +1283,10 @@ void initField(tr_torrent const* const tor, tr_stat const* const st, tr_variant*
         tr_variantInitInt(initme, st->activity);
         break;
 
+    case TR_KEY_superSeeding:
+        tr_variantInitBool(initme, tor->is_super_seeding());
+        break;
+
     case TR_KEY_secondsDownloading:
         tr_variantInitInt(initme, st->secondsDownloading);
         break;
@@ -852,117 +1340,641 @@ void initField(tr_torrent const* const tor, tr_stat const* const st, tr_variant*
         tr_variantInitReal(initme, st->ratio);
         break;
 
-    case TR_KEY_wanted:
+    case TR_KEY_verifyPaused:
+        tr_variantInitBool(initme, tor->verify_checkpoint_ && tor->verify_checkpoint_->paused);
+        break;
+
+    case TR_KEY_wanted:
+        {
+            auto const n = tor->file_count();
+            tr_variantInitList(initme, n);
+            for (tr_file_index_t i = 0; i < n; ++i)
+            {
+                tr_variantListAddInt(initme, tr_torrentFile(tor, i).wanted ? 1 : 0);
+            }
+        }
+        break;
+
+    case TR_KEY_webseeds:
+        tr_variantInitList(initme, tor->webseed_count());
+        addWebseeds(tor, initme);
+        break;
+
+    case TR_KEY_webseedsSendingToUs:
+        tr_variantInitInt(initme, st->webseedsSendingToUs);
+        break;
+
+    default:
+        break;
+    }
+}
+
+void addTorrentInfo(tr_torrent* tor, TrFormat format, tr_variant* entry, tr_quark const* fields, size_t field_count)
+{
+    if (format == TrFormat::Table)
+    {
+        tr_variantInitList(entry, field_count);
+    }
+    else
+    {
+        tr_variantInitDict(entry, field_count);
+    }
+
+    if (field_count > 0)
+    {
+        // only compute the stats that were asked for
+        auto groups = uint32_t{};
+        for (size_t i = 0; i < field_count; ++i)
+        {
+            groups |= statGroupsFor(fields[i]);
+        }
+
+        tr_stat const* const st = groups != 0U ? tr_torrentStat(tor, groups) : &tor->stats;
+
+        for (size_t i = 0; i < field_count; ++i)
+        {
+            tr_variant* child = format == TrFormat::Table ? tr_variantListAdd(entry) : tr_variantDictAdd(entry, fields[i]);
+
+            initField(tor, st, child, fields[i]);
+        }
+    }
+}
+
+// If the client's copy of `pieces` is from a revision that the torrent's
+// journal still covers, send the pieces completed since then instead.
+void addPiecesAdded(tr_torrent const* tor, uint64_t old_revision, tr_variant* entry)
+{
+    auto const added = tor->pieces_added_since(old_revision);
+    if (!added)
+    {
+        return;
+    }
+
+    tr_variantDictRemove(entry, TR_KEY_pieces);
+    auto* const list = tr_variantDictAddList(entry, TR_KEY_piecesAdded, std::size(*added));
+    for (auto const piece : *added)
+    {
+        tr_variantListAddInt(list, piece);
+    }
+}
+
+// Like addTorrentInfo(), but only add the fields that changed since the
+// response that returned `token`. Unchanged torrents are left out.
+void addTorrentDeltas(
+    tr_session* session,
+    tr_rpc_deltas& deltas,
+    std::vector<tr_torrent*> const& torrents,
+    TrFormat format,
+    std::vector<tr_quark> const& keys,
+    tr_rpc_deltas::Token token,
+    tr_variant* list,
+    tr_variant* args_out)
+{
+    auto const* const prev = deltas.find(token, keys);
+    auto next = prev != nullptr ? *prev : tr_rpc_deltas::Snapshot{ keys };
+
+    if (prev != nullptr)
+    {
+        auto removed = std::vector<tr_torrent_id_t>{};
+        for (auto const id : prev->ids())
+        {
+            if (tr_torrentFindFromId(session, id) == nullptr)
+            {
+                removed.push_back(id);
+                next.erase(id);
+            }
+        }
+
+        auto* const out = tr_variantDictAddList(args_out, TR_KEY_removed, std::size(removed));
+        for (auto const id : removed)
+        {
+            tr_variantListAddInt(out, id);
+        }
+    }
+
+    auto const n_keys = std::size(keys);
+    auto const has_id = std::find(std::begin(keys), std::end(keys), TR_KEY_id) != std::end(keys);
+    auto hashes = std::vector<tr_rpc_deltas::Hash>(n_keys);
+
+    for (auto* const tor : torrents)
+    {
+        auto* const entry = tr_variantListAdd(list);
+        addTorrentInfo(tor, format, entry, std::data(keys), n_keys);
+
+        for (size_t i = 0; i < n_keys; ++i)
+        {
+            auto* child = static_cast<tr_variant*>(nullptr);
+            auto key = tr_quark{};
+            if (format == TrFormat::Table)
+            {
+                child = tr_variantListChild(entry, i);
+            }
+            else
+            {
+                (void)tr_variantDictChild(entry, i, &key, &child);
+            }
+            // the pieces revision stands in for a hash so that a later
+            // request can be sent just the pieces completed since then
+            hashes[i] = keys[i] == TR_KEY_pieces && tor->has_metainfo() ? tor->pieces_revision() :
+                                                                          tr_rpc_deltas::hash(child);
+        }
+
+        auto const* const old = prev != nullptr ? prev->find(tor->id()) : nullptr;
+        if (old != nullptr && *old == hashes)
+        {
+            tr_variantListRemove(list, tr_variantListSize(list) - 1U);
+            continue;
+        }
+
+        // tables have fixed columns, so send the whole row
+        if (old != nullptr && format == TrFormat::Object)
+        {
+            for (size_t i = 0; i < n_keys; ++i)
+            {
+                if (keys[i] != TR_KEY_id && (*old)[i] == hashes[i])
+                {
+                    tr_variantDictRemove(entry, keys[i]);
+                }
+                else if (keys[i] == TR_KEY_pieces && tor->has_metainfo())
+                {
+                    addPiecesAdded(tor, (*old)[i], entry);
+                }
+            }
+        }
+
+        if (!has_id && format == TrFormat::Object)
+        {
+            tr_variantDictAddInt(entry, TR_KEY_id, tor->id());
+        }
+
+        next.set(tor->id(), hashes);
+    }
+
+    if (prev == nullptr)
+    {
+        tr_variantDictAddBool(args_out, TR_KEY_delta_full, true);
+    }
+
+    tr_variantDictAddInt(args_out, TR_KEY_delta_token, static_cast<int64_t>(deltas.add(std::move(next))));
+}
+
+// Sort `torrents` by torrent-get's `sort` and `sort-reversed` arguments,
+// then keep the page that `offset` and `limit` ask for.
+char const* sortAndPageTorrents(std::vector<tr_torrent*>& torrents, tr_variant* args_in, tr_variant* args_out)
+{
+    if (auto sv = std::string_view{}; tr_variantDictFindStrView(args_in, TR_KEY_sort, &sv))
+    {
+        auto const key = tr_quark_lookup(sv);
+        if (!key || !isSupportedTorrentGetField(*key))
+        {
+            return "invalid sort key";
+        }
+
+        struct SortKey
+        {
+            double number = 0.0;
+            std::string text; // lowercase
+            tr_torrent_id_t id = 0;
+        };
+
+        auto sort_keys = std::vector<SortKey>{};
+        sort_keys.reserve(std::size(torrents));
+        for (auto* const tor : torrents)
+        {
+            auto value = tr_variant{};
+            initField(tor, tr_torrentStat(tor, statGroupsFor(*key)), &value, *key);
+
+            auto& sort_key = sort_keys.emplace_back();
+            sort_key.id = tor->id();
+            auto is_sortable = true;
+            if (auto text = std::string_view{}; tr_variantIsString(&value) && tr_variantGetStrView(&value, &text))
+            {
+                sort_key.text = tr_strlower(text);
+            }
+            else if (auto flag = bool{}; tr_variantIsBool(&value) && tr_variantGetBool(&value, &flag))
+            {
+                sort_key.number = flag ? 1.0 : 0.0;
+            }
+            else
+            {
+                is_sortable = tr_variantGetReal(&value, &sort_key.number);
+            }
+            tr_variantClear(&value);
+
+            if (!is_sortable)
+            {
+                return "invalid sort key";
+            }
+        }
+
+        auto reversed = false;
+        (void)tr_variantDictFindBool(args_in, TR_KEY_sort_reversed, &reversed);
+
+        auto order = std::vector<size_t>(std::size(torrents));
+        std::iota(std::begin(order), std::end(order), size_t{});
+        std::sort(
+            std::begin(order),
+            std::end(order),
+            [&sort_keys, reversed](size_t a_idx, size_t b_idx)
+            {
+                auto const* a = &sort_keys[a_idx];
+                auto const* b = &sort_keys[b_idx];
+                if (reversed)
+                {
+                    std::swap(a, b);
+                }
+
+                return std::tie(a->number, a->text, a->id) < std::tie(b->number, b->text, b->id);
+            });
+
+        auto sorted = std::vector<tr_torrent*>{};
+        sorted.reserve(std::size(order));
+        std::transform(
+            std::begin(order),
+            std::end(order),
+            std::back_inserter(sorted),
+            [&torrents](size_t idx) { return torrents[idx]; });
+        torrents = std::move(sorted);
+    }
+
+    auto offset = int64_t{};
+    auto limit = int64_t{};
+    auto const has_offset = tr_variantDictFindInt(args_in, TR_KEY_offset, &offset);
+    auto const has_limit = tr_variantDictFindInt(args_in, TR_KEY_limit, &limit);
+    if (has_offset || has_limit)
+    {
+        if (offset < 0 || limit < 0)
+        {
+            return "invalid offset or limit";
+        }
+
+        // let clients size their scrollbars without fetching every torrent
+        tr_variantDictAddInt(args_out, TR_KEY_total, std::size(torrents));
+
+        auto const begin = std::min(static_cast<size_t>(offset), std::size(torrents));
+        auto const end = has_limit ? std::min(begin + static_cast<size_t>(limit), std::size(torrents)) : std::size(torrents);
+        torrents.erase(std::begin(torrents) + end, std::end(torrents));
+        torrents.erase(std::begin(torrents), std::begin(torrents) + begin);
+    }
+
+    return nullptr;
+}
+
+char const* torrentGetImpl(tr_session* session, tr_rpc_deltas& deltas, tr_variant* args_in, tr_variant* args_out)
+{
+    auto const filter = parseTorrentFilter(args_in);
+    auto torrents = filter ? getTorrents(session, args_in, *filter) : getTorrents(session, args_in);
+    if (auto const* const errmsg = sortAndPageTorrents(torrents, args_in, args_out); errmsg != nullptr)
+    {
+        return errmsg;
+    }
+
+    tr_variant* const list = tr_variantDictAddList(args_out, TR_KEY_torrents, std::size(torrents) + 1);
+
+    auto sv = std::string_view{};
+    auto const format = tr_variantDictFindStrView(args_in, TR_KEY_format, &sv) && sv == "table"sv ? TrFormat::Table :
+                                                                                                    TrFormat::Object;
+
+    auto delta_token = int64_t{};
+    auto const is_delta = tr_variantDictFindInt(args_in, TR_KEY_delta_token, &delta_token);
+
+    if (!is_delta && tr_variantDictFindStrView(args_in, TR_KEY_ids, &sv) && sv == "recently-active"sv)
+    {
+        auto const cutoff = tr_time() - RecentlyActiveSeconds;
+        auto const ids = session->torrents().removedSince(cutoff);
+        auto* const out = tr_variantDictAddList(args_out, TR_KEY_removed, std::size(ids));
+        for (auto const& id : ids)
+        {
+            tr_variantListAddInt(out, id);
+        }
+    }
+
+    tr_variant* fields = nullptr;
+    char const* errmsg = nullptr;
+    if (!tr_variantDictFindList(args_in, TR_KEY_fields, &fields))
+    {
+        errmsg = "no fields specified";
+    }
+    else
+    {
+        auto const n = tr_variantListSize(fields);
+        auto keys = std::vector<tr_quark>{};
+        keys.reserve(n);
+
+        for (size_t i = 0; i < n; ++i)
+        {
+            if (!tr_variantGetStrView(tr_variantListChild(fields, i), &sv))
+            {
+                continue;
+            }
+
+            if (auto const key = tr_quark_lookup(sv); key && isSupportedTorrentGetField(*key))
+            {
+                keys.emplace_back(*key);
+            }
+        }
+
+        if (format == TrFormat::Table)
+        {
+            /* first entry is an array of property names */
+            tr_variant* names = tr_variantListAddList(list, std::size(keys));
+            for (auto const& key : keys)
+            {
+                tr_variantListAddQuark(names, key);
+            }
+        }
+
+        if (is_delta)
+        {
+            auto const token = static_cast<tr_rpc_deltas::Token>(delta_token);
+            addTorrentDeltas(session, deltas, torrents, format, keys, token, list, args_out);
+        }
+        else
+        {
+            for (auto* tor : torrents)
+            {
+                addTorrentInfo(tor, format, tr_variantListAdd(list), std::data(keys), std::size(keys));
+            }
+        }
+    }
+
+    return errmsg;
+}
+
+
+char const* torrentGet(tr_session* session, tr_variant* args_in, tr_variant* args_out, tr_rpc_idle_data* /*idle_data*/)
+{
+    return torrentGetImpl(session, session->rpc_deltas(), args_in, args_out);
+}
+
+// ---
+
+// Sort `peers` by torrent-peers' `sort` and `sort-reversed` arguments,
+// then keep the page that `offset` and `limit` ask for.
+char const* sortAndPagePeers(std::vector<tr_peer_stat const*>& peers, tr_variant* args_in, tr_variant* args_out)
+{
+    if (auto sv = std::string_view{}; tr_variantDictFindStrView(args_in, TR_KEY_sort, &sv))
+    {
+        auto const key = tr_quark_lookup(sv);
+        if (!key || !isSupportedPeerField(*key))
+        {
+            return "invalid sort key";
+        }
+
+        struct SortKey
+        {
+            double number = 0.0;
+            std::string_view text;
+            std::string_view address;
+            int port = 0;
+        };
+
+        auto sort_keys = std::vector<SortKey>{};
+        sort_keys.reserve(std::size(peers));
+        auto value = tr_variant{};
+        tr_variantInitDict(&value, 1U);
+        for (auto const* const peer : peers)
+        {
+            addPeerField(&value, *peer, *key);
+            auto* const child = tr_variantDictFind(&value, *key);
+
+            auto& sort_key = sort_keys.emplace_back();
+            sort_key.address = peer->addr;
+            sort_key.port = peer->port;
+            if (auto flag = bool{}; tr_variantIsBool(child) && tr_variantGetBool(child, &flag))
+            {
+                sort_key.number = flag ? 1.0 : 0.0;
+            }
+            else if (!tr_variantGetReal(child, &sort_key.number))
+            {
+                // the peer's own strings, which outlive `value`
+                sort_key.text = *key == TR_KEY_clientName ? std::string_view{ peer->client } :
+                    *key == TR_KEY_flagStr                ? std::string_view{ peer->flagStr } :
+                                                            std::string_view{ peer->addr };
+            }
+
+            tr_variantDictRemove(&value, *key);
+        }
+        tr_variantClear(&value);
+
+        auto reversed = false;
+        (void)tr_variantDictFindBool(args_in, TR_KEY_sort_reversed, &reversed);
+
+        auto order = std::vector<size_t>(std::size(peers));
+        std::iota(std::begin(order), std::end(order), size_t{});
+        std::sort(
+            std::begin(order),
+            std::end(order),
+            [&sort_keys, reversed](size_t a_idx, size_t b_idx)
+            {
+                auto const* a = &sort_keys[a_idx];
+                auto const* b = &sort_keys[b_idx];
+                if (reversed)
+                {
+                    std::swap(a, b);
+                }
+
+                return std::tie(a->number, a->text, a->address, a->port) < std::tie(b->number, b->text, b->address, b->port);
+            });
+
+        auto sorted = std::vector<tr_peer_stat const*>{};
+        sorted.reserve(std::size(order));
+        std::transform(
+            std::begin(order),
+            std::end(order),
+            std::back_inserter(sorted),
+            [&peers](size_t idx) { return peers[idx]; });
+        peers = std::move(sorted);
+    }
+
+    auto offset = int64_t{};
+    auto limit = int64_t{};
+    auto const has_offset = tr_variantDictFindInt(args_in, TR_KEY_offset, &offset);
+    auto const has_limit = tr_variantDictFindInt(args_in, TR_KEY_limit, &limit);
+    if (has_offset || has_limit)
+    {
+        if (offset < 0 || limit < 0)
         {
-            auto const n = tor->file_count();
-            tr_variantInitList(initme, n);
-            for (tr_file_index_t i = 0; i < n; ++i)
-            {
-                tr_variantListAddInt(initme, tr_torrentFile(tor, i).wanted ? 1 : 0);
-            }
+            return "invalid offset or limit";
         }
-        break;
-
-    case TR_KEY_webseeds:
-        tr_variantInitList(initme, tor->webseed_count());
-        addWebseeds(tor, initme);
-        break;
 
-    case TR_KEY_webseedsSendingToUs:
-        tr_variantInitInt(initme, st->webseedsSendingToUs);
-        break;
+        tr_variantDictAddInt(args_out, TR_KEY_total, std::size(peers));
 
-    default:
-        break;
+        auto const begin = std::min(static_cast<size_t>(offset), std::size(peers));
+        auto const end = has_limit ? std::min(begin + static_cast<size_t>(limit), std::size(peers)) : std::size(peers);
+        peers.erase(std::begin(peers) + end, std::end(peers));
+        peers.erase(std::begin(peers), std::begin(peers) + begin);
     }
+
+    return nullptr;
 }
 
-void addTorrentInfo(tr_torrent* tor, TrFormat format, tr_variant* entry, tr_quark const* fields, size_t field_count)
+[[nodiscard]] tr_rpc_peer_key makePeerKey(tr_torrent const* tor, tr_peer_stat const& peer)
 {
-    if (format == TrFormat::Table)
-    {
-        tr_variantInitList(entry, field_count);
-    }
-    else
+    return { tor->id(), peer.addr, static_cast<uint16_t>(peer.port) };
+}
+
+// Like torrent-get's delta mode: only send the peers and fields that
+// changed since the response that returned `token`. Every peer that's
+// sent includes its address and port, so clients can tell them apart.
+void addPeerDeltas(
+    tr_torrent const* tor,
+    tr_rpc_peer_deltas& deltas,
+    std::vector<tr_peer_stat> const& all_peers,
+    std::vector<tr_peer_stat const*> const& peers,
+    std::vector<tr_quark> const& keys,
+    tr_rpc_peer_deltas::Token token,
+    tr_variant* list,
+    tr_variant* args_out)
+{
+    auto const* const prev = deltas.find(token, keys);
+    auto next = prev != nullptr ? *prev : tr_rpc_peer_deltas::Snapshot{ keys };
+
+    if (prev != nullptr)
     {
-        tr_variantInitDict(entry, field_count);
+        auto current = std::set<tr_rpc_peer_key>{};
+        for (auto const& peer : all_peers)
+        {
+            current.emplace(makePeerKey(tor, peer));
+        }
+
+        auto* const out = tr_variantDictAddList(args_out, TR_KEY_removed, 0U);
+        for (auto const& key : prev->ids())
+        {
+            if (auto const& [tor_id, address, port] = key; tor_id == tor->id() && current.count(key) == 0U)
+            {
+                auto* const removed = tr_variantListAddDict(out, 2U);
+                tr_variantDictAddStr(removed, TR_KEY_address, address);
+                tr_variantDictAddInt(removed, TR_KEY_port, port);
+                next.erase(key);
+            }
+        }
     }
 
-    if (field_count > 0)
-    {
-        tr_stat const* const st = tr_torrentStat(tor);
+    auto const n_keys = std::size(keys);
+    auto hashes = std::vector<tr_rpc_peer_deltas::Hash>(n_keys);
 
-        for (size_t i = 0; i < field_count; ++i)
+    for (auto const* const peer : peers)
+    {
+        auto* const entry = tr_variantListAddDict(list, n_keys + 2U);
+        for (auto const key : keys)
         {
-            tr_variant* child = format == TrFormat::Table ? tr_variantListAdd(entry) : tr_variantDictAdd(entry, fields[i]);
+            addPeerField(entry, *peer, key);
+        }
 
-            initField(tor, st, child, fields[i]);
+        for (size_t i = 0; i < n_keys; ++i)
+        {
+            auto* child = static_cast<tr_variant*>(nullptr);
+            auto key = tr_quark{};
+            (void)tr_variantDictChild(entry, i, &key, &child);
+            hashes[i] = tr_rpc_peer_deltas::hash(child);
         }
-    }
-}
 
-char const* torrentGet(tr_session* session, tr_variant* args_in, tr_variant* args_out, tr_rpc_idle_data* /*idle_data*/)
-{
-    auto const torrents = getTorrents(session, args_in);
-    tr_variant* const list = tr_variantDictAddList(args_out, TR_KEY_torrents, std::size(torrents) + 1);
+        auto const peer_key = makePeerKey(tor, *peer);
+        auto const* const old = prev != nullptr ? prev->find(peer_key) : nullptr;
+        if (old != nullptr && *old == hashes)
+        {
+            tr_variantListRemove(list, tr_variantListSize(list) - 1U);
+            continue;
+        }
 
-    auto sv = std::string_view{};
-    auto const format = tr_variantDictFindStrView(args_in, TR_KEY_format, &sv) && sv == "table"sv ? TrFormat::Table :
-                                                                                                    TrFormat::Object;
+        if (old != nullptr)
+        {
+            for (size_t i = 0; i < n_keys; ++i)
+            {
+                if ((*old)[i] == hashes[i])
+                {
+                    tr_variantDictRemove(entry, keys[i]);
+                }
+            }
+        }
 
-    if (tr_variantDictFindStrView(args_in, TR_KEY_ids, &sv) && sv == "recently-active"sv)
-    {
-        auto const cutoff = tr_time() - RecentlyActiveSeconds;
-        auto const ids = session->torrents().removedSince(cutoff);
-        auto* const out = tr_variantDictAddList(args_out, TR_KEY_removed, std::size(ids));
-        for (auto const& id : ids)
+        for (auto const key : { TR_KEY_address, TR_KEY_port })
         {
-            tr_variantListAddInt(out, id);
+            if (tr_variantDictFind(entry, key) == nullptr)
+            {
+                addPeerField(entry, *peer, key);
+            }
         }
+
+        next.set(peer_key, hashes);
     }
 
-    tr_variant* fields = nullptr;
-    char const* errmsg = nullptr;
-    if (!tr_variantDictFindList(args_in, TR_KEY_fields, &fields))
+    if (prev == nullptr)
     {
-        errmsg = "no fields specified";
+        tr_variantDictAddBool(args_out, TR_KEY_delta_full, true);
     }
-    else
+
+    tr_variantDictAddInt(args_out, TR_KEY_delta_token, static_cast<int64_t>(deltas.add(std::move(next))));
+}
+
+// One torrent's peers, with only the fields that the client asks for
+char const* torrentPeers(tr_session* session, tr_variant* args_in, tr_variant* args_out, tr_rpc_idle_data* /*idle_data*/)
+{
+    auto const torrents = getTorrents(session, args_in);
+    if (std::size(torrents) != 1U)
     {
-        auto const n = tr_variantListSize(fields);
-        auto keys = std::vector<tr_quark>{};
-        keys.reserve(n);
+        return "torrent-peers needs exactly one torrent";
+    }
 
-        for (size_t i = 0; i < n; ++i)
+    auto const* const tor = torrents.front();
+    tr_variantDictAddInt(args_out, TR_KEY_id, tor->id());
+
+    auto keys = std::vector<tr_quark>{};
+    if (tr_variant* fields = nullptr; tr_variantDictFindList(args_in, TR_KEY_fields, &fields))
+    {
+        for (size_t i = 0, n = tr_variantListSize(fields); i < n; ++i)
         {
+            auto sv = std::string_view{};
             if (!tr_variantGetStrView(tr_variantListChild(fields, i), &sv))
             {
                 continue;
             }
 
-            if (auto const key = tr_quark_lookup(sv); key && isSupportedTorrentGetField(*key))
+            if (auto const key = tr_quark_lookup(sv);
+                key && isSupportedPeerField(*key) && std::find(std::begin(keys), std::end(keys), *key) == std::end(keys))
             {
                 keys.emplace_back(*key);
             }
         }
+    }
+    else
+    {
+        keys.assign(std::begin(PeerFields), std::end(PeerFields));
+    }
 
-        if (format == TrFormat::Table)
-        {
-            /* first entry is an array of property names */
-            tr_variant* names = tr_variantListAddList(list, std::size(keys));
-            for (auto const& key : keys)
-            {
-                tr_variantListAddQuark(names, key);
-            }
-        }
+    auto const& all_peers = tr_peerMgrPeerStatsSnapshot(tor);
+    auto peers = std::vector<tr_peer_stat const*>{};
+    peers.reserve(std::size(all_peers));
+    std::transform(
+        std::begin(all_peers),
+        std::end(all_peers),
+        std::back_inserter(peers),
+        [](auto const& peer) { return &peer; });
+    if (auto const* const errmsg = sortAndPagePeers(peers, args_in, args_out); errmsg != nullptr)
+    {
+        return errmsg;
+    }
+
+    auto* const list = tr_variantDictAddList(args_out, TR_KEY_peers, std::size(peers));
+
+    if (auto delta_token = int64_t{}; tr_variantDictFindInt(args_in, TR_KEY_delta_token, &delta_token))
+    {
+        auto const token = static_cast<tr_rpc_peer_deltas::Token>(delta_token);
+        addPeerDeltas(tor, session->rpc_peer_deltas(), all_peers, peers, keys, token, list, args_out);
+        return nullptr;
+    }
 
-        for (auto* tor : torrents)
+    for (auto const* const peer : peers)
+    {
+        auto* const entry = tr_variantListAddDict(list, std::size(keys));
+        for (auto const key : keys)
         {
-            addTorrentInfo(tor, format, tr_variantListAdd(list), std::data(keys), std::size(keys));
+            addPeerField(entry, *peer, key);
         }
     }
 
-    return errmsg;
+    return nullptr;
 }
 
 // ---
@@ -1011,61 +2023,25 @@ char const* setLabels(tr_torrent* tor, tr_variant* list)
     return nullptr;
 }
 
-char const* setFilePriorities(tr_torrent* tor, tr_priority_t priority, tr_variant* list)
-{
-    char const* errmsg = nullptr;
-    auto const n_files = tor->file_count();
-
-    auto files = std::vector<tr_file_index_t>{};
-    files.reserve(n_files);
-
-    if (size_t const n = tr_variantListSize(list); n != 0)
-    {
-        for (size_t i = 0; i < n; ++i)
-        {
-            if (auto val = int64_t{}; tr_variantGetInt(tr_variantListChild(list, i), &val))
-            {
-                if (auto const file_index = static_cast<tr_file_index_t>(val); file_index < n_files)
-                {
-                    files.push_back(file_index);
-                }
-                else
-                {
-                    errmsg = "file index out of range";
-                }
-            }
-        }
-    }
-    else // if empty set, apply to all
-    {
-        files.resize(n_files);
-        std::iota(std::begin(files), std::end(files), 0);
-    }
-
-    tor->set_file_priorities(std::data(files), std::size(files), priority);
-
-    return errmsg;
-}
-
-char const* setFileDLs(tr_torrent* tor, bool wanted, tr_variant* list)
+// Get the file indices in `list` for `torrent-set`. An empty list means all files.
+char const* getFileIndices(tr_torrent const* tor, tr_variant* list, std::vector<tr_file_index_t>& setme)
 {
     char const* errmsg = nullptr;
 
     auto const n_files = tor->file_count();
     auto const n_items = tr_variantListSize(list);
 
-    auto files = std::vector<tr_file_index_t>{};
-    files.reserve(n_files);
-
     if (n_items != 0) // if argument list, process them
     {
+        setme.reserve(n_items);
+
         for (size_t i = 0; i < n_items; ++i)
         {
             if (auto val = int64_t{}; tr_variantGetInt(tr_variantListChild(list, i), &val))
             {
                 if (auto const file_index = static_cast<tr_file_index_t>(val); file_index < n_files)
                 {
-                    files.push_back(file_index);
+                    setme.push_back(file_index);
                 }
                 else
                 {
@@ -1076,12 +2052,10 @@ char const* setFileDLs(tr_torrent* tor, bool wanted, tr_variant* list)
     }
     else // if empty set, apply to all
     {
-        files.resize(n_files);
-        std::iota(std::begin(files), std::end(files), 0);
+        setme.resize(n_files);
+        std::iota(std::begin(setme), std::end(setme), 0);
     }
 
-    tor->set_files_wanted(std::data(files), std::size(files), wanted);
-
     return errmsg;
 }
 
@@ -1139,6 +2113,33 @@ char const* replaceTrackers(tr_torrent* tor, tr_variant* urls)
     return nullptr;
 }
 
+// Replace `[old, new]` in all of the torrent's announce URLs.
+// Unlike the other tracker args, it's not an error if nothing matched,
+// since it's meant to be applied to many torrents at once.
+char const* replaceTrackerListText(tr_torrent* tor, tr_variant* args)
+{
+    auto oldval = std::string_view{};
+    auto newval = std::string_view{};
+    if (tr_variantListSize(args) != 2U || !tr_variantGetStrView(tr_variantListChild(args, 0), &oldval) ||
+        !tr_variantGetStrView(tr_variantListChild(args, 1), &newval) || std::empty(oldval))
+    {
+        return "invalid trackerListReplace";
+    }
+
+    auto text = tor->tracker_list();
+    if (!tr_strv_contains(text, oldval))
+    {
+        return nullptr;
+    }
+
+    for (auto pos = text.find(oldval); pos != std::string::npos; pos = text.find(oldval, pos + std::size(newval)))
+    {
+        text.replace(pos, std::size(oldval), newval);
+    }
+
+    return tor->set_tracker_list(text) ? nullptr : "Invalid tracker list";
+}
+
 char const* removeTrackers(tr_torrent* tor, tr_variant* ids)
 {
     auto const old_size = tor->tracker_count();
@@ -1196,14 +2197,17 @@ char const* torrentSet(tr_session* session, tr_variant* args_in, tr_variant* /*a
             errmsg = setLabels(tor, tmp_variant);
         }
 
+        // collect all the file changes and apply them at once
+        auto file_changes = tr_torrent::FileChanges{};
+
         if (errmsg == nullptr && tr_variantDictFindList(args_in, TR_KEY_files_unwanted, &tmp_variant))
         {
-            errmsg = setFileDLs(tor, false, tmp_variant);
+            errmsg = getFileIndices(tor, tmp_variant, file_changes.unwanted);
         }
 
         if (errmsg == nullptr && tr_variantDictFindList(args_in, TR_KEY_files_wanted, &tmp_variant))
         {
-            errmsg = setFileDLs(tor, true, tmp_variant);
+            errmsg = getFileIndices(tor, tmp_variant, file_changes.wanted);
         }
 
         if (tr_variantDictFindInt(args_in, TR_KEY_peer_limit, &tmp))
@@ -1213,19 +2217,21 @@ char const* torrentSet(tr_session* session, tr_variant* args_in, tr_variant* /*a
 
         if (errmsg == nullptr && tr_variantDictFindList(args_in, TR_KEY_priority_high, &tmp_variant))
         {
-            errmsg = setFilePriorities(tor, TR_PRI_HIGH, tmp_variant);
+            errmsg = getFileIndices(tor, tmp_variant, file_changes.priority_high);
         }
 
         if (errmsg == nullptr && tr_variantDictFindList(args_in, TR_KEY_priority_low, &tmp_variant))
         {
-            errmsg = setFilePriorities(tor, TR_PRI_LOW, tmp_variant);
+            errmsg = getFileIndices(tor, tmp_variant, file_changes.priority_low);
         }
 
         if (errmsg == nullptr && tr_variantDictFindList(args_in, TR_KEY_priority_normal, &tmp_variant))
         {
-            errmsg = setFilePriorities(tor, TR_PRI_NORMAL, tmp_variant);
+            errmsg = getFileIndices(tor, tmp_variant, file_changes.priority_normal);
         }
 
+        tor->apply_file_changes(file_changes);
+
         if (tr_variantDictFindInt(args_in, TR_KEY_downloadLimit, &tmp))
         {
             tr_torrentSetSpeedLimit_KBps(tor, TR_DOWN, tmp);
@@ -1236,6 +2242,11 @@ char const* torrentSet(tr_session* session, tr_variant* args_in, tr_variant* /*a
             tor->set_sequential_download(val);
         }
 
+        if (auto val = bool{}; tr_variantDictFindBool(args_in, TR_KEY_superSeeding, &val))
+        {
+            tor->set_super_seeding(val);
+        }
+
         if (auto val = bool{}; tr_variantDictFindBool(args_in, TR_KEY_downloadLimited, &val))
         {
             tor->use_speed_limit(TR_DOWN, val);
@@ -1304,6 +2315,11 @@ char const* torrentSet(tr_session* session, tr_variant* args_in, tr_variant* /*a
             }
         }
 
+        if (errmsg == nullptr && tr_variantDictFindList(args_in, TR_KEY_trackerListReplace, &tmp_variant))
+        {
+            errmsg = replaceTrackerListText(tor, tmp_variant);
+        }
+
         session->rpcNotify(TR_RPC_TORRENT_CHANGED, tor);
     }
 
@@ -1413,24 +2429,70 @@ char const* portTest(tr_session* session, tr_variant* /*args_in*/, tr_variant* /
 
 // ---
 
-void onBlocklistFetched(tr_web::FetchResponse const& web_response)
+struct blocklist_update_data
 {
-    auto const& [status, body, did_connect, did_timeout, user_data] = web_response;
-    auto* data = static_cast<struct tr_rpc_idle_data*>(user_data);
-    auto* const session = data->session;
+    blocklist_update_data(tr_rpc_idle_data* data_in, std::string_view body_in)
+        : data{ data_in }
+        , body{ body_in }
+    {
+    }
 
-    if (status != 200)
+    blocklist_update_data(blocklist_update_data const&) = delete;
+    blocklist_update_data(blocklist_update_data&&) = delete;
+    blocklist_update_data& operator=(blocklist_update_data const&) = delete;
+    blocklist_update_data& operator=(blocklist_update_data&&) = delete;
+
+    // If the import was dropped because the session is closing,
+    // there's no one to answer, so just free the request.
+    ~blocklist_update_data()
     {
-        // we failed to download the blocklist...
-        tr_idle_function_done(
-            data,
-            fmt::format(
-                _("Couldn't fetch blocklist: {error} ({error_code})"),
-                fmt::arg("error", tr_webGetResponseStr(status)),
-                fmt::arg("error_code", status)));
+        if (data != nullptr)
+        {
+            tr_variantClear(&data->response);
+            delete data;
+        }
+    }
+
+    tr_rpc_idle_data* data = nullptr;
+    std::string body;
+    std::optional<libtransmission::Blocklist> blocklist;
+    std::string errmsg;
+};
+
+void commitBlocklist(blocklist_update_data& update)
+{
+    // the RPC server is gone, so there's no one to answer
+    if (update.data->session->isClosing())
+    {
+        return;
+    }
+
+    auto* const data = std::exchange(update.data, nullptr);
+
+    if (!std::empty(update.errmsg))
+    {
+        tr_idle_function_done(data, update.errmsg);
         return;
     }
 
+    // swap in the new list and give the client a response
+    auto rule_count = size_t{ 0U };
+    if (update.blocklist)
+    {
+        rule_count = std::size(*update.blocklist);
+        data->session->setDefaultBlocklist(std::move(*update.blocklist));
+    }
+
+    tr_variantDictAddInt(data->args_out, TR_KEY_blocklist_size, static_cast<int64_t>(rule_count));
+    tr_idle_function_done(data, SuccessResult);
+}
+
+void importBlocklist(std::shared_ptr<blocklist_update_data> const& update)
+{
+    auto* const session = update->data->session;
+    auto const& queue = session->blocklist_import_queue();
+    auto const& body = update->body;
+
     // see if we need to decompress the content
     auto content = std::vector<char>{};
     content.resize(1024 * 128);
@@ -1462,27 +2524,72 @@ void onBlocklistFetched(tr_web::FetchResponse const& web_response)
         break;
     }
 
-    // tr_blocklistSetContent needs a source file,
-    // so save content into a tmpfile
-    auto const filename = tr_pathbuf{ session->configDir(), "/blocklist.tmp"sv };
-    if (tr_error* error = nullptr; !tr_file_save(filename, content, &error))
+    update->body.clear();
+    update->body.shrink_to_fit();
+
+    // the session is closing, so don't bother parsing it
+    if (queue.cancelled())
+    {
+        return;
+    }
+
+    // Blocklist::saveNew needs a source file, so save content into a
+    // tmpfile. It gets a unique name so that it can't clobber, or be
+    // clobbered by, a file that something else left in the config dir.
+    auto filename = tr_pathbuf{ session->configDir(), "/blocklist.tmp.XXXXXX"sv };
+    tr_error* error = nullptr;
+    auto const fd = tr_sys_file_open_temp(std::data(filename), &error);
+    if (fd == TR_BAD_SYS_FILE || !tr_sys_file_close(fd, &error) || !tr_file_save(filename, content, &error))
+    {
+        update->errmsg = fmt::format(
+            _("Couldn't save '{path}': {error} ({error_code})"),
+            fmt::arg("path", filename),
+            fmt::arg("error", error->message),
+            fmt::arg("error_code", error->code));
+        tr_error_clear(&error);
+    }
+    else
+    {
+        content = {};
+        auto const bin_file = tr_pathbuf{ session->blocklistDir(), '/', DEFAULT_BLOCKLIST_FILENAME };
+        update->blocklist = libtransmission::Blocklist::saveNew(filename, bin_file, false);
+        if (update->blocklist)
+        {
+            // load the rules here rather than in the session thread
+            (void)std::size(*update->blocklist);
+        }
+    }
+
+    if (fd != TR_BAD_SYS_FILE)
+    {
+        tr_sys_path_remove(filename);
+    }
+
+    session->runInSessionThread([update]() { commitBlocklist(*update); });
+}
+
+void onBlocklistFetched(tr_web::FetchResponse const& web_response)
+{
+    auto const& [status, body, did_connect, did_timeout, user_data] = web_response;
+    auto* data = static_cast<struct tr_rpc_idle_data*>(user_data);
+
+    if (status != 200)
     {
+        // we failed to download the blocklist...
         tr_idle_function_done(
             data,
             fmt::format(
-                _("Couldn't save '{path}': {error} ({error_code})"),
-                fmt::arg("path", filename),
-                fmt::arg("error", error->message),
-                fmt::arg("error_code", error->code)));
-        tr_error_clear(&error);
+                _("Couldn't fetch blocklist: {error} ({error_code})"),
+                fmt::arg("error", tr_webGetResponseStr(status)),
+                fmt::arg("error_code", status)));
         return;
     }
 
-    // feed it to the session and give the client a response
-    size_t const rule_count = tr_blocklistSetContent(session, filename);
-    tr_variantDictAddInt(data->args_out, TR_KEY_blocklist_size, static_cast<int64_t>(rule_count));
-    tr_sys_path_remove(filename);
-    tr_idle_function_done(data, SuccessResult);
+    // Decompressing and parsing a large list can take seconds,
+    // so do them in the executor and let the session thread keep working.
+    // Imports run one at a time, so they can't race to replace the list.
+    auto update = std::make_shared<blocklist_update_data>(data, body);
+    data->session->blocklist_import_queue().submit([update]() { importBlocklist(update); });
 }
 
 char const* blocklistUpdate(
@@ -1497,7 +2604,9 @@ char const* blocklistUpdate(
 
 // ---
 
-void addTorrentImpl(struct tr_rpc_idle_data* data, tr_ctor* ctor)
+// Add the torrent described by `ctor`, which this function takes ownership of,
+// and describe the new or duplicate torrent in `args_out`.
+char const* addTorrentFromCtor(tr_session* session, tr_ctor* ctor, tr_variant* args_out)
 {
     tr_torrent* duplicate_of = nullptr;
     tr_torrent* tor = tr_torrentNew(ctor, &duplicate_of);
@@ -1505,8 +2614,7 @@ void addTorrentImpl(struct tr_rpc_idle_data* data, tr_ctor* ctor)
 
     if (tor == nullptr && duplicate_of == nullptr)
     {
-        tr_idle_function_done(data, "invalid or corrupt torrent file"sv);
-        return;
+        return "invalid or corrupt torrent file";
     }
 
     static auto constexpr Fields = std::array<tr_quark, 3>{ TR_KEY_id, TR_KEY_name, TR_KEY_hashString };
@@ -1515,33 +2623,26 @@ void addTorrentImpl(struct tr_rpc_idle_data* data, tr_ctor* ctor)
         addTorrentInfo(
             duplicate_of,
             TrFormat::Object,
-            tr_variantDictAdd(data->args_out, TR_KEY_torrent_duplicate),
+            tr_variantDictAdd(args_out, TR_KEY_torrent_duplicate),
             std::data(Fields),
             std::size(Fields));
-        tr_idle_function_done(data, SuccessResult);
-        return;
+        return nullptr;
     }
 
-    data->session->rpcNotify(TR_RPC_TORRENT_ADDED, tor);
-    addTorrentInfo(
-        tor,
-        TrFormat::Object,
-        tr_variantDictAdd(data->args_out, TR_KEY_torrent_added),
-        std::data(Fields),
-        std::size(Fields));
-    tr_idle_function_done(data, SuccessResult);
+    session->rpcNotify(TR_RPC_TORRENT_ADDED, tor);
+    addTorrentInfo(tor, TrFormat::Object, tr_variantDictAdd(args_out, TR_KEY_torrent_added), std::data(Fields), std::size(Fields));
+    return nullptr;
 }
 
-struct add_torrent_idle_data
+void addTorrentImpl(struct tr_rpc_idle_data* data, tr_ctor* ctor)
 {
-    struct tr_rpc_idle_data* data;
-    tr_ctor* ctor;
-};
+    auto const* const errmsg = addTorrentFromCtor(data->session, ctor, data->args_out);
+    tr_idle_function_done(data, errmsg != nullptr ? std::string_view{ errmsg } : SuccessResult);
+}
 
-void onMetadataFetched(tr_web::FetchResponse const& web_response)
+void onMetadataFetched(struct tr_rpc_idle_data* data, tr_ctor* ctor, tr_web::FetchResponse const& web_response)
 {
     auto const& [status, body, did_connect, did_timeout, user_data] = web_response;
-    auto* data = static_cast<struct add_torrent_idle_data*>(user_data);
 
     tr_logAddTrace(fmt::format(
         "torrentAdd: HTTP response code was {} ({}); response length was {} bytes",
@@ -1551,20 +2652,18 @@ void onMetadataFetched(tr_web::FetchResponse const& web_response)
 
     if (status == 200 || status == 221) /* http or ftp success.. */
     {
-        tr_ctorSetMetainfo(data->ctor, std::data(body), std::size(body), nullptr);
-        addTorrentImpl(data->data, data->ctor);
+        tr_ctorSetMetainfo(ctor, std::data(body), std::size(body), nullptr);
+        addTorrentImpl(data, ctor);
     }
     else
     {
         tr_idle_function_done(
-            data->data,
+            data,
             fmt::format(
                 _("Couldn't fetch torrent: {error} ({error_code})"),
                 fmt::arg("error", tr_webGetResponseStr(status)),
                 fmt::arg("error_code", status)));
     }
-
-    delete data;
 }
 
 bool isCurlURL(std::string_view url)
@@ -1593,10 +2692,9 @@ auto fileListFromList(tr_variant* list)
     return files;
 }
 
-char const* torrentAdd(tr_session* session, tr_variant* args_in, tr_variant* /*args_out*/, tr_rpc_idle_data* idle_data)
+// Check the torrent-add arguments in `args_in` and apply the optional ones to `ctor`
+char const* setAddCtorArgs(tr_ctor* ctor, tr_variant* args_in)
 {
-    TR_ASSERT(idle_data != nullptr);
-
     auto filename = std::string_view{};
     (void)tr_variantDictFindStrView(args_in, TR_KEY_filename, &filename);
 
@@ -1616,13 +2714,9 @@ char const* torrentAdd(tr_session* session, tr_variant* args_in, tr_variant* /*a
 
     auto i = int64_t{};
     tr_variant* l = nullptr;
-    tr_ctor* ctor = tr_ctorNew(session);
 
     /* set the optional arguments */
 
-    auto cookies = std::string_view{};
-    (void)tr_variantDictFindStrView(args_in, TR_KEY_cookies, &cookies);
-
     if (!std::empty(download_dir))
     {
         auto const sz_download_dir = std::string{ download_dir };
@@ -1680,19 +2774,56 @@ char const* torrentAdd(tr_session* session, tr_variant* args_in, tr_variant* /*a
 
         if (errmsg != nullptr)
         {
-            tr_ctorFree(ctor);
             return errmsg;
         }
 
         tr_ctorSetLabels(ctor, std::data(labels), std::size(labels));
     }
 
+    if (tr_variant* manifest_var = nullptr; tr_variantDictFindDict(args_in, TR_KEY_manifest, &manifest_var))
+    {
+        auto manifest = tr_verify_manifest::from_variant(manifest_var);
+        if (!manifest)
+        {
+            return "invalid manifest";
+        }
+
+        tr_ctorSetVerifyManifest(ctor, std::move(*manifest));
+    }
+
+    return nullptr;
+}
+
+char const* torrentAdd(tr_session* session, tr_variant* args_in, tr_variant* /*args_out*/, tr_rpc_idle_data* idle_data)
+{
+    TR_ASSERT(idle_data != nullptr);
+
+    tr_ctor* ctor = tr_ctorNew(session);
+    if (auto const* const errmsg = setAddCtorArgs(ctor, args_in); errmsg != nullptr)
+    {
+        tr_ctorFree(ctor);
+        return errmsg;
+    }
+
+    auto filename = std::string_view{};
+    (void)tr_variantDictFindStrView(args_in, TR_KEY_filename, &filename);
+
+    auto metainfo_base64 = std::string_view{};
+    (void)tr_variantDictFindStrView(args_in, TR_KEY_metainfo, &metainfo_base64);
+
+    auto cookies = std::string_view{};
+    (void)tr_variantDictFindStrView(args_in, TR_KEY_cookies, &cookies);
+
     tr_logAddTrace(fmt::format("torrentAdd: filename is '{}'", filename));
 
     if (isCurlURL(filename))
     {
-        auto* const d = new add_torrent_idle_data{ idle_data, ctor };
-        auto options = tr_web::FetchOptions{ filename, onMetadataFetched, d };
+        // small enough for std::function to hold without a heap allocation
+        auto on_fetched = [idle_data, ctor](tr_web::FetchResponse const& web_response)
+        {
+            onMetadataFetched(idle_data, ctor, web_response);
+        };
+        auto options = tr_web::FetchOptions{ filename, std::move(on_fetched), nullptr };
         options.cookies = cookies;
         session->fetch(std::move(options));
     }
@@ -1716,6 +2847,7 @@ char const* torrentAdd(tr_session* session, tr_variant* args_in, tr_variant* /*a
 
         if (!ok)
         {
+            tr_ctorFree(ctor);
             return "unrecognized info";
         }
 
@@ -1727,6 +2859,289 @@ char const* torrentAdd(tr_session* session, tr_variant* args_in, tr_variant* /*a
 
 // ---
 
+/* torrent-add-batch: the metainfo of every item is fetched, decoded, and
+ * parsed before any of them are added. The parsing happens in worker threads
+ * so that a large batch doesn't stall the session thread; then all of the
+ * torrents are added in a single trip back to the session thread. */
+namespace add_batch_helpers
+{
+enum class BatchSource
+{
+    Metainfo, // base64-encoded .torrent contents
+    File, // a local .torrent file
+    Url, // a remote .torrent file
+    Magnet
+};
+
+struct add_batch_item
+{
+    tr_ctor* ctor = nullptr;
+    BatchSource source = BatchSource::Metainfo;
+    std::string filename;
+    std::string metainfo_base64;
+
+    // Set by worker threads. `ctor` is only touched on the session thread.
+    tr_torrent_metainfo metainfo;
+    std::vector<char> contents;
+
+    // An error message for this item, or nullptr if there's none yet
+    char const* errmsg = nullptr;
+    std::string fetch_errmsg;
+};
+
+struct add_batch_data
+{
+    tr_rpc_idle_data* data = nullptr;
+    std::vector<add_batch_item> items;
+    size_t n_pending_fetches = 0U;
+    std::atomic<size_t> n_pending_parses = {};
+};
+
+void parseBatchItem(add_batch_item& item)
+{
+    if (item.errmsg != nullptr || item.source == BatchSource::Magnet)
+    {
+        return;
+    }
+
+    auto ok = false;
+    switch (item.source)
+    {
+    case BatchSource::Metainfo:
+        {
+            auto const metainfo = tr_base64_decode(item.metainfo_base64);
+            item.contents.assign(std::begin(metainfo), std::end(metainfo));
+            item.metainfo_base64 = {};
+            ok = item.metainfo.parse_benc({ std::data(item.contents), std::size(item.contents) });
+        }
+        break;
+
+    case BatchSource::Url:
+        ok = item.metainfo.parse_benc({ std::data(item.contents), std::size(item.contents) });
+        break;
+
+    case BatchSource::File:
+        ok = item.metainfo.parse_torrent_file(item.filename, &item.contents);
+        break;
+
+    default:
+        break;
+    }
+
+    if (!ok)
+    {
+        item.errmsg = "unrecognized info";
+    }
+}
+
+// Runs in the session thread once every item has been parsed
+void commitBatch(add_batch_data* batch)
+{
+    auto* const data = batch->data;
+
+    // the RPC server is gone, so there's no one to answer
+    if (data->session->isClosing())
+    {
+        for (auto& item : batch->items)
+        {
+            tr_ctorFree(item.ctor);
+        }
+
+        tr_variantClear(&data->response);
+        delete data;
+        delete batch;
+        return;
+    }
+    auto* const results = tr_variantDictAddList(data->args_out, TR_KEY_torrents, std::size(batch->items));
+
+    for (auto& item : batch->items)
+    {
+        if (item.errmsg == nullptr)
+        {
+            if (item.source == BatchSource::Magnet)
+            {
+                if (!tr_ctorSetMetainfoFromMagnetLink(item.ctor, item.filename))
+                {
+                    item.errmsg = "unrecognized info";
+                }
+            }
+            else
+            {
+                auto const source_file = item.source == BatchSource::File ? std::string_view{ item.filename } : ""sv;
+                tr_ctorSetMetainfo(item.ctor, std::move(item.metainfo), std::move(item.contents), source_file);
+            }
+        }
+
+        auto* const result = tr_variantListAddDict(results, 2);
+        if (item.errmsg == nullptr)
+        {
+            item.errmsg = addTorrentFromCtor(data->session, item.ctor, result);
+        }
+        else
+        {
+            tr_ctorFree(item.ctor);
+        }
+
+        item.ctor = nullptr;
+        tr_variantDictAddStr(result, TR_KEY_result, item.errmsg != nullptr ? std::string_view{ item.errmsg } : SuccessResult);
+    }
+
+    tr_idle_function_done(data, SuccessResult);
+    delete batch;
+}
+
+void parseBatch(add_batch_data* batch)
+{
+    auto& items = batch->items;
+    auto* const session = batch->data->session;
+
+    if (std::empty(items))
+    {
+        session->runInSessionThread([batch]() { commitBatch(batch); });
+        return;
+    }
+
+    // Decoding and parsing don't need the session, so do them in the
+    // executor and let the session thread keep working. The last item
+    // to be parsed sends the batch back to the session thread.
+    batch->n_pending_parses = std::size(items);
+    for (auto& item : items)
+    {
+        session->rpc_parse_queue().submit(
+            [batch, session, &item]()
+            {
+                parseBatchItem(item);
+                if (--batch->n_pending_parses == 0U)
+                {
+                    session->runInSessionThread([batch]() { commitBatch(batch); });
+                }
+            });
+    }
+}
+
+void onBatchMetadataFetched(tr_web::FetchResponse const& web_response)
+{
+    auto const& [status, body, did_connect, did_timeout, user_data] = web_response;
+    auto* const item = static_cast<add_batch_item*>(user_data);
+
+    tr_logAddTrace(fmt::format(
+        "torrentAddBatch: HTTP response code was {} ({}); response length was {} bytes",
+        status,
+        tr_webGetResponseStr(status),
+        std::size(body)));
+
+    if (status == 200 || status == 221) /* http or ftp success.. */
+    {
+        item->contents.assign(std::begin(body), std::end(body));
+    }
+    else
+    {
+        item->fetch_errmsg = fmt::format(
+            _("Couldn't fetch torrent: {error} ({error_code})"),
+            fmt::arg("error", tr_webGetResponseStr(status)),
+            fmt::arg("error_code", status));
+        item->errmsg = item->fetch_errmsg.c_str();
+    }
+}
+} // namespace add_batch_helpers
+
+char const* torrentAddBatch(tr_session* session, tr_variant* args_in, tr_variant* /*args_out*/, tr_rpc_idle_data* idle_data)
+{
+    using namespace add_batch_helpers;
+
+    TR_ASSERT(idle_data != nullptr);
+
+    tr_variant* list = nullptr;
+    if (!tr_variantDictFindList(args_in, TR_KEY_torrents, &list))
+    {
+        return "no torrents specified";
+    }
+
+    auto* const batch = new add_batch_data{};
+    batch->data = idle_data;
+
+    // Everything needed from `args_in` is copied here,
+    // since the request won't outlive this call.
+    auto const n_items = tr_variantListSize(list);
+    auto& items = batch->items;
+    items.resize(n_items);
+    auto urls = std::vector<std::pair<size_t, std::string>>{};
+    for (size_t i = 0; i < n_items; ++i)
+    {
+        auto* const item_args = tr_variantListChild(list, i);
+        auto& item = items[i];
+        item.ctor = tr_ctorNew(session);
+
+        if (!tr_variantIsDict(item_args))
+        {
+            item.errmsg = "torrent-add-batch items must be objects";
+            continue;
+        }
+
+        item.errmsg = setAddCtorArgs(item.ctor, item_args);
+        if (item.errmsg != nullptr)
+        {
+            continue;
+        }
+
+        auto sv = std::string_view{};
+        if (tr_variantDictFindStrView(item_args, TR_KEY_filename, &sv) && !std::empty(sv))
+        {
+            item.filename = sv;
+            if (isCurlURL(sv))
+            {
+                item.source = BatchSource::Url;
+                auto cookies = std::string_view{};
+                (void)tr_variantDictFindStrView(item_args, TR_KEY_cookies, &cookies);
+                urls.emplace_back(i, cookies);
+            }
+            else if (tr_sys_path_exists(tr_pathbuf{ sv }))
+            {
+                item.source = BatchSource::File;
+            }
+            else
+            {
+                item.source = BatchSource::Magnet;
+            }
+        }
+        else if (tr_variantDictFindStrView(item_args, TR_KEY_metainfo, &sv))
+        {
+            item.source = BatchSource::Metainfo;
+            item.metainfo_base64 = sv;
+        }
+    }
+
+    if (std::empty(urls))
+    {
+        parseBatch(batch);
+        return nullptr;
+    }
+
+    // fetch the remote torrents first, then parse everything at once
+    batch->n_pending_fetches = std::size(urls);
+    for (auto const& [idx, cookies] : urls)
+    {
+        auto options = tr_web::FetchOptions{
+            items[idx].filename,
+            [batch](tr_web::FetchResponse const& web_response)
+            {
+                onBatchMetadataFetched(web_response);
+                if (--batch->n_pending_fetches == 0U)
+                {
+                    parseBatch(batch);
+                }
+            },
+            &items[idx]
+        };
+        options.cookies = cookies;
+        session->fetch(std::move(options));
+    }
+
+    return nullptr;
+}
+
+// ---
+
 char const* groupGet(tr_session* s, tr_variant* args_in, tr_variant* args_out, struct tr_rpc_idle_data* /*idle_data*/)
 {
     std::set<std::string_view> names;
@@ -2070,21 +3485,62 @@ char const* sessionSet(tr_session* session, tr_variant* args_in, tr_variant* /*a
     return nullptr;
 }
 
+// how many places to list in session-stats' `slowEventLoopCalls`
+auto constexpr SlowEventLoopCallsReported = size_t{ 10U };
+
 char const* sessionStats(tr_session* session, tr_variant* /*args_in*/, tr_variant* args_out, tr_rpc_idle_data* /*idle_data*/)
 {
+    // these are kept current by tr_torrents, so they're O(1)
     auto const& torrents = session->torrents();
     auto const total = std::size(torrents);
-    auto const running = std::count_if(
-        std::begin(torrents),
-        std::end(torrents),
-        [](auto const* tor) { return tor->is_running(); });
+    auto const running = torrents.count_running();
 
     tr_variantDictAddInt(args_out, TR_KEY_activeTorrentCount, running);
+    auto const& flush_stats = session->cache->flush_stats();
+    tr_variantDictAddInt(args_out, TR_KEY_cacheFlushBytes, flush_stats.n_bytes);
+    tr_variantDictAddInt(args_out, TR_KEY_cacheFlushMsec, flush_stats.msec);
+    tr_variantDictAddInt(args_out, TR_KEY_cacheFlushWrites, flush_stats.n_writes);
     tr_variantDictAddReal(args_out, TR_KEY_downloadSpeed, session->pieceSpeedBps(TR_DOWN));
+    tr_variantDictAddInt(args_out, TR_KEY_memoryBudget, session->memory_budget().limit());
+    tr_variantDictAddStrView(args_out, TR_KEY_memoryPressure, tr_memory_budget::name(session->memory_budget().pressure()));
+    tr_variantDictAddInt(args_out, TR_KEY_openFileHits, session->openFiles().stats().hits);
+    tr_variantDictAddInt(args_out, TR_KEY_openFileMisses, session->openFiles().stats().misses);
     tr_variantDictAddInt(args_out, TR_KEY_pausedTorrentCount, total - running);
+    tr_variantDictAddInt(args_out, TR_KEY_peersConnected, session->peer_count());
+    tr_variantDictAddInt(args_out, TR_KEY_readCacheHits, session->cache->read_stats().hits);
+    tr_variantDictAddInt(args_out, TR_KEY_readCacheMisses, session->cache->read_stats().misses);
     tr_variantDictAddInt(args_out, TR_KEY_torrentCount, total);
+    auto* const by_status = tr_variantDictAddList(args_out, TR_KEY_torrentsByStatus, TR_STATUS_SEED + 1);
+    for (int status = TR_STATUS_STOPPED; status <= TR_STATUS_SEED; ++status)
+    {
+        tr_variantListAddInt(by_status, torrents.count(static_cast<tr_torrent_activity>(status)));
+    }
+    tr_variantDictAddInt(args_out, TR_KEY_unusedDownloadBytes, session->top_bandwidth_.get_unused_bytes(TR_DOWN));
+    tr_variantDictAddInt(args_out, TR_KEY_unusedUploadBytes, session->top_bandwidth_.get_unused_bytes(TR_UP));
     tr_variantDictAddReal(args_out, TR_KEY_uploadSpeed, session->pieceSpeedBps(TR_UP));
 
+    auto const& memory_usage = session->memory_budget().usage();
+    auto* const memory = tr_variantDictAddDict(args_out, TR_KEY_memoryUsage, tr_memory_usage::NumCategories + 1U);
+    for (uint8_t i = 0U; i < tr_memory_usage::NumCategories; ++i)
+    {
+        auto const category = static_cast<tr_memory_usage::Category>(i);
+        tr_variantDictAddInt(memory, tr_quark_new(tr_memory_usage::name(category)), memory_usage.bytes[category]);
+    }
+    tr_variantDictAddInt(memory, TR_KEY_total, memory_usage.total());
+
+    auto const slowest = tr_metrics::instance().slowest_loop_calls(SlowEventLoopCallsReported);
+    auto* const slow_calls = tr_variantDictAddList(args_out, TR_KEY_slowEventLoopCalls, std::size(slowest));
+    for (auto const& calls : slowest)
+    {
+        using namespace std::chrono;
+        auto* const call = tr_variantListAddDict(slow_calls, 5);
+        tr_variantDictAddInt(call, TR_KEY_count, calls.count);
+        tr_variantDictAddStrView(call, TR_KEY_kind, calls.kind_name());
+        tr_variantDictAddStr(call, TR_KEY_location, calls.location());
+        tr_variantDictAddInt(call, TR_KEY_maxMsec, duration_cast<milliseconds>(calls.max).count());
+        tr_variantDictAddInt(call, TR_KEY_totalMsec, duration_cast<milliseconds>(calls.total).count());
+    }
+
     auto stats = session->stats().cumulative();
     tr_variant* d = tr_variantDictAddDict(args_out, TR_KEY_cumulative_stats, 5);
     tr_variantDictAddInt(d, TR_KEY_downloadedBytes, stats.downloadedBytes);
@@ -2180,7 +3636,7 @@ void addSessionField(tr_session const* s, tr_variant* d, tr_quark key)
         break;
 
     case TR_KEY_download_dir_free_space:
-        if (auto const capacity = tr_sys_path_get_capacity(s->downloadDir()); capacity)
+        if (auto const capacity = s->capacity_monitor().get(s->downloadDir(), tr_time()).capacity; capacity)
         {
             tr_variantDictAddInt(d, key, capacity->free);
         }
@@ -2399,7 +3855,7 @@ char const* sessionGet(tr_session* s, tr_variant* args_in, tr_variant* args_out,
     return nullptr;
 }
 
-char const* freeSpace(tr_session* /*session*/, tr_variant* args_in, tr_variant* args_out, tr_rpc_idle_data* /*idle_data*/)
+char const* freeSpace(tr_session* session, tr_variant* args_in, tr_variant* args_out, tr_rpc_idle_data* /*idle_data*/)
 {
     auto path = std::string_view{};
 
@@ -2414,12 +3870,8 @@ char const* freeSpace(tr_session* /*session*/, tr_variant* args_in, tr_variant*
     }
 
     /* get the free space */
-    auto const old_errno = errno;
-    tr_error* error = nullptr;
-    auto const capacity = tr_sys_path_get_capacity(path, &error);
-    char const* const err = error != nullptr ? tr_strerror(error->code) : nullptr;
-    tr_error_clear(&error);
-    errno = old_errno;
+    auto const [capacity, error_code] = session->capacity_monitor().get(path, tr_time());
+    char const* const err = error_code != 0 ? tr_strerror(error_code) : nullptr;
 
     /* response */
     tr_variantDictAddStr(args_out, TR_KEY_path, path);
@@ -2451,7 +3903,7 @@ struct rpc_method
     handler func;
 };
 
-auto constexpr Methods = std::array<rpc_method, 24>{ {
+auto constexpr Methods = std::array<rpc_method, 29>{ {
     { "blocklist-update"sv, false, blocklistUpdate },
     { "free-space"sv, true, freeSpace },
     { "group-get"sv, true, groupGet },
@@ -2466,7 +3918,10 @@ auto constexpr Methods = std::array<rpc_method, 24>{ {
     { "session-set"sv, true, sessionSet },
     { "session-stats"sv, true, sessionStats },
     { "torrent-add"sv, false, torrentAdd },
+    { "torrent-add-batch"sv, false, torrentAddBatch },
+    { "torrent-add-peers"sv, true, torrentAddPeers },
     { "torrent-get"sv, true, torrentGet },
+    { "torrent-peers"sv, true, torrentPeers },
     { "torrent-reannounce"sv, true, torrentReannounce },
     { "torrent-remove"sv, true, torrentRemove },
     { "torrent-rename-path"sv, false, torrentRenamePath },
@@ -2476,22 +3931,21 @@ auto constexpr Methods = std::array<rpc_method, 24>{ {
     { "torrent-start-now"sv, true, torrentStartNow },
     { "torrent-stop"sv, true, torrentStop },
     { "torrent-verify"sv, true, torrentVerify },
+    { "torrent-verify-pause"sv, true, torrentVerifyPause },
+    { "torrent-verify-resume"sv, true, torrentVerifyResume },
 } };
 
 void noop_response_callback(tr_session* /*session*/, tr_variant* /*response*/, void* /*user_data*/)
 {
 }
 
-} // namespace
-
-void tr_rpc_request_exec_json(
+void exec_request(
     tr_session* session,
     tr_variant const* request,
     tr_rpc_response_func callback,
-    void* callback_user_data)
+    void* callback_user_data,
+    bool transient_response)
 {
-    auto const lock = session->unique_lock();
-
     auto* const mutable_request = const_cast<tr_variant*>(request);
     tr_variant* args_in = tr_variantDictFind(mutable_request, TR_KEY_arguments);
     char const* result = nullptr;
@@ -2540,8 +3994,12 @@ void tr_rpc_request_exec_json(
     }
     else if (method->immediate)
     {
+        // method names are literals, so they can name the span
+        TR_TRACE_SCOPE("rpc", std::data(method->name));
+
+        auto arena = tr_variant_arena{};
         auto response = tr_variant{};
-        tr_variantInitDict(&response, 3);
+        tr_variantInitDict(&response, 3, transient_response ? &arena : nullptr);
         tr_variant* const args_out = tr_variantDictAddDict(&response, TR_KEY_arguments, 0);
         result = (*method->func)(session, args_in, args_out, nullptr);
 
@@ -2563,9 +4021,11 @@ void tr_rpc_request_exec_json(
     }
     else
     {
+        TR_TRACE_SCOPE("rpc", std::data(method->name));
+
         auto* const data = new tr_rpc_idle_data{};
         data->session = session;
-        tr_variantInitDict(&data->response, 3);
+        tr_variantInitDict(&data->response, 3, transient_response ? &data->arena : nullptr);
 
         if (auto tag = int64_t{}; tr_variantDictFindInt(mutable_request, TR_KEY_tag, &tag))
         {
@@ -2585,6 +4045,130 @@ void tr_rpc_request_exec_json(
     }
 }
 
+// ---
+
+/* A batch is a list of requests that share one reply. Each request is run
+ * as if it had been sent by itself, and the reply is the list of their
+ * responses in the same order. It's sent when the last of them is done,
+ * so a batch that only has immediate methods is answered right away. */
+struct rpc_batch
+{
+    rpc_batch(tr_session* session_in, size_t n_requests, tr_rpc_response_func callback_in, void* callback_user_data_in)
+        : session{ session_in }
+        , callback{ callback_in }
+        , callback_user_data{ callback_user_data_in }
+        , responses(n_requests)
+        , n_pending{ n_requests + 1U } // +1 until every request has been started
+    {
+    }
+
+    ~rpc_batch()
+    {
+        for (auto& response : responses)
+        {
+            tr_variantClear(&response);
+        }
+    }
+
+    rpc_batch(rpc_batch const&) = delete;
+    rpc_batch(rpc_batch&&) = delete;
+    rpc_batch& operator=(rpc_batch const&) = delete;
+    rpc_batch& operator=(rpc_batch&&) = delete;
+
+    tr_session* const session;
+    tr_rpc_response_func const callback;
+    void* const callback_user_data;
+    std::vector<tr_variant> responses;
+    std::atomic<size_t> n_pending;
+};
+
+struct rpc_batch_item
+{
+    rpc_batch* batch;
+    size_t index;
+};
+
+void rpc_batch_release(rpc_batch* batch)
+{
+    if (--batch->n_pending != 0U)
+    {
+        return;
+    }
+
+    auto response = tr_variant{};
+    tr_variantInitList(&response, std::size(batch->responses));
+    for (auto& item_response : batch->responses)
+    {
+        *tr_variantListAdd(&response) = item_response;
+        tr_variantInitBool(&item_response, false);
+    }
+
+    (*batch->callback)(batch->session, &response, batch->callback_user_data);
+
+    tr_variantClear(&response);
+    delete batch;
+}
+
+void rpc_batch_response_callback(tr_session* /*session*/, tr_variant* response, void* user_data)
+{
+    auto* const item = static_cast<rpc_batch_item*>(user_data);
+    auto* const batch = item->batch;
+    batch->responses[item->index] = *response;
+    tr_variantInitBool(response, false);
+    delete item;
+
+    rpc_batch_release(batch);
+}
+
+void exec_batch(tr_session* session, tr_variant const* requests, tr_rpc_response_func callback, void* callback_user_data)
+{
+    auto* const mutable_requests = const_cast<tr_variant*>(requests);
+    auto const n_requests = tr_variantListSize(requests);
+    auto* const batch = new rpc_batch{ session, n_requests, callback, callback_user_data };
+
+    for (size_t i = 0; i < n_requests; ++i)
+    {
+        auto const* const request = tr_variantListChild(mutable_requests, i);
+
+        // batches don't nest; a list here fails like any other request without a method
+        exec_request(session, request, rpc_batch_response_callback, new rpc_batch_item{ batch, i }, false);
+    }
+
+    rpc_batch_release(batch);
+}
+
+} // namespace
+
+void tr_rpc_request_exec_json(
+    tr_session* session,
+    tr_variant const* request,
+    tr_rpc_response_func callback,
+    void* callback_user_data,
+    bool transient_response)
+{
+    auto const lock = session->unique_lock();
+
+    if (callback == nullptr)
+    {
+        callback = noop_response_callback;
+    }
+
+    if (tr_variantIsList(request))
+    {
+        exec_batch(session, request, callback, callback_user_data);
+    }
+    else
+    {
+        exec_request(session, request, callback, callback_user_data, transient_response);
+    }
+}
+
+char const* tr_rpc_torrent_get(tr_session* session, tr_rpc_deltas& deltas, tr_variant* args_in, tr_variant* args_out)
+{
+    auto const lock = session->unique_lock();
+    return torrentGetImpl(session, deltas, args_in, args_out);
+}
+
 /**
  * Munge the URI into a usable form.
  *
@@ -7,16 +7,44 @@
 
 #include <string_view>
 
+class tr_rpc_deltas;
 struct tr_session;
 struct tr_variant;
 
 using tr_rpc_response_func = void (*)(tr_session* session, tr_variant* response, void* user_data);
 
-/* https://www.json.org/ */
+/**
+ * @brief Run a JSON-RPC request.
+ *
+ * By default the callback may take ownership of the response, e.g. to
+ * handle it later on another thread. The response doesn't point into the
+ * session's state, so it's a snapshot that stays valid after the session
+ * lock is released. If `transient_response` is true,
+ * the response is built in a `tr_variant_arena` to save allocations and
+ * is only valid until the callback returns. That's the right choice
+ * when the callback is going to serialize the response right away.
+ *
+ * If `request` is a list, each of its requests is run and the callback
+ * gets one list of their responses, in the same order, once they're all done.
+ *
+ * https://www.json.org/
+ */
 void tr_rpc_request_exec_json(
     tr_session* session,
     tr_variant const* request,
     tr_rpc_response_func callback,
-    void* callback_user_data);
+    void* callback_user_data,
+    bool transient_response = false);
+
+/**
+ * @brief Run `torrent-get` with the given arguments.
+ *
+ * Unlike `tr_rpc_request_exec_json()`, a `delta-token` refers to
+ * `deltas` instead of the session's own snapshots. Event subscribers
+ * use this so that they don't push out the snapshots of clients that poll.
+ *
+ * @return an error message, or nullptr on success
+ */
+char const* tr_rpc_torrent_get(tr_session* session, tr_rpc_deltas& deltas, tr_variant* args_in, tr_variant* args_out);
 
 void tr_rpc_parse_list_str(tr_variant* setme, std::string_view str);
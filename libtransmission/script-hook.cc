@@ -0,0 +1,154 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <cstddef> // size_t
+#include <string_view>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+#include <event2/buffer.h>
+#include <event2/bufferevent.h>
+#include <event2/event.h>
+
+#include <fmt/core.h>
+
+#include "libtransmission/transmission.h"
+
+#include "libtransmission/log.h"
+#include "libtransmission/quark.h"
+#include "libtransmission/script-hook.h"
+#include "libtransmission/timer.h"
+#include "libtransmission/tr-assert.h"
+#include "libtransmission/utils.h"
+
+tr_script_hook::tr_script_hook(event_base* base, libtransmission::TimerMaker& timer_maker, std::string_view socket_path)
+    : base_{ base }
+    , socket_path_{ socket_path }
+    , reconnect_timer_{ timer_maker.create([this]() { connect(); }) }
+{
+    connect();
+}
+
+tr_script_hook::~tr_script_hook()
+{
+    disconnect();
+}
+
+bool tr_script_hook::send(std::string_view line)
+{
+    TR_ASSERT(!std::empty(line) && line.back() == '\n');
+
+    if (!is_connected_)
+    {
+        return false;
+    }
+
+    auto* const output = bufferevent_get_output(bev_);
+    if (evbuffer_get_length(output) + std::size(line) > MaxPendingBytes)
+    {
+        if (!is_backed_up_)
+        {
+            is_backed_up_ = true;
+            tr_logAddWarn(fmt::format(
+                _("Script hook '{path}' isn't keeping up; running scripts instead"),
+                fmt::arg("path", socket_path_)));
+        }
+
+        return false;
+    }
+
+    is_backed_up_ = false;
+
+    // libevent writes everything that was added in this pass of the event loop at once
+    return evbuffer_add(output, std::data(line), std::size(line)) == 0;
+}
+
+void tr_script_hook::connect()
+{
+    disconnect();
+
+#ifdef _WIN32
+    tr_logAddError(fmt::format(
+        _("Unix sockets are unsupported on Windows. Please change '{key}' in your settings."),
+        fmt::arg("key", tr_quark_get_string_view(TR_KEY_script_hook_socket))));
+#else
+    auto addr = sockaddr_un{};
+    if (std::size(socket_path_) >= sizeof(addr.sun_path))
+    {
+        tr_logAddError(fmt::format(_("Script hook path '{path}' is too long"), fmt::arg("path", socket_path_)));
+        return;
+    }
+
+    addr.sun_family = AF_UNIX;
+    tr_strlcpy(addr.sun_path, socket_path_.c_str(), sizeof(addr.sun_path));
+
+    // deferred, so that a failed connect doesn't call on_event() from inside bufferevent_socket_connect()
+    bev_ = bufferevent_socket_new(base_, -1, BEV_OPT_CLOSE_ON_FREE | BEV_OPT_DEFER_CALLBACKS);
+    if (bev_ == nullptr)
+    {
+        reconnect_timer_->start_single_shot(ReconnectInterval);
+        return;
+    }
+
+    bufferevent_setcb(bev_, on_read, nullptr, on_event, this);
+    bufferevent_enable(bev_, EV_READ | EV_WRITE);
+
+    // on_event() is called when this finishes
+    if (bufferevent_socket_connect(bev_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0)
+    {
+        disconnect();
+        reconnect_timer_->start_single_shot(ReconnectInterval);
+    }
+#endif
+}
+
+void tr_script_hook::disconnect()
+{
+    if (bev_ != nullptr)
+    {
+        bufferevent_free(bev_);
+        bev_ = nullptr;
+    }
+
+    is_connected_ = false;
+    is_backed_up_ = false;
+}
+
+// the helper has nothing to say, but must be read so that its closing is noticed
+void tr_script_hook::on_read(bufferevent* bev, void* /*vself*/)
+{
+    auto* const input = bufferevent_get_input(bev);
+    evbuffer_drain(input, evbuffer_get_length(input));
+}
+
+void tr_script_hook::on_event(bufferevent* /*bev*/, short events, void* vself)
+{
+    auto* const self = static_cast<tr_script_hook*>(vself);
+
+    if ((events & BEV_EVENT_CONNECTED) != 0)
+    {
+        self->is_connected_ = true;
+        tr_logAddInfo(fmt::format(_("Sending events to script hook '{path}'"), fmt::arg("path", self->socket_path_)));
+        return;
+    }
+
+    if ((events & (BEV_EVENT_EOF | BEV_EVENT_ERROR)) != 0)
+    {
+        if (self->is_connected_)
+        {
+            tr_logAddWarn(fmt::format(_("Lost script hook '{path}'"), fmt::arg("path", self->socket_path_)));
+        }
+        else
+        {
+            tr_logAddDebug(fmt::format("Couldn't connect to script hook '{}'", self->socket_path_));
+        }
+
+        self->disconnect();
+        self->reconnect_timer_->start_single_shot(ReconnectInterval);
+    }
+}
@@ -0,0 +1,83 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <chrono>
+#include <cstddef> // size_t
+#include <memory>
+#include <string>
+#include <string_view>
+
+struct bufferevent;
+struct event_base;
+
+namespace libtransmission
+{
+class Timer;
+class TimerMaker;
+} // namespace libtransmission
+
+/**
+ * Sends torrent events to a long-running helper that listens on a Unix
+ * socket, one line of JSON per event, so that a burst of events doesn't
+ * spawn a script for each one.
+ *
+ * Events that are sent in the same pass of the event loop reach the helper
+ * in one write. If the helper isn't listening, or has fallen too far behind,
+ * send() refuses the event and the caller can run the script instead.
+ * A helper that goes away is reconnected to every ReconnectInterval.
+ *
+ * Used only from the session thread.
+ */
+class tr_script_hook
+{
+public:
+    // refuse events while this much is waiting for the helper to read it
+    static auto constexpr MaxPendingBytes = size_t{ 4U * 1024U * 1024U };
+
+    static auto constexpr ReconnectInterval = std::chrono::seconds{ 5 };
+
+    tr_script_hook(event_base* base, libtransmission::TimerMaker& timer_maker, std::string_view socket_path);
+    ~tr_script_hook();
+
+    tr_script_hook(tr_script_hook const&) = delete;
+    tr_script_hook(tr_script_hook&&) = delete;
+    tr_script_hook& operator=(tr_script_hook const&) = delete;
+    tr_script_hook& operator=(tr_script_hook&&) = delete;
+
+    [[nodiscard]] constexpr auto const& socket_path() const noexcept
+    {
+        return socket_path_;
+    }
+
+    [[nodiscard]] constexpr auto is_connected() const noexcept
+    {
+        return is_connected_;
+    }
+
+    // Queue one event, which must be a line of JSON ending in '\n'.
+    // Returns false if the event won't reach the helper.
+    bool send(std::string_view line);
+
+private:
+    void connect();
+    void disconnect();
+
+    static void on_read(bufferevent* bev, void* vself);
+    static void on_event(bufferevent* bev, short events, void* vself);
+
+    event_base* const base_;
+    std::string const socket_path_;
+    std::unique_ptr<libtransmission::Timer> const reconnect_timer_;
+
+    bufferevent* bev_ = nullptr;
+    bool is_connected_ = false;
+    bool is_backed_up_ = false;
+};
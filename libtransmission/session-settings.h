@@ -17,34 +17,60 @@
 struct tr_variant;
 
 #define SESSION_SETTINGS_FIELDS(V) \
+    V(TR_KEY_adaptive_bandwidth_enabled, adaptive_bandwidth_enabled, bool, false, "Refill bandwidth more often when peers run out") \
     V(TR_KEY_announce_ip, announce_ip, std::string, "", "") \
     V(TR_KEY_announce_ip_enabled, announce_ip_enabled, bool, false, "") \
+    V(TR_KEY_background_io_limit_iops, background_io_limit_iops, size_t, 0U, "Most prefetch and verify reads per second on each disk; 0 for no limit") \
+    V(TR_KEY_background_io_limit_kbps, background_io_limit_kbps, size_t, 0U, "Most KB/s of prefetch and verify reads on each disk; 0 for no limit") \
     V(TR_KEY_bind_address_ipv4, bind_address_ipv4, std::string, "0.0.0.0", "") \
     V(TR_KEY_bind_address_ipv6, bind_address_ipv6, std::string, "::", "") \
     V(TR_KEY_blocklist_enabled, blocklist_enabled, bool, false, "") \
     V(TR_KEY_blocklist_url, blocklist_url, std::string, "http://www.example.com/blocklist", "") \
+    V(TR_KEY_cache_async_writes, cache_async_writes, bool, false, "Write cached blocks to disk in a background thread") \
     V(TR_KEY_cache_size_mb, cache_size_mb, size_t, 4U, "") \
     V(TR_KEY_default_trackers, default_trackers_str, std::string, "", "") \
     V(TR_KEY_dht_enabled, dht_enabled, bool, true, "") \
+    V(TR_KEY_direct_io_enabled, direct_io_enabled, bool, false, "Bypass the OS' page cache when reading and writing torrent data") \
     V(TR_KEY_download_dir, download_dir, std::string, tr_getDefaultDownloadDir(), "") \
     V(TR_KEY_download_queue_enabled, download_queue_enabled, bool, true, "") \
     V(TR_KEY_download_queue_size, download_queue_size, size_t, 5U, "") \
     V(TR_KEY_encryption, encryption_mode, tr_encryption_mode, TR_ENCRYPTION_PREFERRED, "") \
+    V(TR_KEY_executor_cpu_affinity, executor_cpu_affinity, std::string, "", "CPUs to pin the background worker threads to, e.g. 0-3,6; empty to not pin them") \
+    V(TR_KEY_executor_threads, executor_threads, size_t, 0U, "Number of background worker threads; 0 for one per CPU") \
+    V(TR_KEY_hibernate_idle_seeds_minutes, hibernate_idle_seeds_minutes, size_t, 0U, "Free an idle seed's per-piece state after this many minutes without peers; 0 to disable") \
     V(TR_KEY_idle_seeding_limit, idle_seeding_limit_minutes, size_t, 30U, "") \
     V(TR_KEY_idle_seeding_limit_enabled, idle_seeding_limit_enabled, bool, false, "") \
     V(TR_KEY_incomplete_dir, incomplete_dir, std::string, tr_getDefaultDownloadDir(), "") \
     V(TR_KEY_incomplete_dir_enabled, incomplete_dir_enabled, bool, false, "") \
+    V(TR_KEY_io_trace_file, io_trace_file, std::string, "", "Record the cache's block I/O to this file for replaying; empty to not record") \
+    V(TR_KEY_lan_peer_fast_path_enabled, lan_peer_fast_path_enabled, bool, false, "Don't throttle or encrypt LAN peers") \
+    V(TR_KEY_lan_peer_networks, lan_peer_networks, std::string, "", "Comma-separated CIDRs of LAN peers; empty for private ranges") \
+    V(TR_KEY_large_request_size_kib, large_request_size_kib, size_t, 0U, "Request up to this many KiB at once from peers that support it, 64-256; 0 to disable") \
+    V(TR_KEY_lazy_piece_hashes_enabled, lazy_piece_hashes_enabled, bool, false, "Read piece hashes from the .torrent file when needed") \
+    V(TR_KEY_local_data_reuse_enabled, local_data_reuse_enabled, bool, false, "Reuse matching files from other torrents") \
     V(TR_KEY_lpd_enabled, lpd_enabled, bool, true, "") \
+    V(TR_KEY_lpd_cluster_mode, lpd_cluster_mode, bool, false, "Announce to LPD faster than BEP 14 allows, for LANs you control") \
+    V(TR_KEY_memory_budget_mb, memory_budget_mb, size_t, 0U, "Memory for the caches, peer buffers, and metadata together; 0 for no limit") \
     V(TR_KEY_message_level, log_level, tr_log_level, TR_LOG_INFO, "") \
+    V(TR_KEY_metadata_cache_dir, metadata_cache_dir, std::string, "", "Directory of .torrent files shared with other sessions, named by info hash") \
+    V(TR_KEY_metadata_cache_url, metadata_cache_url, std::string, "", "Where to fetch a magnet's .torrent if peers are slow; %s is the info hash") \
+    V(TR_KEY_open_file_limit, open_file_limit, size_t, 32U, "Number of torrent data files to keep open") \
     V(TR_KEY_peer_congestion_algorithm, peer_congestion_algorithm, std::string, "", "") \
+    V(TR_KEY_peer_io_threads, peer_io_threads, size_t, 0U, "Number of threads used to read from peer sockets") \
     V(TR_KEY_peer_limit_global, peer_limit_global, size_t, TR_DEFAULT_PEER_LIMIT_GLOBAL, "") \
     V(TR_KEY_peer_limit_per_torrent, peer_limit_per_torrent, size_t, TR_DEFAULT_PEER_LIMIT_TORRENT, "") \
+    V(TR_KEY_peer_pool_limit_global, peer_pool_limit_global, size_t, 50000U, "Most connectable peers to remember across all torrents; 0 for no limit") \
+    V(TR_KEY_peer_pool_limit_per_torrent, peer_pool_limit_per_torrent, size_t, 2000U, "Most connectable peers to remember per torrent; 0 for no limit") \
     V(TR_KEY_peer_port, peer_port, tr_port, tr_port::fromHost(TR_DEFAULT_PEER_PORT), "The local machine's incoming peer port") \
     V(TR_KEY_peer_port_random_high, peer_port_random_high, tr_port, tr_port::fromHost(65535), "") \
     V(TR_KEY_peer_port_random_low, peer_port_random_low, tr_port, tr_port::fromHost(49152), "") \
     V(TR_KEY_peer_port_random_on_start, peer_port_random_on_start, bool, false, "") \
+    V(TR_KEY_peer_socket_notsent_lowat, peer_socket_notsent_lowat, size_t, 0U, "0 leaves it unset") \
+    V(TR_KEY_peer_socket_receive_buffer, peer_socket_receive_buffer, size_t, 0U, "0 leaves it to the OS") \
+    V(TR_KEY_peer_socket_send_buffer, peer_socket_send_buffer, size_t, 0U, "0 leaves it to the OS") \
     V(TR_KEY_peer_socket_tos, peer_socket_tos, tr_tos_t, 0x04, "") \
     V(TR_KEY_pex_enabled, pex_enabled, bool, true, "") \
+    V(TR_KEY_piece_sync_interval_seconds, piece_sync_interval_seconds, size_t, 0U, "Flush completed pieces to disk together this often, and only save them as done once flushed; 0 leaves flushing to the OS") \
     V(TR_KEY_port_forwarding_enabled, port_forwarding_enabled, bool, true, "") \
     V(TR_KEY_preallocation, preallocation_mode, tr_preallocation_mode, TR_PREALLOCATE_SPARSE, "") \
     V(TR_KEY_prefetch_enabled, is_prefetch_enabled, bool, true, "") \
@@ -52,8 +78,11 @@ struct tr_variant;
     V(TR_KEY_queue_stalled_minutes, queue_stalled_minutes, size_t, 30U, "") \
     V(TR_KEY_ratio_limit, ratio_limit, double, 2.0, "") \
     V(TR_KEY_ratio_limit_enabled, ratio_limit_enabled, bool, false, "") \
+    V(TR_KEY_read_cache_size_mb, read_cache_size_mb, size_t, 8U, "Memory for clean blocks kept for uploading") \
     V(TR_KEY_rename_partial_files, is_incomplete_file_naming_enabled, bool, false, "") \
+    V(TR_KEY_resume_journal_enabled, resume_journal_enabled, bool, false, "Save all torrents' resume data in one file") \
     V(TR_KEY_scrape_paused_torrents_enabled, should_scrape_paused_torrents, bool, true, "") \
+    V(TR_KEY_script_hook_socket, script_hook_socket, std::string, "", "Unix socket of a helper that gets torrent events") \
     V(TR_KEY_script_torrent_added_enabled, script_torrent_added_enabled, bool, false, "") \
     V(TR_KEY_script_torrent_added_filename, script_torrent_added_filename, std::string, "", "") \
     V(TR_KEY_script_torrent_done_enabled, script_torrent_done_enabled, bool, false, "") \
@@ -62,16 +91,19 @@ struct tr_variant;
     V(TR_KEY_script_torrent_done_seeding_filename, script_torrent_done_seeding_filename, std::string, "", "") \
     V(TR_KEY_seed_queue_enabled, seed_queue_enabled, bool, false, "") \
     V(TR_KEY_seed_queue_size, seed_queue_size, size_t, 10U, "") \
+    V(TR_KEY_slow_callback_warning_msec, slow_callback_warning_msec, size_t, 0U, "Log callbacks that block the event loop for longer than this") \
     V(TR_KEY_speed_limit_down, speed_limit_down, size_t, 100U, "") \
     V(TR_KEY_speed_limit_down_enabled, speed_limit_down_enabled, bool, false, "") \
     V(TR_KEY_speed_limit_up, speed_limit_up, size_t, 100U, "") \
     V(TR_KEY_speed_limit_up_enabled, speed_limit_up_enabled, bool, false, "") \
     V(TR_KEY_start_added_torrents, should_start_added_torrents, bool, true, "") \
     V(TR_KEY_tcp_enabled, tcp_enabled, bool, true, "") \
+    V(TR_KEY_tcp_reuseport_enabled, tcp_reuseport_enabled, bool, false, "Listen on one SO_REUSEPORT socket per peer I/O thread") \
     V(TR_KEY_trash_original_torrent_files, should_delete_source_torrents, bool, false, "") \
     V(TR_KEY_umask, umask, tr_mode_t, 022, "") \
     V(TR_KEY_upload_slots_per_torrent, upload_slots_per_torrent, size_t, 8U, "") \
     V(TR_KEY_utp_enabled, utp_enabled, bool, true, "") \
+    V(TR_KEY_verify_threads, verify_threads, size_t, 1U, "Number of threads used to verify local data") \
     V(TR_KEY_torrent_added_verify_mode, torrent_added_verify_mode, tr_verify_added_mode, TR_VERIFY_ADDED_FAST, "")
 
 struct tr_session_settings
@@ -22,6 +22,7 @@
 #include <event2/event.h>
 #include <event2/thread.h>
 
+#include "libtransmission/metrics.h"
 #include "libtransmission/session-thread.h"
 #include "libtransmission/tr-assert.h"
 #include "libtransmission/utils-ev.h"
@@ -130,7 +131,7 @@ auto makeEventBase()
 {
     tr_session_thread::tr_evthread_init();
 
-    return libtransmission::evhelpers::evbase_unique_ptr{ event_base_new() };
+    return libtransmission::evhelpers::make_event_base();
 }
 
 } // namespace
@@ -193,7 +194,7 @@ public:
         return thread_id_ == std::this_thread::get_id();
     }
 
-    void run(std::function<void(void)>&& func) override
+    void run(std::function<void(void)>&& func, tr_source_location where) override
     {
         if (am_in_session_thread())
         {
@@ -202,7 +203,7 @@ public:
         else
         {
             work_queue_mutex_.lock();
-            work_queue_.emplace_back(std::move(func));
+            work_queue_.push_back({ std::move(func), where, std::chrono::steady_clock::now() });
             work_queue_mutex_.unlock();
 
             event_active(work_queue_event_.get(), 0, {});
@@ -210,8 +211,14 @@ public:
     }
 
 private:
-    using callback = std::function<void(void)>;
-    using work_queue_t = std::list<callback>;
+    struct Work
+    {
+        std::function<void(void)> func;
+        tr_source_location where;
+        std::chrono::steady_clock::time_point queued_at;
+    };
+
+    using work_queue_t = std::list<Work>;
 
     void sessionThreadFunc(struct event_base* evbase)
     {
@@ -262,9 +269,16 @@ private:
         work_queue_lock.unlock();
 
         // process the work queue
-        for (auto const& func : work_queue)
+        using namespace std::chrono;
+        auto& metrics = tr_metrics::instance();
+        for (auto const& [func, where, queued_at] : work_queue)
         {
+            auto const started_at = steady_clock::now();
             func();
+            auto const done_at = steady_clock::now();
+
+            metrics.loop_callback_wait.observe(duration_cast<microseconds>(started_at - queued_at));
+            metrics.observe_loop_call(tr_metrics::LoopCall::Callback, where, duration_cast<microseconds>(done_at - started_at));
         }
     }
 
@@ -11,8 +11,8 @@
 
 #include <functional>
 #include <memory>
-#include <tuple>
-#include <utility>
+
+#include "libtransmission/tr-macros.h" // tr_source_location
 
 struct event_base;
 
@@ -28,15 +28,8 @@ public:
 
     [[nodiscard]] virtual bool am_in_session_thread() const noexcept = 0;
 
-    virtual void run(std::function<void(void)>&& func) = 0;
-
-    template<typename Func, typename... Args>
-    void run(Func&& func, Args&&... args)
-    {
-        run(std::function<void(void)>{
-            [func = std::forward<Func&&>(func), args = std::make_tuple(std::forward<Args>(args)...)]()
-            {
-                std::apply(std::move(func), std::move(args));
-            } });
-    }
+    // Run `func` in the session thread. If called from another thread,
+    // it's queued; `where` is used to report callbacks that wait or run
+    // for a long time, e.g. in tr_metrics.
+    virtual void run(std::function<void(void)>&& func, tr_source_location where = tr_source_location::current()) = 0;
 };
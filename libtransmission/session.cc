@@ -4,6 +4,7 @@
 // License text can be found in the licenses/ folder.
 
 #include <algorithm> // std::partial_sort(), std::min(), std::max()
+#include <atomic>
 #include <condition_variable>
 #include <csignal>
 #include <cstddef> // size_t
@@ -20,6 +21,7 @@
 #include <vector>
 
 #ifndef _WIN32
+#include <fcntl.h> /* fcntl() */
 #include <sys/stat.h> /* umask() */
 #endif
 
@@ -37,16 +39,21 @@
 #include "libtransmission/global-ip-cache.h"
 #include "libtransmission/interned-string.h"
 #include "libtransmission/log.h"
+#include "libtransmission/metrics.h"
 #include "libtransmission/net.h"
 #include "libtransmission/peer-mgr.h"
 #include "libtransmission/peer-socket.h"
 #include "libtransmission/port-forwarding.h"
 #include "libtransmission/quark.h"
+#include "libtransmission/resume.h"
+#include "libtransmission/resume-journal.h"
 #include "libtransmission/rpc-server.h"
 #include "libtransmission/session.h"
 #include "libtransmission/session-alt-speeds.h"
 #include "libtransmission/session-settings.h"
-#include "libtransmission/timer-ev.h"
+#include "libtransmission/timer-wheel.h"
+#include "libtransmission/torrent-magnet.h"
+#include "libtransmission/torrent-metainfo.h"
 #include "libtransmission/torrent.h"
 #include "libtransmission/tr-assert.h"
 #include "libtransmission/tr-dht.h"
@@ -264,6 +271,7 @@ std::vector<tr_lpd::Mediator::TorrentInfo> tr_session::LpdMediator::torrents() c
         info.activity = tor->activity();
         info.allows_lpd = tor->allows_lpd();
         info.announce_after = tor->lpdAnnounceAt;
+        info.active_at = tor->activityDate;
         ret.emplace_back(info);
     }
     return ret;
@@ -282,6 +290,39 @@ void tr_session::LpdMediator::setNextAnnounceTime(std::string_view info_hash_str
 
 // ---
 
+int tr_session::PieceSyncerMediator::flush_file(tr_torrent_id_t tor_id, tr_file_index_t file)
+{
+    if (auto const* const tor = session_.torrents_.get(tor_id); tor != nullptr)
+    {
+        return session_.cache->flush_file(tor, file);
+    }
+
+    return 0;
+}
+
+std::optional<std::string> tr_session::PieceSyncerMediator::find_file(tr_torrent_id_t tor_id, tr_file_index_t file) const
+{
+    if (auto const* const tor = session_.torrents_.get(tor_id); tor != nullptr)
+    {
+        if (auto filename = tr_pathbuf{}; tor->find_file_cached(file, filename))
+        {
+            return std::string{ filename.sv() };
+        }
+    }
+
+    return {};
+}
+
+void tr_session::PieceSyncerMediator::on_synced(tr_torrent_id_t tor_id)
+{
+    if (auto* const tor = session_.torrents_.get(tor_id); tor != nullptr)
+    {
+        tor->set_dirty();
+    }
+}
+
+// ---
+
 std::optional<std::string> tr_session::WebMediator::cookieFile() const
 {
     auto const path = tr_pathbuf{ session_->configDir(), "/cookies.txt"sv };
@@ -339,7 +380,7 @@ void tr_session::WebMediator::notifyBandwidthConsumed(int torrent_id, size_t byt
 
 void tr_session::WebMediator::run(tr_web::FetchDoneFunc&& func, tr_web::FetchResponse&& response) const
 {
-    session_->runInSessionThread(std::move(func), std::move(response));
+    session_->runInSessionThread([func = std::move(func), response = std::move(response)]() { func(response); });
 }
 
 time_t tr_session::WebMediator::now() const
@@ -347,6 +388,11 @@ time_t tr_session::WebMediator::now() const
     return tr_time();
 }
 
+tr_dns* tr_session::WebMediator::dns() const
+{
+    return &session_->dns_;
+}
+
 void tr_sessionFetch(tr_session* session, tr_web::FetchOptions&& options)
 {
     session->fetch(std::move(options));
@@ -373,47 +419,128 @@ void tr_sessionSetEncryption(tr_session* session, tr_encryption_mode mode)
 
 void tr_session::onIncomingPeerConnection(tr_socket_t fd, void* vsession)
 {
+    // Drain the backlog in batches so that a burst of connections doesn't overflow
+    // it, without starving the rest of the event loop while the burst lasts
+    static auto constexpr AcceptBudget = size_t{ 64U };
+
     auto* session = static_cast<tr_session*>(vsession);
 
-    if (auto const incoming_info = tr_netAccept(session, fd); incoming_info)
+    auto accepted = tr_netAccept(session, fd, AcceptBudget);
+    for (auto const& [socket_address, sock] : accepted)
     {
-        auto const& [socket_address, sock] = *incoming_info;
         auto const& [addr, port] = socket_address;
         tr_logAddTrace(fmt::format("new incoming connection {} ({})", sock, addr.display_name(port)));
-        session->addIncoming({ session, socket_address, sock });
+    }
+
+    auto add_incoming = [session, accepted = std::move(accepted)]()
+    {
+        for (auto const& [socket_address, sock] : accepted)
+        {
+            session->addIncoming({ session, socket_address, sock });
+        }
+    };
+
+    // listeners on the peer I/O threads hand their connections over to the session thread
+    if (session->am_in_session_thread())
+    {
+        add_incoming();
+    }
+    else if (!std::empty(accepted))
+    {
+        session->runInSessionThread(std::move(add_incoming));
     }
 }
 
 tr_session::BoundSocket::BoundSocket(
-    struct event_base* evbase,
+    std::vector<struct event_base*> const& evbases,
     tr_address const& addr,
     tr_port port,
     IncomingCallback cb,
     void* cb_data)
     : cb_{ cb }
     , cb_data_{ cb_data }
-    , socket_{ tr_netBindTCP(addr, port, false) }
-    , ev_{ event_new(evbase, socket_, EV_READ | EV_PERSIST, &BoundSocket::onCanRead, this) }
 {
-    if (socket_ == TR_BAD_SOCKET)
+    TR_ASSERT(!std::empty(evbases));
+
+    auto reuse_port = std::size(evbases) > 1U;
+
+    for (auto* const evbase : evbases)
+    {
+        auto sock = tr_netBindTCP(addr, port, reuse_port, reuse_port);
+        if (sock == TR_BAD_SOCKET && reuse_port && std::empty(listeners_))
+        {
+            // fall back to a single listener, e.g. if the OS doesn't have SO_REUSEPORT
+            reuse_port = false;
+            sock = tr_netBindTCP(addr, port, false);
+        }
+
+        // A socket that was inherited may not have SO_REUSEPORT,
+        // in which case the others can't share its port
+        if (sock == TR_BAD_SOCKET)
+        {
+            break;
+        }
+
+        auto& listener = listeners_.emplace_back();
+        listener.socket = sock;
+        listener.ev.reset(event_new(evbase, sock, EV_READ | EV_PERSIST, &BoundSocket::onCanRead, this));
+
+        if (!reuse_port)
+        {
+            break;
+        }
+    }
+
+    if (std::empty(listeners_))
     {
         return;
     }
 
-    tr_logAddInfo(
-        fmt::format(_("Listening to incoming peer connections on {hostport}"), fmt::arg("hostport", addr.display_name(port))));
-    event_add(ev_.get(), nullptr);
+    tr_logAddInfo(fmt::format(
+        tr_ngettext(
+            "Listening to incoming peer connections on {hostport}",
+            "Listening to incoming peer connections on {hostport} with {count} sockets",
+            std::size(listeners_)),
+        fmt::arg("hostport", addr.display_name(port)),
+        fmt::arg("count", std::size(listeners_))));
+
+    for (auto const& listener : listeners_)
+    {
+        event_add(listener.ev.get(), nullptr);
+    }
 }
 
 tr_session::BoundSocket::~BoundSocket()
 {
-    ev_.reset();
+    for (auto& listener : listeners_)
+    {
+        listener.ev.reset();
+        tr_net_close_socket(listener.socket);
+    }
+
+    listeners_.clear();
+}
+
+std::vector<struct event_base*> tr_session::listener_event_bases()
+{
+    auto evbases = std::vector<struct event_base*>{};
 
-    if (socket_ != TR_BAD_SOCKET)
+#if HAVE_SO_REUSEPORT
+    if (settings_.tcp_reuseport_enabled && peer_io_threads_)
     {
-        tr_net_close_socket(socket_);
-        socket_ = TR_BAD_SOCKET;
+        for (size_t i = 0, n = peer_io_threads_->size(); i < n; ++i)
+        {
+            evbases.push_back(peer_io_threads_->nth_event_base(i));
+        }
+    }
+#endif
+
+    if (std::empty(evbases))
+    {
+        evbases.push_back(event_base());
     }
+
+    return evbases;
 }
 
 tr_address tr_session::bind_address(tr_address_type type) const noexcept
@@ -597,6 +724,18 @@ tr_session* tr_sessionInit(char const* config_dir, bool message_queueing_enabled
     return session;
 }
 
+void tr_session::onResumeSaveError(tr_torrent_id_t tor_id, int error_code)
+{
+    runInSessionThread(
+        [this, tor_id, error_code]()
+        {
+            if (auto* const tor = torrents().get(tor_id); tor != nullptr)
+            {
+                tor->set_local_error(fmt::format("Unable to save resume file: {:s}", tr_strerror(error_code)));
+            }
+        });
+}
+
 void tr_session::onNowTimer()
 {
     TR_ASSERT(now_timer_);
@@ -605,6 +744,11 @@ void tr_session::onNowTimer()
     // tr_session upkeep tasks to perform once per second
     tr_timeUpdate(std::chrono::system_clock::to_time_t(now));
     alt_speeds_.check_scheduler();
+    Cache::BlockData::pool().release_idle(tr_time());
+    cache->reap_async_writes();
+    cache->flush_aged(tr_time());
+    piece_syncer_.pulse(tr_time());
+    update_memory_budget();
 
     // set the timer to kick again right after (10ms after) the next second
     auto const target_time = std::chrono::time_point_cast<std::chrono::seconds>(now) + 1s + 10ms;
@@ -616,6 +760,106 @@ void tr_session::onNowTimer()
     now_timer_->set_interval(std::chrono::duration_cast<std::chrono::milliseconds>(target_interval));
 }
 
+tr_memory_usage tr_session::memory_usage() const
+{
+    auto usage = tr_memory_usage{};
+    usage.bytes[tr_memory_usage::Cache] = cache->dirty_bytes();
+    usage.bytes[tr_memory_usage::ReadCache] = cache->clean_bytes();
+
+    auto const& pool = Cache::BlockData::pool();
+    usage.bytes[tr_memory_usage::BlockPool] = pool.stats().n_free * pool.buffer_size();
+
+    if (peer_mgr_)
+    {
+        usage.bytes[tr_memory_usage::PeerBuffers] = tr_peerMgrBufferBytes(peer_mgr_.get());
+    }
+
+    for (auto const* const tor : torrents())
+    {
+        if (tor->incomplete_metadata)
+        {
+            usage.bytes[tr_memory_usage::Metadata] += tor->incomplete_metadata->metadata.capacity();
+        }
+    }
+
+    usage.bytes[tr_memory_usage::InfoDicts] = info_dict_cache_.bytes();
+
+    return usage;
+}
+
+void tr_session::update_memory_budget()
+{
+    using Pressure = tr_memory_budget::Pressure;
+
+    auto const old_pressure = memory_budget_.pressure();
+    auto const pressure = memory_budget_.update(memory_usage());
+
+    if (pressure != old_pressure)
+    {
+        auto message = fmt::format(
+            _("Using {used} of the {budget} memory budget; memory pressure is now {pressure}"),
+            fmt::arg("used", tr_formatter_mem_B(memory_budget_.usage().total())),
+            fmt::arg("budget", tr_formatter_mem_B(memory_budget_.limit())),
+            fmt::arg("pressure", tr_memory_budget::name(pressure)));
+        if (pressure > old_pressure)
+        {
+            tr_logAddWarn(std::move(message));
+        }
+        else
+        {
+            tr_logAddInfo(std::move(message));
+        }
+
+        update_cache_limits();
+    }
+
+    if (pressure == Pressure::None || !peer_mgr_)
+    {
+        return;
+    }
+
+    // New peers are refused while under pressure; see tr_memory_budget::is_refusing_peers().
+    // Spare buffers are cheap to lose, so give them back right away.
+    Cache::BlockData::pool().release_all();
+    tr_peerMgrReleaseBuffers(peer_mgr_.get());
+    info_dict_cache_.clear();
+
+    if (pressure == Pressure::Critical)
+    {
+        if (auto const n = tr_peerMgrHibernateIdleSeeds(peer_mgr_.get()); n != 0U)
+        {
+            tr_logAddInfo(fmt::format(
+                tr_ngettext("Hibernated {count} idle seed to save memory", "Hibernated {count} idle seeds to save memory", n),
+                fmt::arg("count", n)));
+        }
+    }
+}
+
+void tr_session::update_cache_limits()
+{
+    auto dirty_bytes = tr_toMemBytes(settings_.cache_size_mb);
+    auto clean_bytes = tr_toMemBytes(settings_.read_cache_size_mb);
+
+    switch (memory_budget_.pressure())
+    {
+    case tr_memory_budget::Pressure::High:
+        dirty_bytes /= 2U;
+        clean_bytes /= 2U;
+        break;
+
+    case tr_memory_budget::Pressure::Critical:
+        dirty_bytes /= 4U;
+        clean_bytes = 0U;
+        break;
+
+    default:
+        break;
+    }
+
+    cache->set_limit(dirty_bytes);
+    cache->set_read_limit(clean_bytes);
+}
+
 void tr_session::initImpl(init_data& data)
 {
     auto lock = unique_lock();
@@ -639,11 +883,15 @@ void tr_session::initImpl(init_data& data)
     tr_logSetQueueEnabled(data.message_queuing_enabled);
 
     this->blocklists_ = libtransmission::Blocklist::loadBlocklists(blocklist_dir_, useBlocklist());
+    mergeBlocklists();
 
     tr_logAddInfo(fmt::format(_("Transmission version {version} starting"), fmt::arg("version", LONG_VERSION_STRING)));
 
     setSettings(client_settings, true);
 
+    // the peer sockets that were handed over and are now in use were taken
+    tr_net_close_inherited_sockets();
+
     if (this->allowsLPD())
     {
         this->lpd_ = tr_lpd::create(lpd_mediator_, event_base());
@@ -693,11 +941,131 @@ void tr_session::setSettings(tr_session_settings&& settings_in, bool force)
     }
 #endif
 
+    if (new_settings.download_queue_enabled != old_settings.download_queue_enabled ||
+        new_settings.seed_queue_enabled != old_settings.seed_queue_enabled)
+    {
+        torrents().recount_activity();
+    }
+
+    if (auto const& val = new_settings.direct_io_enabled; force || val != old_settings.direct_io_enabled)
+    {
+        cache->set_direct_io(val);
+    }
+
+    if (auto const& val = new_settings.cache_async_writes; force || val != old_settings.cache_async_writes)
+    {
+        cache->set_async_writes(val);
+    }
+
+    if (auto const& val = new_settings.io_trace_file; force || val != old_settings.io_trace_file)
+    {
+        cache->set_trace_file(val);
+    }
+
+    if (auto const& val = new_settings.piece_sync_interval_seconds;
+        force || val != old_settings.piece_sync_interval_seconds)
+    {
+        piece_syncer_.set_interval(static_cast<time_t>(val));
+    }
+
+    if (force || new_settings.background_io_limit_kbps != old_settings.background_io_limit_kbps ||
+        new_settings.background_io_limit_iops != old_settings.background_io_limit_iops)
+    {
+        io_scheduler_.set_limits({ tr_toSpeedBytes(new_settings.background_io_limit_kbps),
+                                   new_settings.background_io_limit_iops });
+    }
+
     if (auto const& val = new_settings.cache_size_mb; force || val != old_settings.cache_size_mb)
     {
         tr_sessionSetCacheLimit_MB(this, val);
     }
 
+    if (auto const& val = new_settings.read_cache_size_mb; force || val != old_settings.read_cache_size_mb)
+    {
+        update_cache_limits();
+    }
+
+    if (auto const& val = new_settings.local_data_reuse_enabled; force || val != old_settings.local_data_reuse_enabled)
+    {
+        local_data_index_.set_enabled(val, torrents_);
+    }
+
+    if (auto const& val = new_settings.memory_budget_mb; force || val != old_settings.memory_budget_mb)
+    {
+        memory_budget_.set_limit(tr_toMemBytes(val));
+        update_cache_limits();
+    }
+
+    if (auto const& val = new_settings.open_file_limit; force || val != old_settings.open_file_limit)
+    {
+        open_files_.set_max_open_files(val);
+    }
+
+    if (auto const& val = new_settings.resume_journal_enabled; force || val != old_settings.resume_journal_enabled)
+    {
+        if (val && !resume_journal_)
+        {
+            resume_journal_ = std::make_unique<tr_resume_journal>(std::string{ tr_pathbuf{ resume_dir_, "/resume.journal"sv }.sv() });
+        }
+        else if (!val && resume_journal_)
+        {
+            // Go back to .resume files. Remove the journal so that its
+            // records can't shadow newer .resume files if it's reenabled.
+            auto const filename = resume_journal_->filename();
+            resume_journal_.reset();
+            for (auto* const tor : torrents())
+            {
+                tr_resume::save(tor);
+            }
+            resume_writer_.wait(); // keep the journal until they're on disk
+            tr_sys_path_remove(filename);
+        }
+    }
+
+    if (auto const& val = new_settings.script_hook_socket; force || val != old_settings.script_hook_socket)
+    {
+        script_hook_.reset();
+        if (!std::empty(val))
+        {
+            script_hook_ = std::make_unique<tr_script_hook>(event_base(), timerMaker(), val);
+        }
+    }
+
+    if (auto const& val = new_settings.peer_io_threads; force || val != old_settings.peer_io_threads)
+    {
+        // Existing peers keep the event base they were created with,
+        // so the pool is only created once and changes need a restart.
+        if (!peer_io_threads_ && val > 0U)
+        {
+            peer_io_threads_ = std::make_unique<tr_peer_io_threads>(val);
+        }
+    }
+
+    if (force || new_settings.executor_threads != old_settings.executor_threads ||
+        new_settings.executor_cpu_affinity != old_settings.executor_cpu_affinity)
+    {
+        // The worker threads are only started once, so changes need a restart.
+        executor_.start(new_settings.executor_threads, tr_num_parse_range(new_settings.executor_cpu_affinity));
+    }
+
+    if (auto const& val = new_settings.lan_peer_networks; force || val != old_settings.lan_peer_networks)
+    {
+        lan_subnets_ = std::empty(val) ? tr_subnet::lan_defaults() : tr_subnet::list_from_string(val);
+    }
+
+    if (auto const& val = new_settings.slow_callback_warning_msec; force || val != old_settings.slow_callback_warning_msec)
+    {
+        tr_metrics::instance().set_slow_call_warning(std::chrono::milliseconds{ val });
+    }
+
+    if (auto const& val = new_settings.verify_threads; force || val != old_settings.verify_threads)
+    {
+        if (verifier_)
+        {
+            verifier_->set_max_threads(val);
+        }
+    }
+
     if (auto const& val = new_settings.bind_address_ipv4; force || val != old_settings.bind_address_ipv4)
     {
         global_ip_cache_->update_addr(TR_AF_INET);
@@ -731,17 +1099,21 @@ void tr_session::setSettings(tr_session_settings&& settings_in, bool force)
     bool addr_changed = false;
     if (new_settings.tcp_enabled)
     {
-        if (auto const& val = new_settings.bind_address_ipv4; force || port_changed || val != old_settings.bind_address_ipv4)
+        auto const listeners_changed = new_settings.tcp_reuseport_enabled != old_settings.tcp_reuseport_enabled;
+
+        if (auto const& val = new_settings.bind_address_ipv4;
+            force || port_changed || listeners_changed || val != old_settings.bind_address_ipv4)
         {
             auto const addr = bind_address(TR_AF_INET);
-            bound_ipv4_.emplace(event_base(), addr, local_peer_port_, &tr_session::onIncomingPeerConnection, this);
+            bound_ipv4_.emplace(listener_event_bases(), addr, local_peer_port_, &tr_session::onIncomingPeerConnection, this);
             addr_changed = true;
         }
 
-        if (auto const& val = new_settings.bind_address_ipv6; force || port_changed || val != old_settings.bind_address_ipv6)
+        if (auto const& val = new_settings.bind_address_ipv6;
+            force || port_changed || listeners_changed || val != old_settings.bind_address_ipv6)
         {
             auto const addr = bind_address(TR_AF_INET6);
-            bound_ipv6_.emplace(event_base(), addr, local_peer_port_, &tr_session::onIncomingPeerConnection, this);
+            bound_ipv6_.emplace(listener_event_bases(), addr, local_peer_port_, &tr_session::onIncomingPeerConnection, this);
             addr_changed = true;
         }
     }
@@ -771,7 +1143,8 @@ void tr_session::setSettings(tr_session_settings&& settings_in, bool force)
 
     // Sends out announce messages with advertisedPeerPort(), so this
     // section needs to happen here after the peer port settings changes
-    if (auto const& val = new_settings.lpd_enabled; force || val != old_settings.lpd_enabled)
+    if (auto const& val = new_settings.lpd_enabled;
+        force || val != old_settings.lpd_enabled || new_settings.lpd_cluster_mode != old_settings.lpd_cluster_mode)
     {
         if (val)
         {
@@ -1256,8 +1629,18 @@ void tr_session::closeImplPart1(std::promise<void>* closed_promise, std::chrono:
     // close the low-hanging fruit that can be closed immediately w/o consequences
     utp_timer.reset();
     verifier_.reset();
+    piece_hasher_.reset();
+    mse_worker_.reset();
+    file_mover_.reset();
+    preallocator_.reset();
     save_timer_.reset();
     now_timer_.reset();
+
+    // RPC's background work answers through rpc_server_, so finish it
+    // first. Its answers are dropped from now on.
+    blocklist_import_queue_.cancel();
+    blocklist_import_queue_.wait();
+    rpc_parse_queue_.wait();
     rpc_server_.reset();
     dht_.reset();
     lpd_.reset();
@@ -1266,6 +1649,9 @@ void tr_session::closeImplPart1(std::promise<void>* closed_promise, std::chrono:
     bound_ipv6_.reset();
     bound_ipv4_.reset();
 
+    // make the completed pieces durable so that they're saved as done
+    piece_syncer_.sync_all();
+
     // Close the torrents in order of most active to least active
     // so that the most important announce=stopped events are
     // fired out first...
@@ -1284,6 +1670,12 @@ void tr_session::closeImplPart1(std::promise<void>* closed_promise, std::chrono:
         tr_torrentFreeInSessionThread(tor);
     }
     torrents.clear();
+    if (resume_journal_)
+    {
+        resume_journal_->flush();
+    }
+    resume_writer_.wait();
+    script_hook_.reset();
     // ...now that all the torrents have been closed, any remaining
     // `&event=stopped` announce messages are queued in the announcer.
     // Tell the announcer to start shutdown, which sends out the stop
@@ -1324,6 +1716,7 @@ void tr_session::closeImplPart2(std::promise<void>* closed_promise, std::chrono:
 
     stats().save();
     peer_mgr_.reset();
+    peer_io_threads_.reset();
     openFiles().close_all();
     tr_utpClose(this);
     this->udp_core_.reset();
@@ -1348,46 +1741,139 @@ void tr_sessionClose(tr_session* session, size_t timeout_secs)
     delete session;
 }
 
+#ifndef _WIN32
+
+size_t tr_sessionGetPeerSockets(tr_session* session, int* setme, size_t max_n)
+{
+    TR_ASSERT(session != nullptr);
+    TR_ASSERT(!session->am_in_session_thread());
+
+    auto n = size_t{};
+    auto done_promise = std::promise<void>{};
+    auto done_future = done_promise.get_future();
+    session->runInSessionThread(
+        [session, setme, max_n, &n, &done_promise]()
+        {
+            for (auto const* const bound : { &session->bound_ipv4_, &session->bound_ipv6_ })
+            {
+                if (n < max_n && bound->has_value() && (*bound)->socket() != TR_BAD_SOCKET)
+                {
+                    if (auto const fd = fcntl((*bound)->socket(), F_DUPFD_CLOEXEC, 0); fd != -1)
+                    {
+                        setme[n++] = fd;
+                    }
+                }
+            }
+
+            done_promise.set_value();
+        });
+    done_future.wait();
+
+    return n;
+}
+
+void tr_sessionAddInheritedPeerSockets(int const* sockets, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+    {
+        tr_net_add_inherited_socket(sockets[i]);
+    }
+}
+
+#endif
+
 namespace
 {
 namespace load_torrents_helpers
 {
-void session_load_torrents(tr_session* session, tr_ctor* ctor, std::promise<size_t>* loaded_promise)
+// How many torrents to add per trip to the session thread. Between
+// batches, the session thread is free to answer RPC requests.
+auto constexpr AddBatchSize = size_t{ 64U };
+
+struct ParsedTorrent
 {
-    auto n_torrents = size_t{};
-    auto const& folder = session->torrentDir();
+    std::string filename;
+    std::vector<char> contents;
+    tr_torrent_metainfo metainfo;
+    bool is_valid = false;
 
-    for (auto const& name : tr_sys_dir_get_files(folder, [](auto name) { return tr_strv_ends_with(name, ".torrent"sv); }))
-    {
-        auto const path = tr_pathbuf{ folder, '/', name };
+    std::string resume_filename;
+    std::vector<char> resume_contents;
+};
 
-        if (tr_ctorSetMetainfoFromFile(ctor, path.sv(), nullptr) && tr_torrentNew(ctor, nullptr) != nullptr)
-        {
-            ++n_torrents;
-        }
+// Read and parse the .torrent files and read their resume files in the
+// executor. None of that needs the session, so it can all happen in parallel.
+// `resume_dir` is empty if the resume files shouldn't be read.
+[[nodiscard]] std::vector<ParsedTorrent> parse_torrent_files(
+    tr_executor& executor,
+    std::string_view folder,
+    std::string_view resume_dir,
+    std::vector<std::string> const& names)
+{
+    auto const n_names = std::size(names);
+    auto parsed = std::vector<ParsedTorrent>(n_names);
+    if (n_names == 0U)
+    {
+        return parsed;
     }
 
-    auto buf = std::vector<char>{};
-    for (auto const& name : tr_sys_dir_get_files(folder, [](auto name) { return tr_strv_ends_with(name, ".magnet"sv); }))
+    auto next = std::atomic<size_t>{};
+    auto const parse_next = [&]()
     {
-        auto const path = tr_pathbuf{ folder, '/', name };
-
-        if (tr_file_read(path, buf) &&
-            tr_ctorSetMetainfoFromMagnetLink(ctor, std::string_view{ std::data(buf), std::size(buf) }, nullptr) &&
-            tr_torrentNew(ctor, nullptr) != nullptr)
+        for (auto idx = next++; idx < n_names; idx = next++)
         {
-            ++n_torrents;
+            auto& item = parsed[idx];
+            item.filename = tr_pathbuf{ folder, '/', names[idx] }.sv();
+            if (!tr_file_read(item.filename, item.contents) ||
+                !item.metainfo.parse_benc({ std::data(item.contents), std::size(item.contents) }))
+            {
+                continue;
+            }
+
+            item.is_valid = true;
+
+            if (std::empty(resume_dir))
+            {
+                continue;
+            }
+
+            if (auto const resume_filename = item.metainfo.resume_file(resume_dir);
+                tr_sys_path_exists(resume_filename) && tr_file_read(resume_filename, item.resume_contents))
+            {
+                item.resume_filename = resume_filename.sv();
+            }
         }
-    }
+    };
 
-    if (n_torrents != 0U)
+    // this thread parses too, so it's one more than the executor's threads
+    auto const n_tasks = std::min(n_names - 1U, executor.thread_count());
+    auto tasks = std::vector<std::future<void>>{};
+    tasks.reserve(n_tasks);
+    for (size_t i = 0U; i < n_tasks; ++i)
     {
-        tr_logAddInfo(fmt::format(
-            tr_ngettext("Loaded {count} torrent", "Loaded {count} torrents", n_torrents),
-            fmt::arg("count", n_torrents)));
+        tasks.emplace_back(executor.async(parse_next));
+    }
+    parse_next();
+    for (auto& task : tasks)
+    {
+        task.wait();
     }
 
-    loaded_promise->set_value(n_torrents);
+    return parsed;
+}
+
+template<typename Func>
+void run_in_session_thread_and_wait(tr_session* session, Func&& func)
+{
+    auto promise = std::promise<void>{};
+    auto future = promise.get_future();
+    session->runInSessionThread(
+        [&func, &promise]()
+        {
+            func();
+            promise.set_value();
+        });
+    future.wait();
 }
 } // namespace load_torrents_helpers
 } // namespace
@@ -1396,12 +1882,68 @@ size_t tr_sessionLoadTorrents(tr_session* session, tr_ctor* ctor)
 {
     using namespace load_torrents_helpers;
 
-    auto loaded_promise = std::promise<size_t>{};
-    auto loaded_future = loaded_promise.get_future();
+    auto n_torrents = size_t{};
+    auto const& folder = session->torrentDir();
+
+    auto const torrent_names = tr_sys_dir_get_files(folder, [](auto name) { return tr_strv_ends_with(name, ".torrent"sv); });
+    // if there's a journal, it already has the resume data
+    auto const resume_dir = session->resume_journal() == nullptr ? std::string_view{ session->resumeDir() } : std::string_view{};
+    auto parsed = parse_torrent_files(session->executor(), folder, resume_dir, torrent_names);
 
-    session->runInSessionThread(session_load_torrents, session, ctor, &loaded_promise);
-    loaded_future.wait();
-    auto const n_torrents = loaded_future.get();
+    for (size_t begin = 0U, n_parsed = std::size(parsed); begin < n_parsed; begin += AddBatchSize)
+    {
+        auto const end = std::min(begin + AddBatchSize, n_parsed);
+        run_in_session_thread_and_wait(
+            session,
+            [&]()
+            {
+                for (auto idx = begin; idx < end; ++idx)
+                {
+                    auto& item = parsed[idx];
+                    if (!item.is_valid)
+                    {
+                        continue;
+                    }
+
+                    tr_ctorSetMetainfo(ctor, std::move(item.metainfo), std::move(item.contents), item.filename);
+                    if (!std::empty(item.resume_filename))
+                    {
+                        tr_ctorSetResumeContents(ctor, item.resume_filename, std::move(item.resume_contents));
+                    }
+
+                    if (tr_torrentNew(ctor, nullptr) != nullptr)
+                    {
+                        ++n_torrents;
+                    }
+                }
+            });
+    }
+
+    run_in_session_thread_and_wait(
+        session,
+        [&]()
+        {
+            auto buf = std::vector<char>{};
+            for (auto const& name :
+                 tr_sys_dir_get_files(folder, [](auto name) { return tr_strv_ends_with(name, ".magnet"sv); }))
+            {
+                auto const path = tr_pathbuf{ folder, '/', name };
+
+                if (tr_file_read(path, buf) &&
+                    tr_ctorSetMetainfoFromMagnetLink(ctor, std::string_view{ std::data(buf), std::size(buf) }, nullptr) &&
+                    tr_torrentNew(ctor, nullptr) != nullptr)
+                {
+                    ++n_torrents;
+                }
+            }
+        });
+
+    if (n_torrents != 0U)
+    {
+        tr_logAddInfo(fmt::format(
+            tr_ngettext("Loaded {count} torrent", "Loaded {count} torrents", n_torrents),
+            fmt::arg("count", n_torrents)));
+    }
 
     return n_torrents;
 }
@@ -1518,7 +2060,7 @@ void tr_sessionSetCacheLimit_MB(tr_session* session, size_t mb)
     TR_ASSERT(session != nullptr);
 
     session->settings_.cache_size_mb = mb;
-    session->cache->set_limit(tr_toMemBytes(mb));
+    session->update_cache_limits();
 }
 
 size_t tr_sessionGetCacheLimit_MB(tr_session const* session)
@@ -1604,19 +2146,38 @@ void tr_session::useBlocklist(bool enabled)
         std::begin(blocklists_),
         std::end(blocklists_),
         [enabled](auto& blocklist) { blocklist.setEnabled(enabled); });
+
+    mergeBlocklists();
+}
+
+void tr_session::mergeBlocklists()
+{
+    // only load the rules if they're going to be used
+    merged_blocklist_ = useBlocklist() ? libtransmission::MergedBlocklist{ blocklists_ } :
+                                         libtransmission::MergedBlocklist{};
 }
 
 bool tr_session::addressIsBlocked(tr_address const& addr) const noexcept
 {
-    return std::any_of(
-        std::begin(blocklists_),
-        std::end(blocklists_),
-        [&addr](auto& blocklist) { return blocklist.contains(addr); });
+    return useBlocklist() && merged_blocklist_.contains(addr);
+}
+
+void tr_session::addressesAreBlocked(tr_address const* addrs, size_t n_addrs, bool* setme) const noexcept
+{
+    if (useBlocklist())
+    {
+        merged_blocklist_.contains(addrs, n_addrs, setme);
+    }
+    else
+    {
+        std::fill_n(setme, n_addrs, false);
+    }
 }
 
 void tr_sessionReloadBlocklists(tr_session* session)
 {
     session->blocklists_ = libtransmission::Blocklist::loadBlocklists(session->blocklist_dir_, session->useBlocklist());
+    session->mergeBlocklists();
 
     session->blocklist_changed_.emit();
 }
@@ -1666,23 +2227,30 @@ size_t tr_blocklistSetContent(tr_session* session, char const* content_filename)
     }
 
     auto const n_rules = std::size(*added);
+    session->setDefaultBlocklist(std::move(*added));
+    return n_rules;
+}
+
+void tr_session::setDefaultBlocklist(libtransmission::Blocklist&& blocklist)
+{
+    blocklist.setEnabled(useBlocklist());
 
     // Add (or replace) it in our blocklists_ vector
-    auto& src = session->blocklists_;
+    auto& src = blocklists_;
     if (auto iter = std::find_if(
             std::begin(src),
             std::end(src),
-            [&bin_file](auto const& candidate) { return bin_file == candidate.binFile(); });
+            [&blocklist](auto const& candidate) { return blocklist.binFile() == candidate.binFile(); });
         iter != std::end(src))
     {
-        *iter = std::move(*added);
+        *iter = std::move(blocklist);
     }
     else
     {
-        src.emplace_back(std::move(*added));
+        src.emplace_back(std::move(blocklist));
     }
 
-    return n_rules;
+    mergeBlocklists();
 }
 
 void tr_blocklistSetURL(tr_session* session, char const* url)
@@ -1893,6 +2461,9 @@ void tr_sessionSetQueueEnabled(tr_session* session, tr_direction dir, bool do_li
     {
         session->settings_.seed_queue_enabled = do_limit_simultaneous_torrents;
     }
+
+    // queued torrents' activity depends on whether their queue is enabled
+    session->runInSessionThread([session]() { session->torrents().recount_activity(); });
 }
 
 bool tr_sessionGetQueueEnabled(tr_session const* session, tr_direction dir)
@@ -1969,29 +2540,21 @@ std::vector<tr_torrent*> tr_session::getNextQueuedTorrents(tr_direction dir, siz
 {
     TR_ASSERT(tr_isDirection(dir));
 
-    // build an array of the candidates
+    // the queue is kept in order, so take the first matches
     auto candidates = std::vector<tr_torrent*>{};
-    candidates.reserve(std::size(torrents()));
-    for (auto* const tor : torrents())
+    for (auto* const tor : torrents().queue())
     {
+        if (std::size(candidates) >= num_wanted)
+        {
+            break;
+        }
+
         if (tor->is_queued() && (dir == tor->queue_direction()))
         {
             candidates.push_back(tor);
         }
     }
 
-    // find the best n candidates
-    num_wanted = std::min(num_wanted, std::size(candidates));
-    if (num_wanted < candidates.size())
-    {
-        std::partial_sort(
-            std::begin(candidates),
-            std::begin(candidates) + num_wanted,
-            std::end(candidates),
-            [](auto const* a, auto const* b) { return tr_torrentGetQueuePosition(a) < tr_torrentGetQueuePosition(b); });
-        candidates.resize(num_wanted);
-    }
-
     return candidates;
 }
 
@@ -2038,16 +2601,40 @@ size_t tr_session::countQueueFreeSlots(tr_direction dir) const noexcept
 
 // ---
 
+void tr_session::hashPiece(tr_piece_hasher::Data&& data, tr_sha1_digest_t const& expected, tr_piece_hasher::DoneFunc&& on_done)
+{
+    if (piece_hasher_)
+    {
+        piece_hasher_->add(std::move(data), expected, std::move(on_done));
+    }
+    else
+    {
+        on_done(tr_sha1::digest(data) == expected);
+    }
+}
+
+size_t tr_session::peer_count() const noexcept
+{
+    return tr_peerMgrPeerCount(peer_mgr_.get());
+}
+
 void tr_session::closeTorrentFiles(tr_torrent* tor) noexcept
 {
     this->cache->flush_torrent(tor);
     openFiles().close_torrent(tor->id());
+    tor->forget_found_files();
+
+    if (auto const storage = tor->storage(); storage)
+    {
+        storage->flush(tor);
+    }
 }
 
 void tr_session::closeTorrentFile(tr_torrent* tor, tr_file_index_t file_num) noexcept
 {
     this->cache->flush_file(tor, file_num);
     openFiles().close_file(tor->id(), file_num);
+    tor->forget_found_file(file_num);
 }
 
 // ---
@@ -2133,7 +2720,7 @@ tr_session::tr_session(std::string_view config_dir, tr_variant* settings_dict)
     , torrent_dir_{ makeTorrentDir(config_dir) }
     , blocklist_dir_{ makeBlocklistDir(config_dir) }
     , session_thread_{ tr_session_thread::create() }
-    , timer_maker_{ std::make_unique<libtransmission::EvTimerMaker>(event_base()) }
+    , timer_maker_{ std::make_unique<libtransmission::WheelTimerMaker>(event_base()) }
     , settings_{ settings_dict }
     , session_id_{ tr_time }
     , peer_mgr_{ tr_peerMgrNew(this), &tr_peerMgrFree }
@@ -2153,6 +2740,13 @@ tr_session::tr_session(std::string_view config_dir, tr_variant* settings_dict)
                 tr_torrentSave(tor);
             }
 
+            if (resume_journal_)
+            {
+                resume_journal_->flush();
+            }
+
+            resume_writer_.flush();
+
             stats().save();
         });
     save_timer_->start_repeating(SaveIntervalSecs);
@@ -11,6 +11,7 @@
 
 #define TR_NAME "Transmission"
 
+#include <algorithm>
 #include <array>
 #include <atomic>
 #include <chrono>
@@ -43,18 +44,37 @@
 #include "libtransmission/bandwidth.h"
 #include "libtransmission/blocklist.h"
 #include "libtransmission/cache.h"
+#include "libtransmission/capacity-monitor.h"
+#include "libtransmission/dns.h"
+#include "libtransmission/executor.h"
+#include "libtransmission/file-mover.h"
 #include "libtransmission/global-ip-cache.h"
 #include "libtransmission/interned-string.h"
+#include "libtransmission/info-dict-cache.h"
+#include "libtransmission/io-scheduler.h"
+#include "libtransmission/local-data-index.h"
+#include "libtransmission/memory-budget.h"
 #include "libtransmission/net.h" // tr_socket_t
 #include "libtransmission/observable.h"
 #include "libtransmission/open-files.h"
+#include "libtransmission/peer-io-threads.h"
+#include "libtransmission/piece-hash-cache.h"
+#include "libtransmission/peer-mse-worker.h"
+#include "libtransmission/piece-hasher.h"
+#include "libtransmission/piece-syncer.h"
 #include "libtransmission/port-forwarding.h"
+#include "libtransmission/preallocator.h"
 #include "libtransmission/quark.h"
+#include "libtransmission/resume-journal.h"
+#include "libtransmission/resume-writer.h"
+#include "libtransmission/rpc-deltas.h"
+#include "libtransmission/script-hook.h"
 #include "libtransmission/session-alt-speeds.h"
 #include "libtransmission/session-id.h"
 #include "libtransmission/session-settings.h"
 #include "libtransmission/session-thread.h"
 #include "libtransmission/stats.h"
+#include "libtransmission/storage.h"
 #include "libtransmission/torrents.h"
 #include "libtransmission/tr-assert.h"
 #include "libtransmission/tr-dht.h"
@@ -66,6 +86,7 @@
 
 tr_peer_id_t tr_peerIdInit();
 
+class tr_peerIo;
 class tr_peer_socket;
 struct tr_pex;
 class tr_rpc_server;
@@ -94,14 +115,33 @@ private:
     {
     public:
         using IncomingCallback = void (*)(tr_socket_t, void*);
-        BoundSocket(struct event_base* base, tr_address const& addr, tr_port port, IncomingCallback cb, void* cb_data);
+
+        // Listens on a socket per event base. If there are several, they're bound
+        // with SO_REUSEPORT and the kernel spreads the incoming connections across them.
+        BoundSocket(
+            std::vector<struct event_base*> const& evbases,
+            tr_address const& addr,
+            tr_port port,
+            IncomingCallback cb,
+            void* cb_data);
         BoundSocket(BoundSocket&&) = delete;
         BoundSocket(BoundSocket const&) = delete;
         BoundSocket operator=(BoundSocket&&) = delete;
         BoundSocket operator=(BoundSocket const&) = delete;
         ~BoundSocket();
 
+        [[nodiscard]] auto socket() const noexcept
+        {
+            return std::empty(listeners_) ? TR_BAD_SOCKET : listeners_.front().socket;
+        }
+
     private:
+        struct Listener
+        {
+            tr_socket_t socket = TR_BAD_SOCKET;
+            libtransmission::evhelpers::event_unique_ptr ev;
+        };
+
         static void onCanRead(evutil_socket_t fd, short /*what*/, void* vself)
         {
             auto* const self = static_cast<BoundSocket*>(vself);
@@ -110,8 +150,7 @@ private:
 
         IncomingCallback cb_;
         void* cb_data_;
-        tr_socket_t socket_ = TR_BAD_SOCKET;
-        libtransmission::evhelpers::event_unique_ptr ev_;
+        std::vector<Listener> listeners_;
     };
 
     class AltSpeedMediator final : public tr_session_alt_speeds::Mediator
@@ -157,6 +196,11 @@ private:
             return tr_address::from_string(session_.announceIP());
         }
 
+        [[nodiscard]] tr_dns& dns() override
+        {
+            return session_.dns_;
+        }
+
     private:
         tr_session& session_;
     };
@@ -185,6 +229,11 @@ private:
             return session_.timerMaker();
         }
 
+        [[nodiscard]] tr_dns& dns() override
+        {
+            return session_.dns_;
+        }
+
         void add_pex(tr_sha1_digest_t const&, tr_pex const* pex, size_t n_pex) override;
 
     private:
@@ -241,6 +290,7 @@ private:
         [[nodiscard]] std::optional<std::string_view> userAgent() const override;
         [[nodiscard]] size_t clamp(int torrent_id, size_t byte_count) const override;
         [[nodiscard]] time_t now() const override;
+        [[nodiscard]] tr_dns* dns() const override;
         void notifyBandwidthConsumed(int torrent_id, size_t byte_count) override;
         // runs the tr_web::fetch response callback in the libtransmission thread
         void run(tr_web::FetchDoneFunc&& func, tr_web::FetchResponse&& response) const override;
@@ -272,6 +322,11 @@ private:
             return session_.allowsLPD();
         }
 
+        [[nodiscard]] bool isClusterMode() const override
+        {
+            return session_.settings_.lpd_cluster_mode;
+        }
+
         [[nodiscard]] libtransmission::TimerMaker& timerMaker() override
         {
             return session_.timerMaker();
@@ -323,6 +378,73 @@ private:
         tr_session& session_;
     };
 
+    class PieceHasherMediator final : public tr_piece_hasher::Mediator
+    {
+    public:
+        explicit PieceHasherMediator(tr_session& session) noexcept
+            : session_{ session }
+        {
+        }
+
+        void post(std::function<void(void)>&& func) override
+        {
+            session_.runInSessionThread(std::move(func));
+        }
+
+    private:
+        tr_session& session_;
+    };
+
+    class PieceSyncerMediator final : public tr_piece_syncer::Mediator
+    {
+    public:
+        explicit PieceSyncerMediator(tr_session& session) noexcept
+            : session_{ session }
+        {
+        }
+
+        int flush_file(tr_torrent_id_t tor_id, tr_file_index_t file) override;
+        [[nodiscard]] std::optional<std::string> find_file(tr_torrent_id_t tor_id, tr_file_index_t file) const override;
+        void on_synced(tr_torrent_id_t tor_id) override;
+
+    private:
+        tr_session& session_;
+    };
+
+    class MseWorkerMediator final : public tr_mse_worker::Mediator
+    {
+    public:
+        explicit MseWorkerMediator(tr_session& session) noexcept
+            : session_{ session }
+        {
+        }
+
+        void post(std::function<void(void)>&& func) override
+        {
+            session_.runInSessionThread(std::move(func));
+        }
+
+    private:
+        tr_session& session_;
+    };
+
+    class FileMoverMediator final : public tr_file_mover::Mediator
+    {
+    public:
+        explicit FileMoverMediator(tr_session& session) noexcept
+            : session_{ session }
+        {
+        }
+
+        void post(std::function<void(void)>&& func) override
+        {
+            session_.runInSessionThread(std::move(func));
+        }
+
+    private:
+        tr_session& session_;
+    };
+
     // UDP connectivity used for the DHT and µTP
     class tr_udp_core
     {
@@ -330,7 +452,9 @@ private:
         tr_udp_core(tr_session& session, tr_port udp_port);
         ~tr_udp_core();
 
-        void sendto(void const* buf, size_t buflen, struct sockaddr const* to, socklen_t tolen) const;
+        // Where the platform supports it, datagrams are queued and sent
+        // in a batch once the current event loop callbacks are done.
+        void sendto(void const* buf, size_t buflen, struct sockaddr const* to, socklen_t tolen);
 
         [[nodiscard]] constexpr auto socket4() const noexcept
         {
@@ -343,12 +467,24 @@ private:
         }
 
     private:
+        // Buffers for reading and writing several datagrams per syscall
+        struct Batch;
+
+        static void on_readable(evutil_socket_t sock, short type, void* vself);
+        static void on_flush(evutil_socket_t sock, short type, void* vself);
+
+        void read_datagrams(tr_socket_t sock);
+        void send_now(void const* buf, size_t buflen, struct sockaddr const* to, socklen_t tolen) const;
+        void flush_sends();
+
         tr_port const udp_port_;
         tr_session& session_;
         tr_socket_t udp4_socket_ = TR_BAD_SOCKET;
         tr_socket_t udp6_socket_ = TR_BAD_SOCKET;
+        std::unique_ptr<Batch> batch_;
         libtransmission::evhelpers::event_unique_ptr udp4_event_;
         libtransmission::evhelpers::event_unique_ptr udp6_event_;
+        libtransmission::evhelpers::event_unique_ptr flush_event_;
     };
 
 public:
@@ -369,20 +505,22 @@ public:
         return session_thread_->am_in_session_thread();
     }
 
-    void runInSessionThread(std::function<void(void)>&& func)
+    // `where` is the caller, so that slow callbacks can be traced back to it.
+    void runInSessionThread(std::function<void(void)>&& func, tr_source_location where = tr_source_location::current())
     {
-        session_thread_->run(std::move(func));
+        session_thread_->run(std::move(func), where);
     }
 
-    template<typename Func, typename... Args>
-    void runInSessionThread(Func&& func, Args&&... args)
+    [[nodiscard]] auto* event_base() noexcept
     {
-        session_thread_->run(std::forward<Func&&>(func), std::forward<Args>(args)...);
+        return session_thread_->event_base();
     }
 
-    [[nodiscard]] auto* event_base() noexcept
+    // @return the event base that a new TCP peer socket should be read
+    // from, or nullptr if peer sockets are read in the session thread
+    [[nodiscard]] struct event_base* peer_io_event_base() noexcept
     {
-        return session_thread_->event_base();
+        return peer_io_threads_ ? peer_io_threads_->next_event_base() : nullptr;
     }
 
     [[nodiscard]] constexpr auto& torrents()
@@ -417,6 +555,19 @@ public:
         return resume_dir_;
     }
 
+    // @return the journal that holds the torrents' resume data,
+    // or nullptr if they're saved in separate .resume files
+    [[nodiscard]] auto* resume_journal() noexcept
+    {
+        return resume_journal_.get();
+    }
+
+    // writes the .resume files in the background
+    [[nodiscard]] constexpr auto& resume_writer() noexcept
+    {
+        return resume_writer_;
+    }
+
     [[nodiscard]] constexpr auto const& downloadDir() const noexcept
     {
         return settings_.download_dir;
@@ -454,6 +605,36 @@ public:
         settings_.incomplete_dir = dir;
     }
 
+    [[nodiscard]] constexpr auto adaptiveBandwidthEnabled() const noexcept
+    {
+        return settings_.adaptive_bandwidth_enabled;
+    }
+
+    [[nodiscard]] constexpr auto lazyPieceHashesEnabled() const noexcept
+    {
+        return settings_.lazy_piece_hashes_enabled;
+    }
+
+    [[nodiscard]] constexpr auto hibernateIdleSeedsMinutes() const noexcept
+    {
+        return settings_.hibernate_idle_seeds_minutes;
+    }
+
+    [[nodiscard]] constexpr auto& piece_hash_cache() noexcept
+    {
+        return piece_hash_cache_;
+    }
+
+    [[nodiscard]] constexpr auto& info_dict_cache() noexcept
+    {
+        return info_dict_cache_;
+    }
+
+    [[nodiscard]] constexpr auto& piece_syncer() noexcept
+    {
+        return piece_syncer_;
+    }
+
     [[nodiscard]] constexpr auto useIncompleteDir() const noexcept
     {
         return settings_.incomplete_dir_enabled;
@@ -486,6 +667,12 @@ public:
         return const_cast<tr_session*>(this)->scriptFilename(i);
     }
 
+    // the helper that gets torrent events instead of the scripts, if there is one
+    [[nodiscard]] auto* script_hook() noexcept
+    {
+        return script_hook_.get();
+    }
+
     // blocklist
 
     [[nodiscard]] constexpr auto useBlocklist() const noexcept
@@ -495,11 +682,30 @@ public:
 
     void useBlocklist(bool enabled);
 
+    [[nodiscard]] constexpr auto const& blocklistDir() const noexcept
+    {
+        return blocklist_dir_;
+    }
+
+    // Add a blocklist built by Blocklist::saveNew(),
+    // replacing any existing list that uses the same .bin file.
+    void setDefaultBlocklist(libtransmission::Blocklist&& blocklist);
+
     [[nodiscard]] constexpr auto const& blocklistUrl() const noexcept
     {
         return settings_.blocklist_url;
     }
 
+    [[nodiscard]] constexpr auto const& metadataCacheDir() const noexcept
+    {
+        return settings_.metadata_cache_dir;
+    }
+
+    [[nodiscard]] constexpr auto const& metadataCacheUrl() const noexcept
+    {
+        return settings_.metadata_cache_url;
+    }
+
     void setBlocklistUrl(std::string_view url)
     {
         settings_.blocklist_url = url;
@@ -530,6 +736,50 @@ public:
         tr_netSetTOS(sock, settings_.peer_socket_tos, type);
     }
 
+    // explicit peer socket buffer sizes, or 0 to leave them to the OS's autotuning
+    [[nodiscard]] constexpr auto peerSocketSendBuffer() const noexcept
+    {
+        return settings_.peer_socket_send_buffer;
+    }
+
+    [[nodiscard]] constexpr auto peerSocketReceiveBuffer() const noexcept
+    {
+        return settings_.peer_socket_receive_buffer;
+    }
+
+    [[nodiscard]] constexpr auto peerSocketNotSentLowat() const noexcept
+    {
+        return settings_.peer_socket_notsent_lowat;
+    }
+
+    // Whether a peer at this address is on a LAN that gets the fast path:
+    // no speed limits, plaintext if allowed, and deeper request queues.
+    [[nodiscard]] bool isLanFastPathPeer(tr_address const& addr) const noexcept
+    {
+        if (!settings_.lan_peer_fast_path_enabled)
+        {
+            return false;
+        }
+
+        auto const contains = [&addr](auto const& subnet)
+        {
+            return subnet.contains(addr);
+        };
+        return std::any_of(std::begin(lan_subnets_), std::end(lan_subnets_), contains);
+    }
+
+    // The most bytes that we ask for or serve in one request from peers
+    // that also support large requests, or 0 if they're disabled
+    [[nodiscard]] constexpr uint32_t largeRequestSize() const noexcept
+    {
+        if (settings_.large_request_size_kib == 0U)
+        {
+            return 0U;
+        }
+
+        return static_cast<uint32_t>(std::clamp(settings_.large_request_size_kib, size_t{ 64U }, size_t{ 256U }) * 1024U);
+    }
+
     [[nodiscard]] constexpr auto peerLimit() const noexcept
     {
         return settings_.peer_limit_global;
@@ -540,6 +790,17 @@ public:
         return settings_.peer_limit_per_torrent;
     }
 
+    // the most connectable peers to remember, or 0 for no limit
+    [[nodiscard]] constexpr auto peerPoolLimitGlobal() const noexcept
+    {
+        return settings_.peer_pool_limit_global;
+    }
+
+    [[nodiscard]] constexpr auto peerPoolLimitPerTorrent() const noexcept
+    {
+        return settings_.peer_pool_limit_per_torrent;
+    }
+
     // bandwidth
 
     [[nodiscard]] tr_bandwidth& getBandwidthGroup(std::string_view name);
@@ -554,6 +815,17 @@ public:
     void closeTorrentFiles(tr_torrent* tor) noexcept;
     void closeTorrentFile(tr_torrent* tor, tr_file_index_t file_num) noexcept;
 
+    // backends for download folders whose data isn't in the local filesystem
+    [[nodiscard]] constexpr auto& storages() noexcept
+    {
+        return storages_;
+    }
+
+    [[nodiscard]] constexpr auto const& storages() const noexcept
+    {
+        return storages_;
+    }
+
     // announce ip
 
     [[nodiscard]] constexpr std::string const& announceIP() const noexcept
@@ -662,6 +934,61 @@ public:
         return session_stats_;
     }
 
+    // the worker threads that background work shares
+    [[nodiscard]] constexpr auto& executor() noexcept
+    {
+        return executor_;
+    }
+
+    // RPC's blocklist imports, which run one at a time
+    [[nodiscard]] constexpr auto& blocklist_import_queue() noexcept
+    {
+        return blocklist_import_queue_;
+    }
+
+    // RPC's parsing of torrent-add-batch metainfo
+    [[nodiscard]] constexpr auto& rpc_parse_queue() noexcept
+    {
+        return rpc_parse_queue_;
+    }
+
+    // arbitrates disk I/O between uploads, cache flushes, prefetches, and verification
+    [[nodiscard]] constexpr auto& io_scheduler() noexcept
+    {
+        return io_scheduler_;
+    }
+
+    // finds new torrents' files in other torrents' data
+    [[nodiscard]] constexpr auto& local_data_index() noexcept
+    {
+        return local_data_index_;
+    }
+
+    // cached free space of the folders that RPC clients ask about
+    [[nodiscard]] constexpr auto& capacity_monitor() const noexcept
+    {
+        return capacity_monitor_;
+    }
+
+    // how much memory the session is using, as of the last check, and its limit
+    [[nodiscard]] constexpr auto const& memory_budget() const noexcept
+    {
+        return memory_budget_;
+    }
+
+    [[nodiscard]] constexpr auto& rpc_deltas() noexcept
+    {
+        return rpc_deltas_;
+    }
+
+    [[nodiscard]] constexpr auto& rpc_peer_deltas() noexcept
+    {
+        return rpc_peer_deltas_;
+    }
+
+    // @return how many peers are connected, in every torrent. O(1).
+    [[nodiscard]] size_t peer_count() const noexcept;
+
     constexpr void add_uploaded(uint32_t n_bytes) noexcept
     {
         stats().add_uploaded(n_bytes);
@@ -736,6 +1063,13 @@ public:
         return settings_.encryption_mode;
     }
 
+    // LAN fast-path peers are offered plaintext unless encryption is required
+    [[nodiscard]] tr_encryption_mode encryptionMode(tr_address const& addr) const noexcept
+    {
+        auto const mode = encryptionMode();
+        return mode == TR_ENCRYPTION_PREFERRED && isLanFastPathPeer(addr) ? TR_CLEAR_PREFERRED : mode;
+    }
+
     [[nodiscard]] constexpr auto preallocationMode() const noexcept
     {
         return settings_.preallocation_mode;
@@ -788,6 +1122,11 @@ public:
         return settings_.is_prefetch_enabled;
     }
 
+    [[nodiscard]] constexpr auto isDirectIoEnabled() const noexcept
+    {
+        return settings_.direct_io_enabled;
+    }
+
     [[nodiscard]] constexpr auto isIdleLimited() const noexcept
     {
         return settings_.idle_seeding_limit_enabled;
@@ -821,6 +1160,9 @@ public:
 
     [[nodiscard]] bool addressIsBlocked(tr_address const& addr) const noexcept;
 
+    // addressIsBlocked() for a batch of addresses, e.g. a tracker's peers
+    void addressesAreBlocked(tr_address const* addrs, size_t n_addrs, bool* setme) const noexcept;
+
     [[nodiscard]] bool has_ip_protocol(tr_address_type type) const noexcept
     {
         TR_ASSERT(type == TR_AF_INET || type == TR_AF_INET6);
@@ -891,14 +1233,70 @@ public:
         }
     }
 
-    void verifyAdd(tr_torrent* tor)
+    void verifyAdd(tr_torrent* tor, bool quick, bool background = false, tr_piece_index_t first_piece = 0U)
     {
         if (verifier_)
         {
-            verifier_->add(tor);
+            verifier_->add(tor, quick, background, first_piece);
+        }
+    }
+
+    // Copy a torrent's files to another filesystem in the background.
+    // `on_done` is called in the session thread when they're all copied.
+    void moveFiles(tr_torrent_id_t id, std::vector<tr_file_mover::File>&& files, tr_file_mover::DoneFunc&& on_done)
+    {
+        if (file_mover_)
+        {
+            file_mover_->add(id, std::move(files), std::move(on_done));
         }
     }
 
+    void moveFilesRemove(tr_torrent_id_t id)
+    {
+        if (file_mover_)
+        {
+            file_mover_->remove(id);
+        }
+    }
+
+    // @return how much of a torrent's data has been copied, or nullopt if it isn't being moved
+    [[nodiscard]] std::optional<double> moveFilesProgress(tr_torrent_id_t id) const
+    {
+        return file_mover_ ? file_mover_->progress(id) : std::nullopt;
+    }
+
+    // Create and preallocate a torrent's files in the background.
+    void preallocateFiles(tr_torrent_id_t id, std::vector<tr_preallocator::File>&& files, tr_preallocation_mode mode)
+    {
+        if (preallocator_)
+        {
+            preallocator_->add(id, std::move(files), mode);
+        }
+    }
+
+    void preallocateFilesRemove(tr_torrent_id_t id)
+    {
+        if (preallocator_)
+        {
+            preallocator_->remove(id);
+        }
+    }
+
+    // @return how much of a torrent's data has been preallocated, or nullopt if it isn't being preallocated
+    [[nodiscard]] std::optional<double> preallocateFilesProgress(tr_torrent_id_t id) const
+    {
+        return preallocator_ ? preallocator_->progress(id) : std::nullopt;
+    }
+
+    [[nodiscard]] tr_mse_worker* mseWorker() noexcept
+    {
+        return mse_worker_.get();
+    }
+
+    // Check a completed piece's checksum in the background.
+    // `on_done` is called in the session thread with the verdict.
+    void hashPiece(tr_piece_hasher::Data&& data, tr_sha1_digest_t const& expected, tr_piece_hasher::DoneFunc&& on_done);
+
     void fetch(tr_web::FetchOptions&& options) const
     {
         if (web_)
@@ -969,6 +1367,22 @@ private:
 
     void onNowTimer();
 
+    // called from a worker thread when a torrent's .resume file couldn't be written
+    void onResumeSaveError(tr_torrent_id_t tor_id, int error_code);
+
+    [[nodiscard]] tr_memory_usage memory_usage() const;
+
+    // Measure the memory usage and shed memory if it's near the budget
+    void update_memory_budget();
+
+    // Apply the cache sizes from the settings, shrunk if memory is short
+    void update_cache_limits();
+
+    void mergeBlocklists();
+
+    // the event bases to listen for incoming peer connections on
+    [[nodiscard]] std::vector<struct event_base*> listener_event_bases();
+
     static void onIncomingPeerConnection(tr_socket_t fd, void* vsession);
 
     friend class libtransmission::test::SessionTest;
@@ -989,6 +1403,7 @@ private:
     friend size_t tr_sessionGetAltSpeedBegin(tr_session const* session);
     friend size_t tr_sessionGetAltSpeedEnd(tr_session const* session);
     friend size_t tr_sessionGetCacheLimit_MB(tr_session const* session);
+    friend size_t tr_sessionGetPeerSockets(tr_session* session, int* setme, size_t max_n);
     friend tr_kilobytes_per_second_t tr_sessionGetAltSpeed_KBps(tr_session const* session, tr_direction dir);
     friend tr_kilobytes_per_second_t tr_sessionGetSpeedLimit_KBps(tr_session const* session, tr_direction dir);
     friend tr_port_forwarding_state tr_sessionGetPortForwarding(tr_session const* session);
@@ -1115,14 +1530,60 @@ private:
 
     tr_stats session_stats_{ config_dir_, time(nullptr) };
 
+    tr_memory_budget memory_budget_;
+
+    // Shared by the background work below. Declared before it so that
+    // it's destroyed after everything that submits tasks to it.
+    tr_executor executor_;
+
+    // depends-on: executor_
+    tr_dns dns_{ executor_ };
+
+    // depends-on: executor_
+    // mutable: looking up free space fills the cache
+    mutable tr_capacity_monitor capacity_monitor_{ executor_ };
+
+    // depends-on: executor_
+    tr_executor_queue blocklist_import_queue_{ executor_, 1U, tr_executor::Priority::Low };
+
+    // depends-on: executor_
+    tr_executor_queue rpc_parse_queue_{ executor_, 0U };
+
+    // Declared before the cache and the verify worker, which use it
+    tr_io_scheduler io_scheduler_;
+
+    tr_local_data_index local_data_index_;
+
+    tr_rpc_deltas rpc_deltas_;
+    tr_rpc_peer_deltas rpc_peer_deltas_;
+
     tr_announce_list default_trackers_;
 
     tr_session_id session_id_;
 
     tr_open_files open_files_;
 
+    tr_storages storages_;
+
+    tr_piece_hash_cache piece_hash_cache_;
+
+    tr_info_dict_cache info_dict_cache_;
+
+    std::unique_ptr<tr_resume_journal> resume_journal_;
+
+    // depends-on: executor_
+    tr_resume_writer resume_writer_{ executor_,
+                                     [this](tr_torrent_id_t tor_id, int error_code)
+                                     { onResumeSaveError(tor_id, error_code); } };
+
+    // depends-on: timer_maker_, settings_.script_hook_socket
+    std::unique_ptr<tr_script_hook> script_hook_;
+
     std::vector<libtransmission::Blocklist> blocklists_;
 
+    // all of blocklists_, merged for fast lookups
+    libtransmission::MergedBlocklist merged_blocklist_;
+
 public:
     libtransmission::SimpleObservable<> blocklist_changed_;
 
@@ -1159,6 +1620,10 @@ public:
     // depends-on: udp_core_
     struct struct_utp_context* utp_context = nullptr;
 
+    // µTP peers that got data from the datagrams being processed now.
+    // They parse it once the batch is done; see tr_peerIo::utp_flush_reads().
+    std::vector<std::weak_ptr<tr_peerIo>> utp_pending_reads;
+
 private:
     // depends-on: open_files_
     tr_torrents torrents_;
@@ -1167,16 +1632,22 @@ private:
     GlobalIPCacheMediator global_ip_cache_mediator_{ *this };
     std::unique_ptr<tr_global_ip_cache> global_ip_cache_ = tr_global_ip_cache::create(global_ip_cache_mediator_);
 
-    // depends-on: settings_, session_thread_, torrents_, global_ip_cache (via tr_session::bind_address())
+    // depends-on: settings_, session_thread_, torrents_, dns_, global_ip_cache (via tr_session::bind_address())
     WebMediator web_mediator_{ this };
     std::unique_ptr<tr_web> web_ = tr_web::create(this->web_mediator_);
 
 public:
-    // depends-on: settings_, open_files_, torrents_
-    std::unique_ptr<Cache> cache = std::make_unique<Cache>(torrents_, 1024 * 1024 * 2);
+    // depends-on: settings_, open_files_, torrents_, io_scheduler_
+    std::unique_ptr<Cache> cache = std::make_unique<Cache>(torrents_, io_scheduler_, 1024 * 1024 * 2);
 
 private:
-    // depends-on: timer_maker_, top_bandwidth_, utp_context, torrents_, web_, blocklist_changed_
+    // depends-on: settings_.lan_peer_networks
+    std::vector<tr_subnet> lan_subnets_;
+
+    // Optional event loops for reading peer sockets. See peer-io-threads.h.
+    std::unique_ptr<tr_peer_io_threads> peer_io_threads_;
+
+    // depends-on: timer_maker_, top_bandwidth_, utp_context, torrents_, web_, blocklist_changed_, peer_io_threads_
     std::unique_ptr<struct tr_peerMgr, void (*)(struct tr_peerMgr*)> peer_mgr_;
 
     // depends-on: peer_mgr_, advertised_peer_port_, torrents_
@@ -1185,10 +1656,10 @@ private:
     // depends-on: lpd_mediator_
     std::unique_ptr<tr_lpd> lpd_;
 
-    // depends-on: udp_core_
+    // depends-on: udp_core_, dns_
     AnnouncerUdpMediator announcer_udp_mediator_{ *this };
 
-    // depends-on: timer_maker_, torrents_, peer_mgr_
+    // depends-on: timer_maker_, torrents_, peer_mgr_, dns_
     DhtMediator dht_mediator_{ *this };
 
 public:
@@ -1211,7 +1682,30 @@ private:
     // depends-on: torrents_
     std::unique_ptr<libtransmission::Timer> save_timer_;
 
-    std::unique_ptr<tr_verify_worker> verifier_ = std::make_unique<tr_verify_worker>();
+    // depends-on: executor_, io_scheduler_
+    std::unique_ptr<tr_verify_worker> verifier_ = std::make_unique<tr_verify_worker>(executor_, io_scheduler_);
+
+    PieceHasherMediator piece_hasher_mediator_{ *this };
+
+    // depends-on: session_thread_, executor_, piece_hasher_mediator_
+    std::unique_ptr<tr_piece_hasher> piece_hasher_ = std::make_unique<tr_piece_hasher>(piece_hasher_mediator_, executor_);
+
+    PieceSyncerMediator piece_syncer_mediator_{ *this };
+
+    // depends-on: piece_syncer_mediator_
+    tr_piece_syncer piece_syncer_{ piece_syncer_mediator_ };
+
+    MseWorkerMediator mse_worker_mediator_{ *this };
+
+    // depends-on: session_thread_, executor_, mse_worker_mediator_
+    std::unique_ptr<tr_mse_worker> mse_worker_ = std::make_unique<tr_mse_worker>(executor_, mse_worker_mediator_);
+
+    FileMoverMediator file_mover_mediator_{ *this };
+
+    // depends-on: session_thread_, file_mover_mediator_
+    std::unique_ptr<tr_file_mover> file_mover_ = std::make_unique<tr_file_mover>(file_mover_mediator_);
+
+    std::unique_ptr<tr_preallocator> preallocator_ = std::make_unique<tr_preallocator>();
 
 public:
     std::unique_ptr<libtransmission::Timer> utp_timer;
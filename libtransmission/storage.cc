@@ -0,0 +1,74 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "libtransmission/session.h"
+#include "libtransmission/storage.h"
+#include "libtransmission/utils.h" // tr_strv_starts_with()
+
+namespace
+{
+[[nodiscard]] constexpr std::string_view strip_trailing_separators(std::string_view dir)
+{
+    while (std::size(dir) > 1U && (tr_strv_ends_with(dir, '/') || tr_strv_ends_with(dir, '\\')))
+    {
+        dir.remove_suffix(1U);
+    }
+
+    return dir;
+}
+} // namespace
+
+void tr_storages::set(std::string_view dir, std::shared_ptr<tr_storage> storage)
+{
+    auto const lock = std::lock_guard{ mutex_ };
+
+    dir = strip_trailing_separators(dir);
+    if (storage)
+    {
+        storages_.insert_or_assign(std::string{ dir }, std::move(storage));
+    }
+    else if (auto const iter = storages_.find(dir); iter != std::end(storages_))
+    {
+        storages_.erase(iter);
+    }
+}
+
+std::shared_ptr<tr_storage> tr_storages::find(std::string_view path) const
+{
+    auto const lock = std::lock_guard{ mutex_ };
+
+    if (std::empty(storages_))
+    {
+        return {};
+    }
+
+    // the innermost folder that contains `path` wins
+    path = strip_trailing_separators(path);
+    auto best = std::end(storages_);
+    for (auto iter = std::begin(storages_); iter != std::end(storages_); ++iter)
+    {
+        auto const& dir = iter->first;
+        auto const contains = path == dir ||
+            (tr_strv_starts_with(path, dir) &&
+             (tr_strv_ends_with(dir, '/') || path[std::size(dir)] == '/' || path[std::size(dir)] == '\\'));
+        if (contains && (best == std::end(storages_) || std::size(dir) > std::size(best->first)))
+        {
+            best = iter;
+        }
+    }
+
+    return best != std::end(storages_) ? best->second : nullptr;
+}
+
+void tr_sessionSetStorage(tr_session* session, std::string_view dir, std::shared_ptr<tr_storage> storage)
+{
+    session->storages().set(dir, std::move(storage));
+}
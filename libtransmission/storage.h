@@ -0,0 +1,111 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#include <cstddef> // size_t
+#include <cstdint> // uint8_t, uint64_t
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+#include "libtransmission/transmission.h" // tr_file_index_t
+
+struct tr_error;
+struct tr_session;
+struct tr_sys_file_iovec;
+struct tr_torrent;
+
+/**
+ * @addtogroup file_io File IO
+ * @{
+ */
+
+/**
+ * Where a torrent's data is kept, if not in the local filesystem.
+ *
+ * A backend is registered for a download folder with tr_sessionSetStorage()
+ * and is then used for all block reads, writes and verifies of the
+ * torrents whose download folder is in it. The block cache sits in front
+ * of it as usual, so backends only see whole runs of blocks.
+ *
+ * Files are identified by torrent and file index; a backend can name them
+ * with tr_torrentFile(). Methods may be called from any thread.
+ */
+class tr_storage
+{
+public:
+    tr_storage() = default;
+    virtual ~tr_storage() = default;
+
+    tr_storage(tr_storage const&) = delete;
+    tr_storage(tr_storage&&) = delete;
+    tr_storage& operator=(tr_storage const&) = delete;
+    tr_storage& operator=(tr_storage&&) = delete;
+
+    /** @brief Read exactly `len` bytes from `offset` in one of the torrent's files. */
+    [[nodiscard]] virtual bool read_at(
+        tr_torrent const* tor,
+        tr_file_index_t file_index,
+        uint64_t offset,
+        uint8_t* buf,
+        size_t len,
+        tr_error** error) = 0;
+
+    /** @brief Write all of `vecs` to `offset` in one of the torrent's files, creating it if needed. */
+    [[nodiscard]] virtual bool write_at(
+        tr_torrent const* tor,
+        tr_file_index_t file_index,
+        uint64_t offset,
+        tr_sys_file_iovec const* vecs,
+        size_t n_vecs,
+        tr_error** error) = 0;
+
+    /** @return true if any of the file's data has been written. */
+    [[nodiscard]] virtual bool exists(tr_torrent const* tor, tr_file_index_t file_index) = 0;
+
+    /** @brief A hint that a range will be read soon, e.g. to fetch it in one request. */
+    virtual void prefetch(
+        tr_torrent const* /*tor*/,
+        tr_file_index_t /*file_index*/,
+        uint64_t /*offset*/,
+        uint64_t /*len*/)
+    {
+    }
+
+    /** @brief Called when the torrent is stopped or removed, after its cached blocks are written. */
+    virtual void flush(tr_torrent const* /*tor*/)
+    {
+    }
+};
+
+/**
+ * The backends that are registered for download folders.
+ * Safe to use from any thread.
+ */
+class tr_storages
+{
+public:
+    void set(std::string_view dir, std::shared_ptr<tr_storage> storage);
+
+    /** @return the backend for the folder that contains `path`, or nullptr for the local filesystem. */
+    [[nodiscard]] std::shared_ptr<tr_storage> find(std::string_view path) const;
+
+private:
+    mutable std::mutex mutex_;
+    std::map<std::string, std::shared_ptr<tr_storage>, std::less<>> storages_;
+};
+
+/**
+ * @brief Keep the data of torrents downloaded into `dir` in `storage`.
+ *
+ * Passing a nullptr `storage` goes back to the local filesystem.
+ * Torrents that are already running should be stopped first.
+ */
+void tr_sessionSetStorage(tr_session* session, std::string_view dir, std::shared_ptr<tr_storage> storage);
+
+/** @} */
@@ -0,0 +1,102 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <algorithm> // for std::max()
+#include <cstdint> // for uint64_t
+#include <optional>
+
+#include "libtransmission/transmission.h" // for tr_byte_span_t
+
+/**
+ * Where a streaming reader, e.g. a media player reading a file over
+ * HTTP, is in a torrent and how fast it's reading. The bytes just
+ * ahead of the reader get deadlines so that the wishlist can fetch
+ * them before the reader gets there.
+ *
+ * The reader's speed is learned from how far it moves between updates.
+ * Jumps longer than the read-ahead window are treated as seeks.
+ */
+class tr_stream_cursor
+{
+public:
+    // a guess at the reader's speed until we've seen it move: ~8 Mbit/s
+    static auto constexpr DefaultBytesPerSecond = uint64_t{ 1024U * 1024U };
+
+    // how far ahead of the reader to give pieces deadlines
+    static auto constexpr ReadaheadMsec = uint64_t{ 60000U };
+    static auto constexpr MinReadaheadBytes = uint64_t{ 16U * 1024U * 1024U };
+
+    // forget about a reader that hasn't read anything for this long
+    static auto constexpr IdleMsec = uint64_t{ 60000U };
+
+    constexpr void update(uint64_t byte, uint64_t now_msec) noexcept
+    {
+        if (is_active(now_msec) && byte > byte_ && byte - byte_ < readahead_bytes() && now_msec > updated_at_msec_)
+        {
+            auto const sample = (byte - byte_) * 1000U / (now_msec - updated_at_msec_);
+            bytes_per_second_ = std::max((bytes_per_second_ * 3U + sample) / 4U, uint64_t{ 1U });
+        }
+
+        byte_ = byte;
+        updated_at_msec_ = now_msec;
+        is_set_ = true;
+    }
+
+    constexpr void clear() noexcept
+    {
+        is_set_ = false;
+    }
+
+    [[nodiscard]] constexpr bool is_active(uint64_t now_msec) const noexcept
+    {
+        return is_set_ && now_msec < updated_at_msec_ + IdleMsec;
+    }
+
+    // @return true if the reader went idle and should be clear()ed
+    [[nodiscard]] constexpr bool is_idle(uint64_t now_msec) const noexcept
+    {
+        return is_set_ && !is_active(now_msec);
+    }
+
+    [[nodiscard]] constexpr auto byte() const noexcept
+    {
+        return byte_;
+    }
+
+    [[nodiscard]] constexpr auto bytes_per_second() const noexcept
+    {
+        return bytes_per_second_;
+    }
+
+    [[nodiscard]] constexpr uint64_t readahead_bytes() const noexcept
+    {
+        return std::max(bytes_per_second_ * ReadaheadMsec / 1000U, MinReadaheadBytes);
+    }
+
+    // @return when the reader is expected to reach `span`, or nullopt if
+    // there's no reader or `span` is behind it or beyond the read-ahead window
+    [[nodiscard]] constexpr std::optional<uint64_t> deadline(tr_byte_span_t span) const noexcept
+    {
+        if (!is_set_ || span.end <= byte_ || span.begin >= byte_ + readahead_bytes())
+        {
+            return {};
+        }
+
+        auto const distance = span.begin > byte_ ? span.begin - byte_ : uint64_t{};
+        return updated_at_msec_ + distance * 1000U / bytes_per_second_;
+    }
+
+private:
+    uint64_t byte_ = 0U;
+    uint64_t updated_at_msec_ = 0U;
+    uint64_t bytes_per_second_ = DefaultBytesPerSecond;
+    bool is_set_ = false;
+};
@@ -16,6 +16,7 @@
 
 #include <event2/event.h>
 
+#include "libtransmission/metrics.h"
 #include "libtransmission/timer.h"
 #include "libtransmission/timer-ev.h"
 #include "libtransmission/tr-assert.h"
@@ -68,6 +69,7 @@ public:
         evtimer_add(evtimer_.get(), &tv);
 
         is_running_ = true;
+        due_at_ = steady_clock::now() + interval_;
     }
 
     void set_callback(std::function<void()> callback) override
@@ -145,10 +147,32 @@ private:
 
     void handleTimer()
     {
+        using namespace std::chrono;
+
+        auto const started_at = steady_clock::now();
+        auto& metrics = tr_metrics::instance();
+        metrics.event_loop_lag.observe(duration_cast<microseconds>(started_at - due_at_));
+
         is_running_ = is_repeating_;
+        if (is_repeating_)
+        {
+            // libevent schedules a persistent timer's next run from when
+            // this one was due, unless that's already in the past
+            due_at_ += interval_;
+            if (due_at_ < started_at)
+            {
+                due_at_ = started_at + interval_;
+            }
+        }
+
+        // the callback may destroy `this`, so don't touch it afterwards
+        auto const where = source_location();
 
         TR_ASSERT(callback_);
         callback_();
+
+        auto const duration = duration_cast<microseconds>(steady_clock::now() - started_at);
+        metrics.observe_loop_call(tr_metrics::LoopCall::Timer, where, duration);
     }
 
     [[nodiscard]] constexpr bool isRunning() const noexcept
@@ -157,6 +181,7 @@ private:
     }
 
     std::chrono::milliseconds interval_ = 100ms;
+    std::chrono::steady_clock::time_point due_at_;
     bool is_repeating_ = false;
     bool is_running_ = false;
     std::function<void()> callback_;
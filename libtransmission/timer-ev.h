@@ -25,6 +25,8 @@ public:
     {
     }
 
+    using TimerMaker::create;
+
     [[nodiscard]] std::unique_ptr<Timer> create() override;
 
 private:
@@ -0,0 +1,537 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef> // size_t
+#include <cstdint> // uint64_t
+#include <functional>
+#include <limits>
+#include <memory>
+#include <utility>
+
+#ifdef _WIN32
+#include <ws2tcpip.h>
+#else
+#include <sys/time.h>
+#endif
+
+#include <event2/event.h>
+
+#include "libtransmission/metrics.h"
+#include "libtransmission/timer.h"
+#include "libtransmission/timer-wheel.h"
+#include "libtransmission/tr-assert.h"
+#include "libtransmission/utils-ev.h"
+
+using namespace std::literals;
+
+namespace libtransmission
+{
+
+class WheelTimer;
+
+// Four levels of 64 slots each. A level-0 slot holds the timers due in
+// one tick; a level-N slot holds those due in a span of 64^N ticks, and
+// they're cascaded down into the level below when that span begins.
+class WheelTimerMaker::Wheel
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    Wheel(event_base* base, std::chrono::milliseconds tick);
+    ~Wheel();
+
+    Wheel(Wheel&&) = delete;
+    Wheel(Wheel const&) = delete;
+    Wheel& operator=(Wheel&&) = delete;
+    Wheel& operator=(Wheel const&) = delete;
+
+    void add(WheelTimer* timer);
+    void remove(WheelTimer* timer);
+
+    // @return the first tick that's at least `interval` from now
+    [[nodiscard]] uint64_t due_tick(std::chrono::milliseconds interval) const;
+
+    // @return how many ticks `interval` spans, rounded up
+    [[nodiscard]] uint64_t n_ticks(std::chrono::milliseconds interval) const noexcept
+    {
+        auto const n = (std::chrono::duration_cast<Clock::duration>(interval) + tick_ - 1ns) / tick_;
+        return static_cast<uint64_t>(std::max(n, decltype(n){ 1 }));
+    }
+
+    [[nodiscard]] Clock::time_point time_at(uint64_t tick) const noexcept
+    {
+        return epoch_ + tick_ * static_cast<Clock::rep>(tick);
+    }
+
+    [[nodiscard]] constexpr auto now_tick() const noexcept
+    {
+        return now_tick_;
+    }
+
+    [[nodiscard]] constexpr auto size() const noexcept
+    {
+        return size_;
+    }
+
+private:
+    static auto constexpr LevelBits = 6U;
+    static auto constexpr SlotsPerLevel = size_t{ 1U } << LevelBits;
+    static auto constexpr SlotMask = uint64_t{ SlotsPerLevel - 1U };
+    static auto constexpr NumLevels = size_t{ 4U };
+    static auto constexpr NumSlots = NumLevels * SlotsPerLevel;
+
+    // timers that are due in the tick being run
+    static auto constexpr ExpiredSlot = NumSlots;
+
+    static auto constexpr NotScheduled = std::numeric_limits<uint64_t>::max();
+
+    [[nodiscard]] static constexpr uint64_t span(size_t level) noexcept
+    {
+        return uint64_t{ 1U } << (LevelBits * level);
+    }
+
+    [[nodiscard]] uint64_t tick_at(Clock::time_point time) const noexcept
+    {
+        return time <= epoch_ ? 0U : static_cast<uint64_t>((time - epoch_) / tick_);
+    }
+
+    void link(WheelTimer* timer, size_t slot) noexcept;
+    void unlink(WheelTimer* timer) noexcept;
+    void place(WheelTimer* timer) noexcept;
+    void cascade(size_t level) noexcept;
+    void advance_to(uint64_t target) noexcept;
+    void run_expired(Clock::time_point now);
+
+    [[nodiscard]] uint64_t next_tick() const noexcept;
+    void schedule();
+
+    static void on_event(evutil_socket_t /*unused*/, short /*unused*/, void* vself)
+    {
+        static_cast<Wheel*>(vself)->on_tick();
+    }
+
+    void on_tick();
+
+    std::array<WheelTimer*, NumSlots + 1U> slots_ = {};
+    std::array<uint64_t, NumLevels> occupied_ = {}; // one bit per non-empty slot
+
+    Clock::time_point const epoch_ = Clock::now();
+    Clock::duration const tick_;
+
+    uint64_t now_tick_ = 0U;
+    uint64_t scheduled_tick_ = NotScheduled;
+    size_t size_ = 0U;
+    bool ticking_ = false;
+
+    evhelpers::event_unique_ptr const event_;
+};
+
+class WheelTimer final : public Timer
+{
+public:
+    explicit WheelTimer(WheelTimerMaker::Wheel& wheel) noexcept
+        : wheel_{ wheel }
+    {
+    }
+
+    WheelTimer(WheelTimer&&) = delete;
+    WheelTimer(WheelTimer const&) = delete;
+    WheelTimer& operator=(WheelTimer&&) = delete;
+    WheelTimer& operator=(WheelTimer const&) = delete;
+
+    ~WheelTimer() override
+    {
+        stop();
+    }
+
+    void stop() override
+    {
+        if (is_running())
+        {
+            wheel_.remove(this);
+        }
+    }
+
+    void start() override
+    {
+        if (is_running())
+        {
+            return;
+        }
+
+        due_tick_ = wheel_.due_tick(interval_);
+        wheel_.add(this);
+    }
+
+    void set_callback(std::function<void()> callback) override
+    {
+        callback_ = std::move(callback);
+    }
+
+    [[nodiscard]] std::chrono::milliseconds interval() const noexcept override
+    {
+        return interval_;
+    }
+
+    void set_interval(std::chrono::milliseconds interval) override
+    {
+        TR_ASSERT_MSG(interval.count() > 0 || !is_repeating(), "repeating timers must have a positive interval");
+
+        if (interval_ == interval)
+        {
+            return;
+        }
+
+        interval_ = interval;
+        restart_if_running();
+    }
+
+    [[nodiscard]] bool is_repeating() const noexcept override
+    {
+        return is_repeating_;
+    }
+
+    void set_repeating(bool repeating) override
+    {
+        if (is_repeating_ == repeating)
+        {
+            return;
+        }
+
+        is_repeating_ = repeating;
+        restart_if_running();
+    }
+
+    // Called by the wheel after it's unlinked this timer from the expired list
+    void fire(std::chrono::steady_clock::time_point started_at)
+    {
+        using namespace std::chrono;
+
+        auto& metrics = tr_metrics::instance();
+        auto const lag = started_at - wheel_.time_at(due_tick_);
+        metrics.event_loop_lag.observe(duration_cast<microseconds>(std::max(lag, steady_clock::duration{})));
+
+        if (is_repeating_)
+        {
+            // like libevent, schedule the next run from when this one was
+            // due, unless that's already in the past
+            due_tick_ += wheel_.n_ticks(interval_);
+            if (due_tick_ <= wheel_.now_tick())
+            {
+                due_tick_ = wheel_.now_tick() + wheel_.n_ticks(interval_);
+            }
+
+            wheel_.add(this);
+        }
+
+        // the callback may destroy `this`, so don't touch it afterwards
+        auto const where = source_location();
+
+        TR_ASSERT(callback_);
+        callback_();
+
+        auto const duration = duration_cast<microseconds>(steady_clock::now() - started_at);
+        metrics.observe_loop_call(tr_metrics::LoopCall::Timer, where, duration);
+    }
+
+    static auto constexpr NoSlot = std::numeric_limits<size_t>::max();
+
+    // intrusive list links, owned by the wheel
+    WheelTimer* prev_ = nullptr;
+    WheelTimer* next_ = nullptr;
+    size_t slot_ = NoSlot;
+    uint64_t due_tick_ = 0U;
+
+private:
+    [[nodiscard]] constexpr bool is_running() const noexcept
+    {
+        return slot_ != NoSlot;
+    }
+
+    void restart_if_running()
+    {
+        if (is_running())
+        {
+            stop();
+            start();
+        }
+    }
+
+    WheelTimerMaker::Wheel& wheel_;
+    std::function<void()> callback_;
+    std::chrono::milliseconds interval_ = 100ms;
+    bool is_repeating_ = false;
+};
+
+// ---
+
+WheelTimerMaker::Wheel::Wheel(event_base* base, std::chrono::milliseconds tick)
+    : tick_{ std::chrono::duration_cast<Clock::duration>(std::max(tick, 1ms)) }
+    , event_{ evtimer_new(base, &Wheel::on_event, this) }
+{
+}
+
+WheelTimerMaker::Wheel::~Wheel()
+{
+    // detach any timers still running so that their destructors don't
+    // reach back into a wheel that's gone
+    for (auto* head : slots_)
+    {
+        for (auto* timer = head; timer != nullptr;)
+        {
+            auto* const next = timer->next_;
+            timer->prev_ = timer->next_ = nullptr;
+            timer->slot_ = WheelTimer::NoSlot;
+            timer = next;
+        }
+    }
+}
+
+uint64_t WheelTimerMaker::Wheel::due_tick(std::chrono::milliseconds interval) const
+{
+    auto const when = Clock::now() + interval - epoch_;
+    return std::max(static_cast<uint64_t>((when + tick_ - 1ns) / tick_), now_tick_ + 1U);
+}
+
+void WheelTimerMaker::Wheel::add(WheelTimer* timer)
+{
+    TR_ASSERT(timer->slot_ == WheelTimer::NoSlot);
+    TR_ASSERT(timer->due_tick_ > now_tick_);
+
+    place(timer);
+
+    if (timer->due_tick_ < scheduled_tick_)
+    {
+        schedule();
+    }
+}
+
+void WheelTimerMaker::Wheel::remove(WheelTimer* timer)
+{
+    // no need to reschedule: if this was the next timer due,
+    // the next tick just finds nothing to do
+    unlink(timer);
+}
+
+void WheelTimerMaker::Wheel::link(WheelTimer* timer, size_t slot) noexcept
+{
+    auto*& head = slots_[slot];
+    timer->prev_ = nullptr;
+    timer->next_ = head;
+    if (head != nullptr)
+    {
+        head->prev_ = timer;
+    }
+    head = timer;
+    timer->slot_ = slot;
+
+    if (slot != ExpiredSlot)
+    {
+        occupied_[slot / SlotsPerLevel] |= uint64_t{ 1U } << (slot % SlotsPerLevel);
+    }
+
+    ++size_;
+}
+
+void WheelTimerMaker::Wheel::unlink(WheelTimer* timer) noexcept
+{
+    auto const slot = timer->slot_;
+    auto*& head = slots_[slot];
+
+    if (timer->prev_ != nullptr)
+    {
+        timer->prev_->next_ = timer->next_;
+    }
+    else
+    {
+        head = timer->next_;
+    }
+
+    if (timer->next_ != nullptr)
+    {
+        timer->next_->prev_ = timer->prev_;
+    }
+
+    if (head == nullptr && slot != ExpiredSlot)
+    {
+        occupied_[slot / SlotsPerLevel] &= ~(uint64_t{ 1U } << (slot % SlotsPerLevel));
+    }
+
+    timer->prev_ = timer->next_ = nullptr;
+    timer->slot_ = WheelTimer::NoSlot;
+    --size_;
+}
+
+void WheelTimerMaker::Wheel::place(WheelTimer* timer) noexcept
+{
+    // timers too far out for the wheel are parked in the top level's
+    // last slot and placed again when it's cascaded
+    auto const due = std::clamp(timer->due_tick_, now_tick_, now_tick_ + span(NumLevels) - 1U);
+    auto const delta = due - now_tick_;
+
+    auto level = size_t{ 0U };
+    while (delta >= span(level + 1U))
+    {
+        ++level;
+    }
+
+    link(timer, level * SlotsPerLevel + ((due >> (LevelBits * level)) & SlotMask));
+}
+
+void WheelTimerMaker::Wheel::cascade(size_t level) noexcept
+{
+    auto const slot = level * SlotsPerLevel + ((now_tick_ >> (LevelBits * level)) & SlotMask);
+
+    while (auto* const timer = slots_[slot])
+    {
+        unlink(timer);
+        place(timer);
+    }
+}
+
+void WheelTimerMaker::Wheel::advance_to(uint64_t target) noexcept
+{
+    while (now_tick_ < target)
+    {
+        if (size_ == 0U)
+        {
+            now_tick_ = target;
+            return;
+        }
+
+        // skip straight to the next level-0 rollover if nothing's due before it
+        if (occupied_[0] == 0U)
+        {
+            now_tick_ = std::min(now_tick_ | SlotMask, target - 1U);
+        }
+
+        ++now_tick_;
+
+        // cascade the levels whose span starts at this tick, highest first,
+        // so that timers can fall through more than one level at once
+        auto level = size_t{ 0U };
+        while (level + 1U < NumLevels && (now_tick_ & (span(level + 1U) - 1U)) == 0U)
+        {
+            ++level;
+        }
+        for (; level > 0U; --level)
+        {
+            cascade(level);
+        }
+
+        auto const slot = now_tick_ & SlotMask;
+        while (auto* const timer = slots_[slot])
+        {
+            unlink(timer);
+            link(timer, ExpiredSlot);
+        }
+    }
+}
+
+void WheelTimerMaker::Wheel::run_expired(Clock::time_point now)
+{
+    // a callback may stop or destroy timers that are waiting in this
+    // batch, which unlinks them, so take them one at a time
+    while (auto* const timer = slots_[ExpiredSlot])
+    {
+        unlink(timer);
+        timer->fire(now);
+    }
+}
+
+uint64_t WheelTimerMaker::Wheel::next_tick() const noexcept
+{
+    auto next = NotScheduled;
+
+    if (occupied_[0] != 0U)
+    {
+        for (auto tick = now_tick_ + 1U; tick < now_tick_ + SlotsPerLevel; ++tick)
+        {
+            if ((occupied_[0] & (uint64_t{ 1U } << (tick & SlotMask))) != 0U)
+            {
+                next = tick;
+                break;
+            }
+        }
+    }
+
+    // the higher levels need to be looked at again when level 0 rolls over
+    if (std::any_of(std::begin(occupied_) + 1, std::end(occupied_), [](auto bits) { return bits != 0U; }))
+    {
+        next = std::min(next, (now_tick_ | SlotMask) + 1U);
+    }
+
+    return next;
+}
+
+void WheelTimerMaker::Wheel::schedule()
+{
+    if (ticking_)
+    {
+        return;
+    }
+
+    auto const next = next_tick();
+    if (next == scheduled_tick_)
+    {
+        return;
+    }
+
+    scheduled_tick_ = next;
+
+    if (next == NotScheduled)
+    {
+        event_del(event_.get());
+        return;
+    }
+
+    using namespace std::chrono;
+    auto const delay = std::max(time_at(next) - Clock::now(), Clock::duration{});
+    auto const secs = duration_cast<seconds>(delay);
+    auto tv = timeval{};
+    tv.tv_sec = secs.count();
+    tv.tv_usec = static_cast<decltype(tv.tv_usec)>(duration_cast<microseconds>(delay - secs).count());
+    evtimer_add(event_.get(), &tv);
+}
+
+void WheelTimerMaker::Wheel::on_tick()
+{
+    auto const now = Clock::now();
+
+    // libevent may wake us a hair early; don't make the timers wait another tick
+    auto const target = std::max(tick_at(now), scheduled_tick_ == NotScheduled ? 0U : scheduled_tick_);
+    scheduled_tick_ = NotScheduled;
+
+    ticking_ = true;
+    advance_to(target);
+    run_expired(now);
+    ticking_ = false;
+
+    schedule();
+}
+
+// ---
+
+WheelTimerMaker::WheelTimerMaker(event_base* base, std::chrono::milliseconds tick)
+    : wheel_{ std::make_unique<Wheel>(base, tick) }
+{
+}
+
+WheelTimerMaker::~WheelTimerMaker() = default;
+
+std::unique_ptr<Timer> WheelTimerMaker::create()
+{
+    return std::make_unique<WheelTimer>(*wheel_);
+}
+
+size_t WheelTimerMaker::size() const noexcept
+{
+    return wheel_->size();
+}
+
+} // namespace libtransmission
@@ -0,0 +1,55 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#include <chrono>
+#include <cstddef> // size_t
+#include <memory>
+
+#include "libtransmission/timer.h"
+
+extern "C"
+{
+    struct event_base;
+}
+
+namespace libtransmission
+{
+
+// Makes timers that share a single libevent event instead of each
+// having their own. Running timers live in a hierarchical timer wheel,
+// so starting or stopping one is O(1) no matter how many are running,
+// and all the timers that are due in the same tick are run in one batch.
+//
+// Timers fire on tick boundaries, so they may run up to `tick` late.
+// Timers may outlive their maker, but can't be started once it's gone.
+class WheelTimerMaker final : public TimerMaker
+{
+public:
+    static auto constexpr DefaultTick = std::chrono::milliseconds{ 5 };
+
+    explicit WheelTimerMaker(event_base* base, std::chrono::milliseconds tick = DefaultTick);
+    ~WheelTimerMaker() override;
+
+    WheelTimerMaker(WheelTimerMaker&&) = delete;
+    WheelTimerMaker(WheelTimerMaker const&) = delete;
+    WheelTimerMaker& operator=(WheelTimerMaker&&) = delete;
+    WheelTimerMaker& operator=(WheelTimerMaker const&) = delete;
+
+    using TimerMaker::create;
+
+    [[nodiscard]] std::unique_ptr<Timer> create() override;
+
+    // @return how many of this maker's timers are running
+    [[nodiscard]] size_t size() const noexcept;
+
+    class Wheel;
+
+private:
+    std::unique_ptr<Wheel> const wheel_;
+};
+
+} // namespace libtransmission
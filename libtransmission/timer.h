@@ -10,6 +10,8 @@
 #include <memory>
 #include <utility>
 
+#include "libtransmission/tr-macros.h" // tr_source_location
+
 namespace libtransmission
 {
 
@@ -56,6 +58,20 @@ public:
     {
         set_callback([user_data, callback]() { callback(user_data); });
     }
+
+    // Where the timer was made, so that slow callbacks can be traced back to it.
+    void set_source_location(tr_source_location where) noexcept
+    {
+        where_ = where;
+    }
+
+    [[nodiscard]] constexpr auto const& source_location() const noexcept
+    {
+        return where_;
+    }
+
+private:
+    tr_source_location where_;
 };
 
 class TimerMaker
@@ -64,16 +80,28 @@ public:
     virtual ~TimerMaker() = default;
     [[nodiscard]] virtual std::unique_ptr<Timer> create() = 0;
 
-    [[nodiscard]] std::unique_ptr<Timer> create(std::function<void()> callback)
+    [[nodiscard]] std::unique_ptr<Timer> create(tr_source_location where)
     {
         auto timer = create();
+        timer->set_source_location(where);
+        return timer;
+    }
+
+    [[nodiscard]] std::unique_ptr<Timer> create(
+        std::function<void()> callback,
+        tr_source_location where = tr_source_location::current())
+    {
+        auto timer = create(where);
         timer->set_callback(std::move(callback));
         return timer;
     }
 
-    [[nodiscard]] std::unique_ptr<Timer> create(Timer::CStyleCallback callback, void* user_data)
+    [[nodiscard]] std::unique_ptr<Timer> create(
+        Timer::CStyleCallback callback,
+        void* user_data,
+        tr_source_location where = tr_source_location::current())
     {
-        auto timer = create();
+        auto timer = create(where);
         timer->set_callback(callback, user_data);
         return timer;
     }
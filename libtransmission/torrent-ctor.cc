@@ -21,6 +21,7 @@
 #include "libtransmission/torrent.h"
 #include "libtransmission/tr-assert.h"
 #include "libtransmission/utils.h"
+#include "libtransmission/verify-manifest.h"
 
 using namespace std::literals;
 
@@ -60,6 +61,12 @@ struct tr_ctor
 
     std::vector<char> contents;
 
+    // a resume file that was read ahead of time, e.g. by a worker thread
+    std::string resume_filename;
+    std::vector<char> resume_contents;
+
+    std::optional<tr_verify_manifest> verify_manifest;
+
     explicit tr_ctor(tr_session const* session_in)
         : session{ session_in }
     {
@@ -76,6 +83,7 @@ bool tr_ctorSetMetainfoFromFile(tr_ctor* ctor, std::string_view filename, tr_err
         return false;
     }
 
+    ctor->resume_filename.clear();
     if (!tr_file_read(filename, ctor->contents, error))
     {
         return false;
@@ -94,14 +102,24 @@ bool tr_ctorSetMetainfoFromFile(tr_ctor* ctor, char const* filename, tr_error**
 bool tr_ctorSetMetainfo(tr_ctor* ctor, char const* metainfo, size_t len, tr_error** error)
 {
     ctor->torrent_filename.clear();
+    ctor->resume_filename.clear();
     ctor->contents.assign(metainfo, metainfo + len);
     auto const contents_sv = std::string_view{ std::data(ctor->contents), std::size(ctor->contents) };
     return ctor->metainfo.parse_benc(contents_sv, error);
 }
 
+void tr_ctorSetMetainfo(tr_ctor* ctor, tr_torrent_metainfo&& metainfo, std::vector<char>&& contents, std::string_view filename)
+{
+    ctor->torrent_filename = filename;
+    ctor->resume_filename.clear();
+    ctor->contents = std::move(contents);
+    ctor->metainfo = std::move(metainfo);
+}
+
 bool tr_ctorSetMetainfoFromMagnetLink(tr_ctor* ctor, std::string_view magnet_link, tr_error** error)
 {
     ctor->torrent_filename.clear();
+    ctor->resume_filename.clear();
     ctor->metainfo = {};
     return ctor->metainfo.parseMagnet(magnet_link, error);
 }
@@ -287,6 +305,29 @@ bool tr_ctorGetIncompleteDir(tr_ctor const* ctor, char const** setme)
     return true;
 }
 
+void tr_ctorSetResumeContents(tr_ctor* ctor, std::string_view filename, std::vector<char>&& contents)
+{
+    ctor->resume_filename = filename;
+    ctor->resume_contents = std::move(contents);
+}
+
+std::vector<char> const* tr_ctorGetResumeContents(tr_ctor const* ctor, std::string_view filename)
+{
+    return ctor != nullptr && !std::empty(ctor->resume_filename) && ctor->resume_filename == filename ?
+        &ctor->resume_contents :
+        nullptr;
+}
+
+void tr_ctorSetVerifyManifest(tr_ctor* ctor, tr_verify_manifest&& manifest)
+{
+    ctor->verify_manifest = std::move(manifest);
+}
+
+std::optional<tr_verify_manifest> const& tr_ctorGetVerifyManifest(tr_ctor const* ctor)
+{
+    return ctor->verify_manifest;
+}
+
 tr_torrent_metainfo tr_ctorStealMetainfo(tr_ctor* ctor)
 {
     auto metainfo = tr_torrent_metainfo{};
@@ -144,7 +144,7 @@ bool tr_torrent_files::hasAnyLocalData(std::string_view const* paths, size_t n_p
 {
     for (tr_file_index_t i = 0, n = fileCount(); i < n; ++i)
     {
-        if (find(i, paths, n_paths))
+        if (!isPadding(i) && find(i, paths, n_paths))
         {
             return true;
         }
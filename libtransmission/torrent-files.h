@@ -50,6 +50,13 @@ public:
         return total_size_;
     }
 
+    // BEP 47 padding files only hold zeroes, to align the next file with a piece.
+    // They're never written to disk.
+    [[nodiscard]] TR_CONSTEXPR20 bool isPadding(tr_file_index_t file_index) const
+    {
+        return files_.at(file_index).is_padding_;
+    }
+
     [[nodiscard]] TR_CONSTEXPR20 std::string const& path(tr_file_index_t file_index) const
     {
         return files_.at(file_index).path_;
@@ -102,10 +109,10 @@ public:
         return ret;
     }
 
-    tr_file_index_t add(std::string_view path, uint64_t file_size)
+    tr_file_index_t add(std::string_view path, uint64_t file_size, bool is_padding = false)
     {
         auto const ret = static_cast<tr_file_index_t>(std::size(files_));
-        files_.emplace_back(path, file_size);
+        files_.emplace_back(path, file_size, is_padding);
         total_size_ += file_size;
         return ret;
     }
@@ -185,14 +192,16 @@ private:
             }
         }
 
-        file_t(std::string_view path, uint64_t size)
+        file_t(std::string_view path, uint64_t size, bool is_padding)
             : path_{ path }
             , size_{ size }
+            , is_padding_{ is_padding }
         {
         }
 
         std::string path_;
         uint64_t size_ = 0;
+        bool is_padding_ = false;
     };
 
     std::vector<file_t> files_;
@@ -4,12 +4,14 @@
 // License text can be found in the licenses/ folder.
 
 #include <algorithm>
+#include <chrono>
 #include <climits> /* INT_MAX */
+#include <cstdint> // uint64_t
 #include <cstdlib>
 #include <ctime>
 #include <deque>
-#include <fstream>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include <fmt/core.h>
@@ -20,17 +22,31 @@
 #include "libtransmission/error.h"
 #include "libtransmission/file.h"
 #include "libtransmission/quark.h"
+#include "libtransmission/session.h"
 #include "libtransmission/torrent-magnet.h"
 #include "libtransmission/torrent-metainfo.h"
 #include "libtransmission/torrent.h"
 #include "libtransmission/tr-assert.h"
+#include "libtransmission/tr-strbuf.h"
 #include "libtransmission/utils.h"
 #include "libtransmission/variant.h"
+#include "libtransmission/web.h"
+
+using namespace std::literals;
 
 namespace
 {
-// don't ask for the same metadata piece more than this often
-auto constexpr MinRepeatIntervalSecs = int{ 3 };
+// how long to wait for an answer to a metadata request before asking
+// again, as a multiple of the usual answer time and within these bounds
+auto constexpr RequestTimeoutRtts = uint64_t{ 3U };
+auto constexpr MinRequestTimeoutMsec = uint64_t{ 1000U };
+auto constexpr MaxRequestTimeoutMsec = uint64_t{ 15000U };
+
+// how long a running magnet waits on peers before trying the metadata cache url
+auto constexpr MetadataCacheDelaySecs = time_t{ 15 };
+
+// how often a running magnet looks for its .torrent in the metadata cache dir
+auto constexpr MetadataCacheDirIntervalSecs = time_t{ 5 };
 
 auto create_all_needed(int n_pieces)
 {
@@ -51,6 +67,35 @@ auto create_all_needed(int n_pieces)
     auto const [quot, rem] = std::div(numerator, denominator);
     return quot + (rem == 0 ? 0 : 1);
 }
+
+[[nodiscard]] tr_pathbuf get_metadata_cache_filename(tr_torrent const* tor)
+{
+    return tr_pathbuf{ tor->session->metadataCacheDir(), '/', tor->info_hash_string(), ".torrent"sv };
+}
+
+// share the metainfo with other sessions that use the same metadata cache dir
+void save_to_metadata_cache_dir(tr_torrent const* tor, std::string_view benc)
+{
+    if (std::empty(tor->session->metadataCacheDir()))
+    {
+        return;
+    }
+
+    auto const filename = get_metadata_cache_filename(tor);
+    tr_error* error = nullptr;
+    if (!tr_sys_dir_create(tor->session->metadataCacheDir(), TR_SYS_DIR_CREATE_PARENTS, 0777, &error) ||
+        !tr_file_save(filename, benc, &error))
+    {
+        tr_logAddWarnTor(
+            tor,
+            fmt::format(
+                _("Couldn't save '{path}': {error} ({error_code})"),
+                fmt::arg("path", filename),
+                fmt::arg("error", error->message),
+                fmt::arg("error_code", error->code)));
+        tr_error_clear(&error);
+    }
+}
 } // namespace
 
 bool tr_torrentSetMetadataSizeHint(tr_torrent* tor, int64_t size)
@@ -103,24 +148,20 @@ bool tr_torrentGetMetadataPiece(tr_torrent const* tor, int piece, tr_metadata_pi
         return {};
     }
 
-    auto in = std::ifstream{ tor->torrent_file(), std::ios_base::in };
-    if (!in.is_open())
-    {
-        return {};
-    }
-
     auto const info_dict_size = tor->info_dict_size();
     TR_ASSERT(info_dict_size > 0);
     auto const offset_in_info_dict = static_cast<uint64_t>(piece) * MetadataPieceSize;
-    if (auto const offset_in_file = tor->info_dict_offset() + offset_in_info_dict; !in.seekg(offset_in_file))
-    {
-        return {};
-    }
-
     auto const piece_len = offset_in_info_dict + MetadataPieceSize <= info_dict_size ? MetadataPieceSize :
                                                                                        info_dict_size - offset_in_info_dict;
     setme.resize(piece_len);
-    return !!in.read(reinterpret_cast<char*>(std::data(setme)), std::size(setme));
+    return tor->session->info_dict_cache().read(
+        tor->id(),
+        tor->torrent_file(),
+        tor->info_dict_offset(),
+        info_dict_size,
+        offset_in_info_dict,
+        std::size(setme),
+        std::data(setme));
 }
 
 bool tr_torrentUseMetainfoFromFile(
@@ -217,18 +258,13 @@ void build_metainfo_except_info_dict(tr_torrent_metainfo const& tm, tr_variant*
     }
 }
 
+// the caller has already checked the metadata against the info hash
 bool use_new_metainfo(tr_torrent* tor, tr_error** error)
 {
     auto const& m = tor->incomplete_metadata;
     TR_ASSERT(m);
 
-    // test the info_dict checksum
-    if (tr_sha1::digest(m->metadata) != tor->info_hash())
-    {
-        return false;
-    }
-
-    // checksum passed; now try to parse it as benc
+    // try to parse it as benc
     auto info_dict_v = tr_variant{};
     if (!tr_variantFromBuf(&info_dict_v, TR_VARIANT_PARSE_BENC | TR_VARIANT_PARSE_INPLACE, m->metadata, nullptr, error))
     {
@@ -256,6 +292,8 @@ bool use_new_metainfo(tr_torrent* tor, tr_error** error)
         return false;
     }
 
+    save_to_metadata_cache_dir(tor, benc);
+
     // remove .magnet file
     tr_sys_path_remove(tor->magnet_file());
 
@@ -265,6 +303,26 @@ bool use_new_metainfo(tr_torrent* tor, tr_error** error)
     return true;
 }
 
+void redownload_metainfo(tr_torrent* tor, char const* msg)
+{
+    auto& m = tor->incomplete_metadata;
+    TR_ASSERT(m);
+
+    auto const n = m->piece_count;
+    m->pieces_needed = create_all_needed(n);
+    m->use_timer.reset();
+
+    tr_logAddWarnTor(
+        tor,
+        fmt::format(
+            tr_ngettext(
+                "Couldn't parse magnet metainfo: '{error}'. Redownloading {piece_count} piece",
+                "Couldn't parse magnet metainfo: '{error}'. Redownloading {piece_count} pieces",
+                n),
+            fmt::arg("error", msg),
+            fmt::arg("piece_count", n)));
+}
+
 void on_have_all_metainfo(tr_torrent* tor)
 {
     tr_error* error = nullptr;
@@ -276,36 +334,142 @@ void on_have_all_metainfo(tr_torrent* tor)
     }
     else /* drat. */
     {
-        auto const n = m->piece_count;
+        redownload_metainfo(tor, error != nullptr && error->message != nullptr ? error->message : "unknown error");
+        tr_error_clear(&error);
+    }
+}
+
+// Check the metadata as soon as the last piece is in, so that a bad piece
+// is redownloaded right away. Using it can stop the torrent and its peers,
+// so that part waits until we're out of the peer's message handler.
+void on_got_all_pieces(tr_torrent* tor)
+{
+    auto& m = tor->incomplete_metadata;
+    TR_ASSERT(m);
+
+    if (tr_sha1::digest(m->metadata) != tor->info_hash())
+    {
+        redownload_metainfo(tor, "info hash mismatch");
+        return;
+    }
+
+    tr_logAddDebugTor(tor, fmt::format("we now have all the metainfo!"));
+    m->use_timer = tor->session->timerMaker().create([tor]() { on_have_all_metainfo(tor); });
+    m->use_timer->start_single_shot(0ms);
+}
+
+[[nodiscard]] constexpr uint64_t get_request_timeout_msec(tr_incomplete_metadata const& m) noexcept
+{
+    return std::clamp(m.rtt_msec * RequestTimeoutRtts, MinRequestTimeoutMsec, MaxRequestTimeoutMsec);
+}
+} // namespace set_metadata_piece_helpers
+
+namespace metadata_cache_helpers
+{
+[[nodiscard]] std::string get_metadata_cache_url(std::string_view url_template, std::string_view info_hash)
+{
+    auto url = std::string{ url_template };
+    if (auto const pos = url.find("%s"); pos != std::string::npos)
+    {
+        url.replace(pos, 2U, info_hash);
+    }
+    else
+    {
+        url += info_hash;
+    }
+    return url;
+}
 
-        m->pieces_needed = create_all_needed(n);
+// @return true if `benc` was a usable .torrent for `tor`
+bool use_cached_metainfo(tr_torrent* tor, std::string_view benc)
+{
+    // don't trust the cache: only use metainfo that matches the magnet
+    auto metainfo = tr_torrent_metainfo{};
+    if (!metainfo.parse_benc(benc) || metainfo.info_hash() != tor->info_hash())
+    {
+        tr_logAddDebugTor(tor, "metadata cache didn't have a usable .torrent");
+        return false;
+    }
 
-        char const* const msg = error != nullptr && error->message != nullptr ? error->message : "unknown error";
+    tr_error* error = nullptr;
+    if (!tr_file_save(tor->torrent_file(), benc, &error))
+    {
         tr_logAddWarnTor(
             tor,
             fmt::format(
-                tr_ngettext(
-                    "Couldn't parse magnet metainfo: '{error}'. Redownloading {piece_count} piece",
-                    "Couldn't parse magnet metainfo: '{error}'. Redownloading {piece_count} pieces",
-                    n),
-                fmt::arg("error", msg),
-                fmt::arg("piece_count", n)));
+                _("Couldn't save '{path}': {error} ({error_code})"),
+                fmt::arg("path", tor->torrent_file()),
+                fmt::arg("error", error->message),
+                fmt::arg("error_code", error->code)));
         tr_error_clear(&error);
+        return false;
     }
+
+    tr_logAddDebugTor(tor, "got the metainfo from the metadata cache");
+    tr_sys_path_remove(tor->magnet_file());
+    tor->incomplete_metadata.reset();
+    tor->set_metainfo(metainfo);
+    return true;
 }
-} // namespace set_metadata_piece_helpers
+
+void on_metadata_cache_fetched(tr_session* session, tr_torrent_id_t tor_id, std::string const& benc)
+{
+    if (auto* const tor = session->torrents().get(tor_id); tor != nullptr && !tor->has_metainfo())
+    {
+        if (use_cached_metainfo(tor, benc))
+        {
+            save_to_metadata_cache_dir(tor, benc);
+        }
+    }
+}
+
+// @return true if the metainfo was found in the metadata cache dir
+bool maybe_read_from_metadata_cache_dir(tr_torrent* tor)
+{
+    auto const now = tr_time();
+    if (std::empty(tor->session->metadataCacheDir()) ||
+        tor->metadata_cache_dir_checked_at + MetadataCacheDirIntervalSecs > now)
+    {
+        return false;
+    }
+
+    // another session may have finished downloading it since last time, so keep looking
+    tor->metadata_cache_dir_checked_at = now;
+    auto const filename = get_metadata_cache_filename(tor);
+    auto benc = std::vector<char>{};
+    return tr_sys_path_exists(filename) && tr_file_read(filename, benc) &&
+        use_cached_metainfo(tor, std::string_view{ std::data(benc), std::size(benc) });
+}
+
+void maybe_fetch_from_metadata_cache(tr_torrent* tor)
+{
+    auto* const session = tor->session;
+    auto const& url_template = session->metadataCacheUrl();
+    if (std::empty(url_template) || tor->metadata_cache_tried || tr_time() < tor->startDate + MetadataCacheDelaySecs)
+    {
+        return;
+    }
+
+    tor->metadata_cache_tried = true;
+    auto const url = get_metadata_cache_url(url_template, tor->info_hash_string().sv());
+    tr_logAddDebugTor(tor, fmt::format("peers are slow; asking the metadata cache '{}'", url));
+    session->fetch({ url,
+                     [session, tor_id = tor->id()](tr_web::FetchResponse const& response)
+                     { on_metadata_cache_fetched(session, tor_id, response.body); },
+                     nullptr });
+}
+} // namespace metadata_cache_helpers
 } // namespace
 
 void tr_torrentMagnetDoIdleWork(tr_torrent* const tor)
 {
-    using namespace set_metadata_piece_helpers;
+    using namespace metadata_cache_helpers;
 
     TR_ASSERT(tr_isTorrent(tor));
 
-    if (auto const& m = tor->incomplete_metadata; m && std::empty(m->pieces_needed))
+    if (!tor->has_metainfo() && tor->is_running() && !maybe_read_from_metadata_cache_dir(tor))
     {
-        tr_logAddDebugTor(tor, fmt::format("we now have all the metainfo!"));
-        on_have_all_metainfo(tor);
+        maybe_fetch_from_metadata_cache(tor);
     }
 }
 
@@ -351,14 +515,56 @@ void tr_torrentSetMetadataPiece(tr_torrent* tor, int piece, void const* data, si
     size_t const offset = piece * MetadataPieceSize;
     std::copy_n(reinterpret_cast<char const*>(data), len, std::begin(m->metadata) + offset);
 
+    // learn how long peers take to answer, to time out the ones that don't
+    if (auto const requested_at = iter->requested_at_msec; requested_at != 0U)
+    {
+        auto const now = tr_time_msec();
+        auto const sample = now > requested_at ? now - requested_at : uint64_t{};
+        m->rtt_msec = (m->rtt_msec * 7U + sample) / 8U;
+    }
+
     needed.erase(iter);
     tr_logAddDebugTor(tor, fmt::format("saving metainfo piece {}... {} remain", piece, std::size(needed)));
+
+    if (std::empty(needed))
+    {
+        on_got_all_pieces(tor);
+    }
+}
+
+void tr_torrentMetadataPieceRejected(tr_torrent* tor, int piece)
+{
+    TR_ASSERT(tr_isTorrent(tor));
+
+    auto& m = tor->incomplete_metadata;
+    if (!m)
+    {
+        return;
+    }
+
+    auto& needed = m->pieces_needed;
+    auto const iter = std::find_if(
+        std::begin(needed),
+        std::end(needed),
+        [piece](auto const& item) { return item.piece == piece; });
+    if (iter == std::end(needed))
+    {
+        return;
+    }
+
+    // move it to the front of the line
+    auto node = *iter;
+    node.requested_at_msec = 0U;
+    needed.erase(iter);
+    needed.push_front(node);
 }
 
 // ---
 
-std::optional<int> tr_torrentGetNextMetadataRequest(tr_torrent* tor, time_t now)
+std::optional<int> tr_torrentGetNextMetadataRequest(tr_torrent* tor, uint64_t now_msec)
 {
+    using namespace set_metadata_piece_helpers;
+
     TR_ASSERT(tr_isTorrent(tor));
 
     auto& m = tor->incomplete_metadata;
@@ -368,14 +574,19 @@ std::optional<int> tr_torrentGetNextMetadataRequest(tr_torrent* tor, time_t now)
     }
 
     auto& needed = m->pieces_needed;
-    if (std::empty(needed) || needed.front().requested_at + MinRepeatIntervalSecs >= now)
+    if (std::empty(needed))
+    {
+        return {};
+    }
+
+    if (auto const then = needed.front().requested_at_msec; then != 0U && then + get_request_timeout_msec(*m) > now_msec)
     {
         return {};
     }
 
     auto req = needed.front();
     needed.pop_front();
-    req.requested_at = now;
+    req.requested_at_msec = now_msec;
     needed.push_back(req);
     tr_logAddDebugTor(tor, fmt::format("next piece to request: {}", req.piece));
     return req.piece;
@@ -10,14 +10,17 @@
 #endif
 
 #include <cstddef> // size_t
-#include <cstdint> // int64_t
+#include <cstdint> // int64_t, uint64_t
 #include <ctime> // time_t
 #include <deque>
+#include <memory>
 #include <optional>
 #include <vector>
 
 #include <small/vector.hpp>
 
+#include "libtransmission/timer.h"
+
 struct tr_error;
 struct tr_torrent;
 struct tr_torrent_metainfo;
@@ -29,9 +32,12 @@ using tr_metadata_piece = small::max_size_vector<std::byte, MetadataPieceSize>;
 
 struct tr_incomplete_metadata
 {
+    // our first guess at how long peers take to answer metadata requests
+    static auto constexpr DefaultRttMsec = uint64_t{ 1000U };
+
     struct metadata_node
     {
-        time_t requested_at = 0U;
+        uint64_t requested_at_msec = 0U;
         int piece = 0;
     };
 
@@ -41,13 +47,24 @@ struct tr_incomplete_metadata
     std::deque<metadata_node> pieces_needed;
 
     int piece_count = 0;
+
+    // smoothed time between requesting a piece and getting it,
+    // used to decide when an unanswered request should be sent again
+    uint64_t rtt_msec = DefaultRttMsec;
+
+    // set once all the pieces are in and match the info hash.
+    // the metainfo is used when it fires, outside of any peer callbacks.
+    std::unique_ptr<libtransmission::Timer> use_timer;
 };
 
 bool tr_torrentGetMetadataPiece(tr_torrent const* tor, int piece, tr_metadata_piece& setme);
 
 void tr_torrentSetMetadataPiece(tr_torrent* tor, int piece, void const* data, size_t len);
 
-std::optional<int> tr_torrentGetNextMetadataRequest(tr_torrent* tor, time_t now);
+// A peer said it won't send us `piece`, so ask someone else right away
+void tr_torrentMetadataPieceRejected(tr_torrent* tor, int piece);
+
+std::optional<int> tr_torrentGetNextMetadataRequest(tr_torrent* tor, uint64_t now_msec);
 
 bool tr_torrentSetMetadataSizeHint(tr_torrent* tor, int64_t metadata_size);
 
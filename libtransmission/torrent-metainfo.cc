@@ -5,8 +5,12 @@
 
 #include <algorithm>
 #include <cerrno> // for EINVAL
+#include <cstdint> // uint64_t
+#include <map>
+#include <optional>
 #include <string>
 #include <string_view>
+#include <utility> // std::exchange()
 #include <vector>
 
 #include <fmt/core.h>
@@ -18,6 +22,7 @@
 #include "libtransmission/error.h"
 #include "libtransmission/file.h"
 #include "libtransmission/log.h"
+#include "libtransmission/merkle.h"
 #include "libtransmission/torrent-metainfo.h"
 #include "libtransmission/tr-assert.h"
 #include "libtransmission/tr-strbuf.h"
@@ -71,6 +76,13 @@ struct MetainfoHandler final : public transmission::benc::BasicHandler<MaxBencDe
     tr_pathbuf file_subpath_;
     std::string_view pieces_root_;
     int64_t file_length_ = 0;
+    bool file_is_padding_ = false;
+
+    // bittorrent v2: each file's merkle tree root, keyed by its
+    // portable subpath; the v1 files' roots; and the piece layers
+    std::map<std::string, std::string_view, std::less<>> file_tree_roots_;
+    std::vector<std::string_view> file_roots_;
+    std::map<std::string_view, std::string_view> piece_layers_;
 
     enum class State
     {
@@ -82,8 +94,11 @@ struct MetainfoHandler final : public transmission::benc::BasicHandler<MaxBencDe
     };
     State state_ = State::UsePath;
 
-    explicit MetainfoHandler(tr_torrent_metainfo& tm)
+    bool want_piece_hashes_ = true;
+
+    explicit MetainfoHandler(tr_torrent_metainfo& tm, bool want_piece_hashes)
         : tm_{ tm }
+        , want_piece_hashes_{ want_piece_hashes }
     {
     }
 
@@ -94,15 +109,7 @@ struct MetainfoHandler final : public transmission::benc::BasicHandler<MaxBencDe
 
     bool StartDict(Context const& context) override
     {
-        if (state_ == State::FileTree)
-        {
-            if (!std::empty(file_subpath_))
-            {
-                file_subpath_ += '/';
-            }
-            tr_torrent_files::makeSubpathPortable(currentKey(), file_subpath_);
-        }
-        else if (pathIs(InfoKey))
+        if (pathIs(InfoKey))
         {
             info_dict_begin_ = context.raw();
             tm_.info_dict_offset_ = context.tokenSpan().first;
@@ -137,9 +144,14 @@ struct MetainfoHandler final : public transmission::benc::BasicHandler<MaxBencDe
 
         if (state_ == State::FileTree) // bittorrent v2 format
         {
-            // v2, ignore for today
-            tr_logAddInfo("'file tree' is ignored");
-            state_ = State::UsePath;
+            if (depth() == 2 && currentKey() == FileTreeKey)
+            {
+                state_ = State::UsePath;
+            }
+            else if (depth() > 3 && std::empty(currentKey()))
+            {
+                addFileTreeEntry();
+            }
         }
         else if (state_ == State::Files) // bittorrent v1 format
         {
@@ -281,7 +293,11 @@ struct MetainfoHandler final : public transmission::benc::BasicHandler<MaxBencDe
         }
         else if (state_ == State::FileTree)
         {
-            if (current_key == AttrKey || current_key == PiecesRootKey)
+            if (current_key == PiecesRootKey)
+            {
+                pieces_root_ = value;
+            }
+            else if (current_key == AttrKey)
             {
                 // currently unused. TODO support for bittorrent v2
                 // TODO https://github.com/transmission/transmission/issues/458
@@ -303,8 +319,9 @@ struct MetainfoHandler final : public transmission::benc::BasicHandler<MaxBencDe
             }
             else if (current_key == AttrKey)
             {
-                // currently unused. TODO support for bittorrent v2
-                // TODO https://github.com/transmission/transmission/issues/458
+                // BEP 47: 'p' marks a padding file. The other attributes
+                // (executable, hidden, symlink) are unused by Transmission.
+                file_is_padding_ = tr_strv_contains(value, 'p');
             }
             else if (
                 pathIs(InfoKey, FilesKey, ""sv, Crc32Key) || //
@@ -361,9 +378,17 @@ struct MetainfoHandler final : public transmission::benc::BasicHandler<MaxBencDe
         {
             if (std::size(value) % sizeof(tr_sha1_digest_t) == 0)
             {
-                auto const n = std::size(value) / sizeof(tr_sha1_digest_t);
-                tm_.pieces_.resize(n);
-                std::copy_n(std::data(value), std::size(value), reinterpret_cast<char*>(std::data(tm_.pieces_)));
+                if (want_piece_hashes_)
+                {
+                    auto const n = std::size(value) / sizeof(tr_sha1_digest_t);
+                    tm_.pieces_.resize(n);
+                    std::copy_n(std::data(value), std::size(value), reinterpret_cast<char*>(std::data(tm_.pieces_)));
+                }
+                else
+                {
+                    tm_.piece_hashes_dropped_ = !std::empty(value);
+                }
+
                 tm_.pieces_offset_ = context.tokenSpan().first;
             }
             else
@@ -372,10 +397,9 @@ struct MetainfoHandler final : public transmission::benc::BasicHandler<MaxBencDe
                 unhandled = true;
             }
         }
-        else if (pathStartsWith(PieceLayersKey))
+        else if (curdepth == 2 && pathStartsWith(PieceLayersKey))
         {
-            // currently unused. TODO support for bittorrent v2
-            // TODO https://github.com/transmission/transmission/issues/458
+            piece_layers_.try_emplace(current_key, value);
         }
         else if (pathStartsWith(AnnounceListKey))
         {
@@ -461,6 +485,7 @@ private:
     {
         bool ok = true;
 
+        auto const is_padding = std::exchange(file_is_padding_, false);
         if (file_length_ == 0)
         {
             return ok;
@@ -475,7 +500,7 @@ private:
         }
         else
         {
-            tm_.files_.add(file_subpath_, file_length_);
+            tm_.files_.add(file_subpath_, file_length_, is_padding);
         }
 
         file_length_ = 0;
@@ -485,6 +510,113 @@ private:
         return ok;
     }
 
+    // A file in the v2 file tree, e.g. `{ "dir": { "file": { "": { "length": ..., "pieces root": ... } } } }`.
+    // Its path is the keys between "file tree" and "".
+    void addFileTreeEntry()
+    {
+        if (file_length_ > 0 && std::size(pieces_root_) == sizeof(tr_sha256_digest_t))
+        {
+            file_subpath_.clear();
+            for (size_t i = 3; i < depth(); ++i)
+            {
+                if (!std::empty(file_subpath_))
+                {
+                    file_subpath_ += '/';
+                }
+                tr_torrent_files::makeSubpathPortable(key(i), file_subpath_);
+            }
+
+            file_tree_roots_.try_emplace(std::string{ file_subpath_.sv() }, pieces_root_);
+        }
+
+        file_length_ = 0;
+        pieces_root_ = {};
+    }
+
+    [[nodiscard]] std::string_view findFileTreeRoot(std::string_view subpath) const
+    {
+        auto const iter = file_tree_roots_.find(subpath);
+        return iter != std::end(file_tree_roots_) ? iter->second : std::string_view{};
+    }
+
+    // For hybrid torrents, find the part of a v2 merkle tree that covers each v1 piece.
+    // Files that are missing from the file tree or whose piece layer doesn't match their
+    // root have no v2 hashes, but the v1 hashes still cover them.
+    void buildPieceRoots()
+    {
+        auto const& block_info = tm_.block_info_;
+        auto const piece_size = block_info.piece_size();
+        auto const leaves_per_piece = size_t{ piece_size / TR_MERKLE_BLOCK_SIZE };
+        if (piece_size % TR_MERKLE_BLOCK_SIZE != 0U || leaves_per_piece != tr_merkle_width(leaves_per_piece))
+        {
+            return;
+        }
+
+        auto const zero_piece = tr_merkle_pad(leaves_per_piece);
+        auto roots = std::vector<tr_merkle_subtree>(block_info.piece_count());
+        auto has_roots = false;
+
+        auto offset = uint64_t{};
+        for (tr_file_index_t i = 0, n = tm_.files_.fileCount(); i < n; ++i)
+        {
+            auto const file_size = tm_.files_.fileSize(i);
+            auto const root = i < std::size(file_roots_) ? file_roots_[i] : std::string_view{};
+            auto const begin_offset = offset;
+            offset += file_size;
+            if (std::empty(root))
+            {
+                continue;
+            }
+
+            if (begin_offset % piece_size != 0U)
+            {
+                tr_logAddWarn(fmt::format("v2 file '{:s}' isn't aligned to a piece", tm_.files_.path(i)), tm_.name());
+                continue;
+            }
+
+            auto file_root = tr_sha256_digest_t{};
+            std::copy_n(std::data(root), std::size(root), reinterpret_cast<char*>(std::data(file_root)));
+            auto const first_piece = static_cast<tr_piece_index_t>(begin_offset / piece_size);
+            auto const n_pieces = static_cast<size_t>((file_size + piece_size - 1U) / piece_size);
+            auto const final_size = static_cast<uint32_t>(file_size - (n_pieces - 1U) * piece_size);
+
+            if (n_pieces == 1U)
+            {
+                // the file fits in one piece, so it has no piece layer
+                roots[first_piece] = { file_root, tr_merkle_width(tr_merkle_leaf_count(file_size)), final_size };
+                has_roots = true;
+                continue;
+            }
+
+            auto const layer_iter = piece_layers_.find(root);
+            if (layer_iter == std::end(piece_layers_) || std::size(layer_iter->second) != n_pieces * sizeof(tr_sha256_digest_t))
+            {
+                tr_logAddWarn(fmt::format("v2 file '{:s}' has no piece layer", tm_.files_.path(i)), tm_.name());
+                continue;
+            }
+
+            auto const layer_bytes = layer_iter->second;
+            auto layer = std::vector<tr_sha256_digest_t>(n_pieces);
+            std::copy_n(std::data(layer_bytes), std::size(layer_bytes), reinterpret_cast<char*>(std::data(layer)));
+            if (tr_merkle_root(layer, tr_merkle_width(n_pieces), zero_piece) != file_root)
+            {
+                tr_logAddWarn(fmt::format("v2 file '{:s}' has an invalid piece layer", tm_.files_.path(i)), tm_.name());
+                continue;
+            }
+
+            for (size_t k = 0; k < n_pieces; ++k)
+            {
+                roots[first_piece + k] = { layer[k], leaves_per_piece, k + 1U == n_pieces ? final_size : piece_size };
+            }
+            has_roots = true;
+        }
+
+        if (has_roots)
+        {
+            tm_.piece_roots_ = std::move(roots);
+        }
+    }
+
     bool finishInfoDict(Context const& context)
     {
         if (std::empty(info_dict_begin_))
@@ -493,6 +625,16 @@ private:
             return false;
         }
 
+        // hybrid torrents: match the v1 files with their v2 merkle tree roots
+        if (!std::empty(file_tree_roots_))
+        {
+            file_roots_.resize(tm_.files_.fileCount());
+            for (tr_file_index_t i = 0, n = tm_.files_.fileCount(); i < n; ++i)
+            {
+                file_roots_[i] = findFileTreeRoot(tm_.files_.path(i));
+            }
+        }
+
         auto root = tr_pathbuf{};
         tr_torrent_files::makeSubpathPortable(tm_.name_, root);
         if (!std::empty(root))
@@ -529,6 +671,10 @@ private:
         if (tm_.file_count() == 0 && length_ != 0 && !std::empty(tm_.name_))
         {
             tm_.files_.add(tm_.name_, length_);
+
+            auto subpath = tr_pathbuf{};
+            tr_torrent_files::makeSubpathPortable(tm_.name_, subpath);
+            file_roots_ = { findFileTreeRoot(subpath) };
         }
 
         if (auto const has_metainfo = tm_.info_dict_size() != 0U; has_metainfo)
@@ -553,6 +699,12 @@ private:
             }
 
             tm_.block_info_.init_sizes(tm_.files_.totalSize(), piece_size_);
+
+            if (tm_.is_v2_ && want_piece_hashes_ && tm_.has_v1_metadata())
+            {
+                buildPieceRoots();
+            }
+
             return true;
         }
 
@@ -628,9 +780,14 @@ private:
 };
 
 bool tr_torrent_metainfo::parse_benc(std::string_view benc, tr_error** error)
+{
+    return parse_impl(benc, true, error);
+}
+
+bool tr_torrent_metainfo::parse_impl(std::string_view benc, bool want_piece_hashes, tr_error** error)
 {
     auto stack = transmission::benc::ParserStack<MaxBencDepth>{};
-    auto handler = MetainfoHandler{ *this };
+    auto handler = MetainfoHandler{ *this, want_piece_hashes };
 
     tr_error* my_error = nullptr;
 
@@ -672,6 +829,84 @@ bool tr_torrent_metainfo::parse_torrent_file(std::string_view filename, std::vec
     return tr_file_read(filename, *contents, error) && parse_benc({ std::data(*contents), std::size(*contents) }, error);
 }
 
+bool tr_torrent_metainfo::parse_mapped_torrent_file(std::string_view filename, bool want_piece_hashes, tr_error** error)
+{
+    // everything that's kept is copied out of the mapping,
+    // so it's safe to unmap the file when we're done
+    auto file = tr_mapped_file{};
+    return file.open(filename, error) && parse_impl(file.contents(), want_piece_hashes, error);
+}
+
+void tr_torrent_metainfo::drop_piece_hashes()
+{
+    if (has_piece_hashes())
+    {
+        piece_hashes_dropped_ = true;
+        pieces_ = {};
+    }
+}
+
+std::optional<std::vector<tr_sha1_digest_t>> tr_torrent_metainfo::read_piece_hashes(
+    std::string_view torrent_file,
+    tr_piece_index_t begin,
+    size_t n_pieces,
+    tr_error** error) const
+{
+    TR_ASSERT(begin + n_pieces <= piece_count());
+
+    auto const fd = tr_sys_file_open(tr_pathbuf{ torrent_file }, TR_SYS_FILE_READ, 0, error);
+    if (fd == TR_BAD_SYS_FILE)
+    {
+        return {};
+    }
+
+    // `pieces_offset_` points to the benc string's length prefix.
+    // Check that it still holds the length we expect before trusting it.
+    auto const prefix = fmt::format("{:d}:", uint64_t{ piece_count() } * sizeof(tr_sha1_digest_t));
+    auto buf = std::string(std::size(prefix), '\0');
+    auto n_read = uint64_t{};
+    auto ok = tr_sys_file_read_at(fd, std::data(buf), std::size(buf), pieces_offset_, &n_read, error) &&
+        n_read == std::size(buf);
+    if (ok && buf != prefix)
+    {
+        tr_error_set(error, EINVAL, fmt::format("piece hashes moved in '{:s}'", torrent_file));
+        ok = false;
+    }
+
+    auto hashes = std::vector<tr_sha1_digest_t>(n_pieces);
+    auto const n_bytes = n_pieces * sizeof(tr_sha1_digest_t);
+    ok = ok &&
+        tr_sys_file_read_at(
+             fd,
+             std::data(hashes),
+             n_bytes,
+             pieces_offset_ + std::size(prefix) + uint64_t{ begin } * sizeof(tr_sha1_digest_t),
+             &n_read,
+             error) &&
+        n_read == n_bytes;
+
+    tr_sys_file_close(fd);
+
+    if (!ok)
+    {
+        return {};
+    }
+
+    return hashes;
+}
+
+bool tr_torrent_metainfo::reload_pieces_offset(std::string_view torrent_file, tr_error** error)
+{
+    auto tm = tr_torrent_metainfo{};
+    if (!tm.parse_torrent_file(torrent_file, nullptr, error))
+    {
+        return false;
+    }
+
+    pieces_offset_ = tm.pieces_offset_;
+    return true;
+}
+
 tr_pathbuf tr_torrent_metainfo::make_filename(
     std::string_view dirname,
     std::string_view name,
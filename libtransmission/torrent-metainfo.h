@@ -5,8 +5,10 @@
 
 #pragma once
 
+#include <cstddef> // size_t
 #include <cstdint> // uint32_t, uint64_t
 #include <ctime>
+#include <optional>
 #include <string>
 #include <string_view>
 #include <vector>
@@ -15,6 +17,7 @@
 
 #include "block-info.h"
 #include "magnet-metainfo.h"
+#include "merkle.h"
 #include "torrent-files.h"
 #include "tr-strbuf.h"
 
@@ -36,6 +39,15 @@ public:
     // load multiple files.
     bool parse_torrent_file(std::string_view benc_filename, std::vector<char>* contents = nullptr, tr_error** error = nullptr);
 
+    // Like parse_torrent_file(), but memory-maps the file instead of
+    // copying it into a buffer. Useful when importing many torrents.
+    // If `want_piece_hashes` is false, the piece hashes are checked but
+    // not kept in memory; read_piece_hashes() can still load them later.
+    bool parse_mapped_torrent_file(
+        std::string_view benc_filename,
+        bool want_piece_hashes = true,
+        tr_error** error = nullptr);
+
     // FILES
 
     [[nodiscard]] constexpr auto const& files() const noexcept
@@ -54,6 +66,10 @@ public:
     {
         return files().path(i);
     }
+    [[nodiscard]] TR_CONSTEXPR20 auto file_is_padding(tr_file_index_t i) const
+    {
+        return files().isPadding(i);
+    }
 
     void set_file_subpath(tr_file_index_t i, std::string_view subpath)
     {
@@ -133,11 +149,34 @@ public:
         return pieces_[piece];
     }
 
+    // @return true if the piece hashes are in memory. If they were
+    // dropped, use read_piece_hashes() to get them from the .torrent file.
+    [[nodiscard]] TR_CONSTEXPR20 bool has_piece_hashes() const noexcept
+    {
+        return !std::empty(pieces_);
+    }
+
+    // Free the piece hashes' memory.
+    // Only use this if the metainfo was parsed from a .torrent file that stays on disk.
+    void drop_piece_hashes();
+
+    // Read `n_pieces` hashes, starting at piece `begin`, from the .torrent file
+    // this metainfo was parsed from. @return nullopt if the file couldn't be
+    // read or its hashes are no longer where they used to be.
+    [[nodiscard]] std::optional<std::vector<tr_sha1_digest_t>> read_piece_hashes(
+        std::string_view torrent_file,
+        tr_piece_index_t begin,
+        size_t n_pieces,
+        tr_error** error = nullptr) const;
+
+    // Find the piece hashes again after the .torrent file was rewritten, e.g. with new trackers
+    bool reload_pieces_offset(std::string_view torrent_file, tr_error** error = nullptr);
+
     [[nodiscard]] TR_CONSTEXPR20 bool has_v1_metadata() const noexcept
     {
         // need 'pieces' field and 'files' or 'length'
         // TODO check for 'files' or 'length'
-        return !std::empty(pieces_);
+        return !std::empty(pieces_) || piece_hashes_dropped_;
     }
 
     [[nodiscard]] constexpr bool has_v2_metadata() const noexcept
@@ -145,6 +184,19 @@ public:
         return is_v2_;
     }
 
+    // For hybrid torrents, the part of the piece's file's v2 merkle tree that
+    // covers the piece. nullopt if the piece has no v2 hash, e.g. if the
+    // torrent isn't hybrid or the piece is padding between two files.
+    [[nodiscard]] std::optional<tr_merkle_subtree> piece_root(tr_piece_index_t piece) const
+    {
+        if (piece < std::size(piece_roots_) && piece_roots_[piece].width != 0U)
+        {
+            return piece_roots_[piece];
+        }
+
+        return {};
+    }
+
     [[nodiscard]] constexpr auto const& date_created() const noexcept
     {
         return date_created_;
@@ -196,7 +248,7 @@ public:
 
 private:
     friend struct MetainfoHandler;
-    static bool parse_impl(tr_torrent_metainfo& setme, std::string_view benc, tr_error** error);
+    bool parse_impl(std::string_view benc, bool want_piece_hashes, tr_error** error);
     static std::string fix_webseed_url(tr_torrent_metainfo const& tm, std::string_view url);
 
     enum class BasenameFormat
@@ -223,6 +275,9 @@ private:
 
     std::vector<tr_sha1_digest_t> pieces_;
 
+    // hybrid torrents' v2 hashes, indexed by v1 piece. Empty if there are none.
+    std::vector<tr_merkle_subtree> piece_roots_;
+
     std::string comment_;
     std::string creator_;
     std::string source_;
@@ -242,4 +297,5 @@ private:
     bool has_magnet_info_hash_ = false;
     bool is_private_ = false;
     bool is_v2_ = false;
+    bool piece_hashes_dropped_ = false;
 };
@@ -0,0 +1,140 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint> // uint8_t, uint64_t
+#include <string_view>
+
+/**
+ * What a torrent has cost the session, so that the torrents using the
+ * most CPU time, disk I/O, or memory can be found and throttled.
+ *
+ * The counters are totals since the torrent was loaded. Updating one is
+ * a relaxed atomic add, so they can be bumped from worker threads too,
+ * e.g. while verifying. Memory isn't counted here: it's measured when
+ * it's asked for. See tr_torrent::memory_usage().
+ */
+class tr_torrent_usage
+{
+public:
+    enum Counter : uint8_t
+    {
+        ParseUsec, // time spent reading its peers' messages, including what they set off, e.g. hashing
+        HashUsec, // time spent checking its pieces, including their reads
+        ServeUsec, // time spent answering its peers' block requests
+        CacheReads, // reads answered by the cache
+        CacheReadBytes,
+        DiskReads, // reads from disk, including read-aheads and verifying
+        DiskReadBytes,
+        CacheWrites, // blocks added to the cache
+        CacheWriteBytes,
+        DiskWrites, // writes to disk
+        DiskWriteBytes,
+        NumCounters
+    };
+
+    // @return the counter's name, e.g. "parse_usec"
+    [[nodiscard]] static constexpr std::string_view name(Counter counter) noexcept
+    {
+        using namespace std::literals;
+
+        switch (counter)
+        {
+        case ParseUsec:
+            return "parse_usec"sv;
+        case HashUsec:
+            return "hash_usec"sv;
+        case ServeUsec:
+            return "serve_usec"sv;
+        case CacheReads:
+            return "cache_reads"sv;
+        case CacheReadBytes:
+            return "cache_read_bytes"sv;
+        case DiskReads:
+            return "disk_reads"sv;
+        case DiskReadBytes:
+            return "disk_read_bytes"sv;
+        case CacheWrites:
+            return "cache_writes"sv;
+        case CacheWriteBytes:
+            return "cache_write_bytes"sv;
+        case DiskWrites:
+            return "disk_writes"sv;
+        case DiskWriteBytes:
+            return "disk_write_bytes"sv;
+        default:
+            return {};
+        }
+    }
+
+    void add(Counter counter, uint64_t n = 1U) noexcept
+    {
+        counters_[counter].fetch_add(n, std::memory_order_relaxed);
+    }
+
+    // Count one read or write of `n_bytes`
+    void add_io(Counter ops, Counter bytes, uint64_t n_bytes) noexcept
+    {
+        add(ops);
+        add(bytes, n_bytes);
+    }
+
+    [[nodiscard]] uint64_t get(Counter counter) const noexcept
+    {
+        return counters_[counter].load(std::memory_order_relaxed);
+    }
+
+    // Adds the time from its creation to its destruction to a `*Usec` counter
+    class Timer
+    {
+    public:
+        Timer(tr_torrent_usage& usage, Counter counter) noexcept
+            : usage_{ usage }
+            , counter_{ counter }
+        {
+        }
+
+        ~Timer()
+        {
+            auto const elapsed = std::chrono::steady_clock::now() - started_at_;
+            usage_.add(counter_, std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+        }
+
+        Timer(Timer const&) = delete;
+        Timer(Timer&&) = delete;
+        Timer& operator=(Timer const&) = delete;
+        Timer& operator=(Timer&&) = delete;
+
+    private:
+        tr_torrent_usage& usage_;
+        Counter const counter_;
+        std::chrono::steady_clock::time_point const started_at_ = std::chrono::steady_clock::now();
+    };
+
+    // The memory that a torrent is holding right now
+    struct Memory
+    {
+        uint64_t cache = 0U; // dirty blocks waiting to be written
+        uint64_t read_cache = 0U; // clean blocks kept for uploading
+        uint64_t peer_buffers = 0U; // its peers' read and write buffers
+        uint64_t metadata = 0U; // a magnet link's partly-downloaded metainfo
+
+        [[nodiscard]] constexpr uint64_t total() const noexcept
+        {
+            return cache + read_cache + peer_buffers + metadata;
+        }
+    };
+
+private:
+    std::array<std::atomic<uint64_t>, NumCounters> counters_ = {};
+};
@@ -9,6 +9,7 @@
 #include <climits> /* INT_MAX */
 #include <ctime>
 #include <map>
+#include <mutex>
 #include <sstream>
 #include <string>
 #include <string_view>
@@ -31,11 +32,13 @@
 
 #include "libtransmission/announcer.h"
 #include "libtransmission/bandwidth.h"
+#include "libtransmission/cache.h"
 #include "libtransmission/completion.h"
 #include "libtransmission/crypto-utils.h" // for tr_sha1()
 #include "libtransmission/error.h"
 #include "libtransmission/file.h"
-#include "libtransmission/inout.h" // tr_ioTestPiece()
+#include "libtransmission/inout.h" // tr_ioReadPiece(), tr_ioTestPiece()
+#include "libtransmission/local-data-index.h"
 #include "libtransmission/log.h"
 #include "libtransmission/magnet-metainfo.h"
 #include "libtransmission/peer-common.h"
@@ -48,6 +51,7 @@
 #include "libtransmission/torrent.h"
 #include "libtransmission/tr-assert.h"
 #include "libtransmission/utils.h"
+#include "libtransmission/variant.h"
 #include "libtransmission/version.h"
 #include "libtransmission/web-utils.h"
 
@@ -94,15 +98,7 @@ tr_torrent* tr_torrentFindFromMagnetLink(tr_session* session, char const* magnet
 
 tr_torrent* tr_torrentFindFromObfuscatedHash(tr_session* session, tr_sha1_digest_t const& obfuscated_hash)
 {
-    for (auto* const tor : session->torrents())
-    {
-        if (tor->obfuscated_hash == obfuscated_hash)
-        {
-            return tor;
-        }
-    }
-
-    return nullptr;
+    return session->torrents().get_from_obfuscated(obfuscated_hash);
 }
 
 bool tr_torrentSetMetainfoFromFile(tr_torrent* tor, tr_torrent_metainfo const* metainfo, char const* filename)
@@ -134,13 +130,14 @@ bool tr_torrentSetMetainfoFromFile(tr_torrent* tor, tr_torrent_metainfo const* m
 
 namespace
 {
-constexpr void torrentSetQueued(tr_torrent* tor, bool queued)
+void torrentSetQueued(tr_torrent* tor, bool queued)
 {
     if (tor->is_queued_ != queued)
     {
         tor->is_queued_ = queued;
         tor->mark_changed();
         tor->set_dirty();
+        tor->session->torrents().update_activity(tor);
     }
 }
 
@@ -476,13 +473,57 @@ void torrentCallScript(tr_torrent const* tor, std::string const& script)
         tr_error_free(error);
     }
 }
+
+[[nodiscard]] std::string buildHookEvent(tr_torrent const* tor, TrScript type)
+{
+    auto const event = std::array<std::string_view, TR_SCRIPT_N_TYPES>{
+        "torrent-added"sv,
+        "torrent-done"sv,
+        "torrent-done-seeding"sv,
+    };
+
+    auto data = tr_variant{};
+    tr_variantInitDict(&data, 10);
+    tr_variantDictAddStrView(&data, TR_KEY_event, event[type]);
+    tr_variantDictAddStrView(&data, TR_KEY_version, SHORT_VERSION_STRING);
+    tr_variantDictAddInt(&data, TR_KEY_time, tr_time());
+    tr_variantDictAddInt(&data, TR_KEY_id, tor->id());
+    tr_variantDictAddStr(&data, TR_KEY_hashString, tor->info_hash_string());
+    tr_variantDictAddStr(&data, TR_KEY_name, tor->name());
+    tr_variantDictAddStr(&data, TR_KEY_downloadDir, tor->current_dir().sv());
+    tr_variantDictAddInt(&data, TR_KEY_downloadedEver, tor->downloadedCur + tor->downloadedPrev);
+
+    auto* const labels = tr_variantDictAddList(&data, TR_KEY_labels, std::size(tor->labels));
+    for (auto const label : tor->labels)
+    {
+        tr_variantListAddQuark(labels, label);
+    }
+
+    auto* const trackers = tr_variantDictAddList(&data, TR_KEY_trackers, tor->tracker_count());
+    for (auto const& tracker : tor->announce_list())
+    {
+        tr_variantListAddQuark(trackers, tracker.announce.quark());
+    }
+
+    // lean JSON has no newlines, so each event is one line
+    auto line = tr_variantToStr(&data, TR_VARIANT_FMT_JSON_LEAN);
+    tr_variantClear(&data);
+    line += '\n';
+    return line;
+}
 } // namespace script_helpers
 
 void callScriptIfEnabled(tr_torrent const* tor, TrScript type)
 {
     using namespace script_helpers;
 
-    auto const* session = tor->session;
+    auto* const session = tor->session;
+
+    // the hook gets every event; the script runs if it can't take this one
+    if (auto* const hook = session->script_hook(); hook != nullptr && hook->send(buildHookEvent(tor, type)))
+    {
+        return;
+    }
 
     if (tr_sessionIsScriptEnabled(session, type))
     {
@@ -547,32 +588,19 @@ namespace
 {
 namespace queue_helpers
 {
-constexpr struct
-{
-    constexpr bool operator()(tr_torrent const* a, tr_torrent const* b) const noexcept
-    {
-        return a->queuePosition < b->queuePosition;
-    }
-} CompareTorrentByQueuePosition{};
-
 #ifdef TR_ENABLE_ASSERTS
 bool queueIsSequenced(tr_session const* session)
 {
-    auto torrents = session->getAllTorrents();
-    std::sort(
-        std::begin(torrents),
-        std::end(torrents),
-        [](auto const* a, auto const* b) { return a->queuePosition < b->queuePosition; });
-
-    /* test them */
-    bool is_sequenced = true;
-
-    for (size_t i = 0, n = std::size(torrents); is_sequenced && i < n; ++i)
+    auto const& queue = session->torrents().queue();
+    for (size_t i = 0, n = std::size(queue); i < n; ++i)
     {
-        is_sequenced = torrents[i]->queuePosition == i;
+        if (queue[i]->queuePosition != i)
+        {
+            return false;
+        }
     }
 
-    return is_sequenced;
+    return std::size(queue) == std::size(session->torrents());
 }
 #endif
 } // namespace queue_helpers
@@ -587,89 +615,69 @@ void tr_torrentSetQueuePosition(tr_torrent* tor, size_t queue_position)
 {
     using namespace queue_helpers;
 
-    size_t current = 0;
-    auto const old_pos = tor->queuePosition;
-
-    tor->queuePosition = static_cast<size_t>(-1);
-
-    for (auto* const walk : tor->session->torrents())
-    {
-        if ((old_pos < queue_position) && (old_pos <= walk->queuePosition) && (walk->queuePosition <= queue_position))
-        {
-            walk->queuePosition--;
-            walk->mark_changed();
-        }
-
-        if ((old_pos > queue_position) && (queue_position <= walk->queuePosition) && (walk->queuePosition < old_pos))
-        {
-            walk->queuePosition++;
-            walk->mark_changed();
-        }
-
-        if (current < walk->queuePosition + 1)
-        {
-            current = walk->queuePosition + 1;
-        }
-    }
-
-    tor->queuePosition = std::min(queue_position, current);
-    tor->mark_changed();
+    tor->session->torrents().set_queue_position(tor, queue_position);
 
     TR_ASSERT(queueIsSequenced(tor->session));
 }
 
-void tr_torrentsQueueMoveTop(tr_torrent* const* torrents_in, size_t torrent_count)
+void tr_torrentsQueueMoveTop(tr_torrent* const* torrents, size_t torrent_count)
 {
     using namespace queue_helpers;
 
-    auto torrents = std::vector<tr_torrent*>(torrents_in, torrents_in + torrent_count);
-    std::sort(std::rbegin(torrents), std::rend(torrents), CompareTorrentByQueuePosition);
-    for (auto* tor : torrents)
+    if (torrent_count == 0U)
     {
-        tr_torrentSetQueuePosition(tor, 0);
+        return;
     }
+
+    auto* const session = torrents[0]->session;
+    session->torrents().move_to_queue_top(torrents, torrent_count);
+
+    TR_ASSERT(queueIsSequenced(session));
 }
 
-void tr_torrentsQueueMoveUp(tr_torrent* const* torrents_in, size_t torrent_count)
+void tr_torrentsQueueMoveUp(tr_torrent* const* torrents, size_t torrent_count)
 {
     using namespace queue_helpers;
 
-    auto torrents = std::vector<tr_torrent*>(torrents_in, torrents_in + torrent_count);
-    std::sort(std::begin(torrents), std::end(torrents), CompareTorrentByQueuePosition);
-    for (auto* tor : torrents)
+    if (torrent_count == 0U)
     {
-        if (tor->queuePosition > 0)
-        {
-            tr_torrentSetQueuePosition(tor, tor->queuePosition - 1);
-        }
+        return;
     }
+
+    auto* const session = torrents[0]->session;
+    session->torrents().move_queue_up(torrents, torrent_count);
+
+    TR_ASSERT(queueIsSequenced(session));
 }
 
-void tr_torrentsQueueMoveDown(tr_torrent* const* torrents_in, size_t torrent_count)
+void tr_torrentsQueueMoveDown(tr_torrent* const* torrents, size_t torrent_count)
 {
     using namespace queue_helpers;
 
-    auto torrents = std::vector<tr_torrent*>(torrents_in, torrents_in + torrent_count);
-    std::sort(std::rbegin(torrents), std::rend(torrents), CompareTorrentByQueuePosition);
-    for (auto* tor : torrents)
+    if (torrent_count == 0U)
     {
-        if (tor->queuePosition < UINT_MAX)
-        {
-            tr_torrentSetQueuePosition(tor, tor->queuePosition + 1);
-        }
+        return;
     }
+
+    auto* const session = torrents[0]->session;
+    session->torrents().move_queue_down(torrents, torrent_count);
+
+    TR_ASSERT(queueIsSequenced(session));
 }
 
-void tr_torrentsQueueMoveBottom(tr_torrent* const* torrents_in, size_t torrent_count)
+void tr_torrentsQueueMoveBottom(tr_torrent* const* torrents, size_t torrent_count)
 {
     using namespace queue_helpers;
 
-    auto torrents = std::vector<tr_torrent*>(torrents_in, torrents_in + torrent_count);
-    std::sort(std::begin(torrents), std::end(torrents), CompareTorrentByQueuePosition);
-    for (auto* tor : torrents)
+    if (torrent_count == 0U)
     {
-        tr_torrentSetQueuePosition(tor, UINT_MAX);
+        return;
     }
+
+    auto* const session = torrents[0]->session;
+    session->torrents().move_to_queue_bottom(torrents, torrent_count);
+
+    TR_ASSERT(queueIsSequenced(session));
 }
 
 // --- Start, Stop
@@ -699,6 +707,32 @@ void torrentResetTransferStats(tr_torrent* tor)
     tor->set_dirty();
 }
 
+// Hand the wanted files that don't exist yet to the session's preallocator,
+// so that a large torrent's files don't get preallocated one by one in the
+// session thread the first time that a block is written to each of them.
+void preallocateMissingFiles(tr_torrent const* tor)
+{
+    auto const mode = tor->session->preallocationMode();
+    if (mode == TR_PREALLOCATE_NONE || !tor->has_metainfo() || tor->is_done() || tor->storage())
+    {
+        return;
+    }
+
+    auto const base = tor->current_dir();
+    auto const suffix = tor->session->isIncompleteFileNamingEnabled() ? tr_torrent_files::PartialFileSuffix : ""sv;
+    auto files = std::vector<tr_preallocator::File>{};
+    for (tr_file_index_t i = 0, n = tor->file_count(); i < n; ++i)
+    {
+        if (auto const size = tor->file_size(i);
+            size != 0U && tor->file_is_wanted(i) && !tor->file_is_padding(i) && !tor->find_file(i))
+        {
+            files.push_back({ std::string{ tr_pathbuf{ base, '/', tor->file_subpath(i), suffix }.sv() }, size });
+        }
+    }
+
+    tor->session->preallocateFiles(tor->id(), std::move(files), mode);
+}
+
 void torrentStartImpl(tr_torrent* const tor)
 {
     auto const lock = tor->unique_lock();
@@ -714,6 +748,7 @@ void torrentStartImpl(tr_torrent* const tor)
     tor->completeness = tor->completion.status();
     tor->startDate = now;
     tor->mark_changed();
+    tor->session->torrents().update_activity(tor);
     tr_torrentClearError(tor);
     tor->finished_seeding_by_idle_ = false;
 
@@ -721,6 +756,8 @@ void torrentStartImpl(tr_torrent* const tor)
     tor->session->announcer_->startTorrent(tor);
     tor->lpdAnnounceAt = now;
     tor->started_.emit(tor);
+
+    preallocateMissingFiles(tor);
 }
 
 bool removeTorrentFile(char const* filename, void* /*user_data*/, tr_error** error)
@@ -765,25 +802,19 @@ void freeTorrent(tr_torrent* tor)
 
     tor->doomed_.emit(tor);
 
+    session->moveFilesRemove(tor->id());
+    session->preallocateFilesRemove(tor->id());
     session->announcer_->removeTorrent(tor);
 
     session->torrents().remove(tor, tr_time());
 
-    if (!session->isClosing())
-    {
-        // "so you die, captain, and we all move up in rank."
-        // resequence the queue positions
-        for (auto* t : session->torrents())
-        {
-            if (t->queuePosition > tor->queuePosition)
-            {
-                t->queuePosition--;
-                t->mark_changed();
-            }
-        }
+    session->piece_hash_cache().erase(tor->id());
+    session->info_dict_cache().erase(tor->id());
+    session->piece_syncer().erase(tor->id());
+    session->local_data_index().erase(tor);
 
-        TR_ASSERT(queueIsSequenced(session));
-    }
+    // removing it from the session also moved the torrents behind it up in the queue
+    TR_ASSERT(queueIsSequenced(session));
 
     delete tor;
 }
@@ -835,6 +866,13 @@ void torrentStart(tr_torrent* tor, torrent_start_opts opts)
         break;
     }
 
+    // don't resume downloading while the files are being copied elsewhere;
+    // the torrent is restarted when the copies are in place
+    if (!tor->is_done() && tor->session->moveFilesProgress(tor->id()))
+    {
+        return;
+    }
+
     /* don't allow the torrent to be started if the files disappeared */
     if (setLocalErrorIfFilesDisappeared(tor, opts.has_local_data))
     {
@@ -850,7 +888,7 @@ void torrentStart(tr_torrent* tor, torrent_start_opts opts)
 
     tor->is_running_ = true;
     tor->set_dirty();
-    tor->session->runInSessionThread(torrentStartImpl, tor);
+    tor->session->runInSessionThread([tor]() { torrentStartImpl(tor); });
 }
 
 void torrentStop(tr_torrent* const tor)
@@ -861,6 +899,7 @@ void torrentStop(tr_torrent* const tor)
 
     tor->is_running_ = false;
     tor->is_stopping_ = false;
+    tor->session->torrents().update_activity(tor);
 
     if (!tor->session->isClosing())
     {
@@ -868,6 +907,15 @@ void torrentStop(tr_torrent* const tor)
     }
 
     tor->session->verifyRemove(tor);
+    tor->session->preallocateFilesRemove(tor->id());
+
+    // a verify that's interrupted by shutting down picks up where it
+    // left off at the next startup, but one the user stopped waits for
+    // tr_torrentVerifyResume()
+    if (auto& checkpoint = tor->verify_checkpoint_; checkpoint && !tor->session->isClosing())
+    {
+        checkpoint->paused = true;
+    }
 
     tor->stopped_.emit(tor);
     tor->session->announcer_->stopTorrent(tor);
@@ -894,7 +942,7 @@ void tr_torrentStop(tr_torrent* tor)
 
     tor->start_when_stable = false;
     tor->set_dirty();
-    tor->session->runInSessionThread(torrentStop, tor);
+    tor->session->runInSessionThread([tor]() { torrentStop(tor); });
 }
 
 void tr_torrentRemove(tr_torrent* tor, bool delete_flag, tr_fileFunc delete_func, void* user_data)
@@ -905,7 +953,9 @@ void tr_torrentRemove(tr_torrent* tor, bool delete_flag, tr_fileFunc delete_func
 
     tor->is_deleting_ = true;
 
-    tor->session->runInSessionThread(removeTorrentInSessionThread, tor, delete_flag, delete_func, user_data);
+    tor->session->runInSessionThread(
+        [tor, delete_flag, delete_func, user_data]()
+        { removeTorrentInSessionThread(tor, delete_flag, delete_func, user_data); });
 }
 
 void tr_torrentFreeInSessionThread(tr_torrent* tor)
@@ -928,6 +978,14 @@ void tr_torrentFreeInSessionThread(tr_torrent* tor)
         tr_torrent_metainfo::remove_file(tor->session->torrentDir(), tor->name(), tor->info_hash_string(), ".torrent"sv);
         tr_torrent_metainfo::remove_file(tor->session->torrentDir(), tor->name(), tor->info_hash_string(), ".magnet"sv);
         tr_torrent_metainfo::remove_file(tor->session->resumeDir(), tor->name(), tor->info_hash_string(), ".resume"sv);
+
+        // and again after any save of it that's still being written
+        tor->session->resume_writer().remove(tor->resume_file());
+
+        if (auto* const journal = tor->session->resume_journal(); journal != nullptr)
+        {
+            journal->erase(tor->info_hash());
+        }
     }
 
     freeTorrent(tor);
@@ -937,6 +995,11 @@ void tr_torrentFreeInSessionThread(tr_torrent* tor)
 
 namespace
 {
+namespace verify_helpers
+{
+void resumeVerify(tr_torrent* tor);
+} // namespace verify_helpers
+
 namespace torrent_init_helpers
 {
 // Sniff out newly-added seeds so that they can skip the verify step
@@ -949,6 +1012,11 @@ bool isNewTorrentASeed(tr_torrent* tor)
 
     for (tr_file_index_t i = 0, n = tor->file_count(); i < n; ++i)
     {
+        if (tor->file_is_padding(i))
+        {
+            continue;
+        }
+
         // it's not a new seed if a file is missing
         auto const found = tor->find_file(i);
         if (!found)
@@ -982,7 +1050,6 @@ bool isNewTorrentASeed(tr_torrent* tor)
 void torrentInitFromInfoDict(tr_torrent* tor)
 {
     tor->completion = tr_completion{ tor, &tor->block_info() };
-    tor->obfuscated_hash = tr_sha1::digest("req2"sv, tor->info_hash());
     tor->fpm_.reset(tor->metainfo_);
     tor->file_mtimes_.resize(tor->file_count());
     tor->file_priorities_.reset(&tor->fpm_);
@@ -990,14 +1057,18 @@ void torrentInitFromInfoDict(tr_torrent* tor)
     tor->checked_pieces_ = tr_bitfield{ size_t(tor->piece_count()) };
 }
 
-void on_metainfo_completed(tr_torrent* tor)
+void verify_or_start_new_torrent(tr_torrent* tor, bool force_verify)
 {
-    // we can look for files now that we know what files are in the torrent
-    tor->refresh_current_dir();
-
-    callScriptIfEnabled(tor, TR_SCRIPT_ON_TORRENT_ADDED);
-
-    if (tor->session->shouldFullyVerifyAddedTorrents() || !isNewTorrentASeed(tor))
+    if (tor->verify_manifest_)
+    {
+        // trust the pieces in the manifest's files, then quick-verify
+        // so that only the pieces outside of them get hashed
+        auto const manifest = std::move(*tor->verify_manifest_);
+        tor->verify_manifest_.reset();
+        manifest.apply(tor);
+        tr_torrentVerifyQuick(tor);
+    }
+    else if (force_verify || tor->session->shouldFullyVerifyAddedTorrents() || !isNewTorrentASeed(tor))
     {
         tr_torrentVerify(tor);
     }
@@ -1018,6 +1089,69 @@ void on_metainfo_completed(tr_torrent* tor)
     }
 }
 
+void on_metainfo_completed(tr_torrent* tor)
+{
+    // we can look for files now that we know what files are in the torrent
+    tor->refresh_current_dir();
+
+    callScriptIfEnabled(tor, TR_SCRIPT_ON_TORRENT_ADDED);
+
+    auto* const session = tor->session;
+    auto& index = session->local_data_index();
+    index.add(tor);
+
+    auto imports = tor->verify_manifest_ ? std::vector<tr_local_data_index::Import>{} :
+                                           index.plan(tor, session->torrents());
+    if (std::empty(imports))
+    {
+        verify_or_start_new_torrent(tor, false);
+        return;
+    }
+
+    // look for the missing files in other torrents' data on a worker thread,
+    // since that means hashing them, then pick up where we left off
+    session->executor().submit(
+        [session, tor_id = tor->id(), imports = std::move(imports)]()
+        {
+            auto n_imported = size_t{};
+            for (auto const& import : imports)
+            {
+                if (tr_local_data_index::import_file(import) != tr_local_data_index::Method::None)
+                {
+                    ++n_imported;
+                }
+            }
+
+            session->runInSessionThread(
+                [session, tor_id, n_imported]()
+                {
+                    auto* const cur = session->torrents().get(tor_id);
+                    if (cur == nullptr)
+                    {
+                        return;
+                    }
+
+                    if (n_imported > 0U)
+                    {
+                        tr_logAddInfoTor(
+                            cur,
+                            fmt::format(
+                                tr_ngettext(
+                                    "Reused {count} file from other torrents",
+                                    "Reused {count} files from other torrents",
+                                    n_imported),
+                                fmt::arg("count", n_imported)));
+                        cur->refresh_current_dir();
+                    }
+
+                    // the imported files still need to be checked against this torrent's
+                    // pieces that they share with the files next to them
+                    verify_or_start_new_torrent(cur, n_imported > 0U);
+                });
+        },
+        tr_executor::Priority::Low);
+}
+
 void torrentInit(tr_torrent* tor, tr_ctor const* ctor)
 {
     tr_session* session = tr_ctorGetSession(ctor);
@@ -1026,8 +1160,6 @@ void torrentInit(tr_torrent* tor, tr_ctor const* ctor)
 
     auto const lock = tor->unique_lock();
 
-    tor->queuePosition = std::size(session->torrents());
-
     torrentInitFromInfoDict(tor);
 
     char const* dir = nullptr;
@@ -1053,6 +1185,8 @@ void torrentInit(tr_torrent* tor, tr_ctor const* ctor)
     auto const& labels = tr_ctorGetLabels(ctor);
     tor->setLabels(labels);
 
+    tor->verify_manifest_ = tr_ctorGetVerifyManifest(ctor);
+
     session->addTorrent(tor);
 
     TR_ASSERT(tor->downloadedCur == 0);
@@ -1076,6 +1210,7 @@ void torrentInit(tr_torrent* tor, tr_ctor const* ctor)
     }
 
     tor->completeness = tor->completion.status();
+    session->torrents().update_activity(tor);
 
     tr_ctorInitTorrentPriorities(ctor, tor);
     tr_ctorInitTorrentWanted(ctor, tor);
@@ -1145,12 +1280,32 @@ void torrentInit(tr_torrent* tor, tr_ctor const* ctor)
         }
     }
 
+    // Once the .torrent file is on disk, the piece hashes can be read back
+    // from it when needed. Make sure they're found in that file and not
+    // just in whatever copy of the metainfo the ctor was given.
+    if (session->lazyPieceHashesEnabled() && tor->has_metainfo() && tr_sys_path_exists(filename) &&
+        (is_new_torrent || filename.sv() == tr_ctorGetSourceFile(ctor) || tor->metainfo_.reload_pieces_offset(filename)))
+    {
+        tor->metainfo_.drop_piece_hashes();
+    }
+
     tor->torrent_announcer = session->announcer_->addTorrent(tor, &tr_torrent::on_tracker_response);
 
+    if (!is_new_torrent)
+    {
+        session->local_data_index().add(tor);
+    }
+
     if (auto const has_metainfo = tor->has_metainfo(); is_new_torrent && has_metainfo)
     {
         on_metainfo_completed(tor);
     }
+    else if (auto const& checkpoint = tor->verify_checkpoint_; has_metainfo && checkpoint && !checkpoint->paused)
+    {
+        // the session closed in the middle of a verify; finish it, and
+        // onVerifyDoneThreadFunc() will start the torrent if it should be
+        verify_helpers::resumeVerify(tor);
+    }
     else if (tor->start_when_stable)
     {
         auto opts = torrent_start_opts{};
@@ -1172,8 +1327,10 @@ void tr_torrent::set_metainfo(tr_torrent_metainfo tm)
 
     TR_ASSERT(!has_metainfo());
     metainfo_ = std::move(tm);
+    metainfo_.announce_list().intern();
 
     torrentInitFromInfoDict(this);
+    session->torrents().reindex(this);
     got_metainfo_.emit(this);
     session->onMetadataCompleted(this);
     this->set_dirty();
@@ -1219,38 +1376,33 @@ namespace
 {
 namespace location_helpers
 {
-void setLocationInSessionThread(
-    tr_torrent* tor,
-    std::string const& path,
-    bool move_from_old_path,
-    double volatile* setme_progress,
-    int volatile* setme_state)
+void setLocalMoveError(tr_torrent* tor, std::string_view path, tr_error const* error)
 {
-    TR_ASSERT(tr_isTorrent(tor));
-    TR_ASSERT(tor->session->am_in_session_thread());
+    tor->set_local_error(fmt::format(
+        _("Couldn't move '{old_path}' to '{path}': {error} ({error_code})"),
+        fmt::arg("old_path", tor->current_dir()),
+        fmt::arg("path", path),
+        fmt::arg("error", error->message),
+        fmt::arg("error_code", error->code)));
+}
 
+// Move the torrent's remaining files, which are all on the same
+// filesystem as `path`, and tell the torrent where its files are.
+bool finishSetLocation(tr_torrent* tor, std::string const& path, bool move_from_old_path, double volatile* setme_progress)
+{
     auto ok = bool{ true };
     if (move_from_old_path)
     {
-        if (setme_state != nullptr)
-        {
-            *setme_state = TR_LOC_MOVING;
-        }
-
         // ensure the files are all closed and idle before moving
         tor->session->closeTorrentFiles(tor);
         tor->session->verifyRemove(tor);
+        tor->session->preallocateFilesRemove(tor->id());
 
         tr_error* error = nullptr;
         ok = tor->metainfo_.files().move(tor->current_dir(), path, setme_progress, tor->name(), &error);
         if (error != nullptr)
         {
-            tor->set_local_error(fmt::format(
-                _("Couldn't move '{old_path}' to '{path}': {error} ({error_code})"),
-                fmt::arg("old_path", tor->current_dir()),
-                fmt::arg("path", path),
-                fmt::arg("error", error->message),
-                fmt::arg("error_code", error->code)));
+            setLocalMoveError(tor, path, error);
             tr_torrentStop(tor);
             tr_error_clear(&error);
         }
@@ -1268,11 +1420,129 @@ void setLocationInSessionThread(
         }
     }
 
+    return ok;
+}
+
+// @return the files that live on another filesystem than `path`
+// and so would have to be copied rather than renamed
+std::vector<tr_file_mover::File> getFilesToCopy(tr_torrent const* tor, std::string const& path)
+{
+    auto files = std::vector<tr_file_mover::File>{};
+
+    auto const paths = std::array<std::string_view, 1>{ tor->current_dir().sv() };
+    for (tr_file_index_t i = 0, n = tor->file_count(); i < n; ++i)
+    {
+        auto const found = tor->metainfo_.files().find(i, std::data(paths), std::size(paths));
+        if (!found || tr_sys_path_is_same_filesystem(found->filename(), path))
+        {
+            continue;
+        }
+
+        auto& file = files.emplace_back();
+        file.src = found->filename();
+        file.tgt = tr_pathbuf{ path, '/', found->subpath() };
+        file.size = found->size;
+    }
+
+    return files;
+}
+
+void setLocationInSessionThread(
+    tr_torrent* tor,
+    std::string const& path,
+    bool move_from_old_path,
+    double volatile* setme_progress,
+    int volatile* setme_state)
+{
+    TR_ASSERT(tr_isTorrent(tor));
+    TR_ASSERT(tor->session->am_in_session_thread());
+
+    if (move_from_old_path)
+    {
+        if (setme_state != nullptr)
+        {
+            *setme_state = TR_LOC_MOVING;
+        }
+
+        // cancel any earlier move; its finished copies are kept and reused
+        tor->session->moveFilesRemove(tor->id());
+
+        // Copying to another filesystem can take a long time, so do it in
+        // the background. The torrent keeps seeding from the old files in
+        // the meantime, but a torrent that's downloading is paused so that
+        // new blocks aren't written to files that have already been copied.
+        // the target must exist to tell which filesystem it's on
+        tr_sys_dir_create(path, TR_SYS_DIR_CREATE_PARENTS, 0777);
+        if (auto files = getFilesToCopy(tor, path); !std::empty(files))
+        {
+            if (tor->is_running() && !tor->is_done())
+            {
+                torrentStop(tor);
+            }
+
+            auto copied = std::vector<std::string>{};
+            copied.reserve(std::size(files));
+            for (auto const& file : files)
+            {
+                copied.emplace_back(file.src);
+            }
+
+            auto* const session = tor->session;
+            session->moveFiles(
+                tor->id(),
+                std::move(files),
+                [session, id = tor->id(), path, copied = std::move(copied), setme_progress, setme_state](
+                    tr_error const* error)
+                {
+                    auto* const cur = session->torrents().get(id);
+                    if (cur == nullptr)
+                    {
+                        return;
+                    }
+
+                    auto const lock = cur->unique_lock();
+
+                    auto ok = error == nullptr;
+                    if (ok)
+                    {
+                        // switch over to the new copies
+                        session->closeTorrentFiles(cur);
+                        session->verifyRemove(cur);
+                        for (auto const& filename : copied)
+                        {
+                            tr_sys_path_remove(filename);
+                        }
+
+                        ok = finishSetLocation(cur, path, true, setme_progress);
+                    }
+                    else
+                    {
+                        setLocalMoveError(cur, path, error);
+                        tr_torrentStop(cur);
+                    }
+
+                    if (setme_state != nullptr)
+                    {
+                        *setme_state = ok ? TR_LOC_DONE : TR_LOC_ERROR;
+                    }
+
+                    if (ok && cur->start_when_stable)
+                    {
+                        torrentStart(cur, {});
+                    }
+                });
+            return;
+        }
+    }
+
+    auto const ok = finishSetLocation(tor, path, move_from_old_path, setme_progress);
+
     if (setme_state != nullptr)
     {
         *setme_state = ok ? TR_LOC_DONE : TR_LOC_ERROR;
     }
 }
+
 size_t buildSearchPathArray(tr_torrent const* tor, std::string_view* paths)
 {
     auto* walk = paths;
@@ -1306,12 +1576,8 @@ void tr_torrent::set_location(
     }
 
     this->session->runInSessionThread(
-        setLocationInSessionThread,
-        this,
-        std::string{ location },
-        move_from_old_path,
-        setme_progress,
-        setme_state);
+        [tor = this, path = std::string{ location }, move_from_old_path, setme_progress, setme_state]()
+        { setLocationInSessionThread(tor, path, move_from_old_path, setme_progress, setme_state); });
 }
 
 void tr_torrentSetLocation(
@@ -1336,10 +1602,63 @@ std::optional<tr_torrent_files::FoundFile> tr_torrent::find_file(tr_file_index_t
     return metainfo_.files().find(file_index, std::data(paths), n_paths);
 }
 
+bool tr_torrent::find_file_cached(tr_file_index_t file_index, tr_pathbuf& setme) const
+{
+    {
+        auto const lock = std::lock_guard{ found_files_mutex_ };
+        if (file_index < std::size(found_files_) && !std::empty(found_files_[file_index]))
+        {
+            setme.assign(found_files_[file_index]);
+            return true;
+        }
+    }
+
+    auto const found = find_file(file_index);
+    if (!found)
+    {
+        return false;
+    }
+
+    setme.assign(found->filename());
+
+    auto const lock = std::lock_guard{ found_files_mutex_ };
+    found_files_.resize(file_count());
+    found_files_[file_index].assign(setme.sv());
+    return true;
+}
+
+void tr_torrent::forget_found_files() const
+{
+    auto const lock = std::lock_guard{ found_files_mutex_ };
+    found_files_.clear();
+}
+
+void tr_torrent::forget_found_file(tr_file_index_t file_index) const
+{
+    auto const lock = std::lock_guard{ found_files_mutex_ };
+    if (file_index < std::size(found_files_))
+    {
+        found_files_[file_index].clear();
+    }
+}
+
 bool tr_torrent::has_any_local_data() const
 {
     using namespace location_helpers;
 
+    if (auto const storage = this->storage(); storage)
+    {
+        for (tr_file_index_t i = 0, n = file_count(); i < n; ++i)
+        {
+            if (storage->exists(this, i))
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
     auto paths = std::array<std::string_view, 4>{};
     auto const n_paths = buildSearchPathArray(this, std::data(paths));
     return metainfo_.files().hasAnyLocalData(std::data(paths), n_paths);
@@ -1403,7 +1722,7 @@ void tr_torrentManualUpdate(tr_torrent* tor)
 
     TR_ASSERT(tr_isTorrent(tor));
 
-    tor->session->runInSessionThread(torrentManualUpdateImpl, tor);
+    tor->session->runInSessionThread([tor]() { torrentManualUpdateImpl(tor); });
 }
 
 bool tr_torrentCanManualUpdate(tr_torrent const* tor)
@@ -1432,72 +1751,113 @@ namespace stat_helpers
 } // namespace
 
 tr_stat const* tr_torrentStat(tr_torrent* tor)
+{
+    return tr_torrentStat(tor, TR_STAT_GROUP_ALL);
+}
+
+tr_stat const* tr_torrentStat(tr_torrent* tor, uint32_t groups)
 {
     using namespace stat_helpers;
 
     TR_ASSERT(tr_isTorrent(tor));
 
+    // the ETA is derived from these
+    if ((groups & TR_STAT_GROUP_ETA) != 0U)
+    {
+        groups |= TR_STAT_GROUP_ACTIVITY | TR_STAT_GROUP_SPEED | TR_STAT_GROUP_COMPLETION | TR_STAT_GROUP_AVAILABLE;
+    }
+
     auto const now = tr_time_msec();
     auto const now_sec = tr_time();
 
-    auto swarm_stats = tr_swarm_stats{};
+    if (groups == TR_STAT_GROUP_ALL)
+    {
+        tor->lastStatTime = now_sec;
+    }
 
-    tor->lastStatTime = now_sec;
+    tr_stat* const s = &tor->stats;
 
-    if (tor->swarm != nullptr)
+    if ((groups & TR_STAT_GROUP_BASIC) != 0U)
     {
-        swarm_stats = tr_swarmGetStats(tor->swarm);
+        s->id = tor->id();
+        s->error = tor->error;
+        s->errorString = tor->error_string.c_str();
+        s->queuePosition = tor->queuePosition;
+        s->activityDate = tor->activityDate;
+        s->addedDate = tor->addedDate;
+        s->doneDate = tor->doneDate;
+        s->editDate = tor->editDate;
+        s->startDate = tor->startDate;
+        s->secondsSeeding = tor->seconds_seeding(now_sec);
+        s->secondsDownloading = tor->seconds_downloading(now_sec);
     }
 
-    tr_stat* const s = &tor->stats;
-    s->id = tor->id();
-    s->activity = tor->activity();
-    s->error = tor->error;
-    s->queuePosition = tor->queuePosition;
-    s->idleSecs = torrentGetIdleSecs(tor, s->activity);
-    s->isStalled = tr_torrentIsStalled(tor, s->idleSecs);
-    s->errorString = tor->error_string.c_str();
-
-    s->peersConnected = swarm_stats.peer_count;
-    s->peersSendingToUs = swarm_stats.active_peer_count[TR_DOWN];
-    s->peersGettingFromUs = swarm_stats.active_peer_count[TR_UP];
-    s->webseedsSendingToUs = swarm_stats.active_webseed_count;
-
-    for (int i = 0; i < TR_PEER_FROM__MAX; i++)
-    {
-        s->peersFrom[i] = swarm_stats.peer_from_count[i];
-    }
-
-    auto const piece_upload_speed_bytes_per_second = tor->bandwidth_.get_piece_speed_bytes_per_second(now, TR_UP);
-    s->pieceUploadSpeed_KBps = tr_toSpeedKBps(piece_upload_speed_bytes_per_second);
-    auto const piece_download_speed_bytes_per_second = tor->bandwidth_.get_piece_speed_bytes_per_second(now, TR_DOWN);
-    s->pieceDownloadSpeed_KBps = tr_toSpeedKBps(piece_download_speed_bytes_per_second);
-
-    s->percentComplete = tor->completion.percent_complete();
-    s->metadataPercentComplete = tr_torrentGetMetadataPercent(tor);
-
-    s->percentDone = tor->completion.percent_done();
-    s->leftUntilDone = tor->completion.left_until_done();
-    s->sizeWhenDone = tor->completion.size_when_done();
-
-    auto const verify_progress = tor->verify_progress();
-    s->recheckProgress = verify_progress.value_or(0.0);
-    s->activityDate = tor->activityDate;
-    s->addedDate = tor->addedDate;
-    s->doneDate = tor->doneDate;
-    s->editDate = tor->editDate;
-    s->startDate = tor->startDate;
-    s->secondsSeeding = tor->seconds_seeding(now_sec);
-    s->secondsDownloading = tor->seconds_downloading(now_sec);
-
-    s->corruptEver = tor->corruptCur + tor->corruptPrev;
-    s->downloadedEver = tor->downloadedCur + tor->downloadedPrev;
-    s->uploadedEver = tor->uploadedCur + tor->uploadedPrev;
-    s->haveValid = tor->completion.has_valid();
-    s->haveUnchecked = tor->has_total() - s->haveValid;
-    s->desiredAvailable = tr_peerMgrGetDesiredAvailable(tor);
-
-    s->ratio = tr_getRatio(s->uploadedEver, tor->size_when_done());
+    if ((groups & TR_STAT_GROUP_ACTIVITY) != 0U)
+    {
+        s->activity = tor->activity();
+        s->idleSecs = torrentGetIdleSecs(tor, s->activity);
+        s->isStalled = tr_torrentIsStalled(tor, s->idleSecs);
+    }
+
+    if ((groups & TR_STAT_GROUP_SWARM) != 0U)
+    {
+        auto const swarm_stats = tor->swarm != nullptr ? tr_swarmGetStats(tor->swarm) : tr_swarm_stats{};
+        s->peersConnected = swarm_stats.peer_count;
+        s->peersSendingToUs = swarm_stats.active_peer_count[TR_DOWN];
+        s->peersGettingFromUs = swarm_stats.active_peer_count[TR_UP];
+        s->webseedsSendingToUs = swarm_stats.active_webseed_count;
+
+        for (int i = 0; i < TR_PEER_FROM__MAX; i++)
+        {
+            s->peersFrom[i] = swarm_stats.peer_from_count[i];
+        }
+    }
+
+    auto piece_upload_speed_bytes_per_second = tr_bytes_per_second_t{};
+    auto piece_download_speed_bytes_per_second = tr_bytes_per_second_t{};
+    if ((groups & TR_STAT_GROUP_SPEED) != 0U)
+    {
+        piece_upload_speed_bytes_per_second = tor->bandwidth_.get_piece_speed_bytes_per_second(now, TR_UP);
+        s->pieceUploadSpeed_KBps = tr_toSpeedKBps(piece_upload_speed_bytes_per_second);
+        piece_download_speed_bytes_per_second = tor->bandwidth_.get_piece_speed_bytes_per_second(now, TR_DOWN);
+        s->pieceDownloadSpeed_KBps = tr_toSpeedKBps(piece_download_speed_bytes_per_second);
+    }
+
+    if ((groups & TR_STAT_GROUP_COMPLETION) != 0U)
+    {
+        s->percentComplete = tor->completion.percent_complete();
+        s->percentDone = tor->completion.percent_done();
+        s->leftUntilDone = tor->completion.left_until_done();
+        s->sizeWhenDone = tor->completion.size_when_done();
+        s->haveValid = tor->completion.has_valid();
+        s->haveUnchecked = tor->has_total() - s->haveValid;
+    }
+
+    if ((groups & TR_STAT_GROUP_AVAILABLE) != 0U)
+    {
+        s->desiredAvailable = tr_peerMgrGetDesiredAvailable(tor);
+    }
+
+    if ((groups & TR_STAT_GROUP_PROGRESS) != 0U)
+    {
+        s->metadataPercentComplete = tr_torrentGetMetadataPercent(tor);
+        s->recheckProgress = tor->verify_progress().value_or(0.0);
+        s->relocateProgress = tor->session->moveFilesProgress(tor->id()).value_or(0.0);
+        s->preallocateProgress = tor->session->preallocateFilesProgress(tor->id()).value_or(0.0);
+    }
+
+    if ((groups & TR_STAT_GROUP_TRANSFER) != 0U)
+    {
+        s->corruptEver = tor->corruptCur + tor->corruptPrev;
+        s->downloadedEver = tor->downloadedCur + tor->downloadedPrev;
+        s->uploadedEver = tor->uploadedCur + tor->uploadedPrev;
+        s->ratio = tr_getRatio(s->uploadedEver, tor->size_when_done());
+    }
+
+    if ((groups & TR_STAT_GROUP_ETA) == 0U)
+    {
+        return s;
+    }
 
     auto seed_ratio_bytes_left = uint64_t{};
     auto seed_ratio_bytes_goal = uint64_t{};
@@ -1773,7 +2133,7 @@ void onVerifyDoneThreadFunc(tr_torrent* const tor)
     }
 }
 
-void verifyTorrent(tr_torrent* const tor)
+void verifyTorrent(tr_torrent* const tor, bool quick, bool background)
 {
     TR_ASSERT(tor->session->am_in_session_thread());
     auto const lock = tor->unique_lock();
@@ -1791,6 +2151,42 @@ void verifyTorrent(tr_torrent* const tor)
         return;
     }
 
+    // only a running torrent has anything to keep serving
+    background = background && tor->is_running();
+
+    if (tor->is_running() && !background)
+    {
+        torrentStop(tor);
+    }
+
+    if (!setLocalErrorIfFilesDisappeared(tor))
+    {
+        if (quick || background)
+        {
+            tor->uncheck_changed_files();
+        }
+
+        tor->session->verifyAdd(tor, quick || background, background);
+    }
+}
+
+// Pick up an unfinished verify from its checkpoint
+void resumeVerify(tr_torrent* const tor)
+{
+    TR_ASSERT(tor->session->am_in_session_thread());
+    auto const lock = tor->unique_lock();
+
+    if (tor->is_deleting_ || !tor->has_metainfo() || tor->verify_state() != TR_VERIFY_NONE)
+    {
+        return;
+    }
+
+    auto const checkpoint = tor->verify_checkpoint_;
+    if (!checkpoint)
+    {
+        return;
+    }
+
     if (tor->is_running())
     {
         torrentStop(tor);
@@ -1798,7 +2194,8 @@ void verifyTorrent(tr_torrent* const tor)
 
     if (!setLocalErrorIfFilesDisappeared(tor))
     {
-        tor->session->verifyAdd(tor);
+        tr_logAddInfoTor(tor, fmt::format(_("Resuming verify at piece {piece}"), fmt::arg("piece", checkpoint->piece)));
+        tor->session->verifyAdd(tor, checkpoint->quick, false, checkpoint->piece);
     }
 }
 } // namespace verify_helpers
@@ -1813,23 +2210,63 @@ void tr_torrentOnVerifyDone(tr_torrent* tor, bool aborted)
         return;
     }
 
-    tor->session->runInSessionThread(onVerifyDoneThreadFunc, tor);
+    tor->session->runInSessionThread([tor]() { onVerifyDoneThreadFunc(tor); });
 }
 
 void tr_torrentVerify(tr_torrent* tor)
 {
     using namespace verify_helpers;
 
-    tor->session->runInSessionThread(verifyTorrent, tor);
+    tor->session->runInSessionThread([tor]() { verifyTorrent(tor, false, false); });
 }
 
-void tr_torrent::set_verify_state(tr_verify_state state)
+void tr_torrentVerifyQuick(tr_torrent* tor)
+{
+    using namespace verify_helpers;
+
+    tor->session->runInSessionThread([tor]() { verifyTorrent(tor, true, false); });
+}
+
+void tr_torrentVerifyBackground(tr_torrent* tor)
+{
+    using namespace verify_helpers;
+
+    tor->session->runInSessionThread([tor]() { verifyTorrent(tor, true, true); });
+}
+
+void tr_torrentVerifyPause(tr_torrent* tor)
+{
+    tor->session->runInSessionThread(
+        [tor]()
+        {
+            auto const lock = tor->unique_lock();
+
+            if (auto& checkpoint = tor->verify_checkpoint_; checkpoint && !tor->is_verifying_in_background())
+            {
+                tor->session->verifyRemove(tor);
+                checkpoint->paused = true;
+                tor->set_dirty();
+                tor->mark_changed();
+            }
+        });
+}
+
+void tr_torrentVerifyResume(tr_torrent* tor)
+{
+    using namespace verify_helpers;
+
+    tor->session->runInSessionThread([tor]() { resumeVerify(tor); });
+}
+
+void tr_torrent::set_verify_state(tr_verify_state state, bool background)
 {
     TR_ASSERT(state == TR_VERIFY_NONE || state == TR_VERIFY_WAIT || state == TR_VERIFY_NOW);
 
     this->verify_state_ = state;
+    this->verify_in_background_ = background && state != TR_VERIFY_NONE;
     this->verify_progress_ = {};
     this->mark_changed();
+    this->session->torrents().update_activity(this);
 }
 
 // ---
@@ -1899,6 +2336,7 @@ void tr_torrent::recheck_completeness()
         }
 
         this->completeness = new_completeness;
+        this->session->torrents().update_activity(this);
         this->session->closeTorrentFiles(this);
 
         if (this->is_done())
@@ -1939,6 +2377,40 @@ void tr_torrentSetFileDLs(tr_torrent* tor, tr_file_index_t const* files, tr_file
     tor->set_files_wanted(files, n_files, wanted);
 }
 
+void tr_torrent::apply_file_changes(FileChanges const& changes)
+{
+    auto const lock = unique_lock();
+
+    auto const wanted_changed = !std::empty(changes.unwanted) || !std::empty(changes.wanted);
+    auto const priority_changed = !std::empty(changes.priority_high) || !std::empty(changes.priority_low) ||
+        !std::empty(changes.priority_normal);
+
+    if (wanted_changed)
+    {
+        update_files_wanted(std::data(changes.unwanted), std::size(changes.unwanted), false);
+        update_files_wanted(std::data(changes.wanted), std::size(changes.wanted), true);
+        files_wanted_changed_.emit(this);
+    }
+
+    if (priority_changed)
+    {
+        file_priorities_.set(std::data(changes.priority_high), std::size(changes.priority_high), TR_PRI_HIGH);
+        file_priorities_.set(std::data(changes.priority_low), std::size(changes.priority_low), TR_PRI_LOW);
+        file_priorities_.set(std::data(changes.priority_normal), std::size(changes.priority_normal), TR_PRI_NORMAL);
+        priority_changed_.emit(this);
+    }
+
+    if (wanted_changed || priority_changed)
+    {
+        set_dirty();
+    }
+
+    if (wanted_changed)
+    {
+        recheck_completeness();
+    }
+}
+
 // ---
 
 void tr_torrent::setLabels(std::vector<tr_quark> const& new_labels)
@@ -1954,6 +2426,7 @@ void tr_torrent::setLabels(std::vector<tr_quark> const& new_labels)
         }
     }
     this->labels.shrink_to_fit();
+    this->session->torrents().reindex(this);
     this->set_dirty();
 }
 
@@ -1976,6 +2449,7 @@ void tr_torrent::set_bandwidth_group(std::string_view group_name) noexcept
         this->bandwidth_.set_parent(&this->session->getBandwidthGroup(group_name));
     }
 
+    this->session->torrents().reindex(this);
     this->set_dirty();
 }
 
@@ -2077,9 +2551,85 @@ tr_block_span_t tr_torGetFileBlockSpan(tr_torrent const* tor, tr_file_index_t fi
 
 // ---
 
+void tr_torrent::hibernate()
+{
+    if (is_hibernating_)
+    {
+        return;
+    }
+
+    is_hibernating_ = true;
+    tr_logAddDebugTor(this, "Hibernating");
+
+    // the piece hashes can be read back from the .torrent file when needed
+    if (auto const filename = torrent_file(); has_metainfo() && metainfo_.has_piece_hashes() &&
+        tr_sys_path_exists(filename) && metainfo_.reload_pieces_offset(filename))
+    {
+        metainfo_.drop_piece_hashes();
+    }
+
+    session->piece_hash_cache().erase(id());
+    session->info_dict_cache().erase(id());
+}
+
+void tr_torrent::wake()
+{
+    if (is_hibernating_)
+    {
+        is_hibernating_ = false;
+        tr_logAddDebugTor(this, "Waking up");
+    }
+}
+
+tr_sha1_digest_t tr_torrent::piece_hash(tr_piece_index_t i) const
+{
+    if (metainfo_.has_piece_hashes())
+    {
+        return metainfo_.piece_hash(i);
+    }
+
+    // If the hash can't be read, return a hash that won't match any piece
+    // so that the piece is treated as bad rather than trusted.
+    return session->piece_hash_cache().get(id(), metainfo_, torrent_file(), i).value_or(tr_sha1_digest_t{});
+}
+
+std::string const& tr_torrent::piece_bitfield_base64() const
+{
+    if (auto const revision = pieces_revision(); piece_bitfield_base64_revision_ != revision)
+    {
+        auto const& bytes = piece_bitfield();
+        piece_bitfield_base64_ = tr_base64_encode({ reinterpret_cast<char const*>(std::data(bytes)), std::size(bytes) });
+        piece_bitfield_base64_revision_ = revision;
+    }
+
+    return piece_bitfield_base64_;
+}
+
+// ---
+
+tr_torrent_usage::Memory tr_torrent::memory_usage() const
+{
+    auto memory = tr_torrent_usage::Memory{};
+    memory.cache = session->cache->dirty_bytes(id());
+    memory.read_cache = session->cache->clean_bytes(id());
+
+    if (swarm != nullptr)
+    {
+        memory.peer_buffers = tr_peerMgrBufferBytes(this);
+    }
+
+    if (incomplete_metadata)
+    {
+        memory.metadata = incomplete_metadata->metadata.capacity();
+    }
+
+    return memory;
+}
+
 // TODO: should be const after tr_ioTestPiece() is const
 bool tr_torrent::check_piece(tr_piece_index_t piece)
 {
+    auto const timer = tr_torrent_usage::Timer{ usage_, tr_torrent_usage::HashUsec };
     bool const pass = tr_ioTestPiece(this, piece);
     tr_logAddTraceTor(this, fmt::format("[LAZY] tr_torrent.checkPiece tested piece {}, pass=={}", piece, pass));
     return pass;
@@ -2103,6 +2653,12 @@ bool tr_torrent::set_tracker_list(std::string_view text)
         return false;
     }
 
+    // rewriting the .torrent file may have moved the piece hashes
+    if (has_metadata && !metainfo_.has_piece_hashes())
+    {
+        metainfo_.reload_pieces_offset(torrent_file());
+    }
+
     this->metainfo_.announce_list() = announce_list;
     this->mark_edited();
 
@@ -2300,6 +2856,8 @@ void onFileCompleted(tr_torrent* tor, tr_file_index_t i)
                         fmt::arg("error_code", error->code)));
                 tr_error_free(error);
             }
+
+            tor->forget_found_file(i);
         }
     }
 }
@@ -2313,6 +2871,7 @@ void onPieceCompleted(tr_torrent* tor, tr_piece_index_t piece)
 
     // if this piece completes any file, invoke the fileCompleted func for it
     auto const span = tor->fpm_.file_span(piece);
+    tor->session->piece_syncer().add(tor->id(), piece, span.begin, span.end);
     for (auto file = span.begin; file < span.end; ++file)
     {
         if (tor->completion.has_blocks(tr_torGetFileBlockSpan(tor, file)))
@@ -2332,6 +2891,45 @@ void onPieceFailed(tr_torrent* tor, tr_piece_index_t piece)
     tor->got_bad_piece_.emit(tor, piece);
     tor->set_has_piece(piece, false);
 }
+
+void onPieceChecked(tr_session* session, tr_torrent_id_t id, tr_piece_index_t piece, bool pass)
+{
+    // the torrent may have been removed or reverified while we were hashing
+    auto* const tor = session->torrents().get(id);
+    if (tor == nullptr || !tor->has_piece(piece))
+    {
+        return;
+    }
+
+    tr_logAddTraceTor(tor, fmt::format("tested piece {}, pass=={}", piece, pass));
+
+    if (pass)
+    {
+        onPieceCompleted(tor, piece);
+    }
+    else
+    {
+        onPieceFailed(tor, piece);
+    }
+}
+
+// Hash the piece in a worker thread so that large pieces
+// don't block the session thread while we're downloading.
+void checkCompletedPiece(tr_torrent* tor, tr_piece_index_t piece)
+{
+    auto data = tr_ioReadPiece(tor, piece);
+    if (!data)
+    {
+        onPieceFailed(tor, piece);
+        return;
+    }
+
+    auto* const session = tor->session;
+    session->hashPiece(
+        std::move(*data),
+        tor->piece_hash(piece),
+        [session, id = tor->id(), piece](bool pass) { onPieceChecked(session, id, piece, pass); });
+}
 } // namespace got_block_helpers
 } // namespace
 
@@ -2364,14 +2962,7 @@ void tr_torrentGotBlock(tr_torrent* tor, tr_block_index_t block)
             continue;
         }
 
-        if (tor->check_piece(piece))
-        {
-            onPieceCompleted(tor, piece);
-        }
-        else
-        {
-            onPieceFailed(tor, piece);
-        }
+        checkCompletedPiece(tor, piece);
     }
 }
 
@@ -2413,6 +3004,8 @@ void tr_torrent::set_download_dir(std::string_view path, bool is_new_torrent)
 // decide whether we should be looking for files in downloadDir or incompleteDir
 void tr_torrent::refresh_current_dir()
 {
+    forget_found_files();
+
     auto dir = tr_interned_string{};
 
     if (std::empty(incomplete_dir()))
@@ -2605,6 +3198,7 @@ void torrentRenamePath(
             for (auto const& file_index : file_indices)
             {
                 renameTorrentFileString(tor, oldpath, newname, file_index);
+                tor->forget_found_file(file_index);
             }
 
             /* update tr_info.name if user changed the toplevel */
@@ -2641,12 +3235,8 @@ void tr_torrent::rename_path(
     using namespace rename_helpers;
 
     this->session->runInSessionThread(
-        torrentRenamePath,
-        this,
-        std::string{ oldpath },
-        std::string{ newname },
-        callback,
-        callback_user_data);
+        [tor = this, oldpath = std::string{ oldpath }, newname = std::string{ newname }, callback, callback_user_data]()
+        { torrentRenamePath(tor, oldpath, newname, callback, callback_user_data); });
 }
 
 void tr_torrentRenamePath(
@@ -2720,6 +3310,12 @@ void tr_torrent::init_checked_pieces(tr_bitfield const& checked, time_t const* m
 
     for (size_t i = 0; i < n; ++i)
     {
+        // padding files are never on disk, so there's nothing to check
+        if (this->file_is_padding(i))
+        {
+            continue;
+        }
+
         auto const found = this->find_file(i);
         auto const mtime = found ? found->last_modified_at : 0;
 
@@ -2733,3 +3329,70 @@ void tr_torrent::init_checked_pieces(tr_bitfield const& checked, time_t const* m
         }
     }
 }
+
+void tr_torrent::uncheck_changed_files()
+{
+    for (tr_file_index_t i = 0, n = file_count(); i < n; ++i)
+    {
+        if (file_is_padding(i))
+        {
+            continue;
+        }
+
+        auto const found = find_file(i);
+        auto const mtime = found ? found->last_modified_at : 0;
+        auto const [begin, end] = pieces_in_file(i);
+
+        // a file that's shorter than the data we have in it was truncated,
+        // e.g. because writes were lost in an unclean shutdown
+        auto size_needed = uint64_t{};
+        for (auto piece = end; piece > begin; --piece)
+        {
+            if (has_piece(piece - 1U))
+            {
+                auto const [file_begin, file_end] = byte_span(i);
+                auto const piece_end = piece_loc(piece - 1U).byte + piece_size(piece - 1U);
+                size_needed = std::min(file_end, piece_end) - file_begin;
+                break;
+            }
+        }
+
+        if (mtime == 0 || mtime != file_mtimes_[i] || found->size < size_needed)
+        {
+            checked_pieces_.unset_span(begin, end);
+        }
+
+        file_mtimes_[i] = mtime;
+    }
+}
+
+void tr_torrent::on_background_verdicts(std::vector<std::pair<tr_piece_index_t, bool>> const& verdicts)
+{
+    TR_ASSERT(session->am_in_session_thread());
+
+    auto lost_pieces = false;
+    for (auto const& [piece, pass] : verdicts)
+    {
+        if (is_piece_checked(piece) || !has_piece(piece))
+        {
+            continue;
+        }
+
+        checked_pieces_.set(piece, true);
+
+        if (!pass)
+        {
+            tr_logAddDebugTor(this, fmt::format("Piece {} failed its background check", piece));
+            set_has_piece(piece, false);
+            lost_pieces = true;
+        }
+    }
+
+    mark_changed();
+    set_dirty();
+
+    if (lost_pieces)
+    {
+        recheck_completeness();
+    }
+}
@@ -10,7 +10,10 @@
 #endif
 
 #include <cstddef> // size_t
+#include <cstdint> // uint64_t
 #include <ctime>
+#include <memory>
+#include <mutex>
 #include <optional>
 #include <string>
 #include <string_view>
@@ -30,9 +33,12 @@
 #include "libtransmission/observable.h"
 #include "libtransmission/log.h"
 #include "libtransmission/session.h"
+#include "libtransmission/stream-cursor.h"
 #include "libtransmission/torrent-magnet.h"
 #include "libtransmission/torrent-metainfo.h"
+#include "libtransmission/torrent-usage.h"
 #include "libtransmission/tr-macros.h"
+#include "libtransmission/verify-manifest.h"
 
 class tr_swarm;
 struct tr_error;
@@ -71,6 +77,27 @@ void tr_torrentCheckSeedLimit(tr_torrent* tor);
 /** save a torrent's .resume file if it's changed since the last time it was saved */
 void tr_torrentSave(tr_torrent* tor);
 
+// Groups of `tr_stat` fields that can be computed on their own, so that
+// callers who need only a few fields of many torrents don't pay for all of them.
+enum tr_stat_group : uint32_t
+{
+    TR_STAT_GROUP_BASIC = (1U << 0U), // id, errors, queue position, dates
+    TR_STAT_GROUP_ACTIVITY = (1U << 1U), // activity, idleSecs, isStalled
+    TR_STAT_GROUP_SWARM = (1U << 2U), // peer and webseed counts
+    TR_STAT_GROUP_SPEED = (1U << 3U), // piece speeds
+    TR_STAT_GROUP_COMPLETION = (1U << 4U), // percentages, haveValid, haveUnchecked, leftUntilDone, sizeWhenDone
+    TR_STAT_GROUP_AVAILABLE = (1U << 5U), // desiredAvailable
+    TR_STAT_GROUP_PROGRESS = (1U << 6U), // metadata, recheck, relocate, and preallocate progress
+    TR_STAT_GROUP_TRANSFER = (1U << 7U), // corruptEver, downloadedEver, uploadedEver, ratio
+    TR_STAT_GROUP_ETA = (1U << 8U), // eta, etaIdle, finished, seedRatioPercentDone
+    TR_STAT_GROUP_ALL = (1U << 9U) - 1U
+};
+
+// Like `tr_torrentStat()`, but only updates the fields in `groups`,
+// which is a bitwise-or of `tr_stat_group`s. The other fields keep
+// whatever values they had before.
+tr_stat const* tr_torrentStat(tr_torrent* tor, uint32_t groups);
+
 enum tr_verify_state : uint8_t
 {
     TR_VERIFY_NONE,
@@ -88,6 +115,7 @@ public:
         : metainfo_{ std::move(tm) }
         , completion{ this, &this->metainfo_.block_info() }
     {
+        metainfo_.announce_list().intern();
     }
 
     void set_location(
@@ -102,10 +130,7 @@ public:
         tr_torrent_rename_done_func callback,
         void* callback_user_data);
 
-    tr_sha1_digest_t piece_hash(tr_piece_index_t i) const
-    {
-        return metainfo_.piece_hash(i);
-    }
+    [[nodiscard]] tr_sha1_digest_t piece_hash(tr_piece_index_t i) const;
 
     // these functions should become private when possible,
     // but more refactoring is needed before that can happen
@@ -262,9 +287,23 @@ public:
         return completion.has_total();
     }
 
-    [[nodiscard]] auto create_piece_bitfield() const
+    [[nodiscard]] auto const& piece_bitfield() const
+    {
+        return completion.piece_bitfield();
+    }
+
+    // @return piece_bitfield() in base64, e.g. for RPC clients' piece maps.
+    // It's cached until the torrent's pieces change.
+    [[nodiscard]] std::string const& piece_bitfield_base64() const;
+
+    [[nodiscard]] constexpr auto pieces_revision() const noexcept
+    {
+        return completion.pieces_revision();
+    }
+
+    [[nodiscard]] auto pieces_added_since(uint64_t revision) const
     {
-        return completion.create_piece_bitfield();
+        return completion.pieces_added_since(revision);
     }
 
     [[nodiscard]] constexpr bool is_done() const noexcept
@@ -350,15 +389,34 @@ public:
     void set_file_priorities(tr_file_index_t const* files, tr_file_index_t file_count, tr_priority_t priority)
     {
         file_priorities_.set(files, file_count, priority);
+        priority_changed_.emit(this);
         set_dirty();
     }
 
     void set_file_priority(tr_file_index_t file, tr_priority_t priority)
     {
         file_priorities_.set(file, priority);
+        priority_changed_.emit(this);
         set_dirty();
     }
 
+    /// FILE CHANGES
+
+    // Changes to many files' wanted flags and priorities. They're applied
+    // together so that what depends on them is updated and announced once.
+    // A file that's in more than one list gets the one that's applied last:
+    // `wanted` after `unwanted`, and `normal` after `low` after `high`.
+    struct FileChanges
+    {
+        std::vector<tr_file_index_t> unwanted;
+        std::vector<tr_file_index_t> wanted;
+        std::vector<tr_file_index_t> priority_high;
+        std::vector<tr_file_index_t> priority_low;
+        std::vector<tr_file_index_t> priority_normal;
+    };
+
+    void apply_file_changes(FileChanges const& changes);
+
     /// LOCATION
 
     [[nodiscard]] constexpr tr_interned_string current_dir() const noexcept
@@ -393,6 +451,12 @@ public:
         return metainfo_.file_size(i);
     }
 
+    // BEP 47 padding files aren't on disk: they read as zeroes and writes to them are dropped
+    [[nodiscard]] TR_CONSTEXPR20 auto file_is_padding(tr_file_index_t i) const
+    {
+        return metainfo_.file_is_padding(i);
+    }
+
     void set_file_subpath(tr_file_index_t i, std::string_view subpath)
     {
         metainfo_.set_file_subpath(i, subpath);
@@ -400,8 +464,23 @@ public:
 
     [[nodiscard]] std::optional<tr_torrent_files::FoundFile> find_file(tr_file_index_t file_index) const;
 
+    // Like find_file(), but remembers where the file was found so that
+    // the next lookup doesn't need to search the disk for it again.
+    // @return true if the file was found, and `setme` holds its filename
+    [[nodiscard]] bool find_file_cached(tr_file_index_t file_index, tr_pathbuf& setme) const;
+
+    // Forget where find_file_cached() found the files, e.g. because they may have moved
+    void forget_found_files() const;
+    void forget_found_file(tr_file_index_t file_index) const;
+
     [[nodiscard]] bool has_any_local_data() const;
 
+    // the backend that holds this torrent's data, or nullptr for the local filesystem
+    [[nodiscard]] std::shared_ptr<tr_storage> storage() const
+    {
+        return session->storages().find(download_dir_.sv());
+    }
+
     /// METAINFO - TRACKERS
 
     [[nodiscard]] constexpr auto const& announce_list() const noexcept
@@ -540,6 +619,13 @@ public:
 
     void init_checked_pieces(tr_bitfield const& checked, time_t const* mtimes /*fileCount()*/);
 
+    // Mark the pieces of files that changed on disk since they were checked as unchecked
+    void uncheck_changed_files();
+
+    // Apply a background verify's verdicts. Pieces that were checked on
+    // demand since the verifier read them already have a newer verdict.
+    void on_background_verdicts(std::vector<std::pair<tr_piece_index_t, bool>> const& verdicts);
+
     ///
 
     [[nodiscard]] constexpr auto is_queued() const noexcept
@@ -588,13 +674,19 @@ public:
 
     void refresh_current_dir();
 
-    void set_verify_state(tr_verify_state state);
+    // If `background` is true, the torrent keeps running while it's verified
+    void set_verify_state(tr_verify_state state, bool background = false);
 
     [[nodiscard]] constexpr auto verify_state() const noexcept
     {
         return verify_state_;
     }
 
+    [[nodiscard]] constexpr auto is_verifying_in_background() const noexcept
+    {
+        return verify_in_background_;
+    }
+
     constexpr void set_verify_progress(float f) noexcept
     {
         verify_progress_ = f;
@@ -629,12 +721,12 @@ public:
     {
         bool const is_seed = this->is_done();
 
-        if (this->verify_state() == TR_VERIFY_NOW)
+        if (this->verify_state() == TR_VERIFY_NOW && !verify_in_background_)
         {
             return TR_STATUS_CHECK;
         }
 
-        if (this->verify_state() == TR_VERIFY_WAIT)
+        if (this->verify_state() == TR_VERIFY_WAIT && !verify_in_background_)
         {
             return TR_STATUS_CHECK_WAIT;
         }
@@ -676,6 +768,43 @@ public:
         return sequential_download_;
     }
 
+    // BEP 16 super-seeding. Only used while we have every piece: instead
+    // of a full bitfield, new peers are shown one piece at a time.
+    constexpr void set_super_seeding(bool is_super_seeding) noexcept
+    {
+        if (super_seeding_ != is_super_seeding)
+        {
+            super_seeding_ = is_super_seeding;
+            set_dirty();
+        }
+    }
+
+    [[nodiscard]] constexpr auto is_super_seeding() const noexcept
+    {
+        return super_seeding_;
+    }
+
+    // Tell the piece scheduler that a streaming reader is at `byte`,
+    // so that the pieces just ahead of it are downloaded first.
+    void set_stream_position(uint64_t byte, uint64_t now_msec)
+    {
+        auto const was_active = stream_cursor_.is_active(now_msec);
+        auto const old_piece = byte_loc(stream_cursor_.byte()).piece;
+        stream_cursor_.update(byte, now_msec);
+
+        // the deadlines only need recomputing when the reader reaches a new piece
+        if (!was_active || byte_loc(byte).piece != old_piece)
+        {
+            stream_cursor_changed_.emit(this);
+        }
+    }
+
+    // @return when a streaming reader is expected to need `piece`, if ever
+    [[nodiscard]] std::optional<uint64_t> piece_deadline(tr_piece_index_t piece) const noexcept
+    {
+        return stream_cursor_.deadline(block_info().byte_span_for_piece(piece));
+    }
+
     [[nodiscard]] constexpr bool is_running() const noexcept
     {
         return is_running_;
@@ -795,12 +924,46 @@ public:
             recheck_completeness();
         }
 
+        if (stream_cursor_.is_idle(tr_time_msec()))
+        {
+            stream_cursor_.clear();
+            stream_cursor_changed_.emit(this);
+        }
+
         if (is_stopping_)
         {
             tr_torrentStop(this);
         }
     }
 
+    // --- hibernation
+
+    // @return true if this idle seed has freed the memory that it only
+    // needs while peers are connected. See tr_swarm for when this happens.
+    [[nodiscard]] constexpr auto is_hibernating() const noexcept
+    {
+        return is_hibernating_;
+    }
+
+    void hibernate();
+    void wake();
+
+    // --- resource usage
+
+    // What this torrent has cost the session so far
+    [[nodiscard]] constexpr tr_torrent_usage const& usage() const noexcept
+    {
+        return usage_;
+    }
+
+    [[nodiscard]] constexpr tr_torrent_usage& usage() noexcept
+    {
+        return usage_;
+    }
+
+    // @return the memory that this torrent is holding right now
+    [[nodiscard]] tr_torrent_usage::Memory memory_usage() const;
+
     [[nodiscard]] constexpr auto announce_key() const noexcept
     {
         return announce_key_;
@@ -814,8 +977,10 @@ public:
     // should be called when done modifying the torrent's announce list.
     void on_announce_list_changed()
     {
+        metainfo_.announce_list().intern();
         mark_edited();
         session->announcer_->resetTorrent(this);
+        session->torrents().reindex(this);
     }
 
     tr_torrent_metainfo metainfo_;
@@ -830,6 +995,9 @@ public:
     libtransmission::SimpleObservable<tr_torrent*> started_;
     libtransmission::SimpleObservable<tr_torrent*> stopped_;
     libtransmission::SimpleObservable<tr_torrent*> swarm_is_all_seeds_;
+    libtransmission::SimpleObservable<tr_torrent*> files_wanted_changed_;
+    libtransmission::SimpleObservable<tr_torrent*> priority_changed_;
+    libtransmission::SimpleObservable<tr_torrent*> stream_cursor_changed_;
 
     tr_stat stats = {};
 
@@ -841,6 +1009,19 @@ public:
     // it means that piece needs to be checked before its data is used.
     tr_bitfield checked_pieces_ = tr_bitfield{ 0 };
 
+    // Where an unfinished verify left off, so that it can pick up from
+    // there after a restart or once it's resumed. It's saved in the
+    // .resume file along with checked_pieces_, which has the verdicts
+    // for the pieces before `piece`.
+    struct VerifyCheckpoint
+    {
+        tr_piece_index_t piece = 0;
+        bool quick = false;
+        bool paused = false;
+    };
+
+    std::optional<VerifyCheckpoint> verify_checkpoint_;
+
     tr_file_piece_map fpm_ = tr_file_piece_map{ metainfo_ };
     tr_file_priorities file_priorities_{ &fpm_ };
     tr_files_wanted files_wanted_{ &fpm_ };
@@ -853,8 +1034,6 @@ public:
     // when Transmission thinks the torrent's files were last changed
     std::vector<time_t> file_mtimes_;
 
-    tr_sha1_digest_t obfuscated_hash = {};
-
     tr_session* session = nullptr;
 
     tr_torrent_announcer* torrent_announcer = nullptr;
@@ -866,6 +1045,12 @@ public:
      * other peers */
     std::optional<tr_incomplete_metadata> incomplete_metadata;
 
+    // when we last looked for this magnet's metainfo in the metadata cache dir
+    time_t metadata_cache_dir_checked_at = 0;
+
+    // true once we've asked the metadata cache url for this magnet's metainfo
+    bool metadata_cache_tried = false;
+
     time_t lpdAnnounceAt = 0;
 
     time_t activityDate = 0;
@@ -933,7 +1118,19 @@ public:
     // e.g. fetching metadata from peers and/or verifying the torrent
     bool start_when_stable = false;
 
+    // files that were verified elsewhere, to trust instead of verifying
+    // them when the metainfo is complete. See tr_ctorSetVerifyManifest().
+    std::optional<tr_verify_manifest> verify_manifest_;
+
 private:
+    // where find_file_cached() found each file, or an empty string if unknown
+    mutable std::mutex found_files_mutex_;
+    mutable std::vector<std::string> found_files_;
+
+    // piece_bitfield_base64() and the pieces revision it was made from
+    mutable std::string piece_bitfield_base64_;
+    mutable uint64_t piece_bitfield_base64_revision_ = 0U;
+
     [[nodiscard]] constexpr bool is_piece_transfer_allowed(tr_direction direction) const noexcept
     {
         if (uses_speed_limit(direction) && speed_limit_bps(direction) <= 0)
@@ -952,12 +1149,23 @@ private:
         return true;
     }
 
+    // Update files_wanted_, and the completion's size_when_done() for each piece that changed
+    void update_files_wanted(tr_file_index_t const* files, size_t n_files, bool wanted)
+    {
+        auto changed_pieces = std::vector<tr_piece_index_t>{};
+        files_wanted_.set(files, n_files, wanted, &changed_pieces);
+        for (auto const piece : changed_pieces)
+        {
+            completion.on_piece_wanted_changed(piece);
+        }
+    }
+
     void set_files_wanted(tr_file_index_t const* files, size_t n_files, bool wanted, bool is_bootstrapping)
     {
         auto const lock = unique_lock();
 
-        files_wanted_.set(files, n_files, wanted);
-        completion.invalidate_size_when_done();
+        update_files_wanted(files, n_files, wanted);
+        files_wanted_changed_.emit(this);
 
         if (!is_bootstrapping)
         {
@@ -976,6 +1184,7 @@ private:
     tr_peer_id_t peer_id_ = tr_peerIdInit();
 
     tr_verify_state verify_state_ = TR_VERIFY_NONE;
+    bool verify_in_background_ = false;
 
     float verify_progress_ = -1;
 
@@ -985,7 +1194,14 @@ private:
 
     bool needs_completeness_check_ = true;
 
+    tr_stream_cursor stream_cursor_;
+
     bool sequential_download_ = false;
+    bool super_seeding_ = false;
+
+    bool is_hibernating_ = false;
+
+    tr_torrent_usage usage_;
 };
 
 // ---
@@ -1003,12 +1219,27 @@ void tr_torrentGotBlock(tr_torrent* tor, tr_block_index_t block);
 tr_torrent_metainfo tr_ctorStealMetainfo(tr_ctor* ctor);
 
 bool tr_ctorSetMetainfoFromFile(tr_ctor* ctor, std::string_view filename, tr_error** error = nullptr);
+
+// Use metainfo that was already parsed from `contents`, e.g. by a worker thread
+void tr_ctorSetMetainfo(tr_ctor* ctor, tr_torrent_metainfo&& metainfo, std::vector<char>&& contents, std::string_view filename);
+
+// Use the contents of a resume file that was already read, e.g. by a worker thread.
+// This is forgotten when the ctor's metainfo changes.
+void tr_ctorSetResumeContents(tr_ctor* ctor, std::string_view filename, std::vector<char>&& contents);
+
+// @return the contents passed to tr_ctorSetResumeContents() if they're for `filename`
+[[nodiscard]] std::vector<char> const* tr_ctorGetResumeContents(tr_ctor const* ctor, std::string_view filename);
+
 bool tr_ctorSetMetainfoFromMagnetLink(tr_ctor* ctor, std::string_view magnet_link, tr_error** error = nullptr);
 void tr_ctorSetLabels(tr_ctor* ctor, tr_quark const* labels, size_t n_labels);
 void tr_ctorSetBandwidthPriority(tr_ctor* ctor, tr_priority_t priority);
 tr_priority_t tr_ctorGetBandwidthPriority(tr_ctor const* ctor);
 tr_torrent::labels_t const& tr_ctorGetLabels(tr_ctor const* ctor);
 
+// Trust the files that match `manifest` instead of verifying them when the torrent is added
+void tr_ctorSetVerifyManifest(tr_ctor* ctor, tr_verify_manifest&& manifest);
+[[nodiscard]] std::optional<tr_verify_manifest> const& tr_ctorGetVerifyManifest(tr_ctor const* ctor);
+
 void tr_torrentOnVerifyDone(tr_torrent* tor, bool aborted);
 
 #define tr_logAddCriticalTor(tor, msg) tr_logAddCritical(msg, (tor)->name())
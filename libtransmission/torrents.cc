@@ -4,12 +4,15 @@
 // License text can be found in the licenses/ folder.
 
 #include <algorithm>
+#include <iterator>
 #include <set>
 #include <string_view>
+#include <utility>
 #include <vector>
 
 #include "libtransmission/transmission.h"
 
+#include "libtransmission/crypto-utils.h"
 #include "libtransmission/magnet-metainfo.h"
 #include "libtransmission/torrent.h"
 #include "libtransmission/torrents.h"
@@ -41,6 +44,11 @@ constexpr struct
     }
 } CompareTorrentByHash{};
 
+[[nodiscard]] auto obfuscate(tr_sha1_digest_t const& info_hash)
+{
+    return tr_sha1::digest(std::string_view{ "req2" }, info_hash);
+}
+
 } // namespace
 
 tr_torrent* tr_torrents::get(std::string_view magnet_link)
@@ -66,6 +74,11 @@ tr_torrent_id_t tr_torrents::add(tr_torrent* tor)
     auto const id = static_cast<tr_torrent_id_t>(std::size(by_id_));
     by_id_.push_back(tor);
     by_hash_.insert(std::lower_bound(std::begin(by_hash_), std::end(by_hash_), tor, CompareTorrentByHash), tor);
+    by_obfuscated_hash_.try_emplace(obfuscate(tor->info_hash()), tor);
+    tor->queuePosition = std::size(by_queue_position_);
+    by_queue_position_.push_back(tor);
+    reindex(tor, id);
+    count_activity(id, tor);
     return id;
 }
 
@@ -77,7 +90,24 @@ void tr_torrents::remove(tr_torrent const* tor, time_t current_time)
     by_id_[tor->id()] = nullptr;
     auto const [begin, end] = std::equal_range(std::begin(by_hash_), std::end(by_hash_), tor, CompareTorrentByHash);
     by_hash_.erase(begin, end);
+    if (auto const iter = by_obfuscated_hash_.find(obfuscate(tor->info_hash()));
+        iter != std::end(by_obfuscated_hash_) && iter->second == tor)
+    {
+        by_obfuscated_hash_.erase(iter);
+    }
     removed_.emplace_back(tor->id(), current_time);
+
+    // "so you die, captain, and we all move up in rank."
+    if (auto const pos = tor->queuePosition; pos < std::size(by_queue_position_) && by_queue_position_[pos] == tor)
+    {
+        by_queue_position_.erase(std::begin(by_queue_position_) + pos);
+        renumber_queue(pos, std::size(by_queue_position_));
+    }
+
+    by_label_.set(tor->id(), {});
+    by_group_.set(tor->id(), {});
+    by_tracker_.set(tor->id(), {});
+    count_activity(tor->id(), nullptr);
 }
 
 std::vector<tr_torrent_id_t> tr_torrents::removedSince(time_t timestamp) const
@@ -94,3 +124,227 @@ std::vector<tr_torrent_id_t> tr_torrents::removedSince(time_t timestamp) const
 
     return { std::begin(ids), std::end(ids) };
 }
+
+// ---
+
+void tr_torrents::set_queue_position(tr_torrent* tor, size_t pos)
+{
+    TR_ASSERT(!std::empty(by_queue_position_));
+    TR_ASSERT(by_queue_position_[tor->queuePosition] == tor);
+
+    auto const old_pos = tor->queuePosition;
+    auto const new_pos = std::min(pos, std::size(by_queue_position_) - 1U);
+    auto const begin = std::begin(by_queue_position_);
+
+    if (old_pos < new_pos)
+    {
+        std::rotate(begin + old_pos, begin + old_pos + 1, begin + new_pos + 1);
+    }
+    else if (new_pos < old_pos)
+    {
+        std::rotate(begin + new_pos, begin + old_pos, begin + old_pos + 1);
+    }
+
+    renumber_queue(std::min(old_pos, new_pos), std::max(old_pos, new_pos) + 1U);
+}
+
+void tr_torrents::move_to_queue_top(tr_torrent* const* torrents, size_t n)
+{
+    auto const mask = queue_mask(torrents, n);
+    auto const last = std::find(std::rbegin(mask), std::rend(mask), true);
+    auto const end = static_cast<size_t>(std::distance(last, std::rend(mask)));
+
+    auto const begin = std::begin(by_queue_position_);
+    std::stable_partition(begin, begin + end, [&mask](auto const* tor) { return mask[tor->queuePosition]; });
+    renumber_queue(0U, end);
+}
+
+void tr_torrents::move_to_queue_bottom(tr_torrent* const* torrents, size_t n)
+{
+    auto const mask = queue_mask(torrents, n);
+    auto const first = std::find(std::begin(mask), std::end(mask), true);
+    auto const begin = static_cast<size_t>(std::distance(std::begin(mask), first));
+
+    auto const end = std::end(by_queue_position_);
+    std::stable_partition(
+        std::begin(by_queue_position_) + begin,
+        end,
+        [&mask](auto const* tor) { return !mask[tor->queuePosition]; });
+    renumber_queue(begin, std::size(by_queue_position_));
+}
+
+void tr_torrents::move_queue_up(tr_torrent* const* torrents, size_t n)
+{
+    for (auto const pos : queue_positions(torrents, n))
+    {
+        if (pos > 0U)
+        {
+            std::swap(by_queue_position_[pos - 1U], by_queue_position_[pos]);
+            renumber_queue(pos - 1U, pos + 1U);
+        }
+    }
+}
+
+void tr_torrents::move_queue_down(tr_torrent* const* torrents, size_t n)
+{
+    auto const positions = queue_positions(torrents, n);
+    for (auto iter = std::rbegin(positions), end = std::rend(positions); iter != end; ++iter)
+    {
+        if (auto const pos = *iter; pos + 1U < std::size(by_queue_position_))
+        {
+            std::swap(by_queue_position_[pos], by_queue_position_[pos + 1U]);
+            renumber_queue(pos, pos + 2U);
+        }
+    }
+}
+
+std::vector<size_t> tr_torrents::queue_positions(tr_torrent* const* torrents, size_t n) const
+{
+    auto positions = std::vector<size_t>{};
+    positions.reserve(n);
+    for (size_t i = 0; i < n; ++i)
+    {
+        TR_ASSERT(by_queue_position_[torrents[i]->queuePosition] == torrents[i]);
+        positions.push_back(torrents[i]->queuePosition);
+    }
+
+    std::sort(std::begin(positions), std::end(positions));
+    positions.erase(std::unique(std::begin(positions), std::end(positions)), std::end(positions));
+    return positions;
+}
+
+std::vector<bool> tr_torrents::queue_mask(tr_torrent* const* torrents, size_t n) const
+{
+    auto mask = std::vector<bool>(std::size(by_queue_position_));
+    for (size_t i = 0; i < n; ++i)
+    {
+        TR_ASSERT(by_queue_position_[torrents[i]->queuePosition] == torrents[i]);
+        mask[torrents[i]->queuePosition] = true;
+    }
+    return mask;
+}
+
+void tr_torrents::renumber_queue(size_t begin, size_t end)
+{
+    for (auto pos = begin; pos < end; ++pos)
+    {
+        if (auto* const tor = by_queue_position_[pos]; tor->queuePosition != pos)
+        {
+            tor->queuePosition = pos;
+            tor->mark_changed();
+        }
+    }
+}
+
+// ---
+
+void tr_torrents::reindex(tr_torrent const* tor)
+{
+    // torrents that are still being constructed get indexed by add()
+    if (auto const id = tor->id(); get(id) == tor)
+    {
+        reindex(tor, id);
+    }
+}
+
+void tr_torrents::reindex(tr_torrent const* tor, tr_torrent_id_t id)
+{
+    by_label_.set(id, tor->labels);
+
+    auto group = std::vector<tr_quark>{};
+    if (auto const& name = tor->bandwidth_group(); !std::empty(name))
+    {
+        group.push_back(name.quark());
+    }
+    by_group_.set(id, std::move(group));
+
+    auto trackers = std::vector<tr_quark>{};
+    for (auto const& tracker : tor->announce_list())
+    {
+        trackers.push_back(tracker.host_and_port.quark());
+        trackers.push_back(tracker.sitename.quark());
+    }
+    by_tracker_.set(id, std::move(trackers));
+}
+
+void tr_torrents::update_activity(tr_torrent const* tor)
+{
+    // ignore torrents that are still being added or are being removed
+    if (auto const id = tor->id(); get(id) == tor)
+    {
+        count_activity(id, tor);
+    }
+}
+
+void tr_torrents::recount_activity()
+{
+    for (auto const* const tor : by_hash_)
+    {
+        count_activity(tor->id(), tor);
+    }
+}
+
+void tr_torrents::count_activity(tr_torrent_id_t id, tr_torrent const* tor)
+{
+    auto const uid = static_cast<size_t>(id);
+    if (uid >= std::size(activity_by_id_))
+    {
+        activity_by_id_.resize(uid + 1U);
+    }
+
+    auto& counted = activity_by_id_[uid];
+    if (counted)
+    {
+        --activity_counts_[counted->activity];
+        running_count_ -= counted->is_running ? 1U : 0U;
+    }
+
+    if (tor == nullptr)
+    {
+        counted.reset();
+        return;
+    }
+
+    counted = CountedActivity{ tor->activity(), tor->is_running() };
+    ++activity_counts_[counted->activity];
+    running_count_ += counted->is_running ? 1U : 0U;
+}
+
+void tr_torrents::Index::set(tr_torrent_id_t id, std::vector<tr_quark> keys)
+{
+    auto const uid = static_cast<size_t>(id);
+    if (uid >= std::size(keys_by_id_))
+    {
+        keys_by_id_.resize(uid + 1U);
+    }
+
+    for (auto const key : keys_by_id_[uid])
+    {
+        auto const iter = ids_by_key_.find(key);
+        auto& ids = iter->second;
+        ids.erase(std::lower_bound(std::begin(ids), std::end(ids), id));
+        if (std::empty(ids))
+        {
+            ids_by_key_.erase(iter);
+        }
+    }
+
+    std::sort(std::begin(keys), std::end(keys));
+    keys.erase(std::unique(std::begin(keys), std::end(keys)), std::end(keys));
+
+    for (auto const key : keys)
+    {
+        auto& ids = ids_by_key_[key];
+        ids.insert(std::lower_bound(std::begin(ids), std::end(ids), id), id);
+    }
+
+    keys_by_id_[uid] = std::move(keys);
+}
+
+std::vector<tr_torrent_id_t> const& tr_torrents::Index::find(tr_quark key) const
+{
+    static auto const Empty = std::vector<tr_torrent_id_t>{};
+
+    auto const iter = ids_by_key_.find(key);
+    return iter != std::end(ids_by_key_) ? iter->second : Empty;
+}
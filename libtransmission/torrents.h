@@ -9,14 +9,20 @@
 #error only libtransmission should #include this header.
 #endif
 
+#include <array>
 #include <cstddef> // size_t
+#include <cstring> // memcpy
 #include <ctime>
+#include <map>
+#include <optional>
 #include <string_view>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
 #include "libtransmission/transmission.h"
 
+#include "libtransmission/quark.h"
 #include "libtransmission/torrent-metainfo.h"
 #include "libtransmission/tr-macros.h"
 
@@ -53,6 +59,14 @@ public:
         return get(metainfo.info_hash());
     }
 
+    // O(1). Finds the torrent whose info hash gives `obfuscated_hash`,
+    // i.e. SHA1('req2', info_hash), as sent in encrypted handshakes.
+    [[nodiscard]] tr_torrent* get_from_obfuscated(tr_sha1_digest_t const& obfuscated_hash) const
+    {
+        auto const iter = by_obfuscated_hash_.find(obfuscated_hash);
+        return iter != std::end(by_obfuscated_hash_) ? iter->second : nullptr;
+    }
+
     // These convenience functions use get(tr_sha1_digest_t const&)
     // after parsing the magnet link to get the info hash. If you have
     // the info hash already, use get() instead to avoid excess parsing.
@@ -66,6 +80,74 @@ public:
 
     [[nodiscard]] std::vector<tr_torrent_id_t> removedSince(time_t timestamp) const;
 
+    // Secondary indexes, so that finding the torrents with a given label,
+    // bandwidth group, or tracker doesn't need to look at every torrent.
+    // Call reindex() whenever a torrent's labels, group, or trackers change.
+    void reindex(tr_torrent const* tor);
+
+    // @return the ids, in ascending order, of the torrents with `label`
+    [[nodiscard]] std::vector<tr_torrent_id_t> const& ids_with_label(tr_quark label) const
+    {
+        return by_label_.find(label);
+    }
+
+    // @return the ids, in ascending order, of the torrents in bandwidth group `group`
+    [[nodiscard]] std::vector<tr_torrent_id_t> const& ids_in_group(tr_quark group) const
+    {
+        return by_group_.find(group);
+    }
+
+    // @return the ids, in ascending order, of the torrents with a tracker
+    // at `host_and_port` (e.g. "example.org:80") or with that sitename (e.g. "example")
+    [[nodiscard]] std::vector<tr_torrent_id_t> const& ids_with_tracker(tr_quark host_or_sitename) const
+    {
+        return by_tracker_.find(host_or_sitename);
+    }
+
+    // Counts of the torrents by activity, kept current so that e.g.
+    // session-stats doesn't need to look at every torrent.
+    // Call update_activity() whenever something that tr_torrent::activity()
+    // or tr_torrent::is_running() depends on may have changed.
+    void update_activity(tr_torrent const* tor);
+
+    // update_activity() for every torrent, e.g. after the queue settings change
+    void recount_activity();
+
+    // O(1)
+    [[nodiscard]] constexpr size_t count(tr_torrent_activity activity) const noexcept
+    {
+        return activity_counts_[activity];
+    }
+
+    // O(1)
+    [[nodiscard]] constexpr size_t count_running() const noexcept
+    {
+        return running_count_;
+    }
+
+    // The torrents in queue order, i.e. queue()[tor->queuePosition] == tor.
+    // Kept up to date by add(), remove() and the queue methods below,
+    // so that finding the next queued torrent doesn't need to sort.
+    [[nodiscard]] constexpr auto const& queue() const noexcept
+    {
+        return by_queue_position_;
+    }
+
+    // Move `tor` to `pos` in the queue, or to the bottom if `pos` is past it.
+    // O(distance moved): only the torrents in between are renumbered.
+    void set_queue_position(tr_torrent* tor, size_t pos);
+
+    // Move `torrents` to the top or bottom of the queue, keeping their
+    // order, with one pass over the queue instead of one per torrent.
+    void move_to_queue_top(tr_torrent* const* torrents, size_t n);
+    void move_to_queue_bottom(tr_torrent* const* torrents, size_t n);
+
+    // Move each of `torrents` one place up or down the queue, starting
+    // with the one nearest the top or bottom. Each move is a swap with
+    // a neighbour, so the cost doesn't grow with the queue's length.
+    void move_queue_up(tr_torrent* const* torrents, size_t n);
+    void move_queue_down(tr_torrent* const* torrents, size_t n);
+
     [[nodiscard]] TR_CONSTEXPR20 auto cbegin() const noexcept
     {
         return std::cbegin(by_hash_);
@@ -105,8 +187,51 @@ public:
     }
 
 private:
+    // Maps keys, e.g. labels, to the ids of the torrents that have them.
+    class Index
+    {
+    public:
+        // replace the keys that `id` is listed under
+        void set(tr_torrent_id_t id, std::vector<tr_quark> keys);
+
+        [[nodiscard]] std::vector<tr_torrent_id_t> const& find(tr_quark key) const;
+
+    private:
+        std::map<tr_quark, std::vector<tr_torrent_id_t>> ids_by_key_;
+        std::vector<std::vector<tr_quark>> keys_by_id_;
+    };
+
+    // SHA1 digests are already uniformly distributed, so use their leading bytes as-is
+    struct DigestHash
+    {
+        [[nodiscard]] size_t operator()(tr_sha1_digest_t const& digest) const noexcept
+        {
+            auto val = size_t{};
+            std::memcpy(&val, std::data(digest), sizeof(val));
+            return val;
+        }
+    };
+
+    void reindex(tr_torrent const* tor, tr_torrent_id_t id);
+
+    // count `tor` as the torrent with `id`, or stop counting it if `tor` is nullptr
+    void count_activity(tr_torrent_id_t id, tr_torrent const* tor);
+
+    // update the queue positions of the torrents in [begin, end)
+    void renumber_queue(size_t begin, size_t end);
+
+    // @return whether each queue position holds one of `torrents`
+    [[nodiscard]] std::vector<bool> queue_mask(tr_torrent* const* torrents, size_t n) const;
+
+    // @return the queue positions of `torrents`, sorted and without duplicates
+    [[nodiscard]] std::vector<size_t> queue_positions(tr_torrent* const* torrents, size_t n) const;
+
     std::vector<tr_torrent*> by_hash_;
 
+    std::vector<tr_torrent*> by_queue_position_;
+
+    std::unordered_map<tr_sha1_digest_t, tr_torrent*, DigestHash> by_obfuscated_hash_;
+
     // This is a lookup table where by_id_[id]->id() == id.
     // There is a small tradeoff here -- lookup is O(1) at the cost
     // of a wasted slot in the lookup table whenever a torrent is
@@ -122,4 +247,19 @@ private:
     std::vector<tr_torrent*> by_id_{ nullptr };
 
     std::vector<std::pair<tr_torrent_id_t, time_t>> removed_;
+
+    Index by_label_;
+    Index by_group_;
+    Index by_tracker_;
+
+    // what each torrent was last counted as
+    struct CountedActivity
+    {
+        tr_torrent_activity activity;
+        bool is_running;
+    };
+
+    std::vector<std::optional<CountedActivity>> activity_by_id_;
+    std::array<size_t, TR_STATUS_SEED + 1> activity_counts_ = {};
+    size_t running_count_ = 0U;
 };
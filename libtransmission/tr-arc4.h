@@ -49,18 +49,51 @@ public:
 
     constexpr void process(uint8_t const* const src, size_t n_bytes, uint8_t* const tgt)
     {
-        for (size_t i = 0; i != n_bytes; ++i)
+        // Work on copies of the indices. `tgt` may alias `s_` as far as the
+        // compiler knows, so using the members directly would force them to
+        // be reloaded from memory on every byte.
+        auto i = i_;
+        auto j = j_;
+
+        // Generate the keystream a word at a time and apply it in a separate
+        // loop, which the compiler can turn into a single wide XOR.
+        auto constexpr WordSize = size_t{ 8U };
+        auto keystream = std::array<uint8_t, WordSize>{};
+        auto pos = size_t{};
+        for (; pos + WordSize <= n_bytes; pos += WordSize)
+        {
+            for (auto& key : keystream)
+            {
+                key = arc4_next(s_, i, j);
+            }
+
+            for (size_t k = 0; k != WordSize; ++k)
+            {
+                tgt[pos + k] = src[pos + k] ^ keystream[k];
+            }
+        }
+
+        for (; pos != n_bytes; ++pos)
         {
-            tgt[i] = src[i] ^ arc4_next();
+            tgt[pos] = src[pos] ^ arc4_next(s_, i, j);
         }
+
+        i_ = i;
+        j_ = j;
     }
 
     constexpr void discard(size_t length)
     {
+        auto i = i_;
+        auto j = j_;
+
         while (length-- > 0)
         {
-            arc4_next();
+            arc4_next(s_, i, j);
         }
+
+        i_ = i;
+        j_ = j;
     }
 
 private:
@@ -71,14 +104,17 @@ private:
         s_[j] = tmp;
     }
 
-    constexpr uint8_t arc4_next()
+    static constexpr uint8_t arc4_next(std::array<uint8_t, 256>& s, uint8_t& i, uint8_t& j)
     {
-        i_ += 1;
-        j_ += s_[i_];
+        i += 1;
+        j += s[i];
 
-        arc4_swap(i_, j_);
+        auto const si = s[i];
+        auto const sj = s[j];
+        s[i] = sj;
+        s[j] = si;
 
-        return s_[static_cast<uint8_t>(s_[i_] + s_[j_])];
+        return s[static_cast<uint8_t>(si + sj)];
     }
 
     std::array<uint8_t, 256> s_ = {};
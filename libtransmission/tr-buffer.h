@@ -100,7 +100,8 @@ public:
     }
 
     // Returns the number of bytes written. Check `error` for error.
-    size_t to_socket(tr_socket_t sockfd, size_t n_bytes, tr_error** error = nullptr)
+    // `flags` are passed to send(), e.g. MSG_MORE.
+    size_t to_socket(tr_socket_t sockfd, size_t n_bytes, int flags = 0, tr_error** error = nullptr)
     {
         n_bytes = std::min(n_bytes, size());
 
@@ -109,7 +110,7 @@ public:
             return {};
         }
 
-        if (auto const n_sent = send(sockfd, reinterpret_cast<char const*>(data()), n_bytes, 0); n_sent >= 0U)
+        if (auto const n_sent = send(sockfd, reinterpret_cast<char const*>(data()), n_bytes, flags); n_sent >= 0U)
         {
             drain(n_sent);
             return n_sent;
@@ -252,6 +253,11 @@ public:
         return std::data(buf_) + begin_pos_;
     }
 
+    [[nodiscard]] value_type* data() noexcept
+    {
+        return std::data(buf_) + begin_pos_;
+    }
+
     void drain(size_t n_bytes) override
     {
         begin_pos_ += std::min(n_bytes, size());
@@ -266,15 +272,17 @@ public:
     {
         if (auto const free_at_end = buf_.size() - end_pos_; free_at_end < n_bytes)
         {
-            if (auto const total_free = begin_pos_ + free_at_end; total_free >= n_bytes)
+            // Only move the unread data to the front if it's no bigger than
+            // what's already been drained in front of it. That way each byte
+            // is moved at most once on average, instead of a big backlog being
+            // moved again on every small append.
+            if (auto const size = this->size(); begin_pos_ >= size && begin_pos_ + free_at_end >= n_bytes)
             {
-                // move data so that all free space is at the end
-                auto const size = this->size();
-                std::copy(data(), data() + size, std::data(buf_));
+                std::copy_n(data(), size, std::data(buf_));
                 begin_pos_ = 0;
                 end_pos_ = size;
             }
-            else // even `total_free` is not enough, so resize
+            else // grow instead; wasted space at the front is < size()
             {
                 buf_.resize(end_pos_ + n_bytes);
             }
@@ -288,6 +296,24 @@ public:
         end_pos_ += n_bytes;
     }
 
+    // @return how many bytes the buffer can hold without growing
+    [[nodiscard]] size_t capacity() const noexcept
+    {
+        return buf_.capacity();
+    }
+
+    // If the buffer is empty, free any heap memory that it's grown into
+    // and go back to the inline storage. Busy buffers are left alone.
+    void shrink_to_fit()
+    {
+        if (BufferReader<value_type>::empty() && buf_.capacity() > N)
+        {
+            buf_.clear();
+            buf_.shrink_to_fit();
+            begin_pos_ = end_pos_ = 0U;
+        }
+    }
+
 private:
     small::vector<value_type, N, std::allocator<value_type>, std::true_type, size_t, GrowthFactor> buf_ = {};
     size_t begin_pos_ = {};
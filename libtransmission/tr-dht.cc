@@ -17,14 +17,12 @@
 #include <string_view>
 #include <tuple> // std::tie()
 #include <utility>
+#include <vector>
 
 #ifdef _WIN32
 #include <ws2tcpip.h>
-#undef gai_strerror
-#define gai_strerror gai_strerrorA
 #else
 #include <sys/socket.h> /* socket(), bind() */
-#include <netdb.h>
 #include <netinet/in.h> /* sockaddr_in */
 #endif
 
@@ -33,6 +31,7 @@
 #include "libtransmission/transmission.h"
 
 #include "libtransmission/crypto-utils.h"
+#include "libtransmission/dns.h"
 #include "libtransmission/file.h"
 #include "libtransmission/log.h"
 #include "libtransmission/net.h"
@@ -113,8 +112,18 @@ class tr_dht_impl final : public tr_dht
 private:
     using Node = tr_socket_address;
     using Nodes = std::deque<Node>;
+    using Name = std::pair<std::string, tr_port>;
+    using Names = std::deque<Name>;
     using Id = std::array<unsigned char, 20>;
 
+    struct CachedPeers
+    {
+        std::vector<tr_pex> pex;
+        time_t updated_at = 0;
+    };
+
+    using PeerCache = std::map<tr_sha1_digest_t, CachedPeers>;
+
     enum class SwarmStatus
     {
         Stopped,
@@ -134,16 +143,25 @@ public:
         , announce_timer_{ mediator_.timer_maker().create([this]() { on_announce_timer(); }) }
         , bootstrap_timer_{ mediator_.timer_maker().create([this]() { on_bootstrap_timer(); }) }
         , periodic_timer_{ mediator_.timer_maker().create([this]() { on_periodic_timer(); }) }
+        , checkpoint_timer_{ mediator_.timer_maker().create([this]() { save_state_if_ready(); }) }
     {
         tr_logAddDebug(fmt::format("Starting DHT on port {port}", fmt::arg("port", peer_port.host())));
 
         // load up the bootstrap nodes
         if (tr_sys_path_exists(state_filename_.c_str()))
         {
-            std::tie(id_, bootstrap_queue_) = load_state(state_filename_);
+            std::tie(id_, bootstrap_queue_, peers_to_restore_) = load_state(state_filename_);
+            n_warm_nodes_ = std::size(bootstrap_queue_);
+        }
+        get_names_from_bootstrap_file(tr_pathbuf{ mediator_.config_dir(), "/dht.bootstrap"sv }, bootstrap_names_);
+
+        // If we already know enough nodes, don't bother the public bootstrap
+        // node yet. It's still looked up later if we run out of nodes.
+        if (std::size(bootstrap_queue_) + std::size(bootstrap_names_) < MinBootstrapNodes)
+        {
+            queue_public_bootstrap_node();
         }
-        get_nodes_from_bootstrap_file(tr_pathbuf{ mediator_.config_dir(), "/dht.bootstrap"sv }, bootstrap_queue_);
-        get_nodes_from_name("dht.transmissionbt.com", tr_port::fromHost(6881), bootstrap_queue_);
+
         bootstrap_timer_->start_single_shot(100ms);
 
         mediator_.api().init(udp4_socket_, udp6_socket_, std::data(id_), nullptr);
@@ -152,6 +170,8 @@ public:
         announce_timer_->start_repeating(1s);
 
         on_periodic_timer();
+
+        checkpoint_timer_->start_repeating(CheckpointInterval);
     }
 
     tr_dht_impl(tr_dht_impl&&) = delete;
@@ -163,12 +183,7 @@ public:
     {
         tr_logAddTrace("Uninitializing DHT");
 
-        // Since we only save known good nodes,
-        // only overwrite older data if we know enough nodes.
-        if (is_ready(AF_INET) || is_ready(AF_INET6))
-        {
-            save_state();
-        }
+        save_state_if_ready();
 
         mediator_.api().uninit();
         tr_logAddTrace("Done uninitializing DHT");
@@ -204,6 +219,13 @@ public:
         periodic_timer_->start_single_shot(interval);
     }
 
+    [[nodiscard]] SearchStats search_stats() const override
+    {
+        auto stats = search_stats_;
+        stats.n_in_flight = std::size(searches_);
+        return stats;
+    }
+
 private:
     [[nodiscard]] constexpr tr_socket_t udpSocket(int af) const noexcept
     {
@@ -278,8 +300,16 @@ private:
     ///
 
     // how long to wait between adding nodes during bootstrap
-    [[nodiscard]] static constexpr auto bootstrap_interval(size_t n_added)
+    [[nodiscard]] constexpr std::chrono::milliseconds bootstrap_interval(size_t n_added) const noexcept
     {
+        // Nodes saved from our last session's routing table were chosen
+        // with the same id, so they're already spread across our buckets.
+        // Ping them quickly to get the routing table back up to speed.
+        if (n_added < n_warm_nodes_)
+        {
+            return 200ms;
+        }
+
         // Our DHT code is able to take up to 9 nodes in a row without
         // dropping any. After that, it takes some time to split buckets.
         // So ping the first 8 nodes quickly, then slow down.
@@ -296,15 +326,68 @@ private:
         return 40s;
     }
 
+    void queue_public_bootstrap_node()
+    {
+        if (!queued_public_bootstrap_node_)
+        {
+            queued_public_bootstrap_node_ = true;
+            bootstrap_names_.emplace_back("dht.transmissionbt.com", tr_port::fromHost(6881));
+        }
+    }
+
+    // Move the bootstrap names that have been looked up into the node queue.
+    // Names are taken in order, so one that's still being looked up holds
+    // back the ones behind it.
+    void resolve_bootstrap_names()
+    {
+        auto& dns = mediator_.dns();
+
+        while (!std::empty(bootstrap_names_))
+        {
+            auto const& [name, port] = bootstrap_names_.front();
+            auto const addresses = dns.get(name, tr_time());
+            if (!addresses)
+            {
+                return;
+            }
+
+            for (auto const& address : *addresses)
+            {
+                bootstrap_queue_.emplace_back(address, port);
+            }
+
+            bootstrap_names_.pop_front();
+        }
+    }
+
     void on_bootstrap_timer()
     {
         // Since we don't want to abuse our bootstrap nodes,
         // we don't ping them if the DHT is in a good state.
-        if (is_ready() || std::empty(bootstrap_queue_))
+        if (is_ready())
         {
             return;
         }
 
+        resolve_bootstrap_names();
+
+        if (std::empty(bootstrap_queue_))
+        {
+            queue_public_bootstrap_node();
+            resolve_bootstrap_names();
+
+            if (std::empty(bootstrap_queue_))
+            {
+                // check again once the lookups are done
+                if (!std::empty(bootstrap_names_))
+                {
+                    bootstrap_timer_->start_single_shot(DnsPollInterval);
+                }
+
+                return;
+            }
+        }
+
         auto [address, port] = bootstrap_queue_.front();
         bootstrap_queue_.pop_front();
         add_node(address, port);
@@ -319,36 +402,169 @@ private:
     {
         auto const* dht_hash = reinterpret_cast<unsigned char const*>(std::data(info_hash));
         auto const rc = mediator_.api().search(dht_hash, port.host(), af, callback, this);
+
+        if (rc < 0)
+        {
+            ++search_stats_.n_rejected;
+        }
+        else
+        {
+            ++search_stats_.n_started;
+            searches_[SearchKey{ info_hash, af }] = Search{ tr_time_msec() };
+        }
+
         auto const announce_again_in_n_secs = rc < 0 ? 5s + std::chrono::seconds{ tr_rand_int(5U) } :
-                                                       25min + std::chrono::seconds{ tr_rand_int(3U * 60U) };
+                                                       AnnounceInterval + std::chrono::seconds{ tr_rand_int(3U * 60U) };
         return announce_again_in_n_secs;
     }
 
+    // How many searches we can start this tick. Enough to get through
+    // every torrent once per announce interval, so that a large session
+    // announces at a steady trickle instead of in bursts, and never more
+    // than the in-flight budget allows.
+    [[nodiscard]] size_t search_budget(size_t n_torrents) const
+    {
+        auto const n_searches_per_interval = n_torrents * 2U; // ipv4 + ipv6
+        auto const interval_secs = static_cast<size_t>(std::chrono::seconds{ AnnounceInterval }.count());
+        auto const per_tick = std::max(MinSearchesPerTick, (n_searches_per_interval + interval_secs - 1U) / interval_secs);
+        auto const n_in_flight = std::size(searches_);
+        return n_in_flight >= MaxSearchesInFlight ? 0U : std::min(per_tick, MaxSearchesInFlight - n_in_flight);
+    }
+
+    void on_search_done(tr_sha1_digest_t const& info_hash, int af)
+    {
+        auto const iter = searches_.find(SearchKey{ info_hash, af });
+        if (iter == std::end(searches_))
+        {
+            return;
+        }
+
+        auto const latency_msec = tr_time_msec() - iter->second.started_at_msec;
+        auto& avg = search_stats_.average_latency_msec;
+        avg = search_stats_.n_done == 0U ? latency_msec : (avg * 7U + latency_msec) / 8U;
+
+        ++search_stats_.n_done;
+        if (iter->second.n_peers > 0U)
+        {
+            ++search_stats_.n_found_peers;
+        }
+
+        tr_logAddTrace(fmt::format(
+            "{} search done in {} msec, found {} peers",
+            af == AF_INET6 ? "IPv6" : "IPv4",
+            latency_msec,
+            iter->second.n_peers));
+        searches_.erase(iter);
+    }
+
+    // libdht may drop a search without telling us,
+    // so don't let a lost one hold a slot in the budget forever.
+    void expire_searches()
+    {
+        auto const now_msec = tr_time_msec();
+        for (auto iter = std::begin(searches_); iter != std::end(searches_);)
+        {
+            if (now_msec - iter->second.started_at_msec >= SearchTimeoutMsec)
+            {
+                ++search_stats_.n_expired;
+                iter = searches_.erase(iter);
+            }
+            else
+            {
+                ++iter;
+            }
+        }
+    }
+
+    // Hand the peers saved in dht.dat to their torrents as soon as the
+    // torrents are running, rather than waiting on a new DHT search.
+    void restore_cached_peers()
+    {
+        if (std::empty(peers_to_restore_))
+        {
+            return;
+        }
+
+        auto const now = tr_time();
+        for (auto const id : mediator_.torrents_allowing_dht())
+        {
+            auto const info_hash = mediator_.torrent_info_hash(id);
+            if (auto node = peers_to_restore_.extract(info_hash); !node.empty())
+            {
+                if (auto& cached = node.mapped(); cached.updated_at + MaxCachedPeersAgeSecs >= now)
+                {
+                    mediator_.add_pex(info_hash, std::data(cached.pex), std::size(cached.pex));
+                    peer_cache_.try_emplace(info_hash, std::move(cached));
+                }
+            }
+        }
+    }
+
+    void cache_peers(tr_sha1_digest_t const& info_hash, std::vector<tr_pex> const& pex)
+    {
+        auto& cached = peer_cache_[info_hash];
+        cached.updated_at = tr_time();
+
+        for (auto const& peer : pex)
+        {
+            if (std::find(std::begin(cached.pex), std::end(cached.pex), peer) == std::end(cached.pex))
+            {
+                cached.pex.emplace_back(peer);
+            }
+        }
+
+        // keep the most recent ones
+        if (auto const n = std::size(cached.pex); n > MaxCachedPeers)
+        {
+            cached.pex.erase(std::begin(cached.pex), std::begin(cached.pex) + (n - MaxCachedPeers));
+        }
+    }
+
     void on_announce_timer()
     {
+        restore_cached_peers();
+
         // don't announce if the swarm isn't ready
         if (swarm_status(AF_INET) < SwarmStatus::Poor && swarm_status(AF_INET6) < SwarmStatus::Poor)
         {
             return;
         }
 
+        expire_searches();
+
+        // collect the searches that are due, most overdue first
         auto const now = tr_time();
-        for (auto const id : mediator_.torrents_allowing_dht())
+        auto const ids = mediator_.torrents_allowing_dht();
+        auto due = std::vector<std::tuple<time_t, tr_torrent_id_t, int>>{};
+        for (auto const id : ids)
         {
-            auto& times = announce_times_[id];
+            auto const& times = announce_times_[id];
 
-            if (auto& announce_after = times.ipv4_announce_after; announce_after < now)
+            if (times.ipv4_announce_after < now)
             {
-                auto const announce_again_in_n_secs = announce_torrent(mediator_.torrent_info_hash(id), AF_INET, peer_port_);
-                announce_after = now + std::chrono::seconds{ announce_again_in_n_secs }.count();
+                due.emplace_back(times.ipv4_announce_after, id, AF_INET);
             }
 
-            if (auto& announce_after = times.ipv6_announce_after; announce_after < now)
+            if (times.ipv6_announce_after < now)
             {
-                auto const announce_again_in_n_secs = announce_torrent(mediator_.torrent_info_hash(id), AF_INET6, peer_port_);
-                announce_after = now + std::chrono::seconds{ announce_again_in_n_secs }.count();
+                due.emplace_back(times.ipv6_announce_after, id, AF_INET6);
             }
         }
+
+        auto const budget = search_budget(std::size(ids));
+        if (std::size(due) > budget)
+        {
+            std::partial_sort(std::begin(due), std::begin(due) + budget, std::end(due));
+            due.resize(budget);
+        }
+
+        for (auto const& [announce_after, id, af] : due)
+        {
+            auto const announce_again_in_n_secs = announce_torrent(mediator_.torrent_info_hash(id), af, peer_port_);
+            auto& times = announce_times_[id];
+            (af == AF_INET ? times.ipv4_announce_after : times.ipv6_announce_after) = now +
+                std::chrono::seconds{ announce_again_in_n_secs }.count();
+        }
     }
 
     ///
@@ -399,39 +615,69 @@ private:
         {
             auto const pex = remove_bad_pex(tr_pex::from_compact_ipv4(data, data_len, nullptr, 0));
             self->mediator_.add_pex(hash, std::data(pex), std::size(pex));
+            self->cache_peers(hash, pex);
+            self->count_search_peers(hash, AF_INET, std::size(pex));
         }
         else if (event == DHT_EVENT_VALUES6)
         {
             auto const pex = remove_bad_pex(tr_pex::from_compact_ipv6(data, data_len, nullptr, 0));
             self->mediator_.add_pex(hash, std::data(pex), std::size(pex));
+            self->cache_peers(hash, pex);
+            self->count_search_peers(hash, AF_INET6, std::size(pex));
+        }
+        else if (event == DHT_EVENT_SEARCH_DONE)
+        {
+            self->on_search_done(hash, AF_INET);
+        }
+        else if (event == DHT_EVENT_SEARCH_DONE6)
+        {
+            self->on_search_done(hash, AF_INET6);
+        }
+    }
+
+    void count_search_peers(tr_sha1_digest_t const& info_hash, int af, size_t n_peers)
+    {
+        if (auto const iter = searches_.find(SearchKey{ info_hash, af }); iter != std::end(searches_))
+        {
+            iter->second.n_peers += n_peers;
         }
     }
 
     ///
 
+    void save_state_if_ready() const
+    {
+        // Since we only save known good nodes,
+        // only overwrite older data if we know enough nodes.
+        if (is_ready(AF_INET) || is_ready(AF_INET6))
+        {
+            save_state();
+        }
+    }
+
     void save_state() const
     {
-        auto constexpr MaxNodes = int{ 300 };
+        auto constexpr MaxNodes = int{ 1024 };
         auto constexpr PortLen = size_t{ 2 };
         auto constexpr CompactAddrLen = size_t{ 4 };
         auto constexpr CompactLen = size_t{ CompactAddrLen + PortLen };
         auto constexpr Compact6AddrLen = size_t{ 16 };
         auto constexpr Compact6Len = size_t{ Compact6AddrLen + PortLen };
 
-        auto sins4 = std::array<struct sockaddr_in, MaxNodes>{};
-        auto sins6 = std::array<struct sockaddr_in6, MaxNodes>{};
+        auto sins4 = std::vector<struct sockaddr_in>(MaxNodes);
+        auto sins6 = std::vector<struct sockaddr_in6>(MaxNodes);
         auto num4 = int{ MaxNodes };
         auto num6 = int{ MaxNodes };
         auto const n = mediator_.api().get_nodes(std::data(sins4), &num4, std::data(sins6), &num6);
         tr_logAddTrace(fmt::format("Saving {} ({} + {}) nodes", n, num4, num6));
 
         tr_variant benc;
-        tr_variantInitDict(&benc, 3);
+        tr_variantInitDict(&benc, 4);
         tr_variantDictAddRaw(&benc, TR_KEY_id, std::data(id_), std::size(id_));
 
         if (num4 > 0)
         {
-            auto compact = std::array<char, MaxNodes * CompactLen>{};
+            auto compact = std::vector<char>(MaxNodes * CompactLen);
             char* out = std::data(compact);
             for (auto const* in = std::data(sins4), *end = in + num4; in != end; ++in)
             {
@@ -446,7 +692,7 @@ private:
 
         if (num6 > 0)
         {
-            auto compact6 = std::array<char, MaxNodes * Compact6Len>{};
+            auto compact6 = std::vector<char>(MaxNodes * Compact6Len);
             char* out6 = std::data(compact6);
             for (auto const* in = std::data(sins6), *end = in + num6; in != end; ++in)
             {
@@ -459,17 +705,105 @@ private:
             tr_variantDictAddRaw(&benc, TR_KEY_nodes6, std::data(compact6), out6 - std::data(compact6));
         }
 
+        save_peers(&benc);
+
         tr_variantToFile(&benc, TR_VARIANT_FMT_BENC, state_filename_);
         tr_variantClear(&benc);
     }
 
-    [[nodiscard]] static std::pair<Id, Nodes> load_state(std::string_view filename)
+    // Save the peers recently found for torrents that are still using the DHT
+    void save_peers(tr_variant* benc) const
+    {
+        auto const now = tr_time();
+        auto* const list = tr_variantDictAddList(benc, TR_KEY_peers, std::size(peer_cache_));
+
+        for (auto const id : mediator_.torrents_allowing_dht())
+        {
+            auto const info_hash = mediator_.torrent_info_hash(id);
+            auto const iter = peer_cache_.find(info_hash);
+            if (iter == std::end(peer_cache_) || iter->second.updated_at + MaxCachedPeersAgeSecs < now)
+            {
+                continue;
+            }
+
+            auto const& [pex, updated_at] = iter->second;
+            auto compact = std::vector<std::byte>{};
+            auto compact6 = std::vector<std::byte>{};
+            for (auto const& peer : pex)
+            {
+                if (peer.addr.is_ipv4())
+                {
+                    peer.to_compact_ipv4(std::back_inserter(compact));
+                }
+                else
+                {
+                    peer.to_compact_ipv6(std::back_inserter(compact6));
+                }
+            }
+
+            auto* const dict = tr_variantListAddDict(list, 4);
+            tr_variantDictAddStr(dict, TR_KEY_hashString, tr_sha1_to_string(info_hash));
+            tr_variantDictAddInt(dict, TR_KEY_date, updated_at);
+            tr_variantDictAddRaw(dict, TR_KEY_added, std::data(compact), std::size(compact));
+            tr_variantDictAddRaw(dict, TR_KEY_added6, std::data(compact6), std::size(compact6));
+        }
+    }
+
+    [[nodiscard]] static PeerCache load_peers(tr_variant* dict)
+    {
+        auto peers = PeerCache{};
+
+        tr_variant* list = nullptr;
+        if (!tr_variantDictFindList(dict, TR_KEY_peers, &list))
+        {
+            return peers;
+        }
+
+        for (size_t i = 0, n = tr_variantListSize(list); i < n; ++i)
+        {
+            auto* const child = tr_variantListChild(list, i);
+            auto sv = std::string_view{};
+            auto date = int64_t{};
+            if (!tr_variantDictFindStrView(child, TR_KEY_hashString, &sv) || !tr_variantDictFindInt(child, TR_KEY_date, &date))
+            {
+                continue;
+            }
+
+            auto const info_hash = tr_sha1_from_string(sv);
+            if (!info_hash)
+            {
+                continue;
+            }
+
+            auto& cached = peers[*info_hash];
+            cached.updated_at = static_cast<time_t>(date);
+
+            size_t raw_len = 0U;
+            std::byte const* raw = nullptr;
+            if (tr_variantDictFindRaw(child, TR_KEY_added, &raw, &raw_len))
+            {
+                auto const pex = tr_pex::from_compact_ipv4(raw, raw_len, nullptr, 0);
+                cached.pex.insert(std::end(cached.pex), std::begin(pex), std::end(pex));
+            }
+
+            if (tr_variantDictFindRaw(child, TR_KEY_added6, &raw, &raw_len))
+            {
+                auto const pex = tr_pex::from_compact_ipv6(raw, raw_len, nullptr, 0);
+                cached.pex.insert(std::end(cached.pex), std::begin(pex), std::end(pex));
+            }
+        }
+
+        return peers;
+    }
+
+    [[nodiscard]] static std::tuple<Id, Nodes, PeerCache> load_state(std::string_view filename)
     {
         // Note that DHT ids need to be distributed uniformly,
         // so it should be something truly random
         auto id = tr_rand_obj<Id>();
 
         auto nodes = Nodes{};
+        auto peers = PeerCache{};
 
         if (auto dict = tr_variant{}; tr_variantFromFile(&dict, TR_VARIANT_PARSE_BENC, filename))
         {
@@ -509,15 +843,17 @@ private:
                 }
             }
 
+            peers = load_peers(&dict);
+
             tr_variantClear(&dict);
         }
 
-        return std::make_pair(id, nodes);
+        return std::make_tuple(id, nodes, peers);
     }
 
     ///
 
-    static void get_nodes_from_bootstrap_file(std::string_view filename, Nodes& nodes)
+    static void get_names_from_bootstrap_file(std::string_view filename, Names& names)
     {
         auto in = std::ifstream{ std::string{ filename } };
         if (!in.is_open())
@@ -543,43 +879,9 @@ private:
             }
             else
             {
-                get_nodes_from_name(addrstr.c_str(), tr_port::fromHost(hport), nodes);
-            }
-        }
-    }
-
-    static void get_nodes_from_name(char const* name, tr_port port_in, Nodes& nodes)
-    {
-        auto hints = addrinfo{};
-        hints.ai_socktype = SOCK_DGRAM;
-        hints.ai_family = AF_UNSPEC;
-        hints.ai_protocol = 0;
-        hints.ai_flags = 0;
-
-        auto port_str = std::array<char, 16>{};
-        *fmt::format_to(std::data(port_str), FMT_STRING("{:d}"), port_in.host()) = '\0';
-
-        addrinfo* info = nullptr;
-        if (int const rc = getaddrinfo(name, std::data(port_str), &hints, &info); rc != 0)
-        {
-            tr_logAddWarn(fmt::format(
-                _("Couldn't look up '{address}:{port}': {error} ({error_code})"),
-                fmt::arg("address", name),
-                fmt::arg("port", port_in.host()),
-                fmt::arg("error", gai_strerror(rc)),
-                fmt::arg("error_code", rc)));
-            return;
-        }
-
-        for (auto* infop = info; infop != nullptr; infop = infop->ai_next)
-        {
-            if (auto addrport = tr_address::from_sockaddr(infop->ai_addr); addrport)
-            {
-                nodes.emplace_back(*addrport);
+                names.emplace_back(std::move(addrstr), tr_port::fromHost(hport));
             }
         }
-
-        freeaddrinfo(info);
     }
 
     ///
@@ -593,11 +895,32 @@ private:
     std::unique_ptr<libtransmission::Timer> const announce_timer_;
     std::unique_ptr<libtransmission::Timer> const bootstrap_timer_;
     std::unique_ptr<libtransmission::Timer> const periodic_timer_;
+    std::unique_ptr<libtransmission::Timer> const checkpoint_timer_;
 
     Id id_ = {};
 
     Nodes bootstrap_queue_;
+
+    // bootstrap nodes' host names, waiting to be looked up
+    Names bootstrap_names_;
+
     size_t n_bootstrapped_ = 0;
+    size_t n_warm_nodes_ = 0;
+    bool queued_public_bootstrap_node_ = false;
+
+    // peers that DHT searches found for our torrents
+    PeerCache peer_cache_;
+
+    // peers loaded from the state file, waiting for their torrents to start
+    PeerCache peers_to_restore_;
+
+    // Save the state periodically, not just at shutdown,
+    // so that a crash doesn't cost us a warm restart.
+    static auto constexpr CheckpointInterval = 15min;
+    static auto constexpr MinBootstrapNodes = size_t{ 8U };
+    static auto constexpr DnsPollInterval = 100ms;
+    static auto constexpr MaxCachedPeers = size_t{ 100U };
+    static auto constexpr MaxCachedPeersAgeSecs = time_t{ 2 * 60 * 60 };
 
     struct AnnounceInfo
     {
@@ -606,6 +929,24 @@ private:
     };
 
     std::map<tr_torrent_id_t, AnnounceInfo> announce_times_;
+
+    static auto constexpr AnnounceInterval = 25min;
+
+    // libdht's own table holds 1024 searches; leave it some headroom.
+    static auto constexpr MaxSearchesInFlight = size_t{ 256U };
+    static auto constexpr MinSearchesPerTick = size_t{ 8U };
+    static auto constexpr SearchTimeoutMsec = uint64_t{ 5U * 60U * 1000U };
+
+    using SearchKey = std::pair<tr_sha1_digest_t, int>;
+
+    struct Search
+    {
+        uint64_t started_at_msec = 0;
+        size_t n_peers = 0;
+    };
+
+    std::map<SearchKey, Search> searches_;
+    SearchStats search_stats_;
 };
 
 [[nodiscard]] std::unique_ptr<tr_dht> tr_dht::create(
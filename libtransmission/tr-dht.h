@@ -9,6 +9,7 @@
 #endif
 
 #include <cstddef> // size_t
+#include <cstdint> // uint64_t
 #include <ctime>
 #include <memory>
 #include <string_view>
@@ -27,6 +28,7 @@
 #include "libtransmission/net.h" // tr_port
 #include "libtransmission/tr-macros.h"
 
+class tr_dns;
 struct tr_pex;
 
 namespace libtransmission
@@ -96,6 +98,10 @@ public:
 
         [[nodiscard]] virtual std::string_view config_dir() const = 0;
         [[nodiscard]] virtual libtransmission::TimerMaker& timer_maker() = 0;
+
+        // looks up the bootstrap nodes' addresses
+        [[nodiscard]] virtual tr_dns& dns() = 0;
+
         [[nodiscard]] virtual API& api()
         {
             return api_;
@@ -107,6 +113,17 @@ public:
         API api_;
     };
 
+    struct SearchStats
+    {
+        size_t n_started = 0; // searches handed to libdht
+        size_t n_rejected = 0; // searches libdht refused to start
+        size_t n_done = 0; // searches that ran to completion
+        size_t n_found_peers = 0; // completed searches that found at least one peer
+        size_t n_expired = 0; // searches we stopped waiting on
+        size_t n_in_flight = 0;
+        uint64_t average_latency_msec = 0; // smoothed time from start to completion
+    };
+
     [[nodiscard]] static std::unique_ptr<tr_dht> create(
         Mediator& mediator,
         tr_port peer_port,
@@ -116,4 +133,6 @@ public:
 
     virtual void add_node(tr_address const& address, tr_port port) = 0;
     virtual void handle_message(unsigned char const* msg, size_t msglen, struct sockaddr* from, socklen_t fromlen) = 0;
+
+    [[nodiscard]] virtual SearchStats search_stats() const = 0;
 };
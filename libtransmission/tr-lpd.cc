@@ -205,6 +205,7 @@ class tr_lpd_impl final : public tr_lpd
 public:
     tr_lpd_impl(Mediator& mediator, struct event_base* event_base)
         : mediator_{ mediator }
+        , pacing_{ mediator.isClusterMode() ? ClusterPacing : DefaultPacing }
         , announce_timer_{ mediator.timerMaker().create([this]() { announceUpkeep(); }) }
         , dos_timer_{ mediator.timerMaker().create([this]() { dosUpkeep(); }) }
     {
@@ -213,7 +214,7 @@ public:
             return;
         }
 
-        announce_timer_->start_repeating(AnnounceInterval);
+        announce_timer_->start_repeating(pacing_.announce_interval);
         announceUpkeep();
         dos_timer_->start_repeating(DosInterval);
         dosUpkeep();
@@ -445,7 +446,7 @@ private:
         }
 
         // If we're receiving too many, discard it
-        if (++messages_received_since_upkeep_ > MaxIncomingPerUpkeep)
+        if (++messages_received_since_upkeep_ > max_incoming_per_upkeep())
         {
             return;
         }
@@ -496,7 +497,8 @@ private:
             return;
         }
 
-        // prioritize the remaining torrents
+        // prioritize the remaining torrents: downloads before seeds,
+        // then the most recently active, then the longest waiting
         std::sort(
             std::begin(torrents),
             std::end(torrents),
@@ -507,6 +509,11 @@ private:
                     return a.activity < b.activity;
                 }
 
+                if (a.active_at != b.active_at)
+                {
+                    return a.active_at > b.active_at;
+                }
+
                 if (a.announce_after != b.announce_after)
                 {
                     return a.announce_after < b.announce_after;
@@ -514,39 +521,46 @@ private:
                 return false;
             });
 
-        // cram in as many as will fit in a message
+        // cram in as many as will fit in each message
         auto const baseline_size = std::size(makeAnnounceMsg(cookie_, mediator_.port(), {}));
         auto const size_with_one = std::size(makeAnnounceMsg(cookie_, mediator_.port(), { torrents.front().info_hash_str }));
         auto const size_per_hash = size_with_one - baseline_size;
         auto const max_torrents_per_announce = (MaxDatagramLength - baseline_size) / size_per_hash;
-        auto info_hash_strings = std::vector<std::string_view>{};
-        info_hash_strings.resize(std::min(std::size(torrents), max_torrents_per_announce));
-        std::transform(
-            std::begin(torrents),
-            std::begin(torrents) + std::size(info_hash_strings),
-            std::begin(info_hash_strings),
-            [](auto const& tor) { return tor.info_hash_str; });
+        auto const n_torrents = std::min(std::size(torrents), max_torrents_per_announce * pacing_.max_datagrams_per_announce);
 
-        if (!sendAnnounce(info_hash_strings))
+        auto const next_announce_after = now + pacing_.torrent_announce_interval_sec;
+        auto info_hash_strings = std::vector<std::string_view>{};
+        info_hash_strings.reserve(max_torrents_per_announce);
+        for (size_t begin = 0U; begin < n_torrents; begin += max_torrents_per_announce)
         {
-            return;
-        }
+            auto const end = std::min(begin + max_torrents_per_announce, n_torrents);
+            info_hash_strings.resize(end - begin);
+            std::transform(
+                std::begin(torrents) + begin,
+                std::begin(torrents) + end,
+                std::begin(info_hash_strings),
+                [](auto const& tor) { return tor.info_hash_str; });
+
+            if (!sendAnnounce(info_hash_strings))
+            {
+                return;
+            }
 
-        auto const next_announce_after = now + TorrentAnnounceIntervalSec;
-        for (auto const& info_hash_string : info_hash_strings)
-        {
-            mediator_.setNextAnnounceTime(info_hash_string, next_announce_after);
+            for (auto const& info_hash_string : info_hash_strings)
+            {
+                mediator_.setNextAnnounceTime(info_hash_string, next_announce_after);
+            }
         }
     }
 
     void dosUpkeep()
     {
-        if (messages_received_since_upkeep_ > MaxIncomingPerUpkeep)
+        if (messages_received_since_upkeep_ > max_incoming_per_upkeep())
         {
             tr_logAddTrace(fmt::format(
                 "Dropped {} announces in the last interval (max. {} allowed)",
-                messages_received_since_upkeep_ - MaxIncomingPerUpkeep,
-                MaxIncomingPerUpkeep));
+                messages_received_since_upkeep_ - max_incoming_per_upkeep(),
+                max_incoming_per_upkeep()));
         }
 
         messages_received_since_upkeep_ = 0;
@@ -576,8 +590,32 @@ private:
         return sent;
     }
 
+    [[nodiscard]] constexpr size_t max_incoming_per_upkeep() const noexcept
+    {
+        return std::chrono::duration_cast<std::chrono::seconds>(DosInterval).count() * pacing_.max_incoming_per_second;
+    }
+
+    // How often to announce, and how much
+    struct Pacing
+    {
+        std::chrono::seconds announce_interval;
+        time_t torrent_announce_interval_sec; // how frequently to reannounce the same torrent
+        size_t max_datagrams_per_announce;
+        size_t max_incoming_per_second;
+    };
+
+    // BEP14: "To avoid causing multicast storms on large networks a
+    // client should send no more than 1 announce per minute."
+    static auto constexpr DefaultPacing = Pacing{ 60s, 240, 1U, 10U };
+
+    // For clusters on a LAN that we control, where finding local peers
+    // quickly matters more than staying quiet. About 16 datagrams every
+    // 5 seconds is enough to announce thousands of torrents a minute.
+    static auto constexpr ClusterPacing = Pacing{ 5s, 60, 16U, 500U };
+
     std::string const cookie_ = makeCookie();
     Mediator& mediator_;
+    Pacing const pacing_;
     tr_socket_t mcast_rcv_socket_ = TR_BAD_SOCKET; /**<separate multicast receive socket */
     tr_socket_t mcast_snd_socket_ = TR_BAD_SOCKET; /**<and multicast send socket */
     libtransmission::evhelpers::event_unique_ptr event_;
@@ -585,9 +623,6 @@ private:
     static auto constexpr MaxDatagramLength = size_t{ 1400 };
     sockaddr_in mcast_addr_ = {}; /**<initialized from the above constants in init() */
 
-    // BEP14: "To avoid causing multicast storms on large networks a
-    // client should send no more than 1 announce per minute."
-    static auto constexpr AnnounceInterval = 1min;
     std::unique_ptr<libtransmission::Timer> announce_timer_;
 
     // Flood Protection:
@@ -597,13 +632,9 @@ private:
     // bogus data. Better to drop a few packets than get DoS'ed.
     static auto constexpr DosInterval = 5s;
     std::unique_ptr<libtransmission::Timer> dos_timer_;
-    static auto constexpr MaxIncomingPerSecond = int{ 10 };
-    static auto constexpr MaxIncomingPerUpkeep = std::chrono::duration_cast<std::chrono::seconds>(DosInterval).count() *
-        MaxIncomingPerSecond;
-    // @brief throw away messages after this number exceeds MaxIncomingPerUpkeep
+    // @brief throw away messages after this number exceeds max_incoming_per_upkeep()
     size_t messages_received_since_upkeep_ = 0U;
 
-    static auto constexpr TorrentAnnounceIntervalSec = time_t{ 240U }; // how frequently to reannounce the same torrent
     static auto constexpr TtlSameSubnet = int{ 1 };
     static auto constexpr AnnounceScope = int{ TtlSameSubnet }; /**<the maximum scope for LPD datagrams */
 };
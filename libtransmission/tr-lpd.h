@@ -37,6 +37,7 @@ public:
             tr_torrent_activity activity;
             bool allows_lpd;
             time_t announce_after;
+            time_t active_at; // when the torrent last sent or received data
         };
 
         virtual ~Mediator() = default;
@@ -47,6 +48,13 @@ public:
 
         [[nodiscard]] virtual bool allowsLPD() const = 0;
 
+        // If true, announce much faster and more often than BEP 14 allows.
+        // This is only polite on networks you control, e.g. a cluster's LAN.
+        [[nodiscard]] virtual bool isClusterMode() const
+        {
+            return false;
+        }
+
         [[nodiscard]] virtual std::vector<TorrentInfo> torrents() const = 0;
 
         [[nodiscard]] virtual libtransmission::TimerMaker& timerMaker() = 0;
@@ -81,6 +81,31 @@
 // Mostly to enforce better formatting
 #define TR_ARG_TUPLE(...) __VA_ARGS__
 
+// ---
+
+#if __has_builtin(__builtin_FILE) || TR_GNUC_CHECK_VERSION(4, 8) || (defined(_MSC_VER) && _MSC_VER >= 1926)
+#define TR_BUILTIN_FILE() __builtin_FILE()
+#define TR_BUILTIN_LINE() __builtin_LINE()
+#else
+#define TR_BUILTIN_FILE() ""
+#define TR_BUILTIN_LINE() 0
+#endif
+
+// A stand-in for C++20's std::source_location. When `current()` is
+// used as a default argument, it records the caller's file and line.
+struct tr_source_location
+{
+    [[nodiscard]] static constexpr tr_source_location current(
+        char const* file = TR_BUILTIN_FILE(),
+        int line = TR_BUILTIN_LINE()) noexcept
+    {
+        return { file, line };
+    }
+
+    char const* file = "";
+    int line = 0;
+};
+
 // https://www.bittorrent.org/beps/bep_0007.html
 // "The client SHOULD include a key parameter in its announces. The key
 // should remain the same for a particular infohash during a torrent
@@ -2,15 +2,18 @@
 // It may be used under the MIT (SPDX: MIT) license.
 // License text can be found in the licenses/ folder.
 
+#include <algorithm>
 #include <array>
 #include <cerrno>
+#include <cstring> // memcpy()
 #include <string>
 
 #ifdef _WIN32
 #include <ws2tcpip.h>
 #else
 #include <netinet/in.h> // IPV6_V6ONLY, IPPROTO_IPV6
-#include <sys/socket.h> // setsockopt, SOL_SOCKET, bind
+#include <sys/socket.h> // setsockopt, SOL_SOCKET, bind, recvmmsg, sendmmsg
+#include <sys/uio.h> // iovec
 #endif
 
 #include <event2/event.h>
@@ -89,20 +92,12 @@ void set_socket_buffers(tr_socket_t fd, bool large)
     }
 }
 
-void event_callback(evutil_socket_t s, [[maybe_unused]] short type, void* vsession)
+// @return true if the datagram was passed to libutp
+bool handle_datagram(tr_session* session, unsigned char* buf, size_t len, sockaddr* from, socklen_t fromlen)
 {
-    TR_ASSERT(vsession != nullptr);
-    TR_ASSERT(type == EV_READ);
-
-    auto buf = std::array<unsigned char, 8192>{};
-    auto from = sockaddr_storage{};
-    auto fromlen = socklen_t{ sizeof(from) };
-    auto* const from_sa = reinterpret_cast<sockaddr*>(&from);
-
-    auto const rc = recvfrom(s, reinterpret_cast<char*>(std::data(buf)), std::size(buf) - 1, 0, from_sa, &fromlen);
-    if (rc <= 0)
+    if (len == 0U)
     {
-        return;
+        return false;
     }
 
     /* Since most packets we receive here are µTP, make quick inline
@@ -112,32 +107,189 @@ void event_callback(evutil_socket_t s, [[maybe_unused]] short type, void* vsessi
          is between 0 and 3
        - the above cannot be µTP packets, since these start with a 4-bit
          version number (1). */
-    auto* const session = static_cast<tr_session*>(vsession);
     if (buf[0] == 'd')
     {
         if (session->dht_)
         {
-            buf[rc] = '\0'; // libdht requires zero-terminated messages
-            session->dht_->handle_message(std::data(buf), rc, from_sa, fromlen);
+            buf[len] = '\0'; // libdht requires zero-terminated messages
+            session->dht_->handle_message(buf, len, from, fromlen);
         }
     }
-    else if (rc >= 8 && buf[0] == 0 && buf[1] == 0 && buf[2] == 0 && buf[3] <= 3)
+    else if (len >= 8 && buf[0] == 0 && buf[1] == 0 && buf[2] == 0 && buf[3] <= 3)
     {
-        if (!session->announcer_udp_->handle_message(std::data(buf), rc))
+        if (!session->announcer_udp_->handle_message(buf, len))
         {
             tr_logAddTrace("Couldn't parse UDP tracker packet.");
         }
     }
     else if (session->allowsUTP() && (session->utp_context != nullptr))
     {
-        if (!tr_utpPacket(std::data(buf), rc, from_sa, fromlen, session))
+        if (!tr_utpPacket(buf, len, from, fromlen, session))
         {
             tr_logAddTrace("Unexpected UDP packet");
         }
+
+        return true;
     }
+
+    return false;
+}
+
+void log_send_error(sockaddr const* to, int const error_code)
+{
+    auto display_name = std::string{};
+    if (auto const addrport = tr_address::from_sockaddr(to); addrport)
+    {
+        auto const& [addr, port] = *addrport;
+        display_name = addr.display_name(port);
+    }
+
+    tr_logAddWarn(fmt::format(
+        "Couldn't send to {address}: {errno} ({error})",
+        fmt::arg("address", display_name),
+        fmt::arg("errno", error_code),
+        fmt::arg("error", tr_strerror(error_code))));
 }
 } // namespace
 
+// ---
+
+struct tr_session::tr_udp_core::Batch
+{
+    // the most datagrams to read or write per syscall
+    static auto constexpr Size = size_t{ 16U };
+
+    // the most reads per wakeup, so a busy socket can't starve the event loop
+    static auto constexpr MaxReadsPerWakeup = size_t{ 4U };
+
+    // outgoing datagrams bigger than this are sent right away
+    static auto constexpr MaxQueuedDatagramSize = size_t{ 2048U };
+
+    template<size_t BufSize>
+    struct Datagram
+    {
+        std::array<unsigned char, BufSize> buf;
+        sockaddr_storage addr = {};
+        socklen_t addrlen = 0;
+        size_t len = 0;
+    };
+
+    // @return the number of datagrams read into `recv`
+    size_t read(tr_socket_t sock);
+
+    std::array<Datagram<8192U>, Size> recv;
+
+    std::array<Datagram<MaxQueuedDatagramSize>, Size> send;
+    size_t n_send = 0;
+};
+
+size_t tr_session::tr_udp_core::Batch::read(tr_socket_t sock)
+{
+#ifdef HAVE_RECVMMSG
+    auto iovs = std::array<iovec, Size>{};
+    auto hdrs = std::array<mmsghdr, Size>{};
+    for (size_t i = 0; i < Size; ++i)
+    {
+        auto& dgram = recv[i];
+        iovs[i].iov_base = std::data(dgram.buf);
+        iovs[i].iov_len = std::size(dgram.buf) - 1; // leave room for a '\0'
+        auto& hdr = hdrs[i].msg_hdr;
+        hdr.msg_name = &dgram.addr;
+        hdr.msg_namelen = sizeof(dgram.addr);
+        hdr.msg_iov = &iovs[i];
+        hdr.msg_iovlen = 1;
+    }
+
+    auto const n_read = recvmmsg(sock, std::data(hdrs), Size, MSG_DONTWAIT, nullptr);
+    if (n_read <= 0)
+    {
+        return {};
+    }
+
+    for (int i = 0; i < n_read; ++i)
+    {
+        recv[i].len = hdrs[i].msg_len;
+        recv[i].addrlen = hdrs[i].msg_hdr.msg_namelen;
+    }
+
+    return static_cast<size_t>(n_read);
+#else
+    auto n_read = size_t{};
+
+    for (; n_read < Size; ++n_read)
+    {
+        auto& dgram = recv[n_read];
+        dgram.addrlen = sizeof(dgram.addr);
+#ifdef MSG_DONTWAIT
+        static auto constexpr Flags = MSG_DONTWAIT;
+#else
+        static auto constexpr Flags = 0;
+        if (n_read > 0U) // the socket blocks, so only do the read that we know is ready
+        {
+            break;
+        }
+#endif
+        auto const rc = recvfrom(
+            sock,
+            reinterpret_cast<char*>(std::data(dgram.buf)),
+            std::size(dgram.buf) - 1,
+            Flags,
+            reinterpret_cast<sockaddr*>(&dgram.addr),
+            &dgram.addrlen);
+        if (rc <= 0)
+        {
+            break;
+        }
+
+        dgram.len = static_cast<size_t>(rc);
+    }
+
+    return n_read;
+#endif
+}
+
+// ---
+
+void tr_session::tr_udp_core::on_readable(evutil_socket_t sock, [[maybe_unused]] short type, void* vself)
+{
+    TR_ASSERT(vself != nullptr);
+    TR_ASSERT(type == EV_READ);
+
+    static_cast<tr_udp_core*>(vself)->read_datagrams(sock);
+}
+
+void tr_session::tr_udp_core::on_flush(evutil_socket_t /*sock*/, short /*type*/, void* vself)
+{
+    static_cast<tr_udp_core*>(vself)->flush_sends();
+}
+
+void tr_session::tr_udp_core::read_datagrams(tr_socket_t sock)
+{
+    auto got_utp = false;
+
+    for (size_t pass = 0; pass < Batch::MaxReadsPerWakeup; ++pass)
+    {
+        auto const n_read = batch_->read(sock);
+
+        for (size_t i = 0; i < n_read; ++i)
+        {
+            auto& dgram = batch_->recv[i];
+            auto* const from = reinterpret_cast<sockaddr*>(&dgram.addr);
+            got_utp |= handle_datagram(&session_, std::data(dgram.buf), dgram.len, from, dgram.addrlen);
+        }
+
+        if (n_read < Batch::Size)
+        {
+            break;
+        }
+    }
+
+    if (got_utp)
+    {
+        tr_utpDrained(&session_);
+    }
+}
+
 // BEP-32 explains why we need to bind to one IPv6 address
 
 tr_session::tr_udp_core::tr_udp_core(tr_session& session, tr_port udp_port)
@@ -149,6 +301,9 @@ tr_session::tr_udp_core::tr_udp_core(tr_session& session, tr_port udp_port)
         return;
     }
 
+    batch_ = std::make_unique<Batch>();
+    flush_event_.reset(event_new(session_.event_base(), TR_BAD_SOCKET, 0, on_flush, this));
+
     if (auto sock = socket(PF_INET, SOCK_DGRAM, 0); sock != TR_BAD_SOCKET)
     {
         auto optval = int{ 1 };
@@ -174,7 +329,7 @@ tr_session::tr_udp_core::tr_udp_core(tr_session& session, tr_port udp_port)
             session_.setSocketTOS(sock, TR_AF_INET);
             set_socket_buffers(sock, session_.allowsUTP());
             udp4_socket_ = sock;
-            udp4_event_.reset(event_new(session_.event_base(), udp4_socket_, EV_READ | EV_PERSIST, event_callback, &session_));
+            udp4_event_.reset(event_new(session_.event_base(), udp4_socket_, EV_READ | EV_PERSIST, on_readable, this));
             event_add(udp4_event_.get(), nullptr);
         }
     }
@@ -208,7 +363,7 @@ tr_session::tr_udp_core::tr_udp_core(tr_session& session, tr_port udp_port)
             session_.setSocketTOS(sock, TR_AF_INET6);
             set_socket_buffers(sock, session_.allowsUTP());
             udp6_socket_ = sock;
-            udp6_event_.reset(event_new(session_.event_base(), udp6_socket_, EV_READ | EV_PERSIST, event_callback, &session_));
+            udp6_event_.reset(event_new(session_.event_base(), udp6_socket_, EV_READ | EV_PERSIST, on_readable, this));
             event_add(udp6_event_.get(), nullptr);
 
 #ifdef IPV6_V6ONLY
@@ -223,6 +378,9 @@ tr_session::tr_udp_core::tr_udp_core(tr_session& session, tr_port udp_port)
 
 tr_session::tr_udp_core::~tr_udp_core()
 {
+    flush_sends();
+    flush_event_.reset();
+
     udp6_event_.reset();
 
     if (udp6_socket_ != TR_BAD_SOCKET)
@@ -240,40 +398,116 @@ tr_session::tr_udp_core::~tr_udp_core()
     }
 }
 
-void tr_session::tr_udp_core::sendto(void const* buf, size_t buflen, struct sockaddr const* to, socklen_t const tolen) const
+void tr_session::tr_udp_core::sendto(void const* buf, size_t buflen, struct sockaddr const* to, socklen_t const tolen)
 {
     auto const addrport = tr_address::from_sockaddr(to);
     if (to->sa_family != AF_INET && to->sa_family != AF_INET6)
     {
         errno = EAFNOSUPPORT;
+        log_send_error(to, errno);
+        return;
     }
-    else if (auto const sock = to->sa_family == AF_INET ? udp4_socket_ : udp6_socket_; sock == TR_BAD_SOCKET)
+
+    if (auto const sock = to->sa_family == AF_INET ? udp4_socket_ : udp6_socket_; sock == TR_BAD_SOCKET)
     {
         // don't warn on bad sockets; the system may not support IPv6
         return;
     }
-    else if (
-        addrport && addrport->address().is_global_unicast_address() &&
+
+    if (addrport && addrport->address().is_global_unicast_address() &&
         !session_.global_source_address(to->sa_family == AF_INET ? TR_AF_INET : TR_AF_INET6))
     {
         // don't try to connect to a global address if we don't have connectivity to public internet
         return;
     }
-    else if (::sendto(sock, static_cast<char const*>(buf), buflen, 0, to, tolen) != -1)
+
+#ifdef HAVE_SENDMMSG
+    if (buflen <= Batch::MaxQueuedDatagramSize && tolen <= static_cast<socklen_t>(sizeof(sockaddr_storage)))
     {
+        if (batch_->n_send == Batch::Size)
+        {
+            flush_sends();
+        }
+
+        auto& dgram = batch_->send[batch_->n_send++];
+        std::memcpy(std::data(dgram.buf), buf, buflen);
+        dgram.len = buflen;
+        std::memcpy(&dgram.addr, to, tolen);
+        dgram.addrlen = tolen;
+
+        // send the batch once this round of event callbacks is done
+        if (batch_->n_send == 1U)
+        {
+            event_active(flush_event_.get(), 0, 0);
+        }
+
         return;
     }
 
-    auto display_name = std::string{};
-    if (addrport)
+    // keep the datagrams in order
+    flush_sends();
+#endif
+
+    send_now(buf, buflen, to, tolen);
+}
+
+void tr_session::tr_udp_core::send_now(void const* buf, size_t buflen, struct sockaddr const* to, socklen_t const tolen) const
+{
+    auto const sock = to->sa_family == AF_INET ? udp4_socket_ : udp6_socket_;
+    if (::sendto(sock, static_cast<char const*>(buf), buflen, 0, to, tolen) == -1)
     {
-        auto const& [addr, port] = *addrport;
-        display_name = addr.display_name(port);
+        log_send_error(to, errno);
     }
+}
 
-    tr_logAddWarn(fmt::format(
-        "Couldn't send to {address}: {errno} ({error})",
-        fmt::arg("address", display_name),
-        fmt::arg("errno", errno),
-        fmt::arg("error", tr_strerror(errno))));
+void tr_session::tr_udp_core::flush_sends()
+{
+#ifdef HAVE_SENDMMSG
+    if (!batch_ || batch_->n_send == 0U)
+    {
+        return;
+    }
+
+    auto const n_send = batch_->n_send;
+    batch_->n_send = 0U;
+
+    for (auto const& [sock, family] : { std::pair{ udp4_socket_, AF_INET }, std::pair{ udp6_socket_, AF_INET6 } })
+    {
+        if (sock == TR_BAD_SOCKET)
+        {
+            continue;
+        }
+
+        auto iovs = std::array<iovec, Batch::Size>{};
+        auto hdrs = std::array<mmsghdr, Batch::Size>{};
+        auto n_hdrs = size_t{};
+        for (size_t i = 0; i < n_send; ++i)
+        {
+            if (auto& dgram = batch_->send[i]; dgram.addr.ss_family == family)
+            {
+                iovs[n_hdrs].iov_base = std::data(dgram.buf);
+                iovs[n_hdrs].iov_len = dgram.len;
+                auto& hdr = hdrs[n_hdrs].msg_hdr;
+                hdr.msg_name = &dgram.addr;
+                hdr.msg_namelen = dgram.addrlen;
+                hdr.msg_iov = &iovs[n_hdrs];
+                hdr.msg_iovlen = 1;
+                ++n_hdrs;
+            }
+        }
+
+        for (size_t offset = 0; offset < n_hdrs;)
+        {
+            if (auto const n_sent = sendmmsg(sock, &hdrs[offset], n_hdrs - offset, 0); n_sent > 0)
+            {
+                offset += n_sent;
+                continue;
+            }
+
+            // skip the datagram that failed
+            log_send_error(static_cast<sockaddr const*>(hdrs[offset].msg_hdr.msg_name), errno);
+            ++offset;
+        }
+    }
+#endif
 }
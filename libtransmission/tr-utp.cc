@@ -56,6 +56,10 @@ bool tr_utpPacket(
     return false;
 }
 
+void tr_utpDrained(tr_session* /*ss*/)
+{
+}
+
 struct UTPSocket* utp_create_socket(struct_utp_context* /*ctx*/)
 {
     return nullptr;
@@ -171,6 +175,8 @@ void timer_callback(void* vsession)
 {
     auto* session = static_cast<tr_session*>(vsession);
 
+    tr_peerIo::utp_flush_reads(session);
+
     /* utp_internal.cpp says "Should be called each time the UDP socket is drained" but it's tricky with libevent */
     utp_issue_deferred_acks(session->utp_context);
 
@@ -212,12 +218,15 @@ void tr_utpInit(tr_session* session)
 
 bool tr_utpPacket(unsigned char const* buf, size_t buflen, struct sockaddr const* from, socklen_t fromlen, tr_session* ss)
 {
-    auto const ret = utp_process_udp(ss->utp_context, buf, buflen, from, fromlen);
+    return utp_process_udp(ss->utp_context, buf, buflen, from, fromlen) != 0;
+}
 
-    /* utp_internal.cpp says "Should be called each time the UDP socket is drained" but it's tricky with libevent */
-    utp_issue_deferred_acks(ss->utp_context);
+void tr_utpDrained(tr_session* ss)
+{
+    tr_peerIo::utp_flush_reads(ss);
 
-    return ret != 0;
+    /* utp_internal.cpp says "Should be called each time the UDP socket is drained" */
+    utp_issue_deferred_acks(ss->utp_context);
 }
 
 void tr_utpClose(tr_session* session)
@@ -16,4 +16,7 @@ void tr_utpInit(tr_session* session);
 
 bool tr_utpPacket(unsigned char const* buf, size_t buflen, struct sockaddr const* from, socklen_t fromlen, tr_session* ss);
 
+// Call this after each batch of packets passed to tr_utpPacket()
+void tr_utpDrained(tr_session* ss);
+
 void tr_utpClose(tr_session*);
@@ -0,0 +1,202 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef> // size_t
+#include <cstdint> // int64_t, uint64_t
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include "libtransmission/tracing.h"
+
+namespace
+{
+enum class EventType : uint8_t
+{
+    Span,
+    Counter
+};
+
+struct EventCopy
+{
+    EventType type;
+    char const* category;
+    char const* name;
+    int64_t ts_usec;
+    int64_t value; // a span's duration or a counter's value
+};
+
+// A ring buffer that only its own thread writes to. Readers copy it
+// seqlock-style: events that were overwritten during the copy are dropped.
+class ThreadBuffer
+{
+public:
+    explicit ThreadBuffer(uint64_t tid) noexcept
+        : tid_{ tid }
+    {
+    }
+
+    void add(EventType type, char const* category, char const* name, int64_t ts_usec, int64_t value) noexcept
+    {
+        auto const n = head_.load(std::memory_order_relaxed);
+        auto& event = events_[n % std::size(events_)];
+        event.type.store(type, std::memory_order_relaxed);
+        event.category.store(category, std::memory_order_relaxed);
+        event.name.store(name, std::memory_order_relaxed);
+        event.ts_usec.store(ts_usec, std::memory_order_relaxed);
+        event.value.store(value, std::memory_order_relaxed);
+        head_.store(n + 1U, std::memory_order_release);
+    }
+
+    [[nodiscard]] std::vector<EventCopy> copy() const
+    {
+        auto const end = head_.load(std::memory_order_acquire);
+        auto const begin = oldest(end);
+
+        auto ret = std::vector<EventCopy>{};
+        ret.reserve(end - begin);
+        for (auto n = begin; n < end; ++n)
+        {
+            auto const& event = events_[n % std::size(events_)];
+            ret.push_back({ event.type.load(std::memory_order_relaxed),
+                            event.category.load(std::memory_order_relaxed),
+                            event.name.load(std::memory_order_relaxed),
+                            event.ts_usec.load(std::memory_order_relaxed),
+                            event.value.load(std::memory_order_relaxed) });
+        }
+
+        // drop the events that the thread overwrote while we were copying
+        std::atomic_thread_fence(std::memory_order_acquire);
+        auto const n_overwritten = oldest(head_.load(std::memory_order_relaxed)) - begin;
+        ret.erase(std::begin(ret), std::begin(ret) + std::min(n_overwritten, std::size(ret)));
+        return ret;
+    }
+
+    [[nodiscard]] constexpr auto tid() const noexcept
+    {
+        return tid_;
+    }
+
+private:
+    struct Event
+    {
+        std::atomic<EventType> type = {};
+        std::atomic<char const*> category = {};
+        std::atomic<char const*> name = {};
+        std::atomic<int64_t> ts_usec = {};
+        std::atomic<int64_t> value = {};
+    };
+
+    [[nodiscard]] static constexpr size_t oldest(size_t head) noexcept
+    {
+        return head > tr_trace::EventsPerThread ? head - tr_trace::EventsPerThread : 0U;
+    }
+
+    std::array<Event, tr_trace::EventsPerThread> events_ = {};
+    std::atomic<size_t> head_ = {};
+    uint64_t const tid_;
+};
+
+// Buffers outlive their threads so that their events can still be written.
+class Registry
+{
+public:
+    [[nodiscard]] static Registry& instance()
+    {
+        static auto registry = Registry{};
+        return registry;
+    }
+
+    [[nodiscard]] std::shared_ptr<ThreadBuffer> add()
+    {
+        auto const lock = std::lock_guard{ mutex_ };
+        return buffers_.emplace_back(std::make_shared<ThreadBuffer>(std::size(buffers_) + 1U));
+    }
+
+    [[nodiscard]] std::vector<std::shared_ptr<ThreadBuffer>> buffers() const
+    {
+        auto const lock = std::lock_guard{ mutex_ };
+        return buffers_;
+    }
+
+private:
+    mutable std::mutex mutex_;
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers_;
+};
+
+[[nodiscard]] ThreadBuffer& this_thread_buffer()
+{
+    thread_local auto const buffer = Registry::instance().add();
+    return *buffer;
+}
+
+[[nodiscard]] int64_t to_usec(tr_trace::Clock::time_point time) noexcept
+{
+    static auto const epoch = tr_trace::Clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(time - epoch).count();
+}
+} // namespace
+
+void tr_trace::add_span(char const* category, char const* name, Clock::time_point begin, Clock::time_point end) noexcept
+{
+    auto const duration = std::chrono::duration_cast<std::chrono::microseconds>(end - begin);
+    this_thread_buffer().add(EventType::Span, category, name, to_usec(begin), duration.count());
+}
+
+void tr_trace::add_counter(char const* category, char const* name, int64_t value) noexcept
+{
+    this_thread_buffer().add(EventType::Counter, category, name, to_usec(Clock::now()), value);
+}
+
+void tr_trace::write_json(std::string& out)
+{
+    auto it = std::back_inserter(out);
+    fmt::format_to(it, R"({{"displayTimeUnit":"ms","traceEvents":[)");
+
+    auto sep = "";
+    for (auto const& buffer : Registry::instance().buffers())
+    {
+        auto const tid = buffer->tid();
+        for (auto const& [type, category, name, ts_usec, value] : buffer->copy())
+        {
+            if (type == EventType::Span)
+            {
+                fmt::format_to(
+                    it,
+                    R"({:s}{{"ph":"X","pid":1,"tid":{:d},"cat":"{:s}","name":"{:s}","ts":{:d},"dur":{:d}}})",
+                    sep,
+                    tid,
+                    category,
+                    name,
+                    ts_usec,
+                    value);
+            }
+            else
+            {
+                fmt::format_to(
+                    it,
+                    R"({:s}{{"ph":"C","pid":1,"tid":{:d},"cat":"{:s}","name":"{:s}","ts":{:d},"args":{{"value":{:d}}}}})",
+                    sep,
+                    tid,
+                    category,
+                    name,
+                    ts_usec,
+                    value);
+            }
+
+            sep = ",";
+        }
+    }
+
+    fmt::format_to(it, "]}}");
+}
@@ -0,0 +1,90 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <chrono>
+#include <cstddef> // size_t
+#include <cstdint> // int64_t
+#include <string>
+
+#include "libtransmission/tr-macros.h"
+
+// Spans and counters for profiling a live session, cheap enough to leave on.
+// Each thread records into its own fixed-size ring buffer without locking,
+// so only the newest `EventsPerThread` events per thread are kept.
+// `tr_rpc_server` serves them at `/transmission/trace` as Chrome trace
+// JSON, which chrome://tracing and https://ui.perfetto.dev can open.
+//
+// The TR_TRACE_* macros compile to nothing unless libtransmission is
+// built with -DENABLE_TRACING=ON.
+//
+// Names and categories are stored as pointers, so they must be string
+// literals or otherwise live as long as the process. They're written to
+// the JSON unescaped.
+class tr_trace
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static auto constexpr EventsPerThread = size_t{ 8192U };
+
+#ifdef WITH_TRACING
+    static auto constexpr Enabled = true;
+#else
+    static auto constexpr Enabled = false;
+#endif
+
+    // Records a span from its construction to its destruction.
+    class Span
+    {
+    public:
+        Span(char const* category, char const* name) noexcept
+            : category_{ category }
+            , name_{ name }
+            , begin_{ Clock::now() }
+        {
+        }
+
+        ~Span()
+        {
+            add_span(category_, name_, begin_, Clock::now());
+        }
+
+        TR_DISABLE_COPY_MOVE(Span)
+
+    private:
+        char const* const category_;
+        char const* const name_;
+        Clock::time_point const begin_;
+    };
+
+    static void add_span(char const* category, char const* name, Clock::time_point begin, Clock::time_point end) noexcept;
+
+    static void add_counter(char const* category, char const* name, int64_t value) noexcept;
+
+    // Append the recorded events as a Chrome trace JSON object.
+    static void write_json(std::string& out);
+};
+
+#ifdef WITH_TRACING
+#define TR_TRACE_CONCAT_IMPL(a, b) a##b
+#define TR_TRACE_CONCAT(a, b) TR_TRACE_CONCAT_IMPL(a, b)
+#define TR_TRACE_SCOPE(category, name) tr_trace::Span const TR_TRACE_CONCAT(tr_trace_span_, __LINE__)(category, name)
+#define TR_TRACE_COUNTER(category, name, value) tr_trace::add_counter(category, name, value)
+#else
+#define TR_TRACE_SCOPE(category, name) \
+    do \
+    { \
+    } while (0)
+#define TR_TRACE_COUNTER(category, name, value) \
+    do \
+    { \
+    } while (0)
+#endif
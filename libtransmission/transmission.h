@@ -58,6 +58,7 @@ struct tr_variant;
 using tr_priority_t = int8_t;
 
 #define TR_RPC_SESSION_ID_HEADER "X-Transmission-Session-Id"
+#define TR_RPC_BENC_CONTENT_TYPE "application/x-bencode"
 
 enum tr_verify_added_mode
 {
@@ -249,6 +250,29 @@ void tr_sessionReloadBlocklists(tr_session* session);
  */
 void tr_sessionClose(tr_session* session, size_t timeout_secs = 15);
 
+#ifndef _WIN32
+
+/**
+ * @brief Get copies of the sockets that listen for incoming peer connections,
+ *        e.g. to hand them over to a process that's replacing this one.
+ *
+ * The caller must close the copies.
+ *
+ * @return the number of sockets written to `setme`, at most `max_n`.
+ */
+size_t tr_sessionGetPeerSockets(tr_session* session, int* setme, size_t max_n);
+
+/**
+ * @brief Listen for peers on sockets that another process handed over.
+ *
+ * Call this before `tr_sessionInit()`. Sockets that are bound to the new
+ * session's peer port and bind addresses are used instead of binding new
+ * ones, so that peers can still connect while it starts. The rest are closed.
+ */
+void tr_sessionAddInheritedPeerSockets(int const* sockets, size_t n);
+
+#endif
+
 /**
  * @brief Return the session's configuration directory.
  *
@@ -1222,7 +1246,7 @@ struct tr_peer_stat
 
     char addr[TR_INET6_ADDRSTRLEN];
     char flagStr[32];
-    char const* client;
+    char const* client; // interned, so it stays valid after tr_torrentPeersFree()
 
     float progress;
     double rateToPeer_KBps;
@@ -1244,6 +1268,12 @@ struct tr_peer_stat
 
     /* how many requests we've made and are currently awaiting a response for */
     size_t activeReqsToPeer;
+
+    /* how many requests we try to keep in flight to this peer */
+    size_t desiredReqsToPeer;
+
+    /* memory held by this peer's read and write buffers */
+    size_t bufferBytes;
 };
 
 tr_peer_stat* tr_torrentPeers(tr_torrent const* torrent, size_t* peer_count);
@@ -1410,6 +1440,34 @@ void tr_torrentAmountFinished(tr_torrent const* torrent, float* tab, int n_tabs)
  */
 void tr_torrentVerify(tr_torrent* torrent);
 
+/**
+ * Queue a torrent for a quick verification, e.g. after an unclean shutdown.
+ * Pieces that were checked since their files last changed, judging by the
+ * files' mtimes and sizes, are trusted and only the others are hashed.
+ */
+void tr_torrentVerifyQuick(tr_torrent* torrent);
+
+/**
+ * Like tr_torrentVerifyQuick(), but a running torrent keeps running.
+ * The pieces that the resume data says we have are checked in the
+ * background, in order. If a peer asks for one before it's been reached,
+ * it's checked right before it's sent. If the torrent isn't running, this
+ * is the same as tr_torrentVerifyQuick().
+ */
+void tr_torrentVerifyBackground(tr_torrent* torrent);
+
+/**
+ * Pause a torrent's verify. Its progress is kept, even across restarts,
+ * until it's resumed with tr_torrentVerifyResume().
+ */
+void tr_torrentVerifyPause(tr_torrent* torrent);
+
+/**
+ * Resume a verify that was paused or interrupted, e.g. by stopping the
+ * torrent, from the piece where it left off.
+ */
+void tr_torrentVerifyResume(tr_torrent* torrent);
+
 bool tr_torrentHasMetadata(tr_torrent const* tor);
 
 /**
@@ -1525,6 +1583,16 @@ struct tr_stat
         @see `tr_stat.activity` */
     float recheckProgress;
 
+    /** If the torrent's files are being copied to another filesystem by
+        `tr_torrentSetLocation()`, this is how much has been copied so far.
+        Range is [0..1] */
+    float relocateProgress;
+
+    /** If the torrent's files are being preallocated in the background,
+        this is how much has been preallocated so far.
+        Range is [0..1] */
+    float preallocateProgress;
+
     /** How much has been downloaded of the entire torrent.
         Range is [0..1] */
     float percentComplete;
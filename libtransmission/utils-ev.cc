@@ -45,4 +45,28 @@ void EvhttpDeleter::operator()(struct evhttp* evh) const noexcept
     }
 }
 
+evbase_unique_ptr make_event_base()
+{
+    auto* const config = event_config_new();
+    if (config == nullptr)
+    {
+        return evbase_unique_ptr{ event_base_new() };
+    }
+
+    // Only safe if fds aren't dup()ed while they have events, which ours aren't
+    (void)event_config_set_flag(config, EVENT_BASE_FLAG_EPOLL_USE_CHANGELIST);
+
+    // Try for a backend that doesn't rescan every fd each time it polls
+    (void)event_config_require_features(config, EV_FEATURE_O1);
+    auto* evbase = event_base_new_with_config(config);
+    event_config_free(config);
+
+    if (evbase == nullptr)
+    {
+        evbase = event_base_new();
+    }
+
+    return evbase_unique_ptr{ evbase };
+}
+
 } // namespace libtransmission::evhelpers
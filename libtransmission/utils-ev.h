@@ -47,4 +47,11 @@ struct EvhttpDeleter
 
 using evhttp_unique_ptr = std::unique_ptr<struct evhttp, EvhttpDeleter>;
 
+// Make an event base that uses the platform's O(1) backend, i.e. epoll or
+// kqueue, where there is one. With epoll, changes to an fd's events are
+// batched: a socket whose read and write events are toggled several times
+// while the loop runs its callbacks costs one epoll_ctl() call, not one
+// per change. Falls back to event_base_new() if that can't be had.
+[[nodiscard]] evbase_unique_ptr make_event_base();
+
 } // namespace libtransmission::evhelpers
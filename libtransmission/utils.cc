@@ -132,13 +132,72 @@ bool tr_file_read(std::string_view filename, std::vector<char>& contents, tr_err
     return true;
 }
 
+bool tr_mapped_file::open(std::string_view filename, tr_error** error)
+{
+    close();
+
+    auto const szfilename = tr_pathbuf{ filename };
+    auto const info = tr_sys_path_get_info(szfilename);
+    auto const fd = info && info->isFile() && info->size > 0U ?
+        tr_sys_file_open(szfilename, TR_SYS_FILE_READ | TR_SYS_FILE_SEQUENTIAL, 0) :
+        TR_BAD_SYS_FILE;
+
+    if (fd != TR_BAD_SYS_FILE)
+    {
+        if (auto* const addr = tr_sys_file_map_for_reading(fd, 0U, info->size); addr != nullptr)
+        {
+            contents_ = { static_cast<char const*>(addr), static_cast<size_t>(info->size) };
+            mapped_ = true;
+        }
+
+        tr_sys_file_close(fd);
+    }
+
+    // fall back to reading it, e.g. for empty files or filesystems
+    // that don't support mmap. This also handles the error reporting.
+    if (!mapped_)
+    {
+        if (!tr_file_read(filename, buf_, error))
+        {
+            return false;
+        }
+
+        contents_ = { std::data(buf_), std::size(buf_) };
+    }
+
+    return true;
+}
+
+void tr_mapped_file::close()
+{
+    if (mapped_)
+    {
+        tr_sys_file_unmap(std::data(contents_), std::size(contents_));
+        mapped_ = false;
+    }
+
+    contents_ = {};
+    buf_ = {};
+}
+
 bool tr_file_save(std::string_view filename, std::string_view contents, tr_error** error)
+{
+    return tr_file_save_chunked(
+        filename,
+        [contents](auto const& write) { return write(contents); },
+        error);
+}
+
+bool tr_file_save_chunked(
+    std::string_view filename,
+    std::function<bool(std::function<bool(std::string_view)> const& write)> const& fill,
+    tr_error** error)
 {
     // follow symlinks to find the "real" file, to make sure the temporary
     // we build with tr_sys_file_open_temp() is created on the right partition
     if (auto const realname = tr_sys_path_resolve(filename); !std::empty(realname) && realname != filename)
     {
-        return tr_file_save(realname, contents, error);
+        return tr_file_save_chunked(realname, fill, error);
     }
 
     // Write it to a temp file first.
@@ -150,22 +209,27 @@ bool tr_file_save(std::string_view filename, std::string_view contents, tr_error
         return false;
     }
 
-    // Save the contents. This might take >1 pass.
-    auto ok = bool{ true };
-    while (!std::empty(contents))
+    // Save the contents. Each piece might take >1 pass.
+    auto const write = [fd, error](std::string_view contents)
     {
-        auto n_written = uint64_t{};
-        if (!tr_sys_file_write(fd, std::data(contents), std::size(contents), &n_written, error))
+        while (!std::empty(contents))
         {
-            ok = false;
-            break;
+            auto n_written = uint64_t{};
+            if (!tr_sys_file_write(fd, std::data(contents), std::size(contents), &n_written, error))
+            {
+                return false;
+            }
+            contents.remove_prefix(n_written);
         }
-        contents.remove_prefix(n_written);
-    }
+
+        return true;
+    };
+    auto const ok = fill(write);
 
     // If we saved it to disk successfully, move it from '.tmp' to the correct filename
     if (!tr_sys_file_close(fd, error) || !ok || !tr_sys_path_rename(tmp, tr_pathbuf{ filename }, error))
     {
+        tr_sys_path_remove(tmp);
         return false;
     }
 
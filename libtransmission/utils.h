@@ -10,6 +10,7 @@
 #include <cstdint> // uint8_t, uint32_t, uint64_t
 #include <cstddef> // size_t
 #include <ctime> // time_t
+#include <functional>
 #include <memory>
 #include <optional>
 #include <string>
@@ -62,6 +63,47 @@ void tr_locale_set_global(char const* locale_name) noexcept;
 
 bool tr_file_read(std::string_view filename, std::vector<char>& contents, tr_error** error = nullptr);
 
+/**
+ * @brief A read-only view of a file's contents.
+ *
+ * The file is memory-mapped when possible so that large files can be parsed
+ * without copying them. If mapping fails, it's read into memory instead.
+ * Views into `contents()` are valid until the object is closed or destroyed.
+ */
+class tr_mapped_file
+{
+public:
+    tr_mapped_file() = default;
+    tr_mapped_file(tr_mapped_file const&) = delete;
+    tr_mapped_file(tr_mapped_file&&) = delete;
+    tr_mapped_file& operator=(tr_mapped_file const&) = delete;
+    tr_mapped_file& operator=(tr_mapped_file&&) = delete;
+
+    ~tr_mapped_file()
+    {
+        close();
+    }
+
+    bool open(std::string_view filename, tr_error** error = nullptr);
+
+    void close();
+
+    [[nodiscard]] constexpr std::string_view contents() const noexcept
+    {
+        return contents_;
+    }
+
+    [[nodiscard]] constexpr auto is_mapped() const noexcept
+    {
+        return mapped_;
+    }
+
+private:
+    std::string_view contents_;
+    std::vector<char> buf_;
+    bool mapped_ = false;
+};
+
 bool tr_file_move(std::string_view oldpath, std::string_view newpath, struct tr_error** error = nullptr);
 
 bool tr_file_save(std::string_view filename, std::string_view contents, tr_error** error = nullptr);
@@ -72,6 +114,15 @@ constexpr auto tr_file_save(std::string_view filename, ContiguousRange const& x,
     return tr_file_save(filename, std::string_view{ std::data(x), std::size(x) }, error);
 }
 
+// Same as tr_file_save(), but `fill` writes the contents in pieces by calling its
+// argument, which returns false if a write failed. Useful for contents
+// that are too big to build in memory first.
+// @return false if `fill` returned false or the file couldn't be saved
+bool tr_file_save_chunked(
+    std::string_view filename,
+    std::function<bool(std::function<bool(std::string_view)> const& write)> const& fill,
+    tr_error** error = nullptr);
+
 /** @brief return the current date in milliseconds */
 [[nodiscard]] uint64_t tr_time_msec();
 
@@ -135,12 +135,14 @@ namespace parse_helpers
 struct MyHandler : public transmission::benc::Handler
 {
     tr_variant* const top_;
+    tr_variant_arena* const arena_;
     int const parse_opts_;
     std::deque<tr_variant*> stack_;
     std::optional<tr_quark> key_;
 
-    MyHandler(tr_variant* top, int parse_opts)
+    MyHandler(tr_variant* top, int parse_opts, tr_variant_arena* arena)
         : top_{ top }
+        , arena_{ arena }
         , parse_opts_{ parse_opts }
     {
     }
@@ -178,7 +180,7 @@ struct MyHandler : public transmission::benc::Handler
         }
         else
         {
-            tr_variantInitStr(variant, sv);
+            tr_variantInitStr(variant, sv, arena_);
         }
 
         return true;
@@ -192,7 +194,7 @@ struct MyHandler : public transmission::benc::Handler
             return false;
         }
 
-        tr_variantInitDict(variant, 0);
+        tr_variantInitDict(variant, 0, arena_);
         stack_.push_back(variant);
         return true;
     }
@@ -223,7 +225,7 @@ struct MyHandler : public transmission::benc::Handler
             return false;
         }
 
-        tr_variantInitList(variant, 0);
+        tr_variantInitList(variant, 0, arena_);
         stack_.push_back(variant);
         return true;
     }
@@ -264,13 +266,19 @@ private:
 } // namespace parse_helpers
 } // namespace
 
-bool tr_variantParseBenc(tr_variant& top, int parse_opts, std::string_view benc, char const** setme_end, tr_error** error)
+bool tr_variantParseBenc(
+    tr_variant& top,
+    int parse_opts,
+    std::string_view benc,
+    char const** setme_end,
+    tr_error** error,
+    tr_variant_arena* arena)
 {
     using namespace parse_helpers;
     using Stack = transmission::benc::ParserStack<512>;
 
     auto stack = Stack{};
-    auto handler = MyHandler{ &top, parse_opts };
+    auto handler = MyHandler{ &top, parse_opts, arena };
     return transmission::benc::parse(benc, stack, handler, setme_end, error) && std::empty(stack);
 }
 
@@ -280,7 +288,7 @@ namespace
 {
 namespace to_string_helpers
 {
-using OutBuf = libtransmission::StackBuffer<1024U * 8U, std::byte>;
+using OutBuf = tr_variant_out;
 
 void saveIntFunc(tr_variant const* val, void* vout)
 {
@@ -361,3 +369,12 @@ std::string tr_variantToStrBenc(tr_variant const* top)
     tr_variantWalk(top, &walk_funcs, &buf, true);
     return buf.to_string();
 }
+
+bool tr_variantToSinkBenc(tr_variant const* top, tr_variant_sink const& sink)
+{
+    using namespace to_string_helpers;
+
+    auto buf = OutBuf{ &sink };
+    tr_variantWalk(top, &walk_funcs, &buf, true);
+    return buf.flush();
+}
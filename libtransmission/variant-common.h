@@ -9,13 +9,16 @@
 #error only libtransmission/variant-*.c should #include this header.
 #endif
 
+#include <cstddef> // size_t, std::byte
 #include <cstdint> // int64_t
 #include <optional>
 #include <string>
 #include <string_view>
+#include <utility> // std::pair
 
 #include "transmission.h"
 
+#include "tr-buffer.h"
 #include "variant.h"
 
 using VariantWalkFunc = void (*)(tr_variant const* val, void* user_data);
@@ -33,16 +36,125 @@ struct VariantWalkFuncs
 
 void tr_variantWalk(tr_variant const* top, VariantWalkFuncs const* walk_funcs, void* user_data, bool sort_dicts);
 
+// Where the serializers write. Without a sink, all the output is kept
+// for to_string(). With one, the output is handed to the sink whenever
+// a few KiB of it have been buffered.
+class tr_variant_out
+{
+public:
+    tr_variant_out() = default;
+
+    explicit tr_variant_out(tr_variant_sink const* sink)
+        : sink_{ sink }
+    {
+    }
+
+    tr_variant_out(tr_variant_out const&) = delete;
+    tr_variant_out(tr_variant_out&&) = delete;
+    tr_variant_out& operator=(tr_variant_out const&) = delete;
+    tr_variant_out& operator=(tr_variant_out&&) = delete;
+
+    [[nodiscard]] std::pair<std::byte*, size_t> reserve_space(size_t n_bytes)
+    {
+        return buf_.reserve_space(n_bytes);
+    }
+
+    void commit_space(size_t n_bytes)
+    {
+        buf_.commit_space(n_bytes);
+        maybe_flush();
+    }
+
+    void add(void const* span_begin, size_t span_len)
+    {
+        buf_.add(span_begin, span_len);
+        maybe_flush();
+    }
+
+    template<typename ContiguousContainer>
+    void add(ContiguousContainer const& container)
+    {
+        add(std::data(container), std::size(container));
+    }
+
+    void push_back(char ch)
+    {
+        add(&ch, 1U);
+    }
+
+    // @return true if nothing's been written yet
+    [[nodiscard]] bool empty() const noexcept
+    {
+        return std::empty(buf_) && !flushed_;
+    }
+
+    [[nodiscard]] auto to_string_view() const
+    {
+        return buf_.to_string_view();
+    }
+
+    [[nodiscard]] auto to_string() const
+    {
+        return buf_.to_string();
+    }
+
+    // Hand whatever's buffered to the sink.
+    // @return false if the sink failed
+    bool flush()
+    {
+        if (sink_ != nullptr && !std::empty(buf_))
+        {
+            ok_ = ok_ && (*sink_)(buf_.to_string_view());
+            buf_.clear();
+            flushed_ = true;
+        }
+
+        return ok_;
+    }
+
+private:
+    static auto constexpr FlushSize = size_t{ 1024U * 6U };
+
+    void maybe_flush()
+    {
+        if (sink_ != nullptr && std::size(buf_) >= FlushSize)
+        {
+            flush();
+        }
+    }
+
+    libtransmission::StackBuffer<1024U * 8U, std::byte> buf_;
+    tr_variant_sink const* const sink_ = nullptr;
+    bool flushed_ = false;
+    bool ok_ = true;
+};
+
 [[nodiscard]] std::string tr_variantToStrJson(tr_variant const* top, bool lean);
 
 [[nodiscard]] std::string tr_variantToStrBenc(tr_variant const* top);
 
+bool tr_variantToSinkJson(tr_variant const* top, bool lean, tr_variant_sink const& sink);
+
+bool tr_variantToSinkBenc(tr_variant const* top, tr_variant_sink const& sink);
+
 /** @brief Private function that's exposed here only for unit tests */
 [[nodiscard]] std::optional<int64_t> tr_bencParseInt(std::string_view* benc_inout);
 
 /** @brief Private function that's exposed here only for unit tests */
 [[nodiscard]] std::optional<std::string_view> tr_bencParseStr(std::string_view* benc_inout);
 
-bool tr_variantParseBenc(tr_variant& top, int parse_opts, std::string_view benc, char const** setme_end, tr_error** error);
+bool tr_variantParseBenc(
+    tr_variant& top,
+    int parse_opts,
+    std::string_view benc,
+    char const** setme_end,
+    tr_error** error,
+    tr_variant_arena* arena);
 
-bool tr_variantParseJson(tr_variant& setme, int opts, std::string_view json, char const** setme_end, tr_error** error);
+bool tr_variantParseJson(
+    tr_variant& setme,
+    int opts,
+    std::string_view json,
+    char const** setme_end,
+    tr_error** error,
+    tr_variant_arena* arena);
@@ -14,9 +14,13 @@
 #include <cstring>
 #include <deque>
 #include <iterator> // std::back_inserter
+#include <numeric> // std::iota
+#include <memory>
 #include <string>
 #include <string_view>
+#include <thread>
 #include <utility>
+#include <vector>
 
 #define UTF_CPP_CPLUSPLUS 201703L
 #include <utf8.h>
@@ -24,8 +28,6 @@
 #include <fmt/core.h>
 #include <fmt/compile.h>
 
-#include <jsonsl.h>
-
 #define LIBTRANSMISSION_VARIANT_MODULE
 
 #include "libtransmission/error.h"
@@ -40,97 +42,86 @@ using namespace std::literals;
 
 namespace
 {
-namespace parse_helpers
+// SWAR ("SIMD within a register") helpers for scanning strings eight bytes at a time
+
+namespace swar_helpers
 {
-/* arbitrary value... this is much deeper than our code goes */
-auto constexpr MaxDepth = size_t{ 64 };
+using Word = uint64_t;
 
-struct json_wrapper_data
+[[nodiscard]] constexpr Word broadcast(uint8_t ch) noexcept
 {
-    bool has_content;
-    size_t size;
-    std::string_view key;
-    std::string keybuf;
-    std::string strbuf;
-    tr_error* error;
-    std::deque<tr_variant*> stack;
-    tr_variant* top;
-    int parse_opts;
+    return Word{ 0x0101010101010101U } * ch;
+}
 
-    /* A very common pattern is for a container's children to be similar,
-     * e.g. they may all be objects with the same set of keys. So when
-     * a container is popped off the stack, remember its size to use as
-     * a preallocation heuristic for the next container at that depth. */
-    std::array<size_t, MaxDepth> preallocGuess;
-};
+// @return nonzero iff any byte in `x` is less than `n`, for n <= 128
+[[nodiscard]] constexpr Word has_less(Word x, uint8_t n) noexcept
+{
+    return (x - broadcast(n)) & ~x & broadcast(0x80U);
+}
 
-tr_variant* get_node(struct jsonsl_st* jsn)
+// @return nonzero iff any byte in `x` equals `ch`
+[[nodiscard]] constexpr Word has_byte(Word x, uint8_t ch) noexcept
 {
-    auto* data = static_cast<struct json_wrapper_data*>(jsn->data);
+    return has_less(x ^ broadcast(ch), 1U);
+}
 
-    auto* parent = std::empty(data->stack) ? nullptr : data->stack.back();
+[[nodiscard]] inline Word load(char const* in) noexcept
+{
+    auto word = Word{};
+    std::memcpy(&word, in, sizeof(word));
+    return word;
+}
 
-    tr_variant* node = nullptr;
-    if (parent == nullptr)
-    {
-        node = data->top;
-    }
-    else if (tr_variantIsList(parent))
+// @return the first char in [begin, end) that is a '"' or '\\'
+[[nodiscard]] inline char const* find_quote_or_backslash(char const* begin, char const* const end) noexcept
+{
+    for (; end - begin >= static_cast<ptrdiff_t>(sizeof(Word)); begin += sizeof(Word))
     {
-        node = tr_variantListAdd(parent);
+        if (auto const word = load(begin); (has_byte(word, '"') | has_byte(word, '\\')) != 0U)
+        {
+            break;
+        }
     }
-    else if (tr_variantIsDict(parent) && !std::empty(data->key))
+
+    while (begin != end && *begin != '"' && *begin != '\\')
     {
-        node = tr_variantDictAdd(parent, tr_quark_new(data->key));
-        data->key = ""sv;
+        ++begin;
     }
 
-    return node;
+    return begin;
 }
 
-void error_handler(jsonsl_t jsn, jsonsl_error_t error, jsonsl_state_st* /*state*/, jsonsl_char_t const* buf)
+// @return the first char in [begin, end) that can't be written as-is in a JSON string
+[[nodiscard]] inline char const* find_escapable(char const* begin, char const* const end) noexcept
 {
-    auto* data = static_cast<struct json_wrapper_data*>(jsn->data);
-
-    tr_error_set(
-        &data->error,
-        EILSEQ,
-        fmt::format(
-            _("Couldn't parse JSON at position {position} '{text}': {error} ({error_code})"),
-            fmt::arg("position", jsn->pos),
-            fmt::arg("text", std::string_view{ buf, std::min(size_t{ 16U }, data->size - jsn->pos) }),
-            fmt::arg("error", jsonsl_strerror(error)),
-            fmt::arg("error_code", static_cast<int>(error))));
-}
-
-int error_callback(jsonsl_t jsn, jsonsl_error_t error, struct jsonsl_state_st* state, jsonsl_char_t* at)
-{
-    error_handler(jsn, error, state, at);
-    return 0; /* bail */
-}
-
-void action_callback_PUSH(jsonsl_t jsn, jsonsl_action_t /*action*/, struct jsonsl_state_st* state, jsonsl_char_t const* /*buf*/)
-{
-    auto* const data = static_cast<json_wrapper_data*>(jsn->data);
-
-    if ((state->type == JSONSL_T_LIST) || (state->type == JSONSL_T_OBJECT))
+    static auto constexpr IsSafe = [](unsigned char ch)
     {
-        data->has_content = true;
-        tr_variant* node = get_node(jsn);
-        data->stack.push_back(node);
+        return ch >= 0x20U && ch < 0x7FU && ch != '"' && ch != '\\';
+    };
 
-        size_t const depth = std::size(data->stack);
-        size_t const n = depth < MaxDepth ? data->preallocGuess[depth] : 0;
-        if (state->type == JSONSL_T_LIST)
-        {
-            tr_variantInitList(node, n);
-        }
-        else
+    for (; end - begin >= static_cast<ptrdiff_t>(sizeof(Word)); begin += sizeof(Word))
+    {
+        auto const word = load(begin);
+        if ((has_less(word, 0x20U) | has_byte(word, 0x7FU) | (word & broadcast(0x80U)) | has_byte(word, '"') |
+             has_byte(word, '\\')) != 0U)
         {
-            tr_variantInitDict(node, n);
+            break;
         }
     }
+
+    while (begin != end && IsSafe(static_cast<unsigned char>(*begin)))
+    {
+        ++begin;
+    }
+
+    return begin;
 }
+} // namespace swar_helpers
+
+namespace parse_helpers
+{
+/* arbitrary value... this is much deeper than our code goes */
+auto constexpr MaxDepth = size_t{ 64 };
 
 /* like sscanf(in+2, "%4x", &val) but less slow */
 [[nodiscard]] constexpr bool decode_hex_string(char const* in, std::uint16_t& setme)
@@ -282,143 +273,378 @@ void decode_single_uchar(char const*& in, char const* const in_end, Iter& buf16_
 
         if (!unescaped)
         {
-            buf.push_back(*in);
-            ++in;
+            // copy everything up to the next escape
+            auto const* next = in + 1;
+            if (*in != '\\')
+            {
+                next = static_cast<char const*>(std::memchr(in, '\\', in_end - in));
+                next = next != nullptr ? next : in_end;
+            }
+
+            buf.append(in, next);
+            in = next;
         }
     }
 
     return buf;
 }
 
-[[nodiscard]] std::pair<std::string_view, bool> extract_string(jsonsl_t jsn, struct jsonsl_state_st* state, std::string& buf)
+class JsonParser
 {
-    // figure out where the string is
-    char const* in_begin = jsn->base + state->pos_begin;
-    if (*in_begin == '"')
+public:
+    JsonParser(std::string_view json, int parse_opts, tr_variant_arena* arena)
+        : begin_{ std::data(json) }
+        , end_{ begin_ + std::size(json) }
+        , pos_{ begin_ }
+        , arena_{ arena }
+        , inplace_{ (parse_opts & TR_VARIANT_PARSE_INPLACE) != 0 }
     {
-        in_begin++;
     }
 
-    char const* const in_end = jsn->base + state->pos_cur;
-    size_t const in_len = in_end - in_begin;
-    if (memchr(in_begin, '\\', in_len) == nullptr)
+    bool parse(tr_variant& top, tr_error** error)
     {
-        /* it's not escaped */
-        return std::make_pair(std::string_view{ in_begin, in_len }, true);
+        skip_whitespace();
+
+        if (pos_ == end_)
+        {
+            tr_error_set(error, EINVAL, "No content"sv);
+            return false;
+        }
+
+        if (!parse_value(&top, 0U))
+        {
+            auto const len = std::min(ptrdiff_t{ 16 }, end_ - pos_);
+            tr_error_set(
+                error,
+                EILSEQ,
+                fmt::format(
+                    _("Couldn't parse JSON at position {position} '{text}': {error} ({error_code})"),
+                    fmt::arg("position", pos_ - begin_),
+                    fmt::arg("text", std::string_view{ pos_, static_cast<size_t>(len) }),
+                    fmt::arg("error", err_),
+                    fmt::arg("error_code", EILSEQ)));
+            return false;
+        }
+
+        skip_whitespace();
+        return true;
     }
 
-    return std::make_pair(extract_escaped_string(in_begin, in_len, buf), false);
-}
+    [[nodiscard]] constexpr auto const* pos() const noexcept
+    {
+        return pos_;
+    }
 
-void action_callback_POP(jsonsl_t jsn, jsonsl_action_t /*action*/, struct jsonsl_state_st* state, jsonsl_char_t const* /*buf*/)
-{
-    auto* data = static_cast<struct json_wrapper_data*>(jsn->data);
+private:
+    bool fail(std::string_view err)
+    {
+        err_ = err;
+        return false;
+    }
 
-    if (state->type == JSONSL_T_STRING)
+    void skip_whitespace() noexcept
     {
-        auto const [str, inplace] = extract_string(jsn, state, data->strbuf);
-        if (inplace && ((data->parse_opts & TR_VARIANT_PARSE_INPLACE) != 0))
+        while (pos_ != end_ && (*pos_ == ' ' || *pos_ == '\n' || *pos_ == '\r' || *pos_ == '\t'))
         {
-            tr_variantInitStrView(get_node(jsn), str);
+            ++pos_;
         }
-        else
+    }
+
+    bool consume_literal(std::string_view literal)
+    {
+        if (static_cast<size_t>(end_ - pos_) < std::size(literal) || std::string_view{ pos_, std::size(literal) } != literal)
         {
-            tr_variantInitStr(get_node(jsn), str);
+            return fail("invalid literal"sv);
         }
-        data->has_content = true;
+
+        pos_ += std::size(literal);
+        return true;
     }
-    else if (state->type == JSONSL_T_HKEY)
+
+    // Scan to the end of the string that starts at `pos_`.
+    // @return the string contents, or nullopt if it's unterminated
+    std::optional<std::pair<std::string_view, bool /*has_escapes*/>> scan_string()
     {
-        data->has_content = true;
-        auto const [key, inplace] = extract_string(jsn, state, data->keybuf);
-        data->key = key;
+        TR_ASSERT(*pos_ == '"');
+        auto const* const str_begin = ++pos_;
+        auto has_escapes = false;
+
+        for (;;)
+        {
+            pos_ = swar_helpers::find_quote_or_backslash(pos_, end_);
+
+            if (pos_ == end_)
+            {
+                fail("unterminated string"sv);
+                return {};
+            }
+
+            if (*pos_ == '"')
+            {
+                auto const str = std::string_view{ str_begin, static_cast<size_t>(pos_ - str_begin) };
+                ++pos_;
+                return std::make_pair(str, has_escapes);
+            }
+
+            // skip the escaped character
+            has_escapes = true;
+            pos_ = std::min(pos_ + 2, end_);
+        }
     }
-    else if (state->type == JSONSL_T_LIST || state->type == JSONSL_T_OBJECT)
+
+    bool parse_string(tr_variant* node)
     {
-        auto const depth = std::size(data->stack);
-        auto const* const v = data->stack.back();
-        data->stack.pop_back();
-        if (depth < MaxDepth)
+        auto const scanned = scan_string();
+        if (!scanned)
+        {
+            return false;
+        }
+
+        if (auto const [str, has_escapes] = *scanned; has_escapes)
+        {
+            tr_variantInitStr(node, extract_escaped_string(std::data(str), std::size(str), strbuf_), arena_);
+        }
+        else if (inplace_)
         {
-            data->preallocGuess[depth] = v->val.l.count;
+            tr_variantInitStrView(node, str);
         }
+        else
+        {
+            tr_variantInitStr(node, str, arena_);
+        }
+
+        return true;
     }
-    else if (state->type == JSONSL_T_SPECIAL)
+
+    bool parse_number(tr_variant* node)
     {
-        if ((state->special_flags & JSONSL_SPECIALf_NUMNOINT) != 0)
+        auto const* const num_begin = pos_;
+        auto is_real = false;
+
+        if (*pos_ == '-')
         {
-            auto sv = std::string_view{ jsn->base + state->pos_begin, jsn->pos - state->pos_begin };
-            tr_variantInitReal(get_node(jsn), tr_num_parse<double>(sv).value_or(0.0));
+            ++pos_;
         }
-        else if ((state->special_flags & JSONSL_SPECIALf_NUMERIC) != 0)
+
+        while (pos_ != end_ && ((*pos_ >= '0' && *pos_ <= '9') || *pos_ == '.' || *pos_ == 'e' || *pos_ == 'E' ||
+                                *pos_ == '-' || *pos_ == '+'))
         {
-            char const* begin = jsn->base + state->pos_begin;
-            data->has_content = true;
-            tr_variantInitInt(get_node(jsn), std::strtoll(begin, nullptr, 10));
+            is_real |= *pos_ == '.' || *pos_ == 'e' || *pos_ == 'E';
+            ++pos_;
         }
-        else if ((state->special_flags & JSONSL_SPECIALf_BOOLEAN) != 0)
+
+        auto const sv = std::string_view{ num_begin, static_cast<size_t>(pos_ - num_begin) };
+        auto remainder = std::string_view{};
+
+        if (!is_real)
         {
-            bool const b = (state->special_flags & JSONSL_SPECIALf_TRUE) != 0;
-            data->has_content = true;
-            tr_variantInitBool(get_node(jsn), b);
+            if (auto const val = tr_num_parse<int64_t>(sv, &remainder); val && std::empty(remainder))
+            {
+                tr_variantInitInt(node, *val);
+                return true;
+            }
         }
-        else if ((state->special_flags & JSONSL_SPECIALf_NULL) != 0)
+
+        // reals, and integers too big to fit in an int64_t
+        if (auto const val = tr_num_parse<double>(sv, &remainder); val && std::empty(remainder))
         {
-            data->has_content = true;
-            tr_variantInitQuark(get_node(jsn), TR_KEY_NONE);
+            tr_variantInitReal(node, *val);
+            return true;
         }
+
+        pos_ = num_begin;
+        return fail("invalid number"sv);
     }
-}
 
-} // namespace parse_helpers
-} // namespace
+    bool parse_list(tr_variant* node, size_t depth)
+    {
+        ++pos_; // '['
+        tr_variantInitList(node, prealloc_guess_[depth], arena_);
 
-bool tr_variantParseJson(tr_variant& setme, int parse_opts, std::string_view json, char const** setme_end, tr_error** error)
-{
-    using namespace parse_helpers;
+        skip_whitespace();
+        if (pos_ != end_ && *pos_ == ']')
+        {
+            ++pos_;
+            return true;
+        }
 
-    TR_ASSERT((parse_opts & TR_VARIANT_PARSE_JSON) != 0);
+        for (;;)
+        {
+            if (!parse_value(tr_variantListAdd(node), depth + 1U))
+            {
+                return false;
+            }
+
+            skip_whitespace();
+            if (pos_ == end_)
+            {
+                return fail("unterminated list"sv);
+            }
+
+            if (*pos_ == ']')
+            {
+                ++pos_;
+                prealloc_guess_[depth] = node->val.l.count;
+                return true;
+            }
+
+            if (*pos_ != ',')
+            {
+                return fail("expected ',' or ']'"sv);
+            }
+
+            ++pos_;
+            skip_whitespace();
+        }
+    }
+
+    bool parse_dict(tr_variant* node, size_t depth)
+    {
+        ++pos_; // '{'
+        tr_variantInitDict(node, prealloc_guess_[depth], arena_);
+
+        skip_whitespace();
+        if (pos_ != end_ && *pos_ == '}')
+        {
+            ++pos_;
+            return true;
+        }
+
+        for (;;)
+        {
+            if (pos_ == end_ || *pos_ != '"')
+            {
+                return fail("expected a key"sv);
+            }
+
+            auto const scanned = scan_string();
+            if (!scanned)
+            {
+                return false;
+            }
+
+            auto const [key_str, has_escapes] = *scanned;
+            auto const key = tr_quark_new(
+                has_escapes ? extract_escaped_string(std::data(key_str), std::size(key_str), keybuf_) : key_str);
 
-    auto data = json_wrapper_data{};
+            skip_whitespace();
+            if (pos_ == end_ || *pos_ != ':')
+            {
+                return fail("expected ':'"sv);
+            }
 
-    jsonsl_t jsn = jsonsl_new(MaxDepth);
-    jsn->action_callback_PUSH = action_callback_PUSH;
-    jsn->action_callback_POP = action_callback_POP;
-    jsn->error_callback = error_callback;
-    jsn->data = &data;
-    jsonsl_enable_all_callbacks(jsn);
+            ++pos_;
+            skip_whitespace();
+            if (!parse_value(tr_variantDictAdd(node, key), depth + 1U))
+            {
+                return false;
+            }
 
-    data.error = nullptr;
-    data.size = std::size(json);
-    data.has_content = false;
-    data.key = ""sv;
-    data.parse_opts = parse_opts;
-    data.preallocGuess = {};
-    data.stack = {};
-    data.top = &setme;
+            skip_whitespace();
+            if (pos_ == end_)
+            {
+                return fail("unterminated dict"sv);
+            }
 
-    /* parse it */
-    jsonsl_feed(jsn, static_cast<jsonsl_char_t const*>(std::data(json)), std::size(json));
+            if (*pos_ == '}')
+            {
+                ++pos_;
+                prealloc_guess_[depth] = node->val.l.count;
+                return true;
+            }
 
-    /* EINVAL if there was no content */
-    if (data.error == nullptr && !data.has_content)
+            if (*pos_ != ',')
+            {
+                return fail("expected ',' or '}'"sv);
+            }
+
+            ++pos_;
+            skip_whitespace();
+        }
+    }
+
+    bool parse_value(tr_variant* node, size_t depth)
     {
-        tr_error_set(&data.error, EINVAL, "No content");
+        if (pos_ == end_)
+        {
+            return fail("unexpected end of input"sv);
+        }
+
+        switch (*pos_)
+        {
+        case '{':
+        case '[':
+            if (depth >= MaxDepth)
+            {
+                return fail("too many levels of nesting"sv);
+            }
+            return *pos_ == '{' ? parse_dict(node, depth) : parse_list(node, depth);
+
+        case '"':
+            return parse_string(node);
+
+        case 't':
+            tr_variantInitBool(node, true);
+            return consume_literal("true"sv);
+
+        case 'f':
+            tr_variantInitBool(node, false);
+            return consume_literal("false"sv);
+
+        case 'n':
+            tr_variantInitQuark(node, TR_KEY_NONE);
+            return consume_literal("null"sv);
+
+        default:
+            if (*pos_ == '-' || (*pos_ >= '0' && *pos_ <= '9'))
+            {
+                return parse_number(node);
+            }
+            return fail("unexpected character"sv);
+        }
     }
 
+    char const* const begin_;
+    char const* const end_;
+    char const* pos_;
+    tr_variant_arena* const arena_;
+    std::string_view err_;
+    std::string keybuf_;
+    std::string strbuf_;
+
+    /* A very common pattern is for a container's children to be similar,
+     * e.g. they may all be objects with the same set of keys. So when
+     * a container is finished, remember its size to use as a
+     * preallocation heuristic for the next container at that depth. */
+    std::array<size_t, MaxDepth> prealloc_guess_ = {};
+
+    bool const inplace_;
+};
+
+} // namespace parse_helpers
+} // namespace
+
+bool tr_variantParseJson(
+    tr_variant& setme,
+    int parse_opts,
+    std::string_view json,
+    char const** setme_end,
+    tr_error** error,
+    tr_variant_arena* arena)
+{
+    using namespace parse_helpers;
+
+    TR_ASSERT((parse_opts & TR_VARIANT_PARSE_JSON) != 0);
+
+    auto parser = JsonParser{ json, parse_opts, arena };
+    auto const success = parser.parse(setme, error);
+
     /* maybe set the end ptr */
     if (setme_end != nullptr)
     {
-        *setme_end = std::data(json) + jsn->pos;
+        *setme_end = parser.pos();
     }
 
-    /* cleanup */
-    auto const success = data.error == nullptr;
-    if (data.error != nullptr)
-    {
-        tr_error_propagate(error, &data.error);
-    }
-    jsonsl_destroy(jsn);
     return success;
 }
 
@@ -437,13 +663,14 @@ struct ParentState
 
 struct JsonWalk
 {
-    explicit JsonWalk(bool do_indent)
-        : doIndent{ do_indent }
+    explicit JsonWalk(bool do_indent, tr_variant_sink const* sink = nullptr)
+        : out{ sink }
+        , doIndent{ do_indent }
     {
     }
 
     std::deque<ParentState> parents;
-    libtransmission::StackBuffer<1024U * 8U, std::byte> out;
+    tr_variant_out out;
     bool doIndent;
 };
 
@@ -603,6 +830,19 @@ void jsonStringFunc(tr_variant const* val, void* vdata)
 
     for (; !std::empty(sv); sv.remove_prefix(1))
     {
+        // copy runs of characters that don't need escaping in bulk
+        auto const* const safe_end = swar_helpers::find_escapable(std::data(sv), std::data(sv) + std::size(sv));
+        if (auto const n_safe = static_cast<size_t>(safe_end - std::data(sv)); n_safe != 0U)
+        {
+            walk = std::copy_n(std::data(sv), n_safe, walk);
+            sv.remove_prefix(n_safe);
+
+            if (std::empty(sv))
+            {
+                break;
+            }
+        }
+
         switch (sv.front())
         {
         case '\b':
@@ -724,9 +964,156 @@ struct VariantWalkFuncs const walk_funcs = {
     jsonContainerEndFunc, //
 };
 
+// Writes lean JSON, splitting big lists into shards that are serialized
+// in parallel. Output is identical to walking with `walk_funcs`.
+//
+// Only dicts in the top few levels are descended into when looking for
+// lists to shard; everything else goes through the non-recursive
+// tr_variantWalk(), so malicious nesting can't smash the stack (#667).
+class ShardedJsonWriter
+{
+public:
+    explicit ShardedJsonWriter(size_t n_threads)
+        : n_threads_{ std::max(n_threads, size_t{ 1U }) }
+    {
+    }
+
+    void write(tr_variant const* v, JsonWalk& data) const
+    {
+        write(v, 0U, data);
+    }
+
+private:
+    static auto constexpr MaxDictDepth = size_t{ 4U };
+    static auto constexpr MinChildrenPerShard = size_t{ 512U };
+
+    void write(tr_variant const* v, size_t depth, JsonWalk& data) const
+    {
+        if (tr_variantIsList(v) && shard_count(v) > 1U)
+        {
+            write_sharded_list(v, data);
+        }
+        else if (tr_variantIsDict(v) && depth < MaxDictDepth)
+        {
+            write_dict(v, depth, data);
+        }
+        else
+        {
+            tr_variantWalk(v, &walk_funcs, &data, true);
+        }
+    }
+
+    void write_dict(tr_variant const* v, size_t depth, JsonWalk& data) const
+    {
+        auto const n = v->val.l.count;
+        auto const* const children = v->val.l.vals;
+
+        // same order as tr_variantWalk()'s sort_dicts
+        auto sorted = std::vector<size_t>(n);
+        std::iota(std::begin(sorted), std::end(sorted), size_t{ 0U });
+        std::sort(
+            std::begin(sorted),
+            std::end(sorted),
+            [children](size_t a, size_t b)
+            { return tr_quark_get_string_view(children[a].key) < tr_quark_get_string_view(children[b].key); });
+
+        data.out.push_back('{');
+        for (size_t i = 0; i < n; ++i)
+        {
+            if (i != 0U)
+            {
+                data.out.push_back(',');
+            }
+
+            auto const& child = children[sorted[i]];
+            auto key = tr_variant{};
+            tr_variantInitQuark(&key, child.key);
+            jsonStringFunc(&key, &data);
+            data.out.push_back(':');
+            write(&child, depth + 1U, data);
+        }
+        data.out.push_back('}');
+    }
+
+    void write_sharded_list(tr_variant const* v, JsonWalk& data) const
+    {
+        auto const n = tr_variantListSize(v);
+        auto const n_shards = shard_count(v);
+
+        auto shards = std::vector<std::unique_ptr<JsonWalk>>{};
+        shards.reserve(n_shards);
+        for (size_t i = 0; i < n_shards; ++i)
+        {
+            shards.emplace_back(std::make_unique<JsonWalk>(false));
+        }
+
+        auto const write_shard = [v, n, n_shards](size_t shard, JsonWalk& walk)
+        {
+            auto const begin = n * shard / n_shards;
+            auto const end = n * (shard + 1U) / n_shards;
+            for (auto i = begin; i < end; ++i)
+            {
+                if (i != begin)
+                {
+                    walk.out.push_back(',');
+                }
+
+                tr_variantWalk(v->val.l.vals + i, &walk_funcs, &walk, true);
+            }
+        };
+
+        auto threads = std::vector<std::thread>{};
+        threads.reserve(n_shards - 1U);
+        for (size_t shard = 1U; shard < n_shards; ++shard)
+        {
+            threads.emplace_back(write_shard, shard, std::ref(*shards[shard]));
+        }
+        write_shard(0U, *shards.front());
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+
+        data.out.push_back('[');
+        for (size_t shard = 0; shard < n_shards; ++shard)
+        {
+            if (shard != 0U)
+            {
+                data.out.push_back(',');
+            }
+
+            data.out.add(shards[shard]->out.to_string_view());
+        }
+        data.out.push_back(']');
+    }
+
+    [[nodiscard]] size_t shard_count(tr_variant const* list) const
+    {
+        return std::clamp(tr_variantListSize(list) / MinChildrenPerShard, size_t{ 1U }, n_threads_);
+    }
+
+    size_t const n_threads_;
+};
+
 } // namespace to_string_helpers
 } // namespace
 
+std::string tr_variantToStrJsonSharded(tr_variant const* top, size_t n_threads)
+{
+    using namespace to_string_helpers;
+
+    auto data = JsonWalk{ false };
+
+    ShardedJsonWriter{ n_threads }.write(top, data);
+
+    auto& buf = data.out;
+    if (!std::empty(buf))
+    {
+        buf.push_back('\n');
+    }
+    return buf.to_string();
+}
+
 std::string tr_variantToStrJson(tr_variant const* top, bool lean)
 {
     using namespace to_string_helpers;
@@ -742,3 +1129,19 @@ std::string tr_variantToStrJson(tr_variant const* top, bool lean)
     }
     return buf.to_string();
 }
+
+bool tr_variantToSinkJson(tr_variant const* top, bool lean, tr_variant_sink const& sink)
+{
+    using namespace to_string_helpers;
+
+    auto data = JsonWalk{ !lean, &sink };
+
+    tr_variantWalk(top, &walk_funcs, &data, true);
+
+    auto& buf = data.out;
+    if (!std::empty(buf))
+    {
+        buf.push_back('\n');
+    }
+    return buf.flush();
+}
@@ -4,6 +4,9 @@
 // License text can be found in the licenses/ folder.
 
 #include <algorithm> // std::sort
+#include <cstddef> // std::byte
+#include <cstdint> // uint32_t, uint64_t
+#include <memory> // std::align, std::uninitialized_value_construct_n
 #include <string>
 #include <string_view>
 #include <vector>
@@ -12,6 +15,8 @@
 #include <share.h>
 #endif
 
+#include <event2/buffer.h>
+
 #include <fmt/core.h>
 
 #include <small/vector.hpp>
@@ -37,17 +42,93 @@ constexpr bool tr_variantIsContainer(tr_variant const* v)
 
 // ---
 
+[[nodiscard]] constexpr tr_variant_arena* containerArena(tr_variant const* v)
+{
+    return tr_variantIsContainer(v) ? v->val.l.arena : nullptr;
+}
+
+// ---
+
+// Dicts with room for at least this many children get a key index, so
+// that finding a key in a big dict, e.g. settings or a resume file,
+// doesn't need to look at every child. Smaller ones are searched linearly.
+auto constexpr DictIndexMinAlloc = size_t{ 32U };
+
+[[nodiscard]] constexpr size_t dictIndexMask(tr_variant const* dict) noexcept
+{
+    // `alloc` is always a power of two
+    return dict->val.l.alloc * size_t{ 2U } - 1U;
+}
+
+[[nodiscard]] constexpr size_t dictIndexHome(tr_quark key, size_t mask) noexcept
+{
+    // Fibonacci hashing spreads out runs of sequential quarks
+    return static_cast<size_t>((uint64_t{ key } * 0x9E3779B97F4A7C15ULL) >> 32U) & mask;
+}
+
+void dictIndexInsert(tr_variant* dict, size_t pos)
+{
+    auto* const index = dict->val.l.index;
+    auto const mask = dictIndexMask(dict);
+    auto const key = dict->val.l.vals[pos].key;
+
+    for (auto slot = dictIndexHome(key, mask);; slot = (slot + 1U) & mask)
+    {
+        if (index[slot] == 0U)
+        {
+            index[slot] = static_cast<uint32_t>(pos + 1U);
+            return;
+        }
+
+        // on duplicate keys, the first one wins, as in a linear search
+        if (dict->val.l.vals[index[slot] - 1U].key == key)
+        {
+            return;
+        }
+    }
+}
+
+void dictIndexRebuild(tr_variant* dict)
+{
+    if (dict->val.l.index == nullptr)
+    {
+        return;
+    }
+
+    std::fill_n(dict->val.l.index, dictIndexMask(dict) + 1U, uint32_t{});
+    for (size_t i = 0; i < dict->val.l.count; ++i)
+    {
+        dictIndexInsert(dict, i);
+    }
+}
+
 constexpr int dictIndexOf(tr_variant const* dict, tr_quark key)
 {
-    if (tr_variantIsDict(dict))
+    if (!tr_variantIsDict(dict))
+    {
+        return -1;
+    }
+
+    if (auto const* const index = dict->val.l.index; index != nullptr)
     {
-        for (size_t i = 0; i < dict->val.l.count; ++i)
+        auto const mask = dictIndexMask(dict);
+        for (auto slot = dictIndexHome(key, mask); index[slot] != 0U; slot = (slot + 1U) & mask)
         {
-            if (dict->val.l.vals[i].key == key)
+            if (auto const i = index[slot] - 1U; dict->val.l.vals[i].key == key)
             {
-                return (int)i;
+                return static_cast<int>(i);
             }
         }
+
+        return -1;
+    }
+
+    for (size_t i = 0; i < dict->val.l.count; ++i)
+    {
+        if (dict->val.l.vals[i].key == key)
+        {
+            return (int)i;
+        }
     }
 
     return -1;
@@ -73,11 +154,25 @@ tr_variant* containerReserve(tr_variant* v, size_t count)
             n *= 2U;
         }
 
-        auto* vals = new tr_variant[n];
+        auto* const arena = v->val.l.arena;
+        auto* vals = arena != nullptr ? arena->new_variants(n) : new tr_variant[n];
         std::copy_n(v->val.l.vals, v->val.l.count, vals);
-        delete[] v->val.l.vals;
+        if (arena == nullptr)
+        {
+            delete[] v->val.l.vals;
+        }
         v->val.l.vals = vals;
-        v->val.l.alloc = n;
+        v->val.l.alloc = static_cast<uint32_t>(n);
+
+        if (tr_variantIsDict(v) && n >= DictIndexMinAlloc)
+        {
+            if (arena == nullptr)
+            {
+                delete[] v->val.l.index;
+            }
+            v->val.l.index = arena != nullptr ? arena->new_index(n * 2U) : new uint32_t[n * 2U]{};
+            dictIndexRebuild(v);
+        }
     }
 
     return v->val.l.vals + v->val.l.count;
@@ -111,6 +206,57 @@ tr_variant* dictFindOrAdd(tr_variant* dict, tr_quark key, int type)
 
 } // namespace
 
+// ---
+
+void* tr_variant_arena::allocate(size_t n_bytes, size_t alignment)
+{
+    // big allocations get a block of their own
+    // so that they don't waste the rest of the current one
+    if (n_bytes + alignment > BlockSize)
+    {
+        bytes_used_ += n_bytes;
+        return blocks_.emplace_back(new std::byte[n_bytes]).get();
+    }
+
+    void* ptr = pos_;
+    auto space = n_left_;
+    if (ptr == nullptr || std::align(alignment, n_bytes, ptr, space) == nullptr)
+    {
+        ptr = pos_ = blocks_.emplace_back(new std::byte[BlockSize]).get();
+        space = n_left_ = BlockSize;
+    }
+
+    pos_ = static_cast<std::byte*>(ptr) + n_bytes;
+    n_left_ = space - n_bytes;
+    bytes_used_ += n_bytes;
+    return ptr;
+}
+
+tr_variant* tr_variant_arena::new_variants(size_t n)
+{
+    auto* const vals = static_cast<tr_variant*>(allocate(sizeof(tr_variant) * n, alignof(tr_variant)));
+    std::uninitialized_value_construct_n(vals, n);
+    return vals;
+}
+
+uint32_t* tr_variant_arena::new_index(size_t n)
+{
+    auto* const index = static_cast<uint32_t*>(allocate(sizeof(uint32_t) * n, alignof(uint32_t)));
+    std::fill_n(index, n, uint32_t{});
+    return index;
+}
+
+std::string_view tr_variant_arena::copy(std::string_view str)
+{
+    auto const len = std::size(str);
+    auto* const buf = static_cast<char*>(allocate(len + 1U, alignof(char)));
+    std::copy_n(std::data(str), len, buf);
+    buf[len] = '\0';
+    return { buf, len };
+}
+
+// ---
+
 tr_variant* tr_variantDictFind(tr_variant* dict, tr_quark key)
 {
     auto const i = dictIndexOf(dict, key);
@@ -337,15 +483,24 @@ void tr_variantInitQuark(tr_variant* initme, tr_quark value)
     initme->val.s.set_shallow(tr_quark_get_string_view(value));
 }
 
-void tr_variantInitStr(tr_variant* initme, std::string_view value)
+void tr_variantInitStr(tr_variant* initme, std::string_view value, tr_variant_arena* arena)
 {
     tr_variantInit(initme, TR_VARIANT_TYPE_STR);
-    initme->val.s.set(value);
+
+    if (arena != nullptr)
+    {
+        initme->val.s.set_shallow(arena->copy(value));
+    }
+    else
+    {
+        initme->val.s.set(value);
+    }
 }
 
-void tr_variantInitList(tr_variant* initme, size_t reserve_count)
+void tr_variantInitList(tr_variant* initme, size_t reserve_count, tr_variant_arena* arena)
 {
     tr_variantInit(initme, TR_VARIANT_TYPE_LIST);
+    initme->val.l.arena = arena;
     tr_variantListReserve(initme, reserve_count);
 }
 
@@ -356,9 +511,10 @@ void tr_variantListReserve(tr_variant* list, size_t count)
     containerReserve(list, count);
 }
 
-void tr_variantInitDict(tr_variant* initme, size_t reserve_count)
+void tr_variantInitDict(tr_variant* initme, size_t reserve_count, tr_variant_arena* arena)
 {
     tr_variantInit(initme, TR_VARIANT_TYPE_DICT);
+    initme->val.l.arena = arena;
     tr_variantDictReserve(initme, reserve_count);
 }
 
@@ -405,7 +561,7 @@ tr_variant* tr_variantListAddBool(tr_variant* list, bool value)
 tr_variant* tr_variantListAddStr(tr_variant* list, std::string_view value)
 {
     tr_variant* child = tr_variantListAdd(list);
-    tr_variantInitStr(child, value);
+    tr_variantInitStr(child, value, containerArena(list));
     return child;
 }
 
@@ -426,21 +582,21 @@ tr_variant* tr_variantListAddQuark(tr_variant* list, tr_quark value)
 tr_variant* tr_variantListAddRaw(tr_variant* list, void const* value, size_t value_len)
 {
     tr_variant* child = tr_variantListAdd(list);
-    tr_variantInitRaw(child, value, value_len);
+    tr_variantInitStr(child, { static_cast<char const*>(value), value_len }, containerArena(list));
     return child;
 }
 
 tr_variant* tr_variantListAddList(tr_variant* list, size_t reserve_count)
 {
     tr_variant* child = tr_variantListAdd(list);
-    tr_variantInitList(child, reserve_count);
+    tr_variantInitList(child, reserve_count, containerArena(list));
     return child;
 }
 
 tr_variant* tr_variantListAddDict(tr_variant* list, size_t reserve_count)
 {
     tr_variant* child = tr_variantListAdd(list);
-    tr_variantInitDict(child, reserve_count);
+    tr_variantInitDict(child, reserve_count, containerArena(list));
     return child;
 }
 
@@ -453,6 +609,11 @@ tr_variant* tr_variantDictAdd(tr_variant* dict, tr_quark key)
     val->key = key;
     tr_variantInit(val, TR_VARIANT_TYPE_INT);
 
+    if (dict->val.l.index != nullptr)
+    {
+        dictIndexInsert(dict, dict->val.l.count - 1U);
+    }
+
     return val;
 }
 
@@ -487,7 +648,7 @@ tr_variant* tr_variantDictAddQuark(tr_variant* dict, tr_quark key, tr_quark cons
 tr_variant* tr_variantDictAddStr(tr_variant* dict, tr_quark key, std::string_view val)
 {
     tr_variant* child = dictFindOrAdd(dict, key, TR_VARIANT_TYPE_STR);
-    tr_variantInitStr(child, val);
+    tr_variantInitStr(child, val, containerArena(dict));
     return child;
 }
 
@@ -501,21 +662,21 @@ tr_variant* tr_variantDictAddStrView(tr_variant* dict, tr_quark key, std::string
 tr_variant* tr_variantDictAddRaw(tr_variant* dict, tr_quark key, void const* value, size_t len)
 {
     tr_variant* child = dictFindOrAdd(dict, key, TR_VARIANT_TYPE_STR);
-    tr_variantInitRaw(child, value, len);
+    tr_variantInitStr(child, { static_cast<char const*>(value), len }, containerArena(dict));
     return child;
 }
 
 tr_variant* tr_variantDictAddList(tr_variant* dict, tr_quark key, size_t reserve_count)
 {
     tr_variant* child = tr_variantDictAdd(dict, key);
-    tr_variantInitList(child, reserve_count);
+    tr_variantInitList(child, reserve_count, containerArena(dict));
     return child;
 }
 
 tr_variant* tr_variantDictAddDict(tr_variant* dict, tr_quark key, size_t reserve_count)
 {
     tr_variant* child = tr_variantDictAdd(dict, key);
-    tr_variantInitDict(child, reserve_count);
+    tr_variantInitDict(child, reserve_count, containerArena(dict));
     return child;
 }
 
@@ -544,6 +705,7 @@ bool tr_variantDictRemove(tr_variant* dict, tr_quark key)
         }
 
         --dict->val.l.count;
+        dictIndexRebuild(dict);
 
         removed = true;
     }
@@ -802,7 +964,12 @@ void freeStringFunc(tr_variant const* v, void* /*user_data*/)
 
 void freeContainerEndFunc(tr_variant const* v, void* /*user_data*/)
 {
-    delete[] v->val.l.vals;
+    // arena memory is freed all at once when the arena is destroyed
+    if (v->val.l.arena == nullptr)
+    {
+        delete[] v->val.l.vals;
+        delete[] v->val.l.index;
+    }
 }
 
 VariantWalkFuncs constexpr FreeWalkFuncs = {
@@ -1007,13 +1174,39 @@ std::string tr_variantToStr(tr_variant const* v, tr_variant_fmt fmt)
     }
 }
 
+bool tr_variantToSink(tr_variant const* v, tr_variant_fmt fmt, tr_variant_sink const& sink)
+{
+    switch (fmt)
+    {
+    case TR_VARIANT_FMT_JSON:
+        return tr_variantToSinkJson(v, false, sink);
+
+    case TR_VARIANT_FMT_JSON_LEAN:
+        return tr_variantToSinkJson(v, true, sink);
+
+    default: // TR_VARIANT_FMT_BENC:
+        return tr_variantToSinkBenc(v, sink);
+    }
+}
+
+void tr_variantToBuf(tr_variant const* v, tr_variant_fmt fmt, struct evbuffer* buf)
+{
+    tr_variantToSink(
+        v,
+        fmt,
+        [buf](std::string_view chunk) { return evbuffer_add(buf, std::data(chunk), std::size(chunk)) == 0; });
+}
+
 int tr_variantToFile(tr_variant const* v, tr_variant_fmt fmt, std::string_view filename)
 {
     auto error_code = int{ 0 };
-    auto const contents = tr_variantToStr(v, fmt);
 
+    // stream it to the file instead of building it in memory first
     tr_error* error = nullptr;
-    tr_file_save(filename, contents, &error);
+    tr_file_save_chunked(
+        filename,
+        [v, fmt](auto const& write) { return tr_variantToSink(v, fmt, write); },
+        &error);
     if (error != nullptr)
     {
         tr_logAddError(fmt::format(
@@ -1030,15 +1223,22 @@ int tr_variantToFile(tr_variant const* v, tr_variant_fmt fmt, std::string_view f
 
 // ---
 
-bool tr_variantFromBuf(tr_variant* setme, int opts, std::string_view buf, char const** setme_end, tr_error** error)
+bool tr_variantFromBuf(
+    tr_variant* setme,
+    int opts,
+    std::string_view buf,
+    char const** setme_end,
+    tr_error** error,
+    tr_variant_arena* arena)
 {
     // supported formats: benc, json
     TR_ASSERT((opts & (TR_VARIANT_PARSE_BENC | TR_VARIANT_PARSE_JSON)) != 0);
 
     *setme = {};
 
-    auto const success = ((opts & TR_VARIANT_PARSE_BENC) != 0) ? tr_variantParseBenc(*setme, opts, buf, setme_end, error) :
-                                                                 tr_variantParseJson(*setme, opts, buf, setme_end, error);
+    auto const success = ((opts & TR_VARIANT_PARSE_BENC) != 0) ?
+        tr_variantParseBenc(*setme, opts, buf, setme_end, error, arena) :
+        tr_variantParseJson(*setme, opts, buf, setme_end, error, arena);
 
     if (!success)
     {
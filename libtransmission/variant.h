@@ -7,14 +7,19 @@
 
 #include <algorithm>
 #include <cstddef> // size_t
-#include <cstdint> // int64_t
+#include <cstdint> // int64_t, uint32_t
+#include <functional>
+#include <memory>
 #include <optional>
 #include <string>
 #include <string_view>
+#include <vector>
 
 #include "libtransmission/quark.h"
 
+struct evbuffer;
 struct tr_error;
+class tr_variant_arena;
 
 /**
  * @addtogroup tr_variant Variant
@@ -130,9 +135,15 @@ public:
 
         struct
         {
-            size_t alloc;
-            size_t count;
+            uint32_t alloc;
+            uint32_t count;
             struct tr_variant* vals;
+            tr_variant_arena* arena;
+
+            // Dicts with room for many children also keep a hash index of
+            // their keys, with twice as many slots as `alloc`. Each slot holds
+            // a child's position in `vals` plus one, or zero if it's unused.
+            uint32_t* index;
         } l;
     } val = {};
 };
@@ -147,6 +158,58 @@ public:
  */
 void tr_variantClear(tr_variant* clearme);
 
+// --- Arenas
+
+/**
+ * @brief A monotonic allocator for short-lived `tr_variant` trees.
+ *
+ * Containers initialized with an arena keep their children in it, as do
+ * the lists, dicts, and strings added to them with `tr_variantListAdd*()`
+ * and `tr_variantDictAdd*()`. That memory is never freed piecemeal: it's
+ * all released at once when the arena is destroyed, so the arena must
+ * outlive every variant that uses it.
+ *
+ * Useful for trees that are built, used, and thrown away together,
+ * e.g. an RPC request and its response.
+ */
+class tr_variant_arena
+{
+public:
+    tr_variant_arena() = default;
+    ~tr_variant_arena() = default;
+
+    // not movable, since variants hold pointers to their arena
+    tr_variant_arena(tr_variant_arena const&) = delete;
+    tr_variant_arena(tr_variant_arena&&) = delete;
+    tr_variant_arena& operator=(tr_variant_arena const&) = delete;
+    tr_variant_arena& operator=(tr_variant_arena&&) = delete;
+
+    // @return `n` value-initialized variants
+    [[nodiscard]] tr_variant* new_variants(size_t n);
+
+    // @return `n` zeroed slots for a dict's key index
+    [[nodiscard]] uint32_t* new_index(size_t n);
+
+    // @return a zero-terminated copy of `str`
+    [[nodiscard]] std::string_view copy(std::string_view str);
+
+    // @return how many bytes have been handed out
+    [[nodiscard]] constexpr auto bytes_used() const noexcept
+    {
+        return bytes_used_;
+    }
+
+private:
+    static auto constexpr BlockSize = size_t{ 32U * 1024U };
+
+    [[nodiscard]] void* allocate(size_t n_bytes, size_t alignment);
+
+    std::vector<std::unique_ptr<std::byte[]>> blocks_;
+    std::byte* pos_ = nullptr;
+    size_t n_left_ = 0U;
+    size_t bytes_used_ = 0U;
+};
+
 // --- Serialization / Deserialization
 
 enum tr_variant_fmt
@@ -160,6 +223,27 @@ int tr_variantToFile(tr_variant const* variant, tr_variant_fmt fmt, std::string_
 
 [[nodiscard]] std::string tr_variantToStr(tr_variant const* variant, tr_variant_fmt fmt);
 
+// Receives serialized output a few KiB at a time.
+// @return false to discard the rest of the output, e.g. on a write error
+using tr_variant_sink = std::function<bool(std::string_view chunk)>;
+
+/**
+ * @brief Same output as `tr_variantToStr()`, but handed to `sink` as it's
+ * built, so that the memory used doesn't grow with the size of the output.
+ * @return false if `sink` returned false
+ */
+bool tr_variantToSink(tr_variant const* variant, tr_variant_fmt fmt, tr_variant_sink const& sink);
+
+/** @brief Same as `tr_variantToSink()`, appending to `buf` */
+void tr_variantToBuf(tr_variant const* variant, tr_variant_fmt fmt, struct evbuffer* buf);
+
+/**
+ * @brief Same output as `tr_variantToStr(variant, TR_VARIANT_FMT_JSON_LEAN)`,
+ * but large lists are split into shards that are serialized on up to
+ * `n_threads` threads. Useful for big RPC responses, e.g. `torrent-get`.
+ */
+[[nodiscard]] std::string tr_variantToStrJsonSharded(tr_variant const* variant, size_t n_threads);
+
 enum tr_variant_parse_opts
 {
     TR_VARIANT_PARSE_BENC = (1 << 0),
@@ -173,12 +257,19 @@ bool tr_variantFromFile(
     std::string_view filename,
     struct tr_error** error = nullptr);
 
+/**
+ * @brief Parse `buf` into `setme`.
+ *
+ * If `arena` is not null, the parsed tree's containers and strings are
+ * allocated from it. See `tr_variant_arena`.
+ */
 bool tr_variantFromBuf(
     tr_variant* setme,
     int variant_parse_opts,
     std::string_view buf,
     char const** setme_end = nullptr,
-    tr_error** error = nullptr);
+    tr_error** error = nullptr,
+    tr_variant_arena* arena = nullptr);
 
 template<typename T>
 bool tr_variantFromBuf(
@@ -186,14 +277,16 @@ bool tr_variantFromBuf(
     int variant_parse_opts,
     T const& buf,
     char const** setme_end = nullptr,
-    tr_error** error = nullptr)
+    tr_error** error = nullptr,
+    tr_variant_arena* arena = nullptr)
 {
     return tr_variantFromBuf(
         setme,
         variant_parse_opts,
         std::string_view{ std::data(buf), static_cast<size_t>(std::size(buf)) },
         setme_end,
-        error);
+        error,
+        arena);
 }
 
 [[nodiscard]] constexpr bool tr_variantIsType(tr_variant const* b, int type)
@@ -215,7 +308,8 @@ bool tr_variantFromBuf(
 
 bool tr_variantGetStrView(tr_variant const* variant, std::string_view* setme);
 
-void tr_variantInitStr(tr_variant* initme, std::string_view value);
+// If `arena` is not null, long strings are copied into it instead of onto the heap
+void tr_variantInitStr(tr_variant* initme, std::string_view value, tr_variant_arena* arena = nullptr);
 void tr_variantInitQuark(tr_variant* initme, tr_quark value);
 void tr_variantInitRaw(tr_variant* initme, void const* value, size_t value_len);
 void tr_variantInitStrView(tr_variant* initme, std::string_view val);
@@ -281,7 +375,7 @@ constexpr void tr_variantInitInt(tr_variant* initme, int64_t value)
     return v != nullptr && v->type == TR_VARIANT_TYPE_LIST;
 }
 
-void tr_variantInitList(tr_variant* initme, size_t reserve_count);
+void tr_variantInitList(tr_variant* initme, size_t reserve_count, tr_variant_arena* arena = nullptr);
 void tr_variantListReserve(tr_variant* list, size_t reserve_count);
 
 tr_variant* tr_variantListAdd(tr_variant* list);
@@ -310,7 +404,7 @@ bool tr_variantListRemove(tr_variant* list, size_t pos);
     return v != nullptr && v->type == TR_VARIANT_TYPE_DICT;
 }
 
-void tr_variantInitDict(tr_variant* initme, size_t reserve_count);
+void tr_variantInitDict(tr_variant* initme, size_t reserve_count, tr_variant_arena* arena = nullptr);
 void tr_variantDictReserve(tr_variant* dict, size_t reserve_count);
 bool tr_variantDictRemove(tr_variant* dict, tr_quark key);
 
@@ -0,0 +1,197 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <cstddef> // size_t
+#include <cstdint> // int64_t
+#include <ctime> // time_t
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include "libtransmission/transmission.h"
+
+#include "libtransmission/bitfield.h"
+#include "libtransmission/log.h"
+#include "libtransmission/quark.h"
+#include "libtransmission/torrent-files.h"
+#include "libtransmission/torrent.h"
+#include "libtransmission/utils.h" // _(), tr_strv_ends_with()
+#include "libtransmission/variant.h"
+#include "libtransmission/verify-manifest.h"
+
+tr_verify_manifest tr_verify_manifest::from_torrent(tr_torrent const* tor)
+{
+    auto manifest = tr_verify_manifest{};
+    manifest.info_hash_string = tor->info_hash_string();
+
+    if (!tor->has_metainfo())
+    {
+        return manifest;
+    }
+
+    for (tr_file_index_t i = 0, n = tor->file_count(); i < n; ++i)
+    {
+        if (tor->file_is_padding(i) || tor->file_size(i) == 0U)
+        {
+            continue;
+        }
+
+        auto const [begin, end] = tor->pieces_in_file(i);
+        auto is_verified = true;
+        for (auto piece = begin; is_verified && piece < end; ++piece)
+        {
+            is_verified = tor->has_piece(piece) && tor->is_piece_checked(piece);
+        }
+        if (!is_verified)
+        {
+            continue;
+        }
+
+        auto const found = tor->find_file(i);
+        if (!found || found->size != tor->file_size(i) ||
+            tr_strv_ends_with(found->filename(), tr_torrent_files::PartialFileSuffix))
+        {
+            continue;
+        }
+
+        manifest.files.push_back({ tor->file_subpath(i), found->size, found->last_modified_at });
+    }
+
+    return manifest;
+}
+
+std::optional<tr_verify_manifest> tr_verify_manifest::from_variant(tr_variant* var)
+{
+    if (var == nullptr || !tr_variantIsDict(var))
+    {
+        return {};
+    }
+
+    auto manifest = tr_verify_manifest{};
+
+    if (auto sv = std::string_view{}; tr_variantDictFindStrView(var, TR_KEY_hashString, &sv))
+    {
+        manifest.info_hash_string = sv;
+    }
+
+    tr_variant* files = nullptr;
+    if (!tr_variantDictFindList(var, TR_KEY_files, &files))
+    {
+        return {};
+    }
+
+    for (size_t i = 0, n = tr_variantListSize(files); i < n; ++i)
+    {
+        auto* const file = tr_variantListChild(files, i);
+        auto subpath = std::string_view{};
+        auto size = int64_t{};
+        auto mtime = int64_t{};
+        if (!tr_variantDictFindStrView(file, TR_KEY_name, &subpath) || !tr_variantDictFindInt(file, TR_KEY_length, &size) ||
+            !tr_variantDictFindInt(file, TR_KEY_mtime, &mtime) || size < 0 || mtime <= 0)
+        {
+            return {};
+        }
+
+        manifest.files.push_back({ std::string{ subpath }, static_cast<uint64_t>(size), static_cast<time_t>(mtime) });
+    }
+
+    return manifest;
+}
+
+void tr_verify_manifest::to_variant(tr_variant* initme) const
+{
+    tr_variantInitDict(initme, 2U);
+    tr_variantDictAddStr(initme, TR_KEY_hashString, info_hash_string);
+
+    auto* const list = tr_variantDictAddList(initme, TR_KEY_files, std::size(files));
+    for (auto const& [subpath, size, mtime] : files)
+    {
+        auto* const dict = tr_variantListAddDict(list, 3U);
+        tr_variantDictAddStr(dict, TR_KEY_name, subpath);
+        tr_variantDictAddInt(dict, TR_KEY_length, size);
+        tr_variantDictAddInt(dict, TR_KEY_mtime, mtime);
+    }
+}
+
+tr_piece_index_t tr_verify_manifest::apply(tr_torrent* tor) const
+{
+    if (!tor->has_metainfo())
+    {
+        return {};
+    }
+
+    if (!std::empty(info_hash_string) && info_hash_string != tor->info_hash_string().sv())
+    {
+        tr_logAddWarnTor(tor, _("Ignoring a verify manifest that is for another torrent"));
+        return {};
+    }
+
+    auto by_subpath = std::unordered_map<std::string_view, File const*>{};
+    by_subpath.reserve(std::size(files));
+    for (auto const& file : files)
+    {
+        by_subpath.try_emplace(file.subpath, &file);
+    }
+
+    // A piece can be trusted if every file that it touches matches the manifest.
+    // Start by trusting all of them, then rule out the pieces of files that don't.
+    auto const n_files = tor->file_count();
+    auto checked = tr_bitfield{ tor->piece_count() };
+    checked.set_has_all();
+    auto mtimes = std::vector<time_t>(n_files);
+    for (tr_file_index_t i = 0; i < n_files; ++i)
+    {
+        if (tor->file_is_padding(i))
+        {
+            continue;
+        }
+
+        auto const found = tor->find_file(i);
+        if (tor->file_size(i) == 0U)
+        {
+            mtimes[i] = found ? found->last_modified_at : 0;
+            continue;
+        }
+
+        auto const iter = by_subpath.find(tor->file_subpath(i));
+        auto const matches = iter != std::end(by_subpath) && found && iter->second->size == tor->file_size(i) &&
+            found->size == iter->second->size && found->last_modified_at == iter->second->mtime &&
+            !tr_strv_ends_with(found->filename(), tr_torrent_files::PartialFileSuffix);
+
+        if (matches)
+        {
+            mtimes[i] = found->last_modified_at;
+        }
+        else
+        {
+            auto const [begin, end] = tor->pieces_in_file(i);
+            checked.unset_span(begin, end);
+        }
+    }
+
+    tor->init_checked_pieces(checked, std::data(mtimes));
+
+    auto n_trusted = tr_piece_index_t{};
+    for (tr_piece_index_t piece = 0, n = tor->piece_count(); piece < n; ++piece)
+    {
+        if (tor->is_piece_checked(piece))
+        {
+            tor->set_has_piece(piece, true);
+            ++n_trusted;
+        }
+    }
+
+    tr_logAddInfoTor(
+        tor,
+        fmt::format(
+            _("Trusting {count} of {total} pieces from a verify manifest"),
+            fmt::arg("count", n_trusted),
+            fmt::arg("total", tor->piece_count())));
+    return n_trusted;
+}
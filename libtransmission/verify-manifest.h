@@ -0,0 +1,56 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <cstdint> // uint64_t
+#include <ctime> // time_t
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "libtransmission/transmission.h" // tr_piece_index_t
+
+struct tr_torrent;
+struct tr_variant;
+
+// A list of a torrent's files that were verified complete, with the sizes
+// and mtimes that they had when they were. A session that's given a copy
+// of the same files, e.g. one that was provisioned with rsync, can trust
+// them instead of hashing them again.
+//
+// The manifest is trusted as-is, so it should only come from a source
+// that's already allowed to control the session, e.g. an RPC client.
+struct tr_verify_manifest
+{
+    struct File
+    {
+        std::string subpath;
+        uint64_t size = 0;
+        time_t mtime = 0;
+    };
+
+    // @return a manifest of `tor`'s files that are complete and verified
+    [[nodiscard]] static tr_verify_manifest from_torrent(tr_torrent const* tor);
+
+    // @return the manifest in `var`, or an empty optional if it's malformed
+    [[nodiscard]] static std::optional<tr_verify_manifest> from_variant(tr_variant* var);
+
+    void to_variant(tr_variant* initme) const;
+
+    // Mark the pieces of `tor` whose files all match the manifest
+    // as complete and checked.
+    // @return the number of pieces that were trusted
+    tr_piece_index_t apply(tr_torrent* tor) const;
+
+    // the torrent's info hash; if set, the manifest is only applied to that torrent
+    std::string info_hash_string;
+
+    std::vector<File> files;
+};
@@ -4,10 +4,12 @@
 // License text can be found in the licenses/ folder.
 
 #include <algorithm>
+#include <array>
 #include <ctime>
+#include <memory>
 #include <mutex>
 #include <optional>
-#include <thread>
+#include <utility>
 #include <vector>
 
 #include <fmt/core.h>
@@ -16,21 +18,251 @@
 
 #include "libtransmission/completion.h"
 #include "libtransmission/crypto-utils.h"
+#include "libtransmission/executor.h"
 #include "libtransmission/file.h"
+#include "libtransmission/io-scheduler.h"
 #include "libtransmission/log.h"
+#include "libtransmission/metrics.h"
+#include "libtransmission/session.h"
+#include "libtransmission/storage.h"
 #include "libtransmission/torrent.h"
 #include "libtransmission/tr-assert.h"
+#include "libtransmission/tracing.h"
 #include "libtransmission/utils.h" // tr_time()
 #include "libtransmission/verify.h"
 
-using namespace std::chrono_literals;
-
 namespace
 {
 
-auto constexpr SleepPerSecondDuringVerify = 100ms;
+// How far ahead of the hashing to keep reads in flight.
+// While one buffer is being hashed, the OS is already reading the
+// next part of the file so that the disk and the CPU are both busy.
+auto constexpr ReadAheadBytes = uint64_t{ 1024U * 1024U * 4U };
 
-}
+// How many pieces a runner checks before giving its executor thread
+// back, so that other background work doesn't wait behind a long verify.
+auto constexpr PiecesPerRun = tr_piece_index_t{ 16U };
+
+} // namespace
+
+// Reads pieces from disk and checks them against the metainfo's checksums.
+// Each runner has its own PieceChecker, so no locking is needed.
+// Every read waits for its turn in the I/O scheduler, so that verifying
+// yields to uploads and cache flushes on the same disk.
+class tr_verify_worker::PieceChecker
+{
+public:
+    explicit PieceChecker(tr_io_scheduler& io_scheduler)
+        : io_scheduler_{ io_scheduler }
+    {
+    }
+
+    PieceChecker(PieceChecker const&) = delete;
+    PieceChecker(PieceChecker&&) = delete;
+    PieceChecker& operator=(PieceChecker const&) = delete;
+    PieceChecker& operator=(PieceChecker&&) = delete;
+
+    ~PieceChecker()
+    {
+        close();
+    }
+
+    [[nodiscard]] bool check(tr_torrent* tor, tr_piece_index_t piece)
+    {
+        TR_TRACE_SCOPE("verify", "check_piece");
+        auto const timer = tr_torrent_usage::Timer{ tor->usage(), tr_torrent_usage::HashUsec };
+
+        auto const n_files = tor->file_count();
+        auto [file_index, file_pos] = tor->file_offset(tor->piece_loc(piece));
+        auto left_in_piece = uint64_t{ tor->piece_size(piece) };
+        auto const storage = tor->storage();
+
+        if (device_torrent_ != tor)
+        {
+            device_torrent_ = tor;
+            device_ = tr_io_scheduler::device_of(tor->current_dir().sv());
+        }
+
+        sha_.clear();
+
+        while (left_in_piece > 0U && file_index < n_files)
+        {
+            auto const left_in_file = tor->file_size(file_index) - file_pos;
+            auto const bytes_this_file = std::min(left_in_file, left_in_piece);
+
+            if (bytes_this_file == 0U)
+            {
+                // nothing to read
+            }
+            else if (tor->file_is_padding(file_index))
+            {
+                add_zeroes(bytes_this_file);
+            }
+            else if (!(storage ? read(*storage, tor, file_index, file_pos, bytes_this_file) :
+                                 read(tor, file_index, file_pos, bytes_this_file, tor->file_size(file_index))))
+            {
+                return false;
+            }
+
+            left_in_piece -= bytes_this_file;
+            ++file_index;
+            file_pos = 0U;
+        }
+
+        return left_in_piece == 0U && sha_.finish() == tor->piece_hash(piece);
+    }
+
+    void close()
+    {
+        if (fd_ != TR_BAD_SYS_FILE)
+        {
+            tr_sys_file_close(fd_);
+            fd_ = TR_BAD_SYS_FILE;
+        }
+
+        fd_torrent_ = nullptr;
+        device_torrent_ = nullptr;
+        read_ahead_end_ = 0U;
+    }
+
+private:
+    [[nodiscard]] bool read(
+        tr_torrent* tor,
+        tr_file_index_t file_index,
+        uint64_t file_pos,
+        uint64_t n_bytes,
+        uint64_t file_size)
+    {
+        auto const fd = open(tor, file_index);
+        if (fd == TR_BAD_SYS_FILE)
+        {
+            return false;
+        }
+
+        while (n_bytes > 0U)
+        {
+            auto const bytes_this_pass = std::min(n_bytes, uint64_t{ std::size(buffer_) });
+            read_ahead(fd, file_pos + bytes_this_pass, file_size);
+
+            auto ticket = io_scheduler_.acquire(device_, tr_io_scheduler::Class::Verify, bytes_this_pass);
+            auto num_read = uint64_t{};
+            if (!tr_sys_file_read_at(fd, std::data(buffer_), bytes_this_pass, file_pos, &num_read) || num_read == 0U)
+            {
+                return false;
+            }
+            ticket.reset();
+            tor->usage().add_io(tr_torrent_usage::DiskReads, tr_torrent_usage::DiskReadBytes, num_read);
+
+            sha_.add(std::data(buffer_), num_read);
+            tr_sys_file_advise(fd, file_pos, num_read, TR_SYS_FILE_ADVICE_DONT_NEED);
+            file_pos += num_read;
+            n_bytes -= num_read;
+        }
+
+        return true;
+    }
+
+    [[nodiscard]] bool read(
+        tr_storage& storage,
+        tr_torrent* tor,
+        tr_file_index_t file_index,
+        uint64_t file_pos,
+        uint64_t n_bytes)
+    {
+        storage.prefetch(tor, file_index, file_pos, n_bytes);
+
+        auto* const buf = reinterpret_cast<uint8_t*>(std::data(buffer_));
+        while (n_bytes > 0U)
+        {
+            auto const bytes_this_pass = std::min(n_bytes, uint64_t{ std::size(buffer_) });
+            auto ticket = io_scheduler_.acquire(device_, tr_io_scheduler::Class::Verify, bytes_this_pass);
+            if (!storage.read_at(tor, file_index, file_pos, buf, bytes_this_pass, nullptr))
+            {
+                return false;
+            }
+            ticket.reset();
+            tor->usage().add_io(tr_torrent_usage::DiskReads, tr_torrent_usage::DiskReadBytes, bytes_this_pass);
+
+            sha_.add(buf, bytes_this_pass);
+            file_pos += bytes_this_pass;
+            n_bytes -= bytes_this_pass;
+        }
+
+        return true;
+    }
+
+    // padding files aren't on disk, but they're hashed as zeroes
+    void add_zeroes(uint64_t n_bytes)
+    {
+        static auto constexpr Zeroes = std::array<uint8_t, 4096U>{};
+
+        while (n_bytes > 0U)
+        {
+            auto const bytes_this_pass = std::min(n_bytes, uint64_t{ std::size(Zeroes) });
+            sha_.add(std::data(Zeroes), bytes_this_pass);
+            n_bytes -= bytes_this_pass;
+        }
+    }
+
+    // Ask the OS to start reading [pos, pos + ReadAheadBytes) in the background.
+    // The window is topped up when half of it has been consumed so that we don't
+    // make a syscall for every buffer.
+    void read_ahead(tr_sys_file_t fd, uint64_t pos, uint64_t file_size)
+    {
+        auto begin = read_ahead_end_;
+
+        if (begin < pos || begin > pos + ReadAheadBytes)
+        {
+            // we jumped to another part of the file, so restart the window
+            begin = pos;
+        }
+        else if (begin >= pos + ReadAheadBytes / 2U)
+        {
+            // there's still enough in flight
+            return;
+        }
+
+        auto const end = std::min(pos + ReadAheadBytes, file_size);
+        if (begin < end)
+        {
+            tr_sys_file_advise(fd, begin, end - begin, TR_SYS_FILE_ADVICE_WILL_NEED);
+        }
+
+        read_ahead_end_ = std::max(begin, end);
+    }
+
+    [[nodiscard]] tr_sys_file_t open(tr_torrent const* tor, tr_file_index_t file_index)
+    {
+        if (fd_torrent_ == tor && fd_file_index_ == file_index)
+        {
+            return fd_;
+        }
+
+        close();
+
+        auto const found = tor->find_file(file_index);
+        fd_ = !found ? TR_BAD_SYS_FILE : tr_sys_file_open(found->filename(), TR_SYS_FILE_READ | TR_SYS_FILE_SEQUENTIAL, 0);
+        fd_torrent_ = tor;
+        fd_file_index_ = file_index;
+        return fd_;
+    }
+
+    tr_io_scheduler& io_scheduler_;
+
+    std::vector<std::byte> buffer_ = std::vector<std::byte>(1024 * 256);
+    tr_sha1_context sha_;
+
+    // the device that `device_torrent_`'s data is on
+    tr_torrent const* device_torrent_ = nullptr;
+    tr_io_scheduler::DeviceId device_ = {};
+
+    tr_torrent const* fd_torrent_ = nullptr;
+    tr_file_index_t fd_file_index_ = 0;
+    tr_sys_file_t fd_ = TR_BAD_SYS_FILE;
+
+    // the end of the file range that `read_ahead()` has asked for so far
+    uint64_t read_ahead_end_ = 0U;
+};
 
 int tr_verify_worker::Node::compare(tr_verify_worker::Node const& that) const
 {
@@ -52,167 +284,261 @@ int tr_verify_worker::Node::compare(tr_verify_worker::Node const& that) const
     return tr_compare_3way(torrent->id(), that.torrent->id());
 }
 
-bool tr_verify_worker::verify_torrent(tr_torrent* tor, std::atomic<bool> const& stop_flag)
+tr_verify_worker::Task::Task(Node const& node_in)
+    : node{ node_in }
+    , begin{ tr_time() }
+    , n_pieces{ node_in.torrent->piece_count() }
+    , next_piece{ std::min(node_in.first_piece, n_pieces) }
+    , next_report{ next_piece }
+    , verdicts(n_pieces)
+{
+}
+
+tr_verify_worker::tr_verify_worker(tr_executor& executor, tr_io_scheduler& io_scheduler, size_t max_threads)
+    : executor_{ executor }
+    , io_scheduler_{ io_scheduler }
+    , max_threads_{ std::max(max_threads, size_t{ 1U }) }
+{
+}
+
+// Pick the task that the calling worker thread should hash a piece from.
+// Torrents that are already being verified are finished before new ones
+// are started, so the `todo_` priority ordering is preserved.
+tr_verify_worker::Task* tr_verify_worker::next_task(std::unique_lock<std::mutex>& lock)
 {
-    auto const begin = tr_time();
-
-    tr_sys_file_t fd = TR_BAD_SYS_FILE;
-    uint64_t file_pos = 0;
-    bool changed = false;
-    bool had_piece = false;
-    time_t last_slept_at = 0;
-    uint32_t piece_pos = 0;
-    tr_file_index_t file_index = 0;
-    tr_file_index_t prev_file_index = ~file_index;
-    tr_piece_index_t piece = 0;
-    auto buffer = std::vector<std::byte>(1024 * 256);
-    auto sha = tr_sha1::create();
-
-    tr_logAddDebugTor(tor, "verifying torrent...");
-
-    while (!stop_flag && piece < tor->piece_count())
+    for (;;)
     {
-        auto const file_length = tor->file_size(file_index);
+        if (auto const it = std::find_if(
+                std::begin(active_),
+                std::end(active_),
+                [](auto const& task) { return task.is_finished(); });
+            it != std::end(active_))
+        {
+            finish_task(*it, lock);
+            continue;
+        }
 
-        /* if we're starting a new piece... */
-        if (piece_pos == 0)
+        if (auto const it = std::find_if(
+                std::begin(active_),
+                std::end(active_),
+                [](auto const& task) { return task.has_unclaimed_pieces(); });
+            it != std::end(active_))
         {
-            had_piece = tor->has_piece(piece);
+            return &*it;
         }
 
-        /* if we're starting a new file... */
-        if (file_pos == 0 && fd == TR_BAD_SYS_FILE && file_index != prev_file_index)
+        if (stopping_ || std::empty(todo_))
         {
-            auto const found = tor->find_file(file_index);
-            fd = !found ? TR_BAD_SYS_FILE : tr_sys_file_open(found->filename(), TR_SYS_FILE_READ | TR_SYS_FILE_SEQUENTIAL, 0);
-            prev_file_index = file_index;
+            return nullptr;
         }
 
-        /* figure out how much we can read this pass */
-        uint64_t left_in_piece = tor->piece_size(piece) - piece_pos;
-        uint64_t left_in_file = file_length - file_pos;
-        uint64_t bytes_this_pass = std::min(left_in_file, left_in_piece);
-        bytes_this_pass = std::min(bytes_this_pass, uint64_t(std::size(buffer)));
+        auto const it = std::begin(todo_);
+        auto& task = active_.emplace_back(*it);
+        todo_.erase(it);
+
+        auto* const tor = task.node.torrent;
+        tr_logAddTraceTor(tor, "Verifying torrent");
+        tr_logAddDebugTor(tor, "verifying torrent...");
+        tor->set_verify_state(TR_VERIFY_NOW, task.node.background_pieces != nullptr);
+    }
+}
+
+void tr_verify_worker::report_verdicts(Task& task)
+{
+    auto* const tor = task.node.torrent;
+    auto const* const background_pieces = task.node.background_pieces.get();
+    auto background_verdicts = std::vector<std::pair<tr_piece_index_t, bool>>{};
+
+    while (task.next_report < task.next_piece && task.verdicts[task.next_report])
+    {
+        auto const piece = task.next_report;
 
-        /* read a bit */
-        if (fd != TR_BAD_SYS_FILE)
+        if (background_pieces != nullptr)
         {
-            auto num_read = uint64_t{};
-            if (tr_sys_file_read_at(fd, std::data(buffer), bytes_this_pass, file_pos, &num_read) && num_read > 0)
+            // the torrent is running, so its state is only
+            // changed in the session thread
+            if (background_pieces->test(piece))
             {
-                bytes_this_pass = num_read;
-                sha->add(std::data(buffer), bytes_this_pass);
-                tr_sys_file_advise(fd, file_pos, bytes_this_pass, TR_SYS_FILE_ADVICE_DONT_NEED);
+                background_verdicts.emplace_back(piece, *task.verdicts[piece]);
             }
         }
-
-        /* move our offsets */
-        left_in_piece -= bytes_this_pass;
-        left_in_file -= bytes_this_pass;
-        piece_pos += bytes_this_pass;
-        file_pos += bytes_this_pass;
-
-        /* if we're finishing a piece... */
-        if (left_in_piece == 0)
+        else
         {
-            if (auto const has_piece = sha->finish() == tor->piece_hash(piece); has_piece || had_piece)
+            auto const had_piece = tor->has_piece(piece);
+
+            if (auto const has_piece = *task.verdicts[piece]; has_piece || had_piece)
             {
                 tor->set_has_piece(piece, has_piece);
-                changed |= has_piece != had_piece;
+                task.changed |= has_piece != had_piece;
             }
 
             tor->checked_pieces_.set(piece, true);
             tor->mark_changed();
+        }
 
-            /* sleeping even just a few msec per second goes a long
-             * way towards reducing IO load... */
-            if (auto const now = tr_time(); last_slept_at != now)
-            {
-                last_slept_at = now;
-                std::this_thread::sleep_for(SleepPerSecondDuringVerify);
-            }
+        ++task.next_report;
+        tor->set_verify_progress(task.next_report / float(task.n_pieces));
 
-            sha->clear();
-            ++piece;
-            tor->set_verify_progress(piece / float(tor->piece_count()));
-            piece_pos = 0;
+        // the checkpoint is saved with the torrent's next .resume file
+        if (auto& checkpoint = tor->verify_checkpoint_; checkpoint && background_pieces == nullptr)
+        {
+            checkpoint->piece = task.next_report;
+            tor->set_dirty();
         }
+    }
 
-        /* if we're finishing a file... */
-        if (left_in_file == 0)
-        {
-            if (fd != TR_BAD_SYS_FILE)
+    if (!std::empty(background_verdicts))
+    {
+        auto* const session = tor->session;
+        session->runInSessionThread(
+            [session, tor_id = tor->id(), verdicts = std::move(background_verdicts)]()
             {
-                tr_sys_file_close(fd);
-                fd = TR_BAD_SYS_FILE;
-            }
+                // the torrent may have been removed while we were hashing
+                if (auto* const found = session->torrents().get(tor_id); found != nullptr)
+                {
+                    found->on_background_verdicts(verdicts);
+                }
+            });
+    }
+}
 
-            ++file_index;
-            file_pos = 0;
-        }
+void tr_verify_worker::finish_task(Task& task, std::unique_lock<std::mutex>& lock)
+{
+    TR_ASSERT(task.is_finished());
+
+    auto* const tor = task.node.torrent;
+    auto const aborted = task.stop;
+    task.done = true;
+
+    tor->set_verify_state(TR_VERIFY_NONE);
+    TR_ASSERT(tr_isTorrent(tor));
+
+    if (!aborted && task.changed)
+    {
+        tor->set_dirty();
     }
 
-    /* cleanup */
-    if (fd != TR_BAD_SYS_FILE)
+    if (!aborted && task.node.background_pieces == nullptr)
     {
-        tr_sys_file_close(fd);
+        tor->verify_checkpoint_.reset();
+        tor->set_dirty();
     }
 
     /* stopwatch */
-    time_t const end = tr_time();
+    auto const end = tr_time();
     tr_logAddDebugTor(
         tor,
         fmt::format(
             "Verification is done. It took {} seconds to verify {} bytes ({} bytes per second)",
-            end - begin,
+            end - task.begin,
             tor->total_size(),
-            tor->total_size() / (1 + (end - begin))));
+            tor->total_size() / (1 + (end - task.begin))));
 
-    return changed;
+    lock.unlock();
+    call_callback(tor, aborted);
+    lock.lock();
+
+    active_.remove_if([&task](auto const& walk) { return &walk == &task; });
+    cv_.notify_all();
 }
 
-void tr_verify_worker::verify_thread_func()
+void tr_verify_worker::run(std::shared_ptr<PieceChecker> checker)
 {
-    for (;;)
+    auto lock = std::unique_lock(verify_mutex_);
+
+    for (tr_piece_index_t n_checked = 0U;; ++n_checked)
     {
+        // retire this runner if `max_threads_` has been lowered
+        if (n_runners_ > max_threads_)
         {
-            auto const lock = std::lock_guard(verify_mutex_);
+            break;
+        }
 
-            if (stop_current_)
-            {
-                stop_current_ = false;
-                stop_current_cv_.notify_one();
-            }
+        auto* const task = next_task(lock);
+        if (task == nullptr)
+        {
+            break;
+        }
 
-            if (std::empty(todo_))
-            {
-                current_node_.reset();
-                verify_thread_id_.reset();
-                return;
-            }
+        // give the executor thread back, and pick up where we left off
+        // once any higher-priority background work has had its turn
+        if (n_checked == PiecesPerRun)
+        {
+            executor_.submit(
+                [this, checker = std::move(checker)]() mutable { run(std::move(checker)); },
+                tr_executor::Priority::Low);
+            return;
+        }
+
+        auto* const tor = task->node.torrent;
+        auto const piece = task->next_piece++;
 
-            auto const it = std::begin(todo_);
-            current_node_ = *it;
-            todo_.erase(it);
+        if (auto const& pieces = task->node.background_pieces; pieces && !pieces->test(piece))
+        {
+            // a piece we don't have is downloaded as usual,
+            // and one that was checked before is trusted
+            task->verdicts[piece] = false;
+            report_verdicts(*task);
+            continue;
         }
 
-        auto* const tor = current_node_->torrent;
-        tr_logAddTraceTor(tor, "Verifying torrent");
-        tor->set_verify_state(TR_VERIFY_NOW);
-        auto const changed = verify_torrent(tor, stop_current_);
-        tor->set_verify_state(TR_VERIFY_NONE);
-        TR_ASSERT(tr_isTorrent(tor));
+        if (!task->node.background_pieces && task->node.quick && tor->is_piece_checked(piece))
+        {
+            // trust pieces that were checked since their files last changed
+            task->verdicts[piece] = tor->has_piece(piece);
+            report_verdicts(*task);
+            continue;
+        }
+
+        ++task->n_in_flight;
+
+        lock.unlock();
+        auto const has_piece = checker->check(tor, piece);
+        auto& metrics = tr_metrics::instance();
+        metrics.verify_pieces.add();
+        metrics.verify_bytes.add(tor->piece_size(piece));
+        lock.lock();
 
-        if (!stop_current_ && changed)
+        task->verdicts[piece] = has_piece;
+        report_verdicts(*task);
+
+        if (!task->has_unclaimed_pieces())
         {
-            tor->set_dirty();
+            // don't keep the torrent's files open after we're done with them
+            checker->close();
         }
 
-        call_callback(tor, stop_current_);
+        --task->n_in_flight;
+    }
+
+    checker->close();
+    --n_runners_;
+    cv_.notify_all();
+}
+
+void tr_verify_worker::start_runners()
+{
+    if (std::empty(todo_) && std::empty(active_))
+    {
+        return;
+    }
+
+    while (n_runners_ < max_threads_)
+    {
+        ++n_runners_;
+        executor_.submit([this]() { run(std::make_shared<PieceChecker>(io_scheduler_)); }, tr_executor::Priority::Low);
     }
 }
 
-void tr_verify_worker::add(tr_torrent* tor)
+bool tr_verify_worker::is_active(tr_torrent const* tor) const
+{
+    return std::any_of(
+        std::begin(active_),
+        std::end(active_),
+        [tor](auto const& task) { return task.node.torrent == tor; });
+}
+
+void tr_verify_worker::add(tr_torrent* tor, bool quick, bool background, tr_piece_index_t first_piece)
 {
     TR_ASSERT(tr_isTorrent(tor));
     tr_logAddTraceTor(tor, "Queued for verification");
@@ -220,17 +546,31 @@ void tr_verify_worker::add(tr_torrent* tor)
     auto node = Node{};
     node.torrent = tor;
     node.current_size = tor->has_total();
+    node.first_piece = background ? 0U : first_piece;
+    node.quick = quick;
 
-    auto const lock = std::lock_guard(verify_mutex_);
-    tor->set_verify_state(TR_VERIFY_WAIT);
-    todo_.insert(node);
-
-    if (!verify_thread_id_)
+    if (background)
+    {
+        // snapshot the pieces to check, since the running torrent's
+        // own bitfields change while the worker threads read them
+        auto pieces = std::make_shared<tr_bitfield>(tor->piece_count());
+        for (tr_piece_index_t piece = 0, n = tor->piece_count(); piece < n; ++piece)
+        {
+            pieces->set(piece, tor->has_piece(piece) && !(quick && tor->is_piece_checked(piece)));
+        }
+        node.background_pieces = std::move(pieces);
+        tor->verify_checkpoint_.reset();
+    }
+    else
     {
-        auto thread = std::thread(&tr_verify_worker::verify_thread_func, this);
-        verify_thread_id_ = thread.get_id();
-        thread.detach();
+        tor->verify_checkpoint_ = tr_torrent::VerifyCheckpoint{ node.first_piece, quick, false };
+        tor->set_dirty();
     }
+
+    auto const lock = std::lock_guard(verify_mutex_);
+    tor->set_verify_state(TR_VERIFY_WAIT, background);
+    todo_.insert(node);
+    start_runners();
 }
 
 void tr_verify_worker::remove(tr_torrent* tor)
@@ -239,10 +579,17 @@ void tr_verify_worker::remove(tr_torrent* tor)
 
     auto lock = std::unique_lock(verify_mutex_);
 
-    if (current_node_ && current_node_->torrent == tor)
+    if (is_active(tor))
     {
-        stop_current_ = true;
-        stop_current_cv_.wait(lock, [this]() { return !stop_current_; });
+        for (auto& task : active_)
+        {
+            if (task.node.torrent == tor)
+            {
+                task.stop = true;
+            }
+        }
+
+        cv_.wait(lock, [this, tor]() { return !is_active(tor); });
     }
     else
     {
@@ -261,16 +608,24 @@ void tr_verify_worker::remove(tr_torrent* tor)
     }
 }
 
+void tr_verify_worker::set_max_threads(size_t max_threads)
+{
+    auto const lock = std::lock_guard(verify_mutex_);
+    max_threads_ = std::max(max_threads, size_t{ 1U });
+    start_runners();
+}
+
 tr_verify_worker::~tr_verify_worker()
 {
-    {
-        auto const lock = std::lock_guard(verify_mutex_);
-        stop_current_ = true;
-        todo_.clear();
-    }
+    auto lock = std::unique_lock(verify_mutex_);
+
+    stopping_ = true;
+    todo_.clear();
 
-    while (verify_thread_id_.has_value())
+    for (auto& task : active_)
     {
-        std::this_thread::sleep_for(20ms);
+        task.stop = true;
     }
+
+    cv_.wait(lock, [this]() { return n_runners_ == 0U; });
 }
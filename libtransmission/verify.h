@@ -9,16 +9,24 @@
 #error only libtransmission should #include this header.
 #endif
 
-#include <atomic>
 #include <condition_variable>
+#include <cstddef> // for size_t
 #include <cstdint>
+#include <ctime> // for time_t
 #include <functional>
 #include <list>
+#include <memory>
 #include <mutex>
 #include <optional>
 #include <set>
-#include <thread>
+#include <vector>
 
+#include "libtransmission/transmission.h" // for tr_piece_index_t
+
+#include "libtransmission/bitfield.h"
+
+class tr_executor;
+class tr_io_scheduler;
 struct tr_session;
 struct tr_torrent;
 
@@ -27,22 +35,53 @@ class tr_verify_worker
 public:
     using callback_func = std::function<void(tr_torrent*, bool aborted)>;
 
+    static auto constexpr DefaultMaxThreads = size_t{ 1U };
+
+    tr_verify_worker(tr_executor& executor, tr_io_scheduler& io_scheduler, size_t max_threads = DefaultMaxThreads);
+
     ~tr_verify_worker();
 
+    tr_verify_worker(tr_verify_worker const&) = delete;
+    tr_verify_worker(tr_verify_worker&&) = delete;
+    tr_verify_worker& operator=(tr_verify_worker const&) = delete;
+    tr_verify_worker& operator=(tr_verify_worker&&) = delete;
+
     void add_callback(callback_func callback)
     {
         callbacks_.emplace_back(std::move(callback));
     }
 
-    void add(tr_torrent* tor);
+    // If `quick` is true, pieces that are already checked aren't hashed again.
+    // If `background` is true, the torrent keeps running: only the pieces that
+    // it has are checked, and the verdicts are applied in the session thread.
+    // Otherwise, the torrent's verify_checkpoint_ follows the verify so that
+    // it can be resumed later from `first_piece`.
+    void add(tr_torrent* tor, bool quick = false, bool background = false, tr_piece_index_t first_piece = 0U);
 
     void remove(tr_torrent* tor);
 
+    // Set how many of the executor's threads may hash pieces at the same time.
+    // The threads are shared between all the torrents being verified.
+    void set_max_threads(size_t max_threads);
+
+    [[nodiscard]] size_t max_threads() const
+    {
+        auto const lock = std::lock_guard(verify_mutex_);
+        return max_threads_;
+    }
+
 private:
+    class PieceChecker;
+
     struct Node
     {
         tr_torrent* torrent = nullptr;
         uint64_t current_size = 0;
+        tr_piece_index_t first_piece = 0;
+        bool quick = false;
+
+        // for a background verify, the pieces to check
+        std::shared_ptr<tr_bitfield const> background_pieces;
 
         [[nodiscard]] int compare(Node const& that) const;
 
@@ -52,6 +91,43 @@ private:
         }
     };
 
+    // A torrent that's being verified. Its pieces are handed out to
+    // the worker threads in order, and the verdicts are reported to
+    // the torrent's completion state in order as they come back.
+    struct Task
+    {
+        explicit Task(Node const& node_in);
+
+        [[nodiscard]] constexpr bool has_unclaimed_pieces() const noexcept
+        {
+            return !stop && next_piece < n_pieces;
+        }
+
+        [[nodiscard]] constexpr bool is_finished() const noexcept
+        {
+            return !done && !has_unclaimed_pieces() && n_in_flight == 0U;
+        }
+
+        Node node;
+        time_t begin = 0;
+        tr_piece_index_t n_pieces = 0;
+
+        // the next piece to be handed out to a worker thread
+        tr_piece_index_t next_piece = 0;
+
+        // the next piece to be reported to the torrent
+        tr_piece_index_t next_report = 0;
+
+        // verdicts that have come back from the worker threads,
+        // but that are waiting for `next_report` to catch up
+        std::vector<std::optional<bool>> verdicts;
+
+        size_t n_in_flight = 0;
+        bool changed = false;
+        bool stop = false;
+        bool done = false;
+    };
+
     void call_callback(tr_torrent* tor, bool aborted) const
     {
         for (auto const& callback : callbacks_)
@@ -60,17 +136,30 @@ private:
         }
     }
 
-    void verify_thread_func();
-    [[nodiscard]] static bool verify_torrent(tr_torrent* tor, std::atomic<bool> const& stop_flag);
+    void run(std::shared_ptr<PieceChecker> checker);
+    void start_runners();
+
+    [[nodiscard]] Task* next_task(std::unique_lock<std::mutex>& lock);
+    void finish_task(Task& task, std::unique_lock<std::mutex>& lock);
+    static void report_verdicts(Task& task);
+
+    [[nodiscard]] bool is_active(tr_torrent const* tor) const;
+
+    tr_executor& executor_;
+    tr_io_scheduler& io_scheduler_;
 
     std::list<callback_func> callbacks_;
-    std::mutex verify_mutex_;
+    mutable std::mutex verify_mutex_;
 
     std::set<Node> todo_;
-    std::optional<Node> current_node_;
+    std::list<Task> active_;
+
+    size_t max_threads_ = DefaultMaxThreads;
 
-    std::optional<std::thread::id> verify_thread_id_;
+    // how many tasks are running or queued in `executor_`
+    size_t n_runners_ = 0;
+    bool stopping_ = false;
 
-    std::atomic<bool> stop_current_ = false;
-    std::condition_variable stop_current_cv_;
+    // notified when a task is finished or when a runner exits
+    std::condition_variable cv_;
 };
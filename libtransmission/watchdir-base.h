@@ -12,6 +12,7 @@
 #include <algorithm>
 #include <chrono>
 #include <cstddef> // for size_t
+#include <ctime> // for time_t
 #include <map>
 #include <memory>
 #include <optional>
@@ -32,7 +33,7 @@ public:
     BaseWatchdir(std::string_view dirname, Callback callback, TimerMaker& timer_maker)
         : dirname_{ dirname }
         , callback_{ std::move(callback) }
-        , retry_timer_{ timer_maker.create() }
+        , retry_timer_{ timer_maker.create(tr_source_location::current()) }
     {
         retry_timer_->set_callback([this]() { onRetryTimer(); });
     }
@@ -47,6 +48,8 @@ public:
         return dirname_;
     }
 
+    void finish(std::string_view basename, Action action) override;
+
     [[nodiscard]] constexpr auto timeoutDuration() const noexcept
     {
         return timeout_duration_;
@@ -76,6 +79,10 @@ protected:
     void scan();
     void processFile(std::string_view basename);
 
+    // Like scan(), but skips listing the directory if its mtime shows
+    // that no files have been added or removed since the last listing.
+    void scanIfChanged();
+
 private:
     using Timestamp = std::chrono::time_point<std::chrono::steady_clock>;
 
@@ -87,6 +94,8 @@ private:
         Timestamp next_kick_at = {};
     };
 
+    void handleAction(std::string_view basename, Action action);
+
     void setNextKickTime(Pending& item)
     {
         item.next_kick_at = item.last_kick_at + retry_duration_;
@@ -146,6 +155,9 @@ private:
 
     std::map<std::string, Pending, std::less<>> pending_;
     std::set<std::string, std::less<>> handled_;
+    std::set<std::string, std::less<>> in_progress_;
+    std::optional<time_t> listed_mtime_;
+    time_t listed_at_ = {};
     std::chrono::milliseconds retry_duration_ = std::chrono::seconds{ 5 };
     std::chrono::seconds timeout_duration_ = std::chrono::seconds{ 15 };
 };
@@ -27,9 +27,9 @@ public:
         libtransmission::TimerMaker& timer_maker,
         std::chrono::milliseconds rescan_interval)
         : BaseWatchdir{ dirname, std::move(callback), timer_maker }
-        , rescan_timer_{ timer_maker.create() }
+        , rescan_timer_{ timer_maker.create(tr_source_location::current()) }
     {
-        rescan_timer_->set_callback([this]() { scan(); });
+        rescan_timer_->set_callback([this]() { scanIfChanged(); });
         rescan_timer_->start_repeating(rescan_interval);
         scan();
     }
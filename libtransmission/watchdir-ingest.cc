@@ -0,0 +1,197 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <iterator> // std::back_inserter
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include "libtransmission/error.h"
+#include "libtransmission/file.h"
+#include "libtransmission/log.h"
+#include "libtransmission/timer.h"
+#include "libtransmission/torrent.h" // tr_ctorSetMetainfo()
+#include "libtransmission/tr-strbuf.h"
+#include "libtransmission/utils.h"
+#include "libtransmission/watchdir-ingest.h"
+
+using namespace std::literals;
+
+namespace libtransmission
+{
+
+WatchdirIngest::WatchdirIngest(
+    TimerMaker& timer_maker,
+    AddFunc add_func,
+    FinishFunc finish_func,
+    size_t max_threads,
+    size_t max_parsed)
+    : add_func_{ std::move(add_func) }
+    , finish_func_{ std::move(finish_func) }
+    , max_threads_{ std::max(max_threads, size_t{ 1U }) }
+    , max_parsed_{ std::max(max_parsed, size_t{ 1U }) }
+    , batch_timer_{ timer_maker.create([this]() { on_batch_timer(); }) }
+{
+}
+
+WatchdirIngest::~WatchdirIngest()
+{
+    {
+        auto const lock = std::lock_guard(mutex_);
+        stopping_ = true;
+    }
+
+    cv_.notify_all();
+
+    for (auto& thread : threads_)
+    {
+        thread.join();
+    }
+}
+
+Watchdir::Action WatchdirIngest::enqueue(std::string_view dirname, std::string_view basename)
+{
+    auto const lowercase = tr_strlower(basename);
+    auto const is_torrent = tr_strv_ends_with(lowercase, ".torrent"sv);
+    auto const is_magnet = tr_strv_ends_with(lowercase, ".magnet"sv);
+    if (!is_torrent && !is_magnet)
+    {
+        return Watchdir::Action::Done;
+    }
+
+    {
+        auto const lock = std::lock_guard(mutex_);
+        auto& item = todo_.emplace_back();
+        item.dirname = dirname;
+        item.basename = basename;
+        item.is_magnet = is_magnet;
+        maybe_start_thread();
+    }
+
+    cv_.notify_one();
+
+    if (!batch_timer_running_)
+    {
+        batch_timer_running_ = true;
+        batch_timer_->start_repeating(BatchInterval);
+    }
+
+    return Watchdir::Action::Pending;
+}
+
+void WatchdirIngest::Item::move_to(tr_ctor* ctor)
+{
+    auto const filename = tr_pathbuf{ dirname, '/', basename };
+    tr_ctorSetMetainfo(ctor, std::move(metainfo), std::move(contents), is_magnet ? ""sv : filename.sv());
+}
+
+size_t WatchdirIngest::size() const
+{
+    auto const lock = std::lock_guard(mutex_);
+    return std::size(todo_) + n_parsing_ + std::size(parsed_);
+}
+
+void WatchdirIngest::parse(Parsed& parsed)
+{
+    auto& item = parsed.item;
+    auto const filename = tr_pathbuf{ item.dirname, '/', item.basename };
+
+    if (!item.is_magnet)
+    {
+        parsed.ok = item.metainfo.parse_torrent_file(filename, &item.contents);
+        return;
+    }
+
+    auto content = std::vector<char>{};
+    tr_error* error = nullptr;
+    if (!tr_file_read(filename, content, &error))
+    {
+        tr_logAddWarn(fmt::format(
+            _("Couldn't read '{path}': {error} ({error_code})"),
+            fmt::arg("path", item.basename),
+            fmt::arg("error", error->message),
+            fmt::arg("error_code", error->code)));
+        tr_error_free(error);
+        return;
+    }
+
+    parsed.ok = item.metainfo.parseMagnet(tr_strv_strip({ std::data(content), std::size(content) }));
+}
+
+void WatchdirIngest::maybe_start_thread()
+{
+    // start threads lazily, up to `max_threads_`, while there's more work than threads
+    if (!stopping_ && std::size(threads_) < max_threads_ && std::size(threads_) < std::size(todo_) + n_parsing_)
+    {
+        threads_.emplace_back(&WatchdirIngest::thread_func, this);
+    }
+}
+
+void WatchdirIngest::thread_func()
+{
+    auto lock = std::unique_lock(mutex_);
+
+    for (;;)
+    {
+        // backpressure: don't parse more than the Watchdir's thread can keep up with
+        cv_.wait(
+            lock,
+            [this]() { return stopping_ || (!std::empty(todo_) && std::size(parsed_) + n_parsing_ < max_parsed_); });
+        if (stopping_)
+        {
+            return;
+        }
+
+        auto parsed = Parsed{ std::move(todo_.front()) };
+        todo_.pop_front();
+        ++n_parsing_;
+        lock.unlock();
+
+        parse(parsed);
+
+        lock.lock();
+        --n_parsing_;
+        parsed_.emplace_back(std::move(parsed));
+    }
+}
+
+void WatchdirIngest::on_batch_timer()
+{
+    auto batch = std::vector<Parsed>{};
+    auto done = false;
+
+    {
+        auto const lock = std::lock_guard(mutex_);
+        auto const n = std::min(std::size(parsed_), BatchSize);
+        batch.reserve(n);
+        std::move(std::begin(parsed_), std::begin(parsed_) + n, std::back_inserter(batch));
+        parsed_.erase(std::begin(parsed_), std::begin(parsed_) + n);
+        done = std::empty(todo_) && n_parsing_ == 0U && std::empty(parsed_);
+    }
+
+    // make room for the workers to parse more
+    cv_.notify_all();
+
+    if (done)
+    {
+        batch_timer_->stop();
+        batch_timer_running_ = false;
+    }
+
+    for (auto& [item, ok] : batch)
+    {
+        // a file that can't be parsed may still be being written
+        auto const action = ok ? add_func_(item) : Watchdir::Action::Retry;
+        finish_func_(item.basename, action);
+    }
+}
+
+} // namespace libtransmission
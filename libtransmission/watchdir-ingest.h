@@ -0,0 +1,123 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef> // size_t
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "libtransmission/torrent-metainfo.h"
+#include "libtransmission/watchdir.h"
+
+namespace libtransmission
+{
+
+class Timer;
+class TimerMaker;
+
+// Reads and parses the .torrent and .magnet files that a Watchdir finds
+// in a pool of worker threads, so that a directory full of new files
+// doesn't stall the thread that the Watchdir runs in. The parsed files
+// are handed back to that thread in batches.
+//
+// Use `enqueue()` in the Watchdir's callback. It returns `Action::Pending`
+// and the outcome is reported later through `FinishFunc`, which should
+// call `Watchdir::finish()`.
+//
+// Files that have been parsed but not yet added hold their whole
+// metainfo, so at most `max_parsed` of them are kept at a time.
+// The workers wait for them to be added before parsing more.
+class WatchdirIngest
+{
+public:
+    struct Item
+    {
+        std::string dirname;
+        std::string basename;
+        tr_torrent_metainfo metainfo;
+
+        // the .torrent file's contents; empty for magnets
+        std::vector<char> contents;
+
+        bool is_magnet = false;
+
+        // Move the parsed metainfo into `ctor` so that it needn't be parsed again
+        void move_to(tr_ctor* ctor);
+    };
+
+    // Adds a parsed file, e.g. with tr_torrentNew().
+    // Runs in the Watchdir's thread.
+    using AddFunc = std::function<Watchdir::Action(Item& item)>;
+
+    // Reports what happened to a file that `enqueue()` accepted.
+    // Runs in the Watchdir's thread.
+    using FinishFunc = std::function<void(std::string_view basename, Watchdir::Action action)>;
+
+    static auto constexpr DefaultMaxThreads = size_t{ 4U };
+    static auto constexpr DefaultMaxParsed = size_t{ 256U };
+    static auto constexpr BatchSize = size_t{ 64U };
+    static auto constexpr BatchInterval = std::chrono::milliseconds{ 20 };
+
+    WatchdirIngest(
+        TimerMaker& timer_maker,
+        AddFunc add_func,
+        FinishFunc finish_func,
+        size_t max_threads = DefaultMaxThreads,
+        size_t max_parsed = DefaultMaxParsed);
+    ~WatchdirIngest();
+
+    WatchdirIngest(WatchdirIngest&&) = delete;
+    WatchdirIngest(WatchdirIngest const&) = delete;
+    WatchdirIngest& operator=(WatchdirIngest&&) = delete;
+    WatchdirIngest& operator=(WatchdirIngest const&) = delete;
+
+    // Queue `basename` to be parsed if it's a .torrent or .magnet file.
+    // @return `Action::Pending` if it was queued, or `Action::Done` if it's ignored
+    Watchdir::Action enqueue(std::string_view dirname, std::string_view basename);
+
+    // @return how many files are queued, being parsed, or waiting to be added
+    [[nodiscard]] size_t size() const;
+
+private:
+    struct Parsed
+    {
+        Item item;
+        bool ok = false;
+    };
+
+    static void parse(Parsed& parsed);
+
+    void maybe_start_thread();
+    void thread_func();
+    void on_batch_timer();
+
+    AddFunc const add_func_;
+    FinishFunc const finish_func_;
+    size_t const max_threads_;
+    size_t const max_parsed_;
+    std::unique_ptr<Timer> const batch_timer_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<Item> todo_;
+    std::deque<Parsed> parsed_;
+    std::vector<std::thread> threads_;
+    size_t n_parsing_ = 0U;
+    bool stopping_ = false;
+
+    // only used in the Watchdir's thread
+    bool batch_timer_running_ = false;
+};
+
+} // namespace libtransmission
@@ -4,6 +4,7 @@
 // License text can be found in the licenses/ folder.
 
 #include <chrono>
+#include <ctime>
 #include <string>
 #include <string_view>
 
@@ -35,6 +36,9 @@ namespace
 
     case Watchdir::Action::Done:
         return "done";
+
+    case Watchdir::Action::Pending:
+        return "defer";
     }
 
     return "???";
@@ -70,13 +74,35 @@ namespace impl
 
 void BaseWatchdir::processFile(std::string_view basename)
 {
-    if (!isRegularFile(dirname_, basename) || handled_.count(basename) != 0)
+    // check the caches first so that rescans don't stat() every file
+    if (handled_.count(basename) != 0 || in_progress_.count(basename) != 0 || !isRegularFile(dirname_, basename))
     {
         return;
     }
 
     auto const action = callback_(dirname_, basename);
     tr_logAddDebug(fmt::format("Callback decided to {:s} file '{:s}'", actionToString(action), basename));
+    if (action == Action::Pending)
+    {
+        in_progress_.emplace(basename);
+        return;
+    }
+
+    handleAction(basename, action);
+}
+
+void BaseWatchdir::finish(std::string_view basename, Action action)
+{
+    if (auto const iter = in_progress_.find(basename); iter != std::end(in_progress_))
+    {
+        in_progress_.erase(iter);
+        tr_logAddDebug(fmt::format("Finished deciding to {:s} file '{:s}'", actionToString(action), basename));
+        handleAction(basename, action);
+    }
+}
+
+void BaseWatchdir::handleAction(std::string_view basename, Action action)
+{
     if (action == Action::Retry)
     {
         auto const [iter, added] = pending_.try_emplace(std::string{ basename });
@@ -108,10 +134,37 @@ void BaseWatchdir::processFile(std::string_view basename)
     }
 }
 
+void BaseWatchdir::scanIfChanged()
+{
+    // Directory mtimes only have a resolution of a second, so a file could
+    // be added in the same second as the last listing without changing it.
+    // Relist if it's that recent, and once in a while regardless in case
+    // the filesystem doesn't update directory mtimes at all.
+    static auto constexpr FullRescanSecs = time_t{ 60 };
+
+    auto const now = std::time(nullptr);
+    if (listed_mtime_ && now - listed_at_ < FullRescanSecs)
+    {
+        if (auto const info = tr_sys_path_get_info(dirname_);
+            info && info->last_modified_at == *listed_mtime_ && info->last_modified_at < listed_at_)
+        {
+            return;
+        }
+    }
+
+    scan();
+}
+
 void BaseWatchdir::scan()
 {
     tr_error* error = nullptr;
 
+    listed_at_ = std::time(nullptr);
+    if (auto const info = tr_sys_path_get_info(dirname_); info)
+    {
+        listed_mtime_ = info->last_modified_at;
+    }
+
     for (auto const& file : tr_sys_dir_get_files(dirname_, tr_basename_is_not_dotfile, &error))
     {
         processFile(file);
@@ -26,7 +26,11 @@ public:
     enum class Action
     {
         Done,
-        Retry
+        Retry,
+
+        // The file is being handled elsewhere, e.g. parsed in a worker
+        // thread. Whoever handles it must call `finish()` when it's done.
+        Pending
     };
 
     using Callback = std::function<Action(std::string_view dirname, std::string_view basename)>;
@@ -40,6 +44,10 @@ public:
 
     [[nodiscard]] virtual std::string_view dirname() const noexcept = 0;
 
+    // Report how a file whose callback returned `Action::Pending` turned out.
+    // `action` must be `Action::Done` or `Action::Retry`.
+    virtual void finish(std::string_view basename, Action action) = 0;
+
     [[nodiscard]] static auto generic_rescan_interval() noexcept
     {
         return generic_rescan_interval_;
@@ -8,7 +8,6 @@
 #include <array>
 #endif
 #include <atomic>
-#include <condition_variable>
 #include <cstdint> // uint64_t
 #include <list>
 #include <map>
@@ -16,6 +15,7 @@
 #include <mutex>
 #include <stack>
 #include <string>
+#include <string_view>
 #include <thread>
 #include <utility>
 
@@ -30,13 +30,18 @@
 #include <curl/curl.h>
 
 #include <event2/buffer.h>
+#include <event2/event.h>
 
 #include <fmt/core.h>
 
 #ifdef _WIN32
 #include "libtransmission/crypto-utils.h"
 #endif
+#include "libtransmission/dns.h"
 #include "libtransmission/log.h"
+#include "libtransmission/net.h"
+#include "libtransmission/session-thread.h" // for tr_evthread_init()
+#include "libtransmission/timer-ev.h"
 #include "libtransmission/tr-assert.h"
 #include "libtransmission/utils-ev.h"
 #include "libtransmission/utils.h"
@@ -101,6 +106,16 @@ struct EasyDeleter
 
 using easy_unique_ptr = std::unique_ptr<CURL, EasyDeleter>;
 
+struct SlistDeleter
+{
+    void operator()(curl_slist* val) const noexcept
+    {
+        curl_slist_free_all(val);
+    }
+};
+
+using slist_unique_ptr = std::unique_ptr<curl_slist, SlistDeleter>;
+
 } // namespace curl_helpers
 } // namespace
 
@@ -193,6 +208,10 @@ public:
             this->user_agent = *ua;
         }
 
+        curl_timer_->set_callback([this]() { socketAction(CURL_SOCKET_TIMEOUT, 0); });
+        resume_timer_->set_callback([this]() { resumePausedTasks(); });
+        shutdown_timer_->set_callback([this]() { checkShutdown(); });
+
         auto const lock = std::unique_lock{ tasks_mutex_ };
         curl_thread = std::make_unique<std::thread>(&Impl::curlThreadFunc, this);
     }
@@ -205,14 +224,14 @@ public:
     ~Impl()
     {
         deadline_ = mediator.now();
-        queued_tasks_cv_.notify_one();
+        wake();
         curl_thread->join();
     }
 
     void startShutdown(std::chrono::milliseconds deadline)
     {
         deadline_ = mediator.now() + std::chrono::duration_cast<std::chrono::seconds>(deadline).count();
-        queued_tasks_cv_.notify_one();
+        wake();
     }
 
     void fetch(FetchOptions&& options)
@@ -224,7 +243,7 @@ public:
 
         auto const lock = std::unique_lock{ tasks_mutex_ };
         queued_tasks_.emplace_back(*this, std::move(options));
-        queued_tasks_cv_.notify_one();
+        wake();
     }
 
     class Task
@@ -297,6 +316,11 @@ public:
             return options.timeout_secs;
         }
 
+        [[nodiscard]] constexpr auto reuseConnection() const
+        {
+            return options.reuse_connection;
+        }
+
         [[nodiscard]] constexpr auto ipProtocol() const
         {
             switch (options.ip_proto)
@@ -349,6 +373,9 @@ public:
         tr_web::Impl& impl;
         tr_web::FetchResponse response;
 
+        // CURLOPT_RESOLVE entries; curl reads them when the transfer starts
+        curl_helpers::slist_unique_ptr resolve;
+
     private:
         void easy_dispose(CURL* easy)
         {
@@ -378,8 +405,10 @@ public:
     };
 
     static auto constexpr BandwidthPauseMsec = long{ 500 };
+    static auto constexpr ShutdownCheckInterval = 1s;
     static auto constexpr DnsCacheTimeoutSecs = long{ 60 * 60 };
     static auto constexpr MaxRedirects = long{ 10 };
+    static auto constexpr PooledConnectionMaxAgeSecs = long{ 5 * 60 };
 
     bool const curl_verbose = tr_env_key_exists("TR_CURL_VERBOSE");
     bool const curl_ssl_verify = !tr_env_key_exists("TR_CURL_SSL_NO_VERIFY");
@@ -471,6 +500,7 @@ public:
             if (task->impl.mediator.clamp(*tag, bytes_used) < bytes_used)
             {
                 task->impl.paused_easy_handles.emplace(task->easy(), tr_time_msec());
+                task->impl.resume_timer_->start_repeating(std::chrono::milliseconds{ BandwidthPauseMsec });
                 return CURL_WRITEFUNC_PAUSE;
             }
 
@@ -505,6 +535,40 @@ public:
     }
 #endif
 
+    // Build a CURLOPT_RESOLVE list from the session's DNS cache so that
+    // curl doesn't look up hosts that the UDP announcer and DHT already have.
+    // If the host isn't cached yet, curl looks it up itself this time and
+    // our lookup is started so that the next request can use it.
+    [[nodiscard]] curl_helpers::slist_unique_ptr make_resolve_list([[maybe_unused]] std::string_view url) const
+    {
+#if LIBCURL_VERSION_NUM >= 0x073B00 /* 7.59.0: more than one address per entry */
+        auto* const dns = mediator.dns();
+        auto const parsed = tr_urlParse(url);
+        if (dns == nullptr || !parsed || tr_address::from_string(parsed->host))
+        {
+            return {};
+        }
+
+        auto const addresses = dns->get(parsed->host, mediator.now());
+        if (!addresses || std::empty(*addresses))
+        {
+            return {};
+        }
+
+        auto entry = fmt::format("{:s}:{:d}:", parsed->host, parsed->port);
+        for (auto const& address : *addresses)
+        {
+            entry += address.is_ipv6() ? fmt::format("[{:s}],", address.display_name()) :
+                                         fmt::format("{:s},", address.display_name());
+        }
+        entry.pop_back(); // trailing comma
+
+        return curl_helpers::slist_unique_ptr{ curl_slist_append(nullptr, entry.c_str()) };
+#else
+        return {};
+#endif
+    }
+
     void initEasy(Task& task)
     {
         TR_ASSERT(std::this_thread::get_id() == curl_thread->get_id());
@@ -520,6 +584,9 @@ public:
         (void)curl_easy_setopt(e, CURLOPT_PRIVATE, &task);
         (void)curl_easy_setopt(e, CURLOPT_IPRESOLVE, task.ipProtocol());
 
+        task.resolve = make_resolve_list(task.url());
+        (void)curl_easy_setopt(e, CURLOPT_RESOLVE, task.resolve.get());
+
 #ifdef USE_LIBCURL_SOCKOPT
         (void)curl_easy_setopt(e, CURLOPT_SOCKOPTFUNCTION, onSocketCreated);
         (void)curl_easy_setopt(e, CURLOPT_SOCKOPTDATA, &task);
@@ -586,6 +653,24 @@ public:
             (void)curl_easy_setopt(e, CURLOPT_COOKIEFILE, file.c_str());
         }
 
+        if (task.reuseConnection())
+        {
+            // Prefer waiting for a connection that's already open to this host
+            // (or will be soon, e.g. an HTTP/2 connection still negotiating)
+            // over opening a new one. Keep it alive between requests so that
+            // DNS, TCP and TLS setup aren't repeated for every announce.
+#if LIBCURL_VERSION_NUM >= 0x072B00 /* 7.43.0 */
+            (void)curl_easy_setopt(e, CURLOPT_PIPEWAIT, 1L);
+#endif
+#if LIBCURL_VERSION_NUM >= 0x072F00 /* 7.47.0 */
+            (void)curl_easy_setopt(e, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+#endif
+#if LIBCURL_VERSION_NUM >= 0x074100 /* 7.65.0 */
+            (void)curl_easy_setopt(e, CURLOPT_MAXAGE_CONN, PooledConnectionMaxAgeSecs);
+#endif
+            (void)curl_easy_setopt(e, CURLOPT_TCP_KEEPALIVE, 1L);
+        }
+
         if (auto const& range = task.range(); range)
         {
             /* don't bother asking the server to compress webseed fragments */
@@ -600,25 +685,27 @@ public:
         TR_ASSERT(std::this_thread::get_id() == curl_thread->get_id());
 
         auto& paused = paused_easy_handles;
-        if (std::empty(paused))
-        {
-            return;
-        }
-
         auto const now = tr_time_msec();
 
         for (auto it = std::begin(paused); it != std::end(paused);)
         {
-            if (it->second + BandwidthPauseMsec < now)
+            if (auto* const easy = it->first; it->second + BandwidthPauseMsec <= now)
             {
-                curl_easy_pause(it->first, CURLPAUSE_CONT);
+                // erase before unpausing: curl may deliver the pending data
+                // right away, and onDataReceived() may pause the task again
                 it = paused.erase(it);
+                curl_easy_pause(easy, CURLPAUSE_CONT);
             }
             else
             {
                 ++it;
             }
         }
+
+        if (std::empty(paused))
+        {
+            resume_timer_->stop();
+        }
     }
 
     [[nodiscard]] bool is_idle() const noexcept
@@ -648,113 +735,213 @@ public:
         remove_task(task);
     }
 
-    // the thread started by Impl.curl_thread runs this function
-    void curlThreadFunc()
+    // --- curl thread event loop
+    //
+    // The curl thread sleeps in its event loop until something happens:
+    // curl's sockets become ready, curl's timer fires, a paused transfer
+    // is due to resume, or another thread calls wake().
+
+    // Safe to call from any thread.
+    void wake()
     {
-        auto const multi = curl_helpers::multi_unique_ptr{ curl_multi_init() };
+        event_active(wake_event_.get(), 0, 0);
+    }
+
+    static void onWake(evutil_socket_t /*fd*/, short /*what*/, void* vimpl)
+    {
+        auto* const impl = static_cast<Impl*>(vimpl);
+        impl->addQueuedTasks();
+        impl->checkShutdown();
+    }
 
-        auto repeats = unsigned{};
-        for (;;)
+    void addQueuedTasks()
+    {
+        TR_ASSERT(std::this_thread::get_id() == curl_thread->get_id());
+
+        auto const lock = std::unique_lock{ tasks_mutex_ };
+
+        for (auto& task : queued_tasks_)
         {
-            if (deadline_reached())
-            {
-                while (!std::empty(running_tasks_))
-                {
-                    auto& task = running_tasks_.front();
-                    curl_multi_remove_handle(multi.get(), task.easy());
-                    timeout_task(task);
-                }
-            }
+            initEasy(task);
+            curl_multi_add_handle(multi_, task.easy());
+        }
+
+        running_tasks_.splice(std::end(running_tasks_), queued_tasks_);
+    }
 
-            if (deadline_exists() && is_idle())
+    void checkShutdown()
+    {
+        if (!deadline_exists())
+        {
+            return;
+        }
+
+        if (deadline_reached())
+        {
+            while (!std::empty(running_tasks_))
             {
-                break;
+                auto& task = running_tasks_.front();
+                curl_multi_remove_handle(multi_, task.easy());
+                timeout_task(task);
             }
+        }
 
-            if (auto lock = std::unique_lock{ tasks_mutex_ }; lock.owns_lock())
-            {
-                // sleep until there's something to do
-                auto const stop_waiting = [this]()
-                {
-                    return !is_idle() || !deadline_exists();
-                };
-                if (!stop_waiting())
-                {
-                    queued_tasks_cv_.wait(lock, stop_waiting);
-                }
+        if (is_idle())
+        {
+            event_base_loopbreak(evbase_.get());
+            return;
+        }
 
-                // add queued tasks
-                if (!std::empty(queued_tasks_))
-                {
-                    for (auto& task : queued_tasks_)
-                    {
-                        initEasy(task);
-                        curl_multi_add_handle(multi.get(), task.easy());
-                    }
+        // keep checking until the tasks finish or the deadline is reached
+        shutdown_timer_->start_repeating(ShutdownCheckInterval);
+    }
 
-                    running_tasks_.splice(std::end(running_tasks_), queued_tasks_);
-                }
-            }
+    // CURLMOPT_SOCKETFUNCTION: curl tells us which sockets to watch
+    static int onCurlSocket(CURL* /*easy*/, curl_socket_t sock, int what, void* vimpl, void* /*socketp*/)
+    {
+        auto* const impl = static_cast<Impl*>(vimpl);
+        auto& events = impl->socket_events_;
 
-            resumePausedTasks();
+        if (what == CURL_POLL_REMOVE)
+        {
+            events.erase(sock);
+            return 0;
+        }
 
-            // Adapted from https://curl.se/libcurl/c/curl_multi_wait.html docs.
-            // 'numfds' being zero means either a timeout or no file descriptors to
-            // wait for. Try timeout on first occurrence, then assume no file
-            // descriptors and no file descriptors to wait for means wait for 100
-            // milliseconds.
-            auto numfds = int{};
-            curl_multi_wait(multi.get(), nullptr, 0, 1000, &numfds);
-            if (numfds == 0)
-            {
-                ++repeats;
-                if (repeats > 1U)
-                {
-                    std::this_thread::sleep_for(100ms);
-                }
-            }
-            else
-            {
-                repeats = 0;
-            }
+        auto const flags = static_cast<short>(
+            EV_PERSIST | ((what & CURL_POLL_IN) != 0 ? EV_READ : 0) | ((what & CURL_POLL_OUT) != 0 ? EV_WRITE : 0));
+
+        auto& event = events[sock];
+        event.reset(event_new(impl->evbase_.get(), sock, flags, &Impl::onSocketReady, impl));
+        event_add(event.get(), nullptr);
+        return 0;
+    }
+
+    static void onSocketReady(evutil_socket_t fd, short what, void* vimpl)
+    {
+        auto action = int{};
+        if ((what & EV_READ) != 0)
+        {
+            action |= CURL_CSELECT_IN;
+        }
+        if ((what & EV_WRITE) != 0)
+        {
+            action |= CURL_CSELECT_OUT;
+        }
+
+        static_cast<Impl*>(vimpl)->socketAction(fd, action);
+    }
+
+    // CURLMOPT_TIMERFUNCTION: curl tells us when it next needs a timeout callback
+    static int onCurlTimer(CURLM* /*multi*/, long timeout_ms, void* vimpl)
+    {
+        auto& timer = *static_cast<Impl*>(vimpl)->curl_timer_;
+
+        timer.stop();
+
+        if (timeout_ms >= 0)
+        {
+            timer.start_single_shot(std::chrono::milliseconds{ timeout_ms });
+        }
+
+        return 0;
+    }
+
+    void socketAction(curl_socket_t sock, int action)
+    {
+        TR_ASSERT(std::this_thread::get_id() == curl_thread->get_id());
+
+        auto n_running = int{};
+        curl_multi_socket_action(multi_, sock, action, &n_running);
+        processFinishedTasks();
+    }
 
-            // nonblocking update of the tasks
-            auto n_running = int{};
-            curl_multi_perform(multi.get(), &n_running);
+    void processFinishedTasks()
+    {
+        auto n_finished = size_t{};
 
-            // process any tasks that just finished
-            CURLMsg* msg = nullptr;
-            auto unused = int{};
-            while ((msg = curl_multi_info_read(multi.get(), &unused)) != nullptr)
+        CURLMsg* msg = nullptr;
+        auto unused = int{};
+        while ((msg = curl_multi_info_read(multi_, &unused)) != nullptr)
+        {
+            if (msg->msg == CURLMSG_DONE && msg->easy_handle != nullptr)
             {
-                if (msg->msg == CURLMSG_DONE && msg->easy_handle != nullptr)
-                {
-                    auto* const e = msg->easy_handle;
-
-                    Task* task = nullptr;
-                    curl_easy_getinfo(e, CURLINFO_PRIVATE, (void*)&task);
-
-                    auto req_bytes_sent = long{};
-                    auto total_time = double{};
-                    curl_easy_getinfo(e, CURLINFO_REQUEST_SIZE, &req_bytes_sent);
-                    curl_easy_getinfo(e, CURLINFO_TOTAL_TIME, &total_time);
-                    curl_easy_getinfo(e, CURLINFO_RESPONSE_CODE, &task->response.status);
-                    task->response.did_connect = task->response.status > 0 || req_bytes_sent > 0;
-                    task->response.did_timeout = task->response.status == 0 &&
-                        std::chrono::duration<double>(total_time) >= task->timeoutSecs();
-                    curl_multi_remove_handle(multi.get(), e);
-                    remove_task(*task);
-                }
+                auto* const e = msg->easy_handle;
+
+                Task* task = nullptr;
+                curl_easy_getinfo(e, CURLINFO_PRIVATE, (void*)&task);
+
+                auto req_bytes_sent = long{};
+                auto total_time = double{};
+                curl_easy_getinfo(e, CURLINFO_REQUEST_SIZE, &req_bytes_sent);
+                curl_easy_getinfo(e, CURLINFO_TOTAL_TIME, &total_time);
+                curl_easy_getinfo(e, CURLINFO_RESPONSE_CODE, &task->response.status);
+                task->response.did_connect = task->response.status > 0 || req_bytes_sent > 0;
+                task->response.did_timeout = task->response.status == 0 &&
+                    std::chrono::duration<double>(total_time) >= task->timeoutSecs();
+                curl_multi_remove_handle(multi_, e);
+                remove_task(*task);
+                ++n_finished;
             }
         }
+
+        if (n_finished > 0U)
+        {
+            checkShutdown();
+        }
     }
 
+    // the thread started by Impl.curl_thread runs this function
+    void curlThreadFunc()
+    {
+        auto const multi = curl_helpers::multi_unique_ptr{ curl_multi_init() };
+        multi_ = multi.get();
+
+#if LIBCURL_VERSION_NUM >= 0x072B00 /* 7.43.0 */
+        // Let requests to the same host share one HTTP/2 connection.
+        // Connections themselves are cached in `curlsh_`, so they and their
+        // TLS sessions outlive the individual transfers.
+        (void)curl_multi_setopt(multi_, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+#endif
+        (void)curl_multi_setopt(multi_, CURLMOPT_SOCKETFUNCTION, &Impl::onCurlSocket);
+        (void)curl_multi_setopt(multi_, CURLMOPT_SOCKETDATA, this);
+        (void)curl_multi_setopt(multi_, CURLMOPT_TIMERFUNCTION, &Impl::onCurlTimer);
+        (void)curl_multi_setopt(multi_, CURLMOPT_TIMERDATA, this);
+
+        event_base_loop(evbase_.get(), EVLOOP_NO_EXIT_ON_EMPTY);
+
+        curl_timer_->stop();
+        resume_timer_->stop();
+        shutdown_timer_->stop();
+    }
+
+    [[nodiscard]] static libtransmission::evhelpers::evbase_unique_ptr makeEventBase()
+    {
+        // other threads call wake() to post to the curl thread's event loop
+        tr_session_thread::tr_evthread_init();
+
+        return libtransmission::evhelpers::make_event_base();
+    }
+
+    // Declared before the events and timers so that it outlives them.
+    libtransmission::evhelpers::evbase_unique_ptr const evbase_ = makeEventBase();
+    libtransmission::EvTimerMaker timer_maker_{ evbase_.get() };
+
+    libtransmission::evhelpers::event_unique_ptr const wake_event_{
+        event_new(evbase_.get(), -1, 0, &Impl::onWake, this)
+    };
+    std::unique_ptr<libtransmission::Timer> const curl_timer_ = timer_maker_.create(tr_source_location::current());
+    std::unique_ptr<libtransmission::Timer> const resume_timer_ = timer_maker_.create(tr_source_location::current());
+    std::unique_ptr<libtransmission::Timer> const shutdown_timer_ = timer_maker_.create(tr_source_location::current());
+    std::map<curl_socket_t, libtransmission::evhelpers::event_unique_ptr> socket_events_;
+
+    CURLM* multi_ = nullptr;
+
     curl_helpers::shared_unique_ptr const curlsh_{ curl_share_init() };
 
     std::map<std::string /*host*/, std::stack<curl_helpers::easy_unique_ptr>, std::less<>> easy_pool_;
 
     std::mutex tasks_mutex_;
-    std::condition_variable queued_tasks_cv_;
     std::list<Task> queued_tasks_;
     std::list<Task> running_tasks_;
 
@@ -16,6 +16,7 @@
 #include <utility>
 
 struct evbuffer;
+class tr_dns;
 
 class tr_web
 {
@@ -90,6 +91,12 @@ public:
         // IP protocol to use when making the request
         IPProtocol ip_proto = IPProtocol::ANY;
 
+        // Set for small, frequent requests to the same host, e.g. tracker
+        // announces and scrapes. These may wait for an existing connection
+        // to the host and share it -- multiplexed over HTTP/2 when the server
+        // supports it -- and their idle connections are kept around longer.
+        bool reuse_connection = false;
+
         static auto inline constexpr DefaultTimeoutSecs = std::chrono::seconds{ 120 };
     };
 
@@ -161,6 +168,13 @@ public:
         {
             return time(nullptr);
         }
+
+        // If this returns a resolver, its cached answers are handed to curl
+        // so that hosts aren't looked up separately by curl and by us.
+        [[nodiscard]] virtual tr_dns* dns() const
+        {
+            return nullptr;
+        }
     };
 
     // Note that tr_web does no management of the `mediator` reference.
@@ -76,6 +76,11 @@ public:
     // the current position in the task; i.e., the next block to save
     tr_block_info::Location loc;
 
+    // when the current chunk was requested, and whether it's sent data yet.
+    // Used to measure the webseed's response latency.
+    uint64_t requested_at_msec = 0;
+    bool got_first_byte = false;
+
     bool dead = false;
 };
 
@@ -83,6 +88,8 @@ public:
  * Manages how many web tasks should be running at a time.
  *
  * - When all is well, allow multiple tasks running in parallel.
+ *   Keep adding connections while doing so raises throughput,
+ *   and drop them again once it stops helping.
  * - If we get an error, throttle down to only one at a time
  *   until we get piece data.
  * - If we have too many errors in a row, put the peer in timeout
@@ -114,6 +121,44 @@ public:
         paused_until = 0;
     }
 
+    // Called when a task finishes successfully, with the webseed's current download speed.
+    void adapt(tr_bytes_per_second_t bytes_per_second) noexcept
+    {
+        // only adapt when we're using every slot -- otherwise
+        // the speed doesn't tell us anything about the limit
+        if (n_tasks < max_connections)
+        {
+            return;
+        }
+
+        if (bytes_per_second > last_bytes_per_second + last_bytes_per_second / 10U)
+        {
+            max_connections = std::min(max_connections + 1U, MaxConnections);
+        }
+        else if (bytes_per_second < last_bytes_per_second - last_bytes_per_second / 10U)
+        {
+            max_connections = std::max(max_connections - 1U, MinConnections);
+        }
+
+        last_bytes_per_second = bytes_per_second;
+    }
+
+    // Smoothed time between requesting a chunk and getting its first byte.
+    void gotLatency(uint64_t latency_msec) noexcept
+    {
+        latency_msec_ = latency_msec_ == 0U ? latency_msec : (latency_msec_ * 7U + latency_msec) / 8U;
+    }
+
+    [[nodiscard]] constexpr auto latencyMsec() const noexcept
+    {
+        return latency_msec_;
+    }
+
+    [[nodiscard]] constexpr auto taskCount() const noexcept
+    {
+        return n_tasks;
+    }
+
     [[nodiscard]] size_t slotsAvailable() const noexcept
     {
         if (isPaused())
@@ -138,7 +183,7 @@ private:
 
     [[nodiscard]] constexpr size_t maxConnections() const noexcept
     {
-        return n_consecutive_failures > 0 ? 1 : MaxConnections;
+        return n_consecutive_failures > 0 ? 1 : max_connections;
     }
 
     void taskFailed()
@@ -152,12 +197,17 @@ private:
     }
 
     static time_t constexpr TimeoutIntervalSecs = 120;
-    static size_t constexpr MaxConnections = 4;
-    static size_t constexpr MaxConsecutiveFailures = MaxConnections;
+    static size_t constexpr MinConnections = 4;
+    static size_t constexpr MaxConnections = 32;
+    static size_t constexpr MaxConsecutiveFailures = MinConnections;
 
     size_t n_tasks = 0;
     size_t n_consecutive_failures = 0;
+    size_t max_connections = MinConnections;
     time_t paused_until = 0;
+
+    tr_bytes_per_second_t last_bytes_per_second = 0;
+    uint64_t latency_msec_ = 0;
 };
 
 void task_request_next_chunk(tr_webseed_task* task);
@@ -297,11 +347,29 @@ public:
             return {};
         }
 
-        // Prefer to request large, contiguous chunks from webseeds.
-        // The actual value of '64' is arbitrary here;
-        // we could probably be smarter about this.
-        auto constexpr PreferredBlocksPerTask = size_t{ 64 };
-        return { n_slots, n_slots * PreferredBlocksPerTask };
+        return { n_slots, n_slots * preferredBlocksPerTask() };
+    }
+
+    // Prefer to request large, contiguous chunks from webseeds.
+    // Size them so that each request runs for a while at the current
+    // per-connection speed, which keeps the time spent waiting on each
+    // request's first byte small compared to the time spent downloading.
+    [[nodiscard]] size_t preferredBlocksPerTask() const noexcept
+    {
+        auto constexpr MinBlocksPerTask = size_t{ 64 };
+        auto constexpr MaxBlocksPerTask = size_t{ 1024 };
+        auto constexpr MinTaskMsec = uint64_t{ 2000 };
+
+        auto const task_msec = std::max(MinTaskMsec, connection_limiter.latencyMsec() * 10U);
+        auto const n_tasks = std::max(connection_limiter.taskCount(), size_t{ 1U });
+        auto const bytes_per_second = bandwidth_.get_piece_speed_bytes_per_second(tr_time_msec(), TR_DOWN) / n_tasks;
+        auto const n_blocks = bytes_per_second * task_msec / 1000U / tr_block_info::BlockSize;
+        return std::clamp(static_cast<size_t>(n_blocks), MinBlocksPerTask, MaxBlocksPerTask);
+    }
+
+    [[nodiscard]] auto downloadSpeed() const
+    {
+        return bandwidth_.get_piece_speed_bytes_per_second(tr_time_msec(), TR_DOWN);
     }
 
     void publish(tr_peer_event const& peer_event)
@@ -401,7 +469,7 @@ void useFetchedBlocks(tr_webseed_task* task)
             auto block_buf = std::make_unique<Cache::BlockData>(block_size);
             evbuffer_remove(task->content(), std::data(*block_buf), std::size(*block_buf));
             auto* const data = new write_block_data{ session, tor->id(), task->loc.block, std::move(block_buf), webseed };
-            session->runInSessionThread(&write_block_data::write_block_func, data);
+            session->runInSessionThread([data]() { data->write_block_func(); });
         }
 
         task->loc = tor->byte_loc(task->loc.byte + block_size);
@@ -423,7 +491,19 @@ void onBufferGotData(evbuffer* /*buf*/, evbuffer_cb_info const* info, void* vtas
     }
 
     auto const lock = task->session->unique_lock();
-    task->webseed->gotPieceData(n_added);
+
+    auto* const webseed = task->webseed;
+    if (!task->got_first_byte)
+    {
+        task->got_first_byte = true;
+        webseed->connection_limiter.gotLatency(tr_time_msec() - task->requested_at_msec);
+    }
+
+    webseed->gotPieceData(n_added);
+
+    // hand off each block as soon as it's complete
+    // instead of waiting for the whole response
+    useFetchedBlocks(task);
 }
 
 void on_idle(tr_webseed* webseed)
@@ -434,9 +514,6 @@ void on_idle(tr_webseed* webseed)
         return;
     }
 
-    // Prefer to request large, contiguous chunks from webseeds.
-    // The actual value of '64' is arbitrary here; we could probably
-    // be smarter about this.
     auto spans = tr_peerMgrGetNextRequests(webseed->getTorrent(), webseed, max_blocks);
     if (std::size(spans) > max_spans)
     {
@@ -459,6 +536,10 @@ void onPartialDataFetched(tr_web::FetchResponse const& web_response)
     }
 
     auto* const webseed = task->webseed;
+    if (success)
+    {
+        webseed->connection_limiter.adapt(webseed->downloadSpeed());
+    }
     webseed->connection_limiter.taskFinished(success);
 
     if (auto const* const tor = webseed->getTorrent(); tor == nullptr)
@@ -524,6 +605,8 @@ void task_request_next_chunk(tr_webseed_task* task)
     TR_ASSERT(this_chunk > 0U);
 
     webseed->connection_limiter.taskStarted();
+    task->requested_at_msec = tr_time_msec();
+    task->got_first_byte = false;
 
     auto url = tr_urlbuf{};
     makeUrl(webseed, tor->file_subpath(file_index), std::back_inserter(url));
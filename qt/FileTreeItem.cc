@@ -3,10 +3,7 @@
 // or any future license endorsed by Mnemosyne LLC.
 // License text can be found in the licenses/ folder.
 
-#include <algorithm>
-#include <cassert>
-#include <set>
-#include <utility>
+#include <cstddef> // size_t
 
 #include <QApplication>
 #include <QStyle>
@@ -18,76 +15,49 @@
 #include "Formatter.h"
 #include "IconCache.h"
 
-std::unordered_map<QString, int> const& FileTreeItem::getMyChildRows() const
+FileTreeItem::Totals& FileTreeItem::Totals::operator+=(Totals const& that) noexcept
 {
-    // ensure that all the rows are hashed
-    for (int const n = childCount(); first_unhashed_row_ < n; ++first_unhashed_row_)
+    have += that.have;
+    have_wanted += that.have_wanted;
+    size_wanted += that.size_wanted;
+    n_wanted += that.n_wanted;
+    n_unwanted += that.n_unwanted;
+    for (size_t i = 0; i < std::size(n_priority); ++i)
     {
-        child_rows_.emplace(children_[first_unhashed_row_]->name(), first_unhashed_row_);
+        n_priority[i] += that.n_priority[i];
     }
 
-    return child_rows_;
+    return *this;
 }
 
-FileTreeItem::~FileTreeItem()
+FileTreeItem::Totals& FileTreeItem::Totals::operator-=(Totals const& that) noexcept
 {
-    assert(std::empty(children_));
-
-    if (parent_ == nullptr)
+    have -= that.have;
+    have_wanted -= that.have_wanted;
+    size_wanted -= that.size_wanted;
+    n_wanted -= that.n_wanted;
+    n_unwanted -= that.n_unwanted;
+    for (size_t i = 0; i < std::size(n_priority); ++i)
     {
-        return;
+        n_priority[i] -= that.n_priority[i];
     }
 
-    // find the parent's reference to this child
-    auto& siblings = parent_->children_;
-    auto it = std::find(std::begin(siblings), std::end(siblings), this);
-    if (it == std::end(siblings))
-    {
-        return;
-    }
-
-    // remove this child from the parent
-    parent_->child_rows_.erase(name());
-    it = siblings.erase(it);
-
-    // invalidate the row numbers of the siblings that came after this child
-    parent_->first_unhashed_row_ = std::distance(std::begin(siblings), it);
+    return *this;
 }
 
-void FileTreeItem::appendChild(FileTreeItem* child)
-{
-    int const n = childCount();
-    child->parent_ = this;
-    children_.push_back(child);
-    first_unhashed_row_ = n;
-}
-
-FileTreeItem* FileTreeItem::child(QString const& filename)
+FileTreeItem::~FileTreeItem()
 {
-    auto const& child_rows = getMyChildRows();
-
-    if (auto const iter = child_rows.find(filename); iter != std::end(child_rows))
+    for (auto* const child : children_)
     {
-        auto* const item = child(iter->second);
-        assert(filename == item->name());
-        return item;
+        delete child;
     }
-
-    return {};
 }
 
-int FileTreeItem::row() const
+void FileTreeItem::appendChild(FileTreeItem* child)
 {
-    auto const& child_rows = parent_->getMyChildRows();
-
-    if (auto const iter = child_rows.find(name()); iter != std::end(child_rows))
-    {
-        auto const idx = iter->second;
-        assert(this == parent_->children_[idx]);
-        return idx;
-    }
-
-    return -1;
+    child->parent_ = this;
+    child->row_ = childCount();
+    children_.push_back(child);
 }
 
 QVariant FileTreeItem::data(int column, int role) const
@@ -188,34 +158,14 @@ QVariant FileTreeItem::data(int column, int role) const
     return value;
 }
 
-void FileTreeItem::getSubtreeWantedSize(uint64_t& have, uint64_t& total) const
-{
-    if (is_wanted_)
-    {
-        have += have_size_;
-        total += total_size_;
-    }
-
-    for (FileTreeItem const* const i : children_)
-    {
-        i->getSubtreeWantedSize(have, total);
-    }
-}
-
 double FileTreeItem::progress() const
 {
-    double d(0);
-    uint64_t have(0);
-    uint64_t total(0);
-
-    getSubtreeWantedSize(have, total);
-
-    if (total != 0)
+    if (totals_.size_wanted == 0U)
     {
-        d = static_cast<double>(have) / static_cast<double>(total);
+        return 0.0;
     }
 
-    return d;
+    return static_cast<double>(totals_.have_wanted) / static_cast<double>(totals_.size_wanted);
 }
 
 QString FileTreeItem::sizeString() const
@@ -225,65 +175,7 @@ QString FileTreeItem::sizeString() const
 
 uint64_t FileTreeItem::size() const
 {
-    if (std::empty(children_))
-    {
-        return total_size_;
-    }
-
-    uint64_t have = 0;
-    uint64_t total = 0;
-    getSubtreeWantedSize(have, total);
-    return total;
-}
-
-std::pair<int, int> FileTreeItem::update(QString const& name, bool wanted, int priority, uint64_t have_size, bool update_fields)
-{
-    auto changed_columns = std::set<int>{};
-
-    if (name_ != name)
-    {
-        if (parent_ != nullptr)
-        {
-            parent_->first_unhashed_row_ = row();
-        }
-
-        name_ = name;
-        changed_columns.insert(FileTreeModel::COL_NAME);
-    }
-
-    if (fileIndex() != -1)
-    {
-        if (have_size_ != have_size)
-        {
-            have_size_ = have_size;
-            changed_columns.insert(FileTreeModel::COL_PROGRESS);
-        }
-
-        if (update_fields)
-        {
-            if (is_wanted_ != wanted)
-            {
-                is_wanted_ = wanted;
-                changed_columns.insert(FileTreeModel::COL_WANTED);
-            }
-
-            if (priority_ != priority)
-            {
-                priority_ = priority;
-                changed_columns.insert(FileTreeModel::COL_PRIORITY);
-            }
-        }
-    }
-
-    std::pair<int, int> changed(-1, -1);
-
-    if (!changed_columns.empty())
-    {
-        changed.first = *std::cbegin(changed_columns);
-        changed.second = *std::crbegin(changed_columns);
-    }
-
-    return changed;
+    return file_index_ < 0 ? totals_.size_wanted : total_size_;
 }
 
 QString FileTreeItem::priorityString() const
@@ -310,98 +202,32 @@ int FileTreeItem::priority() const
 {
     int i(0);
 
-    if (std::empty(children_))
+    if (totals_.n_priority[TR_PRI_LOW - TR_PRI_LOW] != 0)
     {
-        switch (priority_)
-        {
-        case TR_PRI_LOW:
-            i |= Low;
-            break;
-
-        case TR_PRI_HIGH:
-            i |= High;
-            break;
-
-        default:
-            i |= Normal;
-            break;
-        }
+        i |= Low;
     }
 
-    for (FileTreeItem const* const child : children_)
+    if (totals_.n_priority[TR_PRI_NORMAL - TR_PRI_LOW] != 0)
     {
-        i |= child->priority();
+        i |= Normal;
     }
 
-    return i;
-}
-
-void FileTreeItem::setSubtreePriority(int priority, QSet<int>& ids)
-{
-    if (priority_ != priority)
+    if (totals_.n_priority[TR_PRI_HIGH - TR_PRI_LOW] != 0)
     {
-        priority_ = priority;
-
-        if (file_index_ >= 0)
-        {
-            ids.insert(file_index_);
-        }
+        i |= High;
     }
 
-    for (FileTreeItem* const child : children_)
-    {
-        child->setSubtreePriority(priority, ids);
-    }
+    return i;
 }
 
 int FileTreeItem::isSubtreeWanted() const
 {
-    if (std::empty(children_))
+    if (totals_.n_unwanted == 0)
     {
-        return is_wanted_ ? Qt::Checked : Qt::Unchecked;
+        return totals_.n_wanted == 0 ? -1 : Qt::Checked;
     }
 
-    int wanted(-1);
-
-    for (FileTreeItem const* const child : children_)
-    {
-        int const child_wanted = child->isSubtreeWanted();
-
-        if (wanted == -1)
-        {
-            wanted = child_wanted;
-        }
-
-        if (wanted != child_wanted)
-        {
-            wanted = Qt::PartiallyChecked;
-        }
-
-        if (wanted == Qt::PartiallyChecked)
-        {
-            return wanted;
-        }
-    }
-
-    return wanted;
-}
-
-void FileTreeItem::setSubtreeWanted(bool b, QSet<int>& ids)
-{
-    if (is_wanted_ != b)
-    {
-        is_wanted_ = b;
-
-        if (file_index_ >= 0)
-        {
-            ids.insert(file_index_);
-        }
-    }
-
-    for (FileTreeItem* const child : children_)
-    {
-        child->setSubtreeWanted(b, ids);
-    }
+    return totals_.n_wanted == 0 ? Qt::Unchecked : Qt::PartiallyChecked;
 }
 
 QString FileTreeItem::path() const
@@ -5,19 +5,17 @@
 
 #pragma once
 
+#include <array>
 #include <cstdint>
-#include <unordered_map>
+#include <utility> // std::exchange(), std::pair
 #include <vector>
 
 #include <QCoreApplication>
-#include <QSet>
 #include <QString>
 #include <QVariant>
 
 #include <libtransmission/tr-macros.h>
 
-#include "Utils.h" // for std::hash<QString>
-
 class FileTreeItem
 {
     Q_DECLARE_TR_FUNCTIONS(FileTreeItem)
@@ -28,6 +26,21 @@ public:
     static auto constexpr Normal = int{ 1 << 1 };
     static auto constexpr High = int{ 1 << 2 };
 
+    // What the files in a subtree add up to. FileTreeModel keeps these
+    // current as files change, so showing a folder doesn't walk its subtree.
+    struct Totals
+    {
+        uint64_t have = {};
+        uint64_t have_wanted = {};
+        uint64_t size_wanted = {};
+        int n_wanted = {};
+        int n_unwanted = {};
+        std::array<int, 3> n_priority = {}; // indexed by priority - TR_PRI_LOW
+
+        Totals& operator+=(Totals const& that) noexcept;
+        Totals& operator-=(Totals const& that) noexcept;
+    };
+
     FileTreeItem(QString const& name = QString{}, int file_index = -1, uint64_t size = 0)
         : name_(name)
         , total_size_(size)
@@ -38,7 +51,6 @@ public:
     ~FileTreeItem();
 
     void appendChild(FileTreeItem* child);
-    FileTreeItem* child(QString const& filename);
 
     FileTreeItem* child(int row)
     {
@@ -60,17 +72,22 @@ public:
         return parent_;
     }
 
-    int row() const;
+    [[nodiscard]] constexpr int row() const noexcept
+    {
+        return row_;
+    }
 
     [[nodiscard]] constexpr auto const& name() const noexcept
     {
         return name_;
     }
 
+    void setName(QString const& name)
+    {
+        name_ = name;
+    }
+
     QVariant data(int column, int role) const;
-    std::pair<int, int> update(QString const& name, bool want, int priority, uint64_t have, bool update_fields);
-    void setSubtreeWanted(bool, QSet<int>& file_ids);
-    void setSubtreePriority(int priority, QSet<int>& file_ids);
 
     [[nodiscard]] constexpr auto fileIndex() const noexcept
     {
@@ -84,7 +101,57 @@ public:
 
     [[nodiscard]] constexpr auto isComplete() const noexcept
     {
-        return have_size_ == totalSize();
+        return file_index_ < 0 || totals_.have == totalSize();
+    }
+
+    [[nodiscard]] constexpr auto const& totals() const noexcept
+    {
+        return totals_;
+    }
+
+    void setTotals(Totals const& totals) noexcept
+    {
+        totals_ = totals;
+    }
+
+    void addTotals(Totals const& delta) noexcept
+    {
+        totals_ += delta;
+    }
+
+    // A folder's files are [first, end) in FileTreeModel's path-sorted file list.
+    // Its children aren't made until the folder is first expanded.
+    [[nodiscard]] constexpr auto fileRange() const noexcept
+    {
+        return std::pair{ first_file_, end_file_ };
+    }
+
+    void setFileRange(int first, int end) noexcept
+    {
+        first_file_ = first;
+        end_file_ = end;
+    }
+
+    [[nodiscard]] constexpr auto isPopulated() const noexcept
+    {
+        return is_populated_;
+    }
+
+    void setPopulated() noexcept
+    {
+        is_populated_ = true;
+    }
+
+    // Used by FileTreeModel to coalesce its dataChanged() signals.
+    // @return true if the item wasn't already marked
+    bool markChanged() noexcept
+    {
+        return !std::exchange(is_changed_, true);
+    }
+
+    void clearChanged() noexcept
+    {
+        is_changed_ = false;
     }
 
     QString path() const;
@@ -94,19 +161,18 @@ public:
 private:
     QString priorityString() const;
     QString sizeString() const;
-    void getSubtreeWantedSize(uint64_t& have, uint64_t& total) const;
     double progress() const;
     uint64_t size() const;
-    std::unordered_map<QString, int> const& getMyChildRows() const;
 
     FileTreeItem* parent_ = {};
-    mutable std::unordered_map<QString, int> child_rows_;
     std::vector<FileTreeItem*> children_;
     QString name_;
+    Totals totals_;
     uint64_t const total_size_ = {};
-    uint64_t have_size_ = {};
-    mutable int first_unhashed_row_ = {};
     int const file_index_ = {};
-    int priority_ = {};
-    bool is_wanted_ = {};
+    int row_ = {};
+    int first_file_ = {};
+    int end_file_ = {};
+    bool is_populated_ = {};
+    bool is_changed_ = {};
 };
@@ -5,6 +5,8 @@
 
 #include <algorithm>
 #include <cassert>
+#include <functional> // std::less
+#include <iterator>
 #include <map>
 #include <memory>
 
@@ -58,34 +60,30 @@ public:
     }
 };
 
-class BackwardPathIterator : public PathIteratorBase
+FileTreeItem::Totals totalsOf(bool wanted, int priority, uint64_t size, uint64_t have)
 {
-public:
-    explicit BackwardPathIterator(QString const& path)
-        : PathIteratorBase{ path, 0 }
+    if (priority != TR_PRI_LOW && priority != TR_PRI_HIGH)
     {
+        priority = TR_PRI_NORMAL;
     }
 
-    [[nodiscard]] bool hasNext() const
+    auto totals = FileTreeItem::Totals{};
+    totals.have = have;
+    ++totals.n_priority[priority - TR_PRI_LOW];
+
+    if (wanted)
     {
-        return slash_index_ < path_.size();
+        totals.have_wanted = have;
+        totals.size_wanted = size;
+        ++totals.n_wanted;
     }
-
-    QString const& next()
+    else
     {
-        int new_slash_index = path_.indexOf(SlashChar, slash_index_);
-
-        if (new_slash_index == -1)
-        {
-            new_slash_index = path_.size();
-        }
-
-        token_.truncate(0);
-        token_.append(&path_.data()[slash_index_], new_slash_index - slash_index_);
-        slash_index_ = new_slash_index + 1;
-        return token_;
+        ++totals.n_unwanted;
     }
-};
+
+    return totals;
+}
 
 } // namespace
 
@@ -96,10 +94,7 @@ FileTreeModel::FileTreeModel(QObject* parent, bool is_editable)
 {
 }
 
-FileTreeModel::~FileTreeModel()
-{
-    clear();
-}
+FileTreeModel::~FileTreeModel() = default;
 
 void FileTreeModel::setEditable(bool is_editable)
 {
@@ -247,6 +242,48 @@ QModelIndex FileTreeModel::parent(QModelIndex const& child, int column) const
     return parent;
 }
 
+bool FileTreeModel::hasChildren(QModelIndex const& parent) const
+{
+    FileTreeItem const* parent_item = parent.isValid() ? itemFromIndex(parent) : root_item_.get();
+
+    // a folder that hasn't been expanded yet has no items, but it isn't empty
+    return parent_item->fileIndex() < 0 && (parent_item->childCount() > 0 || !parent_item->isPopulated());
+}
+
+bool FileTreeModel::canFetchMore(QModelIndex const& parent) const
+{
+    FileTreeItem const* parent_item = parent.isValid() ? itemFromIndex(parent) : root_item_.get();
+
+    return parent_item->fileIndex() < 0 && !parent_item->isPopulated();
+}
+
+void FileTreeModel::fetchMore(QModelIndex const& parent)
+{
+    auto* const parent_item = parent.isValid() ? itemFromIndex(parent) : root_item_.get();
+
+    if (parent_item->fileIndex() >= 0 || parent_item->isPopulated())
+    {
+        return;
+    }
+
+    auto const children = makeChildren(parent_item);
+    parent_item->setPopulated();
+
+    if (std::empty(children))
+    {
+        return;
+    }
+
+    beginInsertRows(indexOf(parent_item, 0), 0, static_cast<int>(std::size(children)) - 1);
+
+    for (auto* const child : children)
+    {
+        parent_item->appendChild(child);
+    }
+
+    endInsertRows();
+}
+
 int FileTreeModel::rowCount(QModelIndex const& parent) const
 {
     FileTreeItem const* parent_item = parent.isValid() ? itemFromIndex(parent) : root_item_.get();
@@ -271,195 +308,299 @@ QModelIndex FileTreeModel::indexOf(FileTreeItem* item, int column) const
     return createIndex(item->row(), column, item);
 }
 
-void FileTreeModel::clearSubtree(QModelIndex const& top)
+void FileTreeModel::clear()
 {
-    size_t i = rowCount(top);
+    beginResetModel();
+    root_item_ = std::make_unique<FileTreeItem>();
+    files_.clear();
+    sorted_files_.clear();
+    changed_items_.clear();
+    endResetModel();
+}
 
-    while (i > 0)
+bool FileTreeModel::needsReset(FileList const& files) const
+{
+    if (std::size(files) != std::size(sorted_files_))
     {
-        clearSubtree(index(--i, 0, top));
+        return true;
     }
 
-    FileTreeItem* const item = itemFromIndex(top);
+    return std::any_of(
+        std::begin(files),
+        std::end(files),
+        [this](TorrentFile const& file)
+        { return file.index < 0 || file.index >= static_cast<int>(std::size(files_)) || files_[file.index].item == nullptr; });
+}
+
+void FileTreeModel::reset(FileList const& files)
+{
+    beginResetModel();
+
+    root_item_ = std::make_unique<FileTreeItem>();
+    changed_items_.clear();
 
-    if (item == nullptr)
+    auto n_files = int{};
+    for (auto const& file : files)
     {
-        return;
+        n_files = std::max(n_files, file.index + 1);
     }
 
-    if (auto const idx = item->fileIndex(); idx != -1)
+    files_.clear();
+    files_.resize(n_files);
+    sorted_files_.clear();
+    sorted_files_.reserve(std::size(files));
+
+    for (auto const& file : files)
     {
-        if (auto const iter = index_cache_.find(idx); iter != std::end(index_cache_))
+        if (file.index >= 0)
         {
-            index_cache_.erase(iter);
+            files_[file.index] = File{ file.filename, file.size, file.have, file.priority, file.wanted, root_item_.get() };
+            sorted_files_.push_back(file.index);
         }
     }
 
-    delete item;
-}
+    sortFiles();
+    root_item_->setFileRange(0, static_cast<int>(std::size(sorted_files_)));
 
-void FileTreeModel::clear()
-{
-    beginResetModel();
-    clearSubtree(QModelIndex{});
-    root_item_ = std::make_unique<FileTreeItem>();
-    endResetModel();
+    for (auto* const child : makeChildren(root_item_.get()))
+    {
+        root_item_->appendChild(child);
+    }
 
-    assert(std::empty(index_cache_));
-}
+    root_item_->setPopulated();
 
-FileTreeItem* FileTreeModel::findItemForFileIndex(int file_index) const
-{
-    auto iter = index_cache_.find(file_index);
-    return iter == std::end(index_cache_) ? nullptr : iter->second;
+    endResetModel();
 }
 
-void FileTreeModel::addFile(
-    int file_index,
-    QString const& filename,
-    bool wanted,
-    int priority,
-    uint64_t total_size,
-    uint64_t have,
-    bool update_fields)
+void FileTreeModel::update(FileList const& files, bool update_fields)
 {
-    auto* item = findItemForFileIndex(file_index);
-
-    if (item != nullptr) // this file is already in the tree, we've added this
+    if (needsReset(files))
     {
-        QModelIndex index_with_changed_parents;
-        ForwardPathIterator filename_it(filename);
+        reset(files);
+        return;
+    }
+
+    auto renamed = false;
 
-        while (filename_it.hasNext())
+    for (auto const& file : files)
+    {
+        if (files_[file.index].filename != file.filename)
         {
-            auto const& token = filename_it.next();
-            auto const& [first_col, last_col] = item->update(token, wanted, priority, have, update_fields);
+            renameFile(file.index, file.filename);
+            renamed = true;
+        }
 
-            if (first_col >= 0)
-            {
-                emit dataChanged(indexOf(item, first_col), indexOf(item, last_col));
+        auto const& old = files_[file.index];
+        setFileState(
+            file.index,
+            update_fields ? file.wanted : old.wanted,
+            update_fields ? file.priority : old.priority,
+            file.have);
+    }
 
-                if (!index_with_changed_parents.isValid() && first_col <= COL_PRIORITY && last_col >= COL_SIZE)
-                {
-                    index_with_changed_parents = indexOf(item, 0);
-                }
-            }
+    if (renamed)
+    {
+        sortFiles();
+        updateFileRanges(root_item_.get());
+    }
 
-            item = item->parent();
-        }
+    emitChanged();
+}
 
-        assert(item == root_item_.get());
+std::vector<FileTreeItem*> FileTreeModel::makeChildren(FileTreeItem const* folder)
+{
+    auto children = std::vector<FileTreeItem*>{};
 
-        if (index_with_changed_parents.isValid())
-        {
-            emitParentsChanged(index_with_changed_parents, COL_SIZE, COL_PRIORITY);
-        }
+    auto prefix = folder->path();
+    if (!prefix.isEmpty())
+    {
+        prefix += QLatin1Char('/');
     }
-    else // we haven't build the FileTreeItems for these tokens yet
+
+    // Since the files are sorted by path, each subfolder's files are a
+    // contiguous run that can be skipped over with a binary search.
+    auto const sorted_begin = std::begin(sorted_files_);
+    auto const [first, end] = folder->fileRange();
+    for (auto pos = first; pos < end;)
     {
-        bool added = false;
+        auto const file_index = sorted_files_[pos];
+        auto const& filename = files_[file_index].filename;
+        auto const slash_index = filename.indexOf(QLatin1Char('/'), prefix.size());
 
-        item = root_item_.get();
-        BackwardPathIterator filename_it(filename);
+        FileTreeItem* child = nullptr;
+        auto next = pos + 1;
 
-        while (filename_it.hasNext())
+        if (slash_index == -1)
         {
-            QString const& token = filename_it.next();
-            FileTreeItem* child(item->child(token));
-
-            if (child == nullptr)
-            {
-                added = true;
-                QModelIndex const parent_index(indexOf(item, 0));
-                int const n(item->childCount());
-
-                beginInsertRows(parent_index, n, n);
-
-                if (!filename_it.hasNext())
-                {
-                    child = new FileTreeItem{ token, file_index, total_size };
-                }
-                else
-                {
-                    child = new FileTreeItem{ token };
-                }
-
-                item->appendChild(child);
-                endInsertRows();
-            }
-
-            item = child;
+            child = new FileTreeItem{ filename.mid(prefix.size()), file_index, files_[file_index].size };
+        }
+        else
+        {
+            auto const child_prefix = filename.left(slash_index + 1);
+            auto const child_end = std::partition_point(
+                sorted_begin + next,
+                sorted_begin + end,
+                [this, &child_prefix](int idx) { return files_[idx].filename.startsWith(child_prefix); });
+            next = static_cast<int>(std::distance(sorted_begin, child_end));
+
+            child = new FileTreeItem{ filename.mid(prefix.size(), slash_index - prefix.size()) };
+            child->setFileRange(pos, next);
         }
 
-        if (item != root_item_.get())
+        auto totals = FileTreeItem::Totals{};
+        for (auto i = pos; i < next; ++i)
         {
-            assert(item->fileIndex() == file_index);
-            assert(item->totalSize() == total_size);
+            auto& file = files_[sorted_files_[i]];
+            totals += totalsOf(file.wanted, file.priority, file.size, file.have);
+            file.item = child;
+        }
 
-            index_cache_[file_index] = item;
+        child->setTotals(totals);
+        children.push_back(child);
+        pos = next;
+    }
 
-            auto const [first_col, last_col] = item->update(item->name(), wanted, priority, have, added || update_fields);
+    return children;
+}
 
-            if (first_col >= 0)
-            {
-                emit dataChanged(indexOf(item, first_col), indexOf(item, last_col));
-            }
-        }
+std::vector<int> FileTreeModel::filesIn(FileTreeItem const* item) const
+{
+    if (item->fileIndex() >= 0)
+    {
+        return { item->fileIndex() };
     }
+
+    auto const [first, end] = item->fileRange();
+    return { std::begin(sorted_files_) + first, std::begin(sorted_files_) + end };
 }
 
-void FileTreeModel::emitParentsChanged(
-    QModelIndex const& index,
-    int first_column,
-    int last_column,
-    QSet<QModelIndex>* visited_parent_indices)
+void FileTreeModel::setFileState(int file_index, bool wanted, int priority, uint64_t have)
 {
-    assert(first_column <= last_column);
+    auto& file = files_[file_index];
+
+    if (file.wanted == wanted && file.priority == priority && file.have == have)
+    {
+        return;
+    }
+
+    auto delta = totalsOf(wanted, priority, file.size, have);
+    delta -= totalsOf(file.wanted, file.priority, file.size, file.have);
 
-    QModelIndex walk = index;
+    file.wanted = wanted;
+    file.priority = priority;
+    file.have = have;
 
-    for (;;)
+    for (auto* item = file.item; item != nullptr; item = item->parent())
     {
-        walk = parent(walk, first_column);
+        item->addTotals(delta);
 
-        if (!walk.isValid())
+        if (item != root_item_.get() && item->markChanged())
         {
-            break;
+            changed_items_.push_back(item);
         }
+    }
+}
 
-        if (visited_parent_indices != nullptr)
+void FileTreeModel::renameFile(int file_index, QString const& filename)
+{
+    auto& file = files_[file_index];
+    file.filename = filename;
+
+    // skip the deepest parts of the path if their items haven't been made yet
+    auto depth = int{};
+    for (auto const* walk = file.item; walk != root_item_.get(); walk = walk->parent())
+    {
+        ++depth;
+    }
+
+    ForwardPathIterator filename_it(filename);
+
+    for (auto n_tokens = filename.count(QLatin1Char('/')) + 1; n_tokens > depth && filename_it.hasNext(); --n_tokens)
+    {
+        filename_it.next();
+    }
+
+    for (auto* item = file.item; item != root_item_.get() && filename_it.hasNext(); item = item->parent())
+    {
+        if (auto const& token = filename_it.next(); item->name() != token)
         {
-            if (visited_parent_indices->contains(walk))
-            {
-                break;
-            }
+            item->setName(token);
 
-            visited_parent_indices->insert(walk);
+            auto const name_index = indexOf(item, COL_NAME);
+            emit dataChanged(name_index, name_index);
         }
+    }
+}
 
-        emit dataChanged(walk, walk.sibling(walk.row(), last_column));
+void FileTreeModel::sortFiles()
+{
+    std::sort(
+        std::begin(sorted_files_),
+        std::end(sorted_files_),
+        [this](int lhs, int rhs) { return files_[lhs].filename < files_[rhs].filename; });
+}
+
+void FileTreeModel::updateFileRanges(FileTreeItem* folder)
+{
+    if (folder != root_item_.get())
+    {
+        auto const prefix = folder->path() + QLatin1Char('/');
+        auto const sorted_begin = std::begin(sorted_files_);
+        auto const sorted_end = std::end(sorted_files_);
+        auto const first = std::lower_bound(
+            sorted_begin,
+            sorted_end,
+            prefix,
+            [this](int idx, QString const& key) { return files_[idx].filename < key; });
+        auto const end = std::partition_point(
+            first,
+            sorted_end,
+            [this, &prefix](int idx) { return files_[idx].filename.startsWith(prefix); });
+        folder->setFileRange(
+            static_cast<int>(std::distance(sorted_begin, first)),
+            static_cast<int>(std::distance(sorted_begin, end)));
+    }
+
+    for (int row = 0, n = folder->childCount(); row < n; ++row)
+    {
+        if (auto* const child = folder->child(row); child->fileIndex() < 0)
+        {
+            updateFileRanges(child);
+        }
     }
 }
 
-void FileTreeModel::emitSubtreeChanged(QModelIndex const& idx, int first_column, int last_column)
+void FileTreeModel::emitChanged()
 {
-    assert(first_column <= last_column);
+    // emit one signal per run of changed siblings instead of one per item
+    std::sort(
+        std::begin(changed_items_),
+        std::end(changed_items_),
+        [](FileTreeItem const* lhs, FileTreeItem const* rhs)
+        {
+            if (lhs->parent() != rhs->parent())
+            {
+                return std::less<FileTreeItem const*>{}(lhs->parent(), rhs->parent());
+            }
 
-    int const child_count = rowCount(idx);
+            return lhs->row() < rhs->row();
+        });
 
-    if (child_count == 0)
+    for (auto it = std::begin(changed_items_), end = std::end(changed_items_); it != end;)
     {
-        return;
-    }
+        auto* const first = *it;
+        auto* last = first;
 
-    // tell everyone that this item changed
-    emit dataChanged(index(0, first_column, idx), index(child_count - 1, last_column, idx));
+        for (; it != end && (*it)->parent() == first->parent(); ++it)
+        {
+            last = *it;
+            last->clearChanged();
+        }
 
-    // walk the subitems
-    for (int i = 0; i < child_count; ++i)
-    {
-        emitSubtreeChanged(index(i, 0, idx), first_column, last_column);
+        emit dataChanged(indexOf(first, COL_SIZE), indexOf(last, COL_PRIORITY));
     }
+
+    changed_items_.clear();
 }
 
 void FileTreeModel::twiddleWanted(QModelIndexList const& indices)
@@ -523,26 +664,21 @@ void FileTreeModel::setWanted(QModelIndexList const& indices, bool wanted)
         return;
     }
 
-    QModelIndexList const orphan_indices = getOrphanIndices(indices);
-
     QSet<int> file_ids;
 
-    for (QModelIndex const& i : orphan_indices)
+    for (QModelIndex const& i : getOrphanIndices(indices))
     {
-        FileTreeItem* const item = itemFromIndex(i);
-        item->setSubtreeWanted(wanted, file_ids);
-
-        emit dataChanged(i, i);
-        emitSubtreeChanged(i, COL_WANTED, COL_WANTED);
+        for (auto const file_index : filesIn(itemFromIndex(i)))
+        {
+            if (auto const& file = files_[file_index]; file.wanted != wanted)
+            {
+                setFileState(file_index, wanted, file.priority, file.have);
+                file_ids.insert(file_index);
+            }
+        }
     }
 
-    // emit parent changes separately to avoid multiple updates for same items
-    QSet<QModelIndex> parent_indices;
-
-    for (QModelIndex const& i : orphan_indices)
-    {
-        emitParentsChanged(i, COL_SIZE, COL_WANTED, &parent_indices);
-    }
+    emitChanged();
 
     if (!file_ids.isEmpty())
     {
@@ -557,26 +693,21 @@ void FileTreeModel::setPriority(QModelIndexList const& indices, int priority)
         return;
     }
 
-    QModelIndexList const orphan_indices = getOrphanIndices(indices);
-
     QSet<int> file_ids;
 
-    for (QModelIndex const& i : orphan_indices)
+    for (QModelIndex const& i : getOrphanIndices(indices))
     {
-        FileTreeItem* const item = itemFromIndex(i);
-        item->setSubtreePriority(priority, file_ids);
-
-        emit dataChanged(i, i);
-        emitSubtreeChanged(i, COL_PRIORITY, COL_PRIORITY);
+        for (auto const file_index : filesIn(itemFromIndex(i)))
+        {
+            if (auto const& file = files_[file_index]; file.priority != priority)
+            {
+                setFileState(file_index, file.wanted, priority, file.have);
+                file_ids.insert(file_index);
+            }
+        }
     }
 
-    // emit parent changes separately to avoid multiple updates for same items
-    QSet<QModelIndex> parent_indices;
-
-    for (QModelIndex const& i : orphan_indices)
-    {
-        emitParentsChanged(i, COL_PRIORITY, COL_PRIORITY, &parent_indices);
-    }
+    emitChanged();
 
     if (!file_ids.isEmpty())
     {
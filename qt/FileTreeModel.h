@@ -6,14 +6,17 @@
 #pragma once
 
 #include <cstdint> // uint64_t
-#include <map>
 #include <memory>
+#include <vector>
 
 #include <QAbstractItemModel>
 #include <QSet>
+#include <QString>
 
 #include <libtransmission/tr-macros.h>
 
+#include "Torrent.h" // FileList
+
 class FileTreeItem;
 
 class FileTreeModel final : public QAbstractItemModel
@@ -47,14 +50,10 @@ public:
     void setEditable(bool editable);
 
     void clear();
-    void addFile(
-        int index,
-        QString const& filename,
-        bool wanted,
-        int priority,
-        uint64_t size,
-        uint64_t have,
-        bool update_fields);
+
+    // Folders' children are made the first time they're expanded, so this
+    // only touches the files' items and the folders that have been shown.
+    void update(FileList const& files, bool update_fields);
 
     bool openFile(QModelIndex const& index);
 
@@ -72,6 +71,9 @@ public:
     QVariant headerData(int column, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
     QModelIndex index(int row, int column, QModelIndex const& parent = {}) const override;
     QModelIndex parent(QModelIndex const& child) const override;
+    bool hasChildren(QModelIndex const& parent = {}) const override;
+    bool canFetchMore(QModelIndex const& parent) const override;
+    void fetchMore(QModelIndex const& parent) override;
     int rowCount(QModelIndex const& parent = {}) const override;
     int columnCount(QModelIndex const& parent = {}) const override;
     bool setData(QModelIndex const& index, QVariant const& value, int role = Qt::EditRole) override;
@@ -83,19 +85,34 @@ signals:
     void openRequested(QString const& path);
 
 private:
-    void clearSubtree(QModelIndex const&);
+    struct File
+    {
+        QString filename;
+        uint64_t size = {};
+        uint64_t have = {};
+        int priority = {};
+        bool wanted = {};
+
+        // the file's item, or its deepest ancestor that has been made
+        FileTreeItem* item = {};
+    };
+
+    void reset(FileList const& files);
+    [[nodiscard]] bool needsReset(FileList const& files) const;
+    [[nodiscard]] std::vector<FileTreeItem*> makeChildren(FileTreeItem const* folder);
+    [[nodiscard]] std::vector<int> filesIn(FileTreeItem const* item) const;
+    void setFileState(int file_index, bool wanted, int priority, uint64_t have);
+    void renameFile(int file_index, QString const& filename);
+    void sortFiles();
+    void updateFileRanges(FileTreeItem* folder);
+    void emitChanged();
     QModelIndex indexOf(FileTreeItem*, int column) const;
-    void emitParentsChanged(
-        QModelIndex const&,
-        int first_column,
-        int last_column,
-        QSet<QModelIndex>* visited_parent_indices = nullptr);
-    void emitSubtreeChanged(QModelIndex const&, int first_column, int last_column);
-    FileTreeItem* findItemForFileIndex(int file_index) const;
     FileTreeItem* itemFromIndex(QModelIndex const&) const;
     QModelIndexList getOrphanIndices(QModelIndexList const& indices) const;
 
-    std::map<int, FileTreeItem*> index_cache_;
+    std::vector<File> files_; // indexed by file index
+    std::vector<int> sorted_files_; // file indices, sorted by path
+    std::vector<FileTreeItem*> changed_items_;
     std::unique_ptr<FileTreeItem> root_item_;
     bool is_editable_ = {};
 };
@@ -189,10 +189,7 @@ void FileTreeView::update(FileList const& files, bool update_fields)
 {
     bool const model_was_empty = proxy_->rowCount() == 0;
 
-    for (TorrentFile const& file : files)
-    {
-        model_->addFile(file.index, file.filename, file.wanted, file.priority, file.size, file.have, update_fields);
-    }
+    model_->update(files, update_fields);
 
     if (model_was_empty)
     {
@@ -129,6 +129,14 @@ void RpcClient::sendNetworkRequest(TrVariantPtr json, QFutureInterface<RpcRespon
             "User-Agent",
             (QApplication::applicationName() + QLatin1Char('/') + QString::fromUtf8(LONG_VERSION_STRING)).toUtf8());
         request.setRawHeader("Content-Type", "application/json; charset=UTF-8");
+
+        // bencoded responses are smaller and quicker to parse,
+        // but keep JSON when the user wants to read them
+        if (!verbose_)
+        {
+            request.setRawHeader("Accept", TR_RPC_BENC_CONTENT_TYPE);
+        }
+
         if (!session_id_.isEmpty())
         {
             request.setRawHeader(TR_RPC_SESSION_ID_HEADER, session_id_.toUtf8());
@@ -272,10 +280,14 @@ void RpcClient::networkRequestFinished(QNetworkReply* reply)
     }
     else
     {
+        // servers that don't know benc answer in JSON
+        auto const is_benc = reply->header(QNetworkRequest::ContentTypeHeader)
+                                 .toString()
+                                 .startsWith(QStringLiteral(TR_RPC_BENC_CONTENT_TYPE));
         auto const json_data = reply->readAll().trimmed();
         auto const json = createVariant();
         RpcResponse result;
-        if (tr_variantFromBuf(json.get(), TR_VARIANT_PARSE_JSON, json_data))
+        if (tr_variantFromBuf(json.get(), is_benc ? TR_VARIANT_PARSE_BENC : TR_VARIANT_PARSE_JSON, json_data))
         {
             result = parseResponseData(*json);
         }
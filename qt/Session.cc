@@ -331,6 +331,9 @@ void Session::restart()
 
 void Session::start()
 {
+    server_has_deltas_ = true;
+    delta_token_ = 0;
+
     if (prefs_.get<bool>(Prefs::SESSION_IS_REMOTE))
     {
         QUrl url;
@@ -687,6 +690,54 @@ void Session::refreshTorrents(torrent_ids_t const& torrent_ids, TorrentPropertie
     q->run();
 }
 
+void Session::refreshTorrentDeltas()
+{
+    auto constexpr Table = std::string_view{ "table" };
+
+    tr_variant args;
+    tr_variantInitDict(&args, 3);
+    dictAdd(&args, TR_KEY_format, Table);
+    dictAdd(&args, TR_KEY_fields, getKeyNames(TorrentProperties::MainStats));
+    dictAdd(&args, TR_KEY_delta_token, delta_token_);
+
+    auto* q = new RpcQueue{};
+
+    q->add([this, &args]() { return exec(TR_KEY_torrent_get, &args); });
+
+    q->add(
+        [this](RpcResponse const& r)
+        {
+            auto token = int64_t{};
+            auto const has_deltas = tr_variantDictFindInt(r.args.get(), TR_KEY_delta_token, &token);
+            if (has_deltas)
+            {
+                delta_token_ = token;
+            }
+            else
+            {
+                // the server ignored `delta-token` and sent every torrent
+                server_has_deltas_ = false;
+            }
+
+            auto full = !has_deltas;
+            (void)tr_variantDictFindBool(r.args.get(), TR_KEY_delta_full, &full);
+
+            tr_variant* torrents = nullptr;
+
+            if (tr_variantDictFindList(r.args.get(), TR_KEY_torrents, &torrents))
+            {
+                emit torrentsUpdated(torrents, full);
+            }
+
+            if (tr_variantDictFindList(r.args.get(), TR_KEY_removed, &torrents))
+            {
+                emit torrentsRemoved(torrents);
+            }
+        });
+
+    q->run();
+}
+
 void Session::refreshDetailInfo(torrent_ids_t const& ids)
 {
     refreshTorrents(ids, TorrentProperties::DetailInfo);
@@ -749,12 +800,25 @@ void Session::queueMoveBottom(torrent_ids_t const& ids)
 
 void Session::refreshActiveTorrents()
 {
+    if (server_has_deltas_)
+    {
+        refreshTorrentDeltas();
+        return;
+    }
+
     // If this object is passed as "ids" (compared by address), then recently active torrents are queried.
     refreshTorrents(RecentlyActiveIDs, TorrentProperties::MainStats);
 }
 
 void Session::refreshAllTorrents()
 {
+    // deltas already cover every torrent
+    if (server_has_deltas_)
+    {
+        refreshTorrentDeltas();
+        return;
+    }
+
     // if an empty ids object is used, all torrents are queried.
     torrent_ids_t const ids = {};
     refreshTorrents(ids, TorrentProperties::MainStats);
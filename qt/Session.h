@@ -156,6 +156,7 @@ private:
     void pumpRequests();
     void sendTorrentRequest(std::string_view request, torrent_ids_t const& torrent_ids);
     void refreshTorrents(torrent_ids_t const& ids, TorrentProperties props);
+    void refreshTorrentDeltas();
     std::vector<std::string_view> const& getKeyNames(TorrentProperties props);
 
     static void updateStats(tr_variant* args_dict, tr_session_stats* stats);
@@ -178,6 +179,12 @@ private:
     RpcClient rpc_;
     torrent_ids_t const RecentlyActiveIDs = { -1 };
 
+    // Servers that support `delta-token` send only the torrents that
+    // changed since the last refresh, so polling stays cheap with many
+    // torrents. Older servers get polled with "recently-active".
+    bool server_has_deltas_ = true;
+    int64_t delta_token_ = 0;
+
     std::map<QString, QString> duplicates_;
     QTimer duplicates_timer_;
 
@@ -64,6 +64,11 @@ void TorrentFilter::onPrefChanged(int key)
 
 void TorrentFilter::refilter()
 {
+    filter_mode_ = prefs_.get<FilterMode>(Prefs::FILTER_MODE);
+    filter_text_ = prefs_.getString(Prefs::FILTER_TEXT);
+    filter_trackers_ = prefs_.getString(Prefs::FILTER_TRACKERS).toLower();
+    sort_mode_ = prefs_.get<SortMode>(Prefs::SORT_MODE);
+
     invalidate();
     sort(0, prefs_.getBool(Prefs::SORT_REVERSED) ? Qt::AscendingOrder : Qt::DescendingOrder);
 }
@@ -72,13 +77,19 @@ void TorrentFilter::refilter()
 ****
 ***/
 
+Torrent const* TorrentFilter::torrentAt(int source_row) const
+{
+    // cheaper than boxing the pointer in a QVariant with data(TorrentRole)
+    return static_cast<TorrentModel const*>(sourceModel())->torrents().at(source_row);
+}
+
 bool TorrentFilter::lessThan(QModelIndex const& left, QModelIndex const& right) const
 {
     int val = 0;
-    auto const* a = sourceModel()->data(left, TorrentModel::TorrentRole).value<Torrent const*>();
-    auto const* b = sourceModel()->data(right, TorrentModel::TorrentRole).value<Torrent const*>();
+    auto const* a = torrentAt(left.row());
+    auto const* b = torrentAt(right.row());
 
-    switch (prefs_.get<SortMode>(Prefs::SORT_MODE).mode())
+    switch (sort_mode_.mode())
     {
     case SortMode::SORT_BY_QUEUE:
         if (val == 0)
@@ -210,29 +221,25 @@ bool TorrentFilter::lessThan(QModelIndex const& left, QModelIndex const& right)
 ****
 ***/
 
-bool TorrentFilter::filterAcceptsRow(int source_row, QModelIndex const& source_parent) const
+bool TorrentFilter::filterAcceptsRow(int source_row, QModelIndex const& /*source_parent*/) const
 {
-    QModelIndex const child_index = sourceModel()->index(source_row, 0, source_parent);
-    auto const& tor = *child_index.model()->data(child_index, TorrentModel::TorrentRole).value<Torrent const*>();
+    auto const& tor = *torrentAt(source_row);
     bool accepts = true;
 
     if (accepts)
     {
-        auto const m = prefs_.get<FilterMode>(Prefs::FILTER_MODE);
-        accepts = m.test(tor);
+        accepts = filter_mode_.test(tor);
     }
 
     if (accepts)
     {
-        auto const display_name = prefs_.getString(Prefs::FILTER_TRACKERS);
-        accepts = display_name.isEmpty() || tor.includesTracker(display_name.toLower());
+        accepts = filter_trackers_.isEmpty() || tor.includesTracker(filter_trackers_);
     }
 
     if (accepts)
     {
-        auto const text = prefs_.getString(Prefs::FILTER_TEXT);
-        accepts = text.isEmpty() || tor.name().contains(text, Qt::CaseInsensitive) ||
-            tor.hash().toString().contains(text, Qt::CaseInsensitive);
+        accepts = filter_text_.isEmpty() || tor.name().contains(filter_text_, Qt::CaseInsensitive) ||
+            tor.hash().toString().contains(filter_text_, Qt::CaseInsensitive);
     }
 
     return accepts;
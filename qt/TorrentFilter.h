@@ -8,14 +8,13 @@
 #include <array>
 
 #include <QSortFilterProxyModel>
+#include <QString>
 #include <QTimer>
 
 #include <libtransmission/tr-macros.h>
 
 #include "Filters.h"
 
-class QString;
-
 class FilterMode;
 class Prefs;
 class Torrent;
@@ -46,6 +45,16 @@ private slots:
     void refilter();
 
 private:
+    [[nodiscard]] Torrent const* torrentAt(int source_row) const;
+
     QTimer refilter_timer_;
     Prefs const& prefs_;
+
+    // Cached from prefs_ by refilter(). lessThan() and filterAcceptsRow()
+    // run for every changed row on every refresh, so they shouldn't have
+    // to look up and copy the prefs each time.
+    FilterMode filter_mode_;
+    QString filter_text_;
+    QString filter_trackers_;
+    SortMode sort_mode_;
 };
@@ -0,0 +1,91 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#define LIBTRANSMISSION_PEER_MODULE
+
+#include <cstddef> // size_t
+#include <cstdint> // uintptr_t
+#include <ctime> // time_t
+#include <random>
+#include <vector>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/peer-mgr-active-requests.h>
+
+#include "bench.h"
+
+class tr_peer;
+
+using namespace libtransmission::bench;
+
+namespace
+{
+auto constexpr NumPeers = size_t{ 50U };
+
+[[nodiscard]] tr_peer* fake_peer(size_t i)
+{
+    return reinterpret_cast<tr_peer*>(uintptr_t{ 0x1000U } + i * 8U);
+}
+
+// Keep `state.arg()` requests in flight, replacing one each iteration the
+// way the peer manager does as blocks arrive and new requests go out.
+void ActiveRequestsChurn(State& state)
+{
+    auto const n_requests = state.arg();
+    auto requests = ActiveRequests{};
+    auto rng = std::mt19937{ options().seed };
+
+    auto in_flight = std::vector<tr_block_index_t>{};
+    in_flight.reserve(n_requests);
+    auto next_block = tr_block_index_t{};
+    for (size_t i = 0U; i < n_requests; ++i)
+    {
+        in_flight.push_back(next_block);
+        (void)requests.add(next_block++, fake_peer(rng() % NumPeers), time_t{});
+    }
+
+    auto when = time_t{};
+    while (state.keep_running())
+    {
+        auto& block = in_flight[rng() % n_requests];
+        do_not_optimize(requests.count(block));
+        do_not_optimize(requests.remove(block));
+        block = next_block++;
+        (void)requests.add(block, fake_peer(rng() % NumPeers), ++when);
+    }
+
+    state.set_items_per_iteration(1U);
+}
+TR_BENCHMARK(ActiveRequestsChurn, 256U, 4096U, 65536U);
+
+// Drop every request to one peer, e.g. when it disconnects or chokes us
+void ActiveRequestsRemovePeer(State& state)
+{
+    auto const n_requests = state.arg();
+    auto requests = ActiveRequests{};
+    auto rng = std::mt19937{ options().seed };
+
+    for (tr_block_index_t block = 0U; block < n_requests; ++block)
+    {
+        (void)requests.add(block, fake_peer(rng() % NumPeers), time_t{});
+    }
+
+    while (state.keep_running())
+    {
+        auto* const peer = fake_peer(rng() % NumPeers);
+        auto const removed = requests.remove(peer);
+        do_not_optimize(removed);
+
+        state.pause_timing();
+        for (auto const block : removed)
+        {
+            (void)requests.add(block, peer, time_t{});
+        }
+        state.resume_timing();
+    }
+}
+TR_BENCHMARK(ActiveRequestsRemovePeer, 256U, 4096U, 65536U);
+} // namespace
@@ -0,0 +1,352 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib> // getenv()
+#include <functional>
+#include <future>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/error.h>
+#include <libtransmission/file.h>
+#include <libtransmission/log.h>
+#include <libtransmission/quark.h>
+#include <libtransmission/session.h>
+#include <libtransmission/torrent.h>
+#include <libtransmission/tr-getopt.h>
+#include <libtransmission/utils.h>
+#include <libtransmission/variant.h>
+
+#include "bench.h"
+
+using namespace std::literals;
+
+namespace libtransmission::bench
+{
+namespace
+{
+struct Benchmark
+{
+    std::string name;
+    BenchmarkFunc func;
+    size_t arg;
+};
+
+[[nodiscard]] auto& benchmarks()
+{
+    static auto instance = std::vector<Benchmark>{};
+    return instance;
+}
+
+void remove_recursive(std::string const& path)
+{
+    if (auto const info = tr_sys_path_get_info(path); info && info->isFolder())
+    {
+        if (auto const odir = tr_sys_dir_open(path); odir != TR_BAD_SYS_DIR)
+        {
+            for (;;)
+            {
+                char const* const name = tr_sys_dir_read_name(odir);
+                if (name == nullptr)
+                {
+                    break;
+                }
+
+                if ("."sv != name && ".."sv != name)
+                {
+                    remove_recursive(fmt::format("{:s}/{:s}", path, name));
+                }
+            }
+
+            tr_sys_dir_close(odir);
+        }
+    }
+
+    tr_sys_path_remove(path);
+}
+
+[[nodiscard]] std::string create_sandbox()
+{
+    auto const* const tmpdir = getenv("TMPDIR");
+    auto path = fmt::format("{:s}/transmission-bench-XXXXXX", tmpdir != nullptr ? tmpdir : "/tmp");
+    tr_sys_dir_create_temp(std::data(path));
+    tr_sys_path_native_separators(std::data(path));
+    return path;
+}
+
+[[nodiscard]] std::string format_rate(double n_per_second, std::string_view units)
+{
+    static auto constexpr Prefixes = std::array<std::string_view, 4>{ ""sv, "k"sv, "M"sv, "G"sv };
+
+    auto idx = size_t{};
+    while (n_per_second >= 1000.0 && idx + 1U < std::size(Prefixes))
+    {
+        n_per_second /= 1000.0;
+        ++idx;
+    }
+
+    return fmt::format("{:.2f} {:s}{:s}/s", n_per_second, Prefixes[idx], units);
+}
+
+void run(Benchmark const& benchmark)
+{
+    auto state = State{ benchmark.arg, options().min_time };
+    benchmark.func(state);
+
+    auto const n_iterations = std::max(uint64_t{ 1U }, state.iterations());
+    auto const secs = std::chrono::duration<double>(state.elapsed()).count();
+    auto const ns_per_iteration = std::chrono::duration<double, std::nano>(state.elapsed()).count() / n_iterations;
+
+    auto rate = std::string{};
+    if (auto const n_bytes = state.bytes_per_iteration(); n_bytes != 0U && secs > 0.0)
+    {
+        rate = format_rate(n_bytes * n_iterations / secs, "B"sv);
+    }
+    else if (auto const n_items = state.items_per_iteration(); n_items != 0U && secs > 0.0)
+    {
+        rate = format_rate(n_items * n_iterations / secs, "items"sv);
+    }
+
+    auto const name = benchmark.arg != 0U ? fmt::format("{:s}/{:d}", benchmark.name, benchmark.arg) : benchmark.name;
+    fmt::print("{:<40s} {:>12d} {:>16.1f} ns {:>18s}\n", name, state.iterations(), ns_per_iteration, rate);
+    std::fflush(stdout);
+}
+
+// ---
+
+char constexpr MyName[] = "libtransmission-bench";
+char constexpr Usage[] = "Usage: libtransmission-bench [options]";
+
+auto constexpr Opts = std::array<tr_option, 7>{
+    { { 'f', "filter", "Only run benchmarks whose names contain this text", "f", true, "<text>" },
+      { 'm', "min-time", "Run each benchmark for at least this many milliseconds", "m", true, "<msec>" },
+      { 'n', "pieces", "Number of pieces in the synthetic torrent", "n", true, "<count>" },
+      { 's', "piece-size", "Piece size of the synthetic torrent, in KiB", "s", true, "<KiB>" },
+      { 'F', "files", "Number of files in the synthetic torrent", "F", true, "<count>" },
+      { 'r', "seed", "Seed for the synthetic data", "r", true, "<seed>" },
+      { 0, nullptr, nullptr, nullptr, false, nullptr } }
+};
+
+bool parse_command_line(Options& opts, int argc, char const* const* argv)
+{
+    int c = 0;
+    char const* optarg = nullptr;
+
+    while ((c = tr_getopt(Usage, argc, argv, std::data(Opts), &optarg)) != TR_OPT_DONE)
+    {
+        switch (c)
+        {
+        case 'f':
+            opts.filter = optarg;
+            break;
+
+        case 'm':
+            opts.min_time = std::chrono::milliseconds{ tr_num_parse<uint32_t>(optarg).value_or(0U) };
+            break;
+
+        case 'n':
+            opts.n_pieces = std::max(size_t{ 1U }, tr_num_parse<size_t>(optarg).value_or(opts.n_pieces));
+            break;
+
+        case 's':
+            opts.piece_size = std::max(uint32_t{ 16U }, tr_num_parse<uint32_t>(optarg).value_or(opts.piece_size / 1024U)) *
+                1024U;
+            break;
+
+        case 'F':
+            opts.n_files = std::max(size_t{ 1U }, tr_num_parse<size_t>(optarg).value_or(opts.n_files));
+            break;
+
+        case 'r':
+            opts.seed = tr_num_parse<uint32_t>(optarg).value_or(opts.seed);
+            break;
+
+        default:
+            return false;
+        }
+    }
+
+    return true;
+}
+} // namespace
+
+Options& options()
+{
+    static auto instance = Options{};
+    return instance;
+}
+
+void escape(void const* /*ptr*/)
+{
+    // defined out-of-line so that callers can't see that it does nothing
+}
+
+bool add_benchmark(std::string_view name, BenchmarkFunc func, std::vector<size_t> args)
+{
+    if (std::empty(args))
+    {
+        args.emplace_back(0U);
+    }
+
+    for (auto const arg : args)
+    {
+        benchmarks().push_back({ std::string{ name }, func, arg });
+    }
+
+    return true;
+}
+
+// ---
+
+std::string make_synthetic_metainfo()
+{
+    auto const& opts = options();
+    auto const total_size = uint64_t{ opts.n_pieces } * opts.piece_size;
+    auto const n_files = std::min(uint64_t{ opts.n_files }, total_size);
+
+    auto rng = std::mt19937{ opts.seed };
+    auto pieces = std::string(opts.n_pieces * sizeof(tr_sha1_digest_t), '\0');
+    std::generate(std::begin(pieces), std::end(pieces), [&rng]() { return static_cast<char>(rng()); });
+
+    auto top = tr_variant{};
+    tr_variantInitDict(&top, 3U);
+    tr_variantDictAddStr(&top, TR_KEY_announce, "https://example.com/announce"sv);
+    tr_variantDictAddStr(&top, TR_KEY_created_by, MyName);
+
+    auto* const info = tr_variantDictAddDict(&top, TR_KEY_info, 4U);
+    tr_variantDictAddStr(info, TR_KEY_name, "synthetic"sv);
+    tr_variantDictAddInt(info, TR_KEY_piece_length, opts.piece_size);
+    tr_variantDictAddRaw(info, TR_KEY_pieces, std::data(pieces), std::size(pieces));
+
+    auto* const files = tr_variantDictAddList(info, TR_KEY_files, n_files);
+    for (uint64_t i = 0U; i < n_files; ++i)
+    {
+        // split the torrent evenly, with any remainder going to the last file
+        auto const file_size = total_size / n_files + (i + 1U == n_files ? total_size % n_files : 0U);
+
+        auto* const file = tr_variantListAddDict(files, 2U);
+        tr_variantDictAddInt(file, TR_KEY_length, file_size);
+        auto* const path = tr_variantDictAddList(file, TR_KEY_path, 1U);
+        tr_variantListAddStr(path, fmt::format("file-{:05d}.bin", i));
+    }
+
+    auto benc = tr_variantToStr(&top, TR_VARIANT_FMT_BENC);
+    tr_variantClear(&top);
+    return benc;
+}
+
+// ---
+
+BenchSession::BenchSession()
+    : sandbox_dir_{ create_sandbox() }
+{
+    auto const download_dir = tr_pathbuf{ sandbox_dir_, "/Downloads"sv };
+    tr_sys_dir_create(download_dir, TR_SYS_DIR_CREATE_PARENTS, 0700);
+
+    auto settings = tr_variant{};
+    tr_variantInitDict(&settings, 8U);
+    tr_variantDictAddStr(&settings, TR_KEY_download_dir, download_dir);
+    tr_variantDictAddBool(&settings, TR_KEY_dht_enabled, false);
+    tr_variantDictAddBool(&settings, TR_KEY_lpd_enabled, false);
+    tr_variantDictAddBool(&settings, TR_KEY_pex_enabled, false);
+    tr_variantDictAddBool(&settings, TR_KEY_port_forwarding_enabled, false);
+    tr_variantDictAddBool(&settings, TR_KEY_peer_port_random_on_start, true);
+    tr_variantDictAddInt(&settings, TR_KEY_message_level, TR_LOG_ERROR);
+    session_ = tr_sessionInit(sandbox_dir_.c_str(), false, &settings);
+    tr_variantClear(&settings);
+}
+
+BenchSession::~BenchSession()
+{
+    tr_sessionClose(session_);
+    remove_recursive(sandbox_dir_);
+}
+
+tr_torrent* BenchSession::add_torrent(std::string_view benc)
+{
+    auto* const ctor = tr_ctorNew(session_);
+    tr_error* error = nullptr;
+    if (!tr_ctorSetMetainfo(ctor, std::data(benc), std::size(benc), &error))
+    {
+        fmt::print(stderr, "couldn't parse synthetic torrent: {:s}\n", error->message);
+        tr_error_free(error);
+        tr_ctorFree(ctor);
+        return nullptr;
+    }
+
+    tr_ctorSetPaused(ctor, TR_FORCE, true);
+    auto* const tor = tr_torrentNew(ctor, nullptr);
+    tr_ctorFree(ctor);
+
+    // wait for the initial verify to finish
+    auto const is_checking = [tor]()
+    {
+        auto const activity = tr_torrentStat(tor)->activity;
+        return activity == TR_STATUS_CHECK || activity == TR_STATUS_CHECK_WAIT;
+    };
+    while (tor != nullptr && is_checking())
+    {
+        std::this_thread::sleep_for(10ms);
+    }
+
+    return tor;
+}
+
+void BenchSession::run_in_session_thread_and_wait(std::function<void()> func)
+{
+    auto promise = std::promise<void>{};
+    auto future = promise.get_future();
+    session_->runInSessionThread(
+        [&func, &promise]()
+        {
+            func();
+            promise.set_value();
+        });
+    future.wait();
+}
+
+} // namespace libtransmission::bench
+
+int main(int argc, char** argv)
+{
+    using namespace libtransmission::bench;
+
+    if (!parse_command_line(options(), argc, argv))
+    {
+        tr_getopt_usage(MyName, Usage, std::data(Opts));
+        return EXIT_FAILURE;
+    }
+
+    auto const& opts = options();
+    fmt::print(
+        "synthetic torrent: {:d} pieces of {:d} KiB in {:d} files; seed {:d}\n\n",
+        opts.n_pieces,
+        opts.piece_size / 1024U,
+        opts.n_files,
+        opts.seed);
+    fmt::print("{:<40s} {:>12s} {:>19s} {:>18s}\n", "Benchmark", "Iterations", "Time/iteration", "Throughput");
+
+    for (auto const& benchmark : benchmarks())
+    {
+        if (std::empty(opts.filter) || tr_strv_contains(benchmark.name, opts.filter))
+        {
+            run(benchmark);
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,202 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#include <chrono>
+#include <cstddef> // size_t
+#include <cstdint> // uint32_t, uint64_t
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct tr_session;
+struct tr_torrent;
+
+namespace libtransmission::bench
+{
+
+// Settings shared by all the benchmarks. These can be changed from the
+// command line so that the same fixtures can be run at different scales.
+struct Options
+{
+    // synthetic torrent shape
+    size_t n_pieces = 1024U;
+    uint32_t piece_size = 256U * 1024U;
+    size_t n_files = 4U;
+
+    // seed for the synthetic data, so that runs are repeatable
+    uint32_t seed = 1U;
+
+    // how long to run each benchmark
+    std::chrono::milliseconds min_time = std::chrono::milliseconds{ 500 };
+
+    // only run benchmarks whose names contain this
+    std::string filter;
+};
+
+[[nodiscard]] Options& options();
+
+class State
+{
+public:
+    State(size_t arg, std::chrono::nanoseconds min_time)
+        : min_time_{ min_time }
+        , arg_{ arg }
+    {
+    }
+
+    // The benchmark's parameter, e.g. a buffer size
+    [[nodiscard]] constexpr auto arg() const noexcept
+    {
+        return arg_;
+    }
+
+    // Benchmarks should loop on this: `while (state.keep_running()) { ... }`
+    // Timing starts the first time it's called, so setup done before the
+    // loop isn't measured.
+    [[nodiscard]] bool keep_running()
+    {
+        auto const now = Clock::now();
+
+        if (!started_)
+        {
+            started_ = true;
+            running_ = true;
+            started_at_ = now;
+            return true;
+        }
+
+        ++n_iterations_;
+        if (auto const elapsed = elapsed_ + (running_ ? now - started_at_ : Clock::duration{}); elapsed < min_time_)
+        {
+            return true;
+        }
+
+        pause_timing(now);
+        return false;
+    }
+
+    // Exclude per-iteration setup from the measurement
+    void pause_timing()
+    {
+        pause_timing(Clock::now());
+    }
+
+    void resume_timing()
+    {
+        if (!running_)
+        {
+            running_ = true;
+            started_at_ = Clock::now();
+        }
+    }
+
+    // Used to report a throughput, e.g. when each iteration hashes N bytes
+    constexpr void set_bytes_per_iteration(uint64_t n_bytes) noexcept
+    {
+        bytes_per_iteration_ = n_bytes;
+    }
+
+    constexpr void set_items_per_iteration(uint64_t n_items) noexcept
+    {
+        items_per_iteration_ = n_items;
+    }
+
+    [[nodiscard]] constexpr auto iterations() const noexcept
+    {
+        return n_iterations_;
+    }
+
+    [[nodiscard]] constexpr auto elapsed() const noexcept
+    {
+        return elapsed_;
+    }
+
+    [[nodiscard]] constexpr auto bytes_per_iteration() const noexcept
+    {
+        return bytes_per_iteration_;
+    }
+
+    [[nodiscard]] constexpr auto items_per_iteration() const noexcept
+    {
+        return items_per_iteration_;
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    void pause_timing(Clock::time_point now)
+    {
+        if (running_)
+        {
+            elapsed_ += now - started_at_;
+            running_ = false;
+        }
+    }
+
+    Clock::time_point started_at_;
+    Clock::duration elapsed_ = {};
+    std::chrono::nanoseconds const min_time_;
+    size_t const arg_;
+    uint64_t n_iterations_ = 0U;
+    uint64_t bytes_per_iteration_ = 0U;
+    uint64_t items_per_iteration_ = 0U;
+    bool started_ = false;
+    bool running_ = false;
+};
+
+// Keep the compiler from optimizing away a benchmark's results
+void escape(void const* ptr);
+
+template<typename T>
+void do_not_optimize(T const& value)
+{
+    escape(&value);
+}
+
+using BenchmarkFunc = void (*)(State& state);
+
+// Register a benchmark to be run once for each arg in `args`,
+// or once with an arg of 0 if `args` is empty.
+bool add_benchmark(std::string_view name, BenchmarkFunc func, std::vector<size_t> args = {});
+
+#define TR_BENCHMARK(func, ...) \
+    [[maybe_unused]] bool const func##_registered = libtransmission::bench::add_benchmark(#func, func, { __VA_ARGS__ })
+
+// ---
+
+// @return the benc of a torrent that uses the shape given in `options()`
+[[nodiscard]] std::string make_synthetic_metainfo();
+
+// A session running in a temporary directory that's removed when done.
+class BenchSession
+{
+public:
+    BenchSession();
+    ~BenchSession();
+
+    BenchSession(BenchSession const&) = delete;
+    BenchSession(BenchSession&&) = delete;
+    BenchSession& operator=(BenchSession const&) = delete;
+    BenchSession& operator=(BenchSession&&) = delete;
+
+    [[nodiscard]] constexpr auto* session() noexcept
+    {
+        return session_;
+    }
+
+    // Add a paused torrent and wait for its initial verify to finish
+    [[nodiscard]] tr_torrent* add_torrent(std::string_view benc);
+
+    void run_in_session_thread_and_wait(std::function<void()> func);
+
+private:
+    std::string const sandbox_dir_;
+    tr_session* session_ = nullptr;
+};
+
+} // namespace libtransmission::bench
@@ -0,0 +1,143 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <cstddef> // size_t
+#include <random>
+#include <utility> // std::swap
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/bitfield.h>
+
+#include "bench.h"
+
+using namespace libtransmission::bench;
+
+namespace
+{
+// a bitfield with about half of its bits set
+[[nodiscard]] tr_bitfield make_half_full_bitfield(size_t n_bits)
+{
+    auto rng = std::mt19937{ options().seed };
+    auto bitfield = tr_bitfield{ n_bits };
+    for (size_t i = 0U; i < n_bits; ++i)
+    {
+        if ((rng() & 1U) != 0U)
+        {
+            bitfield.set(i);
+        }
+    }
+    return bitfield;
+}
+
+void BitfieldSetSpan(State& state)
+{
+    auto const n_bits = state.arg();
+    auto bitfield = tr_bitfield{ n_bits };
+    auto rng = std::mt19937{ options().seed };
+    auto dist = std::uniform_int_distribution<size_t>{ 0U, n_bits - 1U };
+
+    while (state.keep_running())
+    {
+        auto begin = dist(rng);
+        auto end = dist(rng);
+        if (end < begin)
+        {
+            std::swap(begin, end);
+        }
+        bitfield.set_span(begin, end, (begin & 1U) != 0U);
+    }
+
+    state.set_items_per_iteration(1U);
+}
+TR_BENCHMARK(BitfieldSetSpan, 1024U, 65536U, 1048576U);
+
+void BitfieldCountRange(State& state)
+{
+    auto const n_bits = state.arg();
+    auto const bitfield = make_half_full_bitfield(n_bits);
+    auto total = size_t{};
+
+    while (state.keep_running())
+    {
+        total += bitfield.count(n_bits / 4U, n_bits - n_bits / 4U);
+    }
+
+    state.set_items_per_iteration(n_bits / 2U);
+    do_not_optimize(total);
+}
+TR_BENCHMARK(BitfieldCountRange, 1024U, 65536U, 1048576U);
+
+void BitfieldTestAll(State& state)
+{
+    auto const n_bits = state.arg();
+    auto const bitfield = make_half_full_bitfield(n_bits);
+    auto total = size_t{};
+
+    while (state.keep_running())
+    {
+        for (size_t i = 0U; i < n_bits; ++i)
+        {
+            total += bitfield.test(i) ? 1U : 0U;
+        }
+    }
+
+    state.set_items_per_iteration(n_bits);
+    do_not_optimize(total);
+}
+TR_BENCHMARK(BitfieldTestAll, 1024U, 65536U, 1048576U);
+
+void BitfieldSetRaw(State& state)
+{
+    auto const n_bits = state.arg();
+    auto const raw = make_half_full_bitfield(n_bits).raw();
+    auto bitfield = tr_bitfield{ n_bits };
+
+    while (state.keep_running())
+    {
+        bitfield.set_raw(std::data(raw), std::size(raw));
+    }
+
+    state.set_bytes_per_iteration(std::size(raw));
+}
+TR_BENCHMARK(BitfieldSetRaw, 1024U, 65536U, 1048576U);
+
+// e.g. how many of the pieces we want does a peer have?
+void BitfieldAndCount(State& state)
+{
+    auto const n_bits = state.arg();
+    auto const a = make_half_full_bitfield(n_bits);
+    auto b = a;
+    b.unset_span(0U, n_bits / 2U);
+    auto total = size_t{};
+
+    while (state.keep_running())
+    {
+        total += a.and_count(b);
+    }
+
+    state.set_items_per_iteration(n_bits);
+    do_not_optimize(total);
+}
+TR_BENCHMARK(BitfieldAndCount, 1024U, 65536U, 1048576U);
+
+// e.g. building the union of all peers' pieces
+void BitfieldOrAssign(State& state)
+{
+    auto const n_bits = state.arg();
+    auto const that = make_half_full_bitfield(n_bits);
+    auto bitfield = tr_bitfield{ n_bits };
+    bitfield.set(0U);
+
+    while (state.keep_running())
+    {
+        bitfield |= that;
+    }
+
+    state.set_items_per_iteration(n_bits);
+    do_not_optimize(bitfield.count());
+}
+TR_BENCHMARK(BitfieldOrAssign, 1024U, 65536U, 1048576U);
+} // namespace
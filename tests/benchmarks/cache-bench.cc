@@ -0,0 +1,96 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <array>
+#include <memory>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/block-info.h>
+#include <libtransmission/cache.h>
+#include <libtransmission/session.h>
+#include <libtransmission/torrent.h>
+
+#include "bench.h"
+
+using namespace libtransmission::bench;
+
+namespace
+{
+auto constexpr MiB = size_t{ 1024U * 1024U };
+
+// Write every block of the synthetic torrent through a cache of `arg` MiB,
+// then flush whatever is left so that each iteration does the same work.
+void CacheWriteBlock(State& state)
+{
+    auto bench = BenchSession{};
+    auto* const session = bench.session();
+    auto* const tor = bench.add_torrent(make_synthetic_metainfo());
+    if (tor == nullptr)
+    {
+        return;
+    }
+
+    bench.run_in_session_thread_and_wait([session, &state]() { session->cache->set_limit(state.arg() * MiB); });
+
+    while (state.keep_running())
+    {
+        bench.run_in_session_thread_and_wait(
+            [session, tor]()
+            {
+                for (tr_block_index_t block = 0U, n = tor->block_count(); block < n; ++block)
+                {
+                    auto data = std::make_unique<Cache::BlockData>(tor->block_size(block));
+                    session->cache->write_block(tor->id(), block, std::move(data));
+                }
+
+                session->cache->flush_torrent(tor);
+            });
+    }
+
+    state.set_bytes_per_iteration(tor->total_size());
+}
+TR_BENCHMARK(CacheWriteBlock, 4U, 64U);
+
+// Read every block of the synthetic torrent back through the cache
+void CacheReadBlock(State& state)
+{
+    auto bench = BenchSession{};
+    auto* const session = bench.session();
+    auto* const tor = bench.add_torrent(make_synthetic_metainfo());
+    if (tor == nullptr)
+    {
+        return;
+    }
+
+    bench.run_in_session_thread_and_wait(
+        [session, tor]()
+        {
+            for (tr_block_index_t block = 0U, n = tor->block_count(); block < n; ++block)
+            {
+                auto data = std::make_unique<Cache::BlockData>(tor->block_size(block));
+                session->cache->write_block(tor->id(), block, std::move(data));
+            }
+
+            session->cache->flush_torrent(tor);
+        });
+
+    while (state.keep_running())
+    {
+        bench.run_in_session_thread_and_wait(
+            [session, tor]()
+            {
+                auto buf = std::array<uint8_t, tr_block_info::BlockSize>{};
+                for (tr_block_index_t block = 0U, n = tor->block_count(); block < n; ++block)
+                {
+                    session->cache->read_block(tor, tor->block_loc(block), tor->block_size(block), std::data(buf));
+                }
+            });
+    }
+
+    state.set_bytes_per_iteration(tor->total_size());
+}
+TR_BENCHMARK(CacheReadBlock);
+} // namespace
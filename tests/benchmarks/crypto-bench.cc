@@ -0,0 +1,139 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <cstdint> // uint8_t
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/crypto-utils.h>
+#include <libtransmission/tr-arc4.h>
+
+#include "bench.h"
+
+using namespace libtransmission::bench;
+
+namespace
+{
+void Sha1Digest(State& state)
+{
+    auto const buf = std::string(state.arg(), 'x');
+    auto digest = tr_sha1_digest_t{};
+
+    while (state.keep_running())
+    {
+        digest = tr_sha1::digest(buf);
+    }
+
+    state.set_bytes_per_iteration(std::size(buf));
+    do_not_optimize(digest);
+}
+TR_BENCHMARK(Sha1Digest, 16U * 1024U, 256U * 1024U, 4U * 1024U * 1024U);
+
+// hash a piece the way tr_ioTestPiece() does: one block at a time
+void Sha1DigestByBlock(State& state)
+{
+    static auto constexpr BlockSize = size_t{ 16U * 1024U };
+
+    auto const buf = std::string(state.arg(), 'x');
+    auto digest = tr_sha1_digest_t{};
+
+    while (state.keep_running())
+    {
+        auto sha = tr_sha1_context{};
+        for (size_t offset = 0U; offset < std::size(buf); offset += BlockSize)
+        {
+            sha.add(std::data(buf) + offset, std::min(BlockSize, std::size(buf) - offset));
+        }
+        digest = sha.finish();
+    }
+
+    state.set_bytes_per_iteration(std::size(buf));
+    do_not_optimize(digest);
+}
+TR_BENCHMARK(Sha1DigestByBlock, 256U * 1024U, 4U * 1024U * 1024U);
+
+// same as Sha1DigestByBlock, but through the heap-allocated virtual wrapper
+void Sha1DigestByBlockVirtual(State& state)
+{
+    static auto constexpr BlockSize = size_t{ 16U * 1024U };
+
+    auto const buf = std::string(state.arg(), 'x');
+    auto digest = tr_sha1_digest_t{};
+
+    while (state.keep_running())
+    {
+        auto sha = tr_sha1::create();
+        for (size_t offset = 0U; offset < std::size(buf); offset += BlockSize)
+        {
+            sha->add(std::data(buf) + offset, std::min(BlockSize, std::size(buf) - offset));
+        }
+        digest = sha->finish();
+    }
+
+    state.set_bytes_per_iteration(std::size(buf));
+    do_not_optimize(digest);
+}
+TR_BENCHMARK(Sha1DigestByBlockVirtual, 256U * 1024U, 4U * 1024U * 1024U);
+
+// hash 16 pieces of `arg` bytes each in a single batch
+void Sha1Batch(State& state)
+{
+    static auto constexpr NPieces = size_t{ 16U };
+
+    auto const buf = std::string(state.arg() * NPieces, 'x');
+    auto pieces = std::vector<std::string_view>{};
+    for (size_t i = 0U; i < NPieces; ++i)
+    {
+        pieces.emplace_back(std::data(buf) + i * state.arg(), state.arg());
+    }
+
+    auto digests = std::vector<tr_sha1_digest_t>{};
+    while (state.keep_running())
+    {
+        digests = tr_sha1_batch(pieces);
+    }
+
+    state.set_bytes_per_iteration(std::size(buf));
+}
+TR_BENCHMARK(Sha1Batch, 256U * 1024U);
+
+void Sha256Digest(State& state)
+{
+    auto const buf = std::string(state.arg(), 'x');
+    auto digest = tr_sha256_digest_t{};
+
+    while (state.keep_running())
+    {
+        digest = tr_sha256::digest(buf);
+    }
+
+    state.set_bytes_per_iteration(std::size(buf));
+    do_not_optimize(digest);
+}
+TR_BENCHMARK(Sha256Digest, 16U * 1024U, 256U * 1024U);
+
+// the MSE stream cipher, as applied to each chunk of peer traffic
+void Arc4Process(State& state)
+{
+    static auto constexpr Key = std::string_view{ "benchmark key" };
+
+    auto const in = std::vector<uint8_t>(state.arg(), uint8_t{ 'x' });
+    auto out = std::vector<uint8_t>(state.arg());
+    auto arc4 = tr_arc4{ std::data(Key), std::size(Key) };
+
+    while (state.keep_running())
+    {
+        arc4.process(std::data(in), std::size(in), std::data(out));
+        do_not_optimize(out);
+    }
+
+    state.set_bytes_per_iteration(std::size(in));
+}
+TR_BENCHMARK(Arc4Process, 17U, 16U * 1024U, 256U * 1024U);
+} // namespace
@@ -0,0 +1,53 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <cstddef> // size_t
+#include <cstdint> // uint64_t
+#include <random>
+#include <vector>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/block-info.h>
+#include <libtransmission/file-piece-map.h>
+
+#include "bench.h"
+
+using namespace libtransmission::bench;
+
+namespace
+{
+// map every block of a torrent with `n_files` files of a few KiB each,
+// e.g. a dataset, to the file that holds it, as each read and write does
+void FilePieceMapFileOffset(State& state)
+{
+    auto const n_files = state.arg();
+    auto rng = std::mt19937{ options().seed };
+    auto file_sizes = std::vector<uint64_t>(n_files);
+    auto total_size = uint64_t{};
+    for (auto& file_size : file_sizes)
+    {
+        file_size = 1024U + rng() % 16384U;
+        total_size += file_size;
+    }
+
+    auto const block_info = tr_block_info{ total_size, options().piece_size };
+    auto const fpm = tr_file_piece_map{ block_info, std::data(file_sizes), std::size(file_sizes) };
+    auto const n_blocks = block_info.block_count();
+    auto sum = uint64_t{};
+
+    while (state.keep_running())
+    {
+        for (tr_block_index_t block = 0U; block < n_blocks; ++block)
+        {
+            sum += fpm.file_offset(block_info.block_loc(block).byte).index;
+        }
+    }
+
+    state.set_items_per_iteration(n_blocks);
+    do_not_optimize(sum);
+}
+TR_BENCHMARK(FilePieceMapFileOffset, 1024U, 200000U);
+} // namespace
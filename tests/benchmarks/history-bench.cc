@@ -0,0 +1,111 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <cstddef> // size_t
+#include <cstdint> // uint64_t
+#include <ctime> // time_t
+#include <memory>
+#include <vector>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/bandwidth.h>
+#include <libtransmission/history.h>
+
+#include "bench.h"
+
+using namespace libtransmission::bench;
+
+namespace
+{
+// In each simulated second, every peer gets this many reads
+// and its speed is asked for this many times, e.g. by the
+// bandwidth allocator, the rechoke, and RPC clients.
+auto constexpr AddsPerSecond = uint64_t{ 32U };
+auto constexpr QueriesPerSecond = uint64_t{ 8U };
+
+// Run `state.arg()` peers for a simulated second per iteration,
+// so the reported time per item is the cost per peer per second.
+template<typename Peer, typename AddFunc, typename QueryFunc>
+void per_peer_second(State& state, std::vector<Peer>& peers, AddFunc add, QueryFunc query)
+{
+    auto now_msec = uint64_t{ 1000000U };
+
+    while (state.keep_running())
+    {
+        for (uint64_t i = 0U; i < AddsPerSecond; ++i)
+        {
+            auto const now = now_msec + i * 1000U / AddsPerSecond;
+            for (auto& peer : peers)
+            {
+                add(peer, now);
+            }
+
+            if (i % (AddsPerSecond / QueriesPerSecond) == 0U)
+            {
+                for (auto& peer : peers)
+                {
+                    do_not_optimize(query(peer, now));
+                }
+            }
+        }
+
+        now_msec += 1000U;
+    }
+
+    state.set_items_per_iteration(std::size(peers));
+}
+
+void HistoryRollingSum(State& state)
+{
+    auto peers = std::vector<tr_rollingSum<8U, 250U>>(state.arg());
+    per_peer_second(
+        state,
+        peers,
+        [](auto& peer, uint64_t now) { peer.add(now, 16384U); },
+        [](auto& peer, uint64_t now) { return peer.sum(now); });
+}
+TR_BENCHMARK(HistoryRollingSum, 64U, 4096U);
+
+void HistoryEwmaRate(State& state)
+{
+    auto peers = std::vector<tr_ewmaRate>(state.arg(), tr_ewmaRate{ 2000U });
+    per_peer_second(
+        state,
+        peers,
+        [](auto& peer, uint64_t now) { peer.add(now, 16384U); },
+        [](auto const& peer, uint64_t now) { return peer.get(now); });
+}
+TR_BENCHMARK(HistoryEwmaRate, 64U, 4096U);
+
+void HistoryRecentHistory(State& state)
+{
+    auto peers = std::vector<tr_recentHistory<uint16_t>>(state.arg());
+    per_peer_second(
+        state,
+        peers,
+        [](auto& peer, uint64_t now) { peer.add(static_cast<time_t>(now / 1000U), 1U); },
+        [](auto const& peer, uint64_t now) { return peer.count(static_cast<time_t>(now / 1000U), 60U); });
+}
+TR_BENCHMARK(HistoryRecentHistory, 64U, 4096U);
+
+// the real thing, with raw and piece speeds in both directions
+void HistoryBandwidthSpeeds(State& state)
+{
+    auto peers = std::vector<std::unique_ptr<tr_bandwidth>>{};
+    for (size_t i = 0U; i < state.arg(); ++i)
+    {
+        peers.emplace_back(std::make_unique<tr_bandwidth>());
+    }
+
+    per_peer_second(
+        state,
+        peers,
+        [](auto& peer, uint64_t now) { peer->notify_bandwidth_consumed(TR_DOWN, 16384U, true, now); },
+        [](auto const& peer, uint64_t now)
+        { return peer->get_piece_speed_bytes_per_second(now, TR_DOWN) + peer->get_raw_speed_bytes_per_second(now, TR_UP); });
+}
+TR_BENCHMARK(HistoryBandwidthSpeeds, 64U, 4096U);
+} // namespace
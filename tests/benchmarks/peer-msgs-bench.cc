@@ -0,0 +1,127 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <cstddef> // size_t, std::byte
+#include <cstdint> // uint8_t, uint32_t
+#include <ratio>
+#include <vector>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/block-info.h>
+#include <libtransmission/peer-msgs-view.h>
+#include <libtransmission/tr-buffer.h>
+
+#include "bench.h"
+
+using namespace libtransmission::bench;
+
+namespace
+{
+using MessageBuffer = libtransmission::StackBuffer<tr_block_info::BlockSize + 16U, std::byte, std::ratio<5, 1>>;
+
+auto constexpr Have = uint8_t{ 4 };
+auto constexpr Request = uint8_t{ 6 };
+
+void add_uint32(std::vector<std::byte>& buf, uint32_t val)
+{
+    for (int shift = 24; shift >= 0; shift -= 8)
+    {
+        buf.push_back(static_cast<std::byte>((val >> shift) & 0xFFU));
+    }
+}
+
+// `n_messages` alternating HAVE and REQUEST messages,
+// e.g. what a leecher sends while downloading from us
+[[nodiscard]] std::vector<std::byte> make_messages(size_t n_messages)
+{
+    auto buf = std::vector<std::byte>{};
+    for (uint32_t i = 0U; i < n_messages; ++i)
+    {
+        if (i % 2U == 0U)
+        {
+            add_uint32(buf, 5U);
+            buf.push_back(std::byte{ Have });
+            add_uint32(buf, i);
+        }
+        else
+        {
+            add_uint32(buf, 13U);
+            buf.push_back(std::byte{ Request });
+            add_uint32(buf, i);
+            add_uint32(buf, 0U);
+            add_uint32(buf, tr_block_info::BlockSize);
+        }
+    }
+    return buf;
+}
+
+// read the messages one field at a time through BufferReader, and
+// copy each payload out before parsing it, as the general path does
+void PeerMessagesByReader(State& state)
+{
+    auto const messages = make_messages(state.arg());
+    auto sum = uint64_t{};
+
+    while (state.keep_running())
+    {
+        auto buf = MessageBuffer{ messages };
+        while (!std::empty(buf))
+        {
+            auto const message_len = buf.to_uint32();
+            auto const id = buf.to_uint8();
+            auto payload = MessageBuffer{};
+            auto const [space, space_len] = payload.reserve_space(message_len - 1U);
+            buf.to_buf(space, message_len - 1U);
+            payload.commit_space(message_len - 1U);
+
+            sum += id;
+            while (!std::empty(payload))
+            {
+                sum += payload.to_uint32();
+            }
+        }
+    }
+
+    state.set_items_per_iteration(state.arg());
+    do_not_optimize(sum);
+}
+TR_BENCHMARK(PeerMessagesByReader, 64U, 1024U);
+
+// parse the messages in place, as the batched path does
+void PeerMessagesByView(State& state)
+{
+    auto const messages = make_messages(state.arg());
+    auto sum = uint64_t{};
+
+    while (state.keep_running())
+    {
+        auto const* data = std::data(messages);
+        auto len = std::size(messages);
+        for (;;)
+        {
+            auto const message = libtransmission::PeerMessageView{ data, len };
+            if (!message.is_complete())
+            {
+                break;
+            }
+
+            sum += message.id();
+            auto payload = message.payload();
+            while (payload.size() != 0U)
+            {
+                sum += payload.to_uint32();
+            }
+
+            data += message.frame_len();
+            len -= message.frame_len();
+        }
+    }
+
+    state.set_items_per_iteration(state.arg());
+    do_not_optimize(sum);
+}
+TR_BENCHMARK(PeerMessagesByView, 64U, 1024U);
+} // namespace
@@ -0,0 +1,81 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <chrono>
+#include <cstddef> // size_t
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <event2/event.h>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/timer.h>
+#include <libtransmission/timer-ev.h>
+#include <libtransmission/timer-wheel.h>
+#include <libtransmission/utils-ev.h>
+
+#include "bench.h"
+
+using namespace libtransmission::bench;
+using namespace std::literals;
+
+namespace
+{
+using libtransmission::EvTimerMaker;
+using libtransmission::Timer;
+using libtransmission::WheelTimerMaker;
+
+// start `n` timers that won't fire during the benchmark,
+// like the per-peer and per-torrent timers in a busy session
+[[nodiscard]] std::vector<std::unique_ptr<Timer>> make_timers(libtransmission::TimerMaker& maker, size_t n, std::mt19937& rng)
+{
+    auto dist = std::uniform_int_distribution<int>{ 60, 600 };
+
+    auto timers = std::vector<std::unique_ptr<Timer>>{};
+    timers.reserve(n);
+    for (size_t i = 0U; i < n; ++i)
+    {
+        auto& timer = timers.emplace_back(maker.create([]() {}));
+        timer->start_single_shot(std::chrono::seconds{ dist(rng) });
+    }
+    return timers;
+}
+
+// restart timers with new intervals while `state.arg()` of them are running,
+// the way timeouts are pushed back whenever a peer sends something
+template<typename Maker>
+void timer_churn(State& state)
+{
+    auto const evbase = libtransmission::evhelpers::evbase_unique_ptr{ event_base_new() };
+    auto maker = Maker{ evbase.get() };
+    auto rng = std::mt19937{ options().seed };
+    auto timers = make_timers(maker, state.arg(), rng);
+    auto which = std::uniform_int_distribution<size_t>{ 0U, std::size(timers) - 1U };
+    auto interval = std::uniform_int_distribution<int>{ 60, 600 };
+
+    while (state.keep_running())
+    {
+        auto& timer = *timers[which(rng)];
+        timer.stop();
+        timer.start_single_shot(std::chrono::seconds{ interval(rng) });
+    }
+
+    state.set_items_per_iteration(1U);
+}
+
+void TimerChurnEv(State& state)
+{
+    timer_churn<EvTimerMaker>(state);
+}
+TR_BENCHMARK(TimerChurnEv, 1024U, 16384U, 131072U);
+
+void TimerChurnWheel(State& state)
+{
+    timer_churn<WheelTimerMaker>(state);
+}
+TR_BENCHMARK(TimerChurnWheel, 1024U, 16384U, 131072U);
+} // namespace
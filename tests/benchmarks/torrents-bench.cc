@@ -0,0 +1,125 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <cstddef> // size_t
+#include <ctime>
+#include <memory>
+#include <random>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/crypto-utils.h>
+#include <libtransmission/torrent.h>
+#include <libtransmission/torrent-metainfo.h>
+#include <libtransmission/torrents.h>
+
+#include "bench.h"
+
+using namespace libtransmission::bench;
+using namespace std::literals;
+
+namespace
+{
+// `n` magnet-only torrents with random info hashes
+class Torrents
+{
+public:
+    explicit Torrents(size_t n)
+    {
+        auto rng = std::mt19937{ options().seed };
+        owned_.reserve(n);
+
+        for (size_t i = 0U; i < n; ++i)
+        {
+            auto info_hash = tr_sha1_digest_t{};
+            std::generate(std::begin(info_hash), std::end(info_hash), [&rng]() { return static_cast<std::byte>(rng()); });
+
+            auto tm = tr_torrent_metainfo{};
+            auto const magnet = fmt::format("magnet:?xt=urn:btih:{:s}", tr_sha1_to_string(info_hash));
+            [[maybe_unused]] auto const ok = tm.parseMagnet(magnet);
+            owned_.emplace_back(std::make_unique<tr_torrent>(std::move(tm)));
+
+            auto* const tor = owned_.back().get();
+            tor->unique_id_ = torrents_.add(tor);
+            obfuscated_hashes_.emplace_back(tr_sha1::digest("req2"sv, tor->info_hash()));
+        }
+    }
+
+    Torrents(Torrents const&) = delete;
+    Torrents(Torrents&&) = delete;
+    Torrents& operator=(Torrents const&) = delete;
+    Torrents& operator=(Torrents&&) = delete;
+
+    ~Torrents()
+    {
+        for (auto const& tor : owned_)
+        {
+            torrents_.remove(tor.get(), time(nullptr));
+        }
+    }
+
+    [[nodiscard]] constexpr auto const& torrents() const noexcept
+    {
+        return torrents_;
+    }
+
+    [[nodiscard]] constexpr auto const& obfuscated_hashes() const noexcept
+    {
+        return obfuscated_hashes_;
+    }
+
+private:
+    std::vector<std::unique_ptr<tr_torrent>> owned_;
+    std::vector<tr_sha1_digest_t> obfuscated_hashes_;
+    tr_torrents torrents_;
+};
+
+// look up the torrent for each incoming encrypted handshake, as
+// tr_torrentFindFromObfuscatedHash() does, in a session with `arg` torrents
+void TorrentsGetFromObfuscated(State& state)
+{
+    auto const fixture = Torrents{ state.arg() };
+    auto const& hashes = fixture.obfuscated_hashes();
+    auto n_found = size_t{};
+
+    while (state.keep_running())
+    {
+        for (auto const& hash : hashes)
+        {
+            n_found += fixture.torrents().get_from_obfuscated(hash) != nullptr ? 1U : 0U;
+        }
+    }
+
+    state.set_items_per_iteration(std::size(hashes));
+    do_not_optimize(n_found);
+}
+TR_BENCHMARK(TorrentsGetFromObfuscated, 1000U, 30000U);
+
+// the same lookups done by walking the torrents until one matches, for comparison
+void TorrentsGetFromObfuscatedLinear(State& state)
+{
+    auto const fixture = Torrents{ state.arg() };
+    auto const& hashes = fixture.obfuscated_hashes();
+    auto n_found = size_t{};
+
+    while (state.keep_running())
+    {
+        for (auto const& hash : hashes)
+        {
+            n_found += std::find(std::begin(hashes), std::end(hashes), hash) != std::end(hashes) ? 1U : 0U;
+        }
+    }
+
+    state.set_items_per_iteration(std::size(hashes));
+    do_not_optimize(n_found);
+}
+TR_BENCHMARK(TorrentsGetFromObfuscatedLinear, 1000U, 30000U);
+} // namespace
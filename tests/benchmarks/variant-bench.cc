@@ -0,0 +1,233 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <cstddef> // size_t
+#include <cstdint> // int64_t
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/quark.h>
+#include <libtransmission/variant.h>
+
+#include "bench.h"
+
+using namespace libtransmission::bench;
+using namespace std::literals;
+
+namespace
+{
+// Something shaped like a `torrent-get` response for `n_torrents` torrents
+[[nodiscard]] std::string make_rpc_response_json(size_t n_torrents)
+{
+    auto top = tr_variant{};
+    tr_variantInitDict(&top, 2U);
+    tr_variantDictAddStrView(&top, TR_KEY_result, "success"sv);
+    auto* const args = tr_variantDictAddDict(&top, TR_KEY_arguments, 1U);
+    auto* const torrents = tr_variantDictAddList(args, TR_KEY_torrents, n_torrents);
+
+    for (size_t i = 0U; i < n_torrents; ++i)
+    {
+        auto* const tor = tr_variantListAddDict(torrents, 10U);
+        tr_variantDictAddInt(tor, TR_KEY_id, static_cast<int64_t>(i));
+        tr_variantDictAddStr(tor, TR_KEY_name, fmt::format("Synthetic Torrent Number {:d}", i));
+        tr_variantDictAddStr(tor, TR_KEY_hashString, fmt::format("{:040x}", i));
+        tr_variantDictAddInt(tor, TR_KEY_status, 6);
+        tr_variantDictAddInt(tor, TR_KEY_totalSize, static_cast<int64_t>(i * 1048576U));
+        tr_variantDictAddReal(tor, TR_KEY_percentDone, 0.5);
+        tr_variantDictAddInt(tor, TR_KEY_rateDownload, 1024);
+        tr_variantDictAddInt(tor, TR_KEY_rateUpload, 2048);
+        tr_variantDictAddBool(tor, TR_KEY_isFinished, false);
+        tr_variantDictAddStr(tor, TR_KEY_downloadDir, "/home/user/Downloads"sv);
+    }
+
+    auto json = tr_variantToStr(&top, TR_VARIANT_FMT_JSON_LEAN);
+    tr_variantClear(&top);
+    return json;
+}
+
+// Something shaped like a `torrent-add` request with `n_strings` strings
+// that need escaping, e.g. Windows paths and non-ASCII names
+[[nodiscard]] std::string make_rpc_request_json(size_t n_strings)
+{
+    auto top = tr_variant{};
+    tr_variantInitDict(&top, 3U);
+    tr_variantDictAddStrView(&top, TR_KEY_method, "torrent-add"sv);
+    tr_variantDictAddInt(&top, TR_KEY_tag, 1);
+    auto* const args = tr_variantDictAddDict(&top, TR_KEY_arguments, 2U);
+    tr_variantDictAddStrView(args, TR_KEY_download_dir, "C:\\Users\\user\\Downloads"sv);
+    auto* const labels = tr_variantDictAddList(args, TR_KEY_labels, n_strings);
+
+    for (size_t i = 0U; i < n_strings; ++i)
+    {
+        tr_variantListAddStr(labels, fmt::format("C:\\Torrents\\\"Überraschung\"\t{:d} — 日本語", i));
+    }
+
+    auto json = tr_variantToStr(&top, TR_VARIANT_FMT_JSON_LEAN);
+    tr_variantClear(&top);
+    return json;
+}
+
+void BencParse(State& state)
+{
+    auto const benc = make_synthetic_metainfo();
+
+    while (state.keep_running())
+    {
+        auto top = tr_variant{};
+        static_cast<void>(tr_variantFromBuf(&top, TR_VARIANT_PARSE_BENC | TR_VARIANT_PARSE_INPLACE, benc));
+        tr_variantClear(&top);
+    }
+
+    state.set_bytes_per_iteration(std::size(benc));
+}
+TR_BENCHMARK(BencParse);
+
+void BencSerialize(State& state)
+{
+    auto const benc = make_synthetic_metainfo();
+    auto top = tr_variant{};
+    static_cast<void>(tr_variantFromBuf(&top, TR_VARIANT_PARSE_BENC, benc));
+
+    while (state.keep_running())
+    {
+        do_not_optimize(tr_variantToStr(&top, TR_VARIANT_FMT_BENC));
+    }
+
+    tr_variantClear(&top);
+    state.set_bytes_per_iteration(std::size(benc));
+}
+TR_BENCHMARK(BencSerialize);
+
+void JsonParse(State& state)
+{
+    auto const json = make_rpc_response_json(state.arg());
+
+    while (state.keep_running())
+    {
+        auto top = tr_variant{};
+        static_cast<void>(tr_variantFromBuf(&top, TR_VARIANT_PARSE_JSON | TR_VARIANT_PARSE_INPLACE, json));
+        tr_variantClear(&top);
+    }
+
+    state.set_bytes_per_iteration(std::size(json));
+}
+TR_BENCHMARK(JsonParse, 100U, 10000U);
+
+void JsonParseArena(State& state)
+{
+    auto const json = make_rpc_response_json(state.arg());
+
+    while (state.keep_running())
+    {
+        auto arena = tr_variant_arena{};
+        auto top = tr_variant{};
+        static_cast<void>(
+            tr_variantFromBuf(&top, TR_VARIANT_PARSE_JSON | TR_VARIANT_PARSE_INPLACE, json, nullptr, nullptr, &arena));
+        tr_variantClear(&top);
+    }
+
+    state.set_bytes_per_iteration(std::size(json));
+}
+TR_BENCHMARK(JsonParseArena, 100U, 10000U);
+
+void JsonParseEscaped(State& state)
+{
+    auto const json = make_rpc_request_json(state.arg());
+
+    while (state.keep_running())
+    {
+        auto top = tr_variant{};
+        static_cast<void>(tr_variantFromBuf(&top, TR_VARIANT_PARSE_JSON | TR_VARIANT_PARSE_INPLACE, json));
+        tr_variantClear(&top);
+    }
+
+    state.set_bytes_per_iteration(std::size(json));
+}
+TR_BENCHMARK(JsonParseEscaped, 1000U);
+
+void JsonSerialize(State& state)
+{
+    auto const json = make_rpc_response_json(state.arg());
+    auto top = tr_variant{};
+    static_cast<void>(tr_variantFromBuf(&top, TR_VARIANT_PARSE_JSON, json));
+
+    while (state.keep_running())
+    {
+        do_not_optimize(tr_variantToStr(&top, TR_VARIANT_FMT_JSON_LEAN));
+    }
+
+    tr_variantClear(&top);
+    state.set_bytes_per_iteration(std::size(json));
+}
+TR_BENCHMARK(JsonSerialize, 100U, 10000U);
+
+void JsonSerializeEscaped(State& state)
+{
+    auto const json = make_rpc_request_json(state.arg());
+    auto top = tr_variant{};
+    static_cast<void>(tr_variantFromBuf(&top, TR_VARIANT_PARSE_JSON, json));
+
+    while (state.keep_running())
+    {
+        do_not_optimize(tr_variantToStr(&top, TR_VARIANT_FMT_JSON_LEAN));
+    }
+
+    tr_variantClear(&top);
+    state.set_bytes_per_iteration(std::size(json));
+}
+TR_BENCHMARK(JsonSerializeEscaped, 1000U);
+
+void JsonSerializeSharded(State& state)
+{
+    auto const json = make_rpc_response_json(20000U);
+    auto top = tr_variant{};
+    static_cast<void>(tr_variantFromBuf(&top, TR_VARIANT_PARSE_JSON, json));
+
+    while (state.keep_running())
+    {
+        do_not_optimize(tr_variantToStrJsonSharded(&top, state.arg()));
+    }
+
+    tr_variantClear(&top);
+    state.set_bytes_per_iteration(std::size(json));
+}
+TR_BENCHMARK(JsonSerializeSharded, 1U, 2U, 4U);
+
+// look up every key in a dict with `arg` keys, as settings and resume loading do
+void DictFind(State& state)
+{
+    auto const n_keys = state.arg();
+    auto keys = std::vector<tr_quark>{};
+    keys.reserve(n_keys);
+    auto top = tr_variant{};
+    tr_variantInitDict(&top, n_keys);
+    for (size_t i = 0; i < n_keys; ++i)
+    {
+        keys.push_back(tr_quark_new(fmt::format("bench-key-{:d}", i)));
+        tr_variantDictAddInt(&top, keys.back(), static_cast<int64_t>(i));
+    }
+
+    auto sum = int64_t{};
+    while (state.keep_running())
+    {
+        for (auto const key : keys)
+        {
+            auto val = int64_t{};
+            (void)tr_variantDictFindInt(&top, key, &val);
+            sum += val;
+        }
+    }
+
+    tr_variantClear(&top);
+    state.set_items_per_iteration(n_keys);
+    do_not_optimize(sum);
+}
+TR_BENCHMARK(DictFind, 8U, 150U, 1000U);
+} // namespace
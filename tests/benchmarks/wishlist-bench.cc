@@ -0,0 +1,189 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <cstddef> // size_t
+#include <cstdint> // uint64_t
+#include <optional>
+#include <random>
+#include <vector>
+
+#define LIBTRANSMISSION_PEER_MODULE
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/bitfield.h>
+#include <libtransmission/block-info.h>
+#include <libtransmission/peer-mgr-wishlist.h>
+
+#include "bench.h"
+
+using namespace libtransmission::bench;
+
+namespace
+{
+// A torrent shaped like `options()` that we already have about half of,
+// with a few pieces at each priority and a spread of availability.
+class SyntheticMediator final : public Wishlist::Mediator
+{
+public:
+    explicit SyntheticMediator(bool is_sequential)
+        : block_info_{ uint64_t{ options().n_pieces } * options().piece_size, options().piece_size }
+        , have_{ block_info_.block_count() }
+        , priorities_(block_info_.piece_count(), TR_PRI_NORMAL)
+        , availability_(block_info_.piece_count())
+        , is_sequential_{ is_sequential }
+    {
+        auto rng = std::mt19937{ options().seed };
+        for (tr_piece_index_t piece = 0U, n = block_info_.piece_count(); piece < n; ++piece)
+        {
+            if ((rng() & 1U) != 0U)
+            {
+                auto const [begin, end] = block_info_.block_span_for_piece(piece);
+                have_.set_span(begin, end);
+            }
+
+            availability_[piece] = rng() % 50U;
+
+            if (auto const roll = rng() % 16U; roll == 0U)
+            {
+                priorities_[piece] = TR_PRI_HIGH;
+            }
+            else if (roll == 1U)
+            {
+                priorities_[piece] = TR_PRI_LOW;
+            }
+        }
+    }
+
+    [[nodiscard]] bool clientHasBlock(tr_block_index_t block) const override
+    {
+        return have_.test(block);
+    }
+
+    [[nodiscard]] bool clientWantsPiece(tr_piece_index_t /*piece*/) const override
+    {
+        return true;
+    }
+
+    [[nodiscard]] bool isEndgame() const override
+    {
+        return false;
+    }
+
+    [[nodiscard]] bool isSequentialDownload() const override
+    {
+        return is_sequential_;
+    }
+
+    [[nodiscard]] size_t countActiveRequests(tr_block_index_t /*block*/) const override
+    {
+        return 0U;
+    }
+
+    [[nodiscard]] size_t countMissingBlocks(tr_piece_index_t piece) const override
+    {
+        auto const [begin, end] = block_info_.block_span_for_piece(piece);
+        return (end - begin) - have_.count(begin, end);
+    }
+
+    [[nodiscard]] tr_block_span_t blockSpan(tr_piece_index_t piece) const override
+    {
+        return block_info_.block_span_for_piece(piece);
+    }
+
+    [[nodiscard]] tr_piece_index_t countAllPieces() const override
+    {
+        return block_info_.piece_count();
+    }
+
+    [[nodiscard]] tr_priority_t priority(tr_piece_index_t piece) const override
+    {
+        return priorities_[piece];
+    }
+
+    [[nodiscard]] size_t countPeersWithPiece(tr_piece_index_t piece) const override
+    {
+        return availability_[piece];
+    }
+
+    // nothing is being streamed, so no piece has a deadline
+    [[nodiscard]] std::optional<uint64_t> pieceDeadline(tr_piece_index_t /*piece*/) const override
+    {
+        return {};
+    }
+
+    [[nodiscard]] uint64_t now() const override
+    {
+        return 0U;
+    }
+
+    // not in endgame and nothing is urgent, so nothing gets requested twice
+    [[nodiscard]] size_t countDuplicatesAllowed() const override
+    {
+        return 0U;
+    }
+
+private:
+    tr_block_info const block_info_;
+    tr_bitfield have_;
+    std::vector<tr_priority_t> priorities_;
+    std::vector<size_t> availability_;
+    bool const is_sequential_;
+};
+
+[[nodiscard]] bool peer_has_all_pieces(tr_piece_index_t /*piece*/)
+{
+    return true;
+}
+
+[[nodiscard]] bool no_active_requests_to_peer(tr_block_index_t /*block*/)
+{
+    return false;
+}
+
+void WishlistNext(State& state)
+{
+    auto const mediator = SyntheticMediator{ false };
+    auto wishlist = Wishlist{ mediator };
+
+    while (state.keep_running())
+    {
+        do_not_optimize(wishlist.next(state.arg(), peer_has_all_pieces, no_active_requests_to_peer));
+    }
+
+    state.set_items_per_iteration(state.arg());
+}
+TR_BENCHMARK(WishlistNext, 1U, 64U, 512U);
+
+void WishlistNextSequential(State& state)
+{
+    auto const mediator = SyntheticMediator{ true };
+    auto wishlist = Wishlist{ mediator };
+
+    while (state.keep_running())
+    {
+        do_not_optimize(wishlist.next(state.arg(), peer_has_all_pieces, no_active_requests_to_peer));
+    }
+
+    state.set_items_per_iteration(state.arg());
+}
+TR_BENCHMARK(WishlistNextSequential, 64U);
+
+// the first call after an invalidate() rebuilds the whole candidate list
+void WishlistRebuild(State& state)
+{
+    auto const mediator = SyntheticMediator{ false };
+    auto wishlist = Wishlist{ mediator };
+
+    while (state.keep_running())
+    {
+        wishlist.invalidate();
+        do_not_optimize(wishlist.next(state.arg(), peer_has_all_pieces, no_active_requests_to_peer));
+    }
+
+    state.set_items_per_iteration(mediator.countAllPieces());
+}
+TR_BENCHMARK(WishlistRebuild, 64U);
+} // namespace
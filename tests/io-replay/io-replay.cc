@@ -0,0 +1,616 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+// Replays an I/O trace that was recorded with the `io-trace-file` setting
+// through the cache and the disk I/O layer, so that cache sizes, open file
+// limits, and write backends can be compared on a real workload.
+//
+// Each traced torrent is recreated with the same piece size and file sizes
+// in a scratch directory. Its files are created sparse at their full size,
+// and the pieces that the trace never writes are marked as downloaded so
+// that the cache treats them as seeding data.
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef> // size_t
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <future>
+#include <map>
+#include <memory>
+#include <optional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/cache.h>
+#include <libtransmission/error.h>
+#include <libtransmission/file.h>
+#include <libtransmission/io-trace.h>
+#include <libtransmission/log.h>
+#include <libtransmission/quark.h>
+#include <libtransmission/session.h>
+#include <libtransmission/torrent.h>
+#include <libtransmission/tr-getopt.h>
+#include <libtransmission/tr-strbuf.h>
+#include <libtransmission/utils.h>
+#include <libtransmission/variant.h>
+
+using namespace std::literals;
+
+namespace
+{
+using Clock = std::chrono::steady_clock;
+using Op = tr_io_trace::Op;
+
+char constexpr MyName[] = "transmission-io-replay";
+char constexpr Usage[] = "Usage: transmission-io-replay [options] <trace-file>";
+
+auto constexpr Options = std::array<tr_option, 8>{
+    { { 'c', "cache-size", "Memory cache size, in MiB (default: 4)", "c", true, "<MiB>" },
+      { 'r', "read-cache-size", "Read cache size, in MiB (default: 8)", "r", true, "<MiB>" },
+      { 'o', "open-file-limit", "How many files to keep open (default: 32)", "o", true, "<count>" },
+      { 'a', "async-writes", "Write evicted blocks in a background thread", "a", false, nullptr },
+      { 'D', "direct-io", "Keep torrent data out of the OS page cache", "D", false, nullptr },
+      { 's', "speed", "Replay speed; 1 for the traced timing, 0 for as fast as possible (default: 0)", "s", true, "<factor>" },
+      { 'd', "dir", "Where to put the scratch data (default: $TMPDIR)", "d", true, "<dir>" },
+      { 0, nullptr, nullptr, nullptr, false, nullptr } }
+};
+
+auto constexpr OpNames = std::array<std::string_view, 6>{
+    "torrent"sv, "read"sv, "write"sv, "prefetch"sv, "flush-file"sv, "flush-torrent"sv,
+};
+
+struct app_options
+{
+    std::string_view filename;
+    std::string_view scratch_dir;
+    size_t cache_size_mb = 4U;
+    size_t read_cache_size_mb = 8U;
+    size_t open_file_limit = 32U;
+    double speed = 0.0;
+    bool async_writes = false;
+    bool direct_io = false;
+};
+
+bool parse_command_line(app_options& opts, int argc, char const* const* argv)
+{
+    int c;
+    char const* optarg;
+
+    while ((c = tr_getopt(Usage, argc, argv, std::data(Options), &optarg)) != TR_OPT_DONE)
+    {
+        switch (c)
+        {
+        case 'c':
+            opts.cache_size_mb = tr_num_parse<size_t>(optarg).value_or(opts.cache_size_mb);
+            break;
+
+        case 'r':
+            opts.read_cache_size_mb = tr_num_parse<size_t>(optarg).value_or(opts.read_cache_size_mb);
+            break;
+
+        case 'o':
+            opts.open_file_limit = tr_num_parse<size_t>(optarg).value_or(opts.open_file_limit);
+            break;
+
+        case 'a':
+            opts.async_writes = true;
+            break;
+
+        case 'D':
+            opts.direct_io = true;
+            break;
+
+        case 's':
+            opts.speed = std::max(0.0, tr_num_parse<double>(optarg).value_or(0.0));
+            break;
+
+        case 'd':
+            opts.scratch_dir = optarg;
+            break;
+
+        case TR_OPT_UNK:
+            opts.filename = optarg;
+            break;
+
+        default:
+            return false;
+        }
+    }
+
+    return !std::empty(opts.filename);
+}
+
+void remove_recursive(std::string const& path)
+{
+    if (auto const info = tr_sys_path_get_info(path); info && info->isFolder())
+    {
+        if (auto const odir = tr_sys_dir_open(path); odir != TR_BAD_SYS_DIR)
+        {
+            for (char const* name = nullptr; (name = tr_sys_dir_read_name(odir)) != nullptr;)
+            {
+                if ("."sv != name && ".."sv != name)
+                {
+                    remove_recursive(fmt::format("{:s}/{:s}", path, name));
+                }
+            }
+
+            tr_sys_dir_close(odir);
+        }
+    }
+
+    tr_sys_path_remove(path);
+}
+
+[[nodiscard]] std::string make_metainfo(tr_io_trace::Layout const& layout, std::mt19937& rng)
+{
+    auto total_size = uint64_t{};
+    for (auto const size : layout.file_sizes)
+    {
+        total_size += size;
+    }
+
+    // the hashes don't matter, since nothing is ever verified
+    auto const n_pieces = std::max(uint64_t{ 1U }, (total_size + layout.piece_size - 1U) / layout.piece_size);
+    auto pieces = std::string(n_pieces * sizeof(tr_sha1_digest_t), '\0');
+    std::generate(std::begin(pieces), std::end(pieces), [&rng]() { return static_cast<char>(rng()); });
+
+    auto top = tr_variant{};
+    tr_variantInitDict(&top, 1U);
+
+    auto* const info = tr_variantDictAddDict(&top, TR_KEY_info, 4U);
+    tr_variantDictAddStr(info, TR_KEY_name, fmt::format("torrent-{:d}", layout.tor_id));
+    tr_variantDictAddInt(info, TR_KEY_piece_length, layout.piece_size);
+    tr_variantDictAddRaw(info, TR_KEY_pieces, std::data(pieces), std::size(pieces));
+
+    auto* const files = tr_variantDictAddList(info, TR_KEY_files, std::size(layout.file_sizes));
+    for (size_t i = 0U; i < std::size(layout.file_sizes); ++i)
+    {
+        auto* const file = tr_variantListAddDict(files, 2U);
+        tr_variantDictAddInt(file, TR_KEY_length, layout.file_sizes[i]);
+        auto* const path = tr_variantDictAddList(file, TR_KEY_path, 1U);
+        tr_variantListAddStr(path, fmt::format("file-{:05d}.bin", i));
+    }
+
+    auto benc = tr_variantToStr(&top, TR_VARIANT_FMT_BENC);
+    tr_variantClear(&top);
+    return benc;
+}
+
+// ---
+
+class Replay
+{
+public:
+    Replay(app_options const& opts, tr_io_trace::Trace trace)
+        : opts_{ opts }
+        , trace_{ std::move(trace) }
+        , sandbox_dir_{ create_sandbox(opts.scratch_dir) }
+    {
+        auto const download_dir = tr_pathbuf{ sandbox_dir_, "/Downloads"sv };
+        tr_sys_dir_create(download_dir, TR_SYS_DIR_CREATE_PARENTS, 0700);
+
+        auto settings = tr_variant{};
+        tr_variantInitDict(&settings, 14U);
+        tr_variantDictAddStr(&settings, TR_KEY_download_dir, download_dir);
+        tr_variantDictAddBool(&settings, TR_KEY_dht_enabled, false);
+        tr_variantDictAddBool(&settings, TR_KEY_lpd_enabled, false);
+        tr_variantDictAddBool(&settings, TR_KEY_pex_enabled, false);
+        tr_variantDictAddBool(&settings, TR_KEY_utp_enabled, false);
+        tr_variantDictAddBool(&settings, TR_KEY_port_forwarding_enabled, false);
+        tr_variantDictAddBool(&settings, TR_KEY_peer_port_random_on_start, true);
+        tr_variantDictAddBool(&settings, TR_KEY_rename_partial_files, false);
+        tr_variantDictAddInt(&settings, TR_KEY_cache_size_mb, opts.cache_size_mb);
+        tr_variantDictAddInt(&settings, TR_KEY_read_cache_size_mb, opts.read_cache_size_mb);
+        tr_variantDictAddInt(&settings, TR_KEY_open_file_limit, opts.open_file_limit);
+        tr_variantDictAddBool(&settings, TR_KEY_cache_async_writes, opts.async_writes);
+        tr_variantDictAddBool(&settings, TR_KEY_direct_io_enabled, opts.direct_io);
+        tr_variantDictAddInt(&settings, TR_KEY_message_level, TR_LOG_ERROR);
+        session_ = tr_sessionInit(sandbox_dir_.c_str(), false, &settings);
+        tr_variantClear(&settings);
+    }
+
+    ~Replay()
+    {
+        tr_sessionClose(session_);
+        remove_recursive(sandbox_dir_);
+    }
+
+    Replay(Replay const&) = delete;
+    Replay(Replay&&) = delete;
+    Replay& operator=(Replay const&) = delete;
+    Replay& operator=(Replay&&) = delete;
+
+    bool add_torrents()
+    {
+        auto rng = std::mt19937{ 1U };
+        auto* const ctor = tr_ctorNew(session_);
+        tr_ctorSetPaused(ctor, TR_FORCE, true);
+
+        for (auto const& layout : trace_.torrents)
+        {
+            auto const benc = make_metainfo(layout, rng);
+            tr_error* error = nullptr;
+            if (!tr_ctorSetMetainfo(ctor, std::data(benc), std::size(benc), &error))
+            {
+                fmt::print(stderr, "Couldn't recreate torrent {:d}: {:s}\n", layout.tor_id, error->message);
+                tr_error_free(error);
+                continue;
+            }
+
+            auto* const tor = tr_torrentNew(ctor, nullptr);
+            if (tor == nullptr)
+            {
+                continue;
+            }
+
+            auto& replayed = torrents_[layout.tor_id];
+            replayed.tor = tor;
+            for (auto const size : layout.file_sizes)
+            {
+                replayed.file_begins.push_back(replayed.total_size);
+                replayed.total_size += size;
+            }
+
+            create_files(tor);
+        }
+
+        tr_ctorFree(ctor);
+
+        run_in_session_thread([this]() { mark_seeding_pieces(); });
+        return !std::empty(torrents_);
+    }
+
+    void run()
+    {
+        auto const& events = trace_.events;
+        auto const started_at = Clock::now();
+
+        for (size_t begin = 0U; begin < std::size(events);)
+        {
+            // With a speed, wait until the next event is due and then run the
+            // ones that are due by now. Otherwise, run them in batches, leaving
+            // the session thread free in between for its timers and async writes.
+            auto end = begin + 1U;
+            if (opts_.speed > 0.0)
+            {
+                auto const due_at = [&](size_t i)
+                {
+                    return started_at +
+                        std::chrono::duration_cast<Clock::duration>(
+                               std::chrono::duration<double, std::micro>{ events[i].time.count() / opts_.speed });
+                };
+
+                std::this_thread::sleep_until(due_at(begin));
+                auto const now = Clock::now();
+                while (end < std::size(events) && end - begin < MaxBatchSize && due_at(end) <= now)
+                {
+                    ++end;
+                }
+            }
+            else
+            {
+                end = std::min(std::size(events), begin + MaxBatchSize);
+            }
+
+            run_in_session_thread([this, begin, end]() { replay(begin, end); });
+            begin = end;
+        }
+
+        // and write out what's left in the cache
+        auto const flush_started_at = Clock::now();
+        run_in_session_thread(
+            [this]()
+            {
+                for (auto& [id, replayed] : torrents_)
+                {
+                    session_->cache->flush_torrent(replayed.tor);
+                }
+            });
+
+        auto const finished_at = Clock::now();
+        elapsed_ = finished_at - started_at;
+        final_flush_ = finished_at - flush_started_at;
+    }
+
+    void print_report()
+    {
+        fmt::print("replayed {:d} events in {:.2f} s", std::size(trace_.events), std::chrono::duration<double>{ elapsed_ }.count());
+        if (!std::empty(trace_.events))
+        {
+            fmt::print(" (traced over {:.2f} s)", std::chrono::duration<double>{ trace_.events.back().time }.count());
+        }
+        fmt::print("; final flush took {:.1f} ms\n\n", std::chrono::duration<double, std::milli>{ final_flush_ }.count());
+
+        fmt::print(
+            "{:<14s} {:>9s} {:>7s} {:>11s} {:>11s} {:>11s} {:>11s}\n",
+            "op",
+            "count",
+            "errors",
+            "p50 us",
+            "p99 us",
+            "max us",
+            "total ms");
+        for (size_t op = 1U; op < std::size(stats_); ++op)
+        {
+            auto& stats = stats_[op];
+            if (std::empty(stats.usec))
+            {
+                continue;
+            }
+
+            auto total = uint64_t{};
+            for (auto const usec : stats.usec)
+            {
+                total += usec;
+            }
+
+            std::sort(std::begin(stats.usec), std::end(stats.usec));
+            auto const percentile = [&stats](double p)
+            {
+                return stats.usec[std::min(std::size(stats.usec) - 1U, static_cast<size_t>(p * std::size(stats.usec)))];
+            };
+            fmt::print(
+                "{:<14s} {:>9d} {:>7d} {:>11d} {:>11d} {:>11d} {:>11.1f}\n",
+                OpNames[op],
+                std::size(stats.usec),
+                stats.n_errors,
+                percentile(0.5),
+                percentile(0.99),
+                stats.usec.back(),
+                total / 1000.0);
+        }
+
+        if (n_skipped_ != 0U)
+        {
+            fmt::print("\nskipped {:d} events outside of their torrents\n", n_skipped_);
+        }
+
+        auto flush_stats = Cache::FlushStats{};
+        auto read_stats = decltype(session_->cache->read_stats()){};
+        run_in_session_thread(
+            [this, &flush_stats, &read_stats]()
+            {
+                flush_stats = session_->cache->flush_stats();
+                read_stats = session_->cache->read_stats();
+            });
+
+        fmt::print(
+            "\ncache flushes:  {:d} writes, {:.1f} MiB, {:d} ms\n",
+            flush_stats.n_writes,
+            flush_stats.n_bytes / 1048576.0,
+            flush_stats.msec);
+        fmt::print(
+            "read cache:     {:d} hits, {:d} misses; {:d} evicted used, {:d} evicted unused\n",
+            read_stats.hits,
+            read_stats.misses,
+            read_stats.evicted_used,
+            read_stats.evicted_unused);
+    }
+
+private:
+    static auto constexpr MaxBatchSize = size_t{ 256U };
+
+    struct Replayed
+    {
+        tr_torrent* tor = nullptr;
+        std::vector<uint64_t> file_begins;
+        uint64_t total_size = 0;
+    };
+
+    struct Stats
+    {
+        std::vector<uint64_t> usec;
+        size_t n_errors = 0;
+    };
+
+    [[nodiscard]] static std::string create_sandbox(std::string_view parent)
+    {
+        auto const* const tmpdir = getenv("TMPDIR");
+        auto path = fmt::format(
+            "{:s}/transmission-io-replay-XXXXXX",
+            !std::empty(parent) ? parent : tmpdir != nullptr ? tmpdir : "/tmp"sv);
+        tr_sys_dir_create_temp(std::data(path));
+        return path;
+    }
+
+    template<typename Func>
+    void run_in_session_thread(Func&& func)
+    {
+        auto promise = std::promise<void>{};
+        auto future = promise.get_future();
+        session_->runInSessionThread(
+            [&promise, &func]()
+            {
+                func();
+                promise.set_value();
+            });
+        future.wait();
+    }
+
+    static void create_files(tr_torrent const* tor)
+    {
+        for (tr_file_index_t file = 0, n = tor->file_count(); file < n; ++file)
+        {
+            auto const path = tr_pathbuf{ tor->download_dir(), '/', tor->file_subpath(file) };
+            tr_sys_dir_create(std::string{ tr_sys_path_dirname(path) }, TR_SYS_DIR_CREATE_PARENTS, 0700);
+
+            if (auto const fd = tr_sys_file_open(path, TR_SYS_FILE_WRITE | TR_SYS_FILE_CREATE, 0600);
+                fd != TR_BAD_SYS_FILE)
+            {
+                tr_sys_file_truncate(fd, tor->file_size(file));
+                tr_sys_file_close(fd);
+            }
+        }
+    }
+
+    // @return where an event starts in its torrent, if it's inside it
+    [[nodiscard]] std::optional<uint64_t> byte_of(Replayed const& replayed, tr_io_trace::Event const& event) const
+    {
+        if (event.file >= std::size(replayed.file_begins))
+        {
+            return {};
+        }
+
+        auto const byte = replayed.file_begins[event.file] + event.offset;
+        if (event.length == 0U || byte + event.length > replayed.total_size)
+        {
+            return {};
+        }
+
+        return byte;
+    }
+
+    // Pieces that the trace writes to are being downloaded. The rest are
+    // assumed to be seeding data, which the read cache and read-ahead want.
+    void mark_seeding_pieces()
+    {
+        auto written = std::map<tr_torrent_id_t, std::vector<bool>>{};
+        for (auto const& event : trace_.events)
+        {
+            auto const iter = torrents_.find(event.tor_id);
+            if (event.op != Op::Write || iter == std::end(torrents_))
+            {
+                continue;
+            }
+
+            auto const* const tor = iter->second.tor;
+            if (auto const byte = byte_of(iter->second, event); byte)
+            {
+                auto& pieces = written[event.tor_id];
+                pieces.resize(tor->piece_count());
+                pieces[tor->byte_loc(*byte).piece] = true;
+            }
+        }
+
+        for (auto& [tor_id, replayed] : torrents_)
+        {
+            auto const& pieces = written[tor_id];
+            for (tr_piece_index_t piece = 0, n = replayed.tor->piece_count(); piece < n; ++piece)
+            {
+                replayed.tor->set_has_piece(piece, piece >= std::size(pieces) || !pieces[piece]);
+            }
+        }
+    }
+
+    void replay(size_t begin, size_t end)
+    {
+        auto& cache = *session_->cache;
+
+        for (size_t i = begin; i < end; ++i)
+        {
+            auto const& event = trace_.events[i];
+            auto const iter = torrents_.find(event.tor_id);
+            auto const byte = iter != std::end(torrents_) ? byte_of(iter->second, event) : std::nullopt;
+            if (!byte)
+            {
+                ++n_skipped_;
+                continue;
+            }
+
+            auto* const tor = iter->second.tor;
+            auto const loc = tor->byte_loc(*byte);
+            auto const len = static_cast<uint32_t>(std::min(event.length, uint64_t{ tr_block_info::BlockSize }));
+
+            auto const started_at = Clock::now();
+            auto err = 0;
+            switch (event.op)
+            {
+            case Op::Read:
+                buf_.resize(len);
+                err = cache.read_block(tor, loc, len, std::data(buf_));
+                break;
+
+            case Op::Write:
+                err = cache.write_block(tor->id(), loc.block, std::make_unique<Cache::BlockData>(len));
+                break;
+
+            case Op::Prefetch:
+                err = cache.prefetch_block(tor, loc, len);
+                break;
+
+            case Op::FlushFile:
+                err = cache.flush_file(tor, event.file);
+                break;
+
+            case Op::FlushTorrent:
+                err = cache.flush_torrent(tor);
+                break;
+
+            default:
+                break;
+            }
+
+            auto& stats = stats_[static_cast<size_t>(event.op)];
+            stats.usec.push_back(std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - started_at).count());
+            stats.n_errors += err != 0 ? 1U : 0U;
+        }
+    }
+
+    app_options const& opts_;
+    tr_io_trace::Trace const trace_;
+    std::string const sandbox_dir_;
+    tr_session* session_ = nullptr;
+
+    std::map<tr_torrent_id_t, Replayed> torrents_;
+    std::vector<uint8_t> buf_;
+
+    std::array<Stats, std::size(OpNames)> stats_;
+    size_t n_skipped_ = 0;
+
+    Clock::duration elapsed_ = {};
+    Clock::duration final_flush_ = {};
+};
+} // namespace
+
+int main(int argc, char** argv)
+{
+    auto opts = app_options{};
+    if (!parse_command_line(opts, argc, argv))
+    {
+        tr_getopt_usage(MyName, Usage, std::data(Options));
+        return EXIT_FAILURE;
+    }
+
+    tr_error* error = nullptr;
+    auto trace = tr_io_trace::load(opts.filename, &error);
+    if (!trace)
+    {
+        fmt::print(stderr, "Couldn't read '{:s}': {:s}\n", opts.filename, error->message);
+        tr_error_free(error);
+        return EXIT_FAILURE;
+    }
+
+    fmt::print(
+        "{:d} events on {:d} torrents; cache {:d} MiB, read cache {:d} MiB, {:d} open files{:s}{:s}\n",
+        std::size(trace->events),
+        std::size(trace->torrents),
+        opts.cache_size_mb,
+        opts.read_cache_size_mb,
+        opts.open_file_limit,
+        opts.async_writes ? ", async writes" : "",
+        opts.direct_io ? ", direct I/O" : "");
+
+    auto replay = Replay{ opts, std::move(*trace) };
+    if (!replay.add_torrents())
+    {
+        fmt::print(stderr, "The trace has no torrents\n");
+        return EXIT_FAILURE;
+    }
+
+    replay.run();
+    replay.print_report();
+    return EXIT_SUCCESS;
+}
@@ -706,3 +706,48 @@ TEST_F(AnnounceListTest, addAnnounceListWithMultiTier)
         "https://www.qux.com/announce\n"sv;
     EXPECT_EQ(Expected, announce_list.to_string());
 }
+
+TEST_F(AnnounceListTest, internSharesIdenticalLists)
+{
+    auto constexpr Trackers =
+        "https://www.foo.com/announce\n"
+        "\n"
+        "https://www.bar.com/announce\n"sv;
+
+    auto one = tr_announce_list{};
+    EXPECT_TRUE(one.parse(Trackers));
+    auto two = tr_announce_list{};
+    EXPECT_TRUE(two.parse(Trackers));
+    EXPECT_NE(one.at(0).id, two.at(0).id);
+
+    one.intern();
+    two.intern();
+    EXPECT_TRUE(one.is_interned());
+    EXPECT_TRUE(two.is_interned());
+    EXPECT_EQ(&one.at(0), &two.at(0));
+    EXPECT_EQ(one.at(0).id, two.at(0).id);
+
+    // changing one leaves the other alone
+    EXPECT_TRUE(two.add("https://www.baz.com/announce"sv));
+    EXPECT_FALSE(two.is_interned());
+    EXPECT_NE(&one.at(0), &two.at(0));
+    EXPECT_EQ(Trackers, one.to_string());
+    EXPECT_EQ(3U, std::size(two));
+
+    // a different list isn't shared
+    two.intern();
+    EXPECT_NE(&one.at(0), &two.at(0));
+}
+
+TEST_F(AnnounceListTest, copiesShareUntilChanged)
+{
+    auto one = tr_announce_list{};
+    EXPECT_TRUE(one.add("https://www.foo.com/announce"sv));
+
+    auto two = one;
+    EXPECT_EQ(&one.at(0), &two.at(0));
+
+    EXPECT_TRUE(two.remove(two.at(0).id));
+    EXPECT_TRUE(std::empty(two));
+    EXPECT_EQ(1U, std::size(one));
+}
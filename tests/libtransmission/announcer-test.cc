@@ -309,3 +309,42 @@ TEST_F(AnnouncerTest, parseHttpScrapeResponseMultiWithMissing)
     EXPECT_EQ(8, response.rows[2].leechers);
     EXPECT_EQ(9, response.rows[2].downloads);
 }
+
+TEST_F(AnnouncerTest, hostLimitAdaptsToTrackerResponses)
+{
+    auto limit = tr_announce_host_limit{};
+    EXPECT_EQ(tr_announce_host_limit::InitialInFlight, limit.max_in_flight());
+
+    // fill the initial window
+    while (limit.can_send())
+    {
+        limit.on_sent();
+    }
+    EXPECT_EQ(limit.max_in_flight(), limit.in_flight());
+
+    // fast responses open the window
+    limit.on_done(true, 100ms);
+    EXPECT_EQ(tr_announce_host_limit::InitialInFlight + 1U, limit.max_in_flight());
+    EXPECT_TRUE(limit.can_send());
+
+    // slow responses don't
+    limit.on_done(true, tr_announce_host_limit::FastResponse + 1ms);
+    EXPECT_EQ(tr_announce_host_limit::InitialInFlight + 1U, limit.max_in_flight());
+
+    // timeouts halve it, but never close it completely
+    for (int i = 0; i < 10; ++i)
+    {
+        limit.on_done(false, 45s);
+    }
+    EXPECT_EQ(1U, limit.max_in_flight());
+    EXPECT_EQ(0U, limit.in_flight());
+    EXPECT_TRUE(limit.can_send());
+
+    // and it never grows past the maximum
+    for (size_t i = 0; i < tr_announce_host_limit::MaxInFlight * 2U; ++i)
+    {
+        limit.on_sent();
+        limit.on_done(true, 10ms);
+    }
+    EXPECT_EQ(tr_announce_host_limit::MaxInFlight, limit.max_in_flight());
+}
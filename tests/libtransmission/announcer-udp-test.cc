@@ -31,6 +31,8 @@
 #include <libtransmission/announcer.h>
 #include <libtransmission/announcer-common.h>
 #include <libtransmission/crypto-utils.h> // for tr_rand_obj()
+#include <libtransmission/dns.h>
+#include <libtransmission/executor.h>
 #include <libtransmission/net.h>
 #include <libtransmission/peer-mgr.h> // for tr_pex
 #include <libtransmission/session.h> // tr_peerIdInit
@@ -83,6 +85,11 @@ protected:
             return {};
         }
 
+        [[nodiscard]] tr_dns& dns() override
+        {
+            return dns_;
+        }
+
         struct Sent
         {
             Sent() = default;
@@ -102,6 +109,9 @@ protected:
         std::deque<Sent> sent_;
 
         std::unique_ptr<event_base, void (*)(event_base*)> const event_base_;
+
+        tr_executor executor_{ 1U };
+        tr_dns dns_{ executor_ };
     };
 
     static void expectEqual(tr_scrape_response const& expected, tr_scrape_response const& actual)
@@ -378,6 +388,41 @@ TEST_F(AnnouncerUdpTest, canScrape)
     expectEqual(request, info_hashes);
 }
 
+TEST_F(AnnouncerUdpTest, refreshesConnectionBeforeItExpires)
+{
+    auto mediator = MockMediator{};
+    auto announcer = tr_announcer_udp::create(mediator);
+    auto upkeep_timer = createUpkeepTimer(mediator, announcer);
+
+    // tell announcer to scrape
+    auto [request, expected_response] = buildSimpleScrapeRequestAndResponse();
+    announcer->scrape(request, [](tr_scrape_response const& /*resp*/) {});
+
+    // connect and let the scrape go out with the first connection id
+    auto connect_transaction_id = parseConnectionRequest(waitForAnnouncerToSendMessage(mediator));
+    auto const old_connection_id = sendConnectionResponse(*announcer, connect_transaction_id);
+    auto [scrape_transaction_id, info_hashes] = parseScrapeRequest(waitForAnnouncerToSendMessage(mediator), old_connection_id);
+    expectEqual(request, info_hashes);
+
+    // move the clock close to -- but not past -- the connection's expiration.
+    // A new scrape should trigger a connection refresh, but it should not have
+    // to wait for the refresh: it goes out immediately with the old connection id.
+    tr_timeUpdate(tr_time() + 40);
+    announcer->scrape(request, [](tr_scrape_response const& /*resp*/) {});
+    ASSERT_EQ(2U, std::size(mediator.sent_));
+    connect_transaction_id = parseConnectionRequest(mediator.sent_.front().buf_);
+    std::tie(scrape_transaction_id, info_hashes) = parseScrapeRequest(mediator.sent_.back().buf_, old_connection_id);
+    expectEqual(request, info_hashes);
+    mediator.sent_.clear();
+
+    // once the tracker answers the refresh, new requests use the new connection id
+    auto const new_connection_id = sendConnectionResponse(*announcer, connect_transaction_id);
+    EXPECT_NE(old_connection_id, new_connection_id);
+    announcer->scrape(request, [](tr_scrape_response const& /*resp*/) {});
+    std::tie(scrape_transaction_id, info_hashes) = parseScrapeRequest(waitForAnnouncerToSendMessage(mediator), new_connection_id);
+    expectEqual(request, info_hashes);
+}
+
 TEST_F(AnnouncerUdpTest, canDestructCleanlyEvenWhenBusy)
 {
     auto mediator = MockMediator{};
@@ -447,6 +492,53 @@ TEST_F(AnnouncerUdpTest, canMultiScrape)
     expectEqual(expected_response, *response);
 }
 
+TEST_F(AnnouncerUdpTest, canMultiScrapeFullPacket)
+{
+    auto mediator = MockMediator{};
+    auto announcer = tr_announcer_udp::create(mediator);
+    auto upkeep_timer = createUpkeepTimer(mediator, announcer);
+
+    // BEP 15 fits 74 info hashes in a single scrape packet
+    auto expected_response = tr_scrape_response{};
+    expected_response.did_connect = true;
+    expected_response.did_timeout = false;
+    expected_response.row_count = TR_MULTISCRAPE_MAX;
+    for (int i = 0; i < expected_response.row_count; ++i)
+    {
+        expected_response.rows[i] = { tr_rand_obj<tr_sha1_digest_t>(), i, i + 1, i + 2, 0 };
+    }
+    expected_response.scrape_url = DefaultScrapeUrl;
+    expected_response.min_request_interval = 0;
+
+    auto request = buildScrapeRequestFromResponse(expected_response);
+    auto response = std::optional<tr_scrape_response>{};
+    announcer->scrape(request, [&response](tr_scrape_response const& resp) { response = resp; });
+
+    auto connect_transaction_id = parseConnectionRequest(waitForAnnouncerToSendMessage(mediator));
+    auto const connection_id = sendConnectionResponse(*announcer, connect_transaction_id);
+
+    auto [scrape_transaction_id, info_hashes] = parseScrapeRequest(waitForAnnouncerToSendMessage(mediator), connection_id);
+    expectEqual(request, info_hashes);
+
+    auto buf = MessageBuffer{};
+    buf.add_uint32(ScrapeAction);
+    buf.add_uint32(scrape_transaction_id);
+    for (int i = 0; i < expected_response.row_count; ++i)
+    {
+        buf.add_uint32(expected_response.rows[i].seeders);
+        buf.add_uint32(expected_response.rows[i].downloads);
+        buf.add_uint32(expected_response.rows[i].leechers);
+    }
+    auto response_size = std::size(buf);
+    auto arr = std::array<uint8_t, 1024>{};
+    buf.to_buf(std::data(arr), response_size);
+    EXPECT_TRUE(announcer->handle_message(std::data(arr), response_size));
+
+    EXPECT_TRUE(response.has_value());
+    assert(response.has_value());
+    expectEqual(expected_response, *response);
+}
+
 TEST_F(AnnouncerUdpTest, canHandleScrapeError)
 {
     // build the expected response
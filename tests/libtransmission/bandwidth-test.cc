@@ -0,0 +1,87 @@
+// This file Copyright (C) 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <cstddef> // size_t
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/bandwidth.h>
+#include <libtransmission/utils.h> // tr_time_msec()
+
+#include "gtest/gtest.h"
+
+namespace
+{
+auto constexpr Speed = tr_bytes_per_second_t{ 100000 };
+auto constexpr Burst = size_t{ Speed / 2U }; // default burst is 500 msec
+auto constexpr Lots = size_t{ 10U * 1024U * 1024U };
+} // namespace
+
+TEST(Bandwidth, unlimitedIsNotClamped)
+{
+    auto bandwidth = tr_bandwidth{};
+    EXPECT_EQ(Lots, bandwidth.clamp(TR_UP, Lots));
+    EXPECT_EQ(Lots, bandwidth.clamp(TR_DOWN, Lots));
+}
+
+TEST(Bandwidth, bucketStartsWithOneBurst)
+{
+    auto bandwidth = tr_bandwidth{};
+    bandwidth.set_limited(TR_UP, true);
+    bandwidth.set_desired_speed_bytes_per_second(TR_UP, Speed);
+
+    EXPECT_EQ(Burst, bandwidth.clamp(TR_UP, Lots));
+    EXPECT_EQ(100U, bandwidth.clamp(TR_UP, 100U));
+    EXPECT_EQ(Lots, bandwidth.clamp(TR_DOWN, Lots));
+}
+
+TEST(Bandwidth, consumingDebitsTheBucket)
+{
+    auto bandwidth = tr_bandwidth{};
+    bandwidth.set_limited(TR_UP, true);
+    bandwidth.set_desired_speed_bytes_per_second(TR_UP, Speed);
+    EXPECT_EQ(Burst, bandwidth.clamp(TR_UP, Lots));
+
+    // protocol overhead doesn't count against the limit
+    bandwidth.notify_bandwidth_consumed(TR_UP, Burst / 2U, false, tr_time_msec());
+    EXPECT_EQ(Burst, bandwidth.clamp(TR_UP, Lots));
+
+    // piece data does. Allow some slack for the bucket refilling
+    // in the time between these two lines.
+    bandwidth.notify_bandwidth_consumed(TR_UP, Burst / 2U, true, tr_time_msec());
+    auto const left = bandwidth.clamp(TR_UP, Lots);
+    EXPECT_LE(Burst / 2U, left + (Burst / 2U) / 5U); // the clamp may hold back up to 20% near the limit
+    EXPECT_GT(Burst, left);
+
+    // the bucket never goes negative
+    bandwidth.notify_bandwidth_consumed(TR_UP, Lots, true, tr_time_msec());
+    EXPECT_GT(Burst / 10U, bandwidth.clamp(TR_UP, Lots));
+}
+
+TEST(Bandwidth, childrenHonorParentLimits)
+{
+    auto parent = tr_bandwidth{};
+    parent.set_limited(TR_DOWN, true);
+    parent.set_desired_speed_bytes_per_second(TR_DOWN, Speed);
+
+    auto child = tr_bandwidth{ &parent };
+    EXPECT_EQ(Burst, child.clamp(TR_DOWN, Lots));
+
+    child.honor_parent_limits(TR_DOWN, false);
+    EXPECT_EQ(Lots, child.clamp(TR_DOWN, Lots));
+}
+
+TEST(Bandwidth, unclampedChildrenDoNotDebitParents)
+{
+    auto parent = tr_bandwidth{};
+    parent.set_limited(TR_DOWN, true);
+    parent.set_desired_speed_bytes_per_second(TR_DOWN, Speed);
+
+    auto child = tr_bandwidth{ &parent };
+    child.honor_parent_limits(TR_DOWN, false);
+    child.notify_bandwidth_consumed(TR_DOWN, Lots, true, tr_time_msec());
+    EXPECT_EQ(Burst, parent.clamp(TR_DOWN, Lots));
+    EXPECT_LT(0U, parent.get_piece_speed_bytes_per_second(tr_time_msec(), TR_DOWN));
+}
@@ -506,3 +506,168 @@ TEST(Bitfield, intersects)
     EXPECT_TRUE(a.intersects(b));
     EXPECT_TRUE(b.intersects(a));
 }
+
+TEST(Bitfield, andCount)
+{
+    auto a = tr_bitfield{ 1000 };
+    auto b = tr_bitfield{ 1000 };
+
+    a.set_has_all();
+    b.set_has_none();
+    EXPECT_EQ(0U, a.and_count(b));
+    EXPECT_EQ(0U, b.and_count(a));
+
+    a.set_has_all();
+    b.set_has_all();
+    EXPECT_EQ(std::size(a), a.and_count(b));
+
+    a.set_has_all();
+    b.set_has_none();
+    b.set_span(10U, 20U);
+    EXPECT_EQ(10U, a.and_count(b));
+    EXPECT_EQ(10U, b.and_count(a));
+
+    // spans that overlap at odd offsets, crossing word boundaries
+    a.set_has_none();
+    b.set_has_none();
+    a.set_span(3U, 700U);
+    b.set_span(501U, 997U);
+    EXPECT_EQ(199U, a.and_count(b));
+    EXPECT_EQ(199U, b.and_count(a));
+
+    a.set_has_none();
+    b.set_has_none();
+    for (size_t i = 0; i < std::size(a); ++i)
+    {
+        if (i % 3U == 0U)
+        {
+            a.set(i);
+        }
+        if (i % 5U == 0U)
+        {
+            b.set(i);
+        }
+    }
+    EXPECT_EQ(67U, a.and_count(b));
+    auto c = a;
+    c &= b;
+    EXPECT_EQ(c.count(), a.and_count(b));
+}
+
+TEST(Bitfield, largeBitfieldsMatchReferenceModel)
+{
+    // big enough to span many storage chunks, and not a multiple of 8
+    auto constexpr BitCount = size_t{ 100003U };
+    auto constexpr IterCount = int{ 200 };
+
+    auto bf = tr_bitfield{ BitCount };
+    auto ref = std::vector<bool>(BitCount);
+
+    auto const expect_matches = [&bf, &ref]()
+    {
+        auto const n_set = static_cast<size_t>(std::count(std::begin(ref), std::end(ref), true));
+        EXPECT_EQ(n_set, bf.count());
+        EXPECT_EQ(n_set == BitCount, bf.has_all());
+        EXPECT_EQ(n_set == 0U, bf.has_none());
+        EXPECT_TRUE(bf.is_valid());
+
+        auto const raw = bf.raw();
+        ASSERT_EQ((BitCount + 7U) / 8U, std::size(raw));
+        for (size_t i = 0; i < BitCount; ++i)
+        {
+            auto const raw_bit = (raw[i >> 3U] & (0x80 >> (i & 7U))) != 0;
+            ASSERT_EQ(ref[i], bf.test(i)) << i;
+            ASSERT_EQ(ref[i], raw_bit) << i;
+        }
+
+        for (int i = 0; i < 20; ++i)
+        {
+            auto begin = tr_rand_int(BitCount);
+            auto end = tr_rand_int(BitCount);
+            if (begin > end)
+            {
+                std::swap(begin, end);
+            }
+            if (begin == end)
+            {
+                continue;
+            }
+
+            auto const expected = static_cast<size_t>(std::count(std::begin(ref) + begin, std::begin(ref) + end, true));
+            EXPECT_EQ(expected, bf.count(begin, end));
+        }
+    };
+
+    for (int i = 0; i < IterCount; ++i)
+    {
+        auto const value = tr_rand_int(3U) != 0U; // mostly set, like a downloading torrent
+        if (tr_rand_int(2U) == 0U)
+        {
+            auto const bit = tr_rand_int(BitCount);
+            bf.set(bit, value);
+            ref[bit] = value;
+        }
+        else
+        {
+            auto begin = tr_rand_int(BitCount);
+            auto end = begin + tr_rand_int(BitCount / 4U);
+            bf.set_span(begin, end, value);
+            std::fill(std::begin(ref) + begin, std::begin(ref) + std::min(end, BitCount), value);
+        }
+
+        if (i % 20 == 0)
+        {
+            expect_matches();
+        }
+    }
+
+    expect_matches();
+
+    // round-trip through the raw format
+    auto copy = tr_bitfield{ BitCount };
+    auto const raw = bf.raw();
+    copy.set_raw(std::data(raw), std::size(raw));
+    EXPECT_EQ(raw, copy.raw());
+    EXPECT_EQ(bf.count(), copy.count());
+
+    // bitwise ops against a second bitfield
+    auto other = tr_bitfield{ BitCount };
+    auto other_ref = std::vector<bool>(BitCount);
+    other.set_span(BitCount / 3U, BitCount / 2U);
+    std::fill(std::begin(other_ref) + BitCount / 3U, std::begin(other_ref) + BitCount / 2U, true);
+    for (size_t i = 0; i < BitCount; i += 7U)
+    {
+        other.set(i);
+        other_ref[i] = true;
+    }
+
+    auto n_and = size_t{};
+    for (size_t i = 0; i < BitCount; ++i)
+    {
+        n_and += ref[i] && other_ref[i] ? 1U : 0U;
+    }
+    EXPECT_EQ(n_and, bf.and_count(other));
+    EXPECT_EQ(n_and != 0U, bf.intersects(other));
+
+    auto ored = bf;
+    ored |= other;
+    auto anded = bf;
+    anded &= other;
+    for (size_t i = 0; i < BitCount; ++i)
+    {
+        ASSERT_EQ(ref[i] || other_ref[i], ored.test(i)) << i;
+        ASSERT_EQ(ref[i] && other_ref[i], anded.test(i)) << i;
+    }
+    EXPECT_EQ(n_and, anded.count());
+
+    // a bitfield that's all set except for one bit, then all set
+    bf.set_has_all();
+    bf.unset(BitCount / 2U);
+    EXPECT_EQ(BitCount - 1U, bf.count());
+    EXPECT_FALSE(bf.test(BitCount / 2U));
+    EXPECT_EQ(BitCount - 1U, bf.count(0, BitCount));
+    EXPECT_TRUE(bf.is_valid());
+    bf.set(BitCount / 2U);
+    EXPECT_TRUE(bf.has_all());
+    EXPECT_EQ(BitCount, bf.count());
+}
@@ -0,0 +1,174 @@
+// This file Copyright (C) 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <cstdint> // uintptr_t
+#include <ctime> // time_t
+#include <memory>
+#include <vector>
+
+#include <libtransmission/block-info.h>
+#include <libtransmission/block-pool.h>
+#include <libtransmission/cache.h>
+
+#include "gtest/gtest.h"
+
+using BlockPoolTest = ::testing::Test;
+
+TEST_F(BlockPoolTest, reusesBuffers)
+{
+    auto pool = tr_block_pool{ 1024U };
+
+    auto* const a = pool.get();
+    auto* const b = pool.get();
+    EXPECT_NE(a, b);
+    pool.put(a);
+    pool.put(b);
+
+    auto stats = pool.stats();
+    EXPECT_EQ(0U, stats.hits);
+    EXPECT_EQ(2U, stats.misses);
+    EXPECT_EQ(2U, stats.n_free);
+
+    auto* const c = pool.get();
+    EXPECT_TRUE(c == a || c == b);
+    pool.put(c);
+
+    stats = pool.stats();
+    EXPECT_EQ(1U, stats.hits);
+    EXPECT_EQ(2U, stats.misses);
+    EXPECT_EQ(2U, stats.n_free);
+}
+
+TEST_F(BlockPoolTest, releasesIdleBuffers)
+{
+    auto pool = tr_block_pool{ 1024U };
+    auto now = time_t{ 1000 };
+
+    auto bufs = std::vector<void*>{};
+    for (int i = 0; i < 8; ++i)
+    {
+        bufs.emplace_back(pool.get());
+    }
+    for (auto* const buf : bufs)
+    {
+        pool.put(buf);
+    }
+
+    // the first release only starts the clock
+    pool.release_idle(now);
+    EXPECT_EQ(8U, pool.stats().n_free);
+
+    // use some of the buffers, but not all of them
+    now += tr_block_pool::IdleSecs;
+    auto* const a = pool.get();
+    auto* const b = pool.get();
+    pool.put(a);
+    pool.put(b);
+
+    // too soon to release anything
+    pool.release_idle(now - 1);
+    EXPECT_EQ(8U, pool.stats().n_free);
+
+    // the six buffers that sat idle the whole time should be freed
+    pool.release_idle(now);
+    EXPECT_EQ(2U, pool.stats().n_free);
+
+    // nothing was used in the next interval, so the rest go too
+    now += tr_block_pool::IdleSecs;
+    pool.release_idle(now);
+    EXPECT_EQ(0U, pool.stats().n_free);
+}
+
+TEST_F(BlockPoolTest, releasesAllFreeBuffers)
+{
+    auto pool = tr_block_pool{ 1024U };
+
+    auto* const a = pool.get();
+    auto* const b = pool.get();
+    pool.put(a);
+    EXPECT_EQ(1U, pool.stats().n_free);
+
+    // buffers that are in use are left alone
+    pool.release_all();
+    EXPECT_EQ(0U, pool.stats().n_free);
+
+    pool.put(b);
+    EXPECT_EQ(1U, pool.stats().n_free);
+}
+
+TEST_F(BlockPoolTest, alignsBuffers)
+{
+    static auto constexpr Alignment = size_t{ 4096U };
+    auto pool = tr_block_pool{ Alignment * 4U, Alignment };
+
+    auto bufs = std::vector<void*>{};
+    for (int i = 0; i < 4; ++i)
+    {
+        bufs.emplace_back(pool.get());
+        EXPECT_EQ(0U, reinterpret_cast<uintptr_t>(bufs.back()) % Alignment);
+    }
+    for (auto* const buf : bufs)
+    {
+        pool.put(buf);
+    }
+
+    pool.release_all();
+    EXPECT_EQ(0U, pool.stats().n_free);
+}
+
+TEST_F(BlockPoolTest, carvesBuffersFromSlabs)
+{
+    static auto constexpr BufferSize = size_t{ 1000U };
+    static auto constexpr Alignment = size_t{ 64U };
+    auto pool = tr_block_pool{ BufferSize, Alignment, tr_block_pool::Backing::Slabs };
+
+    auto* const a = pool.get();
+    auto* const b = pool.get();
+    EXPECT_NE(a, b);
+    EXPECT_EQ(0U, reinterpret_cast<uintptr_t>(a) % Alignment);
+    EXPECT_EQ(0U, reinterpret_cast<uintptr_t>(b) % Alignment);
+
+    auto stats = pool.stats();
+    if (stats.n_slabs == 0U) // couldn't map a slab here; fell back to the heap
+    {
+        pool.put(a);
+        pool.put(b);
+        return;
+    }
+
+    // one slab served both buffers, and holds the rest for later
+    auto constexpr NPerSlab = tr_block_pool::SlabSize / 1024U;
+    EXPECT_EQ(1U, stats.n_slabs);
+    EXPECT_EQ(1U, stats.misses);
+    EXPECT_EQ(1U, stats.hits);
+    EXPECT_EQ(NPerSlab - 2U, stats.n_free);
+
+    // a slab can't be released while any of its buffers are in use
+    pool.put(a);
+    pool.release_all();
+    EXPECT_EQ(1U, pool.stats().n_slabs);
+    EXPECT_EQ(NPerSlab - 1U, pool.stats().n_free);
+
+    pool.put(b);
+    pool.release_all();
+    stats = pool.stats();
+    EXPECT_EQ(0U, stats.n_slabs);
+    EXPECT_EQ(0U, stats.n_free);
+}
+
+TEST_F(BlockPoolTest, blockDataUsesPool)
+{
+    auto& pool = Cache::BlockData::pool();
+
+    auto block = std::make_unique<Cache::BlockData>(tr_block_info::BlockSize);
+    auto* const addr = block.get();
+    block.reset();
+
+    auto const stats = pool.stats();
+    block = std::make_unique<Cache::BlockData>(tr_block_info::BlockSize);
+    EXPECT_EQ(addr, block.get());
+    EXPECT_EQ(stats.hits + 1U, pool.stats().hits);
+    EXPECT_EQ(tr_block_info::BlockSize, std::size(*block));
+}
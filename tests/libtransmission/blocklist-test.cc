@@ -3,14 +3,19 @@
 // or any future license endorsed by Mnemosyne LLC.
 // License text can be found in the licenses/ folder.
 
+#include <algorithm> // std::count
+#include <array>
 #include <cstddef>
 #include <string_view>
+#include <vector>
 
 #include <libtransmission/transmission.h>
 
+#include <libtransmission/file.h>
 #include <libtransmission/net.h>
 #include <libtransmission/session.h> // tr_session.addressIsBlocked()
 #include <libtransmission/tr-strbuf.h>
+#include <libtransmission/utils.h> // tr_strv_ends_with()
 
 #include "gtest/gtest.h"
 #include "test-fixtures.h"
@@ -86,6 +91,109 @@ TEST_F(BlocklistTest, parsing)
     EXPECT_FALSE(addressIsBlocked("ffff::ffff"));
 }
 
+TEST_F(BlocklistTest, mergesMultipleLists)
+{
+    createFileWithContents(tr_pathbuf{ session_->configDir(), "/blocklists/level1"sv }, Contents1);
+    createFileWithContents(
+        tr_pathbuf{ session_->configDir(), "/blocklists/extra"sv },
+        "Overlaps level1:216.16.1.150-216.16.1.160\n"
+        "Evilcorp:216.88.88.0-216.88.88.255\n"
+        "IPv6 extra:2001:db9::-2001:db9::ffff\n");
+    tr_sessionReloadBlocklists(session_);
+    tr_blocklistSetEnabled(session_, true);
+
+    // each list keeps its own rule count
+    EXPECT_EQ(9U, tr_blocklistGetRuleCount(session_));
+
+    // rules from both lists are honored
+    EXPECT_TRUE(addressIsBlocked("10.1.2.3"));
+    EXPECT_TRUE(addressIsBlocked("216.16.1.144"));
+    EXPECT_TRUE(addressIsBlocked("216.16.1.155"));
+    EXPECT_TRUE(addressIsBlocked("216.16.1.160"));
+    EXPECT_FALSE(addressIsBlocked("216.16.1.161"));
+    EXPECT_TRUE(addressIsBlocked("216.88.88.88"));
+    EXPECT_FALSE(addressIsBlocked("216.88.89.0"));
+    EXPECT_TRUE(addressIsBlocked("2001:db8::1"));
+    EXPECT_TRUE(addressIsBlocked("2001:db9::1"));
+    EXPECT_FALSE(addressIsBlocked("2001:db9::1:0"));
+
+    // nothing is blocked while the blocklist is disabled
+    tr_blocklistSetEnabled(session_, false);
+    EXPECT_FALSE(addressIsBlocked("216.88.88.88"));
+}
+
+TEST_F(BlocklistTest, checksBatchesOfAddresses)
+{
+    createFileWithContents(tr_pathbuf{ session_->configDir(), "/blocklists/level1"sv }, Contents2);
+    tr_sessionReloadBlocklists(session_);
+    tr_blocklistSetEnabled(session_, true);
+
+    // more than one batch's worth, with the address types mixed together
+    static auto constexpr Addresses = std::array<std::string_view, 14>{
+        "0.0.0.1"sv,
+        "10.1.2.3"sv,
+        "2001:db8::1"sv,
+        "216.16.1.143"sv,
+        "216.16.1.144"sv,
+        "fe80::1337"sv,
+        "216.16.1.151"sv,
+        "216.16.1.152"sv,
+        "216.88.88.88"sv,
+        "216.88.89.0"sv,
+        "ffff::ffff"sv,
+        "255.0.0.1"sv,
+        "2001:db8::2"sv,
+        "216.79.131.200"sv,
+    };
+
+    auto addrs = std::vector<tr_address>{};
+    for (auto const& address_sv : Addresses)
+    {
+        auto const addr = tr_address::from_string(address_sv);
+        ASSERT_TRUE(addr) << address_sv;
+        addrs.emplace_back(*addr);
+    }
+
+    auto blocked = std::array<bool, std::size(Addresses)>{};
+    session_->addressesAreBlocked(std::data(addrs), std::size(addrs), std::data(blocked));
+    for (size_t i = 0; i < std::size(addrs); ++i)
+    {
+        EXPECT_EQ(session_->addressIsBlocked(addrs[i]), blocked[i]) << Addresses[i];
+    }
+    EXPECT_EQ(7, std::count(std::begin(blocked), std::end(blocked), true));
+
+    // nothing is blocked while the blocklist is disabled
+    tr_blocklistSetEnabled(session_, false);
+    session_->addressesAreBlocked(std::data(addrs), std::size(addrs), std::data(blocked));
+    EXPECT_EQ(0, std::count(std::begin(blocked), std::end(blocked), true));
+}
+
+TEST_F(BlocklistTest, setContentReplacesDefaultList)
+{
+    auto const external = tr_pathbuf{ sandboxDir(), "/external.txt"sv };
+    createFileWithContents(external, Contents1);
+    EXPECT_EQ(6U, tr_blocklistSetContent(session_, external));
+    EXPECT_EQ(6U, tr_blocklistGetRuleCount(session_));
+
+    createFileWithContents(external, Contents2);
+    EXPECT_EQ(7U, tr_blocklistSetContent(session_, external));
+    EXPECT_EQ(7U, tr_blocklistGetRuleCount(session_));
+
+    tr_blocklistSetEnabled(session_, true);
+    EXPECT_TRUE(addressIsBlocked("216.88.88.88"));
+
+    // the import's scratch files are cleaned up
+    auto const blocklist_dir = tr_pathbuf{ session_->configDir(), "/blocklists"sv };
+    for (auto const& name : tr_sys_dir_get_files(blocklist_dir))
+    {
+        EXPECT_FALSE(tr_strv_ends_with(name, ".tmp"sv)) << name;
+    }
+
+    // and the list survives a reload
+    tr_sessionReloadBlocklists(session_);
+    EXPECT_EQ(7U, tr_blocklistGetRuleCount(session_));
+}
+
 /***
 ****
 ***/
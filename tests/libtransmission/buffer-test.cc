@@ -3,9 +3,11 @@
 // or any future license endorsed by Mnemosyne LLC.
 // License text can be found in the licenses/ folder.
 
-#include <cstddef> // std::byte
+#include <algorithm> // std::min
+#include <cstddef> // std::byte, size_t
 #include <cstdint> // uint16_t, uint32_t, uint64_t
 #include <memory>
+#include <string>
 #include <string_view>
 
 #include <libtransmission/transmission.h>
@@ -102,6 +104,57 @@ TEST_F(BufferTest, Numbers)
     }
 }
 
+TEST_F(BufferTest, keepsDataWhenInterleavingReadsAndWrites)
+{
+    // a rolling window that's usually mostly full, like a peer's read buffer
+    // that always holds the start of the next message
+    auto buf = Buffer{};
+    auto expected = std::string{};
+    auto next_char = 'a';
+
+    for (auto i = 0; i < 1000; ++i)
+    {
+        auto const n_add = static_cast<size_t>(1 + i % 97);
+        auto chunk = std::string{};
+        for (size_t j = 0; j < n_add; ++j)
+        {
+            chunk += next_char;
+            next_char = next_char == 'z' ? 'a' : next_char + 1;
+        }
+        buf.add(chunk);
+        expected += chunk;
+
+        auto const n_drain = std::min(std::size(expected), static_cast<size_t>(i % 89));
+        buf.drain(n_drain);
+        expected.erase(0, n_drain);
+
+        ASSERT_EQ(expected, buf.to_string_view());
+    }
+}
+
+TEST_F(BufferTest, shrinkToFitReleasesEmptyBuffers)
+{
+    auto buf = Buffer{};
+    auto const big = std::string(16384U, 'x');
+
+    buf.add(big);
+    auto const grown = buf.capacity();
+    EXPECT_GE(grown, std::size(big));
+
+    // don't shrink buffers that still have data in them
+    buf.shrink_to_fit();
+    EXPECT_EQ(grown, buf.capacity());
+    EXPECT_EQ(big, buf.to_string_view());
+
+    buf.clear();
+    buf.shrink_to_fit();
+    EXPECT_LT(buf.capacity(), grown);
+
+    // still usable afterwards
+    buf.add("Hello"sv);
+    EXPECT_EQ("Hello"sv, buf.to_string_view());
+}
+
 #if 0
 TEST_F(BufferTest, NonBufferWriter)
 {
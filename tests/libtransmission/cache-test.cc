@@ -0,0 +1,335 @@
+// This file Copyright (C) 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <array>
+#include <cstdint> // uint8_t, uint64_t
+#include <future>
+#include <memory>
+#include <numeric> // std::iota()
+#include <random>
+#include <utility>
+#include <vector>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/block-info.h>
+#include <libtransmission/cache.h>
+#include <libtransmission/inout.h>
+#include <libtransmission/session.h>
+#include <libtransmission/torrent.h>
+
+#include "gtest/gtest.h"
+#include "test-fixtures.h"
+
+namespace libtransmission::test
+{
+
+class CacheTest : public SessionTest
+{
+protected:
+    template<typename Func>
+    void runInSessionThreadAndWait(Func&& func)
+    {
+        auto promise = std::promise<void>{};
+        auto future = promise.get_future();
+        session_->runInSessionThread(
+            [&promise, &func]()
+            {
+                func();
+                promise.set_value();
+            });
+        future.wait();
+    }
+
+    // write every block of `tor` into the cache in a random order.
+    // Blocks in the first piece are filled with `first_piece_ch`, the rest with zeroes.
+    void writeAllBlocks(tr_torrent* tor, uint8_t first_piece_ch)
+    {
+        auto blocks = std::vector<tr_block_index_t>(tor->block_count());
+        std::iota(std::begin(blocks), std::end(blocks), tr_block_index_t{});
+        std::shuffle(std::begin(blocks), std::end(blocks), std::mt19937{ 0U });
+
+        auto const first_piece_end = tor->block_span_for_piece(0).end;
+        for (auto const block : blocks)
+        {
+            auto data = std::make_unique<Cache::BlockData>(tor->block_size(block));
+            auto const ch = block < first_piece_end ? first_piece_ch : uint8_t{};
+            std::fill_n(std::data(*data), std::size(*data), ch);
+            EXPECT_EQ(0, session_->cache->write_block(tor->id(), block, std::move(data)));
+        }
+    }
+
+    // @return true iff every byte of `tor`'s first piece, as seen through the cache, is `ch`
+    [[nodiscard]] static bool firstPieceIs(tr_torrent* tor, uint8_t ch)
+    {
+        auto const [begin, end] = tor->block_span_for_piece(0);
+        for (auto block = begin; block < end; ++block)
+        {
+            auto buf = std::vector<uint8_t>(tor->block_size(block));
+            if (tor->session->cache->read_block(tor, tor->block_loc(block), std::size(buf), std::data(buf)) != 0 ||
+                !std::all_of(std::begin(buf), std::end(buf), [ch](auto val) { return val == ch; }))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+};
+
+TEST_F(CacheTest, readsWhatWasWritten)
+{
+    // the first piece is filled with '\1' on disk
+    auto* const tor = zeroTorrentInit(ZeroTorrentState::Partial);
+    runInSessionThreadAndWait([this, tor]() { session_->cache->set_limit(tor->total_size() * 2U); });
+
+    runInSessionThreadAndWait(
+        [this, tor]()
+        {
+            writeAllBlocks(tor, '\0');
+            EXPECT_TRUE(firstPieceIs(tor, '\0'));
+
+            // rewriting a cached block replaces it
+            writeAllBlocks(tor, '\2');
+            EXPECT_TRUE(firstPieceIs(tor, '\2'));
+            writeAllBlocks(tor, '\0');
+        });
+
+    // nothing's been written to disk yet
+    auto buf = std::vector<uint8_t>(tor->block_size(0));
+    EXPECT_EQ(0, tr_ioRead(tor, tor->block_loc(0), std::size(buf), std::data(buf)));
+    EXPECT_EQ('\1', buf.front());
+
+    runInSessionThreadAndWait([this, tor]() { EXPECT_EQ(0, session_->cache->flush_torrent(tor)); });
+
+    blockingTorrentVerify(tor);
+    EXPECT_EQ(0U, tr_torrentStat(tor)->leftUntilDone);
+}
+
+TEST_F(CacheTest, shrinkingLimitFlushesBlocks)
+{
+    auto* const tor = zeroTorrentInit(ZeroTorrentState::Partial);
+    runInSessionThreadAndWait([this, tor]() { session_->cache->set_limit(tor->total_size() * 2U); });
+
+    runInSessionThreadAndWait(
+        [this, tor]()
+        {
+            writeAllBlocks(tor, '\0');
+            EXPECT_EQ(0, session_->cache->set_limit(tr_block_info::BlockSize));
+            EXPECT_TRUE(firstPieceIs(tor, '\0'));
+            EXPECT_EQ(0, session_->cache->set_limit(0U));
+        });
+
+    blockingTorrentVerify(tor);
+    EXPECT_EQ(0U, tr_torrentStat(tor)->leftUntilDone);
+}
+
+TEST_F(CacheTest, flushFileOnlyWritesThatFile)
+{
+    auto* const tor = zeroTorrentInit(ZeroTorrentState::Partial);
+    runInSessionThreadAndWait([this, tor]() { session_->cache->set_limit(tor->total_size() * 2U); });
+
+    runInSessionThreadAndWait(
+        [this, tor]()
+        {
+            writeAllBlocks(tor, '\0');
+
+            // the first file's blocks should be on disk now
+            EXPECT_EQ(0, session_->cache->flush_file(tor, 0));
+            auto buf = std::vector<uint8_t>(tor->block_size(0));
+            EXPECT_EQ(0, tr_ioRead(tor, tor->block_loc(0), std::size(buf), std::data(buf)));
+            EXPECT_EQ('\0', buf.front());
+
+            EXPECT_TRUE(firstPieceIs(tor, '\0'));
+            EXPECT_EQ(0, session_->cache->flush_torrent(tor));
+        });
+
+    blockingTorrentVerify(tor);
+    EXPECT_EQ(0U, tr_torrentStat(tor)->leftUntilDone);
+}
+
+TEST_F(CacheTest, agedBlocksAreFlushed)
+{
+    auto* const tor = zeroTorrentInit(ZeroTorrentState::Partial);
+    runInSessionThreadAndWait([this, tor]() { session_->cache->set_limit(tor->total_size() * 2U); });
+
+    runInSessionThreadAndWait(
+        [this, tor]()
+        {
+            auto const n_writes = session_->cache->flush_stats().n_writes;
+            writeAllBlocks(tor, '\0');
+
+            // recently-written blocks stay in the cache
+            EXPECT_EQ(0, session_->cache->flush_aged(tr_time()));
+            EXPECT_EQ(n_writes, session_->cache->flush_stats().n_writes);
+
+            // old ones get written out
+            EXPECT_EQ(0, session_->cache->flush_aged(tr_time() + 3600));
+            EXPECT_LT(n_writes, session_->cache->flush_stats().n_writes);
+            EXPECT_LE(tor->total_size(), session_->cache->flush_stats().n_bytes);
+        });
+
+    blockingTorrentVerify(tor);
+    EXPECT_EQ(0U, tr_torrentStat(tor)->leftUntilDone);
+}
+
+TEST_F(CacheTest, asyncWrites)
+{
+    // evict blocks as soon as they're written so that every block goes through the disk writer
+    auto* const tor = zeroTorrentInit(ZeroTorrentState::Partial);
+    runInSessionThreadAndWait(
+        [this]()
+        {
+            session_->cache->set_async_writes(true);
+            session_->cache->set_limit(tr_block_info::BlockSize);
+        });
+
+    runInSessionThreadAndWait(
+        [this, tor]()
+        {
+            writeAllBlocks(tor, '\0');
+
+            // blocks are readable whether or not they've been written yet
+            EXPECT_TRUE(firstPieceIs(tor, '\0'));
+
+            // flushing waits for the background writes to finish
+            EXPECT_EQ(0, session_->cache->flush_torrent(tor));
+            session_->cache->set_async_writes(false);
+        });
+
+    auto buf = std::vector<uint8_t>(tor->block_size(0));
+    EXPECT_EQ(0, tr_ioRead(tor, tor->block_loc(0), std::size(buf), std::data(buf)));
+    EXPECT_EQ('\0', buf.front());
+
+    blockingTorrentVerify(tor);
+    EXPECT_EQ(0U, tr_torrentStat(tor)->leftUntilDone);
+}
+
+TEST_F(CacheTest, readAheadServesLaterRequests)
+{
+    auto* const tor = zeroTorrentInit(ZeroTorrentState::Complete);
+    runInSessionThreadAndWait(
+        [this, tor]()
+        {
+            session_->cache->set_async_writes(true);
+            session_->cache->set_limit(tor->total_size() * 2U);
+        });
+
+    runInSessionThreadAndWait(
+        [this, tor]()
+        {
+            // read the first piece ahead, then wait for the reads to land
+            EXPECT_EQ(0, session_->cache->prefetch_block(tor, tor->block_loc(0), tor->block_size(0)));
+            session_->cache->set_async_writes(false);
+
+            // change the first piece on disk behind the cache's back.
+            // Requests are still served from the blocks that were read ahead.
+            auto const [begin, end] = tor->block_span_for_piece(0);
+            for (auto block = begin; block < end; ++block)
+            {
+                auto const buf = std::vector<uint8_t>(tor->block_size(block), '\1');
+                EXPECT_EQ(0, tr_ioWrite(tor, tor->block_loc(block), std::size(buf), std::data(buf)));
+            }
+            EXPECT_TRUE(firstPieceIs(tor, '\0'));
+
+            // writing through the cache replaces what was read ahead
+            writeAllBlocks(tor, '\2');
+            EXPECT_TRUE(firstPieceIs(tor, '\2'));
+            EXPECT_EQ(0, session_->cache->flush_torrent(tor));
+            EXPECT_TRUE(firstPieceIs(tor, '\2'));
+            writeAllBlocks(tor, '\0');
+            EXPECT_EQ(0, session_->cache->flush_torrent(tor));
+        });
+
+    blockingTorrentVerify(tor);
+    EXPECT_EQ(0U, tr_torrentStat(tor)->leftUntilDone);
+}
+
+TEST_F(CacheTest, directReadAhead)
+{
+    auto* const tor = zeroTorrentInit(ZeroTorrentState::Complete);
+    runInSessionThreadAndWait(
+        [this, tor]()
+        {
+            session_->cache->set_direct_io(true);
+            session_->cache->set_async_writes(true);
+            session_->cache->set_limit(tor->total_size() * 2U);
+        });
+
+    runInSessionThreadAndWait(
+        [this, tor]()
+        {
+            // put something other than zeroes on disk, so that we can tell
+            // whether the unaligned blocks were copied out of the right place
+            auto const [begin, end] = tor->block_span_for_piece(0);
+            for (auto block = begin; block < end; ++block)
+            {
+                auto const buf = std::vector<uint8_t>(tor->block_size(block), '\3');
+                EXPECT_EQ(0, tr_ioWrite(tor, tor->block_loc(block), std::size(buf), std::data(buf)));
+            }
+
+            EXPECT_EQ(0, session_->cache->prefetch_block(tor, tor->block_loc(0), tor->block_size(0)));
+            session_->cache->set_async_writes(false);
+            EXPECT_TRUE(firstPieceIs(tor, '\3'));
+
+            writeAllBlocks(tor, '\0');
+            EXPECT_EQ(0, session_->cache->flush_torrent(tor));
+            session_->cache->set_direct_io(false);
+        });
+
+    blockingTorrentVerify(tor);
+    EXPECT_EQ(0U, tr_torrentStat(tor)->leftUntilDone);
+}
+
+TEST_F(CacheTest, countsUsage)
+{
+    auto* const tor = zeroTorrentInit(ZeroTorrentState::Complete);
+    runInSessionThreadAndWait([this, tor]() { session_->cache->set_limit(tor->total_size() * 2U); });
+
+    auto const& usage = tor->usage();
+    auto before = std::array<uint64_t, tr_torrent_usage::NumCounters>{};
+    for (uint8_t i = 0U; i < tr_torrent_usage::NumCounters; ++i)
+    {
+        before[i] = usage.get(static_cast<tr_torrent_usage::Counter>(i));
+    }
+
+    // @return how much `counter` has gone up during this test
+    auto const get = [&usage, &before](tr_torrent_usage::Counter counter)
+    {
+        return usage.get(counter) - before[counter];
+    };
+
+    runInSessionThreadAndWait(
+        [this, tor, &get]()
+        {
+            auto const block_size = tor->block_size(0);
+
+            // a write goes into the cache
+            EXPECT_EQ(0, session_->cache->write_block(tor->id(), 0, std::make_unique<Cache::BlockData>(block_size)));
+            EXPECT_EQ(1U, get(tr_torrent_usage::CacheWrites));
+            EXPECT_EQ(block_size, get(tr_torrent_usage::CacheWriteBytes));
+
+            // reading it back is answered by the cache
+            auto buf = std::vector<uint8_t>(block_size);
+            EXPECT_EQ(0, session_->cache->read_block(tor, tor->block_loc(0), block_size, std::data(buf)));
+            EXPECT_EQ(1U, get(tr_torrent_usage::CacheReads));
+            EXPECT_EQ(block_size, get(tr_torrent_usage::CacheReadBytes));
+
+            // flushing it writes it to disk
+            EXPECT_EQ(0, session_->cache->flush_torrent(tor));
+            EXPECT_EQ(1U, get(tr_torrent_usage::DiskWrites));
+            EXPECT_EQ(block_size, get(tr_torrent_usage::DiskWriteBytes));
+
+            // a block that isn't cached is read from disk
+            auto const block = tor->block_count() - 1U;
+            buf.resize(tor->block_size(block));
+            EXPECT_EQ(0, session_->cache->read_block(tor, tor->block_loc(block), std::size(buf), std::data(buf)));
+            EXPECT_EQ(1U, get(tr_torrent_usage::DiskReads));
+            EXPECT_EQ(std::size(buf), get(tr_torrent_usage::DiskReadBytes));
+        });
+}
+
+} // namespace libtransmission::test
@@ -0,0 +1,78 @@
+// This file Copyright (C) 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <cerrno>
+#include <chrono>
+#include <ctime>
+#include <string>
+#include <thread>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/capacity-monitor.h>
+#include <libtransmission/executor.h>
+#include <libtransmission/file.h>
+
+#include "gtest/gtest.h"
+#include "test-fixtures.h"
+
+using namespace std::literals;
+
+namespace libtransmission::test
+{
+
+class CapacityMonitorTest : public SandboxedTest
+{
+protected:
+    static auto constexpr Now = time_t{ 1000000 };
+
+    tr_executor executor_{ 1U };
+    tr_capacity_monitor monitor_{ executor_ };
+};
+
+TEST_F(CapacityMonitorTest, answersFirstQueryDirectly)
+{
+    auto const [capacity, error_code] = monitor_.get(sandboxDir(), Now);
+    ASSERT_TRUE(capacity);
+    EXPECT_GT(capacity->total, 0);
+    EXPECT_GE(capacity->free, 0);
+    EXPECT_EQ(0, error_code);
+    EXPECT_EQ(1U, monitor_.stats().misses);
+
+    // the second ask is answered from the cache
+    EXPECT_TRUE(monitor_.get(sandboxDir(), Now + 1).capacity);
+    EXPECT_EQ(1U, monitor_.stats().hits);
+    EXPECT_EQ(0U, monitor_.stats().refreshes);
+}
+
+TEST_F(CapacityMonitorTest, refreshesStaleAnswersInTheBackground)
+{
+    auto const path = sandboxDir() + "/not-yet";
+
+    auto const [capacity, error_code] = monitor_.get(path, Now);
+    EXPECT_FALSE(capacity);
+    EXPECT_EQ(ENOENT, error_code);
+
+    // the cached answer is returned until it's stale...
+    tr_sys_dir_create(path, 0, 0700);
+    EXPECT_FALSE(monitor_.get(path, Now + tr_capacity_monitor::RefreshInterval - 1).capacity);
+    EXPECT_EQ(0U, monitor_.stats().refreshes);
+
+    // ...and while it's being refreshed
+    auto const later = Now + tr_capacity_monitor::RefreshInterval;
+    EXPECT_FALSE(monitor_.get(path, later).capacity);
+    EXPECT_EQ(1U, monitor_.stats().refreshes);
+
+    auto const deadline = std::chrono::steady_clock::now() + 10s;
+    while (!monitor_.get(path, later).capacity && std::chrono::steady_clock::now() < deadline)
+    {
+        std::this_thread::sleep_for(10ms);
+    }
+
+    EXPECT_TRUE(monitor_.get(path, later).capacity);
+    EXPECT_EQ(1U, monitor_.stats().refreshes);
+}
+
+} // namespace libtransmission::test
@@ -85,6 +85,21 @@ TEST(Client, clientForId)
     }
 }
 
+TEST(Client, clientNameIsInterned)
+{
+    auto peer_id = tr_rand_obj<tr_peer_id_t>();
+    auto const prefix = "-TR2840-"sv;
+    std::copy(std::begin(prefix), std::end(prefix), std::begin(peer_id));
+    auto const first = tr_client_name(peer_id);
+
+    peer_id.back() ^= 1;
+    auto const second = tr_client_name(peer_id);
+
+    EXPECT_EQ("Transmission 2.84"sv, first.sv());
+    EXPECT_EQ(first.quark(), second.quark());
+    EXPECT_EQ(first.c_str(), second.c_str());
+}
+
 TEST(Client, clientForIdFuzzRegressions)
 {
     auto constexpr Tests = std::array<std::string_view, 5>{
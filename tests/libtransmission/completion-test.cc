@@ -8,6 +8,7 @@
 #include <cstddef> // size_t
 #include <cstdint>
 #include <set>
+#include <vector>
 
 #include <libtransmission/transmission.h>
 
@@ -349,7 +350,7 @@ TEST_F(CompletionTest, createPieceBitfield)
 
     // serialize it to a raw bitfield, read it back into a bitfield,
     // and test that the new bitfield matches
-    auto const pieces_raw_bitfield = completion.create_piece_bitfield();
+    auto const pieces_raw_bitfield = completion.piece_bitfield();
     tr_bitfield pieces{ size_t{ block_info.piece_count() } };
     pieces.set_raw(std::data(pieces_raw_bitfield), std::size(pieces_raw_bitfield));
     for (uint64_t i = 0; i < block_info.piece_count(); ++i)
@@ -358,6 +359,130 @@ TEST_F(CompletionTest, createPieceBitfield)
     }
 }
 
+TEST_F(CompletionTest, pieceBitfieldFollowsChanges)
+{
+    auto torrent = TestTorrent{};
+    auto constexpr TotalSize = uint64_t{ BlockSize * 64 };
+    auto constexpr PieceSize = uint64_t{ BlockSize * 8 };
+    auto const block_info = tr_block_info{ TotalSize, PieceSize };
+    auto completion = tr_completion(&torrent, &block_info);
+
+    EXPECT_EQ(std::vector<uint8_t>{ 0x00 }, completion.piece_bitfield());
+
+    completion.add_piece(0);
+    EXPECT_EQ(std::vector<uint8_t>{ 0x80 }, completion.piece_bitfield());
+
+    // a piece isn't in the bitfield until all of its blocks are
+    completion.add_block(block_info.block_span_for_piece(7).begin);
+    EXPECT_EQ(std::vector<uint8_t>{ 0x80 }, completion.piece_bitfield());
+    completion.add_piece(7);
+    EXPECT_EQ(std::vector<uint8_t>{ 0x81 }, completion.piece_bitfield());
+
+    completion.remove_piece(0);
+    EXPECT_EQ(std::vector<uint8_t>{ 0x01 }, completion.piece_bitfield());
+
+    completion.set_has_all();
+    EXPECT_EQ(std::vector<uint8_t>{ 0xFF }, completion.piece_bitfield());
+}
+
+TEST_F(CompletionTest, piecesAddedSince)
+{
+    auto torrent = TestTorrent{};
+    auto constexpr TotalSize = uint64_t{ BlockSize * 1024 };
+    auto constexpr PieceSize = uint64_t{ BlockSize };
+    auto const block_info = tr_block_info{ TotalSize, PieceSize };
+    auto completion = tr_completion(&torrent, &block_info);
+
+    // the revision only matters once someone's seen the bitfield
+    (void)completion.piece_bitfield();
+    auto const start = completion.pieces_revision();
+    EXPECT_EQ(std::vector<tr_piece_index_t>{}, completion.pieces_added_since(start));
+
+    completion.add_piece(5);
+    completion.add_piece(2);
+    auto const middle = completion.pieces_revision();
+    EXPECT_NE(start, middle);
+    completion.add_piece(9);
+    EXPECT_EQ((std::vector<tr_piece_index_t>{ 5, 2, 9 }), completion.pieces_added_since(start));
+    EXPECT_EQ(std::vector<tr_piece_index_t>{ 9 }, completion.pieces_added_since(middle));
+
+    // losing a piece can't be described as pieces added
+    completion.remove_piece(2);
+    EXPECT_FALSE(completion.pieces_added_since(middle));
+    auto const after_remove = completion.pieces_revision();
+    completion.add_piece(2);
+    EXPECT_EQ(std::vector<tr_piece_index_t>{ 2 }, completion.pieces_added_since(after_remove));
+
+    // nor is a long journal worth keeping
+    for (tr_piece_index_t piece = 100; piece < 200; ++piece)
+    {
+        completion.add_piece(piece);
+    }
+    EXPECT_FALSE(completion.pieces_added_since(after_remove));
+
+    // revisions aren't reused by other instances
+    auto const other = tr_completion(&torrent, &block_info);
+    EXPECT_NE(completion.pieces_revision(), other.pieces_revision());
+    EXPECT_FALSE(completion.pieces_added_since(other.pieces_revision()));
+}
+
+TEST_F(CompletionTest, aggregatesFollowChanges)
+{
+    // pieces that aren't a multiple of the block size, so some blocks straddle two pieces
+    auto torrent = TestTorrent{};
+    auto constexpr PieceSize = uint64_t{ BlockSize * 5 / 2 };
+    auto constexpr TotalSize = uint64_t{ PieceSize * 40 } + 123U;
+    auto const block_info = tr_block_info{ TotalSize, PieceSize };
+    auto completion = tr_completion(&torrent, &block_info);
+
+    // a completion with nothing cached, to check the running totals against
+    auto const check = [&]()
+    {
+        auto fresh = tr_completion(&torrent, &block_info);
+        fresh.set_blocks(completion.blocks());
+        EXPECT_EQ(fresh.has_valid(), completion.has_valid());
+        EXPECT_EQ(fresh.size_when_done(), completion.size_when_done());
+        EXPECT_EQ(fresh.piece_bitfield(), completion.piece_bitfield());
+    };
+
+    // fill the caches
+    check();
+
+    for (size_t i = 0; i < 500; ++i)
+    {
+        auto const block = tr_rand_int(block_info.block_count());
+        auto const piece = tr_rand_int(block_info.piece_count());
+        switch (tr_rand_int(4U))
+        {
+        case 0:
+            completion.add_block(block);
+            break;
+
+        case 1:
+            completion.add_piece(piece);
+            break;
+
+        case 2:
+            completion.remove_piece(piece);
+            break;
+
+        default:
+            if (auto const iter = torrent.dnd_pieces.find(piece); iter != std::end(torrent.dnd_pieces))
+            {
+                torrent.dnd_pieces.erase(iter);
+            }
+            else
+            {
+                torrent.dnd_pieces.insert(piece);
+            }
+            completion.on_piece_wanted_changed(piece);
+            break;
+        }
+
+        check();
+    }
+}
+
 TEST_F(CompletionTest, setHasPiece)
 {
 }
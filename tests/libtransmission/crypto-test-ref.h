@@ -21,9 +21,11 @@
 #define tr_rand_obj tr_rand_obj_
 #define tr_salt_shaker tr_salt_shaker_
 #define tr_sha1 tr_sha1_
+#define tr_sha1_batch tr_sha1_batch_
 #define tr_sha1_from_string tr_sha1_from_string_
 #define tr_sha1_to_string tr_sha1_to_string_
 #define tr_sha256 tr_sha256_
+#define tr_sha256_batch tr_sha256_batch_
 #define tr_sha256_from_string tr_sha256_from_string_
 #define tr_sha256_to_string tr_sha256_to_string_
 #define tr_ssha1 tr_ssha1_
@@ -56,9 +58,11 @@
 #undef tr_rand_obj
 #undef tr_salt_shaker
 #undef tr_sha1
+#undef tr_sha1_batch
 #undef tr_sha1_from_string
 #undef tr_sha1_to_string
 #undef tr_sha256
+#undef tr_sha256_batch
 #undef tr_sha256_from_string
 #undef tr_sha256_to_string
 #undef tr_ssha1
@@ -3,6 +3,7 @@
 // or any future license endorsed by Mnemosyne LLC.
 // License text can be found in the licenses/ folder.
 
+#include <algorithm>
 #include <array>
 #include <cassert>
 #include <cstddef> // std::byte, size_t
@@ -12,9 +13,13 @@
 #include <string>
 #include <string_view>
 #include <unordered_set>
+#include <vector>
+
+#include <fmt/core.h>
 
 #include <libtransmission/peer-mse.h>
 #include <libtransmission/crypto-utils.h>
+#include <libtransmission/tr-arc4.h>
 #include <libtransmission/tr-macros.h>
 #include <libtransmission/utils.h>
 
@@ -96,6 +101,55 @@ TEST(Crypto, encryptDecrypt)
     EXPECT_EQ(Input2, std::data(decrypted2)) << "Input2 " << Input2 << " decrypted2 " << std::data(decrypted2);
 }
 
+TEST(Crypto, arc4)
+{
+    // test vectors from https://en.wikipedia.org/wiki/RC4#Test_vectors
+    auto const process = [](std::string_view key, std::string_view plaintext)
+    {
+        auto arc4 = tr_arc4{ std::data(key), std::size(key) };
+        auto out = std::vector<uint8_t>(std::size(plaintext));
+        arc4.process(reinterpret_cast<uint8_t const*>(std::data(plaintext)), std::size(plaintext), std::data(out));
+        auto hex = std::string{};
+        for (auto const ch : out)
+        {
+            hex += fmt::format("{:02x}", ch);
+        }
+        return hex;
+    };
+
+    EXPECT_EQ("bbf316e8d940af0ad3"sv, process("Key"sv, "Plaintext"sv));
+    EXPECT_EQ("1021bf0420"sv, process("Wiki"sv, "pedia"sv));
+    EXPECT_EQ("45a01f645fc35b383552544b9bf5"sv, process("Secret"sv, "Attack at dawn"sv));
+}
+
+TEST(Crypto, arc4Chunked)
+{
+    // processing a buffer in pieces must match processing it all at once
+    static auto constexpr Key = "some key"sv;
+    auto input = std::vector<uint8_t>(1000);
+    tr_rand_buffer(std::data(input), std::size(input));
+
+    auto whole = std::vector<uint8_t>(std::size(input));
+    auto arc4 = tr_arc4{ std::data(Key), std::size(Key) };
+    arc4.process(std::data(input), std::size(input), std::data(whole));
+
+    auto chunked = std::vector<uint8_t>(std::size(input));
+    arc4 = tr_arc4{ std::data(Key), std::size(Key) };
+    for (size_t pos = 0, len = 1; pos < std::size(input); pos += len, len = len * 2 + 1)
+    {
+        len = std::min(len, std::size(input) - pos);
+        arc4.process(std::data(input) + pos, len, std::data(chunked) + pos);
+    }
+    EXPECT_EQ(whole, chunked);
+
+    // discarding must advance the keystream the same way as processing
+    auto skipped = std::vector<uint8_t>(std::size(input));
+    arc4 = tr_arc4{ std::data(Key), std::size(Key) };
+    arc4.discard(13);
+    arc4.process(std::data(input) + 13, std::size(input) - 13, std::data(skipped) + 13);
+    EXPECT_TRUE(std::equal(std::begin(whole) + 13, std::end(whole), std::begin(skipped) + 13));
+}
+
 TEST(Crypto, sha1)
 {
     auto hash1 = tr_sha1::digest("test"sv);
@@ -129,6 +183,74 @@ TEST(Crypto, sha1)
     EXPECT_EQ("a94a8fe5ccb19ba61c4c0873d391e987982fbbd3"sv, tr_sha1_to_string(hash5));
 }
 
+TEST(Crypto, sha1Batch)
+{
+    auto const buffers = std::vector<std::string_view>{ "test"sv, ""sv, "1"sv, "22"sv, "333"sv, "122333"sv };
+
+    auto const digests = tr_sha1_batch(buffers);
+    ASSERT_EQ(std::size(buffers), std::size(digests));
+    for (size_t i = 0; i < std::size(buffers); ++i)
+    {
+        EXPECT_EQ(tr_sha1::digest(buffers[i]), digests[i]);
+    }
+
+    EXPECT_EQ("a94a8fe5ccb19ba61c4c0873d391e987982fbbd3"sv, tr_sha1_to_string(digests.front()));
+    EXPECT_EQ(digests.back(), tr_sha1::digest("1"sv, "22"sv, "333"sv));
+
+    EXPECT_TRUE(std::empty(tr_sha1_batch({})));
+}
+
+TEST(Crypto, sha256Batch)
+{
+    auto const buffers = std::vector<std::string_view>{ "test"sv, ""sv, "1"sv, "22"sv, "333"sv, "122333"sv };
+
+    auto const digests = tr_sha256_batch(buffers);
+    ASSERT_EQ(std::size(buffers), std::size(digests));
+    for (size_t i = 0; i < std::size(buffers); ++i)
+    {
+        EXPECT_EQ(tr_sha256::digest(buffers[i]), digests[i]);
+    }
+
+    EXPECT_EQ("9f86d081884c7d659a2feaa0c55ad015a3bf4f1b2b0b822cd15d6c15b0f00a08"sv, tr_sha256_to_string(digests.front()));
+    EXPECT_EQ(digests.back(), tr_sha256::digest("1"sv, "22"sv, "333"sv));
+
+    EXPECT_TRUE(std::empty(tr_sha256_batch({})));
+}
+
+TEST(Crypto, shaContextMatchesWrapper)
+{
+    auto const chunks = std::array<std::string_view, 3>{ "The quick brown fox "sv, ""sv, "jumps over the lazy dog"sv };
+
+    auto sha1 = tr_sha1_context{};
+    auto sha256 = tr_sha256_context{};
+    auto wrapped_sha1 = tr_sha1::create();
+    auto wrapped_sha256 = tr_sha256::create();
+
+    // twice, to check that finish() leaves the context ready for reuse
+    for (int i = 0; i < 2; ++i)
+    {
+        for (auto const chunk : chunks)
+        {
+            sha1.add(std::data(chunk), std::size(chunk));
+            sha256.add(std::data(chunk), std::size(chunk));
+            wrapped_sha1->add(std::data(chunk), std::size(chunk));
+            wrapped_sha256->add(std::data(chunk), std::size(chunk));
+        }
+
+        auto const sha1_digest = sha1.finish();
+        auto const sha256_digest = sha256.finish();
+        EXPECT_EQ("2fd4e1c67a2d28fced849ee1bb76e7391b93eb12"sv, tr_sha1_to_string(sha1_digest));
+        EXPECT_EQ("d7a8fbb307d7809469ca9abcb0082e4f8d5651e46d3cdb762d02d0bf37c9e592"sv, tr_sha256_to_string(sha256_digest));
+        EXPECT_EQ(sha1_digest, wrapped_sha1->finish());
+        EXPECT_EQ(sha256_digest, wrapped_sha256->finish());
+    }
+
+    // clear() discards anything added since the last finish()
+    sha1.add("junk", 4U);
+    sha1.clear();
+    EXPECT_EQ(tr_sha1::digest(""sv), sha1.finish());
+}
+
 TEST(Crypto, ssha1)
 {
     struct LocalTest
@@ -286,6 +408,13 @@ TEST(Crypto, base64)
     EXPECT_EQ(""sv, tr_base64_encode(""sv));
     EXPECT_EQ(""sv, tr_base64_decode(""sv));
 
+    // characters outside the alphabet, e.g. line breaks, are skipped
+    EXPECT_EQ(raw, tr_base64_decode("WU9Z\r\nTyE="sv));
+    EXPECT_EQ(raw, tr_base64_decode("WU9ZTyE"sv));
+    EXPECT_EQ("Zg=="sv, tr_base64_encode("f"sv));
+    EXPECT_EQ("Zm8="sv, tr_base64_encode("fo"sv));
+    EXPECT_EQ("Zm9v"sv, tr_base64_encode("foo"sv));
+
     static auto constexpr MaxBufSize = size_t{ 1024 };
     for (size_t i = 1; i <= MaxBufSize; ++i)
     {
@@ -34,8 +34,11 @@
 #include <libtransmission/transmission.h>
 
 #include <libtransmission/crypto-utils.h> // tr_rand_obj
+#include <libtransmission/dns.h>
+#include <libtransmission/executor.h>
 #include <libtransmission/file.h>
 #include <libtransmission/net.h>
+#include <libtransmission/peer-mgr.h> // for tr_pex
 #include <libtransmission/quark.h>
 #include <libtransmission/session-thread.h> // for tr_evthread_init();
 #include <libtransmission/timer.h>
@@ -201,14 +204,22 @@ protected:
             return 0;
         }
 
-        int search(unsigned char const* id, int port, int af, dht_callback_t /*callback*/, void* /*closure*/) override
+        int search(unsigned char const* id, int port, int af, dht_callback_t callback, void* closure) override
         {
             auto info_hash = tr_sha1_digest_t{};
             std::copy_n(reinterpret_cast<std::byte const*>(id), std::size(info_hash), std::data(info_hash));
             searched_.push_back(Searched{ info_hash, tr_port::fromHost(port), af });
+            callback_ = callback;
+            closure_ = closure;
             return 0;
         }
 
+        void fireSearchEvent(int event, tr_sha1_digest_t const& info_hash, void const* data = nullptr, size_t data_len = 0U)
+        {
+            assert(callback_ != nullptr);
+            callback_(closure_, event, reinterpret_cast<unsigned char const*>(std::data(info_hash)), data, data_len);
+        }
+
         int init(int dht_socket, int dht_socket6, unsigned char const* id, unsigned char const* /*v*/) override
         {
             inited_ = true;
@@ -264,6 +275,8 @@ protected:
         bool inited_ = false;
         std::vector<Pinged> pinged_;
         std::vector<Searched> searched_;
+        dht_callback_t* callback_ = nullptr;
+        void* closure_ = nullptr;
         std::array<char, IdLength> id_ = {};
         tr_socket_t dht_socket_ = TR_BAD_SOCKET;
         tr_socket_t dht_socket6_ = TR_BAD_SOCKET;
@@ -367,20 +380,30 @@ protected:
             return mock_timer_maker_;
         }
 
+        [[nodiscard]] tr_dns& dns() override
+        {
+            return dns_;
+        }
+
         [[nodiscard]] tr_dht::API& api() override
         {
             return mock_dht_;
         }
 
-        void add_pex(tr_sha1_digest_t const& /*info_hash*/, tr_pex const* /*pex*/, size_t /*n_pex*/) override
+        void add_pex(tr_sha1_digest_t const& info_hash, tr_pex const* pex, size_t n_pex) override
         {
+            auto& added = pex_added_[info_hash];
+            added.insert(std::end(added), pex, pex + n_pex);
         }
 
         std::string config_dir_;
+        std::map<tr_sha1_digest_t, std::vector<tr_pex>> pex_added_;
         std::vector<tr_torrent_id_t> torrents_allowing_dht_;
         std::map<tr_torrent_id_t, tr_sha1_digest_t> info_hashes_;
         MockDht mock_dht_;
         MockTimerMaker mock_timer_maker_;
+        tr_executor executor_{ 1U };
+        tr_dns dns_{ executor_ };
     };
 
     [[nodiscard]] static tr_socket_address getSockaddr(std::string_view name, tr_port port)
@@ -555,6 +578,72 @@ TEST_F(DhtTest, savesStateIfSwarmIsGood)
     EXPECT_TRUE(tr_sys_path_exists(dat_file.c_str()));
 }
 
+TEST_F(DhtTest, savesStatePeriodically)
+{
+    auto const dat_file = MockStateFile::filename(sandboxDir());
+    EXPECT_FALSE(tr_sys_path_exists(dat_file.c_str()));
+
+    auto mediator = MockMediator{ event_base_ };
+    mediator.config_dir_ = sandboxDir();
+    mediator.mock_dht_.setHealthySwarm();
+    auto dht = tr_dht::create(mediator, ArbitraryPeerPort, ArbitrarySock4, ArbitrarySock6);
+
+    // the state should be checkpointed while the dht is still running
+    waitFor(
+        event_base_,
+        [&dat_file]() { return tr_sys_path_exists(dat_file.c_str()); },
+        MockTimerInterval * 10);
+    EXPECT_TRUE(tr_sys_path_exists(dat_file.c_str()));
+}
+
+TEST_F(DhtTest, restoresCachedPeersFromStateFile)
+{
+    auto constexpr Id = tr_torrent_id_t{ 1 };
+    auto const info_hash = tr_rand_obj<tr_sha1_digest_t>();
+    auto const peers = std::vector<tr_pex>{
+        tr_pex{ *tr_address::from_string("10.10.10.1"), tr_port::fromHost(128) },
+        tr_pex{ *tr_address::from_string("10.10.10.2"), tr_port::fromHost(129) },
+        tr_pex{ *tr_address::from_string("1002:1035:4527:3546:7854:1237:3247:3217"), tr_port::fromHost(6881) },
+    };
+
+    tr_timeUpdate(time(nullptr));
+
+    // make a state file that has cached peers for our torrent
+    {
+        auto const state_file = MockStateFile{};
+        state_file.save(sandboxDir());
+
+        auto const dat_file = MockStateFile::filename(sandboxDir());
+        auto dict = tr_variant{};
+        ASSERT_TRUE(tr_variantFromFile(&dict, TR_VARIANT_PARSE_BENC, dat_file));
+        auto* const list = tr_variantDictAddList(&dict, TR_KEY_peers, 1U);
+        auto* const entry = tr_variantListAddDict(list, 4U);
+        auto compact = std::vector<std::byte>{};
+        peers[0].to_compact_ipv4(std::back_inserter(compact));
+        peers[1].to_compact_ipv4(std::back_inserter(compact));
+        auto compact6 = std::vector<std::byte>{};
+        peers[2].to_compact_ipv6(std::back_inserter(compact6));
+        tr_variantDictAddStr(entry, TR_KEY_hashString, tr_sha1_to_string(info_hash));
+        tr_variantDictAddInt(entry, TR_KEY_date, tr_time());
+        tr_variantDictAddRaw(entry, TR_KEY_added, std::data(compact), std::size(compact));
+        tr_variantDictAddRaw(entry, TR_KEY_added6, std::data(compact6), std::size(compact6));
+        tr_variantToFile(&dict, TR_VARIANT_FMT_BENC, dat_file);
+        tr_variantClear(&dict);
+    }
+
+    auto mediator = MockMediator{ event_base_ };
+    mediator.info_hashes_[Id] = info_hash;
+    mediator.torrents_allowing_dht_ = { Id };
+    mediator.config_dir_ = sandboxDir();
+
+    // Even though the swarm isn't ready yet, the torrent
+    // should get its cached peers without waiting for a search
+    auto dht = tr_dht::create(mediator, ArbitraryPeerPort, ArbitrarySock4, ArbitrarySock6);
+    EXPECT_TRUE(std::empty(mediator.mock_dht_.searched_));
+    ASSERT_EQ(1U, mediator.pex_added_.count(info_hash));
+    EXPECT_EQ(peers, mediator.pex_added_[info_hash]);
+}
+
 TEST_F(DhtTest, doesNotSaveStateIfSwarmIsBad)
 {
     auto const state_file = MockStateFile{};
@@ -663,6 +752,59 @@ TEST_F(DhtTest, announcesTorrents)
     EXPECT_EQ(AF_INET6, mock_dht.searched_[1].af);
 }
 
+TEST_F(DhtTest, limitsSearchesPerTick)
+{
+    auto constexpr NumTorrents = 100;
+
+    tr_timeUpdate(time(nullptr));
+
+    auto mediator = MockMediator{ event_base_ };
+    mediator.config_dir_ = sandboxDir();
+    for (tr_torrent_id_t id = 1; id <= NumTorrents; ++id)
+    {
+        mediator.info_hashes_[id] = tr_rand_obj<tr_sha1_digest_t>();
+        mediator.torrents_allowing_dht_.push_back(id);
+    }
+
+    auto& mock_dht = mediator.mock_dht_;
+    mock_dht.setHealthySwarm();
+
+    // 200 searches are due, but they should trickle out
+    // rather than all being started at once
+    auto dht = tr_dht::create(mediator, ArbitraryPeerPort, ArbitrarySock4, ArbitrarySock6);
+    auto const n_searched = std::size(mock_dht.searched_);
+    EXPECT_GT(n_searched, 0U);
+    EXPECT_LT(n_searched, NumTorrents * 2U);
+
+    auto stats = dht->search_stats();
+    EXPECT_EQ(n_searched, stats.n_started);
+    EXPECT_EQ(n_searched, stats.n_in_flight);
+    EXPECT_EQ(0U, stats.n_done);
+
+    // the searches started first should be the most overdue ones
+    EXPECT_EQ(mediator.info_hashes_[1], mock_dht.searched_[0].info_hash);
+    EXPECT_EQ(AF_INET, mock_dht.searched_[0].af);
+    EXPECT_EQ(mediator.info_hashes_[1], mock_dht.searched_[1].info_hash);
+    EXPECT_EQ(AF_INET6, mock_dht.searched_[1].af);
+
+    // finish one search that found peers and one that didn't
+    auto const peer = tr_pex{ tr_address::from_string("1.2.3.4").value_or(tr_address{}), tr_port::fromHost(6881) };
+    auto compact = std::array<std::byte, 6>{};
+    peer.to_compact_ipv4(std::data(compact));
+    mock_dht.fireSearchEvent(DHT_EVENT_VALUES, mock_dht.searched_[0].info_hash, std::data(compact), std::size(compact));
+    mock_dht.fireSearchEvent(DHT_EVENT_SEARCH_DONE, mock_dht.searched_[0].info_hash);
+    mock_dht.fireSearchEvent(DHT_EVENT_SEARCH_DONE6, mock_dht.searched_[1].info_hash);
+
+    stats = dht->search_stats();
+    EXPECT_EQ(2U, stats.n_done);
+    EXPECT_EQ(1U, stats.n_found_peers);
+    EXPECT_EQ(n_searched - 2U, stats.n_in_flight);
+
+    // the remaining searches get started on later ticks
+    waitFor(event_base_, MockTimerInterval * 3);
+    EXPECT_GT(std::size(mock_dht.searched_), n_searched);
+}
+
 TEST_F(DhtTest, callsPeriodicPeriodically)
 {
     auto mediator = MockMediator{ event_base_ };
@@ -0,0 +1,95 @@
+// This file Copyright (C) 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <array>
+#include <cstddef> // size_t
+#include <cstdint> // uint64_t
+#include <string>
+#include <string_view>
+#include <utility> // std::move()
+#include <vector>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/disk-writer.h>
+#include <libtransmission/file.h>
+#include <libtransmission/tr-strbuf.h>
+
+#include "gtest/gtest.h"
+#include "test-fixtures.h"
+
+using namespace std::literals;
+
+namespace libtransmission::test
+{
+
+using DiskWriterTest = SandboxedTest;
+
+TEST_F(DiskWriterTest, readsOutOfOrderReadsIntoTheRightBuffers)
+{
+    static auto constexpr ChunkSize = size_t{ 16U * 1024U };
+    static auto constexpr NumChunks = size_t{ 8U };
+
+    auto const filename = std::string{ tr_pathbuf{ sandboxDir(), "/file"sv }.sv() };
+    auto contents = std::string{};
+    for (size_t i = 0; i < ChunkSize * NumChunks; ++i)
+    {
+        contents += static_cast<char>('a' + i % 23U);
+    }
+    createFileWithContents(filename, contents);
+
+    // queue adjacent reads out of order, so that they're sorted and merged
+    auto const order = std::array<size_t, NumChunks>{ 5U, 1U, 7U, 0U, 2U, 6U, 3U, 4U };
+    auto bufs = std::vector<std::string>(NumChunks, std::string(ChunkSize, '\0'));
+    auto ids = std::vector<tr_disk_writer::JobId>{};
+    auto writer = tr_disk_writer{};
+    for (auto const chunk : order)
+    {
+        auto read = tr_disk_writer::Write{ filename, uint64_t{ chunk * ChunkSize }, {} };
+        read.vecs.push_back({ std::data(bufs[chunk]), ChunkSize });
+        ids.push_back(writer.add_read({ std::move(read) }));
+    }
+
+    writer.wait(0U);
+    EXPECT_EQ(0U, writer.size());
+
+    for (size_t chunk = 0; chunk < NumChunks; ++chunk)
+    {
+        EXPECT_EQ(contents.substr(chunk * ChunkSize, ChunkSize), bufs[chunk]) << chunk;
+    }
+
+    auto finished = std::vector<tr_disk_writer::JobId>{};
+    for (auto const& result : writer.take_finished())
+    {
+        EXPECT_EQ(0, result.err);
+        finished.push_back(result.id);
+    }
+    std::sort(std::begin(ids), std::end(ids));
+    std::sort(std::begin(finished), std::end(finished));
+    EXPECT_EQ(ids, finished);
+}
+
+TEST_F(DiskWriterTest, readsSeeEarlierWrites)
+{
+    auto const filename = std::string{ tr_pathbuf{ sandboxDir(), "/file"sv }.sv() };
+    createFileWithContents(filename, "0123456789"sv);
+
+    auto payload = std::string{ "abc" };
+    auto writer = tr_disk_writer{};
+    auto write = tr_disk_writer::Write{ filename, 4U, {} };
+    write.vecs.push_back({ std::data(payload), std::size(payload) });
+    (void)writer.add({ std::move(write) });
+
+    auto buf = std::string(10U, '\0');
+    auto read = tr_disk_writer::Write{ filename, 0U, {} };
+    read.vecs.push_back({ std::data(buf), std::size(buf) });
+    (void)writer.add_read({ std::move(read) });
+
+    writer.wait(0U);
+    EXPECT_EQ("0123abc789"sv, buf);
+}
+
+} // namespace libtransmission::test
@@ -1,175 +1,104 @@
-// This file Copyright (C) 2022 Mnemosyne LLC.
+// This file Copyright (C) 2023 Mnemosyne LLC.
 // It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
 // or any future license endorsed by Mnemosyne LLC.
 // License text can be found in the licenses/ folder.
 
+#include <algorithm>
 #include <chrono>
-#include <memory>
+#include <ctime>
+#include <optional>
+#include <string_view>
+#include <thread>
 
-#include <event2/event.h>
+#include <libtransmission/transmission.h>
 
-#include "transmission.h"
-
-#include "dns-ev.h"
-#include "dns.h"
-#include "trevent.h" // for tr_evthread_init();
+#include <libtransmission/dns.h>
+#include <libtransmission/executor.h>
+#include <libtransmission/net.h>
 
 #include "gtest/gtest.h"
-#include "test-fixtures.h"
 
 using namespace std::literals;
 
-namespace libtransmission::test
-{
-
-class EvDnsTest : public ::testing::Test
+class DnsTest : public ::testing::Test
 {
 protected:
-    void SetUp() override
+    // keep asking until the lookup is done
+    [[nodiscard]] std::optional<tr_dns::Addresses> waitForAnswer(std::string_view host, time_t now)
     {
-        ::testing::Test::SetUp();
-
-        tr_evthread_init();
-        event_base_ = event_base_new();
-    }
+        auto const deadline = std::chrono::steady_clock::now() + 10s;
+        while (std::chrono::steady_clock::now() < deadline)
+        {
+            if (auto addresses = dns_.get(host, now); addresses)
+            {
+                return addresses;
+            }
 
-    void TearDown() override
-    {
-        event_base_free(event_base_);
-        event_base_ = nullptr;
+            std::this_thread::sleep_for(10ms);
+        }
 
-        ::testing::Test::TearDown();
+        return {};
     }
 
-    struct event_base* event_base_ = nullptr;
+    static auto constexpr Now = time_t{ 1000000 };
+
+    tr_executor executor_{ 2U };
+    tr_dns dns_{ executor_ };
 };
 
-TEST_F(EvDnsTest, canLookup)
+TEST_F(DnsTest, doesNotLookUpAddresses)
 {
-    auto dns = EvDns{ event_base_, tr_time };
-    auto done = false;
-
-    dns.lookup(
-        "example.com",
-        [&done](struct sockaddr const* ai, socklen_t ailen, time_t expires_at)
-        {
-            EXPECT_NE(nullptr, ai);
-            EXPECT_GT(ailen, 0);
-            EXPECT_GT(expires_at, tr_time());
-            done = true;
-        });
-
-    waitFor(event_base_, [&done]() { return done; });
-    EXPECT_TRUE(done);
+    auto const addresses = dns_.get("127.0.0.1"sv, Now);
+    ASSERT_TRUE(addresses);
+    ASSERT_EQ(1U, std::size(*addresses));
+    EXPECT_EQ(tr_address::from_string("127.0.0.1"sv), addresses->front());
+    EXPECT_EQ(0U, dns_.stats().lookups);
 }
 
-TEST_F(EvDnsTest, canRequestWhilePending)
+TEST_F(DnsTest, cachesAnswers)
 {
-    auto dns = EvDns{ event_base_, tr_time };
-    auto n_done = size_t{ 0 };
-
-    dns.lookup(
-        "example.com",
-        [&n_done](struct sockaddr const* ai, socklen_t ailen, time_t expires_at)
-        {
-            EXPECT_NE(nullptr, ai);
-            EXPECT_GT(ailen, 0);
-            EXPECT_GT(expires_at, tr_time());
-            ++n_done;
-        });
-
-    dns.lookup(
-        "example.com",
-        [&n_done](struct sockaddr const* ai, socklen_t ailen, time_t expires_at)
-        {
-            EXPECT_NE(nullptr, ai);
-            EXPECT_GT(ailen, 0);
-            EXPECT_GT(expires_at, tr_time());
-            ++n_done;
-        });
-
-    // wait for both callbacks to be called
-    waitFor(event_base_, [&n_done]() { return n_done >= 2U; });
-    EXPECT_EQ(2U, n_done);
+    auto const addresses = waitForAnswer("localhost"sv, Now);
+    ASSERT_TRUE(addresses);
+    EXPECT_FALSE(std::empty(*addresses));
+    EXPECT_TRUE(std::all_of(
+        std::begin(*addresses),
+        std::end(*addresses),
+        [](tr_address const& addr) { return addr.is_ipv4() ? addr.display_name().rfind("127.", 0) == 0 : addr.is_ipv6(); }));
+
+    // the second ask is answered from the cache, even with different case
+    auto const lookups = dns_.stats().lookups;
+    EXPECT_EQ(1U, lookups);
+    EXPECT_EQ(addresses, dns_.get("LocalHost"sv, Now + 1));
+    EXPECT_EQ(lookups, dns_.stats().lookups);
 }
 
-TEST_F(EvDnsTest, canCancel)
+TEST_F(DnsTest, refreshesStaleAnswersInTheBackground)
 {
-    auto dns = EvDns{ event_base_, tr_time };
-    auto n_done = size_t{ 0 };
-    static auto constexpr Name = "example.com"sv;
-
-    auto tag = dns.lookup(
-        Name,
-        [&n_done](struct sockaddr const* ai, socklen_t ailen, time_t expires_at)
-        {
-            ++n_done;
-            // we cancelled this req, so `ai` and `ailen` should be zeroed out
-            EXPECT_EQ(nullptr, ai);
-            EXPECT_EQ(0, ailen);
-            EXPECT_EQ(0, expires_at);
-        });
-
-    dns.lookup(
-        Name,
-        [&n_done](struct sockaddr const* ai, socklen_t ailen, time_t expires_at)
-        {
-            ++n_done;
-
-            // this one did _not_ get cancelled so it should be OK
-            EXPECT_NE(nullptr, ai);
-            EXPECT_GT(ailen, 0);
-            EXPECT_GT(expires_at, tr_time());
-        });
-
-    dns.cancel(tag);
-
-    // wait for both callbacks to be called
-    waitFor(event_base_, [&n_done]() { return n_done >= 2U; });
-    EXPECT_EQ(2U, n_done);
+    auto const addresses = waitForAnswer("localhost"sv, Now);
+    ASSERT_TRUE(addresses);
+    EXPECT_EQ(1U, dns_.stats().lookups);
+
+    // a stale answer is still returned while it's being looked up again
+    auto const later = Now + tr_dns::Ttl;
+    EXPECT_EQ(addresses, dns_.get("localhost"sv, later));
+    EXPECT_EQ(2U, dns_.stats().lookups);
 }
 
-TEST_F(EvDnsTest, doesCacheEntries)
+TEST_F(DnsTest, cachesFailures)
 {
-    auto dns = EvDns{ event_base_, tr_time };
-    static auto constexpr Name = "example.com"sv;
+    // RFC 6761: names under .invalid never resolve
+    static auto constexpr Host = "no-such-host.invalid"sv;
 
-    struct sockaddr const* ai_addr = nullptr;
+    auto const addresses = waitForAnswer(Host, Now);
+    ASSERT_TRUE(addresses);
+    EXPECT_TRUE(std::empty(*addresses));
+    EXPECT_EQ(1U, dns_.stats().lookups);
+    EXPECT_EQ(1U, dns_.stats().failures);
 
-    dns.lookup(
-        Name,
-        [&ai_addr](struct sockaddr const* ai, socklen_t ailen, time_t expires_at)
-        {
-            EXPECT_NE(nullptr, ai);
-            EXPECT_GT(ailen, 0);
-            EXPECT_GT(expires_at, tr_time());
-            ai_addr = ai;
-        });
-
-    // wait for the lookup
-    waitFor(event_base_, [&ai_addr]() { return ai_addr != nullptr; });
-    ASSERT_NE(nullptr, ai_addr);
-
-    auto second_callback_called = false;
-    dns.lookup(
-        Name,
-        [&ai_addr, &second_callback_called](struct sockaddr const* ai, socklen_t ailen, time_t expires_at)
-        {
-            EXPECT_NE(nullptr, ai);
-            EXPECT_GT(ailen, 0);
-            EXPECT_EQ(ai_addr, ai);
-            EXPECT_GT(expires_at, tr_time());
-            second_callback_called = true;
-        });
-    // since it's cached, the callback should have been invoked
-    // without waiting for the event loop
-    EXPECT_TRUE(second_callback_called);
-
-    // confirm that `cached()` returns the cached value immediately
-    auto res = dns.cached(Name);
-    EXPECT_TRUE(res);
-    EXPECT_EQ(ai_addr, res->first);
-    EXPECT_GT(res->second, 0);
-}
+    // don't look it up again until the failure expires
+    EXPECT_EQ(addresses, dns_.get(Host, Now + tr_dns::NegativeTtl - 1));
+    EXPECT_EQ(1U, dns_.stats().lookups);
 
-} // namespace libtransmission::test
+    EXPECT_EQ(addresses, dns_.get(Host, Now + tr_dns::NegativeTtl));
+    EXPECT_EQ(2U, dns_.stats().lookups);
+}
@@ -0,0 +1,181 @@
+// This file Copyright (C) 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef> // size_t
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/executor.h>
+
+#include "gtest/gtest.h"
+
+using ExecutorTest = ::testing::Test;
+using Priority = tr_executor::Priority;
+
+TEST_F(ExecutorTest, runsTasks)
+{
+    static auto constexpr NumTasks = size_t{ 1000U };
+
+    auto n_run = std::atomic<size_t>{};
+
+    {
+        auto executor = tr_executor{ 4U };
+        EXPECT_EQ(4U, executor.thread_count());
+
+        for (size_t i = 0; i < NumTasks; ++i)
+        {
+            executor.submit([&n_run]() { ++n_run; });
+        }
+    }
+
+    EXPECT_EQ(NumTasks, n_run);
+}
+
+TEST_F(ExecutorTest, defaultsToOneThreadPerCpu)
+{
+    auto executor = tr_executor{ 0U };
+    EXPECT_EQ(std::max(size_t{ std::thread::hardware_concurrency() }, size_t{ 1U }), executor.thread_count());
+}
+
+TEST_F(ExecutorTest, returnsFutures)
+{
+    auto executor = tr_executor{ 2U };
+
+    auto future = executor.async([]() { return 6 * 7; }, Priority::High);
+    EXPECT_EQ(42, future.get());
+}
+
+TEST_F(ExecutorTest, holdsTasksUntilStarted)
+{
+    auto executor = tr_executor{};
+    auto future = executor.async([]() { return std::this_thread::get_id(); });
+    EXPECT_EQ(1U, executor.size());
+    EXPECT_EQ(0U, executor.thread_count());
+
+    executor.start(1U);
+    EXPECT_NE(std::this_thread::get_id(), future.get());
+}
+
+TEST_F(ExecutorTest, runsHigherPrioritiesFirst)
+{
+    auto mutex = std::mutex{};
+    auto order = std::vector<Priority>{};
+    auto const record = [&mutex, &order](Priority priority)
+    {
+        auto const lock = std::lock_guard(mutex);
+        order.push_back(priority);
+    };
+
+    // queue the tasks before there's a worker to run them
+    auto executor = tr_executor{};
+    executor.submit([&record]() { record(Priority::Low); }, Priority::Low);
+    executor.submit([&record]() { record(Priority::Normal); }, Priority::Normal);
+    executor.submit([&record]() { record(Priority::High); }, Priority::High);
+    executor.start(1U);
+
+    auto done = executor.async([]() {}, Priority::Low);
+    done.wait();
+
+    auto const lock = std::lock_guard(mutex);
+    auto const expected = std::vector<Priority>{ Priority::High, Priority::Normal, Priority::Low };
+    EXPECT_EQ(expected, order);
+}
+
+TEST_F(ExecutorTest, runsTasksSubmittedFromWorkers)
+{
+    static auto constexpr Depth = size_t{ 100U };
+
+    auto n_run = std::atomic<size_t>{};
+
+    {
+        auto executor = tr_executor{ 3U };
+
+        // each task submits the next one into its worker's own queue,
+        // where the other workers can steal it
+        auto chain = std::function<void(size_t)>{};
+        chain = [&executor, &chain, &n_run](size_t depth)
+        {
+            ++n_run;
+            if (depth > 0U)
+            {
+                executor.submit([&chain, depth]() { chain(depth - 1U); });
+                executor.submit([&n_run]() { ++n_run; });
+            }
+        };
+
+        executor.submit([&chain]() { chain(Depth); });
+
+        // wait for the chain to finish before `chain` goes out of scope
+        while (executor.size() != 0U)
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    EXPECT_EQ(Depth * 2U + 1U, n_run);
+}
+
+TEST_F(ExecutorTest, queueLimitsRunningTasks)
+{
+    static auto constexpr NumTasks = size_t{ 100U };
+
+    auto n_run = std::atomic<size_t>{};
+    auto n_running = std::atomic<size_t>{};
+    auto max_running = std::atomic<size_t>{};
+
+    auto executor = tr_executor{ 4U };
+    auto queue = tr_executor_queue{ executor, 1U };
+    for (size_t i = 0; i < NumTasks; ++i)
+    {
+        queue.submit(
+            [&]()
+            {
+                auto const n = ++n_running;
+                auto prev = max_running.load();
+                while (prev < n && !max_running.compare_exchange_weak(prev, n))
+                {
+                }
+
+                std::this_thread::yield();
+                --n_running;
+                ++n_run;
+            });
+    }
+
+    queue.wait();
+    EXPECT_EQ(NumTasks, n_run);
+    EXPECT_EQ(1U, max_running);
+    EXPECT_EQ(0U, queue.size());
+}
+
+TEST_F(ExecutorTest, queueCancelDropsQueuedTasks)
+{
+    auto n_run = std::atomic<size_t>{};
+
+    // queue the tasks before there's a worker to run them
+    auto executor = tr_executor{};
+    auto queue = tr_executor_queue{ executor, 1U };
+    queue.submit([&n_run]() { ++n_run; });
+    queue.submit([&n_run]() { ++n_run; });
+    EXPECT_EQ(2U, queue.size());
+
+    queue.cancel();
+    EXPECT_TRUE(queue.cancelled());
+    EXPECT_EQ(0U, queue.size());
+
+    // tasks submitted after cancelling are dropped too
+    queue.submit([&n_run]() { ++n_run; });
+    EXPECT_EQ(0U, queue.size());
+
+    executor.start(1U);
+    queue.wait();
+    EXPECT_EQ(0U, n_run);
+}
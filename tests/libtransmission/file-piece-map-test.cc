@@ -90,6 +90,21 @@ TEST_F(FilePieceMapTest, fileOffset)
     EXPECT_EQ(FileSizes[12] - 1, file_offset.offset);
 }
 
+TEST_F(FilePieceMapTest, fileOffsetMatchesByteSpans)
+{
+    auto const fpm = tr_file_piece_map{ block_info_, std::data(FileSizes), std::size(FileSizes) };
+
+    // every byte should map to the nonzero file whose byte span holds it
+    for (uint64_t offset = 0; offset < TotalSize; ++offset)
+    {
+        auto const [index, file_offset] = fpm.file_offset(offset);
+        auto const [begin, end] = fpm.byte_span(index);
+        EXPECT_LE(begin, offset);
+        EXPECT_LT(offset, end);
+        EXPECT_EQ(offset - begin, file_offset);
+    }
+}
+
 TEST_F(FilePieceMapTest, pieceSpan)
 {
     // Note to reviewers: it's easy to see a nonexistent fencepost error here.
@@ -406,3 +421,78 @@ TEST_F(FilePieceMapTest, wanted)
     expected_pieces_wanted.set_has_none();
     compare_to_expected();
 }
+
+TEST_F(FilePieceMapTest, wantedBatchInAnyOrder)
+{
+    auto const fpm = tr_file_piece_map{ block_info_, std::data(FileSizes), std::size(FileSizes) };
+    auto files_wanted = tr_files_wanted(&fpm);
+    tr_file_index_t const n_files = std::size(FileSizes);
+
+    // unsorted, with duplicates, runs, and lone files
+    auto const files = std::vector<tr_file_index_t>{ 9, 2, 3, 16, 1, 2, 7, 8, 12 };
+    files_wanted.set(std::data(files), std::size(files), false);
+
+    for (tr_file_index_t i = 0; i < n_files; ++i)
+    {
+        auto const in_batch = std::find(std::begin(files), std::end(files), i) != std::end(files);
+        EXPECT_EQ(!in_batch, files_wanted.file_wanted(i)) << i;
+    }
+
+    files_wanted.set(std::data(files), std::size(files), true);
+
+    for (tr_file_index_t i = 0; i < n_files; ++i)
+    {
+        EXPECT_TRUE(files_wanted.file_wanted(i)) << i;
+    }
+}
+
+TEST_F(FilePieceMapTest, wantedReportsChangedPieces)
+{
+    auto const fpm = tr_file_piece_map{ block_info_, std::data(FileSizes), std::size(FileSizes) };
+    auto files_wanted = tr_files_wanted(&fpm);
+    tr_file_index_t const n_files = std::size(FileSizes);
+    tr_piece_index_t const n_pieces = block_info_.piece_count();
+
+    auto const pieces_wanted = [&]()
+    {
+        auto ret = std::vector<bool>{};
+        for (tr_piece_index_t piece = 0; piece < n_pieces; ++piece)
+        {
+            ret.push_back(files_wanted.piece_wanted(piece));
+        }
+        return ret;
+    };
+
+    // check that `changed` lists exactly the pieces that differ
+    auto const check = [&](std::vector<bool> const& before, std::vector<tr_piece_index_t> changed)
+    {
+        std::sort(std::begin(changed), std::end(changed));
+        auto const after = pieces_wanted();
+        auto expected = std::vector<tr_piece_index_t>{};
+        for (tr_piece_index_t piece = 0; piece < n_pieces; ++piece)
+        {
+            if (before[piece] != after[piece])
+            {
+                expected.push_back(piece);
+            }
+        }
+        EXPECT_EQ(expected, changed);
+    };
+
+    // some files, then the rest of them, then all of them again
+    auto files = std::vector<tr_file_index_t>{ 1, 2, 3, 7, 8, 12 };
+    for (auto const wanted : { false, true })
+    {
+        auto before = pieces_wanted();
+        auto changed = std::vector<tr_piece_index_t>{};
+        files_wanted.set(std::data(files), std::size(files), wanted, &changed);
+        check(before, changed);
+
+        auto all = std::vector<tr_file_index_t>(n_files);
+        std::iota(std::begin(all), std::end(all), 0U);
+        before = pieces_wanted();
+        changed.clear();
+        files_wanted.set(std::data(all), std::size(all), wanted, &changed);
+        check(before, changed);
+    }
+}
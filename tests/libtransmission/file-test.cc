@@ -346,6 +346,50 @@ TEST_F(FileTest, readFile)
     tr_sys_file_close(fd);
 }
 
+TEST_F(FileTest, readWriteVectored)
+{
+    auto const test_dir = createTestDir(currentTestName());
+    auto const path = tr_pathbuf{ test_dir, "/a.txt"sv };
+
+    tr_error* err = nullptr;
+    auto fd = tr_sys_file_open(path, TR_SYS_FILE_READ | TR_SYS_FILE_WRITE | TR_SYS_FILE_CREATE, 0600);
+    EXPECT_NE(TR_BAD_SYS_FILE, fd);
+
+    // gather-write three buffers, starting at an offset
+    auto hello = std::string{ "hello" };
+    auto comma = std::string{ ", " };
+    auto world = std::string{ "world!" };
+    auto const write_vecs = std::array<tr_sys_file_iovec, 3>{ {
+        { std::data(hello), std::size(hello) },
+        { std::data(comma), std::size(comma) },
+        { std::data(world), std::size(world) },
+    } };
+    auto n_written = uint64_t{};
+    EXPECT_TRUE(tr_sys_file_write_at_v(fd, std::data(write_vecs), std::size(write_vecs), 1U, &n_written, &err));
+    EXPECT_EQ(nullptr, err) << *err;
+    EXPECT_EQ(13U, n_written);
+
+    // scatter-read it back into differently-sized buffers
+    auto head = std::array<char, 4>{};
+    auto tail = std::array<char, 64>{};
+    auto const read_vecs = std::array<tr_sys_file_iovec, 2>{ {
+        { std::data(head), std::size(head) },
+        { std::data(tail), std::size(tail) },
+    } };
+    auto n_read = uint64_t{};
+    EXPECT_TRUE(tr_sys_file_read_at_v(fd, std::data(read_vecs), std::size(read_vecs), 1U, &n_read, &err));
+    EXPECT_EQ(nullptr, err) << *err;
+    EXPECT_EQ(13U, n_read);
+    EXPECT_EQ("hell"sv, std::string_view(std::data(head), std::size(head)));
+    EXPECT_EQ("o, world!"sv, std::string_view(std::data(tail), n_read - std::size(head)));
+
+    // reading past the end of the file
+    EXPECT_FALSE(tr_sys_file_read_at_v(fd, std::data(read_vecs), std::size(read_vecs), 100U, &n_read, &err));
+    EXPECT_EQ(nullptr, err) << *err;
+
+    tr_sys_file_close(fd);
+}
+
 TEST_F(FileTest, pathExists)
 {
     auto const test_dir = createTestDir(currentTestName());
@@ -654,6 +698,31 @@ TEST_F(FileTest, pathIsSame)
     // NOLINTEND(readability-suspicious-call-argument)
 }
 
+TEST_F(FileTest, pathIsSameFilesystem)
+{
+    auto const test_dir = createTestDir(currentTestName());
+
+    auto const path1 = tr_pathbuf{ test_dir, "/a"sv };
+    auto const path2 = tr_pathbuf{ test_dir, "/b"sv };
+
+    /* Non-existent files aren't on any filesystem */
+    tr_error* err = nullptr;
+    EXPECT_FALSE(tr_sys_path_is_same_filesystem(path1, test_dir, &err));
+    EXPECT_NE(nullptr, err);
+    tr_error_clear(&err);
+
+    /* Files in the same directory are on the same filesystem */
+    createFileWithContents(path1, "test");
+    createFileWithContents(path2, "test");
+    EXPECT_TRUE(tr_sys_path_is_same_filesystem(path1, path2, &err));
+    EXPECT_EQ(nullptr, err) << *err;
+    EXPECT_TRUE(tr_sys_path_is_same_filesystem(path1, test_dir, &err));
+    EXPECT_EQ(nullptr, err) << *err;
+
+    tr_sys_path_remove(path2);
+    tr_sys_path_remove(path1);
+}
+
 TEST_F(FileTest, pathResolve)
 {
     auto const test_dir = createTestDir(currentTestName());
@@ -1283,6 +1352,28 @@ TEST_F(FileTest, filePreallocate)
     tr_sys_path_remove(path1);
 }
 
+TEST_F(FileTest, fileMap)
+{
+    auto const test_dir = createTestDir(currentTestName());
+
+    auto const path = tr_pathbuf{ test_dir, "/a"sv };
+    auto const contents = "test"sv;
+    createFileWithContents(path, contents);
+    auto const fd = tr_sys_file_open(path, TR_SYS_FILE_READ, 0600);
+
+    tr_error* err = nullptr;
+    auto* const view = tr_sys_file_map_for_reading(fd, 0, std::size(contents), &err);
+    EXPECT_NE(nullptr, view);
+    EXPECT_EQ(nullptr, err) << *err;
+    EXPECT_EQ(contents, std::string_view(static_cast<char const*>(view), std::size(contents)));
+
+    EXPECT_TRUE(tr_sys_file_unmap(view, std::size(contents), &err));
+    EXPECT_EQ(nullptr, err) << *err;
+
+    tr_sys_file_close(fd);
+    tr_sys_path_remove(path);
+}
+
 TEST_F(FileTest, dirCreate)
 {
     auto const test_dir = createTestDir(currentTestName());
@@ -260,6 +260,7 @@ TEST_F(HandshakeTest, incomingPlaintext)
     EXPECT_EQ(io, res->io);
     EXPECT_TRUE(res->peer_id);
     EXPECT_EQ(peer_id, res->peer_id);
+    EXPECT_EQ("\xc2\xb5Torrent Web 1.1.0"sv, res->client_name.sv());
     EXPECT_EQ(TorrentWeAreSeeding.info_hash, io->torrent_hash());
 
     evutil_closesocket(sock);
@@ -4,6 +4,10 @@
 // License text can be found in the licenses/ folder.
 
 #include <cstddef> // size_t
+#include <cstdint> // uint64_t
+#include <ctime> // time_t
+#include <utility> // std::pair
+#include <vector>
 
 #include <libtransmission/history.h>
 
@@ -23,3 +27,103 @@ TEST(History, recentHistory)
     EXPECT_EQ(2U, h.count(22000, 15000));
     EXPECT_EQ(2U, h.count(22000, 20000));
 }
+
+TEST(History, recentHistoryMatchesScan)
+{
+    static auto constexpr Seconds = size_t{ 10U };
+    auto h = tr_recentHistory<uint16_t, Seconds>{};
+    auto added = std::vector<std::pair<time_t, uint16_t>>{};
+
+    // only the newest `Seconds` distinct timestamps are remembered
+    auto const expected = [&added](time_t now, unsigned int age_sec)
+    {
+        auto sum = uint16_t{};
+        auto n_slots = size_t{};
+        auto prev = time_t{ -1 };
+        for (auto it = std::rbegin(added); it != std::rend(added); ++it)
+        {
+            if (it->first != prev)
+            {
+                prev = it->first;
+                if (++n_slots > Seconds)
+                {
+                    break;
+                }
+            }
+
+            if (it->first >= now - static_cast<time_t>(age_sec))
+            {
+                sum += it->second;
+            }
+        }
+        return sum;
+    };
+
+    auto now = time_t{ 1000 };
+    for (uint16_t i = 0; i < 200; ++i)
+    {
+        now += (i % 3U == 0U) ? 0 : i % 5U;
+        h.add(now, i);
+        added.emplace_back(now, i);
+
+        for (unsigned int age = 0; age < 20; ++age)
+        {
+            EXPECT_EQ(expected(now, age), h.count(now, age)) << "i " << i << " age " << age;
+        }
+    }
+}
+
+TEST(History, rollingSum)
+{
+    auto sum = tr_rollingSum<8U, 250U>{};
+    EXPECT_EQ(2000U, sum.WindowMSec);
+    EXPECT_EQ(0U, sum.sum(100000U));
+
+    sum.add(100000U, 10U);
+    sum.add(100100U, 20U); // same slot
+    sum.add(100500U, 30U);
+    EXPECT_EQ(60U, sum.sum(100500U));
+    EXPECT_EQ(60U, sum.sum(101999U));
+
+    // the first slot expires 2000 msec after it started
+    EXPECT_EQ(30U, sum.sum(102000U));
+    EXPECT_EQ(30U, sum.sum(102499U));
+    EXPECT_EQ(0U, sum.sum(102500U));
+
+    // and it starts over cleanly
+    sum.add(110000U, 5U);
+    EXPECT_EQ(5U, sum.sum(110000U));
+}
+
+TEST(History, rollingSumReusesOldestSlot)
+{
+    auto sum = tr_rollingSum<4U, 100U>{};
+
+    // a new slot every 101 msec, so the fifth one has to push out the first
+    for (uint64_t i = 0; i < 5U; ++i)
+    {
+        sum.add(1000U + i * 101U, 1U);
+    }
+
+    EXPECT_EQ(4U, sum.sum(1000U + 4U * 101U));
+}
+
+TEST(History, ewmaRate)
+{
+    static auto constexpr HalfLifeMSec = uint64_t{ 1000U };
+    auto rate = tr_ewmaRate{ HalfLifeMSec };
+    EXPECT_EQ(0.0, rate.get(0U));
+
+    // a steady 1000 units per second converges on 1000 per second
+    auto now = uint64_t{ 0U };
+    for (; now < 20000U; now += 10U)
+    {
+        rate.add(now, 10U);
+    }
+    EXPECT_NEAR(1000.0, rate.get(now), 50.0);
+
+    // and when it stops, the estimate halves every half-life
+    auto const before = rate.get(now);
+    EXPECT_NEAR(before / 2.0, rate.get(now + HalfLifeMSec), 1.0);
+    EXPECT_NEAR(before / 4.0, rate.get(now + 2U * HalfLifeMSec), 1.0);
+}
@@ -0,0 +1,119 @@
+// This file Copyright (C) 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include <libtransmission/io-scheduler.h>
+
+#include "gtest/gtest.h"
+#include "test-fixtures.h"
+
+using namespace std::literals;
+
+namespace libtransmission::test
+{
+
+using IoSchedulerTest = SandboxedTest;
+
+TEST_F(IoSchedulerTest, backgroundIoYieldsToHigherClasses)
+{
+    using Class = tr_io_scheduler::Class;
+    static auto constexpr Device = tr_io_scheduler::DeviceId{ 1U };
+
+    auto scheduler = tr_io_scheduler{};
+    EXPECT_TRUE(scheduler.may_start(Device, Class::Verify));
+
+    // uploads and flushes never wait
+    auto read = scheduler.begin(Device, Class::Read, 16384U);
+    EXPECT_TRUE(scheduler.may_start(Device, Class::Read));
+    EXPECT_TRUE(scheduler.may_start(Device, Class::Flush));
+    EXPECT_FALSE(scheduler.may_start(Device, Class::Prefetch));
+    EXPECT_FALSE(scheduler.may_start(Device, Class::Verify));
+
+    // other devices aren't affected
+    EXPECT_TRUE(scheduler.may_start(Device + 1U, Class::Verify));
+
+    // background I/O waits a little longer in case more reads follow
+    read.reset();
+    EXPECT_FALSE(scheduler.may_start(Device, Class::Verify));
+    std::this_thread::sleep_for(tr_io_scheduler::YieldWindow + 10ms);
+    EXPECT_TRUE(scheduler.may_start(Device, Class::Verify));
+
+    // verification yields to prefetches, but not the other way around
+    auto prefetch = scheduler.begin(Device, Class::Prefetch, 16384U);
+    EXPECT_FALSE(scheduler.may_start(Device, Class::Verify));
+    auto verify = scheduler.begin(Device, Class::Verify, 16384U);
+    EXPECT_TRUE(scheduler.may_start(Device, Class::Prefetch));
+}
+
+TEST_F(IoSchedulerTest, acquireGoesAnywayAfterMaxYield)
+{
+    using Class = tr_io_scheduler::Class;
+    static auto constexpr Device = tr_io_scheduler::DeviceId{ 1U };
+
+    auto scheduler = tr_io_scheduler{};
+    auto const read = scheduler.begin(Device, Class::Read, 16384U);
+
+    auto const started_at = std::chrono::steady_clock::now();
+    auto const verify = scheduler.acquire(Device, Class::Verify, 16384U);
+    EXPECT_GE(std::chrono::steady_clock::now() - started_at, tr_io_scheduler::MaxYield);
+}
+
+TEST_F(IoSchedulerTest, limitsBackgroundIo)
+{
+    using Class = tr_io_scheduler::Class;
+    static auto constexpr Device = tr_io_scheduler::DeviceId{ 1U };
+
+    auto scheduler = tr_io_scheduler{};
+    scheduler.set_limits({ 0U, 2U });
+
+    // the budget starts out full
+    scheduler.begin(Device, Class::Verify, 16384U).reset();
+    EXPECT_TRUE(scheduler.may_start(Device, Class::Verify));
+    scheduler.begin(Device, Class::Verify, 16384U).reset();
+    EXPECT_FALSE(scheduler.may_start(Device, Class::Verify));
+
+    // uploads and flushes don't count against it
+    EXPECT_TRUE(scheduler.may_start(Device, Class::Read));
+    EXPECT_TRUE(scheduler.may_start(Device, Class::Flush));
+
+    // it refills over time
+    std::this_thread::sleep_for(600ms);
+    EXPECT_TRUE(scheduler.may_start(Device, Class::Verify));
+
+    scheduler.set_limits({});
+    for (int i = 0; i < 10; ++i)
+    {
+        scheduler.begin(Device, Class::Verify, 16384U).reset();
+    }
+    EXPECT_TRUE(scheduler.may_start(Device, Class::Verify));
+}
+
+TEST_F(IoSchedulerTest, writesMetrics)
+{
+    using Class = tr_io_scheduler::Class;
+    static auto constexpr Device = tr_io_scheduler::DeviceId{ 1U };
+
+    auto scheduler = tr_io_scheduler{};
+    auto read = scheduler.begin(Device, Class::Read, 16384U);
+    scheduler.begin(Device, Class::Flush, 32768U).reset();
+
+    auto out = std::string{};
+    scheduler.write_metrics(out);
+    EXPECT_NE(std::string::npos, out.find(",class=\"read\"} 1\n"));
+    EXPECT_NE(std::string::npos, out.find("transmission_io_bytes_total{"));
+    EXPECT_NE(std::string::npos, out.find(",class=\"flush\"} 32768\n"));
+    EXPECT_NE(std::string::npos, out.find("transmission_io_duration_seconds_count{"));
+}
+
+TEST_F(IoSchedulerTest, findsDeviceOfMissingFolder)
+{
+    auto const device = tr_io_scheduler::device_of(sandboxDir());
+    EXPECT_EQ(device, tr_io_scheduler::device_of(sandboxDir() + "/not/created/yet"));
+}
+
+} // namespace libtransmission::test
@@ -0,0 +1,104 @@
+// This file Copyright (C) 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <chrono>
+#include <cstdint> // uint64_t
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <libtransmission/file.h>
+#include <libtransmission/io-trace.h>
+#include <libtransmission/tr-strbuf.h>
+#include <libtransmission/utils.h>
+
+#include "gtest/gtest.h"
+#include "test-fixtures.h"
+
+using namespace std::literals;
+
+namespace libtransmission::test
+{
+
+using IoTraceTest = SandboxedTest;
+using Op = tr_io_trace::Op;
+
+namespace
+{
+[[nodiscard]] bool operator==(tr_io_trace::Event const& lhs, tr_io_trace::Event const& rhs)
+{
+    return lhs.op == rhs.op && lhs.time == rhs.time && lhs.tor_id == rhs.tor_id && lhs.file == rhs.file &&
+        lhs.offset == rhs.offset && lhs.length == rhs.length;
+}
+} // namespace
+
+TEST_F(IoTraceTest, roundTrips)
+{
+    auto const filename = tr_pathbuf{ sandboxDir(), "/trace.bin"sv };
+    auto const layout = tr_io_trace::Layout{ 3, 256U * 1024U, { 1000U, uint64_t{ 5 } << 40U, 16384U } };
+    auto const events = std::vector<tr_io_trace::Event>{
+        { Op::Write, 10us, 3, 0U, 0U, 1000U },
+        { Op::Read, 10us, 3, 1U, uint64_t{ 4 } << 40U, 16384U },
+        { Op::Prefetch, 2500us, 3, 2U, 0U, 16384U },
+        { Op::FlushFile, 1h, 3, 1U, 0U, uint64_t{ 5 } << 40U },
+        { Op::FlushTorrent, 1h + 1us, 3, 0U, 0U, (uint64_t{ 5 } << 40U) + 17384U },
+    };
+
+    {
+        auto trace = tr_io_trace{};
+        EXPECT_TRUE(trace.open(filename));
+        trace.record(layout);
+        for (auto const& event : events)
+        {
+            trace.record(event);
+        }
+    }
+
+    auto const loaded = tr_io_trace::load(filename);
+    ASSERT_TRUE(loaded);
+    ASSERT_EQ(1U, std::size(loaded->torrents));
+    EXPECT_EQ(layout.tor_id, loaded->torrents.front().tor_id);
+    EXPECT_EQ(layout.piece_size, loaded->torrents.front().piece_size);
+    EXPECT_EQ(layout.file_sizes, loaded->torrents.front().file_sizes);
+    ASSERT_EQ(std::size(events), std::size(loaded->events));
+    for (size_t i = 0; i < std::size(events); ++i)
+    {
+        EXPECT_TRUE(events[i] == loaded->events[i]) << i;
+    }
+}
+
+TEST_F(IoTraceTest, loadsUpToTruncatedRecord)
+{
+    auto const filename = tr_pathbuf{ sandboxDir(), "/trace.bin"sv };
+
+    {
+        auto trace = tr_io_trace{};
+        EXPECT_TRUE(trace.open(filename));
+        trace.record(tr_io_trace::Layout{ 1, 16384U, { 65536U } });
+        trace.record(tr_io_trace::Event{ Op::Read, 1us, 1, 0U, 0U, 16384U });
+        trace.record(tr_io_trace::Event{ Op::Read, 2us, 1, 0U, 49152U, 16384U });
+    }
+
+    // as if the session had crashed in the middle of writing the last event
+    auto contents = std::vector<char>{};
+    EXPECT_TRUE(tr_file_read(filename, contents));
+    contents.pop_back();
+    createFileWithContents(filename, std::string_view{ std::data(contents), std::size(contents) });
+
+    auto const loaded = tr_io_trace::load(filename);
+    ASSERT_TRUE(loaded);
+    EXPECT_EQ(1U, std::size(loaded->torrents));
+    ASSERT_EQ(1U, std::size(loaded->events));
+    EXPECT_EQ(0U, loaded->events.front().offset);
+}
+
+TEST_F(IoTraceTest, rejectsOtherFiles)
+{
+    auto const filename = tr_pathbuf{ sandboxDir(), "/trace.bin"sv };
+    createFileWithContents(filename, "d8:announce0:e"sv);
+    EXPECT_FALSE(tr_io_trace::load(filename));
+}
+
+} // namespace libtransmission::test
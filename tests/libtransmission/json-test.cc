@@ -5,13 +5,16 @@
 
 #define LIBTRANSMISSION_VARIANT_MODULE
 
+#include <array>
 #include <cstdint> // int64_t
+#include <limits>
 #include <locale>
 #include <optional>
 #include <stdexcept> // std::runtime_error
 #include <string>
 #include <string_view>
 
+#include <libtransmission/error.h>
 #include <libtransmission/quark.h>
 #include <libtransmission/variant.h>
 
@@ -250,6 +253,152 @@ TEST_P(JSONTest, unescape)
     tr_variantClear(&top);
 }
 
+TEST_P(JSONTest, shardedMatchesLean)
+{
+    // build something shaped like a big `torrent-get` response
+    auto top = tr_variant{};
+    tr_variantInitDict(&top, 2U);
+    tr_variantDictAddStrView(&top, TR_KEY_result, "success"sv);
+    auto* const args = tr_variantDictAddDict(&top, TR_KEY_arguments, 2U);
+    tr_variantDictAddList(args, TR_KEY_removed, 0U);
+    auto constexpr NumTorrents = 5000;
+    auto* const torrents = tr_variantDictAddList(args, TR_KEY_torrents, NumTorrents);
+    for (int i = 0; i < NumTorrents; ++i)
+    {
+        auto* const tor = tr_variantListAddDict(torrents, 4U);
+        tr_variantDictAddInt(tor, TR_KEY_id, i);
+        tr_variantDictAddStr(tor, TR_KEY_name, "\"quoted\" ünïcode\n"sv);
+        tr_variantDictAddReal(tor, TR_KEY_percentDone, i / 7.0);
+        auto* const labels = tr_variantDictAddList(tor, TR_KEY_labels, 2U);
+        tr_variantListAddStrView(labels, "a"sv);
+        tr_variantListAddBool(labels, (i % 2) == 0);
+    }
+
+    auto const expected = tr_variantToStr(&top, TR_VARIANT_FMT_JSON_LEAN);
+    for (size_t n_threads : { 0U, 1U, 2U, 3U, 8U, 64U })
+    {
+        EXPECT_EQ(expected, tr_variantToStrJsonSharded(&top, n_threads)) << n_threads;
+    }
+
+    // small and non-container values go through the regular walker
+    auto small = tr_variant{};
+    tr_variantInitInt(&small, 42);
+    EXPECT_EQ(tr_variantToStr(&small, TR_VARIANT_FMT_JSON_LEAN), tr_variantToStrJsonSharded(&small, 4U));
+
+    tr_variantClear(&top);
+}
+
+TEST_P(JSONTest, rejectsTruncatedInput)
+{
+    auto const full = R"({ "list": [1, 2.5, "three", true, null], "dict": { "key": "value" } })"sv;
+
+    // every proper prefix of a single JSON object is incomplete
+    for (size_t len = 1; len < std::size(full); ++len)
+    {
+        auto const in = full.substr(0, len);
+        auto top = tr_variant{};
+        EXPECT_FALSE(tr_variantFromBuf(&top, TR_VARIANT_PARSE_JSON | TR_VARIANT_PARSE_INPLACE, in)) << in;
+        EXPECT_FALSE(tr_variantIsDict(&top)) << in;
+    }
+
+    auto top = tr_variant{};
+    EXPECT_TRUE(tr_variantFromBuf(&top, TR_VARIANT_PARSE_JSON | TR_VARIANT_PARSE_INPLACE, full));
+    tr_variantClear(&top);
+}
+
+TEST_P(JSONTest, rejectsMalformedInput)
+{
+    static auto constexpr Inputs = std::array<std::string_view, 16>{
+        R"({ "a" 1 })"sv, // missing ':'
+        R"({ "a": 1 "b": 2 })"sv, // missing ','
+        R"({ 1: 2 })"sv, // key isn't a string
+        R"({ "a": 1, })"sv, // trailing ','
+        R"([1 2])"sv,
+        R"([1, ])"sv,
+        R"([1, 2})"sv, // mismatched brackets
+        R"({ "a": [1 })"sv,
+        R"(tru)"sv,
+        R"(nul)"sv,
+        R"([falsy])"sv,
+        R"([+1])"sv,
+        R"([1.2.3])"sv,
+        R"([1-2])"sv,
+        R"([-])"sv,
+        R"([ 'single-quoted' ])"sv,
+    };
+
+    for (auto const& in : Inputs)
+    {
+        auto top = tr_variant{};
+        tr_error* error = nullptr;
+        EXPECT_FALSE(tr_variantFromBuf(&top, TR_VARIANT_PARSE_JSON | TR_VARIANT_PARSE_INPLACE, in, nullptr, &error)) << in;
+        EXPECT_NE(nullptr, error) << in;
+        tr_error_clear(&error);
+    }
+}
+
+TEST_P(JSONTest, limitsNesting)
+{
+    // matches MaxDepth in variant-json.cc
+    auto constexpr MaxDepth = size_t{ 64 };
+
+    auto const nested = [](size_t depth)
+    {
+        return std::string(depth, '[') + std::string(depth, ']');
+    };
+
+    auto top = tr_variant{};
+    EXPECT_TRUE(tr_variantFromBuf(&top, TR_VARIANT_PARSE_JSON, nested(MaxDepth)));
+    EXPECT_TRUE(tr_variantIsList(&top));
+    tr_variantClear(&top);
+
+    tr_error* error = nullptr;
+    EXPECT_FALSE(tr_variantFromBuf(&top, TR_VARIANT_PARSE_JSON, nested(MaxDepth + 1U), nullptr, &error));
+    EXPECT_NE(nullptr, error);
+    tr_error_clear(&error);
+
+    // far too deep to recurse into
+    EXPECT_FALSE(tr_variantFromBuf(&top, TR_VARIANT_PARSE_JSON, nested(100000U)));
+}
+
+TEST_P(JSONTest, parsesBigIntegersAsReals)
+{
+    auto const in = R"([9223372036854775807, -9223372036854775808, 9223372036854775808, -9223372036854775809,
+                        18446744073709551616, 1e3])"sv;
+
+    auto top = tr_variant{};
+    EXPECT_TRUE(tr_variantFromBuf(&top, TR_VARIANT_PARSE_JSON | TR_VARIANT_PARSE_INPLACE, in));
+    EXPECT_EQ(6U, tr_variantListSize(&top));
+
+    // these fit in an int64_t
+    auto i = int64_t{};
+    EXPECT_TRUE(tr_variantIsInt(tr_variantListChild(&top, 0)));
+    EXPECT_TRUE(tr_variantGetInt(tr_variantListChild(&top, 0), &i));
+    EXPECT_EQ(std::numeric_limits<int64_t>::max(), i);
+    EXPECT_TRUE(tr_variantIsInt(tr_variantListChild(&top, 1)));
+    EXPECT_TRUE(tr_variantGetInt(tr_variantListChild(&top, 1), &i));
+    EXPECT_EQ(std::numeric_limits<int64_t>::min(), i);
+
+    // these don't
+    auto d = double{};
+    EXPECT_TRUE(tr_variantIsReal(tr_variantListChild(&top, 2)));
+    EXPECT_TRUE(tr_variantGetReal(tr_variantListChild(&top, 2), &d));
+    EXPECT_DOUBLE_EQ(9223372036854775808.0, d);
+    EXPECT_TRUE(tr_variantIsReal(tr_variantListChild(&top, 3)));
+    EXPECT_TRUE(tr_variantGetReal(tr_variantListChild(&top, 3), &d));
+    EXPECT_DOUBLE_EQ(-9223372036854775809.0, d);
+    EXPECT_TRUE(tr_variantIsReal(tr_variantListChild(&top, 4)));
+    EXPECT_TRUE(tr_variantGetReal(tr_variantListChild(&top, 4), &d));
+    EXPECT_DOUBLE_EQ(18446744073709551616.0, d);
+
+    // an exponent makes it a real, even if its value is a whole number
+    EXPECT_TRUE(tr_variantIsReal(tr_variantListChild(&top, 5)));
+    EXPECT_TRUE(tr_variantGetReal(tr_variantListChild(&top, 5), &d));
+    EXPECT_DOUBLE_EQ(1000.0, d);
+
+    tr_variantClear(&top);
+}
+
 INSTANTIATE_TEST_SUITE_P( //
     JSON,
     JSONTest,
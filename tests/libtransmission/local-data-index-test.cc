@@ -0,0 +1,118 @@
+// This file Copyright (C) 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <cstdint> // uint32_t, uint64_t
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <libtransmission/crypto-utils.h>
+#include <libtransmission/file.h>
+#include <libtransmission/local-data-index.h>
+#include <libtransmission/tr-strbuf.h>
+#include <libtransmission/utils.h>
+
+#include "gtest/gtest.h"
+#include "test-fixtures.h"
+
+using namespace std::literals;
+
+namespace libtransmission::test
+{
+
+class LocalDataIndexTest : public SandboxedTest
+{
+protected:
+    static auto constexpr PieceSize = uint32_t{ 256U * 1024U };
+    static auto constexpr FileSize = uint64_t{ PieceSize } * 5U;
+
+    void SetUp() override
+    {
+        SandboxedTest::SetUp();
+
+        payload_.resize(FileSize);
+        for (size_t i = 0; i < std::size(payload_); ++i)
+        {
+            payload_[i] = static_cast<char>(i * 7U + i / 4096U);
+        }
+
+        source_ = tr_pathbuf{ sandboxDir(), "/seeding/file.bin"sv };
+        tr_sys_dir_create(std::string{ tr_sys_path_dirname(source_) }, TR_SYS_DIR_CREATE_PARENTS, 0700);
+        createFileWithContents(source_, payload_);
+    }
+
+    // an import of the whole file, as if the new torrent's pieces lined up with it
+    [[nodiscard]] tr_local_data_index::Import make_import(uint64_t first_offset = 0U) const
+    {
+        auto import = tr_local_data_index::Import{};
+        import.target = tr_pathbuf{ sandboxDir(), "/new/Some Folder/file.bin"sv };
+        import.size = FileSize;
+        import.candidates.emplace_back(source_);
+
+        for (auto offset = first_offset; offset + PieceSize <= FileSize; offset += PieceSize)
+        {
+            auto const piece = std::string_view{ payload_ }.substr(offset, PieceSize);
+            import.pieces.push_back({ offset, PieceSize, tr_sha1::digest(piece) });
+        }
+
+        return import;
+    }
+
+    [[nodiscard]] std::string target_contents(tr_local_data_index::Import const& import) const
+    {
+        auto contents = std::vector<char>{};
+        EXPECT_TRUE(tr_file_read(import.target, contents));
+        return { std::data(contents), std::size(contents) };
+    }
+
+    std::string payload_;
+    std::string source_;
+};
+
+TEST_F(LocalDataIndexTest, linksFileThatMatches)
+{
+    auto const import = make_import();
+    EXPECT_TRUE(import.covers_file());
+    EXPECT_EQ(tr_local_data_index::Method::Link, tr_local_data_index::import_file(import));
+    EXPECT_EQ(payload_, target_contents(import));
+}
+
+TEST_F(LocalDataIndexTest, copiesFileThatPiecesDoNotCover)
+{
+    // the new torrent's first piece straddles the file before this one
+    auto const import = make_import(PieceSize / 2U);
+    EXPECT_FALSE(import.covers_file());
+    EXPECT_EQ(tr_local_data_index::Method::Copy, tr_local_data_index::import_file(import));
+    EXPECT_EQ(payload_, target_contents(import));
+    EXPECT_FALSE(tr_sys_path_exists(import.target + ".part"));
+}
+
+TEST_F(LocalDataIndexTest, skipsCandidatesThatDoNotMatch)
+{
+    auto import = make_import();
+    import.pieces.back().hash[0] ^= std::byte{ 1 };
+    EXPECT_EQ(tr_local_data_index::Method::None, tr_local_data_index::import_file(import));
+    EXPECT_FALSE(tr_sys_path_exists(import.target));
+
+    // the next candidate is tried after one that doesn't match
+    import = make_import();
+    auto const other = tr_pathbuf{ sandboxDir(), "/seeding/other.bin"sv };
+    createFileWithContents(other, std::string(FileSize, 'x'));
+    import.candidates.insert(std::begin(import.candidates), std::string{ other });
+    EXPECT_EQ(tr_local_data_index::Method::Link, tr_local_data_index::import_file(import));
+    EXPECT_EQ(payload_, target_contents(import));
+}
+
+TEST_F(LocalDataIndexTest, doesNotReplaceExistingFile)
+{
+    auto const import = make_import();
+    tr_sys_dir_create(std::string{ tr_sys_path_dirname(import.target) }, TR_SYS_DIR_CREATE_PARENTS, 0700);
+    createFileWithContents(import.target, "partly downloaded"sv);
+
+    EXPECT_EQ(tr_local_data_index::Method::None, tr_local_data_index::import_file(import));
+    EXPECT_EQ("partly downloaded"sv, target_contents(import));
+}
+
+} // namespace libtransmission::test
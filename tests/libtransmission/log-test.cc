@@ -0,0 +1,119 @@
+// This file Copyright (C) 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <cstddef> // size_t
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include <libtransmission/log.h>
+
+#include "gtest/gtest.h"
+
+using namespace std::literals;
+
+class LogTest : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        old_level_ = tr_logGetLevel();
+        tr_logSetLevel(TR_LOG_INFO);
+        tr_logSetQueueEnabled(true);
+        tr_logFreeQueue(tr_logGetQueue());
+    }
+
+    void TearDown() override
+    {
+        tr_logFreeQueue(tr_logGetQueue());
+        tr_logSetQueueEnabled(false);
+        tr_logSetLevel(old_level_);
+    }
+
+    [[nodiscard]] static std::vector<std::string> takeMessages()
+    {
+        auto ret = std::vector<std::string>{};
+        auto* const list = tr_logGetQueue();
+        for (auto const* walk = list; walk != nullptr; walk = walk->next)
+        {
+            ret.emplace_back(walk->message);
+        }
+        tr_logFreeQueue(list);
+        return ret;
+    }
+
+private:
+    tr_log_level old_level_ = TR_LOG_ERROR;
+};
+
+TEST_F(LogTest, queueIsOldestFirst)
+{
+    tr_logAddInfo("one");
+    tr_logAddInfo("two");
+    tr_logAddDebug("filtered out");
+    tr_logAddInfo("three");
+
+    EXPECT_EQ((std::vector<std::string>{ "one", "two", "three" }), takeMessages());
+    EXPECT_TRUE(std::empty(takeMessages()));
+}
+
+TEST_F(LogTest, queueKeepsEveryThreadsMessages)
+{
+    static auto constexpr NumThreads = size_t{ 4U };
+    static auto constexpr PerThread = size_t{ 500U };
+
+    auto threads = std::vector<std::thread>{};
+    for (size_t i = 0; i < NumThreads; ++i)
+    {
+        threads.emplace_back(
+            [i]()
+            {
+                for (size_t j = 0; j < PerThread; ++j)
+                {
+                    tr_logAddInfo(fmt::format("{:d}-{:d}", i, j));
+                }
+            });
+    }
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    auto const messages = takeMessages();
+    ASSERT_EQ(NumThreads * PerThread, std::size(messages));
+
+    // each thread's messages stay in order
+    auto next = std::vector<size_t>(NumThreads);
+    for (auto const& message : messages)
+    {
+        auto const dash = message.find('-');
+        auto const i = std::stoul(message.substr(0, dash));
+        EXPECT_EQ(next[i]++, std::stoul(message.substr(dash + 1U)));
+    }
+}
+
+TEST_F(LogTest, dropsAndCountsMessagesUnderOverload)
+{
+    static auto constexpr Extra = size_t{ 5U };
+
+    for (size_t i = 0; i < TR_LOG_MAX_QUEUE_LENGTH + Extra; ++i)
+    {
+        tr_logAddInfo(fmt::format("{:d}", i));
+    }
+
+    auto const messages = takeMessages();
+    ASSERT_EQ(TR_LOG_MAX_QUEUE_LENGTH + 1U, std::size(messages));
+    EXPECT_EQ("0"sv, messages.front());
+    EXPECT_EQ(std::to_string(TR_LOG_MAX_QUEUE_LENGTH - 1), messages[TR_LOG_MAX_QUEUE_LENGTH - 1]);
+    EXPECT_EQ("Dropped 5 log messages because too many were waiting"sv, messages.back());
+
+    // after draining, messages are queued again
+    tr_logAddInfo("again");
+    EXPECT_EQ((std::vector<std::string>{ "again" }), takeMessages());
+}
@@ -55,6 +55,11 @@ public:
         return allows_lpd_;
     }
 
+    [[nodiscard]] bool isClusterMode() const override
+    {
+        return cluster_mode_;
+    }
+
     [[nodiscard]] std::vector<TorrentInfo> torrents() const override
     {
         return torrents_;
@@ -86,6 +91,7 @@ public:
     tr_session& session_;
     tr_port port_ = tr_port::fromHost(51413);
     bool allows_lpd_ = true;
+    bool cluster_mode_ = false;
     std::vector<TorrentInfo> torrents_;
     std::set<std::string> found_;
     bool found_returns_ = true;
@@ -212,4 +218,36 @@ TEST_F(LpdTest, DISABLED_DoesNotReannounceTooSoon)
     }
 }
 
+TEST_F(LpdTest, DISABLED_clusterModeAnnouncesManyTorrents)
+{
+    auto mediator_a = MyMediator{ *session_ };
+    auto lpd_a = tr_lpd::create(mediator_a, session_->event_base());
+    EXPECT_TRUE(lpd_a);
+
+    // more than fit in one datagram
+    static auto constexpr NumTorrents = size_t{ 100U };
+    auto info_hash_strings = std::vector<std::string>{};
+    info_hash_strings.reserve(NumTorrents);
+    auto mediator_b = MyMediator{ *session_ };
+    mediator_b.cluster_mode_ = true;
+    for (size_t i = 0; i < NumTorrents; ++i)
+    {
+        auto info = tr_lpd::Mediator::TorrentInfo{};
+        info.info_hash_str = info_hash_strings.emplace_back(makeRandomHashString());
+        info.activity = TR_STATUS_SEED;
+        info.allows_lpd = true;
+        info.announce_after = 0; // never announced
+        info.active_at = 0;
+        mediator_b.torrents_.push_back(info);
+    }
+
+    auto lpd_b = tr_lpd::create(mediator_b, session_->event_base());
+    waitFor([&mediator_a]() { return std::size(mediator_a.found_) == NumTorrents; }, 1s);
+
+    for (auto const& info_hash_string : info_hash_strings)
+    {
+        EXPECT_EQ(1U, mediator_a.found_.count(info_hash_string));
+    }
+}
+
 } // namespace libtransmission::test
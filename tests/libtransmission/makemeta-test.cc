@@ -6,6 +6,7 @@
 #include <algorithm>
 #include <cstddef> // size_t, std::byte
 #include <cstdint> // uint32_t
+#include <cstring> // memcmp()
 #include <ctime>
 #include <string>
 #include <string_view>
@@ -16,6 +17,7 @@
 #include <libtransmission/crypto-utils.h>
 #include <libtransmission/file.h>
 #include <libtransmission/makemeta.h>
+#include <libtransmission/merkle.h>
 #include <libtransmission/quark.h>
 #include <libtransmission/session.h> // TR_NAME
 #include <libtransmission/torrent-metainfo.h>
@@ -76,8 +78,7 @@ protected:
         EXPECT_TRUE(metainfo.parse_benc(builder.benc()));
         EXPECT_EQ(builder.file_count(), metainfo.file_count());
         EXPECT_EQ(builder.piece_size(), metainfo.piece_size());
-        EXPECT_EQ(builder.total_size(), metainfo.total_size());
-        EXPECT_EQ(builder.total_size(), metainfo.total_size());
+        EXPECT_EQ(paddedSize(builder), metainfo.total_size());
         for (size_t i = 0, n = std::min(builder.file_count(), metainfo.file_count()); i < n; ++i)
         {
             EXPECT_EQ(builder.file_size(i), metainfo.files().fileSize(i));
@@ -89,6 +90,44 @@ protected:
         EXPECT_EQ(builder.announce_list().to_string(), metainfo.announce_list().to_string());
         return metainfo;
     }
+
+    // The size of the torrent that `builder` makes. When each file starts
+    // on a new piece, the padding before it is part of the torrent too.
+    static uint64_t paddedSize(tr_metainfo_builder const& builder)
+    {
+        if (!builder.pad_files() && builder.version() == tr_metainfo_builder::Version::V1)
+        {
+            return builder.total_size();
+        }
+
+        auto const piece_size = uint64_t{ builder.piece_size() };
+        auto ret = uint64_t{};
+        for (tr_file_index_t i = 0, n = builder.file_count(); i < n; ++i)
+        {
+            if (auto const file_size = builder.file_size(i); file_size != 0U)
+            {
+                ret = (ret + piece_size - 1U) / piece_size * piece_size + file_size;
+            }
+        }
+        return ret;
+    }
+
+    // the root of a BitTorrent v2 merkle tree whose leaves are
+    // `leaves`, padded with zeroes until there are `width` of them
+    static tr_sha256_digest_t merkleRoot(std::vector<tr_sha256_digest_t> layer, size_t width)
+    {
+        layer.resize(width);
+        while (std::size(layer) > 1U)
+        {
+            auto next = std::vector<tr_sha256_digest_t>{};
+            for (size_t i = 0; i < std::size(layer); i += 2U)
+            {
+                next.emplace_back(tr_sha256::digest(layer[i], layer[i + 1U]));
+            }
+            layer = std::move(next);
+        }
+        return layer.front();
+    }
 };
 
 TEST_F(MakemetaTest, comment)
@@ -141,6 +180,269 @@ TEST_F(MakemetaTest, pieceSize)
     }
 }
 
+TEST_F(MakemetaTest, threads)
+{
+    static auto constexpr PieceSize = uint32_t{ 16384U };
+    auto const files = makeRandomFiles(sandboxDir(), 1, PieceSize * 40U);
+    auto const [filename, payload] = files.front();
+
+    for (size_t const n_threads : { 1U, 2U, 3U, 0U })
+    {
+        auto builder = tr_metainfo_builder{ filename };
+        builder.set_piece_size(PieceSize);
+        builder.set_threads(n_threads);
+        EXPECT_EQ(n_threads, builder.threads());
+
+        auto const metainfo = testBuilder(builder);
+        ASSERT_EQ(builder.piece_count(), metainfo.piece_count());
+        for (tr_piece_index_t piece = 0; piece < metainfo.piece_count(); ++piece)
+        {
+            auto const offset = size_t{ piece } * PieceSize;
+            auto const len = std::min(size_t{ PieceSize }, std::size(payload) - offset);
+            auto const expected = tr_sha1::digest(std::string_view{ reinterpret_cast<char const*>(&payload[offset]), len });
+            EXPECT_EQ(expected, metainfo.piece_hash(piece));
+        }
+    }
+}
+
+TEST_F(MakemetaTest, v2)
+{
+    static auto constexpr BlockSize = size_t{ 16384U };
+    static auto constexpr PieceSize = uint32_t{ BlockSize * 2U };
+    auto const files = makeRandomFiles(sandboxDir(), 1, PieceSize * 6U);
+    auto const [filename, payload] = files.front();
+
+    auto builder = tr_metainfo_builder{ filename };
+    builder.set_piece_size(PieceSize);
+    builder.set_version(tr_metainfo_builder::Version::V2);
+    EXPECT_EQ(nullptr, builder.make_checksums().get());
+
+    // build the merkle tree the slow way
+    auto leaves = std::vector<tr_sha256_digest_t>{};
+    for (size_t offset = 0; offset < std::size(payload); offset += BlockSize)
+    {
+        auto const len = std::min(BlockSize, std::size(payload) - offset);
+        leaves.emplace_back(tr_sha256::digest(std::string_view{ reinterpret_cast<char const*>(&payload[offset]), len }));
+    }
+    auto width = size_t{ 1U };
+    while (width < std::size(leaves))
+    {
+        width *= 2U;
+    }
+    auto const root = merkleRoot(leaves, width);
+    auto layer = std::vector<tr_sha256_digest_t>{};
+    for (size_t i = 0; i < std::size(leaves); i += 2U)
+    {
+        auto const last = std::min(i + 2U, std::size(leaves));
+        layer.emplace_back(merkleRoot(std::vector<tr_sha256_digest_t>(std::begin(leaves) + i, std::begin(leaves) + last), 2U));
+    }
+    EXPECT_EQ(root, builder.pieces_root(0));
+
+    // generate the torrent and parse it as a variant
+    auto top = tr_variant{};
+    auto const benc = builder.benc();
+    EXPECT_TRUE(tr_variantFromBuf(&top, TR_VARIANT_PARSE_BENC | TR_VARIANT_PARSE_INPLACE, benc));
+
+    // confirm it's a v2 torrent with no v1 info
+    tr_variant* info = nullptr;
+    ASSERT_TRUE(tr_variantDictFindDict(&top, TR_KEY_info, &info));
+    auto meta_version = int64_t{};
+    EXPECT_TRUE(tr_variantDictFindInt(info, TR_KEY_meta_version, &meta_version));
+    EXPECT_EQ(2, meta_version);
+    EXPECT_EQ(nullptr, tr_variantDictFind(info, TR_KEY_pieces));
+    EXPECT_EQ(nullptr, tr_variantDictFind(info, TR_KEY_length));
+
+    // confirm the file's entry in the file tree
+    tr_variant* file_tree = nullptr;
+    tr_variant* dir = nullptr;
+    tr_variant* file = nullptr;
+    ASSERT_TRUE(tr_variantDictFindDict(info, TR_KEY_file_tree, &file_tree));
+    ASSERT_TRUE(tr_variantDictFindDict(file_tree, tr_quark_new(builder.name()), &dir));
+    ASSERT_TRUE(tr_variantDictFindDict(dir, TR_KEY_NONE, &file));
+    auto length = int64_t{};
+    EXPECT_TRUE(tr_variantDictFindInt(file, TR_KEY_length, &length));
+    EXPECT_EQ(std::size(payload), static_cast<size_t>(length));
+    auto const* raw = static_cast<std::byte const*>(nullptr);
+    auto raw_len = size_t{};
+    ASSERT_TRUE(tr_variantDictFindRaw(file, TR_KEY_pieces_root, &raw, &raw_len));
+    EXPECT_EQ(std::size(root), raw_len);
+    EXPECT_TRUE(std::equal(std::begin(root), std::end(root), raw));
+
+    // files that are bigger than a piece have a piece layer
+    tr_variant* piece_layers = nullptr;
+    ASSERT_TRUE(tr_variantDictFindDict(&top, TR_KEY_piece_layers, &piece_layers));
+    auto const key = tr_quark_new({ reinterpret_cast<char const*>(std::data(root)), std::size(root) });
+    if (std::size(payload) > PieceSize)
+    {
+        ASSERT_TRUE(tr_variantDictFindRaw(piece_layers, key, &raw, &raw_len));
+        ASSERT_EQ(std::size(layer) * sizeof(tr_sha256_digest_t), raw_len);
+        EXPECT_EQ(0, memcmp(std::data(layer), raw, raw_len));
+    }
+    else
+    {
+        EXPECT_EQ(nullptr, tr_variantDictFind(piece_layers, key));
+    }
+
+    tr_variantClear(&top);
+}
+
+TEST_F(MakemetaTest, hybrid)
+{
+    static auto constexpr PieceSize = uint32_t{ 16384U };
+    auto const files = makeRandomFiles(sandboxDir(), 8, PieceSize * 3U);
+    auto builder = tr_metainfo_builder{ sandboxDir() };
+    builder.set_piece_size(PieceSize);
+    builder.set_version(tr_metainfo_builder::Version::Hybrid);
+    EXPECT_EQ(nullptr, builder.make_checksums().get());
+
+    auto metainfo = tr_torrent_metainfo{};
+    EXPECT_TRUE(metainfo.parse_benc(builder.benc()));
+    EXPECT_EQ(builder.piece_count(), metainfo.piece_count());
+
+    // every file except the pad files starts on a new piece,
+    // so that its v1 pieces are the same as its v2 pieces
+    auto offset = uint64_t{};
+    auto n_files = size_t{};
+    for (tr_file_index_t i = 0; i < metainfo.file_count(); ++i)
+    {
+        auto const file_size = metainfo.files().fileSize(i);
+        auto const first_piece = static_cast<tr_piece_index_t>(offset / PieceSize);
+        offset += file_size;
+
+        EXPECT_EQ(tr_strv_contains(metainfo.files().path(i), "/.pad/"sv), metainfo.file_is_padding(i));
+        if (metainfo.file_is_padding(i))
+        {
+            continue;
+        }
+
+        EXPECT_EQ(0U, (offset - file_size) % PieceSize);
+        EXPECT_EQ(builder.path(n_files), metainfo.files().path(i));
+
+        // each of the file's pieces has the v2 hash that covers it
+        auto const iter = std::find_if(
+            std::begin(files),
+            std::end(files),
+            [&metainfo, i](auto const& file)
+            { return tr_sys_path_basename(file.first) == tr_sys_path_basename(metainfo.files().path(i)); });
+        ASSERT_NE(std::end(files), iter);
+        auto const data = std::string_view{ reinterpret_cast<char const*>(std::data(iter->second)), std::size(iter->second) };
+        ASSERT_EQ(std::size(data), file_size);
+        for (size_t pos = 0; pos < file_size; pos += PieceSize)
+        {
+            auto const subtree = metainfo.piece_root(first_piece + pos / PieceSize);
+            ASSERT_TRUE(subtree);
+            EXPECT_TRUE(tr_merkle_verify(data.substr(pos, PieceSize), *subtree));
+
+            auto corrupt = std::string{ data.substr(pos, PieceSize) };
+            corrupt.back() ^= 1;
+            EXPECT_FALSE(tr_merkle_verify(corrupt, *subtree));
+        }
+        if (file_size <= PieceSize)
+        {
+            EXPECT_EQ(builder.pieces_root(n_files), metainfo.piece_root(first_piece)->root);
+        }
+
+        ++n_files;
+    }
+    EXPECT_EQ(builder.file_count(), n_files);
+    EXPECT_EQ(std::size(files), n_files);
+}
+
+TEST_F(MakemetaTest, padFiles)
+{
+    static auto constexpr PieceSize = uint32_t{ 16384U };
+    auto const files = makeRandomFiles(sandboxDir(), 8, PieceSize * 3U);
+    auto builder = tr_metainfo_builder{ sandboxDir() };
+    builder.set_piece_size(PieceSize);
+    builder.set_pad_files(true);
+    EXPECT_EQ(nullptr, builder.make_checksums().get());
+
+    auto metainfo = tr_torrent_metainfo{};
+    EXPECT_TRUE(metainfo.parse_benc(builder.benc()));
+    EXPECT_EQ(builder.piece_count(), metainfo.piece_count());
+    EXPECT_LT(builder.total_size(), metainfo.total_size());
+    EXPECT_EQ(paddedSize(builder), metainfo.total_size());
+
+    // every file except the pad files starts on a new piece,
+    // and the v1 piece hashes are of the files padded with zeroes
+    auto contents = std::string{};
+    auto n_files = size_t{};
+    for (tr_file_index_t i = 0; i < metainfo.file_count(); ++i)
+    {
+        auto const file_size = metainfo.files().fileSize(i);
+        if (metainfo.file_is_padding(i))
+        {
+            EXPECT_NE(0U, std::size(contents) % PieceSize);
+            contents.append(file_size, '\0');
+            continue;
+        }
+
+        EXPECT_EQ(0U, std::size(contents) % PieceSize);
+        EXPECT_EQ(builder.path(n_files), metainfo.files().path(i));
+
+        auto const iter = std::find_if(
+            std::begin(files),
+            std::end(files),
+            [&metainfo, i](auto const& file)
+            { return tr_sys_path_basename(file.first) == tr_sys_path_basename(metainfo.files().path(i)); });
+        ASSERT_NE(std::end(files), iter);
+        ASSERT_EQ(std::size(iter->second), file_size);
+        contents.append(reinterpret_cast<char const*>(std::data(iter->second)), std::size(iter->second));
+
+        ++n_files;
+    }
+    EXPECT_EQ(builder.file_count(), n_files);
+    EXPECT_EQ(std::size(files), n_files);
+
+    auto const contents_sv = std::string_view{ contents };
+    for (tr_piece_index_t piece = 0; piece < metainfo.piece_count(); ++piece)
+    {
+        EXPECT_EQ(tr_sha1::digest(contents_sv.substr(piece * uint64_t{ PieceSize }, PieceSize)), metainfo.piece_hash(piece));
+    }
+}
+
+TEST_F(MakemetaTest, reusesPreviousPieceHashes)
+{
+    static auto constexpr PieceSize = uint32_t{ 16384U };
+    auto const top = tr_pathbuf{ sandboxDir(), "/files"sv };
+    tr_sys_dir_create(top, TR_SYS_DIR_CREATE_PARENTS, 0700);
+    (void)makeRandomFiles(top, 4, PieceSize * 3U);
+
+    // save a torrent that claims to be newer than its files
+    auto const previous_filename = tr_pathbuf{ sandboxDir(), "/previous.torrent"sv };
+    auto previous = tr_metainfo_builder{ top.sv() };
+    previous.set_piece_size(PieceSize);
+    EXPECT_EQ(nullptr, previous.make_checksums().get());
+    auto top_dict = tr_variant{};
+    ASSERT_TRUE(tr_variantFromBuf(&top_dict, TR_VARIANT_PARSE_BENC, previous.benc()));
+    tr_variantDictAddInt(&top_dict, TR_KEY_creation_date, time(nullptr) + 60);
+    EXPECT_EQ(0, tr_variantToFile(&top_dict, TR_VARIANT_FMT_BENC, previous_filename));
+    tr_variantClear(&top_dict);
+
+    // add a file that sorts after the others
+    auto payload = std::vector<char>(PieceSize * 2U + 1U);
+    tr_rand_buffer(std::data(payload), std::size(payload));
+    EXPECT_TRUE(tr_file_save(tr_pathbuf{ top, "/zzz"sv }, payload));
+
+    auto builder = tr_metainfo_builder{ top.sv() };
+    EXPECT_TRUE(builder.set_previous(previous_filename));
+    EXPECT_EQ(PieceSize, builder.piece_size());
+    auto const metainfo = testBuilder(builder);
+
+    // the pieces that were entirely in the old files are reused
+    EXPECT_EQ(previous.total_size() / PieceSize, builder.reused_piece_count());
+
+    // and the hashes are the same as hashing everything
+    auto rehashed = tr_metainfo_builder{ top.sv() };
+    rehashed.set_piece_size(PieceSize);
+    auto const expected = testBuilder(rehashed);
+    ASSERT_EQ(expected.piece_count(), metainfo.piece_count());
+    for (tr_piece_index_t piece = 0; piece < metainfo.piece_count(); ++piece)
+    {
+        EXPECT_EQ(expected.piece_hash(piece), metainfo.piece_hash(piece));
+    }
+}
+
 TEST_F(MakemetaTest, webseeds)
 {
     auto const files = makeRandomFiles(sandboxDir(), 1);
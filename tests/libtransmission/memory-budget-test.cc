@@ -0,0 +1,82 @@
+// This file Copyright (C) 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <cstdint> // uint64_t
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/memory-budget.h>
+
+#include "gtest/gtest.h"
+
+using MemoryBudgetTest = ::testing::Test;
+using Pressure = tr_memory_budget::Pressure;
+
+namespace
+{
+[[nodiscard]] tr_memory_usage make_usage(uint64_t cache_bytes, uint64_t peer_buffer_bytes)
+{
+    auto usage = tr_memory_usage{};
+    usage.bytes[tr_memory_usage::Cache] = cache_bytes;
+    usage.bytes[tr_memory_usage::PeerBuffers] = peer_buffer_bytes;
+    return usage;
+}
+} // namespace
+
+TEST_F(MemoryBudgetTest, totalsTheCategories)
+{
+    auto const usage = make_usage(100U, 23U);
+    EXPECT_EQ(123U, usage.total());
+    EXPECT_EQ("peer_buffers", tr_memory_usage::name(tr_memory_usage::PeerBuffers));
+}
+
+TEST_F(MemoryBudgetTest, hasNoPressureWithoutALimit)
+{
+    auto budget = tr_memory_budget{};
+    EXPECT_EQ(Pressure::None, budget.update(make_usage(1U << 30U, 1U << 30U)));
+    EXPECT_FALSE(budget.is_refusing_peers());
+}
+
+TEST_F(MemoryBudgetTest, pressureRisesNearTheLimit)
+{
+    auto budget = tr_memory_budget{};
+    budget.set_limit(1000U);
+
+    EXPECT_EQ(Pressure::None, budget.update(make_usage(800U, 0U)));
+    EXPECT_FALSE(budget.is_refusing_peers());
+
+    EXPECT_EQ(Pressure::High, budget.update(make_usage(800U, 100U)));
+    EXPECT_TRUE(budget.is_refusing_peers());
+
+    EXPECT_EQ(Pressure::Critical, budget.update(make_usage(800U, 200U)));
+    EXPECT_TRUE(budget.is_refusing_peers());
+    EXPECT_EQ(1000U, budget.usage().total());
+}
+
+TEST_F(MemoryBudgetTest, pressureFallsWithHysteresis)
+{
+    auto budget = tr_memory_budget{};
+    budget.set_limit(1000U);
+    EXPECT_EQ(Pressure::Critical, budget.update(make_usage(1200U, 0U)));
+
+    // still under pressure until usage drops well below the high-water mark
+    EXPECT_EQ(Pressure::High, budget.update(make_usage(800U, 0U)));
+    EXPECT_EQ(Pressure::None, budget.update(make_usage(700U, 0U)));
+
+    // and not back under pressure until it reaches the high-water mark again
+    EXPECT_EQ(Pressure::None, budget.update(make_usage(800U, 0U)));
+}
+
+TEST_F(MemoryBudgetTest, changingTheLimitUpdatesThePressure)
+{
+    auto budget = tr_memory_budget{};
+    EXPECT_EQ(Pressure::None, budget.update(make_usage(500U, 0U)));
+
+    budget.set_limit(400U);
+    EXPECT_EQ(Pressure::Critical, budget.pressure());
+
+    budget.set_limit(0U);
+    EXPECT_EQ(Pressure::None, budget.pressure());
+}
@@ -0,0 +1,104 @@
+// This file Copyright (C) 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <chrono>
+#include <string>
+#include <string_view>
+
+#include <libtransmission/metrics.h>
+
+#include "gtest/gtest.h"
+
+using namespace std::literals;
+
+TEST(Metrics, counter)
+{
+    auto counter = tr_metrics::Counter{};
+    EXPECT_EQ(0U, counter.value());
+
+    counter.add();
+    counter.add(41U);
+    EXPECT_EQ(42U, counter.value());
+}
+
+TEST(Metrics, histogramBucketsAreCumulative)
+{
+    auto histogram = tr_metrics::Histogram{};
+    histogram.observe(500us);
+    histogram.observe(1ms);
+    histogram.observe(30ms);
+    histogram.observe(1min);
+
+    auto out = std::string{};
+    histogram.write(out, "lag"sv);
+
+    EXPECT_NE(std::string::npos, out.find("lag_bucket{le=\"0.001\"} 2\n"sv)) << out;
+    EXPECT_NE(std::string::npos, out.find("lag_bucket{le=\"0.025\"} 2\n"sv)) << out;
+    EXPECT_NE(std::string::npos, out.find("lag_bucket{le=\"0.05\"} 3\n"sv)) << out;
+    EXPECT_NE(std::string::npos, out.find("lag_bucket{le=\"10\"} 3\n"sv)) << out;
+    EXPECT_NE(std::string::npos, out.find("lag_bucket{le=\"+Inf\"} 4\n"sv)) << out;
+    EXPECT_NE(std::string::npos, out.find("lag_sum 60.0315\n"sv)) << out;
+    EXPECT_NE(std::string::npos, out.find("lag_count 4\n"sv)) << out;
+}
+
+TEST(Metrics, histogramLabels)
+{
+    auto histogram = tr_metrics::Histogram{};
+    histogram.observe(2ms);
+
+    auto out = std::string{};
+    histogram.write(out, "lag"sv, "tracker=\"example.org:80\""sv);
+
+    EXPECT_NE(std::string::npos, out.find("lag_bucket{tracker=\"example.org:80\",le=\"0.0025\"} 1\n"sv)) << out;
+    EXPECT_NE(std::string::npos, out.find("lag_count{tracker=\"example.org:80\"} 1\n"sv)) << out;
+}
+
+TEST(Metrics, writesAnnounceDurationsPerTracker)
+{
+    auto& metrics = tr_metrics::instance();
+    metrics.observe_announce("tracker.example.org:6969"sv, 80ms);
+    metrics.observe_announce("tracker.example.org:6969"sv, 120ms);
+    metrics.observe_announce("a\"b:80"sv, 3ms);
+
+    auto out = std::string{};
+    metrics.write(out);
+
+    EXPECT_NE(std::string::npos, out.find("# TYPE transmission_announce_duration_seconds histogram\n"sv)) << out;
+    EXPECT_NE(
+        std::string::npos,
+        out.find("transmission_announce_duration_seconds_count{tracker=\"tracker.example.org:6969\"} 2\n"sv))
+        << out;
+    EXPECT_NE(std::string::npos, out.find("transmission_announce_duration_seconds_count{tracker=\"a\\\"b:80\"} 1\n"sv))
+        << out;
+}
+
+TEST(Metrics, tracksSlowLoopCallsBySource)
+{
+    auto& metrics = tr_metrics::instance();
+    auto const fast = tr_source_location{ "/src/fast.cc", 10 };
+    auto const slow = tr_source_location{ "/src/slow.cc", 20 };
+    metrics.observe_loop_call(tr_metrics::LoopCall::Timer, fast, 100us);
+    metrics.observe_loop_call(tr_metrics::LoopCall::Timer, slow, 30ms);
+    metrics.observe_loop_call(tr_metrics::LoopCall::Timer, slow, 50ms);
+    metrics.observe_loop_call(tr_metrics::LoopCall::Callback, slow, 2ms);
+
+    auto const slowest = metrics.slowest_loop_calls(2U);
+    ASSERT_EQ(2U, std::size(slowest));
+    EXPECT_EQ("timer"sv, slowest[0].kind_name());
+    EXPECT_EQ("slow.cc:20"sv, slowest[0].location());
+    EXPECT_EQ(2U, slowest[0].count);
+    EXPECT_EQ(80ms, slowest[0].total);
+    EXPECT_EQ(50ms, slowest[0].max);
+    EXPECT_EQ("callback"sv, slowest[1].kind_name());
+    EXPECT_EQ(1U, slowest[1].count);
+
+    auto out = std::string{};
+    metrics.write(out);
+    EXPECT_NE(
+        std::string::npos,
+        out.find("transmission_loop_slow_calls_total{kind=\"timer\",location=\"slow.cc:20\"} 2\n"sv))
+        << out;
+    EXPECT_EQ(std::string::npos, out.find("fast.cc"sv)) << out;
+}
@@ -106,7 +106,7 @@ TEST_P(IncompleteDirTest, incompleteDir)
             std::fill_n(std::data(*data.buf), tr_block_info::BlockSize, '\0');
             data.block = block_index;
             data.done = false;
-            session_->runInSessionThread(test_incomplete_dir_threadfunc, &data);
+            session_->runInSessionThread([&]() { test_incomplete_dir_threadfunc(&data); });
 
             auto const test = [&data]()
             {
@@ -164,6 +164,11 @@ TEST_F(MoveTest, setLocation)
     blockingTorrentVerify(tor);
     EXPECT_EQ(0, tr_torrentStat(tor)->leftUntilDone);
 
+    // remember where the first file is
+    auto filename = tr_pathbuf{};
+    EXPECT_TRUE(tor->find_file_cached(0, filename));
+    EXPECT_EQ(tr_torrentFindFile(tor, 0), filename.sv());
+
     // now move it
     auto state = int{ -1 };
     tr_torrentSetLocation(tor, target_dir, true, nullptr, &state);
@@ -187,6 +192,10 @@ TEST_F(MoveTest, setLocation)
         EXPECT_EQ(expected, tr_torrentFindFile(tor, i));
     }
 
+    // confirm the old location wasn't remembered
+    EXPECT_TRUE(tor->find_file_cached(0, filename));
+    EXPECT_EQ(tr_torrentFindFile(tor, 0), filename.sv());
+
     // cleanup
     tr_torrentRemove(tor, true, nullptr, nullptr);
 }
@@ -256,3 +256,52 @@ TEST_F(NetTest, ipCompare)
         EXPECT_EQ(ip1 == ip2, res == 0) << sv1 << ' ' << sv2;
     }
 }
+
+TEST_F(NetTest, subnetFromString)
+{
+    auto subnet = tr_subnet::from_string("192.168.0.0/16"sv);
+    ASSERT_TRUE(subnet.has_value());
+    assert(subnet.has_value());
+    EXPECT_EQ("192.168.0.0/16"sv, subnet->display_name());
+
+    // a bare address is a block of one
+    subnet = tr_subnet::from_string(" fe80::1 "sv);
+    ASSERT_TRUE(subnet.has_value());
+    assert(subnet.has_value());
+    EXPECT_EQ("fe80::1/128"sv, subnet->display_name());
+
+    EXPECT_FALSE(tr_subnet::from_string("10.0.0.0/33"sv));
+    EXPECT_FALSE(tr_subnet::from_string("10.0.0.0/8x"sv));
+    EXPECT_FALSE(tr_subnet::from_string("not-an-address/8"sv));
+
+    auto const subnets = tr_subnet::list_from_string("10.0.0.0/8, bogus,fc00::/7,"sv);
+    ASSERT_EQ(2U, std::size(subnets));
+    EXPECT_EQ("10.0.0.0/8"sv, subnets[0].display_name());
+    EXPECT_EQ("fc00::/7"sv, subnets[1].display_name());
+}
+
+TEST_F(NetTest, subnetContains)
+{
+    static auto constexpr Tests = std::array<std::tuple<std::string_view, std::string_view, bool>, 10>{ {
+        { "10.0.0.0/8"sv, "10.255.1.2"sv, true },
+        { "10.0.0.0/8"sv, "11.0.0.1"sv, false },
+        { "172.16.0.0/12"sv, "172.31.255.255"sv, true },
+        { "172.16.0.0/12"sv, "172.32.0.0"sv, false },
+        { "192.168.1.7"sv, "192.168.1.7"sv, true },
+        { "192.168.1.7"sv, "192.168.1.8"sv, false },
+        { "0.0.0.0/0"sv, "8.8.8.8"sv, true },
+        { "0.0.0.0/0"sv, "::1"sv, false },
+        { "fc00::/7"sv, "fdab:1234::1"sv, true },
+        { "fc00::/7"sv, "fe80::1"sv, false },
+    } };
+
+    for (auto const& [subnet_sv, address_sv, expected] : Tests)
+    {
+        auto const subnet = tr_subnet::from_string(subnet_sv);
+        auto const address = tr_address::from_string(address_sv);
+        ASSERT_TRUE(subnet.has_value());
+        ASSERT_TRUE(address.has_value());
+        assert(subnet.has_value() && address.has_value());
+        EXPECT_EQ(expected, subnet->contains(*address)) << subnet_sv << ' ' << address_sv;
+    }
+}
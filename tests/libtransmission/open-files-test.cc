@@ -204,3 +204,89 @@ TEST_F(OpenFilesTest, closesLeastRecentlyUsedFile)
     EXPECT_EQ(sorted, results);
     EXPECT_GT(std::count(std::begin(results), std::end(results), true), 0);
 }
+
+TEST_F(OpenFilesTest, closeTorrentLeavesOtherTorrentsOpen)
+{
+    static auto constexpr Contents = "Hello, World!\n"sv;
+    auto filename = tr_pathbuf{ sandboxDir(), "/test-file.txt" };
+    createFileWithContents(filename, Contents);
+
+    auto open_files = tr_open_files{ 8U };
+    EXPECT_TRUE(open_files.get(1, 0, false, filename, TR_PREALLOCATE_FULL, std::size(Contents)));
+    EXPECT_TRUE(open_files.get(1, 1, false, filename, TR_PREALLOCATE_FULL, std::size(Contents)));
+    EXPECT_TRUE(open_files.get(2, 0, false, filename, TR_PREALLOCATE_FULL, std::size(Contents)));
+    EXPECT_EQ(3U, open_files.size());
+
+    open_files.close_torrent(1);
+    EXPECT_EQ(1U, open_files.size());
+    EXPECT_FALSE(open_files.get(1, 0, false));
+    EXPECT_FALSE(open_files.get(1, 1, false));
+    EXPECT_TRUE(open_files.get(2, 0, false));
+}
+
+TEST_F(OpenFilesTest, shrinkingTheLimitClosesOldestFiles)
+{
+    static auto constexpr Contents = "Hello, World!\n"sv;
+    static auto constexpr TorId = tr_torrent_id_t{ 0 };
+    auto filename = tr_pathbuf{ sandboxDir(), "/test-file.txt" };
+    createFileWithContents(filename, Contents);
+
+    auto open_files = tr_open_files{ 4U };
+    for (tr_file_index_t i = 0; i < 4U; ++i)
+    {
+        EXPECT_TRUE(open_files.get(TorId, i, false, filename, TR_PREALLOCATE_FULL, std::size(Contents)));
+    }
+
+    // touch the first file so that it's no longer the oldest
+    EXPECT_TRUE(open_files.get(TorId, 0, false));
+
+    open_files.set_max_open_files(2U);
+    EXPECT_EQ(2U, open_files.max_open_files());
+    EXPECT_EQ(2U, open_files.size());
+    EXPECT_EQ(2U, open_files.stats().evictions);
+    EXPECT_TRUE(open_files.get(TorId, 0, false));
+    EXPECT_FALSE(open_files.get(TorId, 1, false));
+    EXPECT_FALSE(open_files.get(TorId, 2, false));
+    EXPECT_TRUE(open_files.get(TorId, 3, false));
+}
+
+TEST_F(OpenFilesTest, countsHitsAndMisses)
+{
+    static auto constexpr Contents = "Hello, World!\n"sv;
+    static auto constexpr TorId = tr_torrent_id_t{ 0 };
+    auto filename = tr_pathbuf{ sandboxDir(), "/test-file.txt" };
+    createFileWithContents(filename, Contents);
+
+    auto open_files = tr_open_files{};
+    EXPECT_TRUE(open_files.get(TorId, 0, false, filename, TR_PREALLOCATE_FULL, std::size(Contents)));
+    EXPECT_TRUE(open_files.get(TorId, 0, false, filename, TR_PREALLOCATE_FULL, std::size(Contents)));
+    EXPECT_TRUE(open_files.get(TorId, 0, false));
+    EXPECT_EQ(2U, open_files.stats().hits);
+    EXPECT_EQ(1U, open_files.stats().misses);
+}
+
+TEST_F(OpenFilesTest, openUncachedLeavesThePoolAlone)
+{
+    static auto constexpr Contents = "Hello, World!\n"sv;
+    static auto constexpr TorId = tr_torrent_id_t{ 0 };
+    auto filename = tr_pathbuf{ sandboxDir(), "/test-file.txt" };
+    createFileWithContents(filename, Contents);
+
+    auto open_files = tr_open_files{ 1U };
+    EXPECT_TRUE(open_files.get(TorId, 0, false, filename, TR_PREALLOCATE_FULL, std::size(Contents)));
+
+    auto const fd = open_files.open_uncached(filename, false, TR_PREALLOCATE_FULL, std::size(Contents));
+    EXPECT_TRUE(fd.has_value());
+    assert(fd.has_value());
+
+    // the pooled file wasn't evicted to make room
+    EXPECT_EQ(1U, open_files.size());
+    EXPECT_EQ(0U, open_files.stats().evictions);
+    EXPECT_TRUE(open_files.get(TorId, 0, false));
+
+    auto buf = std::array<char, std::size(Contents) + 1>{};
+    auto bytes_read = uint64_t{};
+    EXPECT_TRUE(tr_sys_file_read_at(*fd, std::data(buf), std::size(Contents), 0, &bytes_read));
+    EXPECT_EQ(Contents, (std::string_view{ std::data(buf), static_cast<size_t>(bytes_read) }));
+    EXPECT_TRUE(tr_sys_file_close(*fd));
+}
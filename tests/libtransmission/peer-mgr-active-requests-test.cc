@@ -6,7 +6,12 @@
 #define LIBTRANSMISSION_PEER_MODULE
 
 #include <algorithm>
+#include <cstdint> // uintptr_t
 #include <ctime> // time_t
+#include <limits>
+#include <map>
+#include <random>
+#include <utility>
 #include <vector>
 
 #include <libtransmission/transmission.h> // tr_block_index_t
@@ -189,3 +194,110 @@ TEST_F(PeerMgrActiveRequestsTest, sentBefore)
     EXPECT_EQ(block_a1, items[0].first);
     EXPECT_EQ(peer_a_, items[0].second);
 }
+
+TEST_F(PeerMgrActiveRequestsTest, matchesReferenceModel)
+{
+    // Exercise the hash table's growth and deletion paths by comparing
+    // it against a std::map after a long run of random operations.
+    auto requests = ActiveRequests{};
+    auto model = std::map<std::pair<tr_block_index_t, tr_peer*>, time_t>{};
+
+    auto rng = std::mt19937{ 1U };
+    auto const random_block = [&rng]()
+    {
+        return static_cast<tr_block_index_t>(rng() % 512U);
+    };
+    auto const random_peer = [&rng]()
+    {
+        return reinterpret_cast<tr_peer*>(uintptr_t{ 0x1000U } + (rng() % 16U) * 8U);
+    };
+
+    for (int i = 0; i < 20000; ++i)
+    {
+        auto const block = random_block();
+        auto* const peer = random_peer();
+
+        switch (rng() % 8U)
+        {
+        case 0:
+            {
+                auto const removed = requests.remove(block);
+                auto n_expected = size_t{};
+                for (auto it = std::begin(model); it != std::end(model);)
+                {
+                    if (it->first.first == block)
+                    {
+                        EXPECT_NE(std::end(removed), std::find(std::begin(removed), std::end(removed), it->first.second));
+                        it = model.erase(it);
+                        ++n_expected;
+                    }
+                    else
+                    {
+                        ++it;
+                    }
+                }
+                EXPECT_EQ(n_expected, std::size(removed));
+            }
+            break;
+
+        case 1:
+            if (rng() % 16U == 0U)
+            {
+                auto const removed = requests.remove(peer);
+                auto n_expected = size_t{};
+                for (auto it = std::begin(model); it != std::end(model);)
+                {
+                    if (it->first.second == peer)
+                    {
+                        EXPECT_NE(std::end(removed), std::find(std::begin(removed), std::end(removed), it->first.first));
+                        it = model.erase(it);
+                        ++n_expected;
+                    }
+                    else
+                    {
+                        ++it;
+                    }
+                }
+                EXPECT_EQ(n_expected, std::size(removed));
+            }
+            break;
+
+        case 2:
+        case 3:
+            EXPECT_EQ(model.erase({ block, peer }) != 0U, requests.remove(block, peer));
+            break;
+
+        default:
+            EXPECT_EQ(model.try_emplace({ block, peer }, i).second, requests.add(block, peer, i));
+            break;
+        }
+
+        EXPECT_EQ(std::size(model), requests.size());
+        EXPECT_EQ(model.count({ block, peer }) != 0U, requests.has(block, peer));
+    }
+
+    // check the per-block and per-peer counts
+    auto n_blocks = size_t{};
+    for (tr_block_index_t block = 0; block < 512U; ++block)
+    {
+        auto const n_expected = std::count_if(
+            std::begin(model),
+            std::end(model),
+            [block](auto const& item) { return item.first.first == block; });
+        EXPECT_EQ(static_cast<size_t>(n_expected), requests.count(block));
+        n_blocks += n_expected != 0 ? 1U : 0U;
+    }
+    EXPECT_EQ(std::size(model) - n_blocks, requests.count_duplicates());
+
+    for (uintptr_t i = 0U; i < 16U; ++i)
+    {
+        auto const* const peer = reinterpret_cast<tr_peer*>(uintptr_t{ 0x1000U } + i * 8U);
+        auto const n_expected = std::count_if(
+            std::begin(model),
+            std::end(model),
+            [peer](auto const& item) { return item.first.second == peer; });
+        EXPECT_EQ(static_cast<size_t>(n_expected), requests.count(peer));
+    }
+
+    EXPECT_EQ(std::size(model), std::size(requests.sentBefore(std::numeric_limits<time_t>::max())));
+}
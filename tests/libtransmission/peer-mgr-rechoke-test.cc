@@ -0,0 +1,116 @@
+// This file Copyright (C) 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <cstddef> // size_t
+#include <vector>
+
+#define LIBTRANSMISSION_PEER_MODULE
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/peer-mgr-rechoke.h>
+
+#include "gtest/gtest.h"
+
+namespace
+{
+
+[[nodiscard]] size_t count_unchoked(std::vector<ChokeData> const& candidates, bool is_interested)
+{
+    return std::count_if(
+        std::begin(candidates),
+        std::end(candidates),
+        [is_interested](auto const& item) { return !item.is_choked && item.is_interested == is_interested; });
+}
+
+} // namespace
+
+TEST(PeerMgrRechoke, unchokesFastestInterestedPeers)
+{
+    auto candidates = std::vector<ChokeData>{};
+    for (int rate = 0; rate < 10; ++rate)
+    {
+        candidates.emplace_back(nullptr, rate, uint8_t{}, true, true, true);
+    }
+
+    EXPECT_EQ(nullptr, rechoke_candidates(candidates, 3U, false, false));
+    EXPECT_EQ(3U, count_unchoked(candidates, true));
+    for (auto const& item : candidates)
+    {
+        EXPECT_EQ(item.rate < 7, item.is_choked) << item.rate;
+    }
+}
+
+TEST(PeerMgrRechoke, unchokesUninterestedPeersFasterThanTheDownloaders)
+{
+    auto candidates = std::vector<ChokeData>{};
+    for (int rate = 0; rate < 10; ++rate)
+    {
+        candidates.emplace_back(nullptr, rate * 10, uint8_t{}, true, true, true);
+        candidates.emplace_back(nullptr, rate * 10 + 5, uint8_t{}, false, true, true);
+    }
+
+    // the slowest downloader's rate is 70
+    EXPECT_EQ(nullptr, rechoke_candidates(candidates, 3U, false, false));
+    for (auto const& item : candidates)
+    {
+        EXPECT_EQ(item.rate < 70, item.is_choked) << item.rate;
+    }
+}
+
+TEST(PeerMgrRechoke, tiesDoNotGetExtraSlots)
+{
+    // a swarm of leechers that aren't sending us anything: most of them compare equal
+    static auto constexpr NumPeers = 1000;
+    static auto constexpr Slots = size_t{ 4U };
+
+    auto candidates = std::vector<ChokeData>{};
+    for (int i = 0; i < NumPeers; ++i)
+    {
+        candidates.emplace_back(nullptr, 0, uint8_t{}, true, true, true);
+    }
+
+    EXPECT_EQ(nullptr, rechoke_candidates(candidates, Slots, false, false));
+    EXPECT_EQ(Slots, count_unchoked(candidates, true));
+
+    // the optimistic unchoke is one of the peers that didn't get a slot
+    for (auto& item : candidates)
+    {
+        item.is_choked = true;
+    }
+    auto const* const optimistic = rechoke_candidates(candidates, Slots, false, true);
+    ASSERT_NE(nullptr, optimistic);
+    EXPECT_TRUE(optimistic->is_interested);
+    EXPECT_FALSE(optimistic->is_choked);
+    EXPECT_EQ(Slots + 1U, count_unchoked(candidates, true));
+}
+
+TEST(PeerMgrRechoke, optimisticNeedsALoser)
+{
+    auto candidates = std::vector<ChokeData>{};
+    candidates.emplace_back(nullptr, 10, uint8_t{}, true, true, true);
+    candidates.emplace_back(nullptr, 20, uint8_t{}, false, true, true);
+
+    // everyone interested already has a slot
+    EXPECT_EQ(nullptr, rechoke_candidates(candidates, 4U, false, true));
+    EXPECT_EQ(1U, count_unchoked(candidates, true));
+    EXPECT_EQ(1U, count_unchoked(candidates, false));
+}
+
+TEST(PeerMgrRechoke, maxedOutKeepsChokedPeersChoked)
+{
+    auto candidates = std::vector<ChokeData>{};
+    candidates.emplace_back(nullptr, 30, uint8_t{}, true, false, true);
+    candidates.emplace_back(nullptr, 20, uint8_t{}, true, true, true);
+    candidates.emplace_back(nullptr, 10, uint8_t{}, true, false, true);
+
+    // no optimistic unchoke either
+    EXPECT_EQ(nullptr, rechoke_candidates(candidates, 2U, true, true));
+    for (auto const& item : candidates)
+    {
+        EXPECT_EQ(item.rate != 30, item.is_choked) << item.rate;
+    }
+}
@@ -4,8 +4,12 @@
 // License text can be found in the licenses/ folder.
 
 #include <cstddef> // size_t
+#include <cstdint> // uint64_t
+#include <limits>
 #include <map>
+#include <optional>
 #include <set>
+#include <vector>
 
 #define LIBTRANSMISSION_PEER_MODULE
 
@@ -25,18 +29,22 @@ protected:
         mutable std::map<tr_piece_index_t, size_t> missing_block_count_;
         mutable std::map<tr_piece_index_t, tr_block_span_t> block_span_;
         mutable std::map<tr_piece_index_t, tr_priority_t> piece_priority_;
+        mutable std::map<tr_piece_index_t, size_t> piece_availability_;
+        mutable std::map<tr_piece_index_t, uint64_t> piece_deadline_;
         mutable std::set<tr_block_index_t> can_request_block_;
         mutable std::set<tr_piece_index_t> can_request_piece_;
         tr_piece_index_t piece_count_ = 0;
+        uint64_t now_ = 0;
+        size_t duplicates_allowed_ = std::numeric_limits<size_t>::max();
         bool is_endgame_ = false;
         bool is_sequential_download_ = false;
 
-        [[nodiscard]] bool clientCanRequestBlock(tr_block_index_t block) const final
+        [[nodiscard]] bool clientHasBlock(tr_block_index_t block) const final
         {
-            return can_request_block_.count(block) != 0;
+            return can_request_block_.count(block) == 0;
         }
 
-        [[nodiscard]] bool clientCanRequestPiece(tr_piece_index_t piece) const final
+        [[nodiscard]] bool clientWantsPiece(tr_piece_index_t piece) const final
         {
             return can_request_piece_.count(piece) != 0;
         }
@@ -75,7 +83,63 @@ protected:
         {
             return piece_priority_[piece];
         }
+
+        [[nodiscard]] size_t countPeersWithPiece(tr_piece_index_t piece) const final
+        {
+            return piece_availability_[piece];
+        }
+
+        [[nodiscard]] std::optional<uint64_t> pieceDeadline(tr_piece_index_t piece) const final
+        {
+            if (auto const iter = piece_deadline_.find(piece); iter != std::end(piece_deadline_))
+            {
+                return iter->second;
+            }
+
+            return {};
+        }
+
+        [[nodiscard]] uint64_t now() const final
+        {
+            return now_;
+        }
+
+        [[nodiscard]] size_t countDuplicatesAllowed() const final
+        {
+            return duplicates_allowed_;
+        }
     };
+
+    [[nodiscard]] static bool peerHasAllPieces(tr_piece_index_t /*piece*/)
+    {
+        return true;
+    }
+
+    [[nodiscard]] static bool noActiveRequestsToPeer(tr_block_index_t /*block*/)
+    {
+        return false;
+    }
+
+    [[nodiscard]] static auto next(Wishlist& wishlist, size_t n_wanted_blocks)
+    {
+        return wishlist.next(n_wanted_blocks, peerHasAllPieces, noActiveRequestsToPeer);
+    }
+
+    [[nodiscard]] static auto next(MockMediator const& mediator, size_t n_wanted_blocks)
+    {
+        auto wishlist = Wishlist{ mediator };
+        return next(wishlist, n_wanted_blocks);
+    }
+
+    [[nodiscard]] static auto countBlocks(std::vector<tr_block_span_t> const& spans, size_t n_blocks)
+    {
+        auto requested = tr_bitfield(n_blocks);
+        for (auto const& span : spans)
+        {
+            requested.set_span(span.begin, span.end);
+        }
+        return requested;
+    }
 };
 
 TEST_F(PeerMgrWishlistTest, doesNotRequestPiecesThatCannotBeRequested)
@@ -99,7 +163,7 @@ TEST_F(PeerMgrWishlistTest, doesNotRequestPiecesThatCannotBeRequested)
     }
 
     // we should only get the first piece back
-    auto spans = Wishlist{ mediator }.next(1000);
+    auto spans = next(mediator, 1000);
     ASSERT_EQ(1U, std::size(spans));
     EXPECT_EQ(mediator.block_span_[0].begin, spans[0].begin);
     EXPECT_EQ(mediator.block_span_[0].end, spans[0].end);
@@ -132,7 +196,7 @@ TEST_F(PeerMgrWishlistTest, doesNotRequestBlocksThatCannotBeRequested)
 
     // even if we ask wishlist for more blocks than exist,
     // it should omit blocks 1-10 from the return set
-    auto spans = Wishlist{ mediator }.next(1000);
+    auto spans = next(mediator, 1000);
     auto requested = tr_bitfield(250);
     for (auto const& span : spans)
     {
@@ -169,7 +233,7 @@ TEST_F(PeerMgrWishlistTest, doesNotRequestTooManyBlocks)
     // but we only ask for 10 blocks,
     // so that's how many we should get back
     auto const n_wanted = 10U;
-    auto const spans = Wishlist{ mediator }.next(n_wanted);
+    auto const spans = next(mediator, n_wanted);
     auto n_got = size_t{};
     for (auto const& span : spans)
     {
@@ -213,7 +277,7 @@ TEST_F(PeerMgrWishlistTest, prefersHighPriorityPieces)
     for (int run = 0; run < num_runs; ++run)
     {
         auto const n_wanted = 10U;
-        auto spans = Wishlist{ mediator }.next(n_wanted);
+        auto spans = next(mediator, n_wanted);
         auto n_got = size_t{};
         for (auto const& span : spans)
         {
@@ -259,7 +323,7 @@ TEST_F(PeerMgrWishlistTest, onlyRequestsDupesDuringEndgame)
 
     // even if we ask wishlist to list more blocks than exist,
     // those first 150 should be omitted from the return list
-    auto spans = Wishlist{ mediator }.next(1000);
+    auto spans = next(mediator, 1000);
     auto requested = tr_bitfield(300);
     for (auto const& span : spans)
     {
@@ -272,7 +336,7 @@ TEST_F(PeerMgrWishlistTest, onlyRequestsDupesDuringEndgame)
     // BUT during endgame it's OK to request dupes,
     // so then we _should_ see the first 150 in the list
     mediator.is_endgame_ = true;
-    spans = Wishlist{ mediator }.next(1000);
+    spans = next(mediator, 1000);
     requested = tr_bitfield(300);
     for (auto const& span : spans)
     {
@@ -322,7 +386,7 @@ TEST_F(PeerMgrWishlistTest, prefersNearlyCompletePieces)
     auto const num_runs = 1000;
     for (int run = 0; run < num_runs; ++run)
     {
-        auto const ranges = Wishlist{ mediator }.next(10);
+        auto const ranges = next(mediator, 10);
         auto requested = tr_bitfield(300);
         for (auto const& range : ranges)
         {
@@ -338,7 +402,7 @@ TEST_F(PeerMgrWishlistTest, prefersNearlyCompletePieces)
     // those blocks should be next in line.
     for (int run = 0; run < num_runs; ++run)
     {
-        auto const ranges = Wishlist{ mediator }.next(20);
+        auto const ranges = next(mediator, 20);
         auto requested = tr_bitfield(300);
         for (auto const& range : ranges)
         {
@@ -350,3 +414,276 @@ TEST_F(PeerMgrWishlistTest, prefersNearlyCompletePieces)
         EXPECT_EQ(0U, requested.count(200, 300));
     }
 }
+
+TEST_F(PeerMgrWishlistTest, doesNotRequestPiecesThePeerDoesNotHave)
+{
+    auto mediator = MockMediator{};
+
+    // setup: three pieces, all missing, and we want all of them
+    mediator.piece_count_ = 3;
+    mediator.missing_block_count_[0] = 100;
+    mediator.missing_block_count_[1] = 100;
+    mediator.missing_block_count_[2] = 50;
+    mediator.block_span_[0] = { 0, 100 };
+    mediator.block_span_[1] = { 100, 200 };
+    mediator.block_span_[2] = { 200, 250 };
+    for (tr_piece_index_t i = 0; i < 3; ++i)
+    {
+        mediator.can_request_piece_.insert(i);
+    }
+    for (tr_block_index_t i = 0; i < 250; ++i)
+    {
+        mediator.can_request_block_.insert(i);
+    }
+
+    // but the peer only has the second piece,
+    // and we've already asked it for the first ten blocks of that
+    auto wishlist = Wishlist{ mediator };
+    auto const spans = wishlist.next(
+        1000,
+        [](tr_piece_index_t piece) { return piece == 1U; },
+        [](tr_block_index_t block) { return block < 110U; });
+    auto const requested = countBlocks(spans, 250);
+    EXPECT_EQ(90U, requested.count());
+    EXPECT_EQ(90U, requested.count(110, 200));
+}
+
+TEST_F(PeerMgrWishlistTest, updatesWhenBlocksChange)
+{
+    auto mediator = MockMediator{};
+
+    // setup: three pieces, all missing, and we want all of them
+    mediator.piece_count_ = 3;
+    mediator.block_span_[0] = { 0, 100 };
+    mediator.block_span_[1] = { 100, 200 };
+    mediator.block_span_[2] = { 200, 300 };
+    for (tr_piece_index_t i = 0; i < 3; ++i)
+    {
+        mediator.can_request_piece_.insert(i);
+        mediator.missing_block_count_[i] = 100;
+    }
+    for (tr_block_index_t i = 0; i < 300; ++i)
+    {
+        mediator.can_request_block_.insert(i);
+    }
+
+    // the first piece is the closest to completion
+    mediator.missing_block_count_[0] = 50;
+    for (tr_block_index_t i = 0; i < 50; ++i)
+    {
+        mediator.can_request_block_.erase(i);
+    }
+    auto wishlist = Wishlist{ mediator };
+    auto requested = countBlocks(next(wishlist, 10), 300);
+    EXPECT_EQ(10U, requested.count(0, 100));
+
+    // now the third piece is the closest
+    mediator.missing_block_count_[2] = 5;
+    for (tr_block_index_t i = 200; i < 295; ++i)
+    {
+        mediator.can_request_block_.erase(i);
+    }
+    wishlist.on_blocks_changed(2);
+    requested = countBlocks(next(wishlist, 10), 300);
+    EXPECT_EQ(5U, requested.count(295, 300));
+    EXPECT_EQ(5U, requested.count(0, 100));
+
+    // and when the third piece is complete, it's dropped
+    mediator.missing_block_count_[2] = 0;
+    for (tr_block_index_t i = 295; i < 300; ++i)
+    {
+        mediator.can_request_block_.erase(i);
+    }
+    wishlist.on_blocks_changed(2);
+    requested = countBlocks(next(wishlist, 1000), 300);
+    EXPECT_EQ(150U, requested.count());
+    EXPECT_EQ(0U, requested.count(200, 300));
+}
+
+TEST_F(PeerMgrWishlistTest, rebuildsWhenInvalidated)
+{
+    auto mediator = MockMediator{};
+
+    // setup: three pieces, all missing, and we want all of them
+    mediator.piece_count_ = 3;
+    mediator.block_span_[0] = { 0, 100 };
+    mediator.block_span_[1] = { 100, 200 };
+    mediator.block_span_[2] = { 200, 300 };
+    for (tr_piece_index_t i = 0; i < 3; ++i)
+    {
+        mediator.can_request_piece_.insert(i);
+        mediator.missing_block_count_[i] = 100;
+    }
+    for (tr_block_index_t i = 0; i < 300; ++i)
+    {
+        mediator.can_request_block_.insert(i);
+    }
+
+    auto wishlist = Wishlist{ mediator };
+    EXPECT_EQ(300U, countBlocks(next(wishlist, 1000), 300).count());
+
+    // we no longer want the second piece
+    mediator.can_request_piece_.erase(1);
+    wishlist.invalidate();
+    auto const requested = countBlocks(next(wishlist, 1000), 300);
+    EXPECT_EQ(200U, requested.count());
+    EXPECT_EQ(0U, requested.count(100, 200));
+}
+
+TEST_F(PeerMgrWishlistTest, rebuildsAfterClear)
+{
+    auto mediator = MockMediator{};
+
+    // setup: three pieces, all missing, and we want all of them
+    mediator.piece_count_ = 3;
+    mediator.block_span_[0] = { 0, 100 };
+    mediator.block_span_[1] = { 100, 200 };
+    mediator.block_span_[2] = { 200, 300 };
+    for (tr_piece_index_t i = 0; i < 3; ++i)
+    {
+        mediator.can_request_piece_.insert(i);
+        mediator.missing_block_count_[i] = 100;
+    }
+    for (tr_block_index_t i = 0; i < 300; ++i)
+    {
+        mediator.can_request_block_.insert(i);
+    }
+
+    auto wishlist = Wishlist{ mediator };
+    EXPECT_EQ(300U, countBlocks(next(wishlist, 1000), 300).count());
+
+    // free the list, then get the first piece while it's cleared
+    wishlist.clear();
+    for (tr_block_index_t i = 0; i < 100; ++i)
+    {
+        mediator.can_request_block_.erase(i);
+    }
+    mediator.missing_block_count_[0] = 0;
+    wishlist.on_blocks_changed(0);
+
+    auto const requested = countBlocks(next(wishlist, 1000), 300);
+    EXPECT_EQ(200U, requested.count());
+    EXPECT_EQ(0U, requested.count(0, 100));
+}
+
+TEST_F(PeerMgrWishlistTest, prefersRarePieces)
+{
+    auto mediator = MockMediator{};
+
+    // setup: three pieces, all missing, and we want all of them
+    mediator.piece_count_ = 3;
+    mediator.block_span_[0] = { 0, 100 };
+    mediator.block_span_[1] = { 100, 200 };
+    mediator.block_span_[2] = { 200, 300 };
+    for (tr_piece_index_t i = 0; i < 3; ++i)
+    {
+        mediator.can_request_piece_.insert(i);
+        mediator.missing_block_count_[i] = 100;
+    }
+    for (tr_block_index_t i = 0; i < 300; ++i)
+    {
+        mediator.can_request_block_.insert(i);
+    }
+
+    // but the third piece is the rarest
+    mediator.piece_availability_[0] = 10;
+    mediator.piece_availability_[1] = 5;
+    mediator.piece_availability_[2] = 1;
+
+    // NB: when all other things are equal in the wishlist, pieces are
+    // picked at random so this test -could- pass even if there's a bug.
+    // So test several times to shake out any randomness
+    auto const num_runs = 1000;
+    for (int run = 0; run < num_runs; ++run)
+    {
+        auto const requested = countBlocks(next(mediator, 150), 300);
+        EXPECT_EQ(150U, requested.count());
+        EXPECT_EQ(100U, requested.count(200, 300));
+        EXPECT_EQ(50U, requested.count(100, 200));
+    }
+
+    // when a peer gets the third piece, it becomes the least rare
+    auto wishlist = Wishlist{ mediator };
+    EXPECT_EQ(100U, countBlocks(next(wishlist, 100), 300).count(200, 300));
+    mediator.piece_availability_[2] = 20;
+    wishlist.on_availability_changed(2);
+    auto const requested = countBlocks(next(wishlist, 100), 300);
+    EXPECT_EQ(100U, requested.count(100, 200));
+
+    // but rarity is ignored when downloading sequentially
+    mediator.is_sequential_download_ = true;
+    EXPECT_EQ(100U, countBlocks(next(wishlist, 100), 300).count(0, 100));
+}
+
+TEST_F(PeerMgrWishlistTest, prefersPiecesWithDeadlines)
+{
+    auto mediator = MockMediator{};
+
+    // setup: three pieces, all missing
+    mediator.piece_count_ = 3;
+    for (tr_piece_index_t i = 0; i < 3; ++i)
+    {
+        mediator.missing_block_count_[i] = 100;
+        mediator.block_span_[i] = { i * 100U, (i + 1U) * 100U };
+        mediator.can_request_piece_.insert(i);
+    }
+    for (tr_block_index_t i = 0; i < 300; ++i)
+    {
+        mediator.can_request_block_.insert(i);
+    }
+
+    // a streaming reader needs piece 2 and then piece 1,
+    // so they come first even though piece 0 is high priority
+    mediator.piece_priority_[0] = TR_PRI_HIGH;
+    mediator.now_ = 1000U;
+    mediator.piece_deadline_[1] = 60000U;
+    mediator.piece_deadline_[2] = 30000U;
+
+    auto wishlist = Wishlist{ mediator };
+    EXPECT_EQ(100U, countBlocks(next(wishlist, 100), 300).count(200, 300));
+    EXPECT_EQ(100U, countBlocks(next(wishlist, 200), 300).count(100, 200));
+
+    // the deadlines aren't close, so blocks that someone else
+    // is already fetching aren't requested again
+    for (tr_block_index_t i = 200; i < 300; ++i)
+    {
+        mediator.active_request_count_[i] = 1;
+    }
+    EXPECT_EQ(0U, countBlocks(next(wishlist, 100), 300).count(200, 300));
+
+    // once the deadline is close, a fast peer is asked as well...
+    mediator.now_ = mediator.piece_deadline_[2] - Wishlist::UrgentMsec;
+    EXPECT_EQ(100U, countBlocks(next(wishlist, 100), 300).count(200, 300));
+
+    // ...but a slow one isn't
+    auto const spans = wishlist.next(100, peerHasAllPieces, noActiveRequestsToPeer, false);
+    EXPECT_EQ(0U, countBlocks(spans, 300).count(200, 300));
+}
+
+TEST_F(PeerMgrWishlistTest, limitsEndgameDupes)
+{
+    auto mediator = MockMediator{};
+
+    // setup: one piece, all of it missing and already requested from someone
+    mediator.piece_count_ = 1;
+    mediator.missing_block_count_[0] = 100;
+    mediator.block_span_[0] = { 0, 100 };
+    mediator.can_request_piece_.insert(0);
+    for (tr_block_index_t i = 0; i < 100; ++i)
+    {
+        mediator.can_request_block_.insert(i);
+        mediator.active_request_count_[i] = 1;
+    }
+    mediator.is_endgame_ = true;
+
+    // slow peers don't get duplicate requests
+    auto wishlist = Wishlist{ mediator };
+    EXPECT_EQ(0U, countBlocks(wishlist.next(100, peerHasAllPieces, noActiveRequestsToPeer, false), 100).count());
+
+    // fast ones do, but only as many as the budget allows
+    mediator.duplicates_allowed_ = 10U;
+    EXPECT_EQ(10U, countBlocks(next(wishlist, 100), 100).count());
+
+    mediator.duplicates_allowed_ = 0U;
+    EXPECT_EQ(0U, countBlocks(next(wishlist, 100), 100).count());
+}
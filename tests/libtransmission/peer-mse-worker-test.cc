@@ -0,0 +1,97 @@
+// This file Copyright (C) 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <cstddef> // size_t
+#include <functional>
+#include <map>
+#include <mutex>
+
+#include <libtransmission/executor.h>
+#include <libtransmission/peer-mse.h>
+#include <libtransmission/peer-mse-worker.h>
+
+#include "gtest/gtest.h"
+#include "test-fixtures.h"
+
+namespace libtransmission::test
+{
+
+class MseWorkerTest : public ::testing::Test
+{
+protected:
+    using DH = tr_message_stream_encryption::DH;
+
+    class MockMediator final : public tr_mse_worker::Mediator
+    {
+    public:
+        void post(std::function<void(void)>&& func) override
+        {
+            auto const lock = std::lock_guard(mutex_);
+            func();
+        }
+
+    private:
+        std::mutex mutex_;
+    };
+};
+
+TEST_F(MseWorkerTest, fillsPool)
+{
+    static auto constexpr PoolSize = size_t{ 4U };
+
+    auto executor = tr_executor{ 2U };
+    auto mediator = MockMediator{};
+    auto worker = tr_mse_worker{ executor, mediator, PoolSize };
+    EXPECT_TRUE(waitFor([&worker]() { return worker.pool_size() == PoolSize; }, 5000));
+
+    auto dh = worker.take();
+    ASSERT_TRUE(dh);
+    EXPECT_NE(DH::key_bigend_t{}, dh->publicKey());
+
+    // the pool gets topped up again after it's drained
+    EXPECT_TRUE(waitFor([&worker]() { return worker.pool_size() == PoolSize; }, 5000));
+}
+
+TEST_F(MseWorkerTest, computesSecrets)
+{
+    static auto constexpr NumPairs = size_t{ 8U };
+
+    auto mutex = std::mutex{};
+    auto secrets = std::map<size_t, DH::key_bigend_t>{};
+
+    auto executor = tr_executor{ 2U };
+    auto mediator = MockMediator{};
+    auto worker = tr_mse_worker{ executor, mediator, 0U };
+
+    auto expected = std::map<size_t, DH::key_bigend_t>{};
+    for (size_t i = 0; i < NumPairs; ++i)
+    {
+        auto a = DH{};
+        auto b = DH{};
+        b.setPeerPublicKey(a.publicKey());
+        expected[i] = b.secret();
+
+        worker.compute_secret(
+            a,
+            b.publicKey(),
+            [&mutex, &secrets, i](DH const& dh)
+            {
+                auto const lock = std::lock_guard(mutex);
+                secrets[i] = dh.secret();
+            });
+    }
+
+    auto const test = [&mutex, &secrets]()
+    {
+        auto const lock = std::lock_guard(mutex);
+        return std::size(secrets) == NumPairs;
+    };
+    EXPECT_TRUE(waitFor(test, 5000));
+
+    auto const lock = std::lock_guard(mutex);
+    EXPECT_EQ(expected, secrets);
+}
+
+} // namespace libtransmission::test
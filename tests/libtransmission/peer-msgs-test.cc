@@ -3,13 +3,211 @@
 // or any future license endorsed by Mnemosyne LLC.
 // License text can be found in the licenses/ folder.
 
+#include <array>
+#include <cstddef> // std::byte
+#include <cstdint>
 #include <cstring>
+#include <limits>
+#include <vector>
 
 #include <libtransmission/transmission.h>
+#include <libtransmission/block-info.h>
 #include <libtransmission/peer-msgs.h>
+#include <libtransmission/peer-msgs-requests.h>
+#include <libtransmission/peer-msgs-view.h>
 
 #include "gtest/gtest.h"
 
+using libtransmission::PeerMessageView;
+
+namespace
+{
+
+auto constexpr BlockSize = tr_block_info::BlockSize;
+
+struct Request
+{
+    uint32_t index = 0;
+    uint32_t offset = 0;
+    uint32_t length = 0;
+
+    [[nodiscard]] constexpr bool operator==(Request const& that) const noexcept
+    {
+        return index == that.index && offset == that.offset && length == that.length;
+    }
+};
+
+[[nodiscard]] std::vector<Request> split_into_blocks(Request const& req)
+{
+    auto ret = std::vector<Request>{};
+    libtransmission::for_each_block_request(req, [&ret](Request const& block_req) { ret.emplace_back(block_req); });
+    return ret;
+}
+
+template<typename... T>
+[[nodiscard]] constexpr auto make_bytes(T... vals)
+{
+    return std::array<std::byte, sizeof...(vals)>{ static_cast<std::byte>(vals)... };
+}
+
+} // namespace
+
 TEST(PeerMsgs, placeholder)
 {
 }
+
+TEST(PeerMsgs, viewParsesRequest)
+{
+    // <len=13><id=6><index=2><begin=16384><length=16384>, then the next message's first byte
+    auto const buf = make_bytes(0, 0, 0, 13, 6, 0, 0, 0, 2, 0, 0, 0x40, 0, 0, 0, 0x40, 0, 0);
+
+    auto const message = PeerMessageView{ std::data(buf), std::size(buf) };
+    EXPECT_TRUE(message.has_header());
+    EXPECT_TRUE(message.is_complete());
+    EXPECT_FALSE(message.is_keepalive());
+    EXPECT_EQ(6U, message.id());
+    EXPECT_EQ(13U, message.message_len());
+    EXPECT_EQ(17U, message.frame_len());
+
+    auto payload = message.payload();
+    EXPECT_EQ(12U, payload.size());
+    EXPECT_EQ(2U, payload.to_uint32());
+    EXPECT_EQ(16384U, payload.to_uint32());
+    EXPECT_EQ(16384U, payload.to_uint32());
+    EXPECT_EQ(0U, payload.size());
+}
+
+TEST(PeerMsgs, viewParsesKeepalive)
+{
+    auto const buf = make_bytes(0, 0, 0, 0);
+
+    auto const message = PeerMessageView{ std::data(buf), std::size(buf) };
+    EXPECT_TRUE(message.has_header());
+    EXPECT_TRUE(message.is_keepalive());
+    EXPECT_TRUE(message.is_complete());
+    EXPECT_EQ(4U, message.frame_len());
+}
+
+TEST(PeerMsgs, viewHandlesPartialMessages)
+{
+    auto const buf = make_bytes(0, 0, 0, 5, 4, 0, 0, 1, 0);
+
+    // not enough for a length prefix
+    auto message = PeerMessageView{ std::data(buf), 3U };
+    EXPECT_FALSE(message.has_header());
+    EXPECT_FALSE(message.is_complete());
+
+    // a length prefix but no message id
+    message = PeerMessageView{ std::data(buf), 4U };
+    EXPECT_FALSE(message.has_header());
+    EXPECT_FALSE(message.is_complete());
+
+    // a header but only part of the payload
+    message = PeerMessageView{ std::data(buf), 8U };
+    EXPECT_TRUE(message.has_header());
+    EXPECT_FALSE(message.is_complete());
+    EXPECT_EQ(4U, message.id());
+    EXPECT_EQ(9U, message.frame_len());
+
+    message = PeerMessageView{ std::data(buf), std::size(buf) };
+    EXPECT_TRUE(message.is_complete());
+    EXPECT_EQ(256U, message.payload().to_uint32());
+}
+
+TEST(PeerMsgs, negotiatesMaxRequestSize)
+{
+    using libtransmission::negotiated_max_request_size;
+
+    // both peers want large requests: use the smaller size
+    EXPECT_EQ(4U * BlockSize, negotiated_max_request_size(4U * BlockSize, 8U * BlockSize));
+    EXPECT_EQ(4U * BlockSize, negotiated_max_request_size(8U * BlockSize, 4U * BlockSize));
+
+    // sizes are rounded down to whole blocks
+    EXPECT_EQ(2U * BlockSize, negotiated_max_request_size(8U * BlockSize, 3U * BlockSize - 1U));
+
+    // large requests are off unless both peers want them
+    EXPECT_EQ(BlockSize, negotiated_max_request_size(0U, 8U * BlockSize));
+    EXPECT_EQ(BlockSize, negotiated_max_request_size(8U * BlockSize, 0));
+    EXPECT_EQ(BlockSize, negotiated_max_request_size(8U * BlockSize, BlockSize));
+    EXPECT_EQ(BlockSize, negotiated_max_request_size(8U * BlockSize, 2U * BlockSize - 1U));
+    EXPECT_EQ(BlockSize, negotiated_max_request_size(8U * BlockSize, -1));
+
+    // a huge size in the peer's handshake doesn't overflow
+    EXPECT_EQ(8U * BlockSize, negotiated_max_request_size(8U * BlockSize, std::numeric_limits<int64_t>::max()));
+}
+
+TEST(PeerMsgs, splitsLargeRequestIntoBlocks)
+{
+    auto const expected = std::vector<Request>{
+        { 3, 2U * BlockSize, BlockSize },
+        { 3, 3U * BlockSize, BlockSize },
+        { 3, 4U * BlockSize, BlockSize },
+    };
+    EXPECT_EQ(expected, split_into_blocks({ 3, 2U * BlockSize, 3U * BlockSize }));
+
+    // the last block of a torrent can be short
+    auto const expected_short = std::vector<Request>{
+        { 5, 0U, BlockSize },
+        { 5, BlockSize, 1000U },
+    };
+    EXPECT_EQ(expected_short, split_into_blocks({ 5, 0U, BlockSize + 1000U }));
+
+    auto const expected_one = std::vector<Request>{ { 1, BlockSize, BlockSize } };
+    EXPECT_EQ(expected_one, split_into_blocks({ 1, BlockSize, BlockSize }));
+}
+
+TEST(PeerMsgs, mergesAdjacentRequests)
+{
+    using libtransmission::pop_merged_request;
+
+    auto requests = std::vector<Request>{
+        { 0, 0U, BlockSize },
+        { 0, BlockSize, BlockSize },
+        { 0, 2U * BlockSize, BlockSize },
+        { 0, 3U * BlockSize, BlockSize }, // too many blocks to merge into the first request
+        { 0, 5U * BlockSize, BlockSize }, // not the next block
+        { 1, 0U, BlockSize }, // not the same piece
+        { 1, BlockSize, BlockSize },
+    };
+
+    EXPECT_EQ((Request{ 0, 0U, 3U * BlockSize }), pop_merged_request<Request>(requests, 3U * BlockSize));
+    EXPECT_EQ(4U, std::size(requests));
+    EXPECT_EQ((Request{ 0, 3U * BlockSize, BlockSize }), pop_merged_request<Request>(requests, 3U * BlockSize));
+    EXPECT_EQ((Request{ 0, 5U * BlockSize, BlockSize }), pop_merged_request<Request>(requests, 3U * BlockSize));
+    EXPECT_EQ((Request{ 1, 0U, 2U * BlockSize }), pop_merged_request<Request>(requests, 3U * BlockSize));
+    EXPECT_TRUE(std::empty(requests));
+
+    // without large requests, nothing is merged
+    requests = { { 0, 0U, BlockSize }, { 0, BlockSize, BlockSize } };
+    EXPECT_EQ((Request{ 0, 0U, BlockSize }), pop_merged_request<Request>(requests, BlockSize));
+    EXPECT_EQ((Request{ 0, BlockSize, BlockSize }), pop_merged_request<Request>(requests, BlockSize));
+    EXPECT_TRUE(std::empty(requests));
+}
+
+TEST(PeerMsgs, streamsLargePieceMessageOneBlockAtATime)
+{
+    using libtransmission::piece_data_chunk_len;
+
+    // four pieces of 4 blocks each, and a last piece of 1.5 blocks
+    auto const block_info = tr_block_info{ 16U * BlockSize + BlockSize + BlockSize / 2U, 4U * BlockSize };
+
+    // a normal Piece message is read in one go
+    EXPECT_EQ(BlockSize, piece_data_chunk_len(block_info, 0, 0U, BlockSize));
+    EXPECT_EQ(100U, piece_data_chunk_len(block_info, 0, 0U, 100U));
+
+    // walk a Piece message for 3 blocks of piece 2 the way the reader does
+    auto chunks = std::vector<uint32_t>{};
+    for (auto offset = BlockSize, n_left = 3U * BlockSize; n_left > 0U;)
+    {
+        auto const len = piece_data_chunk_len(block_info, 2, offset, n_left);
+        ASSERT_GT(len, 0U);
+        chunks.emplace_back(len);
+        offset += len;
+        n_left -= len;
+    }
+    EXPECT_EQ((std::vector<uint32_t>{ BlockSize, BlockSize, BlockSize }), chunks);
+
+    // the last piece's short last block
+    EXPECT_EQ(BlockSize, piece_data_chunk_len(block_info, 4, 0U, BlockSize + BlockSize / 2U));
+    EXPECT_EQ(BlockSize / 2U, piece_data_chunk_len(block_info, 4, BlockSize, BlockSize / 2U));
+}
@@ -0,0 +1,80 @@
+// This file Copyright (C) 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <array>
+#include <cerrno>
+#include <cstddef> // size_t
+#include <string>
+#include <string_view>
+
+#ifdef _WIN32
+#include <ws2tcpip.h>
+#else
+#include <sys/socket.h>
+#endif
+
+#include <event2/util.h>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/error.h>
+#include <libtransmission/file.h>
+#include <libtransmission/net.h>
+#include <libtransmission/peer-socket.h>
+#include <libtransmission/utils.h>
+
+#include "test-fixtures.h"
+
+using namespace std::literals;
+
+#ifdef _WIN32
+#define LOCAL_SOCKETPAIR_AF AF_INET
+#else
+#define LOCAL_SOCKETPAIR_AF AF_UNIX
+#endif
+
+namespace libtransmission::test
+{
+
+using PeerSocketTest = SessionTest;
+
+TEST_F(PeerSocketTest, tryWriteFile)
+{
+    static auto constexpr Contents = "Hello, world! This text is sent straight from a file."sv;
+    static auto constexpr Offset = size_t{ 7U };
+
+    auto const filename = tr_pathbuf{ sandboxDir(), "/sendme.txt"sv };
+    createFileWithContents(filename, Contents);
+    auto const fd = tr_sys_file_open(filename, TR_SYS_FILE_READ, 0);
+    ASSERT_NE(TR_BAD_SYS_FILE, fd);
+
+    auto sockpair = std::array<evutil_socket_t, 2>{ -1, -1 };
+    ASSERT_EQ(0, evutil_socketpair(LOCAL_SOCKETPAIR_AF, SOCK_STREAM, 0, std::data(sockpair))) << tr_strerror(errno);
+    auto const peer_addr = tr_socket_address{ *tr_address::from_string("127.0.0.1"sv), tr_port::fromHost(8080) };
+    auto const sock = tr_peer_socket{ session_, peer_addr, sockpair[0] };
+
+    // send everything after `Offset`
+    auto const expected = Contents.substr(Offset);
+    tr_error* error = nullptr;
+    auto const n_sent = sock.try_write_file(fd, Offset, std::size(expected), &error);
+    EXPECT_EQ(nullptr, error) << *error;
+    EXPECT_EQ(std::size(expected), n_sent);
+
+    auto buf = std::array<char, 128>{};
+    auto const n_read = recv(sockpair[1], std::data(buf), std::size(buf), 0);
+    ASSERT_GT(n_read, 0);
+    ASSERT_EQ(std::size(expected), static_cast<size_t>(n_read));
+    EXPECT_EQ(expected, std::string_view(std::data(buf), n_read));
+
+    // reading past the end of the file is an error
+    EXPECT_EQ(0U, sock.try_write_file(fd, std::size(Contents), 1U, &error));
+    EXPECT_NE(nullptr, error);
+    tr_error_clear(&error);
+
+    tr_net_close_socket(sockpair[1]);
+    tr_sys_file_close(fd);
+}
+
+} // namespace libtransmission::test
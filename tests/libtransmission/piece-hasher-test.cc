@@ -0,0 +1,112 @@
+// This file Copyright (C) 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <cstddef> // size_t
+#include <cstdint> // uint8_t
+#include <functional>
+#include <map>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include <libtransmission/crypto-utils.h>
+#include <libtransmission/executor.h>
+#include <libtransmission/piece-hasher.h>
+
+#include "gtest/gtest.h"
+#include "test-fixtures.h"
+
+namespace libtransmission::test
+{
+
+class PieceHasherTest : public ::testing::Test
+{
+protected:
+    class MockMediator final : public tr_piece_hasher::Mediator
+    {
+    public:
+        void post(std::function<void(void)>&& func) override
+        {
+            auto const lock = std::lock_guard(mutex_);
+            func();
+        }
+
+    private:
+        std::mutex mutex_;
+    };
+
+    [[nodiscard]] static tr_piece_hasher::Data makeData(size_t n_bytes, uint8_t fill)
+    {
+        return tr_piece_hasher::Data(n_bytes, fill);
+    }
+};
+
+TEST_F(PieceHasherTest, reportsVerdicts)
+{
+    static auto constexpr NumPieces = 32U;
+    static auto constexpr PieceSize = size_t{ 16384U };
+
+    auto mutex = std::mutex{};
+    auto verdicts = std::map<size_t, bool>{};
+
+    auto mediator = MockMediator{};
+    auto executor = tr_executor{ 4U };
+    auto hasher = tr_piece_hasher{ mediator, executor, 4U };
+
+    for (size_t i = 0; i < NumPieces; ++i)
+    {
+        auto data = makeData(PieceSize, static_cast<uint8_t>(i));
+        auto expected = tr_sha1::digest(data);
+        if (i % 3U == 0U) // corrupt some of them
+        {
+            data.front() ^= 0xFF;
+        }
+
+        hasher.add(
+            std::move(data),
+            expected,
+            [&mutex, &verdicts, i](bool pass)
+            {
+                auto const lock = std::lock_guard(mutex);
+                verdicts[i] = pass;
+            });
+    }
+
+    auto const test = [&mutex, &verdicts]()
+    {
+        auto const lock = std::lock_guard(mutex);
+        return std::size(verdicts) == NumPieces;
+    };
+    EXPECT_TRUE(waitFor(test, 5000));
+
+    auto const lock = std::lock_guard(mutex);
+    for (auto const& [i, pass] : verdicts)
+    {
+        EXPECT_EQ(i % 3U != 0U, pass) << "piece " << i;
+    }
+}
+
+TEST_F(PieceHasherTest, finishesQueuedJobsWhenDestroyed)
+{
+    static auto constexpr NumPieces = 16U;
+
+    auto n_done = size_t{};
+    auto mediator = MockMediator{};
+    auto executor = tr_executor{ 2U };
+
+    {
+        auto hasher = tr_piece_hasher{ mediator, executor, 1U };
+        for (size_t i = 0; i < NumPieces; ++i)
+        {
+            auto data = makeData(1024U, static_cast<uint8_t>(i));
+            auto const expected = tr_sha1::digest(data);
+            hasher.add(std::move(data), expected, [&n_done](bool pass) { n_done += pass ? 1U : 0U; });
+        }
+    }
+
+    EXPECT_EQ(NumPieces, n_done);
+}
+
+} // namespace libtransmission::test
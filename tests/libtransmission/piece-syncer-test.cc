@@ -0,0 +1,133 @@
+// This file Copyright (C) 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <ctime> // time_t
+#include <map>
+#include <optional>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include <libtransmission/piece-syncer.h>
+
+#include "gtest/gtest.h"
+#include "test-fixtures.h"
+
+namespace libtransmission::test
+{
+
+class PieceSyncerTest : public SandboxedTest
+{
+protected:
+    class MockMediator final : public tr_piece_syncer::Mediator
+    {
+    public:
+        int flush_file(tr_torrent_id_t tor_id, tr_file_index_t file) override
+        {
+            flushed.emplace(tor_id, file);
+            return flush_error;
+        }
+
+        [[nodiscard]] std::optional<std::string> find_file(tr_torrent_id_t tor_id, tr_file_index_t file) const override
+        {
+            if (auto const iter = filenames.find({ tor_id, file }); iter != std::end(filenames))
+            {
+                return iter->second;
+            }
+
+            return {};
+        }
+
+        void on_synced(tr_torrent_id_t tor_id) override
+        {
+            synced.push_back(tor_id);
+        }
+
+        std::map<std::pair<tr_torrent_id_t, tr_file_index_t>, std::string> filenames;
+        std::set<std::pair<tr_torrent_id_t, tr_file_index_t>> flushed;
+        std::vector<tr_torrent_id_t> synced;
+        int flush_error = 0;
+    };
+
+    static auto constexpr Interval = time_t{ 5 };
+};
+
+TEST_F(PieceSyncerTest, commitsPiecesInBatches)
+{
+    auto mediator = MockMediator{};
+    for (tr_torrent_id_t tor_id = 1; tor_id <= 2; ++tor_id)
+    {
+        for (tr_file_index_t file = 0; file < 2; ++file)
+        {
+            auto const filename = fmt::format("{:s}/{:d}-{:d}", sandboxDir(), tor_id, file);
+            createFileWithContents(filename, "hello"sv);
+            mediator.filenames[{ tor_id, file }] = filename;
+        }
+    }
+
+    auto syncer = tr_piece_syncer{ mediator };
+    syncer.set_interval(Interval);
+    syncer.pulse(1000);
+
+    syncer.add(1, 0U, 0U, 2U);
+    syncer.add(1, 3U, 1U, 2U);
+    syncer.add(2, 7U, 0U, 1U);
+    EXPECT_EQ((std::vector<tr_piece_index_t>{ 0U, 3U }), syncer.unsynced_pieces(1));
+    EXPECT_EQ((std::vector<tr_piece_index_t>{ 7U }), syncer.unsynced_pieces(2));
+
+    // nothing happens until the interval has passed
+    syncer.pulse(1000 + Interval - 1);
+    EXPECT_TRUE(std::empty(mediator.flushed));
+
+    // then every pending file is flushed and synced in one batch
+    syncer.sync_all();
+    EXPECT_EQ(3U, std::size(mediator.flushed));
+    EXPECT_EQ((std::vector<tr_torrent_id_t>{ 1, 2 }), mediator.synced);
+    EXPECT_TRUE(std::empty(syncer.unsynced_pieces(1)));
+    EXPECT_TRUE(std::empty(syncer.unsynced_pieces(2)));
+}
+
+TEST_F(PieceSyncerTest, keepsPiecesWhoseFilesCouldNotBeFlushed)
+{
+    auto mediator = MockMediator{};
+    mediator.flush_error = EIO;
+
+    auto syncer = tr_piece_syncer{ mediator };
+    syncer.set_interval(Interval);
+    syncer.add(1, 0U, 0U, 1U);
+
+    syncer.sync_all();
+    EXPECT_TRUE(std::empty(mediator.synced));
+    EXPECT_EQ((std::vector<tr_piece_index_t>{ 0U }), syncer.unsynced_pieces(1));
+
+    // turning syncing off hands the pieces to the OS
+    syncer.set_interval(0);
+    EXPECT_EQ((std::vector<tr_torrent_id_t>{ 1 }), mediator.synced);
+    EXPECT_TRUE(std::empty(syncer.unsynced_pieces(1)));
+
+    // and new pieces aren't held back
+    syncer.add(1, 1U, 0U, 1U);
+    EXPECT_TRUE(std::empty(syncer.unsynced_pieces(1)));
+}
+
+TEST_F(PieceSyncerTest, forgetsRemovedTorrents)
+{
+    auto mediator = MockMediator{};
+    auto syncer = tr_piece_syncer{ mediator };
+    syncer.set_interval(Interval);
+
+    syncer.add(1, 0U, 0U, 1U);
+    syncer.erase(1);
+    EXPECT_TRUE(std::empty(syncer.unsynced_pieces(1)));
+
+    syncer.sync_all();
+    EXPECT_TRUE(std::empty(mediator.flushed));
+    EXPECT_TRUE(std::empty(mediator.synced));
+}
+
+} // namespace libtransmission::test
@@ -3,10 +3,15 @@
 // or any future license endorsed by Mnemosyne LLC.
 // License text can be found in the licenses/ folder.
 
+#include <array>
 #include <cassert>
 #include <cstddef> // size_t
 #include <string>
 #include <string_view>
+#include <thread>
+#include <vector>
+
+#include <fmt/core.h>
 
 #include <libtransmission/quark.h>
 
@@ -40,3 +45,52 @@ TEST_F(QuarkTest, newQuarkByStringView)
     auto const q = tr_quark_new(UniqueString);
     EXPECT_EQ(UniqueString, tr_quark_get_string_view(q));
 }
+
+TEST_F(QuarkTest, newQuarkCanBeLookedUp)
+{
+    auto constexpr UniqueString = std::string_view{ "another string that is not a predefined quark" };
+    EXPECT_FALSE(tr_quark_lookup(UniqueString).has_value());
+
+    auto const q = tr_quark_new(UniqueString);
+    EXPECT_LE(TR_N_KEYS, q);
+    EXPECT_EQ(q, tr_quark_lookup(UniqueString));
+    EXPECT_EQ(q, tr_quark_new(std::string{ UniqueString }));
+}
+
+TEST_F(QuarkTest, newQuarksAcrossThreads)
+{
+    static auto constexpr NumThreads = size_t{ 8U };
+    static auto constexpr NumStrings = size_t{ 5000U };
+
+    // every thread interns the same strings, so they race to add each one
+    auto quarks = std::array<std::vector<tr_quark>, NumThreads>{};
+    auto threads = std::vector<std::thread>{};
+    for (size_t i = 0; i < NumThreads; ++i)
+    {
+        threads.emplace_back(
+            [&quarks, i]()
+            {
+                for (size_t j = 0; j < NumStrings; ++j)
+                {
+                    quarks[i].push_back(tr_quark_new(fmt::format("concurrent quark {:d}", j)));
+                }
+            });
+    }
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    for (size_t j = 0; j < NumStrings; ++j)
+    {
+        auto const expected = fmt::format("concurrent quark {:d}", j);
+        EXPECT_EQ(expected, tr_quark_get_string_view(quarks.front()[j]));
+        EXPECT_EQ(quarks.front()[j], tr_quark_lookup(expected));
+
+        for (auto const& thread_quarks : quarks)
+        {
+            EXPECT_EQ(quarks.front()[j], thread_quarks[j]);
+        }
+    }
+}
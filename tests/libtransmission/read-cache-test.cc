@@ -0,0 +1,147 @@
+// This file Copyright (C) 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <memory>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/read-cache.h>
+
+#include "gtest/gtest.h"
+
+using ReadCacheTest = ::testing::Test;
+using Cache = tr_read_cache<int>;
+
+namespace
+{
+
+void insert(Cache& cache, tr_block_index_t block)
+{
+    cache.insert({ 1, block }, std::make_unique<int>(static_cast<int>(block)));
+}
+
+} // namespace
+
+TEST_F(ReadCacheTest, getReturnsWhatWasInserted)
+{
+    auto cache = Cache{ 8U };
+    insert(cache, 3U);
+
+    auto const* const data = cache.get({ 1, 3U });
+    ASSERT_NE(nullptr, data);
+    EXPECT_EQ(3, *data);
+    EXPECT_EQ(nullptr, cache.get({ 1, 4U }));
+    EXPECT_EQ(nullptr, cache.get({ 2, 3U }));
+    EXPECT_EQ(1U, cache.stats().hits);
+    EXPECT_EQ(2U, cache.stats().misses);
+}
+
+TEST_F(ReadCacheTest, disabledWhenEmpty)
+{
+    auto cache = Cache{};
+    insert(cache, 0U);
+    EXPECT_FALSE(cache.reserve({ 1, 1U }));
+    EXPECT_EQ(0U, cache.size());
+    EXPECT_EQ(nullptr, cache.get({ 1, 0U }));
+}
+
+TEST_F(ReadCacheTest, hotBlocksSurviveScans)
+{
+    auto cache = Cache{ 8U };
+
+    // blocks 0 and 1 are used twice, so they're hot
+    insert(cache, 0U);
+    insert(cache, 1U);
+    EXPECT_NE(nullptr, cache.get({ 1, 0U }));
+    EXPECT_NE(nullptr, cache.get({ 1, 1U }));
+
+    // a scan of blocks that are used once only
+    for (tr_block_index_t block = 100U; block < 200U; ++block)
+    {
+        insert(cache, block);
+    }
+
+    EXPECT_EQ(8U, cache.size());
+    EXPECT_NE(nullptr, cache.get({ 1, 0U }));
+    EXPECT_NE(nullptr, cache.get({ 1, 1U }));
+    EXPECT_EQ(nullptr, cache.get({ 1, 100U }));
+    EXPECT_NE(nullptr, cache.get({ 1, 199U }));
+}
+
+TEST_F(ReadCacheTest, reservedBlocksAreFilledUnlessErased)
+{
+    auto cache = Cache{ 8U };
+
+    EXPECT_TRUE(cache.reserve({ 1, 0U }));
+    EXPECT_TRUE(cache.reserve({ 1, 1U }));
+    EXPECT_TRUE(cache.reserve({ 1, 2U }));
+    EXPECT_FALSE(cache.reserve({ 1, 0U }));
+    EXPECT_TRUE(cache.contains({ 1, 0U }));
+    EXPECT_EQ(0U, cache.size());
+    EXPECT_EQ(nullptr, cache.get({ 1, 0U }));
+
+    // e.g. block 1 was rewritten while it was being read
+    cache.erase({ 1, 1U });
+    cache.fill({ 1, 0U }, std::make_unique<int>(0));
+    cache.fill({ 1, 1U }, std::make_unique<int>(1));
+    EXPECT_NE(nullptr, cache.get({ 1, 0U }));
+    EXPECT_EQ(nullptr, cache.get({ 1, 1U }));
+    EXPECT_FALSE(cache.contains({ 1, 1U }));
+
+    // e.g. block 2 couldn't be read
+    cache.unreserve({ 1, 2U });
+    cache.unreserve({ 1, 0U });
+    EXPECT_FALSE(cache.contains({ 1, 2U }));
+    EXPECT_TRUE(cache.contains({ 1, 0U }));
+    EXPECT_EQ(1U, cache.size());
+}
+
+TEST_F(ReadCacheTest, evictionsAreCountedByUse)
+{
+    auto cache = Cache{ 4U };
+
+    EXPECT_TRUE(cache.reserve({ 1, 0U }));
+    cache.fill({ 1, 0U }, std::make_unique<int>(0));
+    insert(cache, 1U);
+    for (tr_block_index_t block = 2U; block < 6U; ++block)
+    {
+        insert(cache, block);
+    }
+
+    EXPECT_EQ(1U, cache.stats().evicted_unused);
+    EXPECT_EQ(1U, cache.stats().evicted_used);
+}
+
+TEST_F(ReadCacheTest, eraseTorrent)
+{
+    auto cache = Cache{ 8U };
+    insert(cache, 0U);
+    cache.insert({ 2, 0U }, std::make_unique<int>(0));
+    cache.insert({ 3, 0U }, std::make_unique<int>(0));
+
+    cache.erase_torrent(2);
+    EXPECT_EQ(2U, cache.size());
+    EXPECT_TRUE(cache.contains({ 1, 0U }));
+    EXPECT_FALSE(cache.contains({ 2, 0U }));
+    EXPECT_TRUE(cache.contains({ 3, 0U }));
+
+    cache.set_max_blocks(1U);
+    EXPECT_EQ(1U, cache.size());
+}
+
+TEST_F(ReadCacheTest, countTorrent)
+{
+    auto cache = Cache{ 8U };
+    insert(cache, 0U);
+    insert(cache, 1U);
+    cache.insert({ 2, 0U }, std::make_unique<int>(0));
+
+    // reserved blocks don't hold any data yet
+    EXPECT_TRUE(cache.reserve({ 2, 1U }));
+
+    EXPECT_EQ(2U, cache.count_torrent(1));
+    EXPECT_EQ(1U, cache.count_torrent(2));
+    EXPECT_EQ(0U, cache.count_torrent(3));
+}
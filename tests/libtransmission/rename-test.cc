@@ -197,6 +197,7 @@ TEST_F(RenameTest, singleFilenameTorrent)
 
     // (while it's renamed: confirm that the .resume file remembers the changes)
     tr_resume::save(tor);
+    session_->resume_writer().wait();
     sync();
     auto const loaded = tr_resume::load(tor, tr_resume::All, ctor);
     EXPECT_STREQ("foobar", tr_torrentName(tor));
@@ -307,6 +308,7 @@ TEST_F(RenameTest, multifileTorrent)
 
     // (while the branch is renamed: confirm that the .resume file remembers the changes)
     tr_resume::save(tor);
+    session_->resume_writer().wait();
     // this is a bit dodgy code-wise, but let's make sure the .resume file got the name
     tor->set_file_subpath(1, "gabba gabba hey"sv);
     auto const loaded = tr_resume::load(tor, tr_resume::All, ctor);
@@ -0,0 +1,117 @@
+// This file Copyright (C) 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <cstddef> // std::byte
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/file.h>
+#include <libtransmission/resume-journal.h>
+#include <libtransmission/tr-strbuf.h>
+#include <libtransmission/utils.h>
+
+#include "gtest/gtest.h"
+#include "test-fixtures.h"
+
+using namespace std::literals;
+
+namespace libtransmission::test
+{
+
+class ResumeJournalTest : public SandboxedTest
+{
+protected:
+    [[nodiscard]] std::string journalFile() const
+    {
+        return std::string{ tr_pathbuf{ sandboxDir(), "/resume.journal"sv }.sv() };
+    }
+
+    [[nodiscard]] static tr_sha1_digest_t makeHash(int n)
+    {
+        auto hash = tr_sha1_digest_t{};
+        hash.front() = static_cast<std::byte>(n);
+        return hash;
+    }
+
+    [[nodiscard]] static std::string toString(std::vector<char> const* buf)
+    {
+        return buf != nullptr ? std::string{ std::data(*buf), std::size(*buf) } : std::string{};
+    }
+};
+
+TEST_F(ResumeJournalTest, roundTrips)
+{
+    {
+        auto journal = tr_resume_journal{ journalFile() };
+        EXPECT_EQ(0U, journal.size());
+        journal.set(makeHash(1), "d3:fooi1ee"sv);
+        journal.set(makeHash(2), "d3:fooi2ee"sv);
+        EXPECT_EQ("d3:fooi1ee"sv, toString(journal.get(makeHash(1))));
+        EXPECT_TRUE(journal.flush());
+    }
+
+    auto journal = tr_resume_journal{ journalFile() };
+    EXPECT_EQ(2U, journal.size());
+    EXPECT_EQ("d3:fooi1ee"sv, toString(journal.get(makeHash(1))));
+    EXPECT_EQ("d3:fooi2ee"sv, toString(journal.get(makeHash(2))));
+    EXPECT_EQ(nullptr, journal.get(makeHash(3)));
+}
+
+TEST_F(ResumeJournalTest, newestRecordWins)
+{
+    {
+        auto journal = tr_resume_journal{ journalFile() };
+        journal.set(makeHash(1), "d3:fooi1ee"sv);
+        journal.set(makeHash(2), "d3:fooi2ee"sv);
+        EXPECT_TRUE(journal.flush());
+
+        // these are appended to the end of the file
+        journal.set(makeHash(1), "d3:fooi3ee"sv);
+        journal.erase(makeHash(2));
+        EXPECT_TRUE(journal.flush());
+    }
+
+    auto journal = tr_resume_journal{ journalFile() };
+    EXPECT_EQ(1U, journal.size());
+    EXPECT_EQ("d3:fooi3ee"sv, toString(journal.get(makeHash(1))));
+    EXPECT_EQ(nullptr, journal.get(makeHash(2)));
+}
+
+TEST_F(ResumeJournalTest, ignoresTruncatedRecord)
+{
+    {
+        auto journal = tr_resume_journal{ journalFile() };
+        journal.set(makeHash(1), "d3:fooi1ee"sv);
+        EXPECT_TRUE(journal.flush());
+        journal.set(makeHash(2), "d3:fooi2ee"sv);
+        EXPECT_TRUE(journal.flush());
+    }
+
+    // simulate a crash partway through writing the last record
+    auto buf = std::vector<char>{};
+    EXPECT_TRUE(tr_file_read(journalFile(), buf));
+    buf.resize(std::size(buf) - 3U);
+    EXPECT_TRUE(tr_file_save(journalFile(), buf));
+
+    {
+        auto journal = tr_resume_journal{ journalFile() };
+        EXPECT_EQ(1U, journal.size());
+        EXPECT_EQ("d3:fooi1ee"sv, toString(journal.get(makeHash(1))));
+        EXPECT_EQ(nullptr, journal.get(makeHash(2)));
+
+        // the bad tail is cleaned up so that new records are readable
+        journal.set(makeHash(3), "d3:fooi3ee"sv);
+        EXPECT_TRUE(journal.flush());
+    }
+
+    auto journal = tr_resume_journal{ journalFile() };
+    EXPECT_EQ(2U, journal.size());
+    EXPECT_EQ("d3:fooi3ee"sv, toString(journal.get(makeHash(3))));
+}
+
+} // namespace libtransmission::test
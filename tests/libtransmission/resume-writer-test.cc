@@ -0,0 +1,117 @@
+// This file Copyright (C) 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <cstdint> // int64_t
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/executor.h>
+#include <libtransmission/file.h>
+#include <libtransmission/quark.h>
+#include <libtransmission/resume-writer.h>
+#include <libtransmission/tr-strbuf.h>
+#include <libtransmission/utils.h>
+#include <libtransmission/variant.h>
+
+#include "gtest/gtest.h"
+#include "test-fixtures.h"
+
+using namespace std::literals;
+
+namespace libtransmission::test
+{
+
+class ResumeWriterTest : public SandboxedTest
+{
+protected:
+    [[nodiscard]] static std::unique_ptr<tr_resume_writer::Snapshot> makeSnapshot(int64_t downloaded)
+    {
+        auto snapshot = std::make_unique<tr_resume_writer::Snapshot>();
+        tr_variantInitDict(&snapshot->top, 1, &snapshot->arena);
+        tr_variantDictAddInt(&snapshot->top, TR_KEY_downloaded, downloaded);
+        return snapshot;
+    }
+
+    [[nodiscard]] static std::string contentsOf(std::string_view filename)
+    {
+        auto contents = std::vector<char>{};
+        if (!tr_file_read(filename, contents))
+        {
+            return {};
+        }
+
+        return { std::data(contents), std::size(contents) };
+    }
+
+    tr_executor executor_{ 2U };
+};
+
+TEST_F(ResumeWriterTest, writesOnFlush)
+{
+    auto const a = std::string{ tr_pathbuf{ sandboxDir(), "/a/1.resume"sv }.sv() };
+    auto const b = std::string{ tr_pathbuf{ sandboxDir(), "/b/2.resume"sv }.sv() };
+    for (auto const& dir : { "/a"sv, "/b"sv })
+    {
+        tr_sys_dir_create(tr_pathbuf{ sandboxDir(), dir }, TR_SYS_DIR_CREATE_PARENTS, 0700);
+    }
+
+    auto writer = tr_resume_writer{ executor_ };
+    writer.add(1, a, makeSnapshot(1));
+    writer.add(2, b, makeSnapshot(2));
+    EXPECT_EQ(2U, writer.size());
+    EXPECT_FALSE(tr_sys_path_exists(a));
+
+    writer.wait();
+    EXPECT_EQ(0U, writer.size());
+    EXPECT_EQ("d10:downloadedi1ee"sv, contentsOf(a));
+    EXPECT_EQ("d10:downloadedi2ee"sv, contentsOf(b));
+}
+
+TEST_F(ResumeWriterTest, writesNewestSnapshot)
+{
+    auto const filename = std::string{ tr_pathbuf{ sandboxDir(), "/1.resume"sv }.sv() };
+
+    auto writer = tr_resume_writer{ executor_ };
+    writer.add(1, filename, makeSnapshot(1));
+    writer.add(1, filename, makeSnapshot(2));
+    EXPECT_EQ(1U, writer.size());
+
+    writer.wait();
+    EXPECT_EQ("d10:downloadedi2ee"sv, contentsOf(filename));
+}
+
+TEST_F(ResumeWriterTest, removesAfterWrite)
+{
+    auto const filename = std::string{ tr_pathbuf{ sandboxDir(), "/1.resume"sv }.sv() };
+
+    auto writer = tr_resume_writer{ executor_ };
+    writer.add(1, filename, makeSnapshot(1));
+    writer.flush();
+    writer.remove(filename);
+    writer.wait();
+    EXPECT_FALSE(tr_sys_path_exists(filename));
+}
+
+TEST_F(ResumeWriterTest, reportsErrors)
+{
+    auto const filename = std::string{ tr_pathbuf{ sandboxDir(), "/missing/1.resume"sv }.sv() };
+
+    auto failed = std::vector<tr_torrent_id_t>{};
+    auto const on_error = [&failed](tr_torrent_id_t tor_id, int /*error_code*/)
+    {
+        failed.push_back(tor_id);
+    };
+
+    auto writer = tr_resume_writer{ executor_, on_error };
+    writer.add(7, filename, makeSnapshot(1));
+    writer.wait();
+    EXPECT_EQ(std::vector<tr_torrent_id_t>{ 7 }, failed);
+}
+
+} // namespace libtransmission::test
@@ -5,15 +5,31 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
+#include <chrono>
 #include <cstddef> // size_t
 #include <cstdint> // int64_t
+#include <functional>
+#include <initializer_list>
 #include <iterator> // std::inserter
+#include <memory>
+#include <optional>
 #include <set>
+#include <string>
 #include <string_view>
+#include <tuple>
+#include <utility>
 #include <vector>
 
+#include <fmt/core.h>
+
 #include <libtransmission/transmission.h>
+#include <libtransmission/log.h>
+#include <libtransmission/peer-mgr.h>
+#include <libtransmission/quark.h>
+#include <libtransmission/rpc-events.h>
 #include <libtransmission/rpcimpl.h>
+#include <libtransmission/torrent.h>
 #include <libtransmission/variant.h>
 
 #include "gtest/gtest.h"
@@ -191,4 +207,976 @@ TEST_F(RpcTest, sessionGet)
     tr_torrentRemove(tor, false, nullptr, nullptr);
 }
 
+TEST_F(RpcTest, batch)
+{
+    auto request = tr_variant{};
+    tr_variantInitList(&request, 4);
+    auto* item = tr_variantListAddDict(&request, 2);
+    tr_variantDictAddStrView(item, TR_KEY_method, "session-stats");
+    tr_variantDictAddInt(item, TR_KEY_tag, 1);
+    item = tr_variantListAddDict(&request, 2);
+    tr_variantDictAddStrView(item, TR_KEY_method, "no-such-method");
+    tr_variantDictAddInt(item, TR_KEY_tag, 2);
+    item = tr_variantListAddDict(&request, 1);
+    tr_variantDictAddStrView(item, TR_KEY_method, "session-get");
+    tr_variantListAddList(&request, 0);
+
+    auto response = tr_variant{};
+    tr_rpc_request_exec_json(
+        session_,
+        &request,
+        [](tr_session* /*session*/, tr_variant* resp, void* setme) noexcept
+        {
+            *static_cast<tr_variant*>(setme) = *resp;
+            tr_variantInitBool(resp, false);
+        },
+        &response);
+    tr_variantClear(&request);
+
+    // one response per request, in the same order
+    ASSERT_TRUE(tr_variantIsList(&response));
+    ASSERT_EQ(4U, tr_variantListSize(&response));
+
+    auto sv = std::string_view{};
+    auto tag = int64_t{};
+    tr_variant* args = nullptr;
+    auto* child = tr_variantListChild(&response, 0);
+    EXPECT_TRUE(tr_variantDictFindStrView(child, TR_KEY_result, &sv));
+    EXPECT_EQ("success"sv, sv);
+    EXPECT_TRUE(tr_variantDictFindInt(child, TR_KEY_tag, &tag));
+    EXPECT_EQ(1, tag);
+    EXPECT_TRUE(tr_variantDictFindDict(child, TR_KEY_arguments, &args));
+    EXPECT_NE(nullptr, tr_variantDictFind(args, TR_KEY_torrentCount));
+
+    // a failed request doesn't affect the rest of the batch
+    child = tr_variantListChild(&response, 1);
+    EXPECT_TRUE(tr_variantDictFindStrView(child, TR_KEY_result, &sv));
+    EXPECT_EQ("method name not recognized"sv, sv);
+    EXPECT_TRUE(tr_variantDictFindInt(child, TR_KEY_tag, &tag));
+    EXPECT_EQ(2, tag);
+
+    child = tr_variantListChild(&response, 2);
+    EXPECT_TRUE(tr_variantDictFindStrView(child, TR_KEY_result, &sv));
+    EXPECT_EQ("success"sv, sv);
+    EXPECT_FALSE(tr_variantDictFindInt(child, TR_KEY_tag, &tag));
+    EXPECT_TRUE(tr_variantDictFindDict(child, TR_KEY_arguments, &args));
+    EXPECT_NE(nullptr, tr_variantDictFind(args, TR_KEY_version));
+
+    // batches don't nest
+    child = tr_variantListChild(&response, 3);
+    EXPECT_TRUE(tr_variantDictFindStrView(child, TR_KEY_result, &sv));
+    EXPECT_EQ("no method name"sv, sv);
+
+    tr_variantClear(&response);
+}
+
+TEST_F(RpcTest, torrentGetDelta)
+{
+    auto const exec = [this](tr_variant* request)
+    {
+        auto response = tr_variant{};
+        tr_rpc_request_exec_json(
+            session_,
+            request,
+            [](tr_session* /*session*/, tr_variant* resp, void* setme) noexcept
+            {
+                *static_cast<tr_variant*>(setme) = *resp;
+                tr_variantInitBool(resp, false);
+            },
+            &response);
+        tr_variantClear(request);
+        return response;
+    };
+
+    auto const torrent_get = [&exec](std::optional<int64_t> token)
+    {
+        auto request = tr_variant{};
+        tr_variantInitDict(&request, 2);
+        tr_variantDictAddStrView(&request, TR_KEY_method, "torrent-get");
+        auto* const args = tr_variantDictAddDict(&request, TR_KEY_arguments, 2);
+        auto* const fields = tr_variantDictAddList(args, TR_KEY_fields, 2);
+        tr_variantListAddStrView(fields, "labels"sv);
+        tr_variantListAddStrView(fields, "name"sv);
+        if (token)
+        {
+            tr_variantDictAddInt(args, TR_KEY_delta_token, *token);
+        }
+        return exec(&request);
+    };
+
+    auto* tor = zeroTorrentInit(ZeroTorrentState::NoFiles);
+    EXPECT_NE(nullptr, tor);
+    auto const id = tr_torrentId(tor);
+
+    // an unknown token gets everything
+    auto response = torrent_get(0);
+    tr_variant* args = nullptr;
+    EXPECT_TRUE(tr_variantDictFindDict(&response, TR_KEY_arguments, &args));
+    auto full = false;
+    EXPECT_TRUE(tr_variantDictFindBool(args, TR_KEY_delta_full, &full));
+    EXPECT_TRUE(full);
+    auto token = int64_t{};
+    EXPECT_TRUE(tr_variantDictFindInt(args, TR_KEY_delta_token, &token));
+    tr_variant* torrents = nullptr;
+    EXPECT_TRUE(tr_variantDictFindList(args, TR_KEY_torrents, &torrents));
+    ASSERT_EQ(1U, tr_variantListSize(torrents));
+    auto* entry = tr_variantListChild(torrents, 0);
+    EXPECT_NE(nullptr, tr_variantDictFind(entry, TR_KEY_name));
+    EXPECT_NE(nullptr, tr_variantDictFind(entry, TR_KEY_labels));
+    auto i = int64_t{};
+    EXPECT_TRUE(tr_variantDictFindInt(entry, TR_KEY_id, &i));
+    EXPECT_EQ(id, i);
+    tr_variantClear(&response);
+
+    // nothing has changed yet
+    response = torrent_get(token);
+    EXPECT_TRUE(tr_variantDictFindDict(&response, TR_KEY_arguments, &args));
+    EXPECT_FALSE(tr_variantDictFindBool(args, TR_KEY_delta_full, &full));
+    EXPECT_TRUE(tr_variantDictFindInt(args, TR_KEY_delta_token, &token));
+    EXPECT_TRUE(tr_variantDictFindList(args, TR_KEY_torrents, &torrents));
+    EXPECT_EQ(0U, tr_variantListSize(torrents));
+    tr_variantClear(&response);
+
+    // change one field
+    auto request = tr_variant{};
+    tr_variantInitDict(&request, 2);
+    tr_variantDictAddStrView(&request, TR_KEY_method, "torrent-set");
+    auto* const set_args = tr_variantDictAddDict(&request, TR_KEY_arguments, 2);
+    tr_variantDictAddInt(set_args, TR_KEY_ids, id);
+    tr_variantListAddStrView(tr_variantDictAddList(set_args, TR_KEY_labels, 1), "delta"sv);
+    response = exec(&request);
+    tr_variantClear(&response);
+
+    response = torrent_get(token);
+    EXPECT_TRUE(tr_variantDictFindDict(&response, TR_KEY_arguments, &args));
+    EXPECT_TRUE(tr_variantDictFindInt(args, TR_KEY_delta_token, &token));
+    EXPECT_TRUE(tr_variantDictFindList(args, TR_KEY_torrents, &torrents));
+    ASSERT_EQ(1U, tr_variantListSize(torrents));
+    entry = tr_variantListChild(torrents, 0);
+    EXPECT_EQ(nullptr, tr_variantDictFind(entry, TR_KEY_name));
+    EXPECT_NE(nullptr, tr_variantDictFind(entry, TR_KEY_labels));
+    EXPECT_TRUE(tr_variantDictFindInt(entry, TR_KEY_id, &i));
+    EXPECT_EQ(id, i);
+    tr_variantClear(&response);
+
+    // removed torrents are listed
+    tr_torrentRemove(tor, false, nullptr, nullptr);
+    EXPECT_TRUE(waitFor([this, id]() { return tr_torrentFindFromId(session_, id) == nullptr; }, 5000));
+    response = torrent_get(token);
+    EXPECT_TRUE(tr_variantDictFindDict(&response, TR_KEY_arguments, &args));
+    tr_variant* removed = nullptr;
+    EXPECT_TRUE(tr_variantDictFindList(args, TR_KEY_removed, &removed));
+    ASSERT_EQ(1U, tr_variantListSize(removed));
+    EXPECT_TRUE(tr_variantGetInt(tr_variantListChild(removed, 0), &i));
+    EXPECT_EQ(id, i);
+    tr_variantClear(&response);
+}
+
+TEST_F(RpcTest, torrentGetPiecesDelta)
+{
+    auto const torrent_get = [this](int64_t token)
+    {
+        auto request = tr_variant{};
+        tr_variantInitDict(&request, 2);
+        tr_variantDictAddStrView(&request, TR_KEY_method, "torrent-get");
+        auto* const args = tr_variantDictAddDict(&request, TR_KEY_arguments, 2);
+        tr_variantListAddStrView(tr_variantDictAddList(args, TR_KEY_fields, 1), "pieces"sv);
+        tr_variantDictAddInt(args, TR_KEY_delta_token, token);
+
+        auto response = tr_variant{};
+        tr_rpc_request_exec_json(
+            session_,
+            &request,
+            [](tr_session* /*session*/, tr_variant* resp, void* setme) noexcept
+            {
+                *static_cast<tr_variant*>(setme) = *resp;
+                tr_variantInitBool(resp, false);
+            },
+            &response);
+        tr_variantClear(&request);
+        return response;
+    };
+
+    auto* const tor = zeroTorrentInit(ZeroTorrentState::NoFiles);
+    EXPECT_NE(nullptr, tor);
+
+    // the first response has the whole bitfield
+    auto response = torrent_get(0);
+    tr_variant* args = nullptr;
+    EXPECT_TRUE(tr_variantDictFindDict(&response, TR_KEY_arguments, &args));
+    auto token = int64_t{};
+    EXPECT_TRUE(tr_variantDictFindInt(args, TR_KEY_delta_token, &token));
+    tr_variant* torrents = nullptr;
+    EXPECT_TRUE(tr_variantDictFindList(args, TR_KEY_torrents, &torrents));
+    ASSERT_EQ(1U, tr_variantListSize(torrents));
+    auto sv = std::string_view{};
+    EXPECT_TRUE(tr_variantDictFindStrView(tr_variantListChild(torrents, 0), TR_KEY_pieces, &sv));
+    EXPECT_EQ(tor->piece_bitfield_base64(), sv);
+    tr_variantClear(&response);
+
+    // the next one only has the pieces that were completed since then
+    tor->completion.add_piece(1);
+    response = torrent_get(token);
+    EXPECT_TRUE(tr_variantDictFindDict(&response, TR_KEY_arguments, &args));
+    EXPECT_TRUE(tr_variantDictFindList(args, TR_KEY_torrents, &torrents));
+    ASSERT_EQ(1U, tr_variantListSize(torrents));
+    auto* const entry = tr_variantListChild(torrents, 0);
+    EXPECT_EQ(nullptr, tr_variantDictFind(entry, TR_KEY_pieces));
+    tr_variant* added = nullptr;
+    EXPECT_TRUE(tr_variantDictFindList(entry, TR_KEY_piecesAdded, &added));
+    ASSERT_EQ(1U, tr_variantListSize(added));
+    auto i = int64_t{};
+    EXPECT_TRUE(tr_variantGetInt(tr_variantListChild(added, 0), &i));
+    EXPECT_EQ(1, i);
+    tr_variantClear(&response);
+
+    // cleanup
+    tr_torrentRemove(tor, false, nullptr, nullptr);
+}
+
+TEST_F(RpcTest, torrentGetResourceUsage)
+{
+    auto* const tor = zeroTorrentInit(ZeroTorrentState::Complete);
+    EXPECT_NE(nullptr, tor);
+    blockingTorrentVerify(tor);
+
+    auto request = tr_variant{};
+    tr_variantInitDict(&request, 2);
+    tr_variantDictAddStrView(&request, TR_KEY_method, "torrent-get");
+    auto* const args_in = tr_variantDictAddDict(&request, TR_KEY_arguments, 1);
+    tr_variantListAddStrView(tr_variantDictAddList(args_in, TR_KEY_fields, 1), "resourceUsage"sv);
+
+    auto response = tr_variant{};
+    tr_rpc_request_exec_json(
+        session_,
+        &request,
+        [](tr_session* /*session*/, tr_variant* resp, void* setme) noexcept
+        {
+            *static_cast<tr_variant*>(setme) = *resp;
+            tr_variantInitBool(resp, false);
+        },
+        &response);
+    tr_variantClear(&request);
+
+    tr_variant* args = nullptr;
+    EXPECT_TRUE(tr_variantDictFindDict(&response, TR_KEY_arguments, &args));
+    tr_variant* torrents = nullptr;
+    EXPECT_TRUE(tr_variantDictFindList(args, TR_KEY_torrents, &torrents));
+    ASSERT_EQ(1U, tr_variantListSize(torrents));
+    tr_variant* usage = nullptr;
+    ASSERT_TRUE(tr_variantDictFindDict(tr_variantListChild(torrents, 0), TR_KEY_resourceUsage, &usage));
+
+    // every counter is there, under its name
+    for (uint8_t i = 0U; i < tr_torrent_usage::NumCounters; ++i)
+    {
+        auto const counter = static_cast<tr_torrent_usage::Counter>(i);
+        auto const name = tr_torrent_usage::name(counter);
+        auto const key = tr_quark_lookup(name);
+        ASSERT_TRUE(key) << name;
+        auto val = int64_t{};
+        EXPECT_TRUE(tr_variantDictFindInt(usage, *key, &val)) << name;
+        EXPECT_EQ(tor->usage().get(counter), static_cast<uint64_t>(val)) << name;
+    }
+
+    // the verify read and hashed the torrent
+    auto val = int64_t{};
+    EXPECT_TRUE(tr_variantDictFindInt(usage, TR_KEY_disk_read_bytes, &val));
+    EXPECT_GE(static_cast<uint64_t>(val), tor->total_size());
+    EXPECT_TRUE(tr_variantDictFindInt(usage, TR_KEY_hash_usec, &val));
+    EXPECT_GT(val, 0);
+
+    tr_variant* memory = nullptr;
+    EXPECT_TRUE(tr_variantDictFindDict(usage, TR_KEY_memory, &memory));
+    for (auto const key : { TR_KEY_cache, TR_KEY_read_cache, TR_KEY_peer_buffers, TR_KEY_metadata, TR_KEY_total })
+    {
+        EXPECT_TRUE(tr_variantDictFindInt(memory, key, &val)) << tr_quark_get_string_view(key);
+    }
+
+    tr_variantClear(&response);
+    tr_torrentRemove(tor, false, nullptr, nullptr);
+}
+
+TEST_F(RpcTest, sessionStatsCountsTorrents)
+{
+    auto const session_stats = [this]()
+    {
+        auto request = tr_variant{};
+        tr_variantInitDict(&request, 1);
+        tr_variantDictAddStrView(&request, TR_KEY_method, "session-stats");
+
+        auto response = tr_variant{};
+        tr_rpc_request_exec_json(
+            session_,
+            &request,
+            [](tr_session* /*session*/, tr_variant* resp, void* setme) noexcept
+            {
+                *static_cast<tr_variant*>(setme) = *resp;
+                tr_variantInitBool(resp, false);
+            },
+            &response);
+        tr_variantClear(&request);
+        return response;
+    };
+
+    // @return the active count and the count for each status
+    auto const get_counts = [&session_stats]()
+    {
+        auto response = session_stats();
+        tr_variant* args = nullptr;
+        EXPECT_TRUE(tr_variantDictFindDict(&response, TR_KEY_arguments, &args));
+        auto active = int64_t{};
+        EXPECT_TRUE(tr_variantDictFindInt(args, TR_KEY_activeTorrentCount, &active));
+        auto peers = int64_t{ -1 };
+        EXPECT_TRUE(tr_variantDictFindInt(args, TR_KEY_peersConnected, &peers));
+        EXPECT_EQ(0, peers);
+        tr_variant* by_status = nullptr;
+        EXPECT_TRUE(tr_variantDictFindList(args, TR_KEY_torrentsByStatus, &by_status));
+        auto counts = std::vector<int64_t>(tr_variantListSize(by_status));
+        for (size_t i = 0; i < std::size(counts); ++i)
+        {
+            EXPECT_TRUE(tr_variantGetInt(tr_variantListChild(by_status, i), &counts[i]));
+        }
+        tr_variantClear(&response);
+        return std::make_pair(active, counts);
+    };
+
+    auto* const tor = zeroTorrentInit(ZeroTorrentState::NoFiles);
+    EXPECT_NE(nullptr, tor);
+
+    auto [active, counts] = get_counts();
+    EXPECT_EQ(0, active);
+    auto expected = std::vector<int64_t>(TR_STATUS_SEED + 1);
+    expected[TR_STATUS_STOPPED] = 1;
+    EXPECT_EQ(expected, counts);
+
+    tr_torrentStart(tor);
+    EXPECT_TRUE(waitFor([tor]() { return tr_torrentStat(tor)->activity != TR_STATUS_STOPPED; }, 5000));
+    std::tie(active, counts) = get_counts();
+    EXPECT_EQ(1, active);
+    expected[TR_STATUS_STOPPED] = 0;
+    expected[tr_torrentStat(tor)->activity] = 1;
+    EXPECT_EQ(expected, counts);
+
+    // removed torrents aren't counted
+    auto const id = tr_torrentId(tor);
+    tr_torrentRemove(tor, false, nullptr, nullptr);
+    EXPECT_TRUE(waitFor([this, id]() { return tr_torrentFindFromId(session_, id) == nullptr; }, 5000));
+    std::tie(active, counts) = get_counts();
+    EXPECT_EQ(0, active);
+    EXPECT_EQ(std::vector<int64_t>(TR_STATUS_SEED + 1), counts);
+}
+
+TEST_F(RpcTest, torrentGetOnlyComputesRequestedStats)
+{
+    auto* tor = zeroTorrentInit(ZeroTorrentState::Complete);
+    EXPECT_NE(nullptr, tor);
+    auto const percent_done = tr_torrentStat(tor)->percentDone;
+
+    auto const torrent_get = [this](std::initializer_list<std::string_view> keys)
+    {
+        auto request = tr_variant{};
+        tr_variantInitDict(&request, 2);
+        tr_variantDictAddStrView(&request, TR_KEY_method, "torrent-get");
+        auto* const args = tr_variantDictAddDict(&request, TR_KEY_arguments, 1);
+        auto* const fields = tr_variantDictAddList(args, TR_KEY_fields, std::size(keys));
+        for (auto const key : keys)
+        {
+            tr_variantListAddStrView(fields, key);
+        }
+        tr_rpc_request_exec_json(session_, &request, nullptr, nullptr);
+        tr_variantClear(&request);
+    };
+
+    // poison a stat so that we can tell if it was recomputed
+    tor->stats.percentDone = -1.0F;
+
+    torrent_get({ "id"sv, "name"sv, "uploadedEver"sv });
+    EXPECT_EQ(-1.0F, tor->stats.percentDone);
+
+    torrent_get({ "id"sv, "percentDone"sv });
+    EXPECT_EQ(percent_done, tor->stats.percentDone);
+
+    // the ETA depends on the completion stats
+    tor->stats.percentDone = -1.0F;
+    torrent_get({ "eta"sv });
+    EXPECT_EQ(percent_done, tor->stats.percentDone);
+}
+
+TEST_F(RpcTest, torrentGetFilter)
+{
+    auto* tor = zeroTorrentInit(ZeroTorrentState::NoFiles);
+    EXPECT_NE(nullptr, tor);
+    auto const id = tor->id();
+
+    auto const label = tr_quark_new("filter-label"sv);
+    tor->setLabels({ label });
+    tor->set_bandwidth_group("filter-group"sv);
+    EXPECT_EQ(std::vector<tr_torrent_id_t>{ id }, session_->torrents().ids_with_label(label));
+    EXPECT_EQ(std::vector<tr_torrent_id_t>{ id }, session_->torrents().ids_in_group(tr_quark_new("filter-group"sv)));
+
+    // returns the ids of the torrents that match the filter
+    auto const torrent_get = [this](std::function<void(tr_variant*)> const& build_filter)
+    {
+        auto request = tr_variant{};
+        tr_variantInitDict(&request, 2);
+        tr_variantDictAddStrView(&request, TR_KEY_method, "torrent-get");
+        auto* const args = tr_variantDictAddDict(&request, TR_KEY_arguments, 2);
+        tr_variantListAddStrView(tr_variantDictAddList(args, TR_KEY_fields, 1), "id"sv);
+        build_filter(tr_variantDictAddDict(args, TR_KEY_filter, 4));
+
+        auto response = tr_variant{};
+        tr_rpc_request_exec_json(
+            session_,
+            &request,
+            [](tr_session* /*session*/, tr_variant* resp, void* setme) noexcept
+            {
+                *static_cast<tr_variant*>(setme) = *resp;
+                tr_variantInitBool(resp, false);
+            },
+            &response);
+        tr_variantClear(&request);
+
+        auto ids = std::vector<int64_t>{};
+        tr_variant* args_out = nullptr;
+        tr_variant* torrents = nullptr;
+        EXPECT_TRUE(tr_variantDictFindDict(&response, TR_KEY_arguments, &args_out));
+        EXPECT_TRUE(tr_variantDictFindList(args_out, TR_KEY_torrents, &torrents));
+        for (size_t i = 0, n = tr_variantListSize(torrents); i < n; ++i)
+        {
+            auto tor_id = int64_t{};
+            EXPECT_TRUE(tr_variantDictFindInt(tr_variantListChild(torrents, i), TR_KEY_id, &tor_id));
+            ids.push_back(tor_id);
+        }
+        tr_variantClear(&response);
+        return ids;
+    };
+
+    auto const matched = std::vector<int64_t>{ id };
+    auto const unmatched = std::vector<int64_t>{};
+
+    EXPECT_EQ(matched, torrent_get([](tr_variant*) {}));
+    EXPECT_EQ(
+        matched,
+        torrent_get([](tr_variant* filter)
+                    { tr_variantListAddStrView(tr_variantDictAddList(filter, TR_KEY_labels, 1), "filter-label"sv); }));
+    EXPECT_EQ(
+        unmatched,
+        torrent_get([](tr_variant* filter)
+                    { tr_variantListAddStrView(tr_variantDictAddList(filter, TR_KEY_labels, 1), "no-such-label"sv); }));
+    EXPECT_EQ(
+        matched,
+        torrent_get([](tr_variant* filter) { tr_variantDictAddStrView(filter, TR_KEY_group, "filter-group"sv); }));
+    EXPECT_EQ(unmatched, torrent_get([](tr_variant* filter) { tr_variantDictAddStrView(filter, TR_KEY_group, ""sv); }));
+
+    auto const activity = int64_t{ tor->activity() };
+    EXPECT_EQ(
+        matched,
+        torrent_get([activity](tr_variant* filter)
+                    { tr_variantListAddInt(tr_variantDictAddList(filter, TR_KEY_status, 1), activity); }));
+    EXPECT_EQ(
+        unmatched,
+        torrent_get([activity](tr_variant* filter)
+                    { tr_variantListAddInt(tr_variantDictAddList(filter, TR_KEY_status, 1), activity + 1); }));
+
+    // the indexes follow changes
+    tor->setLabels({});
+    tor->set_bandwidth_group(""sv);
+    EXPECT_TRUE(std::empty(session_->torrents().ids_with_label(label)));
+    EXPECT_EQ(
+        unmatched,
+        torrent_get([](tr_variant* filter)
+                    { tr_variantListAddStrView(tr_variantDictAddList(filter, TR_KEY_labels, 1), "filter-label"sv); }));
+    EXPECT_EQ(matched, torrent_get([](tr_variant* filter) { tr_variantDictAddStrView(filter, TR_KEY_group, ""sv); }));
+}
+
+TEST_F(RpcTest, torrentGetSortAndPage)
+{
+    for (auto const* const magnet :
+         { "magnet:?xt=urn:btih:1111111111111111111111111111111111111111&dn=Charlie",
+           "magnet:?xt=urn:btih:2222222222222222222222222222222222222222&dn=alpha",
+           "magnet:?xt=urn:btih:3333333333333333333333333333333333333333&dn=Bravo" })
+    {
+        auto* const ctor = tr_ctorNew(session_);
+        EXPECT_TRUE(tr_ctorSetMetainfoFromMagnetLink(ctor, magnet, nullptr));
+        tr_ctorSetPaused(ctor, TR_FORCE, true);
+        EXPECT_NE(nullptr, tr_torrentNew(ctor, nullptr));
+        tr_ctorFree(ctor);
+    }
+
+    struct Result
+    {
+        std::string result;
+        std::vector<std::string> names;
+        std::optional<int64_t> total;
+    };
+
+    auto const torrent_get = [this](std::function<void(tr_variant*)> const& build_args)
+    {
+        auto request = tr_variant{};
+        tr_variantInitDict(&request, 2);
+        tr_variantDictAddStrView(&request, TR_KEY_method, "torrent-get");
+        auto* const args = tr_variantDictAddDict(&request, TR_KEY_arguments, 6);
+        tr_variantListAddStrView(tr_variantDictAddList(args, TR_KEY_fields, 1), "name"sv);
+        build_args(args);
+
+        auto response = tr_variant{};
+        tr_rpc_request_exec_json(
+            session_,
+            &request,
+            [](tr_session* /*session*/, tr_variant* resp, void* setme) noexcept
+            {
+                *static_cast<tr_variant*>(setme) = *resp;
+                tr_variantInitBool(resp, false);
+            },
+            &response);
+        tr_variantClear(&request);
+
+        auto ret = Result{};
+        auto sv = std::string_view{};
+        EXPECT_TRUE(tr_variantDictFindStrView(&response, TR_KEY_result, &sv));
+        ret.result = sv;
+        tr_variant* args_out = nullptr;
+        tr_variant* torrents = nullptr;
+        if (tr_variantDictFindDict(&response, TR_KEY_arguments, &args_out) &&
+            tr_variantDictFindList(args_out, TR_KEY_torrents, &torrents))
+        {
+            for (size_t i = 0, n = tr_variantListSize(torrents); i < n; ++i)
+            {
+                EXPECT_TRUE(tr_variantDictFindStrView(tr_variantListChild(torrents, i), TR_KEY_name, &sv));
+                ret.names.emplace_back(sv);
+            }
+
+            if (auto total = int64_t{}; tr_variantDictFindInt(args_out, TR_KEY_total, &total))
+            {
+                ret.total = total;
+            }
+        }
+        tr_variantClear(&response);
+        return ret;
+    };
+
+    // names sort case-insensitively
+    auto result = torrent_get([](tr_variant* args) { tr_variantDictAddStrView(args, TR_KEY_sort, "name"sv); });
+    EXPECT_EQ("success"sv, result.result);
+    EXPECT_EQ((std::vector<std::string>{ "alpha", "Bravo", "Charlie" }), result.names);
+    EXPECT_FALSE(result.total);
+
+    result = torrent_get(
+        [](tr_variant* args)
+        {
+            tr_variantDictAddStrView(args, TR_KEY_sort, "name"sv);
+            tr_variantDictAddBool(args, TR_KEY_sort_reversed, true);
+        });
+    EXPECT_EQ((std::vector<std::string>{ "Charlie", "Bravo", "alpha" }), result.names);
+
+    // pages report how many torrents there are in all
+    result = torrent_get(
+        [](tr_variant* args)
+        {
+            tr_variantDictAddStrView(args, TR_KEY_sort, "name"sv);
+            tr_variantDictAddInt(args, TR_KEY_offset, 1);
+            tr_variantDictAddInt(args, TR_KEY_limit, 1);
+        });
+    EXPECT_EQ((std::vector<std::string>{ "Bravo" }), result.names);
+    EXPECT_EQ(3, result.total);
+
+    result = torrent_get(
+        [](tr_variant* args)
+        {
+            tr_variantDictAddStrView(args, TR_KEY_sort, "name"sv);
+            tr_variantDictAddInt(args, TR_KEY_offset, 2);
+        });
+    EXPECT_EQ((std::vector<std::string>{ "Charlie" }), result.names);
+
+    result = torrent_get([](tr_variant* args) { tr_variantDictAddInt(args, TR_KEY_offset, 10); });
+    EXPECT_TRUE(std::empty(result.names));
+    EXPECT_EQ(3, result.total);
+
+    // filters apply before paging
+    result = torrent_get(
+        [](tr_variant* args)
+        {
+            tr_variantDictAddStrView(tr_variantDictAddDict(args, TR_KEY_filter, 1), TR_KEY_text, "RAV"sv);
+            tr_variantDictAddInt(args, TR_KEY_limit, 10);
+        });
+    EXPECT_EQ((std::vector<std::string>{ "Bravo" }), result.names);
+    EXPECT_EQ(1, result.total);
+
+    // only scalar fields can be sorted on
+    result = torrent_get([](tr_variant* args) { tr_variantDictAddStrView(args, TR_KEY_sort, "files"sv); });
+    EXPECT_EQ("invalid sort key"sv, result.result);
+    result = torrent_get([](tr_variant* args) { tr_variantDictAddInt(args, TR_KEY_limit, -1); });
+    EXPECT_EQ("invalid offset or limit"sv, result.result);
+}
+
+TEST_F(RpcTest, eventsPushChanges)
+{
+    class TestSink final : public tr_rpc_events::Sink
+    {
+    public:
+        explicit TestSink(std::string& out)
+            : out_{ out }
+        {
+        }
+
+        void write(std::string_view text) override
+        {
+            out_ += text;
+        }
+
+    private:
+        std::string& out_;
+    };
+
+    auto const contains = [](std::string const& text, std::string_view needle)
+    {
+        return text.find(needle) != std::string::npos;
+    };
+
+    auto events = tr_rpc_events{ session_, std::chrono::hours{ 1 } };
+
+    // subscribers start with the state of every torrent
+    auto a = std::string{};
+    auto const id_a = events.subscribe(std::make_unique<TestSink>(a), { "labels", "name" });
+    EXPECT_TRUE(contains(a, "event: torrents\n"sv));
+    EXPECT_EQ(1U, events.size());
+
+    // new torrents are announced, along with their fields
+    auto* tor = zeroTorrentInit(ZeroTorrentState::NoFiles);
+    EXPECT_NE(nullptr, tor);
+    auto const id = tr_torrentId(tor);
+    a.clear();
+    events.pulse();
+    EXPECT_TRUE(contains(a, "event: torrent-added\n"sv));
+    EXPECT_TRUE(contains(a, fmt::format("\"hashString\":\"{:s}\"", tor->info_hash_string())));
+    EXPECT_TRUE(contains(a, "event: torrent-changed\n"sv));
+
+    // subscribers that ask for the same fields get the same changes
+    auto b = std::string{};
+    auto const id_b = events.subscribe(std::make_unique<TestSink>(b), { "name", "labels" });
+    EXPECT_TRUE(contains(b, "event: torrents\n"sv));
+    EXPECT_TRUE(contains(b, fmt::format("\"id\":{:d}", id)));
+
+    // nothing changed
+    a.clear();
+    b.clear();
+    events.pulse();
+    EXPECT_FALSE(contains(a, "event: torrent-changed\n"sv));
+    EXPECT_FALSE(contains(b, "event: torrent-changed\n"sv));
+
+    // change one field
+    auto request = tr_variant{};
+    tr_variantInitDict(&request, 2);
+    tr_variantDictAddStrView(&request, TR_KEY_method, "torrent-set");
+    auto* const set_args = tr_variantDictAddDict(&request, TR_KEY_arguments, 2);
+    tr_variantDictAddInt(set_args, TR_KEY_ids, id);
+    tr_variantListAddStrView(tr_variantDictAddList(set_args, TR_KEY_labels, 1), "pushed"sv);
+    tr_rpc_request_exec_json(session_, &request, nullptr, nullptr);
+    tr_variantClear(&request);
+
+    events.pulse();
+    for (auto const* const text : { &a, &b })
+    {
+        EXPECT_TRUE(contains(*text, "event: torrent-changed\n"sv));
+        EXPECT_TRUE(contains(*text, "\"labels\":[\"pushed\"]"sv));
+        EXPECT_FALSE(contains(*text, "\"name\":"sv));
+    }
+
+    // log messages go to the subscribers that asked for them
+    auto c = std::string{};
+    auto const id_c = events.subscribe(std::make_unique<TestSink>(c), {}, TR_LOG_INFO);
+    auto const old_level = tr_logGetLevel();
+    tr_logSetLevel(TR_LOG_INFO);
+    tr_logAddInfo("Hello, events");
+    tr_logSetLevel(old_level);
+    a.clear();
+    events.pulse();
+    EXPECT_TRUE(contains(c, "event: log\ndata: {\"level\":\"info\""sv));
+    EXPECT_TRUE(contains(c, "Hello, events"sv));
+    EXPECT_FALSE(contains(a, "event: log\n"sv));
+
+    // removed torrents are announced
+    tr_torrentRemove(tor, false, nullptr, nullptr);
+    EXPECT_TRUE(waitFor([this, id]() { return tr_torrentFindFromId(session_, id) == nullptr; }, 5000));
+    a.clear();
+    events.pulse();
+    EXPECT_TRUE(contains(a, fmt::format("event: torrent-removed\ndata: {{\"id\":{:d}}}\n", id)));
+
+    events.unsubscribe(id_a);
+    events.unsubscribe(id_b);
+    events.unsubscribe(id_c);
+    EXPECT_EQ(0U, events.size());
+}
+
+TEST_F(RpcTest, torrentAddPeers)
+{
+    auto* const tor = zeroTorrentInit(ZeroTorrentState::NoFiles);
+    EXPECT_NE(nullptr, tor);
+
+    auto request = tr_variant{};
+    tr_variantInitDict(&request, 2);
+    tr_variantDictAddStrView(&request, TR_KEY_method, "torrent-add-peers");
+    auto* const args = tr_variantDictAddDict(&request, TR_KEY_arguments, 2);
+    auto* const ids = tr_variantDictAddList(args, TR_KEY_ids, 1);
+    tr_variantListAddInt(ids, tr_torrentId(tor));
+    auto* const peers = tr_variantDictAddList(args, TR_KEY_peers, 3);
+    auto* peer = tr_variantListAddDict(peers, 2);
+    tr_variantDictAddStrView(peer, TR_KEY_address, "198.51.100.7"sv);
+    tr_variantDictAddInt(peer, TR_KEY_port, 51413);
+    peer = tr_variantListAddDict(peers, 2);
+    tr_variantDictAddStrView(peer, TR_KEY_address, "not an address"sv);
+    tr_variantDictAddInt(peer, TR_KEY_port, 51413);
+    peer = tr_variantListAddDict(peers, 2);
+    tr_variantDictAddStrView(peer, TR_KEY_address, "198.51.100.8"sv);
+    tr_variantDictAddInt(peer, TR_KEY_port, 70000);
+
+    auto response = tr_variant{};
+    tr_rpc_request_exec_json(
+        session_,
+        &request,
+        [](tr_session* /*session*/, tr_variant* resp, void* setme) noexcept
+        {
+            *static_cast<tr_variant*>(setme) = *resp;
+            tr_variantInitBool(resp, false);
+        },
+        &response);
+    tr_variantClear(&request);
+
+    auto sv = std::string_view{};
+    EXPECT_TRUE(tr_variantDictFindStrView(&response, TR_KEY_result, &sv));
+    EXPECT_EQ("success"sv, sv);
+    tr_variantClear(&response);
+
+    // only the valid peer was added
+    auto const pex = tr_peerMgrGetPeers(tor, TR_AF_INET, TR_PEERS_INTERESTING, 50);
+    ASSERT_EQ(1U, std::size(pex));
+    EXPECT_EQ("198.51.100.7"sv, pex.front().addr.display_name());
+    EXPECT_EQ(51413U, pex.front().port.host());
+
+    // cleanup
+    tr_torrentRemove(tor, false, nullptr, nullptr);
+}
+
+TEST_F(RpcTest, torrentPeers)
+{
+    auto* const tor = zeroTorrentInit(ZeroTorrentState::NoFiles);
+    EXPECT_NE(nullptr, tor);
+
+    auto const exec = [this](tr_variant* args)
+    {
+        auto request = tr_variant{};
+        tr_variantInitDict(&request, 2);
+        tr_variantDictAddStrView(&request, TR_KEY_method, "torrent-peers");
+        *tr_variantDictAdd(&request, TR_KEY_arguments) = *args;
+        tr_variantInitBool(args, false);
+
+        auto response = tr_variant{};
+        tr_rpc_request_exec_json(
+            session_,
+            &request,
+            [](tr_session* /*session*/, tr_variant* resp, void* setme) noexcept
+            {
+                *static_cast<tr_variant*>(setme) = *resp;
+                tr_variantInitBool(resp, false);
+            },
+            &response);
+        tr_variantClear(&request);
+        return response;
+    };
+
+    auto const make_args = [tor](size_t n_extra)
+    {
+        auto args = tr_variant{};
+        tr_variantInitDict(&args, 1U + n_extra);
+        tr_variantListAddInt(tr_variantDictAddList(&args, TR_KEY_ids, 1), tr_torrentId(tor));
+        return args;
+    };
+
+    auto sv = std::string_view{};
+    auto* result_args = static_cast<tr_variant*>(nullptr);
+    auto* peers = static_cast<tr_variant*>(nullptr);
+    auto i = int64_t{};
+    auto flag = bool{};
+
+    // needs exactly one torrent
+    auto args = tr_variant{};
+    tr_variantInitDict(&args, 0);
+    auto response = exec(&args);
+    EXPECT_TRUE(tr_variantDictFindStrView(&response, TR_KEY_result, &sv));
+    EXPECT_NE("success"sv, sv);
+    tr_variantClear(&response);
+
+    // a torrent that isn't connected to anyone
+    args = make_args(3U);
+    tr_variantListAddStrView(tr_variantDictAddList(&args, TR_KEY_fields, 1), "address"sv);
+    tr_variantDictAddStrView(&args, TR_KEY_sort, "rateToClient"sv);
+    tr_variantDictAddInt(&args, TR_KEY_limit, 10);
+    response = exec(&args);
+    EXPECT_TRUE(tr_variantDictFindStrView(&response, TR_KEY_result, &sv));
+    EXPECT_EQ("success"sv, sv);
+    EXPECT_TRUE(tr_variantDictFindDict(&response, TR_KEY_arguments, &result_args));
+    EXPECT_TRUE(tr_variantDictFindInt(result_args, TR_KEY_id, &i));
+    EXPECT_EQ(tr_torrentId(tor), i);
+    EXPECT_TRUE(tr_variantDictFindList(result_args, TR_KEY_peers, &peers));
+    EXPECT_EQ(0U, tr_variantListSize(peers));
+    EXPECT_TRUE(tr_variantDictFindInt(result_args, TR_KEY_total, &i));
+    EXPECT_EQ(0, i);
+    tr_variantClear(&response);
+
+    // sort keys must be peer fields
+    args = make_args(1U);
+    tr_variantDictAddStrView(&args, TR_KEY_sort, "name"sv);
+    response = exec(&args);
+    EXPECT_TRUE(tr_variantDictFindStrView(&response, TR_KEY_result, &sv));
+    EXPECT_NE("success"sv, sv);
+    tr_variantClear(&response);
+
+    // deltas start with a full response...
+    args = make_args(1U);
+    tr_variantDictAddInt(&args, TR_KEY_delta_token, 0);
+    response = exec(&args);
+    EXPECT_TRUE(tr_variantDictFindDict(&response, TR_KEY_arguments, &result_args));
+    EXPECT_TRUE(tr_variantDictFindBool(result_args, TR_KEY_delta_full, &flag));
+    EXPECT_TRUE(flag);
+    auto token = int64_t{};
+    EXPECT_TRUE(tr_variantDictFindInt(result_args, TR_KEY_delta_token, &token));
+    tr_variantClear(&response);
+
+    // ...and the next one is relative to it
+    args = make_args(1U);
+    tr_variantDictAddInt(&args, TR_KEY_delta_token, token);
+    response = exec(&args);
+    EXPECT_TRUE(tr_variantDictFindDict(&response, TR_KEY_arguments, &result_args));
+    EXPECT_FALSE(tr_variantDictFindBool(result_args, TR_KEY_delta_full, &flag));
+    EXPECT_TRUE(tr_variantDictFindList(result_args, TR_KEY_removed, &peers));
+    EXPECT_EQ(0U, tr_variantListSize(peers));
+    EXPECT_TRUE(tr_variantDictFindInt(result_args, TR_KEY_delta_token, &i));
+    EXPECT_NE(token, i);
+    tr_variantClear(&response);
+
+    // cleanup
+    tr_torrentRemove(tor, false, nullptr, nullptr);
+}
+
+TEST_F(RpcTest, torrentSetTrackerListReplace)
+{
+    auto* const tor = zeroTorrentInit(ZeroTorrentState::NoFiles);
+    EXPECT_NE(nullptr, tor);
+    EXPECT_TRUE(tor->set_tracker_list("https://old.example/announce\n\nudp://old.example.org:6969"sv));
+
+    auto const exec = [this, tor](std::string_view oldval, std::string_view newval)
+    {
+        auto request = tr_variant{};
+        tr_variantInitDict(&request, 2);
+        tr_variantDictAddStrView(&request, TR_KEY_method, "torrent-set");
+        auto* const args = tr_variantDictAddDict(&request, TR_KEY_arguments, 2);
+        auto* const ids = tr_variantDictAddList(args, TR_KEY_ids, 1);
+        tr_variantListAddInt(ids, tr_torrentId(tor));
+        auto* const replace = tr_variantDictAddList(args, TR_KEY_trackerListReplace, 2);
+        tr_variantListAddStrView(replace, oldval);
+        tr_variantListAddStrView(replace, newval);
+
+        auto response = tr_variant{};
+        tr_rpc_request_exec_json(
+            session_,
+            &request,
+            [](tr_session* /*session*/, tr_variant* resp, void* setme) noexcept
+            {
+                *static_cast<tr_variant*>(setme) = *resp;
+                tr_variantInitBool(resp, false);
+            },
+            &response);
+        tr_variantClear(&request);
+
+        auto sv = std::string_view{};
+        EXPECT_TRUE(tr_variantDictFindStrView(&response, TR_KEY_result, &sv));
+        auto result = std::string{ sv };
+        tr_variantClear(&response);
+        return result;
+    };
+
+    EXPECT_EQ("success"sv, exec("old.example"sv, "new.example"sv));
+    EXPECT_EQ("https://new.example/announce\n\nudp://new.example.org:6969\n"sv, tor->tracker_list());
+
+    // not matching isn't an error
+    EXPECT_EQ("success"sv, exec("nowhere.example"sv, "new.example"sv));
+    EXPECT_EQ(2U, tor->tracker_count());
+
+    EXPECT_NE("success"sv, exec(""sv, "new.example"sv));
+
+    // cleanup
+    tr_torrentRemove(tor, false, nullptr, nullptr);
+}
+
+TEST_F(RpcTest, torrentAddBatch)
+{
+    auto constexpr Magnet =
+        "magnet:?xt=urn:btih:"
+        "d2354010a3ca4ade5b7427bb093a62a3899ff381"
+        "&dn=Display%20Name"sv;
+
+    auto request = tr_variant{};
+    tr_variantInitDict(&request, 2);
+    tr_variantDictAddStrView(&request, TR_KEY_method, "torrent-add-batch");
+    auto* const args = tr_variantDictAddDict(&request, TR_KEY_arguments, 1);
+    auto* const items = tr_variantDictAddList(args, TR_KEY_torrents, 3);
+    auto* item = tr_variantListAddDict(items, 2);
+    tr_variantDictAddStrView(item, TR_KEY_filename, Magnet);
+    tr_variantDictAddBool(item, TR_KEY_paused, true);
+    item = tr_variantListAddDict(items, 1);
+    tr_variantDictAddStrView(item, TR_KEY_metainfo, "bm90IGEgdG9ycmVudA=="sv);
+    tr_variantListAddDict(items, 0);
+
+    auto response = tr_variant{};
+    auto done = std::atomic<bool>{ false };
+    auto user_data = std::make_pair(&response, &done);
+    tr_rpc_request_exec_json(
+        session_,
+        &request,
+        [](tr_session* /*session*/, tr_variant* resp, void* vdata) noexcept
+        {
+            auto* const data = static_cast<decltype(user_data)*>(vdata);
+            *data->first = *resp;
+            tr_variantInitBool(resp, false);
+            *data->second = true;
+        },
+        &user_data);
+    tr_variantClear(&request);
+    EXPECT_TRUE(waitFor([&done]() { return done.load(); }, 5000));
+
+    auto sv = std::string_view{};
+    EXPECT_TRUE(tr_variantDictFindStrView(&response, TR_KEY_result, &sv));
+    EXPECT_EQ("success"sv, sv);
+    tr_variant* response_args = nullptr;
+    EXPECT_TRUE(tr_variantDictFindDict(&response, TR_KEY_arguments, &response_args));
+    tr_variant* results = nullptr;
+    EXPECT_TRUE(tr_variantDictFindList(response_args, TR_KEY_torrents, &results));
+    ASSERT_EQ(3U, tr_variantListSize(results));
+
+    // the magnet link was added
+    auto* result = tr_variantListChild(results, 0);
+    EXPECT_TRUE(tr_variantDictFindStrView(result, TR_KEY_result, &sv));
+    EXPECT_EQ("success"sv, sv);
+    tr_variant* added = nullptr;
+    EXPECT_TRUE(tr_variantDictFindDict(result, TR_KEY_torrent_added, &added));
+    auto id = int64_t{};
+    EXPECT_TRUE(tr_variantDictFindInt(added, TR_KEY_id, &id));
+
+    // the bad metainfo was rejected without affecting the rest of the batch
+    result = tr_variantListChild(results, 1);
+    EXPECT_TRUE(tr_variantDictFindStrView(result, TR_KEY_result, &sv));
+    EXPECT_EQ("unrecognized info"sv, sv);
+    EXPECT_EQ(nullptr, tr_variantDictFind(result, TR_KEY_torrent_added));
+
+    result = tr_variantListChild(results, 2);
+    EXPECT_TRUE(tr_variantDictFindStrView(result, TR_KEY_result, &sv));
+    EXPECT_EQ("no filename or metainfo specified"sv, sv);
+
+    // cleanup
+    tr_variantClear(&response);
+    auto* const tor = tr_torrentFindFromId(session_, static_cast<tr_torrent_id_t>(id));
+    EXPECT_NE(nullptr, tor);
+    tr_torrentRemove(tor, false, nullptr, nullptr);
+}
+
 } // namespace libtransmission::test
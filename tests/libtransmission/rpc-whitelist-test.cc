@@ -0,0 +1,73 @@
+// This file Copyright (C) 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <array>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <libtransmission/rpc-whitelist.h>
+#include <libtransmission/utils.h> // tr_wildmat()
+
+#include "gtest/gtest.h"
+
+using namespace std::literals;
+
+using RpcWhitelistTest = ::testing::Test;
+
+TEST_F(RpcWhitelistTest, splitsPatterns)
+{
+    auto const whitelist = tr_rpc_whitelist{ "127.0.0.1, ::1;192.168.*.*"sv };
+    auto const expected = std::vector<std::string>{ "127.0.0.1", "::1", "192.168.*.*" };
+    EXPECT_EQ(expected, whitelist.patterns());
+}
+
+TEST_F(RpcWhitelistTest, matchesLikeWildmat)
+{
+    static auto constexpr Patterns = std::array<std::string_view, 6>{
+        "127.0.0.1,::1"sv,
+        "192.168.*.*,10.*"sv,
+        "*.*.*.*"sv,
+        "*.example.com,nas.*,fe80::*"sv,
+        "1?.0.0.1,host[0-9].lan,192.168.1*"sv,
+        "*"sv,
+    };
+
+    static auto constexpr Texts = std::array<std::string_view, 18>{
+        "127.0.0.1"sv,   "127.0.0.10"sv, "::1"sv,          "192.168.1.2"sv,    "192.169.1.2"sv,    "10.0.0.1"sv,
+        "100.0.0.1"sv,   "11.0.0.1"sv,   "fe80::1"sv,      "www.example.com"sv, "example.com"sv,    "nas.lan"sv,
+        "host7.lan"sv,   "hostx.lan"sv,  "192.168.10.1"sv, "192.168.001.1"sv,  "10.evil.example"sv, ""sv,
+    };
+
+    for (auto const& patterns : Patterns)
+    {
+        auto const whitelist = tr_rpc_whitelist{ patterns };
+        for (auto const& text : Texts)
+        {
+            auto const& list = whitelist.patterns();
+            auto const expected = std::any_of(
+                std::begin(list),
+                std::end(list),
+                [text](auto const& pattern) { return tr_wildmat(text, pattern); });
+            EXPECT_EQ(expected, whitelist.matches(text)) << '"' << patterns << "\" \"" << text << '"';
+        }
+    }
+}
+
+TEST_F(RpcWhitelistTest, matchesNetworks)
+{
+    auto const whitelist = tr_rpc_whitelist{ "192.168.*.*,10.*"sv };
+    EXPECT_TRUE(whitelist.matches("192.168.0.1"sv));
+    EXPECT_TRUE(whitelist.matches("10.255.255.255"sv));
+    EXPECT_FALSE(whitelist.matches("192.169.0.1"sv));
+    EXPECT_FALSE(whitelist.matches("11.0.0.1"sv));
+}
+
+TEST_F(RpcWhitelistTest, emptyMatchesNothing)
+{
+    auto const whitelist = tr_rpc_whitelist{};
+    EXPECT_FALSE(whitelist.matches("127.0.0.1"sv));
+}
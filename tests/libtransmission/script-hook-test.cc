@@ -0,0 +1,118 @@
+// This file Copyright (C) 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#ifndef _WIN32
+
+#include <array>
+#include <chrono>
+#include <string>
+#include <string_view>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <event2/event.h>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/script-hook.h>
+#include <libtransmission/timer-ev.h>
+#include <libtransmission/utils.h>
+#include <libtransmission/utils-ev.h>
+
+#include "gtest/gtest.h"
+#include "test-fixtures.h"
+
+using namespace std::literals;
+
+namespace libtransmission::test
+{
+
+class ScriptHookTest : public SandboxedTest
+{
+protected:
+    void SetUp() override
+    {
+        SandboxedTest::SetUp();
+        evbase_.reset(event_base_new());
+        socket_path_ = sandboxDir() + "/hook.sock";
+    }
+
+    void TearDown() override
+    {
+        evbase_.reset();
+        SandboxedTest::TearDown();
+    }
+
+    // listen on the socket, the way a helper would
+    [[nodiscard]] int listenOnSocket() const
+    {
+        auto addr = sockaddr_un{};
+        addr.sun_family = AF_UNIX;
+        tr_strlcpy(addr.sun_path, socket_path_.c_str(), sizeof(addr.sun_path));
+
+        auto const fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        EXPECT_EQ(0, bind(fd, reinterpret_cast<sockaddr const*>(&addr), sizeof(addr)));
+        EXPECT_EQ(0, listen(fd, 1));
+        return fd;
+    }
+
+    evhelpers::evbase_unique_ptr evbase_;
+    std::string socket_path_;
+};
+
+TEST_F(ScriptHookTest, refusesEventsWithoutHelper)
+{
+    auto timer_maker = EvTimerMaker{ evbase_.get() };
+    auto hook = tr_script_hook{ evbase_.get(), timer_maker, socket_path_ };
+
+    EXPECT_FALSE(waitFor(
+        evbase_.get(),
+        [&hook]() { return hook.is_connected(); },
+        200ms));
+    EXPECT_FALSE(hook.send("{\"event\":\"torrent-done\"}\n"sv));
+}
+
+TEST_F(ScriptHookTest, sendsEventsToHelper)
+{
+    static auto constexpr Event1 = "{\"event\":\"torrent-added\",\"id\":1}\n"sv;
+    static auto constexpr Event2 = "{\"event\":\"torrent-done\",\"id\":1}\n"sv;
+
+    auto const listener = listenOnSocket();
+    auto timer_maker = EvTimerMaker{ evbase_.get() };
+    auto hook = tr_script_hook{ evbase_.get(), timer_maker, socket_path_ };
+    EXPECT_TRUE(waitFor(evbase_.get(), [&hook]() { return hook.is_connected(); }));
+    auto const helper = accept(listener, nullptr, nullptr);
+    ASSERT_NE(-1, helper);
+
+    // the helper gets one line per event, in order
+    EXPECT_TRUE(hook.send(Event1));
+    EXPECT_TRUE(hook.send(Event2));
+    auto received = std::string{};
+    EXPECT_TRUE(waitFor(
+        evbase_.get(),
+        [&]()
+        {
+            auto buf = std::array<char, 256>{};
+            if (auto const n = recv(helper, std::data(buf), std::size(buf), MSG_DONTWAIT); n > 0)
+            {
+                received.append(std::data(buf), n);
+            }
+            return std::size(received) >= std::size(Event1) + std::size(Event2);
+        }));
+    EXPECT_EQ(std::string{ Event1 } + std::string{ Event2 }, received);
+
+    // when the helper goes away, events are refused so that scripts can run instead
+    close(helper);
+    EXPECT_TRUE(waitFor(evbase_.get(), [&hook]() { return !hook.is_connected(); }));
+    EXPECT_FALSE(hook.send(Event1));
+
+    close(listener);
+}
+
+} // namespace libtransmission::test
+
+#endif
@@ -11,13 +11,19 @@
 #include <memory>
 #include <string>
 #include <string_view>
+#include <vector>
 
 #include <libtransmission/transmission.h>
 
 #include <libtransmission/crypto-utils.h>
+#include <libtransmission/file.h>
+#include <libtransmission/net.h>
 #include <libtransmission/quark.h>
 #include <libtransmission/session-id.h>
 #include <libtransmission/session.h>
+#include <libtransmission/torrent-metainfo.h>
+#include <libtransmission/torrent.h>
+#include <libtransmission/tr-strbuf.h>
 #include <libtransmission/variant.h>
 #include <libtransmission/version.h>
 
@@ -298,6 +304,49 @@ TEST_F(SessionTest, getDefaultSettingsIncludesSubmodules)
     tr_variantClear(&settings);
 }
 
+TEST_F(SessionTest, acceptsBacklogInBatches)
+{
+    auto const loopback = *tr_address::from_string("127.0.0.1"sv);
+    auto const listener = tr_netBindTCP(loopback, tr_port::fromHost(0), true);
+    ASSERT_NE(TR_BAD_SOCKET, listener);
+
+    auto ss = sockaddr_storage{};
+    auto sslen = socklen_t{ sizeof(ss) };
+    ASSERT_EQ(0, getsockname(listener, reinterpret_cast<sockaddr*>(&ss), &sslen));
+
+    // queue up some connections in the listener's backlog
+    static auto constexpr NumClients = size_t{ 5U };
+    auto clients = std::vector<tr_socket_t>{};
+    for (size_t i = 0; i < NumClients; ++i)
+    {
+        auto const sock = socket(AF_INET, SOCK_STREAM, 0);
+        ASSERT_NE(TR_BAD_SOCKET, sock);
+        ASSERT_EQ(0, connect(sock, reinterpret_cast<sockaddr const*>(&ss), sslen));
+        clients.push_back(sock);
+    }
+
+    // one call takes as many as the budget allows, and the next one takes the rest
+    auto accepted = tr_netAccept(session_, listener, 3U);
+    EXPECT_EQ(3U, std::size(accepted));
+    auto rest = tr_netAccept(session_, listener, 3U);
+    EXPECT_EQ(NumClients - 3U, std::size(rest));
+    EXPECT_TRUE(std::empty(tr_netAccept(session_, listener, 3U)));
+
+    accepted.insert(std::end(accepted), std::begin(rest), std::end(rest));
+    for (auto const& [socket_address, sock] : accepted)
+    {
+        EXPECT_EQ(loopback, socket_address.address());
+        tr_net_close_socket(sock);
+    }
+
+    for (auto const sock : clients)
+    {
+        tr_net_close_socket(sock);
+    }
+
+    tr_net_close_socket(listener);
+}
+
 TEST_F(SessionTest, honorsSettings)
 {
     // Baseline: confirm that these settings are disabled by default
@@ -350,4 +399,39 @@ TEST_F(SessionTest, savesSettings)
     tr_variantClear(&settings);
 }
 
+TEST_F(SessionTest, loadTorrents)
+{
+    static auto constexpr Names = std::array<std::string_view, 3>{
+        "Android-x86 8.1 r6 iso.torrent"sv,
+        "debian-11.2.0-amd64-DVD-1.iso.torrent"sv,
+        "ubuntu-20.04.4-desktop-amd64.iso.torrent"sv,
+    };
+
+    for (auto const& name : Names)
+    {
+        auto const src = tr_pathbuf{ LIBTRANSMISSION_TEST_ASSETS_DIR, '/', name };
+        auto const dst = tr_pathbuf{ session_->torrentDir(), '/', name };
+        EXPECT_TRUE(tr_sys_path_copy(src, dst));
+    }
+
+    // give one of them a resume file
+    auto metainfo = tr_torrent_metainfo{};
+    EXPECT_TRUE(metainfo.parse_torrent_file(tr_pathbuf{ LIBTRANSMISSION_TEST_ASSETS_DIR, '/', Names[1] }));
+    auto resume = tr_variant{};
+    tr_variantInitDict(&resume, 1);
+    tr_variantListAddStrView(tr_variantDictAddList(&resume, TR_KEY_labels, 1), "loaded"sv);
+    EXPECT_EQ(0, tr_variantToFile(&resume, TR_VARIANT_FMT_BENC, metainfo.resume_file(session_->resumeDir())));
+    tr_variantClear(&resume);
+
+    auto* const ctor = tr_ctorNew(session_);
+    tr_ctorSetPaused(ctor, TR_FORCE, true);
+    EXPECT_EQ(std::size(Names), tr_sessionLoadTorrents(session_, ctor));
+    tr_ctorFree(ctor);
+    EXPECT_EQ(std::size(Names), std::size(session_->torrents()));
+
+    auto const* const tor = session_->torrents().get(metainfo.info_hash());
+    ASSERT_NE(nullptr, tor);
+    EXPECT_EQ(tr_torrent::labels_t{ tr_quark_new("loaded"sv) }, tor->labels);
+}
+
 } // namespace libtransmission::test
@@ -0,0 +1,164 @@
+// This file Copyright (C) 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef> // size_t
+#include <cstdint> // uint8_t, uint64_t
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/error.h>
+#include <libtransmission/file.h>
+#include <libtransmission/inout.h>
+#include <libtransmission/storage.h>
+#include <libtransmission/torrent.h>
+#include <libtransmission/tr-strbuf.h>
+
+#include "gtest/gtest.h"
+#include "test-fixtures.h"
+
+using namespace std::literals;
+
+namespace libtransmission::test
+{
+
+namespace
+{
+
+// keeps the files' data in memory
+class MemoryStorage final : public tr_storage
+{
+public:
+    [[nodiscard]] bool read_at(
+        tr_torrent const* /*tor*/,
+        tr_file_index_t file_index,
+        uint64_t offset,
+        uint8_t* buf,
+        size_t len,
+        tr_error** error) override
+    {
+        auto const lock = std::lock_guard{ mutex_ };
+
+        auto const iter = files_.find(file_index);
+        if (iter == std::end(files_) || offset + len > std::size(iter->second))
+        {
+            tr_error_set_from_errno(error, ENOENT);
+            return false;
+        }
+
+        std::copy_n(std::data(iter->second) + offset, len, buf);
+        ++n_reads;
+        return true;
+    }
+
+    [[nodiscard]] bool write_at(
+        tr_torrent const* /*tor*/,
+        tr_file_index_t file_index,
+        uint64_t offset,
+        tr_sys_file_iovec const* vecs,
+        size_t n_vecs,
+        tr_error** /*error*/) override
+    {
+        auto const lock = std::lock_guard{ mutex_ };
+
+        auto& file = files_[file_index];
+        for (size_t i = 0; i < n_vecs; ++i)
+        {
+            auto const* const begin = static_cast<uint8_t const*>(vecs[i].base);
+            file.resize(std::max(std::size(file), offset + vecs[i].len));
+            std::copy_n(begin, vecs[i].len, std::data(file) + offset);
+            offset += vecs[i].len;
+        }
+
+        ++n_writes;
+        return true;
+    }
+
+    [[nodiscard]] bool exists(tr_torrent const* /*tor*/, tr_file_index_t file_index) override
+    {
+        auto const lock = std::lock_guard{ mutex_ };
+        return files_.count(file_index) != 0U;
+    }
+
+    size_t n_reads = 0;
+    size_t n_writes = 0;
+
+private:
+    std::mutex mutex_;
+    std::map<tr_file_index_t, std::vector<uint8_t>> files_;
+};
+
+} // namespace
+
+using StorageTest = SessionTest;
+
+TEST_F(StorageTest, findsInnermostFolder)
+{
+    auto const outer = std::make_shared<MemoryStorage>();
+    auto const inner = std::make_shared<MemoryStorage>();
+
+    auto storages = tr_storages{};
+    EXPECT_EQ(nullptr, storages.find("/data/torrents"sv));
+
+    storages.set("/data/"sv, outer);
+    storages.set("/data/remote"sv, inner);
+    EXPECT_EQ(outer, storages.find("/data"sv));
+    EXPECT_EQ(outer, storages.find("/data/torrents"sv));
+    EXPECT_EQ(inner, storages.find("/data/remote"sv));
+    EXPECT_EQ(inner, storages.find("/data/remote/"sv));
+    EXPECT_EQ(inner, storages.find("/data/remote/linux-isos"sv));
+    EXPECT_EQ(outer, storages.find("/data/remote-not"sv));
+    EXPECT_EQ(nullptr, storages.find("/database"sv));
+
+    // unsetting a folder goes back to the local filesystem
+    storages.set("/data"sv, nullptr);
+    EXPECT_EQ(nullptr, storages.find("/data/torrents"sv));
+    EXPECT_EQ(inner, storages.find("/data/remote/linux-isos"sv));
+}
+
+TEST_F(StorageTest, readsWritesAndVerifiesThroughBackend)
+{
+    auto const storage = std::make_shared<MemoryStorage>();
+    tr_sessionSetStorage(session_, tr_sessionGetDownloadDir(session_), storage);
+
+    auto* const tor = zeroTorrentInit(ZeroTorrentState::NoFiles);
+    ASSERT_NE(nullptr, tor);
+    EXPECT_EQ(storage, tor->storage());
+
+    // write the first piece
+    auto const piece_size = tor->piece_size(0);
+    auto const zeroes = std::vector<uint8_t>(piece_size);
+    EXPECT_EQ(0, tr_ioWrite(tor, tor->piece_loc(0), std::size(zeroes), std::data(zeroes)));
+    EXPECT_LT(0U, storage->n_writes);
+
+    // it went to the backend, not to the download folder
+    EXPECT_FALSE(tr_sys_path_exists(tr_pathbuf{ tr_sessionGetDownloadDir(session_), '/', tor->file_subpath(0) }));
+    EXPECT_FALSE(tr_sys_path_exists(tr_pathbuf{ tr_sessionGetDownloadDir(session_), '/', tor->file_subpath(0), ".part"sv }));
+
+    auto buf = std::vector<uint8_t>(piece_size, 1U);
+    EXPECT_EQ(0, tr_ioRead(tor, tor->piece_loc(0), std::size(buf), std::data(buf)));
+    EXPECT_EQ(zeroes, buf);
+
+    // the rest of the torrent hasn't been written
+    EXPECT_NE(0, tr_ioRead(tor, tor->piece_loc(1), std::size(buf), std::data(buf)));
+
+    // verifying reads from the backend too
+    auto const n_reads = storage->n_reads;
+    blockingTorrentVerify(tor);
+    EXPECT_LT(n_reads, storage->n_reads);
+    EXPECT_EQ(piece_size, tr_torrentStat(tor)->haveValid);
+
+    // cleanup
+    tr_torrentRemove(tor, false, nullptr, nullptr);
+    tr_sessionSetStorage(session_, tr_sessionGetDownloadDir(session_), nullptr);
+}
+
+} // namespace libtransmission::test
@@ -0,0 +1,74 @@
+// This file Copyright (C) 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <cstdint> // uint64_t
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/stream-cursor.h>
+
+#include "gtest/gtest.h"
+
+using StreamCursorTest = ::testing::Test;
+
+TEST_F(StreamCursorTest, hasNoDeadlinesWithoutAReader)
+{
+    auto const cursor = tr_stream_cursor{};
+    EXPECT_FALSE(cursor.is_active(0U));
+    EXPECT_FALSE(cursor.deadline({ 0U, 100U }));
+}
+
+TEST_F(StreamCursorTest, givesDeadlinesAheadOfTheReader)
+{
+    static auto constexpr Rate = tr_stream_cursor::DefaultBytesPerSecond;
+
+    auto cursor = tr_stream_cursor{};
+    cursor.update(Rate, 1000U);
+    EXPECT_TRUE(cursor.is_active(1000U));
+
+    // bytes that the reader has already read don't need a deadline
+    EXPECT_FALSE(cursor.deadline({ 0U, Rate }));
+
+    // the span the reader is in is due now; later ones are due when the reader gets there
+    EXPECT_EQ(1000U, cursor.deadline({ Rate - 10U, Rate + 10U }));
+    EXPECT_EQ(3000U, cursor.deadline({ Rate * 3U, Rate * 4U }));
+
+    // but not beyond the read-ahead window
+    auto const window_end = Rate + cursor.readahead_bytes();
+    EXPECT_FALSE(cursor.deadline({ window_end, window_end + 10U }));
+}
+
+TEST_F(StreamCursorTest, learnsTheReadersSpeed)
+{
+    static auto constexpr Rate = tr_stream_cursor::DefaultBytesPerSecond * 4U;
+
+    auto cursor = tr_stream_cursor{};
+    auto byte = uint64_t{};
+    auto now = uint64_t{ 1000U };
+    for (int i = 0; i < 20; ++i)
+    {
+        cursor.update(byte, now);
+        byte += Rate;
+        now += 1000U;
+    }
+    EXPECT_NEAR(Rate, cursor.bytes_per_second(), Rate / 100U);
+
+    // a seek isn't mistaken for fast reading
+    auto const bytes_per_second = cursor.bytes_per_second();
+    cursor.update(byte + cursor.readahead_bytes() * 10U, now);
+    EXPECT_EQ(bytes_per_second, cursor.bytes_per_second());
+}
+
+TEST_F(StreamCursorTest, forgetsIdleReaders)
+{
+    auto cursor = tr_stream_cursor{};
+    cursor.update(0U, 1000U);
+    EXPECT_FALSE(cursor.is_idle(1000U));
+    EXPECT_TRUE(cursor.is_idle(1000U + tr_stream_cursor::IdleMsec));
+
+    cursor.clear();
+    EXPECT_FALSE(cursor.is_idle(1000U + tr_stream_cursor::IdleMsec));
+    EXPECT_FALSE(cursor.deadline({ 0U, 100U }));
+}
@@ -491,7 +491,7 @@ protected:
         return tor;
     }
 
-    void blockingTorrentVerify(tr_torrent* tor)
+    void blockingTorrentVerify(tr_torrent* tor, bool quick = false, bool background = false)
     {
         EXPECT_NE(nullptr, tor->session);
         EXPECT_FALSE(tor->session->am_in_session_thread());
@@ -503,7 +503,18 @@ protected:
         {
             return std::size(verified_) > n_previously_verified && verified_.back() == tor;
         };
-        tr_torrentVerify(tor);
+        if (background)
+        {
+            tr_torrentVerifyBackground(tor);
+        }
+        else if (quick)
+        {
+            tr_torrentVerifyQuick(tor);
+        }
+        else
+        {
+            tr_torrentVerify(tor);
+        }
         verified_cv_.wait_for(verified_lock, 20s, stop_waiting);
     }
 
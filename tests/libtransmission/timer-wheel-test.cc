@@ -0,0 +1,193 @@
+// This file Copyright (C) 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <chrono>
+#include <cstddef> // size_t
+#include <memory>
+#include <vector>
+
+#include <event2/event.h>
+
+#include <libtransmission/timer.h>
+#include <libtransmission/timer-wheel.h>
+#include <libtransmission/utils-ev.h>
+
+#include "gtest/gtest.h"
+#include "test-fixtures.h"
+
+namespace libtransmission::test
+{
+
+class TimerWheelTest : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        ::testing::Test::SetUp();
+        evbase_.reset(event_base_new());
+    }
+
+    void TearDown() override
+    {
+        evbase_.reset();
+        ::testing::Test::TearDown();
+    }
+
+    static auto constexpr AsMSec = [](auto val)
+    {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(val);
+    };
+
+    void sleepMsec(std::chrono::milliseconds msec)
+    {
+        EXPECT_FALSE(waitFor(
+            evbase_.get(),
+            []() { return false; },
+            msec));
+    }
+
+    // This checks that `actual` is in the bounds of [expected/2 ... expected*1.5]
+    static void expectInterval(std::chrono::milliseconds expected, std::chrono::milliseconds actual)
+    {
+        EXPECT_LT(expected / 2, actual);
+        EXPECT_LT(actual, expected + expected / 2);
+    }
+
+    [[nodiscard]] static auto currentTime()
+    {
+        return std::chrono::steady_clock::now();
+    }
+
+    evhelpers::evbase_unique_ptr evbase_;
+};
+
+TEST_F(TimerWheelTest, singleShotHonorsInterval)
+{
+    auto timer_maker = WheelTimerMaker{ evbase_.get() };
+
+    auto called = false;
+    auto timer = timer_maker.create([&called]() { called = true; });
+
+    auto const begin_time = currentTime();
+    static auto constexpr Interval = 100ms;
+    timer->start_single_shot(Interval);
+    EXPECT_EQ(1U, timer_maker.size());
+    waitFor(evbase_.get(), [&called] { return called; });
+    auto const end_time = currentTime();
+
+    EXPECT_TRUE(called);
+    expectInterval(Interval, AsMSec(end_time - begin_time));
+    EXPECT_EQ(0U, timer_maker.size());
+}
+
+TEST_F(TimerWheelTest, repeatingHonorsInterval)
+{
+    auto timer_maker = WheelTimerMaker{ evbase_.get() };
+
+    auto n_calls = size_t{ 0U };
+    auto timer = timer_maker.create([&n_calls]() { ++n_calls; });
+
+    auto const begin_time = currentTime();
+    static auto constexpr Interval = 100ms;
+    static auto constexpr DesiredLoops = 3;
+    timer->start_repeating(Interval);
+    waitFor(evbase_.get(), [&n_calls] { return n_calls >= DesiredLoops; });
+    auto const end_time = currentTime();
+
+    expectInterval(Interval * DesiredLoops, AsMSec(end_time - begin_time));
+    EXPECT_EQ(DesiredLoops, n_calls);
+    EXPECT_EQ(1U, timer_maker.size());
+}
+
+TEST_F(TimerWheelTest, longIntervalsCascade)
+{
+    // with a 1ms tick, these are spread across the wheel's first three levels
+    auto timer_maker = WheelTimerMaker{ evbase_.get(), 1ms };
+
+    auto const intervals = std::vector<std::chrono::milliseconds>{ 20ms, 150ms, 700ms, 4200ms };
+    auto fired_after = std::vector<std::chrono::milliseconds>(std::size(intervals));
+    auto timers = std::vector<std::unique_ptr<Timer>>{};
+
+    auto const begin_time = currentTime();
+    for (size_t i = 0; i < std::size(intervals); ++i)
+    {
+        auto& timer = timers.emplace_back(
+            timer_maker.create([&fired_after, begin_time, i]() { fired_after[i] = AsMSec(currentTime() - begin_time); }));
+        timer->start_single_shot(intervals[i]);
+    }
+
+    waitFor(evbase_.get(), [&timer_maker]() { return timer_maker.size() == 0U; }, 10s);
+
+    for (size_t i = 0; i < std::size(intervals); ++i)
+    {
+        expectInterval(intervals[i], fired_after[i]);
+    }
+}
+
+TEST_F(TimerWheelTest, stoppedTimersDoNotFire)
+{
+    auto timer_maker = WheelTimerMaker{ evbase_.get() };
+
+    auto n_calls = size_t{ 0U };
+    auto stopped = timer_maker.create([&n_calls]() { ++n_calls; });
+    auto destroyed = timer_maker.create([&n_calls]() { ++n_calls; });
+
+    static auto constexpr Interval = 200ms;
+    stopped->start_repeating(Interval);
+    destroyed->start_single_shot(Interval);
+    EXPECT_EQ(2U, timer_maker.size());
+
+    sleepMsec(Interval / 2);
+    stopped->stop();
+    destroyed.reset();
+    EXPECT_EQ(0U, timer_maker.size());
+
+    sleepMsec(Interval);
+    EXPECT_EQ(0U, n_calls);
+}
+
+TEST_F(TimerWheelTest, callbackCanDestroyTimersInSameBatch)
+{
+    // both timers are due in the same tick, so they're run in one batch.
+    // whichever runs first destroys the other, which must then not run.
+    auto timer_maker = WheelTimerMaker{ evbase_.get(), 50ms };
+
+    auto n_calls = size_t{ 0U };
+    auto timers = std::vector<std::unique_ptr<Timer>>(2U);
+    timers[0] = timer_maker.create(
+        [&]()
+        {
+            ++n_calls;
+            timers[1].reset();
+        });
+    timers[1] = timer_maker.create(
+        [&]()
+        {
+            ++n_calls;
+            timers[0].reset();
+        });
+
+    for (auto& timer : timers)
+    {
+        timer->start_single_shot(10ms);
+    }
+
+    waitFor(evbase_.get(), [&n_calls]() { return n_calls > 0U; });
+    sleepMsec(100ms);
+    EXPECT_EQ(1U, n_calls);
+    EXPECT_EQ(0U, timer_maker.size());
+}
+
+TEST_F(TimerWheelTest, timersCanOutliveTheirMaker)
+{
+    auto timer_maker = std::make_unique<WheelTimerMaker>(evbase_.get());
+    auto timer = timer_maker->create([]() {});
+    timer->start_single_shot(1s);
+
+    timer_maker.reset();
+    timer.reset();
+}
+
+} // namespace libtransmission::test
@@ -4,9 +4,15 @@
 // License text can be found in the licenses/ folder.
 
 #include <cstddef> // size_t
+#include <cstdint> // uint64_t
+#include <optional>
 #include <string>
 
+#include <libtransmission/transmission.h>
+
 #include <libtransmission/error.h>
+#include <libtransmission/file.h>
+#include <libtransmission/session.h>
 #include <libtransmission/torrent-magnet.h>
 #include <libtransmission/torrent-metainfo.h>
 
@@ -42,6 +48,14 @@ TEST_F(TorrentMagnetTest, getMetadataPiece)
     benc.append("e");
     EXPECT_EQ(tor->info_dict_size(), info_dict_size);
 
+    // the info dict was read once and kept for the next requests
+    EXPECT_EQ(info_dict_size, session_->info_dict_cache().bytes());
+    EXPECT_TRUE(tr_sys_path_remove(tor->torrent_file()));
+    EXPECT_TRUE(tr_torrentGetMetadataPiece(tor, 0, data));
+    session_->info_dict_cache().erase(tor->id());
+    EXPECT_EQ(0U, session_->info_dict_cache().bytes());
+    EXPECT_FALSE(tr_torrentGetMetadataPiece(tor, 0, data));
+
     auto torrent_metainfo = tr_torrent_metainfo{};
     tr_error* error = nullptr;
     EXPECT_TRUE(torrent_metainfo.parse_benc(benc, &error));
@@ -51,4 +65,36 @@ TEST_F(TorrentMagnetTest, getMetadataPiece)
     EXPECT_EQ(tor->piece_hash(0), torrent_metainfo.piece_hash(0));
 }
 
+TEST_F(TorrentMagnetTest, metadataRequestsAreSpreadOutAndRetried)
+{
+    static auto constexpr Magnet = "magnet:?xt=urn:btih:1111111111111111111111111111111111111111";
+
+    auto* const ctor = tr_ctorNew(session_);
+    EXPECT_TRUE(tr_ctorSetMetainfoFromMagnetLink(ctor, Magnet, nullptr));
+    tr_ctorSetPaused(ctor, TR_FORCE, true);
+    auto* const tor = tr_torrentNew(ctor, nullptr);
+    tr_ctorFree(ctor);
+    ASSERT_NE(nullptr, tor);
+
+    static auto constexpr NumPieces = 3;
+    EXPECT_TRUE(tr_torrentSetMetadataSizeHint(tor, MetadataPieceSize * NumPieces));
+
+    // every piece is handed out once before any is asked for again
+    auto now = uint64_t{ 1000000U };
+    for (int i = 0; i < NumPieces; ++i)
+    {
+        EXPECT_EQ(i, tr_torrentGetNextMetadataRequest(tor, now));
+    }
+    EXPECT_EQ(std::nullopt, tr_torrentGetNextMetadataRequest(tor, now));
+
+    // a rejected piece can be asked for again right away
+    tr_torrentMetadataPieceRejected(tor, 1);
+    EXPECT_EQ(1, tr_torrentGetNextMetadataRequest(tor, now));
+    EXPECT_EQ(std::nullopt, tr_torrentGetNextMetadataRequest(tor, now));
+
+    // unanswered requests are retried once they time out
+    now += 60000U;
+    EXPECT_EQ(0, tr_torrentGetNextMetadataRequest(tor, now));
+}
+
 } // namespace libtransmission::test
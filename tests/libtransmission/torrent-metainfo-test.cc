@@ -189,6 +189,67 @@ TEST_F(TorrentMetainfoTest, AndroidTorrent)
     tr_ctorFree(ctor);
 }
 
+TEST_F(TorrentMetainfoTest, readsDroppedPieceHashes)
+{
+    auto const filename = tr_pathbuf{ LIBTRANSMISSION_TEST_ASSETS_DIR, "/Android-x86 8.1 r6 iso.torrent"sv };
+
+    auto metainfo = tr_torrent_metainfo{};
+    EXPECT_TRUE(metainfo.parse_torrent_file(filename));
+    auto const n_pieces = metainfo.piece_count();
+    auto expected = std::vector<tr_sha1_digest_t>{};
+    for (tr_piece_index_t piece = 0; piece < n_pieces; ++piece)
+    {
+        expected.emplace_back(metainfo.piece_hash(piece));
+    }
+
+    metainfo.drop_piece_hashes();
+    EXPECT_FALSE(metainfo.has_piece_hashes());
+    EXPECT_TRUE(metainfo.has_v1_metadata());
+
+    auto const all = metainfo.read_piece_hashes(filename, 0, n_pieces);
+    ASSERT_TRUE(all);
+    EXPECT_EQ(expected, *all);
+
+    auto const tail = metainfo.read_piece_hashes(filename, n_pieces - 2U, 2U);
+    ASSERT_TRUE(tail);
+    EXPECT_EQ(expected[n_pieces - 2U], tail->front());
+    EXPECT_EQ(expected.back(), tail->back());
+
+    // a different file doesn't hold the hashes where we expect them
+    auto const other = tr_pathbuf{ LIBTRANSMISSION_TEST_ASSETS_DIR, "/ubuntu-20.04.4-desktop-amd64.iso.torrent"sv };
+    EXPECT_FALSE(metainfo.read_piece_hashes(other, 0, 1U));
+}
+
+TEST_F(TorrentMetainfoTest, parseMappedTorrentFile)
+{
+    auto const filename = tr_pathbuf{ LIBTRANSMISSION_TEST_ASSETS_DIR, "/Android-x86 8.1 r6 iso.torrent"sv };
+
+    auto expected = tr_torrent_metainfo{};
+    EXPECT_TRUE(expected.parse_torrent_file(filename));
+
+    auto metainfo = tr_torrent_metainfo{};
+    EXPECT_TRUE(metainfo.parse_mapped_torrent_file(filename));
+    EXPECT_EQ(expected.info_hash(), metainfo.info_hash());
+    EXPECT_EQ(expected.piece_hash(0), metainfo.piece_hash(0));
+
+    // skip the piece hashes, but keep everything else
+    metainfo = tr_torrent_metainfo{};
+    EXPECT_TRUE(metainfo.parse_mapped_torrent_file(filename, false));
+    EXPECT_FALSE(metainfo.has_piece_hashes());
+    EXPECT_TRUE(metainfo.has_v1_metadata());
+    EXPECT_EQ(expected.info_hash(), metainfo.info_hash());
+    EXPECT_EQ(expected.name(), metainfo.name());
+    EXPECT_EQ(expected.file_count(), metainfo.file_count());
+    EXPECT_EQ(expected.piece_count(), metainfo.piece_count());
+    EXPECT_EQ(expected.pieces_offset(), metainfo.pieces_offset());
+
+    auto const hashes = metainfo.read_piece_hashes(filename, 0, 1U);
+    ASSERT_TRUE(hashes);
+    EXPECT_EQ(expected.piece_hash(0), hashes->front());
+
+    EXPECT_FALSE(metainfo.parse_mapped_torrent_file(tr_pathbuf{ LIBTRANSMISSION_TEST_ASSETS_DIR, "/no-such-file.torrent"sv }));
+}
+
 TEST_F(TorrentMetainfoTest, ctorSaveContents)
 {
     auto const src_filename = tr_pathbuf{ LIBTRANSMISSION_TEST_ASSETS_DIR, "/Android-x86 8.1 r6 iso.torrent"sv };
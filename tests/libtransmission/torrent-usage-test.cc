@@ -0,0 +1,64 @@
+// This file Copyright (C) 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <chrono>
+#include <cstdint>
+#include <set>
+#include <string_view>
+#include <thread>
+
+#include <libtransmission/torrent-usage.h>
+
+#include "gtest/gtest.h"
+
+using namespace std::literals;
+
+TEST(TorrentUsage, counters)
+{
+    auto usage = tr_torrent_usage{};
+    EXPECT_EQ(0U, usage.get(tr_torrent_usage::DiskReads));
+
+    usage.add_io(tr_torrent_usage::DiskReads, tr_torrent_usage::DiskReadBytes, 16384U);
+    usage.add_io(tr_torrent_usage::DiskReads, tr_torrent_usage::DiskReadBytes, 100U);
+    usage.add(tr_torrent_usage::CacheWrites);
+    EXPECT_EQ(2U, usage.get(tr_torrent_usage::DiskReads));
+    EXPECT_EQ(16484U, usage.get(tr_torrent_usage::DiskReadBytes));
+    EXPECT_EQ(1U, usage.get(tr_torrent_usage::CacheWrites));
+    EXPECT_EQ(0U, usage.get(tr_torrent_usage::CacheWriteBytes));
+}
+
+TEST(TorrentUsage, timerAddsElapsedTime)
+{
+    auto usage = tr_torrent_usage{};
+
+    {
+        auto const timer = tr_torrent_usage::Timer{ usage, tr_torrent_usage::HashUsec };
+        std::this_thread::sleep_for(2ms);
+    }
+
+    EXPECT_GE(usage.get(tr_torrent_usage::HashUsec), 2000U);
+    EXPECT_EQ(0U, usage.get(tr_torrent_usage::ParseUsec));
+}
+
+TEST(TorrentUsage, namesAreUnique)
+{
+    auto names = std::set<std::string_view>{};
+    for (uint8_t i = 0U; i < tr_torrent_usage::NumCounters; ++i)
+    {
+        auto const name = tr_torrent_usage::name(static_cast<tr_torrent_usage::Counter>(i));
+        EXPECT_FALSE(std::empty(name));
+        EXPECT_TRUE(names.insert(name).second) << name;
+    }
+}
+
+TEST(TorrentUsage, memoryTotal)
+{
+    auto memory = tr_torrent_usage::Memory{};
+    memory.cache = 1U;
+    memory.read_cache = 2U;
+    memory.peer_buffers = 4U;
+    memory.metadata = 8U;
+    EXPECT_EQ(15U, memory.total());
+}
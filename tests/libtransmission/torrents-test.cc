@@ -13,6 +13,7 @@
 
 #include <libtransmission/transmission.h>
 
+#include <libtransmission/crypto-utils.h>
 #include <libtransmission/torrent.h>
 #include <libtransmission/torrents.h>
 #include <libtransmission/torrent-metainfo.h>
@@ -91,6 +92,39 @@ TEST_F(TorrentsTest, rangedLoop)
     EXPECT_EQ(0U, std::size(torrents_set));
 }
 
+TEST_F(TorrentsTest, getFromObfuscatedHash)
+{
+    auto constexpr Filenames = std::array<std::string_view, 2>{ "Android-x86 8.1 r6 iso.torrent"sv,
+                                                                "debian-11.2.0-amd64-DVD-1.iso.torrent"sv };
+
+    auto owned = std::vector<std::unique_ptr<tr_torrent>>{};
+    auto torrents = tr_torrents{};
+
+    for (auto const& name : Filenames)
+    {
+        auto const path = tr_pathbuf{ LIBTRANSMISSION_TEST_ASSETS_DIR, '/', name };
+        auto tm = tr_torrent_metainfo{};
+        EXPECT_TRUE(tm.parse_torrent_file(path));
+        owned.emplace_back(std::make_unique<tr_torrent>(std::move(tm)));
+
+        auto* const tor = owned.back().get();
+        tor->unique_id_ = torrents.add(tor);
+    }
+
+    for (auto const& tor : owned)
+    {
+        auto const obfuscated_hash = tr_sha1::digest("req2"sv, tor->info_hash());
+        EXPECT_EQ(tor.get(), torrents.get_from_obfuscated(obfuscated_hash));
+        EXPECT_EQ(nullptr, torrents.get_from_obfuscated(tor->info_hash()));
+    }
+
+    // removed torrents can't be found
+    auto const obfuscated_hash = tr_sha1::digest("req2"sv, owned.front()->info_hash());
+    torrents.remove(owned.front().get(), time(nullptr));
+    EXPECT_EQ(nullptr, torrents.get_from_obfuscated(obfuscated_hash));
+    EXPECT_EQ(owned.back().get(), torrents.get_from_obfuscated(tr_sha1::digest("req2"sv, owned.back()->info_hash())));
+}
+
 TEST_F(TorrentsTest, removedSince)
 {
     auto constexpr Filenames = std::array<std::string_view, 4>{ "Android-x86 8.1 r6 iso.torrent"sv,
@@ -136,6 +170,122 @@ TEST_F(TorrentsTest, removedSince)
     EXPECT_EQ(remove, torrents.removedSince(50));
 }
 
+TEST_F(TorrentsTest, queueOrder)
+{
+    auto constexpr Filenames = std::array<std::string_view, 4>{ "Android-x86 8.1 r6 iso.torrent"sv,
+                                                                "debian-11.2.0-amd64-DVD-1.iso.torrent"sv,
+                                                                "ubuntu-18.04.6-desktop-amd64.iso.torrent"sv,
+                                                                "ubuntu-20.04.4-desktop-amd64.iso.torrent"sv };
+
+    auto owned = std::vector<std::unique_ptr<tr_torrent>>{};
+    auto torrents = tr_torrents{};
+
+    for (auto const& name : Filenames)
+    {
+        auto const path = tr_pathbuf{ LIBTRANSMISSION_TEST_ASSETS_DIR, '/', name };
+        auto tm = tr_torrent_metainfo{};
+        EXPECT_TRUE(tm.parse_torrent_file(path));
+        owned.emplace_back(std::make_unique<tr_torrent>(std::move(tm)));
+
+        auto* const tor = owned.back().get();
+        tor->unique_id_ = torrents.add(tor);
+    }
+
+    auto* const a = owned[0].get();
+    auto* const b = owned[1].get();
+    auto* const c = owned[2].get();
+    auto* const d = owned[3].get();
+
+    // every torrent's position matches its place in the queue
+    auto const expect_queue = [&torrents](std::vector<tr_torrent*> const& expected)
+    {
+        EXPECT_EQ(expected, torrents.queue());
+        for (size_t i = 0; i < std::size(expected); ++i)
+        {
+            EXPECT_EQ(i, expected[i]->queuePosition);
+        }
+    };
+
+    // new torrents go to the bottom
+    expect_queue({ a, b, c, d });
+
+    torrents.set_queue_position(d, 1U);
+    expect_queue({ a, d, b, c });
+
+    torrents.set_queue_position(a, 100U);
+    expect_queue({ d, b, c, a });
+
+    // batch moves keep the moved torrents' order
+    auto moved = std::array<tr_torrent*, 2>{ a, b };
+    torrents.move_to_queue_top(std::data(moved), std::size(moved));
+    expect_queue({ b, a, d, c });
+
+    moved = { b, d };
+    torrents.move_to_queue_bottom(std::data(moved), std::size(moved));
+    expect_queue({ a, c, b, d });
+
+    // the torrents behind a removed one move up
+    torrents.remove(c, time(nullptr));
+    expect_queue({ a, b, d });
+}
+
+TEST_F(TorrentsTest, queueMoveUpDown)
+{
+    auto constexpr Filenames = std::array<std::string_view, 4>{ "Android-x86 8.1 r6 iso.torrent"sv,
+                                                                "debian-11.2.0-amd64-DVD-1.iso.torrent"sv,
+                                                                "ubuntu-18.04.6-desktop-amd64.iso.torrent"sv,
+                                                                "ubuntu-20.04.4-desktop-amd64.iso.torrent"sv };
+
+    auto owned = std::vector<std::unique_ptr<tr_torrent>>{};
+    auto torrents = tr_torrents{};
+
+    for (auto const& name : Filenames)
+    {
+        auto const path = tr_pathbuf{ LIBTRANSMISSION_TEST_ASSETS_DIR, '/', name };
+        auto tm = tr_torrent_metainfo{};
+        EXPECT_TRUE(tm.parse_torrent_file(path));
+        owned.emplace_back(std::make_unique<tr_torrent>(std::move(tm)));
+
+        auto* const tor = owned.back().get();
+        tor->unique_id_ = torrents.add(tor);
+    }
+
+    auto* const a = owned[0].get();
+    auto* const b = owned[1].get();
+    auto* const c = owned[2].get();
+    auto* const d = owned[3].get();
+
+    // every torrent's position matches its place in the queue
+    auto const expect_queue = [&torrents](std::vector<tr_torrent*> const& expected)
+    {
+        EXPECT_EQ(expected, torrents.queue());
+        for (size_t i = 0; i < std::size(expected); ++i)
+        {
+            EXPECT_EQ(i, expected[i]->queuePosition);
+        }
+    };
+
+    expect_queue({ a, b, c, d });
+
+    // moving up or down one place swaps with the neighbour
+    auto moved = std::array<tr_torrent*, 2>{ c, d };
+    torrents.move_queue_up(std::data(moved), std::size(moved));
+    expect_queue({ a, c, d, b });
+
+    moved = { a, c };
+    torrents.move_queue_down(std::data(moved), std::size(moved));
+    expect_queue({ d, a, c, b });
+
+    // the torrent already at the top or bottom stays put
+    moved = { d, c };
+    torrents.move_queue_up(std::data(moved), std::size(moved));
+    expect_queue({ d, c, a, b });
+
+    moved = { b, c };
+    torrents.move_queue_down(std::data(moved), std::size(moved));
+    expect_queue({ d, a, c, b });
+}
+
 using TorrentsPieceSpanTest = libtransmission::test::SessionTest;
 
 TEST_F(TorrentsPieceSpanTest, exposesFilePieceSpan)
@@ -4,6 +4,7 @@
 // License text can be found in the licenses/ folder.
 
 #include <array>
+#include <memory>
 #include <optional>
 #include <tuple>
 #include <utility>
@@ -71,3 +72,63 @@ TEST_F(PeerInfoTest, mergeConnectable)
         EXPECT_EQ(info_this.is_connectable(), result);
     }
 }
+
+TEST_F(PeerInfoTest, reconnectAtMatchesReconnectInterval)
+{
+    auto constexpr Now = time_t{ 1000000 };
+
+    auto info = tr_peer_info{ tr_socket_address{ tr_address{}, tr_port::fromHost(51413) }, 0, TR_PEER_FROM_PEX };
+    info.set_connection_attempt_time(Now);
+    info.on_connection_failed();
+    info.on_connection_failed();
+
+    auto const reconnect_at = info.reconnect_at(Now);
+    EXPECT_GT(reconnect_at, Now);
+    EXPECT_FALSE(info.reconnect_interval_has_passed(reconnect_at - 1));
+    EXPECT_TRUE(info.reconnect_interval_has_passed(reconnect_at));
+}
+
+TEST_F(PeerInfoTest, addressesAreSharedBetweenSwarms)
+{
+    auto const socket_address = tr_socket_address{ *tr_address::from_string("192.0.2.7"), tr_port::fromHost(51413) };
+    auto const n_addresses = tr_peer_addresses::size();
+
+    auto info_a = std::make_unique<tr_peer_info>(socket_address, 0, TR_PEER_FROM_PEX);
+    auto info_b = std::make_unique<tr_peer_info>(socket_address, 0, TR_PEER_FROM_DHT);
+    EXPECT_EQ(n_addresses + 1U, tr_peer_addresses::size());
+
+    // facts about the peer itself are shared
+    EXPECT_FALSE(info_b->supports_utp());
+    info_a->set_utp_supported(false);
+    ASSERT_TRUE(info_b->supports_utp());
+    EXPECT_FALSE(*info_b->supports_utp());
+
+    // facts about the peer in a swarm are not
+    info_a->set_connection_attempt_time(1000);
+    EXPECT_EQ(0, info_b->connection_attempt_time());
+
+    // a new listening port gets its own entry
+    info_b->set_listen_port(tr_port::fromHost(6881));
+    EXPECT_EQ(n_addresses + 2U, tr_peer_addresses::size());
+    EXPECT_EQ(socket_address, info_a->listen_socket_address());
+    EXPECT_EQ(tr_port::fromHost(6881), info_b->listen_port());
+
+    info_a.reset();
+    info_b.reset();
+    EXPECT_EQ(n_addresses, tr_peer_addresses::size());
+}
+
+TEST_F(PeerInfoTest, lastHeardAt)
+{
+    auto const found_at = tr_time();
+
+    auto info = tr_peer_info{ tr_socket_address{ tr_address{}, tr_port::fromHost(51413) }, 0, TR_PEER_FROM_TRACKER };
+    EXPECT_EQ(found_at, info.last_heard_at());
+
+    // being connected to counts as hearing from the peer
+    info.set_connected(found_at + 100, false);
+    EXPECT_EQ(found_at + 100, info.last_heard_at());
+
+    info.set_latest_piece_data_time(found_at + 200);
+    EXPECT_EQ(found_at + 200, info.last_heard_at());
+}
@@ -0,0 +1,75 @@
+// This file Copyright (C) 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <chrono>
+#include <cstddef> // size_t
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include <libtransmission/tracing.h>
+
+#include "gtest/gtest.h"
+
+using namespace std::literals;
+
+namespace
+{
+[[nodiscard]] size_t count(std::string_view haystack, std::string_view needle)
+{
+    auto n = size_t{};
+    for (auto pos = haystack.find(needle); pos != std::string_view::npos; pos = haystack.find(needle, pos + 1U))
+    {
+        ++n;
+    }
+
+    return n;
+}
+} // namespace
+
+TEST(Tracing, writesSpansAndCounters)
+{
+    auto const begin = tr_trace::Clock::now();
+    tr_trace::add_span("test", "writesSpansAndCounters-span", begin, begin + 1500us);
+    tr_trace::add_counter("test", "writesSpansAndCounters-counter", 42);
+    {
+        auto const span = tr_trace::Span{ "test", "writesSpansAndCounters-scope" };
+    }
+
+    auto out = std::string{};
+    tr_trace::write_json(out);
+
+    EXPECT_EQ(R"({"displayTimeUnit":"ms","traceEvents":[)"sv, std::string_view{ out }.substr(0, 39)) << out;
+    EXPECT_EQ("]}"sv, std::string_view{ out }.substr(std::size(out) - 2U)) << out;
+    EXPECT_NE(std::string::npos, out.find(R"("ph":"X")"sv)) << out;
+    EXPECT_NE(std::string::npos, out.find(R"("name":"writesSpansAndCounters-span",)"sv)) << out;
+    EXPECT_NE(std::string::npos, out.find(R"("dur":1500})"sv)) << out;
+    EXPECT_NE(std::string::npos, out.find(R"("name":"writesSpansAndCounters-scope",)"sv)) << out;
+    EXPECT_NE(
+        std::string::npos,
+        out.find(R"("cat":"test","name":"writesSpansAndCounters-counter",)"sv))
+        << out;
+    EXPECT_NE(std::string::npos, out.find(R"("args":{"value":42}})"sv)) << out;
+}
+
+TEST(Tracing, keepsOnlyTheNewestEventsPerThread)
+{
+    // use a new thread so that other tests' events don't count
+    auto thread = std::thread{ []()
+                               {
+                                   for (size_t i = 0; i < tr_trace::EventsPerThread + 10U; ++i)
+                                   {
+                                       tr_trace::add_counter("test", "keepsOnlyTheNewestEventsPerThread", 1);
+                                   }
+                                   tr_trace::add_counter("test", "keepsOnlyTheNewestEventsPerThread", 2);
+                               } };
+    thread.join();
+
+    auto out = std::string{};
+    tr_trace::write_json(out);
+
+    EXPECT_EQ(tr_trace::EventsPerThread, count(out, R"("name":"keepsOnlyTheNewestEventsPerThread")"sv));
+    EXPECT_EQ(1U, count(out, R"("name":"keepsOnlyTheNewestEventsPerThread","ts":)"sv) - count(out, R"({"value":1})"sv));
+}
@@ -13,6 +13,7 @@
 #include <cstdint> // int64_t
 #include <string>
 #include <string_view>
+#include <vector>
 
 #define LIBTRANSMISSION_VARIANT_MODULE
 
@@ -545,6 +546,72 @@ TEST_F(VariantTest, dictFindType)
     tr_variantClear(&top);
 }
 
+TEST_F(VariantTest, bigDictFind)
+{
+    // enough keys that the dict gets an index
+    auto constexpr NumKeys = size_t{ 200U };
+    auto keys = std::vector<tr_quark>{};
+    for (size_t i = 0; i < NumKeys; ++i)
+    {
+        keys.push_back(tr_quark_new("big-dict-key-" + std::to_string(i)));
+    }
+
+    auto const dict_size = [](tr_variant* dict)
+    {
+        auto n = size_t{};
+        auto key = tr_quark{};
+        tr_variant* child = nullptr;
+        while (tr_variantDictChild(dict, n, &key, &child))
+        {
+            ++n;
+        }
+        return n;
+    };
+
+    auto arena = tr_variant_arena{};
+    for (auto* const arena_ptr : { static_cast<tr_variant_arena*>(nullptr), &arena })
+    {
+        auto top = tr_variant{};
+        tr_variantInitDict(&top, 0, arena_ptr);
+        for (size_t i = 0; i < NumKeys; ++i)
+        {
+            tr_variantDictAddInt(&top, keys[i], static_cast<int64_t>(i));
+        }
+        EXPECT_EQ(NumKeys, dict_size(&top));
+
+        auto val = int64_t{};
+        for (size_t i = 0; i < NumKeys; ++i)
+        {
+            EXPECT_TRUE(tr_variantDictFindInt(&top, keys[i], &val));
+            EXPECT_EQ(static_cast<int64_t>(i), val);
+        }
+        EXPECT_EQ(nullptr, tr_variantDictFind(&top, tr_quark_new("big-dict-missing-key"sv)));
+
+        // adding an existing key replaces it instead of adding a duplicate
+        tr_variantDictAddInt(&top, keys[7], 700);
+        EXPECT_EQ(NumKeys, dict_size(&top));
+        EXPECT_TRUE(tr_variantDictFindInt(&top, keys[7], &val));
+        EXPECT_EQ(700, val);
+
+        // removing keys moves other entries around; they should still be found
+        for (size_t i = 0; i < NumKeys; i += 2U)
+        {
+            EXPECT_TRUE(tr_variantDictRemove(&top, keys[i]));
+        }
+        EXPECT_EQ(NumKeys / 2U, dict_size(&top));
+        for (size_t i = 0; i < NumKeys; ++i)
+        {
+            EXPECT_EQ(i % 2U != 0U, tr_variantDictFindInt(&top, keys[i], &val));
+            if (i % 2U != 0U)
+            {
+                EXPECT_EQ(i == 7U ? 700 : static_cast<int64_t>(i), val);
+            }
+        }
+
+        tr_variantClear(&top);
+    }
+}
+
 TEST_F(VariantTest, variantFromBufFuzz)
 {
     auto buf = std::vector<char>{};
@@ -568,3 +635,118 @@ TEST_F(VariantTest, variantFromBufFuzz)
         }
     }
 }
+
+TEST_F(VariantTest, arena)
+{
+    auto const long_str = std::string(100U, 'x');
+
+    auto arena = tr_variant_arena{};
+    auto top = tr_variant{};
+    tr_variantInitDict(&top, 0, &arena);
+    auto* const list = tr_variantDictAddList(&top, TR_KEY_files, 0);
+    for (int64_t i = 0; i < 1000; ++i)
+    {
+        auto* const child = tr_variantListAddDict(list, 2);
+        tr_variantDictAddInt(child, TR_KEY_length, i);
+        tr_variantDictAddStr(child, TR_KEY_name, long_str);
+    }
+    EXPECT_EQ(1000U, tr_variantListSize(list));
+
+    // everything added went into the arena
+    auto const n_used = arena.bytes_used();
+    EXPECT_GT(n_used, 1000U * std::size(long_str));
+
+    // ...and behaves the same as heap-allocated variants do
+    auto i = int64_t{};
+    auto sv = std::string_view{};
+    auto* const child = tr_variantListChild(list, 999);
+    EXPECT_TRUE(tr_variantDictFindInt(child, TR_KEY_length, &i));
+    EXPECT_EQ(999, i);
+    EXPECT_TRUE(tr_variantDictFindStrView(child, TR_KEY_name, &sv));
+    EXPECT_EQ(long_str, sv);
+    EXPECT_EQ('\0', std::data(sv)[std::size(sv)]);
+
+    auto const benc = tr_variantToStr(&top, TR_VARIANT_FMT_BENC);
+    tr_variantClear(&top);
+    EXPECT_EQ(n_used, arena.bytes_used());
+
+    // parse into an arena
+    EXPECT_TRUE(tr_variantFromBuf(&top, TR_VARIANT_PARSE_BENC, benc, nullptr, nullptr, &arena));
+    EXPECT_GT(arena.bytes_used(), n_used);
+    EXPECT_EQ(benc, tr_variantToStr(&top, TR_VARIANT_FMT_BENC));
+    auto const json = tr_variantToStr(&top, TR_VARIANT_FMT_JSON);
+    tr_variantClear(&top);
+
+    EXPECT_TRUE(tr_variantFromBuf(&top, TR_VARIANT_PARSE_JSON, json, nullptr, nullptr, &arena));
+    EXPECT_EQ(benc, tr_variantToStr(&top, TR_VARIANT_FMT_BENC));
+    tr_variantClear(&top);
+}
+
+TEST_F(VariantTest, arenaWithHeapChildren)
+{
+    auto arena = tr_variant_arena{};
+    auto top = tr_variant{};
+    tr_variantInitList(&top, 0, &arena);
+
+    // children initialized without the arena are still freed by tr_variantClear()
+    tr_variantInitStr(tr_variantListAdd(&top), std::string(100U, 'x'));
+    auto* const heap_list = tr_variantListAdd(&top);
+    tr_variantInitList(heap_list, 1);
+    tr_variantListAddStr(heap_list, std::string(100U, 'y'));
+
+    auto heap_dict = tr_variant{};
+    tr_variantInitDict(&heap_dict, 1);
+    tr_variantDictAddStr(&heap_dict, TR_KEY_name, std::string(100U, 'z'));
+    auto* const dict = tr_variantListAddDict(&top, 1);
+    tr_variantDictSteal(dict, TR_KEY_info, &heap_dict);
+
+    EXPECT_EQ(3U, tr_variantListSize(&top));
+    tr_variantClear(&top);
+    EXPECT_TRUE(tr_variantIsEmpty(&top));
+}
+
+TEST_F(VariantTest, sinkMatchesStr)
+{
+    // big enough to be handed to the sink in several chunks
+    auto top = tr_variant{};
+    tr_variantInitList(&top, 0);
+    for (int i = 0; i < 2000; ++i)
+    {
+        auto* const dict = tr_variantListAddDict(&top, 3U);
+        tr_variantDictAddInt(dict, TR_KEY_id, i);
+        tr_variantDictAddStr(dict, TR_KEY_name, std::string(static_cast<size_t>(i % 64), 'x'));
+        tr_variantDictAddBool(dict, TR_KEY_paused, (i % 2) == 0);
+    }
+
+    for (auto const fmt : { TR_VARIANT_FMT_BENC, TR_VARIANT_FMT_JSON, TR_VARIANT_FMT_JSON_LEAN })
+    {
+        auto chunks = std::vector<std::string>{};
+        auto const sink = [&chunks](std::string_view chunk)
+        {
+            chunks.emplace_back(chunk);
+            return true;
+        };
+        EXPECT_TRUE(tr_variantToSink(&top, fmt, sink));
+        EXPECT_LT(1U, std::size(chunks));
+
+        auto joined = std::string{};
+        for (auto const& chunk : chunks)
+        {
+            EXPECT_GE(1024U * 8U, std::size(chunk));
+            joined += chunk;
+        }
+        EXPECT_EQ(tr_variantToStr(&top, fmt), joined);
+    }
+
+    // a failed sink isn't called again
+    auto n_calls = size_t{};
+    auto const failing_sink = [&n_calls](std::string_view /*chunk*/)
+    {
+        ++n_calls;
+        return false;
+    };
+    EXPECT_FALSE(tr_variantToSink(&top, TR_VARIANT_FMT_BENC, failing_sink));
+    EXPECT_EQ(1U, n_calls);
+
+    tr_variantClear(&top);
+}
@@ -0,0 +1,103 @@
+// This file Copyright (C) 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <cstddef> // size_t
+#include <string>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/torrent.h>
+#include <libtransmission/variant.h>
+#include <libtransmission/verify-manifest.h>
+
+#include "gtest/gtest.h"
+#include "test-fixtures.h"
+
+namespace libtransmission::test
+{
+
+using VerifyManifestTest = SessionTest;
+
+TEST_F(VerifyManifestTest, exportsVerifiedFiles)
+{
+    auto* const tor = zeroTorrentInit(ZeroTorrentState::Complete);
+    ASSERT_NE(nullptr, tor);
+
+    auto const manifest = tr_verify_manifest::from_torrent(tor);
+    EXPECT_EQ(tor->info_hash_string(), manifest.info_hash_string);
+    ASSERT_EQ(tor->file_count(), std::size(manifest.files));
+    for (tr_file_index_t i = 0, n = tor->file_count(); i < n; ++i)
+    {
+        EXPECT_EQ(tor->file_subpath(i), manifest.files[i].subpath);
+        EXPECT_EQ(tor->file_size(i), manifest.files[i].size);
+        EXPECT_LT(0, manifest.files[i].mtime);
+    }
+
+    // round-trip it through a variant
+    auto var = tr_variant{};
+    manifest.to_variant(&var);
+    auto const parsed = tr_verify_manifest::from_variant(&var);
+    tr_variantClear(&var);
+    ASSERT_TRUE(parsed);
+    EXPECT_EQ(manifest.info_hash_string, parsed->info_hash_string);
+    ASSERT_EQ(std::size(manifest.files), std::size(parsed->files));
+    for (size_t i = 0, n = std::size(manifest.files); i < n; ++i)
+    {
+        EXPECT_EQ(manifest.files[i].subpath, parsed->files[i].subpath);
+        EXPECT_EQ(manifest.files[i].size, parsed->files[i].size);
+        EXPECT_EQ(manifest.files[i].mtime, parsed->files[i].mtime);
+    }
+
+    // cleanup
+    tr_torrentRemove(tor, false, nullptr, nullptr);
+}
+
+TEST_F(VerifyManifestTest, rejectsMalformedManifests)
+{
+    EXPECT_FALSE(tr_verify_manifest::from_variant(nullptr));
+
+    auto var = tr_variant{};
+    tr_variantInitDict(&var, 1U);
+    tr_variantDictAddStr(&var, TR_KEY_hashString, "0000000000000000000000000000000000000000");
+    EXPECT_FALSE(tr_verify_manifest::from_variant(&var));
+
+    // a file without an mtime
+    auto* const files = tr_variantDictAddList(&var, TR_KEY_files, 1U);
+    auto* const file = tr_variantListAddDict(files, 2U);
+    tr_variantDictAddStr(file, TR_KEY_name, "files-filled-with-zeroes/512");
+    tr_variantDictAddInt(file, TR_KEY_length, 512);
+    EXPECT_FALSE(tr_verify_manifest::from_variant(&var));
+
+    tr_variantDictAddInt(file, TR_KEY_mtime, 1);
+    EXPECT_TRUE(tr_verify_manifest::from_variant(&var));
+
+    tr_variantClear(&var);
+}
+
+TEST_F(VerifyManifestTest, trustsOnlyMatchingFiles)
+{
+    auto* const tor = zeroTorrentInit(ZeroTorrentState::Complete);
+    ASSERT_NE(nullptr, tor);
+
+    auto const manifest = tr_verify_manifest::from_torrent(tor);
+    EXPECT_EQ(tor->piece_count(), manifest.apply(tor));
+
+    // the last piece is the only one that doesn't touch the first file
+    auto changed = manifest;
+    ++changed.files[0].mtime;
+    EXPECT_EQ(1U, changed.apply(tor));
+    EXPECT_FALSE(tor->is_piece_checked(0));
+    EXPECT_TRUE(tor->is_piece_checked(tor->piece_count() - 1U));
+
+    // a manifest for another torrent is ignored
+    auto other = manifest;
+    other.info_hash_string = std::string(std::size(manifest.info_hash_string), '0');
+    EXPECT_EQ(0U, other.apply(tor));
+
+    // cleanup
+    tr_torrentRemove(tor, false, nullptr, nullptr);
+}
+
+} // namespace libtransmission::test
@@ -0,0 +1,280 @@
+// This file Copyright (C) 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <array>
+#include <cstddef> // size_t
+#include <cstdint> // uint8_t, uint32_t
+#include <string_view>
+#include <vector>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/crypto-utils.h>
+#include <libtransmission/file.h>
+#include <libtransmission/inout.h>
+#include <libtransmission/makemeta.h>
+#include <libtransmission/quark.h>
+#include <libtransmission/torrent.h>
+#include <libtransmission/tr-strbuf.h>
+#include <libtransmission/utils.h>
+#include <libtransmission/variant.h>
+
+#include "gtest/gtest.h"
+#include "test-fixtures.h"
+
+using namespace std::literals;
+
+namespace libtransmission::test
+{
+
+class VerifyTest
+    : public SessionTest
+    , public ::testing::WithParamInterface<size_t>
+{
+protected:
+    void SetUp() override
+    {
+        tr_variantDictAddInt(settings(), TR_KEY_verify_threads, GetParam());
+
+        SessionTest::SetUp();
+    }
+};
+
+TEST_P(VerifyTest, completeTorrent)
+{
+    auto* const tor = zeroTorrentInit(ZeroTorrentState::Complete);
+    blockingTorrentVerify(tor);
+
+    EXPECT_EQ(0U, tr_torrentStat(tor)->leftUntilDone);
+    EXPECT_TRUE(tor->is_done());
+    for (tr_piece_index_t piece = 0, n = tor->piece_count(); piece < n; ++piece)
+    {
+        EXPECT_TRUE(tor->has_piece(piece));
+        EXPECT_TRUE(tor->is_piece_checked(piece));
+    }
+
+    tr_torrentRemove(tor, false, nullptr, nullptr);
+}
+
+TEST_P(VerifyTest, countsUsage)
+{
+    auto* const tor = zeroTorrentInit(ZeroTorrentState::Complete);
+    auto const& usage = tor->usage();
+    auto const disk_reads = usage.get(tr_torrent_usage::DiskReads);
+    auto const disk_read_bytes = usage.get(tr_torrent_usage::DiskReadBytes);
+    auto const hash_usec = usage.get(tr_torrent_usage::HashUsec);
+
+    blockingTorrentVerify(tor);
+
+    // every byte of every piece is read and hashed
+    EXPECT_GE(usage.get(tr_torrent_usage::DiskReads) - disk_reads, tor->file_count());
+    EXPECT_EQ(tor->total_size(), usage.get(tr_torrent_usage::DiskReadBytes) - disk_read_bytes);
+    EXPECT_GT(usage.get(tr_torrent_usage::HashUsec), hash_usec);
+    EXPECT_EQ(0U, usage.get(tr_torrent_usage::CacheReads));
+
+    tr_torrentRemove(tor, false, nullptr, nullptr);
+}
+
+TEST_P(VerifyTest, partialTorrent)
+{
+    // the test zero_torrent will be missing its first piece.
+    auto* const tor = zeroTorrentInit(ZeroTorrentState::Partial);
+    blockingTorrentVerify(tor);
+
+    EXPECT_EQ(tor->piece_size(), tr_torrentStat(tor)->leftUntilDone);
+    EXPECT_FALSE(tor->has_piece(0));
+    for (tr_piece_index_t piece = 0, n = tor->piece_count(); piece < n; ++piece)
+    {
+        EXPECT_EQ(piece != 0, tor->has_piece(piece));
+        EXPECT_TRUE(tor->is_piece_checked(piece));
+    }
+
+    tr_torrentRemove(tor, false, nullptr, nullptr);
+}
+
+TEST_P(VerifyTest, missingFiles)
+{
+    auto* const tor = zeroTorrentInit(ZeroTorrentState::NoFiles);
+    blockingTorrentVerify(tor);
+
+    EXPECT_EQ(tor->total_size(), tr_torrentStat(tor)->leftUntilDone);
+    EXPECT_TRUE(tor->has_none());
+
+    tr_torrentRemove(tor, false, nullptr, nullptr);
+}
+
+TEST_P(VerifyTest, quickTrustsCheckedPieces)
+{
+    auto* const tor = zeroTorrentInit(ZeroTorrentState::Complete);
+    blockingTorrentVerify(tor);
+    EXPECT_TRUE(tor->is_done());
+
+    // the files haven't changed since they were checked,
+    // so a quick verify doesn't notice that a piece is gone
+    tor->set_has_piece(0, false);
+    blockingTorrentVerify(tor, true);
+    EXPECT_FALSE(tor->has_piece(0));
+    EXPECT_TRUE(tor->is_piece_checked(0));
+
+    // but a full verify does
+    blockingTorrentVerify(tor);
+    EXPECT_TRUE(tor->has_piece(0));
+
+    tr_torrentRemove(tor, false, nullptr, nullptr);
+}
+
+TEST_P(VerifyTest, quickChecksTruncatedFiles)
+{
+    auto* const tor = zeroTorrentInit(ZeroTorrentState::Complete);
+    blockingTorrentVerify(tor);
+    EXPECT_TRUE(tor->is_done());
+
+    // truncate the last file to half its size
+    auto const file_index = tr_file_index_t(tor->file_count() - 1U);
+    auto const found = tor->find_file(file_index);
+    ASSERT_TRUE(found);
+    auto const fd = tr_sys_file_open(found->filename(), TR_SYS_FILE_WRITE, 0);
+    ASSERT_NE(TR_BAD_SYS_FILE, fd);
+    EXPECT_TRUE(tr_sys_file_truncate(fd, tor->file_size(file_index) / 2U));
+    tr_sys_file_close(fd);
+
+    blockingTorrentVerify(tor, true);
+    EXPECT_FALSE(tor->is_done());
+    auto const [begin, end] = tor->pieces_in_file(file_index);
+    EXPECT_FALSE(tor->has_piece(end - 1U));
+    for (tr_piece_index_t piece = 0; piece < begin; ++piece)
+    {
+        EXPECT_TRUE(tor->has_piece(piece));
+    }
+
+    tr_torrentRemove(tor, false, nullptr, nullptr);
+}
+
+TEST_P(VerifyTest, backgroundKeepsRunning)
+{
+    auto* const tor = zeroTorrentInit(ZeroTorrentState::Complete);
+    blockingTorrentVerify(tor);
+    EXPECT_TRUE(tor->is_done());
+
+    tr_torrentStart(tor);
+    EXPECT_TRUE(waitFor([tor]() { return tor->is_running(); }, 5000));
+
+    // truncate the last file to half its size
+    auto const file_index = tr_file_index_t(tor->file_count() - 1U);
+    auto const found = tor->find_file(file_index);
+    ASSERT_TRUE(found);
+    auto const fd = tr_sys_file_open(found->filename(), TR_SYS_FILE_WRITE, 0);
+    ASSERT_NE(TR_BAD_SYS_FILE, fd);
+    EXPECT_TRUE(tr_sys_file_truncate(fd, tor->file_size(file_index) / 2U));
+    tr_sys_file_close(fd);
+
+    // the torrent is never stopped, and the lost piece is noticed
+    blockingTorrentVerify(tor, true, true);
+    EXPECT_TRUE(tor->is_running());
+    auto const [begin, end] = tor->pieces_in_file(file_index);
+    EXPECT_TRUE(waitFor([tor, piece = end - 1U]() { return !tor->has_piece(piece); }, 5000));
+    EXPECT_TRUE(tor->is_piece_checked(end - 1U));
+    for (tr_piece_index_t piece = 0; piece < begin; ++piece)
+    {
+        EXPECT_TRUE(tor->has_piece(piece));
+    }
+    EXPECT_EQ(TR_STATUS_DOWNLOAD, tor->activity());
+
+    tr_torrentRemove(tor, false, nullptr, nullptr);
+}
+
+TEST_P(VerifyTest, resumesFromCheckpoint)
+{
+    auto* const tor = zeroTorrentInit(ZeroTorrentState::Complete);
+    blockingTorrentVerify(tor);
+    EXPECT_TRUE(tor->is_done());
+    EXPECT_FALSE(tor->verify_checkpoint_);
+
+    // truncate the first file to half its size
+    auto const found = tor->find_file(0U);
+    ASSERT_TRUE(found);
+    auto const fd = tr_sys_file_open(found->filename(), TR_SYS_FILE_WRITE, 0);
+    ASSERT_NE(TR_BAD_SYS_FILE, fd);
+    EXPECT_TRUE(tr_sys_file_truncate(fd, tor->file_size(0U) / 2U));
+    tr_sys_file_close(fd);
+
+    // pretend a verify was paused after the first file's pieces
+    auto const [begin, end] = tor->pieces_in_file(0U);
+    ASSERT_LT(end, tor->piece_count());
+    tor->verify_checkpoint_ = tr_torrent::VerifyCheckpoint{ end, false, true };
+
+    // the pieces before the checkpoint aren't hashed again
+    tr_torrentVerifyResume(tor);
+    EXPECT_TRUE(waitFor([tor]() { return !tor->verify_checkpoint_ && tor->verify_state() == TR_VERIFY_NONE; }, 5000));
+    for (tr_piece_index_t piece = 0, n = tor->piece_count(); piece < n; ++piece)
+    {
+        EXPECT_TRUE(tor->has_piece(piece));
+    }
+
+    tr_torrentRemove(tor, false, nullptr, nullptr);
+}
+
+TEST_P(VerifyTest, padFiles)
+{
+    static auto constexpr PieceSize = uint32_t{ 16384U };
+    static auto constexpr Names = std::array<std::string_view, 2>{ "a"sv, "b"sv };
+    static auto constexpr Sizes = std::array<size_t, 2>{ PieceSize + 3616U, 5000U };
+
+    // a v1 torrent whose first file is padded out to the end of its last piece
+    auto const top = tr_pathbuf{ sandboxDir(), "/padded"sv };
+    tr_sys_dir_create(top, TR_SYS_DIR_CREATE_PARENTS, 0700);
+    auto contents = std::vector<std::vector<uint8_t>>{};
+    for (size_t i = 0; i < std::size(Names); ++i)
+    {
+        auto& buf = contents.emplace_back(Sizes[i]);
+        tr_rand_buffer(std::data(buf), std::size(buf));
+        auto const sv = std::string_view{ reinterpret_cast<char const*>(std::data(buf)), std::size(buf) };
+        EXPECT_TRUE(tr_file_save(tr_pathbuf{ top, '/', Names[i] }, sv));
+    }
+
+    auto builder = tr_metainfo_builder{ top };
+    builder.set_piece_size(PieceSize);
+    builder.set_pad_files(true);
+    EXPECT_EQ(nullptr, builder.make_checksums().get());
+    auto const benc = builder.benc();
+
+    auto* const ctor = tr_ctorNew(session_);
+    EXPECT_TRUE(tr_ctorSetMetainfo(ctor, std::data(benc), std::size(benc), nullptr));
+    tr_ctorSetDownloadDir(ctor, TR_FORCE, sandboxDir().c_str());
+    tr_ctorSetPaused(ctor, TR_FORCE, true);
+    auto* const tor = createTorrentAndWaitForVerifyDone(ctor);
+    tr_ctorFree(ctor);
+    ASSERT_NE(nullptr, tor);
+    ASSERT_EQ(3U, tor->file_count());
+    ASSERT_TRUE(tor->file_is_padding(1U));
+
+    // the pad file isn't on disk, but its piece is still verified
+    blockingTorrentVerify(tor);
+    EXPECT_TRUE(tor->is_done());
+    EXPECT_FALSE(tor->find_file(1U));
+    EXPECT_TRUE(tor->find_file(0U));
+    EXPECT_TRUE(tor->find_file(2U));
+
+    // the second piece is the end of the first file, then the pad file's zeroes
+    auto buf = std::vector<uint8_t>(PieceSize);
+    EXPECT_EQ(0, tr_ioRead(tor, tor->piece_loc(1U), std::size(buf), std::data(buf)));
+    auto expected = std::vector<uint8_t>(PieceSize);
+    std::copy(std::begin(contents[0]) + PieceSize, std::end(contents[0]), std::begin(expected));
+    EXPECT_EQ(expected, buf);
+
+    tr_torrentRemove(tor, false, nullptr, nullptr);
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    Verify,
+    VerifyTest,
+    ::testing::Values(
+        // the classic one-torrent-at-a-time verify
+        size_t{ 1U },
+        // several threads hashing pieces of the same torrent
+        size_t{ 4U }));
+
+} // namespace libtransmission::test
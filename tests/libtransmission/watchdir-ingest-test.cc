@@ -0,0 +1,111 @@
+// This file Copyright (C) 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <chrono>
+#include <cstddef> // size_t
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <string_view>
+
+#include <event2/event.h>
+
+#include <fmt/core.h>
+
+#include <libtransmission/timer-ev.h>
+#include <libtransmission/tr-strbuf.h>
+#include <libtransmission/utils-ev.h>
+#include <libtransmission/watchdir.h>
+#include <libtransmission/watchdir-ingest.h>
+
+#include "gtest/gtest.h"
+#include "test-fixtures.h"
+
+using namespace std::literals;
+
+namespace libtransmission::test
+{
+
+class WatchdirIngestTest : public SandboxedTest
+{
+protected:
+    void SetUp() override
+    {
+        SandboxedTest::SetUp();
+        evbase_.reset(event_base_new());
+        timer_maker_ = std::make_unique<EvTimerMaker>(evbase_.get());
+    }
+
+    void TearDown() override
+    {
+        timer_maker_.reset();
+        evbase_.reset();
+        SandboxedTest::TearDown();
+    }
+
+    void createMagnetFile(std::string_view basename, size_t n) const
+    {
+        auto const magnet = fmt::format("magnet:?xt=urn:btih:{:040x}&dn=test-{:d}", n + 1U, n);
+        createFileWithContents(tr_pathbuf{ sandboxDir(), '/', basename }, magnet);
+    }
+
+    evhelpers::evbase_unique_ptr evbase_;
+    std::unique_ptr<TimerMaker> timer_maker_;
+};
+
+TEST_F(WatchdirIngestTest, parsesFilesInBatches)
+{
+    static auto constexpr NumFiles = size_t{ 300U };
+    static auto constexpr MaxParsed = size_t{ 8U };
+
+    auto const dirname = sandboxDir();
+    auto added = std::set<std::string>{};
+    auto finished = std::map<std::string, Watchdir::Action>{};
+
+    auto ingest = WatchdirIngest{
+        *timer_maker_,
+        [&added](WatchdirIngest::Item& item)
+        {
+            EXPECT_TRUE(item.is_magnet);
+            EXPECT_TRUE(std::empty(item.contents));
+            EXPECT_FALSE(std::empty(item.metainfo.info_hash_string()));
+            added.emplace(item.basename);
+            return Watchdir::Action::Done;
+        },
+        [&finished](std::string_view basename, Watchdir::Action action)
+        { finished.try_emplace(std::string{ basename }, action); },
+        3U,
+        MaxParsed
+    };
+
+    for (size_t i = 0; i < NumFiles; ++i)
+    {
+        auto const basename = fmt::format("{:d}.magnet", i);
+        createMagnetFile(basename, i);
+        EXPECT_EQ(Watchdir::Action::Pending, ingest.enqueue(dirname, basename));
+    }
+
+    // files that can't be parsed yet are retried
+    createFileWithContents(tr_pathbuf{ dirname, "/bogus.magnet"sv }, "not a magnet link"sv);
+    EXPECT_EQ(Watchdir::Action::Pending, ingest.enqueue(dirname, "bogus.magnet"sv));
+
+    // files that aren't torrents are ignored
+    EXPECT_EQ(Watchdir::Action::Done, ingest.enqueue(dirname, "readme.txt"sv));
+
+    // nothing's handed back until the event loop runs
+    EXPECT_EQ(NumFiles + 1U, ingest.size());
+
+    // the workers only keep `MaxParsed` files at a time, so this
+    // also checks that draining them lets the workers continue
+    EXPECT_TRUE(waitFor(evbase_.get(), [&finished]() { return std::size(finished) == NumFiles + 1U; }, 20s));
+    EXPECT_EQ(0U, ingest.size());
+    EXPECT_EQ(NumFiles, std::size(added));
+    EXPECT_EQ(Watchdir::Action::Retry, finished["bogus.magnet"]);
+    EXPECT_EQ(Watchdir::Action::Done, finished["0.magnet"]);
+    EXPECT_EQ(0U, added.count("bogus.magnet"));
+}
+
+} // namespace libtransmission::test
@@ -0,0 +1,992 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+// Downloads a synthetic torrent from thousands of simulated seeds in the
+// same process, to see how the peer manager, the wishlist, the active
+// requests table, choking and bandwidth allocation hold up at scale
+// without needing a live swarm.
+//
+// Each simulated peer is one end of a socketpair whose other end is handed
+// to the session as an incoming connection, so everything from the
+// handshake onwards runs through the real code. The peers speak plaintext
+// BitTorrent without extensions, unchoke right away, and serve each block
+// request after their latency has passed and within their upload rate.
+// The blocks are generated on the fly, so the torrent can be much larger
+// than memory and still pass its hash checks.
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstddef> // size_t, std::byte
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring> // std::memcpy()
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <optional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <sys/resource.h> // getrusage(), setrlimit()
+#include <sys/socket.h> // socketpair()
+#include <time.h> // clock_gettime()
+#include <unistd.h>
+
+#include <event2/event.h>
+
+#include <fmt/core.h>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/crypto-utils.h>
+#include <libtransmission/error.h>
+#include <libtransmission/file.h>
+#include <libtransmission/log.h>
+#include <libtransmission/net.h>
+#include <libtransmission/peer-socket.h>
+#include <libtransmission/quark.h>
+#include <libtransmission/session.h>
+#include <libtransmission/torrent.h>
+#include <libtransmission/tr-getopt.h>
+#include <libtransmission/utils-ev.h>
+#include <libtransmission/utils.h>
+#include <libtransmission/variant.h>
+
+using namespace std::literals;
+
+namespace
+{
+using Clock = std::chrono::steady_clock;
+
+struct Options
+{
+    size_t n_peers = 1000U;
+
+    // synthetic torrent shape
+    size_t n_pieces = 1024U;
+    uint32_t piece_size = 256U * 1024U;
+
+    // give up if the download isn't done by then
+    std::chrono::seconds duration = 60s;
+
+    // each peer's upload rate and round-trip latency are picked at random from these ranges
+    uint32_t min_rate_kibps = 64U;
+    uint32_t max_rate_kibps = 1024U;
+    std::chrono::milliseconds min_latency = 20ms;
+    std::chrono::milliseconds max_latency = 200ms;
+
+    // every `churn_interval`, replace `churn_percent` of the connected peers with new ones
+    std::chrono::seconds churn_interval = 0s;
+    size_t churn_percent = 10U;
+
+    size_t peer_io_threads = 0U;
+
+    // seed for the synthetic data and the peers' parameters, so that runs are repeatable
+    uint32_t seed = 1U;
+};
+
+char constexpr MyName[] = "transmission-swarm-sim";
+char constexpr Usage[] = "Usage: transmission-swarm-sim [options]";
+
+auto constexpr Opts = std::array<tr_option, 13>{
+    { { 'p', "peers", "Number of simulated peers", "p", true, "<count>" },
+      { 'n', "pieces", "Number of pieces in the synthetic torrent", "n", true, "<count>" },
+      { 's', "piece-size", "Piece size of the synthetic torrent, in KiB", "s", true, "<KiB>" },
+      { 'd', "duration", "Stop after this many seconds if the download isn't done", "d", true, "<seconds>" },
+      { 'r', "min-rate", "Slowest peer upload rate, in KiB/s", "r", true, "<KiB/s>" },
+      { 'R', "max-rate", "Fastest peer upload rate, in KiB/s", "R", true, "<KiB/s>" },
+      { 'l', "min-latency", "Shortest peer round-trip time, in milliseconds", "l", true, "<msec>" },
+      { 'L', "max-latency", "Longest peer round-trip time, in milliseconds", "L", true, "<msec>" },
+      { 'c', "churn-interval", "Replace some of the peers this often, in seconds; 0 for no churn", "c", true, "<seconds>" },
+      { 'C', "churn-percent", "Percentage of the connected peers to replace each time", "C", true, "<percent>" },
+      { 't', "peer-io-threads", "The session's peer-io-threads setting", "t", true, "<count>" },
+      { 'S', "seed", "Seed for the synthetic data and the peers' parameters", "S", true, "<seed>" },
+      { 0, nullptr, nullptr, nullptr, false, nullptr } }
+};
+
+bool parse_command_line(Options& opts, int argc, char const* const* argv)
+{
+    int c = 0;
+    char const* optarg = nullptr;
+
+    while ((c = tr_getopt(Usage, argc, argv, std::data(Opts), &optarg)) != TR_OPT_DONE)
+    {
+        switch (c)
+        {
+        case 'p':
+            opts.n_peers = std::max(size_t{ 1U }, tr_num_parse<size_t>(optarg).value_or(opts.n_peers));
+            break;
+
+        case 'n':
+            opts.n_pieces = std::max(size_t{ 1U }, tr_num_parse<size_t>(optarg).value_or(opts.n_pieces));
+            break;
+
+        case 's':
+            opts.piece_size = std::max(uint32_t{ 16U }, tr_num_parse<uint32_t>(optarg).value_or(opts.piece_size / 1024U)) *
+                1024U;
+            break;
+
+        case 'd':
+            opts.duration = std::chrono::seconds{ tr_num_parse<uint32_t>(optarg).value_or(60U) };
+            break;
+
+        case 'r':
+            opts.min_rate_kibps = std::max(uint32_t{ 1U }, tr_num_parse<uint32_t>(optarg).value_or(opts.min_rate_kibps));
+            break;
+
+        case 'R':
+            opts.max_rate_kibps = std::max(uint32_t{ 1U }, tr_num_parse<uint32_t>(optarg).value_or(opts.max_rate_kibps));
+            break;
+
+        case 'l':
+            opts.min_latency = std::chrono::milliseconds{ tr_num_parse<uint32_t>(optarg).value_or(0U) };
+            break;
+
+        case 'L':
+            opts.max_latency = std::chrono::milliseconds{ tr_num_parse<uint32_t>(optarg).value_or(0U) };
+            break;
+
+        case 'c':
+            opts.churn_interval = std::chrono::seconds{ tr_num_parse<uint32_t>(optarg).value_or(0U) };
+            break;
+
+        case 'C':
+            opts.churn_percent = std::min(size_t{ 100U }, tr_num_parse<size_t>(optarg).value_or(opts.churn_percent));
+            break;
+
+        case 't':
+            opts.peer_io_threads = tr_num_parse<size_t>(optarg).value_or(0U);
+            break;
+
+        case 'S':
+            opts.seed = tr_num_parse<uint32_t>(optarg).value_or(opts.seed);
+            break;
+
+        default:
+            return false;
+        }
+    }
+
+    opts.max_rate_kibps = std::max(opts.min_rate_kibps, opts.max_rate_kibps);
+    opts.max_latency = std::max(opts.min_latency, opts.max_latency);
+    return true;
+}
+
+// ---
+
+[[nodiscard]] constexpr uint64_t splitmix64(uint64_t x) noexcept
+{
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30U)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27U)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31U);
+}
+
+// The synthetic torrent's contents at `offset`, which is a multiple of 8
+void synthetic_bytes(uint32_t seed, uint64_t offset, std::byte* out, size_t n_bytes)
+{
+    auto const key = splitmix64(seed);
+    for (size_t i = 0U; i < n_bytes; i += sizeof(uint64_t))
+    {
+        auto const word = splitmix64(key ^ ((offset + i) / sizeof(uint64_t)));
+        std::memcpy(out + i, &word, std::min(sizeof(word), n_bytes - i));
+    }
+}
+
+[[nodiscard]] std::string make_metainfo(Options const& opts)
+{
+    auto pieces = std::string{};
+    pieces.reserve(opts.n_pieces * sizeof(tr_sha1_digest_t));
+
+    auto buf = std::vector<std::byte>(opts.piece_size);
+    for (size_t piece = 0U; piece < opts.n_pieces; ++piece)
+    {
+        synthetic_bytes(opts.seed, uint64_t{ piece } * opts.piece_size, std::data(buf), std::size(buf));
+        auto const digest = tr_sha1::digest(buf);
+        pieces.append(reinterpret_cast<char const*>(std::data(digest)), std::size(digest));
+    }
+
+    auto top = tr_variant{};
+    tr_variantInitDict(&top, 2U);
+    tr_variantDictAddStr(&top, TR_KEY_created_by, MyName);
+
+    auto* const info = tr_variantDictAddDict(&top, TR_KEY_info, 4U);
+    tr_variantDictAddStr(info, TR_KEY_name, "swarm-sim.bin"sv);
+    tr_variantDictAddInt(info, TR_KEY_length, uint64_t{ opts.n_pieces } * opts.piece_size);
+    tr_variantDictAddInt(info, TR_KEY_piece_length, opts.piece_size);
+    tr_variantDictAddRaw(info, TR_KEY_pieces, std::data(pieces), std::size(pieces));
+
+    auto benc = tr_variantToStr(&top, TR_VARIANT_FMT_BENC);
+    tr_variantClear(&top);
+    return benc;
+}
+
+[[nodiscard]] std::chrono::nanoseconds thread_cpu_time()
+{
+    auto ts = timespec{};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return std::chrono::seconds{ ts.tv_sec } + std::chrono::nanoseconds{ ts.tv_nsec };
+}
+
+[[nodiscard]] std::chrono::nanoseconds process_cpu_time()
+{
+    auto usage = rusage{};
+    getrusage(RUSAGE_SELF, &usage);
+    auto const to_ns = [](timeval const& tv)
+    {
+        return std::chrono::nanoseconds{ std::chrono::seconds{ tv.tv_sec } + std::chrono::microseconds{ tv.tv_usec } };
+    };
+    return to_ns(usage.ru_utime) + to_ns(usage.ru_stime);
+}
+
+// Thousands of peers need twice as many file descriptors
+void raise_file_limit()
+{
+    auto limit = rlimit{};
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max)
+    {
+        limit.rlim_cur = limit.rlim_max;
+        (void)setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+// ---
+
+// A session running in a temporary directory that's removed when done.
+class SimSession
+{
+public:
+    explicit SimSession(Options const& opts)
+        : sandbox_dir_{ create_sandbox() }
+    {
+        auto const download_dir = tr_pathbuf{ sandbox_dir_, "/Downloads"sv };
+        tr_sys_dir_create(download_dir, TR_SYS_DIR_CREATE_PARENTS, 0700);
+
+        // leave some room above the swarm's size for the churned peers
+        // whose connections haven't been noticed as closed yet
+        auto const peer_limit = static_cast<int64_t>(opts.n_peers + opts.n_peers / 4U + 16U);
+
+        auto settings = tr_variant{};
+        tr_variantInitDict(&settings, 12U);
+        tr_variantDictAddStr(&settings, TR_KEY_download_dir, download_dir);
+        tr_variantDictAddBool(&settings, TR_KEY_dht_enabled, false);
+        tr_variantDictAddBool(&settings, TR_KEY_lpd_enabled, false);
+        tr_variantDictAddBool(&settings, TR_KEY_pex_enabled, false);
+        tr_variantDictAddBool(&settings, TR_KEY_utp_enabled, false);
+        tr_variantDictAddBool(&settings, TR_KEY_port_forwarding_enabled, false);
+        tr_variantDictAddBool(&settings, TR_KEY_peer_port_random_on_start, true);
+        tr_variantDictAddInt(&settings, TR_KEY_encryption, TR_CLEAR_PREFERRED);
+        tr_variantDictAddInt(&settings, TR_KEY_peer_limit_global, peer_limit);
+        tr_variantDictAddInt(&settings, TR_KEY_peer_limit_per_torrent, peer_limit);
+        tr_variantDictAddInt(&settings, TR_KEY_peer_io_threads, static_cast<int64_t>(opts.peer_io_threads));
+        tr_variantDictAddInt(&settings, TR_KEY_message_level, TR_LOG_ERROR);
+        session_ = tr_sessionInit(sandbox_dir_.c_str(), false, &settings);
+        tr_variantClear(&settings);
+    }
+
+    ~SimSession()
+    {
+        tr_sessionClose(session_);
+        remove_recursive(sandbox_dir_);
+    }
+
+    SimSession(SimSession const&) = delete;
+    SimSession(SimSession&&) = delete;
+    SimSession& operator=(SimSession const&) = delete;
+    SimSession& operator=(SimSession&&) = delete;
+
+    [[nodiscard]] constexpr auto* session() noexcept
+    {
+        return session_;
+    }
+
+    // Add the torrent, wait for its initial verify to finish, and start it
+    [[nodiscard]] tr_torrent* add_torrent(std::string_view benc)
+    {
+        auto* const ctor = tr_ctorNew(session_);
+        tr_error* error = nullptr;
+        if (!tr_ctorSetMetainfo(ctor, std::data(benc), std::size(benc), &error))
+        {
+            fmt::print(stderr, "couldn't parse synthetic torrent: {:s}\n", error->message);
+            tr_error_free(error);
+            tr_ctorFree(ctor);
+            return nullptr;
+        }
+
+        tr_ctorSetPaused(ctor, TR_FORCE, true);
+        auto* const tor = tr_torrentNew(ctor, nullptr);
+        tr_ctorFree(ctor);
+        if (tor == nullptr)
+        {
+            return nullptr;
+        }
+
+        auto const is_checking = [tor]()
+        {
+            auto const activity = tr_torrentStat(tor)->activity;
+            return activity == TR_STATUS_CHECK || activity == TR_STATUS_CHECK_WAIT;
+        };
+        while (is_checking())
+        {
+            std::this_thread::sleep_for(10ms);
+        }
+
+        tr_torrentStart(tor);
+        return tor;
+    }
+
+    // @return how much CPU time the session thread has used
+    [[nodiscard]] std::chrono::nanoseconds session_thread_cpu_time()
+    {
+        auto promise = std::promise<std::chrono::nanoseconds>{};
+        auto future = promise.get_future();
+        session_->runInSessionThread([&promise]() { promise.set_value(thread_cpu_time()); });
+        return future.get();
+    }
+
+private:
+    [[nodiscard]] static std::string create_sandbox()
+    {
+        auto const* const tmpdir = getenv("TMPDIR");
+        auto path = fmt::format("{:s}/transmission-swarm-sim-XXXXXX", tmpdir != nullptr ? tmpdir : "/tmp");
+        tr_sys_dir_create_temp(std::data(path));
+        return path;
+    }
+
+    static void remove_recursive(std::string const& path)
+    {
+        if (auto const info = tr_sys_path_get_info(path); info && info->isFolder())
+        {
+            if (auto const odir = tr_sys_dir_open(path); odir != TR_BAD_SYS_DIR)
+            {
+                for (char const* name = nullptr; (name = tr_sys_dir_read_name(odir)) != nullptr;)
+                {
+                    if ("."sv != name && ".."sv != name)
+                    {
+                        remove_recursive(fmt::format("{:s}/{:s}", path, name));
+                    }
+                }
+
+                tr_sys_dir_close(odir);
+            }
+        }
+
+        tr_sys_path_remove(path);
+    }
+
+    std::string const sandbox_dir_;
+    tr_session* session_ = nullptr;
+};
+
+// ---
+
+class Swarm
+{
+public:
+    Swarm(Options const& opts, tr_session* session, tr_sha1_digest_t const& info_hash)
+        : opts_{ opts }
+        , session_{ session }
+        , info_hash_{ info_hash }
+        , evbase_{ event_base_new() }
+        , rng_{ opts.seed }
+    {
+        auto rate = std::uniform_int_distribution<uint32_t>{ opts.min_rate_kibps, opts.max_rate_kibps };
+        auto latency = std::uniform_int_distribution<int64_t>{ opts.min_latency.count(), opts.max_latency.count() };
+
+        peers_.resize(opts.n_peers);
+        for (size_t i = 0U; i < std::size(peers_); ++i)
+        {
+            auto& peer = peers_[i];
+            peer.swarm = this;
+            peer.id = i;
+            peer.rate = uint64_t{ rate(rng_) } * 1024U;
+            peer.latency = std::chrono::milliseconds{ latency(rng_) };
+        }
+    }
+
+    ~Swarm()
+    {
+        for (auto& peer : peers_)
+        {
+            disconnect(peer, Clock::time_point::max());
+        }
+    }
+
+    Swarm(Swarm const&) = delete;
+    Swarm(Swarm&&) = delete;
+    Swarm& operator=(Swarm const&) = delete;
+    Swarm& operator=(Swarm&&) = delete;
+
+    // Serve the session until `is_done()` or until `deadline`
+    void run(Clock::time_point deadline, std::function<bool()> is_done)
+    {
+        deadline_ = deadline;
+        is_done_ = std::move(is_done);
+        started_at_ = last_tick_ = Clock::now();
+        next_churn_ = started_at_ + opts_.churn_interval;
+
+        auto const tick_ev = libtransmission::evhelpers::event_unique_ptr{
+            event_new(evbase_.get(), -1, EV_PERSIST, &Swarm::on_tick, this)
+        };
+        auto const interval = timeval{ 0, static_cast<decltype(timeval::tv_usec)>(TickInterval.count()) };
+        event_add(tick_ev.get(), &interval);
+        event_base_dispatch(evbase_.get());
+
+        finished_at_ = Clock::now();
+        for (auto& peer : peers_)
+        {
+            disconnect(peer, Clock::time_point::max());
+        }
+    }
+
+    void print_report() const
+    {
+        auto const secs = std::chrono::duration<double>{ finished_at_ - started_at_ }.count();
+
+        auto served = uint64_t{};
+        auto shares = std::vector<double>{};
+        for (auto const& peer : peers_)
+        {
+            served += peer.bytes_served;
+
+            // each peer's throughput as a share of its upload rate, for the time it was connected
+            if (auto const connected = std::chrono::duration<double>{ peer.connected_for }.count(); connected >= 1.0)
+            {
+                shares.push_back(peer.bytes_served / connected / peer.rate);
+            }
+        }
+
+        auto sum = 0.0;
+        auto sum_of_squares = 0.0;
+        for (auto const share : shares)
+        {
+            sum += share;
+            sum_of_squares += share * share;
+        }
+        auto const jain = sum_of_squares > 0.0 ? sum * sum / (std::size(shares) * sum_of_squares) : 0.0;
+
+        fmt::print("elapsed:              {:.2f} s\n", secs);
+        fmt::print("served:               {:.1f} MiB ({:.2f} MiB/s)\n", served / 1048576.0, served / 1048576.0 / secs);
+        fmt::print("connections:          {:d} made, {:d} closed by the session\n", n_connects_, n_closed_by_session_);
+        fmt::print("requests:             {:d} served, {:d} cancelled\n", std::size(latencies_), n_cancels_);
+
+        if (!std::empty(latencies_))
+        {
+            auto sorted = latencies_;
+            std::sort(std::begin(sorted), std::end(sorted));
+            auto const percentile = [&sorted](double p)
+            {
+                return sorted[std::min(std::size(sorted) - 1U, static_cast<size_t>(p * std::size(sorted)))];
+            };
+            fmt::print(
+                "request latency:      p50 {:.1f} ms, p90 {:.1f} ms, p99 {:.1f} ms, max {:.1f} ms\n",
+                percentile(0.50),
+                percentile(0.90),
+                percentile(0.99),
+                sorted.back());
+        }
+
+        fmt::print("fairness (Jain):      {:.3f} over {:d} peers\n", jain, std::size(shares));
+    }
+
+    [[nodiscard]] std::chrono::nanoseconds cpu_time() const noexcept
+    {
+        return cpu_time_;
+    }
+
+private:
+    static auto constexpr TickInterval = std::chrono::microseconds{ 5000 };
+    static auto constexpr ReconnectInterval = 1s;
+    static auto constexpr MaxConnectsPerTick = size_t{ 32U };
+    static auto constexpr ReadChunkSize = size_t{ 64U * 1024U };
+
+    // BitTorrent message ids
+    static auto constexpr Unchoke = uint8_t{ 1 };
+    static auto constexpr Bitfield = uint8_t{ 5 };
+    static auto constexpr Request = uint8_t{ 6 };
+    static auto constexpr Piece = uint8_t{ 7 };
+    static auto constexpr Cancel = uint8_t{ 8 };
+
+    static auto constexpr HandshakeLength = size_t{ 68U };
+
+    struct BlockRequest
+    {
+        uint32_t index = 0;
+        uint32_t begin = 0;
+        uint32_t length = 0;
+        Clock::time_point asked_at;
+    };
+
+    struct Peer
+    {
+        Swarm* swarm = nullptr;
+        size_t id = 0;
+        uint32_t generation = 0; // bumped when churn replaces it with a "new" peer
+
+        uint64_t rate = 0; // bytes per second
+        Clock::duration latency = {};
+
+        int fd = -1;
+        libtransmission::evhelpers::event_unique_ptr read_ev;
+        libtransmission::evhelpers::event_unique_ptr write_ev;
+        Clock::time_point connected_at;
+        Clock::time_point reconnect_at;
+        bool is_handshake_done = false;
+
+        std::string inbuf;
+        std::string outbuf;
+        size_t outbuf_pos = 0;
+
+        // bytes ever queued or sent, and the queued total at which each block is fully sent
+        uint64_t n_queued = 0;
+        uint64_t n_sent = 0;
+        std::deque<std::pair<uint64_t, Clock::time_point>> unsent_blocks;
+
+        std::deque<BlockRequest> requests;
+        double tokens = 0;
+
+        Clock::duration connected_for = {};
+        uint64_t bytes_served = 0;
+    };
+
+    static void on_tick(evutil_socket_t /*fd*/, short /*what*/, void* vself)
+    {
+        auto* const self = static_cast<Swarm*>(vself);
+        auto const cpu_at_start = thread_cpu_time();
+        self->tick(Clock::now());
+        self->cpu_time_ += thread_cpu_time() - cpu_at_start;
+    }
+
+    static void on_readable(evutil_socket_t /*fd*/, short /*what*/, void* vpeer)
+    {
+        auto* const peer = static_cast<Peer*>(vpeer);
+        auto const cpu_at_start = thread_cpu_time();
+        peer->swarm->read(*peer, Clock::now());
+        peer->swarm->cpu_time_ += thread_cpu_time() - cpu_at_start;
+    }
+
+    static void on_writable(evutil_socket_t /*fd*/, short /*what*/, void* vpeer)
+    {
+        auto* const peer = static_cast<Peer*>(vpeer);
+        auto const cpu_at_start = thread_cpu_time();
+        peer->swarm->flush(*peer, Clock::now());
+        peer->swarm->cpu_time_ += thread_cpu_time() - cpu_at_start;
+    }
+
+    static void add_uint32(std::string& buf, uint32_t val)
+    {
+        for (int shift = 24; shift >= 0; shift -= 8)
+        {
+            buf.push_back(static_cast<char>((val >> shift) & 0xFFU));
+        }
+    }
+
+    [[nodiscard]] static uint32_t get_uint32(char const* buf)
+    {
+        auto val = uint32_t{};
+        for (size_t i = 0U; i < 4U; ++i)
+        {
+            val = (val << 8U) | static_cast<uint8_t>(buf[i]);
+        }
+        return val;
+    }
+
+    void tick(Clock::time_point now)
+    {
+        if (now >= deadline_ || (now >= next_done_check_ && is_done_()))
+        {
+            event_base_loopbreak(evbase_.get());
+            return;
+        }
+
+        if (now >= next_done_check_)
+        {
+            next_done_check_ = now + 100ms;
+        }
+
+        if (opts_.churn_interval > 0s && now >= next_churn_)
+        {
+            next_churn_ = now + opts_.churn_interval;
+            churn(now);
+        }
+
+        auto const secs = std::chrono::duration<double>{ now - last_tick_ }.count();
+        last_tick_ = now;
+
+        auto n_connects = size_t{};
+        for (auto& peer : peers_)
+        {
+            if (peer.fd == -1)
+            {
+                if (now >= peer.reconnect_at && n_connects < MaxConnectsPerTick)
+                {
+                    ++n_connects;
+                    connect(peer, now);
+                }
+
+                continue;
+            }
+
+            // let a peer save up a little, so that slow ones can still send a whole block
+            auto const max_tokens = std::max(peer.rate / 10.0, tr_block_info::BlockSize + 13.0);
+            peer.tokens = std::min(peer.tokens + peer.rate * secs, max_tokens);
+            serve(peer, now);
+        }
+    }
+
+    void churn(Clock::time_point now)
+    {
+        auto connected = std::vector<Peer*>{};
+        for (auto& peer : peers_)
+        {
+            if (peer.fd != -1)
+            {
+                connected.push_back(&peer);
+            }
+        }
+
+        std::shuffle(std::begin(connected), std::end(connected), rng_);
+        connected.resize(std::size(connected) * opts_.churn_percent / 100U);
+        for (auto* const peer : connected)
+        {
+            disconnect(*peer, now);
+            ++peer->generation;
+        }
+    }
+
+    [[nodiscard]] tr_socket_address address_of(Peer const& peer) const
+    {
+        auto const addr = tr_address::from_string(
+            fmt::format("10.{:d}.{:d}.{:d}", (peer.id >> 16U) & 0xFFU, (peer.id >> 8U) & 0xFFU, peer.id & 0xFFU));
+        return { *addr, tr_port::fromHost(static_cast<uint16_t>(10000U + peer.generation % 50000U)) };
+    }
+
+    void connect(Peer& peer, Clock::time_point now)
+    {
+        int fds[2] = { -1, -1 };
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+        {
+            peer.reconnect_at = now + ReconnectInterval;
+            return;
+        }
+
+        evutil_make_socket_nonblocking(fds[0]);
+        evutil_make_socket_nonblocking(fds[1]);
+        ++n_connects_;
+
+        peer.fd = fds[0];
+        peer.read_ev.reset(event_new(evbase_.get(), peer.fd, EV_READ | EV_PERSIST, &Swarm::on_readable, &peer));
+        peer.write_ev.reset(event_new(evbase_.get(), peer.fd, EV_WRITE, &Swarm::on_writable, &peer));
+        event_add(peer.read_ev.get(), nullptr);
+        peer.connected_at = now;
+        peer.is_handshake_done = false;
+        peer.tokens = 0;
+
+        // plaintext handshake with no extensions
+        auto& out = peer.outbuf;
+        out.push_back(static_cast<char>(19));
+        out.append("BitTorrent protocol"sv);
+        out.append(8U, '\0');
+        out.append(reinterpret_cast<char const*>(std::data(info_hash_)), std::size(info_hash_));
+        out.append(fmt::format("-SM0100-{:06d}{:06d}", peer.id % 1000000U, peer.generation % 1000000U));
+        peer.n_queued += HandshakeLength;
+        flush(peer, now);
+
+        session_->runInSessionThread(
+            [session = session_, socket_address = address_of(peer), sock = fds[1]]()
+            { session->addIncoming(tr_peer_socket{ session, socket_address, sock }); });
+    }
+
+    void disconnect(Peer& peer, Clock::time_point reconnect_at)
+    {
+        if (peer.fd == -1)
+        {
+            return;
+        }
+
+        peer.read_ev.reset();
+        peer.write_ev.reset();
+        close(peer.fd);
+        peer.fd = -1;
+        peer.connected_for += Clock::now() - peer.connected_at;
+        peer.reconnect_at = reconnect_at;
+
+        n_cancels_ += std::size(peer.requests);
+        peer.requests.clear();
+        peer.inbuf.clear();
+        peer.outbuf.clear();
+        peer.outbuf_pos = 0U;
+        peer.n_queued = peer.n_sent = 0U;
+        peer.unsent_blocks.clear();
+    }
+
+    void read(Peer& peer, Clock::time_point now)
+    {
+        for (;;)
+        {
+            auto const old_size = std::size(peer.inbuf);
+            peer.inbuf.resize(old_size + ReadChunkSize);
+            auto const n_read = recv(peer.fd, std::data(peer.inbuf) + old_size, ReadChunkSize, 0);
+            peer.inbuf.resize(old_size + std::max(n_read, ssize_t{ 0 }));
+
+            if (n_read > 0)
+            {
+                continue;
+            }
+
+            if (n_read == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+            {
+                ++n_closed_by_session_;
+                disconnect(peer, now + ReconnectInterval);
+                return;
+            }
+
+            break;
+        }
+
+        auto const* const begin = std::data(peer.inbuf);
+        auto const* const end = begin + std::size(peer.inbuf);
+        auto const* walk = begin;
+
+        if (!peer.is_handshake_done)
+        {
+            if (std::size(peer.inbuf) < HandshakeLength)
+            {
+                return;
+            }
+
+            walk += HandshakeLength;
+            peer.is_handshake_done = true;
+
+            // we're a seed, and we'll serve whatever's asked
+            auto& out = peer.outbuf;
+            auto const n_bitfield_bytes = (opts_.n_pieces + 7U) / 8U;
+            add_uint32(out, 1U + n_bitfield_bytes);
+            out.push_back(static_cast<char>(Bitfield));
+            out.append(n_bitfield_bytes, static_cast<char>(0xFF));
+            if (auto const spare_bits = n_bitfield_bytes * 8U - opts_.n_pieces; spare_bits != 0U)
+            {
+                out.back() = static_cast<char>(0xFFU << spare_bits);
+            }
+            add_uint32(out, 1U);
+            out.push_back(static_cast<char>(Unchoke));
+            peer.n_queued += 4U + 1U + n_bitfield_bytes + 4U + 1U;
+        }
+
+        while (end - walk >= 4)
+        {
+            auto const len = get_uint32(walk);
+            if (static_cast<size_t>(end - walk) < 4U + len)
+            {
+                break;
+            }
+
+            if (len == 13U && static_cast<uint8_t>(walk[4]) == Request)
+            {
+                peer.requests.push_back({ get_uint32(walk + 5), get_uint32(walk + 9), get_uint32(walk + 13), now });
+            }
+            else if (len == 13U && static_cast<uint8_t>(walk[4]) == Cancel)
+            {
+                auto const index = get_uint32(walk + 5);
+                auto const offset = get_uint32(walk + 9);
+                auto const iter = std::find_if(
+                    std::begin(peer.requests),
+                    std::end(peer.requests),
+                    [index, offset](auto const& req) { return req.index == index && req.begin == offset; });
+                if (iter != std::end(peer.requests))
+                {
+                    peer.requests.erase(iter);
+                    ++n_cancels_;
+                }
+            }
+
+            walk += 4U + len;
+        }
+
+        peer.inbuf.erase(0U, walk - begin);
+        flush(peer, now);
+    }
+
+    // Queue the blocks whose latency has passed, as far as the peer's upload rate allows
+    void serve(Peer& peer, Clock::time_point now)
+    {
+        while (!std::empty(peer.requests) && peer.tokens > 0)
+        {
+            auto const& req = peer.requests.front();
+            if (now < req.asked_at + peer.latency)
+            {
+                break;
+            }
+
+            auto& out = peer.outbuf;
+            add_uint32(out, 9U + req.length);
+            out.push_back(static_cast<char>(Piece));
+            add_uint32(out, req.index);
+            add_uint32(out, req.begin);
+            auto const old_size = std::size(out);
+            out.resize(old_size + req.length);
+            synthetic_bytes(
+                opts_.seed,
+                uint64_t{ req.index } * opts_.piece_size + req.begin,
+                reinterpret_cast<std::byte*>(std::data(out) + old_size),
+                req.length);
+
+            auto const n_bytes = 4U + 9U + req.length;
+            peer.n_queued += n_bytes;
+            peer.tokens -= n_bytes;
+            peer.bytes_served += req.length;
+            peer.unsent_blocks.emplace_back(peer.n_queued, req.asked_at);
+            peer.requests.pop_front();
+        }
+
+        flush(peer, now);
+    }
+
+    void flush(Peer& peer, Clock::time_point now)
+    {
+        while (peer.fd != -1 && peer.outbuf_pos < std::size(peer.outbuf))
+        {
+            auto const n_sent = send(
+                peer.fd,
+                std::data(peer.outbuf) + peer.outbuf_pos,
+                std::size(peer.outbuf) - peer.outbuf_pos,
+                0);
+
+            if (n_sent > 0)
+            {
+                peer.outbuf_pos += n_sent;
+                peer.n_sent += n_sent;
+                continue;
+            }
+
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+            {
+                event_add(peer.write_ev.get(), nullptr);
+            }
+            else
+            {
+                ++n_closed_by_session_;
+                disconnect(peer, now + ReconnectInterval);
+            }
+
+            break;
+        }
+
+        if (peer.fd != -1 && peer.outbuf_pos == std::size(peer.outbuf))
+        {
+            peer.outbuf.clear();
+            peer.outbuf_pos = 0U;
+        }
+
+        // a block's request is done once the whole block is in the session's socket buffer
+        while (!std::empty(peer.unsent_blocks) && peer.unsent_blocks.front().first <= peer.n_sent)
+        {
+            latencies_.push_back(std::chrono::duration<float, std::milli>{ now - peer.unsent_blocks.front().second }.count());
+            peer.unsent_blocks.pop_front();
+        }
+    }
+
+    Options const& opts_;
+    tr_session* const session_;
+    tr_sha1_digest_t const info_hash_;
+    libtransmission::evhelpers::evbase_unique_ptr const evbase_;
+    std::mt19937 rng_;
+
+    // a deque, so that the events' pointers to the peers stay valid
+    std::deque<Peer> peers_;
+
+    std::function<bool()> is_done_;
+    Clock::time_point deadline_;
+    Clock::time_point started_at_;
+    Clock::time_point finished_at_;
+    Clock::time_point last_tick_;
+    Clock::time_point next_churn_;
+    Clock::time_point next_done_check_;
+    std::chrono::nanoseconds cpu_time_ = {};
+
+    std::vector<float> latencies_; // in milliseconds
+    size_t n_connects_ = 0;
+    size_t n_closed_by_session_ = 0;
+    size_t n_cancels_ = 0;
+};
+} // namespace
+
+int main(int argc, char** argv)
+{
+    auto opts = Options{};
+    if (!parse_command_line(opts, argc, argv))
+    {
+        tr_getopt_usage(MyName, Usage, std::data(Opts));
+        return EXIT_FAILURE;
+    }
+
+    std::signal(SIGPIPE, SIG_IGN);
+    raise_file_limit();
+
+    fmt::print(
+        "{:d} peers at {:d}-{:d} KiB/s with {:d}-{:d} ms RTT; {:d} pieces of {:d} KiB; seed {:d}\n",
+        opts.n_peers,
+        opts.min_rate_kibps,
+        opts.max_rate_kibps,
+        opts.min_latency.count(),
+        opts.max_latency.count(),
+        opts.n_pieces,
+        opts.piece_size / 1024U,
+        opts.seed);
+    if (opts.churn_interval > 0s)
+    {
+        fmt::print("churn: {:d}% of the peers every {:d} s\n", opts.churn_percent, opts.churn_interval.count());
+    }
+    fmt::print("\n");
+    std::fflush(stdout);
+
+    auto const benc = make_metainfo(opts);
+    auto sim = SimSession{ opts };
+    auto* const tor = sim.add_torrent(benc);
+    if (tor == nullptr)
+    {
+        return EXIT_FAILURE;
+    }
+
+    auto swarm = Swarm{ opts, sim.session(), tor->info_hash() };
+    auto const session_cpu_at_start = sim.session_thread_cpu_time();
+    auto const process_cpu_at_start = process_cpu_time();
+
+    swarm.run(Clock::now() + opts.duration, [tor]() { return tr_torrentStat(tor)->leftUntilDone == 0U; });
+
+    auto const session_cpu = sim.session_thread_cpu_time() - session_cpu_at_start;
+    // everything but the simulated peers, e.g. the peer I/O threads and disk writes
+    auto const libtransmission_cpu = process_cpu_time() - process_cpu_at_start - swarm.cpu_time();
+    auto const* const st = tr_torrentStat(tor);
+
+    swarm.print_report();
+
+    auto const verified_gb = st->haveValid / 1e9;
+    auto const per_gb = [verified_gb](std::chrono::nanoseconds cpu)
+    {
+        return verified_gb > 0.0 ? std::chrono::duration<double>{ cpu }.count() / verified_gb : 0.0;
+    };
+    fmt::print(
+        "verified:             {:.1f} MiB of {:.1f} MiB, {:d} bytes corrupt\n",
+        st->haveValid / 1048576.0,
+        st->sizeWhenDone / 1048576.0,
+        st->corruptEver);
+    fmt::print("session thread CPU:   {:.2f} s ({:.2f} s per GB)\n", session_cpu.count() / 1e9, per_gb(session_cpu));
+    fmt::print(
+        "libtransmission CPU:  {:.2f} s ({:.2f} s per GB)\n",
+        libtransmission_cpu.count() / 1e9,
+        per_gb(libtransmission_cpu));
+
+    return EXIT_SUCCESS;
+}
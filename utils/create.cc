@@ -7,6 +7,7 @@
 #include <cstdio>
 #include <cstdlib> // for strtoul()
 #include <chrono>
+#include <cstddef> // for size_t
 #include <cstdint> // for uint32_t
 #include <future>
 #include <optional>
@@ -41,7 +42,7 @@ char constexpr Usage[] = "Usage: transmission-create [options] <file|directory>"
 
 uint32_t constexpr KiB = 1024;
 
-auto constexpr Options = std::array<tr_option, 10>{
+auto constexpr Options = std::array<tr_option, 14>{
     { { 'p', "private", "Allow this torrent to only be used with the specified tracker(s)", "p", false, nullptr },
       { 'r', "source", "Set the source for private trackers", "r", true, "<source>" },
       { 'o', "outfile", "Save the generated .torrent to this filename", "o", true, "<file>" },
@@ -50,6 +51,10 @@ auto constexpr Options = std::array<tr_option, 10>{
       { 't', "tracker", "Add a tracker's announce URL", "t", true, "<url>" },
       { 'w', "webseed", "Add a webseed URL", "w", true, "<url>" },
       { 'x', "anonymize", R"(Omit "Creation date" and "Created by" info)", nullptr, false, nullptr },
+      { 'P', "protocol", "Set which BitTorrent versions to support: v1, v2, or hybrid (default: v1)", "P", true, "<version>" },
+      { 'f', "pad-files", "Add padding files so that each file starts on a new piece", nullptr, false, nullptr },
+      { 'u', "update", "Reuse unchanged pieces' hashes from an older version of the torrent", "u", true, "<file>" },
+      { 'j', "threads", "Number of threads to hash pieces with (default: one per CPU core)", "j", true, "<count>" },
       { 'V', "version", "Show version number and exit", "V", false, nullptr },
       { 0, nullptr, nullptr, nullptr, false, nullptr } }
 };
@@ -62,9 +67,13 @@ struct app_options
     std::string_view comment;
     std::string_view infile;
     std::string_view source;
+    std::string_view previous;
     uint32_t piece_size = 0;
+    size_t threads = 0;
+    tr_metainfo_builder::Version version = tr_metainfo_builder::Version::V1;
     bool anonymize = false;
     bool is_private = false;
+    bool pad_files = false;
     bool show_version = false;
 };
 
@@ -121,6 +130,38 @@ int parseCommandLine(app_options& options, int argc, char const* const* argv)
             options.anonymize = true;
             break;
 
+        case 'f':
+            options.pad_files = true;
+            break;
+
+        case 'u':
+            options.previous = optarg;
+            break;
+
+        case 'j':
+            options.threads = strtoul(optarg, nullptr, 10);
+            break;
+
+        case 'P':
+            if (optarg == "v1"sv)
+            {
+                options.version = tr_metainfo_builder::Version::V1;
+            }
+            else if (optarg == "v2"sv)
+            {
+                options.version = tr_metainfo_builder::Version::V2;
+            }
+            else if (optarg == "hybrid"sv)
+            {
+                options.version = tr_metainfo_builder::Version::Hybrid;
+            }
+            else
+            {
+                fmt::print(stderr, "ERROR: unknown protocol version \"{:s}\"; expected v1, v2, or hybrid.\n", optarg);
+                return 1;
+            }
+            break;
+
         case TR_OPT_UNK:
             options.infile = optarg;
             break;
@@ -224,12 +265,22 @@ int tr_main(int argc, char* argv[])
         }
     }
 
+    if (tr_error* error = nullptr; !std::empty(options.previous) && !builder.set_previous(options.previous, &error))
+    {
+        fmt::print(stderr, "ERROR: could not read \"{:s}\": {:s} {:d}\n", options.previous, error->message, error->code);
+        tr_error_free(error);
+        return EXIT_FAILURE;
+    }
+
     if (options.piece_size != 0 && !builder.set_piece_size(options.piece_size))
     {
         fmt::print(stderr, "ERROR: piece size must be at least 16 KiB and must be a power of two.\n");
         return EXIT_FAILURE;
     }
 
+    builder.set_version(options.version);
+    builder.set_pad_files(options.pad_files);
+
     fmt::print(
         tr_ngettext("{file_count:L} file, {total_size}\n", "{file_count:L} files, {total_size}\n", builder.file_count()),
         fmt::arg("file_count", builder.file_count()),
@@ -255,6 +306,7 @@ int tr_main(int argc, char* argv[])
 
     builder.set_private(options.is_private);
     builder.set_anonymize(options.anonymize);
+    builder.set_threads(options.threads);
     builder.set_webseeds(std::move(options.webseeds));
     builder.set_announce_list(std::move(options.trackers));
 
@@ -281,6 +333,15 @@ int tr_main(int argc, char* argv[])
         return EXIT_FAILURE;
     }
 
+    if (!std::empty(options.previous))
+    {
+        fmt::print(
+            "reused {:d} of {:d} piece hashes from \"{:s}\" ",
+            builder.reused_piece_count(),
+            builder.piece_count(),
+            options.previous);
+    }
+
     if (tr_error* error = nullptr; !builder.save(options.outfile, &error))
     {
         fmt::print("ERROR: could not save \"{:s}\": {:s} {:d}\n", options.outfile, error->message, error->code);
@@ -3,41 +3,66 @@
 // or any future license endorsed by Mnemosyne LLC.
 // License text can be found in the licenses/ folder.
 
+#include <algorithm> // std::min(), std::max()
 #include <array>
+#include <atomic>
+#include <cctype> // isdigit()
 #include <cstdio> // stderr
 #include <cstdlib> // EXIT_FAILURE
+#include <iterator> // std::back_inserter
+#include <mutex>
+#include <optional>
 #include <string>
 #include <string_view>
+#include <thread>
 #include <vector>
 
+#include <curl/curl.h>
+
 #include <fmt/core.h>
+#include <fmt/format.h>
+
+#include <libtransmission/transmission.h>
 
 #include <libtransmission/error.h>
+#include <libtransmission/file.h>
 #include <libtransmission/log.h>
 #include <libtransmission/quark.h>
 #include <libtransmission/tr-getopt.h>
+#include <libtransmission/tr-strbuf.h>
 #include <libtransmission/utils.h>
 #include <libtransmission/variant.h>
 #include <libtransmission/version.h>
 
 static char constexpr MyName[] = "transmission-edit";
-static char constexpr Usage[] = "Usage: transmission-edit [options] torrent-file(s)";
+static char constexpr Usage[] = "Usage: transmission-edit [options] torrent-file(s) or directories";
+
+using namespace std::literals;
 
 struct app_options
 {
     std::vector<std::string_view> files;
     char const* add = nullptr;
     char const* deleteme = nullptr;
-    std::array<char const*, 2> replace;
+    std::array<char const*, 2> replace = {};
     char const* source = nullptr;
+    char const* rpc_url = nullptr;
+    size_t n_jobs = 1U;
     bool show_version = false;
 };
 
-static auto constexpr Options = std::array<tr_option, 6>{
+static auto constexpr Options = std::array<tr_option, 8>{
     { { 'a', "add", "Add a tracker's announce URL", "a", true, "<url>" },
       { 'd', "delete", "Delete a tracker's announce URL", "d", true, "<url>" },
       { 'r', "replace", "Search and replace a substring in the announce URLs", "r", true, "<old> <new>" },
       { 's', "source", "Set the source", "s", true, "<source>" },
+      { 'j', "jobs", "Edit this many torrent files at once (0 for one per CPU)", "j", true, "<n>" },
+      { 'p',
+        "rpc",
+        "Also apply --replace to every torrent in the session at this RPC URL, e.g. http://localhost:9091/transmission/rpc",
+        "p",
+        true,
+        "<url>" },
       { 'V', "version", "Show version number and exit", "V", false, nullptr },
       { 0, nullptr, nullptr, nullptr, false, nullptr } }
 };
@@ -75,6 +100,22 @@ static int parseCommandLine(app_options& opts, int argc, char const* const* argv
             opts.source = optarg;
             break;
 
+        case 'j':
+            if (auto const n = tr_num_parse<size_t>(optarg); n)
+            {
+                opts.n_jobs = *n != 0U ? *n : std::max(std::thread::hardware_concurrency(), 1U);
+            }
+            else
+            {
+                fmt::print(stderr, "ERROR: Invalid number of jobs '{:s}'\n", optarg);
+                return 1;
+            }
+            break;
+
+        case 'p':
+            opts.rpc_url = optarg;
+            break;
+
         case 'V':
             opts.show_version = true;
             break;
@@ -91,7 +132,7 @@ static int parseCommandLine(app_options& opts, int argc, char const* const* argv
     return 0;
 }
 
-static bool removeURL(tr_variant* metainfo, std::string_view url)
+static bool removeURL(tr_variant* metainfo, std::string_view url, std::string& log)
 {
     auto sv = std::string_view{};
     tr_variant* announce_list;
@@ -99,7 +140,7 @@ static bool removeURL(tr_variant* metainfo, std::string_view url)
 
     if (tr_variantDictFindStrView(metainfo, TR_KEY_announce, &sv) && url == sv)
     {
-        fmt::print("\tRemoved '{:s}' from 'announce'\n", sv);
+        fmt::format_to(std::back_inserter(log), "\tRemoved '{:s}' from 'announce'\n", sv);
         tr_variantDictRemove(metainfo, TR_KEY_announce);
         changed = true;
     }
@@ -117,7 +158,11 @@ static bool removeURL(tr_variant* metainfo, std::string_view url)
             {
                 if (tr_variantGetStrView(node, &sv) && url == sv)
                 {
-                    fmt::print("\tRemoved '{:s}' from 'announce-list' tier #{:d}\n", sv, tierIndex + 1);
+                    fmt::format_to(
+                        std::back_inserter(log),
+                        "\tRemoved '{:s}' from 'announce-list' tier #{:d}\n",
+                        sv,
+                        tierIndex + 1);
                     tr_variantListRemove(tier, nodeIndex);
                     changed = true;
                 }
@@ -129,7 +174,7 @@ static bool removeURL(tr_variant* metainfo, std::string_view url)
 
             if (tr_variantListSize(tier) == 0)
             {
-                fmt::print("\tNo URLs left in tier #{:d}... removing tier\n", tierIndex + 1);
+                fmt::format_to(std::back_inserter(log), "\tNo URLs left in tier #{:d}... removing tier\n", tierIndex + 1);
                 tr_variantListRemove(announce_list, tierIndex);
             }
             else
@@ -140,7 +185,7 @@ static bool removeURL(tr_variant* metainfo, std::string_view url)
 
         if (tr_variantListSize(announce_list) == 0)
         {
-            fmt::print("\tNo tiers left... removing announce-list\n");
+            fmt::format_to(std::back_inserter(log), "\tNo tiers left... removing announce-list\n");
             tr_variantDictRemove(metainfo, TR_KEY_announce_list);
         }
     }
@@ -156,7 +201,7 @@ static bool removeURL(tr_variant* metainfo, std::string_view url)
             if ((node != nullptr) && tr_variantGetStrView(node, &sv))
             {
                 tr_variantDictAddStr(metainfo, TR_KEY_announce, sv);
-                fmt::print("\tAdded '{:s}' to announce\n", sv);
+                fmt::format_to(std::back_inserter(log), "\tAdded '{:s}' to announce\n", sv);
             }
         }
     }
@@ -183,7 +228,7 @@ static std::string replaceSubstr(std::string_view str, std::string_view oldval,
     return ret;
 }
 
-static bool replaceURL(tr_variant* metainfo, std::string_view oldval, std::string_view newval)
+static bool replaceURL(tr_variant* metainfo, std::string_view oldval, std::string_view newval, std::string& log)
 {
     auto sv = std::string_view{};
     tr_variant* announce_list;
@@ -192,7 +237,7 @@ static bool replaceURL(tr_variant* metainfo, std::string_view oldval, std::strin
     if (tr_variantDictFindStrView(metainfo, TR_KEY_announce, &sv) && tr_strv_contains(sv, oldval))
     {
         auto const newstr = replaceSubstr(sv, oldval, newval);
-        fmt::print("\tReplaced in 'announce': '{:s}' --> '{:s}'\n", sv, newstr);
+        fmt::format_to(std::back_inserter(log), "\tReplaced in 'announce': '{:s}' --> '{:s}'\n", sv, newstr);
         tr_variantDictAddStr(metainfo, TR_KEY_announce, newstr);
         changed = true;
     }
@@ -212,7 +257,12 @@ static bool replaceURL(tr_variant* metainfo, std::string_view oldval, std::strin
                 if (tr_variantGetStrView(node, &sv) && tr_strv_contains(sv, oldval))
                 {
                     auto const newstr = replaceSubstr(sv, oldval, newval);
-                    fmt::print("\tReplaced in 'announce-list' tier #{:d}: '{:s}' --> '{:s}'\n", tierCount + 1, sv, newstr);
+                    fmt::format_to(
+                        std::back_inserter(log),
+                        "\tReplaced in 'announce-list' tier #{:d}: '{:s}' --> '{:s}'\n",
+                        tierCount + 1,
+                        sv,
+                        newstr);
                     tr_variantClear(node);
                     tr_variantInitStr(node, newstr);
                     changed = true;
@@ -254,7 +304,7 @@ static bool announce_list_has_url(tr_variant* announce_list, char const* url)
     return false;
 }
 
-static bool addURL(tr_variant* metainfo, char const* url)
+static bool addURL(tr_variant* metainfo, char const* url, std::string& log)
 {
     auto announce = std::string_view{};
     tr_variant* announce_list = nullptr;
@@ -265,7 +315,7 @@ static bool addURL(tr_variant* metainfo, char const* url)
     if (!had_announce && !had_announce_list)
     {
         /* this new tracker is the only one, so add it to "announce"... */
-        fmt::print("\tAdded '{:s}' in 'announce'\n", url);
+        fmt::format_to(std::back_inserter(log), "\tAdded '{:s}' in 'announce'\n", url);
         tr_variantDictAddStr(metainfo, TR_KEY_announce, url);
         changed = true;
     }
@@ -290,7 +340,11 @@ static bool addURL(tr_variant* metainfo, char const* url)
         {
             tr_variant* tier = tr_variantListAddList(announce_list, 1);
             tr_variantListAddStr(tier, url);
-            fmt::print("\tAdded '{:s}' to 'announce-list' tier #{:d}\n", url, tr_variantListSize(announce_list));
+            fmt::format_to(
+                std::back_inserter(log),
+                "\tAdded '{:s}' to 'announce-list' tier #{:d}\n",
+                url,
+                tr_variantListSize(announce_list));
             changed = true;
         }
     }
@@ -298,7 +352,7 @@ static bool addURL(tr_variant* metainfo, char const* url)
     return changed;
 }
 
-static bool setSource(tr_variant* metainfo, char const* source_value)
+static bool setSource(tr_variant* metainfo, char const* source_value, std::string& log)
 {
     auto current_source = std::string_view{};
     bool const had_source = tr_variantDictFindStrView(metainfo, TR_KEY_source, &current_source);
@@ -306,13 +360,13 @@ static bool setSource(tr_variant* metainfo, char const* source_value)
 
     if (!had_source)
     {
-        fmt::print("\tAdded '{:s}' as source\n", source_value);
+        fmt::format_to(std::back_inserter(log), "\tAdded '{:s}' as source\n", source_value);
         tr_variantDictAddStr(metainfo, TR_KEY_source, source_value);
         changed = true;
     }
     else if (current_source.compare(source_value) != 0)
     {
-        fmt::print("\tUpdated source: '{:s}' -> '{:s}'\n", current_source.data(), source_value);
+        fmt::format_to(std::back_inserter(log), "\tUpdated source: '{:s}' -> '{:s}'\n", current_source.data(), source_value);
         tr_variantDictAddStr(metainfo, TR_KEY_source, source_value);
         changed = true;
     }
@@ -320,87 +374,515 @@ static bool setSource(tr_variant* metainfo, char const* source_value)
     return changed;
 }
 
-int tr_main(int argc, char* argv[])
+// --- Patching the announce URLs in place
+
+// @return the benc string at the front of `benc` and the length of its encoding
+static std::optional<std::pair<std::string_view, size_t>> parseBencStr(std::string_view benc)
 {
-    tr_locale_set_global("");
+    auto const colon = benc.find(':');
+    if (std::empty(benc) || isdigit(static_cast<unsigned char>(benc.front())) == 0 || colon == std::string_view::npos)
+    {
+        return {};
+    }
 
-    int changedCount = 0;
+    auto const len = tr_num_parse<size_t>(benc.substr(0, colon));
+    if (!len || *len > std::size(benc) - colon - 1U)
+    {
+        return {};
+    }
 
-    tr_logSetLevel(TR_LOG_ERROR);
+    return std::make_pair(benc.substr(colon + 1U, *len), colon + 1U + *len);
+}
 
-    auto options = app_options{};
-    if (parseCommandLine(options, argc, (char const* const*)argv) != 0)
+// @return the length of the benc value at the front of `benc`, or 0 if it's malformed
+static size_t bencValueLength(std::string_view benc)
+{
+    auto pos = size_t{};
+    auto depth = size_t{};
+
+    do
     {
-        return EXIT_FAILURE;
+        if (pos >= std::size(benc))
+        {
+            return 0U;
+        }
+
+        if (auto const ch = benc[pos]; ch == 'd' || ch == 'l')
+        {
+            ++depth;
+            ++pos;
+        }
+        else if (ch == 'e')
+        {
+            if (depth == 0U)
+            {
+                return 0U;
+            }
+
+            --depth;
+            ++pos;
+        }
+        else if (ch == 'i')
+        {
+            auto const end = benc.find('e', pos);
+            if (end == std::string_view::npos)
+            {
+                return 0U;
+            }
+
+            pos = end + 1U;
+        }
+        else if (auto const str = parseBencStr(benc.substr(pos)); str)
+        {
+            pos += str->second;
+        }
+        else
+        {
+            return 0U;
+        }
+    } while (depth > 0U);
+
+    return pos;
+}
+
+// Append `value` to `out`, replacing `oldval` in each of its strings.
+// @return true if any were replaced
+static bool patchBencStrings(
+    std::string_view key,
+    std::string_view value,
+    std::string_view oldval,
+    std::string_view newval,
+    std::string& out,
+    std::string& log)
+{
+    auto changed = false;
+    auto tier = 0;
+    auto depth = 0;
+
+    while (!std::empty(value))
+    {
+        if (auto const ch = value.front(); ch == 'd' || ch == 'l' || ch == 'e')
+        {
+            if (ch != 'e' && ++depth == 2)
+            {
+                ++tier;
+            }
+            else if (ch == 'e')
+            {
+                --depth;
+            }
+
+            out += ch;
+            value.remove_prefix(1U);
+        }
+        else if (ch == 'i')
+        {
+            auto const len = value.find('e') + 1U;
+            out += value.substr(0, len);
+            value.remove_prefix(len);
+        }
+        else
+        {
+            auto const [str, len] = *parseBencStr(value); // already checked by bencValueLength()
+            if (tr_strv_contains(str, oldval))
+            {
+                auto const newstr = replaceSubstr(str, oldval, newval);
+                if (depth == 0)
+                {
+                    fmt::format_to(std::back_inserter(log), "\tReplaced in '{:s}': '{:s}' --> '{:s}'\n", key, str, newstr);
+                }
+                else
+                {
+                    fmt::format_to(
+                        std::back_inserter(log),
+                        "\tReplaced in '{:s}' tier #{:d}: '{:s}' --> '{:s}'\n",
+                        key,
+                        tier,
+                        str,
+                        newstr);
+                }
+
+                fmt::format_to(std::back_inserter(out), "{:d}:{:s}", std::size(newstr), newstr);
+                changed = true;
+            }
+            else
+            {
+                out += value.substr(0, len);
+            }
+
+            value.remove_prefix(len);
+        }
     }
 
-    if (options.show_version)
+    return changed;
+}
+
+// Replace `oldval` in the announce URLs by rewriting only the bytes of the
+// top-level "announce" and "announce-list" values. Everything else, e.g.
+// the info dict, is copied as-is, so the torrent's hash can't change.
+// @return false if `benc` isn't a dict that can be patched this way
+static bool patchAnnounceUrls(
+    std::string_view benc,
+    std::string_view oldval,
+    std::string_view newval,
+    std::string& setme,
+    std::string& log)
+{
+    if (std::empty(benc) || benc.front() != 'd')
     {
-        fmt::print(stderr, "{:s} {:s}\n", MyName, LONG_VERSION_STRING);
-        return EXIT_SUCCESS;
+        return false;
     }
 
-    if (std::empty(options.files))
+    auto out = std::string{};
+    auto copied = size_t{}; // bytes of `benc` that are already in `out`
+    auto pos = size_t{ 1U };
+    auto changed = false;
+
+    while (pos < std::size(benc) && benc[pos] != 'e')
     {
-        fmt::print(stderr, "ERROR: No torrent files specified.\n");
-        tr_getopt_usage(MyName, Usage, std::data(Options));
-        fmt::print(stderr, "\n");
-        return EXIT_FAILURE;
+        auto const key = parseBencStr(benc.substr(pos));
+        if (!key)
+        {
+            return false;
+        }
+        pos += key->second;
+
+        auto const value_len = bencValueLength(benc.substr(pos));
+        if (value_len == 0U)
+        {
+            return false;
+        }
+
+        if (auto const name = key->first; name == "announce"sv || name == "announce-list"sv)
+        {
+            auto patched = std::string{};
+            if (patchBencStrings(name, benc.substr(pos, value_len), oldval, newval, patched, log))
+            {
+                out += benc.substr(copied, pos - copied);
+                out += patched;
+                copied = pos + value_len;
+                changed = true;
+            }
+        }
+
+        pos += value_len;
     }
 
-    if (options.add == nullptr && options.deleteme == nullptr && options.replace[0] == nullptr && options.source == nullptr)
+    if (pos + 1U != std::size(benc))
     {
-        fmt::print(stderr, "ERROR: Must specify -a, -d, -r or -s\n");
-        tr_getopt_usage(MyName, Usage, std::data(Options));
-        fmt::print(stderr, "\n");
-        return EXIT_FAILURE;
+        return false;
     }
 
-    for (auto const& filename : options.files)
+    if (changed)
     {
-        tr_variant top;
-        bool changed = false;
-        tr_error* error = nullptr;
+        out += benc.substr(copied);
+        setme = std::move(out);
+    }
+
+    return true;
+}
+
+// ---
+
+// Add the .torrent files in `path` to `setme`, recursing into directories
+static void collectTorrentFiles(std::string_view path, std::vector<std::string>& setme)
+{
+    auto const info = tr_sys_path_get_info(path);
+    if (!info || !info->isFolder())
+    {
+        setme.emplace_back(path);
+        return;
+    }
 
-        fmt::print("{:s}\n", filename);
+    auto const odir = tr_sys_dir_open(path);
+    if (odir == TR_BAD_SYS_DIR)
+    {
+        return;
+    }
 
-        if (!tr_variantFromFile(&top, TR_VARIANT_PARSE_BENC, filename, &error))
+    for (char const* name; (name = tr_sys_dir_read_name(odir)) != nullptr;)
+    {
+        auto const sv = std::string_view{ name };
+        if (sv == "."sv || sv == ".."sv)
         {
-            fmt::print("\tError reading file: {:s}\n", error->message);
-            tr_error_free(error);
             continue;
         }
 
+        auto const child = tr_pathbuf{ path, '/', sv };
+        if (auto const child_info = tr_sys_path_get_info(child); child_info && child_info->isFolder())
+        {
+            collectTorrentFiles(child, setme);
+        }
+        else if (tr_strv_ends_with(sv, ".torrent"sv))
+        {
+            setme.emplace_back(child.sv());
+        }
+    }
+
+    tr_sys_dir_close(odir);
+}
+
+// @return true if the file was changed
+static bool editFile(app_options const& options, std::string_view filename, std::string& log)
+{
+    tr_error* error = nullptr;
+
+    fmt::format_to(std::back_inserter(log), "{:s}\n", filename);
+
+    auto file = tr_mapped_file{};
+    if (!file.open(filename, &error))
+    {
+        fmt::format_to(std::back_inserter(log), "\tError reading file: {:s}\n", error->message);
+        tr_error_free(error);
+        return false;
+    }
+
+    auto benc = std::string{};
+    auto changed = false;
+
+    // A tracker moving to a new domain only needs its URLs replaced,
+    // which can be done without decoding and re-encoding the whole file
+    if (auto const replace_only = options.add == nullptr && options.deleteme == nullptr && options.source == nullptr;
+        replace_only && patchAnnounceUrls(file.contents(), options.replace[0], options.replace[1], benc, log))
+    {
+        changed = !std::empty(benc);
+    }
+    else
+    {
+        // parse in-place so that the torrent's strings, e.g. its
+        // piece hashes, are used straight from the mapped file
+        tr_variant top;
+        if (!tr_variantFromBuf(&top, TR_VARIANT_PARSE_BENC | TR_VARIANT_PARSE_INPLACE, file.contents(), nullptr, &error))
+        {
+            fmt::format_to(std::back_inserter(log), "\tError reading file: {:s}\n", error->message);
+            tr_error_free(error);
+            return false;
+        }
+
         if (options.deleteme != nullptr)
         {
-            changed |= removeURL(&top, options.deleteme);
+            changed |= removeURL(&top, options.deleteme, log);
         }
 
         if (options.add != nullptr)
         {
-            changed = addURL(&top, options.add);
+            changed = addURL(&top, options.add, log);
         }
 
         if (options.replace[0] != nullptr && options.replace[1] != nullptr)
         {
-            changed |= replaceURL(&top, options.replace[0], options.replace[1]);
+            changed |= replaceURL(&top, options.replace[0], options.replace[1], log);
         }
 
         if (options.source != nullptr)
         {
-            changed = setSource(&top, options.source);
+            changed = setSource(&top, options.source, log);
         }
 
+        // serialize before unmapping
         if (changed)
         {
-            ++changedCount;
-            tr_variantToFile(&top, TR_VARIANT_FMT_BENC, filename);
+            benc = tr_variantToStr(&top, TR_VARIANT_FMT_BENC);
         }
 
         tr_variantClear(&top);
     }
 
-    fmt::print("Changed {:d} files\n", changedCount);
+    if (!changed)
+    {
+        return false;
+    }
+
+    // unmap before replacing the file
+    file.close();
+    if (!tr_file_save(filename, benc, &error))
+    {
+        fmt::format_to(std::back_inserter(log), "\tError writing file: {:s}\n", error->message);
+        tr_error_free(error);
+        return false;
+    }
+
+    return true;
+}
+
+static size_t writeFunc(void* ptr, size_t size, size_t nmemb, void* vbuf)
+{
+    static_cast<std::string*>(vbuf)->append(static_cast<char const*>(ptr), size * nmemb);
+    return size * nmemb;
+}
+
+static size_t parseResponseHeader(void* ptr, size_t size, size_t nmemb, void* vsession_id)
+{
+    auto const line = std::string_view{ static_cast<char const*>(ptr), size * nmemb };
+    auto constexpr Key = std::string_view{ TR_RPC_SESSION_ID_HEADER ": " };
+    if (tr_strv_starts_with(line, Key))
+    {
+        *static_cast<std::string*>(vsession_id) = tr_strv_strip(line.substr(std::size(Key)));
+    }
+
+    return size * nmemb;
+}
+
+// Ask the session at `url` to replace `oldval` in all its torrents' announce URLs
+static bool replaceInSession(char const* url, std::string_view oldval, std::string_view newval)
+{
+    auto request = tr_variant{};
+    tr_variantInitDict(&request, 2);
+    tr_variantDictAddStrView(&request, TR_KEY_method, "torrent-set"sv);
+    auto* const args = tr_variantDictAddDict(&request, TR_KEY_arguments, 1);
+    auto* const replace = tr_variantDictAddList(args, TR_KEY_trackerListReplace, 2);
+    tr_variantListAddStrView(replace, oldval);
+    tr_variantListAddStrView(replace, newval);
+    auto const json = tr_variantToStr(&request, TR_VARIANT_FMT_JSON_LEAN);
+    tr_variantClear(&request);
+
+    auto* const curl = curl_easy_init();
+    auto session_id = std::string{};
+    auto response = std::string{};
+    (void)curl_easy_setopt(curl, CURLOPT_URL, url);
+    (void)curl_easy_setopt(curl, CURLOPT_USERAGENT, fmt::format("{:s}/{:s}", MyName, LONG_VERSION_STRING).c_str());
+    (void)curl_easy_setopt(curl, CURLOPT_POSTFIELDS, json.c_str());
+    (void)curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeFunc);
+    (void)curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
+    (void)curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, parseResponseHeader);
+    (void)curl_easy_setopt(curl, CURLOPT_HEADERDATA, &session_id);
+    (void)curl_easy_setopt(curl, CURLOPT_NETRC, CURL_NETRC_OPTIONAL);
+    (void)curl_easy_setopt(curl, CURLOPT_HTTPAUTH, CURLAUTH_ANY);
+
+    // the first request just fetches the session id
+    auto code = long{};
+    struct curl_slist* headers = nullptr;
+    for (int attempt = 0; attempt < 2; ++attempt)
+    {
+        response.clear();
+        if (auto const res = curl_easy_perform(curl); res != CURLE_OK)
+        {
+            fmt::print(stderr, "ERROR: {:s}: {:s}\n", url, curl_easy_strerror(res));
+            break;
+        }
+
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &code);
+        if (code != 409)
+        {
+            break;
+        }
+
+        curl_slist_free_all(headers);
+        auto const header = fmt::format("{:s}: {:s}", TR_RPC_SESSION_ID_HEADER, session_id);
+        headers = curl_slist_append(nullptr, header.c_str());
+        (void)curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+    }
+
+    curl_easy_cleanup(curl);
+    curl_slist_free_all(headers);
+
+    auto result = std::string_view{};
+    auto top = tr_variant{};
+    auto const ok = code == 200 && tr_variantFromBuf(&top, TR_VARIANT_PARSE_JSON | TR_VARIANT_PARSE_INPLACE, response) &&
+        tr_variantDictFindStrView(&top, TR_KEY_result, &result) && result == "success"sv;
+    if (code != 0 && !ok)
+    {
+        fmt::print(stderr, "ERROR: {:s}: {:d} {:s}\n", url, code, std::empty(result) ? response : result);
+    }
+    else if (ok)
+    {
+        fmt::print("Replaced '{:s}' with '{:s}' in {:s}\n", oldval, newval, url);
+    }
+
+    tr_variantClear(&top);
+    return ok;
+}
+
+int tr_main(int argc, char* argv[])
+{
+    tr_locale_set_global("");
+
+    tr_logSetLevel(TR_LOG_ERROR);
+
+    auto options = app_options{};
+    if (parseCommandLine(options, argc, (char const* const*)argv) != 0)
+    {
+        return EXIT_FAILURE;
+    }
+
+    if (options.show_version)
+    {
+        fmt::print(stderr, "{:s} {:s}\n", MyName, LONG_VERSION_STRING);
+        return EXIT_SUCCESS;
+    }
+
+    if (std::empty(options.files) && options.rpc_url == nullptr)
+    {
+        fmt::print(stderr, "ERROR: No torrent files specified.\n");
+        tr_getopt_usage(MyName, Usage, std::data(Options));
+        fmt::print(stderr, "\n");
+        return EXIT_FAILURE;
+    }
+
+    if (options.add == nullptr && options.deleteme == nullptr && options.replace[0] == nullptr && options.source == nullptr)
+    {
+        fmt::print(stderr, "ERROR: Must specify -a, -d, -r or -s\n");
+        tr_getopt_usage(MyName, Usage, std::data(Options));
+        fmt::print(stderr, "\n");
+        return EXIT_FAILURE;
+    }
+
+    if (options.rpc_url != nullptr && options.replace[0] == nullptr)
+    {
+        fmt::print(stderr, "ERROR: --rpc only works with -r\n");
+        return EXIT_FAILURE;
+    }
+
+    auto status = EXIT_SUCCESS;
+    if (options.rpc_url != nullptr && !replaceInSession(options.rpc_url, options.replace[0], options.replace[1]))
+    {
+        status = EXIT_FAILURE;
+    }
+
+    auto filenames = std::vector<std::string>{};
+    for (auto const& path : options.files)
+    {
+        collectTorrentFiles(path, filenames);
+    }
+
+    // Each file is edited and written on its own, so they can be done in
+    // parallel. A file's messages are printed together when it's done.
+    auto next = std::atomic<size_t>{};
+    auto changed_count = std::atomic<size_t>{};
+    auto output_mutex = std::mutex{};
+    auto const work = [&]()
+    {
+        auto log = std::string{};
+        for (auto idx = next++; idx < std::size(filenames); idx = next++)
+        {
+            log.clear();
+            if (editFile(options, filenames[idx], log))
+            {
+                ++changed_count;
+            }
+
+            auto const lock = std::lock_guard{ output_mutex };
+            fmt::print("{:s}", log);
+        }
+    };
+
+    auto const n_jobs = std::min(options.n_jobs, std::max(std::size(filenames), size_t{ 1U }));
+    auto threads = std::vector<std::thread>{};
+    threads.reserve(n_jobs - 1U);
+    for (size_t i = 1U; i < n_jobs; ++i)
+    {
+        threads.emplace_back(work);
+    }
+    work();
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    if (!std::empty(filenames))
+    {
+        fmt::print("Changed {:d} files\n", changed_count.load());
+    }
 
-    return EXIT_SUCCESS;
+    return status;
 }
@@ -12,11 +12,16 @@
 #include <cstdint> // int64_t
 #include <cstdio>
 #include <cstdlib>
+#include <chrono>
 #include <cstring> /* strcmp */
 #include <ctime>
+#include <fstream>
+#include <iostream>
 #include <set>
 #include <string>
 #include <string_view>
+#include <thread>
+#include <utility>
 #include <vector>
 
 #include <curl/curl.h>
@@ -88,6 +93,13 @@ struct Config
     std::string torrent_ids;
     std::string unix_socket_path;
 
+    // Reused for every request so that its connection stays open, which
+    // saves a TCP (and maybe TLS) handshake per command in --batch mode.
+    CURL* curl = nullptr;
+
+    // the delta-token for --watch's next torrent-get
+    int64_t delta_token = 0;
+
     bool debug = false;
     bool json = false;
     bool use_ssl = false;
@@ -228,7 +240,8 @@ enum
     TAG_PIECES,
     TAG_PORTTEST,
     TAG_TORRENT_ADD,
-    TAG_TRACKERS
+    TAG_TRACKERS,
+    TAG_WATCH
 };
 
 /***
@@ -237,7 +250,7 @@ enum
 ****
 ***/
 
-static auto constexpr Options = std::array<tr_option, 98>{
+static auto constexpr Options = std::array<tr_option, 100>{
     { { 'a', "add", "Add torrent files by filename or URL", "a", false, nullptr },
       { 970, "alt-speed", "Use the alternate Limits", "as", false, nullptr },
       { 971, "no-alt-speed", "Don't use the alternate Limits", "AS", false, nullptr },
@@ -252,6 +265,12 @@ static auto constexpr Options = std::array<tr_option, 98>{
       { 'c', "incomplete-dir", "Where to store new torrents until they're complete", "c", true, "<dir>" },
       { 'C', "no-incomplete-dir", "Don't store incomplete torrents in a different location", "C", false, nullptr },
       { 'b', "debug", "Print debugging information", "b", false, nullptr },
+      { 994,
+        "batch",
+        "Run the commands in a file (\"-\" for stdin), one command line per line, over one connection",
+        nullptr,
+        true,
+        "<file>" },
       { 730, "bandwidth-group", "Set the current torrents' bandwidth group", "bwg", true, "<group>" },
       { 731, "no-bandwidth-group", "Reset the current torrents' bandwidth group", "nwg", false, nullptr },
       { 732, "list-groups", "Show bandwidth groups with their parameters", "lg", false, nullptr },
@@ -354,6 +373,12 @@ static auto constexpr Options = std::array<tr_option, 98>{
       { 831, "no-utp", "Disable µTP for peer connections", nullptr, false, nullptr },
       { 'v', "verify", "Verify the current torrent(s)", "v", false, nullptr },
       { 'V', "version", "Show version number and exit", "V", false, nullptr },
+      { 995,
+        "watch",
+        "Print the current torrent(s)' changes as newline-delimited JSON, checking every <seconds>",
+        nullptr,
+        true,
+        "<seconds>" },
       { 'w',
         "download-dir",
         "When used in conjunction with --add, set the new torrent's download folder. "
@@ -426,6 +451,8 @@ static int getOptMode(int val)
     case 't': /* set current torrent */
     case 'V': /* show version number */
     case 944: /* print selected torrents' ids */
+    case 994: /* batch */
+    case 995: /* watch */
         return 0;
 
     case 'c': /* incomplete-dir */
@@ -2147,7 +2174,50 @@ static void filterIds(tr_variant* top, Config& config)
         }
     }
 }
-static int processResponse(char const* rpcurl, std::string_view response, Config& config)
+// Print each torrent in a --watch response as a line of JSON
+static void printWatch(tr_variant* top, Config& config)
+{
+    tr_variant* args = nullptr;
+    if (!tr_variantDictFindDict(top, Arguments, &args))
+    {
+        return;
+    }
+
+    if (auto token = int64_t{}; tr_variantDictFindInt(args, TR_KEY_delta_token, &token))
+    {
+        config.delta_token = token;
+    }
+
+    // the torrents that follow are a full snapshot, not changes
+    if (auto full = bool{}; tr_variantDictFindBool(args, TR_KEY_delta_full, &full) && full)
+    {
+        fmt::print("{{\"delta-full\":true}}\n");
+    }
+
+    tr_variant* list = nullptr;
+    if (tr_variantDictFindList(args, TR_KEY_removed, &list))
+    {
+        for (size_t i = 0, n = tr_variantListSize(list); i < n; ++i)
+        {
+            if (auto id = int64_t{}; tr_variantGetInt(tr_variantListChild(list, i), &id))
+            {
+                fmt::print("{{\"id\":{:d},\"removed\":true}}\n", id);
+            }
+        }
+    }
+
+    if (tr_variantDictFindList(args, TR_KEY_torrents, &list))
+    {
+        for (size_t i = 0, n = tr_variantListSize(list); i < n; ++i)
+        {
+            fmt::print("{:s}\n", tr_variantToStr(tr_variantListChild(list, i), TR_VARIANT_FMT_JSON_LEAN));
+        }
+    }
+
+    std::fflush(stdout);
+}
+
+static int processResponse(char const* rpcurl, std::string_view response, bool is_benc, Config& config)
 {
     auto top = tr_variant{};
     auto status = int{ EXIT_SUCCESS };
@@ -2163,7 +2233,8 @@ static int processResponse(char const* rpcurl, std::string_view response, Config
         return status;
     }
 
-    if (!tr_variantFromBuf(&top, TR_VARIANT_PARSE_JSON | TR_VARIANT_PARSE_INPLACE, response))
+    auto const parse_opts = (is_benc ? TR_VARIANT_PARSE_BENC : TR_VARIANT_PARSE_JSON) | TR_VARIANT_PARSE_INPLACE;
+    if (!tr_variantFromBuf(&top, parse_opts, response))
     {
         tr_logAddWarn(fmt::format("Unable to parse response '{}'", response));
         status |= EXIT_FAILURE;
@@ -2230,6 +2301,10 @@ static int processResponse(char const* rpcurl, std::string_view response, Config
                     filterIds(&top, config);
                     break;
 
+                case TAG_WATCH:
+                    printWatch(&top, config);
+                    break;
+
                 case TAG_TORRENT_ADD:
                     {
                         int64_t i;
@@ -2271,9 +2346,15 @@ static int processResponse(char const* rpcurl, std::string_view response, Config
     return status;
 }
 
-static CURL* tr_curl_easy_init(struct evbuffer* writebuf, Config& config)
+static CURL* tr_curl_easy_init(struct evbuffer* writebuf, bool accept_benc, Config& config)
 {
-    CURL* curl = curl_easy_init();
+    if (config.curl == nullptr)
+    {
+        config.curl = curl_easy_init();
+    }
+
+    // (re)apply every option, since earlier arguments may have changed them
+    CURL* curl = config.curl;
     (void)curl_easy_setopt(curl, CURLOPT_USERAGENT, fmt::format(FMT_STRING("{:s}/{:s}"), MyName, LONG_VERSION_STRING).c_str());
     (void)curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeFunc);
     (void)curl_easy_setopt(curl, CURLOPT_WRITEDATA, writebuf);
@@ -2312,13 +2393,27 @@ static CURL* tr_curl_easy_init(struct evbuffer* writebuf, Config& config)
         (void)curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0);
     }
 
+    struct curl_slist* old_headers = nullptr;
+    curl_easy_getinfo(curl, CURLINFO_PRIVATE, &old_headers);
+
+    struct curl_slist* custom_headers = nullptr;
     if (auto const& str = config.session_id; !std::empty(str))
     {
         auto const h = fmt::format(FMT_STRING("{:s}: {:s}"), TR_RPC_SESSION_ID_HEADER, str);
-        auto* const custom_headers = curl_slist_append(nullptr, h.c_str());
+        custom_headers = curl_slist_append(custom_headers, h.c_str());
+    }
 
-        (void)curl_easy_setopt(curl, CURLOPT_HTTPHEADER, custom_headers);
-        (void)curl_easy_setopt(curl, CURLOPT_PRIVATE, custom_headers);
+    if (accept_benc)
+    {
+        custom_headers = curl_slist_append(custom_headers, "Accept: " TR_RPC_BENC_CONTENT_TYPE);
+    }
+
+    (void)curl_easy_setopt(curl, CURLOPT_HTTPHEADER, custom_headers);
+    (void)curl_easy_setopt(curl, CURLOPT_PRIVATE, custom_headers);
+
+    if (old_headers != nullptr)
+    {
+        curl_slist_free_all(old_headers);
     }
 
     return curl;
@@ -2345,7 +2440,13 @@ static int flush(char const* rpcurl, tr_variant* benc, Config& config)
     auto const rpcurl_http = fmt::format(FMT_STRING("{:s}://{:s}"), scheme, rpcurl);
 
     auto* const buf = evbuffer_new();
-    auto* curl = tr_curl_easy_init(buf, config);
+    // Bencoded responses are smaller and quicker to parse. But --json and
+    // --debug print the response as-is, and --watch prints it as JSON, which
+    // benc's lack of booleans and reals would change, so those keep JSON.
+    auto tag = int64_t{};
+    auto const accept_benc = !config.json && !config.debug &&
+        !(tr_variantDictFindInt(benc, TR_KEY_tag, &tag) && tag == TAG_WATCH);
+    auto* curl = tr_curl_easy_init(buf, accept_benc, config);
     (void)curl_easy_setopt(curl, CURLOPT_URL, rpcurl_http.c_str());
     (void)curl_easy_setopt(curl, CURLOPT_POSTFIELDS, json.c_str());
     (void)curl_easy_setopt(curl, CURLOPT_TIMEOUT, getTimeoutSecs(json));
@@ -2368,20 +2469,27 @@ static int flush(char const* rpcurl, tr_variant* benc, Config& config)
         switch (response)
         {
         case 200:
+        {
+            // servers that don't know benc answer in JSON
+            char* content_type = nullptr;
+            curl_easy_getinfo(curl, CURLINFO_CONTENT_TYPE, &content_type);
+            auto const is_benc = content_type != nullptr &&
+                tr_strv_contains(content_type, std::string_view{ TR_RPC_BENC_CONTENT_TYPE });
+
             status |= processResponse(
                 rpcurl,
                 std::string_view{ reinterpret_cast<char const*>(evbuffer_pullup(buf, -1)), evbuffer_get_length(buf) },
+                is_benc,
                 config);
             break;
+        }
 
         case 409:
             /* Session id failed. Our curl header func has already
              * pulled the new session id from this response's headers,
-             * build a new CURL* and try again */
-            tr_curl_easy_cleanup(curl);
-            curl = nullptr;
-            status |= flush(rpcurl, benc, config);
-            break;
+             * so try again */
+            evbuffer_free(buf);
+            return flush(rpcurl, benc, config);
 
         default:
             evbuffer_add(buf, "", 1);
@@ -2394,11 +2502,6 @@ static int flush(char const* rpcurl, tr_variant* benc, Config& config)
     /* cleanup */
     evbuffer_free(buf);
 
-    if (curl != nullptr)
-    {
-        tr_curl_easy_cleanup(curl);
-    }
-
     tr_variantClear(benc);
 
     return status;
@@ -2428,6 +2531,138 @@ static tr_variant* ensure_tset(tr_variant* tset)
     return tr_variantDictAddDict(tset, Arguments, 1);
 }
 
+static int processArgs(char const* rpcurl, int argc, char const* const* argv, Config& config);
+
+// Split a --batch line into arguments. Double quotes group words
+// and a backslash escapes the next character.
+static std::vector<std::string> splitCommandLine(std::string_view line)
+{
+    auto args = std::vector<std::string>{};
+    auto arg = std::string{};
+    auto in_arg = false;
+    auto in_quotes = false;
+
+    for (size_t i = 0; i < std::size(line); ++i)
+    {
+        auto const ch = line[i];
+
+        if (ch == '\\' && i + 1 < std::size(line))
+        {
+            arg += line[++i];
+            in_arg = true;
+        }
+        else if (ch == '"')
+        {
+            in_quotes = !in_quotes;
+            in_arg = true;
+        }
+        else if (!in_quotes && isspace(static_cast<unsigned char>(ch)) != 0)
+        {
+            if (in_arg)
+            {
+                args.emplace_back(std::move(arg));
+                arg.clear();
+                in_arg = false;
+            }
+        }
+        else
+        {
+            arg += ch;
+            in_arg = true;
+        }
+    }
+
+    if (in_arg)
+    {
+        args.emplace_back(std::move(arg));
+    }
+
+    return args;
+}
+
+// Run each line of `filename` as if it were this program's arguments,
+// sharing one connection and session id. Blank lines and lines that
+// start with '#' are skipped.
+static int runBatch(char const* rpcurl, char const* filename, Config& config)
+{
+    auto file = std::ifstream{};
+    auto const from_stdin = std::string_view{ filename } == "-"sv;
+    if (!from_stdin)
+    {
+        file.open(filename);
+        if (!file)
+        {
+            fmt::print(stderr, "Couldn't open '{:s}'\n", filename);
+            return EXIT_FAILURE;
+        }
+    }
+
+    auto& in = from_stdin ? std::cin : file;
+    auto status = int{ EXIT_SUCCESS };
+    auto const saved_optind = tr_optind;
+
+    for (auto line = std::string{}; std::getline(in, line);)
+    {
+        if (auto const stripped = tr_strv_strip(line); std::empty(stripped) || stripped.front() == '#')
+        {
+            continue;
+        }
+
+        auto const args = splitCommandLine(line);
+
+        auto argv = std::vector<char const*>{ MyName };
+        for (auto const& arg : args)
+        {
+            argv.push_back(arg.c_str());
+        }
+
+        // each line starts with the torrents that the batch started with
+        auto line_config = config;
+        tr_optind = 1;
+        status |= processArgs(rpcurl, static_cast<int>(std::size(argv)), std::data(argv), line_config);
+        config.curl = line_config.curl;
+        config.session_id = line_config.session_id;
+
+        std::fflush(stdout);
+    }
+
+    tr_optind = saved_optind;
+    return status;
+}
+
+// Print the current torrent(s)' changes as newline-delimited JSON until
+// the daemon goes away. torrent-get's delta-token keeps each poll down
+// to the torrents and fields that changed.
+static int watchTorrents(char const* rpcurl, std::chrono::seconds interval, Config& config)
+{
+    auto const json = std::exchange(config.json, false);
+    config.delta_token = 0;
+
+    for (;;)
+    {
+        auto top = tr_variant{};
+        tr_variantInitDict(&top, 3);
+        tr_variantDictAddStrView(&top, TR_KEY_method, "torrent-get"sv);
+        tr_variantDictAddInt(&top, TR_KEY_tag, TAG_WATCH);
+        auto* const args = tr_variantDictAddDict(&top, Arguments, 3);
+        auto* const fields = tr_variantDictAddList(args, TR_KEY_fields, std::size(ListKeys));
+        for (auto const key : ListKeys)
+        {
+            tr_variantListAddQuark(fields, key);
+        }
+        tr_variantDictAddInt(args, TR_KEY_delta_token, config.delta_token);
+        addIdArg(args, config, "all"sv);
+
+        if (auto const status = flush(rpcurl, &top, config); status != EXIT_SUCCESS)
+        {
+            config.json = json;
+            return status;
+        }
+
+        std::this_thread::sleep_for(interval);
+    }
+}
+
 static int processArgs(char const* rpcurl, int argc, char const* const* argv, Config& config)
 {
     int status = EXIT_SUCCESS;
@@ -2477,6 +2712,28 @@ static int processArgs(char const* rpcurl, int argc, char const* const* argv, Co
                 config.debug = true;
                 break;
 
+            case 994: /* batch */
+            case 995: /* watch */
+                if (!tr_variantIsEmpty(&tadd))
+                {
+                    status |= flush(rpcurl, &tadd, config);
+                }
+
+                if (!tr_variantIsEmpty(&tset))
+                {
+                    addIdArg(tr_variantDictFind(&tset, Arguments), config);
+                    status |= flush(rpcurl, &tset, config);
+                }
+
+                if (!tr_variantIsEmpty(&sset))
+                {
+                    status |= flush(rpcurl, &sset, config);
+                }
+
+                status |= c == 994 ? runBatch(rpcurl, optarg, config) :
+                                     watchTorrents(rpcurl, std::chrono::seconds{ std::max(numarg(optarg), 1L) }, config);
+                break;
+
             case 'j': /* return output as JSON */
                 config.json = true;
                 break;
@@ -3348,5 +3605,12 @@ int tr_main(int argc, char* argv[])
         rpcurl = fmt::format(FMT_STRING("{:s}:{:d}{:s}"), host, port, DefaultUrl);
     }
 
-    return processArgs(rpcurl.c_str(), argc, (char const* const*)argv, config);
+    auto const status = processArgs(rpcurl.c_str(), argc, (char const* const*)argv, config);
+
+    if (config.curl != nullptr)
+    {
+        tr_curl_easy_cleanup(config.curl);
+    }
+
+    return status;
 }
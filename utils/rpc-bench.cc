@@ -0,0 +1,923 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+// Sends a mix of RPC requests to a session at a target rate and reports
+// their latency and what they cost the session in CPU time.
+//
+// It can either load an existing daemon or start a session in-process
+// with a synthetic library of paused torrents, which makes it easy to
+// see how RPC scales with the number of torrents.
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef> // size_t
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <future>
+#include <optional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <time.h> // clock_gettime()
+#include <unistd.h> // sysconf()
+
+#include <curl/curl.h>
+
+#include <event2/util.h> // evutil_ascii_strncasecmp()
+
+#include <fmt/core.h>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/file.h>
+#include <libtransmission/log.h>
+#include <libtransmission/quark.h>
+#include <libtransmission/session.h>
+#include <libtransmission/tr-getopt.h>
+#include <libtransmission/utils.h>
+#include <libtransmission/variant.h>
+#include <libtransmission/version.h>
+
+using namespace std::literals;
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+char constexpr MyName[] = "transmission-rpc-bench";
+char constexpr Usage[] = "Usage: transmission-rpc-bench [options]";
+
+auto constexpr Options = std::array<tr_option, 12>{
+    { { 'u', "url", "URL of the RPC server (default: http://localhost:9091/transmission/rpc)", "u", true, "<url>" },
+      { 'n', "auth", "Set username and password", "n", true, "<user:pw>" },
+      { 'r', "rate", "Requests per second to aim for; 0 to send them back-to-back (default: 100)", "r", true, "<count>" },
+      { 'c', "concurrency", "Requests in flight at most (default: 8)", "c", true, "<count>" },
+      { 'd', "duration", "How long to run, in seconds (default: 30)", "d", true, "<seconds>" },
+      { 'm', "mix", "Weights of the request kinds (default: list:50,active:20,details:15,stats:10,set:5)", "m", true, "<mix>" },
+      { 's', "synthetic", "Start a session in-process with this many synthetic torrents and load it instead", "s", true, "<count>" },
+      { 'p', "port", "RPC port of the synthetic session (default: 9092)", "p", true, "<port>" },
+      { 'P', "pid", "Report this process's CPU time, e.g. the daemon's", "P", true, "<pid>" },
+      { 'S', "seed", "Seed for picking requests and torrents, so that runs are repeatable", "S", true, "<seed>" },
+      { 'V', "version", "Show version number and exit", "V", false, nullptr },
+      { 0, nullptr, nullptr, nullptr, false, nullptr } }
+};
+
+// The kinds of request that dashboards typically send
+enum class Kind
+{
+    List, // torrent-get of every torrent with the fields that a torrent list shows
+    Active, // the same, for the "recently-active" torrents, as a polling client does
+    Details, // torrent-get of a few torrents with the fields that a details view shows
+    Stats, // session-stats
+    Set, // torrent-set of one torrent's priority
+    N_Kinds
+};
+
+auto constexpr KindNames = std::array<std::string_view, static_cast<size_t>(Kind::N_Kinds)>{
+    "list"sv,
+    "active"sv,
+    "details"sv,
+    "stats"sv,
+    "set"sv,
+};
+
+// clang-format off
+
+auto constexpr ListFields = std::array<std::string_view, 14>{
+    "id"sv,
+    "name"sv,
+    "status"sv,
+    "error"sv,
+    "errorString"sv,
+    "eta"sv,
+    "percentDone"sv,
+    "rateDownload"sv,
+    "rateUpload"sv,
+    "sizeWhenDone"sv,
+    "uploadRatio"sv,
+    "peersConnected"sv,
+    "queuePosition"sv,
+    "labels"sv,
+};
+
+auto constexpr DetailsFields = std::array<std::string_view, 20>{
+    "id"sv,
+    "name"sv,
+    "activityDate"sv,
+    "addedDate"sv,
+    "comment"sv,
+    "creator"sv,
+    "downloadDir"sv,
+    "downloadedEver"sv,
+    "files"sv,
+    "fileStats"sv,
+    "hashString"sv,
+    "haveValid"sv,
+    "peers"sv,
+    "pieceCount"sv,
+    "pieceSize"sv,
+    "priorities"sv,
+    "totalSize"sv,
+    "trackerStats"sv,
+    "uploadedEver"sv,
+    "wanted"sv,
+};
+
+// clang-format on
+
+struct app_options
+{
+    std::string url = "http://localhost:" TR_DEFAULT_RPC_PORT_STR TR_DEFAULT_RPC_URL_STR "rpc";
+    std::string auth;
+    double rate = 100.0;
+    size_t concurrency = 8U;
+    std::chrono::seconds duration = 30s;
+    std::array<unsigned, static_cast<size_t>(Kind::N_Kinds)> weights = { 50U, 20U, 15U, 10U, 5U };
+    size_t n_synthetic = 0U;
+    uint16_t port = 9092U;
+    long pid = 0;
+    uint32_t seed = 1U;
+    bool show_version = false;
+};
+
+bool parse_mix(app_options& opts, std::string_view mix)
+{
+    opts.weights = {};
+
+    auto token = std::string_view{};
+    while (tr_strv_sep(&mix, &token, ','))
+    {
+        auto const name = tr_strv_sep(&token, ':');
+        auto const iter = std::find(std::begin(KindNames), std::end(KindNames), tr_strv_strip(name));
+        auto const weight = tr_num_parse<unsigned>(tr_strv_strip(token));
+        if (iter == std::end(KindNames) || !weight)
+        {
+            fmt::print(stderr, "Couldn't parse mix entry '{:s}'\n", name);
+            return false;
+        }
+
+        opts.weights[iter - std::begin(KindNames)] = *weight;
+    }
+
+    return std::any_of(std::begin(opts.weights), std::end(opts.weights), [](auto weight) { return weight > 0U; });
+}
+
+int parse_command_line(app_options& opts, int argc, char const* const* argv)
+{
+    int c;
+    char const* optarg;
+
+    while ((c = tr_getopt(Usage, argc, argv, std::data(Options), &optarg)) != TR_OPT_DONE)
+    {
+        switch (c)
+        {
+        case 'u':
+            opts.url = optarg;
+            break;
+
+        case 'n':
+            opts.auth = optarg;
+            break;
+
+        case 'r':
+            opts.rate = std::max(0.0, tr_num_parse<double>(optarg).value_or(opts.rate));
+            break;
+
+        case 'c':
+            opts.concurrency = std::max(size_t{ 1U }, tr_num_parse<size_t>(optarg).value_or(opts.concurrency));
+            break;
+
+        case 'd':
+            opts.duration = std::chrono::seconds{ tr_num_parse<uint32_t>(optarg).value_or(30U) };
+            break;
+
+        case 'm':
+            if (!parse_mix(opts, optarg))
+            {
+                return 1;
+            }
+            break;
+
+        case 's':
+            opts.n_synthetic = tr_num_parse<size_t>(optarg).value_or(0U);
+            break;
+
+        case 'p':
+            opts.port = tr_num_parse<uint16_t>(optarg).value_or(opts.port);
+            break;
+
+        case 'P':
+            opts.pid = tr_num_parse<long>(optarg).value_or(0);
+            break;
+
+        case 'S':
+            opts.seed = tr_num_parse<uint32_t>(optarg).value_or(opts.seed);
+            break;
+
+        case 'V':
+            opts.show_version = true;
+            break;
+
+        default:
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+// ---
+
+[[nodiscard]] std::chrono::nanoseconds thread_cpu_time()
+{
+    auto ts = timespec{};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return std::chrono::seconds{ ts.tv_sec } + std::chrono::nanoseconds{ ts.tv_nsec };
+}
+
+// @return the user + system CPU time of another process, if the OS says
+[[nodiscard]] std::optional<std::chrono::nanoseconds> process_cpu_time([[maybe_unused]] long pid)
+{
+#ifdef __linux__
+    auto contents = std::vector<char>{};
+    if (!tr_file_read(fmt::format("/proc/{:d}/stat", pid), contents))
+    {
+        return {};
+    }
+
+    // skip past the command name, which may contain spaces;
+    // utime and stime are the 12th and 13th fields after it
+    auto sv = std::string_view{ std::data(contents), std::size(contents) };
+    if (auto const pos = sv.rfind(')'); pos != std::string_view::npos)
+    {
+        sv.remove_prefix(pos + 2U);
+    }
+
+    auto ticks = uint64_t{};
+    for (size_t i = 0U; i < 13U && !std::empty(sv); ++i)
+    {
+        auto const token = tr_strv_sep(&sv, ' ');
+        if (i >= 11U)
+        {
+            ticks += tr_num_parse<uint64_t>(token).value_or(0U);
+        }
+    }
+
+    return std::chrono::nanoseconds{ ticks * std::nano::den / sysconf(_SC_CLK_TCK) };
+#else
+    return {};
+#endif
+}
+
+// ---
+
+void remove_recursive(std::string const& path)
+{
+    if (auto const info = tr_sys_path_get_info(path); info && info->isFolder())
+    {
+        if (auto const odir = tr_sys_dir_open(path); odir != TR_BAD_SYS_DIR)
+        {
+            for (char const* name = nullptr; (name = tr_sys_dir_read_name(odir)) != nullptr;)
+            {
+                if ("."sv != name && ".."sv != name)
+                {
+                    remove_recursive(fmt::format("{:s}/{:s}", path, name));
+                }
+            }
+
+            tr_sys_dir_close(odir);
+        }
+    }
+
+    tr_sys_path_remove(path);
+}
+
+// A session in a temporary directory that serves RPC for a library of
+// paused torrents. Their data is never on disk, so nothing is verified.
+class SyntheticSession
+{
+public:
+    explicit SyntheticSession(app_options const& opts)
+        : sandbox_dir_{ create_sandbox() }
+    {
+        auto const download_dir = tr_pathbuf{ sandbox_dir_, "/Downloads"sv };
+        tr_sys_dir_create(download_dir, TR_SYS_DIR_CREATE_PARENTS, 0700);
+
+        auto settings = tr_variant{};
+        tr_variantInitDict(&settings, 12U);
+        tr_variantDictAddStr(&settings, TR_KEY_download_dir, download_dir);
+        tr_variantDictAddBool(&settings, TR_KEY_dht_enabled, false);
+        tr_variantDictAddBool(&settings, TR_KEY_lpd_enabled, false);
+        tr_variantDictAddBool(&settings, TR_KEY_pex_enabled, false);
+        tr_variantDictAddBool(&settings, TR_KEY_utp_enabled, false);
+        tr_variantDictAddBool(&settings, TR_KEY_port_forwarding_enabled, false);
+        tr_variantDictAddBool(&settings, TR_KEY_peer_port_random_on_start, true);
+        tr_variantDictAddBool(&settings, TR_KEY_rpc_enabled, true);
+        tr_variantDictAddStr(&settings, TR_KEY_rpc_bind_address, "127.0.0.1"sv);
+        tr_variantDictAddInt(&settings, TR_KEY_rpc_port, opts.port);
+        tr_variantDictAddInt(&settings, TR_KEY_message_level, TR_LOG_ERROR);
+        session_ = tr_sessionInit(sandbox_dir_.c_str(), false, &settings);
+        tr_variantClear(&settings);
+
+        add_torrents(opts.n_synthetic, opts.seed);
+    }
+
+    ~SyntheticSession()
+    {
+        tr_sessionClose(session_);
+        remove_recursive(sandbox_dir_);
+    }
+
+    SyntheticSession(SyntheticSession const&) = delete;
+    SyntheticSession(SyntheticSession&&) = delete;
+    SyntheticSession& operator=(SyntheticSession const&) = delete;
+    SyntheticSession& operator=(SyntheticSession&&) = delete;
+
+    // @return how much CPU time the session thread has used
+    [[nodiscard]] std::chrono::nanoseconds session_thread_cpu_time()
+    {
+        auto promise = std::promise<std::chrono::nanoseconds>{};
+        auto future = promise.get_future();
+        session_->runInSessionThread([&promise]() { promise.set_value(thread_cpu_time()); });
+        return future.get();
+    }
+
+private:
+    static auto constexpr NFiles = size_t{ 8U };
+    static auto constexpr NPieces = size_t{ 64U };
+    static auto constexpr PieceSize = uint32_t{ 256U * 1024U };
+
+    [[nodiscard]] static std::string create_sandbox()
+    {
+        auto const* const tmpdir = getenv("TMPDIR");
+        auto path = fmt::format("{:s}/transmission-rpc-bench-XXXXXX", tmpdir != nullptr ? tmpdir : "/tmp");
+        tr_sys_dir_create_temp(std::data(path));
+        return path;
+    }
+
+    // Each torrent has a few files and a tracker, so that a details
+    // request has about as much to say about it as about a real one
+    [[nodiscard]] static std::string make_metainfo(size_t n, std::mt19937& rng)
+    {
+        auto pieces = std::string(NPieces * sizeof(tr_sha1_digest_t), '\0');
+        std::generate(std::begin(pieces), std::end(pieces), [&rng]() { return static_cast<char>(rng()); });
+
+        auto top = tr_variant{};
+        tr_variantInitDict(&top, 2U);
+        tr_variantDictAddStr(&top, TR_KEY_announce, "https://example.com/announce"sv);
+
+        auto* const info = tr_variantDictAddDict(&top, TR_KEY_info, 4U);
+        tr_variantDictAddStr(info, TR_KEY_name, fmt::format("synthetic-{:06d}", n));
+        tr_variantDictAddInt(info, TR_KEY_piece_length, PieceSize);
+        tr_variantDictAddRaw(info, TR_KEY_pieces, std::data(pieces), std::size(pieces));
+
+        auto* const files = tr_variantDictAddList(info, TR_KEY_files, NFiles);
+        for (size_t i = 0U; i < NFiles; ++i)
+        {
+            auto* const file = tr_variantListAddDict(files, 2U);
+            tr_variantDictAddInt(file, TR_KEY_length, uint64_t{ NPieces } * PieceSize / NFiles);
+            auto* const path = tr_variantDictAddList(file, TR_KEY_path, 1U);
+            tr_variantListAddStr(path, fmt::format("file-{:02d}.bin", i));
+        }
+
+        auto benc = tr_variantToStr(&top, TR_VARIANT_FMT_BENC);
+        tr_variantClear(&top);
+        return benc;
+    }
+
+    void add_torrents(size_t n_torrents, uint32_t seed)
+    {
+        auto rng = std::mt19937{ seed };
+        auto* const ctor = tr_ctorNew(session_);
+        tr_ctorSetPaused(ctor, TR_FORCE, true);
+
+        for (size_t n = 0U; n < n_torrents; ++n)
+        {
+            auto const benc = make_metainfo(n, rng);
+            if (tr_ctorSetMetainfo(ctor, std::data(benc), std::size(benc), nullptr))
+            {
+                tr_torrentNew(ctor, nullptr);
+            }
+
+            if ((n + 1U) % 10000U == 0U)
+            {
+                fmt::print(stderr, "added {:d} of {:d} torrents\n", n + 1U, n_torrents);
+            }
+        }
+
+        tr_ctorFree(ctor);
+    }
+
+    std::string const sandbox_dir_;
+    tr_session* session_ = nullptr;
+};
+
+// ---
+
+class Bench
+{
+public:
+    explicit Bench(app_options const& opts)
+        : opts_{ opts }
+        , rng_{ opts.seed }
+        , multi_{ curl_multi_init() }
+    {
+        for (auto const weight : opts.weights)
+        {
+            total_weight_ += weight;
+        }
+    }
+
+    ~Bench()
+    {
+        for (auto& slot : slots_)
+        {
+            curl_multi_remove_handle(multi_, slot.easy);
+            curl_easy_cleanup(slot.easy);
+            curl_slist_free_all(slot.headers);
+        }
+
+        curl_multi_cleanup(multi_);
+    }
+
+    Bench(Bench const&) = delete;
+    Bench(Bench&&) = delete;
+    Bench& operator=(Bench const&) = delete;
+    Bench& operator=(Bench&&) = delete;
+
+    // Ask for the torrents' ids, which torrent-get and torrent-set need
+    bool fetch_ids()
+    {
+        slots_.resize(1U);
+        auto& slot = slots_.front();
+        slot.body = R"({"method":"torrent-get","arguments":{"fields":["id"]}})";
+
+        for (int attempt = 0; attempt < 2; ++attempt)
+        {
+            prepare(slot);
+            if (auto const res = curl_easy_perform(slot.easy); res != CURLE_OK)
+            {
+                fmt::print(stderr, "Couldn't connect to {:s}: {:s}\n", opts_.url, curl_easy_strerror(res));
+                return false;
+            }
+
+            if (response_code(slot) != 409)
+            {
+                break;
+            }
+        }
+
+        auto top = tr_variant{};
+        tr_variant* args = nullptr;
+        tr_variant* torrents = nullptr;
+        if (response_code(slot) != 200 || !tr_variantFromBuf(&top, TR_VARIANT_PARSE_JSON, slot.response) ||
+            !tr_variantDictFindDict(&top, TR_KEY_arguments, &args) || !tr_variantDictFindList(args, TR_KEY_torrents, &torrents))
+        {
+            fmt::print(stderr, "Couldn't get the torrent list from {:s} (HTTP {:d})\n", opts_.url, response_code(slot));
+            return false;
+        }
+
+        for (size_t i = 0U, n = tr_variantListSize(torrents); i < n; ++i)
+        {
+            if (auto id = int64_t{}; tr_variantDictFindInt(tr_variantListChild(torrents, i), TR_KEY_id, &id))
+            {
+                ids_.push_back(id);
+            }
+        }
+
+        tr_variantClear(&top);
+        return true;
+    }
+
+    [[nodiscard]] auto n_torrents() const noexcept
+    {
+        return std::size(ids_);
+    }
+
+    void run()
+    {
+        slots_.resize(opts_.concurrency);
+
+        // In an open loop, each request has a time at which it's due and its
+        // latency counts from then, even if it had to wait for a free slot.
+        // Otherwise a slow server would lower the rate instead of showing up
+        // in the latencies.
+        auto const interval = opts_.rate > 0.0 ? std::chrono::duration_cast<Clock::duration>(
+                                                     std::chrono::duration<double>{ 1.0 / opts_.rate }) :
+                                                 Clock::duration{};
+        started_at_ = Clock::now();
+        auto const ends_at = started_at_ + opts_.duration;
+        auto next_due = started_at_;
+
+        for (;;)
+        {
+            auto const now = Clock::now();
+            auto n_busy = size_t{};
+
+            for (auto& slot : slots_)
+            {
+                if (!slot.busy && now < ends_at && (opts_.rate <= 0.0 || next_due <= now))
+                {
+                    start(slot, pick_kind(), opts_.rate > 0.0 ? next_due : now);
+                    next_due += interval;
+                }
+
+                n_busy += slot.busy ? 1U : 0U;
+            }
+
+            if (n_busy == 0U && now >= ends_at)
+            {
+                break;
+            }
+
+            auto n_running = int{};
+            curl_multi_perform(multi_, &n_running);
+            for (auto n_msgs = int{}; auto const* const msg = curl_multi_info_read(multi_, &n_msgs);)
+            {
+                if (msg->msg == CURLMSG_DONE)
+                {
+                    on_done(*find_slot(msg->easy_handle), msg->data.result);
+                }
+            }
+
+            auto wait_msec = 100;
+            if (opts_.rate > 0.0 && next_due > now)
+            {
+                wait_msec = static_cast<int>(std::clamp(
+                    std::chrono::duration_cast<std::chrono::milliseconds>(next_due - now).count(),
+                    std::chrono::milliseconds::rep{ 1 },
+                    std::chrono::milliseconds::rep{ 100 }));
+            }
+            else if (opts_.rate > 0.0)
+            {
+                wait_msec = 1;
+            }
+
+            curl_multi_wait(multi_, nullptr, 0U, wait_msec, nullptr);
+        }
+
+        finished_at_ = Clock::now();
+    }
+
+    void print_report() const
+    {
+        auto const secs = std::chrono::duration<double>{ finished_at_ - started_at_ }.count();
+
+        fmt::print("{:d} requests in {:.1f} s ({:.1f}/s)\n\n", n_requests(), secs, n_requests() / secs);
+        fmt::print(
+            "{:<8s} {:>8s} {:>7s} {:>10s} {:>10s} {:>10s} {:>10s}\n",
+            "kind",
+            "count",
+            "errors",
+            "p50 ms",
+            "p99 ms",
+            "p999 ms",
+            "max ms");
+
+        auto all = Stats{};
+        for (size_t kind = 0U; kind < std::size(stats_); ++kind)
+        {
+            auto const& stats = stats_[kind];
+            print_row(KindNames[kind], stats);
+            all.latencies.insert(std::end(all.latencies), std::begin(stats.latencies), std::end(stats.latencies));
+            all.n_errors += stats.n_errors;
+        }
+        print_row("all"sv, all);
+    }
+
+    [[nodiscard]] size_t n_requests() const noexcept
+    {
+        auto n = size_t{};
+        for (auto const& stats : stats_)
+        {
+            n += std::size(stats.latencies);
+        }
+        return n;
+    }
+
+private:
+    struct Slot
+    {
+        CURL* easy = nullptr;
+        curl_slist* headers = nullptr;
+        std::string body;
+        std::string response;
+        Kind kind = {};
+        Clock::time_point due_at;
+        bool busy = false;
+        bool is_retry = false;
+    };
+
+    struct Stats
+    {
+        std::vector<double> latencies; // in milliseconds
+        size_t n_errors = 0;
+    };
+
+    static size_t on_write(char* ptr, size_t size, size_t nmemb, void* vslot)
+    {
+        auto* const slot = static_cast<Slot*>(vslot);
+        slot->response.append(ptr, size * nmemb);
+        return size * nmemb;
+    }
+
+    // look for a session id in the header in case the server gives back a 409
+    static size_t on_header(char* ptr, size_t size, size_t nmemb, void* vself)
+    {
+        auto* const self = static_cast<Bench*>(vself);
+        auto const line = std::string_view{ ptr, size * nmemb };
+        auto constexpr Key = TR_RPC_SESSION_ID_HEADER ": "sv;
+
+        if (std::size(line) > std::size(Key) && evutil_ascii_strncasecmp(std::data(line), std::data(Key), std::size(Key)) == 0)
+        {
+            self->session_id_ = tr_strv_strip(line.substr(std::size(Key)));
+        }
+
+        return std::size(line);
+    }
+
+    [[nodiscard]] static long response_code(Slot const& slot)
+    {
+        auto code = long{};
+        curl_easy_getinfo(slot.easy, CURLINFO_RESPONSE_CODE, &code);
+        return code;
+    }
+
+    static void print_row(std::string_view name, Stats const& stats)
+    {
+        if (std::empty(stats.latencies))
+        {
+            return;
+        }
+
+        auto sorted = stats.latencies;
+        std::sort(std::begin(sorted), std::end(sorted));
+        auto const percentile = [&sorted](double p)
+        {
+            return sorted[std::min(std::size(sorted) - 1U, static_cast<size_t>(p * std::size(sorted)))];
+        };
+
+        fmt::print(
+            "{:<8s} {:>8d} {:>7d} {:>10.2f} {:>10.2f} {:>10.2f} {:>10.2f}\n",
+            name,
+            std::size(sorted),
+            stats.n_errors,
+            percentile(0.5),
+            percentile(0.99),
+            percentile(0.999),
+            sorted.back());
+    }
+
+    [[nodiscard]] Kind pick_kind()
+    {
+        auto roll = std::uniform_int_distribution<unsigned>{ 0U, total_weight_ - 1U }(rng_);
+        for (size_t kind = 0U; kind < std::size(opts_.weights); ++kind)
+        {
+            if (roll < opts_.weights[kind])
+            {
+                return static_cast<Kind>(kind);
+            }
+
+            roll -= opts_.weights[kind];
+        }
+
+        return Kind::Stats;
+    }
+
+    [[nodiscard]] int64_t pick_id()
+    {
+        return std::empty(ids_) ? 1 : ids_[std::uniform_int_distribution<size_t>{ 0U, std::size(ids_) - 1U }(rng_)];
+    }
+
+    [[nodiscard]] static std::string fields_json(std::string_view const* begin, std::string_view const* end)
+    {
+        auto json = std::string{};
+        for (auto const* it = begin; it != end; ++it)
+        {
+            json += fmt::format(R"({:s}"{:s}")", std::empty(json) ? "" : ",", *it);
+        }
+        return json;
+    }
+
+    [[nodiscard]] std::string make_body(Kind kind)
+    {
+        switch (kind)
+        {
+        case Kind::List:
+            return fmt::format(
+                R"({{"method":"torrent-get","arguments":{{"fields":[{:s}]}}}})",
+                fields_json(std::data(ListFields), std::data(ListFields) + std::size(ListFields)));
+
+        case Kind::Active:
+            return fmt::format(
+                R"({{"method":"torrent-get","arguments":{{"ids":"recently-active","fields":[{:s}]}}}})",
+                fields_json(std::data(ListFields), std::data(ListFields) + std::size(ListFields)));
+
+        case Kind::Details:
+            {
+                // a details view shows one torrent, or a few that are selected together
+                auto ids = std::string{};
+                for (auto i = std::uniform_int_distribution<int>{ 1, 4 }(rng_); i > 0; --i)
+                {
+                    ids += fmt::format("{:s}{:d}", std::empty(ids) ? "" : ",", pick_id());
+                }
+
+                // and it asks for a varying subset of its fields, depending on the tab that's open
+                auto const n_fields = std::uniform_int_distribution<size_t>{ 4U, std::size(DetailsFields) }(rng_);
+                return fmt::format(
+                    R"({{"method":"torrent-get","arguments":{{"ids":[{:s}],"fields":[{:s}]}}}})",
+                    ids,
+                    fields_json(std::data(DetailsFields), std::data(DetailsFields) + n_fields));
+            }
+
+        case Kind::Set:
+            return fmt::format(
+                R"({{"method":"torrent-set","arguments":{{"ids":[{:d}],"bandwidthPriority":{:d}}}}})",
+                pick_id(),
+                std::uniform_int_distribution<int>{ -1, 1 }(rng_));
+
+        default:
+            return R"({"method":"session-stats"})";
+        }
+    }
+
+    void prepare(Slot& slot)
+    {
+        if (slot.easy == nullptr)
+        {
+            slot.easy = curl_easy_init();
+        }
+
+        auto* const easy = slot.easy;
+        (void)curl_easy_setopt(easy, CURLOPT_URL, opts_.url.c_str());
+        (void)curl_easy_setopt(easy, CURLOPT_USERAGENT, fmt::format("{:s}/{:s}", MyName, LONG_VERSION_STRING).c_str());
+        (void)curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, on_write);
+        (void)curl_easy_setopt(easy, CURLOPT_WRITEDATA, &slot);
+        (void)curl_easy_setopt(easy, CURLOPT_HEADERFUNCTION, on_header);
+        (void)curl_easy_setopt(easy, CURLOPT_HEADERDATA, this);
+        (void)curl_easy_setopt(easy, CURLOPT_POST, 1L);
+        (void)curl_easy_setopt(easy, CURLOPT_POSTFIELDS, slot.body.c_str());
+        (void)curl_easy_setopt(easy, CURLOPT_POSTFIELDSIZE, static_cast<long>(std::size(slot.body)));
+        (void)curl_easy_setopt(easy, CURLOPT_ENCODING, "");
+        (void)curl_easy_setopt(easy, CURLOPT_HTTPAUTH, CURLAUTH_ANY);
+
+        if (!std::empty(opts_.auth))
+        {
+            (void)curl_easy_setopt(easy, CURLOPT_USERPWD, opts_.auth.c_str());
+        }
+
+        curl_slist_free_all(slot.headers);
+        slot.headers = nullptr;
+        if (!std::empty(session_id_))
+        {
+            slot.headers = curl_slist_append(nullptr, fmt::format("{:s}: {:s}", TR_RPC_SESSION_ID_HEADER, session_id_).c_str());
+        }
+        (void)curl_easy_setopt(easy, CURLOPT_HTTPHEADER, slot.headers);
+
+        slot.response.clear();
+    }
+
+    void start(Slot& slot, Kind kind, Clock::time_point due_at)
+    {
+        slot.kind = kind;
+        slot.due_at = due_at;
+        slot.body = make_body(kind);
+        slot.is_retry = false;
+        send(slot);
+    }
+
+    void send(Slot& slot)
+    {
+        prepare(slot);
+        curl_multi_add_handle(multi_, slot.easy);
+        slot.busy = true;
+    }
+
+    [[nodiscard]] Slot* find_slot(CURL const* easy)
+    {
+        return &*std::find_if(std::begin(slots_), std::end(slots_), [easy](auto const& slot) { return slot.easy == easy; });
+    }
+
+    void on_done(Slot& slot, CURLcode result)
+    {
+        curl_multi_remove_handle(multi_, slot.easy);
+        slot.busy = false;
+
+        auto const code = response_code(slot);
+
+        // the first request of a connection may need the session id,
+        // which on_header() has picked up by now, so send it again
+        if (result == CURLE_OK && code == 409 && !slot.is_retry)
+        {
+            slot.is_retry = true;
+            send(slot);
+            return;
+        }
+
+        auto& stats = stats_[static_cast<size_t>(slot.kind)];
+        stats.latencies.push_back(std::chrono::duration<double, std::milli>{ Clock::now() - slot.due_at }.count());
+        if (result != CURLE_OK || code != 200 || slot.response.find(R"("result":"success")"sv) == std::string::npos)
+        {
+            ++stats.n_errors;
+        }
+    }
+
+    app_options const& opts_;
+    std::mt19937 rng_;
+    CURLM* const multi_;
+    unsigned total_weight_ = 0U;
+
+    std::string session_id_;
+    std::vector<int64_t> ids_;
+
+    // a vector that's only resized before any requests are in flight,
+    // so that the curl handles' pointers to the slots stay valid
+    std::vector<Slot> slots_;
+
+    std::array<Stats, static_cast<size_t>(Kind::N_Kinds)> stats_;
+    Clock::time_point started_at_;
+    Clock::time_point finished_at_;
+};
+
+} // namespace
+
+int tr_main(int argc, char* argv[])
+{
+    tr_logSetLevel(TR_LOG_ERROR);
+
+    auto opts = app_options{};
+    if (parse_command_line(opts, argc, (char const* const*)argv) != 0)
+    {
+        tr_getopt_usage(MyName, Usage, std::data(Options));
+        return EXIT_FAILURE;
+    }
+
+    if (opts.show_version)
+    {
+        fmt::print(stderr, "{:s} {:s}\n", MyName, LONG_VERSION_STRING);
+        return EXIT_SUCCESS;
+    }
+
+    curl_global_init(CURL_GLOBAL_ALL);
+
+    auto synthetic = std::optional<SyntheticSession>{};
+    if (opts.n_synthetic > 0U)
+    {
+        fmt::print(stderr, "adding {:d} synthetic torrents...\n", opts.n_synthetic);
+        synthetic.emplace(opts);
+        opts.url = fmt::format("http://127.0.0.1:{:d}{:s}rpc", opts.port, TR_DEFAULT_RPC_URL_STR);
+    }
+
+    auto bench = Bench{ opts };
+    if (!bench.fetch_ids())
+    {
+        return EXIT_FAILURE;
+    }
+
+    fmt::print(
+        "{:s}: {:d} torrents; {:s}; at most {:d} in flight for {:d} s\n",
+        opts.url,
+        bench.n_torrents(),
+        opts.rate > 0.0 ? fmt::format("{:.0f} requests/s", opts.rate) : "back-to-back"s,
+        opts.concurrency,
+        opts.duration.count());
+
+    auto const session_cpu_at_start = synthetic ? synthetic->session_thread_cpu_time() : std::chrono::nanoseconds{};
+    auto const process_cpu_at_start = opts.pid != 0 ? process_cpu_time(opts.pid) : std::nullopt;
+
+    bench.run();
+
+    auto cpu = std::optional<std::chrono::nanoseconds>{};
+    auto cpu_label = "session thread"sv;
+    if (synthetic)
+    {
+        cpu = synthetic->session_thread_cpu_time() - session_cpu_at_start;
+    }
+    else if (auto const process_cpu = opts.pid != 0 ? process_cpu_time(opts.pid) : std::nullopt;
+             process_cpu && process_cpu_at_start)
+    {
+        cpu = *process_cpu - *process_cpu_at_start;
+        cpu_label = "server process"sv;
+    }
+
+    bench.print_report();
+
+    if (cpu)
+    {
+        auto const cpu_ms = std::chrono::duration<double, std::milli>{ *cpu }.count();
+        auto const n_requests = std::max(bench.n_requests(), size_t{ 1U });
+        fmt::print("\n{:s} CPU: {:.0f} ms ({:.3f} ms per request)\n", cpu_label, cpu_ms, cpu_ms / n_requests);
+    }
+
+    synthetic.reset();
+    curl_global_cleanup();
+    return EXIT_SUCCESS;
+}
@@ -5,6 +5,7 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <condition_variable>
 #include <cstdint> // int64_t
 #include <cstdio>
@@ -16,6 +17,7 @@
 #include <optional>
 #include <string>
 #include <string_view>
+#include <thread>
 #include <vector>
 
 #include <fmt/chrono.h>
@@ -24,6 +26,7 @@
 #include <libtransmission/transmission.h>
 
 #include <libtransmission/error.h>
+#include <libtransmission/file.h>
 #include <libtransmission/log.h>
 #include <libtransmission/quark.h>
 #include <libtransmission/torrent-metainfo.h>
@@ -45,9 +48,12 @@ namespace
 auto constexpr TimeoutSecs = std::chrono::seconds{ 30 };
 
 char constexpr MyName[] = "transmission-show";
-char constexpr Usage[] = "Usage: transmission-show [options] <torrent-file>";
+char constexpr Usage[] = "Usage: transmission-show [options] <torrent-file>\n"
+                         "       transmission-show --json [options] <torrent-file or directory>...";
 
-auto options = std::array<tr_option, 14>{
+auto constexpr DefaultJsonFields = std::string_view{ "name,hashString,totalSize,fileCount,torrentFile" };
+
+auto options = std::array<tr_option, 17>{
     { { 'd', "header", "Show only header section", "d", false, nullptr },
       { 'i', "info", "Show only info section", "i", false, nullptr },
       { 't', "trackers", "Show only trackers section", "t", false, nullptr },
@@ -61,12 +67,24 @@ auto options = std::array<tr_option, 14>{
       { 's', "scrape", "Ask the torrent's trackers how many peers are in the torrent's swarm", "s", false, nullptr },
       { 'u', "unsorted", "Do not sort files by name", "u", false, nullptr },
       { 'V', "version", "Show version number and exit", "V", false, nullptr },
+      { 'j', "json", "Print one line of JSON for each torrent in the given files and directories", "j", false, nullptr },
+      { 'k',
+        "fields",
+        "Comma-separated fields for --json. Default: name,hashString,totalSize,fileCount,torrentFile. Also: pieceCount, "
+        "pieceSize, isPrivate, creator, dateCreated, comment, source, trackers, webseeds, magnetLink, files",
+        "k",
+        true,
+        "<list>" },
+      { 'w', "workers", "Number of threads for --json. Default: one per CPU", "w", true, "<n>" },
       { 0, nullptr, nullptr, nullptr, false, nullptr } }
 };
 
 struct app_opts
 {
-    std::string_view filename;
+    std::vector<std::string_view> filenames;
+    std::string_view json_fields = DefaultJsonFields;
+    size_t n_workers = 0U;
+    bool json = false;
     bool scrape = false;
     bool show_magnet = false;
     bool show_version = false;
@@ -151,8 +169,28 @@ int parseCommandLine(app_opts& opts, int argc, char const* const* argv)
             opts.show_version = true;
             break;
 
+        case 'j':
+            opts.json = true;
+            break;
+
+        case 'k':
+            opts.json_fields = optarg;
+            break;
+
+        case 'w':
+            if (auto const n = tr_num_parse<size_t>(optarg); n)
+            {
+                opts.n_workers = *n;
+            }
+            else
+            {
+                fmt::print(stderr, "ERROR: Invalid number of workers '{:s}'\n", optarg);
+                return 1;
+            }
+            break;
+
         case TR_OPT_UNK:
-            opts.filename = optarg;
+            opts.filenames.emplace_back(optarg);
             break;
 
         default:
@@ -400,6 +438,296 @@ void doScrape(tr_torrent_metainfo const& metainfo)
     }
 }
 
+// --- --json
+
+enum class JsonField
+{
+    Name,
+    HashString,
+    TotalSize,
+    FileCount,
+    TorrentFile,
+    PieceCount,
+    PieceSize,
+    IsPrivate,
+    Creator,
+    DateCreated,
+    Comment,
+    Source,
+    Trackers,
+    Webseeds,
+    MagnetLink,
+    Files
+};
+
+auto constexpr JsonFieldNames = std::array<std::pair<std::string_view, JsonField>, 16U>{ {
+    { "name"sv, JsonField::Name },
+    { "hashString"sv, JsonField::HashString },
+    { "totalSize"sv, JsonField::TotalSize },
+    { "fileCount"sv, JsonField::FileCount },
+    { "torrentFile"sv, JsonField::TorrentFile },
+    { "pieceCount"sv, JsonField::PieceCount },
+    { "pieceSize"sv, JsonField::PieceSize },
+    { "isPrivate"sv, JsonField::IsPrivate },
+    { "creator"sv, JsonField::Creator },
+    { "dateCreated"sv, JsonField::DateCreated },
+    { "comment"sv, JsonField::Comment },
+    { "source"sv, JsonField::Source },
+    { "trackers"sv, JsonField::Trackers },
+    { "webseeds"sv, JsonField::Webseeds },
+    { "magnetLink"sv, JsonField::MagnetLink },
+    { "files"sv, JsonField::Files },
+} };
+
+struct JsonKey
+{
+    JsonField field;
+    tr_quark key;
+};
+
+// @return the fields in `list`, or nullopt if one of them is unknown
+[[nodiscard]] std::optional<std::vector<JsonKey>> parseJsonFields(std::string_view list)
+{
+    auto keys = std::vector<JsonKey>{};
+
+    auto name = std::string_view{};
+    while (tr_strv_sep(&list, &name, ','))
+    {
+        auto const iter = std::find_if(
+            std::begin(JsonFieldNames),
+            std::end(JsonFieldNames),
+            [name](auto const& item) { return item.first == name; });
+        if (iter == std::end(JsonFieldNames))
+        {
+            fmt::print(stderr, "ERROR: Unknown field '{:s}'\n", name);
+            return {};
+        }
+
+        keys.push_back({ iter->second, tr_quark_new(name) });
+    }
+
+    return keys;
+}
+
+void addJsonField(tr_variant* dict, JsonKey const& key, std::string_view filename, tr_torrent_metainfo const& metainfo)
+{
+    switch (key.field)
+    {
+    case JsonField::Name:
+        tr_variantDictAddStrView(dict, key.key, metainfo.name());
+        break;
+
+    case JsonField::HashString:
+        tr_variantDictAddStrView(dict, key.key, metainfo.info_hash_string());
+        break;
+
+    case JsonField::TotalSize:
+        tr_variantDictAddInt(dict, key.key, metainfo.total_size());
+        break;
+
+    case JsonField::FileCount:
+        tr_variantDictAddInt(dict, key.key, metainfo.file_count());
+        break;
+
+    case JsonField::TorrentFile:
+        tr_variantDictAddStrView(dict, key.key, filename);
+        break;
+
+    case JsonField::PieceCount:
+        tr_variantDictAddInt(dict, key.key, metainfo.piece_count());
+        break;
+
+    case JsonField::PieceSize:
+        tr_variantDictAddInt(dict, key.key, metainfo.piece_size());
+        break;
+
+    case JsonField::IsPrivate:
+        tr_variantDictAddBool(dict, key.key, metainfo.is_private());
+        break;
+
+    case JsonField::Creator:
+        tr_variantDictAddStrView(dict, key.key, metainfo.creator());
+        break;
+
+    case JsonField::DateCreated:
+        tr_variantDictAddInt(dict, key.key, metainfo.date_created());
+        break;
+
+    case JsonField::Comment:
+        tr_variantDictAddStrView(dict, key.key, metainfo.comment());
+        break;
+
+    case JsonField::Source:
+        tr_variantDictAddStrView(dict, key.key, metainfo.source());
+        break;
+
+    case JsonField::Trackers:
+        {
+            auto const& announce_list = metainfo.announce_list();
+            auto* const list = tr_variantDictAddList(dict, key.key, std::size(announce_list));
+            for (auto const& tracker : announce_list)
+            {
+                tr_variantListAddStrView(list, tracker.announce.sv());
+            }
+        }
+        break;
+
+    case JsonField::Webseeds:
+        {
+            auto const n = metainfo.webseed_count();
+            auto* const list = tr_variantDictAddList(dict, key.key, n);
+            for (size_t i = 0; i < n; ++i)
+            {
+                tr_variantListAddStrView(list, metainfo.webseed(i));
+            }
+        }
+        break;
+
+    case JsonField::MagnetLink:
+        tr_variantDictAddStr(dict, key.key, metainfo.magnet().sv());
+        break;
+
+    case JsonField::Files:
+        {
+            auto const n = metainfo.file_count();
+            auto* const list = tr_variantDictAddList(dict, key.key, n);
+            for (tr_file_index_t i = 0; i < n; ++i)
+            {
+                auto* const file = tr_variantListAddDict(list, 2U);
+                tr_variantDictAddStrView(file, TR_KEY_name, metainfo.file_subpath(i));
+                tr_variantDictAddInt(file, TR_KEY_length, metainfo.file_size(i));
+            }
+        }
+        break;
+    }
+}
+
+// Add the .torrent files in `path` to `setme`, recursing into directories
+void collectTorrentFiles(std::string_view path, std::vector<std::string>& setme)
+{
+    auto const info = tr_sys_path_get_info(path);
+    if (!info || !info->isFolder())
+    {
+        setme.emplace_back(path);
+        return;
+    }
+
+    auto const odir = tr_sys_dir_open(path);
+    if (odir == TR_BAD_SYS_DIR)
+    {
+        return;
+    }
+
+    for (char const* name; (name = tr_sys_dir_read_name(odir)) != nullptr;)
+    {
+        auto const sv = std::string_view{ name };
+        if (sv == "."sv || sv == ".."sv)
+        {
+            continue;
+        }
+
+        auto const child = tr_pathbuf{ path, '/', sv };
+        if (auto const child_info = tr_sys_path_get_info(child); child_info && child_info->isFolder())
+        {
+            collectTorrentFiles(child, setme);
+        }
+        else if (tr_strv_ends_with(sv, ".torrent"sv))
+        {
+            setme.emplace_back(child.sv());
+        }
+    }
+
+    tr_sys_dir_close(odir);
+}
+
+// Parse the torrents on several threads and print one line of JSON for each.
+// Lines are printed in the order they're finished, not the order given.
+// @return the number of files that couldn't be parsed
+size_t showJson(app_opts const& opts, std::vector<JsonKey> const& keys)
+{
+    // how much output each worker buffers between writes to stdout
+    static auto constexpr OutputBatchSize = size_t{ 64U * 1024U };
+
+    auto filenames = std::vector<std::string>{};
+    for (auto const& path : opts.filenames)
+    {
+        collectTorrentFiles(path, filenames);
+    }
+
+    auto next = std::atomic<size_t>{};
+    auto n_failed = std::atomic<size_t>{};
+    auto output_mutex = std::mutex{};
+
+    auto const work = [&]()
+    {
+        auto out = std::string{};
+        auto errors = std::string{};
+        auto const write = [&]()
+        {
+            auto const lock = std::lock_guard{ output_mutex };
+            fwrite(std::data(out), 1U, std::size(out), stdout);
+            fwrite(std::data(errors), 1U, std::size(errors), stderr);
+            out.clear();
+            errors.clear();
+        };
+
+        for (auto idx = next++; idx < std::size(filenames); idx = next++)
+        {
+            auto const& filename = filenames[idx];
+
+            // the piece hashes are checked, but not copied
+            auto metainfo = tr_torrent_metainfo{};
+            tr_error* error = nullptr;
+            if (!metainfo.parse_mapped_torrent_file(filename, false, &error))
+            {
+                ++n_failed;
+                errors += fmt::format(
+                    "Error parsing torrent file '{:s}': {:s} ({:d})\n",
+                    filename,
+                    error != nullptr ? error->message : "",
+                    error != nullptr ? error->code : 0);
+                tr_error_clear(&error);
+                continue;
+            }
+
+            auto arena = tr_variant_arena{};
+            auto top = tr_variant{};
+            tr_variantInitDict(&top, std::size(keys), &arena);
+            for (auto const& key : keys)
+            {
+                addJsonField(&top, key, filename, metainfo);
+            }
+            out += tr_variantToStr(&top, TR_VARIANT_FMT_JSON_LEAN);
+            tr_variantClear(&top);
+
+            if (std::size(out) >= OutputBatchSize)
+            {
+                write();
+            }
+        }
+
+        write();
+    };
+
+    auto n_workers = opts.n_workers != 0U ? opts.n_workers : std::max(std::thread::hardware_concurrency(), 1U);
+    n_workers = std::min(n_workers, std::max(std::size(filenames), size_t{ 1U }));
+
+    auto threads = std::vector<std::thread>{};
+    threads.reserve(n_workers - 1U);
+    for (size_t i = 1U; i < n_workers; ++i)
+    {
+        threads.emplace_back(work);
+    }
+    work();
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    fflush(stdout);
+    return n_failed;
+}
+
 } // namespace
 
 int tr_main(int argc, char* argv[])
@@ -427,7 +755,7 @@ int tr_main(int argc, char* argv[])
     }
 
     /* make sure the user specified a filename */
-    if (std::empty(opts.filename))
+    if (std::empty(opts.filenames))
     {
         fmt::print(stderr, "ERROR: No torrent file specified.\n");
         tr_getopt_usage(MyName, Usage, std::data(options));
@@ -435,13 +763,31 @@ int tr_main(int argc, char* argv[])
         return EXIT_FAILURE;
     }
 
+    if (opts.json)
+    {
+        auto const keys = parseJsonFields(opts.json_fields);
+        if (!keys)
+        {
+            return EXIT_FAILURE;
+        }
+
+        return showJson(opts, *keys) == 0U ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (std::size(opts.filenames) > 1U)
+    {
+        fmt::print(stderr, "ERROR: Use --json to show more than one torrent.\n");
+        return EXIT_FAILURE;
+    }
+
     /* try to parse the torrent file */
+    auto const filename = opts.filenames.front();
     auto metainfo = tr_torrent_metainfo{};
     tr_error* error = nullptr;
-    auto const parsed = metainfo.parse_torrent_file(opts.filename, nullptr, &error);
+    auto const parsed = metainfo.parse_mapped_torrent_file(filename, false, &error);
     if (error != nullptr)
     {
-        fmt::print(stderr, "Error parsing torrent file '{:s}': {:s} ({:d})\n", opts.filename, error->message, error->code);
+        fmt::print(stderr, "Error parsing torrent file '{:s}': {:s} ({:d})\n", filename, error->message, error->code);
         tr_error_clear(&error);
     }
     if (!parsed)
@@ -458,7 +804,7 @@ int tr_main(int argc, char* argv[])
         if (opts.print_header)
         {
             fmt::print("Name: {:s}\n", metainfo.name());
-            fmt::print("File: {:s}\n", opts.filename);
+            fmt::print("File: {:s}\n", filename);
             fmt::print("\n");
             fflush(stdout);
         }